@@ -43,6 +43,10 @@ int ai_btree_put(as_sindex_metadata *imd, as_sindex_pmetadata *pimd, void *key,
 
 int ai_btree_delete(as_sindex_metadata *imd, as_sindex_pmetadata *pimd, void *key, cf_digest *val);
 
+typedef bool (*ai_btree_reduce_fn)(void *skey, const cf_digest *digs, uint32_t n_digs, void *udata);
+
+bool ai_btree_reduce(as_sindex_metadata *imd, as_sindex_pmetadata *pimd, ai_btree_reduce_fn cb, void *udata);
+
 int ai_btree_query(as_sindex_metadata *imd, as_sindex_range *range, as_sindex_qctx *qctx);
 
 int ai_btree_describe(as_sindex_metadata *imd);
@@ -0,0 +1,71 @@
+/*
+ * ai_plist.h
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/*
+ * Compressed posting list - the digests under one secondary index key, sorted
+ * and packed into blocks with the shared prefix of each digest and its
+ * predecessor truncated. Sits between the small ai_arr and the per-key nbtr,
+ * without the nbtr's node slack.
+ *
+ * Iteration order is that of a U160 nbtr (u160Cmp), so a query batch can
+ * resume across the list being converted to an nbtr.
+ *
+ * Not thread safe - callers hold the pimd lock, as for ai_arr and nbtr.
+ * Iterators are invalidated by any insert or delete.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <citrusleaf/cf_digest.h>
+
+
+#define AI_PLIST_BLOCK_MAX_DIGS 64
+
+typedef struct ai_plist_s ai_plist;
+
+typedef struct ai_plist_iter_s {
+	const ai_plist *pl;
+	uint32_t        block_ix;
+	uint32_t        n_keys;
+	uint32_t        key_ix;
+	uint8_t         keys[AI_PLIST_BLOCK_MAX_DIGS][CF_DIGEST_KEY_SZ];
+} ai_plist_iter;
+
+ai_plist *ai_plist_create(void);
+void ai_plist_destroy(ai_plist *pl);
+
+size_t ai_plist_size(const ai_plist *pl);
+uint32_t ai_plist_count(const ai_plist *pl);
+
+// Returns false only on allocation failure.
+bool ai_plist_insert(ai_plist *pl, const cf_digest *dig, bool *found);
+void ai_plist_delete(ai_plist *pl, const cf_digest *dig, bool *notfound);
+
+// Start at the first digest not before from - at the beginning if from is
+// NULL - or at the x'th digest.
+void ai_plist_iter_init(ai_plist_iter *iter, const ai_plist *pl, const cf_digest *from);
+void ai_plist_iter_init_xth(ai_plist_iter *iter, const ai_plist *pl, uint32_t x);
+bool ai_plist_iter_next(ai_plist_iter *iter, cf_digest *dig);
@@ -97,10 +97,12 @@ typedef struct {
 //  pretty hacky stuff.  Inside Aerospike Index code is_btree is checked
 typedef struct {
 	union {
-		ai_arr *arr;
-		bt      *nbtr;
+		ai_arr            *arr;
+		bt                *nbtr;
+		struct ai_plist_s *plist;
 	} u;
 	bool     is_btree;
+	bool     is_plist; // mid-sized lists - see ai_plist.h
 } __attribute__ ((__packed__)) ai_nbtr;
 
 //NOTE: For Aerospike, not currently using EVICT, save one byte in bt_n
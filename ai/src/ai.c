@@ -37,6 +37,7 @@
 #include "ai.h"
 #include "ai_btree.h"
 #include "ai_globals.h"
+#include "ai_plist.h"
 #include "bt.h"
 #include "find.h"
 #include "stream.h"
@@ -220,6 +221,8 @@ static void destroy_index(bt *ibtr, bt_n *n, int imatch)
 		if (anbtr) {
 			if (anbtr->is_btree) {
 				bt_destroy(anbtr->u.nbtr);
+			} else if (anbtr->is_plist) {
+				ai_plist_destroy(anbtr->u.plist);
 			} else {
 				ai_arr_destroy(anbtr->u.arr);
 			}
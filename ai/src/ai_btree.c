@@ -31,6 +31,7 @@
 #include "ai_globals.h"
 #include "ai_obj.h"
 #include "ai_btree.h"
+#include "ai_plist.h"
 #include "bt_iterator.h"
 #include "bt_output.h"
 #include "find.h"
@@ -48,6 +49,7 @@
 #define DIG_ARRAY_QUEUE_HIGHWATER 512
 
 #define AI_ARR_MAX_USED 32
+#define AI_PLIST_MAX_USED (256 * 1024)
 
 /*
  *  Default file to use for printing a B-Tree by the "sindex-dump:" Info. command.
@@ -103,12 +105,28 @@ ai_arr_new()
 	return arr;
 }
 
-static void
-ai_arr_move_to_tree(ai_arr *arr, bt *nbtr)
+static bool
+ai_arr_move_to_plist(ai_arr *arr, ai_plist *plist)
 {
 	for (int i = 0; i < arr->used; i++) {
+		bool found = false;
+		if (!ai_plist_insert(plist, (cf_digest *)&arr->data[i * CF_DIGEST_KEY_SZ], &found)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void
+ai_plist_move_to_tree(ai_plist *plist, bt *nbtr)
+{
+	ai_plist_iter iter;
+	cf_digest dig;
+
+	ai_plist_iter_init(&iter, plist, NULL);
+	while (ai_plist_iter_next(&iter, &dig)) {
 		ai_obj apk;
-		init_ai_objFromDigest(&apk, (cf_digest *)&arr->data[i * CF_DIGEST_KEY_SZ]);
+		init_ai_objFromDigest(&apk, &dig);
 		if (!btIndNodeAdd(nbtr, &apk)) {
 			// what to do ??
 			continue;
@@ -240,6 +258,9 @@ ai_arr_insert(ai_arr *arr, cf_digest *dig, bool *found)
 }
 
 /*
+ * Moves a list on to the next representation if it has outgrown its own - arr
+ * to plist at AI_ARR_MAX_USED, plist to nbtr at AI_PLIST_MAX_USED.
+ *
  * Returns the size diff
  */
 static int
@@ -249,27 +270,57 @@ anbtr_check_convert(ai_nbtr *anbtr, uchar pktyp)
 	if (anbtr->is_btree)
 		return 0;
 
-	ai_arr *arr = anbtr->u.arr;
-	if (arr && (arr->used >= AI_ARR_MAX_USED)) {
-		//cf_info(AS_SINDEX,"Flipped @ %d", arr->used);
-		ulong ba = ai_arr_size(arr);
-		// Allocate btree move digest from arr to btree
+	if (anbtr->is_plist) {
+		ai_plist *plist = anbtr->u.plist;
+		if (ai_plist_count(plist) < AI_PLIST_MAX_USED) {
+			return 0;
+		}
+
+		ulong ba = ai_plist_size(plist);
+		// Allocate btree move digest from plist to btree
 		bt *nbtr = createIndexNode(pktyp, COL_TYPE_NONE);
 		if (!nbtr) {
 			cf_warning(AS_SINDEX, "btree allocation failure");
 			return 0;
 		}
 
-		ai_arr_move_to_tree(arr, nbtr);
-		ai_arr_destroy(anbtr->u.arr);
+		ai_plist_move_to_tree(plist, nbtr);
+		ai_plist_destroy(plist);
 
 		// Update anbtr
 		anbtr->u.nbtr = nbtr;
+		anbtr->is_plist = false;
 		anbtr->is_btree = true;
 
 		ulong aa = nbtr->msize;
 		return (aa - ba);
 	}
+
+	ai_arr *arr = anbtr->u.arr;
+	if (arr && (arr->used >= AI_ARR_MAX_USED)) {
+		//cf_info(AS_SINDEX,"Flipped @ %d", arr->used);
+		ulong ba = ai_arr_size(arr);
+		// Allocate plist move digest from arr to plist
+		ai_plist *plist = ai_plist_create();
+		if (!plist) {
+			cf_warning(AS_SINDEX, "plist allocation failure");
+			return 0;
+		}
+
+		if (!ai_arr_move_to_plist(arr, plist)) {
+			cf_warning(AS_SINDEX, "plist allocation failure");
+			ai_plist_destroy(plist);
+			return 0;
+		}
+		ai_arr_destroy(anbtr->u.arr);
+
+		// Update anbtr
+		anbtr->u.plist = plist;
+		anbtr->is_plist = true;
+
+		ulong aa = ai_plist_size(plist);
+		return (aa - ba);
+	}
 	return 0;
 }
 
@@ -327,8 +378,9 @@ anbtr_check_init(ai_nbtr *anbtr, uchar pktyp)
 /*
  * Insert operation for the nbtr does the following
  * 1. Sets up anbtr if it is set up
- * 2. Inserts in the arr or nbtr depending number of elements.
- * 3. Cuts over from arr to btr at AI_ARR_MAX_USED
+ * 2. Inserts in the arr, plist or nbtr depending number of elements.
+ * 3. Cuts over from arr to plist at AI_ARR_MAX_USED, and from plist to nbtr
+ *    at AI_PLIST_MAX_USED
  *
  * Parameter:   ibtr  : Btree of key
  *              acol  : Secondary index key
@@ -389,6 +441,17 @@ reduced_iAdd(bt *ibtr, ai_obj *acol, ai_obj *apk, uchar pktyp)
 		}
 		aa += nbtr->msize;
 
+	} else if (anbtr->is_plist) {
+		ai_plist *plist = anbtr->u.plist;
+
+		ba += ai_plist_size(plist);
+		bool found = false;
+		if (!ai_plist_insert(plist, (cf_digest *)&apk->y, &found)) {
+			return AS_SINDEX_ERR;
+		} else if (found) {
+			return AS_SINDEX_KEY_FOUND;
+		}
+		aa += ai_plist_size(plist);
 	} else {
 		ai_arr *arr = anbtr->u.arr;
 		if (!arr) {
@@ -412,8 +475,8 @@ reduced_iAdd(bt *ibtr, ai_obj *acol, ai_obj *apk, uchar pktyp)
 }
 
 /*
- * Delete operation for the nbtr does the following. Delete in the arr or nbtr
- * based on state of anbtr
+ * Delete operation for the nbtr does the following. Delete in the arr, plist or
+ * nbtr based on state of anbtr
  *
  * Parameter:   ibtr  : Btree of key
  *              acol  : Secondary index key
@@ -452,6 +515,24 @@ reduced_iRem(bt *ibtr, ai_obj *acol, ai_obj *apk)
 			ba += sizeof(ai_nbtr);
 			cf_free(anbtr);
 		}
+	} else if (anbtr->is_plist) {
+		ai_plist *plist = anbtr->u.plist;
+
+		// Remove from plist if found
+		bool notfound = false;
+		ba = ai_plist_size(plist);
+		ai_plist_delete(plist, (cf_digest *)&apk->y, &notfound);
+		if (notfound) return AS_SINDEX_KEY_NOTFOUND;
+		aa = ai_plist_size(plist);
+
+		// Remove from ibtr
+		if (ai_plist_count(plist) == 0) {
+			btIndDelete(ibtr, acol);
+			aa = 0;
+			ai_plist_destroy(plist);
+			ba += sizeof(ai_nbtr);
+			cf_free(anbtr);
+		}
 	} else {
 		if (!anbtr->u.arr) return AS_SINDEX_ERR;
 
@@ -640,14 +721,14 @@ END:
  *        -1 in case of failure
  */
 static int
-btree_addsinglerec(as_sindex_metadata *imd, ai_obj * key, cf_digest *dig, cf_ll *recl, uint64_t *n_bdigs, 
-								bool * can_partition_query, bool partitions_pre_reserved)
+btree_addsinglerec(as_sindex_metadata *imd, ai_obj * key, cf_digest *dig, as_sindex_qctx *qctx)
 {
 	// The digests which belongs to one of the query-able partitions are elligible to go into recl
 	as_partition_id pid =  as_partition_getid(*dig);
 	as_namespace * ns = imd->si->ns;
-	if (partitions_pre_reserved) {
-		if (!can_partition_query[pid]) {
+	cf_ll *recl = qctx->recl;
+	if (qctx->partitions_pre_reserved) {
+		if (!qctx->can_partition_query[pid]) {
 			return 0;
 		}
 	}
@@ -688,7 +769,12 @@ btree_addsinglerec(as_sindex_metadata *imd, ai_obj * key, cf_digest *dig, cf_ll
 	}
 
 	keys_arr->num++;
-	*n_bdigs = *n_bdigs + 1;
+	qctx->n_bdigs++;
+
+	// Hand off full arrays as we go, rather than holding the whole batch
+	if (keys_arr->num == AS_INDEX_KEYS_PER_ARR && qctx->stream_fn) {
+		qctx->stream_fn(qctx->stream_udata);
+	}
 	return 0;
 }
 
@@ -721,8 +807,7 @@ add_recs_from_nbtr(as_sindex_metadata *imd, ai_obj *ikey, bt *nbtr, as_sindex_qc
 			if (!fullrng && ai_objEQ(&sfk, akey)) {
 				continue;
 			}
-			if (btree_addsinglerec(imd, ikey, (cf_digest *)&akey->y, qctx->recl, &qctx->n_bdigs,
-									qctx->can_partition_query, qctx->partitions_pre_reserved)) {
+			if (btree_addsinglerec(imd, ikey, (cf_digest *)&akey->y, qctx)) {
 				ret = -1;
 				break;
 			}
@@ -741,14 +826,48 @@ add_recs_from_nbtr(as_sindex_metadata *imd, ai_obj *ikey, bt *nbtr, as_sindex_qc
 	return ret;
 }
 
+/*
+ * Return 0 in case of success
+ *       -1 in case of failure
+ */
+static int
+add_recs_from_plist(as_sindex_metadata *imd, ai_obj *ikey, ai_plist *plist, as_sindex_qctx *qctx, bool fullrng)
+{
+	int ret = 0;
+	ai_plist_iter iter;
+	cf_digest dig;
+
+	// Unlike arr, plist is in nbtr order, so can stop at the batch limit
+	// and resume from the LAST batches end-point
+	ai_plist_iter_init(&iter, plist, fullrng ? NULL : &qctx->bdig);
+
+	while (ai_plist_iter_next(&iter, &dig)) {
+		// FIRST can be REPEAT (last batch)
+		if (!fullrng && memcmp(&dig, &qctx->bdig, CF_DIGEST_KEY_SZ) == 0) {
+			continue;
+		}
+		if (btree_addsinglerec(imd, ikey, &dig, qctx)) {
+			ret = -1;
+			break;
+		}
+		if (qctx->n_bdigs == qctx->bsize) {
+			if (ikey) {
+				ai_objClone(qctx->bkey, ikey);
+			}
+			memcpy(&qctx->bdig, &dig, CF_DIGEST_KEY_SZ);
+			break;
+		}
+	}
+	return ret;
+}
+
 static int
 add_recs_from_arr(as_sindex_metadata *imd, ai_obj *ikey, ai_arr *arr, as_sindex_qctx *qctx)
 {
 	bool ret = 0;
 
 	for (int i = 0; i < arr->used; i++) {
-		if (btree_addsinglerec(imd, ikey, (cf_digest *)&arr->data[i * CF_DIGEST_KEY_SZ], qctx->recl, 
-					&qctx->n_bdigs, qctx->can_partition_query, qctx->partitions_pre_reserved)) {
+		if (btree_addsinglerec(imd, ikey, (cf_digest *)&arr->data[i * CF_DIGEST_KEY_SZ], qctx)) {
 			ret = -1;
 			break;
 		}
@@ -784,6 +903,14 @@ get_recl(as_sindex_metadata *imd, ai_obj *afk, as_sindex_qctx *qctx)
 		if (add_recs_from_nbtr(imd, afk, anbtr->u.nbtr, qctx, qctx->new_ibtr)) {
 			return -1;
 		}
+	} else if (anbtr->is_plist) {
+		// If the entire batch was returned while it was still an arr
+		if (qctx->nbtr_done) {
+			return 0;
+		}
+		if (add_recs_from_plist(imd, afk, anbtr->u.plist, qctx, qctx->new_ibtr)) {
+			return -1;
+		}
 	} else {
 		// If already entire batch is returned
 		if (qctx->nbtr_done) {
@@ -801,20 +928,22 @@ get_recl(as_sindex_metadata *imd, ai_obj *afk, as_sindex_qctx *qctx)
  *        -1 in case of failure
  */
 static int
-get_numeric_range_recl(as_sindex_metadata *imd, uint64_t begk, uint64_t endk, as_sindex_qctx *qctx)
+get_range_recl(as_sindex_metadata *imd, ai_obj *begk, ai_obj *endk, as_sindex_qctx *qctx)
 {
 	ai_obj sfk;
-	init_ai_objLong(&sfk, qctx->new_ibtr ? begk : qctx->bkey->l);
-	ai_obj efk;
-	init_ai_objLong(&efk, endk);
+	ai_objClone(&sfk, qctx->new_ibtr ? begk : qctx->bkey);
 	as_sindex_pmetadata *pimd = &imd->pimd[qctx->pimd_idx];
 	bool fullrng              = qctx->new_ibtr;
 	int ret                   = 0;
-	btSIter *bi               = btGetRangeIter(pimd->ibtr, &sfk, &efk, 1);
+	// Limited walks are never resumed, so may start from either end
+	bool asc                  = !(qctx->limit && qctx->desc);
+	btSIter *bi               = asc ?
+			btGetRangeIter(pimd->ibtr, &sfk, endk, 1) :
+			btGetRangeIter(pimd->ibtr, begk, endk, 0);
 	btEntry *be;
 
 	if (bi) {
-		while ((be = btRangeNext(bi, 1))) {
+		while ((be = btRangeNext(bi, asc))) {
 			ai_obj  *ikey  = be->key;
 			ai_nbtr *anbtr = be->val;
 
@@ -844,6 +973,11 @@ get_numeric_range_recl(as_sindex_metadata *imd, uint64_t begk, uint64_t endk, as
 					ret = -1;
 					break;
 				}
+			} else if (anbtr->is_plist) {
+				if (add_recs_from_plist(imd, ikey, anbtr->u.plist, qctx, fullrng)) {
+					ret = -1;
+					break;
+				}
 			} else {
 				if (add_recs_from_arr(imd, ikey, anbtr->u.arr, qctx)) {
 					ret = -1;
@@ -883,7 +1017,17 @@ ai_btree_query(as_sindex_metadata *imd, as_sindex_range *srange, as_sindex_qctx
 		}
 		err = get_recl(imd, &afk, qctx);
 	} else {                // RANGE LOOKUP
-		err = get_numeric_range_recl(imd, srange->start.u.i64, srange->end.u.i64, qctx);
+		ai_obj sfk;
+		ai_obj efk;
+		if (C_IS_Y(imd->dtype)) { // composite - prefix and range in digest keys
+			init_ai_objFromDigest(&sfk, &srange->start.digest);
+			init_ai_objFromDigest(&efk, &srange->end.digest);
+		}
+		else {
+			init_ai_objLong(&sfk, srange->start.u.i64);
+			init_ai_objLong(&efk, srange->end.u.i64);
+		}
+		err = get_range_recl(imd, &sfk, &efk, qctx);
 	}
 	return (err ? AS_SINDEX_ERR_NO_MEMORY :
 			(qctx->n_bdigs >= qctx->bsize) ? AS_SINDEX_CONTINUE : AS_SINDEX_OK);
@@ -921,6 +1065,9 @@ ai_btree_put(as_sindex_metadata *imd, as_sindex_pmetadata *pimd, void *skey, cf_
 		ret = AS_SINDEX_ERR_NO_MEMORY;
 		goto END;
 	}
+	if (!C_IS_Y(imd->dtype) && imd->si->stats._value_hist) {
+		as_sindex_hist_insert(imd->si->stats._value_hist, *(int64_t *)skey);
+	}
 
 END:
 
@@ -950,9 +1097,97 @@ ai_btree_delete(as_sindex_metadata *imd, as_sindex_pmetadata *pimd, void * skey,
 	ret = reduced_iRem(pimd->ibtr, &ncol, &apk);
 	ulong ab = pimd->ibtr->msize + pimd->ibtr->nsize;
 	as_sindex_release_data_memory(imd, (bb - ab));
+	if (ret == AS_SINDEX_OK && !C_IS_Y(imd->dtype) && imd->si->stats._value_hist) {
+		as_sindex_hist_remove(imd->si->stats._value_hist, *(int64_t *)skey);
+	}
 	return ret;
 }
 
+#define REDUCE_RUN_MAX 256
+
+static bool
+reduce_plist(void *skey, ai_plist *plist, ai_btree_reduce_fn cb, void *udata)
+{
+	cf_digest digs[REDUCE_RUN_MAX];
+	uint32_t n_digs = 0;
+	ai_plist_iter iter;
+
+	ai_plist_iter_init(&iter, plist, NULL);
+	while (ai_plist_iter_next(&iter, &digs[n_digs])) {
+		if (++n_digs == REDUCE_RUN_MAX) {
+			if (!cb(skey, digs, n_digs, udata)) {
+				return false;
+			}
+			n_digs = 0;
+		}
+	}
+	return n_digs == 0 || cb(skey, digs, n_digs, udata);
+}
+
+static bool
+reduce_nbtr(void *skey, bt *nbtr, ai_btree_reduce_fn cb, void *udata)
+{
+	cf_digest digs[REDUCE_RUN_MAX];
+	uint32_t n_digs = 0;
+	bool ok = true;
+	btEntry *nbe;
+	btSIter *nbi = btGetFullRangeIter(nbtr, 1, NULL);
+
+	if (!nbi) {
+		return true;
+	}
+	while ((nbe = btRangeNext(nbi, 1))) {
+		cloneDigestFromai_obj(&digs[n_digs], nbe->key);
+		if (++n_digs == REDUCE_RUN_MAX) {
+			if (!(ok = cb(skey, digs, n_digs, udata))) {
+				break;
+			}
+			n_digs = 0;
+		}
+	}
+	btReleaseRangeIterator(nbi);
+	return ok && (n_digs == 0 || cb(skey, digs, n_digs, udata));
+}
+
+/*
+ * Calls cb with every key in the pimd and its digests, in runs of up to
+ * REDUCE_RUN_MAX, in key order. skey is as for ai_btree_put(). Stops and
+ * returns false if cb does. Caller holds the pimd lock.
+ */
+bool
+ai_btree_reduce(as_sindex_metadata *imd, as_sindex_pmetadata *pimd, ai_btree_reduce_fn cb, void *udata)
+{
+	if (!pimd->ibtr || !pimd->ibtr->numkeys) {
+		return true;
+	}
+
+	bool ok = true;
+	btEntry *be;
+	btSIter *bi = btGetFullRangeIter(pimd->ibtr, 1, NULL);
+
+	if (!bi) {
+		return true;
+	}
+	while (ok && (be = btRangeNext(bi, 1))) {
+		ai_obj *ikey = be->key;
+		ai_nbtr *anbtr = be->val;
+		void *skey = C_IS_Y(imd->dtype) ? (void *)&ikey->y : (void *)&ikey->l;
+
+		if (!anbtr) {
+			continue;
+		}
+		if (anbtr->is_btree) {
+			ok = reduce_nbtr(skey, anbtr->u.nbtr, cb, udata);
+		} else if (anbtr->is_plist) {
+			ok = reduce_plist(skey, anbtr->u.plist, cb, udata);
+		} else if (anbtr->u.arr && anbtr->u.arr->used != 0) {
+			ok = cb(skey, (cf_digest *)anbtr->u.arr->data, anbtr->u.arr->used, udata);
+		}
+	}
+	btReleaseRangeIterator(bi);
+	return ok;
+}
+
 /*
  * Internal function which adds digests to the defrag_list
  * Mallocs the nodes of defrag_list
@@ -1078,6 +1313,62 @@ build_defrag_list_from_arr(as_namespace *ns, ai_obj *acol, ai_arr *arr, long nof
 	return processed;
 }
 
+static long
+build_defrag_list_from_plist(as_namespace *ns, ai_obj *acol, ai_plist *plist, long nofst, long *limit, uint64_t * tot_found, cf_ll *gc_list)
+{
+	long     found              = 0;
+	long     processed          = 0;
+	uint64_t validation_time_ns = 0;
+	ai_plist_iter iter;
+	cf_digest dig;
+
+	ai_plist_iter_init_xth(&iter, plist, (uint32_t)nofst);
+	while (ai_plist_iter_next(&iter, &dig)) {
+		SET_TIME_FOR_SINDEX_GC_HIST(validation_time_ns);
+		int ret = as_sindex_can_defrag_record(ns, &dig);
+		SINDEX_GC_HIST_INSERT_DATA_POINT(sindex_gc_validate_obj_hist, validation_time_ns);
+		validation_time_ns = 0;
+		if (ret == AS_SINDEX_GC_SKIP_ITERATION) {
+			*limit = 0;
+			break;
+		} else if (ret == AS_SINDEX_GC_OK) {
+			bool create   = (cf_ll_size(gc_list) == 0) ? true : false;
+			objs_to_defrag_arr *dt;
+
+			if (!create) {
+				cf_ll_element * ele = cf_ll_get_tail(gc_list);
+				dt = ((ll_sindex_gc_element*)ele)->objs_to_defrag;
+				if (dt->num == SINDEX_GC_NUM_OBJS_PER_ARR) {
+					create = true;
+				}
+			}
+			if (create) {
+				dt = as_sindex_gc_get_defrag_arr();
+				if (!dt) {
+					*tot_found += found;
+					return -1;
+				}
+				ll_sindex_gc_element  * node;
+				node = cf_malloc(sizeof(ll_sindex_gc_element));
+				node->objs_to_defrag = dt;
+				cf_ll_append(gc_list, (cf_ll_element *)node);
+			}
+			memcpy(&(dt->acol_digs[dt->num].dig), &dig, CF_DIGEST_KEY_SZ);
+			ai_objClone(&(dt->acol_digs[dt->num].acol), acol);
+
+			dt->num += 1;
+			found++;
+		}
+		processed++;
+		(*limit)--;
+		if (*limit == 0) {
+			break;
+		}
+	}
+	*tot_found += found;
+	return processed;
+}
+
 /*
  * Aerospike Index interface to build a defrag_list.
  *
@@ -1137,6 +1428,8 @@ ai_btree_build_defrag_list(as_sindex_metadata *imd, as_sindex_pmetadata *pimd, a
 		}
 		if (anbtr->is_btree) {
 			processed = build_defrag_list_from_nbtr(ns, acol, anbtr->u.nbtr, *nofst, &limit, tot_found, gc_list);
+		} else if (anbtr->is_plist) {
+			processed = build_defrag_list_from_plist(ns, acol, anbtr->u.plist, *nofst, &limit, tot_found, gc_list);
 		} else {
 			processed = build_defrag_list_from_arr(ns, acol, anbtr->u.arr, *nofst, &limit, tot_found, gc_list);
 		}
@@ -1211,6 +1504,9 @@ ai_btree_defrag_list(as_sindex_metadata *imd, as_sindex_pmetadata *pimd, cf_ll *
 				SET_TIME_FOR_SINDEX_GC_HIST(deletion_time_ns);
 				if (reduced_iRem(pimd->ibtr, acol, &apk) == AS_SINDEX_OK) {
 					success++;
+					if (!C_IS_Y(imd->dtype) && imd->si->stats._value_hist) {
+						as_sindex_hist_remove(imd->si->stats._value_hist, (int64_t)acol->l);
+					}
 					SINDEX_GC_HIST_INSERT_DATA_POINT(sindex_gc_delete_obj_hist, deletion_time_ns);
 				}
 				deletion_time_ns = 0;
@@ -0,0 +1,578 @@
+/*
+ * ai_plist.c
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/* SYNOPSIS
+ * Digests are held as keys - the digest bytes reversed, so that memcmp() order
+ * is u160Cmp() order. Each block holds up to AI_PLIST_BLOCK_MAX_DIGS sorted
+ * keys: the first in full, then a nibble per remaining key giving how many
+ * leading bytes it shares with its predecessor, then the rest of each of those
+ * keys. Blocks are allocated to fit exactly, and are kept in a sorted array.
+ *
+ * Random digests share little - the saving over the nbtr is mostly its node
+ * slack - so the per-key overhead is kept to half a byte.
+ *
+ * A change decodes the one block concerned, edits it and re-encodes it -
+ * splitting a block that overflows, and merging a block that has dwindled
+ * into its successor.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "ai_plist.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <citrusleaf/alloc.h>
+#include <citrusleaf/cf_digest.h>
+
+
+//==========================================================
+// Constants.
+//
+
+#define KEY_SZ				CF_DIGEST_KEY_SZ
+#define BLOCK_MAX_KEYS		AI_PLIST_BLOCK_MAX_DIGS
+#define BLOCK_MERGE_KEYS	(BLOCK_MAX_KEYS / 2)
+#define MIN_CAPACITY		4
+
+#define MAX_SHARED			15 // fits a nibble
+
+
+//==========================================================
+// Typedefs.
+//
+
+typedef struct pl_block_s {
+	uint16_t	n_keys;
+	uint16_t	n_bytes;
+	uint8_t		data[];
+} __attribute__ ((__packed__)) pl_block;
+
+struct ai_plist_s {
+	uint32_t	n_digs;
+	uint32_t	n_blocks;
+	uint32_t	capacity;
+	size_t		mem_sz;
+	pl_block**	blocks;
+};
+
+typedef uint8_t pl_key[KEY_SZ];
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static uint32_t find_block(const ai_plist* pl, const uint8_t* key);
+static bool find_key(const pl_key* keys, uint32_t n_keys, const uint8_t* key, uint32_t* pos);
+static uint32_t block_decode(const pl_block* b, pl_key* keys);
+static uint32_t block_encoded_sz(const pl_key* keys, uint32_t n_keys);
+static void block_write(pl_block* b, const pl_key* keys, uint32_t n_keys);
+static pl_block* block_encode(const pl_key* keys, uint32_t n_keys);
+static void set_block(ai_plist* pl, uint32_t ix, pl_block* b);
+static bool add_block(ai_plist* pl, uint32_t ix, pl_block* b);
+static void remove_block(ai_plist* pl, uint32_t ix);
+
+static inline void
+key_from_digest(uint8_t* key, const cf_digest* dig)
+{
+	for (uint32_t i = 0; i < KEY_SZ; i++) {
+		key[i] = dig->digest[KEY_SZ - 1 - i];
+	}
+}
+
+static inline void
+digest_from_key(cf_digest* dig, const uint8_t* key)
+{
+	for (uint32_t i = 0; i < KEY_SZ; i++) {
+		dig->digest[i] = key[KEY_SZ - 1 - i];
+	}
+}
+
+static inline size_t
+block_sz(const pl_block* b)
+{
+	return sizeof(pl_block) + b->n_bytes;
+}
+
+static inline const uint8_t*
+block_first_key(const pl_block* b)
+{
+	return b->data;
+}
+
+
+//==========================================================
+// Public API.
+//
+
+ai_plist*
+ai_plist_create(void)
+{
+	ai_plist* pl = cf_malloc(sizeof(ai_plist));
+
+	if (! pl) {
+		return NULL;
+	}
+
+	memset(pl, 0, sizeof(ai_plist));
+	pl->mem_sz = sizeof(ai_plist);
+
+	return pl;
+}
+
+void
+ai_plist_destroy(ai_plist* pl)
+{
+	if (! pl) {
+		return;
+	}
+
+	for (uint32_t i = 0; i < pl->n_blocks; i++) {
+		cf_free(pl->blocks[i]);
+	}
+
+	if (pl->blocks) {
+		cf_free(pl->blocks);
+	}
+
+	cf_free(pl);
+}
+
+size_t
+ai_plist_size(const ai_plist* pl)
+{
+	return pl ? pl->mem_sz : 0;
+}
+
+uint32_t
+ai_plist_count(const ai_plist* pl)
+{
+	return pl ? pl->n_digs : 0;
+}
+
+bool
+ai_plist_insert(ai_plist* pl, const cf_digest* dig, bool* found)
+{
+	pl_key key;
+
+	key_from_digest(key, dig);
+
+	if (pl->n_blocks == 0) {
+		pl_block* b = block_encode(&key, 1);
+
+		if (! b || ! add_block(pl, 0, b)) {
+			if (b) {
+				cf_free(b);
+			}
+
+			return false;
+		}
+
+		pl->n_digs = 1;
+		return true;
+	}
+
+	uint32_t ix = find_block(pl, key);
+	pl_key keys[BLOCK_MAX_KEYS + 1];
+	uint32_t n_keys = block_decode(pl->blocks[ix], keys);
+	uint32_t pos;
+
+	if (find_key(keys, n_keys, key, &pos)) {
+		*found = true;
+		return true;
+	}
+
+	memmove(keys[pos + 1], keys[pos], (n_keys - pos) * KEY_SZ);
+	memcpy(keys[pos], key, KEY_SZ);
+	n_keys++;
+
+	if (n_keys <= BLOCK_MAX_KEYS) {
+		pl_block* b = block_encode(keys, n_keys);
+
+		if (! b) {
+			return false;
+		}
+
+		set_block(pl, ix, b);
+	}
+	else {
+		uint32_t n_lo = n_keys / 2;
+		pl_block* lo = block_encode(keys, n_lo);
+		pl_block* hi = block_encode(&keys[n_lo], n_keys - n_lo);
+
+		if (! lo || ! hi || ! add_block(pl, ix + 1, hi)) {
+			if (lo) {
+				cf_free(lo);
+			}
+
+			if (hi) {
+				cf_free(hi);
+			}
+
+			return false;
+		}
+
+		set_block(pl, ix, lo);
+	}
+
+	pl->n_digs++;
+
+	return true;
+}
+
+void
+ai_plist_delete(ai_plist* pl, const cf_digest* dig, bool* notfound)
+{
+	if (pl->n_blocks == 0) {
+		*notfound = true;
+		return;
+	}
+
+	pl_key key;
+
+	key_from_digest(key, dig);
+
+	uint32_t ix = find_block(pl, key);
+	pl_key keys[BLOCK_MAX_KEYS * 2];
+	uint32_t n_keys = block_decode(pl->blocks[ix], keys);
+	uint32_t pos;
+
+	if (! find_key(keys, n_keys, key, &pos)) {
+		*notfound = true;
+		return;
+	}
+
+	pl->n_digs--;
+	n_keys--;
+
+	if (n_keys == 0) {
+		remove_block(pl, ix);
+		return;
+	}
+
+	memmove(keys[pos], keys[pos + 1], (n_keys - pos) * KEY_SZ);
+
+	// Fold a dwindling block into its successor, so deletes don't leave the
+	// list strewn with near-empty blocks.
+	if (ix + 1 < pl->n_blocks &&
+			n_keys + pl->blocks[ix + 1]->n_keys <= BLOCK_MERGE_KEYS) {
+		uint32_t n_merged = n_keys + block_decode(pl->blocks[ix + 1],
+				&keys[n_keys]);
+		pl_block* b = block_encode(keys, n_merged);
+
+		if (b) {
+			set_block(pl, ix, b);
+			remove_block(pl, ix + 1);
+			return;
+		}
+		// else - just shrink this block.
+	}
+
+	pl_block* b = block_encode(keys, n_keys);
+
+	if (b) {
+		set_block(pl, ix, b);
+		return;
+	}
+
+	// Removing a key never grows the encoding - rewrite in place.
+	pl_block* old = pl->blocks[ix];
+	size_t old_sz = block_sz(old);
+
+	block_write(old, keys, n_keys);
+	pl->mem_sz -= old_sz - block_sz(old);
+}
+
+void
+ai_plist_iter_init(ai_plist_iter* iter, const ai_plist* pl,
+		const cf_digest* from)
+{
+	iter->pl = pl;
+	iter->block_ix = 0;
+	iter->n_keys = 0;
+	iter->key_ix = 0;
+
+	if (pl->n_blocks == 0) {
+		return;
+	}
+
+	if (! from) {
+		iter->n_keys = block_decode(pl->blocks[0], iter->keys);
+		return;
+	}
+
+	pl_key key;
+
+	key_from_digest(key, from);
+
+	iter->block_ix = find_block(pl, key);
+	iter->n_keys = block_decode(pl->blocks[iter->block_ix], iter->keys);
+
+	find_key(iter->keys, iter->n_keys, key, &iter->key_ix);
+}
+
+void
+ai_plist_iter_init_xth(ai_plist_iter* iter, const ai_plist* pl, uint32_t x)
+{
+	iter->pl = pl;
+	iter->block_ix = 0;
+	iter->n_keys = 0;
+	iter->key_ix = 0;
+
+	while (iter->block_ix < pl->n_blocks &&
+			x >= pl->blocks[iter->block_ix]->n_keys) {
+		x -= pl->blocks[iter->block_ix]->n_keys;
+		iter->block_ix++;
+	}
+
+	if (iter->block_ix < pl->n_blocks) {
+		iter->n_keys = block_decode(pl->blocks[iter->block_ix], iter->keys);
+		iter->key_ix = x;
+	}
+}
+
+bool
+ai_plist_iter_next(ai_plist_iter* iter, cf_digest* dig)
+{
+	const ai_plist* pl = iter->pl;
+
+	while (iter->key_ix == iter->n_keys) {
+		if (iter->block_ix + 1 >= pl->n_blocks) {
+			return false;
+		}
+
+		iter->block_ix++;
+		iter->n_keys = block_decode(pl->blocks[iter->block_ix], iter->keys);
+		iter->key_ix = 0;
+	}
+
+	digest_from_key(dig, iter->keys[iter->key_ix++]);
+
+	return true;
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+// Returns the last block whose first key is not after key, or the first block
+// if key precedes them all.
+static uint32_t
+find_block(const ai_plist* pl, const uint8_t* key)
+{
+	uint32_t lo = 0;
+	uint32_t hi = pl->n_blocks;
+
+	while (lo < hi) {
+		uint32_t mid = (lo + hi) / 2;
+
+		if (memcmp(block_first_key(pl->blocks[mid]), key, KEY_SZ) <= 0) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
+		}
+	}
+
+	return lo == 0 ? 0 : lo - 1;
+}
+
+// Sets pos to where key is, or would be inserted.
+static bool
+find_key(const pl_key* keys, uint32_t n_keys, const uint8_t* key,
+		uint32_t* pos)
+{
+	uint32_t lo = 0;
+	uint32_t hi = n_keys;
+
+	while (lo < hi) {
+		uint32_t mid = (lo + hi) / 2;
+		int cmp = memcmp(keys[mid], key, KEY_SZ);
+
+		if (cmp == 0) {
+			*pos = mid;
+			return true;
+		}
+
+		if (cmp < 0) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
+		}
+	}
+
+	*pos = lo;
+
+	return false;
+}
+
+// Nibble i of the lengths is for key i + 1.
+static inline uint32_t
+n_length_bytes(uint32_t n_keys)
+{
+	return n_keys / 2; // (n_keys - 1 + 1) / 2
+}
+
+static uint32_t
+block_decode(const pl_block* b, pl_key* keys)
+{
+	const uint8_t* lengths = b->data + KEY_SZ;
+	const uint8_t* p = lengths + n_length_bytes(b->n_keys);
+
+	memcpy(keys[0], b->data, KEY_SZ);
+
+	for (uint32_t i = 1; i < b->n_keys; i++) {
+		uint32_t nibble = i - 1;
+		uint32_t shared = (lengths[nibble / 2] >> ((nibble & 1) * 4)) & 0xF;
+
+		memcpy(keys[i], keys[i - 1], shared);
+		memcpy(keys[i] + shared, p, KEY_SZ - shared);
+		p += KEY_SZ - shared;
+	}
+
+	return b->n_keys;
+}
+
+static inline uint32_t
+shared_prefix(const uint8_t* prev, const uint8_t* key)
+{
+	uint32_t n = 0;
+
+	// Keys are distinct, so never share all KEY_SZ bytes.
+	while (n < MAX_SHARED && prev[n] == key[n]) {
+		n++;
+	}
+
+	return n;
+}
+
+static uint32_t
+block_encoded_sz(const pl_key* keys, uint32_t n_keys)
+{
+	uint32_t n_bytes = KEY_SZ + n_length_bytes(n_keys);
+
+	for (uint32_t i = 1; i < n_keys; i++) {
+		n_bytes += KEY_SZ - shared_prefix(keys[i - 1], keys[i]);
+	}
+
+	return n_bytes;
+}
+
+static void
+block_write(pl_block* b, const pl_key* keys, uint32_t n_keys)
+{
+	uint8_t* lengths = b->data + KEY_SZ;
+	uint8_t* p = lengths + n_length_bytes(n_keys);
+
+	memcpy(b->data, keys[0], KEY_SZ);
+	memset(lengths, 0, n_length_bytes(n_keys));
+
+	for (uint32_t i = 1; i < n_keys; i++) {
+		uint32_t nibble = i - 1;
+		uint32_t shared = shared_prefix(keys[i - 1], keys[i]);
+
+		lengths[nibble / 2] |= (uint8_t)(shared << ((nibble & 1) * 4));
+		memcpy(p, keys[i] + shared, KEY_SZ - shared);
+		p += KEY_SZ - shared;
+	}
+
+	b->n_keys = (uint16_t)n_keys;
+	b->n_bytes = (uint16_t)(p - b->data);
+}
+
+static pl_block*
+block_encode(const pl_key* keys, uint32_t n_keys)
+{
+	pl_block* b = cf_malloc(sizeof(pl_block) +
+			block_encoded_sz(keys, n_keys));
+
+	if (! b) {
+		return NULL;
+	}
+
+	block_write(b, keys, n_keys);
+
+	return b;
+}
+
+// Replaces (and frees) the block at ix.
+static void
+set_block(ai_plist* pl, uint32_t ix, pl_block* b)
+{
+	pl_block* old = pl->blocks[ix];
+
+	pl->mem_sz += block_sz(b);
+	pl->mem_sz -= block_sz(old);
+	pl->blocks[ix] = b;
+
+	cf_free(old);
+}
+
+static bool
+add_block(ai_plist* pl, uint32_t ix, pl_block* b)
+{
+	if (pl->n_blocks == pl->capacity) {
+		uint32_t capacity = pl->capacity == 0 ?
+				MIN_CAPACITY : pl->capacity * 2;
+		pl_block** blocks = cf_realloc(pl->blocks,
+				capacity * sizeof(pl_block*));
+
+		if (! blocks) {
+			return false;
+		}
+
+		pl->mem_sz += (capacity - pl->capacity) * sizeof(pl_block*);
+		pl->blocks = blocks;
+		pl->capacity = capacity;
+	}
+
+	memmove(&pl->blocks[ix + 1], &pl->blocks[ix],
+			(pl->n_blocks - ix) * sizeof(pl_block*));
+
+	pl->blocks[ix] = b;
+	pl->n_blocks++;
+	pl->mem_sz += block_sz(b);
+
+	return true;
+}
+
+static void
+remove_block(ai_plist* pl, uint32_t ix)
+{
+	pl_block* b = pl->blocks[ix];
+
+	pl->mem_sz -= block_sz(b);
+	cf_free(b);
+
+	pl->n_blocks--;
+
+	memmove(&pl->blocks[ix], &pl->blocks[ix + 1],
+			(pl->n_blocks - ix) * sizeof(pl_block*));
+}
@@ -277,24 +277,57 @@ static inline int _log2(unsigned int a, int nbits) {
 	return real_log2(a, nbits);
 }
 
+/* Trees whose fixed size keys start with a long (the L* OTHER_BTs and the
+ * LONG indexes, e.g. integer sindexes) are chosen at creation by their bflag.
+ * Their search reads the longs in place - no comparator call per probe, and
+ * the probe step is branch-free. Same result as the generic search. */
+#define LONG_KEY_BT(btr) (btr->s.bflag & (BTFLAG_ULONG_INDEX | BTFLAG_ULONG_UINT | \
+                                          BTFLAG_ULONG_ULONG | BTFLAG_ULONG_U128 | \
+                                          BTFLAG_ULONG_U160))
+
+static inline long long_key_at(bt *btr, bt_n *x, int i) {
+    long l;
+    memcpy(&l, (char *)x + btr->keyofst + (i * btr->s.ksize), sizeof(long));
+    return l;
+}
+static int findkindex_long(bt *btr, bt_n *x, bt_data_t k, int *rr) {
+    long key;
+    memcpy(&key, k, sizeof(long));
+    int  i  = 0;
+    int  a  = x->n - 1;
+    while (a > 0) {
+        int  b   = _log2(a, (int)btr->nbits);
+        bool lt  = key < long_key_at(btr, x, (1 << b) + i);
+        a        = lt ? (1 << b) - 1 : a - (1 << b);
+        i        = lt ? i            : i | (1 << b);
+    }
+    long k2 = long_key_at(btr, x, i);
+    *rr     = key == k2 ? 0 : (key > k2) ? 1 : -1;
+    return (*rr < 0) ? i - 1 : i;
+}
+
 static int findkindex(bt *btr, bt_n *x, bt_data_t k, int *r, btIterator *iter) {
     if (x->n == 0) return -1;
     int b, tr;
     int *rr = r ? r : &tr ; /* rr: key is greater than current entry */
     int  i  = 0;
     int  a  = x->n - 1;
-    while (a > 0) {
-        b            = _log2(a, (int)btr->nbits);
-        int slot     = (1 << b) + i;
-        bt_data_t k2 = KEYS(btr, x, slot);
-        if ((*rr = btr->cmp(k, k2)) < 0) {
-            a        = (1 << b) - 1;
-        } else {
-            a       -= (1 << b);
-            i       |= (1 << b);
+    if (LONG_KEY_BT(btr)) {
+        i = findkindex_long(btr, x, k, rr);
+    } else {
+        while (a > 0) {
+            b            = _log2(a, (int)btr->nbits);
+            int slot     = (1 << b) + i;
+            bt_data_t k2 = KEYS(btr, x, slot);
+            if ((*rr = btr->cmp(k, k2)) < 0) {
+                a        = (1 << b) - 1;
+            } else {
+                a       -= (1 << b);
+                i       |= (1 << b);
+            }
         }
+        if ((*rr = btr->cmp(k, KEYS(btr, x, i))) < 0)  i--;
     }
-    if ((*rr = btr->cmp(k, KEYS(btr, x, i))) < 0)  i--;
     if (SIMP_UNIQ(btr) && Index[btr->s.num].iposon) add_to_cipos(btr, x, i);
     if (iter) { iter->bln->in = iter->bln->ik = (i > 0) ? i : 0; }
     return i;
@@ -0,0 +1,57 @@
+/*
+ * admission.h
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+
+#pragma once
+
+//==========================================================
+// Includes.
+//
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "base/datamodel.h"
+
+
+//==========================================================
+// Typedefs.
+//
+
+// Classes of work admission control sheds or delays - each is shed at and
+// above the namespace admission level equal to its value.
+typedef enum {
+	AS_ADMIT_SCAN		= 1,
+	AS_ADMIT_UDF_BG		= 2,
+	AS_ADMIT_MIGRATE	= 3,
+	AS_ADMIT_WRITE		= 4
+} as_admit_class;
+
+
+//==========================================================
+// Public API.
+//
+
+void as_admission_init();
+void as_admission_note_queue_wait(uint64_t wait_ns, uint32_t n_waits);
+void as_admission_note_device_write(as_namespace* ns, uint64_t write_ns);
+bool as_admission_shed(as_namespace* ns, as_admit_class cls);
@@ -49,4 +49,24 @@
 #define ASD_QUERY_SENDPACKET_FINISHED(arg1)
 #define ASD_SINDEX_MSGRANGE_STARTING(arg1,arg2)
 #define ASD_SINDEX_MSGRANGE_FINISHED(arg1,arg2)
+#define ASD_TSVC_ENQUEUE(arg1,arg2)
+#define ASD_TSVC_DEQUEUE(arg1,arg2)
+#define ASD_RECORD_LOCK_START(arg1)
+#define ASD_RECORD_LOCK_ACQUIRED(arg1)
+#define ASD_STORAGE_READ_START(arg1,arg2,arg3)
+#define ASD_STORAGE_READ_DONE(arg1,arg2,arg3)
+#define ASD_STORAGE_FLUSH_START(arg1,arg2)
+#define ASD_STORAGE_FLUSH_DONE(arg1,arg2)
+#define ASD_DEFRAG_WBLOCK_START(arg1,arg2)
+#define ASD_DEFRAG_WBLOCK_DONE(arg1,arg2,arg3)
+#define ASD_RW_SEND(arg1,arg2,arg3)
+#define ASD_REPL_WRITE_ACK(arg1,arg2,arg3)
+#define ASD_MIGRATE_INSERT_START(arg1,arg2)
+#define ASD_MIGRATE_INSERT_DONE(arg1,arg2)
+#define ASD_BATCH_SLICE_START(arg1,arg2)
+#define ASD_BATCH_SLICE_DONE(arg1,arg2)
+#define ASD_JOB_SLICE_START(arg1,arg2,arg3)
+#define ASD_JOB_SLICE_DONE(arg1,arg2,arg3)
+#define ASD_NSUP_PHASE_START(arg1,arg2)
+#define ASD_NSUP_PHASE_DONE(arg1,arg2)
 #endif
@@ -126,6 +126,15 @@ void as_bin_set_double(as_bin *b, double value);
 bool cdt_payload_is_int(const cdt_payload *payload);
 int64_t cdt_payload_get_int64(const cdt_payload *payload);
 
+// msgpack scanning
+int64_t cdt_unpack_size_n(as_unpacker *pk, uint32_t n);
+
+static inline int64_t
+cdt_unpack_size(as_unpacker *pk)
+{
+	return cdt_unpack_size_n(pk, 1);
+}
+
 // cdt_process_state
 bool cdt_process_state_init(cdt_process_state *cdt_state, const as_msg_op *op);
 bool cdt_process_state_get_params(cdt_process_state *state, size_t n, ...);
@@ -37,6 +37,8 @@
 #include "aerospike/mod_lua_config.h"
 #include "citrusleaf/cf_atomic.h"
 
+#include "hist.h"
+#include "hist_track.h"
 #include "socket.h"
 #include "util.h"
 
@@ -62,7 +64,48 @@ struct as_namespace_s;
 
 #define MAX_DEMARSHAL_THREADS 256
 #define MAX_FABRIC_WORKERS 128
+#define MAX_FABRIC_CHANNEL_WORKERS 32
 #define MAX_BATCH_THREADS 64
+#define MAX_NSUP_THREADS 32
+#define MAX_BALANCE_THREADS 32
+#define MAX_INFO_HEAVY_THREADS 32
+#define MAX_UDF_RESULT_CACHE_MODULES 16
+#define MAX_THREAD_SCHED_CPUS 256
+
+// Thread pools whose CPUs and scheduling policy may be configured, e.g. to
+// keep background work off the cores serving transactions. Service thread
+// CPUs are still configured by service-thread-cpus, one CPU per thread.
+typedef enum {
+	AS_SCHED_POOL_SERVICE,
+	AS_SCHED_POOL_TRANSACTION,
+	AS_SCHED_POOL_FABRIC,
+	AS_SCHED_POOL_DEFRAG,
+	AS_SCHED_POOL_WRITE,
+	AS_SCHED_POOL_NSUP,
+	AS_SCHED_POOL_SCAN,
+	AS_SCHED_POOL_QUERY,
+	AS_SCHED_POOL_BATCH,
+
+	AS_N_SCHED_POOLS,
+	AS_SCHED_POOL_NONE = AS_N_SCHED_POOLS // not configurable
+} as_sched_pool;
+
+typedef struct as_thread_sched_s {
+	uint32_t	n_cpus; // 0 means any CPU
+	uint16_t	cpus[MAX_THREAD_SCHED_CPUS];
+	int			policy; // SCHED_OTHER unless configured
+	int			priority; // only for SCHED_FIFO and SCHED_RR
+} as_thread_sched;
+
+// Fabric traffic classes - each has its own connections and send queues, so
+// bulk traffic can't hold up replication and cluster control messages.
+typedef enum {
+	AS_FABRIC_CHANNEL_CTRL,
+	AS_FABRIC_CHANNEL_RW,
+	AS_FABRIC_CHANNEL_BULK,
+
+	AS_FABRIC_N_CHANNELS
+} as_fabric_channel;
 
 // Declare bools with PAD_BOOL so they can't share a 4-byte space with other
 // bools, chars or shorts. This prevents adjacent bools set concurrently in
@@ -94,7 +137,14 @@ typedef struct as_config_s {
 
 	// Normally hidden:
 
+	PAD_BOOL		admission_control; // shed low-priority work when queues or devices degrade
+	uint32_t		admission_device_latency_ms; // device write latency at which admission control is fully engaged
+	uint32_t		admission_queue_wait_ms; // transaction queue wait at which admission control is fully engaged
+	uint32_t		alloc_prof_interval; // bytes allocated between allocation profiling samples, 0 for none
 	PAD_BOOL		allow_inline_transactions;
+	uint32_t		background_max_records_per_sec; // ceiling on all scan, sindex build and long query work - 0 means no limit
+	PAD_BOOL		background_udf_inline; // apply background scan and query UDFs in the job thread, not via transaction queues
+	uint32_t		n_balance_threads; // threads computing partition balance
 	int				n_batch_threads;
 	uint32_t		batch_max_buffers_per_queue; // maximum number of buffers allowed in a buffer queue at any one time, fail batch if full
 	uint32_t		batch_max_requests; // maximum count of database requests in a single batch
@@ -109,27 +159,44 @@ typedef struct as_config_s {
 	PAD_BOOL		generation_disable;
 	uint32_t		hist_track_back; // total time span in seconds over which to cache data
 	uint32_t		hist_track_slice; // period in seconds at which to cache histogram data
+	uint32_t		hist_track_precision; // significant bits of percentiles, 0 for none
+	uint32_t		slow_txn_threshold; // ms beyond which transactions go in the slow transaction log, 0 for no log
+	uint32_t		slow_txn_log_rate; // max slow transactions per second also written to the server log
+	uint32_t		hot_key_sample_rate; // 1 in this many transactions sampled for hot-key detection, 0 for none
 	char*			hist_track_thresholds; // comma-separated bucket (ms) values to track
 	int				n_info_threads;
+	int				n_info_heavy_threads; // separate pool for expensive info commands, 0 for none
+	uint32_t		info_cache_ttl; // ms for which cacheable heavy info results are reused, 0 for no cache
+	uint32_t		info_timeout; // ms an info request may wait in queue before it's dropped, 0 for no limit
 	PAD_BOOL		ldt_benchmarks;
 	// Note - log-local-time affects a global in cf_fault.c, so can't be here.
+	uint64_t		migrate_max_bytes_per_sec; // 0 means unlimited
 	int				migrate_max_num_incoming;
 	int				migrate_rx_lifetime_ms; // for debouncing re-tansmitted migrate start messages
+	uint64_t		migrate_rx_memory_budget; // unacked migrate bytes allowed in, split between emigrators - 0 means no budget
+	uint32_t		migrate_split_threads; // threads per big partition
 	int				n_migrate_threads;
 	uint32_t		nsup_delete_sleep; // sleep this many microseconds between generating delete transactions, default 0
 	uint32_t		nsup_period;
 	PAD_BOOL		nsup_startup_evict;
+	uint32_t		n_nsup_threads; // threads reducing partitions in each nsup cycle
+	PAD_BOOL		paxos_compact_sync; // run-length & varint encode partition sync tables - all nodes must understand it
 	uint32_t		paxos_max_cluster_size;
 	paxos_protocol_enum paxos_protocol;
 	paxos_recovery_policy_enum paxos_recovery_policy;
 	uint32_t		paxos_retransmit_period;
+	uint32_t		proto_compression_threshold; // response chunks at least this big are compressed, for clients that ask
 	int				proto_fd_idle_ms; // after this many milliseconds, connections are aborted unless transaction is in progress
+	uint32_t		proto_read_buffer_size; // if non-zero, demarshal reads ahead into a per-connection buffer of this size
 	int				proto_slow_netio_sleep_ms; // dynamic only
+	uint32_t		proxy_batch_us; // if non-zero, batch proxy requests & responses to each node for up to this long
 	uint32_t		query_bsize;
+	uint32_t		query_aggr_bsize; // long running aggregations - one partial result per batch
 	uint64_t		query_buf_size; // dynamic only
 	uint32_t		query_bufpool_size;
 	PAD_BOOL		query_in_transaction_thr;
 	uint32_t		query_long_q_max_size;
+	uint32_t		query_max_records_per_sec; // all long running queries together - 0 means no limit
 	PAD_BOOL		query_enable_histogram;
 	PAD_BOOL		partitions_pre_reserved; // query will reserve all partitions up front
 	uint32_t		query_priority;
@@ -142,20 +209,35 @@ typedef struct as_config_s {
 	uint32_t		query_threshold;
 	uint64_t		query_untracked_time_ms;
 	uint32_t		query_worker_threads;
+	uint32_t		rack_id; // rack (or zone) this node is in - published to clients choosing replicas to read from
+	uint32_t		n_record_locks; // 0 means scale to number of CPUs
+	PAD_BOOL		record_locks_adaptive; // record locks spin before parking
+	uint32_t		replica_write_batch_us; // if non-zero, batch replica writes to each node for up to this long
 	PAD_BOOL		respond_client_on_master_completion;
 	PAD_BOOL		run_as_daemon;
+	PAD_BOOL		run_to_completion; // pinned service thread per CPU runs what it can inline
 	uint32_t		scan_max_active; // maximum number of active scans allowed
 	uint32_t		scan_max_done; // maximum number of finished scans kept for monitoring
+	uint32_t		scan_max_records_per_sec; // all scans together - 0 means no limit
+	uint32_t		scan_max_records_per_sec_per_job; // one scan job - 0 means no limit
+	uint32_t		scan_max_threads_per_job; // most scan threads one job may use - 0 means no limit
 	uint32_t		scan_max_udf_transactions; // maximum number of active transactions per UDF background scan
 	uint32_t		scan_threads; // size of scan thread pool
+	PAD_BOOL		service_listener_per_thread; // each service thread accepts on its own SO_REUSEPORT socket
+	uint32_t		n_service_thread_cpus; // 0 means service threads aren't pinned, except in run-to-completion mode
+	uint16_t		service_thread_cpus[MAX_DEMARSHAL_THREADS]; // service thread i is pinned to entry i modulo count
+	as_thread_sched	thread_sched[AS_N_SCHED_POOLS]; // <pool>-thread-cpus and <pool>-thread-sched
 	uint32_t		sindex_builder_threads; // secondary index builder thread pool size
 	uint64_t		sindex_data_max_memory; // maximum memory for secondary index trees
 	PAD_BOOL		sindex_gc_enable_histogram; // dynamic only
+	char*			storage_trace_directory; // storage-trace files live only here - null means no trace files
 	uint32_t		ticker_interval;
 	uint64_t		transaction_max_ns;
 	uint32_t		transaction_pending_limit; // 0 means no limit
 	PAD_BOOL		transaction_repeatable_read;
 	uint32_t		transaction_retry_ms;
+	PAD_BOOL		transaction_threads_adaptive; // add or remove transaction threads as queue wait changes
+	uint64_t		udf_runtime_max_memory; // per UDF call, as reported by mod-lua - 0 means no limit
 	PAD_BOOL		use_queue_per_device;
 	char*			work_directory;
 	PAD_BOOL		write_duplicate_resolution_disable;
@@ -167,6 +249,7 @@ typedef struct as_config_s {
 	int64_t			max_msgs_per_type; // maximum number of "msg" objects permitted per type
 	PAD_BOOL		memory_accounting; // whether memory accounting is enabled
 	uint32_t		prole_extra_ttl; // seconds beyond expiry time after which we garbage collect, 0 for no garbage collection
+	uint32_t		non_master_gc_rps; // records per second non-master garbage collection visits, per namespace, 0 for no limit
 	PAD_BOOL		non_master_sets_delete;	// dynamic only - locally delete non-master records in sets that are being emptied
 
 	//--------------------------------------------
@@ -207,6 +290,9 @@ typedef struct as_config_s {
 	int				fabric_keepalive_intvl;
 	int				fabric_keepalive_probes;
 	int				fabric_latency_max_ms; // time window for ordering
+	int				fabric_channel_fds[AS_FABRIC_N_CHANNELS]; // max outbound connections per node
+	int				fabric_channel_workers[AS_FABRIC_N_CHANNELS]; // 0 - use general fabric workers
+	int				fabric_channel_send_buf[AS_FABRIC_N_CHANNELS]; // 0 - use system default
 
 	//--------------------------------------------
 	// network::info context.
@@ -215,12 +301,17 @@ typedef struct as_config_s {
 	// Normally visible, in canonical configuration file order:
 
 	int				info_port;
+	int				metrics_port; // 0 means no OpenMetrics endpoint
 
 	//--------------------------------------------
 	// Remaining configuration top-level contexts.
 	//
 
 	mod_lua_config	mod_lua;
+	char			udf_native_path[256]; // in mod-lua context - empty means no native UDF modules
+	uint32_t		udf_result_cache_size; // in mod-lua context - entries, 0 means no result cache
+	uint32_t		n_udf_result_cache_modules;
+	char			udf_result_cache_modules[MAX_UDF_RESULT_CACHE_MODULES][128]; // in mod-lua context - modules with deterministic read functions
 	cluster_config_t cluster;
 	as_sec_config	sec_cfg;
 
@@ -242,6 +333,12 @@ typedef struct as_config_s {
 	xdr_lastship_s	xdr_lastship[AS_CLUSTER_SZ]; // last XDR shipping info of other nodes
 	uint64_t		xdr_self_lastshiptime[DC_MAX_NUM]; // last XDR shipping by this node
 
+	// Digest log, used when the XDR module isn't - see xdr_dlog.c.
+	bool			xdr_dlog_enabled;
+	char*			xdr_dlog_path;
+	uint64_t		xdr_dlog_size;
+	bool			xdr_dlog_overwrite;
+
 	cf_atomic64	    sindex_data_memory_used;
 
 	// Namespaces.
@@ -262,8 +359,14 @@ typedef struct as_config_s {
 as_config* as_config_init(const char* config_file);
 void as_config_post_process(as_config* c, const char* config_file);
 
+void as_config_sched_thread(as_sched_pool pool, pthread_t thread);
+const char* as_sched_pool_str(as_sched_pool pool);
+const char* as_sched_policy_str(int policy);
+
 void as_config_cluster_id_get(char* cluster_id);
 bool as_config_cluster_id_set(const char* cluster_id);
 
+void create_and_check_hist_track(cf_hist_track** h, const char* name, histogram_scale scale);
+
 extern as_config g_config;
 extern xdr_config g_xcfg;
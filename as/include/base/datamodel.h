@@ -44,6 +44,7 @@
 #include "hist.h"
 #include "hist_track.h"
 #include "linear_hist.h"
+#include "shard_counter.h"
 #include "util.h"
 #include "vmapx.h"
 
@@ -121,6 +122,8 @@ typedef struct as_set_s as_set;
 typedef struct as_treex_s as_treex;
 
 struct as_index_tree_s;
+struct as_expire_index_s;
+struct as_set_index_s;
 
 
 // TODO - We have a #include loop - datamodel.h and storage.h include each
@@ -211,6 +214,7 @@ typedef struct as_particle_s {
 #define AS_BIN_STATE_INUSE_HIDDEN	2 // Denotes a server-side, hidden bin
 #define AS_BIN_STATE_INUSE_OTHER	3
 #define AS_BIN_STATE_INUSE_FLOAT	4
+#define AS_BIN_STATE_INUSE_SHORT	5 // small string or blob, value in the bin
 
 typedef struct as_particle_iparticle_s {
 	uint8_t		version: 4;		// now unused - and can't be used in single-bin config
@@ -218,6 +222,16 @@ typedef struct as_particle_iparticle_s {
 	uint8_t		data[];
 } __attribute__ ((__packed__)) as_particle_iparticle;
 
+// Values of STRING and BLOB-family particles this small are held in place of
+// the bin's particle pointer, instead of in a separate allocation.
+#define AS_PARTICLE_SHORT_MAX_SZ 6
+
+typedef struct as_particle_short_s {
+	uint8_t		type;
+	uint8_t		sz;
+	uint8_t		data[AS_PARTICLE_SHORT_MAX_SZ];
+} __attribute__ ((__packed__)) as_particle_short;
+
 /* Particle function declarations */
 
 static inline bool
@@ -241,6 +255,7 @@ extern uint32_t as_particle_asval_to_client(const as_val *val, as_msg_op *op);
 
 extern void as_bin_particle_destroy(as_bin *b, bool free_particle);
 extern uint32_t as_bin_particle_size(as_bin *b);
+extern uint32_t as_bin_particle_compact(as_bin *b);
 
 // wire:
 extern int32_t as_bin_particle_size_modify_from_client(as_bin *b, const as_msg_op *op); // TODO - will we ever need this?
@@ -251,11 +266,17 @@ extern int as_bin_particle_stack_from_client(as_bin *b, cf_ll_buf *particles_llb
 extern int as_bin_particle_replace_from_pickled(as_bin *b, uint8_t **p_pickled);
 extern int32_t as_bin_particle_stack_from_pickled(as_bin *b, uint8_t* stack, uint8_t **p_pickled);
 extern int as_bin_particle_compare_from_pickled(const as_bin *b, uint8_t **p_pickled);
+extern int as_bin_particle_compare_from_client(const as_bin *b, const as_msg_op *op);
 extern uint32_t as_bin_particle_client_value_size(const as_bin *b);
 extern uint32_t as_bin_particle_to_client(const as_bin *b, as_msg_op *op);
+extern const uint8_t *as_bin_particle_client_value_ref(const as_bin *b, uint32_t *p_size);
 extern uint32_t as_bin_particle_pickled_size(const as_bin *b);
 extern uint32_t as_bin_particle_to_pickled(const as_bin *b, uint8_t *pickled);
 
+// Byte range reads of blobs return a new particle for the range. (Byte range
+// writes are modify ops.)
+extern int as_bin_blob_read_from_client(const as_bin *b, const as_msg_op *op, as_bin *result);
+
 // Different for CDTs - the operations may return results, so we don't use the
 // normal APIs and particle table functions.
 extern int as_bin_cdt_read_from_client(const as_bin *b, as_msg_op *op, as_bin *result);
@@ -309,6 +330,8 @@ extern as_particle *packed_list_simple_create_empty(struct rollback_alloc_s *all
 
 // map:
 extern void as_bin_particle_map_set_hidden(as_bin *b);
+extern uint32_t as_bin_particle_map_flat_size_with_indexes(const as_bin *b);
+extern uint32_t as_bin_particle_map_to_flat_with_indexes(const as_bin *b, uint8_t *flat);
 
 
 /* as_bin
@@ -319,6 +342,7 @@ struct as_bin_s {
 	union {
 		uint64_t ivalue;			// this field should be never used directly. always use the pointer to the iparticle;
 		as_particle *particle;
+		as_particle_short svalue;	// only if state is AS_BIN_STATE_INUSE_SHORT
 	};
 	/*
 	 *  The above is used as an as_particle_int subtype embedded inside the bin
@@ -328,6 +352,23 @@ struct as_bin_s {
 	uint8_t		unused;		// pad to 12 bytes (multiple of 4) for thread safety
 } __attribute__ ((__packed__)) ;
 
+// Optional id -> position index over an rd's bins - see
+// as_bin_index_attach(). Open addressing, load factor at most half.
+#define AS_BIN_INDEX_MIN_BINS 32
+
+typedef struct as_bin_index_slot_s {
+	uint16_t	id;
+	uint16_t	pos;
+} as_bin_index_slot;
+
+typedef struct as_bin_index_s {
+	as_bin*		bins;		// bins array the index was built for
+	uint32_t	mask;		// number of slots - 1
+	uint16_t	n_inuse;
+	bool		valid;		// cleared when bins shift - rebuilt on next use
+	as_bin_index_slot slots[];
+} as_bin_index;
+
 // For data-in-memory namespaces in multi-bin mode, we keep an array of as_bin
 // structs in memory, accessed via this struct.
 typedef struct as_bin_space_s {
@@ -410,12 +451,22 @@ as_bin_set_empty(as_bin *b)
 	as_bin_state_set(b, AS_BIN_STATE_UNUSED);
 }
 
+static inline void
+as_bin_index_invalidate(as_storage_rd *rd)
+{
+	if (rd->bin_index) {
+		rd->bin_index->valid = false;
+	}
+}
+
 static inline void
 as_bin_set_empty_shift(as_storage_rd *rd, uint32_t i)
 {
 	// Shift the bins over, so there's no space between used bins.
 	// This can overwrite the "emptied" bin, and that's fine.
 
+	as_bin_index_invalidate(rd);
+
 	uint16_t j;
 
 	for (j = i + 1; j < rd->n_bins; j++) {
@@ -436,6 +487,8 @@ as_bin_set_empty_shift(as_storage_rd *rd, uint32_t i)
 
 static inline void
 as_bin_set_empty_from(as_storage_rd *rd, uint16_t from) {
+	as_bin_index_invalidate(rd);
+
 	for (uint16_t i = from; i < rd->n_bins; i++) {
 		as_bin_set_empty(&rd->bins[i]);
 	}
@@ -449,7 +502,13 @@ as_bin_set_all_empty(as_storage_rd *rd) {
 static inline bool
 as_bin_is_embedded_particle(const as_bin *b) {
 	return ((as_particle_iparticle *)b)->state == AS_BIN_STATE_INUSE_INTEGER ||
-			((as_particle_iparticle *)b)->state == AS_BIN_STATE_INUSE_FLOAT;
+			((as_particle_iparticle *)b)->state == AS_BIN_STATE_INUSE_FLOAT ||
+			((as_particle_iparticle *)b)->state == AS_BIN_STATE_INUSE_SHORT;
+}
+
+static inline bool
+as_bin_is_short_particle(const as_bin *b) {
+	return ((as_particle_iparticle *)b)->state == AS_BIN_STATE_INUSE_SHORT;
 }
 
 static inline as_particle *
@@ -471,6 +530,8 @@ as_bin_get_particle_type(const as_bin *b) {
 			return AS_PARTICLE_TYPE_INTEGER;
 		case AS_BIN_STATE_INUSE_FLOAT:
 			return AS_PARTICLE_TYPE_FLOAT;
+		case AS_BIN_STATE_INUSE_SHORT:
+			return b->svalue.type;
 		case AS_BIN_STATE_INUSE_OTHER:
 			return b->particle->metadata;
 		case AS_BIN_STATE_INUSE_HIDDEN:
@@ -483,13 +544,19 @@ as_bin_get_particle_type(const as_bin *b) {
 
 /* Bin function declarations */
 extern int16_t as_bin_get_id(as_namespace *ns, const char *name);
+extern bool as_bin_get_id_w_len(as_namespace *ns, uint8_t *name, size_t len, uint32_t *p_id);
 extern uint16_t as_bin_get_or_assign_id(as_namespace *ns, const char *name);
 extern uint16_t as_bin_get_or_assign_id_w_len(as_namespace *ns, const char *name, size_t len);
 extern const char* as_bin_get_name_from_id(as_namespace *ns, uint16_t id);
 extern bool as_bin_name_within_quota(as_namespace *ns, const char *name);
 extern uint16_t as_bin_get_n_bins(as_record *r, as_storage_rd *rd);
 extern as_bin *as_bin_get_all(as_record *r, as_storage_rd *rd, as_bin *stack_bins);
+extern as_bin *as_bin_get_some(as_record *r, as_storage_rd *rd, as_bin *stack_bins, const uint16_t *ids, uint16_t n_ids);
 extern int as_storage_rd_load_bins(as_storage_rd *rd, as_bin *stack_bins);
+extern uint16_t as_bin_get_n_bins_dim(as_record *r);
+extern uint16_t as_bin_get_n_bins_ssd(as_storage_rd *rd);
+extern void as_storage_rd_load_bins_dim(as_storage_rd *rd, bool single_bin);
+extern int as_storage_rd_load_bins_ssd(as_storage_rd *rd, as_bin *stack_bins);
 extern void as_bin_get_all_p(as_storage_rd *rd, as_bin **bin_ptrs);
 extern as_bin *as_bin_create(as_storage_rd *rd, const char *name);
 extern as_bin *as_bin_create_from_buf(as_storage_rd *rd, uint8_t *name, size_t namesz);
@@ -505,6 +572,8 @@ extern void as_bin_destroy(as_storage_rd *rd, uint16_t i);
 extern void as_bin_destroy_from(as_storage_rd *rd, uint16_t i);
 extern void as_bin_destroy_all(as_storage_rd *rd);
 extern uint16_t as_bin_inuse_count(as_storage_rd *rd);
+extern void as_bin_index_attach(as_storage_rd *rd);
+extern void as_bin_index_detach(as_storage_rd *rd);
 extern void as_bin_all_dump(as_storage_rd *rd, char *msg);
 
 extern void as_bin_init(as_namespace *ns, as_bin *b, const char *name);
@@ -531,6 +600,19 @@ typedef enum {
 	AS_NAMESPACE_CONFLICT_RESOLUTION_POLICY_LAST_UPDATE_TIME = 2
 } conflict_resolution_pol;
 
+typedef enum {
+	AS_INDEX_NUMA_POLICY_NONE = 0,
+	AS_INDEX_NUMA_POLICY_INTERLEAVE = 1
+} as_index_numa_policy;
+
+// Values match compression_type in packet_compression.h.
+typedef enum {
+	AS_STORAGE_COMPRESSION_NONE = 0,
+	AS_STORAGE_COMPRESSION_ZLIB = 1,
+	AS_STORAGE_COMPRESSION_LZ4 = 2,
+	AS_STORAGE_COMPRESSION_ZSTD = 3
+} as_storage_compression;
+
 /* Record function declarations */
 // special - get_create returns 1 if created, 0 if just gotten, -1 if fail
 extern int as_record_get_create(struct as_index_tree_s *tree, cf_digest *keyd, as_index_ref *r_ref, as_namespace *ns, bool);
@@ -545,8 +627,8 @@ extern void as_record_clean_bins(as_storage_rd *rd);
 extern void as_record_destroy(as_record *r, as_namespace *ns);
 extern void as_record_done(as_index_ref *r_ref, as_namespace *ns);
 
-extern void as_record_allocate_key(as_record* r, const uint8_t* key, uint32_t key_size);
-extern void as_record_remove_key(as_record* r);
+extern void as_record_allocate_key(as_record* r, as_namespace* ns, const uint8_t* key, uint32_t key_size);
+extern void as_record_remove_key(as_record* r, as_namespace* ns);
 extern int as_record_resolve_conflict(conflict_resolution_pol policy, uint16_t left_gen, uint64_t left_lut, uint32_t left_vt, uint16_t right_gen, uint64_t right_lut, uint32_t right_vt);
 extern int as_record_pickle(as_record *r, as_storage_rd *rd, uint8_t **buf_r, size_t *len_r);
 extern uint32_t as_record_buf_get_stack_particles_sz(uint8_t *buf);
@@ -616,6 +698,7 @@ extern int as_record_flatten(as_partition_reservation *rsv, cf_digest *keyd,
 // a simpler call that gives seconds in the right epoch
 #define as_record_void_time_get() cf_clepoch_seconds()
 bool as_record_is_expired(as_record *r); // TODO - eventually inline
+bool as_record_is_doomed(as_record *r, as_namespace *ns);
 
 
 // Counter that tells clients partition ownership has changed.
@@ -670,6 +753,17 @@ as_partition_getid(cf_digest d)
 //	return((as_partition_id)((*(as_partition_id *)&d.digest[0]) & AS_PARTITION_MASK));
 }
 
+/* as_digest_spread_hash
+ * Hash for spreading records over cache sets, lock stripes, etc. - digest bytes
+ * [8-11], clear of bytes [0-3], which give the partition id, index tree sprig
+ * and record lock. Byte [8] also picks the device, so this doesn't spread well
+ * over records of a single device. */
+static inline uint32_t
+as_digest_spread_hash(const cf_digest *keyd)
+{
+	return *(const uint32_t *)&keyd->digest[DIGEST_STORAGE_BYTE];
+}
+
 
 
 
@@ -679,6 +773,10 @@ as_partition_getid(cf_digest d)
 struct as_partition_s {
 	pthread_mutex_t lock;
 
+	// For lock-free reservations - the version is odd while the lock is held.
+	cf_atomic32 state_version;
+	cf_atomic32 n_fast_reservations; // lock-free reservations in flight
+
 	cf_node replica[AS_CLUSTER_SZ];
 	/* origin: the node that is replicating to us. For master, origin could be "acting master" during migration.
 	 * target: an actual master that we're migrating to */
@@ -701,9 +799,18 @@ struct as_partition_s {
 	// the maximum void time of all records in the tree below
 	cf_atomic_int max_void_time;
 
+	// For delta migration - the maximum last-update-time of loaded and written
+	// records, not trusted after an incomplete immigration.
+	cf_atomic_int max_last_update_time;
+	bool max_last_update_time_valid;
+
 	// the actual data
 	struct as_index_tree_s *vp;
 	struct as_index_tree_s *sub_vp;
+	struct as_expire_index_s *expire_index; // null unless expiration-index is configured
+	struct as_set_index_s *set_index; // null unless a set is configured with set-index
+	struct as_incr_hist_s *incr_hist; // null unless incremental-histograms is configured
+	struct as_partition_changelog_s *changelog; // null unless migrate-changelog-entries is configured
 	as_partition_id partition_id;
 	uint p_repl_factor;
 
@@ -712,7 +819,15 @@ struct as_partition_s {
 	uint64_t current_incoming_ldt_version;
 };
 
-#define AS_PARTITION_HAS_DATA(p)  ((p)->vp->elements || (p)->sub_vp->elements)
+#define AS_PARTITION_HAS_DATA(p)  (as_index_tree_size((p)->vp) || as_index_tree_size((p)->sub_vp))
+
+// Call wherever a record loaded or written (not migrated) sets its
+// last-update-time.
+static inline void
+as_partition_max_lut_update(as_partition *p, uint64_t last_update_time)
+{
+	cf_atomic_int_setmax(&p->max_last_update_time, last_update_time);
+}
 
 /* as_partition_reservation
  * A structure to hold state on a reserved partition
@@ -765,6 +880,8 @@ struct as_partition_reservation_s {
 extern void as_partition_init(as_partition *p, as_namespace *ns, int pid);
 extern void as_partition_reinit(as_partition *p, as_namespace *ns, int pid);
 extern bool is_partition_null(as_partition_vinfo *vinfo);
+extern bool as_partition_vinfo_is_ancestor(const as_partition_vinfo *ancestor, const as_partition_vinfo *vinfo);
+extern bool as_partition_get_delta_info(as_namespace *ns, as_partition_id pid, as_partition_vinfo *vinfo, uint64_t *max_lut);
 extern cf_node as_partition_getreplica_read(as_namespace *ns, as_partition_id p);
 extern int as_partition_getreplica_readall(as_namespace *ns, as_partition_id p, cf_node *nv);
 extern cf_node as_partition_getreplica_write(as_namespace *ns, as_partition_id p);
@@ -781,6 +898,7 @@ extern int as_partition_reserve_migrate_timeout(as_namespace *ns, as_partition_i
 extern int as_partition_reserve_xdr_read(as_namespace *ns, as_partition_id pid, as_partition_reservation *rsv);
 // reserve_read - 
 extern int as_partition_reserve_read(as_namespace *ns, as_partition_id pid, as_partition_reservation *rsv, cf_node *node, uint64_t *cluster_key);
+extern int as_partition_reserve_read_prefer_rack(as_namespace *ns, as_partition_id pid, as_partition_reservation *rsv, cf_node *node, uint64_t *cluster_key);
 
 extern void as_partition_reservation_copy(as_partition_reservation *dst, as_partition_reservation *src);
 extern void as_partition_release(as_partition_reservation *rsv);
@@ -791,7 +909,7 @@ extern void as_partition_getreplica_read_str(cf_dyn_buf *db);
 extern void as_partition_getreplica_prole_str(cf_dyn_buf *db);
 extern void as_partition_getreplica_write_str(cf_dyn_buf *db);
 extern void as_partition_getreplica_master_str(cf_dyn_buf *db);
-extern void as_partition_get_replicas_all_str(cf_dyn_buf *db);
+extern void as_partition_get_replicas_all_str(cf_dyn_buf *db, bool include_rack);
 extern void as_partition_getinfo_str(cf_dyn_buf *db);
 extern uint64_t as_partition_remaining_migrations();
 
@@ -936,6 +1054,38 @@ typedef struct client_replica_map_s {
 extern void client_replica_maps_create(as_namespace* ns);
 extern bool client_replica_maps_update(as_namespace* ns, as_partition_id pid);
 
+// Transaction stages, each with a tracked latency histogram per namespace.
+// Each stage is measured from the end of the previous one.
+typedef enum {
+	AS_STAGE_READ_QUEUE,
+	AS_STAGE_READ_DUP_RES,
+	AS_STAGE_READ_LOCK,
+	AS_STAGE_READ_STORAGE,
+	AS_STAGE_READ_RESPONSE,
+
+	AS_STAGE_WRITE_QUEUE,
+	AS_STAGE_WRITE_DUP_RES,
+	AS_STAGE_WRITE_LOCK,
+	AS_STAGE_WRITE_MASTER,
+	AS_STAGE_WRITE_REPL_WRITE,
+	AS_STAGE_WRITE_RESPONSE,
+
+	AS_NUM_STAGES
+} as_stage;
+
+extern const char* const as_stage_names[AS_NUM_STAGES];
+
+// Most stages of any one transaction type - writes.
+#define AS_MAX_OP_STAGES (AS_NUM_STAGES - AS_STAGE_WRITE_QUEUE)
+
+// Index of a stage among its transaction type's stages.
+static inline uint32_t
+as_stage_op_index(as_stage stage)
+{
+	return stage < AS_STAGE_WRITE_QUEUE ?
+			(uint32_t)stage : (uint32_t)(stage - AS_STAGE_WRITE_QUEUE);
+}
+
 
 struct as_namespace_s {
 
@@ -966,6 +1116,19 @@ struct as_namespace_s {
 	as_set*			sets_cfg_array;
 	uint32_t		sets_cfg_count;
 
+	//--------------------------------------------
+	// Truncation.
+	//
+
+	// Records last updated before this are treated as deleted - 0 if none.
+	uint64_t		truncate_lut;
+
+	// If false, no set has a truncate cutoff - skip set lookups.
+	bool			any_set_truncated;
+
+	// Non-zero while namespace is queued for truncate cleanup.
+	cf_atomic32		truncate_pending;
+
 	//--------------------------------------------
 	// Cold-start.
 	//
@@ -981,6 +1144,7 @@ struct as_namespace_s {
 	uint32_t		cold_start_record_add_count;
 	cf_atomic32		cold_start_threshold_void_time;
 	uint32_t		cold_start_max_void_time;
+	struct cold_start_counts_s* cold_start_counts; // void-times of evictable records loaded
 
 	//--------------------------------------------
 	// Memory management.
@@ -991,9 +1155,15 @@ struct as_namespace_s {
 	int jem_arena;
 #endif
 
+	// Slab pools for bin spaces and record spaces, if bin-space-slabs is set.
+	struct as_dim_slab_pool_s* dim_slab_pool;
+
 	// Cached partition ownership info for clients.
 	client_replica_map* replica_maps;
 
+	// Hot-key sketch, created on first sample if hot-key-sample-rate is set.
+	struct as_hot_keys_s* volatile hot_keys;
+
 	//--------------------------------------------
 	// Storage management.
 	//
@@ -1005,6 +1175,7 @@ struct as_namespace_s {
 	int				storage_min_free_wblocks; // the number of wblocks per device to "reserve"
 	int				storage_last_avail_pct; // most recently calculated available percent
 	int				storage_max_write_q; // storage_max_write_cache is converted to this
+	int				storage_shadow_max_write_q; // storage_shadow_max_write_cache is converted to this
 	uint32_t		saved_defrag_sleep; // restore after defrag at startup is done
 	uint32_t		defrag_lwm_size; // storage_defrag_lwm_pct % of storage_write_block_size
 
@@ -1013,11 +1184,8 @@ struct as_namespace_s {
 	// TODO - could use n_devices in general, if we set it during config parse.
 	int				n_devices; // if using queue-per-device, store the number of devices used by this namespace
 	int				dev_q_offset; // if using queue-per-device, where this namespace's transaction queues are
-
-	// For data-not-in-memory, we optionally cache swbs after writing to device.
-	// To track fraction of reads from cache:
-	cf_atomic32		n_reads_from_cache;
-	cf_atomic32		n_reads_from_device;
+	uint32_t		tsvc_q_offset; // if transaction-queues is set, where this namespace's dedicated queues are
+	uint32_t		tsvc_q_next; // round-robin over the dedicated queues
 
 	//--------------------------------------------
 	// Secondary index.
@@ -1031,6 +1199,7 @@ struct as_namespace_s {
 
 	// Temporary structure to hold si config values until smd-bootup is done.
 	shash*			sindex_cfg_var_hash;
+	uint64_t		sindex_boot_start_ms; // when boot population started
 
 	//--------------------------------------------
 	// Configuration.
@@ -1047,8 +1216,11 @@ struct as_namespace_s {
 	PAD_BOOL		ns_allow_nonxdr_writes; // namespace-level flag to allow nonxdr writes or not
 	PAD_BOOL		ns_allow_xdr_writes; // namespace-level flag to allow xdr writes or not
 
+	PAD_BOOL		async_replication; // replica writes are logged and streamed - writes don't wait for acks
+	uint64_t		async_replication_max_lag; // bytes per destination before writes are refused
 	uint32_t		cold_start_evict_ttl;
 	conflict_resolution_pol conflict_resolution_policy;
+	PAD_BOOL		bin_space_slabs; // data-in-memory bin spaces and record spaces come from slab pools
 	PAD_BOOL		data_in_index; // with single-bin, allows warm restart for data-in-memory (with storage-engine device)
 	PAD_BOOL		disallow_null_setname;
 	PAD_BOOL		batch_sub_benchmarks_enabled;
@@ -1058,21 +1230,41 @@ struct as_namespace_s {
 	PAD_BOOL		udf_sub_benchmarks_enabled;
 	PAD_BOOL		write_benchmarks_enabled;
 	PAD_BOOL		proxy_hist_enabled;
+	PAD_BOOL		stage_hist_enabled; // per-stage latency of reads & writes
+	PAD_BOOL		evict_continuous; // with expiration-index, evict a bucket of soonest-expiring records per second
 	uint32_t		evict_hist_buckets;
 	uint32_t		evict_tenths_pct;
+	PAD_BOOL		expiration_index; // nsup expires via per-partition void-time buckets
+	PAD_BOOL		set_index; // some set is configured with set-index
 	float			hwm_disk;
 	float			hwm_memory;
+	PAD_BOOL		incremental_histograms; // object size & TTL histograms counted on write & delete
+	char*			index_flash_path; // index stage files go here, mapped in - NULL means index in memory
+	as_index_numa_policy index_numa_policy;
+	uint64_t		index_page_size; // 4K means no huge pages
 	PAD_BOOL		ldt_enabled;
 	uint32_t		ldt_gc_sleep_us;
 	uint32_t		ldt_page_size;
 	uint64_t		max_ttl;
+	char*			memory_snapshot_dir; // storage-engine memory only - null means no snapshots
+	uint64_t		memory_snapshot_max_write_rate; // bytes per second - 0 means unlimited
+	uint32_t		memory_snapshot_period; // seconds - 0 means only at shutdown
+	uint32_t		memory_snapshot_threads;
+	PAD_BOOL		migrate_compression; // zlib-compress emigrated records
+	PAD_BOOL		migrate_delta; // after short outages, emigrate only newer records
+	uint32_t		migrate_changelog_entries; // per partition - 0 means no changelog
+	uint32_t		migrate_changelog_max_age; // seconds - older delta migrations reduce the tree
 	uint32_t		migrate_order;
 	uint32_t		migrate_sleep;
+	uint32_t		nsup_period; // 0 means use service nsup-period
 	cf_atomic32		obj_size_hist_max; // TODO - doesn't need to be atomic, really.
+	uint32_t		tree_sprigs; // power of 2 - sub-trees per partition tree
+	PAD_BOOL		read_coalescing; // hot key client reads share one device read
 	as_policy_consistency_level read_consistency_level;
 	PAD_BOOL		read_consistency_level_override;
 	PAD_BOOL		single_bin; // restrict the namespace to objects with exactly one bin
 	float			stop_writes_pct;
+	uint32_t		transaction_queues; // dedicated to this namespace - 0 means it uses the shared queues
 	as_policy_commit_level write_commit_level;
 	PAD_BOOL		write_commit_level_override;
 
@@ -1086,17 +1278,34 @@ struct as_namespace_s {
 	uint32_t		storage_write_block_size;
 	PAD_BOOL		storage_data_in_memory;
 	PAD_BOOL		storage_cold_start_empty;
+	PAD_BOOL		storage_fast_restart;
+	uint32_t		storage_cold_start_threads;
+	PAD_BOOL		storage_defrag_live_map; // track live records per rblock, so defrag skips dead ones
 	uint32_t		storage_defrag_lwm_pct;
 	uint32_t		storage_defrag_queue_min;
 	uint32_t		storage_defrag_sleep;
+	PAD_BOOL		storage_defrag_adaptive;
 	int				storage_defrag_startup_minimum;
 	PAD_BOOL		storage_disable_odirect;
 	PAD_BOOL		storage_enable_osync;
 	uint64_t		storage_flush_max_us;
 	uint64_t		storage_fsync_max_us;
+	uint32_t		storage_max_flush_size; // most bytes of adjacent wblocks to write at once
 	uint64_t		storage_max_write_cache;
 	uint32_t		storage_min_avail_pct;
 	cf_atomic32 	storage_post_write_queue; // number of swbs/device held after writing to device
+	uint64_t		storage_read_cache_size; // bytes of memory for the read cache (0 = no cache)
+	uint64_t		storage_ldt_subrec_cache_size; // bytes of memory kept for LDT sub-records only (0 = none)
+	uint64_t		storage_shadow_max_write_cache;
+	PAD_BOOL		storage_shadow_stop_writes_on_lag; // if false, drop shadow writes past the limit instead
+	uint32_t		storage_shadow_write_threads;
+	as_storage_compression storage_compression;
+	uint32_t		storage_compression_level;
+	PAD_BOOL		storage_persist_map_indexes; // flatten ordered maps with their indexes
+	PAD_BOOL		storage_touch_index_only; // touches update only the index - defrag updates the device copy
+	uint32_t		storage_ttl_write_streams; // current swbs per device, by TTL class
+	PAD_BOOL		storage_weighted_placement; // spread records over devices in proportion to device size
+	PAD_BOOL		storage_wblock_summaries; // trail wblocks with record metadata, for fast cold start
 	uint32_t		storage_write_threads;
 
 	uint32_t		storage_read_block_size;
@@ -1105,6 +1314,7 @@ struct as_namespace_s {
 
 	uint64_t		sindex_data_max_memory;
 	uint32_t		sindex_num_partitions;
+	char*			sindex_snapshot_file; // save at shutdown, load at warm restart
 
 	PAD_BOOL		geo2dsphere_within_strict;
 	uint16_t		geo2dsphere_within_min_level;
@@ -1116,15 +1326,22 @@ struct as_namespace_s {
 	//--------------------------------------------
 	// Statistics and histograms.
 	//
+	// Written by transaction and background threads - so from here on starts a
+	// fresh cache line, and stays off the read-mostly lines above. Per-read and
+	// per-write counts are shard counters, which occupy whole lines.
+	//
 
-	// Object counts.
+	// Object counts, and memory usage - exact, as limits are checked against
+	// them, and sharing one line.
 
-	cf_atomic_int	n_objects;
+	cf_atomic_int	n_objects __attribute__ ((aligned(SHARD_COUNTER_LINE_SZ)));
 	cf_atomic_int	n_sub_objects;
+	cf_atomic_int	n_bytes_memory;
+	cf_atomic64		sindex_data_memory_used;
 
 	// Expiration & eviction (nsup) stats.
 
-	cf_atomic32		stop_writes;
+	cf_atomic32		stop_writes __attribute__ ((aligned(SHARD_COUNTER_LINE_SZ)));
 	cf_atomic32		hwm_breached;
 
 	cf_atomic_int	max_void_time;
@@ -1133,20 +1350,40 @@ struct as_namespace_s {
 	cf_atomic64		n_expired_objects;
 	cf_atomic64		n_evicted_objects;
 	cf_atomic64		n_deleted_set_objects;
+	cf_atomic64		n_truncated_objects;
 
 	cf_atomic64		evict_ttl;
 
 	uint32_t		nsup_cycle_duration; // seconds taken for most recent nsup cycle
 	uint32_t		nsup_cycle_sleep_pct; // fraction of most recent nsup cycle that was spent sleeping
 
-	// Memory usage stats.
-
-	cf_atomic_int	n_bytes_memory;
-	cf_atomic64		sindex_data_memory_used;
+	cf_atomic32		non_master_gc_pid; // partition non-master garbage collection is in, -1 for none
+	cf_atomic32		non_master_gc_sets_delete; // non-master garbage collection is deleting sets' records
+	cf_atomic64		n_non_master_gc_expired_objects;
+	cf_atomic64		n_non_master_gc_deleted_set_objects;
 
 	// Persistent storage stats.
 
+	// For data-not-in-memory, we optionally cache swbs after writing to device.
+	// To track fraction of reads from cache - the ticker works it out from the
+	// change in totals since it last looked:
 	float			cache_read_pct;
+	uint64_t		last_n_reads_from_cache;
+	uint64_t		last_n_reads_from_device;
+	cf_shard_counter	n_reads_from_cache;
+	cf_shard_counter	n_reads_from_device;
+
+	// For data-not-in-memory, we optionally cache records read from device:
+	cf_shard_counter	n_read_cache_hits;
+	cf_shard_counter	n_read_cache_misses;
+
+	// With LDT, hot sub-records may optionally have a cache of their own:
+	cf_shard_counter	n_ldt_subrec_cache_hits;
+	cf_shard_counter	n_ldt_subrec_cache_misses;
+
+	// For devices with compression enabled, to track the compression ratio:
+	cf_shard_counter	n_compression_orig_bytes;
+	cf_shard_counter	n_compression_bytes;
 
 	// Migration stats.
 
@@ -1159,40 +1396,81 @@ struct as_namespace_s {
 	cf_atomic_int	migrate_tx_partitions_remaining;
 	cf_atomic_int	migrate_rx_partitions_initial;
 	cf_atomic_int	migrate_rx_partitions_remaining;
+	cf_atomic_int	migrate_tx_partitions_delta;
+	cf_atomic_int	migrate_tx_partitions_changelog;
 
 	// Per-record migration stats:
 	cf_atomic_int	migrate_records_skipped; // relevant only for enterprise edition
 	cf_atomic_int	migrate_records_transmitted;
 	cf_atomic_int	migrate_record_retransmits;
 	cf_atomic_int	migrate_record_receives;
+	cf_atomic_int	migrate_compression_orig_bytes;
+	cf_atomic_int	migrate_compression_bytes;
+	cf_atomic_int	migrate_decompression_errors;
+	cf_atomic_int	migrate_delta_records_skipped;
 
 	// From-client transaction stats.
 
 	cf_atomic64		n_client_tsvc_error;
 	cf_atomic64		n_client_tsvc_timeout;
 
+	// Transactions of any origin dropped past their deadline, at dequeue or
+	// before storage I/O.
+	cf_atomic64		n_deadline_drops;
+
+	// Writes that replaced an existing device record without reading it.
+	cf_atomic64		n_blind_writes;
+
+	// Time transactions waited in this namespace's dedicated queues.
+	cf_atomic64		n_tsvc_queue_waits;
+	cf_atomic64		tsvc_queue_wait_us;
+
+	// Memory snapshot stats - of the last completed snapshot, and of the load
+	// at startup.
+	uint64_t		memory_snapshot_count;
+	uint64_t		memory_snapshot_last_ms;
+	uint64_t		memory_snapshot_last_records;
+	uint64_t		memory_snapshot_last_bytes;
+	uint64_t		memory_snapshot_loaded_records;
+
+	// Admission control - current level, device write latency accumulated for
+	// the next sample, and work shed or delayed.
+	uint32_t		admission_level;
+	cf_atomic64		admission_device_write_ns;
+	cf_atomic64		admission_device_writes;
+	cf_atomic64		n_admission_scan_shed;
+	cf_atomic64		n_admission_udf_bg_shed;
+	cf_atomic64		n_admission_migrate_delays;
+	cf_atomic64		n_admission_write_shed;
+
+	cf_atomic64		n_async_repl_writes;
+	cf_atomic64		n_async_repl_rejected;
+	cf_atomic64		n_async_repl_dropped_bytes;
+	cf_atomic64		n_async_repl_fallbacks;
+
 	cf_atomic64		n_client_proxy_complete;
 	cf_atomic64		n_client_proxy_error;
 	cf_atomic64		n_client_proxy_timeout;
 
-	cf_atomic64		n_client_read_success;
-	cf_atomic64		n_client_read_error;
-	cf_atomic64		n_client_read_timeout;
-	cf_atomic64		n_client_read_not_found;
+	cf_shard_counter	n_client_read_success;
+	cf_shard_counter	n_client_read_error;
+	cf_shard_counter	n_client_read_timeout;
+	cf_shard_counter	n_client_read_not_found;
+	cf_atomic64		n_client_read_coalesced; // subset of n_client_read_... above
 
-	cf_atomic64		n_client_write_success;
-	cf_atomic64		n_client_write_error;
-	cf_atomic64		n_client_write_timeout;
+	cf_shard_counter	n_client_write_success;
+	cf_shard_counter	n_client_write_error;
+	cf_shard_counter	n_client_write_timeout;
 
 	// Subset of n_client_write_... above, respectively.
 	cf_atomic64		n_xdr_write_success;
 	cf_atomic64		n_xdr_write_error;
 	cf_atomic64		n_xdr_write_timeout;
 
-	cf_atomic64		n_client_delete_success;
-	cf_atomic64		n_client_delete_error;
-	cf_atomic64		n_client_delete_timeout;
-	cf_atomic64		n_client_delete_not_found;
+	cf_shard_counter	n_client_delete_success;
+	cf_shard_counter	n_client_delete_error;
+	cf_shard_counter	n_client_delete_timeout;
+	cf_shard_counter	n_client_delete_not_found;
 
 	cf_atomic64		n_client_udf_complete;
 	cf_atomic64		n_client_udf_error;
@@ -1212,10 +1490,19 @@ struct as_namespace_s {
 	cf_atomic64		n_batch_sub_proxy_error;
 	cf_atomic64		n_batch_sub_proxy_timeout;
 
-	cf_atomic64		n_batch_sub_read_success;
-	cf_atomic64		n_batch_sub_read_error;
-	cf_atomic64		n_batch_sub_read_timeout;
-	cf_atomic64		n_batch_sub_read_not_found;
+	cf_shard_counter	n_batch_sub_read_success;
+	cf_shard_counter	n_batch_sub_read_error;
+	cf_shard_counter	n_batch_sub_read_timeout;
+	cf_shard_counter	n_batch_sub_read_not_found;
+
+	cf_atomic64		n_batch_sub_write_success;
+	cf_atomic64		n_batch_sub_write_error;
+	cf_atomic64		n_batch_sub_write_timeout;
+
+	cf_atomic64		n_batch_sub_delete_success;
+	cf_atomic64		n_batch_sub_delete_error;
+	cf_atomic64		n_batch_sub_delete_timeout;
+	cf_atomic64		n_batch_sub_delete_not_found;
 
 	// Internal-UDF sub-transaction stats.
 
@@ -1274,6 +1561,7 @@ struct as_namespace_s {
 	// Geospatial query stats:
 	cf_atomic64		geo_region_query_count;		// number of region queries
 	cf_atomic64		geo_region_query_cells;		// number of cells used by region queries
+	cf_atomic64		geo_region_query_cache_hits;	// number of region queries with cached coverings
 	cf_atomic64		geo_region_query_points;	// number of valid points found
 	cf_atomic64		geo_region_query_falsepos;	// number of false positives found
 
@@ -1287,6 +1575,7 @@ struct as_namespace_s {
 	// Special non-error counters:
 
 	cf_atomic64		n_deleted_last_bin;
+	cf_atomic64		n_index_only_touches;
 
 	// LDT stats.
 
@@ -1310,6 +1599,8 @@ struct as_namespace_s {
 
 	histogram*		proxy_hist;
 
+	cf_hist_track*	stage_hists[AS_NUM_STAGES]; // tracked histograms
+
 	histogram*		read_start_hist;
 	histogram*		read_restart_hist;
 	histogram*		read_dup_res_hist;
@@ -1343,6 +1634,15 @@ struct as_namespace_s {
 	histogram*		udf_sub_repl_write_hist;
 	histogram*		udf_sub_response_hist;
 
+	// Per-set tracked latency histograms, indexed by set-id - created the
+	// first time a set's latency histograms are enabled via set-config.
+	cf_atomic32		n_set_latency_enabled;
+	bool			set_latency_enabled[AS_SET_MAX_COUNT + 1];
+	cf_hist_track*	set_read_hists[AS_SET_MAX_COUNT + 1];
+	cf_hist_track*	set_write_hists[AS_SET_MAX_COUNT + 1];
+	cf_hist_track*	set_udf_hists[AS_SET_MAX_COUNT + 1];
+	cf_hist_track*	set_query_hists[AS_SET_MAX_COUNT + 1];
+
 	// Histograms of master object storage sizes. (Meaningful for drive-backed
 	// namespaces only.)
 	linear_hist*	obj_size_hist;
@@ -1381,19 +1681,36 @@ struct as_set_s {
 	char			name[AS_SET_NAME_MAX_SIZE];
 	cf_atomic64		num_elements;
 	cf_atomic64		n_bytes_memory;		// for data-in-memory only - sets's total record data size
+	cf_atomic64		n_bytes_device;		// for storage-engine device only - set's total record device size
 	cf_atomic64		stop_writes_count;	// restrict number of records in a set
-	cf_atomic32		unused2;
+	cf_atomic64		memory_quota;		// stop writes, and evict, when the set's data in memory exceeds this
+	cf_atomic64		disk_quota;			// stop writes, and evict, when the set's data on device exceeds this
+	cf_atomic32		evict_priority;		// general eviction takes lower priority sets first
+	cf_atomic32		set_index;			// keep a per-partition membership index (configured only)
 	cf_atomic32		deleted;			// empty a set (triggered via info command only)
 	cf_atomic32		disable_eviction;	// don't evict anything in this set (note - expiration still works)
 	cf_atomic32		enable_xdr;			// white-list (AS_SET_ENABLE_XDR_TRUE) or black-list (AS_SET_ENABLE_XDR_FALSE) a set for XDR replication
+	uint64_t		truncate_lut;		// records last updated before this are treated as deleted
 };
 
+static inline bool
+as_set_over_quota(as_set *p_set) {
+	uint64_t memory_quota = cf_atomic64_get(p_set->memory_quota);
+	uint64_t disk_quota = cf_atomic64_get(p_set->disk_quota);
+
+	return (memory_quota != 0 &&
+			cf_atomic64_get(p_set->n_bytes_memory) >= memory_quota) ||
+			(disk_quota != 0 &&
+					cf_atomic64_get(p_set->n_bytes_device) >= disk_quota);
+}
+
 static inline bool
 as_set_stop_writes(as_set *p_set) {
 	uint64_t num_elements = cf_atomic64_get(p_set->num_elements);
 	uint64_t stop_writes_count = cf_atomic64_get(p_set->stop_writes_count);
 
-	return stop_writes_count != 0 && num_elements >= stop_writes_count;
+	return (stop_writes_count != 0 && num_elements >= stop_writes_count) ||
+			as_set_over_quota(p_set);
 }
 
 // These bin functions must be below definition of struct as_namespace_s:
@@ -1448,7 +1765,10 @@ extern uint16_t as_namespace_get_set_id(as_namespace *ns, const char *set_name);
 extern uint16_t as_namespace_get_create_set_id(as_namespace *ns, const char *set_name);
 extern void as_namespace_get_set_info(as_namespace *ns, const char *set_name, cf_dyn_buf *db);
 extern void as_namespace_adjust_set_memory(as_namespace *ns, uint16_t set_id, int64_t delta_bytes);
+extern void as_namespace_adjust_set_device(as_namespace *ns, uint16_t set_id, int64_t delta_bytes);
 extern void as_namespace_release_set_id(as_namespace *ns, uint16_t set_id);
+extern void as_namespace_enable_set_latency(as_namespace *ns, uint16_t set_id, bool enable);
+extern uint16_t as_namespace_get_latency_set_id(as_namespace *ns, const char *set_name, size_t len);
 extern void as_namespace_get_bins_info(as_namespace *ns, cf_dyn_buf *db, bool show_ns);
 extern void as_namespace_get_hist_info(as_namespace *ns, char *set_name, char *hist_name,
 		cf_dyn_buf *db, bool show_ns);
@@ -1467,6 +1787,8 @@ struct as_treex_s {
 };
 
 void as_namespace_xmem_trusted(as_namespace *ns);
+bool as_namespace_xmem_devices_match(as_namespace *ns, uint64_t device_random);
+void as_namespace_xmem_set_devices(as_namespace *ns, uint64_t device_random);
 void as_namespace_xmem_release(as_namespace* ns);
 
 // Not namespace class functions, but they live in namespace.c:
@@ -0,0 +1,64 @@
+/*
+ * dim_slab.h
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+#pragma once
+
+//==========================================================
+// Includes.
+//
+
+#include <stdint.h>
+
+#include "dynbuf.h"
+
+#include "base/datamodel.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+#define AS_DIM_SLAB_DEFAULT_MAX_FILL_PCT 50
+
+
+//==========================================================
+// Public API.
+//
+
+// All data-in-memory bin spaces and record spaces are allocated and freed
+// here. Without bin-space-slabs configured these are plain cf_malloc() etc.
+
+void as_dim_slab_init(as_namespace* ns);
+
+as_bin_space* as_dim_slab_alloc_bin_space(as_namespace* ns, uint16_t n_bins);
+as_bin_space* as_dim_slab_resize_bin_space(as_namespace* ns, as_bin_space* bin_space, uint16_t old_n_bins, uint16_t n_bins);
+void as_dim_slab_free_bin_space(as_namespace* ns, as_bin_space* bin_space, uint16_t n_bins);
+
+as_rec_space* as_dim_slab_alloc_rec_space(as_namespace* ns, uint32_t key_size);
+void as_dim_slab_free_rec_space(as_namespace* ns, as_rec_space* rec_space);
+
+// For data-in-memory compaction - caller holds the record lock.
+as_bin_space* as_dim_slab_compact_bin_space(as_namespace* ns, as_bin_space* bin_space);
+as_rec_space* as_dim_slab_compact_rec_space(as_namespace* ns, as_rec_space* rec_space);
+
+const char* as_dim_slab_compact_start(as_namespace* ns, uint32_t max_fill_pct);
+void as_dim_slab_get_info(as_namespace* ns, cf_dyn_buf* db);
@@ -0,0 +1,51 @@
+/*
+ * expire_index.h
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+#pragma once
+
+//==========================================================
+// Includes.
+//
+
+#include <stdint.h>
+
+#include "arenax.h"
+
+#include "base/datamodel.h"
+
+
+//==========================================================
+// Typedefs.
+//
+
+typedef struct as_expire_index_s as_expire_index;
+
+
+//==========================================================
+// Public API.
+//
+
+as_expire_index* as_expire_index_create();
+void as_expire_index_clear(as_expire_index* ei);
+uint32_t as_expire_index_pop_due(as_expire_index* ei, cf_arenax* arena, uint32_t now, cf_arenax_handle** p_handles);
+void as_expire_index_add(as_expire_index* ei, cf_arenax_handle r_h, uint32_t void_time);
+void as_expire_index_record_changed(as_namespace* ns, as_record* r, uint32_t old_void_time);
@@ -0,0 +1,62 @@
+/*
+ * hot_keys.h
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+
+/*
+ * Hot-key detection - 1 in hot-key-sample-rate reads and writes are counted
+ * in a per-namespace count-min sketch, and the keys with the highest counts
+ * kept in a small top-K heap. The hot-keys info command reports them, with
+ * estimated rates, over fixed sampling windows.
+ */
+
+#pragma once
+
+//==========================================================
+// Includes.
+//
+
+#include <stdint.h>
+
+#include "dynbuf.h"
+
+#include "base/cfg.h"
+#include "base/datamodel.h"
+#include "base/transaction.h"
+
+
+//==========================================================
+// Public API.
+//
+
+void as_hot_keys_record(as_namespace* ns, as_transaction* tr, uint32_t sample_rate);
+void as_hot_keys_get_info(as_namespace* ns, uint32_t max, cf_dyn_buf* db);
+
+// Call once a read or write has reserved its partition.
+static inline void
+as_hot_keys_sample(as_namespace* ns, as_transaction* tr)
+{
+	uint32_t sample_rate = g_config.hot_key_sample_rate;
+
+	if (sample_rate != 0) {
+		as_hot_keys_record(ns, tr, sample_rate);
+	}
+}
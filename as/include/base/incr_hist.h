@@ -0,0 +1,51 @@
+/*
+ * incr_hist.h
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+#pragma once
+
+//==========================================================
+// Includes.
+//
+
+#include <stdint.h>
+
+#include "linear_hist.h"
+
+#include "base/datamodel.h"
+
+
+//==========================================================
+// Typedefs.
+//
+
+typedef struct as_incr_hist_s as_incr_hist;
+
+
+//==========================================================
+// Public API.
+//
+
+as_incr_hist* as_incr_hist_create(as_namespace* ns);
+void as_incr_hist_void_time_changed(as_namespace* ns, as_record* r, uint32_t old_void_time);
+void as_incr_hist_size_changed(as_namespace* ns, as_record* r, uint32_t old_n_rblocks);
+void as_incr_hist_remove(as_namespace* ns, as_record* r);
+void as_incr_hist_get(as_namespace* ns, uint32_t now, uint32_t ttl_range, linear_hist* obj_size_hist, linear_hist* ttl_hist);
@@ -92,7 +92,8 @@ typedef struct as_index_s {
 	uint8_t flex_bits;
 
 	// offset: 56
-	// For data-not-in-memory namespaces, these 8 bytes are currently unused.
+	// For data-not-in-memory namespaces, these 8 bytes are not allocated - see
+	// AS_INDEX_COMPACT_SIZE below - and must never be touched.
 	// For data-in-memory namespaces: in single-bin mode the as_bin is embedded
 	// here (these 8 bytes plus the last 4 bits in flex_bits_2 above), but in
 	// multi-bin mode this is a pointer to either of:
@@ -109,14 +110,20 @@ typedef struct as_index_s {
 // Accessor functions for bits in as_index.
 //
 
-// Size in bytes of as_index, currently the same for all namespaces.
+// Size of as_index without dim - used for data-not-in-memory SSD namespaces.
+#define AS_INDEX_COMPACT_SIZE ((uint32_t)offsetof(as_index, dim))
+
+// Size in bytes of as_index, as allocated for this namespace.
 static inline
 uint32_t as_index_size_get(as_namespace *ns)
 {
-	return (uint32_t)sizeof(as_index);
+	return ns->storage_type == AS_STORAGE_ENGINE_SSD &&
+			! ns->storage_data_in_memory ?
+					AS_INDEX_COMPACT_SIZE : (uint32_t)sizeof(as_index);
 }
 
-// Fast way to clear the record portion of as_index.
+// Fast way to clear the record portion of as_index. Doesn't clear dim, which
+// may not exist - as_record_initialize() takes care of it.
 // Note - relies on current layout and size of as_index!
 static inline
 void as_index_clear_record_info(as_index *index) {
@@ -124,7 +131,6 @@ void as_index_clear_record_info(as_index *index) {
 
 	uint64_t *p_clear = (uint64_t*)((uint8_t*)index + 40);
 
-	*p_clear++	= 0;
 	*p_clear++	= 0;
 	*p_clear	= 0;
 }
@@ -294,8 +300,14 @@ typedef void (*as_index_value_destructor) (as_index *v, void *udata);
 //==========================================================
 // Index tree.
 //
+// A tree is split into a power-of-2 number of "sprigs" - independent red-black
+// trees selected by digest, each with its own root and locks. The sprigs share
+// the tree's sentinel, which is never modified.
+//
 
-typedef struct as_index_tree_s {
+#define AS_INDEX_MAX_SPRIGS 4096
+
+typedef struct as_index_sprig_s {
 	// Note: reduce_lock's scope is always inside of lock's scope.
 	pthread_mutex_t		lock;        // insert, delete vs. insert, delete, get
 	pthread_mutex_t		reduce_lock; // insert, delete vs. reduce
@@ -303,6 +315,14 @@ typedef struct as_index_tree_s {
 	as_index			*root;
 	cf_arenax_handle	root_h;
 
+	uint32_t			elements; // not making this atomic, it's not very exact
+
+	// Odd while the sprig's structure is changing - bumped under lock, by
+	// insert and delete. Lets reads search without the lock.
+	cf_atomic32			seq;
+} as_index_sprig;
+
+typedef struct as_index_tree_s {
 	cf_arenax_handle	sentinel_h;
 
 	as_index_value_destructor destructor;
@@ -310,7 +330,8 @@ typedef struct as_index_tree_s {
 
 	cf_arenax			*arena; // where we allocate and free to
 
-	uint32_t			elements; // not making this atomic, it's not very exact
+	uint32_t			n_sprigs; // power of 2
+	as_index_sprig		sprigs[];
 } as_index_tree;
 
 
@@ -318,8 +339,9 @@ typedef struct as_index_tree_s {
 // as_index_tree public API.
 //
 
-extern as_index_tree *as_index_tree_create(cf_arenax *arena, as_index_value_destructor destructor, void *destructor_udata, as_treex *p_treex);
-extern as_index_tree *as_index_tree_resume(cf_arenax *arena, as_index_value_destructor destructor, void *destructor_udata, as_treex *p_treex);
+// If p_treex is not null, it must point to an n_sprigs array.
+extern as_index_tree *as_index_tree_create(cf_arenax *arena, uint32_t n_sprigs, as_index_value_destructor destructor, void *destructor_udata, as_treex *p_treex);
+extern as_index_tree *as_index_tree_resume(cf_arenax *arena, uint32_t n_sprigs, as_index_value_destructor destructor, void *destructor_udata, as_treex *p_treex);
 extern int as_index_tree_release(as_index_tree *tree, void *destructor_udata);
 extern uint32_t as_index_tree_size(as_index_tree *tree);
 
@@ -328,6 +350,8 @@ typedef void (*as_index_reduce_sync_fn) (as_index *value, void *udata);
 
 extern void as_index_reduce(as_index_tree *tree, as_index_reduce_fn cb, void *udata);
 extern void as_index_reduce_partial(as_index_tree *tree, uint32_t sample_count, as_index_reduce_fn cb, void *udata);
+extern void as_index_reduce_range(as_index_tree *tree, cf_digest *lo_keyd, cf_digest *hi_keyd, as_index_reduce_fn cb, void *udata);
+extern uint32_t as_index_reduce_from(as_index_tree *tree, cf_digest *keyd, uint32_t max_count, as_index_reduce_fn cb, void *udata);
 extern void as_index_reduce_sync(as_index_tree *tree, as_index_reduce_sync_fn cb, void *udata);
 
 extern int as_index_exists(as_index_tree *tree, cf_digest *keyd);
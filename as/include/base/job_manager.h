@@ -27,9 +27,11 @@
 #include <stdint.h>
 
 #include "citrusleaf/cf_atomic.h"
+#include "citrusleaf/cf_digest.h"
 #include "citrusleaf/cf_queue.h"
 #include "citrusleaf/cf_queue_priority.h"
 
+#include "base/cfg.h"
 #include "base/datamodel.h"
 #include "base/monitor.h"
 
@@ -43,6 +45,7 @@ typedef struct as_priority_thread_pool_s {
 	cf_queue_priority*	dispatch_queue;
 	cf_queue*			complete_queue;
 	uint32_t			n_threads;
+	as_sched_pool		sched_pool; // CPUs and policy for the pool's threads
 } as_priority_thread_pool;
 
 typedef void (*as_priority_thread_pool_task_fn)(void* task);
@@ -52,22 +55,46 @@ typedef void (*as_priority_thread_pool_task_fn)(void* task);
 #define THREAD_POOL_PRIORITY_MEDIUM	CF_QUEUE_PRIORITY_MEDIUM
 #define THREAD_POOL_PRIORITY_HIGH	CF_QUEUE_PRIORITY_HIGH
 
-bool as_priority_thread_pool_init(as_priority_thread_pool* pool, uint32_t n_threads);
+bool as_priority_thread_pool_init(as_priority_thread_pool* pool, uint32_t n_threads, as_sched_pool sched_pool);
 void as_priority_thread_pool_shutdown(as_priority_thread_pool* pool);
 bool as_priority_thread_pool_resize(as_priority_thread_pool* pool, uint32_t n_threads);
 bool as_priority_thread_pool_queue_task(as_priority_thread_pool* pool, as_priority_thread_pool_task_fn task_fn, void* task, int priority);
 bool as_priority_thread_pool_remove_task(as_priority_thread_pool* pool, void* task);
 void as_priority_thread_pool_change_task_priority(as_priority_thread_pool* pool, void* task, int new_priority);
 
+//----------------------------------------------------------
+// as_job_pacer - class header.
+//
+
+// Paces record reads to a records-per-second budget. Work is charged after
+// it's handed out, and the next piece waits until the budget has caught up.
+// A max_per_sec of 0 means unlimited.
+typedef struct as_job_pacer_s {
+	pthread_mutex_t		lock;
+	uint64_t			next_us;
+} as_job_pacer;
+
+#define AS_JOB_PACER_INIT { PTHREAD_MUTEX_INITIALIZER, 0 }
+
+// Shared by scans, queries and sindex builds - background-max-records-per-sec.
+extern as_job_pacer g_background_pacer;
+
+void as_job_pacer_init(as_job_pacer* pacer);
+void as_job_pacer_destroy(as_job_pacer* pacer);
+uint64_t as_job_pacer_due(as_job_pacer* pacer, uint32_t max_per_sec);
+void as_job_pacer_charge(as_job_pacer* pacer, uint64_t n_records, uint32_t max_per_sec);
+bool as_job_pacer_wait(uint64_t due_us);
+
 //----------------------------------------------------------
 // as_job - base class header.
 //
 
 struct as_job_s;
-typedef void (*as_job_slice_fn)(struct as_job_s* _job, as_partition_reservation* rsv);
+typedef void (*as_job_slice_fn)(struct as_job_s* _job, as_partition_reservation* rsv, cf_digest* lo_keyd, cf_digest* hi_keyd);
 typedef void (*as_job_finish_fn)(struct as_job_s* _job);
 typedef void (*as_job_destroy_fn)(struct as_job_s* _job);
 typedef void (*as_job_info_fn)(struct as_job_s* _job, as_mon_jobstat* stat);
+typedef void (*as_job_sweep_fn)(struct as_job_s* _job, uint32_t sweep_slice);
 
 typedef struct as_job_vtable_s {
 	as_job_slice_fn		slice_fn;
@@ -117,8 +144,35 @@ typedef struct as_job_s {
 	int							priority;
 	cf_atomic32					active_rc;
 	volatile int				next_pid;
+	volatile uint32_t			next_slice;
+	uint32_t					n_pid_slices;
+	uint32_t					n_running;
+	bool						requeue_deferred;
 	volatile int				abandoned;
 
+	// Set by derived classes whose output is backed up - a paused job's next
+	// slice parks (keeping its active reservation) instead of running, until
+	// the job is resumed:
+	bool						paused;
+	bool						parked;
+
+	// Set by derived classes after init - default is whole partitions, all of
+	// them, and no thread cap. If set, pids (AS_PARTITIONS flags, freed by the
+	// base) restricts the job to the flagged partitions:
+	bool						split_pids;
+	uint32_t					max_threads;
+	bool*						pids;
+
+	// Set by derived classes for a storage sweep - if n_sweep_slices is set,
+	// the job is that many calls of sweep_fn instead of partition reduces, and
+	// sweep_fn reserves partitions itself:
+	uint32_t					n_sweep_slices;
+	as_job_sweep_fn				sweep_fn;
+
+	// Records-per-second budget for this job - 0 is unlimited:
+	uint32_t					max_rps;
+	as_job_pacer				pacer;
+
 	// For tracking:
 	uint64_t					start_ms;
 	uint64_t					finish_ms;
@@ -134,6 +188,8 @@ void as_job_destroy(as_job* _job);
 void as_job_info(as_job* _job, as_mon_jobstat* stat);
 void as_job_active_reserve(as_job* _job);
 void as_job_active_release(as_job* _job);
+void as_job_pause(as_job* _job);
+void as_job_resume(as_job* _job);
 
 //----------------------------------------------------------
 // as_job_manager - class header.
@@ -148,9 +204,13 @@ typedef struct as_job_manager_s {
 	// Manager configuration:
 	uint32_t				max_active;
 	uint32_t				max_done;
+
+	// Records-per-second budget shared by all the manager's jobs:
+	uint32_t				max_rps;
+	as_job_pacer			pacer;
 } as_job_manager;
 
-void as_job_manager_init(as_job_manager* mgr, uint32_t max_active, uint32_t max_done, uint32_t n_threads);
+void as_job_manager_init(as_job_manager* mgr, uint32_t max_active, uint32_t max_done, uint32_t n_threads, as_sched_pool sched_pool);
 int as_job_manager_start_job(as_job_manager* mgr, as_job* _job);
 void as_job_manager_requeue_job(as_job_manager* mgr, as_job* _job);
 void as_job_manager_finish_job(as_job_manager* mgr, as_job* _job);
@@ -160,6 +220,7 @@ int as_job_manager_abort_all_jobs(as_job_manager* mgr);
 bool as_job_manager_change_job_priority(as_job_manager* mgr, uint64_t trid, int priority);
 void as_job_manager_limit_active_jobs(as_job_manager* mgr, uint32_t max_active);
 void as_job_manager_limit_finished_jobs(as_job_manager* mgr, uint32_t max_done);
+void as_job_manager_limit_records_per_sec(as_job_manager* mgr, uint32_t max_rps);
 void as_job_manager_resize_thread_pool(as_job_manager* mgr, uint32_t n_threads);
 as_mon_jobstat* as_job_manager_get_job_info(as_job_manager* mgr, uint64_t trid);
 as_mon_jobstat* as_job_manager_get_info(as_job_manager* mgr, int* size);
@@ -0,0 +1,44 @@
+/*
+ * metrics.h
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+#pragma once
+
+//==========================================================
+// Includes.
+//
+
+#include <stdint.h>
+
+#include "dynbuf.h"
+
+
+//==========================================================
+// Public API.
+//
+
+void as_metrics_start();
+void as_metrics_get(cf_dyn_buf* db);
+
+// Binary snapshot, base64 encoded - only counters changed since snapshot
+// 'since' if it's still held, otherwise all of them.
+void as_metrics_get_binary(uint32_t since, cf_dyn_buf* db);
+void as_metrics_get_schema(cf_dyn_buf* db);
@@ -22,12 +22,28 @@
 
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+// Values are on the wire - in PROTO_TYPE_AS_MSG_COMPRESSED requests (zlib or
+// zstd, told apart by the zstd frame magic) and in the response compression
+// field clients use to ask for compressed responses. LZ4 and zstd are only
+// available in builds with USE_LZ4 and USE_ZSTD.
 typedef enum compression_type_e {
-	COMPRESSION_ZLIB = 1
+	COMPRESSION_NONE = 0,
+	COMPRESSION_ZLIB = 1,
+	COMPRESSION_LZ4 = 2,
+	COMPRESSION_ZSTD = 3
 } compression_type;
 
+// Compression state across the packets of one multi-packet response - batch,
+// scan or query. Each packet is flushed, so the client can decode it as it
+// arrives, but later packets reference data in earlier ones - the client keeps
+// one decoder per response, and the server must compress packets in the order
+// they're sent.
+typedef struct as_comp_stream_s as_comp_stream;
+
 /**
  * Function to decompress the given data
  * Expected arguments
@@ -41,6 +57,12 @@ typedef enum compression_type_e {
 int
 as_decompress(compression_type type, size_t buf_len, const uint8_t *buf, size_t *out_buf_len, uint8_t *out_buf);
 
+size_t
+as_compress_bound(compression_type type, size_t buf_len);
+
+int
+as_compress_buf(compression_type type, int level, size_t buf_len, const uint8_t *buf, size_t *out_buf_len, uint8_t *out_buf);
+
 /**
  * Function to get back decompressed packet from PROTO_TYPE_AS_MSG_COMPRESSED packet
  * Packet :  Header - Original size of message - Compressed message
@@ -79,3 +101,44 @@ as_compress(int argc, uint8_t *argv[]);
  */
 int
 as_packet_compression(uint8_t *buf, size_t buf_sz, uint8_t **compressed_packet, size_t *compressed_packet_sz);
+
+/**
+ * Create a response compression stream.
+ * @param type			Type of compression the client accepts
+ * @return stream, or NULL if type is none or unsupported by this build
+ */
+as_comp_stream *
+as_comp_stream_create(uint8_t type);
+
+void
+as_comp_stream_destroy(as_comp_stream *cs);
+
+/**
+ * Whether a packet of given size should be compressed - smaller packets are
+ * sent plain, and don't affect the stream.
+ */
+bool
+as_comp_stream_wants(const as_comp_stream *cs, size_t sz);
+
+/**
+ * Maximum size of the compressed packet made from sz bytes of plain packet.
+ */
+size_t
+as_comp_stream_bound(const as_comp_stream *cs, size_t sz);
+
+/**
+ * Compress a plain packet into a PROTO_TYPE_AS_MSG_COMPRESSED packet.
+ * Packet :  Header - Original size of message - Compressed message
+ * @param cs			Stream for the response this packet belongs to
+ * @param hdr			First part of the plain packet (usually its as_proto)
+ * @param hdr_sz		Size of first part
+ * @param body			Rest of the plain packet
+ * @param body_sz		Size of rest
+ * @param packet		Buffer of at least as_comp_stream_bound() bytes
+ * @return size of compressed packet, or 0 on failure - the caller sends the
+ *         plain packet, and the stream wants no more packets, so the client
+ *         gets the rest of the response plain
+ */
+size_t
+as_comp_stream_packet(as_comp_stream *cs, const uint8_t *hdr, size_t hdr_sz,
+		const uint8_t *body, size_t body_sz, uint8_t *packet);
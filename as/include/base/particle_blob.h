@@ -43,6 +43,7 @@ int blob_from_wire(as_particle_type wire_type, const uint8_t *wire_value, uint32
 int blob_compare_from_wire(const as_particle *p, as_particle_type wire_type, const uint8_t *wire_value, uint32_t value_size);
 uint32_t blob_wire_size(const as_particle *p);
 uint32_t blob_to_wire(const as_particle *p, uint8_t *wire);
+const uint8_t *blob_wire_ref(const as_particle *p, uint32_t *p_size);
 
 // Handle as_val translation.
 uint32_t blob_size_from_asval(const as_val *val);
@@ -61,3 +62,9 @@ int blob_cast_from_flat(uint8_t *flat, uint32_t flat_size, as_particle **pp);
 int blob_from_flat(const uint8_t *flat, uint32_t flat_size, as_particle **pp);
 uint32_t blob_flat_size(const as_particle *p);
 uint32_t blob_to_flat(const as_particle *p, uint8_t *flat);
+
+// Handle byte ranges - offsets past the end are errors, lengths are clamped.
+int32_t blob_write_range_size_from_wire(as_particle_type wire_type, const uint8_t *wire_value, uint32_t value_size, const as_particle *p);
+int blob_write_range_from_wire(const uint8_t *wire_value, uint32_t value_size, const as_particle *p, as_particle **pp);
+int32_t blob_read_range_size(const as_particle *p, uint32_t offset, uint32_t length);
+void blob_read_range(const as_particle *p, uint32_t offset, uint32_t length, as_particle **pp);
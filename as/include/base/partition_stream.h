@@ -0,0 +1,58 @@
+/*
+ * partition_stream.h
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+#pragma once
+
+//==========================================================
+// Includes.
+//
+
+#include <stdint.h>
+
+#include "base/transaction.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+// Info name a client sends to subscribe. The reply is:
+//     partition-map-subscribe<TAB>version;ns:n_repl,b64map,b64map...;...
+// Thereafter each change is pushed as:
+//     partition-map<TAB>version:prev-version;ns:n_repl,delta,delta...;...
+// where a replica's delta is empty if unchanged, "=b64map" for a full map, or
+// a '.' separated list of partitions whose bit flipped. Unchanged namespaces
+// are left out.
+#define AS_PARTITION_STREAM_SUBSCRIBE "partition-map-subscribe"
+
+
+//==========================================================
+// Public API.
+//
+
+void as_partition_stream_init();
+
+// Takes over the info transaction's file handle - the connection stays open,
+// and is used only for pushes, until the client or the push fails.
+void as_partition_stream_subscribe(as_file_handle* fd_h);
+
+uint32_t as_partition_stream_n_subscribers();
@@ -0,0 +1,102 @@
+/*
+ * predexp.h
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+#pragma once
+
+//==========================================================
+// Includes.
+//
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "base/datamodel.h"
+#include "base/index.h"
+#include "base/proto.h"
+
+
+//==========================================================
+// Constants.
+//
+
+// Tags of the predicate expression elements in the PREDEXP message field. Each
+// element is a tag (uint16), a value size (uint32) and the value, all big
+// endian, and elements are in postfix order - operands before operators.
+
+// Logical - the value of AND & OR is the number of terms (uint16).
+#define AS_PREDEXP_AND					1
+#define AS_PREDEXP_OR					2
+#define AS_PREDEXP_NOT					3
+
+// Literals - int64 or string.
+#define AS_PREDEXP_INTEGER_VALUE		10
+#define AS_PREDEXP_STRING_VALUE			11
+
+// Bin values - the value is the bin name.
+#define AS_PREDEXP_INTEGER_BIN			100
+#define AS_PREDEXP_STRING_BIN			101
+
+// Record metadata - no value.
+#define AS_PREDEXP_REC_LAST_UPDATE		150 // ms since citrusleaf epoch
+#define AS_PREDEXP_REC_VOID_TIME		151 // s since citrusleaf epoch, 0 if none
+#define AS_PREDEXP_REC_GENERATION		152
+#define AS_PREDEXP_REC_SET_NAME			153 // string, empty if no set
+
+// Comparisons - no value, two operands of the same type.
+#define AS_PREDEXP_INTEGER_EQUAL		200
+#define AS_PREDEXP_INTEGER_UNEQUAL		201
+#define AS_PREDEXP_INTEGER_GREATER		202
+#define AS_PREDEXP_INTEGER_GREATEREQ	203
+#define AS_PREDEXP_INTEGER_LESS			204
+#define AS_PREDEXP_INTEGER_LESSEQ		205
+
+#define AS_PREDEXP_STRING_EQUAL			210
+#define AS_PREDEXP_STRING_UNEQUAL		211
+
+
+//==========================================================
+// Typedefs.
+//
+
+typedef struct predexp_eval_s predexp_eval;
+
+typedef enum {
+	PREDEXP_FALSE = 0,
+	PREDEXP_TRUE = 1,
+	PREDEXP_UNKNOWN = 2 // needs bins which weren't available
+} predexp_retval;
+
+typedef struct predexp_args_s {
+	as_namespace*	ns;
+	as_index*		md;
+	as_storage_rd*	rd; // null when evaluating metadata only
+} predexp_args;
+
+
+//==========================================================
+// Public API.
+//
+
+predexp_eval* predexp_build(as_msg_field* pfp);
+predexp_retval predexp_matches_metadata(predexp_eval* pe, predexp_args* args);
+bool predexp_matches_record(predexp_eval* pe, predexp_args* args);
+void predexp_destroy(predexp_eval* pe);
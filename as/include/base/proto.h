@@ -30,6 +30,7 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <string.h>
+#include <sys/uio.h>
 
 #include "aerospike/as_val.h"
 #include "citrusleaf/cf_digest.h"
@@ -74,6 +75,11 @@ struct as_transaction_s;
 #define AS_PROTO_RESULT_FAIL_FORBIDDEN				22	// operation (perhaps temporarily) not possible
 #define AS_PROTO_RESULT_FAIL_ELEMENT_NOT_FOUND		23
 #define AS_PROTO_RESULT_FAIL_ELEMENT_EXISTS			24
+#define AS_PROTO_RESULT_FAIL_SCAN_SHED				25	// admission control - scans shed under overload
+#define AS_PROTO_RESULT_FAIL_UDF_BG_SHED			26	// admission control - background UDFs shed under overload
+#define AS_PROTO_RESULT_FAIL_WRITE_SHED				27	// admission control - writes shed under overload
+#define AS_PROTO_RESULT_FAIL_REPL_LAG				28	// async replication is too far behind - retry later
+#define AS_PROTO_RESULT_FAIL_COMPARE				29	// a compare op was false - nothing was applied
 
 // Security result codes. Must be <= 255, to fit in one byte. Defined here to
 // ensure no overlap with other result codes.
@@ -207,6 +213,13 @@ typedef struct as_msg_field_s {
 #define AS_MSG_FIELD_TYPE_QUERY_BINLIST			40
 #define AS_MSG_FIELD_TYPE_BATCH					41
 #define AS_MSG_FIELD_TYPE_BATCH_WITH_SET		42
+#define AS_MSG_FIELD_TYPE_PREDEXP				43
+#define AS_MSG_FIELD_TYPE_SCAN_CURSOR			44
+#define AS_MSG_FIELD_TYPE_RESPONSE_COMPRESSION	45 // 1 byte - compression_type the client accepts
+#define AS_MSG_FIELD_TYPE_QUERY_LIMIT			46 // 4 byte limit (big endian), 1 byte flags
+#define AS_MSG_FIELD_TYPE_MULTIPLEX				47 // no value - trid is the request id, response may be out of order
+
+#define AS_MSG_QUERY_LIMIT_DESC 0x01 // QUERY_LIMIT flag - top is the highest keys
 
 	/* NB: field_sz is sizeof(type) + sizeof(data) */
 	uint32_t field_sz; // get the data size through the accessor function, don't worry, it's a small macro
@@ -233,6 +246,11 @@ typedef struct as_msg_field_s {
 #define AS_MSG_FIELD_BIT_QUERY_BINLIST		0x00004000
 #define AS_MSG_FIELD_BIT_BATCH				0x00008000
 #define AS_MSG_FIELD_BIT_BATCH_WITH_SET		0x00010000
+#define AS_MSG_FIELD_BIT_PREDEXP			0x00020000
+#define AS_MSG_FIELD_BIT_SCAN_CURSOR		0x00040000
+#define AS_MSG_FIELD_BIT_RESPONSE_COMPRESSION	0x00080000
+#define AS_MSG_FIELD_BIT_QUERY_LIMIT		0x00100000
+#define AS_MSG_FIELD_BIT_MULTIPLEX			0x00200000
 
 // as_msg ops
 
@@ -244,9 +262,9 @@ typedef struct as_msg_field_s {
 #define AS_MSG_OP_CDT_MODIFY 4
 
 #define AS_MSG_OP_INCR 5			// arithmetically add a value to an existing value, works only on integers
-// Unused - 6
-// Unused - 7
-// Unused - 8
+#define AS_MSG_OP_COMPARE 6			// fail the write unless the bin (as left by earlier ops) compares true to the value
+#define AS_MSG_OP_BLOB_READ 7		// read a byte range of a blob - value is offset then length, each a big-endian uint32_t
+#define AS_MSG_OP_BLOB_WRITE 8		// write bytes into a blob at an offset, extending it - value is a big-endian uint32_t offset then the bytes
 #define AS_MSG_OP_APPEND 9			// append a value to an existing value, works on strings and blobs
 #define AS_MSG_OP_PREPEND 10		// prepend a value to an existing value, works on strings and blobs
 #define AS_MSG_OP_TOUCH 11			// touch a value without doing anything else to it - will increment the generation
@@ -263,15 +281,25 @@ typedef struct as_msg_field_s {
 	|| (op) == AS_MSG_OP_MC_INCR \
     || (op) == AS_MSG_OP_MC_APPEND \
     || (op) == AS_MSG_OP_MC_PREPEND \
+    || (op) == AS_MSG_OP_BLOB_WRITE \
     )
 
 #define OP_IS_TOUCH(op) ((op) == AS_MSG_OP_TOUCH || (op) == AS_MSG_OP_MC_TOUCH)
 
+// AS_MSG_OP_COMPARE comparisons, in the op's version byte. An absent bin is
+// equal only to a null value. The ordered comparisons are for integers only.
+#define AS_MSG_COMPARE_EQ 0
+#define AS_MSG_COMPARE_NE 1
+#define AS_MSG_COMPARE_LT 2
+#define AS_MSG_COMPARE_LE 3
+#define AS_MSG_COMPARE_GT 4
+#define AS_MSG_COMPARE_GE 5
+
 typedef struct as_msg_op_s {
 	uint32_t op_sz;
 	uint8_t  op;
 	uint8_t  particle_type;
-	uint8_t  version; // now unused
+	uint8_t  version; // now unused - except as AS_MSG_COMPARE_* for compare op
 	uint8_t  name_sz;
 	uint8_t	 name[]; // UTF-8
 	// there's also a value here but you can't have two variable size arrays
@@ -354,7 +382,7 @@ typedef struct cl_msg_s {
 
 #define AS_MSG_INFO1_READ				(1 << 0) // contains a read operation
 #define AS_MSG_INFO1_GET_ALL			(1 << 1) // get all bins, period
-// (Note:  Bit 2 is unused.)
+#define AS_MSG_INFO1_PREFER_RACK		(1 << 2) // read sent to a replica in the client's rack - served there only if in sync
 #define AS_MSG_INFO1_BATCH				(1 << 3) // new batch protocol
 #define AS_MSG_INFO1_XDR				(1 << 4) // operation is being performed by XDR
 #define AS_MSG_INFO1_GET_NOBINDATA		(1 << 5) // Do not get information about bins and its data
@@ -377,13 +405,17 @@ typedef struct cl_msg_s {
 #define AS_MSG_INFO3_CREATE_OR_REPLACE	(1 << 4) // completely replace existing record, or create new record
 #define AS_MSG_INFO3_REPLACE_ONLY		(1 << 5) // completely replace existing record, do not create new record
 #define AS_MSG_INFO3_BIN_REPLACE_ONLY	(1 << 6) // replace existing bin, do not create new bin
-// (Note:  Bit 7 is unused.)
+#define AS_MSG_INFO3_SCAN_CURSOR		(1 << 7) // scan response is a partition cursor, not a record
 
+#define AS_MSG_FIELD_SCAN_COUNT_ONLY				(0x01) // only send back the number of matching records
 #define AS_MSG_FIELD_SCAN_INCLUDE_LDT_DATA			(0x02) // whether to send ldt bin data back to the client
 #define AS_MSG_FIELD_SCAN_DISCONNECTED_JOB			(0x04) // for sproc jobs that won't be sending results back to the client [UNUSED]
 #define AS_MSG_FIELD_SCAN_FAIL_ON_CLUSTER_CHANGE	(0x08) // if we should fail when cluster is migrating or cluster changes
 #define AS_MSG_FIELD_SCAN_PRIORITY(__cl_byte)		((0xF0 & __cl_byte)>>4) // 4 bit value indicating the scan priority
 
+// Optional third byte of the scan options field:
+#define AS_MSG_FIELD_SCAN_DEVICE_SWEEP				(0x01) // read records in device order rather than index order
+
 static inline as_msg_field *
 as_msg_field_get_next(as_msg_field *mf)
 {
@@ -508,11 +540,20 @@ extern int as_msg_send_reply(struct as_file_handle_s *fd_h, uint32_t result_code
 		struct as_bin_s **bins, uint16_t bin_count, struct as_namespace_s *ns,
 		uint64_t trid, const char *setname);
 extern int as_msg_send_ops_reply(struct as_file_handle_s *fd_h, cf_dyn_buf *db);
+extern int as_msg_send_iov_reply(struct as_file_handle_s *fd_h, struct iovec *iov, uint32_t n_iov);
 
 extern cl_msg *as_msg_make_response_msg(uint32_t result_code, uint32_t generation,
 		uint32_t void_time, as_msg_op **ops, struct as_bin_s **bins,
 		uint16_t bin_count, struct as_namespace_s *ns, cl_msg *msgp_in,
 		size_t *msg_sz_in, uint64_t trid, const char *setname);
+
+#define AS_MSG_RESPONSE_MAX_IOV 64
+
+extern cl_msg *as_msg_make_response_iov(uint32_t result_code, uint32_t generation,
+		uint32_t void_time, as_msg_op **ops, struct as_bin_s **bins,
+		uint16_t bin_count, struct as_namespace_s *ns, cl_msg *msgp_in,
+		size_t *msg_sz_in, uint64_t trid, const char *setname,
+		struct iovec *iov, uint32_t *p_n_iov);
 extern int as_msg_make_response_bufbuilder(struct as_index_s *r, struct as_storage_rd_s *rd,
 		cf_buf_builder **bb_r, bool nobindata, char *nsname, bool use_sets, bool include_key, bool skip_empty_records, cf_vector *);
 extern int as_msg_make_error_response_bufbuilder(cf_digest *keyd, int result_code,
@@ -559,6 +600,7 @@ typedef struct as_netio_s {
 	uint32_t                   offset;
 	uint32_t                   seq;
 	bool                       slow;
+	bool                       compressed; // bb_r holds a complete compressed packet
 	uint64_t                   start_time;
 } as_netio;
 
@@ -609,6 +651,9 @@ typedef enum as_cdt_optype_e {
 	// ------------------------------------------------------------------------
 	// List Operation
 
+	// Create and flags
+	AS_CDT_OP_LIST_SET_TYPE      = 0,
+
 	// Add to list
 	AS_CDT_OP_LIST_APPEND        = 1,
 	AS_CDT_OP_LIST_APPEND_ITEMS  = 2,
@@ -632,6 +677,14 @@ typedef enum as_cdt_optype_e {
 	AS_CDT_OP_LIST_GET           = 17,
 	AS_CDT_OP_LIST_GET_RANGE     = 18,
 
+	// Read from list by value
+	AS_CDT_OP_LIST_GET_ALL_BY_VALUE         = 22,
+	AS_CDT_OP_LIST_GET_BY_VALUE_INTERVAL    = 25,
+
+	// Remove from list by value
+	AS_CDT_OP_LIST_REMOVE_ALL_BY_VALUE      = 35,
+	AS_CDT_OP_LIST_REMOVE_BY_VALUE_INTERVAL = 38,
+
 	// ------------------------------------------------------------------------
 	// Map Operation
 
@@ -686,4 +739,4 @@ typedef enum as_cdt_optype_e {
 
 } as_cdt_optype;
 
-#define AS_CDT_OP_LIST_LAST	AS_CDT_OP_LIST_GET_RANGE
+#define AS_CDT_OP_LIST_LAST	AS_CDT_OP_LIST_REMOVE_BY_VALUE_INTERVAL
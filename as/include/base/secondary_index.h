@@ -30,6 +30,7 @@
 #include "base/datamodel.h"
 #include "base/monitor.h"
 #include "base/proto.h"
+#include "base/sindex_hist.h"
 #include "base/system_metadata.h"
 #include "base/transaction.h"
 
@@ -211,6 +212,10 @@ typedef struct as_sindex_stat_s {
 
 	cf_atomic64        n_defrag_records;
 	cf_atomic64        defrag_time;
+	cf_atomic64        n_gc_validated;      // entries checked against the primary index
+	cf_atomic64        gc_lock_time;        // us spent holding pimd locks
+	cf_atomic64        gc_cycles;           // complete passes over all pimds
+	cf_atomic32        gc_pimd_ix;          // pimd the current pass has reached
 	
 	// Query Stats
 	histogram *       _query_hist;            // Histogram to track query latency
@@ -229,12 +234,15 @@ typedef struct as_sindex_stat_s {
 
 	histogram *       _query_rcnt_hist;       // Histogram to track record counts from queries
 	histogram *       _query_diff_hist;       // Histogram to track the false positives found by queries
+
+	as_sindex_hist *  _value_hist;            // Distribution of integer keys - always maintained
 } as_sindex_stat;
 
 typedef struct as_sindex_config_var_s {
 	char 		name[AS_ID_INAME_SZ];
 	uint64_t    defrag_period;
 	uint32_t    defrag_max_units;
+	uint32_t    defrag_max_rate;
 	uint64_t    data_max_memory;
 	bool        enable_histogram; // default false;
 	uint16_t    ignore_not_sync_flag;
@@ -244,6 +252,7 @@ typedef struct as_sindex_config_var_s {
 typedef struct as_sindex_config_s {
 	uint64_t    defrag_period;
 	uint32_t    defrag_max_units;
+	uint32_t    defrag_max_rate;  // entries validated per second, 0 is no limit
 	uint64_t    data_max_memory;
 	uint16_t    flag; // TODO change_name
 } as_sindex_config;
@@ -255,6 +264,10 @@ typedef struct as_sindex_config_s {
  * SINDEX METADATAS
  */
 // **************************************************************************************************
+// Locks are spaced at least a cache line apart (given 16 byte aligned
+// allocations), so contention on one doesn't slow the others.
+#define AS_SINDEX_LOCK_SPACING     128
+
 typedef struct as_sindex_physical_metadata_s {
 	// Static member. Does not need protection by lock
 	int                 tmatch;
@@ -263,8 +276,22 @@ typedef struct as_sindex_physical_metadata_s {
 	pthread_rwlock_t    slock;
 	// Need protection by lock
 	struct btree       *ibtr;    // Aerospike Index pointer
+
+	uint8_t             pad[AS_SINDEX_LOCK_SPACING - (2 * sizeof(int)) -
+							sizeof(pthread_rwlock_t) - sizeof(struct btree *)];
 } as_sindex_pmetadata;
 
+// The metadata lock is read locked by every write and query batch, and write
+// locked only to change config and state, or destroy. Readers lock just one of
+// several shards, picked per thread, so they don't all bounce the same cache
+// line - writers lock them all.
+#define AS_SINDEX_LOCK_SHARDS      16
+
+typedef struct as_sindex_lock_shard_s {
+	pthread_rwlock_t    lock;
+	uint8_t             pad[AS_SINDEX_LOCK_SPACING - sizeof(pthread_rwlock_t)];
+} as_sindex_lock_shard;
+
 
 typedef struct as_sindex_path_s {
 	as_particle_type type;  // MAP/LIST
@@ -277,7 +304,7 @@ typedef struct as_sindex_path_s {
 } as_sindex_path;
 
 typedef struct as_sindex_metadata_s {
-	pthread_rwlock_t      slock;
+	as_sindex_lock_shard  slock[AS_SINDEX_LOCK_SHARDS];
 	// Protected by lock
 	as_sindex_pmetadata * pimd;
 	uint32_t              flag;
@@ -296,6 +323,11 @@ typedef struct as_sindex_metadata_s {
 	as_sindex_path        path[AS_SINDEX_MAX_DEPTH];
 	int                   path_length;
 	char                * path_str;
+	// Composite index - keyed on the bin above (the prefix) and an integer
+	// range bin. NULL range_bname for a single bin index.
+	char                * range_bname;
+	uint32_t              range_binid;
+	as_sindex_ktype       prefix_btype;
 	int                   bimatch; // imatch of 0th pimd
 	int                   tmatch;  // Aerospike Index to table(tmatch)
 	int                   nprts;   // Aerospike Index Number of Index partitions	
@@ -418,6 +450,17 @@ typedef struct as_sindex_query_context_s {
 	bool             partitions_pre_reserved; 
 	// Cache information about query-able partitions
 	bool             can_partition_query[AS_PARTITIONS];
+
+	// If set, called (under the sindex lock) each time the index walk fills a
+	// keys array, so the caller can take recl and start I/O on it before the
+	// batch is done - it must leave an empty recl in its place.
+	void             (*stream_fn)(void *udata);
+	void             *stream_udata;
+
+	// If set, walk the range from the high end if desc - the caller caps each
+	// walk with bsize and starts every physical tree afresh (no resume).
+	uint32_t         limit;
+	bool             desc;
 } as_sindex_qctx;
 
 /*
@@ -435,6 +478,7 @@ typedef struct as_sindex_range_s {
 	as_sindex_bin_data  end;
 	as_sindex_type      itype;
 	char                bin_path[AS_SINDEX_MAX_PATH_LENGTH];
+	as_sindex_bin_data  prefix; // composite query - start & end are the range bin
 	uint64_t			cellid;	// target of regions-containing-point query
 	geo_region_t		region;	// target of points-in-region query
 } as_sindex_range;
@@ -495,7 +539,9 @@ extern int  as_sindex_reinit(char *name, char *params, cf_dyn_buf *db);
 // **************************************************************************************************
 extern int  as_sindex_populate_done(as_sindex *si);
 extern int  as_sindex_boot_populateall_done(as_namespace *ns);
-extern int  as_sindex_boot_populateall();
+extern void as_sindex_boot_populate_start();
+extern void as_sindex_boot_populate_ns(as_namespace *ns);
+extern int  as_sindex_boot_populate_finish();
 // **************************************************************************************************
 
 /* 
@@ -522,6 +568,10 @@ extern int  as_sindex_update_by_sbin(as_namespace *ns, const char *set, as_sinde
 			int num_sbins, cf_digest * pkey);
 extern uint32_t as_sindex_sbins_populate(as_sindex_bin *sbins, as_namespace *ns, const char *set_name,
 			const as_bin *b_old, const as_bin *b_new);
+extern int  as_sindex_sbins_composite_from_bins(as_namespace *ns, const char *set, const as_bin *bins,
+			uint16_t n_bins, int binid, as_sindex_bin *start_sbin, as_sindex_op op);
+extern bool as_sindex_composite_key(as_sindex_metadata *imd, const as_bin *prefix_bin,
+			const as_bin *range_bin, cf_digest *prefix, cf_digest *key);
 // **************************************************************************************************
 
 
@@ -539,6 +589,7 @@ void as_sindex_putall_rd(as_namespace *ns, as_storage_rd *rd);
  */
 // **************************************************************************************************
 extern int                  as_sindex_ns_has_sindex(as_namespace *ns);
+extern bool                 as_sindex_set_has_sindex(as_namespace *ns, const char *set_name);
 extern const char         * as_sindex_err_str(int err_code);
 extern uint8_t              as_sindex_err_to_clienterr(int err, char *fname, int lineno);
 extern bool                 as_sindex_isactive(as_sindex *si);
@@ -573,9 +624,9 @@ extern int  as_info_parse_params_to_sindex_imd(char* params, as_sindex_metadata
 void        as_sindex_config_var_default(as_sindex_config_var *si_cfg);
 int         as_sindex_cfg_var_hash_reduce_fn(void *key, void *data, void *udata);
 void        as_sindex__config_default(as_sindex *si);
-void        as_sindex_ticker_start(as_namespace * ns, as_sindex * si);
-void        as_sindex_ticker(as_namespace * ns, as_sindex * si, uint64_t n_obj_scanned, uint64_t start_time);
-void        as_sindex_ticker_done(as_namespace * ns, as_sindex * si, uint64_t start_time);
+void        as_sindex_ticker_start(as_namespace * ns, as_sindex ** sis, uint32_t n_sis);
+void        as_sindex_ticker(as_namespace * ns, as_sindex ** sis, uint32_t n_sis, uint64_t n_obj_scanned, uint64_t start_time);
+void        as_sindex_ticker_done(as_namespace * ns, as_sindex ** sis, uint32_t n_sis, uint64_t start_time);
 // **************************************************************************************************
 
 /*
@@ -584,6 +635,8 @@ void        as_sindex_ticker_done(as_namespace * ns, as_sindex * si, uint64_t st
 // **************************************************************************************************
 extern int as_sindex_histogram_enable(as_namespace *ns, char * iname, bool enable);
 extern int as_sindex_histogram_dumpall(as_namespace *ns);
+extern int as_sindex_value_hist_str(as_namespace *ns, char * iname, cf_dyn_buf *db);
+uint64_t   as_sindex_estimate_n_objects(as_sindex *si, as_sindex_range *srange);
 #define SINDEX_HIST_INSERT_DATA_POINT(si, type, start_time_ns)                          \
 do {                                                                                    \
 	if (si->enable_histogram && start_time_ns != 0) {                                   \
@@ -678,6 +731,29 @@ do {                                            \
 	int ret = pthread_rwlock_unlock((l));        \
 	if (ret) cf_warning(AS_SINDEX, "UNLOCK_ONLY (%d) %s:%d",ret, __FILE__, __LINE__); \
 } while(0);
+
+// Metadata locks - see as_sindex_lock_shard.
+extern uint32_t as_sindex_lock_shard_ix();
+
+#define SINDEX_IMD_RLOCK(imd)                   \
+	SINDEX_RLOCK(&(imd)->slock[as_sindex_lock_shard_ix()].lock)
+
+#define SINDEX_IMD_RUNLOCK(imd)                 \
+	SINDEX_UNLOCK(&(imd)->slock[as_sindex_lock_shard_ix()].lock)
+
+#define SINDEX_IMD_WLOCK(imd)                   \
+do {                                            \
+	for (int _s = 0; _s < AS_SINDEX_LOCK_SHARDS; _s++) { \
+		SINDEX_WLOCK(&(imd)->slock[_s].lock);   \
+	}                                           \
+} while(0);
+
+#define SINDEX_IMD_WUNLOCK(imd)                 \
+do {                                            \
+	for (int _s = AS_SINDEX_LOCK_SHARDS - 1; _s >= 0; _s--) { \
+		SINDEX_UNLOCK(&(imd)->slock[_s].lock);  \
+	}                                           \
+} while(0);
 // **************************************************************************************************
 
 
@@ -693,6 +769,12 @@ as_sindex_config_var_hash_fn(void* p_key)
 {
 	return (uint32_t)cf_hash_fnv(p_key, strlen((const char *)p_key));
 }
+
+static inline bool
+as_sindex_is_composite(const as_sindex_metadata *imd)
+{
+	return imd->range_bname != NULL;
+}
 // **************************************************************************************************
 
 
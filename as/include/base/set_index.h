@@ -0,0 +1,55 @@
+/*
+ * set_index.h
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+#pragma once
+
+//==========================================================
+// Includes.
+//
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "arenax.h"
+
+#include "base/datamodel.h"
+#include "base/index.h"
+
+
+//==========================================================
+// Typedefs.
+//
+
+typedef struct as_set_index_s as_set_index;
+
+
+//==========================================================
+// Public API.
+//
+
+as_set_index* as_set_index_create();
+void as_set_index_clear(as_set_index* si, bool complete);
+void as_set_index_rebuilt(as_set_index* si);
+void as_set_index_add(as_set_index* si, uint16_t set_id, cf_arenax_handle r_h);
+void as_set_index_record_set(as_namespace* ns, as_record* r);
+bool as_set_index_is_indexed(as_namespace* ns, uint16_t set_id);
+bool as_set_index_reduce(as_namespace* ns, as_partition* p, as_index_tree* tree, uint16_t set_id, cf_digest* lo_keyd, cf_digest* hi_keyd, as_index_reduce_fn cb, void* udata);
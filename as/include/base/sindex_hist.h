@@ -0,0 +1,53 @@
+/*
+ * sindex_hist.h
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+#pragma once
+
+//==========================================================
+// Includes.
+//
+
+#include <stdint.h>
+
+#include "dynbuf.h"
+
+
+//==========================================================
+// Typedefs.
+//
+
+typedef struct as_sindex_hist_s as_sindex_hist;
+
+
+//==========================================================
+// Public API.
+//
+
+as_sindex_hist* as_sindex_hist_create();
+void as_sindex_hist_destroy(as_sindex_hist* h);
+void as_sindex_hist_clear(as_sindex_hist* h);
+
+void as_sindex_hist_insert(as_sindex_hist* h, int64_t value);
+void as_sindex_hist_remove(as_sindex_hist* h, int64_t value);
+
+uint64_t as_sindex_hist_estimate(const as_sindex_hist* h, int64_t start, int64_t end);
+void as_sindex_hist_info(const as_sindex_hist* h, cf_dyn_buf* db);
@@ -0,0 +1,69 @@
+/*
+ * slow_txn.h
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+
+/*
+ * Slow transaction log - client reads, writes, deletes and UDFs that took
+ * longer than slow-txn-threshold ms, with their stage timings. Each thread
+ * keeps its own ring of recent ones, read by the slow-transactions info
+ * command, and optionally logs up to slow-txn-log-rate per second.
+ */
+
+#pragma once
+
+//==========================================================
+// Includes.
+//
+
+#include <stdint.h>
+
+#include "citrusleaf/cf_clock.h"
+
+#include "dynbuf.h"
+
+#include "base/cfg.h"
+#include "base/transaction.h"
+
+
+//==========================================================
+// Public API.
+//
+
+void as_slow_txn_record(as_transaction* tr, uint64_t total_ns);
+void as_slow_txn_get_info(uint32_t max, cf_dyn_buf* db);
+
+// Call when sending a client response.
+static inline void
+as_slow_txn_check(as_transaction* tr)
+{
+	uint64_t threshold_ns = (uint64_t)g_config.slow_txn_threshold * 1000000;
+
+	if (threshold_ns == 0 || tr->start_time == 0) {
+		return;
+	}
+
+	uint64_t total_ns = cf_getns() - tr->start_time;
+
+	if (total_ns >= threshold_ns) {
+		as_slow_txn_record(tr, total_ns);
+	}
+}
@@ -31,6 +31,7 @@
 #include "citrusleaf/cf_atomic.h"
 
 #include "hist.h"
+#include "shard_counter.h"
 
 
 //==========================================================
@@ -39,11 +40,12 @@
 
 typedef struct as_stats_s {
 
-	cf_atomic64		global_record_ref_count; // TODO - can't we get rid of this?
+	cf_shard_counter	global_record_ref_count; // TODO - can't we get rid of this?
 
 	// Connection stats.
 	cf_atomic64		proto_connections_opened; // not just a statistic
 	cf_atomic64		proto_connections_closed; // not just a statistic
+	cf_atomic64		proto_connections_multiplexed;
 	// In ticker but not collected via info:
 	cf_atomic64		heartbeat_connections_opened;
 	cf_atomic64		heartbeat_connections_closed;
@@ -56,9 +58,13 @@ typedef struct as_stats_s {
 
 	// Demarshal stats.
 	uint64_t		reaper_count; // not in ticker - incremented only in reaper thread
+	cf_atomic64		proto_read_ahead_recvs; // not in ticker
+	cf_atomic64		proto_read_ahead_msgs; // not in ticker
 
 	// Info stats.
 	cf_atomic64		info_complete;
+	cf_atomic64		info_timeout; // not in ticker - dropped after waiting info-timeout in queue
+	cf_atomic64		info_cache_hits; // not in ticker
 
 	// Proxy stats.
 	uint64_t		proxy_retry; // not in ticker - incremented only in proxy retransmit thread
@@ -79,6 +85,8 @@ typedef struct as_stats_s {
 	cf_atomic64		batch_index_huge_buffers; // not in ticker
 	cf_atomic64		batch_index_created_buffers; // not in ticker
 	cf_atomic64		batch_index_destroyed_buffers; // not in ticker
+	cf_atomic64		batch_index_stolen_chunks; // not in ticker
+	cf_atomic64		batch_index_dup_keys; // not in ticker
 
 	// "Old" batch stats.
 	cf_atomic64		batch_initiate; // not in ticker
@@ -96,9 +104,18 @@ typedef struct as_stats_s {
 	uint64_t		sindex_gc_garbage_found; // amount of garbage found during list creation phase
 	uint64_t		sindex_gc_garbage_cleaned; // amount of garbage deleted during list deletion phase
 
+	// UDF result cache stats.
+	cf_shard_counter	udf_result_cache_hits; // not in ticker
+	cf_shard_counter	udf_result_cache_misses; // not in ticker
+	cf_atomic64		udf_result_cache_evictions; // not in ticker
+
 	// Fabric stats.
 	cf_atomic64		fabric_msgs_sent; // not in ticker
 	cf_atomic64		fabric_msgs_rcvd; // not in ticker
+	cf_atomic64		fabric_sends; // send calls - fabric_msgs_sent / fabric_sends is msgs per send
+	cf_atomic64		fabric_msg_gets; // msg cache hit rate is 1 - fabric_msg_cache_misses / fabric_msg_gets
+	cf_atomic64		fabric_msg_cache_misses; // gets the thread's cache couldn't serve
+	cf_atomic64		fabric_msg_creates; // gets neither cache nor depot could serve
 
 	//--------------------------------------------
 	// Histograms.
@@ -22,6 +22,9 @@
 
 #pragma once
 
+#include "dynbuf.h"
+
 #include "base/transaction.h"
 
 void thr_demarshal_resume(as_file_handle *fd_h);
+void as_demarshal_get_thread_stats(cf_dyn_buf *db);
@@ -87,6 +87,7 @@ extern void build_service_list(cf_ip_addr *addrs, int32_t n_addrs, cf_dyn_buf *d
 // Needed by ticker:
 
 int as_info_queue_get_size();
+int as_info_heavy_queue_get_size();
 void info_log_with_datestamp(void (*log_fn)(void));
 
 extern bool g_mstats_enabled;
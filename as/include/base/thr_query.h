@@ -25,6 +25,7 @@
  */
 // **************************************************************************************************
 #define QUERY_BATCH_SIZE              100
+#define QUERY_AGGR_BATCH_SIZE         1000	// records per stream UDF application
 #define AS_MAX_NUM_SCRIPT_PARAMS      10
 #define AS_QUERY_BUF_SIZE             1024 * 1024 * 2 // At least 2 Meg
 #define AS_QUERY_MAX_BUFS             256	// That makes it 512 meg max in steady state
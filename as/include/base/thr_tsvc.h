@@ -22,18 +22,33 @@
 
 #pragma once
 
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ring_queue.h"
+
+#include "base/datamodel.h"
 #include "base/transaction.h"
 
+bool thr_tsvc_can_process_inline(as_transaction *tr);
 int thr_tsvc_process_or_enqueue(as_transaction *tr);
 int thr_tsvc_enqueue(as_transaction *tr);
+int thr_tsvc_process_or_enqueue_iudf(as_transaction *tr);
+int thr_tsvc_enqueue_local(as_transaction *tr, uint32_t thr_id);
 void process_transaction(as_transaction *tr);
 
 // Statistics function for monitoring server load.
 extern int thr_tsvc_queue_get_size();
+extern int thr_tsvc_ns_queue_get_size(const as_namespace *ns);
 
 // Initialize the queues and start the handler threads.
 extern void as_tsvc_init();
 
+// Resize the transaction service at runtime.
+extern int as_tsvc_set_threads_per_queue(uint32_t n_threads);
+extern int as_tsvc_set_queues(uint32_t n_queues);
+
 // Needed by XDR.
 #define MAX_TRANSACTION_QUEUES 128
-extern cf_queue *g_transaction_queues[MAX_TRANSACTION_QUEUES];
+#define MAX_TRANSACTION_THREADS_PER_QUEUE 256
+extern cf_ring_queue *g_transaction_queues[MAX_TRANSACTION_QUEUES];
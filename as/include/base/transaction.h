@@ -33,6 +33,7 @@
 #include "citrusleaf/cf_clock.h"
 #include "citrusleaf/cf_digest.h"
 
+#include "coarse_clock.h"
 #include "msg.h"
 #include "socket.h"
 #include "util.h"
@@ -66,6 +67,10 @@
 { \
 	trw->rsv.ns->name##_active = true; \
 	cf_hist_track_insert_data_point(trw->rsv.ns->name, trw->start_time); \
+	uint16_t latency_set_id = as_transaction_latency_set_id(trw); \
+	if (latency_set_id != INVALID_SET_ID) { \
+		cf_hist_track_insert_data_point(trw->rsv.ns->set_##name##s[latency_set_id], trw->start_time); \
+	} \
 }
 
 #define BENCHMARK_START(tr, name, orig) \
@@ -87,6 +92,36 @@
 	} \
 }
 
+// Queue stage is from demarshal - restarts' queue stage isn't recorded. Stages
+// are also timed (for the slow transaction log) if slow-txn-threshold is set.
+#define STAGE_START(tr, stage) \
+{ \
+	if ((tr->rsv.ns->stage_hist_enabled || g_config.slow_txn_threshold != 0) && tr->start_time != 0) { \
+		if (as_transaction_is_restart(tr)) { \
+			tr->stage_time = cf_getns(); \
+		} \
+		else { \
+			STAGE_END(tr, stage, tr->start_time); \
+		} \
+	} \
+}
+
+#define STAGE_NEXT_DATA_POINT(trw, stage) \
+{ \
+	if (trw->stage_time != 0) { \
+		STAGE_END(trw, stage, trw->stage_time); \
+	} \
+}
+
+#define STAGE_END(trw, stage, stage_start) \
+{ \
+	uint64_t stage_end = trw->rsv.ns->stage_hist_enabled ? \
+			cf_hist_track_insert_data_point(trw->rsv.ns->stage_hists[stage], stage_start) : cf_getns(); \
+	trw->stage_us[as_stage_op_index(stage)] = stage_end > stage_start ? \
+			(uint32_t)((stage_end - stage_start) / 1000) : 0; \
+	trw->stage_time = stage_end; \
+}
+
 
 //==========================================================
 // Client socket information - as_file_handle.
@@ -97,16 +132,41 @@ typedef struct as_file_handle_s {
 	uint64_t	last_used;		// last ms we read or wrote
 	cf_socket	*sock;			// our socket
 	cf_poll		poll;			// our epoll instance
-	bool		reap_me;		// tells the reaper to come and get us
+	uint32_t	reaper_slot;	// index in demarshal's file handle table, while in it
+	bool		reap_me;		// connection is closing
 	bool		trans_active;	// a transaction is running on this connection
 	uint32_t	fh_info;		// bitmap containing status info of this file handle
 	as_proto	*proto;
 	uint64_t	proto_unread;
+	uint8_t		*rbuf;			// read-ahead buffer, if proto-read-buffer-size is set
+	uint32_t	rbuf_start;		// first unparsed byte in rbuf
+	uint32_t	rbuf_end;		// end of bytes read into rbuf
 	void		*security_filter;
+	pthread_mutex_t	send_lock;	// serializes responses, once multiplexed
 } as_file_handle;
 
 #define FH_INFO_DONOT_REAP	0x00000001	// this bit indicates that this file handle should not be reaped
 #define FH_INFO_XDR			0x00000002	// the file handle belongs to an XDR connection
+#define FH_INFO_MULTIPLEX	0x00000004	// requests may be in flight together - responses are matched by trid
+
+// On a multiplexed connection several transactions may respond at once - each
+// response must go out whole, so hold this around sending it. The flag is set
+// while nothing is in flight on the connection, and never cleared.
+static inline void
+as_file_handle_send_lock(as_file_handle *proto_fd_h)
+{
+	if ((proto_fd_h->fh_info & FH_INFO_MULTIPLEX) != 0) {
+		pthread_mutex_lock(&proto_fd_h->send_lock);
+	}
+}
+
+static inline void
+as_file_handle_send_unlock(as_file_handle *proto_fd_h)
+{
+	if ((proto_fd_h->fh_info & FH_INFO_MULTIPLEX) != 0) {
+		pthread_mutex_unlock(&proto_fd_h->send_lock);
+	}
+}
 
 // Helpers to release transaction file handles.
 void as_release_file_handle(as_file_handle *proto_fd_h);
@@ -195,6 +255,8 @@ typedef struct as_transaction_s {
 	uint16_t	generation;
 	uint32_t	void_time;
 	uint64_t	last_update_time;
+	uint64_t	stage_time; // end of previous stage, if stage histograms enabled
+	uint32_t	stage_us[AS_MAX_OP_STAGES]; // for the slow transaction log
 
 } as_transaction;
 
@@ -208,6 +270,8 @@ typedef struct as_transaction_s {
 
 // 'flags' bits - set in transaction body after queuing:
 #define AS_TRANSACTION_FLAG_SINDEX_TOUCHED	0x0001
+#define AS_TRANSACTION_FLAG_COALESCE_LEADER	0x0002
+#define AS_TRANSACTION_FLAG_INDEX_ONLY		0x0004 // touch didn't rewrite the record
 
 
 void as_transaction_init_head(as_transaction *tr, cf_digest *, cl_msg *);
@@ -230,6 +294,13 @@ as_transaction_is_restart(const as_transaction *tr)
 	return (tr->from_flags & FROM_FLAG_RESTART) != 0;
 }
 
+// Has the client (or origin node) already given up on this transaction?
+static inline bool
+as_transaction_is_past_deadline(const as_transaction *tr)
+{
+	return tr->end_time != 0 && cf_coarse_getns() > tr->end_time;
+}
+
 static inline bool
 as_transaction_is_batch_sub(const as_transaction *tr)
 {
@@ -299,6 +370,30 @@ as_transaction_has_scan_options(const as_transaction *tr)
 	return (tr->msg_fields & AS_MSG_FIELD_BIT_SCAN_OPTIONS) != 0;
 }
 
+static inline bool
+as_transaction_has_predexp(const as_transaction *tr)
+{
+	return (tr->msg_fields & AS_MSG_FIELD_BIT_PREDEXP) != 0;
+}
+
+static inline bool
+as_transaction_has_scan_cursor(const as_transaction *tr)
+{
+	return (tr->msg_fields & AS_MSG_FIELD_BIT_SCAN_CURSOR) != 0;
+}
+
+static inline bool
+as_transaction_has_query_limit(const as_transaction *tr)
+{
+	return (tr->msg_fields & AS_MSG_FIELD_BIT_QUERY_LIMIT) != 0;
+}
+
+static inline bool
+as_transaction_has_multiplex(const as_transaction *tr)
+{
+	return (tr->msg_fields & AS_MSG_FIELD_BIT_MULTIPLEX) != 0;
+}
+
 // For now it's not worth storing the trid in the as_transaction struct since we
 // only parse it from the msg once per transaction anyway.
 static inline uint64_t
@@ -313,12 +408,32 @@ as_transaction_trid(const as_transaction *tr)
 	return cf_swap_from_be64(*(uint64_t*)f->data);
 }
 
+// Compression type the client accepts on responses, 0 if none.
+static inline uint8_t
+as_transaction_response_compression(const as_transaction *tr)
+{
+	if ((tr->msg_fields & AS_MSG_FIELD_BIT_RESPONSE_COMPRESSION) == 0) {
+		return 0;
+	}
+
+	as_msg_field *f = as_msg_field_get(&tr->msgp->msg,
+			AS_MSG_FIELD_TYPE_RESPONSE_COMPRESSION);
+
+	return as_msg_field_get_value_sz(f) == 0 ? 0 : f->data[0];
+}
+
 static inline bool
 as_transaction_is_delete(as_transaction *tr)
 {
 	return (tr->msgp->msg.info2 & AS_MSG_INFO2_DELETE) != 0;
 }
 
+static inline bool
+as_transaction_is_prefer_rack(as_transaction *tr)
+{
+	return (tr->msgp->msg.info1 & AS_MSG_INFO1_PREFER_RACK) != 0;
+}
+
 // TODO - where should this go?
 static inline bool
 as_msg_is_xdr(as_msg *m)
@@ -340,6 +455,16 @@ as_transaction_is_nsup_delete(as_transaction *tr)
 }
 
 int as_transaction_init_iudf(as_transaction *tr, as_namespace *ns, cf_digest *keyd);
+uint16_t as_transaction_latency_set_id_lookup(const as_transaction *tr);
+
+// Set-id of the transaction's set if it has latency histograms enabled, else
+// INVALID_SET_ID - cheap when no set has them enabled.
+static inline uint16_t
+as_transaction_latency_set_id(const as_transaction *tr)
+{
+	return cf_atomic32_get(tr->rsv.ns->n_set_latency_enabled) == 0 ?
+			INVALID_SET_ID : as_transaction_latency_set_id_lookup(tr);
+}
 
 void as_transaction_demarshal_error(as_transaction* tr, uint32_t error_code);
 void as_transaction_error(as_transaction* tr, as_namespace *ns, uint32_t error_code);
@@ -0,0 +1,44 @@
+/*
+ * truncate.h
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+#pragma once
+
+//==========================================================
+// Includes.
+//
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "base/datamodel.h"
+#include "base/rec_props.h"
+
+
+//==========================================================
+// Public API.
+//
+
+void as_truncate_init();
+void as_truncate_start();
+int as_truncate_cmd(const char* ns_name, const char* set_name, const char* lut_str);
+bool as_truncate_record_is_truncated(as_record* r, as_namespace* ns);
+bool as_truncate_lut_is_truncated(uint64_t rec_lut, as_namespace* ns, const as_rec_props* p_rec_props);
@@ -29,6 +29,8 @@
 #include <stdint.h>
 #include "aerospike/as_memtracker.h"
 
+#include "dynbuf.h"
+
 typedef enum {
 	MEM_RESERVE	= 0,
 	MEM_RELEASE	= 1,
@@ -43,9 +45,24 @@ struct mem_tracker_s {
 	as_memtracker_op_cb		cb;
 };
 
+// One UDF call's memory, as reported through the as_memtracker - checked
+// against udf-runtime-max-memory, and folded into the module's high-water
+// mark when the call is done.
+typedef struct udf_mem_call_s {
+	mem_tracker				mt;
+	const char				*filename;
+	uint64_t				in_use;
+	uint64_t				peak;
+	uint64_t				limit;
+} udf_mem_call;
+
 /*****************************************************************************
  * STATIC FUNCTIONS
  *****************************************************************************/
 as_memtracker * udf_memtracker_init();
 void udf_memtracker_setup(mem_tracker *mt);
 void udf_memtracker_cleanup();
+
+as_memtracker * udf_mem_call_setup(udf_mem_call *call, const char *filename);
+void udf_mem_call_done(udf_mem_call *call);
+int udf_memtracker_info(char *name, cf_dyn_buf *db);
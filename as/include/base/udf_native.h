@@ -0,0 +1,84 @@
+/*
+ * udf_native.h
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/*
+ * Natively compiled UDF modules - shared objects in the mod-lua native-path
+ * directory, loaded at startup. A module is called by the same name as a Lua
+ * module, and takes precedence over a Lua module of that name.
+ *
+ * Each shared object exports a udf_native_module named as_udf_native_module.
+ * Functions get the same as_rec, as_list arguments, as_aerospike hooks (in the
+ * context) and as_result as Lua UDFs, and return 0 or an as_module error.
+ * They run without a Lua state, so may run concurrently on any thread.
+ */
+
+#pragma once
+
+//==========================================================
+// Includes.
+//
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "aerospike/as_list.h"
+#include "aerospike/as_rec.h"
+#include "aerospike/as_result.h"
+#include "aerospike/as_stream.h"
+#include "aerospike/as_udf_context.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+#define UDF_NATIVE_ABI_VERSION 1
+#define UDF_NATIVE_MODULE_SYMBOL "as_udf_native_module"
+
+typedef int (*udf_native_record_fn)(as_udf_context* ctx, as_rec* rec,
+		as_list* args, as_result* result);
+
+typedef int (*udf_native_stream_fn)(as_udf_context* ctx, as_stream* istream,
+		as_list* args, as_stream* ostream, as_result* result);
+
+// Either of record_fn or stream_fn may be NULL.
+typedef struct udf_native_function_s {
+	const char*				name;
+	udf_native_record_fn	record_fn;
+	udf_native_stream_fn	stream_fn;
+} udf_native_function;
+
+typedef struct udf_native_module_s {
+	uint32_t				abi_version; // UDF_NATIVE_ABI_VERSION
+	const char*				name;
+	const udf_native_function* functions;
+	uint32_t				n_functions;
+} udf_native_module;
+
+
+//==========================================================
+// Public API.
+//
+
+void udf_native_init();
+udf_native_record_fn udf_native_record_get(const char* module, const char* function);
+udf_native_stream_fn udf_native_stream_get(const char* module, const char* function);
@@ -97,6 +97,7 @@ typedef struct udf_record_s {
 #define UDF_RECORD_FLAG_PREEXISTS			0x0040   // Record preexisted not created
 #define UDF_RECORD_FLAG_ISVALID				0x0080   // Udf is setup and in use
 #define UDF_RECORD_FLAG_METADATA_UPDATED	0x0100   // Write/Update metadata done
+#define UDF_RECORD_FLAG_BINS_DEFERRED		0x0200   // Storage open, bins not loaded
 
 extern const as_rec_hooks udf_record_hooks;
 
@@ -108,6 +109,8 @@ extern int      udf_record_open         (udf_record *);
 extern int      udf_storage_record_open (udf_record *);
 extern void     udf_record_close        (udf_record *);
 extern int      udf_storage_record_close(udf_record *);
+extern void     udf_storage_record_load_bins(udf_record *);
+extern void     udf_storage_record_load_some_bins(udf_record *, const uint16_t *, uint16_t);
 extern void     udf_record_init         (udf_record *, bool);
 extern void     udf_record_cleanup      (udf_record *, bool);
 extern as_val * udf_record_storage_get  (const udf_record *, const char *);
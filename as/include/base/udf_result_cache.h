@@ -0,0 +1,55 @@
+/*
+ * udf_result_cache.h
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/*
+ * Results of read-only record UDFs, for modules configured with mod-lua
+ * result-cache-module - their read functions must depend only on the record
+ * and the arguments. Results are keyed by namespace, digest, generation,
+ * last-update-time, function and arguments, so any write to the record, or
+ * any UDF module change, makes them misses.
+ */
+
+#pragma once
+
+//==========================================================
+// Includes.
+//
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "aerospike/as_val.h"
+#include "citrusleaf/cf_digest.h"
+
+#include "base/datamodel.h"
+#include "transaction/udf.h"
+
+
+//==========================================================
+// Public API.
+//
+
+void udf_result_cache_init();
+bool udf_result_cache_enabled(const udf_def* def);
+as_val* udf_result_cache_get(const udf_def* def, const as_namespace* ns, const cf_digest* keyd, uint16_t generation, uint64_t last_update_time);
+void udf_result_cache_put(const udf_def* def, const as_namespace* ns, const cf_digest* keyd, uint16_t generation, uint64_t last_update_time, const as_val* val);
+void udf_result_cache_invalidate();
@@ -0,0 +1,86 @@
+/*
+ * xdr_dlog.h
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+#pragma once
+
+//==========================================================
+// Includes.
+//
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "citrusleaf/cf_digest.h"
+
+#include "dynbuf.h"
+#include "util.h"
+
+#include "base/datamodel.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+#define AS_XDR_DLOG_FLAG_DELETE 0x01
+
+// One frame in the digest log. The slot is the frame's sequence number - it
+// is stored last by the writer, so a frame is complete only if its slot and
+// crc agree with its position in the log.
+typedef struct as_xdr_dlog_entry_s {
+	uint64_t	slot;
+	cf_node		master;
+	cf_digest	keyd;
+	uint32_t	generation;
+	uint16_t	set_id;
+	uint8_t		ns_id;
+	uint8_t		flags;
+	uint32_t	crc;
+} as_xdr_dlog_entry;
+
+// Called by the shipper with a batch of entries for one partition, deduped
+// and sorted in storage order, so record reads don't seek back and forth.
+typedef void (*as_xdr_dlog_ship_fn)(as_namespace* ns, as_partition_reservation* rsv,
+		const as_xdr_dlog_entry* entries, uint32_t n_entries, void* udata);
+
+
+//==========================================================
+// Public API.
+//
+
+bool as_xdr_dlog_init(const char* path, uint64_t size, bool overwrite);
+bool as_xdr_dlog_is_open();
+void as_xdr_dlog_shutdown();
+
+void as_xdr_dlog_write(as_namespace* ns, const cf_digest* keyd,
+		as_generation generation, cf_node master, bool is_delete,
+		uint16_t set_id);
+
+// For a consumer that does its own shipping - entries up to the last flush,
+// in log order. Entries aren't released until acked.
+uint32_t as_xdr_dlog_read(as_xdr_dlog_entry* entries, uint32_t max_entries);
+void as_xdr_dlog_ack(uint32_t n_entries);
+
+// Starts the shipper thread - only one callback may be registered.
+void as_xdr_dlog_register_shipper(as_xdr_dlog_ship_fn cb, void* udata);
+
+void as_xdr_dlog_get_stats(cf_dyn_buf* db);
@@ -133,6 +133,13 @@ typedef struct as_hb_config_s
 	 */
 	uint32_t override_mtu;
 
+	/**
+	 * Set to true to send adjacency and succession lists in full only when
+	 * they change, and periodically, and a digest of them otherwise. Only
+	 * applies to v3 pulse messages, and all nodes must support it.
+	 */
+	bool compact_payloads;
+
 	/*---- Derived values for convinience ----*/
 	char hb_listen_addr_s[INET6_ADDRSTRLEN];
 	char hb_publish_addr_s[INET6_ADDRSTRLEN];
@@ -232,6 +239,10 @@ typedef enum {
 	 * The clustering subsystem.
 	 */
 	AS_HB_PLUGIN_CLUSTERING,
+	/**
+	 * The rack-id of each node, kept by the paxos subsystem.
+	 */
+	AS_HB_PLUGIN_RACK,
 	/**
 	 * Dummy sentinel enum value. Should be the last.
 	 */
@@ -296,6 +307,20 @@ typedef void (*as_hb_plugin_parse_data_fn)(msg* hb_message, cf_node source,
  */
 typedef void (*as_hb_plugin_data_changed_fn)(cf_node nodeid);
 
+/**
+ * A function to check whether an incoming message carries no new data for this
+ * plugin - e.g. only a digest of the data sent previously. Should be fast and
+ * never acquire locks.
+ *
+ * @param hb_message the heartbeat message.
+ * @param source the source node.
+ * @param prev_data the plugin data last parsed for the source node.
+ * @return true to keep prev_data, in which case the parse function is not
+ * invoked.
+ */
+typedef bool (*as_hb_plugin_data_unchanged_fn)(msg* hb_message, cf_node source,
+					       as_hb_plugin_node_data* prev_data);
+
 /**
  * A plugin allows a module to pushish and read
  * data with heartbeat pulse messages.
@@ -335,8 +360,41 @@ typedef struct as_hb_plugin_s
 	 * Can be NULL. This function can hold the plugin module's locks.
 	 */
 	as_hb_plugin_data_changed_fn change_listener;
+
+	/**
+	 * A function to detect messages that carry no new data for this plugin.
+	 * Can be NULL, in which case the parse function is always invoked.
+	 */
+	as_hb_plugin_data_unchanged_fn unchanged_fn;
 } as_hb_plugin;
 
+/**
+ * Sender side state deciding whether a plugin's list goes out in full, or as a
+ * digest, with compact payloads.
+ */
+typedef struct as_hb_payload_state_s
+{
+	/**
+	 * Digest of the list when it last changed.
+	 */
+	uint64_t digest;
+
+	/**
+	 * Adjacency generation when the list was last sent in full.
+	 */
+	uint32_t adjacency_gen;
+
+	/**
+	 * Number of further pulses to send the list in full.
+	 */
+	uint32_t n_full_pending;
+
+	/**
+	 * Number of pulses since the list was last sent in full.
+	 */
+	uint32_t n_since_full;
+} as_hb_payload_state;
+
 /**
  * The fields in the heartbeat message.
  */
@@ -384,6 +442,23 @@ typedef enum {
 	 */
 	AS_HB_MSG_COMPRESSED_PAYLOAD,
 
+	/**
+	 * Digest of the adjacency list, sent instead of AS_HB_MSG_HB_DATA with
+	 * compact payloads.
+	 */
+	AS_HB_MSG_HB_DATA_DIGEST,
+
+	/**
+	 * Digest of the succession list, sent instead of AS_HB_MSG_PAXOS_DATA
+	 * with compact payloads.
+	 */
+	AS_HB_MSG_PAXOS_DATA_DIGEST,
+
+	/**
+	 * The rack-id of the source node.
+	 */
+	AS_HB_MSG_RACK_ID,
+
 	/**
 	 * Sentinel value. Should be the last in the enum
 	 */
@@ -498,6 +573,11 @@ uint32_t as_hb_node_timeout_get();
  */
 void as_hb_override_mtu_set(int mtu);
 
+/**
+ * Enable or disable compact adjacency and succession payloads.
+ */
+void as_hb_compact_payloads_set(bool compact_payloads);
+
 /**
  * Get the heartbeat pulse transmit interval.
  */
@@ -542,6 +622,23 @@ bool as_hb_max_cluster_size_isvalid(uint32_t max_cluster_size);
  */
 void as_hb_plugin_register(as_hb_plugin* plugin);
 
+/**
+ * Digest of a node list, for compact payloads.
+ */
+uint64_t as_hb_payload_digest(cf_node* nodes, size_t n_nodes);
+
+/**
+ * Decide whether a plugin should send its list in full in the outgoing pulse,
+ * or only its digest. Sends in full for a few pulses after the list or the
+ * adjacency changes, and periodically, so receivers that miss a change catch
+ * up. Always true unless compact payloads are enabled.
+ *
+ * @param state the plugin's sender side state.
+ * @param digest the digest of the list to send.
+ * @return true if the list should be sent in full.
+ */
+bool as_hb_payload_send_full(as_hb_payload_state* state, uint64_t digest);
+
 /**
  * Indicates if a node is alive.
  */
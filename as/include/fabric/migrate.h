@@ -61,6 +61,11 @@
  */
 #define MAX_NUM_MIGRATE_XMIT_THREADS  (100)
 
+/*
+ *  Maximum permissible number of threads emigrating one big partition.
+ */
+#define MAX_MIGRATE_SPLIT_THREADS  (16)
+
 #define TX_FLAGS_NONE           ((uint32_t) 0x0)
 #define TX_FLAGS_ACTING_MASTER  ((uint32_t) 0x1)
 #define TX_FLAGS_REQUEST        ((uint32_t) 0x2)
@@ -145,6 +150,10 @@ typedef enum {
 	MIG_FIELD_META_RECORDS,
 	MIG_FIELD_META_SEQUENCE,
 	MIG_FIELD_META_SEQUENCE_FINAL,
+	MIG_FIELD_RECORD_ORIG_SZ, // if present, MIG_FIELD_RECORD is compressed
+	MIG_FIELD_DELTA_VINFO,
+	MIG_FIELD_DELTA_MAX_LUT,
+	MIG_FIELD_WINDOW, // bytes the immigrator lets this emigration have unacked
 
 	NUM_MIG_FIELDS
 } migrate_msg_fields;
@@ -164,6 +173,8 @@ typedef enum {
 #define OPERATION_MERGE_META_ACK 12
 
 #define MIG_FEATURE_MERGE 0x00000001
+#define MIG_FEATURE_COMPRESSION 0x00000002
+#define MIG_FEATURE_DELTA 0x00000004
 #define MIG_FEATURES_SEEN 0x80000000 // needed for backward compatibility
 extern const uint32_t MY_MIG_FEATURES;
 
@@ -194,9 +205,12 @@ typedef struct emigration_s {
 	uint32_t    tx_flags;
 	cf_atomic32 state;
 	bool        aborted;
+	bool        compress; // immigrator accepts compressed records
+	uint64_t    delta_lut; // if not 0, only emigrate records newer than this
 	as_partition_mig_tx_state tx_state; // really only for LDT
 
 	cf_atomic32 bytes_emigrating;
+	cf_atomic32 window; // cap on bytes_emigrating - immigrator may shrink it
 	shash       *reinsert_hash;
 	cf_queue    *ctrl_q;
 	emig_meta_q *meta_q;
@@ -221,6 +235,7 @@ typedef struct immigration_s {
 	cf_atomic32      done_recv;      // flag - 0 if not yet received, atomic counter for receives
 	uint64_t         start_recv_ms;  // time the first START event was received
 	uint64_t         done_recv_ms;   // time the first DONE event was received
+	bool             receiving;      // counted in the memory budget's split
 
 	uint32_t         emig_id;
 	immig_meta_q     meta_q;
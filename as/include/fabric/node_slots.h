@@ -0,0 +1,92 @@
+/*
+ * node_slots.h
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+#pragma once
+
+//==========================================================
+// Includes.
+//
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "citrusleaf/cf_atomic.h"
+
+#include "util.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+// Head of every slot - the rest of a slot is its owner's, zeroed when the slot
+// is first given to a node.
+typedef struct as_node_slot_s {
+	cf_node			node;
+	pthread_mutex_t	lock;
+} as_node_slot;
+
+// Called under the slot lock, for a slot whose node has left the cluster.
+// Returns true if the slot holds nothing, after returning its owner's fields
+// to their zeroed state.
+typedef bool (*as_node_slot_reclaim_fn)(void* slot);
+
+// A fixed array of slots, one per destination node, that is searched without
+// locking. Slots are appended, and published only once initialized. When the
+// table is full, the slot of a node that has left the cluster is reassigned,
+// so a slot's node may change - use as_node_slots_lock() to lock a node's slot.
+typedef struct as_node_slots_s {
+	uint8_t*		slots;
+	size_t			slot_sz;
+	uint32_t		max_slots;
+	cf_atomic32		n_slots;
+	pthread_mutex_t	lock;
+	as_node_slot_reclaim_fn reclaim_fn;
+} as_node_slots;
+
+#define AS_NODE_SLOTS_INIT(_slots, _max, _reclaim_fn) { \
+	(uint8_t*)(_slots), sizeof((_slots)[0]), (_max), 0, \
+	PTHREAD_MUTEX_INITIALIZER, (_reclaim_fn) }
+
+
+//==========================================================
+// Public API.
+//
+
+void as_node_slots_init(as_node_slots* t, void* slots, size_t slot_sz, uint32_t max_slots, as_node_slot_reclaim_fn reclaim_fn);
+void* as_node_slots_find(as_node_slots* t, cf_node node);
+void* as_node_slots_get(as_node_slots* t, cf_node node);
+void* as_node_slots_lock(as_node_slots* t, cf_node node, bool create);
+
+static inline uint32_t
+as_node_slots_count(as_node_slots* t)
+{
+	return cf_atomic32_get(t->n_slots);
+}
+
+static inline void*
+as_node_slots_at(as_node_slots* t, uint32_t i)
+{
+	return t->slots + (i * t->slot_sz);
+}
@@ -0,0 +1,55 @@
+/*
+ * partition_changelog.h
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+
+#pragma once
+
+//==========================================================
+// Includes.
+//
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "citrusleaf/cf_digest.h"
+
+#include "base/datamodel.h"
+
+
+//==========================================================
+// Typedefs.
+//
+
+typedef struct as_partition_changelog_s as_partition_changelog;
+
+
+//==========================================================
+// Public API.
+//
+
+as_partition_changelog* as_partition_changelog_create(as_namespace* ns);
+void as_partition_changelog_clear(as_partition_changelog* cl);
+void as_partition_changelog_record_changed(as_partition* p, as_record* r);
+
+// Gets the digests written after since_lut, in a new allocation the caller
+// must free. Returns false if the changelog doesn't cover since_lut.
+bool as_partition_changelog_get(as_partition_changelog* cl, uint64_t since_lut, uint32_t max_age_sec, cf_digest** p_keyds, uint32_t* p_n_keyds);
@@ -0,0 +1,71 @@
+/*
+ * partition_digest.h
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+#pragma once
+
+//==========================================================
+// Includes.
+//
+
+#include <stdint.h>
+
+#include "dynbuf.h"
+#include "util.h"
+
+#include "base/datamodel.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+// A partition's hash tree - a root over 16 mid nodes over 256 leaves. A record
+// lands in the leaf given by the first digest byte not used for the partition
+// id, so each leaf is a contiguous digest range.
+#define AS_PARTITION_DIGEST_N_MIDS 16
+#define AS_PARTITION_DIGEST_N_LEAVES 256
+#define AS_PARTITION_DIGEST_LEAF_BYTE 2
+
+// Throttle for tree reduces, shared by local and remote requests.
+#define AS_PARTITION_DIGEST_RECORDS_PER_SEC (1000 * 1000)
+
+// Order-independent - the hash is the sum of its records' (digest, generation,
+// last-update-time) hashes, and a parent the sum of its children.
+typedef struct as_partition_digest_node_s {
+	uint64_t	hash;
+	uint64_t	n_records;
+} as_partition_digest_node;
+
+
+//==========================================================
+// Public API.
+//
+
+void as_partition_digest_init();
+
+// Appends the tree at depth 0 (root), 1 (mids) or 2 (leaves). Returns NULL on
+// success, otherwise an error reason.
+const char* as_partition_digest_get_info(as_namespace* ns, as_partition_id pid, uint32_t depth, cf_dyn_buf* db);
+
+// Compares with the partition's tree on another node, appending "match" or the
+// divergent digest ranges. Returns NULL on success, otherwise an error reason.
+const char* as_partition_digest_compare(as_namespace* ns, as_partition_id pid, cf_node node, cf_dyn_buf* db);
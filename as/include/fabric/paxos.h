@@ -85,7 +85,9 @@ typedef struct as_paxos_msg {
  *   Paxos protocol v4 is identical to v3 except in the value of the version identifier.
  *      The v4 protocol is used as a tag to distinguish nodes running with Rack Aware mode
  *      enabled so that clustering will only be possible between nodes with a common
- *      interpretation of the internal bit field structure of node ID values. */
+ *      interpretation of the internal bit field structure of node ID values.
+ *   Any version may carry partition sync tables compactly encoded in the PARTITION_COMPACT
+ *      field, rather than in the PARTITION and PARTITIONSZ arrays (see paxos-compact-sync). */
 static const msg_template as_paxos_msg_template[] = {
 #define AS_PAXOS_MSG_V1_IDENTIFIER 0x7078
 #define AS_PAXOS_MSG_V2_IDENTIFIER 0x7079
@@ -114,7 +116,9 @@ static const msg_template as_paxos_msg_template[] = {
 #define AS_PAXOS_MSG_SUCCESSION_LENGTH 10
 	{ AS_PAXOS_MSG_SUCCESSION_LENGTH, M_FT_UINT32 },
 #define AS_PAXOS_MSG_PARTITIONSZ 11
-	{ AS_PAXOS_MSG_PARTITIONSZ, M_FT_ARRAY_BUF}
+	{ AS_PAXOS_MSG_PARTITIONSZ, M_FT_ARRAY_BUF},
+#define AS_PAXOS_MSG_PARTITION_COMPACT 12
+	{ AS_PAXOS_MSG_PARTITION_COMPACT, M_FT_BUF}
 };
 
 #define AS_PAXOS_MSG_SCRATCH_SIZE 1536 // accommodate AS_PAXOS_MSG_HEARTBEAT_EVENTS in 64-node cluster
@@ -301,3 +305,9 @@ void as_paxos_dump(bool verbose);
  * Returns 0 if successful, -1 otherwise.
  */
 int as_paxos_get_succession_list(cf_dyn_buf *db);
+
+/*
+ * Get the rack-id of each node in the Paxos succession list, as heard in the
+ * nodes' heartbeats, and append it to the given "cf_dyn_buf *".
+ */
+void as_paxos_get_racks_str(cf_dyn_buf *db);
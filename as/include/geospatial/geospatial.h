@@ -48,6 +48,35 @@ extern bool geo_region_cover(as_namespace * ns,
 							 uint64_t * cellmaxp,
 							 int * numcellsp);
 
+// Cell ranges covering a region - cached by the region's GeoJSON, and merged
+// where adjacent, so fewer than the covering's cells.
+extern bool geo_region_cover_ranges(as_namespace * ns,
+									const char * buf,
+									size_t bufsz,
+									geo_region_t region,
+									int maxnumranges,
+									uint64_t * cellminp,
+									uint64_t * cellmaxp,
+									int * numrangesp,
+									bool * cachedp);
+
+// Parse through a cache of recently parsed GeoJSON geometries - cheap for the
+// same values matched or indexed repeatedly. The cell id is 0 for a region.
+extern bool geo_json_point(const char * buf,
+						   size_t bufsz,
+						   uint64_t * cellidp);
+
+extern bool geo_json_region_contains(const char * buf,
+									 size_t bufsz,
+									 uint64_t cellidval,
+									 bool * withinp);
+
+extern bool geo_json_region_cover(const char * buf,
+								  size_t bufsz,
+								  int maxnumcells,
+								  uint64_t * cellctrp,
+								  int * numcellsp);
+
 extern bool geo_point_centers(as_namespace * ns,
 							  uint64_t cellidval,
 							  int maxnumcenters,
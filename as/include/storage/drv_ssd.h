@@ -35,6 +35,7 @@
 #include "citrusleaf/cf_queue.h"
 
 #include "hist.h"
+#include "ring_queue.h"
 
 #include "base/datamodel.h"
 
@@ -58,6 +59,14 @@
 
 #define MAX_SSD_THREADS 20
 
+// Most swbs coalesced into one device write, and the most that may be popped
+// but not yet completed per device.
+#define MAX_SSD_FLUSH_SWBS 64
+#define SSD_FLUSH_WINDOW (MAX_SSD_THREADS * MAX_SSD_FLUSH_SWBS)
+
+// Current swbs per device, each taking records of a TTL class.
+#define MAX_TTL_WRITE_STREAMS 4
+
 // Forward declaration.
 struct drv_ssd_s;
 
@@ -80,6 +89,20 @@ typedef struct {
 } __attribute__((__packed__)) ssd_device_header;
 
 
+//------------------------------------------------
+// Device placement weights - kept in the device
+// header's spare space, after the info slices.
+//
+#define SSD_PLACEMENT_MAGIC 0x504C4143 // "PLAC"
+#define N_PLACEMENT_SLOTS 256 // one per value of digest[DIGEST_STORAGE_BYTE]
+
+typedef struct {
+	uint32_t	magic;
+	uint32_t	n_devices;
+	uint64_t	weights[AS_STORAGE_MAX_DEVICES]; // device size in MiB when set
+} __attribute__((__packed__)) ssd_placement_header;
+
+
 //------------------------------------------------
 // Write buffer - where records accumulate until
 // (the full buffer is) flushed to a device.
@@ -88,13 +111,29 @@ typedef struct {
 	cf_atomic32			rc;
 	cf_atomic32			n_writers;	// number of concurrent writers
 	bool				skip_post_write_q;
+	bool				recently_read;	// read from since queued on post-write queue
 	struct drv_ssd_s	*ssd;
+	uint64_t			flush_seq;	// order in which write workers took it
 	uint32_t			wblock_id;
 	uint32_t			pos;
+	uint32_t			end;		// records stop here - any summary trailer follows
+	bool				summary;	// keeping a summary trailer for this wblock
+	uint32_t			n_summary_entries;
 	uint8_t				*buf;
 } ssd_write_buf;
 
 
+//------------------------------------------------
+// Shadow write - a copy of a flushed swb's buffer,
+// so the swb needn't wait for the shadow device.
+//
+typedef struct {
+	uint8_t				*buf;
+	uint32_t			wblock_id;
+	uint64_t			queued_ms;	// for lag stats
+} ssd_shadow_write;
+
+
 //------------------------------------------------
 // Per-wblock information.
 //
@@ -103,8 +142,12 @@ typedef struct ssd_wblock_state_s {
 	uint32_t			state;		// for now just a defrag flag
 	cf_atomic32			inuse_sz;	// number of bytes currently used in the wblock
 	ssd_write_buf		*swb;		// pending writes for the wblock, also treated as a cache for reads
+	cf_atomic32			max_void_time;	// latest void-time written to the wblock (0 = unknown)
 } ssd_wblock_state;
 
+// max_void_time for a wblock holding a record that never expires.
+#define WBLOCK_VOID_TIME_NEVER	0x7FFFffff
+
 // wblock state
 //
 // Ultimately this may become a full-blown state, but for now it's effectively
@@ -143,8 +186,8 @@ typedef struct drv_ssd_s
 
 	uint32_t		running;
 
-	pthread_mutex_t	write_lock;			// lock protects writes to current swb
-	ssd_write_buf	*current_swb;		// swb currently being filled by writes
+	pthread_mutex_t	write_lock;			// lock protects writes to current swbs
+	ssd_write_buf	*current_swbs[MAX_TTL_WRITE_STREAMS]; // swbs currently being filled by writes, per TTL class
 
 	pthread_mutex_t	defrag_lock;		// lock protects writes to defrag swb
 	ssd_write_buf	*defrag_swb;		// swb currently being filled by defrag
@@ -155,14 +198,35 @@ typedef struct drv_ssd_s
 	cf_queue		*free_wblock_q;		// IDs of free wblocks
 	cf_queue		*defrag_wblock_q;	// IDs of wblocks to defrag
 
-	cf_queue		*swb_write_q;		// pointers to swbs ready to write
-	cf_queue		*swb_shadow_q;		// pointers to swbs ready to write to shadow, if any
+	cf_ring_queue	*swb_write_q;		// pointers to swbs ready to write
+	cf_queue		*shadow_write_q[MAX_SSD_THREADS]; // shadow writes per shadow worker, if any
+	cf_queue		*shadow_buf_free_q;	// shadow write buffers free and waiting, if any
 	cf_queue		*swb_free_q;		// pointers to swbs free and waiting
 	cf_queue		*post_write_q;		// pointers to swbs that have been written but are cached
 
+	pthread_mutex_t	flush_lock;			// orders write workers' pops of swb_write_q
+	uint64_t		next_flush_seq;		// sequence number for next swb popped
+
+	pthread_mutex_t	flush_done_lock;	// lock protects in-order completion of flushes
+	uint64_t		next_flush_done_seq;	// sequence number of next swb to complete
+	ssd_write_buf	*flush_done_pending[SSD_FLUSH_WINDOW]; // flushed out of order, by sequence number
+	uint32_t		max_flush_swbs;		// most swbs coalesced into one device write
+	cf_atomic32		n_flushes_in_flight;	// swbs currently being flushed
+	uint32_t		max_flushes_in_flight;	// high-water mark since last stats log
+
 	cf_atomic_int	n_defrag_wblock_reads;	// total number of wblocks added to the defrag_wblock_q
 	cf_atomic_int	n_defrag_wblock_writes;	// total number of swbs added to the swb_write_q by defrag
 	cf_atomic_int	n_wblock_writes;		// total number of swbs added to the swb_write_q by writes
+	cf_atomic64		n_defrag_expired_wblocks; // total number of wblocks defrag skipped as all expired
+	cf_atomic64		n_defrag_expired_records; // total number of expired records defrag didn't move
+
+	cf_atomic64		n_cache_read_hits;		// total number of record reads served from swbs
+	cf_atomic64		n_cache_read_misses;	// total number of record reads served from device
+	cf_atomic64		n_batch_read_merged;	// total number of record reads saved by merging batch reads
+
+	cf_atomic32		n_shadow_writes_queued;	// shadow writes in shadow_write_q or being written
+	cf_atomic64		n_shadow_dropped_writes; // shadow writes dropped for lag - shadow is stale
+	uint64_t		shadow_lag_ms;			// age of most recent shadow write when it was popped
 
 	cf_atomic32		defrag_sweep;		// defrag sweep flag
 
@@ -184,25 +248,29 @@ typedef struct drv_ssd_s
 	bool			has_ldt;
 	bool			sub_sweep;
 
-	uint32_t		cold_start_block_counter;		// large blocks read
-	uint64_t		record_add_older_counter;		// records not inserted due to better existing one
-	uint64_t		record_add_expired_counter;		// records not inserted due to expiration
-	uint64_t		record_add_max_ttl_counter;		// records not inserted due to max-ttl
-	uint64_t		record_add_replace_counter;		// records reinserted
-	uint64_t		record_add_unique_counter;		// records inserted
+	cf_atomic32		cold_start_block_counter;		// large blocks read
+	cf_atomic64		record_add_older_counter;		// records not inserted due to better existing one
+	cf_atomic64		record_add_expired_counter;		// records not inserted due to expiration
+	cf_atomic64		record_add_max_ttl_counter;		// records not inserted due to max-ttl
+	cf_atomic64		record_add_truncated_counter;	// records not inserted due to truncation
+	cf_atomic64		record_add_replace_counter;		// records reinserted
+	cf_atomic64		record_add_unique_counter;		// records inserted
 	uint64_t		record_add_sigfail_counter;
+	cf_atomic64		n_cold_start_summaries;		// wblocks loaded from summary trailers
 
 	ssd_alloc_table	*alloc_table;
+	uint64_t		*live_map;			// bit per rblock, set where a live record starts - null unless defrag-live-map
 
 	pthread_t		maintenance_thread;
 	pthread_t		write_worker_thread[MAX_SSD_THREADS];
-	pthread_t		shadow_worker_thread;
+	pthread_t		shadow_worker_thread[MAX_SSD_THREADS];
 	pthread_t		load_device_thread;
 	pthread_t		defrag_thread;
 
 	histogram		*hist_read;
 	histogram		*hist_large_block_read;
 	histogram		*hist_write;
+	histogram		*hist_write_q;		// time swbs wait in swb_write_q
 	histogram		*hist_shadow_write;
 	histogram		*hist_fsync;
 } drv_ssd;
@@ -220,6 +288,18 @@ typedef struct drv_ssds_s
 	// load a record.
 	bool get_state_from_storage[AS_PARTITIONS];
 
+	// Optional memory cache of records read from device - null if disabled.
+	struct ssd_read_cache_s *read_cache;
+
+	// Optional cache just for LDT sub-records, so ordinary reads don't evict
+	// the leaves and nodes of hot large lists - null if disabled.
+	struct ssd_read_cache_s *ldt_subrec_cache;
+
+	// If weighted, the device for each value of digest[DIGEST_STORAGE_BYTE] -
+	// else that value modulo the number of devices.
+	bool				weighted_placement;
+	uint8_t				placement[N_PLACEMENT_SLOTS];
+
 	int					n_ssds;
 	drv_ssd				ssds[];
 } drv_ssds;
@@ -231,6 +311,43 @@ typedef struct drv_ssds_s
 
 void ssd_resume_devices(drv_ssds *ssds);
 
+
+//==========================================================
+// Record read cache - drv_ssd_cache.c
+//
+
+typedef struct ssd_read_cache_s ssd_read_cache;
+
+ssd_read_cache *ssd_read_cache_create(uint64_t max_size);
+uint8_t *ssd_read_cache_get(ssd_read_cache *cache, cf_digest *keyd, uint16_t file_id, uint64_t rblock_id, uint32_t generation, uint32_t size);
+void ssd_read_cache_put(ssd_read_cache *cache, cf_digest *keyd, uint16_t file_id, uint64_t rblock_id, uint32_t generation, const uint8_t *block, uint32_t size);
+void ssd_read_cache_remove(ssd_read_cache *cache, cf_digest *keyd);
+
+
+//==========================================================
+// Device I/O trace - drv_ssd_trace.c
+//
+
+#define SSD_TRACE_READ			1
+#define SSD_TRACE_WRITE			2
+#define SSD_TRACE_DEFRAG_READ	3
+#define SSD_TRACE_N_OPS			4
+
+extern volatile bool g_ssd_trace_enabled;
+
+void ssd_trace_record(drv_ssd *ssd, uint8_t op, uint64_t offset, uint32_t size, uint64_t start_ns);
+
+// Call after a device op issued at start_ns - costs a flag check when off.
+static inline void
+ssd_trace_note(drv_ssd *ssd, uint8_t op, uint64_t offset, uint32_t size,
+		uint64_t start_ns)
+{
+	if (g_ssd_trace_enabled) {
+		ssd_trace_record(ssd, op, offset, size, start_ns);
+	}
+}
+
+
 //
 // Conversions between bytes and rblocks.
 //
@@ -280,6 +397,64 @@ static inline uint32_t RBLOCK_ID_TO_WBLOCK_ID(drv_ssd *ssd, uint64_t rblock_id)
 }
 
 
+//
+// Live-record map - lets defrag visit only the records still in use.
+//
+
+// Note a record placed at rblock_id.
+static inline void
+ssd_live_map_set(drv_ssd *ssd, uint64_t rblock_id)
+{
+	if (ssd->live_map) {
+		__sync_fetch_and_or(&ssd->live_map[rblock_id >> 6],
+				1UL << (rblock_id & 63));
+	}
+}
+
+// Note the record at rblock_id freed.
+static inline void
+ssd_live_map_clear(drv_ssd *ssd, uint64_t rblock_id)
+{
+	if (ssd->live_map) {
+		__sync_fetch_and_and(&ssd->live_map[rblock_id >> 6],
+				~(1UL << (rblock_id & 63)));
+	}
+}
+
+// Note all records in rblocks [rblock_id, end) freed - whole words are zeroed
+// with one store each, and only partial words at either end are masked.
+static inline void
+ssd_live_map_clear_range(drv_ssd *ssd, uint64_t rblock_id, uint64_t end)
+{
+	if (! ssd->live_map || rblock_id >= end) {
+		return;
+	}
+
+	uint64_t word = rblock_id >> 6;
+	uint64_t end_word = end >> 6;
+
+	if (word == end_word) {
+		__sync_fetch_and_and(&ssd->live_map[word],
+				~(((1UL << (end - rblock_id)) - 1) << (rblock_id & 63)));
+		return;
+	}
+
+	if ((rblock_id & 63) != 0) {
+		__sync_fetch_and_and(&ssd->live_map[word],
+				(1UL << (rblock_id & 63)) - 1);
+		word++;
+	}
+
+	for ( ; word < end_word; word++) {
+		__atomic_store_n(&ssd->live_map[word], 0, __ATOMIC_RELAXED);
+	}
+
+	if ((end & 63) != 0) {
+		__sync_fetch_and_and(&ssd->live_map[end_word], ~((1UL << (end & 63)) - 1));
+	}
+}
+
+
 //
 // Size rounding needed for direct IO.
 //
@@ -34,6 +34,8 @@
 #include "citrusleaf/cf_digest.h"
 #include "citrusleaf/cf_queue.h"
 
+#include "dynbuf.h"
+
 #include "base/datamodel.h"
 #include "base/rec_props.h"
 
@@ -72,7 +74,7 @@ typedef enum {
 } as_storage_type;
 
 #define NAMESPACE_HAS_PERSISTENCE(ns) \
-	(ns->storage_type != AS_STORAGE_ENGINE_MEMORY) 
+	(ns->storage_type != AS_STORAGE_ENGINE_MEMORY || ns->memory_snapshot_dir)
 // For sizing the storage API "v-tables".
 #define AS_STORAGE_ENGINE_TYPES 4
 
@@ -97,6 +99,7 @@ typedef struct as_storage_rd_s {
 												// temporary (data_in_memory == false)
 												// enables this record's data to be written to drive
 	uint16_t		n_bins;
+	struct as_bin_index_s *bin_index;			// if not null, index over bins by id - see as_bin_index_attach()
 	bool			record_on_device;			// if true, record exists on device
 	bool			ignore_record_on_device;	// if true, never read record off device (such as in replace case)
 	bool			have_device_block;			// if true, we have a storage block as part of the rd. if false, we must get one.
@@ -136,6 +139,7 @@ typedef struct {
 //
 
 extern void as_storage_init();
+extern as_namespace *as_storage_init_wait_next(); // NULL when all namespaces are loaded
 extern int as_storage_namespace_destroy(as_namespace *ns);
 extern int as_storage_namespace_attributes_get(as_namespace *ns, as_storage_attributes *attr);
 
@@ -151,13 +155,24 @@ extern int as_storage_record_close(as_record *r, as_storage_rd *rd);
 // Called within as_storage_rd usage cycle.
 extern uint16_t as_storage_record_get_n_bins(as_storage_rd *rd);
 extern int as_storage_record_read(as_storage_rd *rd);
+extern void as_storage_record_read_batch(as_storage_rd **rds, uint32_t n_rds); // rds must share storage type
 extern int as_storage_particle_read_all(as_storage_rd *rd);
 extern bool as_storage_record_size_and_check(as_storage_rd *rd);
 extern int as_storage_record_write(as_record *r, as_storage_rd *rd);
 
+// Device-order sweep of all records, e.g. for a scan. The sweep is in slices,
+// each a range of one device, and consecutive slices are on different devices.
+// Records in partitions with a null tree are skipped, as are stale copies. The
+// callback gets each live record locked, with its rd open and block read, and
+// must close the rd and release the record - returning false stops the slice.
+typedef bool (*as_storage_sweep_cb)(as_index_ref *r_ref, as_storage_rd *rd, void *udata);
+extern uint32_t as_storage_sweep_n_slices(as_namespace *ns, uint32_t *p_n_devices); // 0 if storage can't sweep
+extern void as_storage_sweep_slice(as_namespace *ns, uint32_t slice, struct as_index_tree_s **trees, as_storage_sweep_cb cb, void *udata);
+
 // Storage capacity monitoring.
 extern void as_storage_wait_for_defrag();
 extern bool as_storage_overloaded(as_namespace *ns); // returns true if write queue is too backed up
+extern uint32_t as_storage_write_q_depth(as_namespace *ns); // deepest device write queue
 extern bool as_storage_has_space(as_namespace *ns);
 extern void as_storage_defrag_sweep(as_namespace *ns);
 
@@ -182,6 +197,7 @@ extern uint64_t as_storage_record_get_n_bytes_memory(as_storage_rd *rd);
 extern void as_storage_record_adjust_mem_stats(as_storage_rd *rd, uint64_t start_bytes);
 extern void as_storage_record_drop_from_mem_stats(as_storage_rd *rd);
 extern bool as_storage_record_get_key(as_storage_rd *rd);
+extern uint8_t *as_storage_record_detach_block(as_storage_rd *rd);
 extern size_t as_storage_record_rec_props_size(as_storage_rd *rd);
 extern void as_storage_record_set_rec_props(as_storage_rd *rd, uint8_t* rec_props_data);
 extern uint32_t as_storage_record_copy_rec_props(as_storage_rd *rd, as_rec_props *p_rec_props);
@@ -189,6 +205,13 @@ extern uint32_t as_storage_record_copy_rec_props(as_storage_rd *rd, as_rec_props
 // Called only at shutdown to flush all device write-queues.
 extern void as_storage_shutdown();
 
+// Device I/O trace capture and replay - return null or the reason for failure.
+extern const char *as_storage_trace_start(as_namespace *ns, const char *file_name, uint64_t max_recs);
+extern const char *as_storage_trace_stop();
+extern void as_storage_trace_get_info(cf_dyn_buf *db);
+extern const char *as_storage_replay_start(const char *trace_name, const char *device_path, const char *engine_name, uint32_t n_threads, bool paced);
+extern void as_storage_replay_get_info(cf_dyn_buf *db);
+
 
 //------------------------------------------------
 // AS_STORAGE_ENGINE_MEMORY functions.
@@ -199,6 +222,9 @@ extern int as_storage_namespace_destroy_memory(as_namespace *ns);
 extern int as_storage_namespace_attributes_get_memory(as_namespace *ns, as_storage_attributes *attr);
 
 extern int as_storage_stats_memory(as_namespace *ns, int *available_pct, uint64_t *used_disk_bytes);
+extern int as_storage_info_get_memory(as_namespace *ns, uint idx, uint8_t *buf, size_t *len);
+
+extern void as_storage_shutdown_memory(as_namespace *ns);
 
 
 //------------------------------------------------
@@ -218,12 +244,19 @@ extern int as_storage_record_close_ssd(as_record *r, as_storage_rd *rd);
 
 extern uint16_t as_storage_record_get_n_bins_ssd(as_storage_rd *rd);
 extern int as_storage_record_read_ssd(as_storage_rd *rd);
+extern void as_storage_record_read_batch_ssd(as_storage_rd **rds, uint32_t n_rds);
 extern int as_storage_particle_read_all_ssd(as_storage_rd *rd);
+extern int as_storage_particle_read_bins_ssd(as_storage_rd *rd, const uint16_t *ids, uint16_t n_ids);
 extern bool as_storage_record_size_and_check_ssd(as_storage_rd *rd);
 extern int as_storage_record_write_ssd(as_record *r, as_storage_rd *rd);
+extern uint32_t as_storage_sweep_n_slices_ssd(as_namespace *ns, uint32_t *p_n_devices);
+extern void as_storage_sweep_slice_ssd(as_namespace *ns, uint32_t slice, struct as_index_tree_s **trees, as_storage_sweep_cb cb, void *udata);
 
 extern void as_storage_wait_for_defrag_ssd(as_namespace *ns);
 extern bool as_storage_overloaded_ssd(as_namespace *ns);
+extern uint32_t as_storage_write_q_depth_ssd(as_namespace *ns);
+extern void as_storage_shadow_stats_ssd(as_namespace *ns, uint32_t *write_q, uint64_t *lag_ms, uint64_t *dropped_writes);
+extern void as_storage_post_write_q_stats_ssd(as_namespace *ns, cf_dyn_buf *db);
 extern bool as_storage_has_space_ssd(as_namespace *ns);
 extern void as_storage_defrag_sweep_ssd(as_namespace *ns);
 
@@ -238,6 +271,7 @@ extern int as_storage_histogram_clear_ssd(as_namespace *ns);
 
 // Called by "base class" functions but not via table.
 extern bool as_storage_record_get_key_ssd(as_storage_rd *rd);
+extern uint8_t *as_storage_record_detach_block_ssd(as_storage_rd *rd);
 extern void as_storage_shutdown_ssd(as_namespace *ns);
 
 
@@ -262,3 +296,6 @@ extern int as_storage_particle_read_all_kv(as_storage_rd *rd);
 extern int as_storage_record_write_kv(as_record *r, as_storage_rd *rd);
 
 extern int as_storage_stats_kv(as_namespace *ns, int *available_pct, uint64_t *used_disk_bytes);
+
+// Called by "base class" functions but not via table.
+extern void as_storage_shutdown_kv(as_namespace *ns);
@@ -0,0 +1,67 @@
+/*
+ * read_coalesce.h
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+#pragma once
+
+//==========================================================
+// Includes.
+//
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "citrusleaf/cf_digest.h"
+
+#include "base/datamodel.h"
+#include "base/transaction.h"
+
+
+//==========================================================
+// Typedefs.
+//
+
+// A client read attached to an identical in-flight read. (Its reservation and
+// msgp are gone - the leader's response is all it needs.)
+typedef struct as_read_waiter_s {
+	as_file_handle*	fd_h;
+	uint64_t		start_time;
+} as_read_waiter;
+
+
+//==========================================================
+// Public API.
+//
+
+void as_read_coalesce_init();
+bool as_read_coalesce_join(as_transaction* tr);
+void as_read_coalesce_close(as_transaction* tr);
+uint32_t as_read_coalesce_detach(as_transaction* tr, as_read_waiter** p_waiters);
+void as_read_coalesce_close_digest(as_namespace* ns, cf_digest* keyd);
+
+// Call under the record lock, before a write or delete of the record is acked.
+static inline void
+as_read_coalesce_record_changed(as_namespace* ns, cf_digest* keyd)
+{
+	if (ns->read_coalescing) {
+		as_read_coalesce_close_digest(ns, keyd);
+	}
+}
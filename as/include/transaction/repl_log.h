@@ -0,0 +1,58 @@
+/*
+ * repl_log.h
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+#pragma once
+
+//==========================================================
+// Includes.
+//
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "msg.h"
+#include "util.h"
+
+#include "base/datamodel.h"
+#include "base/transaction.h"
+#include "transaction/rw_request.h"
+
+
+//==========================================================
+// Public API.
+//
+
+void repl_log_init();
+
+// Checked before applying a write on master - true if async replication to one
+// of the partition's replicas has reached async-replication-max-lag.
+bool repl_log_is_full(as_transaction* tr);
+
+// Call after the master write, with rw's destinations set up. Returns true if
+// the replica writes were logged, in which case the transaction is finished.
+bool repl_log_write(rw_request* rw, as_transaction* tr);
+
+void repl_log_handle_ack(cf_node node, msg* m);
+
+// Bytes logged but not yet acknowledged, and age of the oldest such write,
+// over all of the namespace's destinations.
+void repl_log_get_lag(const as_namespace* ns, uint64_t* p_lag_bytes, uint64_t* p_lag_ms);
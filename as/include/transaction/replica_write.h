@@ -48,6 +48,9 @@ void repl_write_setup_rw(rw_request* rw, as_transaction* tr, repl_write_done_cb
 void repl_write_reset_rw(rw_request* rw, as_transaction* tr, repl_write_done_cb cb);
 void repl_write_handle_op(cf_node node, msg* m);
 void repl_write_handle_ack(cf_node node, msg* m);
+void repl_write_handle_batch(cf_node node, msg* m);
+void repl_write_handle_batch_ack(cf_node node, msg* m);
+void repl_write_handle_async_batch(cf_node node, msg* m);
 
 // For LDTs only:
 void repl_write_ldt_make_message(msg* m, as_transaction* tr,
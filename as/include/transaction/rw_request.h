@@ -101,6 +101,8 @@ typedef struct rw_request_s {
 
 	cf_clock			start_time;
 	cf_clock			benchmark_time;
+	cf_clock			stage_time;
+	uint32_t			stage_us[AS_MAX_OP_STAGES];
 
 	as_partition_reservation rsv;
 
@@ -135,6 +137,7 @@ typedef struct rw_request_s {
 	// alternatively, timeouts.
 	uint32_t			tid;
 	bool				dup_res_complete;
+	bool				dup_meta_only; // dup-res is in its metadata-only first phase
 	dup_res_done_cb		dup_res_cb;
 	repl_write_done_cb	repl_write_cb;
 	timeout_done_cb		timeout_cb;
@@ -147,6 +150,7 @@ typedef struct rw_request_s {
 
 	cf_clock			xmit_ms; // time of next retransmit
 	uint32_t			retry_interval_ms; // interval to add for next retransmit
+	uint64_t			timer_ms; // deadline of current retransmit timer
 
 	// These three elements are used both for the duplicate resolution phase
 	//  the "operation" (usually write) phase.
@@ -159,6 +163,9 @@ typedef struct rw_request_s {
 	msg*				dup_msg[AS_CLUSTER_SZ];
 	int					dup_result_code[AS_CLUSTER_SZ];
 
+	// Only while on a thread's freelist.
+	struct rw_request_s* free_next;
+
 } rw_request;
 
 
@@ -168,13 +175,7 @@ typedef struct rw_request_s {
 
 rw_request* rw_request_create();
 void rw_request_destroy(rw_request* rw);
-
-
-static inline void
-rw_request_hdestroy(void* pv)
-{
-	rw_request_destroy((rw_request*)pv);
-}
+void rw_request_free(rw_request* rw);
 
 
 static inline void
@@ -182,7 +183,7 @@ rw_request_release(rw_request* rw)
 {
 	if (0 == cf_rc_release(rw)) {
 		rw_request_destroy(rw);
-		cf_rc_free(rw);
+		rw_request_free(rw);
 	}
 }
 
@@ -58,6 +58,7 @@ typedef enum {
 	RW_FIELD_MULTIOP, // single msg for multiple ops - LDT (& secondary index?)
 	RW_FIELD_LDT_VERSION,
 	RW_FIELD_LAST_UPDATE_TIME,
+	RW_FIELD_BATCH, // flattened RW_OP_WRITE msgs or their acks
 
 	NUM_RW_FIELDS
 } rw_msg_field;
@@ -68,6 +69,10 @@ typedef enum {
 #define RW_OP_DUP_ACK 4
 #define RW_OP_MULTI 5
 #define RW_OP_MULTI_ACK 6
+#define RW_OP_WRITE_BATCH 7
+#define RW_OP_WRITE_BATCH_ACK 8
+#define RW_OP_WRITE_ASYNC_BATCH 9
+#define RW_OP_WRITE_ASYNC_BATCH_ACK 10
 
 #define RW_INFO_XDR				0x0001
 #define RW_INFO_UNUSED_2		0x0002 // was RW_INFO_MIGRATE
@@ -79,6 +84,8 @@ typedef enum {
 #define RW_INFO_SINDEX_TOUCHED	0x0080 // sindex was touched
 #define RW_INFO_LDT				0x0100 // LDT multi-op message
 #define RW_INFO_UDF_WRITE		0x0200 // write is done from inside UDF
+#define RW_INFO_INDEX_ONLY		0x0400 // master only touched - pickle is unchanged
+#define RW_INFO_DUP_META_ONLY	0x0800 // dup-res request or ack for metadata only, no record
 
 typedef struct rw_request_hkey_s {
 	as_namespace_id	ns_id;
@@ -96,5 +103,6 @@ uint32_t rw_request_hash_count();
 transaction_status rw_request_hash_insert(rw_request_hkey* hkey, rw_request* rw, as_transaction* tr);
 void rw_request_hash_delete(rw_request_hkey* hkey, rw_request* rw);
 rw_request* rw_request_hash_get(rw_request_hkey* hkey);
+void rw_request_hash_schedule(rw_request* rw);
 
 void rw_request_hash_dump();
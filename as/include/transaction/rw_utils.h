@@ -64,6 +64,7 @@ void send_rw_messages(rw_request* rw);
 int set_set_from_msg(as_record* r, as_namespace* ns, as_msg* m);
 bool check_msg_key(as_msg* m, as_storage_rd* rd);
 bool get_msg_key(as_transaction* tr, as_storage_rd* rd);
+bool msg_key_matches_digest(as_transaction* tr, const char* set_name);
 void update_metadata_in_index(as_transaction* tr, bool increment_generation, as_record* r);
 bool pickle_all(as_storage_rd* rd, rw_request* rw);
 void delete_adjust_sindex(as_storage_rd* rd);
@@ -0,0 +1,280 @@
+/*
+ * admission.c
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/* SYNOPSIS
+ * Adaptive admission control. When admission-control is on, a monitor thread
+ * samples three health signals every ADMIT_PERIOD_US - transaction queue wait,
+ * device write latency, and device write queue depth - and sets each
+ * namespace's admission level from the worst of them, expressed as a
+ * percentage of its threshold (admission-queue-wait-ms,
+ * admission-device-latency-ms and max-write-cache respectively).
+ *
+ * As the level rises, low-priority work is shed or delayed first - scans, then
+ * background UDF scans, then migrations, then writes - so foreground reads keep
+ * their latency. Reads are never shed here.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "base/admission.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "citrusleaf/cf_atomic.h"
+
+#include "fault.h"
+
+#include "base/cfg.h"
+#include "base/datamodel.h"
+#include "storage/storage.h"
+
+
+//==========================================================
+// Constants.
+//
+
+#define ADMIT_PERIOD_US			(100 * 1000)
+#define ADMIT_HYSTERESIS_PCT	10
+#define ADMIT_MIGRATE_DELAY_US	1000
+
+// Signal percentage (of threshold) at which each level is entered.
+static const uint32_t LEVEL_PCT[] = { 50, 75, 100, 125 };
+
+#define N_LEVEL_PCTS (sizeof(LEVEL_PCT) / sizeof(uint32_t))
+
+
+//==========================================================
+// Globals.
+//
+
+static cf_atomic64 g_queue_wait_ns = 0;
+static cf_atomic64 g_queue_waits = 0;
+
+// Smoothed signals - only touched by the monitor thread.
+static uint64_t g_queue_wait_avg = 0;
+static uint64_t g_device_write_avg[AS_NAMESPACE_SZ];
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static void* run_admission(void* arg);
+static void update_namespace(as_namespace* ns, uint32_t queue_pct);
+static uint32_t level_for_pct(uint32_t pct);
+static uint32_t pct_of(uint64_t value, uint64_t threshold);
+
+static inline uint64_t
+smooth(uint64_t avg, uint64_t sample)
+{
+	return (avg * 3 + sample) / 4;
+}
+
+
+//==========================================================
+// Public API.
+//
+
+void
+as_admission_init()
+{
+	pthread_t thread;
+	pthread_attr_t attrs;
+
+	pthread_attr_init(&attrs);
+	pthread_attr_setdetachstate(&attrs, PTHREAD_CREATE_DETACHED);
+
+	if (pthread_create(&thread, &attrs, run_admission, NULL) != 0) {
+		cf_crash(AS_TSVC, "failed to create admission control thread");
+	}
+}
+
+
+// Called by transaction threads once per dequeued batch.
+void
+as_admission_note_queue_wait(uint64_t wait_ns, uint32_t n_waits)
+{
+	if (n_waits != 0) {
+		cf_atomic64_add(&g_queue_wait_ns, (int64_t)wait_ns);
+		cf_atomic64_add(&g_queue_waits, (int64_t)n_waits);
+	}
+}
+
+
+// Called by device write threads after each write-block flush.
+void
+as_admission_note_device_write(as_namespace* ns, uint64_t write_ns)
+{
+	cf_atomic64_add(&ns->admission_device_write_ns, (int64_t)write_ns);
+	cf_atomic64_incr(&ns->admission_device_writes);
+}
+
+
+// Returns true if work of this class should be shed. Migrations are not
+// refused - the caller is delayed here instead, and false is returned.
+bool
+as_admission_shed(as_namespace* ns, as_admit_class cls)
+{
+	if (ns->admission_level < (uint32_t)cls) {
+		return false;
+	}
+
+	switch (cls) {
+	case AS_ADMIT_SCAN:
+		cf_atomic64_incr(&ns->n_admission_scan_shed);
+		return true;
+	case AS_ADMIT_UDF_BG:
+		cf_atomic64_incr(&ns->n_admission_udf_bg_shed);
+		return true;
+	case AS_ADMIT_MIGRATE:
+		cf_atomic64_incr(&ns->n_admission_migrate_delays);
+		usleep(ADMIT_MIGRATE_DELAY_US);
+		return false;
+	case AS_ADMIT_WRITE:
+		cf_atomic64_incr(&ns->n_admission_write_shed);
+		return true;
+	default:
+		cf_crash(AS_TSVC, "unexpected admission class %d", cls);
+		return false;
+	}
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+static void*
+run_admission(void* arg)
+{
+	while (true) {
+		usleep(ADMIT_PERIOD_US);
+
+		uint64_t wait_ns = (uint64_t)cf_atomic64_get(g_queue_wait_ns);
+		uint64_t n_waits = (uint64_t)cf_atomic64_get(g_queue_waits);
+
+		cf_atomic64_sub(&g_queue_wait_ns, (int64_t)wait_ns);
+		cf_atomic64_sub(&g_queue_waits, (int64_t)n_waits);
+
+		if (! g_config.admission_control) {
+			g_queue_wait_avg = 0;
+
+			for (uint32_t i = 0; i < g_config.n_namespaces; i++) {
+				as_namespace* ns = g_config.namespaces[i];
+
+				g_device_write_avg[i] = 0;
+				ns->admission_level = 0;
+			}
+
+			continue;
+		}
+
+		g_queue_wait_avg = smooth(g_queue_wait_avg,
+				n_waits == 0 ? 0 : wait_ns / n_waits);
+
+		uint32_t queue_pct = pct_of(g_queue_wait_avg,
+				(uint64_t)g_config.admission_queue_wait_ms * 1000000);
+
+		for (uint32_t i = 0; i < g_config.n_namespaces; i++) {
+			update_namespace(g_config.namespaces[i], queue_pct);
+		}
+	}
+
+	return NULL;
+}
+
+
+static void
+update_namespace(as_namespace* ns, uint32_t queue_pct)
+{
+	uint64_t write_ns = (uint64_t)cf_atomic64_get(ns->admission_device_write_ns);
+	uint64_t n_writes = (uint64_t)cf_atomic64_get(ns->admission_device_writes);
+
+	cf_atomic64_sub(&ns->admission_device_write_ns, (int64_t)write_ns);
+	cf_atomic64_sub(&ns->admission_device_writes, (int64_t)n_writes);
+
+	uint64_t* device_avg = &g_device_write_avg[ns->id - 1];
+
+	*device_avg = smooth(*device_avg, n_writes == 0 ? 0 : write_ns / n_writes);
+
+	uint32_t pct = queue_pct;
+	uint32_t device_pct = pct_of(*device_avg,
+			(uint64_t)g_config.admission_device_latency_ms * 1000000);
+
+	if (device_pct > pct) {
+		pct = device_pct;
+	}
+
+	uint32_t write_q_pct = pct_of(as_storage_write_q_depth(ns),
+			(uint64_t)ns->storage_max_write_q);
+
+	if (write_q_pct > pct) {
+		pct = write_q_pct;
+	}
+
+	uint32_t old_level = ns->admission_level;
+	uint32_t level = level_for_pct(pct);
+
+	// Rise immediately, but only fall once comfortably below a threshold.
+	if (level < old_level) {
+		uint32_t lower_level = level_for_pct(pct + ADMIT_HYSTERESIS_PCT);
+
+		level = lower_level < old_level ? lower_level : old_level;
+	}
+
+	if (level != old_level) {
+		cf_info(AS_TSVC, "{%s} admission level %u -> %u (queue %u%% device %u%% write-q %u%%)",
+				ns->name, old_level, level, queue_pct, device_pct, write_q_pct);
+		ns->admission_level = level;
+	}
+}
+
+
+static uint32_t
+level_for_pct(uint32_t pct)
+{
+	uint32_t level = 0;
+
+	while (level < N_LEVEL_PCTS && pct >= LEVEL_PCT[level]) {
+		level++;
+	}
+
+	return level;
+}
+
+
+static uint32_t
+pct_of(uint64_t value, uint64_t threshold)
+{
+	if (threshold == 0) {
+		return 0;
+	}
+
+	uint64_t pct = value * 100 / threshold;
+
+	return pct > UINT32_MAX ? UINT32_MAX : (uint32_t)pct;
+}
@@ -39,6 +39,7 @@
 #include "base/transaction.h"
 #include "base/udf_arglist.h"
 #include "base/udf_memtracker.h"
+#include "base/udf_native.h"
 #include "base/udf_record.h"
 
 
@@ -335,13 +336,20 @@ as_aggr_process(as_namespace *ns, as_aggr_call * ag_call, cf_ll * ap_recl, void
 	as_list arglist;
 	as_list_init(&arglist, ag_call->def.arglist, &udf_arglist_hooks);
 
+	udf_mem_call mem_call;
+
 	as_udf_context ctx = {
 		.as         = &as,
 		.timer      = NULL,
-		.memtracker = NULL
+		.memtracker = udf_mem_call_setup(&mem_call, ag_call->def.filename)
 	};
-	int ret = as_module_apply_stream(&mod_lua, &ctx, ag_call->def.filename, ag_call->def.function, &istream, &arglist, &ostream, ap_res);
+	udf_native_stream_fn native_fn = udf_native_stream_get(ag_call->def.filename, ag_call->def.function);
+
+	int ret = native_fn ?
+			native_fn(&ctx, &istream, &arglist, &ostream, ap_res) :
+			as_module_apply_stream(&mod_lua, &ctx, ag_call->def.filename, ag_call->def.function, &istream, &arglist, &ostream, ap_res);
 
+	udf_mem_call_done(&mem_call);
 	as_list_destroy(&arglist);
 
 	acleanup(&astate);
@@ -0,0 +1,145 @@
+/*
+ * alloc_tags.c
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/* SYNOPSIS
+ * The subsystems allocation profiling samples are tagged by, and the source
+ * files that belong to each. Files not listed count as "other".
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "base/alloc_tags.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "alloc_prof.h"
+
+#include "base/cfg.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+typedef enum {
+	TAG_INDEX,
+	TAG_SINDEX,
+	TAG_PARTICLE,
+	TAG_CDT,
+	TAG_UDF,
+	TAG_FABRIC_MSG,
+	TAG_BATCH,
+	TAG_OTHER,
+
+	N_TAGS
+} alloc_tag;
+
+static const char* const TAG_NAMES[N_TAGS] = {
+		[TAG_INDEX] = "index",
+		[TAG_SINDEX] = "sindex",
+		[TAG_PARTICLE] = "particle",
+		[TAG_CDT] = "cdt",
+		[TAG_UDF] = "udf",
+		[TAG_FABRIC_MSG] = "fabric-msg",
+		[TAG_BATCH] = "batch",
+		[TAG_OTHER] = "other"
+};
+
+// File name prefixes - first match wins, so specific ones go first.
+static const struct {
+	const char*	prefix;
+	alloc_tag	tag;
+} FILE_TAGS[] = {
+		{ "arenax", TAG_INDEX },
+		{ "index.c", TAG_INDEX },
+		{ "expire_index.c", TAG_INDEX },
+		{ "set_index.c", TAG_INDEX },
+		{ "secondary_index.c", TAG_SINDEX },
+		{ "sindex_", TAG_SINDEX },
+		{ "thr_sindex.c", TAG_SINDEX },
+		{ "thr_query.c", TAG_SINDEX },
+		{ "ai_", TAG_SINDEX },
+		{ "bt", TAG_SINDEX },
+		{ "find.c", TAG_SINDEX },
+		{ "stream.c", TAG_SINDEX },
+		{ "cdt.c", TAG_CDT },
+		{ "particle_list.c", TAG_CDT },
+		{ "particle_map.c", TAG_CDT },
+		{ "particle", TAG_PARTICLE },
+		{ "bin.c", TAG_PARTICLE },
+		{ "dim_slab.c", TAG_PARTICLE },
+		{ "record.c", TAG_PARTICLE },
+		{ "udf_", TAG_UDF },
+		{ "aggr.c", TAG_UDF },
+		{ "ldt", TAG_UDF },
+		{ "msg.c", TAG_FABRIC_MSG },
+		{ "fabric.c", TAG_FABRIC_MSG },
+		{ "batch.c", TAG_BATCH },
+		{ "thr_batch.c", TAG_BATCH }
+};
+
+#define N_FILE_TAGS (sizeof(FILE_TAGS) / sizeof(FILE_TAGS[0]))
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static uint32_t tag_of_file(const char* file);
+
+
+//==========================================================
+// Public API.
+//
+
+void
+as_alloc_tags_init()
+{
+	cf_alloc_prof_init(TAG_NAMES, N_TAGS, tag_of_file);
+	cf_alloc_prof_set_interval(g_config.alloc_prof_interval);
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+// Only called when sampling - a scan is cheap enough.
+static uint32_t
+tag_of_file(const char* file)
+{
+	const char* base = strrchr(file, '/');
+
+	base = base ? base + 1 : file;
+
+	for (uint32_t i = 0; i < N_FILE_TAGS; i++) {
+		if (strncmp(base, FILE_TAGS[i].prefix,
+				strlen(FILE_TAGS[i].prefix)) == 0) {
+			return FILE_TAGS[i].tag;
+		}
+	}
+
+	return TAG_OTHER;
+}
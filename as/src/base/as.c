@@ -37,19 +37,25 @@
 #include "citrusleaf/alloc.h"
 
 #include "ai.h"
+#include "coarse_clock.h"
 #include "fault.h"
 #include "jem.h"
 #include "util.h"
 
+#include "base/admission.h"
+#include "base/alloc_tags.h"
 #include "base/asm.h"
 #include "base/batch.h"
 #include "base/cfg.h"
 #include "base/datamodel.h"
 #include "base/json_init.h"
+#include "base/metrics.h"
 #include "base/monitor.h"
+#include "base/partition_stream.h"
 #include "base/scan.h"
 #include "base/secondary_index.h"
 #include "base/security.h"
+#include "base/sindex_snapshot.h"
 #include "base/system_metadata.h"
 #include "base/stats.h"
 #include "base/thr_batch.h"
@@ -57,13 +63,16 @@
 #include "base/thr_sindex.h"
 #include "base/thr_tsvc.h"
 #include "base/ticker.h"
+#include "base/truncate.h"
 #include "base/xdr_serverside.h"
 #include "fabric/fabric.h"
 #include "fabric/hb.h"
 #include "fabric/migrate.h"
+#include "fabric/partition_digest.h"
 #include "fabric/paxos.h"
 #include "storage/storage.h"
 #include "transaction/proxy.h"
+#include "transaction/read_coalesce.h"
 #include "transaction/rw_request_hash.h"
 #include "transaction/udf.h"
 
@@ -124,8 +133,9 @@ const char HELP[] =
 		"\n"
 		"--cold-start"
 		"\n"
-		"(Enterprise edition only.) At startup, force the Aerospike server to read all\n"
-		"records from storage devices to rebuild the index.\n"
+		"(Enterprise edition, or namespaces configured with 'fast-restart true'.) At\n"
+		"startup, force the Aerospike server to read all records from storage devices\n"
+		"to rebuild the index.\n"
 		"\n"
 		"--instance <0-15>"
 		"\n"
@@ -349,6 +359,9 @@ main(int argc, char **argv)
 	mem_count_init(c->memory_accounting ? MEM_COUNT_ENABLE : MEM_COUNT_DISABLE);
 #endif
 
+	// Start tagging allocation profiling samples by subsystem.
+	as_alloc_tags_init();
+
 	// Perform privilege separation as necessary. If configured user & group
 	// don't have root privileges, all resources created or reopened past this
 	// point must be set up so that they are accessible without root privileges.
@@ -402,6 +415,11 @@ main(int argc, char **argv)
 		cf_process_daemonize(open_fds, num_open_fds);
 	}
 
+	// Threads don't survive daemonizing, so start the async logger and the
+	// cheap clock used for timeout checks only now.
+	cf_fault_start_async();
+	cf_coarse_clock_start();
+
 #ifdef USE_ASM
 	// Log the main thread's Linux Task ID (pre- and post-fork) to the console.
 	fprintf(stderr, "Initial main thread tid: %lu\n", initial_tid);
@@ -452,18 +470,49 @@ main(int argc, char **argv)
 	ai_init();					// before as_storage_init() populates indexes
 	as_sindex_thr_init();		// defrag secondary index (ok during population)
 
+	// Startup phases are ordered by dependency: namespaces (and truncate
+	// cutoffs) before storage, and each namespace's secondary index population
+	// as soon as its own storage is loaded - namespaces don't wait on each
+	// other. Each phase is timed, to see where a slow restart spends its time.
+	uint64_t phase_start_ms = cf_getms();
+
 	// Initialize namespaces. Each namespace decides here whether it will do a
 	// warm or cold start. Index arenas, partition structures and index tree
 	// structures are initialized. Secondary index system metadata is restored.
 	as_namespaces_init(cold_start_cmd, instance);
 
-	// Initialize the storage system. For cold starts, this includes reading
-	// all the objects off the drives. This may block for a long time. The
-	// defrag subsystem starts operating at the end of this call.
+	// Restore truncate cutoffs, so that cold start can skip truncated records.
+	as_truncate_init();
+
+	cf_info(AS_AS, "startup phase namespaces done in %lu ms",
+			cf_getms() - phase_start_ms);
+	phase_start_ms = cf_getms();
+
+	// Initialize the storage system - each namespace's storage is initialized
+	// concurrently. For cold starts, this includes reading all the objects off
+	// the drives. The defrag subsystem starts operating as each namespace's
+	// storage finishes loading.
 	as_storage_init();
+	as_sindex_boot_populate_start();
+
+	as_namespace *ns;
+
+	// Populate each namespace's secondary indexes as soon as its storage has
+	// loaded. This may block for a long time.
+	while ((ns = as_storage_init_wait_next()) != NULL) {
+		as_sindex_boot_populate_ns(ns);
+	}
+
+	cf_info(AS_AS, "startup phase storage done in %lu ms",
+			cf_getms() - phase_start_ms);
+	phase_start_ms = cf_getms();
+
+	// Wait for all secondary index population to finish.
+	as_sindex_boot_populate_finish();
 
-	// Populate all secondary indexes. This may block for a long time.
-	as_sindex_boot_populateall();
+	cf_info(AS_AS, "startup phase sindex done in %lu ms",
+			cf_getms() - phase_start_ms);
+	phase_start_ms = cf_getms();
 
 	cf_info(AS_AS, "initializing services...");
 
@@ -473,10 +522,14 @@ main(int argc, char **argv)
 	as_hb_init();				// inter-node heartbeat
 	as_fabric_init();			// inter-node communications
 	as_info_init();				// info transaction handling
+	as_partition_stream_init();	// push partition map changes to subscribers
 	as_paxos_init();			// cluster consensus algorithm
 	as_migrate_init();			// move data between nodes
+	as_partition_digest_init();	// replica consistency hash trees
 	as_proxy_init();			// do work on behalf of others
 	as_rw_init();				// read & write service
+	as_read_coalesce_init();	// hot key read coalescing
+	as_admission_init();		// shed low-priority work under overload
 	as_query_init();			// query transaction handling
 	as_udf_init();				// user-defined functions
 	as_scan_init();				// scan a namespace or set
@@ -498,11 +551,15 @@ main(int argc, char **argv)
 	as_hb_start();				// start inter-node heatbeat
 	as_paxos_start();			// blocks until cluster membership is obtained
 	as_nsup_start();			// may send delete transactions to other nodes
+	as_truncate_start();		// background cleanup of truncated records
 	as_demarshal_start();		// server will now receive client transactions
 	as_info_port_start();		// server will now receive info transactions
+	as_metrics_start();			// server will now serve OpenMetrics scrapes
 	as_ticker_start();			// only after everything else is started
 
 	// Log a service-ready message.
+	cf_info(AS_AS, "startup phase services done in %lu ms",
+			cf_getms() - phase_start_ms);
 	cf_info(AS_AS, "service ready: soon there will be cake!");
 
 	//--------------------------------------------
@@ -530,6 +587,7 @@ main(int argc, char **argv)
 	//
 
 	as_storage_shutdown();
+	as_sindex_snapshot_save_all();
 	as_xdr_shutdown();
 	as_smd_shutdown(g_smd);
 
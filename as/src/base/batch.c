@@ -28,15 +28,18 @@
 #include "citrusleaf/cf_clock.h"
 #include "citrusleaf/cf_digest.h"
 #include "citrusleaf/cf_queue.h"
+#include "base/as_stap.h"
 #include "base/cfg.h"
 #include "base/datamodel.h"
 #include "base/index.h"
+#include "base/packet_compression.h"
 #include "base/proto.h"
 #include "base/security.h"
 #include "base/stats.h"
 #include "base/thr_tsvc.h"
 #include "base/transaction.h"
 #include "jem.h"
+#include "ring_queue.h"
 #include "socket.h"
 #include <errno.h>
 
@@ -47,6 +50,17 @@
 #define BATCH_BLOCK_SIZE (1024 * 128) // 128K
 #define BATCH_MAX_TRANSACTION_SIZE (1024 * 1024 * 10) // 10MB
 #define BATCH_REPEAT_SIZE 25  // index(4),digest(20) and repeat(1)
+#define BATCH_ROW_FULL 0 // row contains namespace and bin names
+#define BATCH_ROW_REPEAT 1 // row uses previous row's namespace and bin names
+#define BATCH_ROW_WRITE 2 // as BATCH_ROW_FULL, with as_batch_write_input too
+#define BATCH_RESPONSE_QUEUE_CAPACITY 256 // overflows to a locked queue
+#define BATCH_CHUNK_SIZE 64 // inline rows per chunk shared with batch threads
+#define BATCH_CHUNK_QUEUE_CAPACITY 1024 // overflows to a locked queue
+#define BATCH_SEND_MAX_IOV 64 // buffers per writev
+#define BATCH_SEND_MAX_EVENTS 64
+#define BATCH_SEND_POLL_MS 1 // response queue wait while sends are blocked
+#define BATCH_DUP_UNSEEN UINT32_MAX // batch index not (yet) in any row
+#define BATCH_DUP_END (UINT32_MAX - 1) // last row of a duplicate chain
 
 //---------------------------------------------------------
 // TYPES
@@ -65,18 +79,31 @@ typedef struct {
 	uint16_t n_ops;
 } __attribute__((__packed__)) as_batch_input;
 
+// Follows the as_batch_input header of BATCH_ROW_WRITE rows, before the fields.
+// Carries the write header values a read row doesn't need - the ops which
+// follow have values, as in a single record write or operate.
 typedef struct {
+	uint8_t info2;
+	uint8_t info3;
+	uint16_t generation;
+	uint32_t record_ttl;
+} __attribute__((__packed__)) as_batch_write_input;
+
+typedef struct as_batch_buffer_s {
+	struct as_batch_buffer_s* next; // chain of completed buffers not yet sent
 	uint32_t capacity;
 	uint32_t size;
 	uint32_t tran_count;
 	cf_atomic32 writers;
+	uint8_t* comp_packet; // compressed form of proto + data, if sent compressed
+	uint32_t comp_size;
 	as_proto proto;
 	uint8_t data[];
 } __attribute__((__packed__)) as_batch_buffer;
 
 struct as_batch_shared_s {
 	pthread_mutex_t lock;
-	cf_queue* response_queue;
+	cf_ring_queue* response_queue;
 	as_file_handle* fd_h;
 	cl_msg* msgp;
 	as_batch_buffer* buffer;
@@ -85,15 +112,36 @@ struct as_batch_shared_s {
 	uint32_t tran_count;
 	uint32_t tran_max;
 	int result_code;
+
+	// Response sending state - only used by the batch thread for this batch.
+	as_comp_stream* comp; // NULL unless client asked for compressed responses
+	as_batch_buffer* send_head;
+	as_batch_buffer* send_tail;
+	uint32_t send_offset; // bytes already sent of first unsent buffer or trailer
+	cl_msg final_msg;
+	bool final_pending; // all responses received - trailer not yet sent
+	bool send_blocked; // waiting in the batch thread's poll for socket to drain
+
+	// By batch index, the next row reading the same record with the same
+	// namespace and bins - NULL unless the batch has such duplicate rows.
+	uint32_t* dup_next;
 };
 
 typedef struct {
 	as_batch_shared* shared;
 	as_batch_buffer* buffer;
+	bool steal; // if shared is null - steal chunks rather than stop
 } as_batch_response;
 
+// Inline rows of a large batch, which idle batch threads may steal and process
+// in parallel with the service thread that parsed them.
+typedef struct {
+	uint32_t n_trans;
+	as_transaction trans[BATCH_CHUNK_SIZE];
+} as_batch_chunk;
+
 typedef struct {
-	cf_queue* response_queue;
+	cf_ring_queue* response_queue;
 	cf_queue* complete_queue;
 	cf_atomic32 count;
 	volatile bool active;
@@ -104,6 +152,23 @@ typedef struct {
 	bool complete;
 } as_batch_work;
 
+// Parsed read row, held back so rows can be grouped by partition.
+typedef struct {
+	cf_digest keyd;
+	cl_msg* msgp;
+	uint32_t index;
+	uint32_t msg_fields;
+	as_partition_id pid;
+	bool should_inline;
+} as_batch_row;
+
+// Where rows go once parsed - inline, in shared chunks, or to the tsvc queue.
+typedef struct {
+	uint32_t n_inline;
+	uint32_t n_chunks_shared;
+	as_batch_chunk* chunk;
+} as_batch_dispatch;
+
 //---------------------------------------------------------
 // STATIC DATA
 //---------------------------------------------------------
@@ -114,6 +179,9 @@ static as_buffer_pool batch_buffer_pool;
 static as_batch_queue batch_queues[MAX_BATCH_THREADS];
 static pthread_mutex_t batch_resize_lock;
 
+static cf_ring_queue* batch_chunk_queue;
+static cf_atomic32 batch_wake_index;
+
 static int batch_buffer_arena_normal;
 static int batch_buffer_arena_huge;
 
@@ -184,59 +252,132 @@ as_batch_send_error(as_transaction* btr, int result_code)
 	return status;
 }
 
+static void
+as_batch_buffer_release(as_batch_buffer* buffer)
+{
+	if (buffer->capacity) {
+		if (as_buffer_pool_push_limit(&batch_buffer_pool, buffer, buffer->capacity, g_config.batch_max_unused_buffers) != 0) {
+			cf_atomic64_incr(&g_stats.batch_index_destroyed_buffers);
+		}
+	}
+	else {
+		// Server error buffers should not be put into buffer pool.
+		cf_free(buffer);
+		cf_atomic64_incr(&g_stats.batch_index_destroyed_buffers);
+	}
+}
+
+static inline uint8_t*
+as_batch_buffer_send_data(as_batch_buffer* buffer)
+{
+	return buffer->comp_packet ? buffer->comp_packet : (uint8_t*)&buffer->proto;
+}
+
+static inline uint32_t
+as_batch_buffer_send_size(as_batch_buffer* buffer)
+{
+	return buffer->comp_packet ? buffer->comp_size : sizeof(as_proto) + buffer->size;
+}
+
+static void
+as_batch_send_release(as_batch_buffer* buffer)
+{
+	if (buffer->comp_packet) {
+		cf_free(buffer->comp_packet);
+	}
+
+	as_batch_buffer_release(buffer);
+}
+
+static void
+as_batch_buffer_compress(as_batch_shared* shared, as_batch_buffer* buffer)
+{
+	// Buffers are queued in the order they're sent, so compressing here keeps
+	// the stream in step with the client.
+	uint32_t plain_size = sizeof(as_proto) + buffer->size;
+	uint8_t* packet = cf_malloc(as_comp_stream_bound(shared->comp, plain_size));
+	size_t packet_size = as_comp_stream_packet(shared->comp, (uint8_t*)&buffer->proto, sizeof(as_proto), buffer->data, buffer->size, packet);
+
+	if (packet_size == 0) {
+		cf_free(packet);
+		return;
+	}
+
+	buffer->comp_packet = packet;
+	buffer->comp_size = (uint32_t)packet_size;
+}
+
 static void
 as_batch_send_buffer(as_batch_shared* shared, as_batch_buffer* buffer)
 {
 	// Don't send buffer if an error has already occurred.
-	if (! shared->fd_h || shared->result_code) {
+	if (! shared->fd_h || shared->result_code || ! buffer->capacity) {
+		as_batch_buffer_release(buffer);
 		return;
 	}
 
-	// Send buffer block to client socket.
+	// Queue buffer block to be sent to client socket.
 	buffer->proto.version = PROTO_VERSION;
 	buffer->proto.type = PROTO_TYPE_AS_MSG;
 	buffer->proto.sz = buffer->size;
 	as_proto_swap(&buffer->proto);
 
-	int status = as_batch_send(shared->fd_h->sock, (uint8_t*)&buffer->proto, sizeof(as_proto) + buffer->size, MSG_NOSIGNAL | MSG_MORE);
+	buffer->comp_packet = NULL;
 
-	if (status) {
-		// Socket error. Close socket.
-		as_end_of_transaction_force_close(shared->fd_h);
-		shared->fd_h = 0;
-		cf_atomic64_incr(&g_stats.batch_index_errors);
+	// On failure the buffer simply goes plain.
+	if (as_comp_stream_wants(shared->comp, sizeof(as_proto) + buffer->size)) {
+		as_batch_buffer_compress(shared, buffer);
 	}
+
+	buffer->next = NULL;
+
+	if (shared->send_tail) {
+		shared->send_tail->next = buffer;
+	}
+	else {
+		shared->send_head = buffer;
+	}
+	shared->send_tail = buffer;
 }
 
 static void
 as_batch_send_final(as_batch_shared* shared)
 {
-	// Send protocol trailer to client socket.
+	// Queue protocol trailer to be sent to client socket.
 	if (! shared->fd_h) {
 		return;
 	}
 
-	cl_msg m;
-	m.proto.version = PROTO_VERSION;
-	m.proto.type = PROTO_TYPE_AS_MSG;
-	m.proto.sz = sizeof(as_msg);
-	as_proto_swap(&m.proto);
-	m.msg.header_sz = sizeof(as_msg);
-	m.msg.info1 = 0;
-	m.msg.info2 = 0;
-	m.msg.info3 = AS_MSG_INFO3_LAST;
-	m.msg.unused = 0;
-	m.msg.result_code = shared->result_code;
-	m.msg.generation = 0;
-	m.msg.record_ttl = 0;
-	m.msg.transaction_ttl = 0;
-	m.msg.n_fields = 0;
-	m.msg.n_ops = 0;
-	as_msg_swap_header(&m.msg);
+	cl_msg* m = &shared->final_msg;
+	m->proto.version = PROTO_VERSION;
+	m->proto.type = PROTO_TYPE_AS_MSG;
+	m->proto.sz = sizeof(as_msg);
+	as_proto_swap(&m->proto);
+	m->msg.header_sz = sizeof(as_msg);
+	m->msg.info1 = 0;
+	m->msg.info2 = 0;
+	m->msg.info3 = AS_MSG_INFO3_LAST;
+	m->msg.unused = 0;
+	m->msg.result_code = shared->result_code;
+	m->msg.generation = 0;
+	m->msg.record_ttl = 0;
+	m->msg.transaction_ttl = 0;
+	m->msg.n_fields = 0;
+	m->msg.n_ops = 0;
+	as_msg_swap_header(&m->msg);
+
+	shared->final_pending = true;
+}
 
-	int status = as_batch_send(shared->fd_h->sock, (uint8_t*) &m, sizeof(m), MSG_NOSIGNAL);
+static void
+as_batch_send_complete(as_batch_shared* shared)
+{
+	// Trailer has been sent - release socket.
+	if (! shared->fd_h) {
+		return;
+	}
 
-	as_end_of_transaction(shared->fd_h, status != 0);
+	as_end_of_transaction(shared->fd_h, false);
 	shared->fd_h = 0;
 
 	// For now the model is timeouts don't appear in histograms.
@@ -245,7 +386,7 @@ as_batch_send_final(as_batch_shared* shared)
 	}
 
 	// Check final return code in order to update statistics.
-	if (status == 0 && shared->result_code == 0) {
+	if (shared->result_code == 0) {
 		cf_atomic64_incr(&g_stats.batch_index_complete);
 	}
 	else {
@@ -258,6 +399,105 @@ as_batch_send_final(as_batch_shared* shared)
 	}
 }
 
+// Send as much of the queued buffers and trailer as the socket will take, with
+// one writev per BATCH_SEND_MAX_IOV buffers. If the socket is full, add it to
+// the batch thread's poll and return - the thread calls this again when the
+// socket is writable, rather than spinning.
+static void
+as_batch_send_queued(as_batch_shared* shared, cf_poll poll, uint32_t* n_blocked)
+{
+	while (shared->fd_h && (shared->send_head || shared->final_pending)) {
+		struct iovec iov[BATCH_SEND_MAX_IOV + 1];
+		uint32_t n_iov = 0;
+		uint32_t offset = shared->send_offset;
+		as_batch_buffer* buffer = shared->send_head;
+
+		while (buffer && n_iov < BATCH_SEND_MAX_IOV) {
+			iov[n_iov].iov_base = as_batch_buffer_send_data(buffer) + offset;
+			iov[n_iov].iov_len = as_batch_buffer_send_size(buffer) - offset;
+			n_iov++;
+			offset = 0;
+			buffer = buffer->next;
+		}
+
+		bool with_final = ! buffer && shared->final_pending;
+
+		if (with_final) {
+			iov[n_iov].iov_base = (uint8_t*)&shared->final_msg + offset;
+			iov[n_iov].iov_len = sizeof(cl_msg) - offset;
+			n_iov++;
+		}
+
+		int32_t rv = cf_socket_send_iov(shared->fd_h->sock, iov, n_iov, MSG_DONTWAIT | (with_final ? 0 : MSG_MORE));
+
+		if (rv < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				cf_poll_add_socket(poll, shared->fd_h->sock, EPOLLOUT, shared);
+				shared->send_blocked = true;
+				(*n_blocked)++;
+				return;
+			}
+
+			// This error may occur frequently if client is timing out transactions.
+			// Therefore, use debug level.
+			cf_debug(AS_BATCH, "Batch send response error returned %d errno %d fd %d", rv, errno, CSFD(shared->fd_h->sock));
+
+			// Socket error. Close socket.
+			as_end_of_transaction_force_close(shared->fd_h);
+			shared->fd_h = 0;
+			cf_atomic64_incr(&g_stats.batch_index_errors);
+			break;
+		}
+
+		// Release fully sent buffers.
+		uint32_t sent = (uint32_t)rv;
+
+		while (shared->send_head) {
+			buffer = shared->send_head;
+
+			uint32_t remaining = as_batch_buffer_send_size(buffer) - shared->send_offset;
+
+			if (sent < remaining) {
+				shared->send_offset += sent;
+				sent = 0;
+				break;
+			}
+
+			sent -= remaining;
+			shared->send_offset = 0;
+			shared->send_head = buffer->next;
+
+			if (! shared->send_head) {
+				shared->send_tail = NULL;
+			}
+
+			as_batch_send_release(buffer);
+		}
+
+		if (with_final && ! shared->send_head && sent != 0) {
+			if (sent < sizeof(cl_msg) - shared->send_offset) {
+				shared->send_offset += sent;
+			}
+			else {
+				shared->send_offset = 0;
+				shared->final_pending = false;
+				as_batch_send_complete(shared);
+			}
+		}
+	}
+
+	// Socket closed on error - discard anything still queued.
+	while (shared->send_head) {
+		as_batch_buffer* buffer = shared->send_head;
+
+		shared->send_head = buffer->next;
+		as_batch_send_release(buffer);
+	}
+
+	shared->send_tail = NULL;
+	shared->final_pending = false;
+}
+
 static inline void
 as_batch_free(as_batch_shared* shared, as_batch_queue* batch_queue)
 {
@@ -265,6 +505,14 @@ as_batch_free(as_batch_shared* shared, as_batch_queue* batch_queue)
 	pthread_mutex_destroy(&shared->lock);
 
 	// Release memory
+	if (shared->comp) {
+		as_comp_stream_destroy(shared->comp);
+	}
+
+	if (shared->dup_next) {
+		cf_free(shared->dup_next);
+	}
+
 	cf_free(shared->msgp);
 	cf_free(shared);
 
@@ -274,49 +522,147 @@ as_batch_free(as_batch_shared* shared, as_batch_queue* batch_queue)
 	cf_atomic32_decr(&batch_queue->count);
 }
 
+static void
+as_batch_chunk_process(as_batch_chunk* chunk)
+{
+	ASD_BATCH_SLICE_START((uint64_t)chunk, chunk->n_trans);
+
+	for (uint32_t i = 0; i < chunk->n_trans; i++) {
+		process_transaction(&chunk->trans[i]);
+	}
+
+	ASD_BATCH_SLICE_DONE((uint64_t)chunk, chunk->n_trans);
+
+	cf_free(chunk);
+}
+
+static uint32_t
+as_batch_chunks_drain(uint32_t max_chunks)
+{
+	// Process shared chunks, from any batch, until none are left.
+	as_batch_chunk* chunk;
+	uint32_t n_chunks = 0;
+
+	while (n_chunks < max_chunks &&
+			cf_ring_queue_pop(batch_chunk_queue, &chunk, CF_RING_QUEUE_NOWAIT) == CF_RING_QUEUE_OK) {
+		as_batch_chunk_process(chunk);
+		n_chunks++;
+	}
+	return n_chunks;
+}
+
+static void
+as_batch_chunk_share(as_batch_chunk* chunk)
+{
+	cf_ring_queue_push(batch_chunk_queue, &chunk);
+
+	// Wake a batch thread that has no responses to send. If none are idle, the
+	// service thread processes the chunk itself.
+	uint32_t thread_size = batch_thread_pool.thread_size;
+	uint32_t start = (uint32_t)cf_atomic32_incr(&batch_wake_index);
+
+	for (uint32_t i = 0; i < thread_size; i++) {
+		as_batch_queue* bq = &batch_queues[(start + i) % thread_size];
+
+		// Count keeps "shutdown threads" from destroying the queue under us.
+		cf_atomic32_incr(&bq->count);
+
+		bool woken = false;
+
+		if (bq->active && cf_ring_queue_sz(bq->response_queue) == 0) {
+			as_batch_response response = { NULL, NULL, true };
+
+			cf_ring_queue_push(bq->response_queue, &response);
+			woken = true;
+		}
+
+		cf_atomic32_decr(&bq->count);
+
+		if (woken) {
+			break;
+		}
+	}
+}
+
+static void
+as_batch_send_progress(as_batch_shared* shared, as_batch_queue* batch_queue, cf_poll poll, uint32_t* n_blocked)
+{
+	as_batch_send_queued(shared, poll, n_blocked);
+
+	// Wait till all transactions have been received and sent before
+	// releasing memory.
+	if (! shared->send_blocked && shared->tran_count_response == shared->tran_max) {
+		as_batch_free(shared, batch_queue);
+	}
+}
+
 static void
 as_batch_worker(void* udata)
 {
 	// Send batch data to client, one buffer block at a time.
 	as_batch_work* work = (as_batch_work*)udata;
 	as_batch_queue* batch_queue = work->batch_queue;
-	cf_queue* response_queue = batch_queue->response_queue;
+	cf_ring_queue* response_queue = batch_queue->response_queue;
 	as_batch_response response;
 	as_batch_shared* shared;
-	as_batch_buffer* buffer;
+	cf_poll poll;
+	uint32_t n_blocked = 0;
 
-	while (cf_queue_pop(response_queue, &response, CF_QUEUE_FOREVER) == CF_QUEUE_OK) {
-		// Check if this thread task should end.
-		shared = response.shared;
-		if (! shared) {
-			break;
-		}
+	// The pool's threads run this once each, until shut down - lets us apply
+	// the batch thread CPUs and policy to threads we don't create.
+	as_config_sched_thread(AS_SCHED_POOL_BATCH, pthread_self());
+
+	// Sockets of this thread's batches whose sends would block.
+	cf_poll_create(&poll);
 
-		buffer = response.buffer;
-		shared->tran_count_response += buffer->tran_count;
+	while (true) {
+		int rv = cf_ring_queue_pop(response_queue, &response, n_blocked == 0 ? CF_RING_QUEUE_FOREVER : BATCH_SEND_POLL_MS);
 
-		if (buffer->capacity) {
-			// Send buffer block to client.
-			as_batch_send_buffer(shared, buffer);
+		if (rv == CF_RING_QUEUE_OK) {
+			// Check if this thread task should end.
+			shared = response.shared;
+			if (! shared) {
+				if (response.steal) {
+					uint32_t n_stolen = as_batch_chunks_drain(UINT32_MAX);
 
-			if (as_buffer_pool_push_limit(&batch_buffer_pool, buffer, buffer->capacity, g_config.batch_max_unused_buffers) != 0) {
-				cf_atomic64_incr(&g_stats.batch_index_destroyed_buffers);
+					cf_atomic64_add(&g_stats.batch_index_stolen_chunks, n_stolen);
+					continue;
+				}
+				break;
+			}
+
+			shared->tran_count_response += response.buffer->tran_count;
+			as_batch_send_buffer(shared, response.buffer);
+
+			if (shared->tran_count_response == shared->tran_max) {
+				as_batch_send_final(shared);
+			}
+
+			if (! shared->send_blocked) {
+				as_batch_send_progress(shared, batch_queue, poll, &n_blocked);
 			}
 		}
-		else {
-			// Server error buffers should not be put into buffer pool.
-			cf_free(buffer);
-			cf_atomic64_incr(&g_stats.batch_index_destroyed_buffers);
+		else if (rv != CF_RING_QUEUE_EMPTY) {
+			break;
 		}
 
-		// Wait till all transactions have been received before sending
-		// final batch entry and releasing memory.
-		if (shared->tran_count_response == shared->tran_max) {
-			as_batch_send_final(shared);
-			as_batch_free(shared, batch_queue);
+		if (n_blocked != 0) {
+			cf_poll_event events[BATCH_SEND_MAX_EVENTS];
+			int32_t n_events = cf_poll_wait(poll, events, BATCH_SEND_MAX_EVENTS, 0);
+
+			for (int32_t i = 0; i < n_events; i++) {
+				shared = (as_batch_shared*)events[i].data;
+				cf_poll_delete_socket(poll, shared->fd_h->sock);
+				shared->send_blocked = false;
+				n_blocked--;
+
+				as_batch_send_progress(shared, batch_queue, poll, &n_blocked);
+			}
 		}
 	}
 
+	cf_poll_destroy(poll);
+
 	// Send back completion notification.
 	uint32_t complete = 1;
 	cf_queue_push(work->batch_queue->complete_queue, &complete);
@@ -333,7 +679,7 @@ as_batch_create_thread_queues(uint32_t begin, uint32_t end)
 
 	for (uint32_t i = begin; i < end; i++) {
 		work.batch_queue = &batch_queues[i];
-		work.batch_queue->response_queue = cf_queue_create(sizeof(as_batch_response), true);
+		work.batch_queue->response_queue = cf_ring_queue_create(sizeof(as_batch_response), BATCH_RESPONSE_QUEUE_CAPACITY);
 		work.batch_queue->complete_queue = cf_queue_create(sizeof(uint32_t), true);
 		work.batch_queue->count = 0;
 		work.batch_queue->active = true;
@@ -393,7 +739,7 @@ as_batch_shutdown_thread_queues(uint32_t begin, uint32_t end)
 	memset(&response, 0, sizeof(as_batch_response));
 
 	for (uint32_t i = begin; i < end; i++) {
-		cf_queue_push(batch_queues[i].response_queue, &response);
+		cf_ring_queue_push(batch_queues[i].response_queue, &response);
 	}
 
 	// Wait for completion events.
@@ -403,7 +749,7 @@ as_batch_shutdown_thread_queues(uint32_t begin, uint32_t end)
 		cf_queue_pop(bq->complete_queue, &complete, CF_QUEUE_FOREVER);
 		cf_queue_destroy(bq->complete_queue);
 		bq->complete_queue = 0;
-		cf_queue_destroy(bq->response_queue);
+		cf_ring_queue_destroy(bq->response_queue);
 		bq->response_queue = 0;
 	}
 	return 0;
@@ -416,7 +762,7 @@ as_batch_find_queue(int queue_index)
 	for (int index = queue_index - 1; index >= 0; index--) {
 		as_batch_queue* bq = &batch_queues[index];
 
-		if (bq->active && cf_queue_sz(bq->response_queue) < g_config.batch_max_buffers_per_queue) {
+		if (bq->active && cf_ring_queue_sz(bq->response_queue) < g_config.batch_max_buffers_per_queue) {
 			return bq;
 		}
 	}
@@ -430,7 +776,7 @@ as_batch_find_queue(int queue_index)
 			break;
 		}
 
-		if (cf_queue_sz(bq->response_queue) < g_config.batch_max_buffers_per_queue) {
+		if (cf_ring_queue_sz(bq->response_queue) < g_config.batch_max_buffers_per_queue) {
 			return bq;
 		}
 	}
@@ -506,7 +852,7 @@ as_batch_buffer_complete(as_batch_shared* shared, as_batch_buffer* buffer)
 	// Flush when all writers have finished writing into the buffer.
 	if (cf_atomic32_decr(&buffer->writers) == 0) {
 		as_batch_response response = {.shared = shared, .buffer = buffer};
-		cf_queue_push(shared->response_queue, &response);
+		cf_ring_queue_push(shared->response_queue, &response);
 	}
 }
 
@@ -568,6 +914,32 @@ as_batch_transaction_end(as_batch_shared* shared, as_batch_buffer* buffer, bool
 	}
 }
 
+static void
+as_batch_fan_out(as_batch_shared* shared, uint32_t index, const uint8_t* data, uint32_t size, int result_code)
+{
+	// Answer rows which duplicate this one with copies of its result. Must be
+	// done before this row's transaction ends, while its buffer can't be sent.
+	uint32_t* dup_next = shared->dup_next;
+
+	if (! dup_next || index >= shared->tran_max) {
+		return;
+	}
+
+	for (uint32_t i = dup_next[index]; i < shared->tran_max; i = dup_next[i]) {
+		as_batch_buffer* buffer;
+		bool complete;
+		uint8_t* dup = as_batch_reserve(shared, size, result_code, &buffer, &complete);
+
+		if (dup && data) {
+			memcpy(dup, data, size);
+
+			// Overload transaction_ttl to store batch index.
+			((as_msg*)dup)->transaction_ttl = cf_swap_to_be32(i);
+		}
+		as_batch_transaction_end(shared, buffer, complete);
+	}
+}
+
 static void
 as_batch_terminate(as_batch_shared* shared, uint32_t tran_count, int result_code)
 {
@@ -597,6 +969,133 @@ as_batch_terminate(as_batch_shared* shared, uint32_t tran_count, int result_code
 	as_batch_transaction_end(shared, buffer, complete);
 }
 
+static int
+as_batch_row_cmp(const void* pa, const void* pb)
+{
+	const as_batch_row* a = (const as_batch_row*)pa;
+	const as_batch_row* b = (const as_batch_row*)pb;
+
+	if (a->pid != b->pid) {
+		return a->pid < b->pid ? -1 : 1;
+	}
+
+	int rv = memcmp(&a->keyd, &b->keyd, sizeof(cf_digest));
+
+	if (rv != 0) {
+		return rv;
+	}
+
+	if (a->msgp != b->msgp) {
+		return a->msgp < b->msgp ? -1 : 1;
+	}
+
+	return a->index < b->index ? -1 : (a->index > b->index ? 1 : 0);
+}
+
+static inline bool
+as_batch_row_is_dup(const as_batch_row* a, const as_batch_row* b)
+{
+	// Rows sharing a row header read the same namespace and bins.
+	return a->msgp == b->msgp && memcmp(&a->keyd, &b->keyd, sizeof(cf_digest)) == 0;
+}
+
+static uint32_t
+as_batch_group_rows(as_batch_shared* shared, as_batch_row* rows, uint32_t n_rows)
+{
+	// Order rows by partition, then digest, so each partition's rows run
+	// back to back through the same partition and index tree.
+	qsort(rows, n_rows, sizeof(as_batch_row), as_batch_row_cmp);
+
+	bool has_dups = false;
+
+	for (uint32_t i = 1; i < n_rows; i++) {
+		if (as_batch_row_is_dup(&rows[i - 1], &rows[i])) {
+			has_dups = true;
+			break;
+		}
+	}
+
+	if (! has_dups) {
+		return n_rows;
+	}
+
+	// Results are fanned out by batch index, so only go ahead if the client
+	// sent unique indices in range.
+	uint32_t tran_max = shared->tran_max;
+	uint32_t* dup_next = cf_malloc(tran_max * sizeof(uint32_t));
+
+	if (! dup_next) {
+		return n_rows;
+	}
+
+	memset(dup_next, 0xFF, tran_max * sizeof(uint32_t));
+
+	for (uint32_t i = 0; i < n_rows; i++) {
+		uint32_t index = rows[i].index;
+
+		if (index >= tran_max || dup_next[index] != BATCH_DUP_UNSEEN) {
+			cf_free(dup_next);
+			return n_rows;
+		}
+
+		dup_next[index] = BATCH_DUP_END;
+	}
+
+	// Keep the first row of each run of duplicates, and chain the rest to it.
+	uint32_t n_kept = 1;
+	uint32_t tail = rows[0].index;
+
+	for (uint32_t i = 1; i < n_rows; i++) {
+		if (as_batch_row_is_dup(&rows[n_kept - 1], &rows[i])) {
+			dup_next[tail] = rows[i].index;
+		}
+		else {
+			rows[n_kept++] = rows[i];
+		}
+
+		tail = rows[i].index;
+	}
+
+	cf_atomic64_add(&g_stats.batch_index_dup_keys, n_rows - n_kept);
+	shared->dup_next = dup_next;
+
+	return n_kept;
+}
+
+static void
+as_batch_dispatch_row(as_transaction* tr, bool should_inline, bool is_write_row, as_batch_dispatch* dispatch)
+{
+	if (is_write_row) {
+		thr_tsvc_enqueue(tr);
+	}
+	else if (should_inline && dispatch->n_inline++ >= BATCH_CHUNK_SIZE &&
+			(dispatch->chunk || (dispatch->chunk = cf_malloc(sizeof(as_batch_chunk))) != NULL)) {
+		// Large batch - past the first chunk, collect inline rows into
+		// chunks that idle batch threads can steal.
+		as_batch_chunk* chunk = dispatch->chunk;
+
+		memcpy(&chunk->trans[chunk->n_trans++], tr, sizeof(as_transaction));
+
+		if (chunk->n_trans == BATCH_CHUNK_SIZE) {
+			as_batch_chunk_share(chunk);
+			dispatch->n_chunks_shared++;
+			dispatch->chunk = NULL;
+		}
+	}
+	else if (should_inline) {
+		// Must copy generic transaction before processing inline, because some
+		// transaction fields are modified during the course of the transaction.
+		// We need each transaction to be initialized to proper values.
+		as_transaction tmp;
+		memcpy(&tmp, tr, sizeof(as_transaction));
+		process_transaction(&tmp);
+	}
+	else {
+		// Queue transaction to be processed by a transaction thread.
+		thr_tsvc_enqueue(tr);
+	}
+}
+
 //---------------------------------------------------------
 // FUNCTIONS
 //---------------------------------------------------------
@@ -625,6 +1124,8 @@ as_batch_init()
 		return rc;
 	}
 
+	batch_chunk_queue = cf_ring_queue_create(sizeof(as_batch_chunk*), BATCH_CHUNK_QUEUE_CAPACITY);
+
 	rc = as_batch_create_thread_queues(0, threads);
 
 	if (rc) {
@@ -689,6 +1190,7 @@ as_batch_queue_task(as_transaction* btr)
 	as_msg_field* mf = (as_msg_field*)bmsg->data;
 	as_msg_field* end;
 	as_msg_field* bf = 0;
+	uint8_t comp_type = COMPRESSION_NONE;
 
 	for (int i = 0; i < bmsg->n_fields; i++) {
 		if ((uint8_t*)mf >= limit) {
@@ -701,6 +1203,9 @@ as_batch_queue_task(as_transaction* btr)
 		if (mf->type == AS_MSG_FIELD_TYPE_BATCH || mf->type == AS_MSG_FIELD_TYPE_BATCH_WITH_SET) {
 			bf = mf;
 		}
+		else if (mf->type == AS_MSG_FIELD_TYPE_RESPONSE_COMPRESSION && as_msg_field_get_value_sz(mf) != 0) {
+			comp_type = mf->data[0];
+		}
 		mf = end;
 	}
 
@@ -749,10 +1254,10 @@ as_batch_queue_task(as_transaction* btr)
 	as_batch_queue* batch_queue = &batch_queues[queue_index];
 
 	// batch_max_buffers_per_queue is a soft limit, but still must be checked under lock.
-	if (! (batch_queue->active && cf_queue_sz(batch_queue->response_queue) < g_config.batch_max_buffers_per_queue)) {
+	if (! (batch_queue->active && cf_ring_queue_sz(batch_queue->response_queue) < g_config.batch_max_buffers_per_queue)) {
 		// Queue buffer limit has been exceeded or thread has been shutdown (probably due to
 		// downwards thread resize).  Search for an available queue.
-		// cf_warning(AS_BATCH, "Queue %u full %d", queue_index, cf_queue_sz(batch_queue->response_queue));
+		// cf_warning(AS_BATCH, "Queue %u full %d", queue_index, cf_ring_queue_sz(batch_queue->response_queue));
 		batch_queue = as_batch_find_queue(queue_index);
 
 		if (! batch_queue) {
@@ -764,6 +1269,7 @@ as_batch_queue_task(as_transaction* btr)
 	// Increment batch queue transaction count.
 	cf_atomic32_incr(&batch_queue->count);
 	shared->response_queue = batch_queue->response_queue;
+	shared->comp = as_comp_stream_create(comp_type);
 
 	// Initialize generic transaction.
 	as_transaction tr;
@@ -781,14 +1287,21 @@ as_batch_queue_task(as_transaction* btr)
 	cl_msg* out = 0;
 	as_msg_op* op;
 	uint32_t tran_row = 0;
+	as_batch_dispatch dispatch = { 0, 0, NULL };
+	bool is_write_row = false;
 	uint8_t info = *data++;  // allow transaction inline.
 
 	bool allow_inline = (g_config.allow_inline_transactions && g_config.n_namespaces_in_memory != 0 && info);
 	bool check_inline = (allow_inline && g_config.n_namespaces_not_in_memory != 0);
 	bool should_inline = (allow_inline && g_config.n_namespaces_not_in_memory == 0);
 
-	// Split batch rows into separate single record read transactions.
-	// The read transactions are located in the same memory block as
+	// Read rows are held back and submitted grouped by partition once all rows
+	// are parsed. Without the memory, submit them as they're parsed.
+	as_batch_row* rows = cf_malloc(tran_count * sizeof(as_batch_row));
+	uint32_t n_rows = 0;
+
+	// Split batch rows into separate single record transactions.
+	// The transactions are located in the same memory block as
 	// the original batch transactions. This allows us to avoid performing
 	// an extra malloc for each transaction.
 	while (tran_row < tran_count && data + BATCH_REPEAT_SIZE <= limit) {
@@ -797,12 +1310,28 @@ as_batch_queue_task(as_transaction* btr)
 		tr.from_data.batch_index = cf_swap_from_be32(in->index);
 		memcpy(&tr.keyd, &in->keyd, sizeof(cf_digest));
 
-		if (in->repeat) {
+		if (in->repeat == BATCH_ROW_REPEAT) {
 			// Row should use previous namespace and bin names.
 			data += BATCH_REPEAT_SIZE;
 		}
 		else {
 			// Row contains full namespace/bin names.
+			uint8_t info1 = in->info1;
+			uint16_t n_fields = cf_swap_from_be16(in->n_fields);
+			uint16_t n_ops = cf_swap_from_be16(in->n_ops);
+			as_batch_write_input win = { 0, 0, 0, 0 };
+
+			if (in->repeat == BATCH_ROW_WRITE) {
+				if (data + sizeof(as_batch_write_input) > limit) {
+					break;
+				}
+
+				// Shift the transaction header up over the write input, so
+				// fields still follow it directly.
+				memcpy(&win, data + sizeof(as_batch_input), sizeof(as_batch_write_input));
+				data += sizeof(as_batch_write_input);
+			}
+
 			out = (cl_msg*)data;
 
 			if (data + sizeof(cl_msg) + sizeof(as_msg_field) > limit) {
@@ -810,24 +1339,29 @@ as_batch_queue_task(as_transaction* btr)
 			}
 
 			out->msg.header_sz = sizeof(as_msg);
-			out->msg.info1 = in->info1;
-			out->msg.info2 = 0;
-			out->msg.info3 = 0;
+			out->msg.info1 = info1;
+			out->msg.info2 = win.info2;
+			out->msg.info3 = win.info3;
 			out->msg.unused = 0;
 			out->msg.result_code = 0;
-			out->msg.generation = 0;
-			out->msg.record_ttl = 0;
+			out->msg.generation = cf_swap_from_be16(win.generation);
+			out->msg.record_ttl = cf_swap_from_be32(win.record_ttl);
 			out->msg.transaction_ttl = bmsg->transaction_ttl; // already swapped
-			// n_fields/n_ops is in exact same place on both input/output, but the value still
-			// needs to be swapped.
-			out->msg.n_fields = cf_swap_from_be16(in->n_fields);
+			out->msg.n_fields = n_fields;
 
 			// Older clients sent zero, but always sent namespace.  Adjust this.
 			if (out->msg.n_fields == 0) {
 				out->msg.n_fields = 1;
 			}
 
-			out->msg.n_ops = cf_swap_from_be16(in->n_ops);
+			out->msg.n_ops = n_ops;
+
+			// Writes go through the write path on transaction threads, never inline.
+			is_write_row = (win.info2 & AS_MSG_INFO2_WRITE) != 0;
+
+			// Field flags are per row - repeat rows share them.
+			tr.msg_fields = 0;
+			as_transaction_set_msg_field_flag(&tr, AS_MSG_FIELD_TYPE_NAMESPACE);
 
 			// Namespace input is same as namespace field, so just leave in place and swap.
 			data += sizeof(cl_msg);
@@ -841,8 +1375,9 @@ as_batch_queue_task(as_transaction* btr)
 
 			// Swap remaining fields.
 			for (uint16_t j = 1; j < out->msg.n_fields; j++) {
-				if (mf->type == AS_MSG_FIELD_TYPE_SET) {
-					as_transaction_set_msg_field_flag(&tr, AS_MSG_FIELD_TYPE_SET);
+				if (mf->type == AS_MSG_FIELD_TYPE_SET ||
+						(is_write_row && mf->type == AS_MSG_FIELD_TYPE_KEY)) {
+					as_transaction_set_msg_field_flag(&tr, mf->type);
 				}
 
 				as_msg_swap_field(mf);
@@ -881,22 +1416,56 @@ as_batch_queue_task(as_transaction* btr)
 		}
 
 		// Submit transaction.
-		if (should_inline) {
-			// Must copy generic transaction before processing inline, because some
-			// transaction fields are modified during the course of the transaction.
-			// We need each transaction to be initialized to proper values.
-			as_transaction tmp;
-			memcpy(&tmp, &tr, sizeof(as_transaction));
-			process_transaction(&tmp);
+		if (rows && ! is_write_row) {
+			as_batch_row* row = &rows[n_rows++];
+
+			row->keyd = tr.keyd;
+			row->msgp = tr.msgp;
+			row->index = tr.from_data.batch_index;
+			row->msg_fields = tr.msg_fields;
+			row->pid = as_partition_getid(tr.keyd);
+			row->should_inline = should_inline;
 		}
 		else {
-			// Queue transaction to be processed by a transaction thread.
-			thr_tsvc_enqueue(&tr);
+			as_batch_dispatch_row(&tr, should_inline, is_write_row, &dispatch);
 		}
 		tran_row++;
 	}
 
 TranEnd:
+	if (rows) {
+		if (n_rows != 0) {
+			n_rows = as_batch_group_rows(shared, rows, n_rows);
+		}
+
+		for (uint32_t i = 0; i < n_rows; i++) {
+			as_batch_row* row = &rows[i];
+
+			tr.keyd = row->keyd;
+			tr.msgp = row->msgp;
+			tr.from_data.batch_index = row->index;
+			tr.msg_fields = row->msg_fields;
+			as_batch_dispatch_row(&tr, row->should_inline, false, &dispatch);
+		}
+
+		cf_free(rows);
+	}
+
+	as_batch_chunk* chunk = dispatch.chunk;
+
+	if (chunk) {
+		if (chunk->n_trans != 0) {
+			as_batch_chunk_process(chunk);
+		}
+		else {
+			cf_free(chunk);
+		}
+	}
+
+	// Help process shared chunks - as many as we shared, unless batch threads
+	// have already taken them all.
+	as_batch_chunks_drain(dispatch.n_chunks_shared);
+
 	if (tran_row < tran_count) {
 		// Mismatch between tran_count and actual data.  Terminate transaction.
 		cf_warning(AS_BATCH, "Batch keys mismatch. Expected %u Received %u", tran_count, tran_row);
@@ -1016,6 +1585,7 @@ as_batch_add_result(as_transaction* tr, const char* setname, uint32_t generation
 			as_msg_swap_op(op);
 		}
 	}
+	as_batch_fan_out(shared, tr->from_data.batch_index, data, (uint32_t)size, tr->result_code);
 	as_batch_transaction_end(shared, buffer, complete);
 }
 
@@ -1033,7 +1603,8 @@ as_batch_add_proxy_result(as_batch_shared* shared, uint32_t index, cf_digest* di
 
 	as_batch_buffer* buffer;
 	bool complete;
-	uint8_t* data = as_batch_reserve(shared, size, msg->result_code, &buffer, &complete);
+	int result_code = msg->result_code;
+	uint8_t* data = as_batch_reserve(shared, size, result_code, &buffer, &complete);
 
 	if (data) {
 		// Overload transaction_ttl to store batch index.
@@ -1054,9 +1625,9 @@ as_batch_add_proxy_result(as_batch_shared* shared, uint32_t index, cf_digest* di
 		trg += sizeof(as_msg_field) + sizeof(cf_digest);
 
 		// Copy others fields and ops.
-		size = ((uint8_t*)cmsg + proxy_size) - msg->data;
-		memcpy(trg, msg->data, size);
+		memcpy(trg, msg->data, ((uint8_t*)cmsg + proxy_size) - msg->data);
 	}
+	as_batch_fan_out(shared, index, data, (uint32_t)size, result_code);
 	as_batch_transaction_end(shared, buffer, complete);
 }
 
@@ -1084,6 +1655,7 @@ as_batch_add_error(as_batch_shared* shared, uint32_t index, int result_code)
 		m->n_ops = 0;
 		as_msg_swap_header(m);
 	}
+	as_batch_fan_out(shared, index, data, sizeof(as_msg), result_code);
 	as_batch_transaction_end(shared, buffer, complete);
 }
 
@@ -1160,7 +1732,7 @@ as_batch_queues_info(cf_dyn_buf* db)
 		as_batch_queue* bq = &batch_queues[i];
 		cf_dyn_buf_append_uint32(db, bq->count);  // Batch count
 		cf_dyn_buf_append_char(db, ':');
-		cf_dyn_buf_append_int(db, cf_queue_sz(bq->response_queue));  // Buffer count
+		cf_dyn_buf_append_int(db, cf_ring_queue_sz(bq->response_queue));  // Buffer count
 	}
 }
 
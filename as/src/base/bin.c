@@ -35,6 +35,7 @@
 #include "vmapx.h"
 
 #include "base/datamodel.h"
+#include "base/dim_slab.h"
 #include "base/index.h"
 #include "base/proto.h"
 #include "storage/storage.h"
@@ -57,7 +58,7 @@ as_bin_get_id(as_namespace *ns, const char *name)
 	return -1;
 }
 
-static bool
+bool
 as_bin_get_id_w_len(as_namespace *ns, byte *name, size_t len, uint32_t *p_id)
 {
 	if (ns->single_bin) {
@@ -218,6 +219,24 @@ as_bin_get_n_bins(as_record *r, as_storage_rd *rd)
 		return safe_n_bins(r);
 	}
 
+	return as_bin_get_n_bins_ssd(rd);
+}
+
+// Versions of as_bin_get_n_bins() and as_storage_rd_load_bins() for callers
+// that already know the namespace's storage shape, e.g. the write_master()
+// variants - these skip the single-bin and data-in-memory checks.
+
+// Multi-bin, data-in-memory.
+uint16_t
+as_bin_get_n_bins_dim(as_record *r)
+{
+	return safe_n_bins(r);
+}
+
+// Multi-bin, data-not-in-memory.
+uint16_t
+as_bin_get_n_bins_ssd(as_storage_rd *rd)
+{
 	if (rd->record_on_device && ! rd->ignore_record_on_device) {
 		if (! rd->have_device_block) {
 			as_storage_record_read(rd);
@@ -229,6 +248,31 @@ as_bin_get_n_bins(as_record *r, as_storage_rd *rd)
 	return (0);
 }
 
+// Data-in-memory.
+void
+as_storage_rd_load_bins_dim(as_storage_rd *rd, bool single_bin)
+{
+	rd->bins = single_bin ? as_index_get_single_bin(rd->r) : safe_bins(rd->r);
+}
+
+// Data-not-in-memory.
+int
+as_storage_rd_load_bins_ssd(as_storage_rd *rd, as_bin *stack_bins)
+{
+	rd->bins = stack_bins;
+	as_bin_set_all_empty(rd);
+
+	if (rd->record_on_device && ! rd->ignore_record_on_device) {
+		int result = as_storage_particle_read_all_ssd(rd);
+
+		if (result < 0) {
+			return result;
+		}
+	}
+
+	return 0;
+}
+
 as_bin *
 as_bin_get_all(as_record *r, as_storage_rd *rd, as_bin *stack_bins)
 {
@@ -246,43 +290,211 @@ as_bin_get_all(as_record *r, as_storage_rd *rd, as_bin *stack_bins)
 	return (stack_bins);
 }
 
+// Data-not-in-memory only - like as_bin_get_all(), but loads only the bins
+// with the given ids, packed at the start of stack_bins.
+as_bin *
+as_bin_get_some(as_record *r, as_storage_rd *rd, as_bin *stack_bins,
+		const uint16_t *ids, uint16_t n_ids)
+{
+	rd->bins = stack_bins;
+	as_bin_set_all_empty(rd);
+
+	if (rd->record_on_device && ! rd->ignore_record_on_device) {
+		as_storage_particle_read_bins_ssd(rd, ids, n_ids);
+	}
+
+	return (stack_bins);
+}
+
 // - Seems like an as_storage_record method, but leaving it here for now.
 // - sets rd->bins!
 int
 as_storage_rd_load_bins(as_storage_rd *rd, as_bin *stack_bins)
 {
 	if (rd->ns->storage_data_in_memory) {
-		rd->bins = rd->ns->single_bin ? as_index_get_single_bin(rd->r) :
-				safe_bins(rd->r);
+		as_storage_rd_load_bins_dim(rd, rd->ns->single_bin);
 		return 0;
 	}
 
-	// Data NOT in-memory.
+	return as_storage_rd_load_bins_ssd(rd, stack_bins);
+}
 
-	rd->bins = stack_bins;
-	as_bin_set_all_empty(rd);
+// utility function to convert a pointer to the bin space to an array of pointers to each (used) bin
 
-	if (rd->record_on_device && ! rd->ignore_record_on_device) {
-		int result = as_storage_particle_read_all_ssd(rd);
+void
+as_bin_get_all_p(as_storage_rd *rd, as_bin **bin_ptrs)
+{
+	for (uint16_t i = 0; i < rd->n_bins; i++) {
+		bin_ptrs[i] = &rd->bins[i];
+	}
+}
 
-		if (result < 0) {
-			return result;
+//------------------------------------------------
+// Optional id index over rd->bins.
+//
+
+#define BIN_INDEX_EMPTY 0xFFFF
+
+static void
+bin_index_insert(as_bin_index *ix, uint16_t id, uint16_t pos)
+{
+	// Ids are assigned densely, so the low bits hash well enough.
+	uint32_t s = id & ix->mask;
+
+	while (ix->slots[s].id != BIN_INDEX_EMPTY) {
+		s = (s + 1) & ix->mask;
+	}
+
+	ix->slots[s].id = id;
+	ix->slots[s].pos = pos;
+}
+
+static void
+bin_index_rebuild(as_storage_rd *rd)
+{
+	as_bin_index *ix = rd->bin_index;
+
+	memset(ix->slots, 0xFF, (ix->mask + 1) * sizeof(as_bin_index_slot));
+
+	uint16_t i;
+
+	for (i = 0; i < rd->n_bins; i++) {
+		as_bin *b = &rd->bins[i];
+
+		if (! as_bin_inuse(b)) {
+			break;
 		}
+
+		bin_index_insert(ix, b->id, i);
 	}
 
-	return 0;
+	ix->bins = rd->bins;
+	ix->n_inuse = i;
+	ix->valid = true;
 }
 
-// utility function to convert a pointer to the bin space to an array of pointers to each (used) bin
+// Returns the index, current, or NULL if there's none.
+static as_bin_index *
+bin_index_get(as_storage_rd *rd)
+{
+	as_bin_index *ix = rd->bin_index;
+
+	if (! ix) {
+		return NULL;
+	}
+
+	if (! ix->valid || ix->bins != rd->bins) {
+		// Bins were re-pointed to a bigger array - keep load factor under half,
+		// or give up on indexing.
+		if ((uint32_t)rd->n_bins * 2 > ix->mask + 1) {
+			as_bin_index_detach(rd);
+			return NULL;
+		}
+
+		bin_index_rebuild(rd);
+	}
+
+	return ix;
+}
+
+// Position of the in-use bin with this id, or -1. If not found, *p_n_inuse (if
+// not NULL) is set to the number of bins in use.
+static int32_t
+bin_find_pos(as_storage_rd *rd, uint32_t id, uint16_t *p_n_inuse)
+{
+	as_bin_index *ix = bin_index_get(rd);
+
+	if (ix) {
+		for (uint32_t s = id & ix->mask; ix->slots[s].id != BIN_INDEX_EMPTY;
+				s = (s + 1) & ix->mask) {
+			if (ix->slots[s].id == id) {
+				return (int32_t)ix->slots[s].pos;
+			}
+		}
+
+		if (p_n_inuse) {
+			*p_n_inuse = ix->n_inuse;
+		}
+
+		return -1;
+	}
+
+	uint16_t i;
+
+	for (i = 0; i < rd->n_bins; i++) {
+		as_bin *b = &rd->bins[i];
+
+		if (! as_bin_inuse(b)) {
+			break;
+		}
+
+		if ((uint32_t)b->id == id) {
+			return (int32_t)i;
+		}
+	}
+
+	if (p_n_inuse) {
+		*p_n_inuse = i;
+	}
+
+	return -1;
+}
 
+// Account for a bin just initialized at the end of the in-use bins.
+static inline void
+bin_index_add(as_storage_rd *rd, as_bin *b)
+{
+	as_bin_index *ix = rd->bin_index;
+
+	if (ix && ix->valid && ix->bins == rd->bins) {
+		bin_index_insert(ix, b->id, (uint16_t)(b - rd->bins));
+		ix->n_inuse++;
+	}
+}
+
+// For records with many bins, index rd->bins by id - lookups and creates then
+// don't scan the bins. Only for scopes in which bins change via functions here
+// and as_bin_set_empty_shift() & co. Pair with as_bin_index_detach().
 void
-as_bin_get_all_p(as_storage_rd *rd, as_bin **bin_ptrs)
+as_bin_index_attach(as_storage_rd *rd)
 {
-	for (uint16_t i = 0; i < rd->n_bins; i++) {
-		bin_ptrs[i] = &rd->bins[i];
+	if (rd->ns->single_bin || rd->bin_index ||
+			as_bin_inuse_count(rd) < AS_BIN_INDEX_MIN_BINS) {
+		return;
+	}
+
+	uint32_t n_slots = 1;
+
+	while (n_slots < 2 * (uint32_t)rd->n_bins) {
+		n_slots <<= 1;
+	}
+
+	as_bin_index *ix = cf_malloc(sizeof(as_bin_index) +
+			n_slots * sizeof(as_bin_index_slot));
+
+	if (! ix) {
+		return; // lookups will scan, as usual
+	}
+
+	ix->mask = n_slots - 1;
+	ix->valid = false;
+
+	rd->bin_index = ix;
+}
+
+void
+as_bin_index_detach(as_storage_rd *rd)
+{
+	if (rd->bin_index) {
+		cf_free(rd->bin_index);
+		rd->bin_index = NULL;
 	}
 }
 
+//------------------------------------------------
+// Bin lookup & create.
+//
+
 // Does not check bin name length.
 as_bin *
 as_bin_create(as_storage_rd *rd, const char *name)
@@ -297,18 +509,16 @@ as_bin_create(as_storage_rd *rd, const char *name)
 		return rd->bins;
 	}
 
-	as_bin *b = NULL;
+	uint16_t i = as_bin_inuse_count(rd);
 
-	for (uint16_t i = 0; i < rd->n_bins; i++) {
-		if (! as_bin_inuse(&rd->bins[i])) {
-			b = &rd->bins[i];
-			break;
-		}
+	if (i >= rd->n_bins) {
+		return NULL;
 	}
 
-	if (b) {
-		as_bin_init(rd->ns, b, name);
-	}
+	as_bin *b = &rd->bins[i];
+
+	as_bin_init(rd->ns, b, name);
+	bin_index_add(rd, b);
 
 	return b;
 }
@@ -331,18 +541,16 @@ as_bin_create_from_buf(as_storage_rd *rd, byte *name, size_t namesz)
 		return NULL;
 	}
 
-	as_bin *b = NULL;
+	uint16_t i = as_bin_inuse_count(rd);
 
-	for (uint16_t i = 0; i < rd->n_bins; i++) {
-		if (! as_bin_inuse(&rd->bins[i])) {
-			b = &rd->bins[i];
-			break;
-		}
+	if (i >= rd->n_bins) {
+		return NULL;
 	}
 
-	if (b) {
-		as_bin_init_w_len(rd->ns, b, name, namesz);
-	}
+	as_bin *b = &rd->bins[i];
+
+	as_bin_init_w_len(rd->ns, b, name, namesz);
+	bin_index_add(rd, b);
 
 	return b;
 }
@@ -350,19 +558,9 @@ as_bin_create_from_buf(as_storage_rd *rd, byte *name, size_t namesz)
 as_bin *
 as_bin_get_by_id(as_storage_rd *rd, uint32_t id)
 {
-	for (uint16_t i = 0; i < rd->n_bins; i++) {
-		as_bin *b = &rd->bins[i];
-
-		if (! as_bin_inuse(b)) {
-			break;
-		}
-
-		if ((uint32_t)b->id == id) {
-			return b;
-		}
-	}
+	int32_t i = bin_find_pos(rd, id, NULL);
 
-	return NULL;
+	return i < 0 ? NULL : &rd->bins[i];
 }
 
 as_bin *
@@ -394,19 +592,7 @@ as_bin_get_from_buf(as_storage_rd *rd, byte *name, size_t namesz)
 		return NULL;
 	}
 
-	for (uint16_t i = 0; i < rd->n_bins; i++) {
-		as_bin *b = &rd->bins[i];
-
-		if (! as_bin_inuse(b)) {
-			break;
-		}
-
-		if ((uint32_t)b->id == id) {
-			return b;
-		}
-	}
-
-	return NULL;
+	return as_bin_get_by_id(rd, id);
 }
 
 // Does not check bin name length.
@@ -427,16 +613,10 @@ as_bin_get_or_create(as_storage_rd *rd, const char *name)
 	as_bin *b;
 
 	if (cf_vmapx_get_index(rd->ns->p_bin_name_vmap, name, &id) == CF_VMAPX_OK) {
-		for (i = 0; i < rd->n_bins; i++) {
-			b = &rd->bins[i];
-
-			if (! as_bin_inuse(b)) {
-				break;
-			}
+		int32_t pos = bin_find_pos(rd, id, &i);
 
-			if ((uint32_t)b->id == id) {
-				return b;
-			}
+		if (pos >= 0) {
+			return &rd->bins[pos];
 		}
 	}
 	else {
@@ -462,6 +642,8 @@ as_bin_get_or_create(as_storage_rd *rd, const char *name)
 		b->id = (uint16_t)id;
 	}
 
+	bin_index_add(rd, b);
+
 	return b;
 }
 
@@ -485,27 +667,23 @@ as_bin_get_or_create_from_buf(as_storage_rd *rd, byte *name, size_t namesz,
 	as_bin *b;
 
 	if (cf_vmapx_get_index_w_len(rd->ns->p_bin_name_vmap, (const char *)name, namesz, &id) == CF_VMAPX_OK) {
-		for (i = 0; i < rd->n_bins; i++) {
-			b = &rd->bins[i];
-
-			if (! as_bin_inuse(b)) {
-				break;
-			}
+		int32_t pos = bin_find_pos(rd, id, &i);
 
-			if ((uint32_t)b->id == id) {
-				if (as_bin_is_hidden(b)) {
-					cf_warning(AS_BIN, "cannot manipulate hidden bin directly");
-					*p_result = AS_PROTO_RESULT_FAIL_INCOMPATIBLE_TYPE;
-					return NULL;
-				}
+		if (pos >= 0) {
+			b = &rd->bins[pos];
 
-				if (create_only) {
-					*p_result = AS_PROTO_RESULT_FAIL_BIN_EXISTS;
-					return NULL;
-				}
+			if (as_bin_is_hidden(b)) {
+				cf_warning(AS_BIN, "cannot manipulate hidden bin directly");
+				*p_result = AS_PROTO_RESULT_FAIL_INCOMPATIBLE_TYPE;
+				return NULL;
+			}
 
-				return b;
+			if (create_only) {
+				*p_result = AS_PROTO_RESULT_FAIL_BIN_EXISTS;
+				return NULL;
 			}
+
+			return b;
 		}
 	}
 	else {
@@ -542,6 +720,8 @@ as_bin_get_or_create_from_buf(as_storage_rd *rd, byte *name, size_t namesz,
 		b->id = (uint16_t)id;
 	}
 
+	bin_index_add(rd, b);
+
 	return b;
 }
 
@@ -558,19 +738,7 @@ as_bin_get_index(as_storage_rd *rd, const char *name)
 		return -1;
 	}
 
-	for (uint16_t i = 0; i < rd->n_bins; i++) {
-		as_bin *b = &rd->bins[i];
-
-		if (! as_bin_inuse(b)) {
-			break;
-		}
-
-		if ((uint32_t)b->id == id) {
-			return (int32_t)i;
-		}
-	}
-
-	return -1;
+	return bin_find_pos(rd, id, NULL);
 }
 
 int32_t
@@ -586,19 +754,7 @@ as_bin_get_index_from_buf(as_storage_rd *rd, byte *name, size_t namesz)
 		return -1;
 	}
 
-	for (uint16_t i = 0; i < rd->n_bins; i++) {
-		as_bin *b = &rd->bins[i];
-
-		if (! as_bin_inuse(b)) {
-			break;
-		}
-
-		if ((uint32_t)b->id == id) {
-			return (int32_t)i;
-		}
-	}
-
-	return -1;
+	return bin_find_pos(rd, id, NULL);
 }
 
 void
@@ -606,8 +762,8 @@ as_bin_allocate_bin_space(as_record *r, as_storage_rd *rd, int32_t delta) {
 	if (rd->n_bins == 0) {
 		rd->n_bins = (uint16_t)delta;
 
-		as_bin_space* bin_space = (as_bin_space*)
-				cf_malloc(sizeof(as_bin_space) + (rd->n_bins * sizeof(as_bin)));
+		as_bin_space* bin_space =
+				as_dim_slab_alloc_bin_space(rd->ns, rd->n_bins);
 
 		rd->bins = bin_space->bins;
 		as_bin_set_all_empty(rd);
@@ -627,8 +783,8 @@ as_bin_allocate_bin_space(as_record *r, as_storage_rd *rd, int32_t delta) {
 		rd->n_bins = new_n_bins;
 
 		if (new_n_bins != 0) {
-			as_bin_space* bin_space = (as_bin_space*)
-					cf_realloc((void*)as_index_get_bin_space(r), sizeof(as_bin_space) + (rd->n_bins * sizeof(as_bin)));
+			as_bin_space* bin_space = as_dim_slab_resize_bin_space(rd->ns,
+					as_index_get_bin_space(r), old_n_bins, rd->n_bins);
 
 			rd->bins = bin_space->bins;
 
@@ -640,7 +796,8 @@ as_bin_allocate_bin_space(as_record *r, as_storage_rd *rd, int32_t delta) {
 			as_index_set_bin_space(r, bin_space);
 		}
 		else {
-			cf_free((void*)as_index_get_bin_space(r));
+			as_dim_slab_free_bin_space(rd->ns, as_index_get_bin_space(r),
+					old_n_bins);
 			as_index_set_bin_space(r, NULL);
 			rd->bins = NULL;
 		}
@@ -682,6 +839,13 @@ as_bin_inuse_count(as_storage_rd *rd)
 	if (!rd) {
 		return 0;
 	}
+
+	as_bin_index *ix = bin_index_get(rd);
+
+	if (ix) {
+		return ix->n_inuse;
+	}
+
 	for (i = 0; i < rd->n_bins; i++) {
 		if (! as_bin_inuse(&rd->bins[i])) {
 			break;
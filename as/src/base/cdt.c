@@ -50,6 +50,11 @@ const cdt_op_table_entry cdt_op_table[] = {
 	//============================================
 	// LIST
 
+	//--------------------------------------------
+	// Create and flags
+
+	CDT_OP_ENTRY(AS_CDT_OP_LIST_SET_TYPE,		CDT_RW_TYPE_MODIFY, 0, AS_CDT_PARAM_FLAGS),
+
 	//--------------------------------------------
 	// Modify OPs
 
@@ -70,6 +75,10 @@ const cdt_op_table_entry cdt_op_table[] = {
 	CDT_OP_ENTRY(AS_CDT_OP_LIST_TRIM,			CDT_RW_TYPE_MODIFY, 0, AS_CDT_PARAM_INDEX, AS_CDT_PARAM_COUNT),
 	CDT_OP_ENTRY(AS_CDT_OP_LIST_CLEAR,			CDT_RW_TYPE_MODIFY, 0),
 
+	// Remove from list by value
+	CDT_OP_ENTRY(AS_CDT_OP_LIST_REMOVE_ALL_BY_VALUE,		CDT_RW_TYPE_MODIFY, 0, AS_CDT_PARAM_PAYLOAD),
+	CDT_OP_ENTRY(AS_CDT_OP_LIST_REMOVE_BY_VALUE_INTERVAL,	CDT_RW_TYPE_MODIFY, 1, AS_CDT_PARAM_PAYLOAD, AS_CDT_PARAM_PAYLOAD),
+
 	//--------------------------------------------
 	// Read OPs
 
@@ -78,6 +87,10 @@ const cdt_op_table_entry cdt_op_table[] = {
 	CDT_OP_ENTRY(AS_CDT_OP_LIST_GET,			CDT_RW_TYPE_READ, 0, AS_CDT_PARAM_INDEX),
 	CDT_OP_ENTRY(AS_CDT_OP_LIST_GET_RANGE,		CDT_RW_TYPE_READ, 1, AS_CDT_PARAM_INDEX, AS_CDT_PARAM_COUNT),
 
+	// Read from list by value
+	CDT_OP_ENTRY(AS_CDT_OP_LIST_GET_ALL_BY_VALUE,			CDT_RW_TYPE_READ, 0, AS_CDT_PARAM_PAYLOAD),
+	CDT_OP_ENTRY(AS_CDT_OP_LIST_GET_BY_VALUE_INTERVAL,		CDT_RW_TYPE_READ, 1, AS_CDT_PARAM_PAYLOAD, AS_CDT_PARAM_PAYLOAD),
+
 	//============================================
 	// MAP
 
@@ -262,6 +275,149 @@ cdt_payload_get_int64(const cdt_payload *payload)
 }
 
 
+//==========================================================
+// msgpack scanning functions.
+//
+
+// Skip n consecutive elements in one flat pass - containers just add their
+// elements to the number still to skip, so there's no recursion, and strings,
+// blobs and exts are stepped over by their header length. Sizes are checked
+// against the buffer only where a length is read, and once at the end.
+// Return -1 on failure, otherwise number of bytes skipped.
+int64_t
+cdt_unpack_size_n(as_unpacker *pk, uint32_t n)
+{
+	const uint8_t *buf = pk->buffer;
+	uint64_t length = (uint64_t)pk->length;
+	uint64_t offset = (uint64_t)pk->offset;
+	uint64_t start = offset;
+	uint64_t pending = n;
+
+	while (pending != 0) {
+		if (offset >= length) {
+			return -1;
+		}
+
+		uint8_t b = buf[offset++];
+
+		pending--;
+
+		// Positive and negative fixint.
+		if (b < 0x80 || b >= 0xE0) {
+			continue;
+		}
+
+		// Fixmap.
+		if (b < 0x90) {
+			pending += 2 * (uint64_t)(b & 0x0F);
+			continue;
+		}
+
+		// Fixarray.
+		if (b < 0xA0) {
+			pending += b & 0x0F;
+			continue;
+		}
+
+		// Fixstr.
+		if (b < 0xC0) {
+			offset += b & 0x1F;
+			continue;
+		}
+
+		uint32_t len_sz;
+		uint32_t extra = 0;
+
+		switch (b) {
+		case 0xC0: // nil
+		case 0xC2: // false
+		case 0xC3: // true
+			continue;
+		case 0xCC: case 0xD0:
+			offset += 1;
+			continue;
+		case 0xCD: case 0xD1:
+			offset += 2;
+			continue;
+		case 0xCA: case 0xCE: case 0xD2:
+			offset += 4;
+			continue;
+		case 0xCB: case 0xCF: case 0xD3:
+			offset += 8;
+			continue;
+		case 0xD4: case 0xD5: case 0xD6: case 0xD7: case 0xD8:
+			// Fixext - type byte and 1, 2, 4, 8 or 16 bytes.
+			offset += 1 + (1 << (b - 0xD4));
+			continue;
+		case 0xC4: case 0xD9: // bin8, str8
+			len_sz = 1;
+			break;
+		case 0xC5: case 0xDA: // bin16, str16
+			len_sz = 2;
+			break;
+		case 0xC6: case 0xDB: // bin32, str32
+			len_sz = 4;
+			break;
+		case 0xC7: // ext8
+			len_sz = 1;
+			extra = 1;
+			break;
+		case 0xC8: // ext16
+			len_sz = 2;
+			extra = 1;
+			break;
+		case 0xC9: // ext32
+			len_sz = 4;
+			extra = 1;
+			break;
+		case 0xDC: case 0xDE: // array16, map16
+			len_sz = 2;
+			break;
+		case 0xDD: case 0xDF: // array32, map32
+			len_sz = 4;
+			break;
+		default: // 0xC1 is never used
+			return -1;
+		}
+
+		if (offset + len_sz > length) {
+			return -1;
+		}
+
+		const uint8_t *p = buf + offset;
+		uint64_t len;
+
+		if (len_sz == 1) {
+			len = p[0];
+		}
+		else if (len_sz == 2) {
+			len = ((uint64_t)p[0] << 8) | p[1];
+		}
+		else {
+			len = ((uint64_t)p[0] << 24) | ((uint64_t)p[1] << 16) |
+					((uint64_t)p[2] << 8) | p[3];
+		}
+
+		offset += len_sz;
+
+		if (b >= 0xDC) {
+			pending += b >= 0xDE ? 2 * len : len;
+		}
+		else {
+			offset += extra + len;
+		}
+	}
+
+	if (offset > length) {
+		return -1;
+	}
+
+	pk->offset = (int)offset;
+
+	return (int64_t)(offset - start);
+}
+
+
 //==========================================================
 // cdt_container_builder functions.
 //
@@ -383,7 +539,7 @@ cdt_process_state_get_params(cdt_process_state *state, size_t n, ...)
 
 			arg->ptr = state->pk.buffer + state->pk.offset;
 
-			int size = as_unpack_size(&state->pk);
+			int size = cdt_unpack_size(&state->pk);
 
 			if (size < 0) {
 				va_end(vl);
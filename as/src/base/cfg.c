@@ -27,12 +27,14 @@
 #include <limits.h>
 #include <pthread.h>
 #include <pwd.h>
+#include <sched.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/resource.h>
+#include <unistd.h>
 
 #include "xdr_config.h"
 
@@ -42,9 +44,11 @@
 #include "citrusleaf/cf_clock.h"
 #include "citrusleaf/cf_shash.h"
 
+#include "alloc_prof.h"
 #include "cf_str.h"
 #include "dynbuf.h"
 #include "fault.h"
+#include "hdr_hist.h"
 #include "hist.h"
 #include "hist_track.h"
 #include "msg.h"
@@ -54,6 +58,7 @@
 
 #include "base/cluster_config.h"
 #include "base/datamodel.h"
+#include "base/index.h"
 #include "base/ldt.h"
 #include "base/proto.h"
 #include "base/secondary_index.h"
@@ -63,6 +68,7 @@
 #include "base/thr_sindex.h"
 #include "base/thr_tsvc.h"
 #include "base/transaction_policy.h"
+#include "fabric/fabric.h"
 #include "fabric/migrate.h"
 
 
@@ -73,6 +79,9 @@
 const char IPV4_ANY_ADDR[] = "0.0.0.0";
 const char IPV4_LOCALHOST_ADDR[] = "127.0.0.1";
 
+#define RECORD_LOCKS_MIN		(16 * 1024)
+#define RECORD_LOCKS_PER_CPU	1024
+
 
 //==========================================================
 // Globals.
@@ -92,7 +101,6 @@ void cfg_add_storage_file(as_namespace* ns, char* file_name);
 void cfg_add_storage_device(as_namespace* ns, char* device_name, char* shadow_name);
 void cfg_init_si_var(as_namespace* ns);
 uint32_t cfg_obj_size_hist_max(uint32_t hist_max);
-void create_and_check_hist_track(cf_hist_track** h, const char* name, histogram_scale scale);
 void create_and_check_hist(histogram** h, const char* name, histogram_scale scale);
 void cfg_create_all_histograms();
 int cfg_reset_self_node(as_config* config_p);
@@ -117,7 +125,11 @@ cfg_set_defaults()
 	c->n_transaction_queues = 4; // calculated when use_queue_per_device is set, see thr_tsvc_queue_init()
 	c->n_transaction_threads_per_queue = 4;
 	c->n_proto_fd_max = 15000;
+	c->admission_device_latency_ms = 20;
+	c->admission_queue_wait_ms = 10;
+	c->alloc_prof_interval = CF_ALLOC_PROF_DEFAULT_INTERVAL;
 	c->allow_inline_transactions = true; // allow data-in-memory namespaces to process transactions in service threads
+	c->n_balance_threads = 1;
 	c->n_batch_threads = 4;
 	c->batch_max_buffers_per_queue = 255; // maximum number of buffers allowed in a single queue
 	c->batch_max_requests = 5000; // maximum requests/digests in a single batch
@@ -128,18 +140,24 @@ cfg_set_defaults()
 	c->n_fabric_workers = 16;
 	c->hist_track_back = 300;
 	c->hist_track_slice = 10;
+	c->hist_track_precision = 7;
 	c->n_info_threads = 16;
+	c->n_info_heavy_threads = 2;
+	c->info_cache_ttl = 1000;
 	c->ldt_benchmarks = false;
 	c->migrate_max_num_incoming = AS_MIGRATE_DEFAULT_MAX_NUM_INCOMING; // for receiver-side migration flow-control
 	c->migrate_rx_lifetime_ms = AS_MIGRATE_DEFAULT_RX_LIFETIME_MS; // for debouncing re-transmitted migrate start messages
+	c->migrate_split_threads = 1;
 	c->n_migrate_threads = 1;
 	c->nsup_delete_sleep = 100; // 100 microseconds means a delete rate of 10k TPS
 	c->nsup_period = 120; // run nsup once every 2 minutes
 	c->nsup_startup_evict = true;
+	c->n_nsup_threads = 1;
 	c->paxos_max_cluster_size = AS_CLUSTER_DEFAULT_SZ; // default the maximum cluster size to a "reasonable" value
 	c->paxos_protocol = AS_PAXOS_PROTOCOL_V3; // default to 3.0 "sindex" paxos protocol version
 	c->paxos_recovery_policy = AS_PAXOS_RECOVERY_POLICY_AUTO_RESET_MASTER; // default to auto reset master
 	c->paxos_retransmit_period = 5; // run paxos retransmit once every 5 seconds
+	c->proto_compression_threshold = 1024;
 	c->proto_fd_idle_ms = 60000; // 1 minute reaping of proto file descriptors
 	c->proto_slow_netio_sleep_ms = 1; // 1 ms sleep between retry for slow queries
 	c->run_as_daemon = true; // set false only to run in debugger & see console output
@@ -155,9 +173,11 @@ cfg_set_defaults()
 	as_sindex_gconfig_default(c);
 	as_query_gconfig_default(c);
 	c->work_directory = "/opt/aerospike";
+	c->xdr_dlog_overwrite = true; // as the XDR module - a full log drops the oldest
 	c->fabric_dump_msgs = false;
 	c->max_msgs_per_type = -1; // by default, the maximum number of "msg" objects per type is unlimited
 	c->memory_accounting = false;
+	c->non_master_gc_rps = 5000;
 	c->asmalloc_enabled = true;
 
 	// Network service defaults.
@@ -183,6 +203,9 @@ cfg_set_defaults()
 	c->fabric_keepalive_time = 1; // seconds
 	c->fabric_keepalive_intvl = 1; // seconds
 	c->fabric_keepalive_probes = 10; // tries
+	c->fabric_channel_fds[AS_FABRIC_CHANNEL_CTRL] = 2;
+	c->fabric_channel_fds[AS_FABRIC_CHANNEL_RW] = FABRIC_MAX_FDS - 1;
+	c->fabric_channel_fds[AS_FABRIC_CHANNEL_BULK] = 4;
 
 	// XDR defaults.
 	for (int i = 0; i < g_config.paxos_max_cluster_size; i++) {
@@ -204,6 +227,7 @@ cfg_set_defaults()
 	c->mod_lua.cache_enabled    = true;
 	strcpy(c->mod_lua.system_path, "/opt/aerospike/sys/udf/lua");
 	strcpy(c->mod_lua.user_path, "/opt/aerospike/usr/udf/lua");
+	c->udf_result_cache_size = 4096;
 
 	// Cluster Topology: With the new Rack Aware feature, we allow the customers
 	// to define their nodes and groups with THEIR names, and thus overrule the
@@ -257,40 +281,73 @@ typedef enum {
 	CASE_SERVICE_CLIENT_FD_MAX, // renamed
 	CASE_SERVICE_PROTO_FD_MAX,
 	// Normally hidden:
+	CASE_SERVICE_ADMISSION_CONTROL,
+	CASE_SERVICE_ADMISSION_DEVICE_LATENCY_MS,
+	CASE_SERVICE_ADMISSION_QUEUE_WAIT_MS,
+	CASE_SERVICE_ALLOC_PROF_INTERVAL,
 	CASE_SERVICE_ALLOW_INLINE_TRANSACTIONS,
+	CASE_SERVICE_BACKGROUND_MAX_RECORDS_PER_SEC,
+	CASE_SERVICE_BACKGROUND_UDF_INLINE,
+	CASE_SERVICE_BALANCE_THREADS,
 	CASE_SERVICE_BATCH_THREADS,
 	CASE_SERVICE_BATCH_MAX_BUFFERS_PER_QUEUE,
 	CASE_SERVICE_BATCH_MAX_REQUESTS,
 	CASE_SERVICE_BATCH_MAX_UNUSED_BUFFERS,
 	CASE_SERVICE_BATCH_PRIORITY,
 	CASE_SERVICE_BATCH_INDEX_THREADS,
+	CASE_SERVICE_BATCH_THREAD_CPUS,
+	CASE_SERVICE_BATCH_THREAD_SCHED,
 	CASE_SERVICE_CLOCK_SKEW_MAX_MS,
 	CASE_SERVICE_CLUSTER_ID,
+	CASE_SERVICE_DEFRAG_THREAD_CPUS,
+	CASE_SERVICE_DEFRAG_THREAD_SCHED,
 	CASE_SERVICE_ENABLE_BENCHMARKS_SVC,
 	CASE_SERVICE_ENABLE_HIST_INFO,
+	CASE_SERVICE_FABRIC_THREAD_CPUS,
+	CASE_SERVICE_FABRIC_THREAD_SCHED,
 	CASE_SERVICE_FABRIC_WORKERS,
 	CASE_SERVICE_GENERATION_DISABLE,
 	CASE_SERVICE_HIST_TRACK_BACK,
+	CASE_SERVICE_HIST_TRACK_PRECISION,
 	CASE_SERVICE_HIST_TRACK_SLICE,
 	CASE_SERVICE_HIST_TRACK_THRESHOLDS,
+	CASE_SERVICE_SLOW_TXN_LOG_RATE,
+	CASE_SERVICE_SLOW_TXN_THRESHOLD,
+	CASE_SERVICE_HOT_KEY_SAMPLE_RATE,
 	CASE_SERVICE_INFO_THREADS,
+	CASE_SERVICE_INFO_HEAVY_THREADS,
+	CASE_SERVICE_INFO_CACHE_TTL,
+	CASE_SERVICE_INFO_TIMEOUT,
 	CASE_SERVICE_LDT_BENCHMARKS,
+	CASE_SERVICE_LOG_ASYNC,
 	CASE_SERVICE_LOG_LOCAL_TIME,
+	CASE_SERVICE_MIGRATE_MAX_BYTES_PER_SEC,
 	CASE_SERVICE_MIGRATE_MAX_NUM_INCOMING,
 	CASE_SERVICE_MIGRATE_RX_LIFETIME_MS,
+	CASE_SERVICE_MIGRATE_RX_MEMORY_BUDGET,
+	CASE_SERVICE_MIGRATE_SPLIT_THREADS,
 	CASE_SERVICE_MIGRATE_THREADS,
 	CASE_SERVICE_NSUP_DELETE_SLEEP,
 	CASE_SERVICE_NSUP_PERIOD,
 	CASE_SERVICE_NSUP_STARTUP_EVICT,
+	CASE_SERVICE_NSUP_THREAD_CPUS,
+	CASE_SERVICE_NSUP_THREAD_SCHED,
+	CASE_SERVICE_NSUP_THREADS,
+	CASE_SERVICE_PAXOS_COMPACT_SYNC,
 	CASE_SERVICE_PAXOS_MAX_CLUSTER_SIZE,
 	CASE_SERVICE_PAXOS_PROTOCOL,
 	CASE_SERVICE_PAXOS_RECOVERY_POLICY,
 	CASE_SERVICE_PAXOS_RETRANSMIT_PERIOD,
+	CASE_SERVICE_PROTO_COMPRESSION_THRESHOLD,
 	CASE_SERVICE_PROTO_FD_IDLE_MS,
+	CASE_SERVICE_PROTO_READ_BUFFER_SIZE,
+	CASE_SERVICE_PROXY_BATCH_US,
+	CASE_SERVICE_QUERY_AGGR_BATCH_SIZE,
 	CASE_SERVICE_QUERY_BATCH_SIZE,
 	CASE_SERVICE_QUERY_BUFPOOL_SIZE,
 	CASE_SERVICE_QUERY_IN_TRANSACTION_THREAD,
 	CASE_SERVICE_QUERY_LONG_Q_MAX_SIZE,
+	CASE_SERVICE_QUERY_MAX_RECORDS_PER_SEC,
 	CASE_SERVICE_QUERY_PRE_RESERVE_PARTITIONS,
 	CASE_SERVICE_QUERY_PRIORITY,
 	CASE_SERVICE_QUERY_PRIORITY_SLEEP_US,
@@ -298,32 +355,55 @@ typedef enum {
 	CASE_SERVICE_QUERY_REQ_IN_QUERY_THREAD,
 	CASE_SERVICE_QUERY_REQ_MAX_INFLIGHT,
 	CASE_SERVICE_QUERY_SHORT_Q_MAX_SIZE,
+	CASE_SERVICE_QUERY_THREAD_CPUS,
+	CASE_SERVICE_QUERY_THREAD_SCHED,
 	CASE_SERVICE_QUERY_THREADS,
 	CASE_SERVICE_QUERY_THRESHOLD,
 	CASE_SERVICE_QUERY_UNTRACKED_TIME_MS,
 	CASE_SERVICE_QUERY_WORKER_THREADS,
+	CASE_SERVICE_RACK_ID,
+	CASE_SERVICE_RECORD_LOCKS,
+	CASE_SERVICE_RECORD_LOCKS_ADAPTIVE,
+	CASE_SERVICE_REPLICA_WRITE_BATCH_US,
 	CASE_SERVICE_RESPOND_CLIENT_ON_MASTER_COMPLETION,
 	CASE_SERVICE_RUN_AS_DAEMON,
+	CASE_SERVICE_RUN_TO_COMPLETION,
 	CASE_SERVICE_SCAN_MAX_ACTIVE,
 	CASE_SERVICE_SCAN_MAX_DONE,
+	CASE_SERVICE_SCAN_MAX_RECORDS_PER_SEC,
+	CASE_SERVICE_SCAN_MAX_RECORDS_PER_SEC_PER_JOB,
+	CASE_SERVICE_SCAN_MAX_THREADS_PER_JOB,
 	CASE_SERVICE_SCAN_MAX_UDF_TRANSACTIONS,
+	CASE_SERVICE_SCAN_THREAD_CPUS,
+	CASE_SERVICE_SCAN_THREAD_SCHED,
 	CASE_SERVICE_SCAN_THREADS,
+	CASE_SERVICE_SERVICE_LISTENER_PER_THREAD,
+	CASE_SERVICE_SERVICE_THREAD_CPUS,
+	CASE_SERVICE_SERVICE_THREAD_SCHED,
 	CASE_SERVICE_SINDEX_BUILDER_THREADS,
 	CASE_SERVICE_SINDEX_DATA_MAX_MEMORY,
+	CASE_SERVICE_STORAGE_TRACE_DIRECTORY,
 	CASE_SERVICE_TICKER_INTERVAL,
 	CASE_SERVICE_TRANSACTION_MAX_MS,
 	CASE_SERVICE_TRANSACTION_PENDING_LIMIT,
 	CASE_SERVICE_TRANSACTION_REPEATABLE_READ,
 	CASE_SERVICE_TRANSACTION_RETRY_MS,
+	CASE_SERVICE_TRANSACTION_THREAD_CPUS,
+	CASE_SERVICE_TRANSACTION_THREAD_SCHED,
+	CASE_SERVICE_TRANSACTION_THREADS_ADAPTIVE,
+	CASE_SERVICE_UDF_RUNTIME_MAX_MEMORY,
 	CASE_SERVICE_USE_QUEUE_PER_DEVICE,
 	CASE_SERVICE_WORK_DIRECTORY,
 	CASE_SERVICE_WRITE_DUPLICATE_RESOLUTION_DISABLE,
+	CASE_SERVICE_WRITE_THREAD_CPUS,
+	CASE_SERVICE_WRITE_THREAD_SCHED,
 	// For special debugging or bug-related repair:
 	CASE_SERVICE_ASMALLOC_ENABLED,
 	CASE_SERVICE_FABRIC_DUMP_MSGS,
 	CASE_SERVICE_MAX_MSGS_PER_TYPE,
 	CASE_SERVICE_MEMORY_ACCOUNTING,
 	CASE_SERVICE_PROLE_EXTRA_TTL,
+	CASE_SERVICE_NON_MASTER_GC_RPS,
 	// Deprecated:
 	CASE_SERVICE_AUTO_DUN,
 	CASE_SERVICE_AUTO_UNDUN,
@@ -353,7 +433,6 @@ typedef enum {
 	CASE_SERVICE_NSUP_QUEUE_ESCAPE,
 	CASE_SERVICE_NSUP_REDUCE_PRIORITY,
 	CASE_SERVICE_NSUP_REDUCE_SLEEP,
-	CASE_SERVICE_NSUP_THREADS,
 	CASE_SERVICE_REPLICATION_FIRE_AND_FORGET,
 	CASE_SERVICE_SCAN_MEMORY,
 	CASE_SERVICE_SCAN_PRIORITY,
@@ -363,7 +442,6 @@ typedef enum {
 	CASE_SERVICE_TRANSACTION_DUPLICATE_THREADS,
 	CASE_SERVICE_TRIAL_ACCOUNT_KEY,
 	CASE_SERVICE_UDF_RUNTIME_MAX_GMEMORY,
-	CASE_SERVICE_UDF_RUNTIME_MAX_MEMORY,
 
 	// Service paxos protocol options (value tokens):
 	CASE_SERVICE_PAXOS_PROTOCOL_V1,
@@ -422,6 +500,7 @@ typedef enum {
 	CASE_NETWORK_HEARTBEAT_INTERVAL,
 	CASE_NETWORK_HEARTBEAT_TIMEOUT,
 	// Normally hidden:
+	CASE_NETWORK_HEARTBEAT_COMPACT_PAYLOADS,
 	CASE_NETWORK_HEARTBEAT_FABRIC_GRACE_FACTOR,
 	CASE_NETWORK_HEARTBEAT_INTERFACE_ADDRESS,
 	CASE_NETWORK_HEARTBEAT_MCAST_TTL,
@@ -449,11 +528,21 @@ typedef enum {
 	CASE_NETWORK_FABRIC_KEEPALIVE_INTVL,
 	CASE_NETWORK_FABRIC_KEEPALIVE_PROBES,
 	CASE_NETWORK_FABRIC_LATENCY_MAX_MS,
+	CASE_NETWORK_FABRIC_CHANNEL_BULK_FDS,
+	CASE_NETWORK_FABRIC_CHANNEL_BULK_SEND_BUF,
+	CASE_NETWORK_FABRIC_CHANNEL_BULK_WORKERS,
+	CASE_NETWORK_FABRIC_CHANNEL_CTRL_FDS,
+	CASE_NETWORK_FABRIC_CHANNEL_CTRL_SEND_BUF,
+	CASE_NETWORK_FABRIC_CHANNEL_CTRL_WORKERS,
+	CASE_NETWORK_FABRIC_CHANNEL_RW_FDS,
+	CASE_NETWORK_FABRIC_CHANNEL_RW_SEND_BUF,
+	CASE_NETWORK_FABRIC_CHANNEL_RW_WORKERS,
 
 	// Network info options:
 	// Normally visible, in canonical configuration file order:
 	CASE_NETWORK_INFO_ADDRESS,
 	CASE_NETWORK_INFO_PORT,
+	CASE_NETWORK_INFO_METRICS_PORT,
 	// Deprecated:
 	CASE_NETWORK_INFO_ENABLE_FASTPATH,
 
@@ -472,6 +561,9 @@ typedef enum {
 	CASE_NAMESPACE_ALLOW_NONXDR_WRITES,
 	CASE_NAMESPACE_ALLOW_XDR_WRITES,
 	// Normally hidden:
+	CASE_NAMESPACE_ASYNC_REPLICATION,
+	CASE_NAMESPACE_ASYNC_REPLICATION_MAX_LAG,
+	CASE_NAMESPACE_BIN_SPACE_SLABS,
 	CASE_NAMESPACE_COLD_START_EVICT_TTL,
 	CASE_NAMESPACE_CONFLICT_RESOLUTION_POLICY,
 	CASE_NAMESPACE_DATA_IN_INDEX,
@@ -483,17 +575,35 @@ typedef enum {
 	CASE_NAMESPACE_ENABLE_BENCHMARKS_UDF_SUB,
 	CASE_NAMESPACE_ENABLE_BENCHMARKS_WRITE,
 	CASE_NAMESPACE_ENABLE_HIST_PROXY,
+	CASE_NAMESPACE_ENABLE_HIST_STAGES,
+	CASE_NAMESPACE_EVICT_CONTINUOUS,
 	CASE_NAMESPACE_EVICT_HIST_BUCKETS,
 	CASE_NAMESPACE_EVICT_TENTHS_PCT,
+	CASE_NAMESPACE_EXPIRATION_INDEX,
 	CASE_NAMESPACE_HIGH_WATER_DISK_PCT,
 	CASE_NAMESPACE_HIGH_WATER_MEMORY_PCT,
+	CASE_NAMESPACE_INCREMENTAL_HISTOGRAMS,
+	CASE_NAMESPACE_INDEX_FLASH_PATH,
+	CASE_NAMESPACE_INDEX_NUMA_POLICY,
+	CASE_NAMESPACE_INDEX_PAGE_SIZE,
 	CASE_NAMESPACE_LDT_ENABLED,
 	CASE_NAMESPACE_LDT_GC_RATE,
 	CASE_NAMESPACE_LDT_PAGE_SIZE,
 	CASE_NAMESPACE_MAX_TTL,
+	CASE_NAMESPACE_MEMORY_SNAPSHOT_DIR,
+	CASE_NAMESPACE_MEMORY_SNAPSHOT_MAX_WRITE_RATE,
+	CASE_NAMESPACE_MEMORY_SNAPSHOT_PERIOD,
+	CASE_NAMESPACE_MEMORY_SNAPSHOT_THREADS,
+	CASE_NAMESPACE_MIGRATE_CHANGELOG_ENTRIES,
+	CASE_NAMESPACE_MIGRATE_CHANGELOG_MAX_AGE,
+	CASE_NAMESPACE_MIGRATE_COMPRESSION,
+	CASE_NAMESPACE_MIGRATE_DELTA,
 	CASE_NAMESPACE_MIGRATE_ORDER,
 	CASE_NAMESPACE_MIGRATE_SLEEP,
+	CASE_NAMESPACE_NSUP_PERIOD,
 	CASE_NAMESPACE_OBJ_SIZE_HIST_MAX,
+	CASE_NAMESPACE_PARTITION_TREE_SPRIGS,
+	CASE_NAMESPACE_READ_COALESCING,
 	CASE_NAMESPACE_READ_CONSISTENCY_LEVEL_OVERRIDE,
 	CASE_NAMESPACE_SET_BEGIN,
 	CASE_NAMESPACE_SI_BEGIN,
@@ -501,6 +611,7 @@ typedef enum {
 	CASE_NAMESPACE_GEO2DSPHERE_WITHIN_BEGIN,
 	CASE_NAMESPACE_SINGLE_BIN,
 	CASE_NAMESPACE_STOP_WRITES_PCT,
+	CASE_NAMESPACE_TRANSACTION_QUEUES,
 	CASE_NAMESPACE_WRITE_COMMIT_LEVEL_OVERRIDE,
 	// Deprecated:
 	CASE_NAMESPACE_ALLOW_VERSIONS,
@@ -513,6 +624,10 @@ typedef enum {
 	CASE_NAMESPACE_CONFLICT_RESOLUTION_GENERATION,
 	CASE_NAMESPACE_CONFLICT_RESOLUTION_LAST_UPDATE_TIME,
 
+	// Namespace index NUMA policy options:
+	CASE_NAMESPACE_INDEX_NUMA_POLICY_INTERLEAVE,
+	CASE_NAMESPACE_INDEX_NUMA_POLICY_NONE,
+
 	// Namespace read consistency level options:
 	CASE_NAMESPACE_READ_CONSISTENCY_ALL,
 	CASE_NAMESPACE_READ_CONSISTENCY_OFF,
@@ -529,6 +644,12 @@ typedef enum {
 	CASE_NAMESPACE_STORAGE_DEVICE,
 	CASE_NAMESPACE_STORAGE_KV,
 
+	// Namespace storage-engine device compression options (value tokens):
+	CASE_NAMESPACE_STORAGE_COMPRESSION_NONE,
+	CASE_NAMESPACE_STORAGE_COMPRESSION_ZLIB,
+	CASE_NAMESPACE_STORAGE_COMPRESSION_LZ4,
+	CASE_NAMESPACE_STORAGE_COMPRESSION_ZSTD,
+
 	// Namespace storage-engine device options:
 	// Normally visible, in canonical configuration file order:
 	CASE_NAMESPACE_STORAGE_DEVICE_DEVICE,
@@ -540,18 +661,35 @@ typedef enum {
 	CASE_NAMESPACE_STORAGE_DEVICE_DATA_IN_MEMORY,
 	// Normally hidden:
 	CASE_NAMESPACE_STORAGE_DEVICE_COLD_START_EMPTY,
+	CASE_NAMESPACE_STORAGE_DEVICE_COLD_START_THREADS,
+	CASE_NAMESPACE_STORAGE_DEVICE_DEFRAG_LIVE_MAP,
 	CASE_NAMESPACE_STORAGE_DEVICE_DEFRAG_LWM_PCT,
 	CASE_NAMESPACE_STORAGE_DEVICE_DEFRAG_QUEUE_MIN,
 	CASE_NAMESPACE_STORAGE_DEVICE_DEFRAG_SLEEP,
+	CASE_NAMESPACE_STORAGE_DEVICE_DEFRAG_ADAPTIVE,
 	CASE_NAMESPACE_STORAGE_DEVICE_DEFRAG_STARTUP_MINIMUM,
 	CASE_NAMESPACE_STORAGE_DEVICE_DISABLE_ODIRECT,
 	CASE_NAMESPACE_STORAGE_DEVICE_ENABLE_OSYNC,
+	CASE_NAMESPACE_STORAGE_DEVICE_FAST_RESTART,
 	CASE_NAMESPACE_STORAGE_DEVICE_FLUSH_MAX_MS,
 	CASE_NAMESPACE_STORAGE_DEVICE_FSYNC_MAX_SEC,
+	CASE_NAMESPACE_STORAGE_DEVICE_LDT_SUBREC_CACHE_SIZE,
+	CASE_NAMESPACE_STORAGE_DEVICE_MAX_FLUSH_SIZE,
 	CASE_NAMESPACE_STORAGE_DEVICE_MAX_WRITE_CACHE,
 	CASE_NAMESPACE_STORAGE_DEVICE_MIN_AVAIL_PCT,
 	CASE_NAMESPACE_STORAGE_DEVICE_POST_WRITE_QUEUE,
+	CASE_NAMESPACE_STORAGE_DEVICE_READ_CACHE_SIZE,
+	CASE_NAMESPACE_STORAGE_DEVICE_SHADOW_MAX_WRITE_CACHE,
+	CASE_NAMESPACE_STORAGE_DEVICE_SHADOW_STOP_WRITES_ON_LAG,
+	CASE_NAMESPACE_STORAGE_DEVICE_SHADOW_WRITE_THREADS,
 	CASE_NAMESPACE_STORAGE_DEVICE_WRITE_THREADS,
+	CASE_NAMESPACE_STORAGE_DEVICE_COMPRESSION,
+	CASE_NAMESPACE_STORAGE_DEVICE_COMPRESSION_LEVEL,
+	CASE_NAMESPACE_STORAGE_DEVICE_PERSIST_MAP_INDEXES,
+	CASE_NAMESPACE_STORAGE_DEVICE_TOUCH_INDEX_ONLY,
+	CASE_NAMESPACE_STORAGE_DEVICE_TTL_WRITE_STREAMS,
+	CASE_NAMESPACE_STORAGE_DEVICE_WEIGHTED_PLACEMENT,
+	CASE_NAMESPACE_STORAGE_DEVICE_WBLOCK_SUMMARIES,
 	// Deprecated:
 	CASE_NAMESPACE_STORAGE_DEVICE_DEFRAG_MAX_BLOCKS,
 	CASE_NAMESPACE_STORAGE_DEVICE_DEFRAG_PERIOD,
@@ -571,7 +709,11 @@ typedef enum {
 
 	// Namespace set options:
 	CASE_NAMESPACE_SET_DISABLE_EVICTION,
+	CASE_NAMESPACE_SET_DISK_QUOTA,
 	CASE_NAMESPACE_SET_ENABLE_XDR,
+	CASE_NAMESPACE_SET_EVICT_PRIORITY,
+	CASE_NAMESPACE_SET_INDEX,
+	CASE_NAMESPACE_SET_MEMORY_QUOTA,
 	CASE_NAMESPACE_SET_STOP_WRITES_COUNT,
 	// Deprecated:
 	CASE_NAMESPACE_SET_EVICT_HWM_COUNT,
@@ -587,6 +729,7 @@ typedef enum {
 	// Namespace secondary-index options:
 	CASE_NAMESPACE_SI_GC_PERIOD,
 	CASE_NAMESPACE_SI_GC_MAX_UNITS,
+	CASE_NAMESPACE_SI_GC_MAX_RATE,
 	CASE_NAMESPACE_SI_DATA_MAX_MEMORY,
 	CASE_NAMESPACE_SI_HISTOGRAM,
 	CASE_NAMESPACE_SI_IGNORE_NOT_SYNC,
@@ -594,6 +737,7 @@ typedef enum {
 	// Namespace sindex options:
 	CASE_NAMESPACE_SINDEX_DATA_MAX_MEMORY,
 	CASE_NAMESPACE_SINDEX_NUM_PARTITIONS,
+	CASE_NAMESPACE_SINDEX_SNAPSHOT_FILE,
 
     // Namespace geo2dsphere within options:
     CASE_NAMESPACE_GEO2DSPHERE_WITHIN_STRICT,
@@ -607,6 +751,9 @@ typedef enum {
 	CASE_MOD_LUA_CACHE_ENABLED,
 	CASE_MOD_LUA_SYSTEM_PATH,
 	CASE_MOD_LUA_USER_PATH,
+	CASE_MOD_LUA_NATIVE_PATH,
+	CASE_MOD_LUA_RESULT_CACHE_MODULE,
+	CASE_MOD_LUA_RESULT_CACHE_SIZE,
 
 	// Cluster options:
 	CASE_CLUSTER_SELF_NODE_ID,
@@ -674,40 +821,73 @@ const cfg_opt SERVICE_OPTS[] = {
 		{ "transaction-threads-per-queue",	CASE_SERVICE_TRANSACTION_THREADS_PER_QUEUE },
 		{ "client-fd-max",					CASE_SERVICE_CLIENT_FD_MAX },
 		{ "proto-fd-max",					CASE_SERVICE_PROTO_FD_MAX },
+		{ "admission-control",				CASE_SERVICE_ADMISSION_CONTROL },
+		{ "admission-device-latency-ms",	CASE_SERVICE_ADMISSION_DEVICE_LATENCY_MS },
+		{ "admission-queue-wait-ms",		CASE_SERVICE_ADMISSION_QUEUE_WAIT_MS },
+		{ "alloc-prof-interval",			CASE_SERVICE_ALLOC_PROF_INTERVAL },
 		{ "allow-inline-transactions",		CASE_SERVICE_ALLOW_INLINE_TRANSACTIONS },
+		{ "background-max-records-per-sec",	CASE_SERVICE_BACKGROUND_MAX_RECORDS_PER_SEC },
+		{ "background-udf-inline",			CASE_SERVICE_BACKGROUND_UDF_INLINE },
+		{ "balance-threads",				CASE_SERVICE_BALANCE_THREADS },
 		{ "batch-threads",					CASE_SERVICE_BATCH_THREADS },
 		{ "batch-max-buffers-per-queue",	CASE_SERVICE_BATCH_MAX_BUFFERS_PER_QUEUE },
 		{ "batch-max-requests",				CASE_SERVICE_BATCH_MAX_REQUESTS },
 		{ "batch-max-unused-buffers",		CASE_SERVICE_BATCH_MAX_UNUSED_BUFFERS },
 		{ "batch-priority",					CASE_SERVICE_BATCH_PRIORITY },
 		{ "batch-index-threads",			CASE_SERVICE_BATCH_INDEX_THREADS },
+		{ "batch-thread-cpus",				CASE_SERVICE_BATCH_THREAD_CPUS },
+		{ "batch-thread-sched",				CASE_SERVICE_BATCH_THREAD_SCHED },
 		{ "clock-skew-max-ms",				CASE_SERVICE_CLOCK_SKEW_MAX_MS },
 		{ "cluster-id",						CASE_SERVICE_CLUSTER_ID },
+		{ "defrag-thread-cpus",				CASE_SERVICE_DEFRAG_THREAD_CPUS },
+		{ "defrag-thread-sched",			CASE_SERVICE_DEFRAG_THREAD_SCHED },
 		{ "enable-benchmarks-svc",			CASE_SERVICE_ENABLE_BENCHMARKS_SVC },
 		{ "enable-hist-info",				CASE_SERVICE_ENABLE_HIST_INFO },
+		{ "fabric-thread-cpus",				CASE_SERVICE_FABRIC_THREAD_CPUS },
+		{ "fabric-thread-sched",			CASE_SERVICE_FABRIC_THREAD_SCHED },
 		{ "fabric-workers",					CASE_SERVICE_FABRIC_WORKERS },
 		{ "generation-disable",				CASE_SERVICE_GENERATION_DISABLE },
 		{ "hist-track-back",				CASE_SERVICE_HIST_TRACK_BACK },
+		{ "hist-track-precision",			CASE_SERVICE_HIST_TRACK_PRECISION },
 		{ "hist-track-slice",				CASE_SERVICE_HIST_TRACK_SLICE },
 		{ "hist-track-thresholds",			CASE_SERVICE_HIST_TRACK_THRESHOLDS },
+		{ "slow-txn-log-rate",				CASE_SERVICE_SLOW_TXN_LOG_RATE },
+		{ "slow-txn-threshold",				CASE_SERVICE_SLOW_TXN_THRESHOLD },
+		{ "hot-key-sample-rate",			CASE_SERVICE_HOT_KEY_SAMPLE_RATE },
 		{ "info-threads",					CASE_SERVICE_INFO_THREADS },
+		{ "info-heavy-threads",				CASE_SERVICE_INFO_HEAVY_THREADS },
+		{ "info-cache-ttl",					CASE_SERVICE_INFO_CACHE_TTL },
+		{ "info-timeout",					CASE_SERVICE_INFO_TIMEOUT },
 		{ "ldt-benchmarks",					CASE_SERVICE_LDT_BENCHMARKS },
+		{ "log-async",						CASE_SERVICE_LOG_ASYNC },
 		{ "log-local-time",					CASE_SERVICE_LOG_LOCAL_TIME },
+		{ "migrate-max-bytes-per-sec",		CASE_SERVICE_MIGRATE_MAX_BYTES_PER_SEC },
 		{ "migrate-max-num-incoming",		CASE_SERVICE_MIGRATE_MAX_NUM_INCOMING },
 		{ "migrate-rx-lifetime-ms",			CASE_SERVICE_MIGRATE_RX_LIFETIME_MS },
+		{ "migrate-rx-memory-budget",		CASE_SERVICE_MIGRATE_RX_MEMORY_BUDGET },
+		{ "migrate-split-threads",			CASE_SERVICE_MIGRATE_SPLIT_THREADS },
 		{ "migrate-threads",				CASE_SERVICE_MIGRATE_THREADS },
 		{ "nsup-delete-sleep",				CASE_SERVICE_NSUP_DELETE_SLEEP },
 		{ "nsup-period",					CASE_SERVICE_NSUP_PERIOD },
 		{ "nsup-startup-evict",				CASE_SERVICE_NSUP_STARTUP_EVICT },
+		{ "nsup-thread-cpus",				CASE_SERVICE_NSUP_THREAD_CPUS },
+		{ "nsup-thread-sched",				CASE_SERVICE_NSUP_THREAD_SCHED },
+		{ "nsup-threads",					CASE_SERVICE_NSUP_THREADS },
+		{ "paxos-compact-sync",				CASE_SERVICE_PAXOS_COMPACT_SYNC },
 		{ "paxos-max-cluster-size",			CASE_SERVICE_PAXOS_MAX_CLUSTER_SIZE },
 		{ "paxos-protocol",					CASE_SERVICE_PAXOS_PROTOCOL },
 		{ "paxos-recovery-policy",			CASE_SERVICE_PAXOS_RECOVERY_POLICY },
 		{ "paxos-retransmit-period",		CASE_SERVICE_PAXOS_RETRANSMIT_PERIOD },
+		{ "proto-compression-threshold",	CASE_SERVICE_PROTO_COMPRESSION_THRESHOLD },
 		{ "proto-fd-idle-ms",				CASE_SERVICE_PROTO_FD_IDLE_MS },
+		{ "proto-read-buffer-size",			CASE_SERVICE_PROTO_READ_BUFFER_SIZE },
+		{ "proxy-batch-us",					CASE_SERVICE_PROXY_BATCH_US },
+		{ "query-aggr-batch-size",			CASE_SERVICE_QUERY_AGGR_BATCH_SIZE },
 		{ "query-batch-size",				CASE_SERVICE_QUERY_BATCH_SIZE },
 		{ "query-bufpool-size",				CASE_SERVICE_QUERY_BUFPOOL_SIZE },
 		{ "query-in-transaction-thread",	CASE_SERVICE_QUERY_IN_TRANSACTION_THREAD },
 		{ "query-long-q-max-size",			CASE_SERVICE_QUERY_LONG_Q_MAX_SIZE },
+		{ "query-max-records-per-sec",		CASE_SERVICE_QUERY_MAX_RECORDS_PER_SEC },
 		{ "query-pre-reserve-partitions",   CASE_SERVICE_QUERY_PRE_RESERVE_PARTITIONS },
 		{ "query-priority", 				CASE_SERVICE_QUERY_PRIORITY },
 		{ "query-priority-sleep-us", 		CASE_SERVICE_QUERY_PRIORITY_SLEEP_US },
@@ -715,31 +895,54 @@ const cfg_opt SERVICE_OPTS[] = {
 		{ "query-req-in-query-thread",		CASE_SERVICE_QUERY_REQ_IN_QUERY_THREAD },
 		{ "query-req-max-inflight",			CASE_SERVICE_QUERY_REQ_MAX_INFLIGHT },
 		{ "query-short-q-max-size",			CASE_SERVICE_QUERY_SHORT_Q_MAX_SIZE },
+		{ "query-thread-cpus",				CASE_SERVICE_QUERY_THREAD_CPUS },
+		{ "query-thread-sched",				CASE_SERVICE_QUERY_THREAD_SCHED },
 		{ "query-threads",					CASE_SERVICE_QUERY_THREADS },
 		{ "query-threshold", 				CASE_SERVICE_QUERY_THRESHOLD },
 		{ "query-untracked-time-ms",		CASE_SERVICE_QUERY_UNTRACKED_TIME_MS },
 		{ "query-worker-threads",			CASE_SERVICE_QUERY_WORKER_THREADS },
+		{ "rack-id",						CASE_SERVICE_RACK_ID },
+		{ "record-locks",					CASE_SERVICE_RECORD_LOCKS },
+		{ "record-locks-adaptive",			CASE_SERVICE_RECORD_LOCKS_ADAPTIVE },
+		{ "replica-write-batch-us",			CASE_SERVICE_REPLICA_WRITE_BATCH_US },
 		{ "respond-client-on-master-completion", CASE_SERVICE_RESPOND_CLIENT_ON_MASTER_COMPLETION },
 		{ "run-as-daemon",					CASE_SERVICE_RUN_AS_DAEMON },
+		{ "run-to-completion",				CASE_SERVICE_RUN_TO_COMPLETION },
 		{ "scan-max-active",				CASE_SERVICE_SCAN_MAX_ACTIVE },
 		{ "scan-max-done",					CASE_SERVICE_SCAN_MAX_DONE },
+		{ "scan-max-records-per-sec",		CASE_SERVICE_SCAN_MAX_RECORDS_PER_SEC },
+		{ "scan-max-records-per-sec-per-job", CASE_SERVICE_SCAN_MAX_RECORDS_PER_SEC_PER_JOB },
+		{ "scan-max-threads-per-job",		CASE_SERVICE_SCAN_MAX_THREADS_PER_JOB },
 		{ "scan-max-udf-transactions",		CASE_SERVICE_SCAN_MAX_UDF_TRANSACTIONS },
+		{ "scan-thread-cpus",				CASE_SERVICE_SCAN_THREAD_CPUS },
+		{ "scan-thread-sched",				CASE_SERVICE_SCAN_THREAD_SCHED },
 		{ "scan-threads",					CASE_SERVICE_SCAN_THREADS },
+		{ "service-listener-per-thread",	CASE_SERVICE_SERVICE_LISTENER_PER_THREAD },
+		{ "service-thread-cpus",			CASE_SERVICE_SERVICE_THREAD_CPUS },
+		{ "service-thread-sched",			CASE_SERVICE_SERVICE_THREAD_SCHED },
 		{ "sindex-builder-threads",			CASE_SERVICE_SINDEX_BUILDER_THREADS },
 		{ "sindex-data-max-memory",			CASE_SERVICE_SINDEX_DATA_MAX_MEMORY },
+		{ "storage-trace-directory",		CASE_SERVICE_STORAGE_TRACE_DIRECTORY },
 		{ "ticker-interval",				CASE_SERVICE_TICKER_INTERVAL },
 		{ "transaction-max-ms",				CASE_SERVICE_TRANSACTION_MAX_MS },
 		{ "transaction-pending-limit",		CASE_SERVICE_TRANSACTION_PENDING_LIMIT },
 		{ "transaction-repeatable-read",	CASE_SERVICE_TRANSACTION_REPEATABLE_READ },
 		{ "transaction-retry-ms",			CASE_SERVICE_TRANSACTION_RETRY_MS },
+		{ "transaction-thread-cpus",		CASE_SERVICE_TRANSACTION_THREAD_CPUS },
+		{ "transaction-thread-sched",		CASE_SERVICE_TRANSACTION_THREAD_SCHED },
+		{ "transaction-threads-adaptive",	CASE_SERVICE_TRANSACTION_THREADS_ADAPTIVE },
+		{ "udf-runtime-max-memory",			CASE_SERVICE_UDF_RUNTIME_MAX_MEMORY },
 		{ "use-queue-per-device",			CASE_SERVICE_USE_QUEUE_PER_DEVICE },
 		{ "work-directory",					CASE_SERVICE_WORK_DIRECTORY },
 		{ "write-duplicate-resolution-disable", CASE_SERVICE_WRITE_DUPLICATE_RESOLUTION_DISABLE },
+		{ "write-thread-cpus",				CASE_SERVICE_WRITE_THREAD_CPUS },
+		{ "write-thread-sched",				CASE_SERVICE_WRITE_THREAD_SCHED },
 		{ "asmalloc-enabled",				CASE_SERVICE_ASMALLOC_ENABLED },
 		{ "fabric-dump-msgs",				CASE_SERVICE_FABRIC_DUMP_MSGS },
 		{ "max-msgs-per-type",				CASE_SERVICE_MAX_MSGS_PER_TYPE },
 		{ "memory-accounting",				CASE_SERVICE_MEMORY_ACCOUNTING },
 		{ "prole-extra-ttl",				CASE_SERVICE_PROLE_EXTRA_TTL },
+		{ "non-master-gc-rps",				CASE_SERVICE_NON_MASTER_GC_RPS },
 		{ "auto-dun",						CASE_SERVICE_AUTO_DUN },
 		{ "auto-undun",						CASE_SERVICE_AUTO_UNDUN },
 		{ "batch-retransmit",				CASE_SERVICE_BATCH_RETRANSMIT },
@@ -768,7 +971,6 @@ const cfg_opt SERVICE_OPTS[] = {
 		{ "nsup-queue-lwm",					CASE_SERVICE_NSUP_QUEUE_LWM },
 		{ "nsup-reduce-priority",			CASE_SERVICE_NSUP_REDUCE_PRIORITY },
 		{ "nsup-reduce-sleep",				CASE_SERVICE_NSUP_REDUCE_SLEEP },
-		{ "nsup-threads",					CASE_SERVICE_NSUP_THREADS },
 		{ "replication-fire-and-forget",	CASE_SERVICE_REPLICATION_FIRE_AND_FORGET },
 		{ "scan-memory",					CASE_SERVICE_SCAN_MEMORY },
 		{ "scan-priority",					CASE_SERVICE_SCAN_PRIORITY },
@@ -778,7 +980,6 @@ const cfg_opt SERVICE_OPTS[] = {
 		{ "transaction-duplicate-threads",	CASE_SERVICE_TRANSACTION_DUPLICATE_THREADS },
 		{ "trial-account-key",				CASE_SERVICE_TRIAL_ACCOUNT_KEY },
 		{ "udf-runtime-max-gmemory",		CASE_SERVICE_UDF_RUNTIME_MAX_GMEMORY },
-		{ "udf-runtime-max-memory",			CASE_SERVICE_UDF_RUNTIME_MAX_MEMORY },
 		{ "}",								CASE_CONTEXT_END }
 };
 
@@ -837,6 +1038,7 @@ const cfg_opt NETWORK_HEARTBEAT_OPTS[] = {
 		{ "mesh-seed-address-port",			CASE_NETWORK_HEARTBEAT_MESH_SEED_ADDRESS_PORT },
 		{ "interval",						CASE_NETWORK_HEARTBEAT_INTERVAL },
 		{ "timeout",						CASE_NETWORK_HEARTBEAT_TIMEOUT },
+		{ "compact-payloads",				CASE_NETWORK_HEARTBEAT_COMPACT_PAYLOADS },
 		{ "fabric-grace-factor",			CASE_NETWORK_HEARTBEAT_FABRIC_GRACE_FACTOR },
 		{ "interface-address",				CASE_NETWORK_HEARTBEAT_INTERFACE_ADDRESS },
 		{ "mcast-ttl",						CASE_NETWORK_HEARTBEAT_MCAST_TTL },
@@ -866,12 +1068,22 @@ const cfg_opt NETWORK_FABRIC_OPTS[] = {
 		{ "keepalive-intvl",				CASE_NETWORK_FABRIC_KEEPALIVE_INTVL },
 		{ "keepalive-probes",				CASE_NETWORK_FABRIC_KEEPALIVE_PROBES },
 		{ "latency-max-ms",					CASE_NETWORK_FABRIC_LATENCY_MAX_MS },
+		{ "channel-bulk-fds",				CASE_NETWORK_FABRIC_CHANNEL_BULK_FDS },
+		{ "channel-bulk-send-buf",			CASE_NETWORK_FABRIC_CHANNEL_BULK_SEND_BUF },
+		{ "channel-bulk-workers",			CASE_NETWORK_FABRIC_CHANNEL_BULK_WORKERS },
+		{ "channel-ctrl-fds",				CASE_NETWORK_FABRIC_CHANNEL_CTRL_FDS },
+		{ "channel-ctrl-send-buf",			CASE_NETWORK_FABRIC_CHANNEL_CTRL_SEND_BUF },
+		{ "channel-ctrl-workers",			CASE_NETWORK_FABRIC_CHANNEL_CTRL_WORKERS },
+		{ "channel-rw-fds",					CASE_NETWORK_FABRIC_CHANNEL_RW_FDS },
+		{ "channel-rw-send-buf",			CASE_NETWORK_FABRIC_CHANNEL_RW_SEND_BUF },
+		{ "channel-rw-workers",				CASE_NETWORK_FABRIC_CHANNEL_RW_WORKERS },
 		{ "}",								CASE_CONTEXT_END }
 };
 
 const cfg_opt NETWORK_INFO_OPTS[] = {
 		{ "address",						CASE_NETWORK_INFO_ADDRESS },
 		{ "port",							CASE_NETWORK_INFO_PORT },
+		{ "metrics-port",					CASE_NETWORK_INFO_METRICS_PORT },
 		{ "enable-fastpath",				CASE_NETWORK_INFO_ENABLE_FASTPATH },
 		{ "}",								CASE_CONTEXT_END }
 };
@@ -888,6 +1100,9 @@ const cfg_opt NAMESPACE_OPTS[] = {
 		{ "ns-forward-xdr-writes",			CASE_NAMESPACE_FORWARD_XDR_WRITES },
 		{ "allow-nonxdr-writes",			CASE_NAMESPACE_ALLOW_NONXDR_WRITES },
 		{ "allow-xdr-writes",				CASE_NAMESPACE_ALLOW_XDR_WRITES },
+		{ "async-replication",				CASE_NAMESPACE_ASYNC_REPLICATION },
+		{ "async-replication-max-lag",		CASE_NAMESPACE_ASYNC_REPLICATION_MAX_LAG },
+		{ "bin-space-slabs",				CASE_NAMESPACE_BIN_SPACE_SLABS },
 		{ "cold-start-evict-ttl",			CASE_NAMESPACE_COLD_START_EVICT_TTL },
 		{ "conflict-resolution-policy",		CASE_NAMESPACE_CONFLICT_RESOLUTION_POLICY },
 		{ "data-in-index",					CASE_NAMESPACE_DATA_IN_INDEX },
@@ -899,17 +1114,35 @@ const cfg_opt NAMESPACE_OPTS[] = {
 		{ "enable-benchmarks-udf-sub",		CASE_NAMESPACE_ENABLE_BENCHMARKS_UDF_SUB },
 		{ "enable-benchmarks-write",		CASE_NAMESPACE_ENABLE_BENCHMARKS_WRITE },
 		{ "enable-hist-proxy",				CASE_NAMESPACE_ENABLE_HIST_PROXY },
+		{ "enable-hist-stages",				CASE_NAMESPACE_ENABLE_HIST_STAGES },
+		{ "evict-continuous",				CASE_NAMESPACE_EVICT_CONTINUOUS },
 		{ "evict-hist-buckets",				CASE_NAMESPACE_EVICT_HIST_BUCKETS },
 		{ "evict-tenths-pct",				CASE_NAMESPACE_EVICT_TENTHS_PCT },
+		{ "expiration-index",				CASE_NAMESPACE_EXPIRATION_INDEX },
 		{ "high-water-disk-pct",			CASE_NAMESPACE_HIGH_WATER_DISK_PCT },
 		{ "high-water-memory-pct",			CASE_NAMESPACE_HIGH_WATER_MEMORY_PCT },
+		{ "incremental-histograms",			CASE_NAMESPACE_INCREMENTAL_HISTOGRAMS },
+		{ "index-flash-path",				CASE_NAMESPACE_INDEX_FLASH_PATH },
+		{ "index-numa-policy",				CASE_NAMESPACE_INDEX_NUMA_POLICY },
+		{ "index-page-size",				CASE_NAMESPACE_INDEX_PAGE_SIZE },
 		{ "ldt-enabled",					CASE_NAMESPACE_LDT_ENABLED },
 		{ "ldt-gc-rate",					CASE_NAMESPACE_LDT_GC_RATE },
 		{ "ldt-page-size",					CASE_NAMESPACE_LDT_PAGE_SIZE },
 		{ "max-ttl",						CASE_NAMESPACE_MAX_TTL },
+		{ "memory-snapshot-dir",			CASE_NAMESPACE_MEMORY_SNAPSHOT_DIR },
+		{ "memory-snapshot-max-write-rate",	CASE_NAMESPACE_MEMORY_SNAPSHOT_MAX_WRITE_RATE },
+		{ "memory-snapshot-period",			CASE_NAMESPACE_MEMORY_SNAPSHOT_PERIOD },
+		{ "memory-snapshot-threads",		CASE_NAMESPACE_MEMORY_SNAPSHOT_THREADS },
+		{ "migrate-changelog-entries",		CASE_NAMESPACE_MIGRATE_CHANGELOG_ENTRIES },
+		{ "migrate-changelog-max-age",		CASE_NAMESPACE_MIGRATE_CHANGELOG_MAX_AGE },
+		{ "migrate-compression",			CASE_NAMESPACE_MIGRATE_COMPRESSION },
+		{ "migrate-delta",					CASE_NAMESPACE_MIGRATE_DELTA },
 		{ "migrate-order",					CASE_NAMESPACE_MIGRATE_ORDER },
 		{ "migrate-sleep",					CASE_NAMESPACE_MIGRATE_SLEEP},
+		{ "nsup-period",					CASE_NAMESPACE_NSUP_PERIOD },
 		{ "obj-size-hist-max",				CASE_NAMESPACE_OBJ_SIZE_HIST_MAX },
+		{ "partition-tree-sprigs",			CASE_NAMESPACE_PARTITION_TREE_SPRIGS },
+		{ "read-coalescing",				CASE_NAMESPACE_READ_COALESCING },
 		{ "read-consistency-level-override", CASE_NAMESPACE_READ_CONSISTENCY_LEVEL_OVERRIDE },
 		{ "set",							CASE_NAMESPACE_SET_BEGIN },
 		{ "si",								CASE_NAMESPACE_SI_BEGIN },
@@ -917,6 +1150,7 @@ const cfg_opt NAMESPACE_OPTS[] = {
 		{ "geo2dsphere-within",				CASE_NAMESPACE_GEO2DSPHERE_WITHIN_BEGIN },
 		{ "single-bin",						CASE_NAMESPACE_SINGLE_BIN },
 		{ "stop-writes-pct",				CASE_NAMESPACE_STOP_WRITES_PCT },
+		{ "transaction-queues",				CASE_NAMESPACE_TRANSACTION_QUEUES },
 		{ "write-commit-level-override",	CASE_NAMESPACE_WRITE_COMMIT_LEVEL_OVERRIDE },
 		{ "allow-versions",					CASE_NAMESPACE_ALLOW_VERSIONS },
 		{ "demo-read-multiplier",			CASE_NAMESPACE_DEMO_READ_MULTIPLIER },
@@ -931,6 +1165,11 @@ const cfg_opt NAMESPACE_CONFLICT_RESOLUTION_OPTS[] = {
 		{ "last-update-time",				CASE_NAMESPACE_CONFLICT_RESOLUTION_LAST_UPDATE_TIME }
 };
 
+const cfg_opt NAMESPACE_INDEX_NUMA_POLICY_OPTS[] = {
+		{ "interleave",						CASE_NAMESPACE_INDEX_NUMA_POLICY_INTERLEAVE },
+		{ "none",							CASE_NAMESPACE_INDEX_NUMA_POLICY_NONE }
+};
+
 const cfg_opt NAMESPACE_READ_CONSISTENCY_OPTS[] = {
 		{ "all",							CASE_NAMESPACE_READ_CONSISTENCY_ALL },
 		{ "off",							CASE_NAMESPACE_READ_CONSISTENCY_OFF },
@@ -950,6 +1189,13 @@ const cfg_opt NAMESPACE_STORAGE_OPTS[] = {
 		{ "kv",								CASE_NAMESPACE_STORAGE_KV }
 };
 
+const cfg_opt NAMESPACE_STORAGE_COMPRESSION_OPTS[] = {
+		{ "none",							CASE_NAMESPACE_STORAGE_COMPRESSION_NONE },
+		{ "zlib",							CASE_NAMESPACE_STORAGE_COMPRESSION_ZLIB },
+		{ "lz4",							CASE_NAMESPACE_STORAGE_COMPRESSION_LZ4 },
+		{ "zstd",							CASE_NAMESPACE_STORAGE_COMPRESSION_ZSTD }
+};
+
 const cfg_opt NAMESPACE_STORAGE_DEVICE_OPTS[] = {
 		{ "device",							CASE_NAMESPACE_STORAGE_DEVICE_DEVICE },
 		{ "file",							CASE_NAMESPACE_STORAGE_DEVICE_FILE },
@@ -959,18 +1205,35 @@ const cfg_opt NAMESPACE_STORAGE_DEVICE_OPTS[] = {
 		{ "memory-all",						CASE_NAMESPACE_STORAGE_DEVICE_MEMORY_ALL },
 		{ "data-in-memory",					CASE_NAMESPACE_STORAGE_DEVICE_DATA_IN_MEMORY },
 		{ "cold-start-empty",				CASE_NAMESPACE_STORAGE_DEVICE_COLD_START_EMPTY },
+		{ "cold-start-threads",				CASE_NAMESPACE_STORAGE_DEVICE_COLD_START_THREADS },
+		{ "defrag-live-map",				CASE_NAMESPACE_STORAGE_DEVICE_DEFRAG_LIVE_MAP },
 		{ "defrag-lwm-pct",					CASE_NAMESPACE_STORAGE_DEVICE_DEFRAG_LWM_PCT },
 		{ "defrag-queue-min",				CASE_NAMESPACE_STORAGE_DEVICE_DEFRAG_QUEUE_MIN },
 		{ "defrag-sleep",					CASE_NAMESPACE_STORAGE_DEVICE_DEFRAG_SLEEP },
+		{ "defrag-adaptive",				CASE_NAMESPACE_STORAGE_DEVICE_DEFRAG_ADAPTIVE },
 		{ "defrag-startup-minimum",			CASE_NAMESPACE_STORAGE_DEVICE_DEFRAG_STARTUP_MINIMUM },
 		{ "disable-odirect",				CASE_NAMESPACE_STORAGE_DEVICE_DISABLE_ODIRECT },
 		{ "enable-osync",					CASE_NAMESPACE_STORAGE_DEVICE_ENABLE_OSYNC },
+		{ "fast-restart",					CASE_NAMESPACE_STORAGE_DEVICE_FAST_RESTART },
 		{ "flush-max-ms",					CASE_NAMESPACE_STORAGE_DEVICE_FLUSH_MAX_MS },
 		{ "fsync-max-sec",					CASE_NAMESPACE_STORAGE_DEVICE_FSYNC_MAX_SEC },
+		{ "ldt-subrec-cache-size",			CASE_NAMESPACE_STORAGE_DEVICE_LDT_SUBREC_CACHE_SIZE },
+		{ "max-flush-size",					CASE_NAMESPACE_STORAGE_DEVICE_MAX_FLUSH_SIZE },
 		{ "max-write-cache",				CASE_NAMESPACE_STORAGE_DEVICE_MAX_WRITE_CACHE },
 		{ "min-avail-pct",					CASE_NAMESPACE_STORAGE_DEVICE_MIN_AVAIL_PCT },
 		{ "post-write-queue",				CASE_NAMESPACE_STORAGE_DEVICE_POST_WRITE_QUEUE },
+		{ "read-cache-size",				CASE_NAMESPACE_STORAGE_DEVICE_READ_CACHE_SIZE },
+		{ "shadow-max-write-cache",			CASE_NAMESPACE_STORAGE_DEVICE_SHADOW_MAX_WRITE_CACHE },
+		{ "shadow-stop-writes-on-lag",		CASE_NAMESPACE_STORAGE_DEVICE_SHADOW_STOP_WRITES_ON_LAG },
+		{ "shadow-write-threads",			CASE_NAMESPACE_STORAGE_DEVICE_SHADOW_WRITE_THREADS },
 		{ "write-threads",					CASE_NAMESPACE_STORAGE_DEVICE_WRITE_THREADS },
+		{ "compression",					CASE_NAMESPACE_STORAGE_DEVICE_COMPRESSION },
+		{ "compression-level",				CASE_NAMESPACE_STORAGE_DEVICE_COMPRESSION_LEVEL },
+		{ "persist-map-indexes",			CASE_NAMESPACE_STORAGE_DEVICE_PERSIST_MAP_INDEXES },
+		{ "touch-index-only",				CASE_NAMESPACE_STORAGE_DEVICE_TOUCH_INDEX_ONLY },
+		{ "ttl-write-streams",				CASE_NAMESPACE_STORAGE_DEVICE_TTL_WRITE_STREAMS },
+		{ "weighted-placement",				CASE_NAMESPACE_STORAGE_DEVICE_WEIGHTED_PLACEMENT },
+		{ "wblock-summaries",				CASE_NAMESPACE_STORAGE_DEVICE_WBLOCK_SUMMARIES },
 		{ "defrag-max-blocks",				CASE_NAMESPACE_STORAGE_DEVICE_DEFRAG_MAX_BLOCKS },
 		{ "defrag-period",					CASE_NAMESPACE_STORAGE_DEVICE_DEFRAG_PERIOD },
 		{ "load-at-startup",				CASE_NAMESPACE_STORAGE_DEVICE_LOAD_AT_STARTUP },
@@ -993,7 +1256,11 @@ const cfg_opt NAMESPACE_STORAGE_KV_OPTS[] = {
 
 const cfg_opt NAMESPACE_SET_OPTS[] = {
 		{ "set-disable-eviction",			CASE_NAMESPACE_SET_DISABLE_EVICTION },
+		{ "set-disk-quota",					CASE_NAMESPACE_SET_DISK_QUOTA },
 		{ "set-enable-xdr",					CASE_NAMESPACE_SET_ENABLE_XDR },
+		{ "set-evict-priority",				CASE_NAMESPACE_SET_EVICT_PRIORITY },
+		{ "set-index",						CASE_NAMESPACE_SET_INDEX },
+		{ "set-memory-quota",				CASE_NAMESPACE_SET_MEMORY_QUOTA },
 		{ "set-stop-writes-count",			CASE_NAMESPACE_SET_STOP_WRITES_COUNT },
 		{ "set-evict-hwm-count",			CASE_NAMESPACE_SET_EVICT_HWM_COUNT },
 		{ "set-evict-hwm-pct",				CASE_NAMESPACE_SET_EVICT_HWM_PCT },
@@ -1011,6 +1278,7 @@ const cfg_opt NAMESPACE_SET_ENABLE_XDR_OPTS[] = {
 const cfg_opt NAMESPACE_SI_OPTS[] = {
 		{ "si-gc-period",					CASE_NAMESPACE_SI_GC_PERIOD },
 		{ "si-gc-max-units",				CASE_NAMESPACE_SI_GC_MAX_UNITS },
+		{ "si-gc-max-rate",					CASE_NAMESPACE_SI_GC_MAX_RATE },
 		{ "si-data-max-memory",				CASE_NAMESPACE_SI_DATA_MAX_MEMORY },
 		{ "si-histogram",					CASE_NAMESPACE_SI_HISTOGRAM },
 		{ "si-ignore-not-sync",				CASE_NAMESPACE_SI_IGNORE_NOT_SYNC },
@@ -1020,6 +1288,7 @@ const cfg_opt NAMESPACE_SI_OPTS[] = {
 const cfg_opt NAMESPACE_SINDEX_OPTS[] = {
 		{ "data-max-memory",				CASE_NAMESPACE_SINDEX_DATA_MAX_MEMORY },
 		{ "num-partitions",					CASE_NAMESPACE_SINDEX_NUM_PARTITIONS },
+		{ "snapshot-file",					CASE_NAMESPACE_SINDEX_SNAPSHOT_FILE },
 		{ "}",								CASE_CONTEXT_END }
 };
 
@@ -1037,6 +1306,9 @@ const cfg_opt MOD_LUA_OPTS[] = {
 		{ "cache-enabled",					CASE_MOD_LUA_CACHE_ENABLED },
 		{ "system-path",					CASE_MOD_LUA_SYSTEM_PATH },
 		{ "user-path",						CASE_MOD_LUA_USER_PATH },
+		{ "native-path",					CASE_MOD_LUA_NATIVE_PATH },
+		{ "result-cache-module",			CASE_MOD_LUA_RESULT_CACHE_MODULE },
+		{ "result-cache-size",				CASE_MOD_LUA_RESULT_CACHE_SIZE },
 		{ "}",								CASE_CONTEXT_END }
 };
 
@@ -1097,9 +1369,11 @@ const int NUM_NETWORK_FABRIC_OPTS					= sizeof(NETWORK_FABRIC_OPTS) / sizeof(cfg
 const int NUM_NETWORK_INFO_OPTS						= sizeof(NETWORK_INFO_OPTS) / sizeof(cfg_opt);
 const int NUM_NAMESPACE_OPTS						= sizeof(NAMESPACE_OPTS) / sizeof(cfg_opt);
 const int NUM_NAMESPACE_CONFLICT_RESOLUTION_OPTS	= sizeof(NAMESPACE_CONFLICT_RESOLUTION_OPTS) / sizeof(cfg_opt);
+const int NUM_NAMESPACE_INDEX_NUMA_POLICY_OPTS		= sizeof(NAMESPACE_INDEX_NUMA_POLICY_OPTS) / sizeof(cfg_opt);
 const int NUM_NAMESPACE_READ_CONSISTENCY_OPTS		= sizeof(NAMESPACE_READ_CONSISTENCY_OPTS) / sizeof(cfg_opt);
 const int NUM_NAMESPACE_WRITE_COMMIT_OPTS			= sizeof(NAMESPACE_WRITE_COMMIT_OPTS) / sizeof(cfg_opt);
 const int NUM_NAMESPACE_STORAGE_OPTS				= sizeof(NAMESPACE_STORAGE_OPTS) / sizeof(cfg_opt);
+const int NUM_NAMESPACE_STORAGE_COMPRESSION_OPTS	= sizeof(NAMESPACE_STORAGE_COMPRESSION_OPTS) / sizeof(cfg_opt);
 const int NUM_NAMESPACE_STORAGE_DEVICE_OPTS			= sizeof(NAMESPACE_STORAGE_DEVICE_OPTS) / sizeof(cfg_opt);
 const int NUM_NAMESPACE_STORAGE_KV_OPTS				= sizeof(NAMESPACE_STORAGE_KV_OPTS) / sizeof(cfg_opt);
 const int NUM_NAMESPACE_SET_OPTS					= sizeof(NAMESPACE_SET_OPTS) / sizeof(cfg_opt);
@@ -1632,6 +1906,19 @@ cfg_u32(const cfg_line* p_line, uint32_t min, uint32_t max)
 	return value;
 }
 
+uint32_t
+cfg_u32_power_of_2(const cfg_line* p_line, uint32_t min, uint32_t max)
+{
+	uint32_t value = cfg_u32(p_line, min, max);
+
+	if ((value & (value - 1)) != 0) {
+		cf_crash_nostack(AS_CFG, "line %d :: %s must be a power of 2, not %u",
+				p_line->num, p_line->name_tok, value);
+	}
+
+	return value;
+}
+
 uint16_t
 cfg_u16_no_checks(const cfg_line* p_line)
 {
@@ -1768,6 +2055,106 @@ cfg_port_val2(const cfg_line* p_line)
 	return cfg_int_val2(p_line, CFG_MIN_PORT, CFG_MAX_PORT);
 }
 
+// CPU lists are comma-separated CPUs and inclusive ranges, e.g. "0-7,16-23".
+uint32_t
+cfg_cpu_list(const cfg_line* p_line, uint16_t* cpus, uint32_t max_cpus)
+{
+	const char* p = p_line->val_tok_1;
+	uint32_t n_cpus = 0;
+
+	while (true) {
+		char* end;
+		unsigned long first = strtoul(p, &end, 10);
+		unsigned long last = first;
+
+		if (end == p) {
+			break;
+		}
+
+		if (*end == '-') {
+			p = end + 1;
+			last = strtoul(p, &end, 10);
+
+			if (end == p) {
+				break;
+			}
+		}
+
+		if (first > last || last >= CPU_SETSIZE) {
+			cf_crash_nostack(AS_CFG, "line %d :: %s has bad cpu range %lu-%lu",
+					p_line->num, p_line->name_tok, first, last);
+		}
+
+		for (unsigned long cpu = first; cpu <= last; cpu++) {
+			if (n_cpus == max_cpus) {
+				cf_crash_nostack(AS_CFG, "line %d :: %s has more than %u cpus",
+						p_line->num, p_line->name_tok, max_cpus);
+			}
+
+			cpus[n_cpus++] = (uint16_t)cpu;
+		}
+
+		if (*end == '\0') {
+			return n_cpus;
+		}
+
+		if (*end != ',') {
+			break;
+		}
+
+		p = end + 1;
+	}
+
+	cf_crash_nostack(AS_CFG, "line %d :: %s must be a cpu list like 0-7,16-23, not %s",
+			p_line->num, p_line->name_tok, p_line->val_tok_1);
+
+	return 0;
+}
+
+void
+cfg_thread_cpus(const cfg_line* p_line, as_thread_sched* ts)
+{
+	ts->n_cpus = cfg_cpu_list(p_line, ts->cpus, MAX_THREAD_SCHED_CPUS);
+}
+
+// Policy, and for the real-time policies a priority, e.g. "batch" or "fifo 10".
+void
+cfg_thread_sched(const cfg_line* p_line, as_thread_sched* ts)
+{
+	const char* policy = p_line->val_tok_1;
+
+	if (strcmp(policy, "other") == 0) {
+		ts->policy = SCHED_OTHER;
+	}
+	else if (strcmp(policy, "batch") == 0) {
+		ts->policy = SCHED_BATCH;
+	}
+	else if (strcmp(policy, "idle") == 0) {
+		ts->policy = SCHED_IDLE;
+	}
+	else if (strcmp(policy, "fifo") == 0) {
+		ts->policy = SCHED_FIFO;
+	}
+	else if (strcmp(policy, "rr") == 0) {
+		ts->policy = SCHED_RR;
+	}
+	else {
+		cf_crash_nostack(AS_CFG, "line %d :: %s must be other, batch, idle, fifo or rr, not %s",
+				p_line->num, p_line->name_tok, policy);
+	}
+
+	ts->priority = 0;
+
+	if (ts->policy == SCHED_FIFO || ts->policy == SCHED_RR) {
+		ts->priority = cfg_int_val2(p_line, sched_get_priority_min(ts->policy),
+				sched_get_priority_max(ts->policy));
+	}
+	else if (*p_line->val_tok_2 != '\0') {
+		cf_crash_nostack(AS_CFG, "line %d :: %s %s takes no priority",
+				p_line->num, p_line->name_tok, policy);
+	}
+}
+
 //------------------------------------------------
 // Constants used in parsing.
 //
@@ -1932,7 +2319,7 @@ as_config_init(const char *config_file)
 				transaction_queues_set = true;
 				break;
 			case CASE_SERVICE_TRANSACTION_THREADS_PER_QUEUE:
-				c->n_transaction_threads_per_queue = cfg_int_no_checks(&line);
+				c->n_transaction_threads_per_queue = cfg_int(&line, 1, MAX_TRANSACTION_THREADS_PER_QUEUE);
 				break;
 			case CASE_SERVICE_CLIENT_FD_MAX:
 				cfg_renamed_name_tok(&line, "proto-fd-max");
@@ -1940,9 +2327,30 @@ as_config_init(const char *config_file)
 			case CASE_SERVICE_PROTO_FD_MAX:
 				c->n_proto_fd_max = cfg_int_no_checks(&line);
 				break;
+			case CASE_SERVICE_ADMISSION_CONTROL:
+				c->admission_control = cfg_bool(&line);
+				break;
+			case CASE_SERVICE_ADMISSION_DEVICE_LATENCY_MS:
+				c->admission_device_latency_ms = cfg_u32(&line, 1, 1000 * 10);
+				break;
+			case CASE_SERVICE_ADMISSION_QUEUE_WAIT_MS:
+				c->admission_queue_wait_ms = cfg_u32(&line, 1, 1000 * 10);
+				break;
+			case CASE_SERVICE_ALLOC_PROF_INTERVAL:
+				c->alloc_prof_interval = cfg_u32_no_checks(&line);
+				break;
 			case CASE_SERVICE_ALLOW_INLINE_TRANSACTIONS:
 				c->allow_inline_transactions = cfg_bool(&line);
 				break;
+			case CASE_SERVICE_BACKGROUND_MAX_RECORDS_PER_SEC:
+				c->background_max_records_per_sec = cfg_u32_no_checks(&line);
+				break;
+			case CASE_SERVICE_BACKGROUND_UDF_INLINE:
+				c->background_udf_inline = cfg_bool(&line);
+				break;
+			case CASE_SERVICE_BALANCE_THREADS:
+				c->n_balance_threads = cfg_u32(&line, 1, MAX_BALANCE_THREADS);
+				break;
 			case CASE_SERVICE_BATCH_THREADS:
 				c->n_batch_threads = cfg_int(&line, 0, MAX_BATCH_THREADS);
 				break;
@@ -1961,18 +2369,36 @@ as_config_init(const char *config_file)
 			case CASE_SERVICE_BATCH_INDEX_THREADS:
 				c->n_batch_index_threads = cfg_int(&line, 1, MAX_BATCH_THREADS);
 				break;
+			case CASE_SERVICE_BATCH_THREAD_CPUS:
+				cfg_thread_cpus(&line, &c->thread_sched[AS_SCHED_POOL_BATCH]);
+				break;
+			case CASE_SERVICE_BATCH_THREAD_SCHED:
+				cfg_thread_sched(&line, &c->thread_sched[AS_SCHED_POOL_BATCH]);
+				break;
 			case CASE_SERVICE_CLOCK_SKEW_MAX_MS:
 				c->clock_skew_max_ms = cfg_u32_no_checks(&line);
 				break;
 			case CASE_SERVICE_CLUSTER_ID:
 				cfg_strcpy(&line, c->cluster_id, AS_CLUSTER_ID_SZ);
 				break;
+			case CASE_SERVICE_DEFRAG_THREAD_CPUS:
+				cfg_thread_cpus(&line, &c->thread_sched[AS_SCHED_POOL_DEFRAG]);
+				break;
+			case CASE_SERVICE_DEFRAG_THREAD_SCHED:
+				cfg_thread_sched(&line, &c->thread_sched[AS_SCHED_POOL_DEFRAG]);
+				break;
 			case CASE_SERVICE_ENABLE_BENCHMARKS_SVC:
 				c->svc_benchmarks_enabled = cfg_bool(&line);
 				break;
 			case CASE_SERVICE_ENABLE_HIST_INFO:
 				c->info_hist_enabled = cfg_bool(&line);
 				break;
+			case CASE_SERVICE_FABRIC_THREAD_CPUS:
+				cfg_thread_cpus(&line, &c->thread_sched[AS_SCHED_POOL_FABRIC]);
+				break;
+			case CASE_SERVICE_FABRIC_THREAD_SCHED:
+				cfg_thread_sched(&line, &c->thread_sched[AS_SCHED_POOL_FABRIC]);
+				break;
 			case CASE_SERVICE_FABRIC_WORKERS:
 				c->n_fabric_workers = cfg_int(&line, 1, MAX_FABRIC_WORKERS);
 				break;
@@ -1982,6 +2408,9 @@ as_config_init(const char *config_file)
 			case CASE_SERVICE_HIST_TRACK_BACK:
 				c->hist_track_back = cfg_u32_no_checks(&line);
 				break;
+			case CASE_SERVICE_HIST_TRACK_PRECISION:
+				c->hist_track_precision = cfg_u32(&line, 0, HDR_HIST_MAX_PRECISION);
+				break;
 			case CASE_SERVICE_HIST_TRACK_SLICE:
 				c->hist_track_slice = cfg_u32_no_checks(&line);
 				break;
@@ -1989,21 +2418,51 @@ as_config_init(const char *config_file)
 				c->hist_track_thresholds = cfg_strdup_no_checks(&line);
 				// TODO - if config key present but no value (not even space) failure mode is bad...
 				break;
+			case CASE_SERVICE_SLOW_TXN_LOG_RATE:
+				c->slow_txn_log_rate = cfg_u32_no_checks(&line);
+				break;
+			case CASE_SERVICE_SLOW_TXN_THRESHOLD:
+				c->slow_txn_threshold = cfg_u32_no_checks(&line);
+				break;
+			case CASE_SERVICE_HOT_KEY_SAMPLE_RATE:
+				c->hot_key_sample_rate = cfg_u32_no_checks(&line);
+				break;
 			case CASE_SERVICE_INFO_THREADS:
 				c->n_info_threads = cfg_int_no_checks(&line);
 				break;
+			case CASE_SERVICE_INFO_HEAVY_THREADS:
+				c->n_info_heavy_threads = cfg_int(&line, 0, MAX_INFO_HEAVY_THREADS);
+				break;
+			case CASE_SERVICE_INFO_CACHE_TTL:
+				c->info_cache_ttl = cfg_u32_no_checks(&line);
+				break;
+			case CASE_SERVICE_INFO_TIMEOUT:
+				c->info_timeout = cfg_u32_no_checks(&line);
+				break;
 			case CASE_SERVICE_LDT_BENCHMARKS:
 				c->ldt_benchmarks = cfg_bool(&line);
 				break;
+			case CASE_SERVICE_LOG_ASYNC:
+				cf_fault_use_async(cfg_bool(&line));
+				break;
 			case CASE_SERVICE_LOG_LOCAL_TIME:
 				cf_fault_use_local_time(cfg_bool(&line));
 				break;
+			case CASE_SERVICE_MIGRATE_MAX_BYTES_PER_SEC:
+				c->migrate_max_bytes_per_sec = cfg_u64_no_checks(&line);
+				break;
 			case CASE_SERVICE_MIGRATE_MAX_NUM_INCOMING:
 				c->migrate_max_num_incoming = cfg_int(&line, 0, INT_MAX);
 				break;
 			case CASE_SERVICE_MIGRATE_RX_LIFETIME_MS:
 				c->migrate_rx_lifetime_ms = cfg_int_no_checks(&line);
 				break;
+			case CASE_SERVICE_MIGRATE_RX_MEMORY_BUDGET:
+				c->migrate_rx_memory_budget = cfg_u64_no_checks(&line);
+				break;
+			case CASE_SERVICE_MIGRATE_SPLIT_THREADS:
+				c->migrate_split_threads = cfg_u32(&line, 1, MAX_MIGRATE_SPLIT_THREADS);
+				break;
 			case CASE_SERVICE_MIGRATE_THREADS:
 				c->n_migrate_threads = cfg_int(&line, 0, MAX_NUM_MIGRATE_XMIT_THREADS);
 				break;
@@ -2016,6 +2475,18 @@ as_config_init(const char *config_file)
 			case CASE_SERVICE_NSUP_STARTUP_EVICT:
 				c->nsup_startup_evict = cfg_bool(&line);
 				break;
+			case CASE_SERVICE_NSUP_THREAD_CPUS:
+				cfg_thread_cpus(&line, &c->thread_sched[AS_SCHED_POOL_NSUP]);
+				break;
+			case CASE_SERVICE_NSUP_THREAD_SCHED:
+				cfg_thread_sched(&line, &c->thread_sched[AS_SCHED_POOL_NSUP]);
+				break;
+			case CASE_SERVICE_NSUP_THREADS:
+				c->n_nsup_threads = cfg_u32(&line, 1, MAX_NSUP_THREADS);
+				break;
+			case CASE_SERVICE_PAXOS_COMPACT_SYNC:
+				c->paxos_compact_sync = cfg_bool(&line);
+				break;
 			case CASE_SERVICE_PAXOS_MAX_CLUSTER_SIZE:
 				c->paxos_max_cluster_size = cfg_u64(&line, 2, AS_CLUSTER_SZ);
 				break;
@@ -2053,9 +2524,21 @@ as_config_init(const char *config_file)
 			case CASE_SERVICE_PAXOS_RETRANSMIT_PERIOD:
 				c->paxos_retransmit_period = cfg_u32_no_checks(&line);
 				break;
+			case CASE_SERVICE_PROTO_COMPRESSION_THRESHOLD:
+				c->proto_compression_threshold = cfg_u32_no_checks(&line);
+				break;
 			case CASE_SERVICE_PROTO_FD_IDLE_MS:
 				c->proto_fd_idle_ms = cfg_int_no_checks(&line);
 				break;
+			case CASE_SERVICE_PROTO_READ_BUFFER_SIZE:
+				c->proto_read_buffer_size = cfg_u32(&line, 0, 1024 * 1024);
+				break;
+			case CASE_SERVICE_PROXY_BATCH_US:
+				c->proxy_batch_us = cfg_u32(&line, 0, 1000 * 10);
+				break;
+			case CASE_SERVICE_QUERY_AGGR_BATCH_SIZE:
+				c->query_aggr_bsize = cfg_u32(&line, 1, UINT32_MAX);
+				break;
 			case CASE_SERVICE_QUERY_BATCH_SIZE:
 				c->query_bsize = cfg_int_no_checks(&line);
 				break;
@@ -2068,6 +2551,9 @@ as_config_init(const char *config_file)
 			case CASE_SERVICE_QUERY_LONG_Q_MAX_SIZE:
 				c->query_long_q_max_size = cfg_u32(&line, 1, UINT32_MAX);
 				break;
+			case CASE_SERVICE_QUERY_MAX_RECORDS_PER_SEC:
+				c->query_max_records_per_sec = cfg_u32_no_checks(&line);
+				break;
 			case CASE_SERVICE_QUERY_PRE_RESERVE_PARTITIONS:
 				c->partitions_pre_reserved = cfg_bool(&line);
 				break;
@@ -2089,6 +2575,12 @@ as_config_init(const char *config_file)
 			case CASE_SERVICE_QUERY_SHORT_Q_MAX_SIZE:
 				c->query_short_q_max_size = cfg_u32(&line, 1, UINT32_MAX);
 				break;
+			case CASE_SERVICE_QUERY_THREAD_CPUS:
+				cfg_thread_cpus(&line, &c->thread_sched[AS_SCHED_POOL_QUERY]);
+				break;
+			case CASE_SERVICE_QUERY_THREAD_SCHED:
+				cfg_thread_sched(&line, &c->thread_sched[AS_SCHED_POOL_QUERY]);
+				break;
 			case CASE_SERVICE_QUERY_THREADS:
 				c->query_threads = cfg_u32(&line, 1, AS_QUERY_MAX_THREADS);
 				break;
@@ -2101,30 +2593,72 @@ as_config_init(const char *config_file)
 			case CASE_SERVICE_QUERY_WORKER_THREADS:
 				c->query_worker_threads = cfg_u32(&line, 1, AS_QUERY_MAX_WORKER_THREADS);
 				break;
+			case CASE_SERVICE_RACK_ID:
+				c->rack_id = cfg_u32_no_checks(&line);
+				break;
+			case CASE_SERVICE_RECORD_LOCKS:
+				c->n_record_locks = cfg_u32_power_of_2(&line, 1, OLOCK_MAX_LOCKS);
+				break;
+			case CASE_SERVICE_RECORD_LOCKS_ADAPTIVE:
+				c->record_locks_adaptive = cfg_bool(&line);
+				break;
+			case CASE_SERVICE_REPLICA_WRITE_BATCH_US:
+				c->replica_write_batch_us = cfg_u32(&line, 0, 1000 * 10);
+				break;
 			case CASE_SERVICE_RESPOND_CLIENT_ON_MASTER_COMPLETION:
 				c->respond_client_on_master_completion = cfg_bool(&line);
 				break;
 			case CASE_SERVICE_RUN_AS_DAEMON:
 				c->run_as_daemon = cfg_bool_no_value_is_true(&line);
 				break;
+			case CASE_SERVICE_RUN_TO_COMPLETION:
+				c->run_to_completion = cfg_bool(&line);
+				break;
 			case CASE_SERVICE_SCAN_MAX_ACTIVE:
 				c->scan_max_active = cfg_u32(&line, 0, 200);
 				break;
 			case CASE_SERVICE_SCAN_MAX_DONE:
 				c->scan_max_done = cfg_u32(&line, 0, 1000);
 				break;
+			case CASE_SERVICE_SCAN_MAX_RECORDS_PER_SEC:
+				c->scan_max_records_per_sec = cfg_u32_no_checks(&line);
+				break;
+			case CASE_SERVICE_SCAN_MAX_RECORDS_PER_SEC_PER_JOB:
+				c->scan_max_records_per_sec_per_job = cfg_u32_no_checks(&line);
+				break;
+			case CASE_SERVICE_SCAN_MAX_THREADS_PER_JOB:
+				c->scan_max_threads_per_job = cfg_u32(&line, 0, 32);
+				break;
 			case CASE_SERVICE_SCAN_MAX_UDF_TRANSACTIONS:
 				c->scan_max_udf_transactions = cfg_u32_no_checks(&line);
 				break;
+			case CASE_SERVICE_SCAN_THREAD_CPUS:
+				cfg_thread_cpus(&line, &c->thread_sched[AS_SCHED_POOL_SCAN]);
+				break;
+			case CASE_SERVICE_SCAN_THREAD_SCHED:
+				cfg_thread_sched(&line, &c->thread_sched[AS_SCHED_POOL_SCAN]);
+				break;
 			case CASE_SERVICE_SCAN_THREADS:
 				c->scan_threads = cfg_u32(&line, 0, 32);
 				break;
+			case CASE_SERVICE_SERVICE_LISTENER_PER_THREAD:
+				c->service_listener_per_thread = cfg_bool(&line);
+				break;
+			case CASE_SERVICE_SERVICE_THREAD_CPUS:
+				c->n_service_thread_cpus = cfg_cpu_list(&line, c->service_thread_cpus, MAX_DEMARSHAL_THREADS);
+				break;
+			case CASE_SERVICE_SERVICE_THREAD_SCHED:
+				cfg_thread_sched(&line, &c->thread_sched[AS_SCHED_POOL_SERVICE]);
+				break;
 			case CASE_SERVICE_SINDEX_BUILDER_THREADS:
 				c->sindex_builder_threads = cfg_u32(&line, 1, MAX_SINDEX_BUILDER_THREADS);
 				break;
 			case CASE_SERVICE_SINDEX_DATA_MAX_MEMORY:
 				c->sindex_data_max_memory = cfg_u64_no_checks(&line);
 				break;
+			case CASE_SERVICE_STORAGE_TRACE_DIRECTORY:
+				c->storage_trace_directory = cfg_strdup_no_checks(&line);
+				break;
 			case CASE_SERVICE_TICKER_INTERVAL:
 				c->ticker_interval = cfg_u32_no_checks(&line);
 				break;
@@ -2140,6 +2674,18 @@ as_config_init(const char *config_file)
 			case CASE_SERVICE_TRANSACTION_RETRY_MS:
 				c->transaction_retry_ms = cfg_u32_no_checks(&line);
 				break;
+			case CASE_SERVICE_TRANSACTION_THREAD_CPUS:
+				cfg_thread_cpus(&line, &c->thread_sched[AS_SCHED_POOL_TRANSACTION]);
+				break;
+			case CASE_SERVICE_TRANSACTION_THREAD_SCHED:
+				cfg_thread_sched(&line, &c->thread_sched[AS_SCHED_POOL_TRANSACTION]);
+				break;
+			case CASE_SERVICE_TRANSACTION_THREADS_ADAPTIVE:
+				c->transaction_threads_adaptive = cfg_bool(&line);
+				break;
+			case CASE_SERVICE_UDF_RUNTIME_MAX_MEMORY:
+				c->udf_runtime_max_memory = cfg_u64_no_checks(&line);
+				break;
 			case CASE_SERVICE_USE_QUEUE_PER_DEVICE:
 				c->use_queue_per_device = cfg_bool(&line);
 				break;
@@ -2149,6 +2695,12 @@ as_config_init(const char *config_file)
 			case CASE_SERVICE_WRITE_DUPLICATE_RESOLUTION_DISABLE:
 				c->write_duplicate_resolution_disable = cfg_bool(&line);
 				break;
+			case CASE_SERVICE_WRITE_THREAD_CPUS:
+				cfg_thread_cpus(&line, &c->thread_sched[AS_SCHED_POOL_WRITE]);
+				break;
+			case CASE_SERVICE_WRITE_THREAD_SCHED:
+				cfg_thread_sched(&line, &c->thread_sched[AS_SCHED_POOL_WRITE]);
+				break;
 			case CASE_SERVICE_ASMALLOC_ENABLED:
 				c->asmalloc_enabled = cfg_bool(&line);
 				break;
@@ -2165,6 +2717,9 @@ as_config_init(const char *config_file)
 			case CASE_SERVICE_PROLE_EXTRA_TTL:
 				c->prole_extra_ttl = cfg_u32_no_checks(&line);
 				break;
+			case CASE_SERVICE_NON_MASTER_GC_RPS:
+				c->non_master_gc_rps = cfg_u32_no_checks(&line);
+				break;
 			case CASE_SERVICE_AUTO_DUN:
 			case CASE_SERVICE_AUTO_UNDUN:
 			case CASE_SERVICE_BATCH_RETRANSMIT:
@@ -2193,7 +2748,6 @@ as_config_init(const char *config_file)
 			case CASE_SERVICE_NSUP_QUEUE_LWM:
 			case CASE_SERVICE_NSUP_REDUCE_PRIORITY:
 			case CASE_SERVICE_NSUP_REDUCE_SLEEP:
-			case CASE_SERVICE_NSUP_THREADS:
 			case CASE_SERVICE_REPLICATION_FIRE_AND_FORGET:
 			case CASE_SERVICE_SCAN_MEMORY:
 			case CASE_SERVICE_SCAN_PRIORITY:
@@ -2203,7 +2757,6 @@ as_config_init(const char *config_file)
 			case CASE_SERVICE_TRANSACTION_DUPLICATE_THREADS:
 			case CASE_SERVICE_TRIAL_ACCOUNT_KEY:
 			case CASE_SERVICE_UDF_RUNTIME_MAX_GMEMORY:
-			case CASE_SERVICE_UDF_RUNTIME_MAX_MEMORY:
 				cfg_deprecated_name_tok(&line);
 				break;
 			case CASE_CONTEXT_END:
@@ -2393,6 +2946,9 @@ as_config_init(const char *config_file)
 			case CASE_NETWORK_HEARTBEAT_TIMEOUT:
 				c->hb_config.hb_max_intervals_missed = cfg_u32_no_checks(&line);
 				break;
+			case CASE_NETWORK_HEARTBEAT_COMPACT_PAYLOADS:
+				c->hb_config.compact_payloads = cfg_bool(&line);
+				break;
 			case CASE_NETWORK_HEARTBEAT_FABRIC_GRACE_FACTOR:
 				c->hb_config.hb_fabric_grace_factor = cfg_int_no_checks(&line);
 		 		break;
@@ -2461,6 +3017,33 @@ as_config_init(const char *config_file)
 			case CASE_NETWORK_FABRIC_LATENCY_MAX_MS:
 				c->fabric_latency_max_ms = cfg_int(&line, 0, 1000);
 				break;
+			case CASE_NETWORK_FABRIC_CHANNEL_BULK_FDS:
+				c->fabric_channel_fds[AS_FABRIC_CHANNEL_BULK] = cfg_int(&line, 1, FABRIC_MAX_FDS - 1);
+				break;
+			case CASE_NETWORK_FABRIC_CHANNEL_BULK_SEND_BUF:
+				c->fabric_channel_send_buf[AS_FABRIC_CHANNEL_BULK] = cfg_int(&line, 0, 1024 * 1024 * 64);
+				break;
+			case CASE_NETWORK_FABRIC_CHANNEL_BULK_WORKERS:
+				c->fabric_channel_workers[AS_FABRIC_CHANNEL_BULK] = cfg_int(&line, 0, MAX_FABRIC_CHANNEL_WORKERS);
+				break;
+			case CASE_NETWORK_FABRIC_CHANNEL_CTRL_FDS:
+				c->fabric_channel_fds[AS_FABRIC_CHANNEL_CTRL] = cfg_int(&line, 1, FABRIC_MAX_FDS - 1);
+				break;
+			case CASE_NETWORK_FABRIC_CHANNEL_CTRL_SEND_BUF:
+				c->fabric_channel_send_buf[AS_FABRIC_CHANNEL_CTRL] = cfg_int(&line, 0, 1024 * 1024 * 64);
+				break;
+			case CASE_NETWORK_FABRIC_CHANNEL_CTRL_WORKERS:
+				c->fabric_channel_workers[AS_FABRIC_CHANNEL_CTRL] = cfg_int(&line, 0, MAX_FABRIC_CHANNEL_WORKERS);
+				break;
+			case CASE_NETWORK_FABRIC_CHANNEL_RW_FDS:
+				c->fabric_channel_fds[AS_FABRIC_CHANNEL_RW] = cfg_int(&line, 1, FABRIC_MAX_FDS - 1);
+				break;
+			case CASE_NETWORK_FABRIC_CHANNEL_RW_SEND_BUF:
+				c->fabric_channel_send_buf[AS_FABRIC_CHANNEL_RW] = cfg_int(&line, 0, 1024 * 1024 * 64);
+				break;
+			case CASE_NETWORK_FABRIC_CHANNEL_RW_WORKERS:
+				c->fabric_channel_workers[AS_FABRIC_CHANNEL_RW] = cfg_int(&line, 0, MAX_FABRIC_CHANNEL_WORKERS);
+				break;
 			case CASE_CONTEXT_END:
 				cfg_end_context(&state);
 				break;
@@ -2482,6 +3065,9 @@ as_config_init(const char *config_file)
 			case CASE_NETWORK_INFO_PORT:
 				c->info_port = cfg_port(&line);
 				break;
+			case CASE_NETWORK_INFO_METRICS_PORT:
+				c->metrics_port = cfg_port(&line);
+				break;
 			case CASE_NETWORK_INFO_ENABLE_FASTPATH:
 				cfg_deprecated_name_tok(&line);
 				break;
@@ -2570,6 +3156,15 @@ as_config_init(const char *config_file)
 					cfg_not_supported(&line, "XDR");
 				}
 				break;
+			case CASE_NAMESPACE_ASYNC_REPLICATION:
+				ns->async_replication = cfg_bool(&line);
+				break;
+			case CASE_NAMESPACE_ASYNC_REPLICATION_MAX_LAG:
+				ns->async_replication_max_lag = cfg_u64(&line, 1024 * 1024, UINT64_MAX);
+				break;
+			case CASE_NAMESPACE_BIN_SPACE_SLABS:
+				ns->bin_space_slabs = cfg_bool(&line);
+				break;
 			case CASE_NAMESPACE_COLD_START_EVICT_TTL:
 				ns->cold_start_evict_ttl = cfg_u32_no_checks(&line);
 				break;
@@ -2614,18 +3209,56 @@ as_config_init(const char *config_file)
 			case CASE_NAMESPACE_ENABLE_HIST_PROXY:
 				ns->proxy_hist_enabled = cfg_bool(&line);
 				break;
+			case CASE_NAMESPACE_ENABLE_HIST_STAGES:
+				ns->stage_hist_enabled = cfg_bool(&line);
+				break;
+			case CASE_NAMESPACE_EVICT_CONTINUOUS:
+				ns->evict_continuous = cfg_bool(&line);
+				break;
 			case CASE_NAMESPACE_EVICT_HIST_BUCKETS:
 				ns->evict_hist_buckets = cfg_u32(&line, 100, 10000000);
 				break;
 			case CASE_NAMESPACE_EVICT_TENTHS_PCT:
 				ns->evict_tenths_pct = cfg_u32_no_checks(&line);
 				break;
+			case CASE_NAMESPACE_EXPIRATION_INDEX:
+				ns->expiration_index = cfg_bool(&line);
+				break;
 			case CASE_NAMESPACE_HIGH_WATER_DISK_PCT:
 				ns->hwm_disk = (float)cfg_pct_fraction(&line);
 				break;
 			case CASE_NAMESPACE_HIGH_WATER_MEMORY_PCT:
 				ns->hwm_memory = (float)cfg_pct_fraction(&line);
 				break;
+			case CASE_NAMESPACE_INCREMENTAL_HISTOGRAMS:
+				ns->incremental_histograms = cfg_bool(&line);
+				break;
+			case CASE_NAMESPACE_INDEX_FLASH_PATH:
+				ns->index_flash_path = cfg_strdup_no_checks(&line);
+				break;
+			case CASE_NAMESPACE_INDEX_NUMA_POLICY:
+				switch(cfg_find_tok(line.val_tok_1, NAMESPACE_INDEX_NUMA_POLICY_OPTS, NUM_NAMESPACE_INDEX_NUMA_POLICY_OPTS)) {
+				case CASE_NAMESPACE_INDEX_NUMA_POLICY_INTERLEAVE:
+					ns->index_numa_policy = AS_INDEX_NUMA_POLICY_INTERLEAVE;
+					break;
+				case CASE_NAMESPACE_INDEX_NUMA_POLICY_NONE:
+					ns->index_numa_policy = AS_INDEX_NUMA_POLICY_NONE;
+					break;
+				case CASE_NOT_FOUND:
+				default:
+					cfg_unknown_val_tok_1(&line);
+					break;
+				}
+				break;
+			case CASE_NAMESPACE_INDEX_PAGE_SIZE:
+				ns->index_page_size = cfg_u64_no_checks(&line);
+				if (ns->index_page_size != 4 * 1024 &&
+						ns->index_page_size != 2 * 1024 * 1024 &&
+						ns->index_page_size != 1024 * 1024 * 1024) {
+					cf_crash_nostack(AS_CFG, "line %d :: %s must be 4K, 2M or 1G, not %s",
+							line.num, line.name_tok, line.val_tok_1);
+				}
+				break;
 			case CASE_NAMESPACE_LDT_ENABLED:
 				ns->ldt_enabled = cfg_bool(&line);
 				break;
@@ -2638,15 +3271,48 @@ as_config_init(const char *config_file)
 			case CASE_NAMESPACE_MAX_TTL:
 				ns->max_ttl = cfg_seconds(&line, 1, MAX_ALLOWED_TTL);
 				break;
+			case CASE_NAMESPACE_MEMORY_SNAPSHOT_DIR:
+				ns->memory_snapshot_dir = cfg_strdup_no_checks(&line);
+				break;
+			case CASE_NAMESPACE_MEMORY_SNAPSHOT_MAX_WRITE_RATE:
+				ns->memory_snapshot_max_write_rate = cfg_u64_no_checks(&line);
+				break;
+			case CASE_NAMESPACE_MEMORY_SNAPSHOT_PERIOD:
+				ns->memory_snapshot_period = cfg_seconds_no_checks(&line);
+				break;
+			case CASE_NAMESPACE_MEMORY_SNAPSHOT_THREADS:
+				ns->memory_snapshot_threads = cfg_u32(&line, 1, 128);
+				break;
+			case CASE_NAMESPACE_MIGRATE_CHANGELOG_ENTRIES:
+				ns->migrate_changelog_entries = cfg_u32_no_checks(&line);
+				break;
+			case CASE_NAMESPACE_MIGRATE_CHANGELOG_MAX_AGE:
+				ns->migrate_changelog_max_age = cfg_u32_no_checks(&line);
+				break;
+			case CASE_NAMESPACE_MIGRATE_COMPRESSION:
+				ns->migrate_compression = cfg_bool(&line);
+				break;
+			case CASE_NAMESPACE_MIGRATE_DELTA:
+				ns->migrate_delta = cfg_bool(&line);
+				break;
 			case CASE_NAMESPACE_MIGRATE_ORDER:
 				ns->migrate_order = cfg_u32(&line, 1, 10);
 				break;
 			case CASE_NAMESPACE_MIGRATE_SLEEP:
 				ns->migrate_sleep = cfg_u32_no_checks(&line);
 				break;
+			case CASE_NAMESPACE_NSUP_PERIOD:
+				ns->nsup_period = cfg_u32_no_checks(&line);
+				break;
 			case CASE_NAMESPACE_OBJ_SIZE_HIST_MAX:
 				ns->obj_size_hist_max = cfg_obj_size_hist_max(cfg_u32_no_checks(&line));
 				break;
+			case CASE_NAMESPACE_PARTITION_TREE_SPRIGS:
+				ns->tree_sprigs = cfg_u32_power_of_2(&line, 1, AS_INDEX_MAX_SPRIGS);
+				break;
+			case CASE_NAMESPACE_READ_COALESCING:
+				ns->read_coalescing = cfg_bool(&line);
+				break;
 			case CASE_NAMESPACE_READ_CONSISTENCY_LEVEL_OVERRIDE:
 				switch(cfg_find_tok(line.val_tok_1, NAMESPACE_READ_CONSISTENCY_OPTS, NUM_NAMESPACE_READ_CONSISTENCY_OPTS)) {
 				case CASE_NAMESPACE_READ_CONSISTENCY_ALL:
@@ -2689,6 +3355,9 @@ as_config_init(const char *config_file)
 			case CASE_NAMESPACE_STOP_WRITES_PCT:
 				ns->stop_writes_pct = (float)cfg_pct_fraction(&line);
 				break;
+			case CASE_NAMESPACE_TRANSACTION_QUEUES:
+				ns->transaction_queues = cfg_u32(&line, 0, MAX_TRANSACTION_QUEUES);
+				break;
 			case CASE_NAMESPACE_WRITE_COMMIT_LEVEL_OVERRIDE:
 				switch(cfg_find_tok(line.val_tok_1, NAMESPACE_WRITE_COMMIT_OPTS, NUM_NAMESPACE_WRITE_COMMIT_OPTS)) {
 				case CASE_NAMESPACE_WRITE_COMMIT_ALL:
@@ -2722,9 +3391,15 @@ as_config_init(const char *config_file)
 				if (ns->ldt_enabled && ns->single_bin) {
 					cf_crash_nostack(AS_CFG, "ns %s ldt-enabled and single-bin can't both be true", ns->name);
 				}
+				if (ns->bin_space_slabs && (ns->single_bin || ! ns->storage_data_in_memory)) {
+					cf_crash_nostack(AS_CFG, "ns %s bin-space-slabs can't be true unless data-in-memory is true and single-bin is false", ns->name);
+				}
 				if (ns->default_ttl > ns->max_ttl) {
 					cf_crash_nostack(AS_CFG, "ns %s default-ttl can't be > max-ttl", ns->name);
 				}
+				if (ns->memory_snapshot_dir && (ns->storage_type != AS_STORAGE_ENGINE_MEMORY || ns->ldt_enabled)) {
+					cf_crash_nostack(AS_CFG, "ns %s memory-snapshot-dir can't be set unless storage-engine is memory and ldt-enabled is false", ns->name);
+				}
 				if (ns->storage_data_in_memory) {
 					ns->storage_post_write_queue = 0; // override default (or configuration mistake)
 					c->n_namespaces_in_memory++;
@@ -2774,6 +3449,12 @@ as_config_init(const char *config_file)
 			case CASE_NAMESPACE_STORAGE_DEVICE_COLD_START_EMPTY:
 				ns->storage_cold_start_empty = cfg_bool(&line);
 				break;
+			case CASE_NAMESPACE_STORAGE_DEVICE_COLD_START_THREADS:
+				ns->storage_cold_start_threads = cfg_u32(&line, 1, 128);
+				break;
+			case CASE_NAMESPACE_STORAGE_DEVICE_DEFRAG_LIVE_MAP:
+				ns->storage_defrag_live_map = cfg_bool(&line);
+				break;
 			case CASE_NAMESPACE_STORAGE_DEVICE_DEFRAG_LWM_PCT:
 				ns->storage_defrag_lwm_pct = cfg_u32_no_checks(&line);
 				break;
@@ -2783,6 +3464,9 @@ as_config_init(const char *config_file)
 			case CASE_NAMESPACE_STORAGE_DEVICE_DEFRAG_SLEEP:
 				ns->storage_defrag_sleep = cfg_u32_no_checks(&line);
 				break;
+			case CASE_NAMESPACE_STORAGE_DEVICE_DEFRAG_ADAPTIVE:
+				ns->storage_defrag_adaptive = cfg_bool(&line);
+				break;
 			case CASE_NAMESPACE_STORAGE_DEVICE_DEFRAG_STARTUP_MINIMUM:
 				ns->storage_defrag_startup_minimum = cfg_int(&line, 1, 99);
 				break;
@@ -2792,12 +3476,18 @@ as_config_init(const char *config_file)
 			case CASE_NAMESPACE_STORAGE_DEVICE_ENABLE_OSYNC:
 				ns->storage_enable_osync = cfg_bool(&line);
 				break;
+			case CASE_NAMESPACE_STORAGE_DEVICE_FAST_RESTART:
+				ns->storage_fast_restart = cfg_bool(&line);
+				break;
 			case CASE_NAMESPACE_STORAGE_DEVICE_FLUSH_MAX_MS:
 				ns->storage_flush_max_us = cfg_u64_no_checks(&line) * 1000;
 				break;
 			case CASE_NAMESPACE_STORAGE_DEVICE_FSYNC_MAX_SEC:
 				ns->storage_fsync_max_us = cfg_u64_no_checks(&line) * 1000000;
 				break;
+			case CASE_NAMESPACE_STORAGE_DEVICE_MAX_FLUSH_SIZE:
+				ns->storage_max_flush_size = cfg_u32_no_checks(&line);
+				break;
 			case CASE_NAMESPACE_STORAGE_DEVICE_MAX_WRITE_CACHE:
 				ns->storage_max_write_cache = cfg_u64_no_checks(&line);
 				break;
@@ -2807,9 +3497,70 @@ as_config_init(const char *config_file)
 			case CASE_NAMESPACE_STORAGE_DEVICE_POST_WRITE_QUEUE:
 				ns->storage_post_write_queue = cfg_u32(&line, 0, 2 * 1024);
 				break;
+			case CASE_NAMESPACE_STORAGE_DEVICE_READ_CACHE_SIZE:
+				ns->storage_read_cache_size = cfg_u64_no_checks(&line);
+				break;
+			case CASE_NAMESPACE_STORAGE_DEVICE_LDT_SUBREC_CACHE_SIZE:
+				ns->storage_ldt_subrec_cache_size = cfg_u64_no_checks(&line);
+				break;
+			case CASE_NAMESPACE_STORAGE_DEVICE_SHADOW_MAX_WRITE_CACHE:
+				ns->storage_shadow_max_write_cache = cfg_u64_no_checks(&line);
+				break;
+			case CASE_NAMESPACE_STORAGE_DEVICE_SHADOW_STOP_WRITES_ON_LAG:
+				ns->storage_shadow_stop_writes_on_lag = cfg_bool(&line);
+				break;
+			case CASE_NAMESPACE_STORAGE_DEVICE_SHADOW_WRITE_THREADS:
+				ns->storage_shadow_write_threads = cfg_u32_no_checks(&line);
+				break;
 			case CASE_NAMESPACE_STORAGE_DEVICE_WRITE_THREADS:
 				ns->storage_write_threads = cfg_u32_no_checks(&line);
 				break;
+			case CASE_NAMESPACE_STORAGE_DEVICE_COMPRESSION:
+				switch(cfg_find_tok(line.val_tok_1, NAMESPACE_STORAGE_COMPRESSION_OPTS, NUM_NAMESPACE_STORAGE_COMPRESSION_OPTS)) {
+				case CASE_NAMESPACE_STORAGE_COMPRESSION_NONE:
+					ns->storage_compression = AS_STORAGE_COMPRESSION_NONE;
+					break;
+				case CASE_NAMESPACE_STORAGE_COMPRESSION_ZLIB:
+					ns->storage_compression = AS_STORAGE_COMPRESSION_ZLIB;
+					break;
+				case CASE_NAMESPACE_STORAGE_COMPRESSION_LZ4:
+#if defined(USE_LZ4)
+					ns->storage_compression = AS_STORAGE_COMPRESSION_LZ4;
+#else
+					cfg_not_supported(&line, "LZ4");
+#endif
+					break;
+				case CASE_NAMESPACE_STORAGE_COMPRESSION_ZSTD:
+#if defined(USE_ZSTD)
+					ns->storage_compression = AS_STORAGE_COMPRESSION_ZSTD;
+#else
+					cfg_not_supported(&line, "zstd");
+#endif
+					break;
+				case CASE_NOT_FOUND:
+				default:
+					cfg_unknown_val_tok_1(&line);
+					break;
+				}
+				break;
+			case CASE_NAMESPACE_STORAGE_DEVICE_COMPRESSION_LEVEL:
+				ns->storage_compression_level = cfg_u32(&line, 1, 9);
+				break;
+			case CASE_NAMESPACE_STORAGE_DEVICE_PERSIST_MAP_INDEXES:
+				ns->storage_persist_map_indexes = cfg_bool(&line);
+				break;
+			case CASE_NAMESPACE_STORAGE_DEVICE_TOUCH_INDEX_ONLY:
+				ns->storage_touch_index_only = cfg_bool(&line);
+				break;
+			case CASE_NAMESPACE_STORAGE_DEVICE_TTL_WRITE_STREAMS:
+				ns->storage_ttl_write_streams = cfg_u32(&line, 1, 4);
+				break;
+			case CASE_NAMESPACE_STORAGE_DEVICE_WEIGHTED_PLACEMENT:
+				ns->storage_weighted_placement = cfg_bool(&line);
+				break;
+			case CASE_NAMESPACE_STORAGE_DEVICE_WBLOCK_SUMMARIES:
+				ns->storage_wblock_summaries = cfg_bool(&line);
+				break;
 			case CASE_NAMESPACE_STORAGE_DEVICE_DEFRAG_MAX_BLOCKS:
 			case CASE_NAMESPACE_STORAGE_DEVICE_DEFRAG_PERIOD:
 			case CASE_NAMESPACE_STORAGE_DEVICE_LOAD_AT_STARTUP:
@@ -2870,6 +3621,9 @@ as_config_init(const char *config_file)
 			case CASE_NAMESPACE_SET_DISABLE_EVICTION:
 				DISABLE_SET_EVICTION(p_set, cfg_bool(&line));
 				break;
+			case CASE_NAMESPACE_SET_DISK_QUOTA:
+				p_set->disk_quota = cfg_u64_no_checks(&line);
+				break;
 			case CASE_NAMESPACE_SET_ENABLE_XDR:
 				switch(cfg_find_tok(line.val_tok_1, NAMESPACE_SET_ENABLE_XDR_OPTS, NUM_NAMESPACE_SET_ENABLE_XDR_OPTS)) {
 				case CASE_NAMESPACE_SET_ENABLE_XDR_USE_DEFAULT:
@@ -2887,6 +3641,18 @@ as_config_init(const char *config_file)
 					break;
 				}
 				break;
+			case CASE_NAMESPACE_SET_EVICT_PRIORITY:
+				p_set->evict_priority = cfg_u32_no_checks(&line);
+				break;
+			case CASE_NAMESPACE_SET_INDEX:
+				if (cfg_bool(&line)) {
+					p_set->set_index = 1;
+					ns->set_index = true;
+				}
+				break;
+			case CASE_NAMESPACE_SET_MEMORY_QUOTA:
+				p_set->memory_quota = cfg_u64_no_checks(&line);
+				break;
 			case CASE_NAMESPACE_SET_STOP_WRITES_COUNT:
 				p_set->stop_writes_count = cfg_u64_no_checks(&line);
 				break;
@@ -2917,6 +3683,9 @@ as_config_init(const char *config_file)
 			case CASE_NAMESPACE_SI_GC_MAX_UNITS:
 				si_cfg.defrag_max_units = cfg_u32_no_checks(&line);
 				break;
+			case CASE_NAMESPACE_SI_GC_MAX_RATE:
+				si_cfg.defrag_max_rate = cfg_u32_no_checks(&line);
+				break;
 			case CASE_NAMESPACE_SI_DATA_MAX_MEMORY:
 				si_cfg.data_max_memory = cfg_u64_no_checks(&line);
 				break;
@@ -2951,6 +3720,9 @@ as_config_init(const char *config_file)
 				// FIXME - minimum should be 1, but currently crashes.
 				ns->sindex_num_partitions = cfg_u32(&line, MIN_PARTITIONS_PER_INDEX, MAX_PARTITIONS_PER_INDEX);
 				break;
+			case CASE_NAMESPACE_SINDEX_SNAPSHOT_FILE:
+				ns->sindex_snapshot_file = cfg_strdup_no_checks(&line);
+				break;
 			case CASE_CONTEXT_END:
 				cfg_end_context(&state);
 				break;
@@ -3002,6 +3774,14 @@ as_config_init(const char *config_file)
 			// Just skip over the XDR section and its DC subsection. XDR config
 			// parser will pick up XDR configuration.
 			// TODO - config parsing should be unified.
+			// Except for the digest log, which the server can run by itself.
+			case XDR_CASE_ENABLE_XDR:
+				c->xdr_dlog_enabled = cfg_bool(&line);
+				break;
+			case XDR_CASE_DIGESTLOG_PATH:
+				c->xdr_dlog_path = cfg_strdup_no_checks(&line);
+				c->xdr_dlog_size = cfg_u64_val2_no_checks(&line);
+				break;
 			case XDR_CASE_DATACENTER_BEGIN:
 				cfg_begin_context(&state, XDR_DATACENTER);
 				break;
@@ -3048,6 +3828,18 @@ as_config_init(const char *config_file)
 			case CASE_MOD_LUA_USER_PATH:
 				cfg_strcpy(&line, c->mod_lua.user_path, sizeof(c->mod_lua.user_path));
 				break;
+			case CASE_MOD_LUA_NATIVE_PATH:
+				cfg_strcpy(&line, c->udf_native_path, sizeof(c->udf_native_path));
+				break;
+			case CASE_MOD_LUA_RESULT_CACHE_MODULE:
+				if (c->n_udf_result_cache_modules == MAX_UDF_RESULT_CACHE_MODULES) {
+					cf_crash_nostack(AS_CFG, "can't configure more than %d result-cache-module entries", MAX_UDF_RESULT_CACHE_MODULES);
+				}
+				cfg_strcpy(&line, c->udf_result_cache_modules[c->n_udf_result_cache_modules++], sizeof(c->udf_result_cache_modules[0]));
+				break;
+			case CASE_MOD_LUA_RESULT_CACHE_SIZE:
+				c->udf_result_cache_size = cfg_u32(&line, 0, 16 * 1024 * 1024);
+				break;
 			case CASE_CONTEXT_END:
 				cfg_end_context(&state);
 				break;
@@ -3289,9 +4081,26 @@ as_config_post_process(as_config *c, const char *config_file)
 
 	cf_info(AS_CFG, "system file descriptor limit: %lu, proto-fd-max: %d", fd_limit.rlim_cur, c->n_proto_fd_max);
 
-	// Allocate and initialize the record locks (olocks). Maybe not the best
-	// place for this, unless we make number of locks configurable.
-	g_record_locks = olock_create(16 * 1024, true);
+	// Allocate and initialize the record locks (olocks). Unless configured,
+	// scale the number of locks with the number of CPUs, to keep unrelated
+	// hot keys from sharing locks.
+	if (c->n_record_locks == 0) {
+		long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		uint32_t n_locks = RECORD_LOCKS_MIN;
+
+		while (n_locks < OLOCK_MAX_LOCKS &&
+				n_locks < (uint64_t)n_cpus * RECORD_LOCKS_PER_CPU) {
+			n_locks <<= 1;
+		}
+
+		c->n_record_locks = n_locks;
+	}
+
+	if (! (g_record_locks = olock_create(c->n_record_locks, c->record_locks_adaptive))) {
+		cf_crash(AS_CFG, "failed to create %u record locks", c->n_record_locks);
+	}
+
+	cf_info(AS_CFG, "record locks: %u%s", c->n_record_locks, c->record_locks_adaptive ? " (adaptive)" : "");
 
 	// Setup performance metrics histograms.
 	cfg_create_all_histograms();
@@ -3417,6 +4226,13 @@ as_config_post_process(as_config *c, const char *config_file)
 		sprintf(hist_name, "{%s}-query", ns->name);
 		create_and_check_hist_track(&ns->query_hist, hist_name, HIST_MILLISECONDS);
 
+		if (g_config.hist_track_precision != 0) {
+			cf_hist_track_enable_percentiles(ns->read_hist, g_config.hist_track_precision);
+			cf_hist_track_enable_percentiles(ns->write_hist, g_config.hist_track_precision);
+			cf_hist_track_enable_percentiles(ns->udf_hist, g_config.hist_track_precision);
+			cf_hist_track_enable_percentiles(ns->query_hist, g_config.hist_track_precision);
+		}
+
 		sprintf(hist_name, "{%s}-query-rec-count", ns->name);
 		create_and_check_hist(&ns->query_rec_count_hist, hist_name, HIST_RAW);
 
@@ -3425,6 +4241,11 @@ as_config_post_process(as_config *c, const char *config_file)
 		sprintf(hist_name, "{%s}-proxy", ns->name);
 		create_and_check_hist(&ns->proxy_hist, hist_name, HIST_MILLISECONDS);
 
+		for (int s = 0; s < AS_NUM_STAGES; s++) {
+			sprintf(hist_name, "{%s}-stage-%s", ns->name, as_stage_names[s]);
+			create_and_check_hist_track(&ns->stage_hists[s], hist_name, HIST_MILLISECONDS);
+		}
+
 		sprintf(hist_name, "{%s}-read-start", ns->name);
 		create_and_check_hist(&ns->read_start_hist, hist_name, HIST_MILLISECONDS);
 		sprintf(hist_name, "{%s}-read-restart", ns->name);
@@ -3501,6 +4322,77 @@ as_config_post_process(as_config *c, const char *config_file)
 }
 
 
+//==========================================================
+// Public API - thread pool scheduling.
+//
+
+// Call as a pool's threads are created. Failure isn't fatal - the thread just
+// keeps the default CPUs and policy.
+void
+as_config_sched_thread(as_sched_pool pool, pthread_t thread)
+{
+	if (pool == AS_SCHED_POOL_NONE) {
+		return;
+	}
+
+	const as_thread_sched* ts = &g_config.thread_sched[pool];
+
+	if (ts->n_cpus != 0) {
+		cf_thread_restrict_to_cpus(thread, ts->cpus, ts->n_cpus);
+	}
+
+	if (ts->policy != SCHED_OTHER) {
+		cf_thread_set_sched_policy(thread, ts->policy, ts->priority);
+	}
+}
+
+const char*
+as_sched_pool_str(as_sched_pool pool)
+{
+	switch (pool) {
+	case AS_SCHED_POOL_SERVICE:
+		return "service";
+	case AS_SCHED_POOL_TRANSACTION:
+		return "transaction";
+	case AS_SCHED_POOL_FABRIC:
+		return "fabric";
+	case AS_SCHED_POOL_DEFRAG:
+		return "defrag";
+	case AS_SCHED_POOL_WRITE:
+		return "write";
+	case AS_SCHED_POOL_NSUP:
+		return "nsup";
+	case AS_SCHED_POOL_SCAN:
+		return "scan";
+	case AS_SCHED_POOL_QUERY:
+		return "query";
+	case AS_SCHED_POOL_BATCH:
+		return "batch";
+	default:
+		return "?";
+	}
+}
+
+const char*
+as_sched_policy_str(int policy)
+{
+	switch (policy) {
+	case SCHED_OTHER:
+		return "other";
+	case SCHED_BATCH:
+		return "batch";
+	case SCHED_IDLE:
+		return "idle";
+	case SCHED_FIFO:
+		return "fifo";
+	case SCHED_RR:
+		return "rr";
+	default:
+		return "?";
+	}
+}
+
+
 //==========================================================
 // Public API - get/set (dynamic) members.
 //
@@ -3643,7 +4535,8 @@ void
 create_and_check_hist_track(cf_hist_track** h, const char* name,
 		histogram_scale scale)
 {
-	if (NULL == (*h = cf_hist_track_create(name, scale))) {
+	if (NULL == (*h = cf_hist_track_create(name, scale)) ||
+			! histogram_add_shards((histogram*)*h)) {
 		cf_crash(AS_AS, "couldn't create histogram: %s", name);
 	}
 
@@ -3658,7 +4551,8 @@ create_and_check_hist_track(cf_hist_track** h, const char* name,
 void
 create_and_check_hist(histogram** h, const char* name, histogram_scale scale)
 {
-	if (NULL == (*h = histogram_create(name, scale))) {
+	if (NULL == (*h = histogram_create(name, scale)) ||
+			! histogram_add_shards(*h)) {
 		cf_crash(AS_AS, "couldn't create histogram: %s", name);
 	}
 }
@@ -0,0 +1,416 @@
+/*
+ * dim_compact.c
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/* SYNOPSIS
+ * Online compaction of a data-in-memory namespace's heap. After mass deletes
+ * or evictions the namespace's JEMalloc arena is left with sparse runs that
+ * can't be returned to the OS. A rate-limited background thread visits every
+ * record under its lock and moves its particles, bin space and record space
+ * to fresh allocations that land lower - where JEMalloc packs - so the sparse
+ * runs drain, then purges the arena. Arena stats before and after are kept,
+ * as the tools/jem scripts see them.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "base/dim_compact.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "citrusleaf/cf_atomic.h"
+#include "citrusleaf/cf_clock.h"
+
+#include "dynbuf.h"
+#include "fault.h"
+#include "jem.h"
+
+#include "base/datamodel.h"
+#include "base/dim_slab.h"
+#include "base/index.h"
+#include "storage/storage.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+// Yield between partitions, so compaction stays in the background.
+#define COMPACT_PARTITION_SLEEP_us 1000
+
+// How many records between rate checks.
+#define THROTTLE_CHECK_RECORDS 64
+
+// How far ahead of the rate compaction may get before it sleeps.
+#define THROTTLE_SLACK_ms 10
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static void* run_compact(void* udata);
+static void compact_reduce_cb(as_index_ref* r_ref, void* udata);
+static void compact_record(as_namespace* ns, as_record* r);
+static void throttle(uint64_t n_records);
+static void append_arena_stats(cf_dyn_buf* db, const char* prefix, const jem_arena_stats* stats);
+
+
+//==========================================================
+// Globals.
+//
+
+static struct {
+	pthread_mutex_t		lock;
+	bool				running;
+	bool				done;
+	volatile bool		stop;
+
+	// Set up at start, read-only while running.
+	as_namespace*		ns;
+	uint32_t			records_per_sec;
+	uint64_t			start_ms;
+
+	cf_atomic32			pid; // partition being visited
+	cf_atomic64			n_records;
+	cf_atomic64			n_moved;
+	cf_atomic64			n_bytes_moved;
+
+	bool				have_stats;
+	jem_arena_stats		before;
+	jem_arena_stats		after;
+
+	// Filled in when done.
+	uint64_t			elapsed_ms;
+} g_compact = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+
+//==========================================================
+// Public API.
+//
+
+// Returns NULL on success, otherwise an error reason.
+const char*
+as_dim_compact_start(as_namespace* ns, uint32_t records_per_sec)
+{
+	if (! ns->storage_data_in_memory) {
+		return "not-data-in-memory";
+	}
+
+	pthread_mutex_lock(&g_compact.lock);
+
+	if (g_compact.running) {
+		pthread_mutex_unlock(&g_compact.lock);
+		return "already-running";
+	}
+
+	g_compact.ns = ns;
+	g_compact.records_per_sec = records_per_sec;
+	g_compact.start_ms = cf_getms();
+	g_compact.stop = false;
+	g_compact.done = false;
+	g_compact.elapsed_ms = 0;
+	cf_atomic32_set(&g_compact.pid, 0);
+	cf_atomic64_set(&g_compact.n_records, 0);
+	cf_atomic64_set(&g_compact.n_moved, 0);
+	cf_atomic64_set(&g_compact.n_bytes_moved, 0);
+
+#ifdef USE_JEM
+	g_compact.have_stats =
+			jem_get_arena_stats(ns->jem_arena, &g_compact.before) == 0;
+#else
+	g_compact.have_stats = false;
+#endif
+
+	pthread_attr_t attrs;
+	pthread_t thread;
+
+	pthread_attr_init(&attrs);
+	pthread_attr_setdetachstate(&attrs, PTHREAD_CREATE_DETACHED);
+
+	if (pthread_create(&thread, &attrs, run_compact, NULL) != 0) {
+		pthread_attr_destroy(&attrs);
+		pthread_mutex_unlock(&g_compact.lock);
+		return "failed-thread-create";
+	}
+
+	pthread_attr_destroy(&attrs);
+
+	g_compact.running = true;
+
+	pthread_mutex_unlock(&g_compact.lock);
+
+	return NULL;
+}
+
+const char*
+as_dim_compact_stop()
+{
+	pthread_mutex_lock(&g_compact.lock);
+
+	if (! g_compact.running) {
+		pthread_mutex_unlock(&g_compact.lock);
+		return "not-running";
+	}
+
+	g_compact.stop = true;
+
+	pthread_mutex_unlock(&g_compact.lock);
+
+	return NULL;
+}
+
+void
+as_dim_compact_get_info(cf_dyn_buf* db)
+{
+	pthread_mutex_lock(&g_compact.lock);
+
+	if (! g_compact.running && ! g_compact.done) {
+		cf_dyn_buf_append_string(db, "status=idle");
+		pthread_mutex_unlock(&g_compact.lock);
+		return;
+	}
+
+	cf_dyn_buf_append_string(db, g_compact.running ?
+			"status=running" : "status=done");
+	cf_dyn_buf_append_string(db, ":ns=");
+	cf_dyn_buf_append_string(db, g_compact.ns->name);
+	cf_dyn_buf_append_string(db, ":records-per-sec=");
+	cf_dyn_buf_append_uint32(db, g_compact.records_per_sec);
+	cf_dyn_buf_append_string(db, ":elapsed-ms=");
+	cf_dyn_buf_append_uint64(db, g_compact.running ?
+			cf_getms() - g_compact.start_ms : g_compact.elapsed_ms);
+
+	if (g_compact.running) {
+		cf_dyn_buf_append_string(db, ":partition=");
+		cf_dyn_buf_append_uint32(db, cf_atomic32_get(g_compact.pid));
+	}
+
+	cf_dyn_buf_append_string(db, ":records=");
+	cf_dyn_buf_append_uint64(db, cf_atomic64_get(g_compact.n_records));
+	cf_dyn_buf_append_string(db, ":moved=");
+	cf_dyn_buf_append_uint64(db, cf_atomic64_get(g_compact.n_moved));
+	cf_dyn_buf_append_string(db, ":moved-bytes=");
+	cf_dyn_buf_append_uint64(db, cf_atomic64_get(g_compact.n_bytes_moved));
+
+	if (g_compact.have_stats) {
+		append_arena_stats(db, "before", &g_compact.before);
+
+		if (g_compact.done) {
+			append_arena_stats(db, "after", &g_compact.after);
+		}
+	}
+
+	pthread_mutex_unlock(&g_compact.lock);
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+static void*
+run_compact(void* udata)
+{
+	as_namespace* ns = g_compact.ns;
+
+#ifdef USE_JEM
+	// Fresh allocations go to the namespace arena, and freed ones go straight
+	// back to their runs - a thread cache would hand them out again.
+	jem_set_arena(ns->jem_arena);
+	jem_enable_tcache(false);
+#endif
+
+	cf_info(AS_NAMESPACE, "{%s} dim compaction starting - %u records/sec",
+			ns->name, g_compact.records_per_sec);
+
+	for (uint32_t pid = 0; pid < AS_PARTITIONS && ! g_compact.stop; pid++) {
+		as_partition_reservation rsv;
+
+		AS_PARTITION_RESERVATION_INIT(rsv);
+		as_partition_reserve_migrate(ns, pid, &rsv, NULL);
+
+		cf_atomic32_set(&g_compact.pid, pid);
+		as_index_reduce(rsv.p->vp, compact_reduce_cb, (void*)ns);
+
+		as_partition_release(&rsv);
+
+		usleep(COMPACT_PARTITION_SLEEP_us);
+	}
+
+	jem_arena_stats after = { 0 };
+	bool have_stats = false;
+
+#ifdef USE_JEM
+	jem_purge_arena(ns->jem_arena);
+	jem_enable_tcache(true);
+
+	have_stats = g_compact.have_stats &&
+			jem_get_arena_stats(ns->jem_arena, &after) == 0;
+#endif
+
+	pthread_mutex_lock(&g_compact.lock);
+
+	g_compact.after = after;
+	g_compact.have_stats = have_stats;
+	g_compact.elapsed_ms = cf_getms() - g_compact.start_ms;
+	g_compact.running = false;
+	g_compact.done = true;
+
+	pthread_mutex_unlock(&g_compact.lock);
+
+	cf_info(AS_NAMESPACE, "{%s} dim compaction %s - visited %lu records, moved %lu (%lu bytes) in %lu ms",
+			ns->name, g_compact.stop ? "stopped" : "done",
+			cf_atomic64_get(g_compact.n_records),
+			cf_atomic64_get(g_compact.n_moved),
+			cf_atomic64_get(g_compact.n_bytes_moved), g_compact.elapsed_ms);
+
+	if (have_stats) {
+		cf_info(AS_NAMESPACE, "{%s} dim compaction arena active %lu -> %lu, allocated %lu -> %lu",
+				ns->name, g_compact.before.active, after.active,
+				g_compact.before.allocated, after.allocated);
+	}
+
+	return NULL;
+}
+
+static void
+compact_reduce_cb(as_index_ref* r_ref, void* udata)
+{
+	as_namespace* ns = (as_namespace*)udata;
+
+	// On stop, just run out the rest of the partition's callbacks.
+	if (! g_compact.stop) {
+		compact_record(ns, r_ref->r);
+	}
+
+	as_record_done(r_ref, ns);
+
+	// Sleep only once the record lock is released.
+	throttle(cf_atomic64_incr(&g_compact.n_records));
+}
+
+static void
+compact_record(as_namespace* ns, as_record* r)
+{
+	as_storage_rd rd;
+
+	rd.r = r;
+	rd.ns = ns;
+	rd.n_bins = as_bin_get_n_bins(r, &rd);
+	rd.bins = as_bin_get_all(r, &rd, 0);
+
+	uint64_t n_moved = 0;
+	uint64_t n_bytes_moved = 0;
+
+	for (uint16_t i = 0; i < rd.n_bins; i++) {
+		uint32_t sz = as_bin_particle_compact(&rd.bins[i]);
+
+		if (sz != 0) {
+			n_moved++;
+			n_bytes_moved += sz;
+		}
+	}
+
+	// Particle pointers are fixed up in the bins - now move the bins.
+	if (! ns->single_bin && r->dim) {
+		if (as_index_is_flag_set(r, AS_INDEX_FLAG_KEY_STORED)) {
+			as_rec_space* rec_space = (as_rec_space*)r->dim;
+			as_rec_space* new_rec_space =
+					as_dim_slab_compact_rec_space(ns, rec_space);
+
+			if (new_rec_space != rec_space) {
+				r->dim = (void*)new_rec_space;
+				n_moved++;
+				n_bytes_moved += sizeof(as_rec_space) +
+						new_rec_space->key_size;
+			}
+		}
+
+		as_bin_space* bin_space = as_index_get_bin_space(r);
+
+		if (bin_space) {
+			as_bin_space* new_bin_space =
+					as_dim_slab_compact_bin_space(ns, bin_space);
+
+			if (new_bin_space != bin_space) {
+				as_index_set_bin_space(r, new_bin_space);
+				n_moved++;
+				n_bytes_moved += sizeof(as_bin_space) +
+						(new_bin_space->n_bins * sizeof(as_bin));
+			}
+		}
+	}
+
+	if (n_moved != 0) {
+		cf_atomic64_add(&g_compact.n_moved, (int64_t)n_moved);
+		cf_atomic64_add(&g_compact.n_bytes_moved, (int64_t)n_bytes_moved);
+	}
+}
+
+static void
+throttle(uint64_t n_records)
+{
+	if (g_compact.records_per_sec == 0 ||
+			n_records % THROTTLE_CHECK_RECORDS != 0) {
+		return;
+	}
+
+	uint64_t target_ms = n_records * 1000 / g_compact.records_per_sec;
+	uint64_t elapsed_ms = cf_getms() - g_compact.start_ms;
+
+	if (target_ms > elapsed_ms + THROTTLE_SLACK_ms) {
+		usleep((useconds_t)((target_ms - elapsed_ms) * 1000));
+	}
+}
+
+static void
+append_arena_stats(cf_dyn_buf* db, const char* prefix,
+		const jem_arena_stats* stats)
+{
+	cf_dyn_buf_append_char(db, ':');
+	cf_dyn_buf_append_string(db, prefix);
+	cf_dyn_buf_append_string(db, "-allocated-bytes=");
+	cf_dyn_buf_append_uint64(db, stats->allocated);
+	cf_dyn_buf_append_char(db, ':');
+	cf_dyn_buf_append_string(db, prefix);
+	cf_dyn_buf_append_string(db, "-active-bytes=");
+	cf_dyn_buf_append_uint64(db, stats->active);
+	cf_dyn_buf_append_char(db, ':');
+	cf_dyn_buf_append_string(db, prefix);
+	cf_dyn_buf_append_string(db, "-dirty-bytes=");
+	cf_dyn_buf_append_uint64(db, stats->dirty);
+	cf_dyn_buf_append_char(db, ':');
+	cf_dyn_buf_append_string(db, prefix);
+	cf_dyn_buf_append_string(db, "-mapped-bytes=");
+	cf_dyn_buf_append_uint64(db, stats->mapped);
+	cf_dyn_buf_append_char(db, ':');
+	cf_dyn_buf_append_string(db, prefix);
+	cf_dyn_buf_append_string(db, "-fragmentation-pct=");
+	cf_dyn_buf_append_uint64(db, stats->active <= stats->allocated ? 0 :
+			(stats->active - stats->allocated) * 100 / stats->active);
+}
@@ -0,0 +1,785 @@
+/*
+ * dim_slab.c
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/* SYNOPSIS
+ * Slab pools for data-in-memory bin spaces and record spaces. Each namespace
+ * that configures bin-space-slabs gets size classes 8 bytes apart - for bin
+ * spaces that's one class per bin count or so - each carving page-sized slabs
+ * into equal elements. Resizing a bin space moves it to a neighboring class
+ * instead of churning the general heap, and an opt-in compaction pass empties
+ * sparse slabs by moving their elements, under the record lock, into fuller
+ * ones.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "base/dim_slab.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "citrusleaf/alloc.h"
+#include "citrusleaf/cf_atomic.h"
+#include "citrusleaf/cf_clock.h"
+
+#include "dynbuf.h"
+#include "fault.h"
+#include "jem.h"
+
+#include "base/datamodel.h"
+#include "base/index.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+#define SLAB_SIZE 4096 // must match cf_valloc() alignment - header found by mask
+#define SLAB_HEADER_SIZE 64
+#define CLASS_STEP 8
+#define N_CLASSES 64
+#define MAX_ELEMENT_SIZE (CLASS_STEP * N_CLASSES) // larger ones use cf_malloc()
+
+// Yield between partitions, so compaction stays in the background.
+#define COMPACT_PARTITION_SLEEP_us 1000
+
+typedef enum {
+	SLAB_LIST_NONE, // full
+	SLAB_LIST_PARTIAL,
+	SLAB_LIST_EVACUATING
+} slab_list;
+
+typedef struct slab_s {
+	struct slab_s*	prev;
+	struct slab_s*	next;
+	void*			free_head; // freed elements, linked through themselves
+	uint16_t		n_carved; // elements never freed are carved in order
+	uint16_t		n_inuse;
+	uint8_t			class_ix;
+	uint8_t			list;
+} slab;
+
+typedef struct slab_dlist_s {
+	slab*			head;
+	slab*			tail;
+} slab_dlist;
+
+typedef struct slab_class_s {
+	pthread_mutex_t	lock;
+	uint32_t		element_size;
+	uint32_t		n_per_slab;
+	slab_dlist		partial; // allocate at the head, return at the tail
+	slab_dlist		evacuating;
+	uint64_t		n_slabs;
+	uint64_t		n_inuse;
+} slab_class;
+
+struct as_dim_slab_pool_s {
+	slab_class		classes[N_CLASSES];
+	cf_atomic64		oversize_bytes;
+
+	// Compaction - one job at a time per namespace.
+	cf_atomic32		compacting;
+	uint32_t		compact_max_fill_pct;
+	uint64_t		compact_start_ms;
+	uint64_t		compact_end_ms;
+	uint64_t		compact_bytes_before;
+	uint64_t		compact_bytes_after;
+	cf_atomic64		compact_n_moved;
+	cf_atomic64		compact_n_released;
+};
+
+typedef struct as_dim_slab_pool_s dim_slab_pool;
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static inline uint32_t bin_space_size(uint16_t n_bins);
+static inline uint32_t rec_space_size(uint32_t key_size);
+static inline slab* slab_of(void* p);
+static void dlist_push_tail(slab_dlist* dl, slab* s);
+static void dlist_remove(slab_dlist* dl, slab* s);
+static void* heap_move_lower(void* p, uint32_t size);
+
+static void* pool_alloc(dim_slab_pool* pool, uint32_t size);
+static void pool_free(dim_slab_pool* pool, void* p, uint32_t size);
+static void* pool_relocate(dim_slab_pool* pool, void* p, uint32_t size);
+static uint64_t pool_slab_bytes(dim_slab_pool* pool);
+
+static void* run_compact(void* udata);
+static uint32_t mark_sparse_slabs(dim_slab_pool* pool, uint32_t max_fill_pct);
+static void unmark_slabs(dim_slab_pool* pool);
+static void compact_reduce_cb(as_index_ref* r_ref, void* udata);
+
+
+//==========================================================
+// Public API.
+//
+
+void
+as_dim_slab_init(as_namespace* ns)
+{
+	if (! ns->bin_space_slabs) {
+		return;
+	}
+
+	dim_slab_pool* pool = cf_malloc(sizeof(dim_slab_pool));
+
+	cf_assert(pool, AS_NAMESPACE, CF_CRITICAL, "{%s} failed dim slab pool alloc", ns->name);
+
+	memset(pool, 0, sizeof(dim_slab_pool));
+
+	for (uint32_t i = 0; i < N_CLASSES; i++) {
+		slab_class* sc = &pool->classes[i];
+
+		pthread_mutex_init(&sc->lock, NULL);
+		sc->element_size = (i + 1) * CLASS_STEP;
+		sc->n_per_slab = (SLAB_SIZE - SLAB_HEADER_SIZE) / sc->element_size;
+	}
+
+	ns->dim_slab_pool = pool;
+
+	cf_info(AS_NAMESPACE, "{%s} bin spaces and record spaces use slab pools", ns->name);
+}
+
+as_bin_space*
+as_dim_slab_alloc_bin_space(as_namespace* ns, uint16_t n_bins)
+{
+	uint32_t size = bin_space_size(n_bins);
+
+	if (! ns->dim_slab_pool) {
+		return (as_bin_space*)cf_malloc(size);
+	}
+
+	return (as_bin_space*)pool_alloc(ns->dim_slab_pool, size);
+}
+
+// Bins up to the smaller count are kept, like realloc().
+as_bin_space*
+as_dim_slab_resize_bin_space(as_namespace* ns, as_bin_space* bin_space,
+		uint16_t old_n_bins, uint16_t n_bins)
+{
+	uint32_t old_size = bin_space_size(old_n_bins);
+	uint32_t size = bin_space_size(n_bins);
+
+	if (! ns->dim_slab_pool) {
+		return (as_bin_space*)cf_realloc((void*)bin_space, size);
+	}
+
+	dim_slab_pool* pool = ns->dim_slab_pool;
+
+	// Same class - nothing to do.
+	if (old_size <= MAX_ELEMENT_SIZE && size <= MAX_ELEMENT_SIZE &&
+			(old_size - 1) / CLASS_STEP == (size - 1) / CLASS_STEP) {
+		return bin_space;
+	}
+
+	// Both outside the pool - the heap may resize in place.
+	if (old_size > MAX_ELEMENT_SIZE && size > MAX_ELEMENT_SIZE) {
+		as_bin_space* new_bin_space = (as_bin_space*)
+				cf_realloc((void*)bin_space, size);
+
+		if (new_bin_space) {
+			cf_atomic64_add(&pool->oversize_bytes,
+					(int64_t)size - (int64_t)old_size);
+		}
+
+		return new_bin_space;
+	}
+
+	as_bin_space* new_bin_space = (as_bin_space*)pool_alloc(pool, size);
+
+	if (! new_bin_space) {
+		return NULL;
+	}
+
+	memcpy((void*)new_bin_space, (const void*)bin_space,
+			old_size < size ? old_size : size);
+	pool_free(pool, (void*)bin_space, old_size);
+
+	return new_bin_space;
+}
+
+void
+as_dim_slab_free_bin_space(as_namespace* ns, as_bin_space* bin_space,
+		uint16_t n_bins)
+{
+	if (! ns->dim_slab_pool) {
+		cf_free((void*)bin_space);
+		return;
+	}
+
+	pool_free(ns->dim_slab_pool, (void*)bin_space, bin_space_size(n_bins));
+}
+
+as_rec_space*
+as_dim_slab_alloc_rec_space(as_namespace* ns, uint32_t key_size)
+{
+	uint32_t size = rec_space_size(key_size);
+
+	if (! ns->dim_slab_pool) {
+		return (as_rec_space*)cf_malloc(size);
+	}
+
+	return (as_rec_space*)pool_alloc(ns->dim_slab_pool, size);
+}
+
+void
+as_dim_slab_free_rec_space(as_namespace* ns, as_rec_space* rec_space)
+{
+	if (! ns->dim_slab_pool) {
+		cf_free((void*)rec_space);
+		return;
+	}
+
+	pool_free(ns->dim_slab_pool, (void*)rec_space,
+			rec_space_size(rec_space->key_size));
+}
+
+// Heap spaces move only if the fresh allocation lands lower - see
+// as_bin_particle_compact(). Slab pool spaces move only out of slabs being
+// evacuated.
+as_bin_space*
+as_dim_slab_compact_bin_space(as_namespace* ns, as_bin_space* bin_space)
+{
+	uint32_t size = bin_space_size(bin_space->n_bins);
+
+	if (! ns->dim_slab_pool) {
+		return (as_bin_space*)heap_move_lower((void*)bin_space, size);
+	}
+
+	return (as_bin_space*)pool_relocate(ns->dim_slab_pool, (void*)bin_space,
+			size);
+}
+
+as_rec_space*
+as_dim_slab_compact_rec_space(as_namespace* ns, as_rec_space* rec_space)
+{
+	uint32_t size = rec_space_size(rec_space->key_size);
+
+	if (! ns->dim_slab_pool) {
+		return (as_rec_space*)heap_move_lower((void*)rec_space, size);
+	}
+
+	return (as_rec_space*)pool_relocate(ns->dim_slab_pool, (void*)rec_space,
+			size);
+}
+
+// Returns NULL on success, otherwise an error reason.
+const char*
+as_dim_slab_compact_start(as_namespace* ns, uint32_t max_fill_pct)
+{
+	dim_slab_pool* pool = ns->dim_slab_pool;
+
+	if (! pool) {
+		return "not-enabled";
+	}
+
+	if (max_fill_pct == 0 || max_fill_pct >= 100) {
+		return "bad-max-fill-pct";
+	}
+
+	if (cf_atomic32_incr(&pool->compacting) != 1) {
+		cf_atomic32_decr(&pool->compacting);
+		return "already-running";
+	}
+
+	pool->compact_max_fill_pct = max_fill_pct;
+	pool->compact_start_ms = cf_getms();
+	pool->compact_end_ms = 0;
+	pool->compact_bytes_before = pool_slab_bytes(pool);
+	pool->compact_bytes_after = 0;
+	cf_atomic64_set(&pool->compact_n_moved, 0);
+	cf_atomic64_set(&pool->compact_n_released, 0);
+
+	pthread_attr_t attrs;
+	pthread_t thread;
+
+	pthread_attr_init(&attrs);
+	pthread_attr_setdetachstate(&attrs, PTHREAD_CREATE_DETACHED);
+
+	if (pthread_create(&thread, &attrs, run_compact, (void*)ns) != 0) {
+		pthread_attr_destroy(&attrs);
+		cf_atomic32_set(&pool->compacting, 0);
+		return "failed-thread-create";
+	}
+
+	pthread_attr_destroy(&attrs);
+
+	return NULL;
+}
+
+void
+as_dim_slab_get_info(as_namespace* ns, cf_dyn_buf* db)
+{
+	dim_slab_pool* pool = ns->dim_slab_pool;
+
+	if (! pool) {
+		cf_dyn_buf_append_string(db, "enabled=false");
+		return;
+	}
+
+	uint64_t n_slabs = 0;
+	uint64_t inuse_bytes = 0;
+
+	for (uint32_t i = 0; i < N_CLASSES; i++) {
+		slab_class* sc = &pool->classes[i];
+
+		pthread_mutex_lock(&sc->lock);
+		n_slabs += sc->n_slabs;
+		inuse_bytes += sc->n_inuse * sc->element_size;
+		pthread_mutex_unlock(&sc->lock);
+	}
+
+	uint64_t slab_bytes = n_slabs * SLAB_SIZE;
+	bool compacting = cf_atomic32_get(pool->compacting) != 0;
+
+	cf_dyn_buf_append_string(db, "enabled=true:slabs=");
+	cf_dyn_buf_append_uint64(db, n_slabs);
+	cf_dyn_buf_append_string(db, ":slab-bytes=");
+	cf_dyn_buf_append_uint64(db, slab_bytes);
+	cf_dyn_buf_append_string(db, ":inuse-bytes=");
+	cf_dyn_buf_append_uint64(db, inuse_bytes);
+	cf_dyn_buf_append_string(db, ":fill-pct=");
+	cf_dyn_buf_append_uint64(db, slab_bytes == 0 ?
+			100 : inuse_bytes * 100 / slab_bytes);
+	cf_dyn_buf_append_string(db, ":oversize-bytes=");
+	cf_dyn_buf_append_uint64(db, cf_atomic64_get(pool->oversize_bytes));
+
+	cf_dyn_buf_append_string(db, ":compact-status=");
+	cf_dyn_buf_append_string(db, compacting ?
+			"running" : (pool->compact_end_ms != 0 ? "done" : "idle"));
+
+	if (pool->compact_start_ms != 0) {
+		uint64_t end_ms = compacting ? cf_getms() : pool->compact_end_ms;
+
+		cf_dyn_buf_append_string(db, ":compact-max-fill-pct=");
+		cf_dyn_buf_append_uint32(db, pool->compact_max_fill_pct);
+		cf_dyn_buf_append_string(db, ":compact-moved=");
+		cf_dyn_buf_append_uint64(db, cf_atomic64_get(pool->compact_n_moved));
+		cf_dyn_buf_append_string(db, ":compact-released-slabs=");
+		cf_dyn_buf_append_uint64(db, cf_atomic64_get(pool->compact_n_released));
+		cf_dyn_buf_append_string(db, ":compact-slab-bytes-before=");
+		cf_dyn_buf_append_uint64(db, pool->compact_bytes_before);
+
+		if (! compacting) {
+			cf_dyn_buf_append_string(db, ":compact-slab-bytes-after=");
+			cf_dyn_buf_append_uint64(db, pool->compact_bytes_after);
+		}
+
+		cf_dyn_buf_append_string(db, ":compact-ms=");
+		cf_dyn_buf_append_uint64(db, end_ms - pool->compact_start_ms);
+	}
+
+	for (uint32_t i = 0; i < N_CLASSES; i++) {
+		slab_class* sc = &pool->classes[i];
+
+		pthread_mutex_lock(&sc->lock);
+
+		uint64_t class_n_slabs = sc->n_slabs;
+		uint64_t class_n_inuse = sc->n_inuse;
+		uint32_t n_per_slab = sc->n_per_slab;
+
+		pthread_mutex_unlock(&sc->lock);
+
+		if (class_n_slabs == 0) {
+			continue;
+		}
+
+		cf_dyn_buf_append_string(db, ";element-size=");
+		cf_dyn_buf_append_uint32(db, sc->element_size);
+		cf_dyn_buf_append_string(db, ":slabs=");
+		cf_dyn_buf_append_uint64(db, class_n_slabs);
+		cf_dyn_buf_append_string(db, ":elements=");
+		cf_dyn_buf_append_uint64(db, class_n_inuse);
+		cf_dyn_buf_append_string(db, ":fill-pct=");
+		cf_dyn_buf_append_uint64(db,
+				class_n_inuse * 100 / (class_n_slabs * n_per_slab));
+	}
+}
+
+
+//==========================================================
+// Local helpers - generic.
+//
+
+static inline uint32_t
+bin_space_size(uint16_t n_bins)
+{
+	return (uint32_t)(sizeof(as_bin_space) + (n_bins * sizeof(as_bin)));
+}
+
+static inline uint32_t
+rec_space_size(uint32_t key_size)
+{
+	return (uint32_t)sizeof(as_rec_space) + key_size;
+}
+
+static inline slab*
+slab_of(void* p)
+{
+	return (slab*)((uintptr_t)p & ~(uintptr_t)(SLAB_SIZE - 1));
+}
+
+static void
+dlist_push_tail(slab_dlist* dl, slab* s)
+{
+	s->next = NULL;
+	s->prev = dl->tail;
+
+	if (dl->tail) {
+		dl->tail->next = s;
+	}
+	else {
+		dl->head = s;
+	}
+
+	dl->tail = s;
+}
+
+static void
+dlist_remove(slab_dlist* dl, slab* s)
+{
+	if (s->prev) {
+		s->prev->next = s->next;
+	}
+	else {
+		dl->head = s->next;
+	}
+
+	if (s->next) {
+		s->next->prev = s->prev;
+	}
+	else {
+		dl->tail = s->prev;
+	}
+
+	s->prev = NULL;
+	s->next = NULL;
+}
+
+static void*
+heap_move_lower(void* p, uint32_t size)
+{
+	void* new_p = cf_malloc(size);
+
+	if (! new_p) {
+		return p;
+	}
+
+	if ((uintptr_t)new_p > (uintptr_t)p) {
+		cf_free(new_p);
+		return p;
+	}
+
+	memcpy(new_p, p, size);
+	cf_free(p);
+
+	return new_p;
+}
+
+
+//==========================================================
+// Local helpers - pool.
+//
+
+static void*
+pool_alloc(dim_slab_pool* pool, uint32_t size)
+{
+	if (size > MAX_ELEMENT_SIZE) {
+		void* p = cf_malloc(size);
+
+		if (p) {
+			cf_atomic64_add(&pool->oversize_bytes, size);
+		}
+
+		return p;
+	}
+
+	uint32_t class_ix = (size - 1) / CLASS_STEP;
+	slab_class* sc = &pool->classes[class_ix];
+
+	pthread_mutex_lock(&sc->lock);
+
+	slab* s = sc->partial.head;
+
+	if (! s) {
+		if (! (s = (slab*)cf_valloc(SLAB_SIZE))) {
+			pthread_mutex_unlock(&sc->lock);
+			return NULL;
+		}
+
+		memset((void*)s, 0, SLAB_HEADER_SIZE);
+		s->class_ix = (uint8_t)class_ix;
+		s->list = SLAB_LIST_PARTIAL;
+		dlist_push_tail(&sc->partial, s);
+		sc->n_slabs++;
+	}
+
+	void* p = s->free_head;
+
+	if (p) {
+		s->free_head = *(void**)p;
+	}
+	else {
+		p = (uint8_t*)s + SLAB_HEADER_SIZE + (s->n_carved++ * sc->element_size);
+	}
+
+	sc->n_inuse++;
+
+	if (++s->n_inuse == sc->n_per_slab) {
+		dlist_remove(&sc->partial, s);
+		s->list = SLAB_LIST_NONE;
+	}
+
+	pthread_mutex_unlock(&sc->lock);
+
+	return p;
+}
+
+static void
+pool_free(dim_slab_pool* pool, void* p, uint32_t size)
+{
+	if (size > MAX_ELEMENT_SIZE) {
+		cf_free(p);
+		cf_atomic64_sub(&pool->oversize_bytes, size);
+		return;
+	}
+
+	slab* s = slab_of(p);
+	slab_class* sc = &pool->classes[s->class_ix];
+
+	pthread_mutex_lock(&sc->lock);
+
+	*(void**)p = s->free_head;
+	s->free_head = p;
+	sc->n_inuse--;
+	s->n_inuse--;
+
+	if (s->list == SLAB_LIST_NONE) {
+		s->list = SLAB_LIST_PARTIAL;
+		dlist_push_tail(&sc->partial, s);
+	}
+
+	if (s->n_inuse == 0) {
+		if (s->list == SLAB_LIST_EVACUATING) {
+			dlist_remove(&sc->evacuating, s);
+			cf_atomic64_incr(&pool->compact_n_released);
+		}
+		// Keep the last partial slab, so one element doesn't thrash a slab.
+		else if (sc->partial.head != s || s->next) {
+			dlist_remove(&sc->partial, s);
+		}
+		else {
+			s = NULL;
+		}
+
+		if (s) {
+			sc->n_slabs--;
+			cf_free((void*)s);
+		}
+	}
+
+	pthread_mutex_unlock(&sc->lock);
+}
+
+// Caller holds the lock of the record that owns p. Returns where p now lives.
+static void*
+pool_relocate(dim_slab_pool* pool, void* p, uint32_t size)
+{
+	if (size > MAX_ELEMENT_SIZE) {
+		return p;
+	}
+
+	// Unlocked peek is ok - only the compaction thread moves slabs on and off
+	// the evacuating list, and p being live keeps its slab from being freed.
+	if (slab_of(p)->list != SLAB_LIST_EVACUATING) {
+		return p;
+	}
+
+	void* new_p = pool_alloc(pool, size);
+
+	if (! new_p) {
+		return p;
+	}
+
+	memcpy(new_p, p, size);
+	pool_free(pool, p, size);
+
+	cf_atomic64_incr(&pool->compact_n_moved);
+
+	return new_p;
+}
+
+static uint64_t
+pool_slab_bytes(dim_slab_pool* pool)
+{
+	uint64_t n_slabs = 0;
+
+	for (uint32_t i = 0; i < N_CLASSES; i++) {
+		slab_class* sc = &pool->classes[i];
+
+		pthread_mutex_lock(&sc->lock);
+		n_slabs += sc->n_slabs;
+		pthread_mutex_unlock(&sc->lock);
+	}
+
+	return n_slabs * SLAB_SIZE;
+}
+
+
+//==========================================================
+// Local helpers - compaction.
+//
+
+static void*
+run_compact(void* udata)
+{
+	as_namespace* ns = (as_namespace*)udata;
+	dim_slab_pool* pool = ns->dim_slab_pool;
+
+#ifdef USE_JEM
+	// Slabs that replace evacuated ones should come from the namespace arena.
+	jem_set_arena(ns->jem_arena);
+#endif
+
+	uint32_t n_marked = mark_sparse_slabs(pool, pool->compact_max_fill_pct);
+
+	cf_info(AS_NAMESPACE, "{%s} dim slab compaction starting - evacuating %u slabs under %u%% full",
+			ns->name, n_marked, pool->compact_max_fill_pct);
+
+	if (n_marked != 0) {
+		for (uint32_t pid = 0; pid < AS_PARTITIONS; pid++) {
+			as_partition_reservation rsv;
+
+			AS_PARTITION_RESERVATION_INIT(rsv);
+			as_partition_reserve_migrate(ns, pid, &rsv, NULL);
+
+			as_index_reduce(rsv.p->vp, compact_reduce_cb, (void*)ns);
+
+			as_partition_release(&rsv);
+
+			usleep(COMPACT_PARTITION_SLEEP_us);
+		}
+
+		// Elements of records the reduce didn't visit stay where they are.
+		unmark_slabs(pool);
+	}
+
+	pool->compact_bytes_after = pool_slab_bytes(pool);
+	pool->compact_end_ms = cf_getms();
+
+	cf_info(AS_NAMESPACE, "{%s} dim slab compaction done - moved %lu, released %lu slabs, slab bytes %lu -> %lu in %lu ms",
+			ns->name, cf_atomic64_get(pool->compact_n_moved),
+			cf_atomic64_get(pool->compact_n_released),
+			pool->compact_bytes_before, pool->compact_bytes_after,
+			pool->compact_end_ms - pool->compact_start_ms);
+
+	cf_atomic32_set(&pool->compacting, 0);
+
+	return NULL;
+}
+
+static uint32_t
+mark_sparse_slabs(dim_slab_pool* pool, uint32_t max_fill_pct)
+{
+	uint32_t n_marked = 0;
+
+	for (uint32_t i = 0; i < N_CLASSES; i++) {
+		slab_class* sc = &pool->classes[i];
+
+		pthread_mutex_lock(&sc->lock);
+
+		slab* s = sc->partial.head;
+
+		while (s) {
+			slab* next = s->next;
+
+			if (s->n_inuse * 100 < sc->n_per_slab * max_fill_pct) {
+				dlist_remove(&sc->partial, s);
+				s->list = SLAB_LIST_EVACUATING;
+				dlist_push_tail(&sc->evacuating, s);
+				n_marked++;
+			}
+
+			s = next;
+		}
+
+		pthread_mutex_unlock(&sc->lock);
+	}
+
+	return n_marked;
+}
+
+static void
+unmark_slabs(dim_slab_pool* pool)
+{
+	for (uint32_t i = 0; i < N_CLASSES; i++) {
+		slab_class* sc = &pool->classes[i];
+
+		pthread_mutex_lock(&sc->lock);
+
+		slab* s;
+
+		while ((s = sc->evacuating.head) != NULL) {
+			dlist_remove(&sc->evacuating, s);
+			s->list = SLAB_LIST_PARTIAL;
+			dlist_push_tail(&sc->partial, s);
+		}
+
+		pthread_mutex_unlock(&sc->lock);
+	}
+}
+
+static void
+compact_reduce_cb(as_index_ref* r_ref, void* udata)
+{
+	as_namespace* ns = (as_namespace*)udata;
+	dim_slab_pool* pool = ns->dim_slab_pool;
+	as_record* r = r_ref->r;
+
+	if (r->dim) {
+		if (as_index_is_flag_set(r, AS_INDEX_FLAG_KEY_STORED)) {
+			as_rec_space* rec_space = (as_rec_space*)r->dim;
+
+			r->dim = pool_relocate(pool, (void*)rec_space,
+					rec_space_size(rec_space->key_size));
+		}
+
+		as_bin_space* bin_space = as_index_get_bin_space(r);
+
+		if (bin_space) {
+			as_index_set_bin_space(r, (as_bin_space*)pool_relocate(pool,
+					(void*)bin_space, bin_space_size(bin_space->n_bins)));
+		}
+	}
+
+	as_record_done(r_ref, ns);
+}
@@ -0,0 +1,289 @@
+/*
+ * expire_index.c
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/* SYNOPSIS
+ * Optional per-partition expiration index, so nsup can expire records without
+ * walking the whole index tree. Records are listed by arena handle in coarse
+ * void-time buckets - a ring covering the next EI_N_SLOTS buckets, plus an
+ * overflow list for void-times beyond the ring, re-binned as the ring turns.
+ *
+ * Entries are hints, never removed when a record changes or is deleted. A
+ * record is only added when its void-time moves to a different bucket, and
+ * nsup looks each popped entry up by digest, under the record lock, before
+ * deciding it's expired. Stale and duplicate entries are therefore harmless -
+ * nsup's periodic full walks rebuild the index, which bounds their number.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "base/expire_index.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "citrusleaf/alloc.h"
+
+#include "arenax.h"
+#include "fault.h"
+
+#include "base/datamodel.h"
+#include "base/index.h"
+
+
+//==========================================================
+// Constants.
+//
+
+#define EI_SLOT_SEC		60
+#define EI_N_SLOTS		128 // ring covers ~2 hours
+#define EI_MIN_CAPACITY	16
+
+
+//==========================================================
+// Typedefs.
+//
+
+typedef struct ei_bucket_s {
+	cf_arenax_handle*	handles;
+	uint32_t			n_handles;
+	uint32_t			capacity;
+} ei_bucket;
+
+struct as_expire_index_s {
+	pthread_mutex_t		lock;
+	uint32_t			base_slot;	// oldest slot not yet popped
+	uint32_t			rebin_slot;	// base_slot when overflow was last re-binned
+	ei_bucket			overflow;	// slots at or beyond rebin_slot + EI_N_SLOTS
+	ei_bucket			buckets[EI_N_SLOTS];
+};
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static void add_lockfree(as_expire_index* ei, cf_arenax_handle r_h, uint32_t slot);
+static void rebin_overflow(as_expire_index* ei, cf_arenax* arena);
+static void bucket_append(ei_bucket* bucket, const cf_arenax_handle* handles, uint32_t n_handles);
+static void bucket_free(ei_bucket* bucket);
+
+static inline uint32_t
+void_time_slot(uint32_t void_time)
+{
+	return void_time / EI_SLOT_SEC;
+}
+
+
+//==========================================================
+// Public API.
+//
+
+as_expire_index*
+as_expire_index_create()
+{
+	as_expire_index* ei = cf_malloc(sizeof(as_expire_index));
+
+	cf_assert(ei, AS_NSUP, CF_CRITICAL, "failed expire index malloc");
+
+	memset(ei, 0, sizeof(as_expire_index));
+	pthread_mutex_init(&ei->lock, NULL);
+
+	ei->base_slot = void_time_slot(as_record_void_time_get());
+	ei->rebin_slot = ei->base_slot;
+
+	return ei;
+}
+
+
+void
+as_expire_index_clear(as_expire_index* ei)
+{
+	pthread_mutex_lock(&ei->lock);
+
+	bucket_free(&ei->overflow);
+
+	for (uint32_t i = 0; i < EI_N_SLOTS; i++) {
+		bucket_free(&ei->buckets[i]);
+	}
+
+	pthread_mutex_unlock(&ei->lock);
+}
+
+
+// Detaches all buckets whose void-times are entirely in the past. Returns the
+// number of handles, in a new allocation the caller must free.
+uint32_t
+as_expire_index_pop_due(as_expire_index* ei, cf_arenax* arena, uint32_t now,
+		cf_arenax_handle** p_handles)
+{
+	uint32_t now_slot = void_time_slot(now);
+	ei_bucket due = { NULL, 0, 0 };
+
+	pthread_mutex_lock(&ei->lock);
+
+	while (ei->base_slot < now_slot) {
+		if (ei->base_slot >= ei->rebin_slot + EI_N_SLOTS) {
+			rebin_overflow(ei, arena);
+		}
+
+		ei_bucket* bucket = &ei->buckets[ei->base_slot % EI_N_SLOTS];
+
+		if (! due.handles) {
+			due = *bucket;
+			memset(bucket, 0, sizeof(ei_bucket));
+		}
+		else if (bucket->n_handles != 0) {
+			bucket_append(&due, bucket->handles, bucket->n_handles);
+			bucket_free(bucket);
+		}
+
+		ei->base_slot++;
+	}
+
+	pthread_mutex_unlock(&ei->lock);
+
+	*p_handles = due.handles;
+
+	return due.n_handles;
+}
+
+
+void
+as_expire_index_add(as_expire_index* ei, cf_arenax_handle r_h,
+		uint32_t void_time)
+{
+	pthread_mutex_lock(&ei->lock);
+	add_lockfree(ei, r_h, void_time_slot(void_time));
+	pthread_mutex_unlock(&ei->lock);
+}
+
+
+// Call (under the record lock) wherever a record's void-time may have changed.
+void
+as_expire_index_record_changed(as_namespace* ns, as_record* r,
+		uint32_t old_void_time)
+{
+	if (! ns->expiration_index || r->void_time == 0 ||
+			(old_void_time != 0 &&
+					void_time_slot(r->void_time) ==
+							void_time_slot(old_void_time))) {
+		return;
+	}
+
+	cf_arenax_handle r_h = cf_arenax_get_handle(ns->arena, r);
+
+	if (r_h == 0) {
+		return;
+	}
+
+	as_partition* p = &ns->partitions[as_partition_getid(r->key)];
+
+	as_expire_index_add(p->expire_index, r_h, r->void_time);
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+static void
+add_lockfree(as_expire_index* ei, cf_arenax_handle r_h, uint32_t slot)
+{
+	// Already due - will be popped next time.
+	if (slot < ei->base_slot) {
+		slot = ei->base_slot;
+	}
+
+	ei_bucket* bucket = slot < ei->rebin_slot + EI_N_SLOTS ?
+			&ei->buckets[slot % EI_N_SLOTS] : &ei->overflow;
+
+	bucket_append(bucket, &r_h, 1);
+}
+
+
+// Moves overflow entries that now fit in the ring. Uses the records' current
+// void-times - entries whose records no longer expire are dropped.
+static void
+rebin_overflow(as_expire_index* ei, cf_arenax* arena)
+{
+	ei_bucket overflow = ei->overflow;
+
+	memset(&ei->overflow, 0, sizeof(ei_bucket));
+	ei->rebin_slot = ei->base_slot;
+
+	for (uint32_t i = 0; i < overflow.n_handles; i++) {
+		cf_arenax_handle r_h = overflow.handles[i];
+
+		// Unlocked read - may be stale, or a freed element. Either way the
+		// entry is only a hint.
+		uint32_t void_time = ((as_index*)cf_arenax_resolve(arena, r_h))->void_time;
+
+		if (void_time != 0) {
+			add_lockfree(ei, r_h, void_time_slot(void_time));
+		}
+	}
+
+	bucket_free(&overflow);
+}
+
+
+static void
+bucket_append(ei_bucket* bucket, const cf_arenax_handle* handles,
+		uint32_t n_handles)
+{
+	uint32_t n_needed = bucket->n_handles + n_handles;
+
+	if (n_needed > bucket->capacity) {
+		uint32_t capacity = bucket->capacity == 0 ?
+				EI_MIN_CAPACITY : bucket->capacity;
+
+		while (capacity < n_needed) {
+			capacity *= 2;
+		}
+
+		cf_arenax_handle* resized = cf_realloc(bucket->handles,
+				capacity * sizeof(cf_arenax_handle));
+
+		cf_assert(resized, AS_NSUP, CF_CRITICAL, "failed expire index realloc");
+
+		bucket->handles = resized;
+		bucket->capacity = capacity;
+	}
+
+	memcpy(&bucket->handles[bucket->n_handles], handles,
+			n_handles * sizeof(cf_arenax_handle));
+	bucket->n_handles = n_needed;
+}
+
+
+static void
+bucket_free(ei_bucket* bucket)
+{
+	if (bucket->handles) {
+		cf_free(bucket->handles);
+	}
+
+	memset(bucket, 0, sizeof(ei_bucket));
+}
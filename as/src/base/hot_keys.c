@@ -0,0 +1,414 @@
+/*
+ * hot_keys.c
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+
+/* SYNOPSIS
+ * Each thread counts transactions itself, and only every sample_rate'th one
+ * touches the namespace's sketch. Sketch counters are incremented atomically,
+ * without a lock - the lock is only taken when a key's estimate beats the
+ * smallest count in the top-K heap, or to roll the window.
+ *
+ * The digest is already a good hash, so each sketch row is indexed by a
+ * different word of it.
+ *
+ * At the end of each window the top-K is kept for the info command, and the
+ * sketch and heap start again from zero - rates therefore reflect the last
+ * WINDOW_MS, not all time.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "base/hot_keys.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "citrusleaf/alloc.h"
+#include "citrusleaf/cf_atomic.h"
+#include "citrusleaf/cf_digest.h"
+
+#include "coarse_clock.h"
+#include "dynbuf.h"
+#include "fault.h"
+
+#include "base/datamodel.h"
+#include "base/proto.h"
+#include "base/transaction.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+#define SKETCH_DEPTH 4 // rows - digest words 1 to 4
+#define SKETCH_WIDTH 4096 // counters per row, power of 2
+#define TOP_K 32
+#define WINDOW_MS (10 * 1000)
+
+COMPILER_ASSERT(SKETCH_DEPTH + 1 <= sizeof(cf_digest) / sizeof(uint32_t));
+
+typedef struct hot_key_s {
+	cf_digest	keyd;
+	uint32_t	count; // sketch estimate, in samples
+	char		set_name[AS_SET_NAME_MAX_SIZE];
+} hot_key;
+
+typedef struct as_hot_keys_s {
+	pthread_mutex_t	lock; // top-K, and rolling the window
+
+	volatile uint64_t window_start_ms;
+	volatile uint32_t min_count; // of a full heap - 0 until full
+
+	uint32_t	n_top;
+	hot_key		top[TOP_K]; // min-heap on count
+
+	// The last complete window.
+	uint64_t	last_window_ms;
+	uint32_t	last_sample_rate;
+	uint32_t	n_last;
+	hot_key		last[TOP_K];
+
+	cf_atomic32	counts[SKETCH_DEPTH][SKETCH_WIDTH];
+} as_hot_keys;
+
+
+//==========================================================
+// Globals.
+//
+
+static __thread uint32_t t_n_unsampled = 0;
+
+static pthread_mutex_t g_create_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static as_hot_keys* get_hot_keys(as_namespace* ns);
+static void roll_window(as_hot_keys* hk, uint64_t now_ms, uint32_t sample_rate);
+static uint32_t sketch_add(as_hot_keys* hk, const cf_digest* keyd);
+static void top_update(as_hot_keys* hk, as_transaction* tr, uint32_t count);
+static void heap_sift_up(hot_key* heap, uint32_t i);
+static void heap_sift_down(hot_key* heap, uint32_t n, uint32_t i);
+static void copy_set_name(char* set_name, as_transaction* tr);
+static int compare_hottest_first(const void* pa, const void* pb);
+
+
+//==========================================================
+// Public API.
+//
+
+void
+as_hot_keys_record(as_namespace* ns, as_transaction* tr, uint32_t sample_rate)
+{
+	if (++t_n_unsampled < sample_rate) {
+		return;
+	}
+
+	t_n_unsampled = 0;
+
+	as_hot_keys* hk = get_hot_keys(ns);
+	uint64_t now_ms = cf_coarse_getms();
+
+	if (now_ms - hk->window_start_ms >= WINDOW_MS) {
+		roll_window(hk, now_ms, sample_rate);
+	}
+
+	uint32_t count = sketch_add(hk, &tr->keyd);
+
+	if (count <= hk->min_count) {
+		return;
+	}
+
+	pthread_mutex_lock(&hk->lock);
+	top_update(hk, tr, count);
+	pthread_mutex_unlock(&hk->lock);
+}
+
+// Hottest first, at most max entries, as
+// "window-ms=...:sample-rate=...;digest=...:set=...:rate=...;".
+void
+as_hot_keys_get_info(as_namespace* ns, uint32_t max, cf_dyn_buf* db)
+{
+	as_hot_keys* hk = ns->hot_keys;
+
+	if (! hk) {
+		cf_dyn_buf_append_string(db, "window-ms=0:sample-rate=0");
+		return;
+	}
+
+	hot_key keys[TOP_K];
+	uint32_t n_keys;
+	uint64_t window_ms;
+	uint32_t sample_rate;
+
+	pthread_mutex_lock(&hk->lock);
+
+	if (hk->n_last != 0) {
+		n_keys = hk->n_last;
+		memcpy(keys, hk->last, n_keys * sizeof(hot_key));
+		window_ms = hk->last_window_ms;
+		sample_rate = hk->last_sample_rate;
+	}
+	else {
+		// No complete window yet - report the one in progress.
+		n_keys = hk->n_top;
+		memcpy(keys, hk->top, n_keys * sizeof(hot_key));
+		window_ms = cf_coarse_getms() - hk->window_start_ms;
+		sample_rate = g_config.hot_key_sample_rate;
+	}
+
+	pthread_mutex_unlock(&hk->lock);
+
+	if (window_ms == 0) {
+		window_ms = 1;
+	}
+
+	qsort(keys, n_keys, sizeof(hot_key), compare_hottest_first);
+
+	if (max == 0 || max > n_keys) {
+		max = n_keys;
+	}
+
+	cf_dyn_buf_append_string(db, "window-ms=");
+	cf_dyn_buf_append_uint64(db, window_ms);
+	cf_dyn_buf_append_string(db, ":sample-rate=");
+	cf_dyn_buf_append_uint32(db, sample_rate);
+
+	for (uint32_t i = 0; i < max; i++) {
+		const hot_key* k = &keys[i];
+		char digest[CF_DIGEST_KEY_SZ * 2 + 1];
+
+		for (uint32_t j = 0; j < CF_DIGEST_KEY_SZ; j++) {
+			sprintf(digest + (j * 2), "%02x", k->keyd.digest[j]);
+		}
+
+		cf_dyn_buf_append_string(db, ";digest=");
+		cf_dyn_buf_append_string(db, digest);
+		cf_dyn_buf_append_string(db, ":set=");
+		cf_dyn_buf_append_string(db, k->set_name);
+		cf_dyn_buf_append_string(db, ":rate=");
+		cf_dyn_buf_append_uint64(db,
+				(uint64_t)k->count * sample_rate * 1000 / window_ms);
+	}
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+static as_hot_keys*
+get_hot_keys(as_namespace* ns)
+{
+	as_hot_keys* hk = ns->hot_keys;
+
+	if (hk) {
+		return hk;
+	}
+
+	pthread_mutex_lock(&g_create_lock);
+
+	if (! (hk = ns->hot_keys)) {
+		hk = cf_calloc(1, sizeof(as_hot_keys));
+
+		cf_assert(hk, AS_RW, CF_CRITICAL, "failed hot-key sketch calloc");
+
+		pthread_mutex_init(&hk->lock, NULL);
+		hk->window_start_ms = cf_coarse_getms();
+
+		__sync_synchronize();
+		ns->hot_keys = hk;
+	}
+
+	pthread_mutex_unlock(&g_create_lock);
+
+	return hk;
+}
+
+static void
+roll_window(as_hot_keys* hk, uint64_t now_ms, uint32_t sample_rate)
+{
+	pthread_mutex_lock(&hk->lock);
+
+	uint64_t window_ms = now_ms - hk->window_start_ms;
+
+	// Another thread may have just rolled it - maybe even after now_ms.
+	if (now_ms < hk->window_start_ms || window_ms < WINDOW_MS) {
+		pthread_mutex_unlock(&hk->lock);
+		return;
+	}
+
+	memcpy(hk->last, hk->top, hk->n_top * sizeof(hot_key));
+	hk->n_last = hk->n_top;
+	hk->last_window_ms = window_ms;
+	hk->last_sample_rate = sample_rate;
+
+	hk->n_top = 0;
+	hk->min_count = 0;
+
+	// Samples racing with this just land in one window or the other.
+	memset((void*)hk->counts, 0, sizeof(hk->counts));
+
+	hk->window_start_ms = now_ms;
+
+	pthread_mutex_unlock(&hk->lock);
+}
+
+static uint32_t
+sketch_add(as_hot_keys* hk, const cf_digest* keyd)
+{
+	uint32_t words[sizeof(cf_digest) / sizeof(uint32_t)];
+
+	memcpy(words, keyd, sizeof(words));
+
+	uint32_t min = UINT32_MAX;
+
+	for (uint32_t d = 0; d < SKETCH_DEPTH; d++) {
+		uint32_t count = (uint32_t)cf_atomic32_incr(
+				&hk->counts[d][words[d + 1] & (SKETCH_WIDTH - 1)]);
+
+		if (count < min) {
+			min = count;
+		}
+	}
+
+	return min;
+}
+
+static void
+top_update(as_hot_keys* hk, as_transaction* tr, uint32_t count)
+{
+	hot_key* top = hk->top;
+
+	for (uint32_t i = 0; i < hk->n_top; i++) {
+		if (cf_digest_compare(&top[i].keyd, &tr->keyd) == 0) {
+			// Estimates only grow within a window.
+			if (count > top[i].count) {
+				top[i].count = count;
+				heap_sift_down(top, hk->n_top, i);
+			}
+
+			goto Done;
+		}
+	}
+
+	if (hk->n_top < TOP_K) {
+		hot_key* k = &top[hk->n_top];
+
+		k->keyd = tr->keyd;
+		k->count = count;
+		copy_set_name(k->set_name, tr);
+		heap_sift_up(top, hk->n_top++);
+	}
+	else if (count > top[0].count) {
+		top[0].keyd = tr->keyd;
+		top[0].count = count;
+		copy_set_name(top[0].set_name, tr);
+		heap_sift_down(top, TOP_K, 0);
+	}
+
+Done:
+	hk->min_count = hk->n_top == TOP_K ? top[0].count : 0;
+}
+
+static void
+heap_sift_up(hot_key* heap, uint32_t i)
+{
+	while (i != 0) {
+		uint32_t parent = (i - 1) / 2;
+
+		if (heap[parent].count <= heap[i].count) {
+			break;
+		}
+
+		hot_key tmp = heap[parent];
+
+		heap[parent] = heap[i];
+		heap[i] = tmp;
+		i = parent;
+	}
+}
+
+static void
+heap_sift_down(hot_key* heap, uint32_t n, uint32_t i)
+{
+	while (true) {
+		uint32_t least = i;
+		uint32_t l = (2 * i) + 1;
+		uint32_t r = l + 1;
+
+		if (l < n && heap[l].count < heap[least].count) {
+			least = l;
+		}
+
+		if (r < n && heap[r].count < heap[least].count) {
+			least = r;
+		}
+
+		if (least == i) {
+			break;
+		}
+
+		hot_key tmp = heap[least];
+
+		heap[least] = heap[i];
+		heap[i] = tmp;
+		i = least;
+	}
+}
+
+static void
+copy_set_name(char* set_name, as_transaction* tr)
+{
+	set_name[0] = 0;
+
+	as_msg_field* f = as_transaction_has_set(tr) ?
+			as_msg_field_get(&tr->msgp->msg, AS_MSG_FIELD_TYPE_SET) : NULL;
+
+	if (f) {
+		uint32_t len = as_msg_field_get_value_sz(f);
+
+		if (len >= AS_SET_NAME_MAX_SIZE) {
+			len = AS_SET_NAME_MAX_SIZE - 1;
+		}
+
+		memcpy(set_name, f->data, len);
+		set_name[len] = 0;
+	}
+}
+
+static int
+compare_hottest_first(const void* pa, const void* pb)
+{
+	uint32_t a = ((const hot_key*)pa)->count;
+	uint32_t b = ((const hot_key*)pb)->count;
+
+	return a > b ? -1 : (a < b ? 1 : 0);
+}
@@ -0,0 +1,319 @@
+/*
+ * incr_hist.c
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/* SYNOPSIS
+ * Optional per-partition object size and void-time counts, kept up to date as
+ * records are written and deleted, so nsup needn't walk the index to build
+ * the namespace's object size and TTL histograms. The partitions are the
+ * shards - reading merges the counts of the master partitions, the same
+ * records nsup would have walked.
+ *
+ * Void-times are counted in absolute slots on a ring twice as long as max-ttl
+ * (as configured at startup), so a slot isn't reused before its records have
+ * long been expired. Sizes are counted exactly up to 64 rblocks, then in
+ * eighths of each power of two.
+ *
+ * Callers hold the record lock, but records of a partition change in
+ * parallel, so counts are atomic. Readers clamp negative counts, which races
+ * with partition drops can produce.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "base/incr_hist.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "citrusleaf/alloc.h"
+#include "citrusleaf/cf_atomic.h"
+
+#include "fault.h"
+#include "linear_hist.h"
+
+#include "base/datamodel.h"
+#include "base/index.h"
+#include "base/ldt.h"
+
+
+//==========================================================
+// Constants.
+//
+
+#define IH_N_TTL_SLOTS		512
+
+#define IH_SIZE_EXACT		64
+#define IH_SIZE_SUB_BITS	3
+#define IH_N_SIZE_SUBS		(1 << IH_SIZE_SUB_BITS)
+#define IH_SIZE_MIN_BITS	7 // bits in IH_SIZE_EXACT
+
+// n_rblocks is 14 bits - 64 exact slots, then 8 powers of two.
+#define IH_N_SIZE_SLOTS		(IH_SIZE_EXACT + (14 - IH_SIZE_MIN_BITS + 1) * IH_N_SIZE_SUBS)
+
+
+//==========================================================
+// Typedefs.
+//
+
+struct as_incr_hist_s {
+	uint32_t	ttl_slot_sec;
+	cf_atomic32	ttl_counts[IH_N_TTL_SLOTS];
+	cf_atomic32	size_counts[IH_N_SIZE_SLOTS];
+};
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static uint32_t size_slot(uint32_t n_rblocks);
+static uint32_t size_slot_point(uint32_t slot);
+
+static inline as_incr_hist*
+record_hist(as_namespace* ns, as_record* r)
+{
+	if (! ns->incremental_histograms || as_ldt_record_is_sub(r)) {
+		return NULL; // sub-records aren't in the histograms, as for nsup
+	}
+
+	return ns->partitions[as_partition_getid(r->key)].incr_hist;
+}
+
+static inline uint32_t
+record_n_rblocks(as_namespace* ns, as_record* r)
+{
+	return ns->storage_type == AS_STORAGE_ENGINE_SSD ?
+			(uint32_t)r->storage_key.ssd.n_rblocks : 0;
+}
+
+static inline cf_atomic32*
+ttl_count(as_incr_hist* ih, uint32_t void_time)
+{
+	return &ih->ttl_counts[(void_time / ih->ttl_slot_sec) % IH_N_TTL_SLOTS];
+}
+
+
+//==========================================================
+// Public API.
+//
+
+as_incr_hist*
+as_incr_hist_create(as_namespace* ns)
+{
+	as_incr_hist* ih = cf_calloc(1, sizeof(as_incr_hist));
+
+	cf_assert(ih, AS_NSUP, CF_CRITICAL, "failed incremental histogram calloc");
+
+	uint64_t slot_sec = (2 * ns->max_ttl + IH_N_TTL_SLOTS - 1) / IH_N_TTL_SLOTS;
+
+	ih->ttl_slot_sec = slot_sec == 0 ? 1 : (uint32_t)slot_sec;
+
+	return ih;
+}
+
+
+// Call (under the record lock) wherever a record's void-time may have changed.
+void
+as_incr_hist_void_time_changed(as_namespace* ns, as_record* r,
+		uint32_t old_void_time)
+{
+	as_incr_hist* ih;
+
+	if (old_void_time == r->void_time || ! (ih = record_hist(ns, r))) {
+		return;
+	}
+
+	if (old_void_time != 0) {
+		cf_atomic32_decr(ttl_count(ih, old_void_time));
+	}
+
+	if (r->void_time != 0) {
+		cf_atomic32_incr(ttl_count(ih, r->void_time));
+	}
+}
+
+
+// Call (under the record lock) wherever a record's storage size is set.
+void
+as_incr_hist_size_changed(as_namespace* ns, as_record* r,
+		uint32_t old_n_rblocks)
+{
+	uint32_t n_rblocks = record_n_rblocks(ns, r);
+	as_incr_hist* ih;
+
+	if (old_n_rblocks == n_rblocks || ! (ih = record_hist(ns, r))) {
+		return;
+	}
+
+	if (old_n_rblocks != 0) {
+		cf_atomic32_decr(&ih->size_counts[size_slot(old_n_rblocks)]);
+	}
+
+	if (n_rblocks != 0) {
+		cf_atomic32_incr(&ih->size_counts[size_slot(n_rblocks)]);
+	}
+}
+
+
+// Call when a record is destroyed.
+void
+as_incr_hist_remove(as_namespace* ns, as_record* r)
+{
+	as_incr_hist* ih = record_hist(ns, r);
+
+	if (! ih) {
+		return;
+	}
+
+	if (r->void_time != 0) {
+		cf_atomic32_decr(ttl_count(ih, r->void_time));
+	}
+
+	uint32_t n_rblocks = record_n_rblocks(ns, r);
+
+	if (n_rblocks != 0) {
+		cf_atomic32_decr(&ih->size_counts[size_slot(n_rblocks)]);
+	}
+}
+
+
+// Rebuilds (namespace-wide) histograms from the master partitions' counts.
+// Records of 0 void-time are only in the object size histogram, and expired
+// records in neither, as for nsup's walks.
+void
+as_incr_hist_get(as_namespace* ns, uint32_t now, uint32_t ttl_range,
+		linear_hist* obj_size_hist, linear_hist* ttl_hist)
+{
+	uint64_t ttl_counts[IH_N_TTL_SLOTS];
+	uint64_t size_counts[IH_N_SIZE_SLOTS];
+	uint32_t slot_sec = 0;
+
+	memset(ttl_counts, 0, sizeof(ttl_counts));
+	memset(size_counts, 0, sizeof(size_counts));
+
+	for (int n = 0; n < AS_PARTITIONS; n++) {
+		as_partition_reservation rsv;
+
+		if (0 != as_partition_reserve_write(ns, n, &rsv, 0, 0)) {
+			continue;
+		}
+
+		as_incr_hist* ih = rsv.p->incr_hist;
+
+		slot_sec = ih->ttl_slot_sec;
+
+		for (uint32_t i = 0; i < IH_N_TTL_SLOTS; i++) {
+			int32_t count = (int32_t)cf_atomic32_get(ih->ttl_counts[i]);
+
+			if (count > 0) {
+				ttl_counts[i] += (uint64_t)count;
+			}
+		}
+
+		for (uint32_t i = 0; i < IH_N_SIZE_SLOTS; i++) {
+			int32_t count = (int32_t)cf_atomic32_get(ih->size_counts[i]);
+
+			if (count > 0) {
+				size_counts[i] += (uint64_t)count;
+			}
+		}
+
+		as_partition_release(&rsv);
+	}
+
+	linear_hist_clear(obj_size_hist, 0, cf_atomic32_get(ns->obj_size_hist_max));
+	linear_hist_clear(ttl_hist, now, ttl_range);
+
+	for (uint32_t i = 0; i < IH_N_SIZE_SLOTS; i++) {
+		if (size_counts[i] != 0) {
+			linear_hist_insert_data_points(obj_size_hist, size_slot_point(i),
+					(uint32_t)size_counts[i]);
+		}
+	}
+
+	if (slot_sec == 0) {
+		return; // no master partitions
+	}
+
+	// Only the half-ring from now on holds unexpired void-times.
+	uint64_t now_slot = now / slot_sec;
+
+	for (uint64_t slot = now_slot; slot < now_slot + IH_N_TTL_SLOTS / 2;
+			slot++) {
+		uint64_t count = ttl_counts[slot % IH_N_TTL_SLOTS];
+
+		if (count == 0) {
+			continue;
+		}
+
+		uint64_t point = slot * slot_sec + slot_sec / 2;
+
+		if (point <= now) {
+			point = now + 1;
+		}
+
+		if (point > UINT32_MAX) {
+			break;
+		}
+
+		linear_hist_insert_data_points(ttl_hist, (uint32_t)point,
+				(uint32_t)count);
+	}
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+static uint32_t
+size_slot(uint32_t n_rblocks)
+{
+	if (n_rblocks < IH_SIZE_EXACT) {
+		return n_rblocks;
+	}
+
+	uint32_t n_bits = 32 - __builtin_clz(n_rblocks);
+	uint32_t sub = (n_rblocks >> (n_bits - IH_SIZE_SUB_BITS - 1)) &
+			(IH_N_SIZE_SUBS - 1);
+	uint32_t slot = IH_SIZE_EXACT + (n_bits - IH_SIZE_MIN_BITS) *
+			IH_N_SIZE_SUBS + sub;
+
+	return slot < IH_N_SIZE_SLOTS ? slot : IH_N_SIZE_SLOTS - 1;
+}
+
+// Middle of the slot's range of sizes.
+static uint32_t
+size_slot_point(uint32_t slot)
+{
+	if (slot < IH_SIZE_EXACT) {
+		return slot;
+	}
+
+	uint32_t n_bits = IH_SIZE_MIN_BITS + (slot - IH_SIZE_EXACT) / IH_N_SIZE_SUBS;
+	uint32_t sub = (slot - IH_SIZE_EXACT) % IH_N_SIZE_SUBS;
+	uint32_t width = 1 << (n_bits - IH_SIZE_SUB_BITS - 1);
+
+	return (1 << (n_bits - 1)) + sub * width + width / 2;
+}
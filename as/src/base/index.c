@@ -42,6 +42,7 @@
 #include "fault.h"
 #include "olock.h"
 
+#include "base/as_stap.h"
 #include "base/cfg.h"
 #include "base/datamodel.h"
 #include "base/stats.h"
@@ -62,6 +63,22 @@ typedef enum {
 // Flag to indicate full index reduce.
 #define AS_REDUCE_ALL (-1)
 
+// Maximum number of elements reserved at a time by a reduce.
+#define REDUCE_CHUNK_SIZE 1024
+
+// How far ahead to prefetch when making reduce callbacks.
+#define REDUCE_PREFETCH_AHEAD 8
+
+// Start loading an element's cache line before it's needed.
+#define PREFETCH_H(__h) __builtin_prefetch(RESOLVE_H(__h))
+
+// Optimistic search results - other than found (0) and not found (-1).
+#define SEARCH_CONFLICT 1
+
+// Deeper than any valid red-black tree - a search that goes this deep is
+// following stale handles.
+#define MAX_SEARCH_DEPTH (64 * 2)
+
 typedef struct as_index_ph_s {
 	as_index			*r;
 	cf_arenax_handle	r_h;
@@ -73,6 +90,25 @@ typedef struct as_index_ph_array_s {
 	as_index_ph	indexes[];
 } as_index_ph_array;
 
+// Select a sprig by the digest bits just above those used for partition id.
+static inline as_index_sprig *
+as_index_sprig_from_keyd(as_index_tree *tree, cf_digest *keyd)
+{
+	return &tree->sprigs[(*(uint32_t*)keyd->digest >> 12) &
+			(tree->n_sprigs - 1)];
+}
+
+// Lock a record - probed, to see how long transactions wait on hot records.
+static inline void
+as_index_record_vlock(cf_digest *keyd, pthread_mutex_t **olock)
+{
+	ASD_RECORD_LOCK_START(*(uint64_t*)keyd->digest);
+
+	olock_vlock(g_record_locks, keyd, olock);
+
+	ASD_RECORD_LOCK_ACQUIRED(*(uint64_t*)keyd->digest);
+}
+
 typedef struct as_index_ele_s {
 	struct as_index_ele_s	*parent;
 	cf_arenax_handle		me_h;
@@ -88,11 +124,17 @@ typedef struct as_index_ele_s {
 bool as_index_invalid_record_done(as_index_tree *tree, as_index_ref *index_ref);
 void as_index_done(as_index_tree *tree, as_index *r, cf_arenax_handle r_h);
 void as_index_tree_purge(as_index_tree *tree, as_index *r, cf_arenax_handle r_h);
-void as_index_reduce_traverse(as_index_tree *tree, cf_arenax_handle r_h, cf_arenax_handle sentinel_h, as_index_ph_array *v_a);
+void as_index_tree_destroy_sprigs(as_index_tree *tree, uint32_t n_sprigs);
+void as_index_reduce_traverse(as_index_tree *tree, cf_arenax_handle r_h, cf_arenax_handle sentinel_h, cf_digest *last_keyd, cf_digest *lo_keyd, as_index_ph_array *v_a);
+uint32_t as_index_sprig_reduce_partial(as_index_tree *tree, as_index_sprig *sprig, uint32_t sample_count, cf_digest *lo_keyd, cf_digest *hi_keyd, as_index_reduce_fn cb, void *udata);
+void as_index_reduce_callbacks(as_index_tree *tree, as_index_ph_array *v_a, as_index_reduce_fn cb, void *udata);
+uint32_t as_index_count_traverse(as_index_tree *tree, cf_arenax_handle r_h);
 void as_index_reduce_sync_traverse(as_index_tree *tree, as_index *r, cf_arenax_handle sentinel_h, as_index_reduce_sync_fn cb, void *udata);
-int as_index_search_lockless(as_index_tree *tree, cf_digest *keyd, as_index **ret, cf_arenax_handle *ret_h);
-void as_index_insert_rebalance(as_index_tree *tree, as_index_ele *ele);
-void as_index_delete_rebalance(as_index_tree *tree, as_index_ele *ele);
+int as_index_search_lockless(as_index_tree *tree, as_index_sprig *sprig, cf_digest *keyd, as_index **ret, cf_arenax_handle *ret_h);
+int as_index_search_optimistic(as_index_tree *tree, as_index_sprig *sprig, cf_digest *keyd, as_index_ref *index_ref);
+bool as_index_reserve_if_live(as_index *r);
+void as_index_insert_rebalance(as_index_tree *tree, as_index_sprig *sprig, as_index_ele *ele);
+void as_index_delete_rebalance(as_index_tree *tree, as_index_sprig *sprig, as_index_ele *ele);
 void as_index_rotate_left(as_index_tree *tree, as_index_ele *a, as_index_ele *b);
 void as_index_rotate_right(as_index_tree *tree, as_index_ele *a, as_index_ele *b);
 
@@ -104,19 +146,19 @@ void as_index_rotate_right(as_index_tree *tree, as_index_ele *a, as_index_ele *b
 
 // Create a new red-black tree.
 as_index_tree *
-as_index_tree_create(cf_arenax *arena, as_index_value_destructor destructor,
-		void *destructor_udata, as_treex *p_treex)
+as_index_tree_create(cf_arenax *arena, uint32_t n_sprigs,
+		as_index_value_destructor destructor, void *destructor_udata,
+		as_treex *p_treex)
 {
-	as_index_tree *tree = cf_rc_alloc(sizeof(as_index_tree));
+	as_index_tree *tree = cf_rc_alloc(sizeof(as_index_tree) +
+			(sizeof(as_index_sprig) * n_sprigs));
 
 	if (! tree) {
 		return NULL;
 	}
 
-	pthread_mutex_init(&tree->lock, NULL);
-	pthread_mutex_init(&tree->reduce_lock, NULL);
-
 	tree->arena = arena;
+	tree->n_sprigs = n_sprigs;
 
 	// Make the sentinel element.
 	tree->sentinel_h = cf_arenax_alloc(arena);
@@ -128,33 +170,44 @@ as_index_tree_create(cf_arenax *arena, as_index_value_destructor destructor,
 
 	as_index *sentinel = RESOLVE_H(tree->sentinel_h);
 
-	memset(sentinel, 0, sizeof(as_index));
+	memset(sentinel, 0, AS_INDEX_COMPACT_SIZE);
 	sentinel->left_h = sentinel->right_h = tree->sentinel_h;
 	sentinel->color = AS_BLACK;
 
-	// Make the fixed root element.
-	tree->root_h = cf_arenax_alloc(arena);
+	// Make the fixed root element of each sprig.
+	for (uint32_t i = 0; i < n_sprigs; i++) {
+		as_index_sprig *sprig = &tree->sprigs[i];
 
-	if (tree->root_h == 0) {
-		cf_arenax_free(arena, tree->sentinel_h);
-		cf_rc_free(tree);
-		return NULL;
-	}
+		sprig->root_h = cf_arenax_alloc(arena);
+
+		if (sprig->root_h == 0) {
+			as_index_tree_destroy_sprigs(tree, i);
+			cf_arenax_free(arena, tree->sentinel_h);
+			cf_rc_free(tree);
+			return NULL;
+		}
+
+		pthread_mutex_init(&sprig->lock, NULL);
+		pthread_mutex_init(&sprig->reduce_lock, NULL);
+
+		sprig->root = RESOLVE_H(sprig->root_h);
+		memset(sprig->root, 0, AS_INDEX_COMPACT_SIZE);
+		sprig->root->left_h = sprig->root->right_h = tree->sentinel_h;
+		sprig->root->color = AS_BLACK;
 
-	tree->root = RESOLVE_H(tree->root_h);
-	memset(tree->root, 0, sizeof(as_index));
-	tree->root->left_h = tree->root->right_h = tree->sentinel_h;
-	tree->root->color = AS_BLACK;
+		sprig->elements = 0;
+		sprig->seq = 0;
+	}
 
 	tree->destructor = destructor;
 	tree->destructor_udata = destructor_udata;
 
-	tree->elements = 0;
-
 	if (p_treex) {
 		// Update the tree information in persistent memory.
-		p_treex->sentinel_h = tree->sentinel_h;
-		p_treex->root_h = tree->root_h;
+		for (uint32_t i = 0; i < n_sprigs; i++) {
+			p_treex[i].sentinel_h = tree->sentinel_h;
+			p_treex[i].root_h = tree->sprigs[i].root_h;
+		}
 	}
 
 	return tree;
@@ -164,44 +217,51 @@ as_index_tree_create(cf_arenax *arena, as_index_value_destructor destructor,
 // Resume a red-black tree in persistent memory.
 // TODO - should really hide this in an EE version of as_index.c.
 as_index_tree *
-as_index_tree_resume(cf_arenax *arena, as_index_value_destructor destructor,
-		void *destructor_udata, as_treex *p_treex)
+as_index_tree_resume(cf_arenax *arena, uint32_t n_sprigs,
+		as_index_value_destructor destructor, void *destructor_udata,
+		as_treex *p_treex)
 {
-	as_index_tree *tree = cf_rc_alloc(sizeof(as_index_tree));
+	// Resume the sentinel, and check the fixed roots.
+	if (p_treex[0].sentinel_h == 0) {
+		return NULL;
+	}
+
+	for (uint32_t i = 0; i < n_sprigs; i++) {
+		if (p_treex[i].root_h == 0 ||
+				p_treex[i].sentinel_h != p_treex[0].sentinel_h) {
+			return NULL;
+		}
+	}
+
+	as_index_tree *tree = cf_rc_alloc(sizeof(as_index_tree) +
+			(sizeof(as_index_sprig) * n_sprigs));
 
 	if (! tree) {
 		return NULL;
 	}
 
-	pthread_mutex_init(&tree->lock, NULL);
-	pthread_mutex_init(&tree->reduce_lock, NULL);
-
 	tree->arena = arena;
+	tree->n_sprigs = n_sprigs;
+	tree->sentinel_h = p_treex[0].sentinel_h;
 
-	// Resume the sentinel.
-	tree->sentinel_h = p_treex->sentinel_h;
+	// Resume the fixed roots.
+	for (uint32_t i = 0; i < n_sprigs; i++) {
+		as_index_sprig *sprig = &tree->sprigs[i];
 
-	if (tree->sentinel_h == 0) {
-		cf_rc_free(tree);
-		return NULL;
-	}
+		pthread_mutex_init(&sprig->lock, NULL);
+		pthread_mutex_init(&sprig->reduce_lock, NULL);
 
-	// Resume the fixed root.
-	tree->root_h = p_treex->root_h;
+		sprig->root_h = p_treex[i].root_h;
+		sprig->root = RESOLVE_H(sprig->root_h);
 
-	if (tree->root_h == 0) {
-		cf_rc_free(tree);
-		return NULL;
+		sprig->elements = sprig->root->left_h == tree->sentinel_h ?
+				0 : as_index_count_traverse(tree, sprig->root->left_h);
+		sprig->seq = 0;
 	}
 
-	tree->root = RESOLVE_H(tree->root_h);
-
 	tree->destructor = destructor;
 	tree->destructor_udata = destructor_udata;
 
-	// We'll soon update this to its proper value by reducing the tree.
-	tree->elements = 0;
-
 	return tree;
 }
 
@@ -215,31 +275,34 @@ as_index_tree_release(as_index_tree *tree, void *destructor_udata)
 		return 1;
 	}
 
-	as_index_tree_purge(tree, RESOLVE_H(tree->root->left_h),
-			tree->root->left_h);
+	for (uint32_t i = 0; i < tree->n_sprigs; i++) {
+		as_index_sprig *sprig = &tree->sprigs[i];
 
-	cf_arenax_free(tree->arena, tree->root_h);
-	cf_arenax_free(tree->arena, tree->sentinel_h);
+		as_index_tree_purge(tree, RESOLVE_H(sprig->root->left_h),
+				sprig->root->left_h);
+	}
 
-	pthread_mutex_destroy(&tree->lock);
-	pthread_mutex_destroy(&tree->reduce_lock);
+	as_index_tree_destroy_sprigs(tree, tree->n_sprigs);
+	cf_arenax_free(tree->arena, tree->sentinel_h);
 
-	memset(tree, 0, sizeof(as_index_tree)); // paranoia - for debugging only
+	// Paranoia - for debugging only.
+	memset(tree, 0, sizeof(as_index_tree) +
+			(sizeof(as_index_sprig) * tree->n_sprigs));
 	cf_rc_free(tree);
 
 	return 0;
 }
 
 
-// Get the number of elements in the tree.
+// Get the number of elements in the tree. Not exact - doesn't lock the sprigs.
 uint32_t
 as_index_tree_size(as_index_tree *tree)
 {
-	pthread_mutex_lock(&tree->lock);
+	uint32_t sz = 0;
 
-	uint32_t sz = tree->elements;
-
-	pthread_mutex_unlock(&tree->lock);
+	for (uint32_t i = 0; i < tree->n_sprigs; i++) {
+		sz += tree->sprigs[i].elements;
+	}
 
 	return sz;
 }
@@ -264,73 +327,64 @@ void
 as_index_reduce_partial(as_index_tree *tree, uint32_t sample_count,
 		as_index_reduce_fn cb, void *udata)
 {
-	pthread_mutex_lock(&tree->reduce_lock);
-
-	// For full reduce, get the number of elements inside the tree lock.
-	if (sample_count == AS_REDUCE_ALL) {
-		sample_count = tree->elements;
-	}
-
-	if (sample_count == 0) {
-		pthread_mutex_unlock(&tree->reduce_lock);
-		return;
-	}
+	// Reduce sprig by sprig, so only one sprig at a time blocks inserts and
+	// deletes, and the element array is never bigger than a sprig.
+	for (uint32_t i = 0; i < tree->n_sprigs; i++) {
+		uint32_t n_reduced = as_index_sprig_reduce_partial(tree,
+				&tree->sprigs[i], sample_count, NULL, NULL, cb, udata);
 
-	size_t sz = sizeof(as_index_ph_array) +
-			(sizeof(as_index_ph) * sample_count);
-	as_index_ph_array *v_a;
-	uint8_t buf[64 * 1024];
+		if (sample_count != AS_REDUCE_ALL) {
+			sample_count -= n_reduced;
 
-	if (sz > 64 * 1024) {
-		v_a = cf_malloc(sz);
-
-		if (! v_a) {
-			pthread_mutex_unlock(&tree->reduce_lock);
-			return;
+			if (sample_count == 0) {
+				break;
+			}
 		}
 	}
-	else {
-		v_a = (as_index_ph_array*)buf;
-	}
-
-	v_a->alloc_sz = sample_count;
-	v_a->pos = 0;
+}
 
-	uint64_t start_ms = cf_getms();
 
-	// Recursively, fetch all the value pointers into this array, so we can make
-	// all the callbacks outside the big lock.
-	if (tree->root->left_h != tree->sentinel_h) {
-		as_index_reduce_traverse(tree, tree->root->left_h, tree->sentinel_h,
-				v_a);
+// Make a callback, from outside the tree lock, for every element with digest
+// in [lo_keyd, hi_keyd) - null means unbounded. Disjoint ranges may be reduced
+// concurrently.
+void
+as_index_reduce_range(as_index_tree *tree, cf_digest *lo_keyd,
+		cf_digest *hi_keyd, as_index_reduce_fn cb, void *udata)
+{
+	for (uint32_t i = 0; i < tree->n_sprigs; i++) {
+		as_index_sprig_reduce_partial(tree, &tree->sprigs[i], AS_REDUCE_ALL,
+				lo_keyd, hi_keyd, cb, udata);
 	}
+}
 
-	cf_debug(AS_INDEX, "as_index_reduce_traverse took %"PRIu64" ms",
-			cf_getms() - start_ms);
-
-	pthread_mutex_unlock(&tree->reduce_lock);
-
-	for (uint32_t i = 0; i < v_a->pos; i++) {
-		as_index_ref r_ref;
 
-		r_ref.skip_lock = false;
-		r_ref.r = v_a->indexes[i].r;
-		r_ref.r_h = v_a->indexes[i].r_h;
+// Make a callback, from outside the tree lock, for up to max_count elements,
+// resuming the reduce order - sprig by sprig, descending digest within each -
+// just past keyd. Null keyd means from the start. Returns the number reduced,
+// fewer than max_count meaning the tree is done, so a caller can page through
+// a tree by passing the last digest it saw.
+uint32_t
+as_index_reduce_from(as_index_tree *tree, cf_digest *keyd, uint32_t max_count,
+		as_index_reduce_fn cb, void *udata)
+{
+	uint32_t i = 0;
+	uint32_t n_reduced = 0;
 
-		olock_vlock(g_record_locks, &r_ref.r->key, &r_ref.olock);
+	if (keyd) {
+		i = (uint32_t)(as_index_sprig_from_keyd(tree, keyd) - tree->sprigs);
 
-		// Ignore this record if it's "half created" or deleted.
-		if (as_index_invalid_record_done(tree, &r_ref)) {
-			continue;
-		}
-
-		// Callback MUST call as_record_done() to unlock and release record.
-		cb(&r_ref, udata);
+		// Within the digest's sprig, start just below it.
+		n_reduced = as_index_sprig_reduce_partial(tree, &tree->sprigs[i],
+				max_count, NULL, keyd, cb, udata);
+		i++;
 	}
 
-	if (v_a != (as_index_ph_array*)buf) {
-		cf_free(v_a);
+	for ( ; i < tree->n_sprigs && n_reduced < max_count; i++) {
+		n_reduced += as_index_sprig_reduce_partial(tree, &tree->sprigs[i],
+				max_count - n_reduced, NULL, NULL, cb, udata);
 	}
+
+	return n_reduced;
 }
 
 
@@ -339,14 +393,18 @@ void
 as_index_reduce_sync(as_index_tree *tree, as_index_reduce_sync_fn cb,
 		void *udata)
 {
-	pthread_mutex_lock(&tree->reduce_lock);
+	for (uint32_t i = 0; i < tree->n_sprigs; i++) {
+		as_index_sprig *sprig = &tree->sprigs[i];
 
-	if (tree->root->left_h != tree->sentinel_h) {
-		as_index_reduce_sync_traverse(tree, RESOLVE_H(tree->root->left_h),
-				tree->sentinel_h, cb, udata);
-	}
+		pthread_mutex_lock(&sprig->reduce_lock);
+
+		if (sprig->root->left_h != tree->sentinel_h) {
+			as_index_reduce_sync_traverse(tree, RESOLVE_H(sprig->root->left_h),
+					tree->sentinel_h, cb, udata);
+		}
 
-	pthread_mutex_unlock(&tree->reduce_lock);
+		pthread_mutex_unlock(&sprig->reduce_lock);
+	}
 }
 
 
@@ -363,11 +421,13 @@ as_index_reduce_sync(as_index_tree *tree, as_index_reduce_sync_fn cb,
 int
 as_index_exists(as_index_tree *tree, cf_digest *keyd)
 {
-	pthread_mutex_lock(&tree->lock);
+	as_index_sprig *sprig = as_index_sprig_from_keyd(tree, keyd);
+
+	pthread_mutex_lock(&sprig->lock);
 
-	int rv = as_index_search_lockless(tree, keyd, NULL, NULL);
+	int rv = as_index_search_lockless(tree, sprig, keyd, NULL, NULL);
 
-	pthread_mutex_unlock(&tree->lock);
+	pthread_mutex_unlock(&sprig->lock);
 
 	return rv;
 }
@@ -383,23 +443,34 @@ int
 as_index_get_vlock(as_index_tree *tree, cf_digest *keyd,
 		as_index_ref *index_ref)
 {
-	pthread_mutex_lock(&tree->lock);
+	as_index_sprig *sprig = as_index_sprig_from_keyd(tree, keyd);
 
-	int rv = as_index_search_lockless(tree, keyd, &index_ref->r,
-			&index_ref->r_h);
+	// Usually no insert or delete gets in the way, and we don't need the lock.
+	int rv = as_index_search_optimistic(tree, sprig, keyd, index_ref);
 
-	if (rv != 0) {
-		pthread_mutex_unlock(&tree->lock);
-		return rv;
+	if (rv == -1) {
+		return -1;
 	}
 
-	as_index_reserve(index_ref->r);
-	cf_atomic64_incr(&g_stats.global_record_ref_count);
+	if (rv == SEARCH_CONFLICT) {
+		pthread_mutex_lock(&sprig->lock);
 
-	pthread_mutex_unlock(&tree->lock);
+		rv = as_index_search_lockless(tree, sprig, keyd, &index_ref->r,
+				&index_ref->r_h);
+
+		if (rv != 0) {
+			pthread_mutex_unlock(&sprig->lock);
+			return rv;
+		}
+
+		as_index_reserve(index_ref->r);
+		cf_shard_counter_incr(&g_stats.global_record_ref_count);
+
+		pthread_mutex_unlock(&sprig->lock);
+	}
 
 	if (! index_ref->skip_lock) {
-		olock_vlock(g_record_locks, keyd, &index_ref->olock);
+		as_index_record_vlock(keyd, &index_ref->olock);
 	}
 
 	// Treat record as not found if it's "half created" or deleted.
@@ -424,6 +495,7 @@ int
 as_index_get_insert_vlock(as_index_tree *tree, cf_digest *keyd,
 		as_index_ref *index_ref)
 {
+	as_index_sprig *sprig = as_index_sprig_from_keyd(tree, keyd);
 	int cmp = 0;
 	bool retry;
 
@@ -434,15 +506,15 @@ as_index_get_insert_vlock(as_index_tree *tree, cf_digest *keyd,
 	do {
 		ele = eles;
 
-		pthread_mutex_lock(&tree->lock);
+		pthread_mutex_lock(&sprig->lock);
 
 		// Search for the specified element, or a parent to insert it under.
 
 		ele->parent = NULL; // we'll never look this far up
-		ele->me_h = tree->root_h;
-		ele->me = tree->root;
+		ele->me_h = sprig->root_h;
+		ele->me = sprig->root;
 
-		cf_arenax_handle t_h = tree->root->left_h;
+		cf_arenax_handle t_h = sprig->root->left_h;
 		as_index *t = RESOLVE_H(t_h);
 
 		while (t_h != tree->sentinel_h) {
@@ -451,16 +523,19 @@ as_index_get_insert_vlock(as_index_tree *tree, cf_digest *keyd,
 			ele->me_h = t_h;
 			ele->me = t;
 
+			PREFETCH_H(t->left_h);
+			PREFETCH_H(t->right_h);
+
 			if ((cmp = cf_digest_compare(keyd, &t->key)) == 0) {
 				// The element already exists, simply return it.
 
 				as_index_reserve(t);
-				cf_atomic64_incr(&g_stats.global_record_ref_count);
+				cf_shard_counter_incr(&g_stats.global_record_ref_count);
 
-				pthread_mutex_unlock(&tree->lock);
+				pthread_mutex_unlock(&sprig->lock);
 
 				if (! index_ref->skip_lock) {
-					olock_vlock(g_record_locks, keyd, &index_ref->olock);
+					as_index_record_vlock(keyd, &index_ref->olock);
 				}
 
 				index_ref->r = t;
@@ -482,14 +557,14 @@ as_index_get_insert_vlock(as_index_tree *tree, cf_digest *keyd,
 
 		retry = false;
 
-		if (EBUSY == pthread_mutex_trylock(&tree->reduce_lock)) {
+		if (EBUSY == pthread_mutex_trylock(&sprig->reduce_lock)) {
 			// The tree is being reduced - could take long, unlock so reads and
 			// overwrites aren't blocked.
-			pthread_mutex_unlock(&tree->lock);
+			pthread_mutex_unlock(&sprig->lock);
 
 			// Wait until the tree reduce is done...
-			pthread_mutex_lock(&tree->reduce_lock);
-			pthread_mutex_unlock(&tree->reduce_lock);
+			pthread_mutex_lock(&sprig->reduce_lock);
+			pthread_mutex_unlock(&sprig->reduce_lock);
 
 			// ... and start over - we unlocked, so the tree may have changed.
 			retry = true;
@@ -503,15 +578,15 @@ as_index_get_insert_vlock(as_index_tree *tree, cf_digest *keyd,
 
 	if (n_h == 0) {
 		cf_warning(AS_INDEX, "arenax alloc failed");
-		pthread_mutex_unlock(&tree->reduce_lock);
-		pthread_mutex_unlock(&tree->lock);
+		pthread_mutex_unlock(&sprig->reduce_lock);
+		pthread_mutex_unlock(&sprig->lock);
 		return -1;
 	}
 
 	as_index *n = RESOLVE_H(n_h);
 
 	n->rc = 2; // one for create (eventually balanced by delete), one for caller
-	cf_atomic64_add(&g_stats.global_record_ref_count, 2);
+	cf_shard_counter_add(&g_stats.global_record_ref_count, 2);
 
 	n->key = *keyd;
 
@@ -521,8 +596,11 @@ as_index_get_insert_vlock(as_index_tree *tree, cf_digest *keyd,
 	// Make sure we can detect that the record isn't initialized.
 	as_index_clear_record_info(n);
 
+	// Optimistic readers must not trust what they see until we're done.
+	cf_atomic32_incr(&sprig->seq);
+
 	// Insert the new element n under parent ele.
-	if (ele->me == tree->root || 0 < cmp) {
+	if (ele->me == sprig->root || 0 < cmp) {
 		ele->me->left_h = n_h;
 	}
 	else {
@@ -535,15 +613,17 @@ as_index_get_insert_vlock(as_index_tree *tree, cf_digest *keyd,
 	ele->me = n;
 
 	// Rebalance the tree as needed.
-	as_index_insert_rebalance(tree, ele);
+	as_index_insert_rebalance(tree, sprig, ele);
 
-	tree->elements++;
+	cf_atomic32_incr(&sprig->seq);
 
-	pthread_mutex_unlock(&tree->reduce_lock);
-	pthread_mutex_unlock(&tree->lock);
+	sprig->elements++;
+
+	pthread_mutex_unlock(&sprig->reduce_lock);
+	pthread_mutex_unlock(&sprig->lock);
 
 	if (! index_ref->skip_lock) {
-		olock_vlock(g_record_locks, keyd, &index_ref->olock);
+		as_index_record_vlock(keyd, &index_ref->olock);
 	}
 
 	index_ref->r = n;
@@ -562,6 +642,7 @@ as_index_get_insert_vlock(as_index_tree *tree, cf_digest *keyd,
 int
 as_index_delete(as_index_tree *tree, cf_digest *keyd)
 {
+	as_index_sprig *sprig = as_index_sprig_from_keyd(tree, keyd);
 	as_index *r;
 	cf_arenax_handle r_h;
 	bool retry;
@@ -573,13 +654,13 @@ as_index_delete(as_index_tree *tree, cf_digest *keyd)
 	do {
 		ele = eles;
 
-		pthread_mutex_lock(&tree->lock);
+		pthread_mutex_lock(&sprig->lock);
 
 		ele->parent = NULL; // we'll never look this far up
-		ele->me_h = tree->root_h;
-		ele->me = tree->root;
+		ele->me_h = sprig->root_h;
+		ele->me = sprig->root;
 
-		r_h = tree->root->left_h;
+		r_h = sprig->root->left_h;
 		r = RESOLVE_H(r_h);
 
 		while (r_h != tree->sentinel_h) {
@@ -599,7 +680,7 @@ as_index_delete(as_index_tree *tree, cf_digest *keyd)
 		}
 
 		if (r_h == tree->sentinel_h) {
-			pthread_mutex_unlock(&tree->lock);
+			pthread_mutex_unlock(&sprig->lock);
 			return -1; // not found, nothing to delete
 		}
 
@@ -607,14 +688,14 @@ as_index_delete(as_index_tree *tree, cf_digest *keyd)
 
 		retry = false;
 
-		if (EBUSY == pthread_mutex_trylock(&tree->reduce_lock)) {
+		if (EBUSY == pthread_mutex_trylock(&sprig->reduce_lock)) {
 			// The tree is being reduced - could take long, unlock so reads and
 			// overwrites aren't blocked.
-			pthread_mutex_unlock(&tree->lock);
+			pthread_mutex_unlock(&sprig->lock);
 
 			// Wait until the tree reduce is done...
-			pthread_mutex_lock(&tree->reduce_lock);
-			pthread_mutex_unlock(&tree->reduce_lock);
+			pthread_mutex_lock(&sprig->reduce_lock);
+			pthread_mutex_unlock(&sprig->reduce_lock);
 
 			// ... and start over - we unlocked, so the tree may have changed.
 			retry = true;
@@ -660,6 +741,9 @@ as_index_delete(as_index_tree *tree, cf_digest *keyd)
 
 	ele->me = RESOLVE_H(ele->me_h);
 
+	// Optimistic readers must not trust what they see until we're done.
+	cf_atomic32_incr(&sprig->seq);
+
 	// Cut s (remember, it could be r) out of the tree.
 	ele->parent = s_e->parent;
 
@@ -673,7 +757,7 @@ as_index_delete(as_index_tree *tree, cf_digest *keyd)
 	// Rebalance at ele if necessary. (Note - if r != s, r is in the tree, and
 	// its parent may change during rebalancing.)
 	if (s->color == AS_BLACK) {
-		as_index_delete_rebalance(tree, ele);
+		as_index_delete_rebalance(tree, sprig, ele);
 	}
 
 	if (s != r) {
@@ -690,16 +774,18 @@ as_index_delete(as_index_tree *tree, cf_digest *keyd)
 		}
 	}
 
+	cf_atomic32_incr(&sprig->seq);
+
 	// Flag record as deleted.
 	as_index_invalidate_record(r);
 
 	// We may now destroy r, which is no longer in the tree.
 	as_index_done(tree, r, r_h);
 
-	tree->elements--;
+	sprig->elements--;
 
-	pthread_mutex_unlock(&tree->reduce_lock);
-	pthread_mutex_unlock(&tree->lock);
+	pthread_mutex_unlock(&sprig->reduce_lock);
+	pthread_mutex_unlock(&sprig->lock);
 
 	return 0;
 }
@@ -737,7 +823,7 @@ as_index_done(as_index_tree *tree, as_index *r, cf_arenax_handle r_h)
 		cf_arenax_free(tree->arena, r_h);
 	}
 
-	cf_atomic64_decr(&g_stats.global_record_ref_count);
+	cf_shard_counter_decr(&g_stats.global_record_ref_count);
 }
 
 void
@@ -759,33 +845,189 @@ as_index_tree_purge(as_index_tree *tree, as_index *r, cf_arenax_handle r_h)
 		cf_arenax_free(tree->arena, r_h);
 	}
 
-	cf_atomic64_decr(&g_stats.global_record_ref_count);
+	cf_shard_counter_decr(&g_stats.global_record_ref_count);
 }
 
 
+void
+as_index_tree_destroy_sprigs(as_index_tree *tree, uint32_t n_sprigs)
+{
+	for (uint32_t i = 0; i < n_sprigs; i++) {
+		as_index_sprig *sprig = &tree->sprigs[i];
+
+		cf_arenax_free(tree->arena, sprig->root_h);
+
+		pthread_mutex_destroy(&sprig->lock);
+		pthread_mutex_destroy(&sprig->reduce_lock);
+	}
+}
+
+
+// Returns the number of elements for which callbacks were attempted. Walks the
+// sprig a chunk at a time, resuming after the last digest of the previous
+// chunk, so memory use and reduce lock hold times are bounded.
+uint32_t
+as_index_sprig_reduce_partial(as_index_tree *tree, as_index_sprig *sprig,
+		uint32_t sample_count, cf_digest *lo_keyd, cf_digest *hi_keyd,
+		as_index_reduce_fn cb, void *udata)
+{
+	uint8_t buf[sizeof(as_index_ph_array) +
+				(sizeof(as_index_ph) * REDUCE_CHUNK_SIZE)];
+	as_index_ph_array *v_a = (as_index_ph_array*)buf;
+	cf_digest last_keyd;
+	bool started = false;
+
+	// Traversal is in descending digest order, so start just below hi_keyd.
+	if (hi_keyd) {
+		last_keyd = *hi_keyd;
+		started = true;
+	}
+	uint32_t n_reduced = 0;
+
+	while (n_reduced < sample_count) {
+		uint32_t n_remaining = sample_count - n_reduced;
+
+		v_a->alloc_sz = n_remaining < REDUCE_CHUNK_SIZE ?
+				n_remaining : REDUCE_CHUNK_SIZE;
+		v_a->pos = 0;
+
+		pthread_mutex_lock(&sprig->reduce_lock);
+
+		// Fetch the next chunk of value pointers into the array, so we can make
+		// the callbacks outside the big lock.
+		if (sprig->root->left_h != tree->sentinel_h) {
+			as_index_reduce_traverse(tree, sprig->root->left_h,
+					tree->sentinel_h, started ? &last_keyd : NULL, lo_keyd,
+					v_a);
+		}
+
+		pthread_mutex_unlock(&sprig->reduce_lock);
+
+		if (v_a->pos == 0) {
+			break;
+		}
+
+		// Reserved elements' digests can't change.
+		last_keyd = v_a->indexes[v_a->pos - 1].r->key;
+		started = true;
+
+		as_index_reduce_callbacks(tree, v_a, cb, udata);
+
+		n_reduced += v_a->pos;
+
+		if (v_a->pos < v_a->alloc_sz) {
+			break; // reached the end of the sprig
+		}
+	}
+
+	return n_reduced;
+}
+
+
+// Make callbacks for an array of reserved elements, from outside the tree lock.
+void
+as_index_reduce_callbacks(as_index_tree *tree, as_index_ph_array *v_a,
+		as_index_reduce_fn cb, void *udata)
+{
+	uint32_t n_prefetched = v_a->pos < REDUCE_PREFETCH_AHEAD ?
+			v_a->pos : REDUCE_PREFETCH_AHEAD;
+
+	for (uint32_t i = 0; i < n_prefetched; i++) {
+		__builtin_prefetch(v_a->indexes[i].r);
+	}
+
+	for (uint32_t i = 0; i < v_a->pos; i++) {
+		as_index_ref r_ref;
+
+		// Callbacks may be slow - keep the next elements in flight.
+		if (i + REDUCE_PREFETCH_AHEAD < v_a->pos) {
+			__builtin_prefetch(v_a->indexes[i + REDUCE_PREFETCH_AHEAD].r);
+		}
+
+		r_ref.skip_lock = false;
+		r_ref.r = v_a->indexes[i].r;
+		r_ref.r_h = v_a->indexes[i].r_h;
+
+		as_index_record_vlock(&r_ref.r->key, &r_ref.olock);
+
+		// Ignore this record if it's "half created" or deleted.
+		if (as_index_invalid_record_done(tree, &r_ref)) {
+			continue;
+		}
+
+		// Callback MUST call as_record_done() to unlock and release record.
+		cb(&r_ref, udata);
+	}
+}
+
+
+uint32_t
+as_index_count_traverse(as_index_tree *tree, cf_arenax_handle r_h)
+{
+	as_index *r = RESOLVE_H(r_h);
+	uint32_t count = 1;
+
+	if (r->left_h != tree->sentinel_h) {
+		count += as_index_count_traverse(tree, r->left_h);
+	}
+
+	if (r->right_h != tree->sentinel_h) {
+		count += as_index_count_traverse(tree, r->right_h);
+	}
+
+	return count;
+}
+
+
+// Collect elements in traversal order, starting after last_keyd if it's not
+// null, and stopping before any digest less than lo_keyd if it's not null.
+// Note - traversal order is descending digest order.
 void
 as_index_reduce_traverse(as_index_tree *tree, cf_arenax_handle r_h,
-		cf_arenax_handle sentinel_h, as_index_ph_array *v_a)
+		cf_arenax_handle sentinel_h, cf_digest *last_keyd, cf_digest *lo_keyd,
+		as_index_ph_array *v_a)
 {
 	as_index *r = RESOLVE_H(r_h);
 
-	if (r->left_h != sentinel_h) {
-		as_index_reduce_traverse(tree, r->left_h, sentinel_h, v_a);
+	// If r comes before (isn't less than) the last digest, so does its left
+	// subtree, and all of it has been done. Its right subtree may not have.
+	bool after_last = ! last_keyd || cf_digest_compare(&r->key, last_keyd) < 0;
+
+	// If r is below the range, so is its right subtree. Its left may not be.
+	bool below_lo = lo_keyd && cf_digest_compare(&r->key, lo_keyd) < 0;
+
+	if (after_last) {
+		PREFETCH_H(r->left_h);
 	}
 
-	if (v_a->pos >= v_a->alloc_sz) {
+	if (! below_lo) {
+		PREFETCH_H(r->right_h);
+	}
+
+	if (after_last && r->left_h != sentinel_h) {
+		as_index_reduce_traverse(tree, r->left_h, sentinel_h, last_keyd,
+				lo_keyd, v_a);
+	}
+
+	if (v_a->pos >= v_a->alloc_sz || below_lo) {
 		return;
 	}
 
-	as_index_reserve(r);
-	cf_atomic64_incr(&g_stats.global_record_ref_count);
+	if (after_last) {
+		as_index_reserve(r);
+		cf_shard_counter_incr(&g_stats.global_record_ref_count);
 
-	v_a->indexes[v_a->pos].r = r;
-	v_a->indexes[v_a->pos].r_h = r_h;
-	v_a->pos++;
+		v_a->indexes[v_a->pos].r = r;
+		v_a->indexes[v_a->pos].r_h = r_h;
+		v_a->pos++;
+
+		// Everything in the right subtree comes after r.
+		last_keyd = NULL;
+	}
 
 	if (r->right_h != sentinel_h) {
-		as_index_reduce_traverse(tree, r->right_h, sentinel_h, v_a);
+		as_index_reduce_traverse(tree, r->right_h, sentinel_h, last_keyd,
+				lo_keyd, v_a);
 	}
 }
 
@@ -809,13 +1051,17 @@ as_index_reduce_sync_traverse(as_index_tree *tree, as_index *r,
 
 
 int
-as_index_search_lockless(as_index_tree *tree, cf_digest *keyd, as_index **ret,
-		cf_arenax_handle *ret_h)
+as_index_search_lockless(as_index_tree *tree, as_index_sprig *sprig,
+		cf_digest *keyd, as_index **ret, cf_arenax_handle *ret_h)
 {
-	cf_arenax_handle r_h = tree->root->left_h;
+	cf_arenax_handle r_h = sprig->root->left_h;
 	as_index *r = RESOLVE_H(r_h);
 
 	while (r_h != tree->sentinel_h) {
+		// Load the next level while comparing at this one.
+		PREFETCH_H(r->left_h);
+		PREFETCH_H(r->right_h);
+
 		int cmp = cf_digest_compare(keyd, &r->key);
 
 		if (cmp == 0) {
@@ -838,8 +1084,96 @@ as_index_search_lockless(as_index_tree *tree, cf_digest *keyd, as_index **ret,
 }
 
 
+// Search without the sprig lock. Elements are never unmapped, and handles in
+// them are always resolvable, so following stale handles is safe - the
+// sequence check afterwards tells if anything we saw may have been stale.
+//
+// Returns:
+//		 0 - found (reserved reference returned in index_ref)
+//		-1 - not found
+//		SEARCH_CONFLICT - sprig changed under us, caller must search locked
+int
+as_index_search_optimistic(as_index_tree *tree, as_index_sprig *sprig,
+		cf_digest *keyd, as_index_ref *index_ref)
+{
+	uint32_t seq = (uint32_t)cf_atomic32_get(sprig->seq);
+
+	if ((seq & 1) != 0) {
+		return SEARCH_CONFLICT;
+	}
+
+	__sync_synchronize();
+
+	cf_arenax_handle r_h = sprig->root->left_h;
+	uint32_t depth = 0;
+
+	while (r_h != tree->sentinel_h) {
+		if (++depth > MAX_SEARCH_DEPTH) {
+			return SEARCH_CONFLICT;
+		}
+
+		as_index *r = RESOLVE_H(r_h);
+
+		PREFETCH_H(r->left_h);
+		PREFETCH_H(r->right_h);
+
+		int cmp = cf_digest_compare(keyd, &r->key);
+
+		if (cmp == 0) {
+			if (! as_index_reserve_if_live(r)) {
+				return SEARCH_CONFLICT;
+			}
+
+			cf_shard_counter_incr(&g_stats.global_record_ref_count);
+
+			// Reserve is a full barrier - it happened before this check.
+			if ((uint32_t)cf_atomic32_get(sprig->seq) != seq) {
+				as_index_done(tree, r, r_h);
+				return SEARCH_CONFLICT;
+			}
+
+			index_ref->r = r;
+			index_ref->r_h = r_h;
+
+			return 0; // found
+		}
+
+		r_h = cmp > 0 ? r->left_h : r->right_h;
+	}
+
+	__sync_synchronize();
+
+	if ((uint32_t)cf_atomic32_get(sprig->seq) != seq) {
+		return SEARCH_CONFLICT;
+	}
+
+	return -1; // not found
+}
+
+
+// Reserve an element found without the sprig lock - fail if it may already be
+// freed. Freed elements have ref-count 0, then (in the arena's free list) the
+// free magic, until re-initialized under the sprig lock.
+bool
+as_index_reserve_if_live(as_index *r)
+{
+	uint32_t rc = (uint32_t)cf_atomic32_get(r->rc);
+
+	while (rc != 0 && rc != FREE_MAGIC) {
+		if (__sync_bool_compare_and_swap(&r->rc, rc, rc + 1)) {
+			return true;
+		}
+
+		rc = (uint32_t)cf_atomic32_get(r->rc);
+	}
+
+	return false;
+}
+
+
 void
-as_index_insert_rebalance(as_index_tree *tree, as_index_ele *ele)
+as_index_insert_rebalance(as_index_tree *tree, as_index_sprig *sprig,
+		as_index_ele *ele)
 {
 	// Entering here, ele is the last element on the stack. It turns out during
 	// insert rebalancing we won't ever need new elements on the stack, but make
@@ -924,19 +1258,20 @@ as_index_insert_rebalance(as_index_tree *tree, as_index_ele *ele)
 		}
 	}
 
-	RESOLVE_H(tree->root->left_h)->color = AS_BLACK;
+	RESOLVE_H(sprig->root->left_h)->color = AS_BLACK;
 }
 
 
 void
-as_index_delete_rebalance(as_index_tree *tree, as_index_ele *ele)
+as_index_delete_rebalance(as_index_tree *tree, as_index_sprig *sprig,
+		as_index_ele *ele)
 {
 	// Entering here, ele is the last element on the stack. It's possible as r_e
 	// crawls up the tree, we'll need new elements on the stack, in which case
 	// ele keeps building the stack down while r_e goes up.
 	as_index_ele *r_e = ele;
 
-	while (r_e->me->color == AS_BLACK && r_e->me_h != tree->root->left_h) {
+	while (r_e->me->color == AS_BLACK && r_e->me_h != sprig->root->left_h) {
 		as_index *r_parent = r_e->parent->me;
 
 		if (r_e->me_h == r_parent->left_h) {
@@ -1000,7 +1335,7 @@ as_index_delete_rebalance(as_index_tree *tree, as_index_ele *ele)
 
 				as_index_rotate_left(tree, r_e->parent, ele);
 
-				RESOLVE_H(tree->root->left_h)->color = AS_BLACK;
+				RESOLVE_H(sprig->root->left_h)->color = AS_BLACK;
 
 				return;
 			}
@@ -1066,7 +1401,7 @@ as_index_delete_rebalance(as_index_tree *tree, as_index_ele *ele)
 
 				as_index_rotate_right(tree, r_e->parent, ele);
 
-				RESOLVE_H(tree->root->left_h)->color = AS_BLACK;
+				RESOLVE_H(sprig->root->left_h)->color = AS_BLACK;
 
 				return;
 			}
@@ -32,28 +32,51 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "aerospike/as_string.h"
 #include "citrusleaf/alloc.h"
 #include "citrusleaf/cf_atomic.h"
 #include "citrusleaf/cf_clock.h"
+#include "citrusleaf/cf_digest.h"
 #include "citrusleaf/cf_queue.h"
 #include "citrusleaf/cf_queue_priority.h"
 
 #include "fault.h"
 
+#include "base/as_stap.h"
 #include "base/cfg.h"
 #include "base/datamodel.h"
+#include "base/index.h"
 #include "base/monitor.h"
 
 
 
+//==============================================================================
+// Constants.
+//
+
+// Split partitions bigger than this into slices of about this size.
+#define JOB_SLICE_ELEMENTS (16 * 1024)
+#define JOB_MAX_PID_SLICES 64
+
+// Slices split the 12 digest bits after the partition id bits.
+#define JOB_SPLIT_N_VALUES (1 << 12)
+
+// Pacers don't bank more than this much idle time, and sleep at most this long
+// at a time, so they notice budget changes and abandoned jobs.
+#define JOB_PACER_BURST_US (100 * 1000)
+
+
+
 //==============================================================================
 // Globals.
 //
 
 static cf_atomic32 g_job_trid = 0;
 
+as_job_pacer g_background_pacer = AS_JOB_PACER_INIT;
+
 
 
 //==============================================================================
@@ -116,9 +139,11 @@ int compare_cb(void* buf, void* task);
 //
 
 bool
-as_priority_thread_pool_init(as_priority_thread_pool* pool, uint32_t n_threads)
+as_priority_thread_pool_init(as_priority_thread_pool* pool, uint32_t n_threads,
+		as_sched_pool sched_pool)
 {
 	pthread_mutex_init(&pool->lock, NULL);
+	pool->sched_pool = sched_pool;
 
 	// Initialize queues.
 	pool->dispatch_queue = cf_queue_priority_create(sizeof(queue_task), true);
@@ -212,6 +237,7 @@ create_threads(as_priority_thread_pool* pool, uint32_t count)
 
 	for (uint32_t i = 0; i < count; i++) {
 		if (pthread_create(&thread, &attrs, run_pool_thread, pool) == 0) {
+			as_config_sched_thread(pool->sched_pool, thread);
 			n_threads_created++;
 		}
 	}
@@ -272,6 +298,86 @@ compare_cb(void* buf, void* task)
 
 
 
+//==============================================================================
+// as_job_pacer class implementation.
+//
+
+//----------------------------------------------------------
+// as_job_pacer public API.
+//
+
+void
+as_job_pacer_init(as_job_pacer* pacer)
+{
+	pthread_mutex_init(&pacer->lock, NULL);
+	pacer->next_us = 0;
+}
+
+void
+as_job_pacer_destroy(as_job_pacer* pacer)
+{
+	pthread_mutex_destroy(&pacer->lock);
+}
+
+// Returns when the next piece of work may start, 0 if unlimited.
+uint64_t
+as_job_pacer_due(as_job_pacer* pacer, uint32_t max_per_sec)
+{
+	if (max_per_sec == 0) {
+		return 0;
+	}
+
+	pthread_mutex_lock(&pacer->lock);
+
+	uint64_t due_us = pacer->next_us;
+
+	pthread_mutex_unlock(&pacer->lock);
+
+	return due_us;
+}
+
+void
+as_job_pacer_charge(as_job_pacer* pacer, uint64_t n_records,
+		uint32_t max_per_sec)
+{
+	if (max_per_sec == 0 || n_records == 0) {
+		return;
+	}
+
+	uint64_t now_us = cf_getus();
+
+	pthread_mutex_lock(&pacer->lock);
+
+	// Don't let an idle pacer bank more than a burst's worth of budget.
+	if (pacer->next_us + JOB_PACER_BURST_US < now_us) {
+		pacer->next_us = now_us - JOB_PACER_BURST_US;
+	}
+
+	pacer->next_us += (n_records * 1000000) / max_per_sec;
+
+	pthread_mutex_unlock(&pacer->lock);
+}
+
+// Sleeps towards due_us, at most a burst at a time. Returns false if already
+// due, true if the caller should recheck.
+bool
+as_job_pacer_wait(uint64_t due_us)
+{
+	uint64_t now_us = cf_getus();
+
+	if (due_us <= now_us) {
+		return false;
+	}
+
+	uint64_t sleep_us = due_us - now_us;
+
+	usleep(sleep_us > JOB_PACER_BURST_US ? JOB_PACER_BURST_US : sleep_us);
+
+	return true;
+}
+
+
+
 //==============================================================================
 // as_job base class implementation.
 //
@@ -283,6 +389,12 @@ compare_cb(void* buf, void* task)
 static inline const char* as_job_safe_set_name(as_job* _job);
 static inline float as_job_progress(as_job* _job);
 int as_job_partition_reserve(as_job* _job, int pid, as_partition_reservation* rsv);
+uint64_t as_job_due(as_job* _job);
+void as_job_charge(as_job* _job, uint64_t n_records);
+uint32_t as_job_pid_slices(as_job* _job, as_partition_reservation* rsv);
+void as_job_sweep_slice(as_job* _job);
+void as_job_slice_digest(as_partition_id pid, uint32_t slice, uint32_t n_slices, cf_digest* keyd);
+bool as_job_unpark(as_job* _job);
 
 //----------------------------------------------------------
 // as_job public API.
@@ -304,6 +416,7 @@ as_job_init(as_job* _job, const as_job_vtable* vtable,
 	_job->priority	= safe_priority(priority);
 
 	pthread_mutex_init(&_job->requeue_lock, NULL);
+	as_job_pacer_init(&_job->pacer);
 }
 
 void
@@ -311,7 +424,30 @@ as_job_slice(void* task)
 {
 	as_job* _job = (as_job*)task;
 
+	pthread_mutex_lock(&_job->requeue_lock);
+
+	if (_job->paused && _job->abandoned == 0) {
+		// Hold on to this task's active reservation - as_job_resume() (or
+		// abandoning the job) will use it.
+		_job->parked = true;
+		pthread_mutex_unlock(&_job->requeue_lock);
+		return;
+	}
+
+	pthread_mutex_unlock(&_job->requeue_lock);
+
+	// Only one task per job is queued, so waiting here paces the whole job.
+	while (_job->abandoned == 0 && as_job_pacer_wait(as_job_due(_job))) {
+		;
+	}
+
+	if (_job->n_sweep_slices != 0) {
+		as_job_sweep_slice(_job);
+		return;
+	}
+
 	int pid = _job->next_pid;
+	uint32_t slice = _job->next_slice;
 	as_partition_reservation rsv;
 
 	if ((pid = as_job_partition_reserve(_job, pid, &rsv)) == AS_PARTITIONS) {
@@ -320,6 +456,10 @@ as_job_slice(void* task)
 		return;
 	}
 
+	if (pid != _job->next_pid) {
+		slice = 0; // skipped partition(s) we couldn't reserve
+	}
+
 	pthread_mutex_lock(&_job->requeue_lock);
 
 	if (_job->abandoned != 0) {
@@ -329,16 +469,69 @@ as_job_slice(void* task)
 		return;
 	}
 
-	if ((_job->next_pid = pid + 1) < AS_PARTITIONS) {
-		as_job_active_reserve(_job);
-		as_job_manager_requeue_job(_job->mgr, _job);
+	// Only one task per job is ever queued, so this is stable until the
+	// partition's last slice is handed out.
+	if (slice == 0) {
+		_job->n_pid_slices = as_job_pid_slices(_job, &rsv);
+	}
+
+	uint32_t n_slices = _job->n_pid_slices;
+
+	as_job_charge(_job, as_index_tree_size(rsv.tree) / n_slices);
+
+	if (slice + 1 < n_slices) {
+		_job->next_slice = slice + 1;
+	}
+	else {
+		_job->next_slice = 0;
+		_job->next_pid = pid + 1;
+	}
+
+	_job->n_running++;
+
+	if (_job->next_pid < AS_PARTITIONS) {
+		if (_job->max_threads == 0 || _job->n_running < _job->max_threads) {
+			as_job_active_reserve(_job);
+			as_job_manager_requeue_job(_job->mgr, _job);
+		}
+		else {
+			// At the job's thread cap - requeue when a slice finishes.
+			_job->requeue_deferred = true;
+		}
 	}
 
 	pthread_mutex_unlock(&_job->requeue_lock);
 
-	_job->vtable.slice_fn(_job, &rsv);
+	cf_digest lo;
+	cf_digest hi;
+
+	as_job_slice_digest(pid, slice, n_slices, &lo);
+	as_job_slice_digest(pid, slice + 1, n_slices, &hi);
+
+	ASD_JOB_SLICE_START(_job->trid, pid, slice);
+
+	_job->vtable.slice_fn(_job, &rsv, slice == 0 ? NULL : &lo,
+			slice + 1 == n_slices ? NULL : &hi);
+
+	ASD_JOB_SLICE_DONE(_job->trid, pid, slice);
 
 	as_partition_release(&rsv);
+
+	pthread_mutex_lock(&_job->requeue_lock);
+
+	_job->n_running--;
+
+	if (_job->requeue_deferred) {
+		_job->requeue_deferred = false;
+
+		if (_job->abandoned == 0) {
+			as_job_active_reserve(_job);
+			as_job_manager_requeue_job(_job->mgr, _job);
+		}
+	}
+
+	pthread_mutex_unlock(&_job->requeue_lock);
+
 	as_job_active_release(_job);
 }
 
@@ -354,6 +547,11 @@ as_job_destroy(as_job* _job)
 {
 	_job->vtable.destroy_fn(_job);
 
+	if (_job->pids) {
+		cf_free(_job->pids);
+	}
+
+	as_job_pacer_destroy(&_job->pacer);
 	pthread_mutex_destroy(&_job->requeue_lock);
 	cf_free(_job);
 }
@@ -400,6 +598,30 @@ as_job_active_release(as_job* _job)
 	}
 }
 
+// Slices already running carry on - the next one to start parks.
+void
+as_job_pause(as_job* _job)
+{
+	pthread_mutex_lock(&_job->requeue_lock);
+	_job->paused = true;
+	pthread_mutex_unlock(&_job->requeue_lock);
+}
+
+void
+as_job_resume(as_job* _job)
+{
+	pthread_mutex_lock(&_job->requeue_lock);
+
+	_job->paused = false;
+
+	if (as_job_unpark(_job)) {
+		// Uses the parked task's active reservation.
+		as_job_manager_requeue_job(_job->mgr, _job);
+	}
+
+	pthread_mutex_unlock(&_job->requeue_lock);
+}
+
 //----------------------------------------------------------
 // as_job utilities.
 //
@@ -415,15 +637,36 @@ as_job_safe_set_name(as_job* _job)
 static inline float
 as_job_progress(as_job* _job)
 {
-	return ((float)(_job->next_pid * 100)) / (float)AS_PARTITIONS;
+	if (_job->n_sweep_slices != 0) {
+		return ((float)_job->next_slice * 100) / (float)_job->n_sweep_slices;
+	}
+
+	float pid_done = (float)_job->next_pid;
+
+	if (_job->next_slice != 0 && _job->n_pid_slices != 0) {
+		pid_done += (float)_job->next_slice / (float)_job->n_pid_slices;
+	}
+
+	return (pid_done * 100) / (float)AS_PARTITIONS;
 }
 
 int
 as_job_partition_reserve(as_job* _job, int pid, as_partition_reservation* rsv)
 {
+	if (_job->pids) {
+		while (pid < AS_PARTITIONS && ! _job->pids[pid]) {
+			pid++;
+		}
+	}
+
+	if (pid == AS_PARTITIONS) {
+		return pid;
+	}
+
 	if (_job->rsv_type == RSV_WRITE) {
-		while (pid < AS_PARTITIONS && as_partition_reserve_write(_job->ns, pid,
-				rsv, NULL, NULL) != 0) {
+		while (pid < AS_PARTITIONS && ((_job->pids && ! _job->pids[pid]) ||
+				as_partition_reserve_write(_job->ns, pid, rsv, NULL,
+						NULL) != 0)) {
 			pid++;
 		}
 	}
@@ -437,6 +680,128 @@ as_job_partition_reserve(as_job* _job, int pid, as_partition_reservation* rsv)
 	return pid;
 }
 
+// Call with requeue_lock held. If the job's task was parked, the caller gets
+// its active reservation.
+bool
+as_job_unpark(as_job* _job)
+{
+	if (! _job->parked) {
+		return false;
+	}
+
+	_job->parked = false;
+	return true;
+}
+
+// Latest of the job's, its manager's and the global background due times.
+uint64_t
+as_job_due(as_job* _job)
+{
+	uint64_t due_us = as_job_pacer_due(&_job->pacer, _job->max_rps);
+	uint64_t mgr_due_us = as_job_pacer_due(&_job->mgr->pacer,
+			_job->mgr->max_rps);
+	uint64_t bg_due_us = as_job_pacer_due(&g_background_pacer,
+			g_config.background_max_records_per_sec);
+
+	if (mgr_due_us > due_us) {
+		due_us = mgr_due_us;
+	}
+
+	return bg_due_us > due_us ? bg_due_us : due_us;
+}
+
+void
+as_job_charge(as_job* _job, uint64_t n_records)
+{
+	as_job_pacer_charge(&_job->pacer, n_records, _job->max_rps);
+	as_job_pacer_charge(&_job->mgr->pacer, n_records, _job->mgr->max_rps);
+	as_job_pacer_charge(&g_background_pacer, n_records,
+			g_config.background_max_records_per_sec);
+}
+
+uint32_t
+as_job_pid_slices(as_job* _job, as_partition_reservation* rsv)
+{
+	if (! _job->split_pids) {
+		return 1;
+	}
+
+	uint32_t n_slices = as_index_tree_size(rsv->p->vp) / JOB_SLICE_ELEMENTS;
+
+	if (n_slices == 0) {
+		return 1;
+	}
+
+	return n_slices > JOB_MAX_PID_SLICES ? JOB_MAX_PID_SLICES : n_slices;
+}
+
+// Like as_job_slice(), but for a storage sweep - slices are handed out in
+// order, and there's no partition to reserve here.
+void
+as_job_sweep_slice(as_job* _job)
+{
+	pthread_mutex_lock(&_job->requeue_lock);
+
+	uint32_t slice = _job->next_slice;
+
+	if (_job->abandoned != 0 || slice >= _job->n_sweep_slices) {
+		pthread_mutex_unlock(&_job->requeue_lock);
+		as_job_active_release(_job);
+		return;
+	}
+
+	// No record count in advance - charge an even share of the namespace.
+	as_job_charge(_job, cf_atomic_int_get(_job->ns->n_objects) /
+			_job->n_sweep_slices);
+
+	_job->next_slice = slice + 1;
+	_job->n_running++;
+
+	if (_job->next_slice < _job->n_sweep_slices) {
+		if (_job->max_threads == 0 || _job->n_running < _job->max_threads) {
+			as_job_active_reserve(_job);
+			as_job_manager_requeue_job(_job->mgr, _job);
+		}
+		else {
+			_job->requeue_deferred = true;
+		}
+	}
+
+	pthread_mutex_unlock(&_job->requeue_lock);
+
+	_job->sweep_fn(_job, slice);
+
+	pthread_mutex_lock(&_job->requeue_lock);
+
+	_job->n_running--;
+
+	if (_job->requeue_deferred) {
+		_job->requeue_deferred = false;
+
+		if (_job->abandoned == 0) {
+			as_job_active_reserve(_job);
+			as_job_manager_requeue_job(_job->mgr, _job);
+		}
+	}
+
+	pthread_mutex_unlock(&_job->requeue_lock);
+
+	as_job_active_release(_job);
+}
+
+// Lowest digest of the slice - same layout as migration's tree split.
+void
+as_job_slice_digest(as_partition_id pid, uint32_t slice, uint32_t n_slices,
+		cf_digest* keyd)
+{
+	uint32_t v = (slice * JOB_SPLIT_N_VALUES) / n_slices;
+
+	memset(keyd, 0, sizeof(cf_digest));
+	keyd->digest[0] = (uint8_t)(pid & 0xFF);
+	keyd->digest[1] = (uint8_t)(((pid >> 8) & 0x0F) | ((v >> 8) << 4));
+	keyd->digest[2] = (uint8_t)(v & 0xFF);
+}
+
 
 
 //==============================================================================
@@ -471,10 +836,13 @@ int as_job_manager_info_cb(void* buf, void* udata);
 
 void
 as_job_manager_init(as_job_manager* mgr, uint32_t max_active, uint32_t max_done,
-		uint32_t n_threads)
+		uint32_t n_threads, as_sched_pool sched_pool)
 {
 	mgr->max_active	= max_active;
 	mgr->max_done	= max_done;
+	mgr->max_rps	= 0;
+
+	as_job_pacer_init(&mgr->pacer);
 
 	if (pthread_mutex_init(&mgr->lock, NULL) != 0) {
 		cf_crash(AS_JOB, "job manager failed mutex init");
@@ -488,7 +856,8 @@ as_job_manager_init(as_job_manager* mgr, uint32_t max_active, uint32_t max_done,
 		cf_crash(AS_JOB, "job manager failed finished jobs queue create");
 	}
 
-	if (! as_priority_thread_pool_init(&mgr->thread_pool, n_threads)) {
+	if (! as_priority_thread_pool_init(&mgr->thread_pool, n_threads,
+			sched_pool)) {
 		cf_crash(AS_JOB, "job manager failed thread pool init");
 	}
 }
@@ -544,7 +913,8 @@ as_job_manager_abandon_job(as_job_manager* mgr, as_job* _job, int reason)
 {
 	pthread_mutex_lock(&_job->requeue_lock);
 	_job->abandoned = reason;
-	bool found = as_priority_thread_pool_remove_task(&mgr->thread_pool, _job);
+	bool found = as_priority_thread_pool_remove_task(&mgr->thread_pool, _job) ||
+			as_job_unpark(_job);
 	pthread_mutex_unlock(&_job->requeue_lock);
 
 	if (found) {
@@ -602,7 +972,8 @@ as_job_manager_abort_all_jobs(as_job_manager* mgr)
 
 		pthread_mutex_lock(&_job->requeue_lock);
 		_job->abandoned = AS_JOB_FAIL_USER_ABORT;
-		found[i] = as_priority_thread_pool_remove_task(&mgr->thread_pool, _job);
+		found[i] = as_priority_thread_pool_remove_task(&mgr->thread_pool,
+				_job) || as_job_unpark(_job);
 		pthread_mutex_unlock(&_job->requeue_lock);
 	}
 
@@ -655,6 +1026,12 @@ as_job_manager_limit_finished_jobs(as_job_manager* mgr, uint32_t max_done)
 	pthread_mutex_unlock(&mgr->lock);
 }
 
+void
+as_job_manager_limit_records_per_sec(as_job_manager* mgr, uint32_t max_rps)
+{
+	mgr->max_rps = max_rps;
+}
+
 void
 as_job_manager_resize_thread_pool(as_job_manager* mgr, uint32_t n_threads)
 {
@@ -1661,6 +1661,21 @@ as_bin_get_llist(as_namespace *ns, as_storage_rd *rd, as_index_tree *sub_tree, a
 	as_bytes *leftMostDigest = (as_bytes *)as_hashmap_get((as_hashmap *)ldtMap, (as_val *)&key);
 	char *curDigest = as_val_tostring(leftMostDigest);
 
+	// Data not in memory - the leaf walk only needs two bins per subrecord, so
+	// don't unpack the rest.
+	uint16_t leaf_ids[2];
+	uint16_t n_leaf_ids = 0;
+
+	if (!ns->storage_data_in_memory) {
+		int16_t ctrl_id = as_bin_get_id(ns, "LsrControlBin");
+		int16_t list_id = as_bin_get_id(ns, "LsrListBin");
+
+		if (ctrl_id >= 0 && list_id >= 0) {
+			leaf_ids[n_leaf_ids++] = (uint16_t)ctrl_id;
+			leaf_ids[n_leaf_ids++] = (uint16_t)list_id;
+		}
+	}
+
 	as_arraylist *rl = as_arraylist_new(100, 100);
 	while (true) {
 		if (!curDigest || (!strcmp(curDigest,"0"))) { 
@@ -1692,7 +1707,11 @@ as_bin_get_llist(as_namespace *ns, as_storage_rd *rd, as_index_tree *sub_tree, a
 		sub_rd.n_bins = as_bin_get_n_bins(sub_r, &sub_rd);
 		// Have bound checks ...
 		as_bin stack_bins[(sub_r && !ns->storage_data_in_memory) ? sub_rd.n_bins : 0];
-		sub_rd.bins = as_bin_get_all(sub_r, &sub_rd, stack_bins);
+		if (n_leaf_ids != 0) {
+			sub_rd.bins = as_bin_get_some(sub_r, &sub_rd, stack_bins, leaf_ids, n_leaf_ids);
+		} else {
+			sub_rd.bins = as_bin_get_all(sub_r, &sub_rd, stack_bins);
+		}
 
 		// 3. Scan the current leaf
 		as_list *sl = as_ldt_leaf_scan(&sub_rd); 
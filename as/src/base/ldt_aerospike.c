@@ -324,6 +324,8 @@ slot_init(ldt_slot *lslotp, ldt_record *lrecord)
 
 	// We do not track microbenchmark or time for chunk today
 	c_tr->benchmark_time  = 0;
+	c_tr->stage_time      = 0;
+	memset(c_tr->stage_us, 0, sizeof(c_tr->stage_us));
 	c_tr->start_time           = h_tr->start_time;
 	c_tr->end_time             = h_tr->end_time;
 
@@ -0,0 +1,911 @@
+/*
+ * metrics.c
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/* SYNOPSIS
+ * Optional HTTP endpoint (network::info metrics-port) serving node, fabric,
+ * namespace, storage, set and latency stats in OpenMetrics text format, for
+ * scrapers that would otherwise poll and parse info commands. Stats are read
+ * straight from their structures - nothing goes through info dispatch, and
+ * scrapes don't compete with info transactions.
+ *
+ * One thread serves one connection at a time - scrapers are few, and a
+ * response is built in well under a millisecond. Latency histograms are the
+ * cumulative bucket counts, which is what OpenMetrics wants anyway.
+ *
+ * The same field tables back the stats-binary info command - fixed-size
+ * entries identified by table and index, so the tables may only be appended
+ * to without bumping STATS_SCHEMA_VERSION. Each snapshot's values are kept in
+ * a small ring, so a poller can ask for only what changed since its last one.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "base/metrics.h"
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "citrusleaf/alloc.h"
+#include "citrusleaf/cf_atomic.h"
+#include "citrusleaf/cf_b64.h"
+
+#include "dynbuf.h"
+#include "fault.h"
+#include "hist.h"
+#include "shard_counter.h"
+#include "socket.h"
+#include "vmapx.h"
+
+#include "base/cfg.h"
+#include "base/datamodel.h"
+#include "base/index.h"
+#include "base/stats.h"
+#include "storage/storage.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+#define MAX_REQUEST_SZ 4096
+#define IO_TIMEOUT_SEC 5
+
+// Latency buckets beyond this are only in +Inf.
+#define MAX_LE_SEC 131.072
+
+#define LABELS_SZ 256
+
+typedef enum {
+	METRIC_COUNTER,
+	METRIC_GAUGE,
+	METRIC_HISTOGRAM
+} metric_type;
+
+typedef enum {
+	FIELD_ATOMIC,
+	FIELD_SHARD
+} field_kind;
+
+typedef struct metric_field_s {
+	const char*	name;
+	metric_type	type;
+	field_kind	kind;
+	size_t		offset;
+} metric_field;
+
+#define STAT(_type, _name, _field) \
+	{ _name, _type, FIELD_ATOMIC, offsetof(as_stats, _field) }
+
+#define NS_STAT(_type, _name, _field) \
+	{ _name, _type, FIELD_ATOMIC, offsetof(as_namespace, _field) }
+
+#define NS_SHARD(_type, _name, _field) \
+	{ _name, _type, FIELD_SHARD, offsetof(as_namespace, _field) }
+
+static const metric_field NODE_FIELDS[] = {
+		STAT(METRIC_COUNTER, "client_connections_opened", proto_connections_opened),
+		STAT(METRIC_COUNTER, "client_connections_closed", proto_connections_closed),
+		STAT(METRIC_COUNTER, "heartbeat_connections_opened", heartbeat_connections_opened),
+		STAT(METRIC_COUNTER, "heartbeat_connections_closed", heartbeat_connections_closed),
+		STAT(METRIC_COUNTER, "heartbeat_received_self", heartbeat_received_self),
+		STAT(METRIC_COUNTER, "heartbeat_received_foreign", heartbeat_received_foreign),
+		STAT(METRIC_COUNTER, "info_complete", info_complete),
+		STAT(METRIC_COUNTER, "demarshal_error", n_demarshal_error),
+		STAT(METRIC_COUNTER, "tsvc_client_error", n_tsvc_client_error),
+		STAT(METRIC_COUNTER, "batch_index_complete", batch_index_complete),
+		STAT(METRIC_COUNTER, "batch_index_error", batch_index_errors),
+		STAT(METRIC_COUNTER, "batch_index_timeout", batch_index_timeout)
+};
+
+static const metric_field FABRIC_FIELDS[] = {
+		STAT(METRIC_COUNTER, "connections_opened", fabric_connections_opened),
+		STAT(METRIC_COUNTER, "connections_closed", fabric_connections_closed),
+		STAT(METRIC_COUNTER, "msgs_sent", fabric_msgs_sent),
+		STAT(METRIC_COUNTER, "msgs_rcvd", fabric_msgs_rcvd),
+		STAT(METRIC_COUNTER, "sends", fabric_sends),
+		STAT(METRIC_COUNTER, "msg_gets", fabric_msg_gets),
+		STAT(METRIC_COUNTER, "msg_cache_misses", fabric_msg_cache_misses),
+		STAT(METRIC_COUNTER, "msg_creates", fabric_msg_creates)
+};
+
+static const metric_field NS_FIELDS[] = {
+		NS_STAT(METRIC_GAUGE, "objects", n_objects),
+		NS_STAT(METRIC_GAUGE, "sub_objects", n_sub_objects),
+		NS_STAT(METRIC_GAUGE, "memory_used_data_bytes", n_bytes_memory),
+		NS_STAT(METRIC_GAUGE, "memory_used_sindex_bytes", sindex_data_memory_used),
+		NS_STAT(METRIC_COUNTER, "expired_objects", n_expired_objects),
+		NS_STAT(METRIC_COUNTER, "evicted_objects", n_evicted_objects),
+		NS_STAT(METRIC_COUNTER, "set_deleted_objects", n_deleted_set_objects),
+		NS_STAT(METRIC_COUNTER, "truncated_objects", n_truncated_objects),
+		NS_STAT(METRIC_COUNTER, "client_tsvc_error", n_client_tsvc_error),
+		NS_STAT(METRIC_COUNTER, "client_tsvc_timeout", n_client_tsvc_timeout),
+		NS_STAT(METRIC_COUNTER, "client_proxy_complete", n_client_proxy_complete),
+		NS_SHARD(METRIC_COUNTER, "client_read_success", n_client_read_success),
+		NS_SHARD(METRIC_COUNTER, "client_read_error", n_client_read_error),
+		NS_SHARD(METRIC_COUNTER, "client_read_timeout", n_client_read_timeout),
+		NS_SHARD(METRIC_COUNTER, "client_read_not_found", n_client_read_not_found),
+		NS_SHARD(METRIC_COUNTER, "client_write_success", n_client_write_success),
+		NS_SHARD(METRIC_COUNTER, "client_write_error", n_client_write_error),
+		NS_SHARD(METRIC_COUNTER, "client_write_timeout", n_client_write_timeout),
+		NS_SHARD(METRIC_COUNTER, "client_delete_success", n_client_delete_success),
+		NS_SHARD(METRIC_COUNTER, "client_delete_error", n_client_delete_error),
+		NS_SHARD(METRIC_COUNTER, "client_delete_timeout", n_client_delete_timeout),
+		NS_SHARD(METRIC_COUNTER, "client_delete_not_found", n_client_delete_not_found),
+		NS_STAT(METRIC_COUNTER, "client_udf_complete", n_client_udf_complete),
+		NS_STAT(METRIC_COUNTER, "client_udf_error", n_client_udf_error),
+		NS_STAT(METRIC_COUNTER, "client_udf_timeout", n_client_udf_timeout),
+		NS_STAT(METRIC_COUNTER, "tsvc_queue_waits", n_tsvc_queue_waits),
+		NS_STAT(METRIC_COUNTER, "tsvc_queue_wait_us", tsvc_queue_wait_us)
+};
+
+#define N_NODE_FIELDS (sizeof(NODE_FIELDS) / sizeof(metric_field))
+#define N_FABRIC_FIELDS (sizeof(FABRIC_FIELDS) / sizeof(metric_field))
+#define N_NS_FIELDS (sizeof(NS_FIELDS) / sizeof(metric_field))
+
+// Binary snapshots.
+#define STATS_SCHEMA_VERSION 1
+
+#define STATS_ID_NODE 0x0000
+#define STATS_ID_FABRIC 0x0100
+#define STATS_ID_NS 0x0200
+
+#define STATS_NS_IX_NONE 0xFF
+
+#define STATS_FLAG_FULL 0x01 // not a delta - 'since' wasn't held
+
+#define N_SNAPSHOTS 8 // a few pollers may each delta against their own
+#define MAX_SNAPSHOT_VALUES \
+	(N_NODE_FIELDS + N_FABRIC_FIELDS + (N_NS_FIELDS * AS_NAMESPACE_SZ))
+
+// All in host byte order.
+typedef struct stats_bin_header_s {
+	uint8_t		version;
+	uint8_t		flags;
+	uint16_t	n_namespaces;
+	uint32_t	seq; // pass as 'since' next time
+	uint32_t	since; // 0 if full
+	uint32_t	n_entries;
+} __attribute__((__packed__)) stats_bin_header;
+
+typedef struct stats_bin_entry_s {
+	uint16_t	id;
+	uint8_t		ns_ix; // STATS_NS_IX_NONE for node and fabric stats
+	uint8_t		type; // metric_type
+	uint64_t	value;
+} __attribute__((__packed__)) stats_bin_entry;
+
+typedef struct stats_snapshot_s {
+	uint32_t	seq; // 0 if slot unused
+	uint64_t	values[MAX_SNAPSHOT_VALUES];
+} stats_snapshot;
+
+
+//==========================================================
+// Globals.
+//
+
+static pthread_mutex_t g_snapshot_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t g_snapshot_seq = 0;
+static stats_snapshot g_snapshots[N_SNAPSHOTS];
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static void* run_metrics(void* arg);
+static void serve_connection(cf_socket* sock);
+static bool send_all(cf_socket* sock, const void* buf, size_t sz);
+
+static void append_fields(cf_dyn_buf* db, const char* prefix, const metric_field* fields, uint32_t n_fields, const void* base);
+static void append_namespace_metrics(cf_dyn_buf* db);
+static void append_storage_metrics(cf_dyn_buf* db);
+static void append_set_metrics(cf_dyn_buf* db);
+static void append_latency_metrics(cf_dyn_buf* db);
+static void append_family(cf_dyn_buf* db, const char* name, metric_type type);
+static void append_sample(cf_dyn_buf* db, const char* name, const char* suffix, const char* labels, uint64_t value);
+static void append_histogram(cf_dyn_buf* db, const char* name, const char* labels, histogram* h);
+static void format_labels(char* labels, const char* ns_name, const char* set_name, const char* op);
+
+static uint32_t collect_values(uint64_t* values, stats_bin_entry* entries);
+static void append_schema_fields(cf_dyn_buf* db, uint16_t base_id, const metric_field* fields, uint32_t n_fields);
+
+static inline uint64_t
+field_value(const metric_field* f, const void* base)
+{
+	const uint8_t* p = (const uint8_t*)base + f->offset;
+
+	return f->kind == FIELD_SHARD ?
+			cf_shard_counter_get((const cf_shard_counter*)p) :
+			cf_atomic64_get(*(const cf_atomic64*)p);
+}
+
+
+//==========================================================
+// Public API.
+//
+
+void
+as_metrics_start()
+{
+	if (g_config.metrics_port == 0) {
+		return;
+	}
+
+	pthread_t thread;
+	pthread_attr_t attrs;
+
+	pthread_attr_init(&attrs);
+	pthread_attr_setdetachstate(&attrs, PTHREAD_CREATE_DETACHED);
+
+	if (pthread_create(&thread, &attrs, run_metrics, NULL) != 0) {
+		cf_crash(AS_INFO, "failed to create metrics thread");
+	}
+}
+
+// The whole exposition - also usable without the endpoint, e.g. for testing.
+void
+as_metrics_get(cf_dyn_buf* db)
+{
+	append_fields(db, "aerospike_node_", NODE_FIELDS, N_NODE_FIELDS,
+			&g_stats);
+	append_fields(db, "aerospike_fabric_", FABRIC_FIELDS, N_FABRIC_FIELDS,
+			&g_stats);
+	append_namespace_metrics(db);
+	append_storage_metrics(db);
+	append_set_metrics(db);
+	append_latency_metrics(db);
+
+	cf_dyn_buf_append_string(db, "# EOF\n");
+}
+
+void
+as_metrics_get_binary(uint32_t since, cf_dyn_buf* db)
+{
+	uint64_t values[MAX_SNAPSHOT_VALUES];
+	stats_bin_entry all[MAX_SNAPSHOT_VALUES];
+	uint32_t n_values = collect_values(values, all);
+
+	// Header plus entries - at most all of them.
+	uint8_t bin[sizeof(stats_bin_header) +
+				(MAX_SNAPSHOT_VALUES * sizeof(stats_bin_entry))];
+	stats_bin_header* hdr = (stats_bin_header*)bin;
+	stats_bin_entry* entries = (stats_bin_entry*)(bin + sizeof(*hdr));
+
+	pthread_mutex_lock(&g_snapshot_lock);
+
+	const stats_snapshot* prev = NULL;
+
+	for (uint32_t i = 0; since != 0 && i < N_SNAPSHOTS; i++) {
+		if (g_snapshots[i].seq == since) {
+			prev = &g_snapshots[i];
+			break;
+		}
+	}
+
+	uint32_t n_entries = 0;
+
+	for (uint32_t v = 0; v < n_values; v++) {
+		if (! prev || prev->values[v] != values[v]) {
+			entries[n_entries++] = all[v];
+		}
+	}
+
+	if (++g_snapshot_seq == 0) {
+		g_snapshot_seq = 1;
+	}
+
+	stats_snapshot* slot = &g_snapshots[g_snapshot_seq % N_SNAPSHOTS];
+
+	slot->seq = g_snapshot_seq;
+	memcpy(slot->values, values, n_values * sizeof(uint64_t));
+
+	hdr->seq = g_snapshot_seq;
+
+	pthread_mutex_unlock(&g_snapshot_lock);
+
+	hdr->version = STATS_SCHEMA_VERSION;
+	hdr->flags = prev ? 0 : STATS_FLAG_FULL;
+	hdr->n_namespaces = (uint16_t)g_config.n_namespaces;
+	hdr->since = prev ? since : 0;
+	hdr->n_entries = n_entries;
+
+	uint32_t bin_sz = (uint32_t)(sizeof(*hdr) +
+			(n_entries * sizeof(stats_bin_entry)));
+	uint32_t b64_sz = cf_b64_encoded_len(bin_sz);
+	uint8_t* b64;
+
+	cf_dyn_buf_reserve(db, b64_sz, &b64);
+	cf_b64_encode(bin, bin_sz, (char*)b64);
+}
+
+// Decoding key for stats-binary, as
+// "version=...;namespaces=ns1,ns2;<id>=<type>:<name>;...".
+void
+as_metrics_get_schema(cf_dyn_buf* db)
+{
+	cf_dyn_buf_append_string(db, "version=");
+	cf_dyn_buf_append_uint32(db, STATS_SCHEMA_VERSION);
+	cf_dyn_buf_append_string(db, ";namespaces=");
+
+	for (uint32_t ns_ix = 0; ns_ix < g_config.n_namespaces; ns_ix++) {
+		if (ns_ix != 0) {
+			cf_dyn_buf_append_char(db, ',');
+		}
+
+		cf_dyn_buf_append_string(db, g_config.namespaces[ns_ix]->name);
+	}
+
+	append_schema_fields(db, STATS_ID_NODE, NODE_FIELDS, N_NODE_FIELDS);
+	append_schema_fields(db, STATS_ID_FABRIC, FABRIC_FIELDS, N_FABRIC_FIELDS);
+	append_schema_fields(db, STATS_ID_NS, NS_FIELDS, N_NS_FIELDS);
+}
+
+
+//==========================================================
+// Local helpers - endpoint.
+//
+
+static void*
+run_metrics(void* arg)
+{
+	// Like the info port, this starts after privilege de-escalation, so can't
+	// use privileged ports.
+	cf_socket_cfg metrics_socket;
+
+	metrics_socket.addr = cf_strdup("0.0.0.0");
+	metrics_socket.type = SOCK_STREAM;
+	metrics_socket.port = g_config.metrics_port;
+	metrics_socket.reuse_addr = g_config.socket_reuse_addr ? true : false;
+	metrics_socket.reuse_port = false;
+
+	if (cf_socket_init_server(&metrics_socket) != 0) {
+		cf_crash(AS_INFO, "couldn't initialize metrics socket");
+	}
+
+	cf_info(AS_INFO, "serving metrics on port %d", g_config.metrics_port);
+
+	while (true) {
+		cf_socket* sock;
+		cf_sock_addr sa;
+
+		if (cf_socket_accept(metrics_socket.sock, &sock, &sa) < 0) {
+			cf_detail(AS_INFO, "metrics accept failed: %s",
+					cf_strerror(errno));
+			continue;
+		}
+
+		serve_connection(sock);
+		cf_socket_close(sock);
+	}
+
+	return NULL;
+}
+
+static void
+serve_connection(cf_socket* sock)
+{
+	struct timeval tv = { .tv_sec = IO_TIMEOUT_SEC, .tv_usec = 0 };
+
+	// A stalled scraper mustn't hold up the next one for long.
+	setsockopt(CSFD(sock), SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	setsockopt(CSFD(sock), SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+	char req[MAX_REQUEST_SZ];
+	size_t req_sz = 0;
+
+	// Only need the request line - but read the headers so the close is clean.
+	while (true) {
+		int32_t n = cf_socket_recv(sock, req + req_sz, sizeof(req) - 1 - req_sz,
+				0);
+
+		if (n <= 0) {
+			return;
+		}
+
+		req_sz += (size_t)n;
+		req[req_sz] = 0;
+
+		if (strstr(req, "\r\n\r\n") || strstr(req, "\n\n")) {
+			break;
+		}
+
+		if (req_sz == sizeof(req) - 1) {
+			break; // oversized headers - the request line is all we use
+		}
+	}
+
+	const char* status = NULL;
+
+	if (strncmp(req, "GET ", 4) != 0) {
+		status = "405 Method Not Allowed";
+	}
+	else if (strncmp(req + 4, "/metrics ", 9) != 0 &&
+			strncmp(req + 4, "/ ", 2) != 0) {
+		status = "404 Not Found";
+	}
+
+	cf_dyn_buf_define_size(db, 64 * 1024);
+
+	if (! status) {
+		status = "200 OK";
+		as_metrics_get(&db);
+	}
+
+	char header[256];
+	int header_sz = snprintf(header, sizeof(header),
+			"HTTP/1.1 %s\r\n"
+			"Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+			"Content-Length: %zu\r\n"
+			"Connection: close\r\n\r\n", status, db.used_sz);
+
+	if (send_all(sock, header, (size_t)header_sz)) {
+		send_all(sock, db.buf, db.used_sz);
+	}
+
+	cf_dyn_buf_free(&db);
+}
+
+static bool
+send_all(cf_socket* sock, const void* buf, size_t sz)
+{
+	const uint8_t* p = (const uint8_t*)buf;
+
+	while (sz != 0) {
+		int32_t n = cf_socket_send(sock, (void*)p, sz, MSG_NOSIGNAL);
+
+		if (n <= 0) {
+			return false;
+		}
+
+		p += n;
+		sz -= (size_t)n;
+	}
+
+	return true;
+}
+
+
+//==========================================================
+// Local helpers - exposition.
+//
+
+static void
+append_fields(cf_dyn_buf* db, const char* prefix, const metric_field* fields,
+		uint32_t n_fields, const void* base)
+{
+	char name[128];
+
+	for (uint32_t i = 0; i < n_fields; i++) {
+		const metric_field* f = &fields[i];
+
+		snprintf(name, sizeof(name), "%s%s", prefix, f->name);
+		append_family(db, name, f->type);
+		append_sample(db, name, f->type == METRIC_COUNTER ? "_total" : "",
+				NULL, field_value(f, base));
+	}
+}
+
+// Families outermost - OpenMetrics wants each family's samples together.
+static void
+append_namespace_metrics(cf_dyn_buf* db)
+{
+	char name[128];
+	char labels[LABELS_SZ];
+
+	for (uint32_t i = 0; i < N_NS_FIELDS; i++) {
+		const metric_field* f = &NS_FIELDS[i];
+
+		snprintf(name, sizeof(name), "aerospike_namespace_%s", f->name);
+		append_family(db, name, f->type);
+
+		for (uint32_t ns_ix = 0; ns_ix < g_config.n_namespaces; ns_ix++) {
+			as_namespace* ns = g_config.namespaces[ns_ix];
+
+			format_labels(labels, ns->name, NULL, NULL);
+			append_sample(db, name,
+					f->type == METRIC_COUNTER ? "_total" : "", labels,
+					field_value(f, ns));
+		}
+	}
+
+	append_family(db, "aerospike_namespace_memory_used_index_bytes",
+			METRIC_GAUGE);
+
+	for (uint32_t ns_ix = 0; ns_ix < g_config.n_namespaces; ns_ix++) {
+		as_namespace* ns = g_config.namespaces[ns_ix];
+
+		format_labels(labels, ns->name, NULL, NULL);
+		append_sample(db, "aerospike_namespace_memory_used_index_bytes", "",
+				labels, ns->index_flash_path ? 0 : as_index_size_get(ns) *
+						(ns->n_objects + ns->n_sub_objects));
+	}
+
+	append_family(db, "aerospike_namespace_memory_size_bytes", METRIC_GAUGE);
+
+	for (uint32_t ns_ix = 0; ns_ix < g_config.n_namespaces; ns_ix++) {
+		as_namespace* ns = g_config.namespaces[ns_ix];
+
+		format_labels(labels, ns->name, NULL, NULL);
+		append_sample(db, "aerospike_namespace_memory_size_bytes", "", labels,
+				ns->memory_size);
+	}
+
+	append_family(db, "aerospike_namespace_stop_writes", METRIC_GAUGE);
+
+	for (uint32_t ns_ix = 0; ns_ix < g_config.n_namespaces; ns_ix++) {
+		as_namespace* ns = g_config.namespaces[ns_ix];
+
+		format_labels(labels, ns->name, NULL, NULL);
+		append_sample(db, "aerospike_namespace_stop_writes", "", labels,
+				cf_atomic32_get(ns->stop_writes) != 0 ? 1 : 0);
+	}
+
+	append_family(db, "aerospike_namespace_hwm_breached", METRIC_GAUGE);
+
+	for (uint32_t ns_ix = 0; ns_ix < g_config.n_namespaces; ns_ix++) {
+		as_namespace* ns = g_config.namespaces[ns_ix];
+
+		format_labels(labels, ns->name, NULL, NULL);
+		append_sample(db, "aerospike_namespace_hwm_breached", "", labels,
+				cf_atomic32_get(ns->hwm_breached) != 0 ? 1 : 0);
+	}
+}
+
+// Device stats - namespaces without devices are left out.
+static void
+append_storage_metrics(cf_dyn_buf* db)
+{
+	int available_pcts[AS_NAMESPACE_SZ];
+	uint64_t used_bytes[AS_NAMESPACE_SZ];
+	char labels[LABELS_SZ];
+
+	for (uint32_t ns_ix = 0; ns_ix < g_config.n_namespaces; ns_ix++) {
+		as_namespace* ns = g_config.namespaces[ns_ix];
+
+		available_pcts[ns_ix] = 0;
+		used_bytes[ns_ix] = 0;
+
+		if (ns->storage_type == AS_STORAGE_ENGINE_SSD) {
+			as_storage_stats(ns, &available_pcts[ns_ix], &used_bytes[ns_ix]);
+		}
+	}
+
+	append_family(db, "aerospike_storage_device_total_bytes", METRIC_GAUGE);
+
+	for (uint32_t ns_ix = 0; ns_ix < g_config.n_namespaces; ns_ix++) {
+		as_namespace* ns = g_config.namespaces[ns_ix];
+
+		if (ns->storage_type == AS_STORAGE_ENGINE_SSD) {
+			format_labels(labels, ns->name, NULL, NULL);
+			append_sample(db, "aerospike_storage_device_total_bytes", "",
+					labels, ns->ssd_size);
+		}
+	}
+
+	append_family(db, "aerospike_storage_device_used_bytes", METRIC_GAUGE);
+
+	for (uint32_t ns_ix = 0; ns_ix < g_config.n_namespaces; ns_ix++) {
+		as_namespace* ns = g_config.namespaces[ns_ix];
+
+		if (ns->storage_type == AS_STORAGE_ENGINE_SSD) {
+			format_labels(labels, ns->name, NULL, NULL);
+			append_sample(db, "aerospike_storage_device_used_bytes", "",
+					labels, used_bytes[ns_ix]);
+		}
+	}
+
+	append_family(db, "aerospike_storage_device_available_pct", METRIC_GAUGE);
+
+	for (uint32_t ns_ix = 0; ns_ix < g_config.n_namespaces; ns_ix++) {
+		as_namespace* ns = g_config.namespaces[ns_ix];
+
+		if (ns->storage_type == AS_STORAGE_ENGINE_SSD) {
+			format_labels(labels, ns->name, NULL, NULL);
+			append_sample(db, "aerospike_storage_device_available_pct", "",
+					labels, (uint64_t)available_pcts[ns_ix]);
+		}
+	}
+}
+
+static void
+append_set_metrics(cf_dyn_buf* db)
+{
+	static const struct {
+		const char* name;
+		size_t offset;
+	} SET_FIELDS[] = {
+			{ "aerospike_set_objects", offsetof(as_set, num_elements) },
+			{ "aerospike_set_memory_data_bytes", offsetof(as_set, n_bytes_memory) },
+			{ "aerospike_set_device_data_bytes", offsetof(as_set, n_bytes_device) }
+	};
+
+	char labels[LABELS_SZ];
+
+	for (uint32_t i = 0; i < sizeof(SET_FIELDS) / sizeof(SET_FIELDS[0]); i++) {
+		append_family(db, SET_FIELDS[i].name, METRIC_GAUGE);
+
+		for (uint32_t ns_ix = 0; ns_ix < g_config.n_namespaces; ns_ix++) {
+			as_namespace* ns = g_config.namespaces[ns_ix];
+			uint32_t n_sets = cf_vmapx_count(ns->p_sets_vmap);
+
+			for (uint32_t idx = 0; idx < n_sets; idx++) {
+				as_set* p_set;
+
+				if (cf_vmapx_get_by_index(ns->p_sets_vmap, idx,
+						(void**)&p_set) != CF_VMAPX_OK) {
+					continue;
+				}
+
+				const cf_atomic64* p_value = (const cf_atomic64*)
+						((const uint8_t*)p_set + SET_FIELDS[i].offset);
+
+				format_labels(labels, ns->name, p_set->name, NULL);
+				append_sample(db, SET_FIELDS[i].name, "", labels,
+						cf_atomic64_get(*p_value));
+			}
+		}
+	}
+}
+
+static void
+append_latency_metrics(cf_dyn_buf* db)
+{
+	char labels[LABELS_SZ];
+
+	append_family(db, "aerospike_namespace_latency_seconds", METRIC_HISTOGRAM);
+
+	for (uint32_t ns_ix = 0; ns_ix < g_config.n_namespaces; ns_ix++) {
+		as_namespace* ns = g_config.namespaces[ns_ix];
+
+		format_labels(labels, ns->name, NULL, "read");
+		append_histogram(db, "aerospike_namespace_latency_seconds", labels,
+				(histogram*)ns->read_hist);
+
+		format_labels(labels, ns->name, NULL, "write");
+		append_histogram(db, "aerospike_namespace_latency_seconds", labels,
+				(histogram*)ns->write_hist);
+
+		format_labels(labels, ns->name, NULL, "udf");
+		append_histogram(db, "aerospike_namespace_latency_seconds", labels,
+				(histogram*)ns->udf_hist);
+
+		format_labels(labels, ns->name, NULL, "query");
+		append_histogram(db, "aerospike_namespace_latency_seconds", labels,
+				(histogram*)ns->query_hist);
+	}
+
+	append_family(db, "aerospike_set_latency_seconds", METRIC_HISTOGRAM);
+
+	for (uint32_t ns_ix = 0; ns_ix < g_config.n_namespaces; ns_ix++) {
+		as_namespace* ns = g_config.namespaces[ns_ix];
+
+		if (cf_atomic32_get(ns->n_set_latency_enabled) == 0) {
+			continue;
+		}
+
+		uint32_t n_sets = cf_vmapx_count(ns->p_sets_vmap);
+
+		for (uint32_t idx = 0; idx < n_sets; idx++) {
+			uint16_t set_id = (uint16_t)(idx + 1);
+			as_set* p_set;
+
+			if (! ns->set_latency_enabled[set_id] ||
+					cf_vmapx_get_by_index(ns->p_sets_vmap, idx,
+							(void**)&p_set) != CF_VMAPX_OK) {
+				continue;
+			}
+
+			format_labels(labels, ns->name, p_set->name, "read");
+			append_histogram(db, "aerospike_set_latency_seconds", labels,
+					(histogram*)ns->set_read_hists[set_id]);
+
+			format_labels(labels, ns->name, p_set->name, "write");
+			append_histogram(db, "aerospike_set_latency_seconds", labels,
+					(histogram*)ns->set_write_hists[set_id]);
+
+			format_labels(labels, ns->name, p_set->name, "udf");
+			append_histogram(db, "aerospike_set_latency_seconds", labels,
+					(histogram*)ns->set_udf_hists[set_id]);
+
+			format_labels(labels, ns->name, p_set->name, "query");
+			append_histogram(db, "aerospike_set_latency_seconds", labels,
+					(histogram*)ns->set_query_hists[set_id]);
+		}
+	}
+}
+
+static void
+append_family(cf_dyn_buf* db, const char* name, metric_type type)
+{
+	static const char* TYPE_NAMES[] = { " counter\n", " gauge\n", " histogram\n" };
+
+	cf_dyn_buf_append_string(db, "# TYPE ");
+	cf_dyn_buf_append_string(db, name);
+	cf_dyn_buf_append_string(db, TYPE_NAMES[type]);
+}
+
+static void
+append_sample(cf_dyn_buf* db, const char* name, const char* suffix,
+		const char* labels, uint64_t value)
+{
+	cf_dyn_buf_append_string(db, name);
+	cf_dyn_buf_append_string(db, suffix);
+
+	if (labels && *labels) {
+		cf_dyn_buf_append_char(db, '{');
+		cf_dyn_buf_append_string(db, labels);
+		cf_dyn_buf_append_char(db, '}');
+	}
+
+	cf_dyn_buf_append_char(db, ' ');
+	cf_dyn_buf_append_uint64(db, value);
+	cf_dyn_buf_append_char(db, '\n');
+}
+
+// Bucket b holds values below 2^b units - a fixed set of bounds, so series
+// stay comparable across scrapes.
+static void
+append_histogram(cf_dyn_buf* db, const char* name, const char* labels,
+		histogram* h)
+{
+	if (! h || h->time_div == 0) {
+		return;
+	}
+
+	uint64_t counts[N_BUCKETS];
+
+	histogram_get_counts(h, counts);
+
+	double unit_sec = (double)h->time_div / 1000000000.0;
+	uint64_t cumulative = 0;
+	int b = 0;
+
+	for ( ; b < N_BUCKETS && ldexp(unit_sec, b) <= MAX_LE_SEC; b++) {
+		cumulative += counts[b];
+
+		cf_dyn_buf_append_string(db, name);
+		cf_dyn_buf_append_string(db, "_bucket{");
+		cf_dyn_buf_append_string(db, labels);
+
+		char le[64];
+
+		snprintf(le, sizeof(le), ",le=\"%g\"} ", ldexp(unit_sec, b));
+		cf_dyn_buf_append_string(db, le);
+		cf_dyn_buf_append_uint64(db, cumulative);
+		cf_dyn_buf_append_char(db, '\n');
+	}
+
+	for ( ; b < N_BUCKETS; b++) {
+		cumulative += counts[b];
+	}
+
+	cf_dyn_buf_append_string(db, name);
+	cf_dyn_buf_append_string(db, "_bucket{");
+	cf_dyn_buf_append_string(db, labels);
+	cf_dyn_buf_append_string(db, ",le=\"+Inf\"} ");
+	cf_dyn_buf_append_uint64(db, cumulative);
+	cf_dyn_buf_append_char(db, '\n');
+
+	append_sample(db, name, "_count", labels, cumulative);
+}
+
+// Escapes a label value per the exposition format, truncating if need be.
+static void
+append_label(char* labels, const char* key, const char* value)
+{
+	size_t len = strlen(labels);
+	char* at = labels + len;
+	char* end = labels + LABELS_SZ - 2; // room for closing quote and null
+
+	at += snprintf(at, LABELS_SZ - len, "%s%s=\"", len == 0 ? "" : ",", key);
+
+	for (const char* v = value; *v && at + 1 < end; v++) {
+		if (*v == '\\' || *v == '"' || *v == '\n') {
+			*at++ = '\\';
+			*at++ = *v == '\n' ? 'n' : *v;
+		}
+		else {
+			*at++ = *v;
+		}
+	}
+
+	*at++ = '"';
+	*at = 0;
+}
+
+static void
+format_labels(char* labels, const char* ns_name, const char* set_name,
+		const char* op)
+{
+	labels[0] = 0;
+
+	append_label(labels, "ns", ns_name);
+
+	if (set_name) {
+		append_label(labels, "set", set_name);
+	}
+
+	if (op) {
+		append_label(labels, "op", op);
+	}
+}
+
+
+//==========================================================
+// Local helpers - binary snapshots.
+//
+
+// Values and their full entries, in schema order - node, fabric, then each
+// namespace's.
+static uint32_t
+collect_values(uint64_t* values, stats_bin_entry* entries)
+{
+	uint32_t n = 0;
+
+	for (uint32_t i = 0; i < N_NODE_FIELDS; i++, n++) {
+		values[n] = field_value(&NODE_FIELDS[i], &g_stats);
+		entries[n] = (stats_bin_entry){ (uint16_t)(STATS_ID_NODE + i),
+				STATS_NS_IX_NONE, (uint8_t)NODE_FIELDS[i].type, values[n] };
+	}
+
+	for (uint32_t i = 0; i < N_FABRIC_FIELDS; i++, n++) {
+		values[n] = field_value(&FABRIC_FIELDS[i], &g_stats);
+		entries[n] = (stats_bin_entry){ (uint16_t)(STATS_ID_FABRIC + i),
+				STATS_NS_IX_NONE, (uint8_t)FABRIC_FIELDS[i].type, values[n] };
+	}
+
+	for (uint32_t ns_ix = 0; ns_ix < g_config.n_namespaces; ns_ix++) {
+		as_namespace* ns = g_config.namespaces[ns_ix];
+
+		for (uint32_t i = 0; i < N_NS_FIELDS; i++, n++) {
+			values[n] = field_value(&NS_FIELDS[i], ns);
+			entries[n] = (stats_bin_entry){ (uint16_t)(STATS_ID_NS + i),
+					(uint8_t)ns_ix, (uint8_t)NS_FIELDS[i].type, values[n] };
+		}
+	}
+
+	return n;
+}
+
+static void
+append_schema_fields(cf_dyn_buf* db, uint16_t base_id,
+		const metric_field* fields, uint32_t n_fields)
+{
+	for (uint32_t i = 0; i < n_fields; i++) {
+		cf_dyn_buf_append_char(db, ';');
+		cf_dyn_buf_append_uint32(db, base_id + i);
+		cf_dyn_buf_append_string(db,
+				fields[i].type == METRIC_COUNTER ? "=counter:" : "=gauge:");
+		cf_dyn_buf_append_string(db, fields[i].name);
+	}
+}
@@ -26,6 +26,7 @@
  */
 
 #include <limits.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -38,6 +39,7 @@
 #include "dynbuf.h"
 #include "fault.h"
 #include "hist.h"
+#include "hist_track.h"
 #include "jem.h"
 #include "linear_hist.h"
 #include "meminfo.h"
@@ -45,6 +47,7 @@
 
 #include "base/cfg.h"
 #include "base/datamodel.h"
+#include "base/dim_slab.h"
 #include "base/index.h"
 #include "base/proto.h"
 #include "base/secondary_index.h"
@@ -54,6 +57,20 @@
 
 static as_namespace_id g_namespace_id_counter = 0;
 
+const char* const as_stage_names[AS_NUM_STAGES] = {
+	"read-queue",
+	"read-dup-res",
+	"read-lock",
+	"read-storage",
+	"read-response",
+	"write-queue",
+	"write-dup-res",
+	"write-lock",
+	"write-master",
+	"write-repl-write",
+	"write-response"
+};
+
 // Create a new namespace and hook it up in the data structure
 
 as_namespace *
@@ -81,7 +98,8 @@ as_namespace_create(char *name, uint16_t replication_factor)
 		}
 	}
 
-	as_namespace *ns = cf_malloc(sizeof(as_namespace));
+	// Aligned, for the cache-line layout of the counters.
+	as_namespace *ns = cf_valloc(sizeof(as_namespace));
 	cf_assert(ns, AS_NAMESPACE, CF_CRITICAL, "%s as_namespace allocation failed", name);
 
 	// Set all members 0/NULL/false to start with.
@@ -116,6 +134,8 @@ as_namespace_create(char *name, uint16_t replication_factor)
 	ns->ns_forward_xdr_writes = false; // forwarding of xdr writes is disabled by default
 	ns->ns_allow_nonxdr_writes = true; // allow nonxdr writes by default
 	ns->ns_allow_xdr_writes = true; // allow xdr writes by default
+	ns->async_replication = false;
+	ns->async_replication_max_lag = 64 * 1024 * 1024; // refuse writes when a destination is 64M behind
 	ns->cold_start_evict_ttl = 0xFFFFffff; // unless this is specified via config file, use evict void-time saved in device header
 	ns->conflict_resolution_policy = AS_NAMESPACE_CONFLICT_RESOLUTION_POLICY_GENERATION;
 	ns->data_in_index = false;
@@ -123,14 +143,21 @@ as_namespace_create(char *name, uint16_t replication_factor)
 	ns->evict_tenths_pct = 5; // default eviction amount is 0.5%
 	ns->hwm_disk = 0.5; // default high water mark for eviction is 50%
 	ns->hwm_memory = 0.6; // default high water mark for eviction is 60%
+	ns->index_numa_policy = AS_INDEX_NUMA_POLICY_NONE; // default is kernel's placement policy
+	ns->index_page_size = 4 * 1024; // default is normal pages
 	ns->ldt_enabled = false; // By default ldt is not enabled
 	ns->ldt_gc_sleep_us = 500; // Default is sleep for .5Ms. This translates to constant 2k Subrecord
 							   // GC per second.
 	ns->ldt_page_size = 8192; // default ldt page size is 8192
 	ns->max_ttl = MAX_ALLOWED_TTL; // 10 years
+	ns->memory_snapshot_max_write_rate = 64 * 1024 * 1024; // bytes per second for periodic snapshots
+	ns->memory_snapshot_period = 60 * 60;
+	ns->memory_snapshot_threads = 8; // also used to load the snapshot at startup
+	ns->migrate_changelog_max_age = 60 * 10;
 	ns->migrate_order = 5;
 	ns->migrate_sleep = 1;
 	ns->obj_size_hist_max = OBJ_SIZE_HIST_NUM_BUCKETS;
+	ns->tree_sprigs = 1; // each partition tree has one sprig, i.e. isn't split
 	ns->single_bin = false;
 	ns->stop_writes_pct = 0.9; // stop writes when 90% of either memory or disk is used
 
@@ -148,19 +175,31 @@ as_namespace_create(char *name, uint16_t replication_factor)
 	ns->storage_filesize = 1024LL * 1024LL * 1024LL * 16LL; // default file size is 16G per file
 	ns->storage_scheduler_mode = NULL; // null indicates default is to not change scheduler mode
 	ns->storage_write_block_size = 1024 * 1024;
+	ns->storage_cold_start_threads = 1; // threads per device to sweep device at cold start
 	ns->storage_defrag_lwm_pct = 50; // defrag if occupancy of block is < 50%
 	ns->storage_defrag_queue_min = 0; // don't defrag unless the queue has this many eligible wblocks (0: defrag anything queued)
 	ns->storage_defrag_sleep = 1000; // sleep this many microseconds between each wblock
+	ns->storage_defrag_adaptive = false; // if true, scale defrag-sleep by device load
 	ns->storage_defrag_startup_minimum = 10; // defrag until >= 10% disk is writable before joining cluster
+	ns->storage_fast_restart = false; // if true, and data not in memory, keep index in shared memory for warm restart
 	ns->storage_flush_max_us = 1000 * 1000; // wait this many microseconds before flushing inactive current write buffer (0 = never)
 	ns->storage_fsync_max_us = 0; // fsync interval in microseconds (0 = never)
+	ns->storage_max_flush_size = 0; // largest coalesced device write (0 = write-block-size, i.e. don't coalesce)
 	ns->storage_max_write_cache = 1024 * 1024 * 64;
 	ns->storage_min_avail_pct = 5; // stop writes when < 5% disk is writable
 	ns->storage_num_write_blocks = 64; // number of write blocks to use with KV store devices
 	ns->storage_post_write_queue = 256; // number of wblocks per device used as post-write cache
+	ns->storage_read_cache_size = 0; // bytes of memory for caching records read from device (0 = no cache)
+	ns->storage_ldt_subrec_cache_size = 0; // bytes of memory for caching LDT sub-records read from device (0 = no cache)
+	ns->storage_shadow_max_write_cache = 1024 * 1024 * 64; // bytes of copied wblocks per device waiting for shadow
+	ns->storage_shadow_stop_writes_on_lag = true; // if true, fail writes when shadow can't keep up - else drop shadow writes
+	ns->storage_shadow_write_threads = 1;
+	ns->storage_compression = AS_STORAGE_COMPRESSION_NONE;
+	ns->storage_compression_level = 1; // favor speed over ratio
 	ns->storage_read_block_size = 64 * 1024; // size in bytes of read buffers to use with KV store devices
 	// [Note - current FusionIO maximum read buffer size is 1MB - 512B.]
 	ns->storage_write_threads = 1;
+	ns->storage_ttl_write_streams = 1; // records of all TTLs share current swbs
 
 	// SINDEX
 	ns->sindex_data_max_memory = ULONG_MAX;
@@ -206,6 +245,7 @@ as_namespaces_init(bool cold_start_cmd, uint32_t instance)
 		ns->cold_start = cold_start_cmd;
 
 		as_namespace_setup(ns, instance, stage_capacity);
+		as_dim_slab_init(ns);
 
 		// Done with temporary sets configuration array.
 		if (ns->sets_cfg_array) {
@@ -260,8 +300,12 @@ as_namespace_configure_sets(as_namespace *ns)
 
 			// Rewrite configurable metadata - config values may have changed.
 			p_set->stop_writes_count = ns->sets_cfg_array[i].stop_writes_count;
+			p_set->memory_quota = ns->sets_cfg_array[i].memory_quota;
+			p_set->disk_quota = ns->sets_cfg_array[i].disk_quota;
+			p_set->evict_priority = ns->sets_cfg_array[i].evict_priority;
 			p_set->disable_eviction = ns->sets_cfg_array[i].disable_eviction;
 			p_set->enable_xdr = ns->sets_cfg_array[i].enable_xdr;
+			p_set->set_index = ns->sets_cfg_array[i].set_index;
 		}
 		else if (result != CF_VMAPX_OK) {
 			// Maybe exceeded max sets allowed, but try failing gracefully.
@@ -394,9 +438,11 @@ as_namespace_eval_write_state(as_namespace *ns, bool *hwm_breached, bool *stop_w
 	}
 
 	// compute memory size of namespace
-	// compute index size - index is always stored in memory
-	uint64_t index_sz = cf_atomic_int_get(ns->n_objects) * as_index_size_get(ns);
-	uint64_t sub_index_sz = cf_atomic_int_get(ns->n_sub_objects) * as_index_size_get(ns);
+	// compute index size - unless the index is on flash, it's in memory
+	uint64_t index_sz = ns->index_flash_path ? 0 :
+			cf_atomic_int_get(ns->n_objects) * as_index_size_get(ns);
+	uint64_t sub_index_sz = ns->index_flash_path ? 0 :
+			cf_atomic_int_get(ns->n_sub_objects) * as_index_size_get(ns);
 	uint64_t sindex_sz = as_sindex_get_ns_memory_used(ns);
 	uint64_t data_in_memory_sz = cf_atomic_int_get(ns->n_bytes_memory);
 	uint64_t memory_sz = index_sz + sub_index_sz + data_in_memory_sz + sindex_sz;
@@ -681,16 +727,36 @@ append_set_props(as_set *p_set, cf_dyn_buf *db)
 	cf_dyn_buf_append_uint64(db, cf_atomic64_get(p_set->n_bytes_memory));
 	cf_dyn_buf_append_char(db, ':');
 
+	cf_dyn_buf_append_string(db, "device_data_bytes=");
+	cf_dyn_buf_append_uint64(db, cf_atomic64_get(p_set->n_bytes_device));
+	cf_dyn_buf_append_char(db, ':');
+
 	cf_dyn_buf_append_string(db, "deleting=");
 	cf_dyn_buf_append_string(db, IS_SET_DELETED(p_set) ? "true" : "false");
 	cf_dyn_buf_append_char(db, ':');
 
+	cf_dyn_buf_append_string(db, "truncate_lut=");
+	cf_dyn_buf_append_uint64(db, p_set->truncate_lut);
+	cf_dyn_buf_append_char(db, ':');
+
 	// Configuration:
 
 	cf_dyn_buf_append_string(db, "stop-writes-count=");
 	cf_dyn_buf_append_uint64(db, cf_atomic64_get(p_set->stop_writes_count));
 	cf_dyn_buf_append_char(db, ':');
 
+	cf_dyn_buf_append_string(db, "memory-quota=");
+	cf_dyn_buf_append_uint64(db, cf_atomic64_get(p_set->memory_quota));
+	cf_dyn_buf_append_char(db, ':');
+
+	cf_dyn_buf_append_string(db, "disk-quota=");
+	cf_dyn_buf_append_uint64(db, cf_atomic64_get(p_set->disk_quota));
+	cf_dyn_buf_append_char(db, ':');
+
+	cf_dyn_buf_append_string(db, "evict-priority=");
+	cf_dyn_buf_append_uint32(db, cf_atomic32_get(p_set->evict_priority));
+	cf_dyn_buf_append_char(db, ':');
+
 	cf_dyn_buf_append_string(db, "set-enable-xdr=");
 	if (cf_atomic32_get(p_set->enable_xdr) == AS_SET_ENABLE_XDR_TRUE) {
 		cf_dyn_buf_append_string(db, "true");
@@ -708,6 +774,10 @@ append_set_props(as_set *p_set, cf_dyn_buf *db)
 
 	cf_dyn_buf_append_string(db, "disable-eviction=");
 	cf_dyn_buf_append_string(db, IS_SET_EVICTION_DISABLED(p_set) ? "true" : "false");
+	cf_dyn_buf_append_char(db, ':');
+
+	cf_dyn_buf_append_string(db, "set-index=");
+	cf_dyn_buf_append_string(db, cf_atomic32_get(p_set->set_index) != 0 ? "true" : "false");
 	cf_dyn_buf_append_char(db, ';');
 }
 
@@ -757,6 +827,26 @@ as_namespace_adjust_set_memory(as_namespace *ns, uint16_t set_id,
 	}
 }
 
+void
+as_namespace_adjust_set_device(as_namespace *ns, uint16_t set_id,
+		int64_t delta_bytes)
+{
+	if (set_id == INVALID_SET_ID) {
+		return;
+	}
+
+	as_set *p_set;
+
+	if (cf_vmapx_get_by_index(ns->p_sets_vmap, set_id - 1, (void**)&p_set) != CF_VMAPX_OK) {
+		cf_warning(AS_NAMESPACE, "set_id %u - failed to get as_set from vmap", set_id);
+		return;
+	}
+
+	if (cf_atomic64_add(&p_set->n_bytes_device, delta_bytes) < 0) {
+		cf_warning(AS_NAMESPACE, "set_id %u - n_bytes_device went negative!", set_id);
+	}
+}
+
 void
 as_namespace_release_set_id(as_namespace *ns, uint16_t set_id)
 {
@@ -775,6 +865,70 @@ as_namespace_release_set_id(as_namespace *ns, uint16_t set_id)
 	}
 }
 
+// Only called via set-config, for one set at a time.
+void
+as_namespace_enable_set_latency(as_namespace *ns, uint16_t set_id, bool enable)
+{
+	static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+	pthread_mutex_lock(&lock);
+
+	if (enable && ! ns->set_read_hists[set_id]) {
+		const char *set_name = as_namespace_get_set_name(ns, set_id);
+		char hist_name[HISTOGRAM_NAME_SIZE];
+
+		sprintf(hist_name, "{%s}-set-%s-read", ns->name, set_name);
+		create_and_check_hist_track(&ns->set_read_hists[set_id], hist_name, HIST_MILLISECONDS);
+
+		sprintf(hist_name, "{%s}-set-%s-write", ns->name, set_name);
+		create_and_check_hist_track(&ns->set_write_hists[set_id], hist_name, HIST_MILLISECONDS);
+
+		sprintf(hist_name, "{%s}-set-%s-udf", ns->name, set_name);
+		create_and_check_hist_track(&ns->set_udf_hists[set_id], hist_name, HIST_MILLISECONDS);
+
+		sprintf(hist_name, "{%s}-set-%s-query", ns->name, set_name);
+		create_and_check_hist_track(&ns->set_query_hists[set_id], hist_name, HIST_MILLISECONDS);
+
+		if (g_config.hist_track_precision != 0) {
+			cf_hist_track_enable_percentiles(ns->set_read_hists[set_id], g_config.hist_track_precision);
+			cf_hist_track_enable_percentiles(ns->set_write_hists[set_id], g_config.hist_track_precision);
+			cf_hist_track_enable_percentiles(ns->set_udf_hists[set_id], g_config.hist_track_precision);
+			cf_hist_track_enable_percentiles(ns->set_query_hists[set_id], g_config.hist_track_precision);
+		}
+	}
+
+	// Histograms are complete before they're visible to transactions.
+	if (ns->set_latency_enabled[set_id] != enable) {
+		ns->set_latency_enabled[set_id] = enable;
+
+		if (enable) {
+			cf_atomic32_incr(&ns->n_set_latency_enabled);
+		}
+		else {
+			cf_atomic32_decr(&ns->n_set_latency_enabled);
+		}
+	}
+
+	pthread_mutex_unlock(&lock);
+}
+
+// Returns INVALID_SET_ID unless the set has latency histograms enabled.
+uint16_t
+as_namespace_get_latency_set_id(as_namespace *ns, const char *set_name,
+		size_t len)
+{
+	uint32_t idx;
+
+	if (len == 0 || cf_vmapx_get_index_w_len(ns->p_sets_vmap, set_name, len,
+			&idx) != CF_VMAPX_OK) {
+		return INVALID_SET_ID;
+	}
+
+	uint16_t set_id = (uint16_t)(idx + 1);
+
+	return ns->set_latency_enabled[set_id] ? set_id : INVALID_SET_ID;
+}
+
 void
 as_namespace_get_bins_info(as_namespace *ns, cf_dyn_buf *db, bool show_ns)
 {
@@ -20,8 +20,16 @@
  * along with this program.  If not, see http://www.gnu.org/licenses/
  */
 
+#include <errno.h>
+#include <limits.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/types.h>
 
 #include "citrusleaf/alloc.h"
 
@@ -93,18 +101,228 @@ as_mem_check()
 	return capacity;
 }
 
+//==========================================================
+// Persistent memory for SSD fast restart.
+//
+// A namespace with data not in memory can keep its index in shared memory, so
+// that after a clean shutdown it can restart without reading its devices. The
+// "base" block holds the arena structure, the partition tree roots and the
+// vmaps. Arena stages live in their own segments - see arenax_ce.c.
+//
+
+#define XMEM_KEY_BASE	0xAE000000
+#define XMEM_MAGIC		0x58454D41 // "AMEX"
+#define XMEM_VERSION	1
+
+typedef struct xmem_base_s {
+	uint32_t	magic;
+	uint32_t	version;
+	uint64_t	size;			// of whole base block, including data
+	char		ns_name[AS_ID_NAMESPACE_SZ];
+	uint32_t	index_size;
+	bool		single_bin;
+	bool		trusted;		// set on clean shutdown, cleared on resume
+	uint64_t	device_random;	// device header random value at last startup
+	uint8_t		data[];			// arena, tree roots, sets & bins vmaps
+} xmem_base;
+
+static inline size_t
+xmem_align(size_t sz)
+{
+	return (sz + 7) & ~(size_t)7;
+}
+
+static inline key_t
+xmem_key_base(as_namespace* ns, uint32_t instance)
+{
+	// Leaves low 12 bits for arena stages.
+	return (key_t)(XMEM_KEY_BASE | ((instance & 0xF) << 20) |
+			((ns->id & 0xFF) << 12));
+}
+
+static size_t
+xmem_base_size(as_namespace* ns)
+{
+	size_t sz = xmem_align(sizeof(xmem_base));
+
+	sz += xmem_align(cf_arenax_sizeof());
+	sz += xmem_align(sizeof(as_treex) * AS_PARTITIONS * ns->tree_sprigs) * 2;
+	sz += xmem_align(cf_vmapx_sizeof(sizeof(as_set), AS_SET_MAX_COUNT));
+
+	if (! ns->single_bin) {
+		sz += xmem_align(cf_vmapx_sizeof(VMAP_BIN_NAME_MAX_SZ, MAX_BIN_NAMES));
+	}
+
+	return sz;
+}
+
+// Point the namespace's persistent structures into the base block.
+static void
+xmem_map_base(as_namespace* ns, xmem_base* base)
+{
+	uint8_t* p = (uint8_t*)base + xmem_align(sizeof(xmem_base));
+
+	ns->p_xmem_base = (uint8_t*)base;
+
+	ns->arena = (cf_arenax*)p;
+	p += xmem_align(cf_arenax_sizeof());
+
+	ns->tree_roots = (as_treex*)p;
+	p += xmem_align(sizeof(as_treex) * AS_PARTITIONS * ns->tree_sprigs);
+
+	ns->sub_tree_roots = (as_treex*)p;
+	p += xmem_align(sizeof(as_treex) * AS_PARTITIONS * ns->tree_sprigs);
+
+	ns->p_sets_vmap = (cf_vmapx*)p;
+	p += xmem_align(cf_vmapx_sizeof(sizeof(as_set), AS_SET_MAX_COUNT));
+
+	ns->p_bin_name_vmap = ns->single_bin ? NULL : (cf_vmapx*)p;
+}
+
+static void
+xmem_destroy(key_t key_base)
+{
+	int shmid = shmget(key_base, 0, 0666);
+
+	if (shmid >= 0) {
+		shmctl(shmid, IPC_RMID, NULL);
+	}
+
+	cf_arenax_destroy_stages(key_base, CF_ARENAX_MAX_STAGES);
+}
+
+// Create a fresh base block, discarding anything left by a previous run.
+static void
+xmem_create(as_namespace* ns, key_t key_base)
+{
+	xmem_destroy(key_base);
+
+	size_t size = xmem_base_size(ns);
+	int shmid = shmget(key_base, size, IPC_CREAT | IPC_EXCL | 0666);
+
+	if (shmid < 0) {
+		cf_crash(AS_NAMESPACE, "ns %s can't create %lu-byte base block: errno %d (%s)",
+				ns->name, size, errno, cf_strerror(errno));
+	}
+
+	xmem_base* base = (xmem_base*)shmat(shmid, NULL, 0);
+
+	if (base == (xmem_base*)-1) {
+		cf_crash(AS_NAMESPACE, "ns %s can't attach base block: errno %d (%s)",
+				ns->name, errno, cf_strerror(errno));
+	}
+
+	memset(base, 0, size);
+
+	base->magic = XMEM_MAGIC;
+	base->version = XMEM_VERSION;
+	base->size = size;
+	strcpy(base->ns_name, ns->name);
+	base->index_size = as_index_size_get(ns);
+	base->single_bin = ns->single_bin;
+
+	xmem_map_base(ns, base);
+}
+
+// Attach the base block left by a previous run, and check it can be used.
+static bool
+xmem_resume(as_namespace* ns, key_t key_base)
+{
+	int shmid = shmget(key_base, 0, 0666);
+
+	if (shmid < 0) {
+		cf_info(AS_NAMESPACE, "ns %s found no persistent memory", ns->name);
+		return false;
+	}
+
+	xmem_base* base = (xmem_base*)shmat(shmid, NULL, 0);
+
+	if (base == (xmem_base*)-1) {
+		cf_warning(AS_NAMESPACE, "ns %s can't attach base block: errno %d (%s)",
+				ns->name, errno, cf_strerror(errno));
+		return false;
+	}
+
+	if (base->magic != XMEM_MAGIC || base->version != XMEM_VERSION ||
+			base->size != xmem_base_size(ns) ||
+			strcmp(base->ns_name, ns->name) != 0 ||
+			base->index_size != as_index_size_get(ns) ||
+			base->single_bin != ns->single_bin) {
+		cf_warning(AS_NAMESPACE, "ns %s persistent memory doesn't match config",
+				ns->name);
+		shmdt(base);
+		return false;
+	}
+
+	if (! base->trusted) {
+		cf_info(AS_NAMESPACE, "ns %s persistent memory not trusted - last shutdown not clean",
+				ns->name);
+		shmdt(base);
+		return false;
+	}
+
+	xmem_map_base(ns, base);
+
+	if (cf_arenax_resume(ns->arena) != CF_ARENAX_OK) {
+		cf_warning(AS_NAMESPACE, "ns %s can't resume arena", ns->name);
+		shmdt(base);
+		return false;
+	}
+
+	if (cf_vmapx_resume(ns->p_sets_vmap, sizeof(as_set), AS_SET_MAX_COUNT, 1024, AS_SET_NAME_MAX_SIZE) != CF_VMAPX_OK) {
+		cf_crash(AS_NAMESPACE, "ns %s can't resume sets vmap", ns->name);
+	}
+
+	if (ns->p_bin_name_vmap && cf_vmapx_resume(ns->p_bin_name_vmap, VMAP_BIN_NAME_MAX_SZ, MAX_BIN_NAMES, 4096, VMAP_BIN_NAME_MAX_SZ) != CF_VMAPX_OK) {
+		cf_crash(AS_NAMESPACE, "ns %s can't resume bins vmap", ns->name);
+	}
+
+	// Transfer configuration file information about sets.
+	if (! as_namespace_configure_sets(ns)) {
+		cf_crash(AS_NAMESPACE, "ns %s can't configure sets", ns->name);
+	}
+
+	// If we go down before the next clean shutdown, don't trust the index.
+	base->trusted = false;
+
+	return true;
+}
+
 void
 as_namespace_setup(as_namespace* ns, uint32_t instance, uint32_t stage_capacity)
 {
+	// Only worth it (and only safe) if records aren't in process memory. An
+	// index on flash is rebuilt every start.
+	bool fast_restart = ns->storage_type == AS_STORAGE_ENGINE_SSD &&
+			ns->storage_fast_restart && ! ns->storage_data_in_memory &&
+			! ns->index_flash_path;
+
+	if (ns->storage_fast_restart && ns->index_flash_path) {
+		cf_warning(AS_NAMESPACE, "ns %s index on flash - ignoring fast-restart",
+				ns->name);
+	}
+	key_t key_base = fast_restart ? xmem_key_base(ns, instance) : 0;
+
+	if (fast_restart && ! ns->cold_start && xmem_resume(ns, key_base)) {
+		cf_info(AS_NAMESPACE, "ns %s beginning WARM restart", ns->name);
+		return;
+	}
+
 	ns->cold_start = true;
 
 	cf_info(AS_NAMESPACE, "ns %s beginning COLD start", ns->name);
 
+	if (fast_restart) {
+		xmem_create(ns, key_base);
+	}
+
 	//--------------------------------------------
 	// Set up the set name vmap.
 	//
 
-	ns->p_sets_vmap = (cf_vmapx*)cf_malloc(cf_vmapx_sizeof(sizeof(as_set), AS_SET_MAX_COUNT));
+	if (! fast_restart) {
+		ns->p_sets_vmap = (cf_vmapx*)cf_malloc(cf_vmapx_sizeof(sizeof(as_set), AS_SET_MAX_COUNT));
+	}
 
 	if (! ns->p_sets_vmap) {
 		cf_crash(AS_NAMESPACE, "ns %s can't allocate sets vmap", ns->name);
@@ -126,7 +344,9 @@ as_namespace_setup(as_namespace* ns, uint32_t instance, uint32_t stage_capacity)
 	//
 
 	if (! ns->single_bin) {
-		ns->p_bin_name_vmap = (cf_vmapx*)cf_malloc(cf_vmapx_sizeof(VMAP_BIN_NAME_MAX_SZ, MAX_BIN_NAMES));
+		if (! fast_restart) {
+			ns->p_bin_name_vmap = (cf_vmapx*)cf_malloc(cf_vmapx_sizeof(VMAP_BIN_NAME_MAX_SZ, MAX_BIN_NAMES));
+		}
 
 		if (! ns->p_bin_name_vmap) {
 			cf_crash(AS_NAMESPACE, "ns %s can't allocate bins vmap", ns->name);
@@ -143,13 +363,50 @@ as_namespace_setup(as_namespace* ns, uint32_t instance, uint32_t stage_capacity)
 	// Set up the index arena.
 	//
 
-	ns->arena = (cf_arenax*)cf_malloc(cf_arenax_sizeof());
+	if (! fast_restart) {
+		ns->arena = (cf_arenax*)cf_malloc(cf_arenax_sizeof());
+	}
 
 	if (! ns->arena) {
 		cf_crash(AS_NAMESPACE, "ns %s can't allocate index arena", ns->name);
 	}
 
-	cf_arenax_err arena_result = cf_arenax_create(ns->arena, 0, as_index_size_get(ns), stage_capacity, 0, CF_ARENAX_BIGLOCK);
+	uint32_t arena_flags = CF_ARENAX_BIGLOCK;
+
+	if (ns->index_page_size == 2 * 1024 * 1024) {
+		arena_flags |= CF_ARENAX_HUGE_2M;
+	}
+	else if (ns->index_page_size == 1024 * 1024 * 1024) {
+		arena_flags |= CF_ARENAX_HUGE_1G;
+	}
+
+	if (ns->index_numa_policy == AS_INDEX_NUMA_POLICY_INTERLEAVE) {
+		arena_flags |= CF_ARENAX_INTERLEAVE;
+	}
+
+	cf_arenax_err arena_result;
+
+	if (ns->index_flash_path) {
+		// Huge pages don't apply to file-backed stages.
+		arena_flags &= ~(uint32_t)(CF_ARENAX_HUGE_2M | CF_ARENAX_HUGE_1G);
+
+		char path[PATH_MAX];
+
+		snprintf(path, sizeof(path), "%s/%s-index", ns->index_flash_path,
+				ns->name);
+
+		// The arena keeps the path, to name stages it adds later.
+		char* arena_path = cf_strdup(path);
+
+		if (! arena_path) {
+			cf_crash(AS_NAMESPACE, "ns %s can't allocate index flash path", ns->name);
+		}
+
+		arena_result = cf_arenax_create_flash(ns->arena, arena_path, as_index_size_get(ns), stage_capacity, 0, arena_flags);
+	}
+	else {
+		arena_result = cf_arenax_create(ns->arena, key_base, as_index_size_get(ns), stage_capacity, 0, arena_flags);
+	}
 
 	if (arena_result != CF_ARENAX_OK) {
 		cf_crash(AS_NAMESPACE, "ns %s can't create arena: %s", ns->name, cf_arenax_errstr(arena_result));
@@ -159,5 +416,29 @@ as_namespace_setup(as_namespace* ns, uint32_t instance, uint32_t stage_capacity)
 void
 as_namespace_xmem_trusted(as_namespace *ns)
 {
-	// For enterprise version only.
+	xmem_base* base = (xmem_base*)ns->p_xmem_base;
+
+	// Devices are flushed - the index may be used on the next startup.
+	if (base) {
+		base->trusted = true;
+		cf_info(AS_NAMESPACE, "ns %s persistent memory trusted", ns->name);
+	}
+}
+
+bool
+as_namespace_xmem_devices_match(as_namespace *ns, uint64_t device_random)
+{
+	xmem_base* base = (xmem_base*)ns->p_xmem_base;
+
+	return base && base->device_random == device_random;
+}
+
+void
+as_namespace_xmem_set_devices(as_namespace *ns, uint64_t device_random)
+{
+	xmem_base* base = (xmem_base*)ns->p_xmem_base;
+
+	if (base) {
+		base->device_random = device_random;
+	}
 }
@@ -20,19 +20,55 @@
  * along with this program.  If not, see http://www.gnu.org/licenses/
  */
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <zlib.h>
 
+#if defined(USE_LZ4)
+#include <lz4.h>
+#endif
+
+#if defined(USE_ZSTD)
+#include <zstd.h>
+#endif
+
 #include "citrusleaf/alloc.h"
 
 #include "fault.h"
 
+#include "base/cfg.h"
 #include "base/packet_compression.h"
 #include "base/proto.h"
 
 #define STACK_BUF_SZ (1024 * 16)
 
+// First 4 bytes of every zstd frame - 0xFD2FB528 little-endian.
+static const uint8_t zstd_frame_magic[] = { 0x28, 0xB5, 0x2F, 0xFD };
+
+// LZ4 streams reference up to the last 64K of plain data.
+#define LZ4_DICT_SZ (64 * 1024)
+
+// Room for zlib sync flush markers, zstd frame and block headers.
+#define STREAM_BOUND_PAD 64
+
+struct as_comp_stream_s {
+	compression_type type;
+	bool failed;
+	z_stream zs;
+#if defined(USE_LZ4)
+	LZ4_stream_t *lz4;
+	uint8_t *lz4_in; // staging for hdr + body, which must be one block
+	size_t lz4_in_sz;
+	char lz4_dict[LZ4_DICT_SZ];
+#endif
+#if defined(USE_ZSTD)
+	ZSTD_CStream *zstd;
+#endif
+};
+
 /**
  * Function to decompress the given data
  * Expected arguments
@@ -57,6 +93,26 @@ as_decompress(compression_type type, size_t buf_len, const uint8_t *buf, size_t
 			*out_buf_len = converted_out_buf_len;
 			break;
 		}
+#if defined(USE_LZ4)
+		case COMPRESSION_LZ4: {
+			int sz = LZ4_decompress_safe((const char *)buf, (char *)out_buf, (int)buf_len, (int)*out_buf_len);
+			if (sz >= 0) {
+				*out_buf_len = (size_t)sz;
+				ret_value = 0;
+			}
+			break;
+		}
+#endif
+#if defined(USE_ZSTD)
+		case COMPRESSION_ZSTD: {
+			size_t sz = ZSTD_decompress(out_buf, *out_buf_len, buf, buf_len);
+			if (! ZSTD_isError(sz)) {
+				*out_buf_len = sz;
+				ret_value = 0;
+			}
+			break;
+		}
+#endif
 		default:
 			cf_warning(AS_COMPRESSION, "Unknown as_proto compression type: %d", type);
 			break;
@@ -65,6 +121,84 @@ as_decompress(compression_type type, size_t buf_len, const uint8_t *buf, size_t
 	return ret_value;
 }
 
+/**
+ * Worst-case compressed size of buf_len bytes - the room as_compress_buf needs.
+ * @param type			Type of compression
+ * @param buf_len		Length of buffer to be compressed
+ * @return bound, or 0 if the type isn't supported
+ */
+size_t
+as_compress_bound(compression_type type, size_t buf_len)
+{
+	switch (type) {
+		case COMPRESSION_ZLIB:
+			return (size_t)compressBound((uLong)buf_len);
+#if defined(USE_LZ4)
+		case COMPRESSION_LZ4:
+			return (size_t)LZ4_compressBound((int)buf_len);
+#endif
+#if defined(USE_ZSTD)
+		case COMPRESSION_ZSTD:
+			return ZSTD_compressBound(buf_len);
+#endif
+		default:
+			return 0;
+	}
+}
+
+/**
+ * Function to compress a buffer in one shot - the counterpart of as_decompress.
+ * @param type			Type of compression
+ * @param level			Compression level - zlib and zstd only, LZ4 ignores it
+ * @param buf_len		Length of buffer to be compressed
+ * @param buf			Pointer to buffer to be compressed
+ * @param out_buf_len	Length of buffer to hold compressed data - at least
+ *						as_compress_bound(), set to the compressed length
+ * @param out_buf		Pointer to buffer to hold compressed data
+ * @return 0 if successful
+ */
+int
+as_compress_buf(compression_type type, int level, size_t buf_len, const uint8_t *buf, size_t *out_buf_len, uint8_t *out_buf)
+{
+	int ret_value = -1;
+
+	switch (type) {
+		case COMPRESSION_ZLIB: {
+			uLongf converted_out_buf_len = *out_buf_len;
+			if (compress2(out_buf, &converted_out_buf_len, buf, (uLong)buf_len, level) == Z_OK) {
+				*out_buf_len = converted_out_buf_len;
+				ret_value = 0;
+			}
+			break;
+		}
+#if defined(USE_LZ4)
+		case COMPRESSION_LZ4: {
+			int sz = LZ4_compress_default((const char *)buf, (char *)out_buf, (int)buf_len, (int)*out_buf_len);
+			if (sz > 0) {
+				*out_buf_len = (size_t)sz;
+				ret_value = 0;
+			}
+			break;
+		}
+#endif
+#if defined(USE_ZSTD)
+		case COMPRESSION_ZSTD: {
+			size_t sz = ZSTD_compress(out_buf, *out_buf_len, buf, buf_len, level);
+			if (! ZSTD_isError(sz)) {
+				*out_buf_len = sz;
+				ret_value = 0;
+			}
+			break;
+		}
+#endif
+		default:
+			cf_warning(AS_COMPRESSION, "Unknown compression type: %d", type);
+			break;
+	}
+
+	return ret_value;
+}
+
 /**
  * Function to get back decompressed packet from PROTO_TYPE_AS_MSG_COMPRESSED packet
  * Packet :  Header - Original size of message - Compressed message
@@ -98,8 +232,16 @@ as_packet_decompression(uint8_t *buf, uint8_t **output_packet, size_t *output_pa
 
 	size_t buf_sz = as_comp_protop->proto.sz - 8;
 	buf += sizeof(as_comp_proto);
+
+	// Requests carry no compression type - zstd frames are recognized by their
+	// magic, which can't start a zlib stream.
+	compression_type type = COMPRESSION_ZLIB;
+	if (buf_sz >= sizeof(zstd_frame_magic) && memcmp(buf, zstd_frame_magic, sizeof(zstd_frame_magic)) == 0) {
+		type = COMPRESSION_ZSTD;
+	}
+
 	uint8_t *decompressed_packet = cf_malloc(decompressed_as_packet_sz);
-	ret_value = as_decompress(COMPRESSION_ZLIB, buf_sz, buf, &decompressed_as_packet_sz, decompressed_packet);
+	ret_value = as_decompress(type, buf_sz, buf, &decompressed_as_packet_sz, decompressed_packet);
 	if (ret_value) {
 		cf_free(decompressed_packet);
 	} else {
@@ -232,3 +374,246 @@ as_packet_compression(uint8_t *buf, size_t buf_sz, uint8_t **compressed_packet,
 	cf_debug(AS_COMPRESSION, "Returned as_packet_compression : 0");
 	return 0;
 }
+
+/**
+ * Create a response compression stream.
+ * @param type			Type of compression the client accepts
+ * @return stream, or NULL if type is none or unsupported by this build
+ */
+as_comp_stream *
+as_comp_stream_create(uint8_t type)
+{
+	as_comp_stream *cs;
+
+	switch (type) {
+		case COMPRESSION_NONE:
+			return NULL;
+		case COMPRESSION_ZLIB:
+			cs = cf_calloc(1, sizeof(as_comp_stream));
+			if (deflateInit(&cs->zs, Z_DEFAULT_COMPRESSION) != Z_OK) {
+				cf_warning(AS_COMPRESSION, "failed zlib stream init");
+				cf_free(cs);
+				return NULL;
+			}
+			break;
+#if defined(USE_LZ4)
+		case COMPRESSION_LZ4:
+			cs = cf_calloc(1, sizeof(as_comp_stream));
+			cs->lz4 = LZ4_createStream();
+			break;
+#endif
+#if defined(USE_ZSTD)
+		case COMPRESSION_ZSTD:
+			cs = cf_calloc(1, sizeof(as_comp_stream));
+			cs->zstd = ZSTD_createCStream();
+			if (ZSTD_isError(ZSTD_initCStream(cs->zstd, ZSTD_CLEVEL_DEFAULT))) {
+				cf_warning(AS_COMPRESSION, "failed zstd stream init");
+				ZSTD_freeCStream(cs->zstd);
+				cf_free(cs);
+				return NULL;
+			}
+			break;
+#endif
+		default:
+			// Let old servers and builds without a codec look the same - the
+			// client just gets plain responses.
+			cf_debug(AS_COMPRESSION, "unsupported response compression type %u", type);
+			return NULL;
+	}
+
+	cs->type = (compression_type)type;
+
+	return cs;
+}
+
+void
+as_comp_stream_destroy(as_comp_stream *cs)
+{
+	switch (cs->type) {
+		case COMPRESSION_ZLIB:
+			deflateEnd(&cs->zs);
+			break;
+#if defined(USE_LZ4)
+		case COMPRESSION_LZ4:
+			LZ4_freeStream(cs->lz4);
+			if (cs->lz4_in) {
+				cf_free(cs->lz4_in);
+			}
+			break;
+#endif
+#if defined(USE_ZSTD)
+		case COMPRESSION_ZSTD:
+			ZSTD_freeCStream(cs->zstd);
+			break;
+#endif
+		default:
+			break;
+	}
+
+	cf_free(cs);
+}
+
+bool
+as_comp_stream_wants(const as_comp_stream *cs, size_t sz)
+{
+	return cs && ! cs->failed && sz >= g_config.proto_compression_threshold;
+}
+
+size_t
+as_comp_stream_bound(const as_comp_stream *cs, size_t sz)
+{
+	size_t bound;
+
+	switch (cs->type) {
+		case COMPRESSION_ZLIB:
+			bound = deflateBound((z_stream *)&cs->zs, sz);
+			break;
+#if defined(USE_LZ4)
+		case COMPRESSION_LZ4:
+			bound = (size_t)LZ4_compressBound((int)sz);
+			break;
+#endif
+#if defined(USE_ZSTD)
+		case COMPRESSION_ZSTD:
+			bound = ZSTD_compressBound(sz);
+			break;
+#endif
+		default:
+			bound = sz;
+			break;
+	}
+
+	return sizeof(as_comp_proto) + bound + STREAM_BOUND_PAD;
+}
+
+static size_t
+stream_zlib(as_comp_stream *cs, const uint8_t *hdr, size_t hdr_sz, const uint8_t *body, size_t body_sz, uint8_t *out, size_t out_sz)
+{
+	z_stream *zs = &cs->zs;
+
+	zs->next_out = out;
+	zs->avail_out = (uInt)out_sz;
+
+	zs->next_in = (Bytef *)hdr;
+	zs->avail_in = (uInt)hdr_sz;
+	if (deflate(zs, Z_NO_FLUSH) != Z_OK) {
+		return 0;
+	}
+
+	zs->next_in = (Bytef *)body;
+	zs->avail_in = (uInt)body_sz;
+	if (deflate(zs, Z_SYNC_FLUSH) != Z_OK || zs->avail_in != 0 || zs->avail_out == 0) {
+		// Out of room means the flush may be incomplete.
+		return 0;
+	}
+
+	return out_sz - zs->avail_out;
+}
+
+#if defined(USE_LZ4)
+static size_t
+stream_lz4(as_comp_stream *cs, const uint8_t *hdr, size_t hdr_sz, const uint8_t *body, size_t body_sz, uint8_t *out, size_t out_sz)
+{
+	size_t in_sz = hdr_sz + body_sz;
+
+	if (in_sz > LZ4_MAX_INPUT_SIZE) {
+		return 0;
+	}
+
+	if (in_sz > cs->lz4_in_sz) {
+		if (cs->lz4_in) {
+			cf_free(cs->lz4_in);
+		}
+		cs->lz4_in = cf_malloc(in_sz);
+		cs->lz4_in_sz = in_sz;
+	}
+
+	memcpy(cs->lz4_in, hdr, hdr_sz);
+	memcpy(cs->lz4_in + hdr_sz, body, body_sz);
+
+	int sz = LZ4_compress_fast_continue(cs->lz4, (const char *)cs->lz4_in, (char *)out, (int)in_sz, (int)out_sz, 1);
+
+	// Staging is overwritten by the next packet - keep the history.
+	LZ4_saveDict(cs->lz4, cs->lz4_dict, LZ4_DICT_SZ);
+
+	return sz <= 0 ? 0 : (size_t)sz;
+}
+#endif
+
+#if defined(USE_ZSTD)
+static size_t
+stream_zstd(as_comp_stream *cs, const uint8_t *hdr, size_t hdr_sz, const uint8_t *body, size_t body_sz, uint8_t *out, size_t out_sz)
+{
+	ZSTD_outBuffer ob = { out, out_sz, 0 };
+	ZSTD_inBuffer ib_hdr = { hdr, hdr_sz, 0 };
+	ZSTD_inBuffer ib_body = { body, body_sz, 0 };
+
+	while (ib_hdr.pos < ib_hdr.size) {
+		if (ZSTD_isError(ZSTD_compressStream(cs->zstd, &ob, &ib_hdr)) || ob.pos == ob.size) {
+			return 0;
+		}
+	}
+
+	while (ib_body.pos < ib_body.size) {
+		if (ZSTD_isError(ZSTD_compressStream(cs->zstd, &ob, &ib_body)) || ob.pos == ob.size) {
+			return 0;
+		}
+	}
+
+	// Non-zero means data is left in the stream - out of room.
+	if (ZSTD_flushStream(cs->zstd, &ob) != 0) {
+		return 0;
+	}
+
+	return ob.pos;
+}
+#endif
+
+/**
+ * Compress a plain packet into a PROTO_TYPE_AS_MSG_COMPRESSED packet.
+ * Packet :  Header - Original size of message - Compressed message
+ * @return size of compressed packet, or 0 on failure - no more packets wanted
+ */
+size_t
+as_comp_stream_packet(as_comp_stream *cs, const uint8_t *hdr, size_t hdr_sz,
+		const uint8_t *body, size_t body_sz, uint8_t *packet)
+{
+	uint8_t *out = packet + sizeof(as_comp_proto);
+	size_t out_sz = as_comp_stream_bound(cs, hdr_sz + body_sz) - sizeof(as_comp_proto);
+	size_t sz = 0;
+
+	switch (cs->type) {
+		case COMPRESSION_ZLIB:
+			sz = stream_zlib(cs, hdr, hdr_sz, body, body_sz, out, out_sz);
+			break;
+#if defined(USE_LZ4)
+		case COMPRESSION_LZ4:
+			sz = stream_lz4(cs, hdr, hdr_sz, body, body_sz, out, out_sz);
+			break;
+#endif
+#if defined(USE_ZSTD)
+		case COMPRESSION_ZSTD:
+			sz = stream_zstd(cs, hdr, hdr_sz, body, body_sz, out, out_sz);
+			break;
+#endif
+		default:
+			break;
+	}
+
+	if (sz == 0) {
+		// Compression state is now unknown - plain packets from here on.
+		cf_warning(AS_COMPRESSION, "failed type %d stream compression of %zu bytes", cs->type, hdr_sz + body_sz);
+		cs->failed = true;
+		return 0;
+	}
+
+	// Construct the packet for compressed data - org_sz as the requests have it.
+	as_comp_proto *as_comp_protop = (as_comp_proto *)packet;
+	as_comp_protop->proto.version = PROTO_VERSION;
+	as_comp_protop->proto.type = PROTO_TYPE_AS_MSG_COMPRESSED;
+	as_comp_protop->proto.sz = sizeof(as_comp_proto) - sizeof(as_proto) + sz;
+	as_proto_swap(&as_comp_protop->proto);
+	as_comp_protop->org_sz = hdr_sz + body_sz;
+
+	return sizeof(as_comp_proto) + sz;
+}
@@ -40,6 +40,7 @@
 
 #include "base/datamodel.h"
 #include "base/ldt.h"
+#include "base/particle_blob.h"
 #include "base/proto.h"
 #include "storage/storage.h"
 
@@ -77,6 +78,13 @@ const as_particle_vtable *particle_vtable[] = {
 		[AS_PARTICLE_TYPE_GEOJSON]		= &geojson_vtable
 };
 
+// Same layout as blob_mem and string_mem, big enough for any short value.
+typedef struct short_mem_s {
+	uint8_t		type;
+	uint32_t	sz;
+	uint8_t		data[AS_PARTICLE_SHORT_MAX_SZ];
+} __attribute__ ((__packed__)) short_mem;
+
 
 //==========================================================
 // Local utilities.
@@ -111,6 +119,59 @@ safe_particle_type(uint8_t type)
 	}
 }
 
+// Whether a new particle of this type and in-memory size is held in the bin.
+static inline bool
+fits_short(as_particle_type type, uint32_t mem_size)
+{
+	return mem_size <= sizeof(short_mem) &&
+			(particle_vtable[type] == &blob_vtable ||
+					particle_vtable[type] == &string_vtable);
+}
+
+// Particle methods can't see a short value in the bin - expand it into buf.
+static inline const as_particle *
+bin_particle(const as_bin *b, short_mem *buf)
+{
+	if (! as_bin_is_short_particle(b)) {
+		return b->particle;
+	}
+
+	buf->type = b->svalue.type;
+	buf->sz = b->svalue.sz;
+	memcpy(buf->data, b->svalue.data, buf->sz);
+
+	return (const as_particle *)buf;
+}
+
+// A byte range write to a bin with no blob creates it - only from offset 0.
+static inline bool
+strip_blob_write_offset(as_particle_type op_type, uint8_t **p_value,
+		uint32_t *p_value_size)
+{
+	if (op_type != AS_PARTICLE_TYPE_BLOB || *p_value_size < sizeof(uint32_t) ||
+			cf_swap_from_be32(*(uint32_t *)*p_value) != 0) {
+		return false;
+	}
+
+	*p_value += sizeof(uint32_t);
+	*p_value_size -= (uint32_t)sizeof(uint32_t);
+
+	return true;
+}
+
+// Move a particle built in buf (or any blob_mem layout) into the bin itself.
+static inline void
+bin_set_short(as_bin *b, const short_mem *buf)
+{
+	uint32_t sz = buf->sz;
+
+	b->svalue.type = buf->type;
+	b->svalue.sz = (uint8_t)sz;
+	memcpy(b->svalue.data, buf->data, sz);
+
+	as_bin_state_set(b, AS_BIN_STATE_INUSE_SHORT);
+}
+
 
 //==========================================================
 // Particle "class static" functions.
@@ -295,9 +356,52 @@ as_bin_particle_size(as_bin *b)
 		return 0;
 	}
 
+	if (as_bin_is_short_particle(b)) {
+		// Nothing allocated beyond the bin.
+		return 0;
+	}
+
 	return particle_vtable[as_bin_get_particle_type(b)]->size_fn(b->particle);
 }
 
+// For data-in-memory compaction - moves a heap particle to a fresh allocation,
+// but only if that lands lower. JEMalloc fills runs lowest address first, so
+// the sparse runs left after deletes tend to be the high ones. Only flat
+// layouts move - list wrappers point into themselves. Returns bytes moved.
+uint32_t
+as_bin_particle_compact(as_bin *b)
+{
+	if (! as_bin_inuse(b) || as_bin_is_embedded_particle(b) || ! b->particle) {
+		return 0;
+	}
+
+	const as_particle_vtable *vtable =
+			particle_vtable[as_bin_get_particle_type(b)];
+
+	if (vtable != &blob_vtable && vtable != &string_vtable &&
+			vtable != &map_vtable) {
+		return 0;
+	}
+
+	uint32_t size = vtable->size_fn(b->particle);
+	as_particle *p = (as_particle *)cf_malloc(size);
+
+	if (! p) {
+		return 0;
+	}
+
+	if ((uintptr_t)p > (uintptr_t)b->particle) {
+		cf_free(p);
+		return 0;
+	}
+
+	memcpy((void *)p, (const void *)b->particle, size);
+	vtable->destructor_fn(b->particle);
+	b->particle = p;
+
+	return size;
+}
+
 //------------------------------------------------
 // Handle "wire" format.
 //
@@ -324,12 +428,18 @@ as_bin_particle_size_modify_from_client(as_bin *b, const as_msg_op *op)
 		if (operation == AS_MSG_OP_MC_INCR) {
 			op_type = AS_PARTICLE_TYPE_INTEGER;
 		}
+		else if (operation == AS_MSG_OP_BLOB_WRITE &&
+				! strip_blob_write_offset(op_type, &op_value, &op_value_size)) {
+			return -AS_PROTO_RESULT_FAIL_PARAMETER;
+		}
 
 		return particle_vtable[op_type]->size_from_wire_fn(op_value, op_value_size);
 	}
 
 	// There is an existing particle, which we will modify.
 	uint8_t existing_type = as_bin_get_particle_type(b);
+	short_mem buf;
+	as_particle *existing = (as_particle *)bin_particle(b, &buf);
 
 	switch (operation) {
 	case AS_MSG_OP_MC_INCR:
@@ -340,7 +450,9 @@ as_bin_particle_size_modify_from_client(as_bin *b, const as_msg_op *op)
 	case AS_MSG_OP_APPEND:
 	case AS_MSG_OP_MC_PREPEND:
 	case AS_MSG_OP_PREPEND:
-		return particle_vtable[existing_type]->concat_size_from_wire_fn(op_type, op_value, op_value_size, &b->particle);
+		return particle_vtable[existing_type]->concat_size_from_wire_fn(op_type, op_value, op_value_size, &existing);
+	case AS_MSG_OP_BLOB_WRITE:
+		return blob_write_range_size_from_wire(op_type, op_value, op_value_size, existing);
 	default:
 		// TODO - just crash?
 		return -AS_PROTO_RESULT_FAIL_UNKNOWN;
@@ -377,6 +489,10 @@ as_bin_particle_alloc_modify_from_client(as_bin *b, const as_msg_op *op)
 			op_value_size = sizeof(uint64_t);
 			op_value += sizeof(uint64_t);
 		}
+		else if (operation == AS_MSG_OP_BLOB_WRITE &&
+				! strip_blob_write_offset(op_type, &op_value, &op_value_size)) {
+			return -AS_PROTO_RESULT_FAIL_PARAMETER;
+		}
 
 		int32_t mem_size = particle_vtable[op_type]->size_from_wire_fn(op_value, op_value_size);
 
@@ -385,8 +501,13 @@ as_bin_particle_alloc_modify_from_client(as_bin *b, const as_msg_op *op)
 		}
 
 		as_particle *old_particle = b->particle;
+		short_mem buf;
+		bool is_short = fits_short(op_type, (uint32_t)mem_size);
 
-		if (mem_size != 0) {
+		if (is_short) {
+			b->particle = (as_particle *)&buf;
+		}
+		else if (mem_size != 0) {
 			b->particle = cf_malloc((size_t)mem_size);
 
 			if (! b->particle) {
@@ -400,10 +521,15 @@ as_bin_particle_alloc_modify_from_client(as_bin *b, const as_msg_op *op)
 
 		// Set the bin's iparticle metadata.
 		if (result == 0) {
-			as_bin_state_set_from_type(b, op_type);
+			if (is_short) {
+				bin_set_short(b, &buf);
+			}
+			else {
+				as_bin_state_set_from_type(b, op_type);
+			}
 		}
 		else {
-			if (mem_size != 0) {
+			if (mem_size != 0 && ! is_short) {
 				cf_free(b->particle);
 			}
 
@@ -416,6 +542,8 @@ as_bin_particle_alloc_modify_from_client(as_bin *b, const as_msg_op *op)
 	// There is an existing particle, which we will modify.
 	uint8_t existing_type = as_bin_get_particle_type(b);
 	int32_t new_mem_size = 0;
+	short_mem buf;
+	as_particle *existing = (as_particle *)bin_particle(b, &buf);
 	as_particle *new_particle = NULL;
 
 	as_particle *old_particle = b->particle;
@@ -438,14 +566,14 @@ as_bin_particle_alloc_modify_from_client(as_bin *b, const as_msg_op *op)
 		}
 		// no break
 	case AS_MSG_OP_APPEND:
-		new_mem_size = particle_vtable[existing_type]->concat_size_from_wire_fn(op_type, op_value, op_value_size, &b->particle);
+		new_mem_size = particle_vtable[existing_type]->concat_size_from_wire_fn(op_type, op_value, op_value_size, &existing);
 		if (new_mem_size < 0) {
 			return new_mem_size;
 		}
 		if (! (new_particle = cf_malloc((size_t)new_mem_size))) {
 			return -AS_PROTO_RESULT_FAIL_UNKNOWN;
 		}
-		memcpy(new_particle, b->particle, particle_vtable[existing_type]->size_fn(b->particle));
+		memcpy(new_particle, existing, particle_vtable[existing_type]->size_fn(existing));
 		b->particle = new_particle;
 		result = particle_vtable[existing_type]->append_from_wire_fn(op_type, op_value, op_value_size, &b->particle);
 		break;
@@ -455,17 +583,28 @@ as_bin_particle_alloc_modify_from_client(as_bin *b, const as_msg_op *op)
 		}
 		// no break
 	case AS_MSG_OP_PREPEND:
-		new_mem_size = particle_vtable[existing_type]->concat_size_from_wire_fn(op_type, op_value, op_value_size, &b->particle);
+		new_mem_size = particle_vtable[existing_type]->concat_size_from_wire_fn(op_type, op_value, op_value_size, &existing);
 		if (new_mem_size < 0) {
 			return new_mem_size;
 		}
 		if (! (new_particle = cf_malloc((size_t)new_mem_size))) {
 			return -AS_PROTO_RESULT_FAIL_UNKNOWN;
 		}
-		memcpy(new_particle, b->particle, particle_vtable[existing_type]->size_fn(b->particle));
+		memcpy(new_particle, existing, particle_vtable[existing_type]->size_fn(existing));
 		b->particle = new_particle;
 		result = particle_vtable[existing_type]->prepend_from_wire_fn(op_type, op_value, op_value_size, &b->particle);
 		break;
+	case AS_MSG_OP_BLOB_WRITE:
+		new_mem_size = blob_write_range_size_from_wire(op_type, op_value, op_value_size, existing);
+		if (new_mem_size < 0) {
+			return new_mem_size;
+		}
+		if (! (new_particle = cf_malloc((size_t)new_mem_size))) {
+			return -AS_PROTO_RESULT_FAIL_UNKNOWN;
+		}
+		b->particle = new_particle;
+		result = blob_write_range_from_wire(op_value, op_value_size, existing, &b->particle);
+		break;
 	default:
 		// TODO - just crash?
 		return -AS_PROTO_RESULT_FAIL_UNKNOWN;
@@ -478,6 +617,10 @@ as_bin_particle_alloc_modify_from_client(as_bin *b, const as_msg_op *op)
 
 		b->particle = old_particle;
 	}
+	else if (new_mem_size != 0) {
+		// An appended short value is in a particle now.
+		as_bin_state_set_from_type(b, existing_type);
+	}
 
 	return result;
 }
@@ -507,6 +650,10 @@ as_bin_particle_stack_modify_from_client(as_bin *b, cf_ll_buf *particles_llb, co
 			op_value_size = sizeof(uint64_t);
 			op_value += sizeof(uint64_t);
 		}
+		else if (operation == AS_MSG_OP_BLOB_WRITE &&
+				! strip_blob_write_offset(op_type, &op_value, &op_value_size)) {
+			return -AS_PROTO_RESULT_FAIL_PARAMETER;
+		}
 
 		int32_t mem_size = particle_vtable[op_type]->size_from_wire_fn(op_value, op_value_size);
 
@@ -539,6 +686,8 @@ as_bin_particle_stack_modify_from_client(as_bin *b, cf_ll_buf *particles_llb, co
 	// There is an existing particle, which we will modify.
 	uint8_t existing_type = as_bin_get_particle_type(b);
 	int32_t new_mem_size = 0;
+	short_mem buf;
+	as_particle *existing = (as_particle *)bin_particle(b, &buf);
 
 	as_particle *old_particle = b->particle;
 	int result = 0;
@@ -560,14 +709,14 @@ as_bin_particle_stack_modify_from_client(as_bin *b, cf_ll_buf *particles_llb, co
 		}
 		// no break
 	case AS_MSG_OP_APPEND:
-		new_mem_size = particle_vtable[existing_type]->concat_size_from_wire_fn(op_type, op_value, op_value_size, &b->particle);
+		new_mem_size = particle_vtable[existing_type]->concat_size_from_wire_fn(op_type, op_value, op_value_size, &existing);
 		if (new_mem_size < 0) {
 			return (int)new_mem_size;
 		}
 		if (0 > cf_ll_buf_reserve(particles_llb, (size_t)new_mem_size, (uint8_t **)&b->particle)) {
 			return -AS_PROTO_RESULT_FAIL_UNKNOWN;
 		}
-		memcpy(b->particle, old_particle, particle_vtable[existing_type]->size_fn(old_particle));
+		memcpy(b->particle, existing, particle_vtable[existing_type]->size_fn(existing));
 		result = particle_vtable[existing_type]->append_from_wire_fn(op_type, op_value, op_value_size, &b->particle);
 		break;
 	case AS_MSG_OP_MC_PREPEND:
@@ -576,16 +725,26 @@ as_bin_particle_stack_modify_from_client(as_bin *b, cf_ll_buf *particles_llb, co
 		}
 		// no break
 	case AS_MSG_OP_PREPEND:
-		new_mem_size = particle_vtable[existing_type]->concat_size_from_wire_fn(op_type, op_value, op_value_size, &b->particle);
+		new_mem_size = particle_vtable[existing_type]->concat_size_from_wire_fn(op_type, op_value, op_value_size, &existing);
 		if (new_mem_size < 0) {
 			return (int)new_mem_size;
 		}
 		if (0 > cf_ll_buf_reserve(particles_llb, (size_t)new_mem_size, (uint8_t **)&b->particle)) {
 			return -AS_PROTO_RESULT_FAIL_UNKNOWN;
 		}
-		memcpy(b->particle, old_particle, particle_vtable[existing_type]->size_fn(old_particle));
+		memcpy(b->particle, existing, particle_vtable[existing_type]->size_fn(existing));
 		result = particle_vtable[existing_type]->prepend_from_wire_fn(op_type, op_value, op_value_size, &b->particle);
 		break;
+	case AS_MSG_OP_BLOB_WRITE:
+		new_mem_size = blob_write_range_size_from_wire(op_type, op_value, op_value_size, existing);
+		if (new_mem_size < 0) {
+			return (int)new_mem_size;
+		}
+		if (0 > cf_ll_buf_reserve(particles_llb, (size_t)new_mem_size, (uint8_t **)&b->particle)) {
+			return -AS_PROTO_RESULT_FAIL_UNKNOWN;
+		}
+		result = blob_write_range_from_wire(op_value, op_value_size, existing, &b->particle);
+		break;
 	default:
 		// TODO - just crash?
 		return -AS_PROTO_RESULT_FAIL_UNKNOWN;
@@ -594,6 +753,10 @@ as_bin_particle_stack_modify_from_client(as_bin *b, cf_ll_buf *particles_llb, co
 	if (result < 0) {
 		b->particle = old_particle;
 	}
+	else if (new_mem_size != 0) {
+		// An appended short value is in a particle now.
+		as_bin_state_set_from_type(b, existing_type);
+	}
 
 	return result;
 }
@@ -621,8 +784,13 @@ as_bin_particle_alloc_from_client(as_bin *b, const as_msg_op *op)
 	}
 
 	as_particle *old_particle = b->particle;
+	short_mem buf;
+	bool is_short = fits_short(type, (uint32_t)mem_size);
 
-	if (mem_size != 0) {
+	if (is_short) {
+		b->particle = (as_particle *)&buf;
+	}
+	else if (mem_size != 0) {
 		b->particle = cf_malloc((size_t)mem_size);
 
 		if (! b->particle) {
@@ -636,10 +804,15 @@ as_bin_particle_alloc_from_client(as_bin *b, const as_msg_op *op)
 
 	// Set the bin's iparticle metadata.
 	if (result == 0) {
-		as_bin_state_set_from_type(b, type);
+		if (is_short) {
+			bin_set_short(b, &buf);
+		}
+		else {
+			as_bin_state_set_from_type(b, type);
+		}
 	}
 	else {
-		if (mem_size != 0) {
+		if (mem_size != 0 && ! is_short) {
 			cf_free(b->particle);
 		}
 
@@ -695,6 +868,11 @@ as_bin_particle_stack_from_client(as_bin *b, cf_ll_buf *particles_llb, const as_
 int
 as_bin_particle_replace_from_pickled(as_bin *b, uint8_t **p_pickled)
 {
+	if (as_bin_is_short_particle(b)) {
+		// Nothing to destroy or re-use.
+		as_bin_set_empty(b);
+	}
+
 	uint8_t old_type = as_bin_get_particle_type(b);
 	uint32_t old_mem_size = as_bin_inuse(b) ? particle_vtable[old_type]->size_fn(b->particle) : 0;
 
@@ -717,6 +895,30 @@ as_bin_particle_replace_from_pickled(as_bin *b, uint8_t **p_pickled)
 		return (int)new_mem_size;
 	}
 
+	if (fits_short(new_type, (uint32_t)new_mem_size)) {
+		if (as_bin_inuse(b)) {
+			// Destroy the old particle.
+			particle_vtable[old_type]->destructor_fn(b->particle);
+		}
+
+		short_mem buf;
+
+		b->particle = (as_particle *)&buf;
+
+		// Load the new particle into the bin.
+		int result = particle_vtable[new_type]->from_wire_fn(new_type, new_value, new_value_size, &b->particle);
+
+		if (result == 0) {
+			bin_set_short(b, &buf);
+		}
+		else {
+			b->particle = NULL;
+			as_bin_set_empty(b);
+		}
+
+		return result;
+	}
+
 	if ((uint32_t)new_mem_size != old_mem_size) {
 		if (as_bin_inuse(b)) {
 			// Destroy the old particle.
@@ -821,7 +1023,31 @@ as_bin_particle_compare_from_pickled(const as_bin *b, uint8_t **p_pickled)
 		return -AS_PROTO_RESULT_FAIL_UNKNOWN;
 	}
 
-	return particle_vtable[as_bin_get_particle_type(b)]->compare_from_wire_fn(b->particle, type, value, value_size);
+	short_mem buf;
+
+	return particle_vtable[as_bin_get_particle_type(b)]->compare_from_wire_fn(bin_particle(b, &buf), type, value, value_size);
+}
+
+// Returns 0 if the bin's value equals the op's, positive if not.
+int
+as_bin_particle_compare_from_client(const as_bin *b, const as_msg_op *op)
+{
+	if (! as_bin_inuse(b)) {
+		cf_warning(AS_PARTICLE, "comparing to unused bin");
+		return -AS_PROTO_RESULT_FAIL_UNKNOWN;
+	}
+
+	as_particle_type type = safe_particle_type(op->particle_type);
+
+	if (type == AS_PARTICLE_TYPE_BAD) {
+		return -AS_PROTO_RESULT_FAIL_PARAMETER;
+	}
+
+	uint8_t *value = as_msg_op_get_value_p((as_msg_op *)op);
+	uint32_t value_size = as_msg_op_get_value_sz(op);
+	short_mem buf;
+
+	return particle_vtable[as_bin_get_particle_type(b)]->compare_from_wire_fn(bin_particle(b, &buf), type, value, value_size);
 }
 
 uint32_t
@@ -837,8 +1063,9 @@ as_bin_particle_client_value_size(const as_bin *b)
 	}
 
 	uint8_t type = as_bin_get_particle_type(b);
+	short_mem buf;
 
-	return particle_vtable[type]->wire_size_fn(b->particle);
+	return particle_vtable[type]->wire_size_fn(bin_particle(b, &buf));
 }
 
 uint32_t
@@ -861,20 +1088,47 @@ as_bin_particle_to_client(const as_bin *b, as_msg_op *op)
 	op->particle_type = type;
 
 	uint8_t *value = (uint8_t *)op + sizeof(as_msg_op) + op->name_sz;
-	uint32_t added_size = particle_vtable[type]->to_wire_fn(b->particle, value);
+	short_mem buf;
+	uint32_t added_size = particle_vtable[type]->to_wire_fn(bin_particle(b, &buf), value);
 
 	op->op_sz += added_size;
 
 	return added_size;
 }
 
+// Returns the bin's client value in place, for particle types whose in-memory
+// form holds it contiguously - otherwise returns NULL, and the value must be
+// copied via as_bin_particle_to_client().
+const uint8_t *
+as_bin_particle_client_value_ref(const as_bin *b, uint32_t *p_size)
+{
+	if (! (b && as_bin_inuse(b)) || as_bin_is_hidden(b)) {
+		return NULL;
+	}
+
+	const as_particle_vtable *vtable =
+			particle_vtable[as_bin_get_particle_type(b)];
+
+	if (vtable != &blob_vtable && vtable != &string_vtable) {
+		return NULL;
+	}
+
+	if (as_bin_is_short_particle(b)) {
+		*p_size = b->svalue.sz;
+		return b->svalue.data;
+	}
+
+	return blob_wire_ref(b->particle, p_size);
+}
+
 uint32_t
 as_bin_particle_pickled_size(const as_bin *b)
 {
 	uint8_t type = as_bin_get_particle_type(b);
+	short_mem buf;
 
 	// Always a type byte and a 32-bit size.
-	return 1 + 4 + particle_vtable[type]->wire_size_fn(b->particle);
+	return 1 + 4 + particle_vtable[type]->wire_size_fn(bin_particle(b, &buf));
 }
 
 uint32_t
@@ -886,7 +1140,8 @@ as_bin_particle_to_pickled(const as_bin *b, uint8_t *pickled)
 
 	uint32_t *p_size = (uint32_t *)pickled;
 	uint8_t *value = (uint8_t *)(p_size + 1);
-	uint32_t size = particle_vtable[type]->to_wire_fn(b->particle, value);
+	short_mem buf;
+	uint32_t size = particle_vtable[type]->to_wire_fn(bin_particle(b, &buf), value);
 
 	*p_size = cf_swap_to_be32(size);
 
@@ -912,8 +1167,13 @@ as_bin_particle_replace_from_asval(as_bin *b, const as_val *val)
 	// TODO - could this ever fail?
 
 	as_particle *old_particle = b->particle;
+	short_mem buf;
+	bool is_short = fits_short(new_type, new_mem_size);
 
-	if (new_mem_size != 0) {
+	if (is_short) {
+		b->particle = (as_particle *)&buf;
+	}
+	else if (new_mem_size != 0) {
 		b->particle = cf_malloc(new_mem_size);
 
 		if (! b->particle) {
@@ -926,13 +1186,18 @@ as_bin_particle_replace_from_asval(as_bin *b, const as_val *val)
 	particle_vtable[new_type]->from_asval_fn(val, &b->particle);
 	// TODO - could this ever fail?
 
-	if (as_bin_inuse(b)) {
+	if (as_bin_inuse(b) && ! as_bin_is_short_particle(b)) {
 		// Destroy the old particle.
 		particle_vtable[old_type]->destructor_fn(old_particle);
 	}
 
 	// Set the bin's iparticle metadata.
-	as_bin_state_set_from_type(b, new_type);
+	if (is_short) {
+		bin_set_short(b, &buf);
+	}
+	else {
+		as_bin_state_set_from_type(b, new_type);
+	}
 
 	return 0;
 }
@@ -971,8 +1236,10 @@ as_bin_particle_to_asval(const as_bin *b)
 {
 	uint8_t type = as_bin_get_particle_type(b);
 
+	short_mem buf;
+
 	// Caller is responsible for freeing as_val returned here.
-	return particle_vtable[type]->to_asval_fn(b->particle);
+	return particle_vtable[type]->to_asval_fn(bin_particle(b, &buf));
 }
 
 //------------------------------------------------
@@ -995,8 +1262,13 @@ as_bin_particle_alloc_from_msgpack(as_bin *b, const uint8_t *packed, uint32_t pa
 	}
 
 	uint32_t mem_size = particle_vtable[type]->size_from_msgpack_fn(packed, packed_size);
+	short_mem buf;
+	bool is_short = fits_short(type, mem_size);
 
-	if (mem_size != 0) {
+	if (is_short) {
+		b->particle = (as_particle *)&buf;
+	}
+	else if (mem_size != 0) {
 		b->particle = cf_malloc(mem_size);
 
 		if (! b->particle) {
@@ -1007,7 +1279,12 @@ as_bin_particle_alloc_from_msgpack(as_bin *b, const uint8_t *packed, uint32_t pa
 	particle_vtable[type]->from_msgpack_fn(packed, packed_size, &b->particle);
 
 	// Set the bin's iparticle metadata.
-	as_bin_state_set_from_type(b, type);
+	if (is_short) {
+		bin_set_short(b, &buf);
+	}
+	else {
+		as_bin_state_set_from_type(b, type);
+	}
 
 	return 0;
 }
@@ -1058,10 +1335,23 @@ as_bin_particle_replace_from_flat(as_bin *b, const uint8_t *flat, uint32_t flat_
 	}
 
 	// Just destroy the old particle, if any - we're replacing it.
-	if (as_bin_inuse(b)) {
+	if (as_bin_inuse(b) && ! as_bin_is_short_particle(b)) {
 		particle_vtable[old_type]->destructor_fn(b->particle);
 	}
 
+	int32_t mem_size = particle_vtable[new_type]->size_from_flat_fn(flat, flat_size);
+
+	if (mem_size >= 0 && fits_short(new_type, (uint32_t)mem_size)) {
+		as_particle *p;
+
+		// Flat and in-memory formats are identical for these types - copy the
+		// value straight into the bin.
+		particle_vtable[new_type]->cast_from_flat_fn((uint8_t *)flat, flat_size, &p);
+		bin_set_short(b, (const short_mem *)p);
+
+		return 0;
+	}
+
 	// Load the new particle into the bin.
 	int result = particle_vtable[new_type]->from_flat_fn(flat, flat_size, &b->particle);
 
@@ -1086,8 +1376,9 @@ as_bin_particle_flat_size(as_bin *b)
 	}
 
 	uint8_t type = as_bin_get_particle_type(b);
+	short_mem buf;
 
-	return particle_vtable[type]->flat_size_fn(b->particle);
+	return particle_vtable[type]->flat_size_fn(bin_particle(b, &buf));
 }
 
 uint32_t
@@ -1103,7 +1394,9 @@ as_bin_particle_to_flat(const as_bin *b, uint8_t *flat)
 
 	*flat = type;
 
-	return particle_vtable[type]->to_flat_fn(b->particle, flat);
+	short_mem buf;
+
+	return particle_vtable[type]->to_flat_fn(bin_particle(b, &buf), flat);
 }
 
 
@@ -1160,6 +1453,50 @@ as_ldt_particle_to_client(as_val *val, as_msg_op *op)
 }
 
 
+//==========================================================
+// as_bin particle functions specific to blobs.
+//
+
+// Result is a new blob of the range - the value is offset then length.
+int
+as_bin_blob_read_from_client(const as_bin *b, const as_msg_op *op, as_bin *result)
+{
+	if (as_msg_op_get_value_sz(op) != 2 * sizeof(uint32_t)) {
+		cf_warning(AS_PARTICLE, "byte range read value size %u", as_msg_op_get_value_sz(op));
+		return -AS_PROTO_RESULT_FAIL_PARAMETER;
+	}
+
+	if (as_bin_get_particle_type(b) != AS_PARTICLE_TYPE_BLOB) {
+		return -AS_PROTO_RESULT_FAIL_INCOMPATIBLE_TYPE;
+	}
+
+	const uint32_t *op_value = (const uint32_t *)as_msg_op_get_value_p((as_msg_op *)op);
+	uint32_t offset = cf_swap_from_be32(op_value[0]);
+	uint32_t length = cf_swap_from_be32(op_value[1]);
+
+	short_mem buf;
+	const as_particle *existing = bin_particle(b, &buf);
+	int32_t mem_size = blob_read_range_size(existing, offset, length);
+
+	if (mem_size < 0) {
+		return (int)mem_size;
+	}
+
+	as_particle *range = cf_malloc((size_t)mem_size);
+
+	if (! range) {
+		return -AS_PROTO_RESULT_FAIL_UNKNOWN;
+	}
+
+	blob_read_range(existing, offset, length, &range);
+
+	result->particle = range;
+	as_bin_state_set_from_type(result, AS_PARTICLE_TYPE_BLOB);
+
+	return 0;
+}
+
+
 //==========================================================
 // as_bin particle functions specific to CDTs.
 //
@@ -31,6 +31,7 @@
 #include "aerospike/as_msgpack.h"
 #include "aerospike/as_val.h"
 #include "citrusleaf/alloc.h"
+#include "citrusleaf/cf_byte_order.h"
 
 #include "fault.h"
 
@@ -226,6 +227,18 @@ blob_to_wire(const as_particle *p, uint8_t *wire)
 	return p_blob_mem->sz;
 }
 
+// Not in the vtable - wire value is the in-memory data, so can be referenced
+// in place rather than copied.
+const uint8_t *
+blob_wire_ref(const as_particle *p, uint32_t *p_size)
+{
+	const blob_mem *p_blob_mem = (const blob_mem *)p;
+
+	*p_size = p_blob_mem->sz;
+
+	return p_blob_mem->data;
+}
+
 //------------------------------------------------
 // Handle as_val translation.
 //
@@ -402,6 +415,105 @@ blob_to_flat(const as_particle *p, uint8_t *flat)
 }
 
 
+//------------------------------------------------
+// Handle byte ranges.
+//
+
+int32_t
+blob_write_range_size_from_wire(as_particle_type wire_type, const uint8_t *wire_value, uint32_t value_size, const as_particle *p)
+{
+	const blob_mem *p_blob_mem = (const blob_mem *)p;
+
+	if (p_blob_mem->type != AS_PARTICLE_TYPE_BLOB || wire_type != AS_PARTICLE_TYPE_BLOB) {
+		cf_warning(AS_PARTICLE, "byte range write needs blobs, %d:%d", p_blob_mem->type, wire_type);
+		return -AS_PROTO_RESULT_FAIL_INCOMPATIBLE_TYPE;
+	}
+
+	if (value_size < sizeof(uint32_t)) {
+		cf_warning(AS_PARTICLE, "byte range write value too small %u", value_size);
+		return -AS_PROTO_RESULT_FAIL_PARAMETER;
+	}
+
+	uint32_t offset = cf_swap_from_be32(*(const uint32_t *)wire_value);
+	uint32_t data_size = value_size - (uint32_t)sizeof(uint32_t);
+
+	if (offset > p_blob_mem->sz) {
+		cf_warning(AS_PARTICLE, "byte range write offset %u past blob size %u", offset, p_blob_mem->sz);
+		return -AS_PROTO_RESULT_FAIL_PARAMETER;
+	}
+
+	uint32_t new_sz = offset + data_size > p_blob_mem->sz ?
+			offset + data_size : p_blob_mem->sz;
+
+	return (int32_t)(sizeof(blob_mem) + new_sz);
+}
+
+// Call only after sizing - *pp must be big enough, and not overlap p.
+int
+blob_write_range_from_wire(const uint8_t *wire_value, uint32_t value_size, const as_particle *p, as_particle **pp)
+{
+	const blob_mem *p_blob_mem = (const blob_mem *)p;
+	blob_mem *p_new_blob_mem = (blob_mem *)*pp;
+
+	uint32_t offset = cf_swap_from_be32(*(const uint32_t *)wire_value);
+	uint32_t data_size = value_size - (uint32_t)sizeof(uint32_t);
+
+	p_new_blob_mem->type = p_blob_mem->type;
+	p_new_blob_mem->sz = offset + data_size > p_blob_mem->sz ?
+			offset + data_size : p_blob_mem->sz;
+
+	// Only the bytes not overwritten need copying.
+	memcpy(p_new_blob_mem->data, p_blob_mem->data, offset);
+	memcpy(p_new_blob_mem->data + offset, wire_value + sizeof(uint32_t), data_size);
+
+	if (offset + data_size < p_blob_mem->sz) {
+		memcpy(p_new_blob_mem->data + offset + data_size,
+				p_blob_mem->data + offset + data_size,
+				p_blob_mem->sz - offset - data_size);
+	}
+
+	return 0;
+}
+
+int32_t
+blob_read_range_size(const as_particle *p, uint32_t offset, uint32_t length)
+{
+	const blob_mem *p_blob_mem = (const blob_mem *)p;
+
+	if (p_blob_mem->type != AS_PARTICLE_TYPE_BLOB) {
+		cf_warning(AS_PARTICLE, "byte range read of non-blob type %d", p_blob_mem->type);
+		return -AS_PROTO_RESULT_FAIL_INCOMPATIBLE_TYPE;
+	}
+
+	if (offset > p_blob_mem->sz) {
+		cf_warning(AS_PARTICLE, "byte range read offset %u past blob size %u", offset, p_blob_mem->sz);
+		return -AS_PROTO_RESULT_FAIL_PARAMETER;
+	}
+
+	if (length > p_blob_mem->sz - offset) {
+		length = p_blob_mem->sz - offset;
+	}
+
+	return (int32_t)(sizeof(blob_mem) + length);
+}
+
+// Call only after sizing - *pp must be big enough.
+void
+blob_read_range(const as_particle *p, uint32_t offset, uint32_t length, as_particle **pp)
+{
+	const blob_mem *p_blob_mem = (const blob_mem *)p;
+	blob_mem *p_range_mem = (blob_mem *)*pp;
+
+	if (length > p_blob_mem->sz - offset) {
+		length = p_blob_mem->sz - offset;
+	}
+
+	p_range_mem->type = p_blob_mem->type;
+	p_range_mem->sz = length;
+	memcpy(p_range_mem->data, p_blob_mem->data + offset, length);
+}
+
+
 //==========================================================
 // Local helpers.
 //
@@ -454,36 +454,33 @@ as_particle_geojson_match(as_particle *particle, uint64_t query_cellid, geo_regi
 	uint64_t *cells = (uint64_t *)gp->data;
 
 	uint64_t candidate_cellid = cells[0];
-	geo_region_t candidate_region = NULL;
 
 	bool candidate_is_region = (gp->flags & GEOJSON_ISREGION) != 0;
 
-	// If we are a strict RCP query on a region candidate we need to
-	// run the parser to obtain a candidate_region for the matcher.
+	// If we are a strict RCP query on a region candidate we need the parsed
+	// candidate region - from the geometry cache, parsing only on a miss.
 	//
 	if (query_cellid != 0 && candidate_is_region && is_strict) {
 		size_t jsonsz;
 		char const *jsonptr = geojson_mem_jsonstr(gp, &jsonsz);
+		bool iswithin;
 
-		if (! geo_parse(NULL, jsonptr, jsonsz, &candidate_cellid,
-				&candidate_region)) {
-			cf_warning(AS_PARTICLE, "geo_parse() failed - unexpected");
-			geo_region_destroy(candidate_region);
+		if (! geo_json_region_contains(jsonptr, jsonsz, query_cellid,
+				&iswithin)) {
+			cf_warning(AS_PARTICLE, "geo_json_region_contains() failed - unexpected");
 			return false;
 		}
+
+		return iswithin;
 	}
 
-	bool ismatch = geojson_match(
+	return geojson_match(
 			candidate_is_region,
 			candidate_cellid,
-			candidate_region,
+			NULL,
 			query_cellid,
 			query_region,
 			is_strict);
-
-	geo_region_destroy(candidate_region);
-
-	return ismatch;
 }
 
 bool
@@ -494,28 +491,33 @@ as_particle_geojson_match_asval(const as_val *val, uint64_t query_cellid, geo_re
 	char * jsonptr = as_geojson_get(pg);
 
 	uint64_t candidate_cellid = 0;
-	geo_region_t candidate_region = NULL;
 
-	if (! geo_parse(NULL, jsonptr, jsonsz, &candidate_cellid,
-			&candidate_region)) {
-		cf_warning(AS_PARTICLE, "geo_parse() failed - unexpected");
-		geo_region_destroy(candidate_region);
+	if (! geo_json_point(jsonptr, jsonsz, &candidate_cellid)) {
+		cf_warning(AS_PARTICLE, "geo_json_point() failed - unexpected");
 		return false;
 	}
 
 	bool candidate_is_region = candidate_cellid == 0;
 
-	bool ismatch = geojson_match(
+	if (query_cellid != 0 && candidate_is_region && is_strict) {
+		bool iswithin;
+
+		if (! geo_json_region_contains(jsonptr, jsonsz, query_cellid,
+				&iswithin)) {
+			cf_warning(AS_PARTICLE, "geo_json_region_contains() failed - unexpected");
+			return false;
+		}
+
+		return iswithin;
+	}
+
+	return geojson_match(
 			candidate_is_region,
 			candidate_cellid,
-			candidate_region,
+			NULL,
 			query_cellid,
 			query_region,
 			is_strict);
-
-	geo_region_destroy(candidate_region);
-
-	return ismatch;
 }
 
 
@@ -23,6 +23,7 @@
 #include <stdarg.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "aerospike/as_buffer.h"
@@ -123,6 +124,10 @@ const as_particle_vtable list_vtable = {
 
 #define AS_PACKED_LIST_INDEX_STEP	128
 
+// Flags in the ext element heading a list - as for maps, a list with no flags
+// has no ext element.
+#define AS_PACKED_LIST_FLAG_ORDERED	0x01
+
 typedef struct as_packed_list_index_s {
 	uint32_t count;
 	uint32_t cap;
@@ -140,8 +145,23 @@ typedef struct as_packed_list_s {
 	uint32_t seg2_index;
 	uint32_t seg2_size;
 	uint32_t nil_ele_size;	// number of nils we need to insert
+
+	uint8_t flags;			// valid once element count is extracted
 } as_packed_list;
 
+// Search bounds for value ops - end NULL means no upper bound, end == start
+// means only values equal to start.
+typedef struct list_value_interval_s {
+	const cdt_payload *start;
+	const cdt_payload *end;
+} list_value_interval;
+
+// An element of a packed buffer, for sorting.
+typedef struct list_item_s {
+	uint32_t offset;
+	uint32_t size;
+} list_item;
+
 #define CDT_FLAG_PACKED_NEED_FREE	1
 
 typedef struct list_wrapper_s {
@@ -191,10 +211,11 @@ static const list_wrapper list_wrapper_empty = {
 static inline bool is_list_type(uint8_t type);
 
 // as_bin
-static inline void as_bin_set_empty_packed_list(as_bin *b, rollback_alloc *alloc_buf);
+static inline void as_bin_set_empty_packed_list(as_bin *b, rollback_alloc *alloc_buf, uint8_t flags);
 static inline as_packed_list_index *as_bin_get_packed_list_index(const as_bin *b);
 static inline void as_bin_create_temp_packed_list_if_notinuse(as_bin *b);
 static inline bool as_bin_is_temp_packed_list(const as_bin *b);
+static inline bool as_bin_is_ordered_packed_list(const as_bin *b);
 
 // as_packed_list
 static int32_t as_packed_list_get_new_element_count(as_packed_list *pl);
@@ -205,6 +226,8 @@ static int64_t as_packed_list_insert(as_packed_list *pl, uint32_t index, uint32_
 static int32_t as_packed_list_remove(as_packed_list *pl, uint32_t index, uint32_t count, as_packed_list_index *pli);
 static int32_t as_packed_list_write_hdrseg1(as_packed_list *pl, uint8_t *buf);
 static int32_t as_packed_list_write_header(uint8_t *buf, uint32_t ele_count);
+static int32_t as_packed_list_write_header_flags(uint8_t *buf, uint32_t ele_count, uint8_t flags);
+static inline uint32_t as_packed_list_header_size(uint32_t ele_count, uint8_t flags);
 static int32_t as_packed_list_write_header_new(as_packed_list *pl, uint8_t *buf);
 static int32_t as_packed_list_write_header_old(as_packed_list *pl, uint8_t *buf);
 static uint32_t as_packed_list_write_seg1(as_packed_list *pl, uint8_t *buf);
@@ -226,6 +249,14 @@ static void list_wrapper_init(list_wrapper *p_list_wrapped, uint32_t ele_count);
 
 // packed_list create
 static as_particle *packed_list_create(rollback_alloc *alloc_buf, uint32_t ele_count, const uint8_t *buf, uint32_t size, bool wrapped);
+static as_particle *packed_list_create_empty_flags(rollback_alloc *alloc_buf, uint8_t flags);
+
+// ordered list
+static bool ordered_list_find(const as_packed_list *pl, as_packed_list_index *pli, const cdt_payload *value, bool after_equal, uint32_t *p_index, uint32_t *p_offset);
+static bool ordered_list_find_interval(const as_packed_list *pl, as_packed_list_index *pli, const list_value_interval *interval, uint32_t *p_index, uint32_t *p_offset, uint32_t *p_end_index, uint32_t *p_end_offset);
+static int unordered_list_ele_match(const uint8_t *buf, uint32_t offset, uint32_t length, const list_value_interval *interval);
+static int list_item_sort_compare(const void *a, const void *b, void *arg);
+static list_item *list_items_sorted(const uint8_t *buf, uint32_t offset, uint32_t length, uint32_t ele_count);
 
 // packed_list ops
 static int packed_list_append(as_bin *b, rollback_alloc *alloc_buf, const cdt_payload *payload, bool payload_is_container, as_bin *result);
@@ -234,6 +265,10 @@ static int packed_list_remove(as_bin *b, rollback_alloc *alloc_buf, int64_t inde
 static int packed_list_set(as_bin *b, rollback_alloc *alloc_buf, const cdt_payload *payload, int64_t index);
 static int packed_list_trim(as_bin *b, rollback_alloc *alloc_buf, int64_t index, uint64_t count, as_bin *result);
 static uint8_t *packed_list_setup_bin(as_bin *b, rollback_alloc *alloc_buf, uint32_t new_size, uint32_t index, uint32_t new_ele_count, as_packed_list_index *pli);
+static int packed_list_set_flags(as_bin *b, rollback_alloc *alloc_buf, uint8_t flags);
+static int packed_list_add_ordered(as_bin *b, rollback_alloc *alloc_buf, const cdt_payload *payload, bool payload_is_container, as_bin *result);
+static int packed_list_get_by_value_interval(const as_bin *b, const list_value_interval *interval, rollback_alloc *alloc_result, as_bin *result);
+static int packed_list_remove_by_value_interval(as_bin *b, rollback_alloc *alloc_buf, const list_value_interval *interval, as_bin *result);
 
 // Debugging support
 static void print_cdt_list_particle(const as_particle *p);
@@ -413,6 +448,29 @@ list_to_asval(const as_particle *p)
 		buf.size = p_list_mem->sz;
 	}
 
+	// The as_val has no flags - strip an ordered list's ext element.
+	as_packed_list pl;
+	as_packed_list_init(&pl, buf.data, buf.size);
+
+	uint8_t *stripped = NULL;
+	int32_t ele_count = as_packed_list_header_element_count(&pl);
+
+	if (ele_count >= 0 && pl.flags != 0) {
+		uint32_t content_sz = buf.size - (uint32_t)pl.upk.offset;
+
+		if (! (stripped = cf_malloc(as_pack_list_header_get_size(ele_count) + content_sz))) {
+			return NULL;
+		}
+
+		uint32_t hdr_sz = (uint32_t)as_packed_list_write_header(stripped, (uint32_t)ele_count);
+
+		memcpy(stripped + hdr_sz, buf.data + pl.upk.offset, content_sz);
+
+		buf.data = stripped;
+		buf.capacity = hdr_sz + content_sz;
+		buf.size = hdr_sz + content_sz;
+	}
+
 	as_serializer s;
 	as_msgpack_init(&s);
 
@@ -421,6 +479,10 @@ list_to_asval(const as_particle *p)
 	as_serializer_deserialize(&s, &buf, &val);
 	as_serializer_destroy(&s);
 
+	if (stripped) {
+		cf_free(stripped);
+	}
+
 	return val;
 }
 
@@ -607,12 +669,19 @@ is_list_type(uint8_t type)
 //
 
 static inline void
-as_bin_set_empty_packed_list(as_bin *b, rollback_alloc *alloc_buf)
+as_bin_set_empty_packed_list(as_bin *b, rollback_alloc *alloc_buf, uint8_t flags)
 {
 #if defined(CDT_LIST_DISALLOW_EMPTY)
 	as_bin_set_empty(b);
 #else
-	b->particle = packed_list_simple_create_empty(alloc_buf);
+	if (flags == 0) {
+		b->particle = packed_list_simple_create_empty(alloc_buf);
+	}
+	else {
+		// An emptied ordered list stays ordered.
+		b->particle = packed_list_create_empty_flags(alloc_buf, flags);
+	}
+
 	as_bin_state_set_from_type(b, AS_PARTICLE_TYPE_LIST);
 #endif
 }
@@ -643,6 +712,16 @@ as_bin_is_temp_packed_list(const as_bin *b)
 	return b->particle == (const as_particle *)&list_wrapper_empty;
 }
 
+static inline bool
+as_bin_is_ordered_packed_list(const as_bin *b)
+{
+	as_packed_list pl;
+	as_packed_list_init_from_bin(&pl, b);
+
+	return as_packed_list_header_element_count(&pl) >= 0 &&
+			(pl.flags & AS_PACKED_LIST_FLAG_ORDERED) != 0;
+}
+
 //----------------------------------------------------------
 // as_packed_list
 //
@@ -667,6 +746,20 @@ as_packed_list_header_element_count(as_packed_list *pl)
 
 	if ((pl->ele_count = as_unpack_list_header_element_count(&pl->upk)) < 0) {
 		pl->ele_count = -AS_PACKED_LIST_FAILED;
+		return pl->ele_count;
+	}
+
+	// A leading ext element holds flags - it's not one of the elements.
+	if (pl->ele_count > 0 && as_unpack_peek_is_ext(&pl->upk)) {
+		as_msgpack_ext ext;
+
+		if (as_unpack_ext(&pl->upk, &ext) != 0) {
+			pl->ele_count = -AS_PACKED_LIST_FAILED;
+			return pl->ele_count;
+		}
+
+		pl->flags = ext.type;
+		pl->ele_count--;
 	}
 
 	return pl->ele_count;
@@ -687,6 +780,8 @@ as_packed_list_init(as_packed_list *pl, const uint8_t *buf, uint32_t size)
 	pl->seg2_index = 0;
 	pl->seg2_size = 0;
 	pl->nil_ele_size = 0;
+
+	pl->flags = 0;
 }
 
 static void
@@ -751,7 +846,7 @@ as_packed_list_insert(as_packed_list *pl, uint32_t index, uint32_t count, uint32
 		pl->seg1_size -= pl->header_size;
 	}
 
-	return (int64_t)as_pack_list_header_get_size(pl->new_ele_count)
+	return (int64_t)as_packed_list_header_size((uint32_t)pl->new_ele_count, pl->flags)
 			+ pl->seg1_size
 			+ pl->nil_ele_size
 			+ insert_size
@@ -801,10 +896,8 @@ as_packed_list_remove(as_packed_list *pl, uint32_t index, uint32_t count, as_pac
 
 			pl->seg1_size = (uint32_t)pl->upk.offset;
 
-			for (uint32_t i = 0; i < count; i++) {
-				if (as_unpack_size(&pl->upk) < 0) {
-					return -4;
-				}
+			if (cdt_unpack_size_n(&pl->upk, count) < 0) {
+				return -4;
 			}
 
 			pl->seg2_index = (uint32_t)pl->upk.offset;
@@ -815,7 +908,7 @@ as_packed_list_remove(as_packed_list *pl, uint32_t index, uint32_t count, as_pac
 		pl->seg1_size -= pl->header_size;
 	}
 
-	return (int32_t)(as_pack_list_header_get_size(pl->new_ele_count)
+	return (int32_t)(as_packed_list_header_size((uint32_t)pl->new_ele_count, pl->flags)
 			+ pl->seg1_size
 			+ pl->seg2_size);
 }
@@ -857,6 +950,42 @@ as_packed_list_write_header(uint8_t *buf, uint32_t ele_count)
 	return pk.offset;
 }
 
+// Write header with ele_count elements, and an ext element if there are flags.
+// Return -1 on failure, number of bytes written.
+static int32_t
+as_packed_list_write_header_flags(uint8_t *buf, uint32_t ele_count, uint8_t flags)
+{
+	if (flags == 0) {
+		return as_packed_list_write_header(buf, ele_count);
+	}
+
+	as_packer pk = {
+			.head = NULL,
+			.tail = NULL,
+			.buffer = buf,
+			.offset = 0,
+			.capacity = INT_MAX,
+	};
+
+	if (as_pack_list_header(&pk, ele_count + 1) != 0) {
+		return -1;
+	}
+
+	as_pack_ext_header(&pk, 0, flags);
+
+	return pk.offset;
+}
+
+static inline uint32_t
+as_packed_list_header_size(uint32_t ele_count, uint8_t flags)
+{
+	if (flags == 0) {
+		return as_pack_list_header_get_size(ele_count);
+	}
+
+	return as_pack_list_header_get_size(ele_count + 1) + as_pack_ext_header_get_size(0);
+}
+
 // Write new header.
 // Return -1 on failure, number of bytes written.
 static int32_t
@@ -866,7 +995,7 @@ as_packed_list_write_header_new(as_packed_list *pl, uint8_t *buf)
 		return -1;
 	}
 
-	return as_packed_list_write_header(buf, pl->new_ele_count);
+	return as_packed_list_write_header_flags(buf, (uint32_t)pl->new_ele_count, pl->flags);
 }
 
 // Write original header.
@@ -880,7 +1009,7 @@ as_packed_list_write_header_old(as_packed_list *pl, uint8_t *buf)
 		return -1;
 	}
 
-	return as_packed_list_write_header(buf, ele_count);
+	return as_packed_list_write_header_flags(buf, (uint32_t)ele_count, pl->flags);
 }
 
 // Write segment 1 and trailing nils if any.
@@ -974,29 +1103,24 @@ as_unpack_list_elements_find_index(as_unpacker *pk, uint32_t index, as_packed_li
 			}
 		}
 
-		uint32_t count_down = AS_PACKED_LIST_INDEX_STEP;
+		// Skip a block at a time, filling in the index on the way.
+		while (index != 0) {
+			uint32_t n = index < AS_PACKED_LIST_INDEX_STEP ? index : AS_PACKED_LIST_INDEX_STEP;
 
-		for (uint32_t i = 0; i < index; i++) {
-			if (as_unpack_size(pk) < 0) {
+			if (cdt_unpack_size_n(pk, n) < 0) {
 				return NULL;
 			}
 
-			if (--count_down == 0) {
-				if (pli->count < pli->cap) {
-					pli->indexes[pli->count] = pk->offset - start_offset;
-					pli->count++;
-				}
+			index -= n;
 
-				count_down = AS_PACKED_LIST_INDEX_STEP;
+			if (n == AS_PACKED_LIST_INDEX_STEP && pli->count < pli->cap) {
+				pli->indexes[pli->count] = pk->offset - start_offset;
+				pli->count++;
 			}
 		}
 	}
-	else {
-		for (uint32_t i = 0; i < index; i++) {
-			if (as_unpack_size(pk) < 0) {
-				return NULL;
-			}
-		}
+	else if (cdt_unpack_size_n(pk, index) < 0) {
+		return NULL;
 	}
 
 	return pk->buffer + pk->offset;
@@ -1169,6 +1293,273 @@ packed_list_simple_create_empty(rollback_alloc *alloc_buf)
 	return packed_list_simple_create_from_buf(alloc_buf, 0, NULL, 0);
 }
 
+static as_particle *
+packed_list_create_empty_flags(rollback_alloc *alloc_buf, uint8_t flags)
+{
+	uint32_t size = as_packed_list_header_size(0, flags);
+	list_mem *p_list_mem = (list_mem *)rollback_alloc_reserve(alloc_buf, sizeof(list_mem) + size);
+
+	if (! p_list_mem) {
+		return NULL;
+	}
+
+	p_list_mem->type = AS_PARTICLE_TYPE_LIST;
+	p_list_mem->sz = size;
+
+	as_packed_list_write_header_flags(p_list_mem->data, 0, flags);
+
+	return (as_particle *)p_list_mem;
+}
+
+//----------------------------------------------------------
+// ordered list
+//
+
+static msgpack_compare_t
+list_ele_compare(const uint8_t *buf, uint32_t offset, uint32_t length, const cdt_payload *value)
+{
+	as_unpacker pk_ele = {
+			.buffer = buf + offset,
+			.offset = 0,
+			.length = (int)(length - offset)
+	};
+
+	as_unpacker pk_value = {
+			.buffer = value->ptr,
+			.offset = 0,
+			.length = (int)value->size
+	};
+
+	return as_unpack_compare(&pk_ele, &pk_value);
+}
+
+static inline bool
+list_ele_goes_before(msgpack_compare_t cmp, bool after_equal)
+{
+	return cmp == MSGPACK_COMPARE_LESS ||
+			(after_equal && cmp == MSGPACK_COMPARE_EQUAL);
+}
+
+// Assumes element count has already been extracted.
+// Find the first element not less than value - or greater than value, if
+// after_equal. With an index, binary search the indexed blocks, then walk one
+// block. Offset is from start of the packed buffer.
+// Return false on failure.
+static bool
+ordered_list_find(const as_packed_list *pl, as_packed_list_index *pli, const cdt_payload *value, bool after_equal, uint32_t *p_index, uint32_t *p_offset)
+{
+	const uint8_t *buf = pl->upk.buffer;
+	uint32_t length = (uint32_t)pl->upk.length;
+	uint32_t ele_count = (uint32_t)pl->ele_count;
+	as_unpacker pk = pl->upk;
+	uint32_t data_offset = (uint32_t)pk.offset;
+	uint32_t index = 0;
+
+	if (pli && ele_count > AS_PACKED_LIST_INDEX_STEP) {
+		uint32_t n_blocks = (ele_count - 1) / AS_PACKED_LIST_INDEX_STEP + 1;
+
+		// Index is filled lazily - fill it in one pass, so this and later
+		// searches are O(log n).
+		if (pli->count < n_blocks - 1 && pli->count < pli->cap) {
+			if (! as_unpack_list_elements_find_index(&pk, ele_count, pli)) {
+				return false;
+			}
+
+			pk.offset = (int)data_offset;
+		}
+
+		// Block k starts at element k * STEP. Find the last block whose first
+		// element goes before value.
+		uint32_t lower = 0;
+		uint32_t upper = pli->count + 1 < n_blocks ? pli->count + 1 : n_blocks;
+
+		while (upper - lower > 1) {
+			uint32_t mid = (lower + upper) / 2;
+			msgpack_compare_t cmp = list_ele_compare(buf, data_offset + pli->indexes[mid - 1], length, value);
+
+			if (cmp == MSGPACK_COMPARE_ERROR) {
+				return false;
+			}
+
+			if (list_ele_goes_before(cmp, after_equal)) {
+				lower = mid;
+			}
+			else {
+				upper = mid;
+			}
+		}
+
+		if (lower > 0) {
+			index = lower * AS_PACKED_LIST_INDEX_STEP;
+			pk.offset = (int)(data_offset + pli->indexes[lower - 1]);
+		}
+	}
+
+	for (; index < ele_count; index++) {
+		msgpack_compare_t cmp = list_ele_compare(buf, (uint32_t)pk.offset, length, value);
+
+		if (cmp == MSGPACK_COMPARE_ERROR) {
+			return false;
+		}
+
+		if (! list_ele_goes_before(cmp, after_equal)) {
+			break;
+		}
+
+		if (cdt_unpack_size(&pk) < 0) {
+			return false;
+		}
+	}
+
+	*p_index = index;
+	*p_offset = (uint32_t)pk.offset;
+
+	return true;
+}
+
+// Find the run of elements in interval - [start, end), or equal to start.
+// Return false on failure.
+static bool
+ordered_list_find_interval(const as_packed_list *pl, as_packed_list_index *pli, const list_value_interval *interval, uint32_t *p_index, uint32_t *p_offset, uint32_t *p_end_index, uint32_t *p_end_offset)
+{
+	if (! ordered_list_find(pl, pli, interval->start, false, p_index, p_offset)) {
+		return false;
+	}
+
+	if (! interval->end) {
+		*p_end_index = (uint32_t)pl->ele_count;
+		*p_end_offset = (uint32_t)pl->upk.length;
+		return true;
+	}
+
+	bool equal_only = interval->end == interval->start;
+
+	if (! ordered_list_find(pl, pli, interval->end, equal_only, p_end_index, p_end_offset)) {
+		return false;
+	}
+
+	// Interval is backwards - nothing in it.
+	if (*p_end_index < *p_index) {
+		*p_end_index = *p_index;
+		*p_end_offset = *p_offset;
+	}
+
+	return true;
+}
+
+// Return -1 on failure, 1 if element at offset is in interval, otherwise 0.
+static int
+unordered_list_ele_match(const uint8_t *buf, uint32_t offset, uint32_t length, const list_value_interval *interval)
+{
+	msgpack_compare_t cmp = list_ele_compare(buf, offset, length, interval->start);
+
+	if (cmp == MSGPACK_COMPARE_ERROR) {
+		return -1;
+	}
+
+	if (cmp == MSGPACK_COMPARE_LESS) {
+		return 0;
+	}
+
+	if (! interval->end) {
+		return 1;
+	}
+
+	if (interval->end == interval->start) {
+		return cmp == MSGPACK_COMPARE_EQUAL ? 1 : 0;
+	}
+
+	if ((cmp = list_ele_compare(buf, offset, length, interval->end)) == MSGPACK_COMPARE_ERROR) {
+		return -1;
+	}
+
+	return cmp == MSGPACK_COMPARE_LESS ? 1 : 0;
+}
+
+typedef struct list_item_sort_userdata_s {
+	const uint8_t *buf;
+	bool error;
+} list_item_sort_userdata;
+
+// qsort_r callback function.
+static int
+list_item_sort_compare(const void *a, const void *b, void *arg)
+{
+	list_item_sort_userdata *udata = (list_item_sort_userdata *)arg;
+
+	if (udata->error) {
+		return 0;
+	}
+
+	const list_item *x = (const list_item *)a;
+	const list_item *y = (const list_item *)b;
+	cdt_payload value = {
+			.ptr = udata->buf + y->offset,
+			.size = y->size
+	};
+
+	msgpack_compare_t cmp = list_ele_compare(udata->buf, x->offset, x->offset + x->size, &value);
+
+	if (cmp == MSGPACK_COMPARE_LESS) {
+		return -1;
+	}
+
+	if (cmp == MSGPACK_COMPARE_EQUAL) {
+		// Keep sort stable.
+		return x->offset < y->offset ? -1 : 1;
+	}
+
+	if (cmp == MSGPACK_COMPARE_GREATER) {
+		return 1;
+	}
+
+	udata->error = true;
+	return 0;
+}
+
+// Return sorted offset/size of ele_count elements from offset, to be freed
+// by caller, or NULL on failure.
+static list_item *
+list_items_sorted(const uint8_t *buf, uint32_t offset, uint32_t length, uint32_t ele_count)
+{
+	list_item *items = cf_malloc(sizeof(list_item) * ele_count);
+
+	if (! items) {
+		return NULL;
+	}
+
+	as_unpacker pk = {
+			.buffer = buf,
+			.offset = (int)offset,
+			.length = (int)length
+	};
+
+	for (uint32_t i = 0; i < ele_count; i++) {
+		items[i].offset = (uint32_t)pk.offset;
+
+		if (cdt_unpack_size(&pk) < 0) {
+			cf_free(items);
+			return NULL;
+		}
+
+		items[i].size = (uint32_t)pk.offset - items[i].offset;
+	}
+
+	list_item_sort_userdata udata = {
+			.buf = buf,
+			.error = false
+	};
+
+	qsort_r(items, ele_count, sizeof(list_item), list_item_sort_compare, &udata);
+
+	if (udata.error) {
+		cf_free(items);
+		return NULL;
+	}
+
+	return items;
+}
+
 //----------------------------------------------------------
 // packed_list ops
 //
@@ -1186,6 +1577,11 @@ packed_list_append(as_bin *b, rollback_alloc *alloc_buf, const cdt_payload *payl
 		return -AS_PROTO_RESULT_FAIL_PARAMETER;
 	}
 
+	// Ordered lists have no end to append to - add in order.
+	if ((pl.flags & AS_PACKED_LIST_FLAG_ORDERED) != 0) {
+		return packed_list_add_ordered(b, alloc_buf, payload, payload_is_container, result);
+	}
+
 	return packed_list_insert(b, alloc_buf, payload, payload_is_container, (int64_t)ele_count, result);
 }
 
@@ -1316,7 +1712,7 @@ packed_list_remove(as_bin *b, rollback_alloc *alloc_buf, int64_t index, uint64_t
 	}
 
 	if (as_packed_list_get_new_element_count(&pl) == 0) {
-		as_bin_set_empty_packed_list(b, alloc_buf);
+		as_bin_set_empty_packed_list(b, alloc_buf, pl.flags);
 	}
 	else {
 		int32_t new_ele_count = as_packed_list_get_new_element_count(&pl);
@@ -1408,7 +1804,7 @@ packed_list_set(as_bin *b, rollback_alloc *alloc_buf, const cdt_payload *payload
 	int32_t new_ele_count = as_packed_list_get_new_element_count(&pl);
 
 	// Add difference in header size and payload size.
-	new_size += as_pack_list_header_get_size(ele_count) - as_pack_list_header_get_size(new_ele_count);
+	new_size += as_packed_list_header_size((uint32_t)ele_count, pl.flags) - as_packed_list_header_size((uint32_t)new_ele_count, pl.flags);
 	new_size += payload->size;
 
 	uint8_t *ptr = packed_list_setup_bin(b, alloc_buf, (uint32_t)new_size, (uint32_t)ele_count, uindex, pli);
@@ -1453,7 +1849,7 @@ packed_list_trim(as_bin *b, rollback_alloc *alloc_buf, int64_t index, uint64_t c
 	if (count == 0) {
 		// Remove everything.
 		as_bin_set_int(result, original_ele_count);
-		as_bin_set_empty_packed_list(b, alloc_buf);
+		as_bin_set_empty_packed_list(b, alloc_buf, pl.flags);
 
 		return AS_PROTO_RESULT_OK;
 	}
@@ -1477,7 +1873,7 @@ packed_list_trim(as_bin *b, rollback_alloc *alloc_buf, int64_t index, uint64_t c
 
 	if (as_packed_list_get_new_element_count(&pl) == 0) {
 		as_bin_set_int(result, original_ele_count);
-		as_bin_set_empty_packed_list(b, alloc_buf);
+		as_bin_set_empty_packed_list(b, alloc_buf, pl.flags);
 
 		return AS_PROTO_RESULT_OK;
 	}
@@ -1511,7 +1907,7 @@ packed_list_trim(as_bin *b, rollback_alloc *alloc_buf, int64_t index, uint64_t c
 
 	if (new_ele_count == 0) {
 		as_bin_set_int(result, original_ele_count);
-		as_bin_set_empty_packed_list(b, alloc_buf);
+		as_bin_set_empty_packed_list(b, alloc_buf, pl.flags);
 
 		return AS_PROTO_RESULT_OK;
 	}
@@ -1539,6 +1935,396 @@ packed_list_trim(as_bin *b, rollback_alloc *alloc_buf, int64_t index, uint64_t c
 	return AS_PROTO_RESULT_OK;
 }
 
+// Set list flags - making a list ordered sorts it.
+static int
+packed_list_set_flags(as_bin *b, rollback_alloc *alloc_buf, uint8_t flags)
+{
+	if (! as_bin_inuse(b)) {
+		as_bin_set_empty_packed_list(b, alloc_buf, flags);
+		return AS_PROTO_RESULT_OK;
+	}
+
+	as_packed_list pl;
+	as_packed_list_init_from_bin(&pl, b);
+
+	int32_t ele_count = as_packed_list_header_element_count(&pl);
+
+	if (ele_count < 0) {
+		cf_warning(AS_PARTICLE, "packed_list_set_flags() invalid list");
+		return -AS_PROTO_RESULT_FAIL_PARAMETER;
+	}
+
+	if (pl.flags == flags) {
+		return AS_PROTO_RESULT_OK;
+	}
+
+	if (ele_count == 0) {
+		as_bin_set_empty_packed_list(b, alloc_buf, flags);
+		return AS_PROTO_RESULT_OK;
+	}
+
+	const uint8_t *buf = pl.upk.buffer;
+	uint32_t data_offset = (uint32_t)pl.upk.offset;
+	uint32_t content_size = (uint32_t)pl.upk.length - data_offset;
+	uint32_t new_size = as_packed_list_header_size((uint32_t)ele_count, flags) + content_size;
+	bool sort = (flags & AS_PACKED_LIST_FLAG_ORDERED) != 0 &&
+			(pl.flags & AS_PACKED_LIST_FLAG_ORDERED) == 0;
+	list_item *items = NULL;
+
+	if (sort && ! (items = list_items_sorted(buf, data_offset, (uint32_t)pl.upk.length, (uint32_t)ele_count))) {
+		cf_warning(AS_PARTICLE, "packed_list_set_flags() failed to sort list");
+		return -AS_PROTO_RESULT_FAIL_PARAMETER;
+	}
+
+	as_packed_list_index *pli = as_bin_get_packed_list_index(b);
+	// Element order is unchanged unless sorting - keep the whole index.
+	uint8_t *ptr = packed_list_setup_bin(b, alloc_buf, new_size, (uint32_t)ele_count, sort ? 0 : (uint32_t)ele_count, pli);
+
+	if (! ptr) {
+		cf_warning(AS_PARTICLE, "packed_list_set_flags() failed to alloc list particle");
+		cf_free(items);
+		return -AS_PROTO_RESULT_FAIL_UNKNOWN;
+	}
+
+	ptr += as_packed_list_write_header_flags(ptr, (uint32_t)ele_count, flags);
+
+	if (! sort) {
+		memcpy(ptr, buf + data_offset, content_size);
+		return AS_PROTO_RESULT_OK;
+	}
+
+	for (int32_t i = 0; i < ele_count; i++) {
+		memcpy(ptr, buf + items[i].offset, items[i].size);
+		ptr += items[i].size;
+	}
+
+	cf_free(items);
+
+	return AS_PROTO_RESULT_OK;
+}
+
+// Add value, or the items of a list value, to an ordered list in order.
+static int
+packed_list_add_ordered(as_bin *b, rollback_alloc *alloc_buf, const cdt_payload *payload, bool payload_is_container, as_bin *result)
+{
+	as_packed_list pl;
+	as_packed_list_init_from_bin(&pl, b);
+
+	int32_t ele_count = as_packed_list_header_element_count(&pl);
+
+	if (ele_count < 0) {
+		cf_warning(AS_PARTICLE, "packed_list_add_ordered() invalid list");
+		return -AS_PROTO_RESULT_FAIL_PARAMETER;
+	}
+
+	as_packed_list_index *pli = as_bin_get_packed_list_index(b);
+	uint32_t index;
+	uint32_t offset;
+
+	if (! payload_is_container) {
+		// Equal values go after existing ones, as an append would.
+		if (! ordered_list_find(&pl, pli, payload, true, &index, &offset)) {
+			cf_warning(AS_PARTICLE, "packed_list_add_ordered() invalid list");
+			return -AS_PROTO_RESULT_FAIL_PARAMETER;
+		}
+
+		return packed_list_insert(b, alloc_buf, payload, false, (int64_t)index, result);
+	}
+
+	int payload_ele_count = as_unpack_buf_list_element_count(payload->ptr, payload->size);
+
+	if (payload_ele_count < 0) {
+		cf_warning(AS_PARTICLE, "packed_list_add_ordered() invalid payload, expected a list");
+		return -AS_PROTO_RESULT_FAIL_PARAMETER;
+	}
+
+	if (payload_ele_count == 0) {
+		if (result) {
+			as_bin_set_int(result, ele_count);
+		}
+
+		return AS_PROTO_RESULT_OK;
+	}
+
+	uint32_t payload_hdr_sz = as_pack_list_header_get_size(payload_ele_count);
+	list_item *items = list_items_sorted(payload->ptr, payload_hdr_sz, payload->size, (uint32_t)payload_ele_count);
+
+	if (! items) {
+		cf_warning(AS_PARTICLE, "packed_list_add_ordered() invalid payload");
+		return -AS_PROTO_RESULT_FAIL_PARAMETER;
+	}
+
+	cdt_payload first = {
+			.ptr = payload->ptr + items[0].offset,
+			.size = items[0].size
+	};
+
+	// Everything before the first item's place is kept as is.
+	if (! ordered_list_find(&pl, pli, &first, true, &index, &offset)) {
+		cf_warning(AS_PARTICLE, "packed_list_add_ordered() invalid list");
+		cf_free(items);
+		return -AS_PROTO_RESULT_FAIL_PARAMETER;
+	}
+
+	const uint8_t *buf = pl.upk.buffer;
+	uint32_t length = (uint32_t)pl.upk.length;
+	uint32_t data_offset = (uint32_t)pl.upk.offset;
+	uint32_t new_ele_count = (uint32_t)ele_count + (uint32_t)payload_ele_count;
+	uint32_t new_size = as_packed_list_header_size(new_ele_count, pl.flags) +
+			(length - data_offset) + (payload->size - payload_hdr_sz);
+	uint8_t *ptr = packed_list_setup_bin(b, alloc_buf, new_size, new_ele_count, index, pli);
+
+	if (! ptr) {
+		cf_warning(AS_PARTICLE, "packed_list_add_ordered() failed to alloc list particle");
+		cf_free(items);
+		return -AS_PROTO_RESULT_FAIL_UNKNOWN;
+	}
+
+	ptr += as_packed_list_write_header_flags(ptr, new_ele_count, pl.flags);
+	memcpy(ptr, buf + data_offset, offset - data_offset);
+	ptr += offset - data_offset;
+
+	// Merge the sorted items with the rest of the list.
+	as_unpacker pk = {
+			.buffer = buf,
+			.offset = (int)offset,
+			.length = (int)length
+	};
+
+	for (int i = 0; i < payload_ele_count; i++) {
+		cdt_payload item = {
+				.ptr = payload->ptr + items[i].offset,
+				.size = items[i].size
+		};
+
+		while (index < (uint32_t)ele_count) {
+			uint32_t ele_offset = (uint32_t)pk.offset;
+			msgpack_compare_t cmp = list_ele_compare(buf, ele_offset, length, &item);
+
+			if (cmp == MSGPACK_COMPARE_ERROR) {
+				cf_warning(AS_PARTICLE, "packed_list_add_ordered() invalid list");
+				cf_free(items);
+				return -AS_PROTO_RESULT_FAIL_PARAMETER;
+			}
+
+			if (! list_ele_goes_before(cmp, true)) {
+				break;
+			}
+
+			if (cdt_unpack_size(&pk) < 0) {
+				cf_warning(AS_PARTICLE, "packed_list_add_ordered() invalid list");
+				cf_free(items);
+				return -AS_PROTO_RESULT_FAIL_PARAMETER;
+			}
+
+			memcpy(ptr, buf + ele_offset, (uint32_t)pk.offset - ele_offset);
+			ptr += (uint32_t)pk.offset - ele_offset;
+			index++;
+		}
+
+		memcpy(ptr, item.ptr, item.size);
+		ptr += item.size;
+	}
+
+	memcpy(ptr, buf + pk.offset, length - (uint32_t)pk.offset);
+
+	cf_free(items);
+
+	if (result) {
+		as_bin_set_int(result, new_ele_count);
+	}
+
+	return AS_PROTO_RESULT_OK;
+}
+
+static int
+packed_list_get_by_value_interval(const as_bin *b, const list_value_interval *interval, rollback_alloc *alloc_result, as_bin *result)
+{
+	as_packed_list pl;
+	as_packed_list_init_from_bin(&pl, b);
+
+	int32_t ele_count = as_packed_list_header_element_count(&pl);
+
+	if (ele_count < 0) {
+		cf_warning(AS_PARTICLE, "packed_list_get_by_value_interval() invalid list");
+		return -AS_PROTO_RESULT_FAIL_PARAMETER;
+	}
+
+	const uint8_t *buf = pl.upk.buffer;
+	uint32_t length = (uint32_t)pl.upk.length;
+
+	if ((pl.flags & AS_PACKED_LIST_FLAG_ORDERED) != 0) {
+		uint32_t index;
+		uint32_t offset;
+		uint32_t end_index;
+		uint32_t end_offset;
+
+		if (! ordered_list_find_interval(&pl, as_bin_get_packed_list_index(b), interval, &index, &offset, &end_index, &end_offset)) {
+			cf_warning(AS_PARTICLE, "packed_list_get_by_value_interval() invalid list");
+			return -AS_PROTO_RESULT_FAIL_PARAMETER;
+		}
+
+		result->particle = packed_list_simple_create_from_buf(alloc_result, end_index - index, buf + offset, end_offset - offset);
+
+		if (! result->particle) {
+			return -AS_PROTO_RESULT_FAIL_UNKNOWN;
+		}
+
+		as_bin_state_set_from_type(result, AS_PARTICLE_TYPE_LIST);
+
+		return AS_PROTO_RESULT_OK;
+	}
+
+	// Unordered - size the result, then fill it.
+	as_unpacker pk = pl.upk;
+	uint32_t count = 0;
+	uint32_t size = 0;
+
+	for (int32_t i = 0; i < ele_count; i++) {
+		uint32_t offset = (uint32_t)pk.offset;
+		int match = unordered_list_ele_match(buf, offset, length, interval);
+
+		if (match < 0 || cdt_unpack_size(&pk) < 0) {
+			cf_warning(AS_PARTICLE, "packed_list_get_by_value_interval() invalid list");
+			return -AS_PROTO_RESULT_FAIL_PARAMETER;
+		}
+
+		if (match) {
+			count++;
+			size += (uint32_t)pk.offset - offset;
+		}
+	}
+
+	result->particle = packed_list_simple_create_from_buf(alloc_result, count, NULL, size);
+
+	if (! result->particle) {
+		return -AS_PROTO_RESULT_FAIL_UNKNOWN;
+	}
+
+	uint8_t *ptr = ((list_mem *)result->particle)->data + as_pack_list_header_get_size(count);
+
+	pk = pl.upk;
+
+	for (int32_t i = 0; i < ele_count && count != 0; i++) {
+		uint32_t offset = (uint32_t)pk.offset;
+		int match = unordered_list_ele_match(buf, offset, length, interval);
+
+		cdt_unpack_size(&pk);
+
+		if (match) {
+			memcpy(ptr, buf + offset, (uint32_t)pk.offset - offset);
+			ptr += (uint32_t)pk.offset - offset;
+			count--;
+		}
+	}
+
+	as_bin_state_set_from_type(result, AS_PARTICLE_TYPE_LIST);
+
+	return AS_PROTO_RESULT_OK;
+}
+
+// Result is number of elements removed.
+static int
+packed_list_remove_by_value_interval(as_bin *b, rollback_alloc *alloc_buf, const list_value_interval *interval, as_bin *result)
+{
+	as_packed_list pl;
+	as_packed_list_init_from_bin(&pl, b);
+
+	int32_t ele_count = as_packed_list_header_element_count(&pl);
+
+	if (ele_count < 0) {
+		cf_warning(AS_PARTICLE, "packed_list_remove_by_value_interval() invalid list");
+		return -AS_PROTO_RESULT_FAIL_PARAMETER;
+	}
+
+	as_packed_list_index *pli = as_bin_get_packed_list_index(b);
+	const uint8_t *buf = pl.upk.buffer;
+	uint32_t length = (uint32_t)pl.upk.length;
+
+	if ((pl.flags & AS_PACKED_LIST_FLAG_ORDERED) != 0) {
+		uint32_t index;
+		uint32_t offset;
+		uint32_t end_index;
+		uint32_t end_offset;
+
+		if (! ordered_list_find_interval(&pl, pli, interval, &index, &offset, &end_index, &end_offset)) {
+			cf_warning(AS_PARTICLE, "packed_list_remove_by_value_interval() invalid list");
+			return -AS_PROTO_RESULT_FAIL_PARAMETER;
+		}
+
+		if (end_index == index) {
+			as_bin_set_int(result, 0);
+			return AS_PROTO_RESULT_OK;
+		}
+
+		return packed_list_remove(b, alloc_buf, (int64_t)index, end_index - index, result, true, false, NULL);
+	}
+
+	// Unordered - count and size what goes, then copy what stays.
+	as_unpacker pk = pl.upk;
+	uint32_t data_offset = (uint32_t)pk.offset;
+	uint32_t count = 0;
+	uint32_t size = 0;
+	uint32_t first_index = 0;
+
+	for (int32_t i = 0; i < ele_count; i++) {
+		uint32_t offset = (uint32_t)pk.offset;
+		int match = unordered_list_ele_match(buf, offset, length, interval);
+
+		if (match < 0 || cdt_unpack_size(&pk) < 0) {
+			cf_warning(AS_PARTICLE, "packed_list_remove_by_value_interval() invalid list");
+			return -AS_PROTO_RESULT_FAIL_PARAMETER;
+		}
+
+		if (match) {
+			if (count++ == 0) {
+				first_index = (uint32_t)i;
+			}
+
+			size += (uint32_t)pk.offset - offset;
+		}
+	}
+
+	as_bin_set_int(result, count);
+
+	if (count == 0) {
+		return AS_PROTO_RESULT_OK;
+	}
+
+	uint32_t new_ele_count = (uint32_t)ele_count - count;
+
+	if (new_ele_count == 0) {
+		as_bin_set_empty_packed_list(b, alloc_buf, pl.flags);
+		return AS_PROTO_RESULT_OK;
+	}
+
+	uint32_t new_size = as_packed_list_header_size(new_ele_count, pl.flags) + (length - data_offset) - size;
+	uint8_t *ptr = packed_list_setup_bin(b, alloc_buf, new_size, new_ele_count, first_index, pli);
+
+	if (! ptr) {
+		cf_warning(AS_PARTICLE, "packed_list_remove_by_value_interval() failed to alloc list particle");
+		return -AS_PROTO_RESULT_FAIL_UNKNOWN;
+	}
+
+	ptr += as_packed_list_write_header_flags(ptr, new_ele_count, pl.flags);
+
+	pk.offset = (int)data_offset;
+
+	for (int32_t i = 0; i < ele_count; i++) {
+		uint32_t offset = (uint32_t)pk.offset;
+		int match = unordered_list_ele_match(buf, offset, length, interval);
+
+		cdt_unpack_size(&pk);
+
+		if (! match) {
+			memcpy(ptr, buf + offset, (uint32_t)pk.offset - offset);
+			ptr += (uint32_t)pk.offset - offset;
+		}
+	}
+
+	return AS_PROTO_RESULT_OK;
+}
+
 static uint8_t *
 packed_list_setup_bin(as_bin *b, rollback_alloc *alloc_buf, uint32_t new_size, uint32_t new_ele_count, uint32_t index, as_packed_list_index *pli)
 {
@@ -1626,6 +2412,31 @@ cdt_process_state_packed_list_modify_optype(cdt_process_state *state, cdt_modify
 	rollback_alloc_inita(alloc_result, NULL, 1);
 
 	switch (optype) {
+	case AS_CDT_OP_LIST_SET_TYPE: {
+		uint64_t flags;
+
+		if (! CDT_OP_TABLE_GET_PARAMS(state, &flags)) {
+			cdt_udata->ret_code = -AS_PROTO_RESULT_FAIL_PARAMETER;
+			return false;
+		}
+
+		if ((flags & ~(uint64_t)AS_PACKED_LIST_FLAG_ORDERED) != 0) {
+			cf_warning(AS_PARTICLE, "cdt_process_state_packed_list_modify_optype() SET_TYPE invalid flags %lx", flags);
+			cdt_udata->ret_code = -AS_PROTO_RESULT_FAIL_PARAMETER;
+			return false;
+		}
+
+		int ret = packed_list_set_flags(b, alloc_buf, (uint8_t)flags);
+
+		if (ret < 0) {
+			cf_warning(AS_PARTICLE, "cdt_process_state_packed_list_modify_optype() SET_TYPE failed");
+			cdt_udata->ret_code = ret;
+			rollback_alloc_rollback(alloc_buf);
+			return false;
+		}
+
+		break;
+	}
 	// Add to list.
 	case AS_CDT_OP_LIST_APPEND: {
 		cdt_payload payload;
@@ -1685,6 +2496,12 @@ cdt_process_state_packed_list_modify_optype(cdt_process_state *state, cdt_modify
 
 		as_bin_create_temp_packed_list_if_notinuse(b);
 
+		if (as_bin_is_ordered_packed_list(b)) {
+			cf_warning(AS_PARTICLE, "cdt_process_state_packed_list_modify_optype() INSERT not allowed on ordered list");
+			cdt_udata->ret_code = -AS_PROTO_RESULT_FAIL_PARAMETER;
+			return false;
+		}
+
 		int ret = packed_list_insert(b, alloc_buf, &payload, false, index, result);
 
 		if (ret < 0) {
@@ -1707,6 +2524,12 @@ cdt_process_state_packed_list_modify_optype(cdt_process_state *state, cdt_modify
 
 		as_bin_create_temp_packed_list_if_notinuse(b);
 
+		if (as_bin_is_ordered_packed_list(b)) {
+			cf_warning(AS_PARTICLE, "cdt_process_state_packed_list_modify_optype() INSERT_ITEMS not allowed on ordered list");
+			cdt_udata->ret_code = -AS_PROTO_RESULT_FAIL_PARAMETER;
+			return false;
+		}
+
 		int ret = packed_list_insert(b, alloc_buf, &payload, true, index, result);
 
 		if (ret < 0) {
@@ -1734,6 +2557,12 @@ cdt_process_state_packed_list_modify_optype(cdt_process_state *state, cdt_modify
 
 		as_bin_create_temp_packed_list_if_notinuse(b);
 
+		if (as_bin_is_ordered_packed_list(b)) {
+			cf_warning(AS_PARTICLE, "cdt_process_state_packed_list_modify_optype() SET not allowed on ordered list");
+			cdt_udata->ret_code = -AS_PROTO_RESULT_FAIL_PARAMETER;
+			return false;
+		}
+
 		int ret = packed_list_set(b, alloc_buf, &payload, index);
 
 		if (ret < 0) {
@@ -1832,7 +2661,41 @@ cdt_process_state_packed_list_modify_optype(cdt_process_state *state, cdt_modify
 			return false;
 		}
 
-		as_bin_set_empty_packed_list(b, alloc_buf);
+		as_bin_set_empty_packed_list(b, alloc_buf, as_bin_is_ordered_packed_list(b) ? AS_PACKED_LIST_FLAG_ORDERED : 0);
+
+		break;
+	}
+	case AS_CDT_OP_LIST_REMOVE_ALL_BY_VALUE:
+	case AS_CDT_OP_LIST_REMOVE_BY_VALUE_INTERVAL: {
+		cdt_payload value_start;
+		cdt_payload value_end;
+		list_value_interval interval = {
+				.start = &value_start,
+				.end = &value_start
+		};
+
+		if (! CDT_OP_TABLE_GET_PARAMS(state, &value_start, &value_end)) {
+			cdt_udata->ret_code = -AS_PROTO_RESULT_FAIL_PARAMETER;
+			return false;
+		}
+
+		if (optype == AS_CDT_OP_LIST_REMOVE_BY_VALUE_INTERVAL) {
+			interval.end = state->ele_count > 1 ? &value_end : NULL;
+		}
+
+		if (! as_bin_inuse(b)) {
+			as_bin_set_int(result, 0);
+			break;
+		}
+
+		int ret = packed_list_remove_by_value_interval(b, alloc_buf, &interval, result);
+
+		if (ret < 0) {
+			cf_warning(AS_PARTICLE, "cdt_process_state_packed_list_modify_optype() REMOVE_BY_VALUE failed");
+			cdt_udata->ret_code = ret;
+			rollback_alloc_rollback(alloc_buf);
+			return false;
+		}
 
 		break;
 	}
@@ -1915,7 +2778,7 @@ cdt_process_state_packed_list_read_optype(cdt_process_state *state, cdt_read_dat
 
 		as_packed_list_index *pli = as_bin_get_packed_list_index(b);
 		const uint8_t *ele_ptr = as_unpack_list_elements_find_index(&pl.upk, uindex, pli);
-		int ele_size = as_unpack_size(&pl.upk);
+		int ele_size = cdt_unpack_size(&pl.upk);
 
 		if (ele_size < 0) {
 			cf_warning(AS_PARTICLE, "OP_LIST_GET: unable to unpack element at %u", uindex);
@@ -1980,7 +2843,7 @@ cdt_process_state_packed_list_read_optype(cdt_process_state *state, cdt_read_dat
 		}
 
 		for (uint64_t i = 0; i < count; i++) {
-			int64_t i_size = as_unpack_size(&pl.upk);
+			int64_t i_size = cdt_unpack_size(&pl.upk);
 
 			if (i_size < 0) {
 				cf_warning(AS_PARTICLE, "OP_LIST_GET_RANGE: invalid list element at index %u", uindex + (uint32_t)i);
@@ -2002,6 +2865,34 @@ cdt_process_state_packed_list_read_optype(cdt_process_state *state, cdt_read_dat
 
 		break;
 	}
+	case AS_CDT_OP_LIST_GET_ALL_BY_VALUE:
+	case AS_CDT_OP_LIST_GET_BY_VALUE_INTERVAL: {
+		cdt_payload value_start;
+		cdt_payload value_end;
+		list_value_interval interval = {
+				.start = &value_start,
+				.end = &value_start
+		};
+
+		if (! CDT_OP_TABLE_GET_PARAMS(state, &value_start, &value_end)) {
+			cdt_udata->ret_code = -AS_PROTO_RESULT_FAIL_PARAMETER;
+			return false;
+		}
+
+		if (optype == AS_CDT_OP_LIST_GET_BY_VALUE_INTERVAL) {
+			interval.end = state->ele_count > 1 ? &value_end : NULL;
+		}
+
+		int ret = packed_list_get_by_value_interval(b, &interval, packed_alloc, result);
+
+		if (ret < 0) {
+			cdt_udata->ret_code = ret;
+			rollback_alloc_rollback(packed_alloc);
+			return false;
+		}
+
+		break;
+	}
 	case AS_CDT_OP_LIST_SIZE: {
 		as_packed_list pl;
 		as_packed_list_init_from_bin(&pl, b);
@@ -290,6 +290,18 @@ typedef struct map_add_control_s {
 	bool allow_create;				// if key does not exist - may create
 } map_add_control;
 
+// An incoming pair for a bulk add - key and value are contiguous.
+typedef struct map_add_item_s {
+	uint32_t offset;
+	uint32_t key_size;
+	uint32_t size;
+} map_add_item;
+
+typedef struct map_add_item_sort_userdata_s {
+	const uint8_t *buf;
+	bool error;
+} map_add_item_sort_userdata;
+
 typedef struct map_ele_find_s {
 	bool found_key;
 	bool found_value;
@@ -414,6 +426,9 @@ static int packed_map_set_flags(as_bin *b, rollback_alloc *alloc_buf, as_bin *re
 static int packed_map_increment(as_bin *b, rollback_alloc *alloc_buf, const cdt_payload *key, const cdt_payload *delta_value, as_bin *result, bool is_decrement);
 static int packed_map_add(as_bin *b, rollback_alloc *alloc_buf, const cdt_payload *key, const cdt_payload *value, as_bin *result, const map_add_control *control);
 static int packed_map_add_items(as_bin *b, rollback_alloc *alloc_buf, const cdt_payload *items, as_bin *result, const map_add_control *control);
+static int packed_map_add_items_ordered(as_bin *b, const packed_map_op *op, rollback_alloc *alloc_buf, as_unpacker *pk, uint32_t items_count, as_bin *result, const map_add_control *control);
+static int map_add_item_sort_compare(const void *x, const void *y, void *p);
+static int packed_map_op_merge_items(const packed_map_op *op, const map_add_item *items, uint32_t items_count, const uint8_t *items_buf, const map_add_control *control, uint8_t *write_ptr, uint32_t *p_ele_count, uint32_t *p_content_size);
 
 static int packed_map_remove_idxs(as_bin *b, const packed_map_op *op, rollback_alloc *alloc_buf, const order_index *remove_idxs, uint32_t count, uint32_t *removed);
 
@@ -497,6 +512,9 @@ static as_particle *packed_map_create(rollback_alloc *alloc_buf, uint32_t ele_co
 
 static int64_t packed_map_strip_indexes_delta(const as_particle *p);
 static int64_t packed_map_strip_indexes(uint8_t *dest, const as_particle *p, bool remove_flags);
+static bool packed_map_op_has_full_indexes(const packed_map_op *op);
+static bool packed_map_fill_indexes(uint8_t *packed, uint32_t packed_sz);
+static void packed_map_clear_index_flags(uint8_t *packed, uint32_t packed_sz);
 
 // map_ele_find
 static void map_ele_find_init(map_ele_find *find, const packed_map_op *op);
@@ -991,6 +1009,19 @@ map_cast_from_flat(uint8_t *flat, uint32_t flat_size, as_particle **pp)
 	// Cast temp buffer from disk to data-not-in-memory.
 	map_flat *p_map_flat = (map_flat *)flat;
 
+	// Indexes persisted with the map are used in place if they pass a cheap
+	// check - otherwise they're ignored, and built per op as for a stripped
+	// map.
+	packed_map_op op;
+
+	packed_map_op_init(&op, p_map_flat->data, p_map_flat->size);
+
+	if (packed_map_op_unpack_hdridx(&op) &&
+			(op.pmi.flags & (AS_PACKED_MAP_FLAG_OFF_IDX | AS_PACKED_MAP_FLAG_ORD_IDX)) != 0 &&
+			! packed_map_op_has_full_indexes(&op)) {
+		packed_map_clear_index_flags(p_map_flat->data, p_map_flat->size);
+	}
+
 	// This assumes map_flat is the same as map_mem.
 	*pp = (as_particle *)p_map_flat;
 
@@ -1009,7 +1040,9 @@ map_from_flat(const uint8_t *flat, uint32_t flat_size, as_particle **pp)
 		return -1;
 	}
 
-	if (op.pmi.flags == 0) {
+	// Unordered, or ordered with complete persisted indexes - use as is.
+	if (op.pmi.flags == 0 || ((op.pmi.flags & AS_PACKED_MAP_FLAG_OFF_IDX) != 0 &&
+			packed_map_op_has_full_indexes(&op))) {
 		// Convert temp buffer from disk to data-in-memory.
 		map_mem *p_map_mem = cf_malloc(sizeof(map_mem) + p_map_flat->size);
 
@@ -1107,6 +1140,37 @@ as_bin_particle_map_set_hidden(as_bin *b)
 	as_bin_state_set_from_type(b, AS_PARTICLE_TYPE_HIDDEN_MAP);
 }
 
+// Flat size if the map's indexes are kept - see
+// as_bin_particle_map_to_flat_with_indexes().
+uint32_t
+as_bin_particle_map_flat_size_with_indexes(const as_bin *b)
+{
+	const map_mem *p_map_mem = (const map_mem *)b->particle;
+
+	return sizeof(map_flat) + p_map_mem->sz;
+}
+
+// Like as_bin_particle_to_flat(), but keeps the offset and order indexes, so a
+// data-not-in-memory read can use them instead of rebuilding them per op. The
+// indexes may have been filled lazily - they're completed here.
+uint32_t
+as_bin_particle_map_to_flat_with_indexes(const as_bin *b, uint8_t *flat)
+{
+	const map_mem *p_map_mem = (const map_mem *)b->particle;
+	map_flat *p_map_flat = (map_flat *)flat;
+
+	p_map_flat->type = as_bin_get_particle_type(b);
+	p_map_flat->size = p_map_mem->sz;
+	memcpy(p_map_flat->data, p_map_mem->data, p_map_mem->sz);
+
+	if (! packed_map_fill_indexes(p_map_flat->data, p_map_flat->size)) {
+		// Same size, but readers will ignore the indexes.
+		packed_map_clear_index_flags(p_map_flat->data, p_map_flat->size);
+	}
+
+	return sizeof(map_flat) + p_map_flat->size;
+}
+
 
 //==========================================================
 // Local helpers.
@@ -1227,15 +1291,7 @@ as_pack_init_indexes(as_packer *pk, const packed_map_op *op)
 static inline bool
 skip_map_pair(as_unpacker *pk)
 {
-	if (as_unpack_size(pk) < 0) {
-		return false;
-	}
-
-	if (as_unpack_size(pk) < 0) {
-		return false;
-	}
-
-	return true;
+	return cdt_unpack_size_n(pk, 2) >= 0;
 }
 
 static int
@@ -1520,12 +1576,12 @@ map_packer_fill_index_sort_compare(const void *x, const void *y, void *p)
 
 	if (udata->sort_by == SORT_BY_VALUE) {
 		// Skip keys.
-		if (as_unpack_size(&x_pk) < 0) {
+		if (cdt_unpack_size(&x_pk) < 0) {
 			udata->error = true;
 			return 0;
 		}
 
-		if (as_unpack_size(&y_pk) < 0) {
+		if (cdt_unpack_size(&y_pk) < 0) {
 			udata->error = true;
 			return 0;
 		}
@@ -1987,6 +2043,15 @@ packed_map_add_items(as_bin *b, rollback_alloc *alloc_buf, const cdt_payload *it
 		items_count--;
 	}
 
+	// Key-ordered maps merge all items in one pass, instead of one add each.
+	if (items_count > 1) {
+		packed_map_op op;
+
+		if (packed_map_op_init_from_bin(&op, b) && op_is_k_ordered(&op)) {
+			return packed_map_add_items_ordered(b, &op, alloc_buf, &pk, (uint32_t)items_count, result, control);
+		}
+	}
+
 	rollback_alloc_inita(alloc_0, NULL, 1);
 	rollback_alloc_inita(alloc_1, NULL, 1);
 
@@ -1998,7 +2063,7 @@ packed_map_add_items(as_bin *b, rollback_alloc *alloc_buf, const cdt_payload *it
 				.size = (uint32_t)pk.offset
 		};
 
-		if (as_unpack_size(&pk) < 0) {
+		if (cdt_unpack_size(&pk) < 0) {
 			cf_warning(AS_PARTICLE, "packed_map_add_items() invalid parameter");
 			ret = -AS_PROTO_RESULT_FAIL_PARAMETER;
 			break;
@@ -2011,7 +2076,7 @@ packed_map_add_items(as_bin *b, rollback_alloc *alloc_buf, const cdt_payload *it
 				.size = (uint32_t)pk.offset
 		};
 
-		if (as_unpack_size(&pk) < 0) {
+		if (cdt_unpack_size(&pk) < 0) {
 			cf_warning(AS_PARTICLE, "packed_map_add_items() invalid parameter");
 			ret = -AS_PROTO_RESULT_FAIL_PARAMETER;
 			break;
@@ -2060,6 +2125,269 @@ packed_map_add_items(as_bin *b, rollback_alloc *alloc_buf, const cdt_payload *it
 	return ret;
 }
 
+// Sort the items, then merge them with the existing pairs into a new buffer -
+// O(n + m log m) rather than a search and shift per item.
+static int
+packed_map_add_items_ordered(as_bin *b, const packed_map_op *op, rollback_alloc *alloc_buf, as_unpacker *pk, uint32_t items_count, as_bin *result, const map_add_control *control)
+{
+	map_add_item *items = cf_malloc(sizeof(map_add_item) * items_count);
+
+	if (! items) {
+		cf_warning(AS_PARTICLE, "packed_map_add_items_ordered() failed to alloc items");
+		return -AS_PROTO_RESULT_FAIL_UNKNOWN;
+	}
+
+	for (uint32_t i = 0; i < items_count; i++) {
+		items[i].offset = (uint32_t)pk->offset;
+
+		int64_t key_size = cdt_unpack_size(pk);
+
+		if (key_size < 0 || cdt_unpack_size(pk) < 0) {
+			cf_warning(AS_PARTICLE, "packed_map_add_items_ordered() invalid parameter");
+			cf_free(items);
+			return -AS_PROTO_RESULT_FAIL_PARAMETER;
+		}
+
+		items[i].key_size = (uint32_t)key_size;
+		items[i].size = (uint32_t)pk->offset - items[i].offset;
+	}
+
+	map_add_item_sort_userdata udata = {
+			.buf = pk->buffer,
+			.error = false
+	};
+
+	qsort_r(items, items_count, sizeof(map_add_item), map_add_item_sort_compare, &udata);
+
+	if (udata.error) {
+		cf_warning(AS_PARTICLE, "packed_map_add_items_ordered() invalid parameter");
+		cf_free(items);
+		return -AS_PROTO_RESULT_FAIL_PARAMETER;
+	}
+
+	// Sort is stable, so of equal keys the last one added wins - unless the
+	// second add of a key is an error.
+	uint32_t count = 1;
+
+	for (uint32_t i = 1; i < items_count; i++) {
+		if (map_add_item_sort_compare(&items[count - 1], &items[i], &udata) == 0) {
+			if (! control->allow_overwrite) {
+				cf_free(items);
+				return -AS_PROTO_RESULT_FAIL_ELEMENT_EXISTS;
+			}
+
+			items[count - 1] = items[i];
+		}
+		else {
+			items[count++] = items[i];
+		}
+	}
+
+	uint32_t new_ele_count;
+	uint32_t content_size;
+	int ret = packed_map_op_merge_items(op, items, count, pk->buffer, control, NULL, &new_ele_count, &content_size);
+
+	if (ret < 0) {
+		cf_free(items);
+		return ret;
+	}
+
+	map_packer mpk;
+
+	map_packer_init(&mpk, new_ele_count, op->pmi.flags, content_size);
+
+	if (! map_packer_setup_bin(&mpk, b, alloc_buf)) {
+		cf_warning(AS_PARTICLE, "packed_map_add_items_ordered() failed to alloc map particle");
+		cf_free(items);
+		return -AS_PROTO_RESULT_FAIL_UNKNOWN;
+	}
+
+	map_packer_write_hdridx(&mpk);
+	packed_map_op_merge_items(op, items, count, pk->buffer, control, mpk.write_ptr, &new_ele_count, &content_size);
+	cf_free(items);
+
+	if (! map_packer_fill_offset_index(&mpk)) {
+		cf_warning(AS_PARTICLE, "packed_map_add_items_ordered() fill index failed");
+		return -AS_PROTO_RESULT_FAIL_UNKNOWN;
+	}
+
+	if (order_index_is_valid(&mpk.value_idx) && ! map_packer_fill_v_index(&mpk, mpk.ele_start_ptr, mpk.content_size)) {
+		cf_warning(AS_PARTICLE, "packed_map_add_items_ordered() fill value index failed");
+		return -AS_PROTO_RESULT_FAIL_UNKNOWN;
+	}
+
+	if (result) {
+		as_bin_set_int(result, new_ele_count);
+	}
+
+#ifdef MAP_DEBUG_VERIFY
+	if (! as_bin_verify(b)) {
+		const map_mem *p = (const map_mem *)b->particle;
+		cf_warning(AS_PARTICLE, "packed_map_add_items_ordered(): data=%p sz=%u type=%d", p->data, p->sz, p->type);
+	}
+#endif
+
+	return AS_PROTO_RESULT_OK;
+}
+
+// qsort_r callback function.
+static int
+map_add_item_sort_compare(const void *x, const void *y, void *p)
+{
+	map_add_item_sort_userdata *udata = (map_add_item_sort_userdata *)p;
+
+	if (udata->error) {
+		return 0;
+	}
+
+	const map_add_item *a = (const map_add_item *)x;
+	const map_add_item *b = (const map_add_item *)y;
+
+	as_unpacker pk_a = {
+			.buffer = udata->buf + a->offset,
+			.offset = 0,
+			.length = (int)a->key_size
+	};
+
+	as_unpacker pk_b = {
+			.buffer = udata->buf + b->offset,
+			.offset = 0,
+			.length = (int)b->key_size
+	};
+
+	msgpack_compare_t cmp = as_unpack_compare(&pk_a, &pk_b);
+
+	if (cmp == MSGPACK_COMPARE_LESS) {
+		return -1;
+	}
+
+	if (cmp == MSGPACK_COMPARE_EQUAL) {
+		return 0;
+	}
+
+	if (cmp == MSGPACK_COMPARE_GREATER) {
+		return 1;
+	}
+
+	udata->error = true;
+	return 0;
+}
+
+// Assumes items are sorted with unique keys. With no write_ptr, just size the
+// merged content.
+static int
+packed_map_op_merge_items(const packed_map_op *op, const map_add_item *items, uint32_t items_count, const uint8_t *items_buf, const map_add_control *control, uint8_t *write_ptr, uint32_t *p_ele_count, uint32_t *p_content_size)
+{
+	cdt_payload first = {
+			.ptr = items_buf + items[0].offset,
+			.size = items[0].key_size
+	};
+
+	// Everything before the first item's place is kept as is.
+	map_ele_find find;
+	map_ele_find_init(&find, op);
+
+	if (! packed_map_op_find_key(op, &find, &first, NULL)) {
+		cf_warning(AS_PARTICLE, "packed_map_op_merge_items() find key failed, ele_count=%u", op->ele_count);
+		return -AS_PROTO_RESULT_FAIL_PARAMETER;
+	}
+
+	as_unpacker pk;
+
+	packed_map_op_init_unpacker(op, &pk);
+
+	uint32_t idx = op->ele_count == 0 ? 0 : find.idx;
+	uint32_t ele_count = idx;
+	uint32_t content_size = op->ele_count == 0 ? 0 : find.key_offset;
+
+	pk.offset = (int)content_size;
+
+	if (write_ptr) {
+		memcpy(write_ptr, pk.buffer, content_size);
+		write_ptr += content_size;
+	}
+
+	for (uint32_t i = 0; i < items_count; i++) {
+		const map_add_item *item = &items[i];
+		msgpack_compare_t cmp = MSGPACK_COMPARE_GREATER;
+
+		while (idx < op->ele_count) {
+			uint32_t offset = (uint32_t)pk.offset;
+			as_unpacker pk_key = {
+					.buffer = items_buf + item->offset,
+					.offset = 0,
+					.length = (int)item->key_size
+			};
+			as_unpacker pk_ele = {
+					.buffer = pk.buffer + offset,
+					.offset = 0,
+					.length = pk.length - (int)offset
+			};
+
+			if ((cmp = as_unpack_compare(&pk_ele, &pk_key)) == MSGPACK_COMPARE_ERROR) {
+				cf_warning(AS_PARTICLE, "packed_map_op_merge_items() compare failed");
+				return -AS_PROTO_RESULT_FAIL_PARAMETER;
+			}
+
+			if (cmp != MSGPACK_COMPARE_LESS) {
+				break;
+			}
+
+			if (! skip_map_pair(&pk)) {
+				cf_warning(AS_PARTICLE, "packed_map_op_merge_items() invalid packed map");
+				return -AS_PROTO_RESULT_FAIL_PARAMETER;
+			}
+
+			uint32_t size = (uint32_t)pk.offset - offset;
+
+			if (write_ptr) {
+				memcpy(write_ptr, pk.buffer + offset, size);
+				write_ptr += size;
+			}
+
+			content_size += size;
+			ele_count++;
+			idx++;
+		}
+
+		if (idx < op->ele_count && cmp == MSGPACK_COMPARE_EQUAL) {
+			if (! control->allow_overwrite) {
+				return -AS_PROTO_RESULT_FAIL_ELEMENT_EXISTS;
+			}
+
+			// Replaced - drop the existing pair.
+			if (! skip_map_pair(&pk)) {
+				cf_warning(AS_PARTICLE, "packed_map_op_merge_items() invalid packed map");
+				return -AS_PROTO_RESULT_FAIL_PARAMETER;
+			}
+
+			idx++;
+		}
+		else if (! control->allow_create) {
+			return -AS_PROTO_RESULT_FAIL_ELEMENT_NOT_FOUND;
+		}
+
+		if (write_ptr) {
+			memcpy(write_ptr, items_buf + item->offset, item->size);
+			write_ptr += item->size;
+		}
+
+		content_size += item->size;
+		ele_count++;
+	}
+
+	uint32_t tail_size = (uint32_t)(pk.length - pk.offset);
+
+	if (write_ptr) {
+		memcpy(write_ptr, pk.buffer + pk.offset, tail_size);
+	}
+
+	*p_ele_count = ele_count + (op->ele_count - idx);
+	*p_content_size = content_size + tail_size;
+
+	return AS_PROTO_RESULT_OK;
+}
+
 // Assumes remove_indexes ordered by idx.
 static int
 packed_map_remove_idxs(as_bin *b, const packed_map_op *op, rollback_alloc *alloc_buf, const order_index *remove_idxs, uint32_t count, uint32_t *removed)
@@ -2308,7 +2636,7 @@ packed_map_remove_all_key_items(as_bin *b, rollback_alloc *alloc_buf, const cdt_
 				.size = (uint32_t)pk.offset
 		};
 
-		if (as_unpack_size(&pk) < 0) {
+		if (cdt_unpack_size(&pk) < 0) {
 			cf_warning(AS_PARTICLE, "packed_map_remove_all_key_items() invalid parameter");
 			return -AS_PROTO_RESULT_FAIL_PARAMETER;
 		}
@@ -2541,7 +2869,7 @@ packed_map_remove_all_value_items(as_bin *b, rollback_alloc *alloc_buf, const cd
 				.size = (uint32_t)pk.offset
 		};
 
-		if (as_unpack_size(&pk) < 0) {
+		if (cdt_unpack_size(&pk) < 0) {
 			cf_warning(AS_PARTICLE, "packed_map_remove_all_value_items() invalid parameter");
 			return -AS_PROTO_RESULT_FAIL_PARAMETER;
 		}
@@ -2915,7 +3243,7 @@ packed_map_op_unpack_hdridx(packed_map_op *op)
 			return false;
 		}
 
-		if (as_unpack_size(&pk) < 0) {	// skip the packed nil
+		if (cdt_unpack_size(&pk) < 0) {	// skip the packed nil
 			return false;
 		}
 
@@ -3019,7 +3347,7 @@ packed_map_op_find_index_by_key_unordered(const packed_map_op *op, const cdt_pay
 			index++;
 		}
 
-		if (as_unpack_size(&pk) < 0) {
+		if (cdt_unpack_size(&pk) < 0) {
 			return op->ele_count;
 		}
 	}
@@ -3088,7 +3416,7 @@ packed_map_op_find_rank_indexed(const packed_map_op *op, map_ele_find *find)
 				.length = (int)op->packed_sz
 		};
 
-		if (as_unpack_size(&pk_buf) < 0) {	// skip key
+		if (cdt_unpack_size(&pk_buf) < 0) {	// skip key
 			cf_warning(AS_PARTICLE, "packed_map_op_find_rank_indexed() unpack key failed at rank=%u", rank);
 			return false;
 		}
@@ -3175,7 +3503,7 @@ packed_map_op_find_rank_by_value_indexed(const packed_map_op *op, map_ele_find *
 				.length = (int)len
 		};
 
-		if (as_unpack_size(&pk_buf) < 0) {	// skip key
+		if (cdt_unpack_size(&pk_buf) < 0) {	// skip key
 			return false;
 		}
 
@@ -3309,14 +3637,14 @@ packed_map_op_find_rank_range_by_value_interval_unordered(const packed_map_op *o
 	};
 
 	// Pre-check parameters.
-	if (as_unpack_size(&pk_start) < 0) {
+	if (cdt_unpack_size(&pk_start) < 0) {
 		cf_warning(AS_PARTICLE, "packed_map_op_find_rank_range_by_value_interval_unordered() invalid start value");
 		return false;
 	}
 
 	if (value_end != value_start) {
 		// Pre-check parameters.
-		if (value_end && as_unpack_size(&pk_end) < 0) {
+		if (value_end && cdt_unpack_size(&pk_end) < 0) {
 			cf_warning(AS_PARTICLE, "packed_map_op_find_rank_range_by_value_interval_unordered() invalid end value");
 			return false;
 		}
@@ -3332,7 +3660,7 @@ packed_map_op_find_rank_range_by_value_interval_unordered(const packed_map_op *o
 	for (uint32_t i = 0; i < op->ele_count; i++) {
 		offset_index_set(offidx, i, (uint32_t)pk.offset);
 
-		if (as_unpack_size(&pk) < 0) {	// skip key
+		if (cdt_unpack_size(&pk) < 0) {	// skip key
 			cf_warning(AS_PARTICLE, "packed_map_op_find_rank_range_by_value_interval_unordered() invalid packed map at index %u", i);
 			return false;
 		}
@@ -3467,7 +3795,7 @@ packed_map_op_find_key_indexed(const packed_map_op *op, map_ele_find *find, cons
 							.length = (int)len
 					};
 
-					if (as_unpack_size(&pk) < 0) {
+					if (cdt_unpack_size(&pk) < 0) {
 						cf_warning(AS_PARTICLE, "packed_map_op_find_key_indexed() invalid packed map");
 						return false;
 					}
@@ -3592,7 +3920,7 @@ packed_map_op_find_key(const packed_map_op *op, map_ele_find *find, const cdt_pa
 			}
 			else {
 				// Skip value.
-				if (as_unpack_size(&pk) < 0) {
+				if (cdt_unpack_size(&pk) < 0) {
 					return false;
 				}
 
@@ -3626,14 +3954,14 @@ packed_map_op_find_key(const packed_map_op *op, map_ele_find *find, const cdt_pa
 			find->key_offset = (uint32_t)pk.offset;
 
 			// Skip key.
-			if (as_unpack_size(&pk) < 0) {
+			if (cdt_unpack_size(&pk) < 0) {
 				return false;
 			}
 
 			find->value_offset = (uint32_t)pk.offset;
 
 			// Skip value.
-			if (as_unpack_size(&pk) < 0) {
+			if (cdt_unpack_size(&pk) < 0) {
 				return false;
 			}
 
@@ -3672,7 +4000,7 @@ packed_map_op_find_key(const packed_map_op *op, map_ele_find *find, const cdt_pa
 				}
 				else {
 					// Skip value.
-					if (as_unpack_size(&pk) < 0) {
+					if (cdt_unpack_size(&pk) < 0) {
 						return false;
 					}
 				}
@@ -3711,7 +4039,7 @@ packed_map_op_find_key(const packed_map_op *op, map_ele_find *find, const cdt_pa
 				return true;
 			}
 			// Skip value.
-			else if (as_unpack_size(&pk) < 0) {
+			else if (cdt_unpack_size(&pk) < 0) {
 				return false;
 			}
 
@@ -4331,14 +4659,14 @@ packed_map_op_get_range_by_key_interval_unordered(packed_map_op *op, const cdt_p
 	};
 
 	// Pre-check parameters.
-	if (as_unpack_size(&pk_start) < 0) {
+	if (cdt_unpack_size(&pk_start) < 0) {
 		cf_warning(AS_PARTICLE, "packed_map_op_get_range_by_key_interval_unordered() invalid start key");
 		return false;
 	}
 
 	if (key_end) {
 		// Pre-check parameters.
-		if (key_end && as_unpack_size(&pk_end) < 0) {
+		if (key_end && cdt_unpack_size(&pk_end) < 0) {
 			cf_warning(AS_PARTICLE, "packed_map_op_get_range_by_key_interval_unordered() invalid end key");
 			return false;
 		}
@@ -4385,7 +4713,7 @@ packed_map_op_get_range_by_key_interval_unordered(packed_map_op *op, const cdt_p
 		}
 
 		// Skip value.
-		if (as_unpack_size(&pk) < 0) {
+		if (cdt_unpack_size(&pk) < 0) {
 			cf_warning(AS_PARTICLE, "packed_map_op_get_range_by_key_interval_unordered() invalid packed map at index %u", i);
 			return false;
 		}
@@ -4533,7 +4861,7 @@ packed_map_op_get_key_by_idx(const packed_map_op *op, cdt_payload *key, uint32_t
 			.length = (int)(op->packed_sz - pk_offset)
 	};
 
-	if (as_unpack_size(&pk) < 0) { // read key
+	if (cdt_unpack_size(&pk) < 0) { // read key
 		cf_warning(AS_PARTICLE, "packed_map_op_get_key_by_idx() read key failed");
 		return false;
 	}
@@ -4555,7 +4883,7 @@ packed_map_op_get_value_by_idx(const packed_map_op *op, cdt_payload *value, uint
 			.length = (int)(op->packed_sz - pk_offset)
 	};
 
-	if (as_unpack_size(&pk) < 0) { // read key
+	if (cdt_unpack_size(&pk) < 0) { // read key
 		cf_warning(AS_PARTICLE, "packed_map_op_get_value_by_idx() read key failed");
 		return false;
 	}
@@ -5306,7 +5634,7 @@ packed_map_strip_indexes(uint8_t *dest, const as_particle *p, bool remove_flags)
 		}
 
 		// Skip nil val.
-		if (as_unpack_size(&upk) < 0) {
+		if (cdt_unpack_size(&upk) < 0) {
 			return -3;
 		}
 
@@ -5340,6 +5668,91 @@ packed_map_strip_indexes(uint8_t *dest, const as_particle *p, bool remove_flags)
 	return (int64_t)pk.offset + (int64_t)ele_size;
 }
 
+// Indexes are complete, and the last offset is within the content.
+static bool
+packed_map_op_has_full_indexes(const packed_map_op *op)
+{
+	static const uint8_t idx_mask = AS_PACKED_MAP_FLAG_OFF_IDX | AS_PACKED_MAP_FLAG_ORD_IDX;
+
+	if ((op->pmi.flags & idx_mask) != (map_adjust_incoming_flags(op->pmi.flags) & idx_mask)) {
+		return false;
+	}
+
+	const offset_index *offidx = &op->pmi.offset_idx;
+	uint32_t ele_count = op->ele_count;
+
+	if (op_is_k_ordered(op)) {
+		if (! offset_index_is_valid(offidx)) {
+			return false;
+		}
+
+		if (ele_count != 0 && (offset_index_get_filled(offidx) != ele_count ||
+				offset_index_get_const(offidx, ele_count - 1) >= offidx->tot_ele_sz)) {
+			return false;
+		}
+	}
+
+	if (op_is_kv_ordered(op) && ! order_index_is_filled(&op->pmi.value_idx)) {
+		return false;
+	}
+
+	return true;
+}
+
+// Complete any lazily filled indexes of a packed map, in place. Returns true if
+// the map has no indexes.
+static bool
+packed_map_fill_indexes(uint8_t *packed, uint32_t packed_sz)
+{
+	packed_map_op op;
+
+	packed_map_op_init(&op, packed, packed_sz);
+
+	if (! packed_map_op_unpack_hdridx(&op)) {
+		return false;
+	}
+
+	if ((op.pmi.flags & (AS_PACKED_MAP_FLAG_OFF_IDX | AS_PACKED_MAP_FLAG_ORD_IDX)) == 0) {
+		return true;
+	}
+
+	offset_index *offidx = &op.pmi.offset_idx;
+	order_index *ordidx = &op.pmi.value_idx;
+
+	if (offset_index_is_valid(offidx) && ! offset_index_fill(offidx, op.ele_count)) {
+		return false;
+	}
+
+	if (order_index_is_valid(ordidx) && ! order_index_is_filled(ordidx)) {
+		if (! offset_index_is_valid(offidx) ||
+				! order_index_set_sorted_with_offsets(ordidx, offidx, SORT_BY_VALUE)) {
+			return false;
+		}
+	}
+
+	return packed_map_op_has_full_indexes(&op);
+}
+
+// Leave the ordering flags but drop the index flags, making the index content
+// dead space.
+static void
+packed_map_clear_index_flags(uint8_t *packed, uint32_t packed_sz)
+{
+	as_unpacker pk = {
+			.buffer = packed,
+			.offset = 0,
+			.length = (int)packed_sz
+	};
+
+	if (as_unpack_map_header_element_count(&pk) > 0 && as_unpack_peek_is_ext(&pk)) {
+		as_msgpack_ext ext;
+
+		if (as_unpack_ext(&pk, &ext) == 0) {
+			packed[ext.type_offset] &= ~(AS_PACKED_MAP_FLAG_OFF_IDX | AS_PACKED_MAP_FLAG_ORD_IDX);
+		}
+	}
+}
+
 //------------------------------------------------
 // map_ele_find
 
@@ -5391,7 +5804,7 @@ map_ele_find_init_from_idx(map_ele_find *find, const packed_map_op *op, uint32_t
 			.length = op->packed_sz - op->ele_start
 	};
 
-	as_unpack_size(&pk);
+	cdt_unpack_size(&pk);
 	find->value_offset = pk.offset;
 	find->size = offset_index_get_const(&op->pmi.offset_idx, idx + 1) - find->key_offset;
 }
@@ -5663,22 +6076,14 @@ offset_index_fill(offset_index *offidx, size_t index)
 	pk.offset = (int)offset_index_get_const(offidx, ele_filled - 1);
 
 	for (size_t i = ele_filled; i < index; i++) {
-		if (as_unpack_size(&pk) < 0) {
-			return false;
-		}
-
-		if (as_unpack_size(&pk) < 0) {
+		if (cdt_unpack_size_n(&pk, 2) < 0) {
 			return false;
 		}
 
 		offset_index_set(offidx, i, (uint32_t)pk.offset);
 	}
 
-	if (as_unpack_size(&pk) < 0) {
-		return false;
-	}
-
-	if (as_unpack_size(&pk) < 0) {
+	if (cdt_unpack_size_n(&pk, 2) < 0) {
 		return false;
 	}
 
@@ -8060,14 +8465,14 @@ as_bin_verify(const as_bin *b)
 
 		offset = (uint32_t)pk.offset;
 
-		if (as_unpack_size(&pk) < 0) {
+		if (cdt_unpack_size(&pk) < 0) {
 			cf_warning(AS_PARTICLE, "as_bin_verify() i=%u offset=%u pk.offset=%d invalid key", i, offset, pk.offset);
 			return false;
 		}
 
 		offset = (uint32_t)pk.offset;
 
-		if (as_unpack_size(&pk) < 0) {
+		if (cdt_unpack_size(&pk) < 0) {
 			cf_warning(AS_PARTICLE, "as_bin_verify() i=%u offset=%u pk.offset=%d invalid value", i, offset, pk.offset);
 			return false;
 		}
@@ -8106,7 +8511,7 @@ as_bin_verify(const as_bin *b)
 
 			pk_key.offset = offset;
 
-			if (as_unpack_size(&pk) < 0) {
+			if (cdt_unpack_size(&pk) < 0) {
 				cf_warning(AS_PARTICLE, "as_bin_verify() i=%u offset=%u pk.offset=%d invalid value", i, offset, pk.offset);
 				return false;
 			}
@@ -8141,7 +8546,7 @@ as_bin_verify(const as_bin *b)
 
 		prev_value.offset = offset_index_get_const(offidx, index);
 
-		if (as_unpack_size(&prev_value) < 0) {
+		if (cdt_unpack_size(&prev_value) < 0) {
 			cf_warning(AS_PARTICLE, "as_bin_verify() index=%u pk.offset=%d invalid key", index, pk.offset);
 			return false;
 		}
@@ -8150,7 +8555,7 @@ as_bin_verify(const as_bin *b)
 			index = order_index_get(ordidx, i);
 			pk.offset = offset_index_get_const(offidx, index);
 
-			if (as_unpack_size(&pk) < 0) {
+			if (cdt_unpack_size(&pk) < 0) {
 				cf_warning(AS_PARTICLE, "as_bin_verify() i=%u index=%u pk.offset=%d invalid key", i, index, pk.offset);
 				return false;
 			}
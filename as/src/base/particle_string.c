@@ -169,6 +169,12 @@ uint32_t
 as_bin_particle_string_ptr(const as_bin *b, char **p_value)
 {
 	// Caller must ensure this is called only for STRING particles.
+	if (as_bin_is_short_particle(b)) {
+		*p_value = (char *)b->svalue.data;
+
+		return b->svalue.sz;
+	}
+
 	string_mem *p_string_mem = (string_mem *)b->particle;
 
 	*p_value = (char *)p_string_mem->data;
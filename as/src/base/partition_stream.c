@@ -0,0 +1,443 @@
+/*
+ * partition_stream.c
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/* SYNOPSIS
+ * Partition map change notifications. Instead of polling the replicas-* info
+ * names, a client may send partition-map-subscribe on an info connection. It
+ * gets this node's replica maps with their version, and the connection is kept
+ * for pushes - no further requests are read from it. When the maps change, all
+ * subscribers are pushed the same message, holding only what changed since the
+ * previous version.
+ *
+ * The versions are partition generations. The stream thread snapshots the maps
+ * once per change, and builds each delta once for all subscribers. Subscribers
+ * whose socket doesn't take a push promptly are dropped - they re-subscribe to
+ * catch up with a full map.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "base/partition_stream.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "citrusleaf/alloc.h"
+#include "citrusleaf/cf_b64.h"
+#include "citrusleaf/cf_clock.h"
+
+#include "dynbuf.h"
+#include "fault.h"
+#include "socket.h"
+
+#include "base/cfg.h"
+#include "base/datamodel.h"
+#include "base/proto.h"
+#include "base/transaction.h"
+
+
+//==========================================================
+// Constants.
+//
+
+#define STREAM_PERIOD_MS		100
+#define STREAM_SEND_TIMEOUT_MS	50
+#define MAX_SUBSCRIBERS			(16 * 1024)
+
+// A flipped partition costs up to 5 bytes ("4095.") - past this many, send
+// the full map instead.
+#define MAX_FLIPS				(CLIENT_B64MAP_BYTES / 5)
+
+#define PUSH_NAME				"partition-map"
+
+
+//==========================================================
+// Globals.
+//
+
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static as_file_handle* g_subscribers[MAX_SUBSCRIBERS];
+static uint32_t g_n_subscribers = 0;
+
+// Snapshot of the maps, as of partition generation g_version. The maps are
+// the same as of g_pushed_version, the version subscribers last heard of.
+static uint32_t g_version = 0;
+static uint32_t g_pushed_version = 0;
+static uint8_t* g_maps[AS_NAMESPACE_SZ];
+static uint32_t g_n_repls[AS_NAMESPACE_SZ];
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static void* run_stream(void* arg);
+static bool append_ns_delta(cf_dyn_buf* db, uint32_t ns_ix);
+static void msg_start(cf_dyn_buf* db);
+static void msg_finish(cf_dyn_buf* db);
+static bool send_msg(as_file_handle* fd_h, const uint8_t* buf, size_t sz);
+static void push_and_prune(const uint8_t* buf, size_t sz);
+static void drop_subscriber(uint32_t i);
+
+
+//==========================================================
+// Public API.
+//
+
+void
+as_partition_stream_init()
+{
+	for (uint32_t ns_ix = 0; ns_ix < g_config.n_namespaces; ns_ix++) {
+		as_namespace* ns = g_config.namespaces[ns_ix];
+
+		g_maps[ns_ix] = cf_malloc(ns->cfg_replication_factor *
+				CLIENT_BITMAP_BYTES);
+
+		if (! g_maps[ns_ix]) {
+			cf_crash(AS_PARTITION, "failed partition stream map alloc");
+		}
+
+		for (uint32_t r = 0; r < ns->cfg_replication_factor; r++) {
+			memcpy(g_maps[ns_ix] + (r * CLIENT_BITMAP_BYTES),
+					(const uint8_t*)ns->replica_maps[r].bitmap,
+					CLIENT_BITMAP_BYTES);
+		}
+
+		g_n_repls[ns_ix] = ns->replication_factor;
+	}
+
+	g_version = (uint32_t)g_partition_generation;
+	g_pushed_version = g_version;
+
+	pthread_t thread;
+	pthread_attr_t attrs;
+
+	pthread_attr_init(&attrs);
+	pthread_attr_setdetachstate(&attrs, PTHREAD_CREATE_DETACHED);
+
+	if (pthread_create(&thread, &attrs, run_stream, NULL) != 0) {
+		cf_crash(AS_PARTITION, "failed to create partition stream thread");
+	}
+}
+
+void
+as_partition_stream_subscribe(as_file_handle* fd_h)
+{
+	cf_dyn_buf_define_size(db, 64 * 1024);
+	char b64map[CLIENT_B64MAP_BYTES];
+
+	pthread_mutex_lock(&g_lock);
+
+	if (g_n_subscribers == MAX_SUBSCRIBERS) {
+		pthread_mutex_unlock(&g_lock);
+		cf_dyn_buf_free(&db);
+
+		cf_warning(AS_PARTITION, "partition map subscriber limit %d reached",
+				MAX_SUBSCRIBERS);
+		as_end_of_transaction_force_close(fd_h);
+		return;
+	}
+
+	msg_start(&db);
+	cf_dyn_buf_append_string(&db, AS_PARTITION_STREAM_SUBSCRIBE "\t");
+	cf_dyn_buf_append_uint32(&db, g_pushed_version);
+
+	for (uint32_t ns_ix = 0; ns_ix < g_config.n_namespaces; ns_ix++) {
+		as_namespace* ns = g_config.namespaces[ns_ix];
+
+		cf_dyn_buf_append_char(&db, ';');
+		cf_dyn_buf_append_string(&db, ns->name);
+		cf_dyn_buf_append_char(&db, ':');
+		cf_dyn_buf_append_uint32(&db, g_n_repls[ns_ix]);
+
+		for (uint32_t r = 0; r < ns->cfg_replication_factor; r++) {
+			cf_b64_encode(g_maps[ns_ix] + (r * CLIENT_BITMAP_BYTES),
+					CLIENT_BITMAP_BYTES, b64map);
+			cf_dyn_buf_append_char(&db, ',');
+			cf_dyn_buf_append_buf(&db, (uint8_t*)b64map, CLIENT_B64MAP_BYTES);
+		}
+	}
+
+	cf_dyn_buf_append_char(&db, '\n');
+	msg_finish(&db);
+
+	// Send under the lock, so no push can get ahead of the full map.
+	if (! send_msg(fd_h, db.buf, db.used_sz)) {
+		pthread_mutex_unlock(&g_lock);
+		cf_dyn_buf_free(&db);
+
+		as_end_of_transaction_force_close(fd_h);
+		return;
+	}
+
+	fd_h->fh_info |= FH_INFO_DONOT_REAP;
+	g_subscribers[g_n_subscribers++] = fd_h;
+
+	pthread_mutex_unlock(&g_lock);
+	cf_dyn_buf_free(&db);
+}
+
+uint32_t
+as_partition_stream_n_subscribers()
+{
+	return g_n_subscribers;
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+static void*
+run_stream(void* arg)
+{
+	cf_dyn_buf_define_size(db, 64 * 1024);
+
+	while (true) {
+		usleep(STREAM_PERIOD_MS * 1000);
+
+		// Sample before reading the maps - a change racing the read shows up
+		// again next time.
+		uint32_t version = (uint32_t)g_partition_generation;
+
+		pthread_mutex_lock(&g_lock);
+
+		if (version == g_version) {
+			// Nothing to push - just let go of closed connections.
+			push_and_prune(NULL, 0);
+			pthread_mutex_unlock(&g_lock);
+			continue;
+		}
+
+		db.used_sz = 0;
+
+		msg_start(&db);
+		cf_dyn_buf_append_string(&db, PUSH_NAME "\t");
+		cf_dyn_buf_append_uint32(&db, version);
+		cf_dyn_buf_append_char(&db, ':');
+		cf_dyn_buf_append_uint32(&db, g_pushed_version);
+
+		bool changed = false;
+
+		for (uint32_t ns_ix = 0; ns_ix < g_config.n_namespaces; ns_ix++) {
+			if (append_ns_delta(&db, ns_ix)) {
+				changed = true;
+			}
+		}
+
+		cf_dyn_buf_append_char(&db, '\n');
+		msg_finish(&db);
+
+		g_version = version;
+
+		// Generation bumps that left this node's maps as they were (e.g.
+		// replica flips that undid each other) aren't worth a push.
+		if (changed) {
+			g_pushed_version = version;
+			push_and_prune(db.buf, db.used_sz);
+		}
+		else {
+			push_and_prune(NULL, 0);
+		}
+
+		pthread_mutex_unlock(&g_lock);
+	}
+
+	return NULL;
+}
+
+// Diffs a namespace's live maps against the snapshot, appends the delta if
+// anything changed, and updates the snapshot. Called under g_lock.
+static bool
+append_ns_delta(cf_dyn_buf* db, uint32_t ns_ix)
+{
+	as_namespace* ns = g_config.namespaces[ns_ix];
+	uint32_t n_repl = ns->replication_factor;
+	size_t start_sz = db->used_sz;
+	bool changed = n_repl != g_n_repls[ns_ix];
+
+	uint8_t cur[CLIENT_BITMAP_BYTES];
+	char b64map[CLIENT_B64MAP_BYTES];
+
+	cf_dyn_buf_append_char(db, ';');
+	cf_dyn_buf_append_string(db, ns->name);
+	cf_dyn_buf_append_char(db, ':');
+	cf_dyn_buf_append_uint32(db, n_repl);
+
+	for (uint32_t r = 0; r < ns->cfg_replication_factor; r++) {
+		uint8_t* snap = g_maps[ns_ix] + (r * CLIENT_BITMAP_BYTES);
+
+		// Copy first - the live map may change as we go.
+		memcpy(cur, (const uint8_t*)ns->replica_maps[r].bitmap,
+				CLIENT_BITMAP_BYTES);
+
+		uint32_t n_flips = 0;
+
+		for (uint32_t i = 0; i < CLIENT_BITMAP_BYTES; i++) {
+			n_flips += (uint32_t)__builtin_popcount(cur[i] ^ snap[i]);
+		}
+
+		cf_dyn_buf_append_char(db, ',');
+
+		if (n_flips == 0) {
+			continue;
+		}
+
+		changed = true;
+
+		if (n_flips > MAX_FLIPS) {
+			cf_b64_encode(cur, CLIENT_BITMAP_BYTES, b64map);
+			cf_dyn_buf_append_char(db, '=');
+			cf_dyn_buf_append_buf(db, (uint8_t*)b64map, CLIENT_B64MAP_BYTES);
+		}
+		else {
+			bool first = true;
+
+			for (uint32_t i = 0; i < CLIENT_BITMAP_BYTES; i++) {
+				uint8_t x = cur[i] ^ snap[i];
+
+				for (uint32_t b = 0; x != 0 && b < 8; b++) {
+					if ((x & (0x80 >> b)) == 0) {
+						continue;
+					}
+
+					if (! first) {
+						cf_dyn_buf_append_char(db, '.');
+					}
+
+					cf_dyn_buf_append_uint32(db, (i << 3) + b);
+					first = false;
+				}
+			}
+		}
+
+		memcpy(snap, cur, CLIENT_BITMAP_BYTES);
+	}
+
+	g_n_repls[ns_ix] = n_repl;
+
+	if (! changed) {
+		db->used_sz = start_sz;
+	}
+
+	return changed;
+}
+
+// Leaves room for the proto header.
+static void
+msg_start(cf_dyn_buf* db)
+{
+	uint64_t h = 0;
+
+	cf_dyn_buf_append_buf(db, (uint8_t*)&h, sizeof(h));
+}
+
+// Fills in the proto header, as for info replies.
+static void
+msg_finish(cf_dyn_buf* db)
+{
+	uint64_t sz = db->used_sz - 8;
+
+	db->buf[0] = PROTO_VERSION;
+	db->buf[1] = PROTO_TYPE_INFO;
+	db->buf[2] = (sz >> 40) & 0xff;
+	db->buf[3] = (sz >> 32) & 0xff;
+	db->buf[4] = (sz >> 24) & 0xff;
+	db->buf[5] = (sz >> 16) & 0xff;
+	db->buf[6] = (sz >> 8) & 0xff;
+	db->buf[7] = sz & 0xff;
+}
+
+static bool
+send_msg(as_file_handle* fd_h, const uint8_t* buf, size_t sz)
+{
+	uint64_t deadline_ms = cf_getms() + STREAM_SEND_TIMEOUT_MS;
+	const uint8_t* b = buf;
+	const uint8_t* lim = buf + sz;
+
+	while (b < lim) {
+		int32_t rv = cf_socket_send(fd_h->sock, (void*)b, lim - b,
+				MSG_NOSIGNAL);
+
+		if (rv > 0) {
+			b += rv;
+			continue;
+		}
+
+		if (rv < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+			cf_debug(AS_PARTITION, "partition map send failed: fd %d error %d",
+					CSFD(fd_h->sock), errno);
+			return false;
+		}
+
+		if (cf_getms() > deadline_ms) {
+			cf_debug(AS_PARTITION, "partition map send timed out: fd %d",
+					CSFD(fd_h->sock));
+			return false;
+		}
+
+		usleep(100);
+	}
+
+	fd_h->last_used = cf_getms();
+
+	return true;
+}
+
+// Pushes buf (if not NULL) to every subscriber, and drops those that are
+// closing or fail. Called under g_lock.
+static void
+push_and_prune(const uint8_t* buf, size_t sz)
+{
+	uint32_t i = 0;
+
+	while (i < g_n_subscribers) {
+		as_file_handle* fd_h = g_subscribers[i];
+
+		if (fd_h->reap_me || (buf && ! send_msg(fd_h, buf, sz))) {
+			drop_subscriber(i);
+			continue; // the last subscriber now sits at i
+		}
+
+		i++;
+	}
+}
+
+static void
+drop_subscriber(uint32_t i)
+{
+	as_file_handle* fd_h = g_subscribers[i];
+
+	g_subscribers[i] = g_subscribers[--g_n_subscribers];
+
+	fd_h->fh_info &= ~FH_INFO_DONOT_REAP;
+	as_end_of_transaction_force_close(fd_h);
+}
@@ -0,0 +1,541 @@
+/*
+ * predexp.c
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/* SYNOPSIS
+ * Predicate expressions for scans and queries, sent in the PREDEXP message
+ * field. The postfix element list is built into a tree, using a stack of
+ * nodes, and evaluated per record.
+ *
+ * Evaluation is three-valued, so a predicate can first be tried on metadata
+ * alone - bin operands evaluate UNKNOWN, and the caller reads the record only
+ * if the result is UNKNOWN. A missing bin, or a bin of the wrong type, makes
+ * its comparisons false.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "base/predexp.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "citrusleaf/alloc.h"
+#include "citrusleaf/cf_byte_order.h"
+
+#include "fault.h"
+
+#include "base/datamodel.h"
+#include "base/index.h"
+#include "base/proto.h"
+
+
+//==========================================================
+// Constants.
+//
+
+#define PREDEXP_MAX_NODES 256 // per expression
+
+
+//==========================================================
+// Typedefs.
+//
+
+typedef enum {
+	PREDEXP_TYPE_BOOL,
+	PREDEXP_TYPE_INTEGER,
+	PREDEXP_TYPE_STRING
+} predexp_type;
+
+typedef struct predexp_node_s {
+	struct predexp_node_s*	next;		// build stack link
+	uint16_t				tag;
+	predexp_type			type;		// what the node evaluates to
+	uint16_t				n_children;
+	struct predexp_node_s**	children;
+	int64_t					i_val;
+	char*					s_val;		// string literal or bin name
+	uint32_t				s_len;
+} predexp_node;
+
+struct predexp_eval_s {
+	predexp_node*	root;
+	predexp_node*	nodes;		// all nodes, for destroy
+	uint32_t		n_nodes;
+};
+
+typedef struct predexp_value_s {
+	int64_t		i_val;
+	const char*	s_val;
+	uint32_t	s_len;
+} predexp_value;
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static bool build_node(predexp_eval* pe, predexp_node** p_stack, uint16_t tag, const uint8_t* value, uint32_t value_sz);
+static predexp_node* pop_node(predexp_node** p_stack, predexp_type type);
+static predexp_retval eval_bool(const predexp_node* node, predexp_args* args);
+static predexp_retval eval_value(const predexp_node* node, predexp_args* args, predexp_value* v);
+static predexp_retval eval_compare(const predexp_node* node, predexp_args* args);
+
+
+//==========================================================
+// Public API.
+//
+
+// Returns null (and warns) on a malformed expression.
+predexp_eval*
+predexp_build(as_msg_field* pfp)
+{
+	const uint8_t* p = pfp->data;
+	const uint8_t* end = p + as_msg_field_get_value_sz(pfp);
+
+	predexp_eval* pe = cf_malloc(sizeof(predexp_eval));
+
+	cf_assert(pe, AS_QUERY, CF_CRITICAL, "failed predexp malloc");
+
+	pe->root = NULL;
+	pe->n_nodes = 0;
+	pe->nodes = cf_malloc(PREDEXP_MAX_NODES * sizeof(predexp_node));
+
+	cf_assert(pe->nodes, AS_QUERY, CF_CRITICAL, "failed predexp nodes malloc");
+
+	predexp_node* stack = NULL;
+
+	while (p < end) {
+		if (end - p < (ptrdiff_t)(sizeof(uint16_t) + sizeof(uint32_t))) {
+			cf_warning(AS_QUERY, "predexp: truncated element header");
+			predexp_destroy(pe);
+			return NULL;
+		}
+
+		uint16_t tag = cf_swap_from_be16(*(uint16_t*)p);
+		p += sizeof(uint16_t);
+
+		uint32_t value_sz = cf_swap_from_be32(*(uint32_t*)p);
+		p += sizeof(uint32_t);
+
+		if (value_sz > (uint32_t)(end - p)) {
+			cf_warning(AS_QUERY, "predexp: truncated element value");
+			predexp_destroy(pe);
+			return NULL;
+		}
+
+		if (! build_node(pe, &stack, tag, p, value_sz)) {
+			predexp_destroy(pe);
+			return NULL;
+		}
+
+		p += value_sz;
+	}
+
+	// Must leave exactly one boolean on the stack.
+	if (! stack || stack->next || stack->type != PREDEXP_TYPE_BOOL) {
+		cf_warning(AS_QUERY, "predexp: expression doesn't reduce to one predicate");
+		predexp_destroy(pe);
+		return NULL;
+	}
+
+	pe->root = stack;
+
+	return pe;
+}
+
+
+// Evaluate using index metadata only. UNKNOWN means bins are needed.
+predexp_retval
+predexp_matches_metadata(predexp_eval* pe, predexp_args* args)
+{
+	as_storage_rd* rd = args->rd;
+
+	args->rd = NULL;
+
+	predexp_retval rv = eval_bool(pe->root, args);
+
+	args->rd = rd;
+
+	return rv;
+}
+
+
+// Evaluate with bins - args->rd must have its bins loaded.
+bool
+predexp_matches_record(predexp_eval* pe, predexp_args* args)
+{
+	return eval_bool(pe->root, args) == PREDEXP_TRUE;
+}
+
+
+void
+predexp_destroy(predexp_eval* pe)
+{
+	for (uint32_t i = 0; i < pe->n_nodes; i++) {
+		predexp_node* node = &pe->nodes[i];
+
+		if (node->children) {
+			cf_free(node->children);
+		}
+
+		if (node->s_val) {
+			cf_free(node->s_val);
+		}
+	}
+
+	cf_free(pe->nodes);
+	cf_free(pe);
+}
+
+
+//==========================================================
+// Local helpers - build.
+//
+
+static bool
+build_node(predexp_eval* pe, predexp_node** p_stack, uint16_t tag,
+		const uint8_t* value, uint32_t value_sz)
+{
+	if (pe->n_nodes == PREDEXP_MAX_NODES) {
+		cf_warning(AS_QUERY, "predexp: more than %d elements",
+				PREDEXP_MAX_NODES);
+		return false;
+	}
+
+	predexp_node* node = &pe->nodes[pe->n_nodes++];
+
+	memset(node, 0, sizeof(predexp_node));
+	node->tag = tag;
+
+	switch (tag) {
+	case AS_PREDEXP_AND:
+	case AS_PREDEXP_OR:
+		if (value_sz != sizeof(uint16_t)) {
+			cf_warning(AS_QUERY, "predexp: bad and/or value size %u", value_sz);
+			return false;
+		}
+
+		node->type = PREDEXP_TYPE_BOOL;
+		node->n_children = cf_swap_from_be16(*(uint16_t*)value);
+
+		if (node->n_children == 0) {
+			cf_warning(AS_QUERY, "predexp: and/or with no terms");
+			return false;
+		}
+
+		node->children = cf_malloc(node->n_children * sizeof(predexp_node*));
+
+		cf_assert(node->children, AS_QUERY, CF_CRITICAL,
+				"failed predexp children malloc");
+
+		// Terms were pushed in order, so pop them in reverse.
+		for (int i = node->n_children - 1; i >= 0; i--) {
+			if (! (node->children[i] = pop_node(p_stack, PREDEXP_TYPE_BOOL))) {
+				return false;
+			}
+		}
+		break;
+	case AS_PREDEXP_NOT:
+		node->type = PREDEXP_TYPE_BOOL;
+		node->n_children = 1;
+		node->children = cf_malloc(sizeof(predexp_node*));
+
+		cf_assert(node->children, AS_QUERY, CF_CRITICAL,
+				"failed predexp children malloc");
+
+		if (! (node->children[0] = pop_node(p_stack, PREDEXP_TYPE_BOOL))) {
+			return false;
+		}
+		break;
+	case AS_PREDEXP_INTEGER_VALUE:
+		if (value_sz != sizeof(int64_t)) {
+			cf_warning(AS_QUERY, "predexp: bad integer value size %u", value_sz);
+			return false;
+		}
+
+		node->type = PREDEXP_TYPE_INTEGER;
+		node->i_val = (int64_t)cf_swap_from_be64(*(uint64_t*)value);
+		break;
+	case AS_PREDEXP_STRING_VALUE:
+	case AS_PREDEXP_INTEGER_BIN:
+	case AS_PREDEXP_STRING_BIN:
+		if (tag != AS_PREDEXP_STRING_VALUE &&
+				(value_sz == 0 || value_sz >= AS_ID_BIN_SZ)) {
+			cf_warning(AS_QUERY, "predexp: bad bin name size %u", value_sz);
+			return false;
+		}
+
+		node->type = tag == AS_PREDEXP_INTEGER_BIN ?
+				PREDEXP_TYPE_INTEGER : PREDEXP_TYPE_STRING;
+		node->s_val = cf_malloc(value_sz + 1);
+
+		cf_assert(node->s_val, AS_QUERY, CF_CRITICAL,
+				"failed predexp string malloc");
+
+		memcpy(node->s_val, value, value_sz);
+		node->s_val[value_sz] = '\0'; // bin names need it
+		node->s_len = value_sz;
+		break;
+	case AS_PREDEXP_REC_LAST_UPDATE:
+	case AS_PREDEXP_REC_VOID_TIME:
+	case AS_PREDEXP_REC_GENERATION:
+		node->type = PREDEXP_TYPE_INTEGER;
+		break;
+	case AS_PREDEXP_REC_SET_NAME:
+		node->type = PREDEXP_TYPE_STRING;
+		break;
+	case AS_PREDEXP_INTEGER_EQUAL:
+	case AS_PREDEXP_INTEGER_UNEQUAL:
+	case AS_PREDEXP_INTEGER_GREATER:
+	case AS_PREDEXP_INTEGER_GREATEREQ:
+	case AS_PREDEXP_INTEGER_LESS:
+	case AS_PREDEXP_INTEGER_LESSEQ:
+	case AS_PREDEXP_STRING_EQUAL:
+	case AS_PREDEXP_STRING_UNEQUAL: {
+		predexp_type operand_type = tag >= AS_PREDEXP_STRING_EQUAL ?
+				PREDEXP_TYPE_STRING : PREDEXP_TYPE_INTEGER;
+
+		node->type = PREDEXP_TYPE_BOOL;
+		node->n_children = 2;
+		node->children = cf_malloc(2 * sizeof(predexp_node*));
+
+		cf_assert(node->children, AS_QUERY, CF_CRITICAL,
+				"failed predexp children malloc");
+
+		if (! (node->children[1] = pop_node(p_stack, operand_type)) ||
+				! (node->children[0] = pop_node(p_stack, operand_type))) {
+			return false;
+		}
+		break;
+	}
+	default:
+		cf_warning(AS_QUERY, "predexp: unknown tag %u", tag);
+		return false;
+	}
+
+	node->next = *p_stack;
+	*p_stack = node;
+
+	return true;
+}
+
+
+static predexp_node*
+pop_node(predexp_node** p_stack, predexp_type type)
+{
+	predexp_node* node = *p_stack;
+
+	if (! node) {
+		cf_warning(AS_QUERY, "predexp: missing operand");
+		return NULL;
+	}
+
+	if (node->type != type) {
+		cf_warning(AS_QUERY, "predexp: operand of tag %u has wrong type",
+				node->tag);
+		return NULL;
+	}
+
+	*p_stack = node->next;
+	node->next = NULL;
+
+	return node;
+}
+
+
+//==========================================================
+// Local helpers - evaluate.
+//
+
+static predexp_retval
+eval_bool(const predexp_node* node, predexp_args* args)
+{
+	switch (node->tag) {
+	case AS_PREDEXP_AND: {
+		predexp_retval rv = PREDEXP_TRUE;
+
+		for (uint16_t i = 0; i < node->n_children; i++) {
+			predexp_retval child_rv = eval_bool(node->children[i], args);
+
+			if (child_rv == PREDEXP_FALSE) {
+				return PREDEXP_FALSE;
+			}
+
+			if (child_rv == PREDEXP_UNKNOWN) {
+				rv = PREDEXP_UNKNOWN;
+			}
+		}
+
+		return rv;
+	}
+	case AS_PREDEXP_OR: {
+		predexp_retval rv = PREDEXP_FALSE;
+
+		for (uint16_t i = 0; i < node->n_children; i++) {
+			predexp_retval child_rv = eval_bool(node->children[i], args);
+
+			if (child_rv == PREDEXP_TRUE) {
+				return PREDEXP_TRUE;
+			}
+
+			if (child_rv == PREDEXP_UNKNOWN) {
+				rv = PREDEXP_UNKNOWN;
+			}
+		}
+
+		return rv;
+	}
+	case AS_PREDEXP_NOT: {
+		predexp_retval child_rv = eval_bool(node->children[0], args);
+
+		return child_rv == PREDEXP_UNKNOWN ? PREDEXP_UNKNOWN :
+				(child_rv == PREDEXP_TRUE ? PREDEXP_FALSE : PREDEXP_TRUE);
+	}
+	default:
+		return eval_compare(node, args);
+	}
+}
+
+
+// TRUE means v is set, FALSE means there's no such value (e.g. missing bin).
+static predexp_retval
+eval_value(const predexp_node* node, predexp_args* args, predexp_value* v)
+{
+	switch (node->tag) {
+	case AS_PREDEXP_INTEGER_VALUE:
+		v->i_val = node->i_val;
+		return PREDEXP_TRUE;
+	case AS_PREDEXP_STRING_VALUE:
+		v->s_val = node->s_val;
+		v->s_len = node->s_len;
+		return PREDEXP_TRUE;
+	case AS_PREDEXP_REC_LAST_UPDATE:
+		v->i_val = (int64_t)args->md->last_update_time;
+		return PREDEXP_TRUE;
+	case AS_PREDEXP_REC_VOID_TIME:
+		v->i_val = (int64_t)args->md->void_time;
+		return PREDEXP_TRUE;
+	case AS_PREDEXP_REC_GENERATION:
+		v->i_val = (int64_t)args->md->generation;
+		return PREDEXP_TRUE;
+	case AS_PREDEXP_REC_SET_NAME: {
+		const char* set_name = as_index_get_set_name(args->md, args->ns);
+
+		v->s_val = set_name ? set_name : "";
+		v->s_len = (uint32_t)strlen(v->s_val);
+		return PREDEXP_TRUE;
+	}
+	case AS_PREDEXP_INTEGER_BIN:
+	case AS_PREDEXP_STRING_BIN: {
+		if (! args->rd) {
+			return PREDEXP_UNKNOWN;
+		}
+
+		as_bin* b = as_bin_get(args->rd, node->s_val);
+
+		if (! b) {
+			return PREDEXP_FALSE;
+		}
+
+		uint8_t particle_type = as_bin_get_particle_type(b);
+
+		if (node->tag == AS_PREDEXP_INTEGER_BIN) {
+			if (particle_type != AS_PARTICLE_TYPE_INTEGER) {
+				return PREDEXP_FALSE;
+			}
+
+			v->i_val = as_bin_particle_integer_value(b);
+			return PREDEXP_TRUE;
+		}
+
+		if (particle_type != AS_PARTICLE_TYPE_STRING) {
+			return PREDEXP_FALSE;
+		}
+
+		char* s_val;
+
+		v->s_len = as_bin_particle_string_ptr(b, &s_val);
+		v->s_val = s_val;
+		return PREDEXP_TRUE;
+	}
+	default:
+		cf_crash(AS_QUERY, "predexp: unexpected value tag %u", node->tag);
+		return PREDEXP_FALSE;
+	}
+}
+
+
+static predexp_retval
+eval_compare(const predexp_node* node, predexp_args* args)
+{
+	predexp_value l;
+	predexp_value r;
+
+	predexp_retval l_rv = eval_value(node->children[0], args, &l);
+	predexp_retval r_rv = eval_value(node->children[1], args, &r);
+
+	if (l_rv == PREDEXP_FALSE || r_rv == PREDEXP_FALSE) {
+		return PREDEXP_FALSE;
+	}
+
+	if (l_rv == PREDEXP_UNKNOWN || r_rv == PREDEXP_UNKNOWN) {
+		return PREDEXP_UNKNOWN;
+	}
+
+	bool result;
+
+	switch (node->tag) {
+	case AS_PREDEXP_INTEGER_EQUAL:
+		result = l.i_val == r.i_val;
+		break;
+	case AS_PREDEXP_INTEGER_UNEQUAL:
+		result = l.i_val != r.i_val;
+		break;
+	case AS_PREDEXP_INTEGER_GREATER:
+		result = l.i_val > r.i_val;
+		break;
+	case AS_PREDEXP_INTEGER_GREATEREQ:
+		result = l.i_val >= r.i_val;
+		break;
+	case AS_PREDEXP_INTEGER_LESS:
+		result = l.i_val < r.i_val;
+		break;
+	case AS_PREDEXP_INTEGER_LESSEQ:
+		result = l.i_val <= r.i_val;
+		break;
+	case AS_PREDEXP_STRING_EQUAL:
+		result = l.s_len == r.s_len && memcmp(l.s_val, r.s_val, l.s_len) == 0;
+		break;
+	case AS_PREDEXP_STRING_UNEQUAL:
+		result = l.s_len != r.s_len || memcmp(l.s_val, r.s_val, l.s_len) != 0;
+		break;
+	default:
+		cf_crash(AS_QUERY, "predexp: unexpected predicate tag %u", node->tag);
+		return PREDEXP_FALSE;
+	}
+
+	return result ? PREDEXP_TRUE : PREDEXP_FALSE;
+}
@@ -86,6 +86,14 @@ as_msg_swap_field(as_msg_field *mf)
 	mf->field_sz = ntohl(mf->field_sz);
 }
 
+// Values at least this big are referenced in place by iovec responses.
+#define IOV_MIN_VALUE_SZ 1024
+
+static cl_msg *make_response_msg(uint32_t result_code, uint32_t generation,
+		uint32_t void_time, as_msg_op **ops, as_bin **bins, uint16_t bin_count,
+		as_namespace *ns, cl_msg *msgp_in, size_t *msg_sz_in, uint64_t trid,
+		const char *setname, struct iovec *iov, uint32_t *p_n_iov);
+
 //
 // This function will attempt to fill the passed in buffer,
 // but if too small, will malloc and return that.
@@ -97,8 +105,56 @@ as_msg_make_response_msg(uint32_t result_code, uint32_t generation,
 		uint32_t void_time, as_msg_op **ops, as_bin **bins, uint16_t bin_count,
 		as_namespace *ns, cl_msg *msgp_in, size_t *msg_sz_in, uint64_t trid,
 		const char *setname)
+{
+	return make_response_msg(result_code, generation, void_time, ops, bins,
+			bin_count, ns, msgp_in, msg_sz_in, trid, setname, NULL, NULL);
+}
+
+
+// As above, but big string/blob values aren't copied - the response is
+// described by iov (at most AS_MSG_RESPONSE_MAX_IOV entries), referencing the
+// returned buffer and the bins' particles in place. Caller must not free the
+// bins' particles until the response is sent. Returned size is that of the
+// buffer, not the response.
+cl_msg *
+as_msg_make_response_iov(uint32_t result_code, uint32_t generation,
+		uint32_t void_time, as_msg_op **ops, as_bin **bins, uint16_t bin_count,
+		as_namespace *ns, cl_msg *msgp_in, size_t *msg_sz_in, uint64_t trid,
+		const char *setname, struct iovec *iov, uint32_t *p_n_iov)
+{
+	return make_response_msg(result_code, generation, void_time, ops, bins,
+			bin_count, ns, msgp_in, msg_sz_in, trid, setname, iov, p_n_iov);
+}
+
+
+static inline const uint8_t *
+response_value_ref(const as_bin *b, uint32_t *p_sz, uint32_t *p_n_refs)
+{
+	if (*p_n_refs == (AS_MSG_RESPONSE_MAX_IOV - 1) / 2) {
+		return NULL;
+	}
+
+	const uint8_t *ref = as_bin_particle_client_value_ref(b, p_sz);
+
+	if (! ref || *p_sz < IOV_MIN_VALUE_SZ) {
+		return NULL;
+	}
+
+	(*p_n_refs)++;
+
+	return ref;
+}
+
+
+static cl_msg *
+make_response_msg(uint32_t result_code, uint32_t generation,
+		uint32_t void_time, as_msg_op **ops, as_bin **bins, uint16_t bin_count,
+		as_namespace *ns, cl_msg *msgp_in, size_t *msg_sz_in, uint64_t trid,
+		const char *setname, struct iovec *iov, uint32_t *p_n_iov)
 {
 	size_t msg_sz = sizeof(cl_msg);
+	size_t ref_sz = 0;
+	uint32_t n_refs = 0;
 
 	msg_sz += sizeof(as_msg_op) * bin_count;
 
@@ -115,7 +171,14 @@ as_msg_make_response_msg(uint32_t result_code, uint32_t generation,
 		}
 
 		if (bins[i]) {
-			msg_sz += as_bin_particle_client_value_size(bins[i]);
+			uint32_t value_sz;
+
+			if (iov && response_value_ref(bins[i], &value_sz, &n_refs)) {
+				ref_sz += value_sz;
+			}
+			else {
+				msg_sz += as_bin_particle_client_value_size(bins[i]);
+			}
 		}
 	}
 
@@ -133,7 +196,10 @@ as_msg_make_response_msg(uint32_t result_code, uint32_t generation,
 	uint8_t *b;
 
 	if (! msgp_in || *msg_sz_in < msg_sz) {
-		b = cf_malloc(msg_sz);
+		size_t alloc_sz;
+
+		// Sized for this thread's recent responses, and reused when possible.
+		b = cf_dyn_buf_pool_get(msg_sz, &alloc_sz);
 
 		if (! b) {
 			return NULL;
@@ -150,7 +216,7 @@ as_msg_make_response_msg(uint32_t result_code, uint32_t generation,
 
 	msgp->proto.version = PROTO_VERSION;
 	msgp->proto.type = PROTO_TYPE_AS_MSG;
-	msgp->proto.sz = msg_sz - sizeof(as_proto);
+	msgp->proto.sz = msg_sz + ref_sz - sizeof(as_proto);
 	as_proto_swap(&msgp->proto);
 
 	as_msg *m = &msgp->msg;
@@ -197,6 +263,11 @@ as_msg_make_response_msg(uint32_t result_code, uint32_t generation,
 
 	as_msg_swap_header(m);
 
+	uint8_t *seg_start = b;
+	uint32_t n_iov = 0;
+
+	n_refs = 0;
+
 	for (uint16_t i = 0; i < bin_count; i++) {
 		as_msg_op *op = (as_msg_op *)buf;
 
@@ -215,11 +286,38 @@ as_msg_make_response_msg(uint32_t result_code, uint32_t generation,
 		op->op_sz = 4 + op->name_sz;
 
 		buf += sizeof(as_msg_op) + op->name_sz;
-		buf += as_bin_particle_to_client(bins[i], op);
+
+		uint32_t value_sz;
+		const uint8_t *ref = iov && bins[i] ?
+				response_value_ref(bins[i], &value_sz, &n_refs) : NULL;
+
+		if (ref) {
+			op->particle_type = as_bin_get_particle_type(bins[i]);
+			op->op_sz += value_sz;
+
+			iov[n_iov].iov_base = seg_start;
+			iov[n_iov++].iov_len = buf - seg_start;
+			iov[n_iov].iov_base = (void *)ref;
+			iov[n_iov++].iov_len = value_sz;
+
+			seg_start = buf;
+		}
+		else {
+			buf += as_bin_particle_to_client(bins[i], op);
+		}
 
 		as_msg_swap_op(op);
 	}
 
+	if (iov) {
+		if (buf != seg_start) {
+			iov[n_iov].iov_base = seg_start;
+			iov[n_iov++].iov_len = buf - seg_start;
+		}
+
+		*p_n_iov = n_iov;
+	}
+
 	return (cl_msg *)b;
 }
 
@@ -239,6 +337,8 @@ as_msg_send_ops_reply(as_file_handle *fd_h, cf_dyn_buf *db)
 	size_t msg_sz = db->used_sz;
 	size_t pos = 0;
 
+	as_file_handle_send_lock(fd_h);
+
 	while (pos < msg_sz) {
 		int result = cf_socket_send(fd_h->sock, msgp + pos, msg_sz - pos, MSG_NOSIGNAL);
 
@@ -249,6 +349,7 @@ as_msg_send_ops_reply(as_file_handle *fd_h, cf_dyn_buf *db)
 			if (errno != EWOULDBLOCK) {
 				// Common when a client aborts.
 				cf_debug(AS_PROTO, "protocol write fail: fd %d sz %zd pos %zd rv %d errno %d", CSFD(fd_h->sock), msg_sz, pos, rv, errno);
+				as_file_handle_send_unlock(fd_h);
 				as_end_of_transaction_force_close(fd_h);
 				rv = -1;
 				goto Exit;
@@ -258,12 +359,14 @@ as_msg_send_ops_reply(as_file_handle *fd_h, cf_dyn_buf *db)
 		}
 		else {
 			cf_info(AS_PROTO, "protocol write fail zero return: fd %d sz %zu pos %zu ", CSFD(fd_h->sock), msg_sz, pos);
+			as_file_handle_send_unlock(fd_h);
 			as_end_of_transaction_force_close(fd_h);
 			rv = -1;
 			goto Exit;
 		}
 	}
 
+	as_file_handle_send_unlock(fd_h);
 	as_end_of_transaction_ok(fd_h);
 
 Exit:
@@ -271,6 +374,59 @@ Exit:
 }
 
 
+// Send a response made by as_msg_make_response_iov(). Note - advances iov.
+int
+as_msg_send_iov_reply(as_file_handle *fd_h, struct iovec *iov, uint32_t n_iov)
+{
+	if (fd_h->sock == NULL) {
+		cf_crash(AS_PROTO, "fd is NULL");
+	}
+
+	as_file_handle_send_lock(fd_h);
+
+	while (n_iov != 0) {
+		int result = cf_socket_send_iov(fd_h->sock, iov, n_iov, MSG_NOSIGNAL);
+
+		if (result > 0) {
+			size_t sent = (size_t)result;
+
+			while (n_iov != 0 && sent >= iov->iov_len) {
+				sent -= iov->iov_len;
+				iov++;
+				n_iov--;
+			}
+
+			if (n_iov != 0) {
+				iov->iov_base = (uint8_t *)iov->iov_base + sent;
+				iov->iov_len -= sent;
+			}
+		}
+		else if (result < 0) {
+			if (errno != EWOULDBLOCK) {
+				// Common when a client aborts.
+				cf_debug(AS_PROTO, "protocol write fail: fd %d n-iov %u errno %d", CSFD(fd_h->sock), n_iov, errno);
+				as_file_handle_send_unlock(fd_h);
+				as_end_of_transaction_force_close(fd_h);
+				return -1;
+			}
+
+			usleep(1); // yield
+		}
+		else {
+			cf_info(AS_PROTO, "protocol write fail zero return: fd %d n-iov %u", CSFD(fd_h->sock), n_iov);
+			as_file_handle_send_unlock(fd_h);
+			as_end_of_transaction_force_close(fd_h);
+			return -1;
+		}
+	}
+
+	as_file_handle_send_unlock(fd_h);
+	as_end_of_transaction_ok(fd_h);
+
+	return 0;
+}
+
+
 // NB: this uses the same logic as the bufbuild function
 // as_msg_make_response_bufbuilder() but does not build a buffer and simply
 // returns sizing information.  This is required for query runtime memory
@@ -696,6 +852,8 @@ as_msg_send_reply(as_file_handle *fd_h, uint32_t result_code, uint32_t generatio
 
 //	cf_detail(AS_PROTO, "write fd %d",fd);
 
+	as_file_handle_send_lock(fd_h);
+
 	size_t pos = 0;
 	while (pos < msg_sz) {
 		int rv = cf_socket_send(fd_h->sock, msgp + pos, msg_sz - pos, MSG_NOSIGNAL);
@@ -706,6 +864,7 @@ as_msg_send_reply(as_file_handle *fd_h, uint32_t result_code, uint32_t generatio
 			if (errno != EWOULDBLOCK) {
 				// common message when a client aborts
 				cf_debug(AS_PROTO, "protocol write fail: fd %d sz %zd pos %zd rv %d errno %d", CSFD(fd_h->sock), msg_sz, pos, rv, errno);
+				as_file_handle_send_unlock(fd_h);
 				as_end_of_transaction_force_close(fd_h);
 				rv = -1;
 				goto Exit;
@@ -713,12 +872,14 @@ as_msg_send_reply(as_file_handle *fd_h, uint32_t result_code, uint32_t generatio
 			usleep(1); // Yield
 		} else {
 			cf_info(AS_PROTO, "protocol write fail zero return: fd %d sz %zu pos %zu ", CSFD(fd_h->sock), msg_sz, pos);
+			as_file_handle_send_unlock(fd_h);
 			as_end_of_transaction_force_close(fd_h);
 			rv = -1;
 			goto Exit;
 		}
 	}
 
+	as_file_handle_send_unlock(fd_h);
 	as_end_of_transaction_ok(fd_h);
 
 Exit:
@@ -976,7 +1137,7 @@ static cf_queue     * g_netio_queue      = 0;
 static cf_queue     * g_netio_slow_queue = 0;
 
 int
-as_netio_send_packet(as_file_handle *fd_h, cf_buf_builder *bb_r, uint32_t *offset, bool blocking)
+as_netio_send_packet(as_file_handle *fd_h, cf_buf_builder *bb_r, uint32_t *offset, bool blocking, bool compressed)
 {
 #if defined(USE_SYSTEMTAP)
 	uint64_t nodeid = g_config.self_node;
@@ -985,13 +1146,16 @@ as_netio_send_packet(as_file_handle *fd_h, cf_buf_builder *bb_r, uint32_t *offse
 	uint32_t len  = bb_r->used_sz;
 	uint8_t *buf  = bb_r->buf;
 
-	as_proto proto;
-	proto.version = PROTO_VERSION;
-	proto.type    = PROTO_TYPE_AS_MSG;
-	proto.sz      = len - 8;
-	as_proto_swap(&proto);
+	// Compressed packets come with their own header.
+	if (! compressed) {
+		as_proto proto;
+		proto.version = PROTO_VERSION;
+		proto.type    = PROTO_TYPE_AS_MSG;
+		proto.sz      = len - 8;
+		as_proto_swap(&proto);
 
-    memcpy(bb_r->buf, &proto, 8); 
+		memcpy(bb_r->buf, &proto, 8);
+	}
 
 	uint32_t pos = *offset;
 
@@ -1098,7 +1262,7 @@ as_netio_send(as_netio *io, void *q_to_use, bool blocking)
 	int ret = io->start_cb(io, io->seq);
 
 	if (ret == AS_NETIO_OK) {
-		ret     = io->finish_cb(io, as_netio_send_packet(io->fd_h, io->bb_r, &io->offset, blocking));
+		ret     = io->finish_cb(io, as_netio_send_packet(io->fd_h, io->bb_r, &io->offset, blocking, io->compressed));
 	} 
 	else {
 		ret     = io->finish_cb(io, ret);
@@ -40,13 +40,19 @@
 
 #include "base/cfg.h"
 #include "base/datamodel.h"
+#include "base/dim_slab.h"
+#include "base/expire_index.h"
+#include "base/incr_hist.h"
 #include "base/index.h"
 #include "base/ldt.h"
 #include "base/rec_props.h"
 #include "base/secondary_index.h"
+#include "base/set_index.h"
 #include "base/stats.h"
 #include "base/transaction.h"
+#include "base/truncate.h"
 #include "storage/storage.h"
+#include "transaction/read_coalesce.h"
 
 
 // #define EXTRA_CHECKS
@@ -76,14 +82,17 @@ void as_record_initialize(as_index_ref *r_ref, as_namespace *ns)
 
 	as_index_clear_flags(r, AS_INDEX_ALL_FLAGS);
 
-	if (ns->single_bin) {
-		as_bin *b = as_index_get_single_bin(r);
-		as_bin_state_set(b, AS_BIN_STATE_UNUSED);
-		b->particle = 0;
-
-	}
-	else {
-		r->dim = NULL;
+	// Only data-in-memory uses dim - it isn't even there for data-not-in-memory
+	// SSD namespaces.
+	if (ns->storage_data_in_memory) {
+		if (ns->single_bin) {
+			as_bin *b = as_index_get_single_bin(r);
+			as_bin_state_set(b, AS_BIN_STATE_UNUSED);
+			b->particle = 0;
+		}
+		else {
+			r->dim = NULL;
+		}
 	}
 
 	// clear everything owned by record
@@ -177,6 +186,8 @@ as_record_destroy(as_record *r, as_namespace *ns)
 {
 	cf_detail(AS_RECORD, "destroying record %p", r);
 
+	as_incr_hist_remove(ns, r);
+
 	// cleanup statistic at the ns level
 	if (ns->storage_data_in_memory) {
 		as_storage_rd rd;
@@ -193,12 +204,13 @@ as_record_destroy(as_record *r, as_namespace *ns)
 			as_bin_space *bin_space = as_index_get_bin_space(r);
 
 			if (bin_space) {
-				cf_free((void*)bin_space);
+				as_dim_slab_free_bin_space(ns, bin_space, bin_space->n_bins);
 				as_index_set_bin_space(r, NULL);
 			}
 
 			if (r->dim) {
-				cf_free(r->dim); // frees the key
+				// Frees the key.
+				as_dim_slab_free_rec_space(ns, (as_rec_space*)r->dim);
 			}
 		}
 	}
@@ -289,16 +301,16 @@ as_record_done(as_index_ref *r_ref, as_namespace *ns)
 		cf_arenax_free(ns->arena, r_ref->r_h);
 	}
 
-	cf_atomic64_decr(&g_stats.global_record_ref_count);
+	cf_shard_counter_decr(&g_stats.global_record_ref_count);
 }
 
 // Called only for data-in-memory multi-bin, with no key currently stored.
 // Note - have to modify if/when other metadata joins key in as_rec_space.
 void
-as_record_allocate_key(as_record* r, const uint8_t* key, uint32_t key_size)
+as_record_allocate_key(as_record* r, as_namespace* ns, const uint8_t* key,
+		uint32_t key_size)
 {
-	as_rec_space* rec_space = (as_rec_space*)
-			cf_malloc(sizeof(as_rec_space) + key_size);
+	as_rec_space* rec_space = as_dim_slab_alloc_rec_space(ns, key_size);
 
 	rec_space->bin_space = (as_bin_space*)r->dim;
 	rec_space->key_size = key_size;
@@ -310,11 +322,11 @@ as_record_allocate_key(as_record* r, const uint8_t* key, uint32_t key_size)
 // Called only for data-in-memory multi-bin, with a key currently stored.
 // Note - have to modify if/when other metadata joins key in as_rec_space.
 void
-as_record_remove_key(as_record* r)
+as_record_remove_key(as_record* r, as_namespace* ns)
 {
 	as_bin_space* p_bin_space = ((as_rec_space*)r->dim)->bin_space;
 
-	cf_free(r->dim);
+	as_dim_slab_free_rec_space(ns, (as_rec_space*)r->dim);
 	r->dim = (void*)p_bin_space;
 }
 
@@ -442,6 +454,10 @@ as_record_unpickle_replace(as_record *r, as_storage_rd *rd, uint8_t *buf, size_t
 		sbins_populated += as_sindex_sbins_from_rd(rd, newbins, old_n_bins, &sbins[sbins_populated], AS_SINDEX_OP_DELETE);
 	}
 
+	if (has_sindex) {
+		sbins_populated += as_sindex_sbins_composite_from_bins(ns, set_name, rd->bins, old_n_bins, -1, &sbins[sbins_populated], AS_SINDEX_OP_DELETE);
+	}
+
 #ifdef USE_JEM
 	int orig_arena = -1;
 	if (ns->storage_data_in_memory) {
@@ -521,6 +537,9 @@ as_record_unpickle_replace(as_record *r, as_storage_rd *rd, uint8_t *buf, size_t
 	}
 
 	if (has_sindex) {
+		if (ret == 0) {
+			sbins_populated += as_sindex_sbins_composite_from_bins(ns, set_name, rd->bins, newbins, -1, &sbins[sbins_populated], AS_SINDEX_OP_INSERT);
+		}
 		SINDEX_GUNLOCK();
 	}
 	if (ret == 0) {
@@ -549,8 +568,9 @@ as_record_apply_properties(as_record *r, as_namespace *ns, const as_rec_props *p
 		const char* set_name;
 
 		if (as_rec_props_get_value(p_rec_props, CL_REC_PROPS_FIELD_SET_NAME,
-				NULL, (uint8_t**)&set_name) == 0) {
-			as_index_set_set(r, ns, set_name, false);
+				NULL, (uint8_t**)&set_name) == 0 &&
+				as_index_set_set(r, ns, set_name, false) == 0) {
+			as_set_index_record_set(ns, r);
 		}
 	}
 
@@ -563,7 +583,7 @@ as_record_apply_properties(as_record *r, as_namespace *ns, const as_rec_props *p
 	if (! as_index_is_flag_set(r, AS_INDEX_FLAG_KEY_STORED)) {
 		if (result == 0) {
 			if (ns->storage_data_in_memory) {
-				as_record_allocate_key(r, key, key_size);
+				as_record_allocate_key(r, ns, key, key_size);
 			}
 
 			as_index_set_flags(r, AS_INDEX_FLAG_KEY_STORED);
@@ -572,7 +592,7 @@ as_record_apply_properties(as_record *r, as_namespace *ns, const as_rec_props *p
 	// If a key was stored, but we didn't get one, remove the key.
 	else if (result != 0) {
 		if (ns->storage_data_in_memory) {
-			as_record_remove_key(r);
+			as_record_remove_key(r, ns);
 		}
 
 		as_index_clear_flags(r, AS_INDEX_FLAG_KEY_STORED);
@@ -593,7 +613,7 @@ as_record_clear_properties(as_record *r, as_namespace *ns)
 	// If a key was stored, and we didn't get one, remove the key.
 	if (as_index_is_flag_set(r, AS_INDEX_FLAG_KEY_STORED)) {
 		if (ns->storage_data_in_memory) {
-			as_record_remove_key(r);
+			as_record_remove_key(r, ns);
 		}
 
 		as_index_clear_flags(r, AS_INDEX_FLAG_KEY_STORED);
@@ -659,9 +679,16 @@ as_record_flatten_component(as_partition_reservation *rsv, as_storage_rd *rd,
 		return rv;
     }
 
+	uint32_t old_void_time = r->void_time;
+
 	r->void_time  = c->void_time;
 	r->last_update_time  = c->last_update_time;
 	r->generation = c->generation;
+
+	if (! as_ldt_record_is_sub(r)) {
+		as_expire_index_record_changed(rd->ns, r, old_void_time);
+		as_incr_hist_void_time_changed(rd->ns, r, old_void_time);
+	}
 	// Update the version in the parent. In case it is incoming migration
 	//
 	// Should it be done only in case of migration ?? for LDT currently
@@ -954,6 +981,9 @@ as_record_flatten(as_partition_reservation *rsv, cf_digest *keyd,
 		return(-1);
 	}
 
+	// Reads from now on mustn't share an in-flight read of the old record.
+	as_read_coalesce_record_changed(rsv->ns, keyd);
+
 	// and after here it's GONE
 	as_record_done(&r_ref, rsv->ns);
 
@@ -966,3 +996,10 @@ as_record_is_expired(as_record *r)
 {
 	return r->void_time != 0 && r->void_time < as_record_void_time_get();
 }
+
+// Expired or truncated - either way, treat as not found.
+bool
+as_record_is_doomed(as_record *r, as_namespace *ns)
+{
+	return as_record_is_expired(r) || as_truncate_record_is_truncated(r, ns);
+}
@@ -36,31 +36,42 @@
 #include <string.h>
 #include <unistd.h>
 
+#include "aerospike/as_integer.h"
 #include "aerospike/as_module.h"
 #include "aerospike/as_string.h"
 #include "aerospike/as_val.h"
 #include "citrusleaf/alloc.h"
 #include "citrusleaf/cf_atomic.h"
+#include "citrusleaf/cf_byte_order.h"
 #include "citrusleaf/cf_clock.h"
 #include "citrusleaf/cf_digest.h"
 #include "citrusleaf/cf_ll.h"
+#include "citrusleaf/cf_queue.h"
 #include "citrusleaf/cf_vector.h"
 
 #include "dynbuf.h"
 #include "fault.h"
+#include "olock.h"
 #include "socket.h"
 
+#include "base/admission.h"
 #include "base/aggr.h"
 #include "base/cfg.h"
 #include "base/datamodel.h"
 #include "base/index.h"
 #include "base/job_manager.h"
 #include "base/monitor.h"
+#include "base/packet_compression.h"
+#include "base/predexp.h"
 #include "base/proto.h"
 #include "base/secondary_index.h"
+#include "base/set_index.h"
+#include "base/stats.h"
 #include "base/thr_tsvc.h"
 #include "base/transaction.h"
 #include "base/udf_memtracker.h"
+#include "base/udf_record.h"
+#include "storage/storage.h"
 #include "transaction/udf.h"
 
 
@@ -114,15 +125,56 @@ typedef struct scan_options_s {
 	bool		fail_on_cluster_change;
 	bool		include_ldt_data;
 	uint32_t	sample_pct;
+	bool		count_only;
+	bool		device_sweep;
 } scan_options;
 
 int get_scan_set_id(as_transaction* tr, as_namespace* ns, uint16_t* p_set_id);
 scan_type get_scan_type(as_transaction* tr);
 bool get_scan_options(as_transaction* tr, scan_options* options);
-size_t send_blocking_response_chunk(cf_socket *sock, uint8_t* buf, size_t size);
-size_t send_blocking_response_fin(cf_socket *sock, int result_code);
+bool scan_predexp_build(as_transaction* tr, predexp_eval** p_predexp);
+void scan_reduce_range(as_job* _job, as_partition_reservation* rsv, cf_digest* lo_keyd, cf_digest* hi_keyd, as_index_reduce_fn cb, void* udata);
 static inline bool excluded_set(as_index* r, uint16_t set_id);
 
+//----------------------------------------------------------
+// Response streams.
+//
+
+// Responses not yet taken by the socket, in the order they must go out.
+typedef struct scan_chunk_s {
+	uint32_t	size;
+	uint32_t	offset; // bytes already sent
+	uint8_t		data[];
+} scan_chunk;
+
+// A connection scan's socket and its unsent responses. Kept apart from the
+// job so the sender thread can finish sending after the job is done.
+typedef struct scan_stream_s {
+	pthread_mutex_t	lock;
+	pthread_cond_t	cond; // signaled as the backlog drains
+
+	as_file_handle*	fd_h; // NULL once released
+	cf_queue*		chunks; // scan_chunk* - not started
+	scan_chunk*		cur; // partly sent
+	uint32_t		n_unsent;
+	bool			polled; // if set, only the sender thread sends
+
+	as_job*			job; // NULL once the job has finished
+	bool			paused; // we paused the job
+} scan_stream;
+
+scan_stream* scan_stream_create(as_file_handle* fd_h);
+void scan_stream_destroy(scan_stream* stream);
+bool scan_stream_send(scan_stream* stream, as_comp_stream* comp, const uint8_t* buf, size_t size, size_t* p_packet_sz);
+bool scan_stream_send_fin(scan_stream* stream, int result_code);
+bool scan_stream_push(scan_stream* stream, scan_chunk* chunk);
+bool scan_stream_drain(scan_stream* stream);
+void scan_stream_fail(scan_stream* stream);
+void scan_stream_release_fd(scan_stream* stream, bool force_close);
+void scan_stream_on_event(scan_stream* stream, uint32_t events);
+void* run_scan_sender(void* udata);
+int32_t scan_send(cf_socket* sock, const uint8_t* buf, size_t size, int flags);
+
 
 
 //==============================================================================
@@ -132,6 +184,15 @@ static inline bool excluded_set(as_index* r, uint16_t set_id);
 const size_t INIT_BUF_BUILDER_SIZE = 1024 * 1024 * 2;
 const size_t SCAN_CHUNK_LIMIT = 1024 * 1024;
 
+// Unsent response bytes per connection scan - above PAUSE the job's slices
+// park, below RESUME they go again, and a running slice only waits if its
+// own output gets to WAIT (e.g. a huge unsplit partition).
+const uint32_t SCAN_STREAM_PAUSE_SZ = 4 * 1024 * 1024;
+const uint32_t SCAN_STREAM_RESUME_SZ = 2 * 1024 * 1024;
+const uint32_t SCAN_STREAM_WAIT_SZ = 16 * 1024 * 1024;
+
+#define SCAN_SENDER_POLL_SZ 64
+
 
 
 //==============================================================================
@@ -140,6 +201,9 @@ const size_t SCAN_CHUNK_LIMIT = 1024 * 1024;
 
 static as_job_manager g_scan_manager;
 
+// Sends what the scan threads couldn't, as sockets become writable.
+static cf_poll g_scan_sender_poll;
+
 
 
 //==============================================================================
@@ -150,7 +214,23 @@ void
 as_scan_init()
 {
 	as_job_manager_init(&g_scan_manager, g_config.scan_max_active,
-			g_config.scan_max_done, g_config.scan_threads);
+			g_config.scan_max_done, g_config.scan_threads, AS_SCHED_POOL_SCAN);
+	as_job_manager_limit_records_per_sec(&g_scan_manager,
+			g_config.scan_max_records_per_sec);
+
+	cf_poll_create(&g_scan_sender_poll);
+
+	pthread_t thread;
+	pthread_attr_t attrs;
+
+	pthread_attr_init(&attrs);
+	pthread_attr_setdetachstate(&attrs, PTHREAD_CREATE_DETACHED);
+
+	if (pthread_create(&thread, &attrs, run_scan_sender, NULL) != 0) {
+		cf_crash(AS_SCAN, "failed to create scan sender thread");
+	}
+
+	as_config_sched_thread(AS_SCHED_POOL_SCAN, thread);
 }
 
 int
@@ -163,7 +243,24 @@ as_scan(as_transaction *tr, as_namespace *ns)
 		return result;
 	}
 
-	switch (get_scan_type(tr)) {
+	scan_type type = get_scan_type(tr);
+
+	// Only record-returning scans can be paged.
+	if (type != SCAN_TYPE_BASIC && as_transaction_has_scan_cursor(tr)) {
+		cf_warning(AS_SCAN, "cursor only allowed for basic scans");
+		return AS_PROTO_RESULT_FAIL_PARAMETER;
+	}
+
+	if (type == SCAN_TYPE_UDF_BG) {
+		if (as_admission_shed(ns, AS_ADMIT_UDF_BG)) {
+			return AS_PROTO_RESULT_FAIL_UDF_BG_SHED;
+		}
+	}
+	else if (as_admission_shed(ns, AS_ADMIT_SCAN)) {
+		return AS_PROTO_RESULT_FAIL_SCAN_SHED;
+	}
+
+	switch (type) {
 	case SCAN_TYPE_BASIC:
 		result = basic_scan_job_start(tr, ns, set_id);
 		break;
@@ -194,6 +291,12 @@ as_scan_limit_finished_jobs(uint32_t max_done)
 	as_job_manager_limit_finished_jobs(&g_scan_manager, max_done);
 }
 
+void
+as_scan_limit_records_per_sec(uint32_t max_rps)
+{
+	as_job_manager_limit_records_per_sec(&g_scan_manager, max_rps);
+}
+
 void
 as_scan_resize_thread_pool(uint32_t n_threads)
 {
@@ -306,8 +409,11 @@ get_scan_options(as_transaction* tr, scan_options* options)
 	as_msg_field *f = as_msg_field_get(&tr->msgp->msg,
 			AS_MSG_FIELD_TYPE_SCAN_OPTIONS);
 
-	if (as_msg_field_get_value_sz(f) != 2) {
-		cf_warning(AS_SCAN, "scan msg options field size not 2");
+	uint32_t sz = as_msg_field_get_value_sz(f);
+
+	// Older clients send 2 bytes - a third byte holds newer flags.
+	if (sz != 2 && sz != 3) {
+		cf_warning(AS_SCAN, "scan msg options field size not 2 or 3");
 		return false;
 	}
 
@@ -317,12 +423,105 @@ get_scan_options(as_transaction* tr, scan_options* options)
 	options->include_ldt_data =
 			(AS_MSG_FIELD_SCAN_INCLUDE_LDT_DATA & f->data[0]) != 0;
 	options->sample_pct = f->data[1];
+	options->count_only = (AS_MSG_FIELD_SCAN_COUNT_ONLY & f->data[0]) != 0;
+	options->device_sweep = sz == 3 &&
+			(AS_MSG_FIELD_SCAN_DEVICE_SWEEP & f->data[2]) != 0;
+
+	return true;
+}
+
+// Set scans visit just the set's records if the set is indexed, otherwise
+// every record in the slice.
+void
+scan_reduce_range(as_job* _job, as_partition_reservation* rsv,
+		cf_digest* lo_keyd, cf_digest* hi_keyd, as_index_reduce_fn cb,
+		void* udata)
+{
+	if (_job->set_id == INVALID_SET_ID ||
+			! as_set_index_reduce(_job->ns, rsv->p, rsv->p->vp, _job->set_id,
+					lo_keyd, hi_keyd, cb, udata)) {
+		as_index_reduce_range(rsv->p->vp, lo_keyd, hi_keyd, cb, udata);
+	}
+}
+
+// Leaves *p_predexp null if there's no predicate. Returns false if there's a
+// malformed one.
+bool
+scan_predexp_build(as_transaction* tr, predexp_eval** p_predexp)
+{
+	if (! as_transaction_has_predexp(tr)) {
+		return true;
+	}
+
+	as_msg_field *f = as_msg_field_get(&tr->msgp->msg,
+			AS_MSG_FIELD_TYPE_PREDEXP);
+
+	if (! (*p_predexp = predexp_build(f))) {
+		cf_warning(AS_SCAN, "scan msg has malformed predexp field");
+		return false;
+	}
 
 	return true;
 }
 
-size_t
-send_blocking_response_chunk(cf_socket *sock, uint8_t* buf, size_t size)
+static inline bool
+excluded_set(as_index* r, uint16_t set_id)
+{
+	return set_id != INVALID_SET_ID && set_id != as_index_get_set_id(r);
+}
+
+
+
+//==============================================================================
+// scan_stream implementation.
+//
+
+scan_stream*
+scan_stream_create(as_file_handle* fd_h)
+{
+	scan_stream* stream = cf_malloc(sizeof(scan_stream));
+
+	cf_assert(stream, AS_SCAN, CF_CRITICAL, "failed scan stream malloc");
+
+	pthread_mutex_init(&stream->lock, NULL);
+	pthread_cond_init(&stream->cond, NULL);
+
+	stream->fd_h = fd_h;
+	stream->chunks = cf_queue_create(sizeof(scan_chunk*), false);
+	stream->cur = NULL;
+	stream->n_unsent = 0;
+	stream->polled = false;
+	stream->job = NULL;
+	stream->paused = false;
+
+	return stream;
+}
+
+void
+scan_stream_destroy(scan_stream* stream)
+{
+	scan_chunk* chunk;
+
+	while (cf_queue_pop(stream->chunks, &chunk, CF_QUEUE_NOWAIT) ==
+			CF_QUEUE_OK) {
+		cf_free(chunk);
+	}
+
+	if (stream->cur) {
+		cf_free(stream->cur);
+	}
+
+	cf_queue_destroy(stream->chunks);
+	pthread_cond_destroy(&stream->cond);
+	pthread_mutex_destroy(&stream->lock);
+	cf_free(stream);
+}
+
+// Call with lock held, and fd_h set. Sends what the socket will take now -
+// straight from buf if nothing is ahead of it - and queues the rest.
+bool
+scan_stream_send(scan_stream* stream, as_comp_stream* comp, const uint8_t* buf,
+		size_t size, size_t* p_packet_sz)
 {
 	as_proto proto;
 
@@ -331,62 +530,274 @@ send_blocking_response_chunk(cf_socket *sock, uint8_t* buf, size_t size)
 	proto.sz = size;
 	as_proto_swap(&proto);
 
-	int rv = cf_socket_send(sock, (uint8_t*)&proto, sizeof(as_proto),
-			MSG_NOSIGNAL | MSG_MORE);
+	size_t total_sz = sizeof(as_proto) + size;
+	scan_chunk* chunk;
+
+	if (as_comp_stream_wants(comp, total_sz)) {
+		chunk = cf_malloc(sizeof(scan_chunk) +
+				as_comp_stream_bound(comp, total_sz));
+
+		cf_assert(chunk, AS_SCAN, CF_CRITICAL, "failed scan chunk malloc");
+
+		size_t packet_sz = as_comp_stream_packet(comp, (uint8_t*)&proto,
+				sizeof(as_proto), buf, size, chunk->data);
 
-	if (rv != sizeof(as_proto)) {
-		cf_warning(AS_SCAN, "send error - fd %d rv %d %s", CSFD(sock), rv,
-				rv < 0 ? cf_strerror(errno) : "");
-		return 0;
+		if (packet_sz != 0) {
+			chunk->size = packet_sz;
+			chunk->offset = 0;
+			*p_packet_sz = packet_sz;
+
+			return scan_stream_push(stream, chunk);
+		}
+
+		// On failure the chunk simply goes plain.
+		cf_free(chunk);
 	}
 
-	if ((rv = cf_socket_send(sock, buf, size, MSG_NOSIGNAL)) != size) {
-		cf_warning(AS_SCAN, "send error - fd %d sz %lu rv %d %s", CSFD(sock),
-				size, rv, rv < 0 ? cf_strerror(errno) : "");
-		return 0;
+	size_t sent_sz = 0;
+
+	*p_packet_sz = total_sz;
+
+	if (! stream->polled) {
+		cf_socket* sock = stream->fd_h->sock;
+		int32_t rv = scan_send(sock, (uint8_t*)&proto, sizeof(as_proto),
+				MSG_MORE);
+
+		if (rv < 0) {
+			return false;
+		}
+
+		sent_sz = rv;
+
+		if (sent_sz == sizeof(as_proto)) {
+			if ((rv = scan_send(sock, buf, size, 0)) < 0) {
+				return false;
+			}
+
+			sent_sz += rv;
+		}
+
+		if (sent_sz == total_sz) {
+			return true;
+		}
 	}
 
-	return sizeof(as_proto) + size;
+	chunk = cf_malloc(sizeof(scan_chunk) + total_sz - sent_sz);
+
+	cf_assert(chunk, AS_SCAN, CF_CRITICAL, "failed scan chunk malloc");
+
+	chunk->size = total_sz - sent_sz;
+	chunk->offset = 0;
+
+	size_t proto_left = sent_sz < sizeof(as_proto) ?
+			sizeof(as_proto) - sent_sz : 0;
+	size_t buf_offset = sent_sz - (sizeof(as_proto) - proto_left);
+
+	memcpy(chunk->data, (uint8_t*)&proto + sizeof(as_proto) - proto_left,
+			proto_left);
+	memcpy(chunk->data + proto_left, buf + buf_offset, size - buf_offset);
+
+	return scan_stream_push(stream, chunk);
 }
 
-size_t
-send_blocking_response_fin(cf_socket *sock, int result_code)
+// Call with lock held, and fd_h set.
+bool
+scan_stream_send_fin(scan_stream* stream, int result_code)
 {
-	cl_msg m;
+	scan_chunk* chunk = cf_malloc(sizeof(scan_chunk) + sizeof(cl_msg));
+
+	cf_assert(chunk, AS_SCAN, CF_CRITICAL, "failed scan chunk malloc");
+
+	chunk->size = sizeof(cl_msg);
+	chunk->offset = 0;
+
+	cl_msg* m = (cl_msg*)chunk->data;
+
+	m->proto.version = PROTO_VERSION;
+	m->proto.type = PROTO_TYPE_AS_MSG;
+	m->proto.sz = sizeof(as_msg);
+	as_proto_swap(&m->proto);
+
+	m->msg.header_sz = sizeof(as_msg);
+	m->msg.info1 = 0;
+	m->msg.info2 = 0;
+	m->msg.info3 = AS_MSG_INFO3_LAST;
+	m->msg.unused = 0;
+	m->msg.result_code = result_code;
+	m->msg.generation = 0;
+	m->msg.record_ttl = 0;
+	m->msg.transaction_ttl = 0;
+	m->msg.n_fields = 0;
+	m->msg.n_ops = 0;
+	as_msg_swap_header(&m->msg);
+
+	return scan_stream_push(stream, chunk);
+}
 
-	m.proto.version = PROTO_VERSION;
-	m.proto.type = PROTO_TYPE_AS_MSG;
-	m.proto.sz = sizeof(as_msg);
-	as_proto_swap(&m.proto);
+// Call with lock held, and fd_h set. Consumes chunk.
+bool
+scan_stream_push(scan_stream* stream, scan_chunk* chunk)
+{
+	cf_queue_push(stream->chunks, &chunk);
+	stream->n_unsent += chunk->size;
 
-	m.msg.header_sz = sizeof(as_msg);
-	m.msg.info1 = 0;
-	m.msg.info2 = 0;
-	m.msg.info3 = AS_MSG_INFO3_LAST;
-	m.msg.unused = 0;
-	m.msg.result_code = result_code;
-	m.msg.generation = 0;
-	m.msg.record_ttl = 0;
-	m.msg.transaction_ttl = 0;
-	m.msg.n_fields = 0;
-	m.msg.n_ops = 0;
-	as_msg_swap_header(&m.msg);
+	if (stream->polled) {
+		return true; // the sender thread will get to it
+	}
 
-	int rv = cf_socket_send(sock, (uint8_t*)&m, sizeof(cl_msg), MSG_NOSIGNAL);
+	if (! scan_stream_drain(stream)) {
+		return false;
+	}
 
-	if (rv != sizeof(cl_msg)) {
-		cf_warning(AS_SCAN, "send error - fd %d rv %d %s", CSFD(sock), rv,
-				rv < 0 ? cf_strerror(errno) : "");
-		return 0;
+	if (stream->n_unsent != 0) {
+		cf_poll_add_socket(g_scan_sender_poll, stream->fd_h->sock,
+				EPOLLOUT | EPOLLERR | EPOLLHUP, stream);
+		stream->polled = true;
 	}
 
-	return sizeof(cl_msg);
+	return true;
 }
 
-static inline bool
-excluded_set(as_index* r, uint16_t set_id)
+// Call with lock held, and fd_h set. Returns false only on socket error.
+bool
+scan_stream_drain(scan_stream* stream)
 {
-	return set_id != INVALID_SET_ID && set_id != as_index_get_set_id(r);
+	while (true) {
+		if (! stream->cur && cf_queue_pop(stream->chunks, &stream->cur,
+				CF_QUEUE_NOWAIT) != CF_QUEUE_OK) {
+			return true;
+		}
+
+		scan_chunk* chunk = stream->cur;
+		int32_t rv = scan_send(stream->fd_h->sock, chunk->data + chunk->offset,
+				chunk->size - chunk->offset, 0);
+
+		if (rv < 0) {
+			return false;
+		}
+
+		chunk->offset += rv;
+		stream->n_unsent -= rv;
+
+		if (chunk->offset < chunk->size) {
+			return true; // socket is full
+		}
+
+		cf_free(chunk);
+		stream->cur = NULL;
+	}
+}
+
+// Call with lock held, and fd_h set. Drops the backlog and closes the socket -
+// the job (if any) finds out on its next send.
+void
+scan_stream_fail(scan_stream* stream)
+{
+	if (stream->polled) {
+		cf_poll_delete_socket(g_scan_sender_poll, stream->fd_h->sock);
+		stream->polled = false;
+	}
+
+	scan_stream_release_fd(stream, true);
+
+	scan_chunk* chunk;
+
+	while (cf_queue_pop(stream->chunks, &chunk, CF_QUEUE_NOWAIT) ==
+			CF_QUEUE_OK) {
+		cf_free(chunk);
+	}
+
+	if (stream->cur) {
+		cf_free(stream->cur);
+		stream->cur = NULL;
+	}
+
+	stream->n_unsent = 0;
+	pthread_cond_broadcast(&stream->cond);
+}
+
+void
+scan_stream_release_fd(scan_stream* stream, bool force_close)
+{
+	stream->fd_h->fh_info &= ~FH_INFO_DONOT_REAP;
+	stream->fd_h->last_used = cf_getms();
+	as_end_of_transaction(stream->fd_h, force_close);
+	stream->fd_h = NULL;
+}
+
+void
+scan_stream_on_event(scan_stream* stream, uint32_t events)
+{
+	pthread_mutex_lock(&stream->lock);
+
+	if ((events & (EPOLLERR | EPOLLHUP)) != 0 || ! scan_stream_drain(stream)) {
+		scan_stream_fail(stream);
+	}
+	else if (stream->n_unsent == 0) {
+		cf_poll_delete_socket(g_scan_sender_poll, stream->fd_h->sock);
+		stream->polled = false;
+
+		if (! stream->job) {
+			scan_stream_release_fd(stream, false); // the fin's gone
+		}
+	}
+
+	if (stream->n_unsent < SCAN_STREAM_WAIT_SZ) {
+		pthread_cond_broadcast(&stream->cond);
+	}
+
+	// Resuming a failed stream's job lets its next slice see the failure.
+	if (stream->paused && stream->n_unsent < SCAN_STREAM_RESUME_SZ) {
+		stream->paused = false;
+
+		if (stream->job) {
+			as_job_resume(stream->job);
+		}
+	}
+
+	bool done = ! stream->job && ! stream->fd_h;
+
+	pthread_mutex_unlock(&stream->lock);
+
+	if (done) {
+		scan_stream_destroy(stream);
+	}
+}
+
+void*
+run_scan_sender(void* udata)
+{
+	while (true) {
+		cf_poll_event events[SCAN_SENDER_POLL_SZ];
+		int32_t n_events = cf_poll_wait(g_scan_sender_poll, events,
+				SCAN_SENDER_POLL_SZ, -1);
+
+		for (int32_t i = 0; i < n_events; i++) {
+			scan_stream_on_event((scan_stream*)events[i].data,
+					events[i].events);
+		}
+	}
+
+	return NULL;
+}
+
+// Never blocks - returns bytes sent, 0 if the socket is full, or -1 on error.
+int32_t
+scan_send(cf_socket* sock, const uint8_t* buf, size_t size, int flags)
+{
+	int32_t rv = cf_socket_send(sock, (void*)buf, size,
+			MSG_NOSIGNAL | MSG_DONTWAIT | flags);
+
+	if (rv < 0) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			return 0;
+		}
+
+		cf_warning(AS_SCAN, "send error - fd %d sz %lu %s", CSFD(sock), size,
+				cf_strerror(errno));
+	}
+
+	return rv;
 }
 
 
@@ -404,17 +815,16 @@ typedef struct conn_scan_job_s {
 	as_job			_base;
 
 	// Derived class data:
-	pthread_mutex_t	fd_lock;
-	as_file_handle*	fd_h;
+	scan_stream*	stream;
+	as_comp_stream*	comp; // NULL unless client asked for compressed responses
 
 	uint64_t		net_io_bytes;
 } conn_scan_job;
 
-void conn_scan_job_own_fd(conn_scan_job* job, as_file_handle* fd_h);
+void conn_scan_job_own_fd(conn_scan_job* job, as_file_handle* fd_h, uint8_t comp_type);
 void conn_scan_job_disown_fd(conn_scan_job* job);
 void conn_scan_job_finish(conn_scan_job* job);
 bool conn_scan_job_send_response(conn_scan_job* job, uint8_t* buf, size_t size);
-void conn_scan_job_release_fd(conn_scan_job* job, bool force_close);
 void conn_scan_job_info(conn_scan_job* job, as_mon_jobstat* stat);
 
 //----------------------------------------------------------
@@ -422,13 +832,16 @@ void conn_scan_job_info(conn_scan_job* job, as_mon_jobstat* stat);
 //
 
 void
-conn_scan_job_own_fd(conn_scan_job* job, as_file_handle* fd_h)
+conn_scan_job_own_fd(conn_scan_job* job, as_file_handle* fd_h,
+		uint8_t comp_type)
 {
-	pthread_mutex_init(&job->fd_lock, NULL);
+	// The socket stays non-blocking - slow clients are left to the sender.
+	fd_h->fh_info |= FH_INFO_DONOT_REAP;
+
+	job->stream = scan_stream_create(fd_h);
+	job->stream->job = (as_job*)job;
 
-	job->fd_h = fd_h;
-	job->fd_h->fh_info |= FH_INFO_DONOT_REAP;
-	cf_socket_enable_blocking(job->fd_h->sock);
+	job->comp = as_comp_stream_create(comp_type);
 
 	job->net_io_bytes = 0;
 }
@@ -438,65 +851,93 @@ conn_scan_job_disown_fd(conn_scan_job* job)
 {
 	// Just undo conn_scan_job_own_fd(), nothing more.
 
-	cf_socket_disable_blocking(job->fd_h->sock);
-	job->fd_h->fh_info &= ~FH_INFO_DONOT_REAP;
+	job->stream->fd_h->fh_info &= ~FH_INFO_DONOT_REAP;
+	scan_stream_destroy(job->stream);
 
-	pthread_mutex_destroy(&job->fd_lock);
+	if (job->comp) {
+		as_comp_stream_destroy(job->comp);
+	}
 }
 
 void
 conn_scan_job_finish(conn_scan_job* job)
 {
 	as_job* _job = (as_job*)job;
+	scan_stream* stream = job->stream;
+
+	pthread_mutex_lock(&stream->lock);
+
+	stream->job = NULL;
+
+	if (stream->fd_h) {
+		if (! scan_stream_send_fin(stream, _job->abandoned)) {
+			scan_stream_fail(stream);
+		}
+		else {
+			job->net_io_bytes += sizeof(cl_msg);
+
+			if (! stream->polled) {
+				scan_stream_release_fd(stream, false);
+			}
+			// else - the sender thread releases it once the fin's gone.
+		}
+	}
 
-	if (job->fd_h) {
-		size_t size_sent = send_blocking_response_fin(job->fd_h->sock,
-				_job->abandoned);
+	bool done = ! stream->fd_h;
 
-		job->net_io_bytes += size_sent;
-		conn_scan_job_release_fd(job, size_sent == 0);
+	pthread_mutex_unlock(&stream->lock);
+
+	if (done) {
+		scan_stream_destroy(stream);
 	}
 
-	pthread_mutex_destroy(&job->fd_lock);
+	if (job->comp) {
+		as_comp_stream_destroy(job->comp);
+	}
 }
 
 bool
 conn_scan_job_send_response(conn_scan_job* job, uint8_t* buf, size_t size)
 {
 	as_job* _job = (as_job*)job;
+	scan_stream* stream = job->stream;
 
-	pthread_mutex_lock(&job->fd_lock);
+	size_t packet_sz = 0;
 
-	if (! job->fd_h) {
-		pthread_mutex_unlock(&job->fd_lock);
-		// Job already abandoned.
-		return false;
+	pthread_mutex_lock(&stream->lock);
+
+	if (stream->fd_h &&
+			! scan_stream_send(stream, job->comp, buf, size, &packet_sz)) {
+		scan_stream_fail(stream);
 	}
 
-	size_t size_sent = send_blocking_response_chunk(job->fd_h->sock, buf, size);
+	if (! stream->fd_h) {
+		pthread_mutex_unlock(&stream->lock);
+
+		// Send failed - here, an earlier slice, or the sender thread.
+		if (_job->abandoned == 0) {
+			as_job_manager_abandon_job(_job->mgr, _job,
+					AS_PROTO_RESULT_FAIL_UNKNOWN);
+		}
 
-	if (size_sent == 0) {
-		conn_scan_job_release_fd(job, true);
-		pthread_mutex_unlock(&job->fd_lock);
-		as_job_manager_abandon_job(_job->mgr, _job,
-				AS_PROTO_RESULT_FAIL_UNKNOWN);
 		return false;
 	}
 
-	job->net_io_bytes += size_sent;
+	job->net_io_bytes += packet_sz;
 
-	pthread_mutex_unlock(&job->fd_lock);
-	return true;
-}
+	if (stream->n_unsent >= SCAN_STREAM_PAUSE_SZ && ! stream->paused) {
+		stream->paused = true;
+		as_job_pause(_job);
+	}
 
-void
-conn_scan_job_release_fd(conn_scan_job* job, bool force_close)
-{
-	cf_socket_disable_blocking(job->fd_h->sock);
-	job->fd_h->fh_info &= ~FH_INFO_DONOT_REAP;
-	job->fd_h->last_used = cf_getms();
-	as_end_of_transaction(job->fd_h, force_close);
-	job->fd_h = NULL;
+	// Don't let one slice's output grow without bound.
+	while (stream->fd_h && stream->n_unsent >= SCAN_STREAM_WAIT_SZ &&
+			_job->abandoned == 0) {
+		pthread_cond_wait(&stream->cond, &stream->lock);
+	}
+
+	pthread_mutex_unlock(&stream->lock);
+	return true;
 }
 
 void
@@ -524,11 +965,16 @@ typedef struct basic_scan_job_s {
 	bool			fail_on_cluster_change;
 	bool			include_ldt_data;
 	bool			no_bin_data;
+	bool			count_only;
+	bool			device_sweep;
 	uint32_t		sample_pct;
+	cf_atomic64		n_counted;
+	predexp_eval*	predexp;
 	cf_vector*		bin_names;
+	struct scan_cursor_s* cursor;
 } basic_scan_job;
 
-void basic_scan_job_slice(as_job* _job, as_partition_reservation* rsv);
+void basic_scan_job_slice(as_job* _job, as_partition_reservation* rsv, cf_digest* lo_keyd, cf_digest* hi_keyd);
 void basic_scan_job_finish(as_job* _job);
 void basic_scan_job_destroy(as_job* _job);
 void basic_scan_job_info(as_job* _job, as_mon_jobstat* stat);
@@ -540,245 +986,893 @@ const as_job_vtable basic_scan_job_vtable = {
 		basic_scan_job_info
 };
 
+// For data-not-in-memory, records are collected in batches so their device
+// reads can be issued in storage order.
+#define SCAN_READ_BATCH_SIZE 64
+
+// Cursor scans claim their share of the page in chunks of this many records.
+#define SCAN_CURSOR_CHUNK 1024
+
+// The SCAN_CURSOR field is the page size (uint32, 0 for no limit) followed by
+// an entry per partition to scan, all big endian. Each partition's records are
+// in index reduce order - resuming just past keyd if flagged. Every partition
+// scanned gets a cursor response: the last digest reached if the page filled
+// first, or no digest if the partition is done. Partitions with no cursor
+// response (e.g. not owned here) should be retried as they were.
+typedef struct scan_cursor_entry_s {
+	uint16_t	pid;
+	uint8_t		flags;
+	cf_digest	keyd;
+} __attribute__((__packed__)) scan_cursor_entry;
+
+#define SCAN_CURSOR_RESUME 0x01
+
+typedef struct scan_cursor_s {
+	uint32_t	max_records;
+	cf_atomic64	n_unclaimed;
+	bool		resume[AS_PARTITIONS];
+	cf_digest	keyds[AS_PARTITIONS];
+} scan_cursor;
+
 typedef struct basic_scan_slice_s {
 	basic_scan_job*		job;
 	cf_buf_builder**	bb_r;
+	bool				has_last_keyd;
+	cf_digest			last_keyd;
+	uint32_t			n_returned;
+	uint64_t			n_counted;
+	bool				batch_reads;
+	uint32_t			n_batched;
+	as_storage_rd		batch_rds[SCAN_READ_BATCH_SIZE];
+	cf_arenax_handle	batch_r_hs[SCAN_READ_BATCH_SIZE];
+	uint16_t			batch_generations[SCAN_READ_BATCH_SIZE];
 } basic_scan_slice;
 
+void basic_scan_job_sweep(as_job* _job, uint32_t sweep_slice);
+bool basic_scan_job_sweep_cb(as_index_ref* r_ref, as_storage_rd* rd, void* udata);
 void basic_scan_job_reduce_cb(as_index_ref* r_ref, void* udata);
+bool basic_scan_predexp_matches_record(basic_scan_job* job, as_index* r);
+void basic_scan_job_send_count(basic_scan_job* job);
+void basic_scan_slice_add_record(basic_scan_slice* slice, as_index_ref* r_ref, as_storage_rd* rd);
+void basic_scan_slice_batch_add(basic_scan_slice* slice, as_index_ref* r_ref);
+void basic_scan_slice_batch_flush(basic_scan_slice* slice);
+void basic_scan_slice_cursor_reduce(basic_scan_slice* slice, as_partition_reservation* rsv);
+void basic_scan_slice_add_cursor(basic_scan_slice* slice, as_partition_id pid, bool done);
+uint32_t scan_cursor_claim(scan_cursor* cursor);
+scan_cursor* scan_cursor_from_msg(as_transaction* tr, bool** p_pids);
 cf_vector* bin_names_from_op(as_msg* m, int* result);
 
 //----------------------------------------------------------
 // basic_scan_job public API.
 //
 
-int
-basic_scan_job_start(as_transaction* tr, as_namespace* ns, uint16_t set_id)
+int
+basic_scan_job_start(as_transaction* tr, as_namespace* ns, uint16_t set_id)
+{
+	basic_scan_job* job = cf_malloc(sizeof(basic_scan_job));
+	as_job* _job = (as_job*)job;
+
+	if (! job) {
+		cf_warning(AS_SCAN, "basic scan job failed alloc");
+		return AS_PROTO_RESULT_FAIL_UNKNOWN;
+	}
+
+	scan_options options = { 0, false, false, 100, false, false };
+
+	if (! get_scan_options(tr, &options)) {
+		cf_free(job);
+		return AS_PROTO_RESULT_FAIL_PARAMETER;
+	}
+
+	as_job_init(_job, &basic_scan_job_vtable, &g_scan_manager, RSV_WRITE,
+			as_transaction_trid(tr), ns, set_id, options.priority);
+
+	// Sampling counts per partition, so sampled scans don't split partitions.
+	_job->split_pids = options.sample_pct == 100;
+	_job->max_threads = g_config.scan_max_threads_per_job;
+	_job->max_rps = g_config.scan_max_records_per_sec_per_job;
+
+	int result;
+
+	job->cluster_key = as_paxos_get_cluster_key();
+	job->fail_on_cluster_change = options.fail_on_cluster_change;
+	job->include_ldt_data = options.include_ldt_data;
+	job->no_bin_data = (tr->msgp->msg.info1 & AS_MSG_INFO1_GET_NOBINDATA) != 0;
+	job->count_only = options.count_only;
+	job->device_sweep = false;
+	job->sample_pct = options.sample_pct;
+	job->n_counted = 0;
+	job->predexp = NULL;
+	job->cursor = NULL;
+	job->bin_names = bin_names_from_op(&tr->msgp->msg, &result);
+
+	if (! job->bin_names && result != AS_PROTO_RESULT_OK) {
+		as_job_destroy(_job);
+		return result;
+	}
+
+	if (! scan_predexp_build(tr, &job->predexp)) {
+		as_job_destroy(_job);
+		return AS_PROTO_RESULT_FAIL_PARAMETER;
+	}
+
+	if (as_transaction_has_scan_cursor(tr)) {
+		// A cursor is a position in each partition, so a cursor scan can't
+		// sample, and mustn't split partitions. Pages are of records sent, so
+		// there's no paging a count.
+		if (job->sample_pct != 100 || job->count_only ||
+				! (job->cursor = scan_cursor_from_msg(tr, &_job->pids))) {
+			cf_warning(AS_SCAN, "basic scan job bad cursor");
+			as_job_destroy(_job);
+			return AS_PROTO_RESULT_FAIL_PARAMETER;
+		}
+
+		_job->split_pids = false;
+	}
+
+	// A device sweep only pays off when every record's bins are read from
+	// device - otherwise, quietly scan in index order.
+	if (options.device_sweep && ! job->cursor && job->sample_pct == 100 &&
+			! job->no_bin_data && ! job->count_only &&
+			ns->storage_type == AS_STORAGE_ENGINE_SSD &&
+			! ns->storage_data_in_memory) {
+		uint32_t n_devices;
+
+		if ((_job->n_sweep_slices = as_storage_sweep_n_slices(ns,
+				&n_devices)) != 0) {
+			job->device_sweep = true;
+			_job->sweep_fn = basic_scan_job_sweep;
+
+			// One slice per device at a time, so each device reads in order.
+			if (_job->max_threads == 0 || _job->max_threads > n_devices) {
+				_job->max_threads = n_devices;
+			}
+		}
+	}
+
+	if (job->fail_on_cluster_change &&
+			(cf_atomic_int_get(ns->migrate_tx_partitions_remaining) != 0 ||
+			 cf_atomic_int_get(ns->migrate_rx_partitions_remaining) != 0)) {
+		// TODO - was AS_PROTO_RESULT_FAIL_UNAVAILABLE - ok?
+		cf_warning(AS_SCAN, "basic scan job not started - migration");
+		as_job_destroy(_job);
+		return AS_PROTO_RESULT_FAIL_CLUSTER_KEY_MISMATCH;
+	}
+
+	// Take ownership of socket from transaction.
+	conn_scan_job_own_fd((conn_scan_job*)job, tr->from.proto_fd_h,
+			as_transaction_response_compression(tr));
+
+	cf_info(AS_SCAN, "starting basic scan job %lu {%s:%s} priority %u, sample-pct %u%s%s%s%s%s%s%s",
+			_job->trid, ns->name, as_namespace_get_set_name(ns, set_id),
+			_job->priority, job->sample_pct,
+			job->count_only ? ", count-only" : "",
+			job->no_bin_data ? ", metadata-only" : "",
+			job->predexp ? ", predexp" : "",
+			job->cursor ? ", cursor" : "",
+			job->device_sweep ? ", device-sweep" : "",
+			job->fail_on_cluster_change ? ", fail-on-cluster-change" : "",
+			job->include_ldt_data ? ", include-ldt-data" : "");
+
+	if ((result = as_job_manager_start_job(_job->mgr, _job)) != 0) {
+		cf_warning(AS_SCAN, "basic scan job %lu failed to start (%d)",
+				_job->trid, result);
+		conn_scan_job_disown_fd((conn_scan_job*)job);
+		as_job_destroy(_job);
+		return result;
+	}
+
+	// Normal scans don't need anything in the message beyond here.
+	cf_free(tr->msgp);
+
+	return AS_PROTO_RESULT_OK;
+}
+
+//----------------------------------------------------------
+// basic_scan_job mandatory scan_job interface.
+//
+
+void
+basic_scan_job_slice(as_job* _job, as_partition_reservation* rsv,
+		cf_digest* lo_keyd, cf_digest* hi_keyd)
+{
+	basic_scan_job* job = (basic_scan_job*)_job;
+	as_index_tree* tree = rsv->p->vp;
+	cf_buf_builder* bb = cf_buf_builder_create_size(INIT_BUF_BUILDER_SIZE);
+
+	if (! bb) {
+		as_job_manager_abandon_job(_job->mgr, _job,
+				AS_PROTO_RESULT_FAIL_UNKNOWN);
+		return;
+	}
+
+	uint64_t slice_start = cf_getms();
+	basic_scan_slice slice;
+
+	slice.job = job;
+	slice.bb_r = &bb;
+	slice.has_last_keyd = false;
+	slice.n_returned = 0;
+	slice.n_counted = 0;
+	slice.batch_reads = ! job->no_bin_data && ! job->count_only &&
+			rsv->ns->storage_type == AS_STORAGE_ENGINE_SSD &&
+			! rsv->ns->storage_data_in_memory;
+	slice.n_batched = 0;
+
+	if (job->cursor) {
+		basic_scan_slice_cursor_reduce(&slice, rsv);
+	}
+	else if (job->sample_pct == 100) {
+		scan_reduce_range(_job, rsv, lo_keyd, hi_keyd, basic_scan_job_reduce_cb,
+				(void*)&slice);
+	}
+	else {
+		uint32_t sample_count = (uint32_t)
+				(((uint64_t)as_index_tree_size(tree) * (uint64_t)job->sample_pct) / 100);
+
+		as_index_reduce_partial(tree, sample_count, basic_scan_job_reduce_cb,
+				(void*)&slice);
+	}
+
+	basic_scan_slice_batch_flush(&slice);
+
+	if (slice.n_counted != 0) {
+		cf_atomic64_add(&job->n_counted, (int64_t)slice.n_counted);
+		cf_atomic64_add(&_job->n_records_read, (int64_t)slice.n_counted);
+	}
+
+	if (bb->used_sz != 0) {
+		conn_scan_job_send_response((conn_scan_job*)job, bb->buf, bb->used_sz);
+	}
+
+	// TODO - guts don't check buf_builder realloc failures rigorously.
+	cf_buf_builder_free(bb);
+
+	cf_detail(AS_SCAN, "%s:%u basic scan job %lu in thread %lu took %lu ms",
+			rsv->ns->name, rsv->p->partition_id, _job->trid, pthread_self(),
+			cf_getms() - slice_start);
+}
+
+void
+basic_scan_job_finish(as_job* _job)
+{
+	basic_scan_job* job = (basic_scan_job*)_job;
+
+	if (job->count_only && _job->abandoned == 0) {
+		basic_scan_job_send_count(job);
+	}
+
+	conn_scan_job_finish((conn_scan_job*)_job);
+
+	switch (_job->abandoned) {
+	case 0:
+		cf_atomic_int_incr(&_job->ns->n_scan_basic_complete);
+		break;
+	case AS_JOB_FAIL_USER_ABORT:
+		cf_atomic_int_incr(&_job->ns->n_scan_basic_abort);
+		break;
+	case AS_JOB_FAIL_UNKNOWN:
+	case AS_JOB_FAIL_CLUSTER_KEY:
+	default:
+		cf_atomic_int_incr(&_job->ns->n_scan_basic_error);
+		break;
+	}
+
+	cf_info(AS_SCAN, "finished basic scan job %lu (%d)", _job->trid,
+			_job->abandoned);
+}
+
+void
+basic_scan_job_destroy(as_job* _job)
+{
+	basic_scan_job* job = (basic_scan_job*)_job;
+
+	if (job->bin_names) {
+		cf_vector_destroy(job->bin_names);
+	}
+
+	if (job->predexp) {
+		predexp_destroy(job->predexp);
+	}
+
+	if (job->cursor) {
+		cf_free(job->cursor);
+	}
+}
+
+void
+basic_scan_job_info(as_job* _job, as_mon_jobstat* stat)
+{
+	strcpy(stat->job_type, scan_type_str(SCAN_TYPE_BASIC));
+	conn_scan_job_info((conn_scan_job*)_job, stat);
+}
+
+//----------------------------------------------------------
+// basic_scan_job utilities.
+//
+
+// One slice of a device sweep - holds every partition this node can scan for
+// the slice, since any of them may have records in the device range.
+void
+basic_scan_job_sweep(as_job* _job, uint32_t sweep_slice)
+{
+	basic_scan_job* job = (basic_scan_job*)_job;
+	as_namespace* ns = _job->ns;
+	as_partition_reservation* rsvs =
+			cf_malloc(sizeof(as_partition_reservation) * AS_PARTITIONS);
+	struct as_index_tree_s** trees =
+			cf_malloc(sizeof(struct as_index_tree_s*) * AS_PARTITIONS);
+	cf_buf_builder* bb = cf_buf_builder_create_size(INIT_BUF_BUILDER_SIZE);
+
+	if (! rsvs || ! trees || ! bb) {
+		if (rsvs) {
+			cf_free(rsvs);
+		}
+
+		if (trees) {
+			cf_free(trees);
+		}
+
+		if (bb) {
+			cf_buf_builder_free(bb);
+		}
+
+		as_job_manager_abandon_job(_job->mgr, _job,
+				AS_PROTO_RESULT_FAIL_UNKNOWN);
+		return;
+	}
+
+	for (uint32_t pid = 0; pid < AS_PARTITIONS; pid++) {
+		trees[pid] = as_partition_reserve_write(ns, pid, &rsvs[pid], NULL,
+				NULL) == 0 ? rsvs[pid].tree : NULL;
+	}
+
+	uint64_t slice_start = cf_getms();
+	basic_scan_slice slice;
+
+	slice.job = job;
+	slice.bb_r = &bb;
+	slice.has_last_keyd = false;
+	slice.n_returned = 0;
+	slice.n_counted = 0;
+	slice.batch_reads = false;
+	slice.n_batched = 0;
+
+	as_storage_sweep_slice(ns, sweep_slice, trees, basic_scan_job_sweep_cb,
+			(void*)&slice);
+
+	for (uint32_t pid = 0; pid < AS_PARTITIONS; pid++) {
+		if (trees[pid]) {
+			as_partition_release(&rsvs[pid]);
+		}
+	}
+
+	cf_free(trees);
+	cf_free(rsvs);
+
+	if (bb->used_sz != 0) {
+		conn_scan_job_send_response((conn_scan_job*)job, bb->buf, bb->used_sz);
+	}
+
+	cf_buf_builder_free(bb);
+
+	cf_detail(AS_SCAN, "%s basic scan job %lu sweep slice %u in thread %lu took %lu ms",
+			ns->name, _job->trid, sweep_slice, pthread_self(),
+			cf_getms() - slice_start);
+}
+
+// Device sweep counterpart of basic_scan_job_reduce_cb() - the record's block
+// has already been read.
+bool
+basic_scan_job_sweep_cb(as_index_ref* r_ref, as_storage_rd* rd, void* udata)
+{
+	basic_scan_slice* slice = (basic_scan_slice*)udata;
+	basic_scan_job* job = slice->job;
+	as_job* _job = (as_job*)job;
+	as_namespace* ns = _job->ns;
+	as_index *r = r_ref->r;
+
+	if (_job->abandoned != 0) {
+		as_storage_record_close(r, rd);
+		as_record_done(r_ref, ns);
+		return false;
+	}
+
+	if (job->fail_on_cluster_change &&
+			job->cluster_key != as_paxos_get_cluster_key()) {
+		as_storage_record_close(r, rd);
+		as_record_done(r_ref, ns);
+		as_job_manager_abandon_job(_job->mgr, _job,
+				AS_PROTO_RESULT_FAIL_CLUSTER_KEY_MISMATCH);
+		return false;
+	}
+
+	if (excluded_set(r, _job->set_id) || as_record_is_doomed(r, ns)) {
+		as_storage_record_close(r, rd);
+		as_record_done(r_ref, ns);
+		return true;
+	}
+
+	if (job->predexp) {
+		predexp_args predargs = { .ns = ns, .md = r, .rd = NULL };
+
+		if (predexp_matches_metadata(job->predexp, &predargs) ==
+				PREDEXP_FALSE) {
+			as_storage_record_close(r, rd);
+			as_record_done(r_ref, ns);
+			return true;
+		}
+	}
+
+	basic_scan_slice_add_record(slice, r_ref, rd);
+
+	return _job->abandoned == 0;
+}
+
+void
+basic_scan_job_reduce_cb(as_index_ref* r_ref, void* udata)
+{
+	basic_scan_slice* slice = (basic_scan_slice*)udata;
+	basic_scan_job* job = slice->job;
+	as_job* _job = (as_job*)job;
+	as_namespace* ns = _job->ns;
+
+	if (_job->abandoned != 0) {
+		as_record_done(r_ref, ns);
+		return;
+	}
+
+	if (job->fail_on_cluster_change &&
+			job->cluster_key != as_paxos_get_cluster_key()) {
+		as_record_done(r_ref, ns);
+		as_job_manager_abandon_job(_job->mgr, _job,
+				AS_PROTO_RESULT_FAIL_CLUSTER_KEY_MISMATCH);
+		return;
+	}
+
+	as_index *r = r_ref->r;
+
+	// Cursor scans resume past the last record reached, wanted or not.
+	slice->has_last_keyd = true;
+	slice->last_keyd = r->key;
+
+	if (excluded_set(r, _job->set_id) || as_record_is_doomed(r, ns)) {
+		as_record_done(r_ref, ns);
+		return;
+	}
+
+	predexp_retval predexp_result = PREDEXP_TRUE;
+
+	if (job->predexp) {
+		predexp_args predargs = { .ns = ns, .md = r, .rd = NULL };
+
+		// Filter on metadata before touching storage, where possible.
+		if ((predexp_result = predexp_matches_metadata(job->predexp,
+				&predargs)) == PREDEXP_FALSE) {
+			as_record_done(r_ref, ns);
+			return;
+		}
+	}
+
+	if (job->count_only) {
+		// Counted from the index alone, unless the predicate needs bins.
+		if (predexp_result == PREDEXP_UNKNOWN &&
+				! basic_scan_predexp_matches_record(job, r)) {
+			as_record_done(r_ref, ns);
+			return;
+		}
+
+		as_record_done(r_ref, ns);
+		slice->n_counted++;
+		return;
+	}
+
+	if (job->no_bin_data) {
+		if (predexp_result == PREDEXP_UNKNOWN) {
+			// Predicate needs bins, though the response won't include them.
+			as_storage_rd rd;
+
+			as_storage_record_open(ns, r, &rd, &r->key);
+			rd.n_bins = as_bin_get_n_bins(r, &rd);
+
+			as_bin stack_bins[ns->storage_data_in_memory ? 0 : rd.n_bins];
+
+			rd.bins = as_bin_get_all(r, &rd, stack_bins);
+
+			predexp_args predargs = { .ns = ns, .md = r, .rd = &rd };
+
+			if (! predexp_matches_record(job->predexp, &predargs)) {
+				as_storage_record_close(r, &rd);
+				as_record_done(r_ref, ns);
+				return;
+			}
+
+			bool key_stored = as_index_is_flag_set(r, AS_INDEX_FLAG_KEY_STORED);
+
+			as_msg_make_response_bufbuilder(r, key_stored ? &rd : NULL,
+					slice->bb_r, true, key_stored ? NULL : ns->name,
+					job->include_ldt_data, key_stored, true, NULL);
+			as_storage_record_close(r, &rd);
+		}
+		else if (as_index_is_flag_set(r, AS_INDEX_FLAG_KEY_STORED)) {
+			as_storage_rd rd;
+
+			as_storage_record_open(ns, r, &rd, &r->key);
+			as_msg_make_response_bufbuilder(r, &rd, slice->bb_r, true, NULL,
+					job->include_ldt_data, true, true, NULL);
+			as_storage_record_close(r, &rd);
+		}
+		else {
+			as_msg_make_response_bufbuilder(r, NULL, slice->bb_r, true,
+					ns->name, job->include_ldt_data, false, true, NULL);
+		}
+	}
+	else if (slice->batch_reads) {
+		basic_scan_slice_batch_add(slice, r_ref);
+		return;
+	}
+	else {
+		as_storage_rd rd;
+
+		as_storage_record_open(ns, r, &rd, &r->key);
+		basic_scan_slice_add_record(slice, r_ref, &rd);
+		return;
+	}
+
+	as_record_done(r_ref, ns);
+
+	cf_atomic64_incr(&_job->n_records_read);
+	slice->n_returned++;
+
+	cf_buf_builder* bb = *slice->bb_r;
+
+	// If we exceed the proto size limit, send accumulated data back to client
+	// and reset the buf-builder to start a new proto.
+	if (bb->used_sz > SCAN_CHUNK_LIMIT) {
+		if (! conn_scan_job_send_response((conn_scan_job*)job, bb->buf,
+				bb->used_sz)) {
+			return;
+		}
+
+		cf_buf_builder_reset(bb);
+	}
+}
+
+bool
+basic_scan_predexp_matches_record(basic_scan_job* job, as_index* r)
+{
+	as_namespace* ns = ((as_job*)job)->ns;
+	as_storage_rd rd;
+
+	as_storage_record_open(ns, r, &rd, &r->key);
+	rd.n_bins = as_bin_get_n_bins(r, &rd);
+
+	as_bin stack_bins[ns->storage_data_in_memory ? 0 : rd.n_bins];
+
+	rd.bins = as_bin_get_all(r, &rd, stack_bins);
+
+	predexp_args predargs = { .ns = ns, .md = r, .rd = &rd };
+	bool matches = predexp_matches_record(job->predexp, &predargs);
+
+	as_storage_record_close(r, &rd);
+
+	return matches;
+}
+
+// The count goes back as a single value, like an aggregation's result.
+void
+basic_scan_job_send_count(basic_scan_job* job)
+{
+	cf_buf_builder* bb = cf_buf_builder_create_size(INIT_BUF_BUILDER_SIZE);
+
+	if (! bb) {
+		return; // client will see the fin without a count
+	}
+
+	as_integer count;
+
+	as_integer_init(&count, (int64_t)cf_atomic64_get(job->n_counted));
+
+	as_msg_make_val_response_bufbuilder((as_val*)&count, &bb,
+			as_particle_asval_client_value_size((as_val*)&count), true);
+	conn_scan_job_send_response((conn_scan_job*)job, bb->buf, bb->used_sz);
+
+	as_integer_destroy(&count);
+	cf_buf_builder_free(bb);
+}
+
+// Add a record's bins to the response, given an open rd - the record's block
+// may already have been read. Closes the rd and releases the record.
+void
+basic_scan_slice_add_record(basic_scan_slice* slice, as_index_ref* r_ref,
+		as_storage_rd* rd)
 {
-	basic_scan_job* job = cf_malloc(sizeof(basic_scan_job));
+	basic_scan_job* job = slice->job;
 	as_job* _job = (as_job*)job;
+	as_index *r = r_ref->r;
 
-	if (! job) {
-		cf_warning(AS_SCAN, "basic scan job failed alloc");
-		return AS_PROTO_RESULT_FAIL_UNKNOWN;
-	}
+	rd->n_bins = as_bin_get_n_bins(r, rd);
 
-	scan_options options = { 0, false, false, 100 };
+	as_bin stack_bins[rd->ns->storage_data_in_memory ? 0 : rd->n_bins];
 
-	if (! get_scan_options(tr, &options)) {
-		cf_free(job);
-		return AS_PROTO_RESULT_FAIL_PARAMETER;
+	rd->bins = as_bin_get_all(r, rd, stack_bins);
+
+	if (job->predexp) {
+		predexp_args predargs = { .ns = _job->ns, .md = r, .rd = rd };
+
+		if (! predexp_matches_record(job->predexp, &predargs)) {
+			as_storage_record_close(r, rd);
+			as_record_done(r_ref, _job->ns);
+			return;
+		}
 	}
 
-	as_job_init(_job, &basic_scan_job_vtable, &g_scan_manager, RSV_WRITE,
-			as_transaction_trid(tr), ns, set_id, options.priority);
+	as_msg_make_response_bufbuilder(r, rd, slice->bb_r, false, NULL,
+			job->include_ldt_data, true, true, job->bin_names);
+	as_storage_record_close(r, rd);
 
-	int result;
+	as_record_done(r_ref, _job->ns);
 
-	job->cluster_key = as_paxos_get_cluster_key();
-	job->fail_on_cluster_change = options.fail_on_cluster_change;
-	job->include_ldt_data = options.include_ldt_data;
-	job->no_bin_data = (tr->msgp->msg.info1 & AS_MSG_INFO1_GET_NOBINDATA) != 0;
-	job->sample_pct = options.sample_pct;
-	job->bin_names = bin_names_from_op(&tr->msgp->msg, &result);
+	cf_atomic64_incr(&_job->n_records_read);
+	slice->n_returned++;
 
-	if (! job->bin_names && result != AS_PROTO_RESULT_OK) {
-		as_job_destroy(_job);
-		return result;
-	}
+	cf_buf_builder* bb = *slice->bb_r;
 
-	if (job->fail_on_cluster_change &&
-			(cf_atomic_int_get(ns->migrate_tx_partitions_remaining) != 0 ||
-			 cf_atomic_int_get(ns->migrate_rx_partitions_remaining) != 0)) {
-		// TODO - was AS_PROTO_RESULT_FAIL_UNAVAILABLE - ok?
-		cf_warning(AS_SCAN, "basic scan job not started - migration");
-		as_job_destroy(_job);
-		return AS_PROTO_RESULT_FAIL_CLUSTER_KEY_MISMATCH;
+	// If we exceed the proto size limit, send accumulated data back to client
+	// and reset the buf-builder to start a new proto.
+	if (bb->used_sz > SCAN_CHUNK_LIMIT) {
+		if (! conn_scan_job_send_response((conn_scan_job*)job, bb->buf,
+				bb->used_sz)) {
+			return;
+		}
+
+		cf_buf_builder_reset(bb);
 	}
+}
 
-	// Take ownership of socket from transaction.
-	conn_scan_job_own_fd((conn_scan_job*)job, tr->from.proto_fd_h);
+// Hold on to the record (reserved but not locked) until the batch is full.
+void
+basic_scan_slice_batch_add(basic_scan_slice* slice, as_index_ref* r_ref)
+{
+	as_namespace* ns = ((as_job*)slice->job)->ns;
+	as_index *r = r_ref->r;
+	uint32_t i = slice->n_batched++;
 
-	cf_info(AS_SCAN, "starting basic scan job %lu {%s:%s} priority %u, sample-pct %u%s%s%s",
-			_job->trid, ns->name, as_namespace_get_set_name(ns, set_id),
-			_job->priority, job->sample_pct,
-			job->no_bin_data ? ", metadata-only" : "",
-			job->fail_on_cluster_change ? ", fail-on-cluster-change" : "",
-			job->include_ldt_data ? ", include-ldt-data" : "");
+	as_storage_record_open(ns, r, &slice->batch_rds[i], &r->key);
+	slice->batch_r_hs[i] = r_ref->r_h;
+	slice->batch_generations[i] = r->generation;
 
-	if ((result = as_job_manager_start_job(_job->mgr, _job)) != 0) {
-		cf_warning(AS_SCAN, "basic scan job %lu failed to start (%d)",
-				_job->trid, result);
-		conn_scan_job_disown_fd((conn_scan_job*)job);
-		as_job_destroy(_job);
-		return result;
-	}
+	as_index_reserve(r);
+	cf_shard_counter_incr(&g_stats.global_record_ref_count);
 
-	// Normal scans don't need anything in the message beyond here.
-	cf_free(tr->msgp);
+	as_record_done(r_ref, ns);
 
-	return AS_PROTO_RESULT_OK;
+	if (slice->n_batched == SCAN_READ_BATCH_SIZE) {
+		basic_scan_slice_batch_flush(slice);
+	}
 }
 
-//----------------------------------------------------------
-// basic_scan_job mandatory scan_job interface.
-//
-
+// Read the batched records in storage order, then respond record by record.
 void
-basic_scan_job_slice(as_job* _job, as_partition_reservation* rsv)
+basic_scan_slice_batch_flush(basic_scan_slice* slice)
 {
-	basic_scan_job* job = (basic_scan_job*)_job;
-	as_index_tree* tree = rsv->p->vp;
-	cf_buf_builder* bb = cf_buf_builder_create_size(INIT_BUF_BUILDER_SIZE);
+	uint32_t n_batched = slice->n_batched;
 
-	if (! bb) {
-		as_job_manager_abandon_job(_job->mgr, _job,
-				AS_PROTO_RESULT_FAIL_UNKNOWN);
+	if (n_batched == 0) {
 		return;
 	}
 
-	uint64_t slice_start = cf_getms();
-	basic_scan_slice slice = { job, &bb };
+	as_job* _job = (as_job*)slice->job;
+	as_namespace* ns = _job->ns;
+	as_storage_rd* rds[n_batched];
 
-	if (job->sample_pct == 100) {
-		as_index_reduce(tree, basic_scan_job_reduce_cb, (void*)&slice);
+	for (uint32_t i = 0; i < n_batched; i++) {
+		rds[i] = &slice->batch_rds[i];
 	}
-	else {
-		uint32_t sample_count = (uint32_t)
-				(((uint64_t)tree->elements * (uint64_t)job->sample_pct) / 100);
 
-		as_index_reduce_partial(tree, sample_count, basic_scan_job_reduce_cb,
-				(void*)&slice);
+	if (_job->abandoned == 0) {
+		as_storage_record_read_batch(rds, n_batched);
 	}
 
-	if (bb->used_sz != 0) {
-		conn_scan_job_send_response((conn_scan_job*)job, bb->buf, bb->used_sz);
-	}
+	for (uint32_t i = 0; i < n_batched; i++) {
+		as_storage_rd* rd = rds[i];
+		as_index_ref r_ref;
 
-	// TODO - guts don't check buf_builder realloc failures rigorously.
-	cf_buf_builder_free(bb);
+		r_ref.skip_lock = false;
+		r_ref.r = rd->r;
+		r_ref.r_h = slice->batch_r_hs[i];
 
-	cf_detail(AS_SCAN, "%s:%u basic scan job %lu in thread %lu took %lu ms",
-			rsv->ns->name, rsv->p->partition_id, _job->trid, pthread_self(),
-			cf_getms() - slice_start);
-}
+		olock_vlock(g_record_locks, &r_ref.r->key, &r_ref.olock);
 
-void
-basic_scan_job_finish(as_job* _job)
-{
-	conn_scan_job_finish((conn_scan_job*)_job);
+		// Record may have been deleted or expired while unlocked.
+		if (_job->abandoned != 0 || ! as_index_is_valid_record(r_ref.r) ||
+				as_record_is_doomed(r_ref.r, ns)) {
+			as_storage_record_close(r_ref.r, rd);
+			as_record_done(&r_ref, ns);
+			continue;
+		}
 
-	switch (_job->abandoned) {
-	case 0:
-		cf_atomic_int_incr(&_job->ns->n_scan_basic_complete);
-		break;
-	case AS_JOB_FAIL_USER_ABORT:
-		cf_atomic_int_incr(&_job->ns->n_scan_basic_abort);
-		break;
-	case AS_JOB_FAIL_UNKNOWN:
-	case AS_JOB_FAIL_CLUSTER_KEY:
-	default:
-		cf_atomic_int_incr(&_job->ns->n_scan_basic_error);
-		break;
+		// Record may have been rewritten while unlocked - re-read it.
+		if (r_ref.r->generation != slice->batch_generations[i]) {
+			as_storage_record_close(r_ref.r, rd);
+			as_storage_record_open(ns, r_ref.r, rd, &r_ref.r->key);
+		}
+
+		basic_scan_slice_add_record(slice, &r_ref, rd);
 	}
 
-	cf_info(AS_SCAN, "finished basic scan job %lu (%d)", _job->trid,
-			_job->abandoned);
+	slice->n_batched = 0;
 }
 
+// Reduce the partition from its cursor in chunks of the page, until the page
+// is used up or the partition is done, then respond with the new cursor.
 void
-basic_scan_job_destroy(as_job* _job)
+basic_scan_slice_cursor_reduce(basic_scan_slice* slice,
+		as_partition_reservation* rsv)
 {
-	basic_scan_job* job = (basic_scan_job*)_job;
+	as_job* _job = (as_job*)slice->job;
+	scan_cursor* cursor = slice->job->cursor;
+	as_index_tree* tree = rsv->p->vp;
+	as_partition_id pid = rsv->p->partition_id;
 
-	if (job->bin_names) {
-		cf_vector_destroy(job->bin_names);
+	if (cursor->resume[pid]) {
+		slice->has_last_keyd = true;
+		slice->last_keyd = cursor->keyds[pid];
+	}
+
+	bool done = false;
+
+	while (! done && _job->abandoned == 0) {
+		uint32_t n_claimed = cursor->max_records == 0 ?
+				UINT32_MAX : scan_cursor_claim(cursor);
+
+		if (n_claimed == 0) {
+			break;
+		}
+
+		// The reduce overwrites last_keyd as it goes.
+		cf_digest from_keyd = slice->last_keyd;
+
+		slice->n_returned = 0;
+
+		uint32_t n_reduced = as_index_reduce_from(tree,
+				slice->has_last_keyd ? &from_keyd : NULL, n_claimed,
+				basic_scan_job_reduce_cb, (void*)slice);
+
+		// Batched records must be returned (or not) before the count is used.
+		basic_scan_slice_batch_flush(slice);
+
+		done = n_reduced < n_claimed;
+
+		// Hand back what wasn't returned - records reduced but filtered out.
+		if (cursor->max_records != 0 && slice->n_returned < n_claimed) {
+			cf_atomic64_add(&cursor->n_unclaimed,
+					n_claimed - slice->n_returned);
+		}
+	}
+
+	if (_job->abandoned == 0) {
+		basic_scan_slice_add_cursor(slice, pid, done);
 	}
 }
 
 void
-basic_scan_job_info(as_job* _job, as_mon_jobstat* stat)
+basic_scan_slice_add_cursor(basic_scan_slice* slice, as_partition_id pid,
+		bool done)
 {
-	strcpy(stat->job_type, scan_type_str(SCAN_TYPE_BASIC));
-	conn_scan_job_info((conn_scan_job*)_job, stat);
-}
+	// Page filled before anything was reduced - the cursor is unchanged.
+	if (! done && ! slice->has_last_keyd) {
+		return;
+	}
 
-//----------------------------------------------------------
-// basic_scan_job utilities.
-//
+	uint16_t n_fields = done ? 0 : 1;
+	size_t msg_sz = sizeof(as_msg) +
+			(done ? 0 : sizeof(as_msg_field) + sizeof(cf_digest));
+	uint8_t* b;
 
-void
-basic_scan_job_reduce_cb(as_index_ref* r_ref, void* udata)
-{
-	basic_scan_slice* slice = (basic_scan_slice*)udata;
-	basic_scan_job* job = slice->job;
-	as_job* _job = (as_job*)job;
-	as_namespace* ns = _job->ns;
+	cf_buf_builder_reserve(slice->bb_r, (int)msg_sz, &b);
 
-	if (_job->abandoned != 0) {
-		as_record_done(r_ref, ns);
-		return;
+	as_msg* msgp = (as_msg*)b;
+
+	memset(msgp, 0, sizeof(as_msg));
+	msgp->header_sz = sizeof(as_msg);
+	msgp->info3 = AS_MSG_INFO3_SCAN_CURSOR;
+	msgp->generation = pid;
+	msgp->n_fields = n_fields;
+	as_msg_swap_header(msgp);
+
+	if (! done) {
+		as_msg_field* mf = (as_msg_field*)(b + sizeof(as_msg));
+
+		mf->field_sz = sizeof(cf_digest) + 1;
+		mf->type = AS_MSG_FIELD_TYPE_DIGEST_RIPE;
+		memcpy(mf->data, &slice->last_keyd, sizeof(cf_digest));
+		as_msg_swap_field(mf);
 	}
+}
 
-	if (job->fail_on_cluster_change &&
-			job->cluster_key != as_paxos_get_cluster_key()) {
-		as_record_done(r_ref, ns);
-		as_job_manager_abandon_job(_job->mgr, _job,
-				AS_PROTO_RESULT_FAIL_CLUSTER_KEY_MISMATCH);
-		return;
+// Claim up to a chunk of the page - returns 0 when the page is used up.
+uint32_t
+scan_cursor_claim(scan_cursor* cursor)
+{
+	int64_t n_left = (int64_t)cf_atomic64_sub(&cursor->n_unclaimed,
+			SCAN_CURSOR_CHUNK);
+
+	if (n_left >= 0) {
+		return SCAN_CURSOR_CHUNK;
 	}
 
-	as_index *r = r_ref->r;
+	// Overdrawn - give back the shortfall.
+	uint32_t n_short = -n_left > SCAN_CURSOR_CHUNK ?
+			SCAN_CURSOR_CHUNK : (uint32_t)-n_left;
 
-	if (excluded_set(r, _job->set_id) || as_record_is_expired(r)) {
-		as_record_done(r_ref, ns);
-		return;
+	cf_atomic64_add(&cursor->n_unclaimed, n_short);
+
+	return SCAN_CURSOR_CHUNK - n_short;
+}
+
+scan_cursor*
+scan_cursor_from_msg(as_transaction* tr, bool** p_pids)
+{
+	as_msg_field* f = as_msg_field_get(&tr->msgp->msg,
+			AS_MSG_FIELD_TYPE_SCAN_CURSOR);
+	uint32_t value_sz = as_msg_field_get_value_sz(f);
+
+	if (value_sz < sizeof(uint32_t) + sizeof(scan_cursor_entry) ||
+			(value_sz - sizeof(uint32_t)) % sizeof(scan_cursor_entry) != 0) {
+		cf_warning(AS_SCAN, "scan msg cursor field bad size %u", value_sz);
+		return NULL;
 	}
 
-	if (job->no_bin_data) {
-		if (as_index_is_flag_set(r, AS_INDEX_FLAG_KEY_STORED)) {
-			as_storage_rd rd;
+	scan_cursor* cursor = cf_malloc(sizeof(scan_cursor));
+	bool* pids = cf_malloc(sizeof(bool) * AS_PARTITIONS);
 
-			as_storage_record_open(ns, r, &rd, &r->key);
-			as_msg_make_response_bufbuilder(r, &rd, slice->bb_r, true, NULL,
-					job->include_ldt_data, true, true, NULL);
-			as_storage_record_close(r, &rd);
+	if (! cursor || ! pids) {
+		cf_warning(AS_SCAN, "scan cursor failed alloc");
+
+		if (cursor) {
+			cf_free(cursor);
 		}
-		else {
-			as_msg_make_response_bufbuilder(r, NULL, slice->bb_r, true,
-					ns->name, job->include_ldt_data, false, true, NULL);
+
+		if (pids) {
+			cf_free(pids);
 		}
+
+		return NULL;
 	}
-	else {
-		as_storage_rd rd;
 
-		as_storage_record_open(ns, r, &rd, &r->key);
-		rd.n_bins = as_bin_get_n_bins(r, &rd);
+	memset(cursor->resume, 0, sizeof(cursor->resume));
+	memset(pids, 0, sizeof(bool) * AS_PARTITIONS);
 
-		as_bin stack_bins[rd.ns->storage_data_in_memory ? 0 : rd.n_bins];
+	cursor->max_records = cf_swap_from_be32(*(uint32_t*)f->data);
+	cursor->n_unclaimed = cursor->max_records;
 
-		rd.bins = as_bin_get_all(r, &rd, stack_bins);
-		as_msg_make_response_bufbuilder(r, &rd, slice->bb_r, false, NULL,
-				job->include_ldt_data, true, true, job->bin_names);
-		as_storage_record_close(r, &rd);
-	}
+	const scan_cursor_entry* entries =
+			(const scan_cursor_entry*)(f->data + sizeof(uint32_t));
+	uint32_t n_entries = (value_sz - sizeof(uint32_t)) /
+			sizeof(scan_cursor_entry);
 
-	as_record_done(r_ref, ns);
+	for (uint32_t i = 0; i < n_entries; i++) {
+		uint16_t pid = cf_swap_from_be16(entries[i].pid);
 
-	cf_atomic64_incr(&_job->n_records_read);
+		if (pid >= AS_PARTITIONS) {
+			cf_warning(AS_SCAN, "scan msg cursor bad pid %u", pid);
+			cf_free(cursor);
+			cf_free(pids);
+			return NULL;
+		}
 
-	cf_buf_builder* bb = *slice->bb_r;
+		pids[pid] = true;
 
-	// If we exceed the proto size limit, send accumulated data back to client
-	// and reset the buf-builder to start a new proto.
-	if (bb->used_sz > SCAN_CHUNK_LIMIT) {
-		if (! conn_scan_job_send_response((conn_scan_job*)job, bb->buf,
-				bb->used_sz)) {
-			return;
+		if ((entries[i].flags & SCAN_CURSOR_RESUME) != 0) {
+			cursor->resume[pid] = true;
+			cursor->keyds[pid] = entries[i].keyd;
 		}
-
-		cf_buf_builder_reset(bb);
 	}
+
+	*p_pids = pids;
+
+	return cursor;
 }
 
 cf_vector*
@@ -830,9 +1924,10 @@ typedef struct aggr_scan_job_s {
 	// Derived class data:
 	cl_msg*			msgp;
 	as_aggr_call	aggr_call;
+	predexp_eval*	predexp;
 } aggr_scan_job;
 
-void aggr_scan_job_slice(as_job* _job, as_partition_reservation* rsv);
+void aggr_scan_job_slice(as_job* _job, as_partition_reservation* rsv, cf_digest* lo_keyd, cf_digest* hi_keyd);
 void aggr_scan_job_finish(as_job* _job);
 void aggr_scan_job_destroy(as_job* _job);
 void aggr_scan_job_info(as_job* _job, as_mon_jobstat* stat);
@@ -857,13 +1952,14 @@ bool aggr_scan_add_digest(cf_ll* ll, cf_digest* keyd);
 as_partition_reservation* aggr_scan_ptn_reserve(void* udata, as_namespace* ns,
 		as_partition_id pid, as_partition_reservation* rsv);
 as_stream_status aggr_scan_ostream_write(void* udata, as_val* val);
+bool aggr_scan_pre_check(void* udata, udf_record* urecord, void* key_data);
 
 const as_aggr_hooks scan_aggr_hooks = {
 	.ostream_write = aggr_scan_ostream_write,
 	.set_error     = NULL,
 	.ptn_reserve   = aggr_scan_ptn_reserve,
 	.ptn_release   = NULL,
-	.pre_check     = NULL
+	.pre_check     = aggr_scan_pre_check
 };
 
 void aggr_scan_add_val_response(aggr_scan_slice* slice, const as_val* val,
@@ -884,7 +1980,7 @@ aggr_scan_job_start(as_transaction* tr, as_namespace* ns, uint16_t set_id)
 		return AS_PROTO_RESULT_FAIL_UNKNOWN;
 	}
 
-	scan_options options = { 0, false, false, 100 };
+	scan_options options = { 0, false, false, 100, false, false };
 
 	if (! get_scan_options(tr, &options)) {
 		cf_free(job);
@@ -894,7 +1990,18 @@ aggr_scan_job_start(as_transaction* tr, as_namespace* ns, uint16_t set_id)
 	as_job_init(_job, &aggr_scan_job_vtable, &g_scan_manager, RSV_WRITE,
 			as_transaction_trid(tr), ns, set_id, options.priority);
 
+	_job->split_pids = true;
+	_job->max_threads = g_config.scan_max_threads_per_job;
+	_job->max_rps = g_config.scan_max_records_per_sec_per_job;
+
 	job->msgp = tr->msgp;
+	job->predexp = NULL;
+
+	if (! scan_predexp_build(tr, &job->predexp)) {
+		job->msgp = NULL;
+		as_job_destroy(_job);
+		return AS_PROTO_RESULT_FAIL_PARAMETER;
+	}
 
 	if (! aggr_scan_init(&job->aggr_call, tr)) {
 		cf_warning(AS_SCAN, "aggregation scan job failed call init");
@@ -904,7 +2011,8 @@ aggr_scan_job_start(as_transaction* tr, as_namespace* ns, uint16_t set_id)
 	}
 
 	// Take ownership of socket from transaction.
-	conn_scan_job_own_fd((conn_scan_job*)job, tr->from.proto_fd_h);
+	conn_scan_job_own_fd((conn_scan_job*)job, tr->from.proto_fd_h,
+			as_transaction_response_compression(tr));
 
 	cf_info(AS_SCAN, "starting aggregation scan job %lu {%s:%s} priority %u",
 			_job->trid, ns->name, as_namespace_get_set_name(ns, set_id),
@@ -929,10 +2037,10 @@ aggr_scan_job_start(as_transaction* tr, as_namespace* ns, uint16_t set_id)
 //
 
 void
-aggr_scan_job_slice(as_job* _job, as_partition_reservation* rsv)
+aggr_scan_job_slice(as_job* _job, as_partition_reservation* rsv,
+		cf_digest* lo_keyd, cf_digest* hi_keyd)
 {
 	aggr_scan_job* job = (aggr_scan_job*)_job;
-	as_index_tree* tree = rsv->p->vp;
 	cf_ll ll;
 	cf_buf_builder* bb = cf_buf_builder_create_size(INIT_BUF_BUILDER_SIZE);
 
@@ -946,7 +2054,8 @@ aggr_scan_job_slice(as_job* _job, as_partition_reservation* rsv)
 
 	aggr_scan_slice slice = { job, &ll, &bb, rsv };
 
-	as_index_reduce(tree, aggr_scan_job_reduce_cb, (void*)&slice);
+	scan_reduce_range(_job, rsv, lo_keyd, hi_keyd, aggr_scan_job_reduce_cb,
+			(void*)&slice);
 
 	if (cf_ll_size(&ll) != 0) {
 		as_result result;
@@ -1028,6 +2137,10 @@ aggr_scan_job_destroy(as_job* _job)
 	if (job->msgp) {
 		cf_free(job->msgp);
 	}
+
+	if (job->predexp) {
+		predexp_destroy(job->predexp);
+	}
 }
 
 void
@@ -1068,11 +2181,22 @@ aggr_scan_job_reduce_cb(as_index_ref* r_ref, void* udata)
 
 	as_index* r = r_ref->r;
 
-	if (excluded_set(r, _job->set_id) || as_record_is_expired(r)) {
+	if (excluded_set(r, _job->set_id) || as_record_is_doomed(r, ns)) {
 		as_record_done(r_ref, ns);
 		return;
 	}
 
+	if (job->predexp) {
+		predexp_args predargs = { .ns = ns, .md = r, .rd = NULL };
+
+		// Anything needing bins is checked again as the record is aggregated.
+		if (predexp_matches_metadata(job->predexp, &predargs) ==
+				PREDEXP_FALSE) {
+			as_record_done(r_ref, ns);
+			return;
+		}
+	}
+
 	if (! aggr_scan_add_digest(slice->ll, &r->key)) {
 		as_record_done(r_ref, ns);
 		as_job_manager_abandon_job(_job->mgr, _job,
@@ -1084,6 +2208,22 @@ aggr_scan_job_reduce_cb(as_index_ref* r_ref, void* udata)
 	as_record_done(r_ref, ns);
 }
 
+// Called with the record open and its bins loaded.
+bool
+aggr_scan_pre_check(void* udata, udf_record* urecord, void* key_data)
+{
+	aggr_scan_job* job = ((aggr_scan_slice*)udata)->job;
+
+	if (! job->predexp) {
+		return true;
+	}
+
+	predexp_args predargs = { .ns = ((as_job*)job)->ns,
+			.md = urecord->r_ref->r, .rd = urecord->rd };
+
+	return predexp_matches_record(job->predexp, &predargs);
+}
+
 bool
 aggr_scan_add_digest(cf_ll* ll, cf_digest* keyd)
 {
@@ -1178,13 +2318,14 @@ typedef struct udf_bg_scan_job_s {
 	// Derived class data:
 	cl_msg*			msgp;
 	iudf_origin		origin;
+	predexp_eval*	predexp;
 	cf_atomic32		n_active_tr;
 
 	cf_atomic64		n_successful_tr;
 	cf_atomic64		n_failed_tr;
 } udf_bg_scan_job;
 
-void udf_bg_scan_job_slice(as_job* _job, as_partition_reservation* rsv);
+void udf_bg_scan_job_slice(as_job* _job, as_partition_reservation* rsv, cf_digest* lo_keyd, cf_digest* hi_keyd);
 void udf_bg_scan_job_finish(as_job* _job);
 void udf_bg_scan_job_destroy(as_job* _job);
 void udf_bg_scan_job_info(as_job* _job, as_mon_jobstat* stat);
@@ -1197,6 +2338,7 @@ const as_job_vtable udf_bg_scan_job_vtable = {
 };
 
 void udf_bg_scan_job_reduce_cb(as_index_ref* r_ref, void* udata);
+bool udf_bg_scan_predexp_matches(udf_bg_scan_job* job, as_index* r);
 int udf_bg_scan_tr_complete(void* udata, int retcode);
 
 //----------------------------------------------------------
@@ -1214,7 +2356,7 @@ udf_bg_scan_job_start(as_transaction* tr, as_namespace* ns, uint16_t set_id)
 		return AS_PROTO_RESULT_FAIL_UNKNOWN;
 	}
 
-	scan_options options = { 0, false, false, 100 };
+	scan_options options = { 0, false, false, 100, false, false };
 
 	if (! get_scan_options(tr, &options)) {
 		cf_free(job);
@@ -1224,7 +2366,12 @@ udf_bg_scan_job_start(as_transaction* tr, as_namespace* ns, uint16_t set_id)
 	as_job_init(_job, &udf_bg_scan_job_vtable, &g_scan_manager, RSV_WRITE,
 			as_transaction_trid(tr), ns, set_id, options.priority);
 
+	_job->split_pids = true;
+	_job->max_threads = g_config.scan_max_threads_per_job;
+	_job->max_rps = g_config.scan_max_records_per_sec_per_job;
+
 	job->msgp = tr->msgp;
+	job->predexp = NULL;
 	job->n_active_tr = 0;
 	job->n_successful_tr = 0;
 	job->n_failed_tr = 0;
@@ -1236,6 +2383,12 @@ udf_bg_scan_job_start(as_transaction* tr, as_namespace* ns, uint16_t set_id)
 		return AS_PROTO_RESULT_FAIL_PARAMETER;
 	}
 
+	if (! scan_predexp_build(tr, &job->predexp)) {
+		job->msgp = NULL;
+		as_job_destroy(_job);
+		return AS_PROTO_RESULT_FAIL_PARAMETER;
+	}
+
 	job->origin.cb = udf_bg_scan_tr_complete;
 	job->origin.udata = (void*)job;
 
@@ -1273,9 +2426,11 @@ udf_bg_scan_job_start(as_transaction* tr, as_namespace* ns, uint16_t set_id)
 //
 
 void
-udf_bg_scan_job_slice(as_job* _job, as_partition_reservation* rsv)
+udf_bg_scan_job_slice(as_job* _job, as_partition_reservation* rsv,
+		cf_digest* lo_keyd, cf_digest* hi_keyd)
 {
-	as_index_reduce(rsv->p->vp, udf_bg_scan_job_reduce_cb, (void*)_job);
+	scan_reduce_range(_job, rsv, lo_keyd, hi_keyd, udf_bg_scan_job_reduce_cb,
+			(void*)_job);
 }
 
 void
@@ -1316,6 +2471,10 @@ udf_bg_scan_job_destroy(as_job* _job)
 	if (job->msgp) {
 		cf_free(job->msgp);
 	}
+
+	if (job->predexp) {
+		predexp_destroy(job->predexp);
+	}
 }
 
 void
@@ -1352,7 +2511,12 @@ udf_bg_scan_job_reduce_cb(as_index_ref* r_ref, void* udata)
 
 	as_index* r = r_ref->r;
 
-	if (excluded_set(r, _job->set_id) || as_record_is_expired(r)) {
+	if (excluded_set(r, _job->set_id) || as_record_is_doomed(r, ns)) {
+		as_record_done(r_ref, ns);
+		return;
+	}
+
+	if (job->predexp && ! udf_bg_scan_predexp_matches(job, r)) {
 		as_record_done(r_ref, ns);
 		return;
 	}
@@ -1381,7 +2545,37 @@ udf_bg_scan_job_reduce_cb(as_index_ref* r_ref, void* udata)
 	cf_atomic64_incr(&_job->n_records_read);
 	cf_atomic32_incr(&job->n_active_tr);
 
-	thr_tsvc_enqueue(&tr);
+	thr_tsvc_process_or_enqueue_iudf(&tr);
+}
+
+// Filter before enqueuing a UDF transaction - reading bins only if the
+// predicate needs them.
+bool
+udf_bg_scan_predexp_matches(udf_bg_scan_job* job, as_index* r)
+{
+	as_namespace* ns = ((as_job*)job)->ns;
+	predexp_args predargs = { .ns = ns, .md = r, .rd = NULL };
+	predexp_retval result = predexp_matches_metadata(job->predexp, &predargs);
+
+	if (result != PREDEXP_UNKNOWN) {
+		return result == PREDEXP_TRUE;
+	}
+
+	as_storage_rd rd;
+
+	as_storage_record_open(ns, r, &rd, &r->key);
+	rd.n_bins = as_bin_get_n_bins(r, &rd);
+
+	as_bin stack_bins[ns->storage_data_in_memory ? 0 : rd.n_bins];
+
+	rd.bins = as_bin_get_all(r, &rd, stack_bins);
+	predargs.rd = &rd;
+
+	bool matches = predexp_matches_record(job->predexp, &predargs);
+
+	as_storage_record_close(r, &rd);
+
+	return matches;
 }
 
 int
@@ -48,7 +48,7 @@
  *
  * BOOT INDEX
  *
- * as_sindex_boot_populateall --> If fast restart or data in memory and load at start up --> as_sbld_build_all
+ * as_sindex_boot_populate_ns --> If fast restart or data in memory and load at start up --> as_sbld_build_all
  *
  * SBIN creation
  *
@@ -62,11 +62,11 @@
  *
  * SBIN updates
  *
- * as_sindex_update_by_sbin --> For every sbin --> as_sindex__op_by_sbin
+ * as_sindex_update_by_sbin --> For every sindex's sbins --> as_sindex__op_by_si
  *
- * as_sindex__op_by_sbin --> If op == AS_SINDEX_OP_INSERT --> ai_btree_put
- *                       |
- *                       --> If op == AS_SINDEX_OP_DELETE --> ai_btree_delete
+ * as_sindex__op_by_si --> If op == AS_SINDEX_OP_INSERT --> ai_btree_put
+ *                     |
+ *                     --> If op == AS_SINDEX_OP_DELETE --> ai_btree_delete
  *
  * DMLs using RECORD
  *
@@ -100,6 +100,7 @@
 #include "ai_globals.h"
 #include "bt_iterator.h"
 #include "cf_str.h"
+#include "digest_mb.h"
 #include "fault.h"
 
 #include "base/cdt.h"
@@ -107,6 +108,7 @@
 #include "base/datamodel.h"
 #include "base/index.h"
 #include "base/proto.h"
+#include "base/sindex_snapshot.h"
 #include "base/stats.h"
 #include "base/system_metadata.h"
 #include "base/thr_sindex.h"
@@ -149,7 +151,8 @@ as_sindex_reset_binid_has_sindex(as_namespace *ns, int binid)
 		if (si != NULL) {
 			if (si->state == AS_SINDEX_ACTIVE) {
 				j++;
-				if (si->imd->binid == binid) {
+				if (si->imd->binid == binid || (as_sindex_is_composite(si->imd) &&
+						si->imd->range_binid == binid)) {
 					return;
 				}
 			}
@@ -390,6 +393,7 @@ as_sindex_config_var_default(as_sindex_config_var *si_cfg)
 	// 2 of the 6 variables : enable-histogram and trace-flag are not a part of default-settings for si
 	si_cfg->defrag_period        = from_si.config.defrag_period;
 	si_cfg->defrag_max_units     = from_si.config.defrag_max_units;
+	si_cfg->defrag_max_rate      = from_si.config.defrag_max_rate;
 	// related non config value defaults
 	si_cfg->data_max_memory      = from_si.config.data_max_memory;
 	si_cfg->ignore_not_sync_flag = from_si.config.flag;
@@ -404,6 +408,38 @@ as_sindex_ns_has_sindex(as_namespace *ns)
 	return (ns->sindex_cnt > 0);
 }
 
+/*
+ * Client API to check if there is secondary index on given set - NULL set
+ * being a valid set
+ */
+bool
+as_sindex_set_has_sindex(as_namespace *ns, const char *set_name)
+{
+	if (ns->sindex_cnt == 0) {
+		return false;
+	}
+
+	bool has_sindex = false;
+	int valid       = 0;
+
+	SINDEX_GRLOCK();
+	for (int i = 0; i < AS_SINDEX_MAX && valid < ns->sindex_cnt; i++) {
+		as_sindex_metadata *imd = ns->sindex[i].imd;
+
+		if (!imd) {
+			continue;
+		}
+		valid++;
+		if (as_sindex__setname_match(imd, set_name)) {
+			has_sindex = true;
+			break;
+		}
+	}
+	SINDEX_GUNLOCK();
+
+	return has_sindex;
+}
+
 char *as_sindex_type_defs[] =
 {	"NONE", "LIST", "MAPKEYS", "MAPVALUES"
 };
@@ -500,6 +536,12 @@ as_sindex__dup_meta(as_sindex_metadata *imd, as_sindex_metadata **qimd,
 	qimdp->btype       = imd->btype;
 	qimdp->binid       = imd->binid;
 
+	if (as_sindex_is_composite(imd)) {
+		qimdp->range_bname  = cf_strdup(imd->range_bname);
+		qimdp->range_binid  = imd->range_binid;
+		qimdp->prefix_btype = imd->prefix_btype;
+	}
+
 
 	pthread_rwlockattr_t rwattr;
 	if (pthread_rwlockattr_init(&rwattr))
@@ -510,9 +552,11 @@ as_sindex__dup_meta(as_sindex_metadata *imd, as_sindex_metadata **qimd,
 		cf_crash( AS_TSVC, "pthread_rwlockattr_setkind_np: %s",
 				cf_strerror(errno));
 	}
-	if (pthread_rwlock_init(&qimdp->slock, &rwattr)) {
-		cf_crash(AS_SINDEX,
-				"Could not create secondary index dml mutex ");
+	for (int i = 0; i < AS_SINDEX_LOCK_SHARDS; i++) {
+		if (pthread_rwlock_init(&qimdp->slock[i].lock, &rwattr)) {
+			cf_crash(AS_SINDEX,
+					"Could not create secondary index dml mutex ");
+		}
 	}
 	qimdp->flag |= IMD_FLAG_LOCKSET;
 
@@ -593,6 +637,23 @@ as_sindex__populate_binid(as_namespace *ns, as_sindex_metadata *imd)
 	imd->binid = as_bin_get_or_assign_id(ns, bname);
 	cf_debug(AS_SINDEX, " Assigned %d for %s", imd->binid, imd->bname);
 
+	if (as_sindex_is_composite(imd)) {
+		if (strlen(imd->range_bname) >= AS_ID_BIN_SZ) {
+			cf_warning(AS_SINDEX, "bin name %s too big. Max size allowed is %d",
+					imd->range_bname, AS_ID_BIN_SZ-1);
+			return AS_SINDEX_ERR;
+		}
+
+		if (!as_bin_name_within_quota(ns, imd->range_bname)) {
+			cf_warning(AS_SINDEX, "Bin %s not added. Quota is full", imd->range_bname);
+			return AS_SINDEX_ERR;
+		}
+
+		strncpy(bname, imd->range_bname, AS_ID_BIN_SZ);
+		imd->range_binid = as_bin_get_or_assign_id(ns, bname);
+		cf_debug(AS_SINDEX, " Assigned %d for %s", imd->range_binid, imd->range_bname);
+	}
+
 	return AS_SINDEX_OK;
 }
 
@@ -626,7 +687,9 @@ as_sindex_imd_free(as_sindex_metadata *imd)
 	}
 
 	if (imd->flag & IMD_FLAG_LOCKSET) {
-		pthread_rwlock_destroy(&imd->slock);
+		for (int i = 0; i < AS_SINDEX_LOCK_SHARDS; i++) {
+			pthread_rwlock_destroy(&imd->slock[i].lock);
+		}
 	}
 
 	if (imd->bname) {
@@ -634,8 +697,88 @@ as_sindex_imd_free(as_sindex_metadata *imd)
 		imd->bname = NULL;
 	}
 
+	if (imd->range_bname) {
+		cf_free(imd->range_bname);
+		imd->range_bname = NULL;
+	}
+
 	return AS_SINDEX_OK;
 }
+
+// Shard of the metadata locks this thread read locks - threads are spread
+// round robin, in the order they first take one.
+static __thread int32_t t_lock_shard_ix = -1;
+static cf_atomic32 g_next_lock_shard_ix = 0;
+
+uint32_t
+as_sindex_lock_shard_ix()
+{
+	if (t_lock_shard_ix < 0) {
+		t_lock_shard_ix = (int32_t)(cf_atomic32_incr(&g_next_lock_shard_ix) % AS_SINDEX_LOCK_SHARDS);
+	}
+
+	return (uint32_t)t_lock_shard_ix;
+}
+
+// Composite keys sort by prefix, then range value. u160Cmp() compares bytes 4
+// to 19 as a little-endian 128-bit integer, then bytes 0 to 3 - so 8 bytes of
+// the prefix digest go on top, and the range value, sign-flipped to sort as
+// unsigned, below them.
+static void
+as_sindex__composite_skey(const cf_digest *prefix, int64_t value, cf_digest *key)
+{
+	uint64_t range = (uint64_t)value ^ ((uint64_t)1 << 63);
+
+	memset(key->digest, 0, 4);
+	memcpy(key->digest + 4, &range, sizeof(range));
+	memcpy(key->digest + 12, prefix->digest, sizeof(uint64_t));
+}
+
+// Digest of a composite sindex's prefix value, integer or string - queries
+// compare it in full, the key holds only part of it.
+static void
+as_sindex__composite_prefix_int(int64_t value, cf_digest *prefix)
+{
+	cf_digest_compute(&value, sizeof(value), prefix);
+}
+
+/*
+ * Returns false if the bins aren't (both) of the composite sindex's types.
+ */
+bool
+as_sindex_composite_key(as_sindex_metadata *imd, const as_bin *prefix_bin,
+		const as_bin *range_bin, cf_digest *prefix, cf_digest *key)
+{
+	if (!as_bin_inuse(prefix_bin) || !as_bin_inuse(range_bin) ||
+			as_bin_get_particle_type(range_bin) != AS_PARTICLE_TYPE_INTEGER) {
+		return false;
+	}
+
+	as_particle_type prefix_type = as_bin_get_particle_type(prefix_bin);
+
+	if (as_sindex_sktype_from_pktype(prefix_type) != imd->prefix_btype) {
+		return false;
+	}
+
+	if (prefix_type == AS_PARTICLE_TYPE_INTEGER) {
+		as_sindex__composite_prefix_int(as_bin_particle_integer_value(prefix_bin), prefix);
+	}
+	else {
+		char *str;
+		uint32_t str_sz = as_bin_particle_string_ptr(prefix_bin, &str);
+
+		if (str_sz > AS_SINDEX_MAX_STRING_KSIZE) {
+			cf_warning(AS_SINDEX, "sindex key size out of bounds %u", str_sz);
+			return false;
+		}
+
+		cf_digest_compute(str, str_sz, prefix);
+	}
+
+	as_sindex__composite_skey(prefix, as_bin_particle_integer_value(range_bin), key);
+
+	return true;
+}
 //                                           END - UTILITY
 // ************************************************************************************************
 // ************************************************************************************************
@@ -707,8 +850,8 @@ as_sindex__put_in_set_binid_hash(as_namespace * ns, char * set, int binid, int c
 /*
  * Should happen under SINDEX_GWLOCK
  */
-as_sindex_status
-as_sindex__delete_from_set_binid_hash(as_namespace * ns, as_sindex_metadata * imd)
+static as_sindex_status
+as_sindex__delete_binid_from_set_binid_hash(as_namespace * ns, as_sindex_metadata * imd, int binid)
 {
 	// Make a key
 	// Get the sindex list corresponding to key
@@ -726,10 +869,10 @@ as_sindex__delete_from_set_binid_hash(as_namespace * ns, as_sindex_metadata * im
 	char si_prop[AS_SINDEX_PROP_KEY_SIZE];
 	memset(si_prop, 0, AS_SINDEX_PROP_KEY_SIZE);
 	if (imd->set == NULL ) {
-		sprintf(si_prop, "_%d", imd->binid);
+		sprintf(si_prop, "_%d", binid);
 	}
 	else {
-		sprintf(si_prop, "%s_%d", imd->set, imd->binid);
+		sprintf(si_prop, "%s_%d", imd->set, binid);
 	}
 
 	// Get the sindex list corresponding to key
@@ -789,6 +932,24 @@ as_sindex__delete_from_set_binid_hash(as_namespace * ns, as_sindex_metadata * im
 	return AS_SINDEX_OK;
 }
 
+// A composite sindex is in the lists of both its bins.
+as_sindex_status
+as_sindex__delete_from_set_binid_hash(as_namespace * ns, as_sindex_metadata * imd)
+{
+	as_sindex_status rv = as_sindex__delete_binid_from_set_binid_hash(ns, imd, imd->binid);
+
+	if (as_sindex_is_composite(imd)) {
+		as_sindex_status range_rv = as_sindex__delete_binid_from_set_binid_hash(ns, imd,
+				imd->range_binid);
+
+		if (rv == AS_SINDEX_OK) {
+			rv = range_rv;
+		}
+	}
+
+	return rv;
+}
+
 // Hash a binname string.
 static inline uint32_t
 as_sindex__set_binid_hash_fn(void* p_key)
@@ -964,12 +1125,12 @@ as_sindex_arr_lookup_by_setname_lockfree(as_namespace * ns, const char *setname,
 			continue;
 		}
 	
-		SINDEX_RLOCK(&si->imd->slock);
+		SINDEX_IMD_RLOCK(si->imd);
 		if (!as_sindex__setname_match(si->imd, setname)) {
-			SINDEX_UNLOCK(&si->imd->slock);
+			SINDEX_IMD_RUNLOCK(si->imd);
 			continue;
 		}
-		SINDEX_UNLOCK(&si->imd->slock);
+		SINDEX_IMD_RUNLOCK(si->imd);
 	
 		AS_SINDEX_RESERVE(si);
 
@@ -1113,7 +1274,10 @@ as_sindex_exists_by_defn(as_namespace* ns, as_sindex_metadata* imd)
 	int binid     = as_bin_get_id(ns, imd->bname);
 	if(si->imd->bname && imd->bname) {
 		if (binid == si->imd->binid && !strcmp(imd->bname, si->imd->bname)
-						&& imd->btype == si->imd->btype) {
+						&& imd->btype == si->imd->btype
+						&& as_sindex_is_composite(imd) == as_sindex_is_composite(si->imd)
+						&& (!as_sindex_is_composite(imd) ||
+								!strcmp(imd->range_bname, si->imd->range_bname))) {
 			AS_SINDEX_RELEASE(si);
 			return true;
 		}
@@ -1146,6 +1310,10 @@ as_sindex__stats_clear(as_sindex *si) {
 
 	s->n_defrag_records     = 0;
 	s->defrag_time          = 0;
+	s->n_gc_validated       = 0;
+	s->gc_lock_time         = 0;
+	s->gc_cycles            = 0;
+	s->gc_pimd_ix           = 0;
 
 	// Aggregation stat
 	s->n_aggregation        = 0;
@@ -1183,6 +1351,9 @@ as_sindex__stats_clear(as_sindex *si) {
 	if (s->_query_diff_hist) {
 		histogram_clear(s->_query_diff_hist);
 	}
+	if (s->_value_hist) {
+		as_sindex_hist_clear(s->_value_hist);
+	}
 }
 
 void
@@ -1197,6 +1368,7 @@ as_sindex__config_default(as_sindex *si)
 {
 	si->config.defrag_period    = 1000;
 	si->config.defrag_max_units = 1000;
+	si->config.defrag_max_rate  = 0; // No Limit
 	si->config.data_max_memory  = ULONG_MAX; // No Limit
 	si->config.flag             = 1; // Default is - index is active
 }
@@ -1206,6 +1378,7 @@ as_sindex_config_var_copy(as_sindex *to_si, as_sindex_config_var *from_si_cfg)
 {
 	to_si->config.defrag_period    = from_si_cfg->defrag_period;
 	to_si->config.defrag_max_units = from_si_cfg->defrag_max_units;
+	to_si->config.defrag_max_rate  = from_si_cfg->defrag_max_rate;
 	to_si->config.data_max_memory  = from_si_cfg->data_max_memory;
 	to_si->enable_histogram        = from_si_cfg->enable_histogram;
 	to_si->config.flag             = from_si_cfg->ignore_not_sync_flag;
@@ -1246,6 +1419,9 @@ as_sindex__setup_histogram(as_sindex *si)
 	if (NULL == (si->stats._query_diff_hist = histogram_create(hist_name, HIST_RAW)))
 		cf_warning(AS_SINDEX, "couldn't create histogram for sindex query diff histogram");
 
+	if (NULL == (si->stats._value_hist = as_sindex_hist_create()))
+		cf_warning(AS_SINDEX, "couldn't create histogram for sindex value histogram");
+
 }
 
 int
@@ -1259,6 +1435,7 @@ as_sindex__destroy_histogram(as_sindex *si)
 	if (si->stats._query_batch_io)        cf_free(si->stats._query_batch_io);
 	if (si->stats._query_rcnt_hist)       cf_free(si->stats._query_rcnt_hist);
 	if (si->stats._query_diff_hist)       cf_free(si->stats._query_diff_hist);
+	if (si->stats._value_hist)            as_sindex_hist_destroy(si->stats._value_hist);
 	return 0;
 }
 
@@ -1278,15 +1455,15 @@ as_sindex_stats_str(as_namespace *ns, char * iname, cf_dyn_buf *db)
 	uint64_t pending     = cf_atomic64_get(si->stats.recs_pending);
 	uint64_t si_memory   = cf_atomic64_get(si->stats.mem_used);
 	// To protect the pimd while accessing it.
-	SINDEX_RLOCK(&si->imd->slock);
+	SINDEX_IMD_RLOCK(si->imd);
 	uint64_t n_keys      = ai_btree_get_numkeys(si->imd);
-	SINDEX_UNLOCK(&si->imd->slock);
+	SINDEX_IMD_RUNLOCK(si->imd);
 	info_append_uint64(db, "keys", n_keys);
 	info_append_uint64(db, "entries", si_objects);
-	SINDEX_RLOCK(&si->imd->slock);
+	SINDEX_IMD_RLOCK(si->imd);
 	uint64_t i_size      = ai_btree_get_isize(si->imd);
 	uint64_t n_size      = ai_btree_get_nsize(si->imd);
-	SINDEX_UNLOCK(&si->imd->slock);
+	SINDEX_IMD_RUNLOCK(si->imd);
 	info_append_uint64(db, "ibtr_memory_used", i_size);
 	info_append_uint64(db, "nbtr_memory_used", n_size);
 	info_append_uint64(db, "si_accounted_memory", si_memory);
@@ -1310,6 +1487,10 @@ as_sindex_stats_str(as_namespace *ns, char * iname, cf_dyn_buf *db)
 	// defrag
 	info_append_uint64(db, "stat_gc_recs", cf_atomic64_get(si->stats.n_defrag_records));
 	info_append_uint64(db, "stat_gc_time", cf_atomic64_get(si->stats.defrag_time));
+	info_append_uint64(db, "stat_gc_validated", cf_atomic64_get(si->stats.n_gc_validated));
+	info_append_uint64(db, "stat_gc_lock_time", cf_atomic64_get(si->stats.gc_lock_time) / 1000);
+	info_append_uint64(db, "stat_gc_cycles", cf_atomic64_get(si->stats.gc_cycles));
+	info_append_uint32(db, "gc_progress_pct", (100 * cf_atomic32_get(si->stats.gc_pimd_ix)) / si->imd->nprts);
 
 	// Cache values
 	uint64_t agg        = cf_atomic64_get(si->stats.n_aggregation);
@@ -1338,6 +1519,7 @@ as_sindex_stats_str(as_namespace *ns, char * iname, cf_dyn_buf *db)
 	//CONFIG
 	info_append_uint64(db, "gc-period", si->config.defrag_period);
 	info_append_uint32(db, "gc-max-units", si->config.defrag_max_units);
+	info_append_uint32(db, "gc-max-rate", si->config.defrag_max_rate);
 	if (si->config.data_max_memory != ULONG_MAX) {
 		info_append_uint64(db, "data-max-memory", si->config.data_max_memory);
 	} else {
@@ -1386,6 +1568,65 @@ as_sindex_histogram_dumpall(as_namespace *ns)
 	return AS_SINDEX_OK;
 }
 
+int
+as_sindex_value_hist_str(as_namespace *ns, char * iname, cf_dyn_buf *db)
+{
+	as_sindex *si = as_sindex_lookup_by_iname(ns, iname, AS_SINDEX_LOOKUP_FLAG_ISACTIVE);
+	if (!si) {
+		cf_warning(AS_SINDEX, "SINDEX VALUE HISTOGRAM : sindex %s not found", iname);
+		return AS_SINDEX_ERR_NOTFOUND;
+	}
+
+	int ret = AS_SINDEX_OK;
+
+	if (si->imd->btype == AS_SINDEX_KTYPE_DIGEST || !si->stats._value_hist) {
+		ret = AS_SINDEX_ERR_PARAM;
+	}
+	else {
+		as_sindex_hist_info(si->stats._value_hist, db);
+	}
+
+	AS_SINDEX_RELEASE(si);
+	return ret;
+}
+
+/*
+ * Estimated number of sindex entries a query will visit - from the value
+ * histogram for integer keys, else the mean entries per key. Composite keys
+ * are near unique, so a composite query could visit any of them.
+ */
+uint64_t
+as_sindex_estimate_n_objects(as_sindex *si, as_sindex_range *srange)
+{
+	if (as_sindex_is_composite(si->imd)) {
+		return cf_atomic64_get(si->stats.n_objects);
+	}
+
+	if (si->imd->btype == AS_SINDEX_KTYPE_DIGEST || !si->stats._value_hist) {
+		uint64_t n_keys = ai_btree_get_numkeys(si->imd);
+		return n_keys ? cf_atomic64_get(si->stats.n_objects) / n_keys : 0;
+	}
+
+	uint64_t estimate = 0;
+
+	// Geospatial queries use several ranges, the rest just the first.
+	for (int i = 0; i < MAX_REGION_CELLS && srange[i].num_binval != 0; i++) {
+		int64_t start = srange[i].start.u.i64;
+		int64_t end   = srange[i].end.u.i64;
+
+		if (start <= end) {
+			estimate += as_sindex_hist_estimate(si->stats._value_hist, start, end);
+		}
+		else {
+			// Unsigned cell ranges which straddle the sign bit.
+			estimate += as_sindex_hist_estimate(si->stats._value_hist, start, INT64_MAX) +
+					as_sindex_hist_estimate(si->stats._value_hist, INT64_MIN, end);
+		}
+	}
+
+	return estimate;
+}
+
 int
 as_sindex_histogram_enable(as_namespace *ns, char * iname, bool enable)
 {
@@ -1412,7 +1653,7 @@ as_sindex_set_config(as_namespace *ns, as_sindex_metadata *imd, char *params)
 	if (!si) {
 		return AS_SINDEX_ERR_NOTFOUND;
 	}
-	SINDEX_WLOCK(&si->imd->slock);
+	SINDEX_IMD_WLOCK(si->imd);
 	if (si->state == AS_SINDEX_ACTIVE) {
 		char context[100];
 		int  context_len = sizeof(context);
@@ -1461,16 +1702,26 @@ as_sindex_set_config(as_namespace *ns, as_sindex_metadata *imd, char *params)
 							ns->name, imd->iname, si->config.defrag_max_units, val);
 			si->config.defrag_max_units = val;
 		}
+		else if (0 == as_info_parameter_get(params, "gc-max-rate", context, &context_len)) {
+			uint64_t val = atoll(context);
+			cf_detail(AS_INFO, "gc-max-rate = %"PRIu64"",val);
+			if (val > UINT32_MAX) {
+				goto Error;
+			}
+			cf_info(AS_INFO,"Changing value of gc-max-rate of ns %s sindex %s from %u to %lu",
+							ns->name, imd->iname, si->config.defrag_max_rate, val);
+			si->config.defrag_max_rate = val;
+		}
 		else {
 			goto Error;
 		}
 	}
-	SINDEX_UNLOCK(&si->imd->slock);
+	SINDEX_IMD_WUNLOCK(si->imd);
 	AS_SINDEX_RELEASE(si);
 	return AS_SINDEX_OK;
 
 Error:
-	SINDEX_UNLOCK(&si->imd->slock);
+	SINDEX_IMD_WUNLOCK(si->imd);
 	AS_SINDEX_RELEASE(si);
 	return AS_SINDEX_ERR_PARAM;
 }
@@ -1487,7 +1738,7 @@ as_sindex_list_str(as_namespace *ns, cf_dyn_buf *db)
 		if (&(ns->sindex[i]) && (ns->sindex[i].imd)) {
 			as_sindex si = ns->sindex[i];
 			if (as_sindex_isactive(&si)) {
-				SINDEX_RLOCK(&si.imd->slock);
+				SINDEX_IMD_RLOCK(si.imd);
 			}
 			cf_dyn_buf_append_string(db, "ns=");
 			cf_dyn_buf_append_string(db, ns->name);
@@ -1497,8 +1748,13 @@ as_sindex_list_str(as_namespace *ns, cf_dyn_buf *db)
 			cf_dyn_buf_append_string(db, si.imd->iname);
 			cf_dyn_buf_append_string(db, ":bin=");
 			cf_dyn_buf_append_buf(db, (uint8_t *)si.imd->bname, strlen(si.imd->bname));
+			if (as_sindex_is_composite(si.imd)) {
+				cf_dyn_buf_append_string(db, ":range_bin=");
+				cf_dyn_buf_append_string(db, si.imd->range_bname);
+			}
 			cf_dyn_buf_append_string(db, ":type=");
-			cf_dyn_buf_append_string(db, as_sindex_ktype_str(si.imd->btype));
+			cf_dyn_buf_append_string(db, as_sindex_ktype_str(as_sindex_is_composite(si.imd) ?
+					si.imd->prefix_btype : si.imd->btype));
 			cf_dyn_buf_append_string(db, ":indextype=");
 			cf_dyn_buf_append_string(db, as_sindex_type_defs[si.imd->itype]);
 
@@ -1531,7 +1787,7 @@ as_sindex_list_str(as_namespace *ns, cf_dyn_buf *db)
 				cf_dyn_buf_append_string(db, ":state=D;");
 			}
 			if (as_sindex_isactive(&si)) {
-				SINDEX_UNLOCK(&si.imd->slock);
+				SINDEX_IMD_RUNLOCK(si.imd);
 			}
 		}
 	}
@@ -1580,7 +1836,7 @@ as_sindex_release(as_sindex *si, char *fname, int lineno)
 		}
 	}
 	else {
-		SINDEX_RLOCK(&si->imd->slock);
+		SINDEX_IMD_RLOCK(si->imd);
 		cf_debug(AS_SINDEX, "Index %s in %d state Released "
 					"to reference count  %"PRIu64" < 2 at %s:%d",
 					si->imd->iname, si->state, val, fname, lineno);
@@ -1589,7 +1845,7 @@ as_sindex_release(as_sindex *si, char *fname, int lineno)
 			cf_info(AS_SINDEX,"Returning from a sindex destroy op for: %s:%s with reference count %"PRIu64"",
 								si->ns->name, si->imd->iname, val);
 		}
-		SINDEX_UNLOCK(&si->imd->slock);
+		SINDEX_IMD_RUNLOCK(si->imd);
 	}
 	return AS_SINDEX_OK;
 }
@@ -1803,6 +2059,16 @@ as_sindex_create(as_namespace *ns, as_sindex_metadata *imd, bool user_create)
 		return AS_SINDEX_ERR;
 	}
 
+	if (as_sindex_is_composite(imd)) {
+		rv = as_sindex__put_in_set_binid_hash(ns, imd->set, imd->range_binid, id);
+		if (rv != AS_SINDEX_OK) {
+			cf_warning(AS_SINDEX, "SINDEX CREATE : Put in set_binid hash fails with error %d", rv);
+			as_sindex__delete_from_set_binid_hash(ns, imd);
+			SINDEX_GUNLOCK();
+			return AS_SINDEX_ERR;
+		}
+	}
+
 	cf_detail(AS_SINDEX, "Put binid simatch %d->%d", imd->binid, chosen_id);
 
 	char iname[AS_ID_INAME_SZ];
@@ -1832,6 +2098,9 @@ as_sindex_create(as_namespace *ns, as_sindex_metadata *imd, bool user_create)
 		si->imd->bimatch = bimatch;
 		si->state       = AS_SINDEX_ACTIVE;
 		as_sindex_set_binid_has_sindex(ns, si->imd->binid);
+		if (as_sindex_is_composite(si->imd)) {
+			as_sindex_set_binid_has_sindex(ns, si->imd->range_binid);
+		}
 		si->desync_cnt  = 0;
 		si->flag        = AS_SINDEX_FLAG_WACTIVE;
 		si->new_imd     = NULL;
@@ -1973,6 +2242,9 @@ as_sindex_destroy(as_namespace *ns, as_sindex_metadata *imd)
 		}
 		si->state = AS_SINDEX_DESTROY;
 		as_sindex_reset_binid_has_sindex(ns, imd->binid);
+		if (as_sindex_is_composite(si->imd)) {
+			as_sindex_reset_binid_has_sindex(ns, si->imd->range_binid);
+		}
 		AS_SINDEX_RELEASE(si);
 		SINDEX_GUNLOCK();
 		return AS_SINDEX_OK;
@@ -1995,6 +2267,10 @@ as_sindex_clear_stats_on_empty_index(as_sindex * si)
 	cf_atomic64_add(&si->stats.n_deletes, cf_atomic64_get(si->stats.n_objects));
 	cf_atomic64_set(&si->stats.n_keys, 0);
 	cf_atomic64_set(&si->stats.n_objects, 0);
+
+	if (si->stats._value_hist) {
+		as_sindex_hist_clear(si->stats._value_hist);
+	}
 }
 
 void
@@ -2002,13 +2278,13 @@ as_sindex_empty_index(as_sindex_metadata * imd)
 {
 	as_sindex_pmetadata * pimd;
 	for (int i=0; i<imd->nprts; i++) {
-		SINDEX_RLOCK(&imd->slock);
+		SINDEX_IMD_RLOCK(imd);
 		pimd = &imd->pimd[i];
 		SINDEX_WLOCK(&pimd->slock);
 		struct btree * ibtr = pimd->ibtr;
 		ai_btree_reinit_pimd(pimd);
 		SINDEX_UNLOCK(&pimd->slock);
-		SINDEX_UNLOCK(&imd->slock);
+		SINDEX_IMD_RUNLOCK(imd);
 		ai_btree_delete_ibtr(ibtr, pimd->imatch);
 	}
 	as_sindex_clear_stats_on_empty_index(imd->si);
@@ -2040,53 +2316,69 @@ int
 as_sindex_populate_done(as_sindex *si)
 {
 	int ret = AS_SINDEX_OK;
-	SINDEX_WLOCK(&si->imd->slock);
+	SINDEX_IMD_WLOCK(si->imd);
 	// Setting flag is atomic: meta lockless
 	si->flag |= AS_SINDEX_FLAG_RACTIVE;
 	si->flag &= ~AS_SINDEX_FLAG_POPULATING;
-	SINDEX_UNLOCK(&si->imd->slock);
+	SINDEX_IMD_WUNLOCK(si->imd);
 	return ret;
 }
 /*
- * Client API to start namespace scan to populate secondary index. The scan
- * is only performed in the namespace is warm start or if its data is not in
+ * Client API to start namespace scans to populate secondary indexes. The scan
+ * is only performed if the namespace is warm start or if its data is not in
  * memory and data is loaded from. For cold start with data in memory the indexes
- * are populate upfront.
+ * are populated upfront.
  *
- * This call is only made at the boot time.
+ * These calls are only made at boot time - start, then populate each namespace
+ * as soon as its storage has loaded, then finish once all namespaces are queued.
  */
-int
-as_sindex_boot_populateall()
+static int g_sindex_boot_ns_cnt = 0;
+
+void
+as_sindex_boot_populate_start()
 {
 	// Initialize the secondary index builder. The thread pool is initialized
 	// with maximum threads to go full throttle, then down-sized to the
 	// configured number after the startup population job is done.
 	as_sbld_init();
+}
 
-	int ns_cnt = 0;
+void
+as_sindex_boot_populate_ns(as_namespace *ns)
+{
+	// Consume any snapshot even if there are no sindexes to load it into.
+	bool loaded = as_sindex_snapshot_load(ns);
 
-	// Trigger namespace scan to populate all secondary indexes
-	// mark all secondary index for a namespace as populated
-	for (int i = 0; i < g_config.n_namespaces; i++) {
-		as_namespace *ns = g_config.namespaces[i];
-		if (!ns || (ns->sindex_cnt == 0)) {
-			continue;
-		}
+	if (ns->sindex_cnt == 0) {
+		return;
+	}
 
-		// If FAST START
-		// OR (Data not in memory AND COLD START)
-		if (!ns->cold_start
-			|| (!ns->storage_data_in_memory)) {
-			// reserve all sindexes
-			as_sindex_populator_reserve_all(ns);
+	ns->sindex_boot_start_ms = cf_getms();
+
+	// If FAST START
+	// OR (Data not in memory AND COLD START)
+	if (!ns->cold_start
+		|| (!ns->storage_data_in_memory)) {
+		// reserve all sindexes
+		as_sindex_populator_reserve_all(ns);
+
+		if (loaded) {
+			as_sindex_boot_populateall_done(ns);
+		}
+		else {
 			as_sbld_build_all(ns);
 			cf_info(AS_SINDEX, "Queuing namespace %s for sindex population ", ns->name);
-		} else {
-			as_sindex_boot_populateall_done(ns);
 		}
-		ns_cnt++;
+	} else {
+		as_sindex_boot_populateall_done(ns);
 	}
-	for (int i = 0; i < ns_cnt; i++) {
+	g_sindex_boot_ns_cnt++;
+}
+
+int
+as_sindex_boot_populate_finish()
+{
+	for (int i = 0; i < g_sindex_boot_ns_cnt; i++) {
 		int ret;
 		// blocking call, wait till an item is popped out of Q :
 		cf_queue_pop(g_sindex_populateall_done_q, &ret, CF_QUEUE_FOREVER);
@@ -2148,7 +2440,8 @@ as_sindex_boot_populateall_done(as_namespace *ns)
 	}
 	SINDEX_GUNLOCK();
 	cf_queue_push(g_sindex_populateall_done_q, &ret);
-	cf_info(AS_SINDEX, "Namespace %s sindex population done", ns->name);
+	cf_info(AS_SINDEX, "Namespace %s sindex population done in %lu ms", ns->name,
+			cf_getms() - ns->sindex_boot_start_ms);
 	return ret;
 }
 
@@ -2524,6 +2817,19 @@ as_sindex_from_range(as_namespace *ns, char *set, as_sindex_range *srange)
 		cf_warning(AS_SINDEX, "Secondary index query not allowed on single bin namespace %s", ns->name);
 		return NULL;
 	}
+	if (srange->num_binval == 2) {
+		// Composite sindexes are keyed by digest, and found by their prefix bin.
+		as_sindex *si = as_sindex_lookup_by_defns(ns, set, srange->prefix.id,
+				AS_SINDEX_KTYPE_DIGEST, srange->itype, srange->bin_path,
+				AS_SINDEX_LOOKUP_FLAG_ISACTIVE);
+		if (si && as_sindex_sktype_from_pktype(srange->prefix.type) != si->imd->prefix_btype) {
+			cf_warning(AS_SINDEX, "Query and Index Prefix Bin Type Mismatch: index %s",
+					si->imd->iname);
+			AS_SINDEX_RELEASE(si);
+			return NULL;
+		}
+		return si;
+	}
 	as_sindex *si = as_sindex_lookup_by_defns(ns, set, srange->start.id,
 						as_sindex_sktype_from_pktype(srange->start.type), srange->itype, srange->bin_path,
 						AS_SINDEX_LOOKUP_FLAG_ISACTIVE);
@@ -2646,6 +2952,13 @@ as_sindex_range_free(as_sindex_range **range)
 int
 as_sindex_assert_query(as_sindex *si, as_sindex_range *range)
 {
+	// A composite sindex takes composite queries only, and vice versa.
+	if (as_sindex_is_composite(si->imd) != (range->num_binval == 2) ||
+			(range->num_binval == 2 && si->imd->prefix_btype !=
+					as_sindex_sktype_from_pktype(range->prefix.type))) {
+		cf_warning(AS_SINDEX, "Query and index %s composite mismatch", si->imd->iname);
+		return AS_SINDEX_ERR_PARAM;
+	}
 	return as_sindex__pre_op_assert(si, AS_SINDEX_OP_READ);
 }
 
@@ -2704,7 +3017,8 @@ as_sindex_binlist_from_msg(as_namespace *ns, as_msg *msgp, int * num_bins)
  * Description -
  *		Frames a sane as_sindex_range from msg.
  *
- *		We are not supporting multiranges right now. So numrange is always expected to be 1.
+ *		We are not supporting multiranges right now. So numrange is expected to be 1 - or 2
+ *		for a composite sindex, an equality on its prefix bin then a range on its range bin.
  */
 int
 as_sindex_range_from_msg(as_namespace *ns, as_msg *msgp, as_sindex_range *srange)
@@ -2724,11 +3038,12 @@ as_sindex_range_from_msg(as_namespace *ns, as_msg *msgp, as_sindex_range *srange
 	const uint8_t *data = rfp->data;
 	int numrange        = *data++;
 
-	if (numrange != 1) {
+	if (numrange != 1 && numrange != 2) {
 		cf_warning(AS_SINDEX,
 					"can't handle multiple ranges right now %d", rfp->data[0]);
 		return AS_SINDEX_ERR_PARAM;
 	}
+	char prefix_path[AS_SINDEX_MAX_PATH_LENGTH];
 	// NOTE - to support geospatial queries the srange object is actually a vector
 	// of MAX_REGION_CELLS elements.  Normal queries only use the first element.
 	// Geospatial queries use multiple elements.
@@ -2743,6 +3058,19 @@ as_sindex_range_from_msg(as_namespace *ns, as_msg *msgp, as_sindex_range *srange
 	for (int i = 0; i < numrange; i++) {
 		as_sindex_bin_data *start = &(srange->start);
 		as_sindex_bin_data *end   = &(srange->end);
+		if (i == 1) {
+			// Composite query - the first range was the prefix's equality.
+			if (srange->isrange || (start->type != AS_PARTICLE_TYPE_INTEGER &&
+					start->type != AS_PARTICLE_TYPE_STRING)) {
+				cf_warning(AS_SINDEX, "Composite query needs an integer or string equality first");
+				goto Cleanup;
+			}
+			srange->prefix = *start;
+			if (start->type == AS_PARTICLE_TYPE_INTEGER) {
+				as_sindex__composite_prefix_int(start->u.i64, &srange->prefix.digest);
+			}
+			strcpy(prefix_path, srange->bin_path);
+		}
 		// Populate Bin id
 		uint8_t bin_path_len         = *data++;
 		if (bin_path_len >= AS_SINDEX_MAX_PATH_LENGTH) {
@@ -2899,17 +3227,23 @@ as_sindex_range_from_msg(as_namespace *ns, as_msg *msgp, as_sindex_range *srange
 			} else {
 				// POINTS-INSIDE-REGION QUERY
 
+				// One range per run of adjacent cells, from the covering
+				// cache if this region was queried recently.
 				uint64_t cellmin[MAX_REGION_CELLS];
 				uint64_t cellmax[MAX_REGION_CELLS];
 				int numcells;
-				if (!geo_region_cover(ns, srange->region, MAX_REGION_CELLS,
-									  NULL, cellmin, cellmax, &numcells)) {
+				bool cached;
+				if (!geo_region_cover_ranges(ns, start_binval, startl, srange->region,
+									  MAX_REGION_CELLS, cellmin, cellmax, &numcells, &cached)) {
 					cf_warning(AS_GEO, "Query region invalid.");
 					goto Cleanup;
 				}
 
 				cf_atomic64_incr(&ns->geo_region_query_count);
 				cf_atomic64_add(&ns->geo_region_query_cells, numcells);
+				if (cached) {
+					cf_atomic64_incr(&ns->geo_region_query_cache_hits);
+				}
 
 				// Geospatial queries use multiple srange elements.	 Many
 				// of the fields are copied from the first cell because
@@ -2932,6 +3266,26 @@ as_sindex_range_from_msg(as_namespace *ns, as_msg *msgp, as_sindex_range *srange
 		}
 		srange->num_binval = numrange;
 	}
+
+	if (numrange == 2) {
+		as_sindex_bin_data *start = &(srange->start);
+		as_sindex_bin_data *end   = &(srange->end);
+		if (start->type != AS_PARTICLE_TYPE_INTEGER) {
+			cf_warning(AS_SINDEX, "Composite query needs an integer range second");
+			goto Cleanup;
+		}
+		// The composite sindex's path - see as_info_parse_params_to_sindex_imd().
+		char range_path[AS_SINDEX_MAX_PATH_LENGTH];
+		strcpy(range_path, srange->bin_path);
+		if (snprintf(srange->bin_path, AS_SINDEX_MAX_PATH_LENGTH, "%s,%s", prefix_path,
+				range_path) >= AS_SINDEX_MAX_PATH_LENGTH) {
+			cf_warning(AS_SINDEX, "Composite query bin paths too long");
+			goto Cleanup;
+		}
+		as_sindex__composite_skey(&srange->prefix.digest, start->u.i64, &start->digest);
+		as_sindex__composite_skey(&srange->prefix.digest, end->u.i64, &end->digest);
+		srange->isrange = TRUE;
+	}
 	return AS_SINDEX_OK;
 
 Cleanup:
@@ -2995,19 +3349,19 @@ as_sindex_query(as_sindex *si, as_sindex_range *srange, as_sindex_qctx *qctx)
 {
 	if ((!si || !srange)) return AS_SINDEX_ERR_PARAM;
 	as_sindex_metadata *imd = si->imd;
-	SINDEX_RLOCK(&imd->slock);
+	SINDEX_IMD_RLOCK(imd);
 	SINDEX_RLOCK(&imd->pimd[qctx->pimd_idx].slock);
 	int ret = as_sindex__pre_op_assert(si, AS_SINDEX_OP_READ);
 	if (AS_SINDEX_OK != ret) {
 		SINDEX_UNLOCK(&imd->pimd[qctx->pimd_idx].slock);
-		SINDEX_UNLOCK(&imd->slock);
+		SINDEX_IMD_RUNLOCK(imd);
 		return ret;
 	}
 	uint64_t starttime = 0;
 	ret = ai_btree_query(imd, srange, qctx);
 	as_sindex__process_ret(si, ret, AS_SINDEX_OP_READ, starttime, __LINE__);
 	SINDEX_UNLOCK(&imd->pimd[qctx->pimd_idx].slock);
-	SINDEX_UNLOCK(&imd->slock);
+	SINDEX_IMD_RUNLOCK(imd);
 	return ret;
 }
 //                                        END -  SINDEX QUERY
@@ -3046,112 +3400,200 @@ as_sindex_sbin_freeall(as_sindex_bin *sbin, int numbins)
 	return AS_SINDEX_OK;
 }
 
-as_sindex_status
-as_sindex__op_by_sbin(as_namespace *ns, const char *set, int numbins, as_sindex_bin *start_sbin, cf_digest * pkey)
-{
-	// If numbins == 0 return AS_SINDEX_OK
-	// Iterate through sbins
-	// 		Reserve the SI.
-	// 		Take the read lock on imd
-	//		Get a value from sbin
-	//			Get the related pimd
-	//			Get the pimd write lock
-	//			If op is DELETE delete the values from sbin from sindex
-	//			If op is INSERT put all the values from bin in sindex.
-	//			Release the pimd lock
-	//		Release the imd lock.
-	//		Release the SI.
-
-	as_sindex_status retval = AS_SINDEX_OK;
-	if (!ns || !start_sbin) {
+// Key of the j'th value of an sbin - the first is held in the sbin itself.
+static void *
+as_sindex__sbin_skey(as_sindex_bin *sbin, uint64_t j)
+{
+	switch (sbin->type) {
+	case AS_PARTICLE_TYPE_INTEGER:
+	case AS_PARTICLE_TYPE_GEOJSON:
+		return j == 0 ? (void *)&sbin->value.int_val : (void *)((uint64_t *)sbin->values + j);
+	case AS_PARTICLE_TYPE_STRING:
+		return j == 0 ? (void *)&sbin->value.str_val : (void *)((cf_digest *)sbin->values + j);
+	default:
+		return NULL;
+	}
+}
+
+// Whether an sbin with the other op has the same key. Deleting and inserting a
+// key leaves the sindex as it was, so both are skipped.
+static bool
+as_sindex__sbins_cancel(as_sindex_bin **sbins, int n_sbins, as_sindex_op op,
+		const void *skey, size_t key_sz)
+{
+	for (int i = 0; i < n_sbins; i++) {
+		if (sbins[i]->op == op) {
+			continue;
+		}
+
+		for (uint64_t j = 0; j < sbins[i]->num_values; j++) {
+			if (memcmp(as_sindex__sbin_skey(sbins[i], j), skey, key_sz) == 0) {
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+typedef struct sindex_op_s {
+	uint32_t      pimd_ix;
+	uint32_t      seq;
+	as_sindex_op  op;
+	int           ret;
+	void        * skey;
+} sindex_op;
+
+static int
+sindex_op_cmp(const void *a, const void *b)
+{
+	const sindex_op *op_a = (const sindex_op *)a;
+	const sindex_op *op_b = (const sindex_op *)b;
+
+	if (op_a->pimd_ix != op_b->pimd_ix) {
+		return op_a->pimd_ix < op_b->pimd_ix ? -1 : 1;
+	}
+
+	return op_a->seq < op_b->seq ? -1 : (op_a->seq > op_b->seq ? 1 : 0);
+}
+
+#define SINDEX_OPS_ON_STACK        64
+#define SINDEX_OPS_INSERTION_SORT  16
+#define SINDEX_CANCEL_MAX_PAIRS    1024 // bigger lists were already diffed
+
+/*
+ * Applies all of the sbins of one sindex, under one metadata lock, with one
+ * pimd lock per pimd touched. Deletes go before inserts within each pimd, as
+ * the same key may be in both - and the same key is always in the same pimd.
+ */
+static as_sindex_status
+as_sindex__op_by_si(as_sindex *si, as_sindex_bin **sbins, int n_sbins, cf_digest *pkey)
+{
+	as_sindex_metadata *imd = si->imd;
+	size_t key_sz;
+
+	switch (sbins[0]->type) {
+	case AS_PARTICLE_TYPE_INTEGER:
+	case AS_PARTICLE_TYPE_GEOJSON:
+		key_sz = sizeof(uint64_t);
+		break;
+	case AS_PARTICLE_TYPE_STRING:
+		key_sz = sizeof(cf_digest);
+		break;
+	default:
 		return AS_SINDEX_ERR;
 	}
 
-	// If numbins != 1 return AS_SINDEX_OK
-	if (numbins != 1 ) {
+	uint64_t n_dels = 0;
+	uint64_t n_ins  = 0;
+
+	for (int i = 0; i < n_sbins; i++) {
+		if (sbins[i]->op == AS_SINDEX_OP_DELETE) {
+			n_dels += sbins[i]->num_values;
+		}
+		else if (sbins[i]->op == AS_SINDEX_OP_INSERT) {
+			n_ins += sbins[i]->num_values;
+		}
+	}
+
+	uint64_t n_ops = n_dels + n_ins;
+
+	if (n_ops == 0) {
 		return AS_SINDEX_OK;
 	}
 
-	as_sindex * si             = NULL;
-	as_sindex_bin * sbin   = NULL;
-	as_sindex_metadata * imd   = NULL;
-	as_sindex_pmetadata * pimd = NULL;
-	as_sindex_op op;
-	// Iterate through sbins
-	for (int i=0; i<numbins; i++) {
-	// 		Reserve the SI.
-		sbin = &start_sbin[i];
-		si = sbin->si;
-		if (!si) {
-			cf_warning(AS_SINDEX, "as_sindex_op_by_sbin : si is null in sbin");
-			return AS_SINDEX_ERR;
+	bool cancel = n_dels != 0 && n_ins != 0 && n_dels * n_ins <= SINDEX_CANCEL_MAX_PAIRS;
+	sindex_op stack_ops[SINDEX_OPS_ON_STACK];
+	sindex_op *ops = n_ops <= SINDEX_OPS_ON_STACK ?
+			stack_ops : cf_malloc(n_ops * sizeof(sindex_op));
+
+	SINDEX_IMD_RLOCK(imd);
+
+	if (AS_SINDEX_OK != as_sindex__pre_op_assert(si, AS_SINDEX_OP_INSERT)) {
+		SINDEX_IMD_RUNLOCK(imd);
+
+		if (ops != stack_ops) {
+			cf_free(ops);
 		}
-		imd =  si->imd;
-		op = sbin->op;
-	// 		Take the read lock on imd
-		SINDEX_RLOCK(&imd->slock);
-		for (int j=0; j<sbin->num_values; j++) {
 
-			int ret = as_sindex__pre_op_assert(si, op);
-			if (AS_SINDEX_OK != ret) {
-				goto Cleanup;
+		return AS_SINDEX_OK;
+	}
+
+	uint32_t n = 0;
+
+	for (int pass = 0; pass < 2; pass++) {
+		as_sindex_op op = pass == 0 ? AS_SINDEX_OP_DELETE : AS_SINDEX_OP_INSERT;
+
+		for (int i = 0; i < n_sbins; i++) {
+			if (sbins[i]->op != op) {
+				continue;
 			}
-	//		Get a value from sbin
-			void * skey;
-			switch (sbin->type) {
-			case AS_PARTICLE_TYPE_INTEGER:
-			case AS_PARTICLE_TYPE_GEOJSON:
-				if (j==0) {
-					skey = (void *)&(sbin->value.int_val);
-				}
-				else {
-					skey = (void *)((uint64_t *)(sbin->values) + j);
-				}
-				break;
-			case AS_PARTICLE_TYPE_STRING:
-				if (j==0) {
-					skey = (void *)&(sbin->value.str_val);
-				}
-				else {
-					skey = (void *)((cf_digest *)(sbin->values) + j);
+
+			for (uint64_t j = 0; j < sbins[i]->num_values; j++) {
+				void *skey = as_sindex__sbin_skey(sbins[i], j);
+
+				if (cancel && as_sindex__sbins_cancel(sbins, n_sbins, op, skey, key_sz)) {
+					continue;
 				}
-				break;
-			default:
-				retval = AS_SINDEX_ERR;
-				goto Cleanup;
-			}
-	//			Get the related pimd
-			pimd = &imd->pimd[ai_btree_key_hash(imd, skey)];
-			uint64_t starttime = 0;
-			if (si->enable_histogram) {
-				starttime = cf_getns();
+
+				ops[n].pimd_ix = ai_btree_key_hash(imd, skey);
+				ops[n].seq     = n;
+				ops[n].op      = op;
+				ops[n].skey    = skey;
+				n++;
 			}
+		}
+	}
 
-	//			Get the pimd write lock
-			SINDEX_WLOCK(&pimd->slock);
+	// Group by pimd, keeping the order within each pimd.
+	if (n > SINDEX_OPS_INSERTION_SORT) {
+		qsort(ops, n, sizeof(sindex_op), sindex_op_cmp);
+	}
+	else {
+		for (uint32_t i = 1; i < n; i++) {
+			sindex_op op = ops[i];
+			uint32_t k   = i;
 
-	//			If op is DELETE delete the value from sindex
-			if (op == AS_SINDEX_OP_DELETE) {
-				ret = ai_btree_delete(imd, pimd, skey, pkey);
-			}
-			else if (op == AS_SINDEX_OP_INSERT) {
-	//			If op is INSERT put the value in sindex.
-				ret = ai_btree_put(imd, pimd, skey, pkey);
+			for (; k > 0 && ops[k - 1].pimd_ix > op.pimd_ix; k--) {
+				ops[k] = ops[k - 1];
 			}
 
-	//			Release the pimd lock
-			SINDEX_UNLOCK(&pimd->slock);
-			as_sindex__process_ret(si, ret, op, starttime, __LINE__);
+			ops[k] = op;
+		}
+	}
+
+	for (uint32_t i = 0; i < n; ) {
+		uint32_t pimd_ix = ops[i].pimd_ix;
+		as_sindex_pmetadata *pimd = &imd->pimd[pimd_ix];
+		uint32_t first = i;
+		uint64_t starttime = 0;
+
+		if (si->enable_histogram) {
+			starttime = cf_getns();
 		}
-		cf_debug(AS_SINDEX, " Secondary Index Op Finish------------- ");
 
-	//		Release the imd lock.
-	//		Release the SI.
+		SINDEX_WLOCK(&pimd->slock);
+
+		for (; i < n && ops[i].pimd_ix == pimd_ix; i++) {
+			ops[i].ret = ops[i].op == AS_SINDEX_OP_DELETE ?
+					ai_btree_delete(imd, pimd, ops[i].skey, pkey) :
+					ai_btree_put(imd, pimd, ops[i].skey, pkey);
+		}
 
+		SINDEX_UNLOCK(&pimd->slock);
+
+		for (uint32_t k = first; k < i; k++) {
+			as_sindex__process_ret(si, ops[k].ret, ops[k].op, starttime, __LINE__);
+		}
 	}
-	Cleanup:
-	SINDEX_UNLOCK(&imd->slock);
-	return retval;
+
+	SINDEX_IMD_RUNLOCK(imd);
+
+	if (ops != stack_ops) {
+		cf_free(ops);
+	}
+
+	return AS_SINDEX_OK;
 }
 //                                       END - SBIN UTILITY
 // ************************************************************************************************
@@ -3441,40 +3883,29 @@ as_sindex_add_geo2dsphere_from_as_val(as_val *val, as_sindex_bin *sbin)
 	const char *s = as_geojson_get(g);
 	size_t jsonsz = as_geojson_len(g);
 	uint64_t parsed_cellid = 0;
-	geo_region_t parsed_region = NULL;
 
-	if (! geo_parse(NULL, s, jsonsz, &parsed_cellid, &parsed_region)) {
-		cf_warning(AS_PARTICLE, "geo_parse() failed - unexpected");
-		geo_region_destroy(parsed_region);
+	if (! geo_json_point(s, jsonsz, &parsed_cellid)) {
+		cf_warning(AS_PARTICLE, "geo_json_point() failed - unexpected");
 		return AS_SINDEX_ERR;
 	}
 
 	if (parsed_cellid) {
-		if (parsed_region) {
-			geo_region_destroy(parsed_region);
-			cf_warning(AS_PARTICLE, "geo_parse found both point and region");
-			return AS_SINDEX_ERR;
-		}
-
 		// POINT
 		if (as_sindex_add_integer_to_sbin(sbin, parsed_cellid) != AS_SINDEX_OK) {
 			cf_warning(AS_PARTICLE, "as_sindex_add_integer_to_sbin() failed - unexpected");
 			return AS_SINDEX_ERR;
 		}
 	}
-	else if (parsed_region) {
+	else {
 		// REGION
 		int numcells;
 		uint64_t outcells[MAX_REGION_CELLS];
 
-		if (! geo_region_cover(NULL, parsed_region, MAX_REGION_CELLS, outcells, NULL, NULL, &numcells)) {
-			geo_region_destroy(parsed_region);
-			cf_warning(AS_PARTICLE, "geo_region_cover failed");
+		if (! geo_json_region_cover(s, jsonsz, MAX_REGION_CELLS, outcells, &numcells)) {
+			cf_warning(AS_PARTICLE, "geo_json_region_cover failed");
 			return AS_SINDEX_ERR;
 		}
 
-		geo_region_destroy(parsed_region);
-
 		int added = 0;
 		for (size_t i = 0; i < numcells; i++) {
 			if (as_sindex_add_integer_to_sbin(sbin, outcells[i]) == AS_SINDEX_OK) {
@@ -3489,10 +3920,6 @@ as_sindex_add_geo2dsphere_from_as_val(as_val *val, as_sindex_bin *sbin)
 			return AS_SINDEX_ERR;
 		}
 	}
-	else {
-		cf_warning(AS_PARTICLE, "geo_parse found neither point nor region");
-		return AS_SINDEX_ERR;
-	}
 
 	return AS_SINDEX_OK;
 }
@@ -3521,10 +3948,64 @@ typedef struct as_sindex_cdt_sbin_s {
 	as_sindex_bin * sbin;
 } as_sindex_cdt_sbin;
 
+// String elements of a list or map are collected, so their digests can be
+// computed several at a time - see cf_digest_compute_mb().
+#define SINDEX_CDT_DIGEST_BATCH 16
+
+typedef struct as_sindex_cdt_batch_s {
+	as_sindex_bin * sbin;
+	uint32_t        n_strs;
+	const void *    strs[SINDEX_CDT_DIGEST_BATCH];
+	size_t          str_lens[SINDEX_CDT_DIGEST_BATCH];
+} as_sindex_cdt_batch;
+
+static void
+as_sindex_cdt_batch_flush(as_sindex_cdt_batch * batch)
+{
+	if (batch->n_strs == 0) {
+		return;
+	}
+
+	cf_digest digests[SINDEX_CDT_DIGEST_BATCH];
+
+	cf_digest_compute_mb(batch->strs, batch->str_lens, batch->n_strs, digests);
+
+	for (uint32_t i = 0; i < batch->n_strs; i++) {
+		as_sindex_add_digest_to_sbin(batch->sbin, digests[i]);
+	}
+
+	batch->n_strs = 0;
+}
+
+static void
+as_sindex_cdt_batch_add(as_sindex_cdt_batch * batch, as_val * element)
+{
+	as_sindex_bin * sbin = batch->sbin;
+
+	if (sbin->type != AS_PARTICLE_TYPE_STRING) {
+		as_sindex_add_keytype_from_asval[as_sindex_key_type_from_pktype(sbin->type)](element, sbin);
+		return;
+	}
+
+	// Same checks as as_sindex_add_digest_from_asval().
+	as_string * s = element ? as_string_fromval(element) : NULL;
+	char * str_val = s ? as_string_get(s) : NULL;
+
+	if (! str_val) {
+		return;
+	}
+
+	batch->strs[batch->n_strs] = str_val;
+	batch->str_lens[batch->n_strs] = strlen(str_val);
+
+	if (++batch->n_strs == SINDEX_CDT_DIGEST_BATCH) {
+		as_sindex_cdt_batch_flush(batch);
+	}
+}
+
 static bool as_sindex_add_listvalues_foreach(as_val * element, void * udata)
 {
-	as_sindex_bin * sbin = (as_sindex_bin *)udata;
-	as_sindex_add_keytype_from_asval[as_sindex_key_type_from_pktype(sbin->type)](element, sbin);
+	as_sindex_cdt_batch_add((as_sindex_cdt_batch *)udata, element);
 	return true;
 }
 
@@ -3549,23 +4030,23 @@ as_sindex_add_asval_to_list_sindex(as_val *val, as_sindex_bin * sbin)
 	}
 	// Else iterate through all elements of map
 	as_list * list               = as_list_fromval(val);
-	if (as_list_foreach(list, as_sindex_add_listvalues_foreach, sbin)) {
-		return AS_SINDEX_OK;
-	}
-	return AS_SINDEX_ERR;
+	as_sindex_cdt_batch batch    = { .sbin = sbin, .n_strs = 0 };
+	bool ok                      = as_list_foreach(list, as_sindex_add_listvalues_foreach, &batch);
+
+	as_sindex_cdt_batch_flush(&batch);
+
+	return ok ? AS_SINDEX_OK : AS_SINDEX_ERR;
 }
 
 static bool as_sindex_add_mapkeys_foreach(const as_val * key, const as_val * val, void * udata)
 {
-	as_sindex_bin * sbin = (as_sindex_bin *)udata;
-	as_sindex_add_keytype_from_asval[as_sindex_key_type_from_pktype(sbin->type)]((as_val *)key, sbin);
+	as_sindex_cdt_batch_add((as_sindex_cdt_batch *)udata, (as_val *)key);
 	return true;
 }
 
 static bool as_sindex_add_mapvalues_foreach(const as_val * key, const as_val * val, void * udata)
 {
-	as_sindex_bin * sbin = (as_sindex_bin *)udata;
-	as_sindex_add_keytype_from_asval[as_sindex_key_type_from_pktype(sbin->type)]((as_val *)val, sbin);
+	as_sindex_cdt_batch_add((as_sindex_cdt_batch *)udata, (as_val *)val);
 	return true;
 }
 
@@ -3585,10 +4066,12 @@ as_sindex_add_asval_to_mapkeys_sindex(as_val *val, as_sindex_bin * sbin)
 
 	// Else iterate through all keys of map
 	as_map * map                   = as_map_fromval(val);
-	if (as_map_foreach(map, as_sindex_add_mapkeys_foreach, sbin)) {
-		return AS_SINDEX_OK;
-	}
-	return AS_SINDEX_ERR;
+	as_sindex_cdt_batch batch      = { .sbin = sbin, .n_strs = 0 };
+	bool ok                        = as_map_foreach(map, as_sindex_add_mapkeys_foreach, &batch);
+
+	as_sindex_cdt_batch_flush(&batch);
+
+	return ok ? AS_SINDEX_OK : AS_SINDEX_ERR;
 }
 
 as_sindex_status
@@ -3612,10 +4095,12 @@ as_sindex_add_asval_to_mapvalues_sindex(as_val *val, as_sindex_bin * sbin)
 	}
 	// Else iterate through all keys, values of map
 	as_map * map                  = as_map_fromval(val);
-	if (as_map_foreach(map, as_sindex_add_mapvalues_foreach, sbin)) {
-		return AS_SINDEX_OK;
-	}
-	return AS_SINDEX_ERR;
+	as_sindex_cdt_batch batch     = { .sbin = sbin, .n_strs = 0 };
+	bool ok                       = as_map_foreach(map, as_sindex_add_mapvalues_foreach, &batch);
+
+	as_sindex_cdt_batch_flush(&batch);
+
+	return ok ? AS_SINDEX_OK : AS_SINDEX_ERR;
 }
 
 typedef as_sindex_status (*as_sindex_add_asval_to_itype_sindex_fn)
@@ -3858,7 +4343,7 @@ as_sindex_sbins_sindex_list_diff_populate(as_sindex_bin *sbins, as_sindex *si, c
 			cdt_payload ele;
 
 			ele.ptr = pk_long->buffer + pk_long->offset;
-			ele.size = as_unpack_size(pk_long);
+			ele.size = cdt_unpack_size(pk_long);
 
 			// sizeof(cf_digest) is big enough for all key types we support so far.
 			uint8_t skey[sizeof(cf_digest)];
@@ -3890,7 +4375,7 @@ as_sindex_sbins_sindex_list_diff_populate(as_sindex_bin *sbins, as_sindex *si, c
 				.ptr = pk_short->buffer + pk_short->offset
 		};
 
-		int size = as_unpack_size(pk_short);
+		int size = cdt_unpack_size(pk_short);
 
 		if (size < 0) {
 			cf_warning(AS_SINDEX, "as_sindex_sbins_sindex_list_diff_populate() list unpack failed");
@@ -3913,7 +4398,7 @@ as_sindex_sbins_sindex_list_diff_populate(as_sindex_bin *sbins, as_sindex *si, c
 		cdt_payload ele;
 
 		ele.ptr = pk_long->buffer + pk_long->offset;
-		ele.size = as_unpack_size(pk_long);
+		ele.size = cdt_unpack_size(pk_long);
 
 		if (! packed_val_add_sbin_or_update_shash(&ele, sbins, hash, expected_type)) {
 			cf_warning(AS_SINDEX, "as_sindex_sbins_sindex_list_diff_populate() hash update failed");
@@ -4000,7 +4485,7 @@ as_sindex_sbins_list_diff_populate(as_sindex_bin *sbins, as_namespace *ns, const
 		int simatch = si_ele->simatch;
 		as_sindex *si = &ns->sindex[simatch];
 
-		if (! as_sindex_isactive(si)) {
+		if (! as_sindex_isactive(si) || as_sindex_is_composite(si->imd)) {
 			ele = ele->next;
 			continue;
 		}
@@ -4200,7 +4685,8 @@ as_sindex_sbins_from_bin_buf(as_namespace *ns, const char *set, const as_bin *b,
 		si_ele                = (sindex_set_binid_hash_ele *) ele;
 		simatch               = si_ele->simatch;
 		si                    = &ns->sindex[simatch];
-		if (!as_sindex_isactive(si)) {
+		// Composite sindexes need both bins - see as_sindex_sbins_composite_from_bins().
+		if (!as_sindex_isactive(si) || as_sindex_is_composite(si->imd)) {
 			ele = ele->next;
 			continue;
 		}
@@ -4235,6 +4721,92 @@ as_sindex_sbins_from_bin(as_namespace *ns, const char *set, const as_bin *b, as_
 	return as_sindex_sbins_from_bin_buf(ns, set, b, start_sbin, op);
 }
 
+static const as_bin *
+as_sindex__bin_by_id(const as_bin *bins, uint16_t n_bins, uint32_t binid)
+{
+	for (uint16_t i = 0; i < n_bins; i++) {
+		if (as_bin_inuse(&bins[i]) && bins[i].id == binid) {
+			return &bins[i];
+		}
+	}
+
+	return NULL;
+}
+
+// Returns the number of sbins found - 1 or 0.
+static int
+as_sindex__composite_sbin(as_sindex *si, const as_bin *bins, uint16_t n_bins,
+		as_sindex_bin *sbin, as_sindex_op op)
+{
+	const as_bin *prefix_bin = as_sindex__bin_by_id(bins, n_bins, si->imd->binid);
+	const as_bin *range_bin  = as_sindex__bin_by_id(bins, n_bins, si->imd->range_binid);
+	cf_digest prefix;
+	cf_digest key;
+
+	if (!prefix_bin || !range_bin ||
+			!as_sindex_composite_key(si->imd, prefix_bin, range_bin, &prefix, &key)) {
+		return 0;
+	}
+
+	as_sindex_init_sbin(sbin, op, AS_PARTICLE_TYPE_STRING, si);
+
+	if (as_sindex_add_digest_to_sbin(sbin, key) != AS_SINDEX_OK || !sbin->num_values) {
+		as_sindex_sbin_free(sbin);
+		return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * Composite sindexes' keys come from two bins, so their sbins are built from
+ * the record's bins rather than per bin - for the composite sindexes over bin
+ * binid, or all of them for binid -1. Callers delete using the old bins and
+ * insert using the new - pairs with the same key cancel out when applied.
+ *
+ * Returns the number of sbins found.
+ */
+int
+as_sindex_sbins_composite_from_bins(as_namespace *ns, const char *set, const as_bin *bins,
+		uint16_t n_bins, int binid, as_sindex_bin *start_sbin, as_sindex_op op)
+{
+	int sindex_found = 0;
+
+	for (uint16_t i = 0; i < n_bins; i++) {
+		const as_bin *b = &bins[i];
+
+		if (!as_bin_inuse(b) || (binid != -1 && b->id != binid) ||
+				!as_sindex_binid_has_sindex(ns, b->id)) {
+			continue;
+		}
+
+		cf_ll *simatch_ll = NULL;
+		as_sindex__simatch_list_by_set_binid(ns, set, b->id, &simatch_ll);
+
+		if (!simatch_ll) {
+			continue;
+		}
+
+		for (cf_ll_element *ele = cf_ll_get_head(simatch_ll); ele; ele = ele->next) {
+			as_sindex *si = &ns->sindex[((sindex_set_binid_hash_ele *)ele)->simatch];
+
+			if (!as_sindex_isactive(si) || !as_sindex_is_composite(si->imd)) {
+				continue;
+			}
+
+			// Over all bins, take each sindex once - at its prefix bin.
+			if (binid == -1 && si->imd->binid != b->id) {
+				continue;
+			}
+
+			sindex_found += as_sindex__composite_sbin(si, bins, n_bins,
+					&start_sbin[sindex_found], op);
+		}
+	}
+
+	return sindex_found;
+}
+
 /*
  * returns number of sbins found.
  */
@@ -4249,26 +4821,47 @@ as_sindex_sbins_from_rd(as_storage_rd *rd, uint16_t from_bin, uint16_t to_bin, a
 	return count;
 }
 
-// Needs comments
+// Applies a transaction's sbins, grouped by sindex - see as_sindex__op_by_si().
 int
 as_sindex_update_by_sbin(as_namespace *ns, const char *set, as_sindex_bin *start_sbin, int num_sbins, cf_digest * pkey)
 {
 	cf_debug(AS_SINDEX, "as_sindex_update_by_sbin");
 
-	// Need to address sbins which have OP as AS_SINDEX_OP_DELETE before the ones which have
-	// OP as AS_SINDEX_OP_INSERT. This is because same secondary index key can exist in sbins
-	// with different OPs
+	if (!ns || !start_sbin || num_sbins <= 0) {
+		return AS_SINDEX_OK;
+	}
+
 	int sindex_ret = AS_SINDEX_OK;
-	for (int i=0; i<num_sbins; i++) {
-		if (start_sbin[i].op == AS_SINDEX_OP_DELETE) {
-			sindex_ret = as_sindex__op_by_sbin(ns, set, 1, &start_sbin[i], pkey);
+	as_sindex_bin *group[num_sbins];
+	bool done[num_sbins];
+
+	memset(done, 0, sizeof(done));
+
+	for (int i = 0; i < num_sbins; i++) {
+		if (done[i]) {
+			continue;
 		}
-	}
-	for (int i=0; i<num_sbins; i++) {
-		if (start_sbin[i].op == AS_SINDEX_OP_INSERT) {
-			sindex_ret = as_sindex__op_by_sbin(ns, set, 1, &start_sbin[i], pkey);
+
+		as_sindex *si = start_sbin[i].si;
+
+		if (!si) {
+			cf_warning(AS_SINDEX, "as_sindex_update_by_sbin : si is null in sbin");
+			sindex_ret = AS_SINDEX_ERR;
+			continue;
+		}
+
+		int n_group = 0;
+
+		for (int k = i; k < num_sbins; k++) {
+			if (!done[k] && start_sbin[k].si == si) {
+				group[n_group++] = &start_sbin[k];
+				done[k] = true;
+			}
 		}
+
+		sindex_ret = as_sindex__op_by_si(si, group, n_group, pkey);
 	}
+
 	return sindex_ret;
 }
 //                                 END - SBIN INTERFACE FUNCTIONS
@@ -4313,14 +4906,14 @@ as_sindex_put_rd(as_sindex *si, as_storage_rd *rd)
 	if (as_index_has_set(rd->r)) {
 		setname = as_index_get_set_name(rd->r, si->ns);
 	}
-	SINDEX_RLOCK(&imd->slock);
+	SINDEX_IMD_RLOCK(imd);
 	if (!as_sindex__setname_match(imd, setname)) {
-		SINDEX_UNLOCK(&imd->slock);
+		SINDEX_IMD_RUNLOCK(imd);
 		SINDEX_GUNLOCK();
 		return AS_SINDEX_OK;
 	}
 
-	SINDEX_UNLOCK(&imd->slock);
+	SINDEX_IMD_RUNLOCK(imd);
 
 	// collect sbins
 	SINDEX_BINS_SETUP(sbins, 1);
@@ -4328,6 +4921,19 @@ as_sindex_put_rd(as_sindex *si, as_storage_rd *rd)
 	int sbins_populated = 0;
 	as_val * cdt_val = NULL;
 
+	if (as_sindex_is_composite(imd)) {
+		sbins_populated = as_sindex__composite_sbin(si, rd->bins, rd->n_bins, sbins,
+				AS_SINDEX_OP_INSERT);
+		SINDEX_GUNLOCK();
+
+		if (sbins_populated) {
+			as_sindex_update_by_sbin(rd->ns, setname, sbins, sbins_populated, &rd->keyd);
+			as_sindex_sbin_freeall(sbins, sbins_populated);
+		}
+
+		return AS_SINDEX_OK;
+	}
+
 	as_bin *b = as_bin_get(rd, imd->bname);
 
 	if (!b) {
@@ -4786,7 +5392,7 @@ as_sindex_smd_accept_cb(char *module, as_smd_item_list_t *items, void *udata, ui
 					as_sindex *si = &local_ns->sindex[i];
 					if (si && si->imd && as_sindex_isactive(si)) {
 						int found     = 0;
-						SINDEX_RLOCK(&si->imd->slock);
+						SINDEX_IMD_RLOCK(si->imd);
 						for (int j = 0; j < items->num_items; j++) {
 							char key[256];
 							sprintf(key, "%s:%s", si->imd->ns_name, si->imd->iname);
@@ -4798,7 +5404,7 @@ as_sindex_smd_accept_cb(char *module, as_smd_item_list_t *items, void *udata, ui
 								break;
 							}
 						}
-						SINDEX_UNLOCK(&si->imd->slock);
+						SINDEX_IMD_RUNLOCK(si->imd);
 
 						if (found == 0) { // Was not found in the merged list from paxos principal
 							AS_SINDEX_RESERVE(si);
@@ -4828,17 +5434,50 @@ as_sindex_smd_accept_cb(char *module, as_smd_item_list_t *items, void *udata, ui
 // ************************************************************************************************
 // ************************************************************************************************
 //                                         SINDEX TICKER
+// Describe the sindexes a populate job is building - no sindexes means all of
+// the namespace's.
+static void
+as_sindex__ticker_scope(as_namespace * ns, as_sindex ** sis, uint32_t n_sis,
+		char * si_names, size_t names_sz, uint64_t * si_memory)
+{
+	if (n_sis == 0) {
+		strcpy(si_names, "<all>");
+		*si_memory = (uint64_t)cf_atomic64_get(ns->sindex_data_memory_used);
+		return;
+	}
+
+	size_t len = 0;
+
+	*si_memory = 0;
+	si_names[0] = '\0';
+
+	for (uint32_t i = 0; i < n_sis; i++) {
+		*si_memory += cf_atomic64_get(sis[i]->stats.mem_used);
+
+		if (len < names_sz) {
+			len += snprintf(si_names + len, names_sz - len, "%s%s",
+					i == 0 ? "" : ",", sis[i]->imd->iname);
+		}
+	}
+}
+
 // Sindex ticker start
 void
-as_sindex_ticker_start(as_namespace * ns, as_sindex * si)
+as_sindex_ticker_start(as_namespace * ns, as_sindex ** sis, uint32_t n_sis)
 {
-	cf_info(AS_SINDEX, "Sindex-ticker start: ns=%s si=%s job=%s", ns->name ? ns->name : "<all>",
-			si ? si->imd->iname : "<all>", si ? "SINDEX_POPULATE" : "SINDEX_POPULATEALL");
+	char si_names[256];
+	uint64_t si_memory;
 
+	as_sindex__ticker_scope(ns, sis, n_sis, si_names, sizeof(si_names), &si_memory);
+
+	cf_info(AS_SINDEX, "Sindex-ticker start: ns=%s si=%s job=%s", ns->name, si_names,
+			n_sis != 0 ? "SINDEX_POPULATE" : "SINDEX_POPULATEALL");
 }
-// Sindex ticker
+
+// Sindex ticker - n_obj_scanned counts records visited by all of the job's
+// threads, so progress and the estimate reflect the whole parallel build.
 void
-as_sindex_ticker(as_namespace * ns, as_sindex * si, uint64_t n_obj_scanned, uint64_t start_time)
+as_sindex_ticker(as_namespace * ns, as_sindex ** sis, uint32_t n_sis, uint64_t n_obj_scanned, uint64_t start_time)
 {
 	const uint64_t sindex_ticker_obj_count = 500000;
 
@@ -4849,47 +5488,38 @@ as_sindex_ticker(as_namespace * ns, as_sindex * si, uint64_t n_obj_scanned, uint
 		// ai_btree_put() <- for every single sindex insertion (boot-time/dynamic)
 		// as_sindex_create() : for dynamic si creation, cluster change, smd on boot-up.
 
-		uint64_t si_memory   = 0;
-		char   * si_name     = NULL;
+		char si_names[256];
+		uint64_t si_memory;
 
-		if (si) {
-			si_memory        = cf_atomic64_get(si->stats.mem_used);
-			si_name          = si->imd->iname;
-		}
-		else {
-			si_memory        = (uint64_t)cf_atomic64_get(ns->sindex_data_memory_used);
-			si_name          = "<all>";
-		}
+		as_sindex__ticker_scope(ns, sis, n_sis, si_names, sizeof(si_names), &si_memory);
 
+		// Records can arrive (or migrate in) mid-build - don't report more
+		// than all done.
 		uint64_t n_objects       = (uint64_t)cf_atomic_int_get(ns->n_objects);
-		uint64_t pct_obj_scanned = n_objects == 0 ? 100 : ((n_obj_scanned * 100) / n_objects);
-		uint64_t elapsed         = (cf_getms() - start_time);
-		uint64_t est_time        = (elapsed * n_objects)/n_obj_scanned - elapsed;
+		uint64_t n_expected      = n_objects > n_obj_scanned ? n_objects : n_obj_scanned;
+		uint64_t pct_obj_scanned = (n_obj_scanned * 100) / n_expected;
+		uint64_t elapsed         = cf_getms() - start_time;
+		uint64_t obj_per_sec     = elapsed == 0 ? 0 : (n_obj_scanned * 1000) / elapsed;
+		uint64_t est_time        = (elapsed * (n_expected - n_obj_scanned)) / n_obj_scanned;
 
 		cf_info(AS_SINDEX, " Sindex-ticker: ns=%s si=%s obj-scanned=%"PRIu64" si-mem-used=%"PRIu64""
-				" progress= %"PRIu64"%% est-time=%"PRIu64" ms",
-				ns->name, si_name, n_obj_scanned, si_memory, pct_obj_scanned, est_time);
+				" progress= %"PRIu64"%% obj-per-sec=%"PRIu64" est-time=%"PRIu64" ms",
+				ns->name, si_names, n_obj_scanned, si_memory, pct_obj_scanned,
+				obj_per_sec, est_time);
 	}
 }
 
 // Sindex ticker end
 void
-as_sindex_ticker_done(as_namespace * ns, as_sindex * si, uint64_t start_time)
+as_sindex_ticker_done(as_namespace * ns, as_sindex ** sis, uint32_t n_sis, uint64_t start_time)
 {
-	uint64_t si_memory   = 0;
-	char   * si_name     = NULL;
+	char si_names[256];
+	uint64_t si_memory;
 
-	if (si) {
-		si_memory        = cf_atomic64_get(si->stats.mem_used);
-		si_name          = si->imd->iname;
-	}
-	else {
-		si_memory        = (uint64_t)cf_atomic64_get(ns->sindex_data_memory_used);
-		si_name          = "<all>";
-	}
+	as_sindex__ticker_scope(ns, sis, n_sis, si_names, sizeof(si_names), &si_memory);
 
 	cf_info(AS_SINDEX, "Sindex-ticker done: ns=%s si=%s si-mem-used=%"PRIu64" elapsed=%"PRIu64" ms",
-				ns->name, si_name, si_memory, cf_getms() - start_time);
+				ns->name, si_names, si_memory, cf_getms() - start_time);
 
 }
 //                                       END - SINDEX TICKER
@@ -129,6 +129,8 @@ as_security_transact(as_transaction* tr)
 	uint8_t* p_end = resp + resp_size;
 	cf_socket *sock = tr->from.proto_fd_h->sock;
 
+	as_file_handle_send_lock(tr->from.proto_fd_h);
+
 	while (p_write < p_end) {
 		int rv = cf_socket_send(sock, (void*)p_write, p_end - p_write, MSG_NOSIGNAL);
 
@@ -137,6 +139,7 @@ as_security_transact(as_transaction* tr)
 		}
 		else if (rv == 0) {
 			cf_warning(AS_SECURITY, "fd %d send returned 0", CSFD(sock));
+			as_file_handle_send_unlock(tr->from.proto_fd_h);
 			as_end_of_transaction_force_close(tr->from.proto_fd_h);
 			tr->from.proto_fd_h = NULL;
 			return;
@@ -147,12 +150,14 @@ as_security_transact(as_transaction* tr)
 		}
 		else {
 			cf_warning(AS_SECURITY, "fd %d send failed, errno %d", CSFD(sock), errno);
+			as_file_handle_send_unlock(tr->from.proto_fd_h);
 			as_end_of_transaction_force_close(tr->from.proto_fd_h);
 			tr->from.proto_fd_h = NULL;
 			return;
 		}
 	}
 
+	as_file_handle_send_unlock(tr->from.proto_fd_h);
 	as_end_of_transaction_ok(tr->from.proto_fd_h);
 	tr->from.proto_fd_h = NULL;
 }
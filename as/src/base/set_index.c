@@ -0,0 +1,360 @@
+/*
+ * set_index.c
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/* SYNOPSIS
+ * Optional per-partition set membership index, so set scans and truncates can
+ * visit a set's records without walking the whole index tree. Records of sets
+ * configured with set-index are listed by arena handle, per set.
+ *
+ * As with the expiration index, entries are hints - a record is added when it
+ * gets its set-ID, and never removed. Visitors look each entry up by digest,
+ * under the record lock, and skip it unless it's still the same element in
+ * the same set. Duplicates are squeezed out before each visit.
+ *
+ * An index is only complete once nsup has rebuilt it by walking the partition
+ * - until then visitors must walk the tree. A partition dropped to an empty
+ * tree starts out complete.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "base/set_index.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "citrusleaf/alloc.h"
+#include "citrusleaf/cf_digest.h"
+
+#include "arenax.h"
+#include "fault.h"
+#include "vmapx.h"
+
+#include "base/datamodel.h"
+#include "base/index.h"
+
+
+//==========================================================
+// Constants.
+//
+
+#define SI_MIN_CAPACITY	16
+
+
+//==========================================================
+// Typedefs.
+//
+
+typedef struct si_set_s {
+	uint16_t			set_id;
+	cf_arenax_handle*	handles;
+	uint32_t			n_handles;
+	uint32_t			capacity;
+} si_set;
+
+// Few sets are indexed, so they're just listed.
+struct as_set_index_s {
+	pthread_mutex_t		lock;
+	bool				complete;
+	uint32_t			n_sets;
+	si_set*				sets;
+};
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static si_set* find_set(as_set_index* si, uint16_t set_id, bool create);
+static void set_append(si_set* set, cf_arenax_handle r_h);
+static uint32_t set_squeeze(si_set* set);
+static int handle_compare(const void* pa, const void* pb);
+
+static inline bool
+in_range(cf_digest* keyd, cf_digest* lo_keyd, cf_digest* hi_keyd)
+{
+	return (! lo_keyd || cf_digest_compare(keyd, lo_keyd) >= 0) &&
+			(! hi_keyd || cf_digest_compare(keyd, hi_keyd) < 0);
+}
+
+
+//==========================================================
+// Public API.
+//
+
+as_set_index*
+as_set_index_create()
+{
+	as_set_index* si = cf_malloc(sizeof(as_set_index));
+
+	cf_assert(si, AS_INDEX, CF_CRITICAL, "failed set index malloc");
+
+	memset(si, 0, sizeof(as_set_index));
+	pthread_mutex_init(&si->lock, NULL);
+
+	return si;
+}
+
+
+// Pass complete true only if the partition's tree has just been emptied.
+void
+as_set_index_clear(as_set_index* si, bool complete)
+{
+	pthread_mutex_lock(&si->lock);
+
+	for (uint32_t i = 0; i < si->n_sets; i++) {
+		if (si->sets[i].handles) {
+			cf_free(si->sets[i].handles);
+		}
+	}
+
+	if (si->sets) {
+		cf_free(si->sets);
+	}
+
+	si->sets = NULL;
+	si->n_sets = 0;
+	si->complete = complete;
+
+	pthread_mutex_unlock(&si->lock);
+}
+
+
+// Call when a walk that added every record, begun with a clear, is done.
+void
+as_set_index_rebuilt(as_set_index* si)
+{
+	pthread_mutex_lock(&si->lock);
+	si->complete = true;
+	pthread_mutex_unlock(&si->lock);
+}
+
+
+void
+as_set_index_add(as_set_index* si, uint16_t set_id, cf_arenax_handle r_h)
+{
+	pthread_mutex_lock(&si->lock);
+	set_append(find_set(si, set_id, true), r_h);
+	pthread_mutex_unlock(&si->lock);
+}
+
+
+// Call (under the record lock) wherever a record gets its set-ID.
+void
+as_set_index_record_set(as_namespace* ns, as_record* r)
+{
+	if (! ns->set_index) {
+		return;
+	}
+
+	uint16_t set_id = as_index_get_set_id(r);
+
+	if (! as_set_index_is_indexed(ns, set_id)) {
+		return;
+	}
+
+	cf_arenax_handle r_h = cf_arenax_get_handle(ns->arena, r);
+
+	if (r_h == 0) {
+		return;
+	}
+
+	as_partition* p = &ns->partitions[as_partition_getid(r->key)];
+
+	as_set_index_add(p->set_index, set_id, r_h);
+}
+
+
+bool
+as_set_index_is_indexed(as_namespace* ns, uint16_t set_id)
+{
+	as_set* p_set;
+
+	return ns->set_index && set_id != INVALID_SET_ID &&
+			cf_vmapx_get_by_index(ns->p_sets_vmap, set_id - 1,
+					(void**)&p_set) == CF_VMAPX_OK &&
+			cf_atomic32_get(p_set->set_index) != 0;
+}
+
+
+// Reduces the set's records in [lo_keyd, hi_keyd) - null means unbounded - in
+// no particular order. Returns false, having done nothing, if the partition's
+// index can't be used - the caller should reduce the tree instead.
+bool
+as_set_index_reduce(as_namespace* ns, as_partition* p, as_index_tree* tree,
+		uint16_t set_id, cf_digest* lo_keyd, cf_digest* hi_keyd,
+		as_index_reduce_fn cb, void* udata)
+{
+	as_set_index* si = p->set_index;
+
+	if (! si || ! as_set_index_is_indexed(ns, set_id)) {
+		return false;
+	}
+
+	pthread_mutex_lock(&si->lock);
+
+	if (! si->complete) {
+		pthread_mutex_unlock(&si->lock);
+		return false;
+	}
+
+	si_set* set = find_set(si, set_id, false);
+	uint32_t n_handles = set ? set_squeeze(set) : 0;
+	cf_arenax_handle* handles = NULL;
+
+	if (n_handles != 0) {
+		handles = cf_malloc(n_handles * sizeof(cf_arenax_handle));
+
+		cf_assert(handles, AS_INDEX, CF_CRITICAL, "failed set index malloc");
+
+		memcpy(handles, set->handles, n_handles * sizeof(cf_arenax_handle));
+	}
+
+	pthread_mutex_unlock(&si->lock);
+
+	for (uint32_t i = 0; i < n_handles; i++) {
+		// Unlocked read - may be stale, or a freed element. Either way the
+		// lookup below decides.
+		cf_digest keyd = ((as_index*)cf_arenax_resolve(ns->arena,
+				handles[i]))->key;
+
+		if (! in_range(&keyd, lo_keyd, hi_keyd)) {
+			continue;
+		}
+
+		as_index_ref r_ref;
+
+		r_ref.skip_lock = false;
+
+		if (as_record_get(tree, &keyd, &r_ref, ns) != 0) {
+			continue;
+		}
+
+		if (r_ref.r_h != handles[i] ||
+				as_index_get_set_id(r_ref.r) != set_id) {
+			as_record_done(&r_ref, ns);
+			continue;
+		}
+
+		// Callback MUST call as_record_done() to unlock and release record.
+		cb(&r_ref, udata);
+	}
+
+	if (handles) {
+		cf_free(handles);
+	}
+
+	return true;
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+static si_set*
+find_set(as_set_index* si, uint16_t set_id, bool create)
+{
+	for (uint32_t i = 0; i < si->n_sets; i++) {
+		if (si->sets[i].set_id == set_id) {
+			return &si->sets[i];
+		}
+	}
+
+	if (! create) {
+		return NULL;
+	}
+
+	si_set* resized = cf_realloc(si->sets, (si->n_sets + 1) * sizeof(si_set));
+
+	cf_assert(resized, AS_INDEX, CF_CRITICAL, "failed set index realloc");
+
+	si->sets = resized;
+
+	si_set* set = &si->sets[si->n_sets++];
+
+	memset(set, 0, sizeof(si_set));
+	set->set_id = set_id;
+
+	return set;
+}
+
+
+static void
+set_append(si_set* set, cf_arenax_handle r_h)
+{
+	if (set->n_handles == set->capacity) {
+		uint32_t capacity = set->capacity == 0 ?
+				SI_MIN_CAPACITY : set->capacity * 2;
+
+		cf_arenax_handle* resized = cf_realloc(set->handles,
+				capacity * sizeof(cf_arenax_handle));
+
+		cf_assert(resized, AS_INDEX, CF_CRITICAL, "failed set index realloc");
+
+		set->handles = resized;
+		set->capacity = capacity;
+	}
+
+	set->handles[set->n_handles++] = r_h;
+}
+
+
+// Sorts and removes duplicates - a freed element re-used in the same set gets
+// listed again. Returns the new number of handles.
+static uint32_t
+set_squeeze(si_set* set)
+{
+	if (set->n_handles < 2) {
+		return set->n_handles;
+	}
+
+	qsort(set->handles, set->n_handles, sizeof(cf_arenax_handle),
+			handle_compare);
+
+	uint32_t n_unique = 1;
+
+	for (uint32_t i = 1; i < set->n_handles; i++) {
+		if (set->handles[i] != set->handles[n_unique - 1]) {
+			set->handles[n_unique++] = set->handles[i];
+		}
+	}
+
+	set->n_handles = n_unique;
+
+	return n_unique;
+}
+
+
+static int
+handle_compare(const void* pa, const void* pb)
+{
+	cf_arenax_handle a = *(const cf_arenax_handle*)pa;
+	cf_arenax_handle b = *(const cf_arenax_handle*)pb;
+
+	return a < b ? -1 : (a > b ? 1 : 0);
+}
@@ -0,0 +1,255 @@
+/*
+ * sindex_hist.c
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/* SYNOPSIS
+ * Approximate value distribution of an integer-keyed secondary index, for
+ * estimating how many entries a range query will visit before running it.
+ *
+ * Buckets are fixed, so there's nothing to rebalance as values arrive - each
+ * power of two of magnitude, either sign, is split into four equal buckets.
+ * That's within 25% of the value for the bucket edges, whatever the values'
+ * scale. Within a bucket values are assumed uniform.
+ *
+ * Counts are updated atomically, under whichever pimd lock the caller holds,
+ * so a reader sees a slightly stale but never torn distribution.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "base/sindex_hist.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "citrusleaf/alloc.h"
+#include "citrusleaf/cf_atomic.h"
+
+#include "dynbuf.h"
+
+
+//==========================================================
+// Constants.
+//
+
+#define SUB_BITS	2
+#define N_SUBS		(1 << SUB_BITS)
+
+// Magnitudes 0 to 2^64 - 1 - magnitude 0, and 64 powers of two.
+#define N_MAG_BUCKETS	((64 + 1) * N_SUBS)
+#define N_BUCKETS		(2 * N_MAG_BUCKETS)
+
+
+//==========================================================
+// Typedefs.
+//
+
+// Negative values, descending magnitude, then non-negative, ascending - so
+// bucket order is value order.
+struct as_sindex_hist_s {
+	cf_atomic64	counts[N_BUCKETS];
+};
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static uint32_t bucket_of(int64_t value);
+static void bucket_range(uint32_t b, double* lo, double* hi);
+
+static inline uint64_t
+count_of(const as_sindex_hist* h, uint32_t b)
+{
+	int64_t count = (int64_t)cf_atomic64_get(h->counts[b]);
+
+	// Removes may beat inserts in a race with clear.
+	return count > 0 ? (uint64_t)count : 0;
+}
+
+
+//==========================================================
+// Public API.
+//
+
+as_sindex_hist*
+as_sindex_hist_create()
+{
+	return cf_calloc(1, sizeof(as_sindex_hist));
+}
+
+void
+as_sindex_hist_destroy(as_sindex_hist* h)
+{
+	cf_free(h);
+}
+
+void
+as_sindex_hist_clear(as_sindex_hist* h)
+{
+	for (uint32_t b = 0; b < N_BUCKETS; b++) {
+		cf_atomic64_set(&h->counts[b], 0);
+	}
+}
+
+void
+as_sindex_hist_insert(as_sindex_hist* h, int64_t value)
+{
+	cf_atomic64_incr(&h->counts[bucket_of(value)]);
+}
+
+void
+as_sindex_hist_remove(as_sindex_hist* h, int64_t value)
+{
+	cf_atomic64_decr(&h->counts[bucket_of(value)]);
+}
+
+// Estimated number of entries with values in [start, end].
+uint64_t
+as_sindex_hist_estimate(const as_sindex_hist* h, int64_t start, int64_t end)
+{
+	if (start > end) {
+		return 0;
+	}
+
+	uint32_t first = bucket_of(start);
+	uint32_t last = bucket_of(end);
+	double estimate = 0;
+
+	for (uint32_t b = first; b <= last; b++) {
+		uint64_t count = count_of(h, b);
+
+		if (count == 0) {
+			continue;
+		}
+
+		double lo;
+		double hi;
+
+		bucket_range(b, &lo, &hi);
+
+		double from = (double)start > lo ? (double)start : lo;
+		double to = (double)end < hi ? (double)end : hi;
+
+		estimate += (double)count * (to - from + 1) / (hi - lo + 1);
+	}
+
+	return (uint64_t)(estimate + 0.5);
+}
+
+// Non-empty buckets, as "[lo,hi]=count;".
+void
+as_sindex_hist_info(const as_sindex_hist* h, cf_dyn_buf* db)
+{
+	for (uint32_t b = 0; b < N_BUCKETS; b++) {
+		uint64_t count = count_of(h, b);
+
+		if (count == 0) {
+			continue;
+		}
+
+		double lo;
+		double hi;
+
+		bucket_range(b, &lo, &hi);
+
+		char buf[128];
+
+		snprintf(buf, sizeof(buf), "[%.0f,%.0f]=%lu;", lo, hi, count);
+		cf_dyn_buf_append_string(db, buf);
+	}
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+static uint32_t
+mag_bucket_of(uint64_t mag)
+{
+	if (mag == 0) {
+		return 0;
+	}
+
+	uint32_t n_bits = 64 - __builtin_clzll(mag);
+	uint32_t sub = n_bits > SUB_BITS + 1 ?
+			(uint32_t)(mag >> (n_bits - SUB_BITS - 1)) & (N_SUBS - 1) : 0;
+
+	return n_bits * N_SUBS + sub;
+}
+
+static uint32_t
+bucket_of(int64_t value)
+{
+	if (value < 0) {
+		return N_MAG_BUCKETS - 1 - mag_bucket_of(0 - (uint64_t)value);
+	}
+
+	return N_MAG_BUCKETS + mag_bucket_of((uint64_t)value);
+}
+
+// Smallest and largest magnitudes of a magnitude bucket.
+static void
+mag_bucket_range(uint32_t mb, double* lo, double* hi)
+{
+	uint32_t n_bits = mb / N_SUBS;
+	uint32_t sub = mb % N_SUBS;
+
+	if (n_bits == 0) {
+		*lo = 0;
+		*hi = 0;
+		return;
+	}
+
+	// Buckets too narrow to split hold the whole power of two.
+	if (n_bits <= SUB_BITS + 1) {
+		*lo = ldexp(1, n_bits - 1);
+		*hi = ldexp(1, n_bits) - 1;
+		return;
+	}
+
+	double width = ldexp(1, n_bits - SUB_BITS - 1);
+
+	*lo = ldexp(1, n_bits - 1) + sub * width;
+	*hi = *lo + width - 1;
+}
+
+static void
+bucket_range(uint32_t b, double* lo, double* hi)
+{
+	if (b >= N_MAG_BUCKETS) {
+		mag_bucket_range(b - N_MAG_BUCKETS, lo, hi);
+		return;
+	}
+
+	double mag_lo;
+	double mag_hi;
+
+	mag_bucket_range(N_MAG_BUCKETS - 1 - b, &mag_lo, &mag_hi);
+
+	// Only the most negative value has magnitude 2^63.
+	*lo = mag_hi > ldexp(1, 63) ? -ldexp(1, 63) : -mag_hi;
+	*hi = -mag_lo;
+}
@@ -0,0 +1,554 @@
+/*
+ * sindex_snapshot.c
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/* SYNOPSIS
+ * Optional per-namespace snapshot of secondary index contents, so a warm
+ * restart can stream the indexes back instead of reading every record from the
+ * devices to rebuild them.
+ *
+ * The snapshot is saved at clean shutdown, after storage is flushed (so no
+ * further writes can happen), to a temporary file renamed into place once
+ * complete. It's sequential, in host byte order:
+ *
+ *   header
+ *   definition (name, set, bin path, key & index type) of each sindex
+ *   for each sindex, in definition order:
+ *     runs of { n-digests, key, digests }, ended by a run of 0 digests
+ *   trailer (total digests)
+ *
+ * It's consumed - unlinked - by the next startup whether or not it's used,
+ * so it can only ever describe the shutdown just before that startup. It's
+ * used only if that startup is a warm restart (meaning the shutdown was clean),
+ * the namespace hasn't gained records, and the sindex definitions all match.
+ * Otherwise the startup falls back to a full build. Entries for records that
+ * have since gone (e.g. expired during startup) are garbage collected by the
+ * usual sindex defrag.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "base/sindex_snapshot.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "citrusleaf/alloc.h"
+#include "citrusleaf/cf_clock.h"
+#include "citrusleaf/cf_digest.h"
+
+#include "ai_btree.h"
+#include "ai_types.h"
+#include "fault.h"
+
+#include "base/cfg.h"
+#include "base/datamodel.h"
+#include "base/secondary_index.h"
+#include "base/thr_sindex.h"
+
+
+//==========================================================
+// Constants.
+//
+
+#define SNAPSHOT_MAGIC		0x534E5853 // "SXNS"
+#define SNAPSHOT_VERSION	1
+
+#define SNAPSHOT_BUF_SZ		(1024 * 1024)
+#define SNAPSHOT_RUN_MAX	1024
+
+
+//==========================================================
+// Typedefs.
+//
+
+typedef struct snapshot_header_s {
+	uint32_t	magic;
+	uint32_t	version;
+	char		ns_name[AS_ID_NAMESPACE_SZ];
+	uint64_t	n_objects;
+	uint32_t	n_sindexes;
+	uint32_t	unused;
+} snapshot_header;
+
+typedef struct snapshot_trailer_s {
+	uint32_t	magic;
+	uint32_t	unused;
+	uint64_t	n_digs;
+} snapshot_trailer;
+
+typedef struct snapshot_writer_s {
+	FILE*		fh;
+	uint32_t	key_sz;
+	bool		ok;
+	uint64_t	n_digs;
+} snapshot_writer;
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static void snapshot_save(as_namespace* ns);
+static uint32_t reserve_sindexes(as_namespace* ns, as_sindex** sis);
+static void release_sindexes(as_sindex** sis, uint32_t n_sis);
+static bool write_def(FILE* fh, const as_sindex_metadata* imd);
+static bool save_run_cb(void* skey, const cf_digest* digs, uint32_t n_digs, void* udata);
+static bool def_matches(FILE* fh, const as_sindex_metadata* imd);
+static bool load_entries(FILE* fh, as_sindex_metadata* imd, uint64_t* n_digs);
+
+static inline bool
+can_warm_restart(const as_namespace* ns)
+{
+	return ns->storage_type == AS_STORAGE_ENGINE_SSD &&
+			ns->storage_fast_restart && ! ns->storage_data_in_memory;
+}
+
+static inline uint32_t
+key_sz(const as_sindex_metadata* imd)
+{
+	return C_IS_Y(imd->dtype) ? CF_DIGEST_KEY_SZ : sizeof(uint64_t);
+}
+
+static inline bool
+write_buf(FILE* fh, const void* buf, size_t sz)
+{
+	return sz == 0 || fwrite(buf, sz, 1, fh) == 1;
+}
+
+static inline bool
+read_buf(FILE* fh, void* buf, size_t sz)
+{
+	return sz == 0 || fread(buf, sz, 1, fh) == 1;
+}
+
+
+//==========================================================
+// Public API.
+//
+
+// Called at shutdown, after storage is flushed.
+void
+as_sindex_snapshot_save_all()
+{
+	for (uint32_t i = 0; i < g_config.n_namespaces; i++) {
+		as_namespace* ns = g_config.namespaces[i];
+
+		if (ns->sindex_snapshot_file) {
+			snapshot_save(ns);
+		}
+	}
+}
+
+// Called at startup, before sindex population. Returns true if all of the
+// namespace's sindexes were loaded and need no population scan.
+bool
+as_sindex_snapshot_load(as_namespace* ns)
+{
+	const char* path = ns->sindex_snapshot_file;
+
+	if (! path) {
+		return false;
+	}
+
+	FILE* fh = fopen(path, "r");
+
+	if (! fh) {
+		if (errno != ENOENT) {
+			cf_warning(AS_SINDEX, "ns %s can't open sindex snapshot %s: %s",
+					ns->name, path, cf_strerror(errno));
+		}
+
+		return false;
+	}
+
+	// Used at most once - any later startup needs a later shutdown's snapshot.
+	if (unlink(path) != 0) {
+		cf_warning(AS_SINDEX, "ns %s can't remove sindex snapshot %s: %s",
+				ns->name, path, cf_strerror(errno));
+		fclose(fh);
+		return false;
+	}
+
+	if (ns->cold_start) {
+		cf_info(AS_SINDEX, "ns %s cold start - ignoring sindex snapshot",
+				ns->name);
+		fclose(fh);
+		return false;
+	}
+
+	setvbuf(fh, NULL, _IOFBF, SNAPSHOT_BUF_SZ);
+
+	uint64_t start_ms = cf_getms();
+	as_sindex* sis[AS_SINDEX_MAX];
+	uint32_t n_sis = reserve_sindexes(ns, sis);
+	snapshot_header header;
+	bool loaded = false;
+
+	if (! read_buf(fh, &header, sizeof(header)) ||
+			header.magic != SNAPSHOT_MAGIC ||
+			header.version != SNAPSHOT_VERSION ||
+			strncmp(header.ns_name, ns->name, AS_ID_NAMESPACE_SZ) != 0) {
+		cf_warning(AS_SINDEX, "ns %s sindex snapshot %s invalid - ignoring",
+				ns->name, path);
+		goto Done;
+	}
+
+	// Records can go (e.g. expire) but not arrive without a write.
+	if ((uint64_t)ns->n_objects > header.n_objects ||
+			header.n_sindexes != n_sis) {
+		cf_info(AS_SINDEX, "ns %s sindex snapshot %s stale - ignoring",
+				ns->name, path);
+		goto Done;
+	}
+
+	// Definitions are in the order they were saved - sindexes are found by
+	// name, so reorder ours to match.
+	for (uint32_t i = 0; i < n_sis; i++) {
+		uint32_t j;
+
+		for (j = i; j < n_sis; j++) {
+			long pos = ftell(fh);
+
+			if (def_matches(fh, sis[j]->imd)) {
+				break;
+			}
+
+			fseek(fh, pos, SEEK_SET);
+		}
+
+		if (j == n_sis) {
+			cf_info(AS_SINDEX, "ns %s sindex snapshot %s definitions don't match - ignoring",
+					ns->name, path);
+			goto Done;
+		}
+
+		as_sindex* si = sis[i];
+
+		sis[i] = sis[j];
+		sis[j] = si;
+	}
+
+	uint64_t n_digs = 0;
+
+	for (uint32_t i = 0; i < n_sis; i++) {
+		if (! load_entries(fh, sis[i]->imd, &n_digs)) {
+			cf_warning(AS_SINDEX, "ns %s sindex snapshot %s failed loading sindex %s",
+					ns->name, path, sis[i]->imd->iname);
+			goto Done;
+		}
+	}
+
+	snapshot_trailer trailer;
+
+	if (! read_buf(fh, &trailer, sizeof(trailer)) ||
+			trailer.magic != SNAPSHOT_MAGIC || trailer.n_digs != n_digs) {
+		cf_warning(AS_SINDEX, "ns %s sindex snapshot %s truncated",
+				ns->name, path);
+		goto Done;
+	}
+
+	uint64_t loadtime = cf_getms() - start_ms;
+
+	for (uint32_t i = 0; i < n_sis; i++) {
+		sis[i]->stats.loadtime = loadtime;
+	}
+
+	cf_info(AS_SINDEX, "ns %s loaded %lu entries of %u sindexes from snapshot %s in %lu ms",
+			ns->name, n_digs, n_sis, path, loadtime);
+
+	loaded = true;
+
+Done:
+	// A part-loaded snapshot isn't undone - its entries are valid, and a full
+	// build will just confirm them.
+	release_sindexes(sis, n_sis);
+	fclose(fh);
+
+	return loaded;
+}
+
+
+//==========================================================
+// Local helpers - save.
+//
+
+static void
+snapshot_save(as_namespace* ns)
+{
+	const char* path = ns->sindex_snapshot_file;
+
+	if (! can_warm_restart(ns)) {
+		cf_warning(AS_SINDEX, "ns %s can't warm restart - not saving sindex snapshot",
+				ns->name);
+		return;
+	}
+
+	if (! g_sindex_boot_done) {
+		cf_warning(AS_SINDEX, "ns %s sindexes not yet populated - not saving sindex snapshot",
+				ns->name);
+		return;
+	}
+
+	uint64_t start_ms = cf_getms();
+	as_sindex* sis[AS_SINDEX_MAX];
+	uint32_t n_sis = reserve_sindexes(ns, sis);
+
+	for (uint32_t i = 0; i < n_sis; i++) {
+		as_sindex* si = sis[i];
+
+		if (! (si->flag & AS_SINDEX_FLAG_RACTIVE) ||
+				(si->flag & AS_SINDEX_FLAG_POPULATING) ||
+				si->desync_cnt != 0) {
+			cf_warning(AS_SINDEX, "ns %s sindex %s incomplete - not saving sindex snapshot",
+					ns->name, si->imd->iname);
+			release_sindexes(sis, n_sis);
+			return;
+		}
+	}
+
+	char tmp_path[PATH_MAX];
+
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+	FILE* fh = fopen(tmp_path, "w");
+
+	if (! fh) {
+		cf_warning(AS_SINDEX, "ns %s can't create sindex snapshot %s: %s",
+				ns->name, tmp_path, cf_strerror(errno));
+		release_sindexes(sis, n_sis);
+		return;
+	}
+
+	setvbuf(fh, NULL, _IOFBF, SNAPSHOT_BUF_SZ);
+
+	snapshot_header header = {
+			.magic = SNAPSHOT_MAGIC,
+			.version = SNAPSHOT_VERSION,
+			.n_objects = (uint64_t)ns->n_objects,
+			.n_sindexes = n_sis
+	};
+
+	strncpy(header.ns_name, ns->name, AS_ID_NAMESPACE_SZ);
+
+	snapshot_writer w = { .fh = fh, .ok = true, .n_digs = 0 };
+
+	w.ok = write_buf(fh, &header, sizeof(header));
+
+	for (uint32_t i = 0; w.ok && i < n_sis; i++) {
+		w.ok = write_def(fh, sis[i]->imd);
+	}
+
+	for (uint32_t i = 0; w.ok && i < n_sis; i++) {
+		as_sindex_metadata* imd = sis[i]->imd;
+
+		w.key_sz = key_sz(imd);
+
+		for (int p = 0; w.ok && p < imd->nprts; p++) {
+			as_sindex_pmetadata* pimd = &imd->pimd[p];
+
+			SINDEX_RLOCK(&pimd->slock);
+			ai_btree_reduce(imd, pimd, save_run_cb, &w);
+			SINDEX_UNLOCK(&pimd->slock);
+		}
+
+		uint32_t end = 0;
+
+		w.ok = w.ok && write_buf(fh, &end, sizeof(end));
+	}
+
+	snapshot_trailer trailer = {
+			.magic = SNAPSHOT_MAGIC,
+			.n_digs = w.n_digs
+	};
+
+	w.ok = w.ok && write_buf(fh, &trailer, sizeof(trailer)) &&
+			fflush(fh) == 0 && fsync(fileno(fh)) == 0;
+
+	if (fclose(fh) != 0) {
+		w.ok = false;
+	}
+
+	release_sindexes(sis, n_sis);
+
+	if (! w.ok || rename(tmp_path, path) != 0) {
+		cf_warning(AS_SINDEX, "ns %s failed saving sindex snapshot %s: %s",
+				ns->name, path, cf_strerror(errno));
+		unlink(tmp_path);
+		return;
+	}
+
+	cf_info(AS_SINDEX, "ns %s saved %lu entries of %u sindexes to snapshot %s in %lu ms",
+			ns->name, w.n_digs, n_sis, path, cf_getms() - start_ms);
+}
+
+static uint32_t
+reserve_sindexes(as_namespace* ns, as_sindex** sis)
+{
+	uint32_t n_sis = 0;
+
+	SINDEX_GRLOCK();
+
+	for (int i = 0; i < AS_SINDEX_MAX && n_sis < (uint32_t)ns->sindex_cnt; i++) {
+		as_sindex* si = &ns->sindex[i];
+
+		if (as_sindex_isactive(si)) {
+			AS_SINDEX_RESERVE(si);
+			sis[n_sis++] = si;
+		}
+	}
+
+	SINDEX_GUNLOCK();
+
+	return n_sis;
+}
+
+static void
+release_sindexes(as_sindex** sis, uint32_t n_sis)
+{
+	for (uint32_t i = 0; i < n_sis; i++) {
+		AS_SINDEX_RELEASE(sis[i]);
+	}
+}
+
+static bool
+write_str(FILE* fh, const char* str)
+{
+	uint16_t len = str ? (uint16_t)strlen(str) : 0;
+
+	return write_buf(fh, &len, sizeof(len)) && write_buf(fh, str, len);
+}
+
+static bool
+write_def(FILE* fh, const as_sindex_metadata* imd)
+{
+	uint32_t types[2] = { (uint32_t)imd->btype, (uint32_t)imd->itype };
+
+	return write_str(fh, imd->iname) && write_str(fh, imd->set) &&
+			write_str(fh, imd->path_str) &&
+			write_buf(fh, types, sizeof(types));
+}
+
+static bool
+save_run_cb(void* skey, const cf_digest* digs, uint32_t n_digs, void* udata)
+{
+	snapshot_writer* w = (snapshot_writer*)udata;
+
+	while (w->ok && n_digs != 0) {
+		uint32_t n_run = n_digs > SNAPSHOT_RUN_MAX ? SNAPSHOT_RUN_MAX : n_digs;
+
+		w->ok = write_buf(w->fh, &n_run, sizeof(n_run)) &&
+				write_buf(w->fh, skey, w->key_sz) &&
+				write_buf(w->fh, digs, n_run * sizeof(cf_digest));
+
+		w->n_digs += n_run;
+		digs += n_run;
+		n_digs -= n_run;
+	}
+
+	return w->ok;
+}
+
+
+//==========================================================
+// Local helpers - load.
+//
+
+static bool
+str_matches(FILE* fh, const char* str)
+{
+	uint16_t len;
+	char buf[UINT16_MAX + 1];
+
+	if (! read_buf(fh, &len, sizeof(len)) || ! read_buf(fh, buf, len)) {
+		return false;
+	}
+
+	buf[len] = '\0';
+
+	return strcmp(buf, str ? str : "") == 0;
+}
+
+// Consumes the definition only if it matches.
+static bool
+def_matches(FILE* fh, const as_sindex_metadata* imd)
+{
+	uint32_t types[2];
+
+	return str_matches(fh, imd->iname) && str_matches(fh, imd->set) &&
+			str_matches(fh, imd->path_str) &&
+			read_buf(fh, types, sizeof(types)) &&
+			types[0] == (uint32_t)imd->btype &&
+			types[1] == (uint32_t)imd->itype;
+}
+
+static bool
+load_entries(FILE* fh, as_sindex_metadata* imd, uint64_t* n_digs)
+{
+	static cf_digest digs[SNAPSHOT_RUN_MAX];
+
+	uint32_t sz = key_sz(imd);
+
+	while (true) {
+		uint32_t n_run;
+		union {
+			uint64_t	i64;
+			cf_digest	digest;
+		} skey;
+
+		if (! read_buf(fh, &n_run, sizeof(n_run)) || n_run > SNAPSHOT_RUN_MAX) {
+			return false;
+		}
+
+		if (n_run == 0) {
+			return true;
+		}
+
+		if (! read_buf(fh, &skey, sz) ||
+				! read_buf(fh, digs, n_run * sizeof(cf_digest))) {
+			return false;
+		}
+
+		as_sindex_pmetadata* pimd = &imd->pimd[ai_btree_key_hash(imd, &skey)];
+
+		SINDEX_WLOCK(&pimd->slock);
+
+		for (uint32_t i = 0; i < n_run; i++) {
+			int ret = ai_btree_put(imd, pimd, &skey, &digs[i]);
+
+			if (ret != AS_SINDEX_OK && ret != AS_SINDEX_KEY_FOUND) {
+				SINDEX_UNLOCK(&pimd->slock);
+				return false;
+			}
+		}
+
+		SINDEX_UNLOCK(&pimd->slock);
+
+		*n_digs += n_run;
+	}
+}
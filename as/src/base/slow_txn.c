@@ -0,0 +1,388 @@
+/*
+ * slow_txn.c
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+
+/* SYNOPSIS
+ * Each thread records its slow transactions in its own ring, so recording
+ * takes no locks and shares no cache lines. Entries are seqlocked - the owner
+ * makes the sequence odd while writing, and readers retry or skip entries
+ * whose sequence changed under them.
+ *
+ * Rings are allocated on a thread's first slow transaction and never freed.
+ * Beyond MAX_RINGS threads, slow transactions are only counted as dropped.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "base/slow_txn.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "citrusleaf/alloc.h"
+#include "citrusleaf/cf_atomic.h"
+#include "citrusleaf/cf_clock.h"
+#include "citrusleaf/cf_digest.h"
+
+#include "dynbuf.h"
+#include "fault.h"
+
+#include "base/cfg.h"
+#include "base/datamodel.h"
+#include "base/proto.h"
+#include "base/transaction.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+#define RING_SIZE 64 // per thread
+#define MAX_RINGS 512
+
+#define MAX_INFO_ENTRIES 1000
+
+typedef enum {
+	SLOW_TXN_READ,
+	SLOW_TXN_WRITE,
+	SLOW_TXN_DELETE,
+	SLOW_TXN_UDF
+} slow_txn_op;
+
+static const char* const OP_NAMES[] = { "read", "write", "delete", "udf" };
+
+typedef struct slow_txn_s {
+	uint32_t	seq; // odd while being written, 0 if never written
+	uint32_t	total_us;
+	uint64_t	timestamp_ms; // cf_clock_getabsolute()
+	cf_digest	keyd;
+	char		ns_name[AS_ID_NAMESPACE_SZ];
+	char		set_name[AS_SET_NAME_MAX_SIZE];
+	uint8_t		op;
+	uint8_t		result_code;
+	uint8_t		n_stages;
+	uint32_t	stage_us[AS_MAX_OP_STAGES];
+} slow_txn;
+
+typedef struct slow_txn_ring_s {
+	uint32_t	write_ix; // owner only
+	slow_txn	entries[RING_SIZE];
+} slow_txn_ring;
+
+
+//==========================================================
+// Globals.
+//
+
+static __thread slow_txn_ring* t_ring = NULL;
+
+static slow_txn_ring* volatile g_rings[MAX_RINGS];
+static cf_atomic32 g_n_rings = 0;
+static cf_atomic64 g_n_dropped = 0;
+
+// Bounds logging to slow-txn-log-rate per second.
+static cf_atomic64 g_log_sec = 0;
+static cf_atomic32 g_n_logged = 0;
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static slow_txn_ring* thread_ring();
+static void fill_entry(slow_txn* e, as_transaction* tr, uint64_t total_ns);
+static bool should_log();
+static void log_entry(const slow_txn* e);
+static bool read_entry(const slow_txn* e, slow_txn* copy);
+static int compare_newest_first(const void* pa, const void* pb);
+static void append_entry(const slow_txn* e, cf_dyn_buf* db);
+
+
+//==========================================================
+// Public API.
+//
+
+void
+as_slow_txn_record(as_transaction* tr, uint64_t total_ns)
+{
+	slow_txn_ring* ring = thread_ring();
+
+	if (! ring) {
+		cf_atomic64_incr(&g_n_dropped);
+		return;
+	}
+
+	slow_txn* e = &ring->entries[ring->write_ix++ % RING_SIZE];
+
+	*(volatile uint32_t*)&e->seq = e->seq + 1; // odd
+	__sync_synchronize();
+
+	fill_entry(e, tr, total_ns);
+
+	__sync_synchronize();
+	*(volatile uint32_t*)&e->seq = e->seq + 1; // even
+
+	if (should_log()) {
+		log_entry(e);
+	}
+}
+
+// Most recent first, at most max entries, as
+// "time=...:ns=...:set=...:digest=...:op=...:...;".
+void
+as_slow_txn_get_info(uint32_t max, cf_dyn_buf* db)
+{
+	uint32_t n_rings = cf_atomic32_get(g_n_rings);
+
+	if (n_rings > MAX_RINGS) {
+		n_rings = MAX_RINGS;
+	}
+
+	if (max == 0 || max > MAX_INFO_ENTRIES) {
+		max = MAX_INFO_ENTRIES;
+	}
+
+	slow_txn* copies = cf_malloc((n_rings * RING_SIZE + 1) * sizeof(slow_txn));
+
+	if (! copies) {
+		cf_dyn_buf_append_string(db, "error-out-of-memory");
+		return;
+	}
+
+	uint32_t n_copies = 0;
+
+	for (uint32_t r = 0; r < n_rings; r++) {
+		slow_txn_ring* ring = g_rings[r];
+
+		if (! ring) {
+			continue; // being set up
+		}
+
+		for (uint32_t i = 0; i < RING_SIZE; i++) {
+			if (read_entry(&ring->entries[i], &copies[n_copies])) {
+				n_copies++;
+			}
+		}
+	}
+
+	qsort(copies, n_copies, sizeof(slow_txn), compare_newest_first);
+
+	for (uint32_t i = 0; i < n_copies && i < max; i++) {
+		append_entry(&copies[i], db);
+	}
+
+	cf_free(copies);
+
+	uint64_t n_dropped = cf_atomic64_get(g_n_dropped);
+
+	if (n_dropped != 0) {
+		cf_dyn_buf_append_string(db, "dropped=");
+		cf_dyn_buf_append_uint64(db, n_dropped);
+		cf_dyn_buf_append_char(db, ';');
+	}
+
+	cf_dyn_buf_chomp(db);
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+static slow_txn_ring*
+thread_ring()
+{
+	if (t_ring) {
+		return t_ring;
+	}
+
+	uint32_t r = cf_atomic32_incr(&g_n_rings) - 1;
+
+	if (r >= MAX_RINGS) {
+		return NULL; // and never try again - g_n_rings stays beyond limit
+	}
+
+	slow_txn_ring* ring = cf_calloc(1, sizeof(slow_txn_ring));
+
+	cf_assert(ring, AS_RW, CF_CRITICAL, "failed slow transaction ring calloc");
+
+	g_rings[r] = ring;
+	t_ring = ring;
+
+	return ring;
+}
+
+static void
+fill_entry(slow_txn* e, as_transaction* tr, uint64_t total_ns)
+{
+	as_namespace* ns = tr->rsv.ns;
+	uint32_t stage_base = AS_NUM_STAGES;
+
+	if (as_transaction_is_udf(tr)) {
+		e->op = SLOW_TXN_UDF;
+	}
+	else if (as_transaction_is_delete(tr)) {
+		e->op = SLOW_TXN_DELETE;
+	}
+	else if ((tr->msgp->msg.info2 & AS_MSG_INFO2_WRITE) != 0) {
+		e->op = SLOW_TXN_WRITE;
+		stage_base = AS_STAGE_WRITE_QUEUE;
+	}
+	else {
+		e->op = SLOW_TXN_READ;
+		stage_base = AS_STAGE_READ_QUEUE;
+	}
+
+	e->total_us = (uint32_t)(total_ns / 1000);
+	e->timestamp_ms = cf_clock_getabsolute();
+	e->keyd = tr->keyd;
+	strcpy(e->ns_name, ns->name);
+	e->set_name[0] = 0;
+
+	as_msg_field* f = as_transaction_has_set(tr) ?
+			as_msg_field_get(&tr->msgp->msg, AS_MSG_FIELD_TYPE_SET) : NULL;
+
+	if (f) {
+		uint32_t len = as_msg_field_get_value_sz(f);
+
+		if (len >= AS_SET_NAME_MAX_SIZE) {
+			len = AS_SET_NAME_MAX_SIZE - 1;
+		}
+
+		memcpy(e->set_name, f->data, len);
+		e->set_name[len] = 0;
+	}
+
+	e->result_code = tr->result_code;
+
+	// Stages are only timed from the queue stage on, and not for UDFs.
+	if (stage_base != AS_NUM_STAGES && tr->stage_time != 0) {
+		e->n_stages = stage_base == AS_STAGE_WRITE_QUEUE ?
+				AS_NUM_STAGES - AS_STAGE_WRITE_QUEUE :
+				AS_STAGE_WRITE_QUEUE - AS_STAGE_READ_QUEUE;
+		memcpy(e->stage_us, tr->stage_us, sizeof(e->stage_us));
+	}
+	else {
+		e->n_stages = 0;
+	}
+}
+
+static bool
+should_log()
+{
+	uint32_t rate = g_config.slow_txn_log_rate;
+
+	if (rate == 0) {
+		return false;
+	}
+
+	uint64_t now_sec = cf_get_seconds();
+	uint64_t log_sec = cf_atomic64_get(g_log_sec);
+
+	if (now_sec != log_sec &&
+			cf_atomic64_cas(&g_log_sec, log_sec, now_sec) == log_sec) {
+		cf_atomic32_set(&g_n_logged, 0);
+	}
+
+	return cf_atomic32_incr(&g_n_logged) <= rate;
+}
+
+static void
+log_entry(const slow_txn* e)
+{
+	cf_dyn_buf_define(db);
+
+	append_entry(e, &db);
+	cf_dyn_buf_chomp(&db);
+	cf_dyn_buf_append_char(&db, 0);
+
+	cf_info(AS_RW, "slow transaction: %s", db.buf);
+
+	cf_dyn_buf_free(&db);
+}
+
+static bool
+read_entry(const slow_txn* e, slow_txn* copy)
+{
+	uint32_t seq = *(volatile const uint32_t*)&e->seq;
+
+	if (seq == 0 || (seq & 1) != 0) {
+		return false; // never written, or being written
+	}
+
+	__sync_synchronize();
+	memcpy(copy, e, sizeof(slow_txn));
+	__sync_synchronize();
+
+	return *(volatile const uint32_t*)&e->seq == seq;
+}
+
+static int
+compare_newest_first(const void* pa, const void* pb)
+{
+	uint64_t a = ((const slow_txn*)pa)->timestamp_ms;
+	uint64_t b = ((const slow_txn*)pb)->timestamp_ms;
+
+	return a > b ? -1 : (a < b ? 1 : 0);
+}
+
+static void
+append_entry(const slow_txn* e, cf_dyn_buf* db)
+{
+	char digest[CF_DIGEST_KEY_SZ * 2 + 1];
+
+	for (uint32_t i = 0; i < CF_DIGEST_KEY_SZ; i++) {
+		sprintf(digest + (i * 2), "%02x", e->keyd.digest[i]);
+	}
+
+	cf_dyn_buf_append_string(db, "time=");
+	cf_dyn_buf_append_uint64(db, e->timestamp_ms);
+	cf_dyn_buf_append_string(db, ":ns=");
+	cf_dyn_buf_append_string(db, e->ns_name);
+	cf_dyn_buf_append_string(db, ":set=");
+	cf_dyn_buf_append_string(db, e->set_name);
+	cf_dyn_buf_append_string(db, ":digest=");
+	cf_dyn_buf_append_string(db, digest);
+	cf_dyn_buf_append_string(db, ":op=");
+	cf_dyn_buf_append_string(db, OP_NAMES[e->op]);
+	cf_dyn_buf_append_string(db, ":result=");
+	cf_dyn_buf_append_uint32(db, e->result_code);
+	cf_dyn_buf_append_string(db, ":total-us=");
+	cf_dyn_buf_append_uint32(db, e->total_us);
+
+	uint32_t stage_base = e->op == SLOW_TXN_READ ?
+			AS_STAGE_READ_QUEUE : AS_STAGE_WRITE_QUEUE;
+
+	for (uint32_t i = 0; i < e->n_stages; i++) {
+		cf_dyn_buf_append_char(db, ':');
+		cf_dyn_buf_append_string(db, as_stage_names[stage_base + i]);
+		cf_dyn_buf_append_string(db, "-us=");
+		cf_dyn_buf_append_uint32(db, e->stage_us[i]);
+	}
+
+	cf_dyn_buf_append_char(db, ';');
+}
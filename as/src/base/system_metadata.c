@@ -156,6 +156,21 @@
 **          exists, it must return non-zero for the item to be processed.  Otherwise the item
 **          will be rejected.
 **
+**   Incremental Synchronization:
+**   ----------------------------
+**
+**   Each module keeps an order-independent hash of its metadata items (key, value, generation
+**   and timestamp), updated as items change, so two nodes with the same item count and hash
+**   hold the same metadata.  On a Paxos change, each node sends the principal only a summary
+**   of (module, item count, hash) triples.  For each module whose summary matches its own, the
+**   principal uses its own items as that node's list.  It asks the node for the items of only
+**   the modules that differ, and merges once every node has reported in.  The merged metadata
+**   is sent only to nodes whose list differed from the merge result ~~ the others already hold
+**   it, so an unchanged cluster exchanges summaries only.  Accepted metadata identical to what
+**   is already held is not persisted again.
+**
+**   A principal still merges full metadata from nodes that send it unsolicited.
+**
 **   Threading Structure:
 **   --------------------
 **
@@ -307,7 +322,9 @@ typedef enum as_smd_msg_op_e {
 	AS_SMD_MSG_OP_DELETE_ITEM,              // Delete an existing metadata item (must already exist)
 	AS_SMD_MSG_OP_MY_CURRENT_METADATA,      // Current metadata sent from a node to the principal
 	AS_SMD_MSG_OP_ACCEPT_THIS_METADATA,     // New blessed metadata sent from the principal to a node
-	AS_SMD_MSG_OP_NODES_CURRENT_METADATA    // Another node's current metadata sent from the principal to a node
+	AS_SMD_MSG_OP_NODES_CURRENT_METADATA,   // Another node's current metadata sent from the principal to a node
+	AS_SMD_MSG_OP_MY_CURRENT_SUMMARY,       // Item count and hash of each module sent from a node to the principal
+	AS_SMD_MSG_OP_SEND_METADATA             // Principal asking a node for the current metadata of the listed modules
 } as_smd_msg_op_t;
 
 /*
@@ -317,7 +334,9 @@ typedef enum as_smd_msg_op_e {
 								 (AS_SMD_MSG_OP_DELETE_ITEM == op ? "DELETE_ITEM" : \
 								  (AS_SMD_MSG_OP_MY_CURRENT_METADATA == op ? "MY_CURRENT_METADATA" : \
 								   (AS_SMD_MSG_OP_ACCEPT_THIS_METADATA == op ? "ACCEPT_THIS_METADATA" : \
-									(AS_SMD_MSG_OP_NODES_CURRENT_METADATA == op ? "NODES_CURRENT_METADATA" : "<UNKNOWN>")))))
+									(AS_SMD_MSG_OP_NODES_CURRENT_METADATA == op ? "NODES_CURRENT_METADATA" : \
+									 (AS_SMD_MSG_OP_MY_CURRENT_SUMMARY == op ? "MY_CURRENT_SUMMARY" : \
+									  (AS_SMD_MSG_OP_SEND_METADATA == op ? "SEND_METADATA" : "<UNKNOWN>")))))))
 
 /*
  *  Name of the given System Metadata action.
@@ -343,6 +362,15 @@ typedef enum as_smd_msg_op_e {
 #define MSG_OP2ACTION(op)  (AS_SMD_MSG_OP_SET_ITEM == op ? AS_SMD_ACTION_SET : \
 							(AS_SMD_MSG_OP_DELETE_ITEM == op ? AS_SMD_ACTION_DELETE : AS_SMD_ACTION_SET))
 
+/*
+ *  Type for a module's summary:  Equal item counts and hashes mean equal metadata.
+ */
+typedef struct as_smd_module_summary_s {
+	char *module_name;          // Name of the module.
+	uint32_t num_items;         // Number of metadata items
+	uint64_t hash;              // Order-independent hash of the metadata items
+} as_smd_module_summary_t;
+
 /*
  *  Type for System Metadata messages transmitted via the fabric.
  */
@@ -354,6 +382,8 @@ typedef struct as_smd_msg_s {
 	uint32_t num_items;         // Number of metadata items
 	as_smd_item_list_t *items;  // List of metadata items associated with this message (only relevant fields are set)
 	uint32_t options;           // Message options (originator)
+	uint32_t num_summaries;     // Number of module summaries
+	as_smd_module_summary_t *summaries; // Module summaries (the principal's own, for SEND_METADATA)
 } as_smd_msg_t;
 
 /*
@@ -402,6 +432,9 @@ typedef struct as_smd_external_item_key_s {
  *     10). Timestamp[] - Array of (uint64_t <==> UINT64)
  *     11). Module Name - (char * <==> STR)
  *     12). Options - (uint32_t <==> UINT32)
+ *     13). Summary Module[] - Array of (char * <==> STR)
+ *     14). Summary Hash[] - Array of (uint64_t <==> UINT64)
+ *     15). Summary Num Items[] - Array of (uint32_t <==> UINT32)
  */
 static const msg_template as_smd_msg_template[] = {
 #define AS_SMD_MSG_TRID 0
@@ -430,7 +463,13 @@ static const msg_template as_smd_msg_template[] = {
 #define AS_SMD_MSG_MODULE_NAME 11
 	{ AS_SMD_MSG_MODULE_NAME, M_FT_STR },          // Name of module the message is from or else NULL if from all.
 #define AS_SMD_MSG_OPTIONS 12
-	{ AS_SMD_MSG_OPTIONS, M_FT_UINT32 }            // Option flags specifying the originator of the message (i.e., MERGE/API)
+	{ AS_SMD_MSG_OPTIONS, M_FT_UINT32 },           // Option flags specifying the originator of the message (i.e., MERGE/API)
+#define AS_SMD_MSG_SUMMARY_MODULE 13
+	{ AS_SMD_MSG_SUMMARY_MODULE, M_FT_ARRAY_STR }, // Module summary module name array
+#define AS_SMD_MSG_SUMMARY_HASH 14
+	{ AS_SMD_MSG_SUMMARY_HASH, M_FT_ARRAY_UINT64 },// Module summary metadata hash array
+#define AS_SMD_MSG_SUMMARY_NUM_ITEMS 15
+	{ AS_SMD_MSG_SUMMARY_NUM_ITEMS, M_FT_ARRAY_UINT32 } // Module summary item count array
 };
 
 #define AS_SMD_MSG_SCRATCH_SIZE 64 // accommodate module name
@@ -476,6 +515,10 @@ struct as_smd_s {
 	// Scoreboard of what cluster nodes the Paxos principal has received metadata from:  cf_node ==> shash *.
 	shash *scoreboard;
 
+	// Nodes the Paxos principal has asked for some modules' metadata, with the item counts of the modules
+	// that matched the principal's own:  cf_node ==> shash *.
+	shash *pending;
+
 };
 
 /*
@@ -513,6 +556,9 @@ typedef struct as_smd_module_s {
 	// Hash table of metadata received from all external nodes mapping key (as_smd_external_item_key_t *) ==> metadata item (as_smd_item_t *).
 	rchash *external_metadata;
 
+	// Order-independent hash of the items in "my_metadata", kept current as items change.
+	uint64_t my_metadata_hash;
+
 } as_smd_module_t;
 
 
@@ -541,6 +587,8 @@ typedef struct as_smd_module_s {
 
 
 static int as_smd_module_persist(as_smd_module_t *module_obj);
+static uint64_t as_smd_item_hash(as_smd_item_t *item);
+static void as_smd_scoreboard_put(as_smd_t *smd, cf_node node_id, shash *module_item_count_hash);
 void *as_smd_thr(void *arg);
 
 
@@ -755,6 +803,29 @@ static as_smd_event_t *as_smd_create_msg_event(as_smd_msg_op_t op, cf_node node_
 	}
 	smd_msg->items->node_id = node_id;
 
+	// Get the module summaries if present.
+	int num_summaries = 0;
+	if ((AS_SMD_MSG_OP_MY_CURRENT_SUMMARY == op || AS_SMD_MSG_OP_SEND_METADATA == op) &&
+			!msg_get_uint64_array_size(msg, AS_SMD_MSG_SUMMARY_HASH, &num_summaries) && num_summaries > 0) {
+		smd_msg->num_summaries = num_summaries;
+
+		if (!(smd_msg->summaries = (as_smd_module_summary_t *) cf_calloc(smd_msg->num_summaries, sizeof(as_smd_module_summary_t)))) {
+			cf_crash(AS_SMD, "failed to allocate %u module summaries for a msg event", smd_msg->num_summaries);
+		}
+
+		for (int i = 0; i < smd_msg->num_summaries; i++) {
+			as_smd_module_summary_t *summary = &(smd_msg->summaries[i]);
+
+			e += msg_get_str_array(msg, AS_SMD_MSG_SUMMARY_MODULE, i, &(summary->module_name), &ignored_len, MSG_GET_COPY_MALLOC);
+			e += msg_get_uint64_array(msg, AS_SMD_MSG_SUMMARY_HASH, i, &(summary->hash));
+			e += msg_get_uint32_array(msg, AS_SMD_MSG_SUMMARY_NUM_ITEMS, i, &(summary->num_items));
+
+			if (0 > e || !summary->module_name) {
+				cf_crash(AS_SMD, "failed to unpack incoming fabric System Metadata msg module summary %d (err %d ; op %d)", i, e, op);
+			}
+		}
+	}
+
 	// Populate the msg event items from the fabric msg.
 	for (int i = 0; i < smd_msg->num_items; i++) {
 		as_smd_item_t *item = smd_msg->items->item[i];
@@ -886,6 +957,13 @@ static void as_smd_destroy_event(as_smd_event_t *evt)
 			as_smd_item_list_destroy(msg->items);
 			msg->num_items = 0;
 			msg->items = NULL;
+
+			// Release the module summaries.
+			for (int i = 0; i < msg->num_summaries; i++) {
+				CF_FREE_AND_NULLIFY(msg->summaries[i].module_name);
+			}
+			CF_FREE_AND_NULLIFY(msg->summaries);
+			msg->num_summaries = 0;
 		} else {
 			cf_warning(AS_SMD, "not destroying unknown type of System Metadata event (%d)", evt->type);
 			return;
@@ -953,6 +1031,55 @@ static uint32_t shash_str_hash_fn(void *value)
 	return hash;
 }
 
+/*
+ *  Continue a 64-bit FNV-1a hash over the given bytes.
+ */
+static uint64_t fnv64_update(uint64_t hash, const void *value, size_t value_len)
+{
+	const uint8_t *p = (const uint8_t *) value;
+
+	while (value_len--) {
+		hash ^= *p++;
+		hash *= 1099511628211UL;
+	}
+
+	return hash;
+}
+
+/*
+ *  Hash a metadata item's contents.  Module metadata hashes are the sum of their items' hashes,
+ *   so they don't depend on item order and can be updated as single items change.
+ */
+static uint64_t as_smd_item_hash(as_smd_item_t *item)
+{
+	uint64_t hash = 14695981039346656037UL;
+
+	hash = fnv64_update(hash, item->key, strlen(item->key) + 1);
+
+	if (item->value) {
+		hash = fnv64_update(hash, item->value, strlen(item->value) + 1);
+	}
+
+	hash = fnv64_update(hash, &(item->generation), sizeof(item->generation));
+	hash = fnv64_update(hash, &(item->timestamp), sizeof(item->timestamp));
+
+	return hash;
+}
+
+/*
+ *  Sum the hashes of the items in a list.
+ */
+static uint64_t as_smd_item_list_hash(as_smd_item_list_t *item_list)
+{
+	uint64_t hash = 0;
+
+	for (int i = 0; i < item_list->num_items; i++) {
+		hash += as_smd_item_hash(item_list->item[i]);
+	}
+
+	return hash;
+}
+
 /*
  *  Free a module object from the modules rchash table.
  */
@@ -1052,6 +1179,11 @@ static as_smd_t *as_smd_create(void)
 		cf_crash(AS_SMD, "failed to create the System Metadata scoreboard hash table");
 	}
 
+	// Create the pending hash table.
+	if (SHASH_OK != shash_create(&(smd->pending), ptr_hash_fn, sizeof(cf_node), sizeof(shash *), 127, SHASH_CR_MT_BIGLOCK)) {
+		cf_crash(AS_SMD, "failed to create the System Metadata pending hash table");
+	}
+
 	// Create the System Metadata message queue.
 	if (!(smd->msgq = cf_queue_create(sizeof(as_smd_event_t *), true))) {
 		cf_crash(AS_SMD, "failed to create the System Metadata message queue");
@@ -1995,6 +2127,13 @@ static int as_smd_metadata_change_local(as_smd_t *smd, as_smd_msg_op_t op, as_sm
 		return retval;
 	}
 
+	// Take any item being replaced or deleted out of the module's hash.
+	as_smd_item_t *old_item = NULL;
+	if (item->key && (RCHASH_OK == rchash_get(module_obj->my_metadata, item->key, strlen(item->key) + 1, (void **) &old_item))) {
+		module_obj->my_metadata_hash -= as_smd_item_hash(old_item);
+		cf_rc_release(old_item);
+	}
+
 	if (AS_SMD_ACTION_DELETE == item->action) {
 		// Delete the metadata from the module's local metadata hash table.
 		if (RCHASH_OK != (retval = rchash_delete(module_obj->my_metadata, item->key, strlen(item->key) + 1))) {
@@ -2029,6 +2168,8 @@ static int as_smd_metadata_change_local(as_smd_t *smd, as_smd_msg_op_t op, as_sm
 		// Add new, or replace existing, metadata in the module's metadata hash table.
 		if (RCHASH_OK != (retval = rchash_put(metadata_hash, key, key_len, item))) {
 			cf_warning(AS_SMD, "failed to set metadata for key \"%s\" for System Metadata module \"%s\" (retval %d)", item->key, item->module_name, retval);
+		} else {
+			module_obj->my_metadata_hash += as_smd_item_hash(item);
 		}
 	} else {
 		cf_debug(AS_SMD, "(not setting empty metadata item for module \"%s\")", module_obj->module);
@@ -2242,8 +2383,9 @@ static void as_smd_terminate(as_smd_t *smd)
 	// Destroy the message queue.
 	cf_queue_destroy(smd->msgq);
 
-	// Release the scoreboard hash table.
+	// Release the scoreboard and pending hash tables.
 	shash_destroy(smd->scoreboard);
+	shash_destroy(smd->pending);
 
 	// Release the modules hash table.
 	rchash_destroy(smd->modules);
@@ -2313,39 +2455,150 @@ static int as_smd_module_serialize_reduce_fn(void *key, uint32_t keylen, void *o
 	return 0;
 }
 
+/*
+ *  Reduce function to summarize one module's metadata items.
+ */
+static int as_smd_module_summary_reduce_fn(void *key, uint32_t keylen, void *object, void *udata)
+{
+//	char *module = (char *) key; // (Not used.)
+	as_smd_module_t *module_obj = (as_smd_module_t *) object;
+	as_smd_module_summary_t **summary = (as_smd_module_summary_t **) udata;
+
+	// (Note:  The module name is not copied ~~ The summaries only live until the msg is built.)
+	(*summary)->module_name = module_obj->module;
+	(*summary)->num_items = rchash_get_size(module_obj->my_metadata);
+	(*summary)->hash = module_obj->my_metadata_hash;
+	(*summary)++;
+
+	return 0;
+}
+
+/*
+ *  Add module summaries to a System Metadata fabric msg.
+ *  Return:  0 if successful, -1 otherwise.
+ */
+static int as_smd_msg_set_summaries(msg *msg, as_smd_module_summary_t *summaries, size_t num_summaries)
+{
+	if (!num_summaries) {
+		return 0;
+	}
+
+	int module_sz = 0;
+	for (int i = 0; i < num_summaries; i++) {
+		module_sz += strlen(summaries[i].module_name) + 1;
+	}
+
+	int e = 0;
+	e += msg_set_str_array_size(msg, AS_SMD_MSG_SUMMARY_MODULE, num_summaries, module_sz);
+	e += msg_set_uint64_array_size(msg, AS_SMD_MSG_SUMMARY_HASH, num_summaries);
+	e += msg_set_uint32_array_size(msg, AS_SMD_MSG_SUMMARY_NUM_ITEMS, num_summaries);
+
+	for (int i = 0; 0 <= e && i < num_summaries; i++) {
+		e += msg_set_str_array(msg, AS_SMD_MSG_SUMMARY_MODULE, i, summaries[i].module_name);
+		e += msg_set_uint64_array(msg, AS_SMD_MSG_SUMMARY_HASH, i, summaries[i].hash);
+		e += msg_set_uint32_array(msg, AS_SMD_MSG_SUMMARY_NUM_ITEMS, i, summaries[i].num_items);
+	}
+
+	if (0 > e) {
+		cf_warning(AS_SMD, "failed to add %zu module summaries to System Metadata fabric msg (rv %d)", num_summaries, e);
+		return -1;
+	}
+
+	return 0;
+}
+
 /*
  *  Handle a Paxos state changed message.
- *  This function collects all metadata items in this node, from all the module,
- *  currently (UDF, SINDEX) and sends it to the Paxos principal for merging the metadata.
+ *  This function sends the Paxos principal a summary of the metadata in this node, for every
+ *  module, currently (UDF, SINDEX, ...).  The principal asks for the items of any module whose
+ *  summary doesn't match its own, for merging the metadata.
  */
 static void as_smd_paxos_changed(as_smd_t *smd, as_smd_cmd_t *cmd)
 {
 	cf_debug(AS_SMD, "System Metadata thread received Paxos state changed cmd event!");
 
-	// Q: Does the Paxos state need to be passed and considered with the event???
 	// (The cluster key is being sent in the msg for verification by the principal.)
 
+	size_t num_summaries = rchash_get_size(smd->modules);
+	as_smd_module_summary_t *summaries = NULL;
+	if (num_summaries && !(summaries = (as_smd_module_summary_t *) cf_malloc(num_summaries * sizeof(as_smd_module_summary_t)))) {
+		cf_crash(AS_SMD, "failed to allocate %zu System Metadata module summaries", num_summaries);
+	}
+
+	as_smd_module_summary_t *summary = summaries;
+	rchash_reduce(smd->modules, as_smd_module_summary_reduce_fn, &summary);
+
+	cf_debug(AS_SMD, "sending %zu module summaries to the Paxos principal", num_summaries);
+
+	// Build a System Metadata fabric msg containing the module summaries.
+	// (Note:  Even if this node has no modules, we must still send a message to the principal.)
+	msg *msg = NULL;
+	as_smd_msg_op_t my_smd_op = AS_SMD_MSG_OP_MY_CURRENT_SUMMARY;
+	if (!(msg = as_smd_msg_get(my_smd_op, NULL, 0, NULL, 0)) || as_smd_msg_set_summaries(msg, summaries, num_summaries)) {
+		cf_crash(AS_SMD, "failed to get a System Metadata fabric msg for operation %s transact start", AS_SMD_MSG_OP_NAME(my_smd_op));
+	}
+
+	if (summaries) {
+		cf_free(summaries);
+	}
+
+	// Send the module summaries to the Paxos principal.
+	cf_node principal = as_paxos_succession_getprincipal();
+	as_fabric_transact_start(principal, msg, AS_SMD_TRANSACT_TIMEOUT_MS, transact_complete_fn, smd);
+}
+
+/*
+ *  Send the Paxos principal this node's metadata items for the modules it asked for.
+ */
+static int as_smd_send_requested_metadata(as_smd_t *smd, as_smd_msg_t *smd_msg)
+{
+	cf_node principal = as_paxos_succession_getprincipal();
+
+	if (smd_msg->node_id != principal) {
+		cf_debug(AS_SMD, "received metadata request from non-principal node %016lX ~~ Ignoring!", smd_msg->node_id);
+		return -1;
+	}
+
+	if (as_paxos_get_cluster_key() != smd_msg->cluster_key) {
+		cf_debug(AS_SMD, "received metadata request with non-current cluster key (%016lx != %016lx) ~~ Ignoring!",
+				 smd_msg->cluster_key, as_paxos_get_cluster_key());
+		return -1;
+	}
+
+	if (!smd_msg->num_summaries) {
+		cf_warning(AS_SMD, "received metadata request for no modules from node %016lX ~~ Ignoring!", smd_msg->node_id);
+		return -1;
+	}
+
 	// Determine the number of metadata items to be sent.
+	as_smd_module_t *module_objs[smd_msg->num_summaries];
 	size_t num_items = 0;
-	rchash_reduce(smd->modules, as_smd_module_count_items_reduce_fn, &num_items);
+	for (int i = 0; i < smd_msg->num_summaries; i++) {
+		char *module_name = smd_msg->summaries[i].module_name;
 
-	cf_debug(AS_SMD, "sending %zu serialized metadata items to the Paxos principal", num_items);
+		module_objs[i] = NULL;
+		if (RCHASH_OK == rchash_get(smd->modules, module_name, strlen(module_name) + 1, (void **) &module_objs[i])) {
+			num_items += rchash_get_size(module_objs[i]->my_metadata);
+		}
+	}
 
-	// Copy all reference-counted metadata item pointers from the hash table into an item list.
-	// (Note:  Even if this node has no metadata items, we must still send a message to the principal.)
 	as_smd_item_list_t *item_list;
 	if (!(item_list = as_smd_item_list_alloc(num_items))) {
 		cf_crash(AS_SMD, "failed to create a System Metadata item list of size %zu", num_items);
 	}
 	// (Note:  Use num_items to count the position for each serialized metadata item.)
 	item_list->num_items = 0;
-	// set the module name to NULL, because this item_list consists of items from all modules registered to SMD
 	item_list->module_name = NULL;
-	rchash_reduce(smd->modules, as_smd_module_serialize_reduce_fn, item_list);
 
-	cf_debug(AS_SMD, "aspc():  num_items = %zu (%zu)", item_list->num_items, num_items);
+	for (int i = 0; i < smd_msg->num_summaries; i++) {
+		if (module_objs[i]) {
+			rchash_reduce(module_objs[i]->my_metadata, as_smd_item_serialize_reduce_fn, item_list);
+			cf_rc_release(module_objs[i]);
+		}
+	}
+
+	cf_debug(AS_SMD, "sending %zu metadata items for %u modules to the Paxos principal", item_list->num_items, smd_msg->num_summaries);
 
-	// Build a System Metadata fabric msg containing serialized metadata from the item list.
 	msg *msg = NULL;
 	as_smd_msg_op_t my_smd_op = AS_SMD_MSG_OP_MY_CURRENT_METADATA;
 	if (!(msg = as_smd_msg_get(my_smd_op, item_list->item, item_list->num_items, NULL, 0))) {
@@ -2355,9 +2608,9 @@ static void as_smd_paxos_changed(as_smd_t *smd, as_smd_cmd_t *cmd)
 	// The metadata has been copied into the fabric msg and can now be released.
 	as_smd_item_list_destroy(item_list);
 
-	// Send the serialized metadata to the Paxos principal.
-	cf_node principal = as_paxos_succession_getprincipal();
 	as_fabric_transact_start(principal, msg, AS_SMD_TRANSACT_TIMEOUT_MS, transact_complete_fn, smd);
+
+	return 0;
 }
 
 /*
@@ -2404,6 +2657,7 @@ static int as_smd_delete_external_metadata_reduce_fn(void *key, uint32_t keylen,
 static void as_smd_clear_scoreboard(as_smd_t *smd)
 {
 	shash_reduce_delete(smd->scoreboard, as_smd_scoreboard_reduce_delete_fn, smd);
+	shash_reduce_delete(smd->pending, as_smd_scoreboard_reduce_delete_fn, smd);
 	rchash_reduce(smd->modules, as_smd_delete_external_metadata_reduce_fn, smd);
 }
 
@@ -2553,6 +2807,43 @@ static int as_smd_shash_incr(shash *ht, as_smd_module_t *module_obj, size_t delt
 	return count;
 }
 
+/*
+ *  Add a metadata item to a module's external hash table as being from the given node.
+ */
+static void as_smd_put_external_item(as_smd_module_t *module_obj, cf_node node_id, as_smd_item_t *item)
+{
+	// The length of the key string includes the NULL terminator.
+	uint32_t key_len = strlen(item->key) + 1;
+	uint32_t stack_key_len = sizeof(as_smd_external_item_key_t) + key_len;
+
+	as_smd_external_item_key_t *stack_key = alloca(stack_key_len);
+	if (!stack_key) {
+		cf_crash(AS_SMD, "Failed to allocate stack key of size %d bytes!", stack_key_len);
+	}
+	stack_key->node_id = node_id;
+	stack_key->key_len = key_len;
+	memcpy(&(stack_key->key), item->key, key_len);
+
+	// Warn if the item is already present.
+	as_smd_item_t *old_item = NULL;
+	rchash *metadata_hash = module_obj->external_metadata;
+	if (RCHASH_OK == rchash_get(metadata_hash, stack_key, stack_key_len, (void **) &old_item)) {
+		cf_warning(AS_SMD, "found existing metadata item: node: %016lX module: \"%s\" key: \"%s\" value: \"%s\" ~~ Replacing with value: \"%s\"!",
+				   node_id, item->module_name, item->key, old_item->value, item->value);
+		// Give back the item reference.
+		cf_rc_release(old_item);
+	}
+
+	// Add reference to item for storage in the hash table.
+	// (Note:  The caller's reference to the item is released separately.)
+	cf_rc_reserve(item);
+
+	// Insert the new metadata into the module's external metadata hash table, replacing any previous contents.
+	if (RCHASH_OK != rchash_put(metadata_hash, stack_key, stack_key_len, item)) {
+		cf_warning(AS_SMD, "failed to insert metadata for key \"%s\" for System Metadata module \"%s\"", item->key, item->module_name);
+	}
+}
+
 /*
  *  Add the metadata items from this msg to the appropriate modules' external hash tables.
  */
@@ -2577,38 +2868,9 @@ static shash *as_smd_store_metadata_by_module(as_smd_t *smd, as_smd_msg_t *smd_m
 			continue;
 		}
 
-		// The length of the key string includes the NULL terminator.
-		uint32_t key_len = strlen(item->key) + 1;
-		uint32_t stack_key_len = sizeof(as_smd_external_item_key_t) + key_len;
-
-		as_smd_external_item_key_t *stack_key = alloca(stack_key_len);
-		if (!stack_key) {
-			cf_crash(AS_SMD, "Failed to allocate stack key of size %d bytes!", stack_key_len);
-		}
-		stack_key->node_id = item->node_id;
-		stack_key->key_len = key_len;
-		memcpy(&(stack_key->key), item->key, key_len);
+		as_smd_put_external_item(module_obj, item->node_id, item);
 
-		// Warn if the item is already present.
-		as_smd_item_t *old_item = NULL;
-		rchash *metadata_hash = module_obj->external_metadata;
-		if (RCHASH_OK == rchash_get(metadata_hash, stack_key, stack_key_len, (void **) &old_item)) {
-			cf_warning(AS_SMD, "found existing metadata item: node: %016lX module: \"%s\" key: \"%s\" value: \"%s\" ~~ Replacing with value: \"%s\"!",
-					   item->node_id, item->module_name, item->key, old_item->value, item->value);
-			// Give back the item reference.
-			cf_rc_release(old_item);
-		}
-
-		// Add reference to item for storage in the hash table.
-		// (Note:  One reference to the item will be released by the thread when it releases the containing msg.)
-		cf_rc_reserve(item);
-
-		// Insert the new metadata into the module's external metadata hash table, replacing any previous contents.
-		if (RCHASH_OK != rchash_put(metadata_hash, stack_key, stack_key_len, item)) {
-			cf_warning(AS_SMD, "failed to insert metadata for key \"%s\" for System Metadata module \"%s\"", item->key, item->module_name);
-		}
-
-		cf_debug(AS_SMD, "Stored metadata by module for item %d: module \"%s\" ; key \"%s\"", i, module_obj->module, stack_key->key);
+		cf_debug(AS_SMD, "Stored metadata by module for item %d: module \"%s\" ; key \"%s\"", i, module_obj->module, item->key);
 		// Increment the number of items for this module in this node's hash table.
 		as_smd_shash_incr(module_item_count_hash, module_obj, 1);
 
@@ -2619,6 +2881,42 @@ static shash *as_smd_store_metadata_by_module(as_smd_t *smd, as_smd_msg_t *smd_m
 	return module_item_count_hash;
 }
 
+/*
+ *  Type for copying a module's metadata items into its external hash table as a given node's.
+ */
+typedef struct as_smd_external_copy_s {
+	as_smd_module_t *module_obj;     // Module whose items are copied.
+	cf_node node_id;                 // Node to copy them as.
+} as_smd_external_copy_t;
+
+/*
+ *  Reduce function to copy one of the principal's own metadata items as another node's.
+ */
+static int as_smd_copy_as_external_reduce_fn(void *key, uint32_t keylen, void *object, void *udata)
+{
+//	char *item_key = (char *) key; // (Not used.)
+	as_smd_item_t *item = (as_smd_item_t *) object;
+	as_smd_external_copy_t *copy = (as_smd_external_copy_t *) udata;
+
+	as_smd_put_external_item(copy->module_obj, copy->node_id, item);
+
+	return 0;
+}
+
+/*
+ *  Reduce function to add one module's item count to another module item count hash table.
+ */
+static int as_smd_shash_add_reduce_fn(void *key, void *data, void *udata)
+{
+	as_smd_module_t *module_obj = *((as_smd_module_t **) key);
+	size_t count = *((size_t *) data);
+	shash *module_item_count_hash = (shash *) udata;
+
+	as_smd_shash_incr(module_item_count_hash, module_obj, count);
+
+	return 0;
+}
+
 /*
  *  Type for searching for and returning metadata items from a given node.
  */
@@ -2686,8 +2984,12 @@ static int as_smd_invoke_merge_reduce_fn(void *key, uint32_t keylen, void *objec
 		cf_crash(AS_SMD, "failed to allocate %zu System Metadata item lists", num_lists);
 	}
 
+	// Which node each list is from, and the list's hash, to tell which nodes already hold the merge result.
+	cf_node list_node_ids[num_lists];
+	uint64_t list_hashes[num_lists];
+
 	int list_num = 0;
-	for (int i = 0; i < g_config.paxos_max_cluster_size; i++) {
+	for (int i = 0; i < g_config.paxos_max_cluster_size && list_num < num_lists; i++) {
 		cf_node node_id = g_paxos->succession[i];
 
 		// Skip any non-existent nodes.
@@ -2729,6 +3031,9 @@ static int as_smd_invoke_merge_reduce_fn(void *key, uint32_t keylen, void *objec
 			rchash_reduce(module_obj->external_metadata, as_smd_item_list_for_node_reduce_fn, &search);
 		}
 
+		list_node_ids[list_num] = node_id;
+		list_hashes[list_num] = as_smd_item_list_hash(item_lists_in[list_num]);
+
 		list_num++;
 	}
 
@@ -2787,7 +3092,10 @@ static int as_smd_invoke_merge_reduce_fn(void *key, uint32_t keylen, void *objec
 		rchash_destroy(merge_hash);
 	}
 
-	// Sent out a merged metadata msg via fabric transaction to every cluster node.
+	uint64_t merged_hash = as_smd_item_list_hash(item_list_out);
+	int num_in_sync = 0;
+
+	// Sent out a merged metadata msg via fabric transaction to every cluster node that doesn't already hold it.
 	msg *msg = NULL;
 	as_smd_msg_op_t merge_op = AS_SMD_MSG_OP_ACCEPT_THIS_METADATA;
 	for (int i = 0; i < g_config.paxos_max_cluster_size; i++) {
@@ -2796,12 +3104,28 @@ static int as_smd_invoke_merge_reduce_fn(void *key, uint32_t keylen, void *objec
 		if (!node_id) {
 			continue;
 		}
+
+		bool in_sync = false;
+		for (int j = 0; j < list_num; j++) {
+			if (list_node_ids[j] == node_id) {
+				in_sync = list_hashes[j] == merged_hash && item_lists_in[j]->num_items == item_list_out->num_items;
+				break;
+			}
+		}
+
+		if (in_sync) {
+			num_in_sync++;
+			continue;
+		}
+
 		if (!(msg = as_smd_msg_get(merge_op, item_list_out->item, item_list_out->num_items, module, AS_SMD_ACCEPT_OPT_MERGE))) {
 			cf_crash(AS_SMD, "failed to get a System Metadata fabric msg for operation %s", AS_SMD_MSG_OP_NAME(merge_op));
 		}
 		as_fabric_transact_start(node_id, msg, AS_SMD_TRANSACT_TIMEOUT_MS, transact_complete_fn, smd);
 	}
 
+	cf_debug(AS_SMD, "merged %zu items for module \"%s\" ~~ %d of %d nodes already in sync", item_list_out->num_items, module, num_in_sync, list_num);
+
 #if 0 
 	// Apparently not necessary to do this here, but still need to make sure 
 	// the list containers do not leak.
@@ -2846,19 +3170,128 @@ static int as_smd_receive_metadata(as_smd_t *smd, as_smd_msg_t *smd_msg)
 		cf_crash(AS_SMD, "failed to store metadata by module from node %016lX", smd_msg->node_id);
 	}
 
+	// If these are the modules this node was asked for, add the counts of the modules that already matched.
+	shash *pending_module_item_count_hash = NULL;
+	if (SHASH_OK == shash_get(smd->pending, &(smd_msg->node_id), &pending_module_item_count_hash)) {
+		shash_reduce(pending_module_item_count_hash, as_smd_shash_add_reduce_fn, module_item_count_hash);
+		shash_delete(smd->pending, &(smd_msg->node_id));
+		shash_destroy(pending_module_item_count_hash);
+	}
+
+	as_smd_scoreboard_put(smd, smd_msg->node_id, module_item_count_hash);
+
+	return retval;
+}
+
+/*
+ *  Receive a node's module summaries on the Paxos principal.  Use the principal's own metadata for
+ *   each module that matches, and ask the node for the metadata of the rest.
+ */
+static int as_smd_receive_summary(as_smd_t *smd, as_smd_msg_t *smd_msg)
+{
+	// Only the Paxos principal receives other node's metadata.)
+	if (as_paxos_succession_getprincipal() != g_config.self_node) {
+		cf_debug(AS_SMD, "non-principal node %016lX received module summaries from node %016lX ~~ Ignoring!", g_config.self_node, smd_msg->node_id);
+		return -1;
+	}
+
+	if (as_paxos_get_cluster_key() != smd_msg->cluster_key) {
+		cf_debug(AS_SMD, "received module summaries with non-current cluster key (%016lx != %016lx) from node %016lX ~~ Ignoring!",
+				 smd_msg->cluster_key, as_paxos_get_cluster_key(), smd_msg->node_id);
+		return -1;
+	}
+
+	shash *module_item_count_hash = NULL;
+	if (SHASH_OK != shash_create(&module_item_count_hash, ptr_hash_fn, sizeof(as_smd_module_t *), sizeof(size_t), 19, SHASH_CR_MT_BIGLOCK)) {
+		cf_crash(AS_SMD, "failed to allocate module item count hash table");
+	}
+
+	as_smd_module_summary_t needed[smd_msg->num_summaries + 1];
+	size_t num_needed = 0;
+
+	for (int i = 0; i < smd_msg->num_summaries; i++) {
+		as_smd_module_summary_t *summary = &(smd_msg->summaries[i]);
+		as_smd_module_t *module_obj = NULL;
+
+		if (RCHASH_OK != rchash_get(smd->modules, summary->module_name, strlen(summary->module_name) + 1, (void **) &module_obj)) {
+			// (The module will be created on-the-fly when the node's items arrive.)
+			needed[num_needed].module_name = summary->module_name;
+			needed[num_needed].num_items = 0;
+			needed[num_needed].hash = 0;
+			num_needed++;
+			continue;
+		}
+
+		uint32_t num_items = rchash_get_size(module_obj->my_metadata);
+
+		if (summary->hash == module_obj->my_metadata_hash && summary->num_items == num_items) {
+			cf_debug(AS_SMD, "module \"%s\" on node %016lX matches principal (%u items)", module_obj->module, smd_msg->node_id, num_items);
+
+			// The node holds the same items as the principal, so use the principal's own.
+			if (num_items) {
+				as_smd_external_copy_t copy = { module_obj, smd_msg->node_id };
+				rchash_reduce(module_obj->my_metadata, as_smd_copy_as_external_reduce_fn, &copy);
+				as_smd_shash_incr(module_item_count_hash, module_obj, num_items);
+			}
+		} else {
+			needed[num_needed].module_name = module_obj->module;
+			needed[num_needed].num_items = num_items;
+			needed[num_needed].hash = module_obj->my_metadata_hash;
+			num_needed++;
+		}
+
+		cf_rc_release(module_obj);
+	}
+
+	if (!num_needed) {
+		as_smd_scoreboard_put(smd, smd_msg->node_id, module_item_count_hash);
+		return 0;
+	}
+
+	cf_debug(AS_SMD, "asking node %016lX for metadata of %zu of %u modules", smd_msg->node_id, num_needed, smd_msg->num_summaries);
+
 	// If something is already there, its obsolete, so release it.
 	shash *prev_module_item_count_hash = NULL;
-	if (SHASH_OK == shash_get(smd->scoreboard, &(smd_msg->node_id), &prev_module_item_count_hash)) {
-		cf_debug(AS_SMD, "found an obsolete module item count hash for node %016lX ~~ Deleting!", smd_msg->node_id);
-		if (SHASH_OK != shash_delete(smd->scoreboard, &(smd_msg->node_id))) {
-			cf_warning(AS_SMD, "failed to delete obsolete module item count hash for node %016lX", smd_msg->node_id);
+	if (SHASH_OK == shash_get(smd->pending, &(smd_msg->node_id), &prev_module_item_count_hash)) {
+		shash_delete(smd->pending, &(smd_msg->node_id));
+		shash_destroy(prev_module_item_count_hash);
+	}
+
+	if (SHASH_OK != shash_put_unique(smd->pending, &(smd_msg->node_id), &module_item_count_hash)) {
+		cf_warning(AS_SMD, "failed to put unique node %016lX into System Metadata pending hash table", smd_msg->node_id);
+		shash_destroy(module_item_count_hash);
+		return -1;
+	}
+
+	msg *msg = NULL;
+	as_smd_msg_op_t send_op = AS_SMD_MSG_OP_SEND_METADATA;
+	if (!(msg = as_smd_msg_get(send_op, NULL, 0, NULL, 0)) || as_smd_msg_set_summaries(msg, needed, num_needed)) {
+		cf_crash(AS_SMD, "failed to get a System Metadata fabric msg for operation %s transact start", AS_SMD_MSG_OP_NAME(send_op));
+	}
+
+	as_fabric_transact_start(smd_msg->node_id, msg, AS_SMD_TRANSACT_TIMEOUT_MS, transact_complete_fn, smd);
+
+	return 0;
+}
+
+/*
+ *  Record on the Paxos principal that a node has provided its metadata, and merge once all nodes have.
+ */
+static void as_smd_scoreboard_put(as_smd_t *smd, cf_node node_id, shash *module_item_count_hash)
+{
+	// If something is already there, its obsolete, so release it.
+	shash *prev_module_item_count_hash = NULL;
+	if (SHASH_OK == shash_get(smd->scoreboard, &node_id, &prev_module_item_count_hash)) {
+		cf_debug(AS_SMD, "found an obsolete module item count hash for node %016lX ~~ Deleting!", node_id);
+		if (SHASH_OK != shash_delete(smd->scoreboard, &node_id)) {
+			cf_warning(AS_SMD, "failed to delete obsolete module item count hash for node %016lX", node_id);
 		}
 		shash_destroy(prev_module_item_count_hash);
 	}
 
 	// Note that this node has provided its metadata for this cluster state change.
-	if (SHASH_OK != shash_put_unique(smd->scoreboard, &(smd_msg->node_id), &module_item_count_hash)) {
-		cf_warning(AS_SMD, "failed to put unique node %016lX into System Metadata scoreboard hash table", smd_msg->node_id);
+	if (SHASH_OK != shash_put_unique(smd->scoreboard, &node_id, &module_item_count_hash)) {
+		cf_warning(AS_SMD, "failed to put unique node %016lX into System Metadata scoreboard hash table", node_id);
 	}
 
 	// Merge the metadata when all nodes have reported in.
@@ -2887,8 +3320,6 @@ static int as_smd_receive_metadata(as_smd_t *smd, as_smd_msg_t *smd_msg)
 	} else {
 		cf_debug(AS_SMD, "Cluster size = %zu and smd->scoreboard size = %d ", g_paxos->cluster_size, shash_get_size(smd->scoreboard));
 	}
-
-	return retval;
 }
 
 static int metadata_local_deleteall_fn(void * key, uint32_t key_len, void *object, void *udata)
@@ -2932,8 +3363,12 @@ static int as_smd_accept_metadata(as_smd_t *smd, as_smd_module_t *module_obj, as
 
 	// In case of merge (after cluster state change) drop the existing local metadata definitions
 	// This is done to clean up some metadata, which could have been dropped during the merge
+	uint64_t prev_hash = module_obj->my_metadata_hash;
+	uint32_t prev_num_items = rchash_get_size(module_obj->my_metadata);
+
 	if (smd_msg->options & AS_SMD_ACCEPT_OPT_MERGE) {
 		rchash_reduce(module_obj->my_metadata, metadata_local_deleteall_fn, NULL);
+		module_obj->my_metadata_hash = 0;
 	}
 
 	for (int i = 0; i < smd_msg->items->num_items; i++) {
@@ -2951,8 +3386,10 @@ static int as_smd_accept_metadata(as_smd_t *smd, as_smd_module_t *module_obj, as
 		(module_obj->accept_cb)(module_obj->module, smd_msg->items, module_obj->accept_udata, smd_msg->options);
 	}
 
-	// Persist the accepted metadata for this module.
-	if (as_smd_module_persist(module_obj)) {
+	// Persist the accepted metadata for this module, unless it's unchanged.
+	if (prev_hash == module_obj->my_metadata_hash && prev_num_items == rchash_get_size(module_obj->my_metadata)) {
+		cf_debug(AS_SMD, "accepted metadata for module \"%s\" unchanged ~~ Not persisting", module_obj->module);
+	} else if (as_smd_module_persist(module_obj)) {
 		cf_warning(AS_SMD, "failed to persist accepted metadata for module \"%s\"", module_obj->module);
 	}
 
@@ -3215,6 +3652,14 @@ static void as_smd_process_event (as_smd_t *smd, as_smd_event_t *evt)
 			case AS_SMD_MSG_OP_NODES_CURRENT_METADATA:
 				as_smd_receive_nodes_metadata(smd, module_obj, msg);
 				break;
+
+			case AS_SMD_MSG_OP_MY_CURRENT_SUMMARY:
+				as_smd_receive_summary(smd, msg);
+				break;
+
+			case AS_SMD_MSG_OP_SEND_METADATA:
+				as_smd_send_requested_metadata(smd, msg);
+				break;
 		}
 
 		if (module_obj) {
@@ -37,8 +37,10 @@
 #include "citrusleaf/cf_digest.h"
 #include "citrusleaf/cf_queue.h"
 
+#include "coarse_clock.h"
 #include "dynbuf.h"
 #include "hist.h"
+#include "olock.h"
 #include "util.h"
 #include "socket.h"
 
@@ -72,8 +74,96 @@ typedef struct {
 	bool complete;
 } batch_transaction;
 
+// For data-not-in-memory, found records are collected in groups so their
+// device reads can be issued in storage order.
+#define BATCH_READ_GROUP_SIZE 64
+
+typedef struct {
+	uint32_t n_records;
+	as_partition_reservation rsvs[BATCH_READ_GROUP_SIZE];
+	as_storage_rd rds[BATCH_READ_GROUP_SIZE];
+	cf_arenax_handle r_hs[BATCH_READ_GROUP_SIZE];
+	uint16_t generations[BATCH_READ_GROUP_SIZE];
+} batch_read_group;
+
 static as_thread_pool batch_direct_thread_pool;
 
+// Add a record to the response. If getting data, rd is open - the record's
+// block may already have been read. Closes the rd.
+static void
+batch_add_record(batch_transaction* btr, as_index* r, as_storage_rd* rd, cf_buf_builder** bb_r)
+{
+	as_namespace* ns = btr->ns;
+	bool get_data = btr->get_data;
+
+	if (get_data) {
+		rd->n_bins = as_bin_get_n_bins(r, rd);
+	}
+
+	// Note: this array must stay in scope until the response for this record
+	// has been built, since in the get data w/ record on device case, it's
+	// copied by reference directly into the record descriptor.
+	as_bin stack_bins[!get_data || ns->storage_data_in_memory ? 0 : rd->n_bins];
+
+	if (get_data) {
+		// Figure out which bins you want - for now, all.
+		rd->bins = as_bin_get_all(r, rd, stack_bins);
+		rd->n_bins = as_bin_inuse_count(rd);
+	}
+
+	as_msg_make_response_bufbuilder(r, (get_data ? rd : NULL), bb_r, !get_data, (get_data ? NULL : ns->name), false, false, false, btr->binlist);
+
+	if (get_data) {
+		as_storage_record_close(r, rd);
+	}
+}
+
+// Read a group's records in storage order, then respond record by record.
+static void
+batch_read_group_flush(batch_transaction* btr, batch_read_group* group, cf_buf_builder** bb_r)
+{
+	as_namespace* ns = btr->ns;
+	uint32_t n_records = group->n_records;
+	as_storage_rd* rds[BATCH_READ_GROUP_SIZE];
+
+	for (uint32_t i = 0; i < n_records; i++) {
+		rds[i] = &group->rds[i];
+	}
+
+	as_storage_record_read_batch(rds, n_records);
+
+	for (uint32_t i = 0; i < n_records; i++) {
+		as_storage_rd* rd = rds[i];
+		as_index_ref r_ref;
+
+		r_ref.skip_lock = false;
+		r_ref.r = rd->r;
+		r_ref.r_h = group->r_hs[i];
+
+		olock_vlock(g_record_locks, &r_ref.r->key, &r_ref.olock);
+
+		// Record may have been deleted or expired while unlocked.
+		if (! as_index_is_valid_record(r_ref.r) || as_record_is_doomed(r_ref.r, ns)) {
+			as_msg_make_error_response_bufbuilder(&rd->keyd, AS_PROTO_RESULT_FAIL_NOTFOUND, bb_r, ns->name);
+			as_storage_record_close(r_ref.r, rd);
+		}
+		else {
+			// Record may have been rewritten while unlocked - re-read it.
+			if (r_ref.r->generation != group->generations[i]) {
+				as_storage_record_close(r_ref.r, rd);
+				as_storage_record_open(ns, r_ref.r, rd, &r_ref.r->key);
+			}
+
+			batch_add_record(btr, r_ref.r, rd, bb_r);
+		}
+
+		as_record_done(&r_ref, ns);
+		as_partition_release(&group->rsvs[i]);
+	}
+
+	group->n_records = 0;
+}
+
 // Build response to batch request.
 static void
 batch_build_response(batch_transaction* btr, cf_buf_builder** bb_r)
@@ -82,6 +172,13 @@ batch_build_response(batch_transaction* btr, cf_buf_builder** bb_r)
 	batch_digests *bmds = btr->digests;
 	bool get_data = btr->get_data;
 	uint32_t yield_count = 0;
+	bool group_reads = get_data && ns->storage_type == AS_STORAGE_ENGINE_SSD &&
+			! ns->storage_data_in_memory;
+	batch_read_group* group = NULL;
+
+	if (group_reads && (group = cf_malloc(sizeof(batch_read_group))) != NULL) {
+		group->n_records = 0;
+	}
 
 	for (int i = 0; i < bmds->n_digests; i++)
 	{
@@ -109,34 +206,40 @@ batch_build_response(batch_transaction* btr, cf_buf_builder** bb_r)
 					as_index *r = r_ref.r;
 
 					// Check to see this isn't an expired record waiting to die.
-					if (as_record_is_expired(r)) {
+					if (as_record_is_doomed(r, ns)) {
 						as_msg_make_error_response_bufbuilder(&bmd->keyd, AS_PROTO_RESULT_FAIL_NOTFOUND, bb_r, ns->name);
 					}
-					else {
-						// Make sure it's brought in from storage if necessary.
-						as_storage_rd rd;
-						if (get_data) {
-							as_storage_record_open(ns, r, &rd, &r->key);
-							rd.n_bins = as_bin_get_n_bins(r, &rd);
-						}
+					else if (group) {
+						// Hold on to the record (reserved but not locked) and
+						// the partition until the group is read.
+						uint32_t n = group->n_records++;
 
-						// Note: this array must stay in scope until the
-						// response for this record has been built, since in the
-						// get data w/ record on device case, it's copied by
-						// reference directly into the record descriptor.
-						as_bin stack_bins[!get_data || rd.ns->storage_data_in_memory ? 0 : rd.n_bins];
+						as_storage_record_open(ns, r, &group->rds[n], &r->key);
+						group->r_hs[n] = r_ref.r_h;
+						group->generations[n] = r->generation;
+						group->rsvs[n] = rsv;
 
-						if (get_data) {
-							// Figure out which bins you want - for now, all.
-							rd.bins = as_bin_get_all(r, &rd, stack_bins);
-							rd.n_bins = as_bin_inuse_count(&rd);
+						as_index_reserve(r);
+						cf_shard_counter_incr(&g_stats.global_record_ref_count);
+
+						as_record_done(&r_ref, ns);
+						bmd->done = true;
+
+						if (group->n_records == BATCH_READ_GROUP_SIZE) {
+							batch_read_group_flush(btr, group, bb_r);
 						}
 
-						as_msg_make_response_bufbuilder(r, (get_data ? &rd : NULL), bb_r, !get_data, (get_data ? NULL : ns->name), false, false, false, btr->binlist);
+						goto Next;
+					}
+					else {
+						// Make sure it's brought in from storage if necessary.
+						as_storage_rd rd;
 
 						if (get_data) {
-							as_storage_record_close(r, &rd);
+							as_storage_record_open(ns, r, &rd, &r->key);
 						}
+
+						batch_add_record(btr, r, &rd, bb_r);
 					}
 					as_record_done(&r_ref, ns);
 				}
@@ -163,12 +266,18 @@ batch_build_response(batch_transaction* btr, cf_buf_builder** bb_r)
 				}
 			}
 
+Next:
 			yield_count++;
 			if (yield_count % g_config.batch_priority == 0) {
 				usleep(1);
 			}
 		}
 	}
+
+	if (group) {
+		batch_read_group_flush(btr, group, bb_r);
+		cf_free(group);
+	}
 }
 
 // Send response to client socket.
@@ -296,7 +405,7 @@ batch_worker(void* udata)
 	batch_transaction* btr = (batch_transaction*)udata;
 
 	// Check for timeouts.
-	if (btr->end_time != 0 && cf_getns() > btr->end_time) {
+	if (btr->end_time != 0 && cf_coarse_getns() > btr->end_time) {
 		cf_atomic64_incr(&g_stats.batch_timeout);
 
 		if (btr->fd_h) {
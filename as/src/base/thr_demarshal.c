@@ -25,6 +25,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <pthread.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
@@ -39,10 +40,12 @@
 #include "citrusleaf/cf_clock.h"
 #include "citrusleaf/cf_queue.h"
 
+#include "dynbuf.h"
 #include "fault.h"
 #include "jem.h"
 #include "hist.h"
 #include "socket.h"
+#include "util.h"
 
 #include "base/as_stap.h"
 #include "base/batch.h"
@@ -67,14 +70,34 @@
 
 extern void *thr_demarshal(void *arg);
 
+// Per service thread, only kept when threads accept their own connections.
+typedef struct {
+	cf_atomic64		n_connections;
+	cf_atomic64		n_inline;
+	cf_atomic64		n_queued;
+} demarshal_thread_stats;
+
 typedef struct {
 	cf_poll			polls[MAX_DEMARSHAL_THREADS];
 	unsigned int	num_threads;
 	pthread_t	dm_th[MAX_DEMARSHAL_THREADS];
+	// With a listener per thread, each thread listens on its own SO_REUSEPORT
+	// service socket - [0] is g_config.socket's.
+	cf_socket		*listen_socks[MAX_DEMARSHAL_THREADS];
+	demarshal_thread_stats stats[MAX_DEMARSHAL_THREADS];
 } demarshal_args;
 
 static demarshal_args *g_demarshal_args = 0;
 
+// Whether each service thread accepts on its own socket and keeps the
+// connections it accepts - the kernel spreads new connections over the
+// sockets, so no one thread's accept is a bottleneck.
+static inline bool
+demarshal_listener_per_thread()
+{
+	return g_config.run_to_completion || g_config.service_listener_per_thread;
+}
+
 
 //
 // File handle reaper.
@@ -88,6 +111,84 @@ pthread_t		g_demarshal_reaper_th;
 void *thr_demarshal_reaper_fn(void *arg);
 static cf_queue *g_freeslot = 0;
 
+// Idle connections are found with a timer wheel of one-second buckets. Each
+// table slot in use is in the bucket of the second it would next go idle, as
+// of its last check - activity doesn't move it, but when its bucket comes up
+// it's re-bucketed by its current last_used unless it's really idle. So the
+// reaper looks at a connection about once per idle time, not every second.
+//
+// Buckets are circular doubly-linked lists of slots - the wheel arrays have
+// one entry per table slot, followed by one sentinel entry per bucket. All is
+// protected by g_file_handle_a_LOCK.
+#define REAPER_WHEEL_SIZE 64 // seconds - later times wait in the last bucket
+#define REAPER_NO_SLOT UINT32_MAX
+#define REAPER_REFRESH_SLICE 4096 // slots per lock hold when refreshing security
+
+static uint32_t *g_reaper_next = NULL;
+static uint32_t *g_reaper_prev = NULL;
+static uint64_t g_reaper_sec; // last second whose bucket was expired
+static uint32_t g_reaper_n_used = 0;
+
+static inline uint32_t
+reaper_sentinel(uint64_t sec)
+{
+	return g_file_handle_a_sz + (uint32_t)(sec % REAPER_WHEEL_SIZE);
+}
+
+static inline void
+reaper_unlink(uint32_t slot)
+{
+	// Detached slots are linked to themselves, making this a no-op.
+	g_reaper_next[g_reaper_prev[slot]] = g_reaper_next[slot];
+	g_reaper_prev[g_reaper_next[slot]] = g_reaper_prev[slot];
+	g_reaper_next[slot] = slot;
+	g_reaper_prev[slot] = slot;
+}
+
+static void
+reaper_link(uint32_t slot, uint64_t last_used_ms)
+{
+	uint64_t kill_ms = (uint64_t)g_config.proto_fd_idle_ms;
+	uint64_t sec = kill_ms == 0 ?
+			g_reaper_sec + REAPER_WHEEL_SIZE : (last_used_ms + kill_ms) / 1000 + 1;
+
+	if (sec <= g_reaper_sec) {
+		sec = g_reaper_sec + 1;
+	}
+	else if (sec > g_reaper_sec + REAPER_WHEEL_SIZE) {
+		sec = g_reaper_sec + REAPER_WHEEL_SIZE;
+	}
+
+	uint32_t head = reaper_sentinel(sec);
+
+	g_reaper_next[slot] = head;
+	g_reaper_prev[slot] = g_reaper_prev[head];
+	g_reaper_next[g_reaper_prev[head]] = slot;
+	g_reaper_prev[head] = slot;
+}
+
+// Take a file handle out of the table, releasing the table's reference. Call
+// with g_file_handle_a_LOCK held.
+static void
+demarshal_table_remove(as_file_handle *fd_h)
+{
+	uint32_t slot = fd_h->reaper_slot;
+
+	if (slot == REAPER_NO_SLOT) {
+		return; // reaper got here first
+	}
+
+	reaper_unlink(slot);
+	g_file_handle_a[slot] = 0;
+	fd_h->reaper_slot = REAPER_NO_SLOT;
+	g_reaper_n_used--;
+
+	int i = (int)slot;
+
+	cf_queue_push(g_freeslot, &i);
+	as_release_file_handle(fd_h);
+}
+
 void
 thr_demarshal_pause(as_file_handle *fd_h)
 {
@@ -104,13 +205,21 @@ thr_demarshal_resume(as_file_handle *fd_h)
 	// data, even when edge-triggered. If there is data, the demarshal thread
 	// gets EPOLLIN for this FD.
 
+	// Pipelined messages already read ahead into the connection's buffer
+	// won't raise EPOLLIN - the socket is almost always writable, so ask for
+	// EPOLLOUT to get an event.
+	uint32_t events = EPOLLIN | EPOLLET | EPOLLRDHUP;
+
+	if (fd_h->rbuf_end != fd_h->rbuf_start) {
+		events |= EPOLLOUT;
+	}
+
 	// This causes ENOENT, when we reached NextEvent_FD_Cleanup (e.g, because
 	// the client disconnected) while the transaction was still ongoing.
 
 	static int32_t err_ok[] = { ENOENT };
 	CF_IGNORE_ERROR(cf_poll_modify_socket_forgiving(fd_h->poll, fd_h->sock,
-			EPOLLIN | EPOLLET | EPOLLRDHUP, fd_h,
-			sizeof(err_ok) / sizeof(int32_t), err_ok));
+			events, fd_h, sizeof(err_ok) / sizeof(int32_t), err_ok));
 }
 
 void
@@ -134,6 +243,19 @@ demarshal_file_handle_init()
 			cf_queue_push(g_freeslot, &i);
 		}
 
+		uint32_t n_links = g_file_handle_a_sz + REAPER_WHEEL_SIZE;
+
+		g_reaper_next = cf_malloc(n_links * sizeof(uint32_t));
+		g_reaper_prev = cf_malloc(n_links * sizeof(uint32_t));
+		cf_assert(g_reaper_next && g_reaper_prev, AS_DEMARSHAL, CF_CRITICAL, "allocation: %s", cf_strerror(errno));
+
+		for (uint32_t i = 0; i < n_links; i++) {
+			g_reaper_next[i] = i;
+			g_reaper_prev[i] = i;
+		}
+
+		g_reaper_sec = cf_getms() / 1000;
+
 		pthread_create(&g_demarshal_reaper_th, 0, thr_demarshal_reaper_fn, 0);
 
 		// If config value is 0, set a maximum proto size based on the RLIMIT.
@@ -146,10 +268,72 @@ demarshal_file_handle_init()
 	pthread_mutex_unlock(&g_file_handle_a_LOCK);
 }
 
+// Expire one second's bucket - reap what's really idle, re-bucket the rest.
+static void
+reaper_expire(uint64_t sec, uint64_t now)
+{
+	uint64_t kill_ms = (uint64_t)g_config.proto_fd_idle_ms;
+	uint32_t head = reaper_sentinel(sec);
+	uint32_t slot = g_reaper_next[head];
+
+	// Detach the whole bucket first - re-bucketed slots may land back in it.
+	g_reaper_next[head] = head;
+	g_reaper_prev[head] = head;
+
+	while (slot != head) {
+		uint32_t next = g_reaper_next[slot];
+		as_file_handle *fd_h = g_file_handle_a[slot];
+
+		g_reaper_next[slot] = slot;
+		g_reaper_prev[slot] = slot;
+
+		if (kill_ms == 0 || fd_h->last_used + kill_ms >= now) {
+			reaper_link(slot, fd_h->last_used);
+		}
+		else if (fd_h->fh_info & FH_INFO_DONOT_REAP) {
+			cf_debug(AS_DEMARSHAL, "Not reaping the fd %d as it has the protection bit set", CSFD(fd_h->sock));
+			reaper_link(slot, now);
+		}
+		else {
+			cf_socket_shutdown(fd_h->sock); // will trigger epoll errors
+			cf_debug(AS_DEMARSHAL, "remove unused connection, fd %d", CSFD(fd_h->sock));
+			demarshal_table_remove(fd_h);
+			g_stats.reaper_count++;
+		}
+
+		slot = next;
+	}
+}
+
+// Privileges are refreshed on every connection - a slice at a time, so the
+// demarshal threads aren't locked out of the table for long.
+static void
+reaper_security_refresh()
+{
+	for (uint32_t start = 0; start < g_file_handle_a_sz; start += REAPER_REFRESH_SLICE) {
+		uint32_t end = start + REAPER_REFRESH_SLICE;
+
+		if (end > g_file_handle_a_sz) {
+			end = g_file_handle_a_sz;
+		}
+
+		pthread_mutex_lock(&g_file_handle_a_LOCK);
+
+		for (uint32_t i = start; i < end; i++) {
+			if (g_file_handle_a[i]) {
+				as_security_refresh(g_file_handle_a[i]);
+			}
+		}
+
+		pthread_mutex_unlock(&g_file_handle_a_LOCK);
+	}
+}
+
 // Keep track of the connections, since they're precious. Kill anything that
 // hasn't been used in a while. The file handle array keeps a reference count,
-// and allows a reaper to run through and find the ones to reap. The table is
-// only written by the demarshal threads, and only read by the reaper thread.
+// and the timer wheel lets the reaper find the ones to reap without visiting
+// every connection. Connections that close are taken out of the table by the
+// demarshal threads themselves.
 void *
 thr_demarshal_reaper_fn(void *arg)
 {
@@ -157,55 +341,28 @@ thr_demarshal_reaper_fn(void *arg)
 
 	while (true) {
 		uint64_t now = cf_getms();
-		uint inuse_cnt = 0;
-		uint64_t kill_ms = g_config.proto_fd_idle_ms;
-		bool refresh = false;
 
 		if (now - last > (uint64_t)(g_config.sec_cfg.privilege_refresh_period * 1000)) {
-			refresh = true;
+			reaper_security_refresh();
 			last = now;
 		}
 
 		pthread_mutex_lock(&g_file_handle_a_LOCK);
 
-		for (int i = 0; i < g_file_handle_a_sz; i++) {
-			if (g_file_handle_a[i]) {
-				as_file_handle *fd_h = g_file_handle_a[i];
-
-				if (refresh) {
-					as_security_refresh(fd_h);
-				}
+		uint64_t now_sec = now / 1000;
 
-				// Reap, if asked to.
-				if (fd_h->reap_me) {
-					cf_debug(AS_DEMARSHAL, "Reaping FD %d as requested", CSFD(fd_h->sock));
-					g_file_handle_a[i] = 0;
-					cf_queue_push(g_freeslot, &i);
-					as_release_file_handle(fd_h);
-					fd_h = 0;
-				}
-				// Reap if past kill time.
-				else if ((0 != kill_ms) && (fd_h->last_used + kill_ms < now)) {
-					if (fd_h->fh_info & FH_INFO_DONOT_REAP) {
-						cf_debug(AS_DEMARSHAL, "Not reaping the fd %d as it has the protection bit set", CSFD(fd_h->sock));
-						inuse_cnt++;
-						continue;
-					}
+		// After a long stall, one turn of the wheel covers every bucket.
+		if (now_sec > g_reaper_sec + REAPER_WHEEL_SIZE) {
+			g_reaper_sec = now_sec - REAPER_WHEEL_SIZE;
+		}
 
-					cf_socket_shutdown(fd_h->sock); // will trigger epoll errors
-					cf_debug(AS_DEMARSHAL, "remove unused connection, fd %d", CSFD(fd_h->sock));
-					g_file_handle_a[i] = 0;
-					cf_queue_push(g_freeslot, &i);
-					as_release_file_handle(fd_h);
-					fd_h = 0;
-					g_stats.reaper_count++;
-				}
-				else {
-					inuse_cnt++;
-				}
-			}
+		while (g_reaper_sec < now_sec) {
+			g_reaper_sec++;
+			reaper_expire(g_reaper_sec, now);
 		}
 
+		uint32_t inuse_cnt = g_reaper_n_used;
+
 		pthread_mutex_unlock(&g_file_handle_a_LOCK);
 
 		if ((g_file_handle_a_sz / 10) > (g_file_handle_a_sz - inuse_cnt)) {
@@ -362,6 +519,38 @@ thr_demarshal_config_xdr(cf_socket *sock)
 	return 0;
 }
 
+// A request flagged multiplex makes its connection multiplexed - from then on
+// every request on it is answered as soon as it completes, in any order, and
+// the client matches responses to requests by trid. Only single-record
+// transactions qualify, since batch, scan and query responses don't carry the
+// trid. Returns false if the request can't be multiplexed.
+static bool
+demarshal_multiplex(as_transaction *tr)
+{
+	as_file_handle *fd_h = tr->from.proto_fd_h;
+
+	if (as_transaction_trid(tr) == 0) {
+		cf_warning(AS_DEMARSHAL, "multiplexed request from %s has no trid", fd_h->client);
+		return false;
+	}
+
+	if (as_transaction_is_multi_record(tr)) {
+		cf_warning(AS_DEMARSHAL, "multiplexed request from %s is not single-record", fd_h->client);
+		return false;
+	}
+
+	// Nothing else is in flight on a connection until it's multiplexed.
+	if ((fd_h->fh_info & FH_INFO_MULTIPLEX) == 0) {
+		fd_h->fh_info |= FH_INFO_MULTIPLEX;
+		cf_atomic64_incr(&g_stats.proto_connections_multiplexed);
+	}
+
+	// Go on reading the connection without waiting for this response.
+	thr_demarshal_resume(fd_h);
+
+	return true;
+}
+
 // Log information about a suspicious incoming transaction.
 static void
 log_as_proto_and_peeked_data(as_proto *proto, uint8_t *peekbuf, size_t peeked_data_sz)
@@ -376,6 +565,115 @@ log_as_proto_and_peeked_data(as_proto *proto, uint8_t *peekbuf, size_t peeked_da
 // is done by that thread. Fair fd usage is expected of the client. First thread
 // is special - also does accept [listens for new connections]. It is the only
 // thread which does it.
+// Returns true if the read-ahead buffer holds at least one whole message.
+static bool
+read_ahead_has_msg(const as_file_handle *fd_h)
+{
+	uint32_t n_buffered = fd_h->rbuf_end - fd_h->rbuf_start;
+
+	if (n_buffered < sizeof(as_proto)) {
+		return false;
+	}
+
+	as_proto proto;
+
+	memcpy(&proto, fd_h->rbuf + fd_h->rbuf_start, sizeof(as_proto));
+	as_proto_swap(&proto);
+
+	return proto.sz <= n_buffered - sizeof(as_proto);
+}
+
+// Reads as much as the socket holds (unless a whole message is already
+// buffered), then splits off the next message into fd_h->proto. Messages too
+// big for the buffer are left partially read, for the caller to finish.
+// Returns 1 if fd_h->proto was set, 0 to wait for more data, -1 on error.
+static int
+demarshal_read_ahead(as_file_handle *fd_h)
+{
+	uint32_t buf_sz = g_config.proto_read_buffer_size;
+
+	if (! fd_h->rbuf) {
+		fd_h->rbuf = cf_malloc(buf_sz);
+
+		cf_assert(fd_h->rbuf, AS_DEMARSHAL, CF_CRITICAL, "allocation: %u %s", buf_sz, cf_strerror(errno));
+
+		fd_h->rbuf_start = 0;
+		fd_h->rbuf_end = 0;
+	}
+
+	if (! read_ahead_has_msg(fd_h)) {
+		uint32_t n_buffered = fd_h->rbuf_end - fd_h->rbuf_start;
+
+		if (fd_h->rbuf_start != 0) {
+			memmove(fd_h->rbuf, fd_h->rbuf + fd_h->rbuf_start, n_buffered);
+			fd_h->rbuf_start = 0;
+			fd_h->rbuf_end = n_buffered;
+		}
+
+		int32_t n = cf_socket_recv(fd_h->sock, fd_h->rbuf + n_buffered, buf_sz - n_buffered, 0);
+
+		if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+			cf_detail(AS_DEMARSHAL, "proto socket: read-ahead fail: rv %d errno %d", n, errno);
+			return -1;
+		}
+
+		if (n > 0) {
+			fd_h->rbuf_end += (uint32_t)n;
+			cf_atomic64_incr(&g_stats.proto_read_ahead_recvs);
+		}
+	}
+
+	uint32_t n_buffered = fd_h->rbuf_end - fd_h->rbuf_start;
+
+	if (n_buffered < sizeof(as_proto)) {
+		return 0;
+	}
+
+	as_proto proto;
+
+	memcpy(&proto, fd_h->rbuf + fd_h->rbuf_start, sizeof(as_proto));
+
+	if (proto.version != PROTO_VERSION &&
+			// For backward compatibility, allow version 0 with security
+			// messages.
+			! (proto.version == 0 && proto.type == PROTO_TYPE_SECURITY)) {
+		cf_warning(AS_DEMARSHAL, "proto input from %s: unsupported proto version %u",
+				fd_h->client, proto.version);
+		return -1;
+	}
+
+	as_proto_swap(&proto);
+
+	if (proto.sz > PROTO_SIZE_MAX) {
+		cf_warning(AS_DEMARSHAL, "proto input from %s: msg greater than %d, likely request from non-Aerospike client, rejecting: sz %"PRIu64,
+				fd_h->client, PROTO_SIZE_MAX, (uint64_t)proto.sz);
+		return -1;
+	}
+
+	// The transaction owns (and frees) its message, so it needs its own copy.
+	as_proto *proto_p = cf_malloc(sizeof(as_proto) + proto.sz);
+
+	cf_assert(proto_p, AS_DEMARSHAL, CF_CRITICAL, "allocation: %zu %s", (sizeof(as_proto) + proto.sz), cf_strerror(errno));
+	memcpy(proto_p, &proto, sizeof(as_proto));
+
+	uint64_t n_body = MIN(proto.sz, n_buffered - sizeof(as_proto));
+
+	memcpy(proto_p->data, fd_h->rbuf + fd_h->rbuf_start + sizeof(as_proto), n_body);
+	fd_h->rbuf_start += sizeof(as_proto) + (uint32_t)n_body;
+
+	if (fd_h->rbuf_start == fd_h->rbuf_end) {
+		fd_h->rbuf_start = 0;
+		fd_h->rbuf_end = 0;
+	}
+
+	fd_h->proto = proto_p;
+	fd_h->proto_unread = proto.sz - n_body;
+
+	cf_atomic64_incr(&g_stats.proto_read_ahead_msgs);
+
+	return 1;
+}
+
 void *
 thr_demarshal(void *arg)
 {
@@ -416,8 +714,28 @@ thr_demarshal(void *arg)
 		return(0);
 	}
 
+	demarshal_thread_stats *stats = &g_demarshal_args->stats[thr_id];
+
+	// Configured CPUs let service threads follow the NIC's RSS queues - thread
+	// i with the i'th CPU handling receive interrupts.
+	if (g_config.n_service_thread_cpus != 0) {
+		cf_thread_pin_to_cpu(self, g_config.service_thread_cpus[thr_id % g_config.n_service_thread_cpus]);
+	}
+	else if (g_config.run_to_completion) {
+		cf_thread_pin_to_cpu(self, (uint32_t)thr_id);
+	}
+
+	as_config_sched_thread(AS_SCHED_POOL_SERVICE, self);
+
 	cf_poll_create(&poll);
 
+	// With a listener per thread, other threads accept on their own sockets.
+	if (thr_id != 0 && demarshal_listener_per_thread()) {
+		demarshal_file_handle_init();
+
+		cf_poll_add_socket(poll, g_demarshal_args->listen_socks[thr_id], EPOLLIN | EPOLLERR | EPOLLHUP, &g_demarshal_args->listen_socks[thr_id]);
+	}
+
 	// First thread accepts new connection at interface socket.
 	if (thr_id == 0) {
 		demarshal_file_handle_init();
@@ -462,7 +780,8 @@ thr_demarshal(void *arg)
 		for (i = 0; i < nevents; i++) {
 			cf_socket **ssock = events[i].data;
 
-			if (ssock == &s->sock || ssock == &ls->sock || ssock == &xs->sock) {
+			if (ssock == &s->sock || ssock == &ls->sock || ssock == &xs->sock ||
+					ssock == &g_demarshal_args->listen_socks[thr_id]) {
 				// Accept new connections on the service socket.
 				cf_socket *csock;
 				cf_sock_addr sa;
@@ -516,8 +835,12 @@ thr_demarshal(void *arg)
 				fd_h->trans_active = false;
 				fd_h->proto = 0;
 				fd_h->proto_unread = 0;
+				fd_h->rbuf = NULL;
+				fd_h->rbuf_start = 0;
+				fd_h->rbuf_end = 0;
 				fd_h->fh_info = 0;
 				fd_h->security_filter = as_security_filter_create();
+				pthread_mutex_init(&fd_h->send_lock, NULL);
 
 				// Insert into the global table so the reaper can manage it. Do
 				// this before queueing it up for demarshal threads - once
@@ -535,6 +858,9 @@ thr_demarshal(void *arg)
 				}
 				else {
 					g_file_handle_a[j] = fd_h;
+					fd_h->reaper_slot = (uint32_t)j;
+					g_reaper_n_used++;
+					reaper_link((uint32_t)j, fd_h->last_used);
 				}
 
 				pthread_mutex_unlock(&g_file_handle_a_LOCK);
@@ -546,10 +872,17 @@ thr_demarshal(void *arg)
 					cf_rc_free(fd_h); // will free even with ref-count of 2
 				}
 				else {
-					// Round-robin pick up demarshal thread epoll_fd and add
-					// this new connection to epoll.
-					int id = (id_cntr++) % g_demarshal_args->num_threads;
-					fd_h->poll = g_demarshal_args->polls[id];
+					if (demarshal_listener_per_thread()) {
+						// Keep the connection on this thread.
+						fd_h->poll = poll;
+						cf_atomic64_incr(&stats->n_connections);
+					}
+					else {
+						// Round-robin pick up demarshal thread epoll_fd and add
+						// this new connection to epoll.
+						int id = (id_cntr++) % g_demarshal_args->num_threads;
+						fd_h->poll = g_demarshal_args->polls[id];
+					}
 
 					// Place the client socket in the event queue.
 					cf_poll_add_socket(fd_h->poll, csock, EPOLLIN | EPOLLET | EPOLLRDHUP, fd_h);
@@ -582,9 +915,27 @@ thr_demarshal(void *arg)
 					goto NextEvent;
 				}
 
+				// Streaming mode - buffer as much as the socket holds, and
+				// serve pipelined messages from the buffer.
+				if (fd_h->proto == NULL && g_config.proto_read_buffer_size != 0) {
+#ifdef USE_JEM
+					jem_set_arena(orig_arena);
+#endif
+					int rv = demarshal_read_ahead(fd_h);
+
+					if (rv < 0) {
+						goto NextEvent_FD_Cleanup;
+					}
+
+					if (rv == 0) {
+						goto NextEvent;
+					}
+
+					proto_p = fd_h->proto;
+				}
 				// If pointer is NULL, then we need to create a transaction and
 				// store it in the buffer.
-				if (fd_h->proto == NULL) {
+				else if (fd_h->proto == NULL) {
 					as_proto proto;
 					int sz = cf_socket_available(sock);
 
@@ -828,6 +1179,13 @@ thr_demarshal(void *arg)
 
 					// Fast path for batch requests.
 					if (tr.msgp->msg.info1 & AS_MSG_INFO1_BATCH) {
+						// Batch responses have no trid - can't be multiplexed.
+						if ((fd_h->fh_info & FH_INFO_MULTIPLEX) != 0) {
+							cf_warning(AS_DEMARSHAL, "batch request from %s on multiplexed connection", fd_h->client);
+							as_transaction_demarshal_error(&tr, AS_PROTO_RESULT_FAIL_PARAMETER);
+							goto NextEvent;
+						}
+
 						as_batch_queue_task(&tr);
 						goto NextEvent;
 					}
@@ -839,11 +1197,30 @@ thr_demarshal(void *arg)
 						goto NextEvent;
 					}
 
+					if ((as_transaction_has_multiplex(&tr) ||
+							(fd_h->fh_info & FH_INFO_MULTIPLEX) != 0) &&
+							! demarshal_multiplex(&tr)) {
+						as_transaction_demarshal_error(&tr, AS_PROTO_RESULT_FAIL_PARAMETER);
+						goto NextEvent;
+					}
+
 					ASD_TRANS_DEMARSHAL(nodeid, (uint64_t) tr.msgp, as_transaction_trid(&tr));
 
+					if (g_config.run_to_completion) {
+						// Run to completion in this thread unless it could
+						// block on a device - then use this CPU's queue.
+						if (thr_tsvc_can_process_inline(&tr)) {
+							process_transaction(&tr);
+							cf_atomic64_incr(&stats->n_inline);
+						}
+						else {
+							thr_tsvc_enqueue_local(&tr, (uint32_t)thr_id);
+							cf_atomic64_incr(&stats->n_queued);
+						}
+					}
 					// Either process the transaction directly in this thread,
 					// or queue it for processing by another thread (tsvc/info).
-					if (0 != thr_tsvc_process_or_enqueue(&tr)) {
+					else if (0 != thr_tsvc_process_or_enqueue(&tr)) {
 						cf_warning(AS_DEMARSHAL, "Failed to queue transaction to the service thread");
 						goto NextEvent_FD_Cleanup;
 					}
@@ -869,6 +1246,7 @@ NextEvent_FD_Cleanup:
 				cf_poll_delete_socket(poll, sock);
 				pthread_mutex_lock(&g_file_handle_a_LOCK);
 				fd_h->reap_me = true;
+				demarshal_table_remove(fd_h);
 				as_release_file_handle(fd_h);
 				fd_h = 0;
 				pthread_mutex_unlock(&g_file_handle_a_LOCK);
@@ -892,6 +1270,21 @@ as_demarshal_start()
 	memset(dm, 0, sizeof(demarshal_args));
 	g_demarshal_args = dm;
 
+	if (g_config.run_to_completion) {
+		// One pinned service thread per CPU.
+		uint32_t n_cpus = cf_process_n_cpus();
+
+		g_config.n_service_threads = n_cpus < MAX_DEMARSHAL_THREADS ? (int)n_cpus : MAX_DEMARSHAL_THREADS;
+		g_config.socket.reuse_port = true;
+
+		cf_info(AS_DEMARSHAL, "run-to-completion: %d service threads", g_config.n_service_threads);
+	}
+	else if (g_config.service_listener_per_thread) {
+		g_config.socket.reuse_port = true;
+
+		cf_info(AS_DEMARSHAL, "listener per service thread: %d service threads", g_config.n_service_threads);
+	}
+
 	dm->num_threads = g_config.n_service_threads;
 
 	g_freeslot = cf_queue_create(sizeof(int), true);
@@ -907,6 +1300,23 @@ as_demarshal_start()
 	}
 	cf_socket_disable_blocking(g_config.socket.sock);
 
+	if (demarshal_listener_per_thread()) {
+		dm->listen_socks[0] = g_config.socket.sock;
+
+		for (int i = 1; i < dm->num_threads; i++) {
+			cf_socket_cfg thr_socket = g_config.socket;
+
+			thr_socket.sock = NULL;
+
+			if (0 != cf_socket_init_server(&thr_socket)) {
+				cf_crash(AS_DEMARSHAL, "couldn't initialize service socket for thread %d", i);
+			}
+
+			cf_socket_disable_blocking(thr_socket.sock);
+			dm->listen_socks[i] = thr_socket.sock;
+		}
+	}
+
 	// Note:  The localhost socket address will only be set if the main service socket
 	//        is not already (effectively) listening on the localhost address.
 	if (g_config.localhost_socket.addr) {
@@ -959,3 +1369,36 @@ as_demarshal_start()
 
 	return 0;
 }
+
+// Per service thread statistics - only kept when threads accept their own
+// connections, and only run-to-completion mode runs transactions inline.
+void
+as_demarshal_get_thread_stats(cf_dyn_buf *db)
+{
+	if (! demarshal_listener_per_thread() || ! g_demarshal_args) {
+		return;
+	}
+
+	for (unsigned int i = 0; i < g_demarshal_args->num_threads; i++) {
+		demarshal_thread_stats *stats = &g_demarshal_args->stats[i];
+		char name[64];
+
+		sprintf(name, "service_thread_%u_connections", i);
+		info_append_uint64(db, name, cf_atomic64_get(stats->n_connections));
+
+		if (! g_config.run_to_completion) {
+			continue;
+		}
+
+		sprintf(name, "service_thread_%u_inline", i);
+		info_append_uint64(db, name, cf_atomic64_get(stats->n_inline));
+
+		sprintf(name, "service_thread_%u_queued", i);
+		info_append_uint64(db, name, cf_atomic64_get(stats->n_queued));
+
+		if (! g_config.use_queue_per_device) {
+			sprintf(name, "service_thread_%u_queue", i);
+			info_append_int(db, name, cf_ring_queue_sz(g_transaction_queues[i % g_config.n_transaction_queues]));
+		}
+	}
+}
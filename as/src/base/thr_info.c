@@ -26,6 +26,7 @@
 #include <fcntl.h>
 #include <getopt.h>
 #include <pthread.h>
+#include <sched.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
@@ -44,11 +45,14 @@
 
 #include "xdr_config.h"
 
+#include "alloc_prof.h"
+#include "arenax.h"
 #include "cf_str.h"
 #include "dynbuf.h"
 #include "fault.h"
 #include "jem.h"
 #include "meminfo.h"
+#include "olock.h"
 #include "socket.h"
 
 #include "ai_obj.h"
@@ -57,26 +61,38 @@
 #include "base/asm.h"
 #include "base/batch.h"
 #include "base/datamodel.h"
+#include "base/dim_compact.h"
+#include "base/dim_slab.h"
+#include "base/hot_keys.h"
 #include "base/ldt.h"
+#include "base/metrics.h"
 #include "base/monitor.h"
+#include "base/partition_stream.h"
 #include "base/scan.h"
 #include "base/thr_batch.h"
+#include "base/thr_demarshal.h"
 #include "base/thr_sindex.h"
 #include "base/thr_tsvc.h"
 #include "base/transaction.h"
+#include "base/truncate.h"
 #include "base/xdr_serverside.h"
 #include "base/secondary_index.h"
 #include "base/security.h"
+#include "base/slow_txn.h"
 #include "base/stats.h"
 #include "base/system_metadata.h"
 #include "base/udf_cask.h"
+#include "base/udf_memtracker.h"
 #include "base/xdr_serverside.h"
 #include "fabric/fabric.h"
 #include "fabric/hb.h"
 #include "fabric/hlc.h"
 #include "fabric/migrate.h"
+#include "fabric/partition_digest.h"
 #include "fabric/paxos.h"
+#include "storage/storage.h"
 #include "transaction/proxy.h"
+#include "transaction/repl_log.h"
 #include "transaction/rw_request_hash.h"
 
 #define STR_NS              "ns"
@@ -130,6 +146,7 @@ as_stats_init()
 uint64_t g_start_ms; // start time of the server
 
 static cf_queue *g_info_work_q = 0;
+static cf_queue *g_info_heavy_work_q = 0; // NULL if no heavy pool
 
 //
 // Info has its own fabric service
@@ -177,11 +194,41 @@ typedef struct info_static_s {
 } info_static;
 
 
+//
+// Heavy names are served by their own pool, so they can't hold up cheap ones
+// like statistics. A request with any heavy name goes to the heavy pool.
+//
+
+typedef enum {
+	INFO_CLASS_CHEAP,
+	INFO_CLASS_HEAVY
+} info_class;
+
+typedef struct info_exec_stats_s {
+	cf_atomic64		n_calls;
+	cf_atomic64		total_us;
+	cf_atomic64		max_us;
+} info_exec_stats;
+
+// Last result of a read-only heavy name, reused for info-cache-ttl.
+typedef struct info_cache_s {
+	pthread_mutex_t	lock;
+	char			*param; // NULL for dynamic names
+	uint8_t			*rsp;
+	size_t			rsp_sz;
+	uint64_t		expire_ms;
+	bool			by_generation; // valid while partition generation is unchanged, instead of for info-cache-ttl
+	uint32_t		generation;
+} info_cache;
+
 typedef struct info_dynamic_s {
 	struct info_dynamic_s *next;
 	bool 	def;  // default, but that's a reserved word
 	char *name;
 	as_info_get_value_fn	value_fn;
+	info_class				cls;
+	info_exec_stats			stats;
+	info_cache				*cache; // NULL if not cacheable
 } info_dynamic;
 
 typedef struct info_command_s {
@@ -189,12 +236,17 @@ typedef struct info_command_s {
 	char *name;
 	as_info_command_fn 		command_fn;
 	as_sec_perm				required_perm; // required security permission
+	info_class				cls;
+	info_exec_stats			stats;
+	info_cache				*cache; // NULL if not cacheable
 } info_command;
 
 typedef struct info_tree_s {
 	struct info_tree_s *next;
 	char *name;
 	as_info_get_tree_fn	tree_fn;
+	info_class				cls;
+	info_exec_stats			stats;
 } info_tree;
 
 
@@ -259,13 +311,31 @@ info_get_stats(char *name, cf_dyn_buf *db)
 	info_get_aggregated_namespace_stats(db);
 
 	info_append_int(db, "tsvc_queue", thr_tsvc_queue_get_size());
+	as_demarshal_get_thread_stats(db);
 	info_append_int(db, "info_queue", as_info_queue_get_size());
+	info_append_int(db, "info_heavy_queue", as_info_heavy_queue_get_size());
 	info_append_int(db, "delete_queue", as_nsup_queue_get_size());
 	info_append_uint32(db, "rw_in_progress", rw_request_hash_count());
 	info_append_uint32(db, "proxy_in_progress", as_proxy_hash_count());
-	info_append_uint64(db, "record_refs", g_stats.global_record_ref_count);
+	info_append_uint64(db, "record_refs", cf_shard_counter_get(&g_stats.global_record_ref_count));
+
+	uint64_t max_lock_contended;
+	uint32_t n_hot_locks;
+
+	info_append_uint64(db, "record_lock_contended", olock_contended(g_record_locks, &max_lock_contended, &n_hot_locks));
+	info_append_uint64(db, "record_lock_max_contended", max_lock_contended);
+	info_append_uint32(db, "record_lock_hot_stripes", n_hot_locks);
+
+	cf_fault_async_stats log_stats;
+
+	cf_fault_get_async_stats(&log_stats);
+	info_append_uint64(db, "log_async_queued", log_stats.queued);
+	info_append_uint64(db, "log_async_dropped", log_stats.dropped);
+	info_append_uint64(db, "log_async_rate_limited", log_stats.rate_limited);
+	info_append_uint64(db, "log_async_suppressed", log_stats.suppressed);
 
 	info_append_uint64(db, "client_connections", g_stats.proto_connections_opened - g_stats.proto_connections_closed);
+	info_append_uint64(db, "client_connections_multiplexed", g_stats.proto_connections_multiplexed);
 	info_append_uint64(db, "heartbeat_connections", g_stats.heartbeat_connections_opened - g_stats.heartbeat_connections_closed);
 	info_append_uint64(db, "fabric_connections", g_stats.fabric_connections_opened - g_stats.fabric_connections_closed);
 
@@ -273,8 +343,13 @@ info_get_stats(char *name, cf_dyn_buf *db)
 	info_append_uint64(db, "heartbeat_received_foreign", g_stats.heartbeat_received_foreign);
 
 	info_append_uint64(db, "reaped_fds", g_stats.reaper_count); // not in ticker
+	info_append_uint64(db, "proto_read_ahead_recvs", g_stats.proto_read_ahead_recvs); // not in ticker
+	info_append_uint64(db, "proto_read_ahead_msgs", g_stats.proto_read_ahead_msgs); // not in ticker
 
 	info_append_uint64(db, "info_complete", g_stats.info_complete); // not in ticker
+	info_append_uint64(db, "info_timeout", g_stats.info_timeout); // not in ticker
+	info_append_uint64(db, "info_cache_hits", g_stats.info_cache_hits); // not in ticker
+	info_append_uint32(db, "partition_map_subscribers", as_partition_stream_n_subscribers()); // not in ticker
 
 	info_append_uint64(db, "proxy_retry", g_stats.proxy_retry); // not in ticker
 
@@ -299,6 +374,8 @@ info_get_stats(char *name, cf_dyn_buf *db)
 	info_append_uint64(db, "batch_index_huge_buffers", g_stats.batch_index_huge_buffers);
 	info_append_uint64(db, "batch_index_created_buffers", g_stats.batch_index_created_buffers);
 	info_append_uint64(db, "batch_index_destroyed_buffers", g_stats.batch_index_destroyed_buffers);
+	info_append_uint64(db, "batch_index_stolen_chunks", g_stats.batch_index_stolen_chunks);
+	info_append_uint64(db, "batch_index_dup_keys", g_stats.batch_index_dup_keys);
 
 	info_append_uint64(db, "batch_initiate", g_stats.batch_initiate);
 	info_append_int(db, "batch_queue", as_batch_direct_queue_size());
@@ -320,6 +397,10 @@ info_get_stats(char *name, cf_dyn_buf *db)
 	info_append_uint64(db, "sindex_gc_garbage_found", g_stats.sindex_gc_garbage_found);
 	info_append_uint64(db, "sindex_gc_garbage_cleaned", g_stats.sindex_gc_garbage_cleaned);
 
+	info_append_uint64(db, "udf_result_cache_hits", cf_shard_counter_get(&g_stats.udf_result_cache_hits));
+	info_append_uint64(db, "udf_result_cache_misses", cf_shard_counter_get(&g_stats.udf_result_cache_misses));
+	info_append_uint64(db, "udf_result_cache_evictions", g_stats.udf_result_cache_evictions);
+
 	char paxos_principal[19];
 	snprintf(paxos_principal, 19, "%"PRIX64"", as_paxos_succession_getprincipal());
 	info_append_string(db, "paxos_principal", paxos_principal);
@@ -329,6 +410,10 @@ info_get_stats(char *name, cf_dyn_buf *db)
 
 	info_append_uint64(db, "fabric_msgs_sent", g_stats.fabric_msgs_sent);
 	info_append_uint64(db, "fabric_msgs_rcvd", g_stats.fabric_msgs_rcvd);
+	info_append_uint64(db, "fabric_sends", g_stats.fabric_sends);
+	info_append_uint64(db, "fabric_msg_gets", g_stats.fabric_msg_gets);
+	info_append_uint64(db, "fabric_msg_cache_misses", g_stats.fabric_msg_cache_misses);
+	info_append_uint64(db, "fabric_msg_creates", g_stats.fabric_msg_creates);
 
 	as_xdr_get_stats(name, db);
 
@@ -413,7 +498,23 @@ info_get_replicas_master(char *name, cf_dyn_buf *db)
 int
 info_get_replicas_all(char *name, cf_dyn_buf *db)
 {
-	as_partition_get_replicas_all_str(db);
+	as_partition_get_replicas_all_str(db, false);
+
+	return(0);
+}
+
+int
+info_get_replicas_rack(char *name, cf_dyn_buf *db)
+{
+	as_partition_get_replicas_all_str(db, true);
+
+	return(0);
+}
+
+int
+info_get_racks(char *name, cf_dyn_buf *db)
+{
+	as_paxos_get_racks_str(db);
 
 	return(0);
 }
@@ -980,6 +1081,157 @@ info_command_alloc_info(char *name, char *params, cf_dyn_buf *db)
 	return 0;
 }
 
+//
+// Online compaction of a data-in-memory namespace's heap - moves particles,
+// bin spaces and record spaces out of sparse JEMalloc runs, at most
+// records-per-sec records a second (default 100000, 0 for no limit). Without
+// an action, reports the run in progress or the last run, with arena stats
+// from before and after.
+//
+// Format:
+//	dim-compact:[action=start;ns=<NS>[;records-per-sec=<N>]]
+//	dim-compact:action=stop
+//
+// Example output:
+//	status=done:ns=test:...:before-active-bytes=6442450944:...:before-fragmentation-pct=38:...:after-fragmentation-pct=6
+//
+int
+info_command_dim_compact(char *name, char *params, cf_dyn_buf *db)
+{
+	char action[16];
+	int action_len = sizeof(action);
+
+	if (0 != as_info_parameter_get(params, "action", action, &action_len)) {
+		as_dim_compact_get_info(db);
+		return 0;
+	}
+
+	const char *err = NULL;
+
+	if (0 == strcmp(action, "start")) {
+		char ns_name[AS_ID_NAMESPACE_SZ];
+		int ns_name_len = sizeof(ns_name);
+		as_namespace *ns = NULL;
+		char rate_str[16];
+		int rate_str_len = sizeof(rate_str);
+		uint32_t records_per_sec = AS_DIM_COMPACT_DEFAULT_RECORDS_PER_SEC;
+
+		if (0 != as_info_parameter_get(params, "ns", ns_name, &ns_name_len) ||
+				! (ns = as_namespace_get_byname(ns_name))) {
+			err = "bad-ns";
+		}
+		else if (0 == as_info_parameter_get(params, "records-per-sec",
+				rate_str, &rate_str_len) &&
+				0 != cf_str_atoi_u32(rate_str, &records_per_sec)) {
+			err = "bad-records-per-sec";
+		}
+		else {
+			err = as_dim_compact_start(ns, records_per_sec);
+		}
+	}
+	else if (0 == strcmp(action, "stop")) {
+		err = as_dim_compact_stop();
+	}
+	else {
+		err = "bad-action";
+	}
+
+	if (err) {
+		cf_dyn_buf_append_string(db, "error-");
+		cf_dyn_buf_append_string(db, err);
+	}
+	else {
+		cf_dyn_buf_append_string(db, "ok");
+	}
+
+	return 0;
+}
+
+//
+// Slab pool stats for a bin-space-slabs namespace - overall and per element
+// size - and the state of the last compaction. With action=compact, starts a
+// background pass that empties slabs under max-fill-pct full (default 50).
+//
+// Format:
+//	dim-slabs:ns=<NS>[;action=compact[;max-fill-pct=<PCT>]]
+//
+// Example output:
+//	enabled=true:slabs=52100:slab-bytes=213401600:inuse-bytes=140845056:fill-pct=66:...;element-size=40:slabs=12030:...
+//
+int
+info_command_dim_slabs(char *name, char *params, cf_dyn_buf *db)
+{
+	char ns_name[AS_ID_NAMESPACE_SZ];
+	int ns_name_len = sizeof(ns_name);
+	as_namespace *ns = NULL;
+
+	if (0 != as_info_parameter_get(params, "ns", ns_name, &ns_name_len) ||
+			! (ns = as_namespace_get_byname(ns_name))) {
+		cf_dyn_buf_append_string(db, "error-bad-ns");
+		return 0;
+	}
+
+	char action[16];
+	int action_len = sizeof(action);
+
+	if (0 != as_info_parameter_get(params, "action", action, &action_len)) {
+		as_dim_slab_get_info(ns, db);
+		return 0;
+	}
+
+	const char *err = NULL;
+
+	if (0 == strcmp(action, "compact")) {
+		char pct_str[8];
+		int pct_str_len = sizeof(pct_str);
+		uint32_t max_fill_pct = AS_DIM_SLAB_DEFAULT_MAX_FILL_PCT;
+
+		if (0 == as_info_parameter_get(params, "max-fill-pct", pct_str,
+				&pct_str_len) && 0 != cf_str_atoi_u32(pct_str, &max_fill_pct)) {
+			err = "bad-max-fill-pct";
+		}
+		else {
+			err = as_dim_slab_compact_start(ns, max_fill_pct);
+		}
+	}
+	else {
+		err = "bad-action";
+	}
+
+	if (err) {
+		cf_dyn_buf_append_string(db, "error-");
+		cf_dyn_buf_append_string(db, err);
+	}
+	else {
+		cf_dyn_buf_append_string(db, "ok");
+	}
+
+	return 0;
+}
+
+//
+// Sampled allocation profile - estimated live bytes, and allocated bytes and
+// allocations with their rates since the last report, per subsystem. Samples
+// are taken every alloc-prof-interval bytes allocated.
+//
+// Format:
+//	alloc-prof
+//
+// Example output:
+//	interval=524288:live-samples=8214:dropped-samples=0;tag=index:live-bytes=1073741824:alloc-bytes=...
+//
+int
+info_command_alloc_prof(char *name, char *params, cf_dyn_buf *db)
+{
+#ifdef MEM_COUNT
+	cf_alloc_prof_get_info(db);
+#else
+	cf_dyn_buf_append_string(db, "error-not-compiled-in");
+#endif
+
+	return 0;
+}
+
 int
 info_command_mem(char *name, char *params, cf_dyn_buf *db)
 {
@@ -1495,6 +1747,132 @@ info_command_smd_cmd(char *name, char *params, cf_dyn_buf *db)
 	return 0;
 }
 
+int
+info_command_truncate(char *name, char *params, cf_dyn_buf *db)
+{
+	/*
+	 *  Command Format:  "truncate:namespace=<ns>{;set=<set>;lut=<lut>}"
+	 *
+	 *  where <lut> is milliseconds since the Citrusleaf epoch, and defaults to
+	 *  now - records last updated before it are removed.
+	 */
+	char ns_name[AS_ID_NAMESPACE_SZ];
+	int ns_name_len = sizeof(ns_name);
+
+	if (as_info_parameter_get(params, "namespace", ns_name, &ns_name_len) != 0) {
+		cf_warning(AS_INFO, "The \"%s:\" command requires a valid \"namespace\" parameter", name);
+		cf_dyn_buf_append_string(db, "error");
+		return 0;
+	}
+
+	char set_name[AS_SET_NAME_MAX_SIZE];
+	int set_name_len = sizeof(set_name);
+	int rv = as_info_parameter_get(params, "set", set_name, &set_name_len);
+
+	if (rv == -2) {
+		cf_warning(AS_INFO, "The \"%s:\" command \"set\" parameter is too long", name);
+		cf_dyn_buf_append_string(db, "error");
+		return 0;
+	}
+
+	bool has_set = rv == 0;
+
+	char lut_str[24];
+	int lut_str_len = sizeof(lut_str);
+
+	rv = as_info_parameter_get(params, "lut", lut_str, &lut_str_len);
+
+	if (rv == -2) {
+		cf_warning(AS_INFO, "The \"%s:\" command \"lut\" parameter is too long", name);
+		cf_dyn_buf_append_string(db, "error");
+		return 0;
+	}
+
+	bool has_lut = rv == 0;
+
+	if (as_truncate_cmd(ns_name, has_set ? set_name : NULL,
+			has_lut ? lut_str : NULL) != 0) {
+		cf_dyn_buf_append_string(db, "error");
+		return 0;
+	}
+
+	cf_dyn_buf_append_string(db, "ok");
+
+	return 0;
+}
+
+//
+// Per-partition hash trees over (digest, generation, LUT), for checking replica
+// consistency. partition-digest gives this node's tree to the given depth - 0
+// root, 1 mids, 2 leaves - so a tool can compare nodes top-down itself.
+// partition-compare fetches another node's tree over fabric and reports the
+// divergent leaves - leaf n holds the partition's digests with byte 2 equal
+// to n. Both reduce the partition, throttled.
+//
+// Format:
+//	partition-digest:namespace=<NS>;pid=<PID>[;depth=<0-2>]
+//	partition-compare:namespace=<NS>;pid=<PID>;node=<NODE-ID>
+//
+// Example output:
+//	records=4112:hash=9C3A51E07F2B64D8:nodes=251/...,266/...,...
+//	mismatch:local-records=4112:remote-records=4109:leaves=17,130-131
+//
+int
+info_command_partition_digest(char *name, char *params, cf_dyn_buf *db)
+{
+	char ns_name[AS_ID_NAMESPACE_SZ];
+	int ns_name_len = sizeof(ns_name);
+	as_namespace *ns = NULL;
+	char pid_str[8];
+	int pid_str_len = sizeof(pid_str);
+	uint32_t pid;
+	const char *err = NULL;
+
+	if (0 != as_info_parameter_get(params, "namespace", ns_name, &ns_name_len) ||
+			! (ns = as_namespace_get_byname(ns_name))) {
+		err = "bad-namespace";
+	}
+	else if (0 != as_info_parameter_get(params, "pid", pid_str, &pid_str_len) ||
+			0 != cf_str_atoi_u32(pid_str, &pid)) {
+		err = "bad-pid";
+	}
+	else if (0 == strcmp(name, "partition-compare")) {
+		char node_str[24];
+		int node_str_len = sizeof(node_str);
+		uint64_t node;
+
+		if (0 != as_info_parameter_get(params, "node", node_str, &node_str_len) ||
+				0 != cf_str_atoi_u64_x(node_str, &node, 16)) {
+			err = "bad-node";
+		}
+		else {
+			err = as_partition_digest_compare(ns, (as_partition_id)pid,
+					(cf_node)node, db);
+		}
+	}
+	else {
+		char depth_str[4];
+		int depth_str_len = sizeof(depth_str);
+		uint32_t depth = 0;
+
+		if (0 == as_info_parameter_get(params, "depth", depth_str,
+				&depth_str_len) && 0 != cf_str_atoi_u32(depth_str, &depth)) {
+			err = "bad-depth";
+		}
+		else {
+			err = as_partition_digest_get_info(ns, (as_partition_id)pid, depth,
+					db);
+		}
+	}
+
+	if (err) {
+		cf_dyn_buf_append_string(db, "error-");
+		cf_dyn_buf_append_string(db, err);
+	}
+
+	return 0;
+}
+
 int
 info_command_mon_cmd(char *name, char *params, cf_dyn_buf *db)
 {
@@ -1595,6 +1973,71 @@ info_command_mon_cmd(char *name, char *params, cf_dyn_buf *db)
 }
 
 
+// Same form as configured - e.g. "0-7,16-23".
+static void
+info_append_cpu_list(cf_dyn_buf *db, const char *name, const uint16_t *cpus, uint32_t n_cpus)
+{
+	cf_dyn_buf_append_string(db, name);
+	cf_dyn_buf_append_char(db, '=');
+
+	if (n_cpus == 0) {
+		cf_dyn_buf_append_string(db, "null;");
+		return;
+	}
+
+	for (uint32_t i = 0; i < n_cpus; i++) {
+		uint32_t j = i;
+
+		while (j + 1 < n_cpus && cpus[j + 1] == cpus[j] + 1) {
+			j++;
+		}
+
+		if (i != 0) {
+			cf_dyn_buf_append_char(db, ',');
+		}
+
+		cf_dyn_buf_append_uint32(db, cpus[i]);
+
+		if (j != i) {
+			cf_dyn_buf_append_char(db, '-');
+			cf_dyn_buf_append_uint32(db, cpus[j]);
+			i = j;
+		}
+	}
+
+	cf_dyn_buf_append_char(db, ';');
+}
+
+// <pool>-thread-cpus and <pool>-thread-sched for each pool - the real-time
+// policies show their priority, e.g. "fifo:10".
+static void
+info_append_thread_sched(cf_dyn_buf *db)
+{
+	char name[64];
+
+	for (as_sched_pool pool = 0; pool < AS_N_SCHED_POOLS; pool++) {
+		const as_thread_sched *ts = &g_config.thread_sched[pool];
+		const char *pool_str = as_sched_pool_str(pool);
+
+		// Service thread CPUs are service-thread-cpus.
+		if (pool != AS_SCHED_POOL_SERVICE) {
+			snprintf(name, sizeof(name), "%s-thread-cpus", pool_str);
+			info_append_cpu_list(db, name, ts->cpus, ts->n_cpus);
+		}
+
+		snprintf(name, sizeof(name), "%s-thread-sched", pool_str);
+		cf_dyn_buf_append_string(db, name);
+		cf_dyn_buf_append_char(db, '=');
+		cf_dyn_buf_append_string(db, as_sched_policy_str(ts->policy));
+
+		if (ts->policy == SCHED_FIFO || ts->policy == SCHED_RR) {
+			cf_dyn_buf_append_char(db, ':');
+			cf_dyn_buf_append_int(db, ts->priority);
+		}
+
+		cf_dyn_buf_append_char(db, ';');
+	}
+}
 
 void
 info_service_config_get(cf_dyn_buf *db)
@@ -1607,7 +2050,14 @@ info_service_config_get(cf_dyn_buf *db)
 	info_append_int(db, "transaction-threads-per-queue", g_config.n_transaction_threads_per_queue);
 	info_append_int(db, "proto-fd-max", g_config.n_proto_fd_max);
 
+	info_append_bool(db, "admission-control", g_config.admission_control);
+	info_append_uint32(db, "admission-device-latency-ms", g_config.admission_device_latency_ms);
+	info_append_uint32(db, "admission-queue-wait-ms", g_config.admission_queue_wait_ms);
+	info_append_uint32(db, "alloc-prof-interval", g_config.alloc_prof_interval);
 	info_append_bool(db, "allow-inline-transactions", g_config.allow_inline_transactions);
+	info_append_uint32(db, "background-max-records-per-sec", g_config.background_max_records_per_sec);
+	info_append_bool(db, "background-udf-inline", g_config.background_udf_inline);
+	info_append_uint32(db, "balance-threads", g_config.n_balance_threads);
 	info_append_int(db, "batch-threads", g_config.n_batch_threads);
 	info_append_uint32(db, "batch-max-buffers-per-queue", g_config.batch_max_buffers_per_queue);
 	info_append_uint32(db, "batch-max-requests", g_config.batch_max_requests);
@@ -1629,18 +2079,31 @@ info_service_config_get(cf_dyn_buf *db)
 	info_append_bool(db, "generation-disable", g_config.generation_disable);
 	info_append_uint32(db, "hist-track-back", g_config.hist_track_back);
 	info_append_uint32(db, "hist-track-slice", g_config.hist_track_slice);
+	info_append_uint32(db, "hist-track-precision", g_config.hist_track_precision);
+	info_append_uint32(db, "slow-txn-log-rate", g_config.slow_txn_log_rate);
+	info_append_uint32(db, "slow-txn-threshold", g_config.slow_txn_threshold);
+	info_append_uint32(db, "hot-key-sample-rate", g_config.hot_key_sample_rate);
 	info_append_string(db, "hist-track-thresholds", g_config.hist_track_thresholds ? g_config.hist_track_thresholds : "null");
 	info_append_int(db, "info-threads", g_config.n_info_threads);
+	info_append_int(db, "info-heavy-threads", g_config.n_info_heavy_threads);
+	info_append_uint32(db, "info-cache-ttl", g_config.info_cache_ttl);
+	info_append_uint32(db, "info-timeout", g_config.info_timeout);
 	info_append_bool(db, "ldt-benchmarks", g_config.ldt_benchmarks);
+	info_append_bool(db, "log-async", cf_fault_is_using_async());
 	info_append_bool(db, "log-local-time", cf_fault_is_using_local_time());
+	info_append_uint64(db, "migrate-max-bytes-per-sec", g_config.migrate_max_bytes_per_sec);
 	info_append_int(db, "migrate-max-num-incoming", g_config.migrate_max_num_incoming);
 	info_append_int(db, "migrate-rx-lifetime-ms", g_config.migrate_rx_lifetime_ms);
+	info_append_uint64(db, "migrate-rx-memory-budget", g_config.migrate_rx_memory_budget);
+	info_append_uint32(db, "migrate-split-threads", g_config.migrate_split_threads);
 	info_append_int(db, "migrate-threads", g_config.n_migrate_threads);
 	info_append_uint32(db, "nsup-delete-sleep", g_config.nsup_delete_sleep);
 	info_append_uint32(db, "nsup-period", g_config.nsup_period);
 	info_append_bool(db, "nsup-startup-evict", g_config.nsup_startup_evict);
+	info_append_uint32(db, "nsup-threads", g_config.n_nsup_threads);
 	info_append_uint64(db, "paxos-max-cluster-size", g_config.paxos_max_cluster_size);
 
+	info_append_bool(db, "paxos-compact-sync", g_config.paxos_compact_sync);
 	info_append_string(db, "paxos-protocol",
 			(AS_PAXOS_PROTOCOL_V1 == g_config.paxos_protocol ? "v1" :
 				(AS_PAXOS_PROTOCOL_V2 == g_config.paxos_protocol ? "v2" :
@@ -1652,13 +2115,18 @@ info_service_config_get(cf_dyn_buf *db)
 			(AS_PAXOS_RECOVERY_POLICY_AUTO_RESET_MASTER == g_config.paxos_recovery_policy ? "auto-reset-master" : "undefined"));
 
 	info_append_uint32(db, "paxos-retransmit-period", g_config.paxos_retransmit_period);
+	info_append_uint32(db, "proto-compression-threshold", g_config.proto_compression_threshold);
 	info_append_int(db, "proto-fd-idle-ms", g_config.proto_fd_idle_ms);
+	info_append_uint32(db, "proto-read-buffer-size", g_config.proto_read_buffer_size);
 	info_append_int(db, "proto-slow-netio-sleep-ms", g_config.proto_slow_netio_sleep_ms); // dynamic only
+	info_append_uint32(db, "proxy-batch-us", g_config.proxy_batch_us);
+	info_append_uint32(db, "query-aggr-batch-size", g_config.query_aggr_bsize);
 	info_append_uint32(db, "query-batch-size", g_config.query_bsize);
 	info_append_uint32(db, "query-buf-size", g_config.query_buf_size); // dynamic only
 	info_append_uint32(db, "query-bufpool-size", g_config.query_bufpool_size);
 	info_append_bool(db, "query-in-transaction-thread", g_config.query_in_transaction_thr);
 	info_append_uint32(db, "query-long-q-max-size", g_config.query_long_q_max_size);
+	info_append_uint32(db, "query-max-records-per-sec", g_config.query_max_records_per_sec);
 	info_append_bool(db, "query-microbenchmark", g_config.query_enable_histogram); // dynamic only
 	info_append_bool(db, "query-pre-reserve-partitions", g_config.partitions_pre_reserved);
 	info_append_uint32(db, "query-priority", g_config.query_priority);
@@ -1671,12 +2139,23 @@ info_service_config_get(cf_dyn_buf *db)
 	info_append_uint32(db, "query-threshold", g_config.query_threshold);
 	info_append_uint64(db, "query-untracked-time-ms", g_config.query_untracked_time_ms);
 	info_append_uint32(db, "query-worker-threads", g_config.query_worker_threads);
+	info_append_uint32(db, "rack-id", g_config.rack_id);
+	info_append_uint32(db, "record-locks", g_config.n_record_locks);
+	info_append_bool(db, "record-locks-adaptive", g_config.record_locks_adaptive);
+	info_append_uint32(db, "replica-write-batch-us", g_config.replica_write_batch_us);
 	info_append_bool(db, "respond-client-on-master-completion", g_config.respond_client_on_master_completion);
 	info_append_bool(db, "run-as-daemon", g_config.run_as_daemon);
+	info_append_bool(db, "run-to-completion", g_config.run_to_completion);
 	info_append_uint32(db, "scan-max-active", g_config.scan_max_active);
 	info_append_uint32(db, "scan-max-done", g_config.scan_max_done);
+	info_append_uint32(db, "scan-max-records-per-sec", g_config.scan_max_records_per_sec);
+	info_append_uint32(db, "scan-max-records-per-sec-per-job", g_config.scan_max_records_per_sec_per_job);
+	info_append_uint32(db, "scan-max-threads-per-job", g_config.scan_max_threads_per_job);
 	info_append_uint32(db, "scan-max-udf-transactions", g_config.scan_max_udf_transactions);
 	info_append_uint32(db, "scan-threads", g_config.scan_threads);
+	info_append_bool(db, "service-listener-per-thread", g_config.service_listener_per_thread);
+	info_append_cpu_list(db, "service-thread-cpus", g_config.service_thread_cpus, g_config.n_service_thread_cpus);
+	info_append_thread_sched(db);
 	info_append_uint32(db, "sindex-builder-threads", g_config.sindex_builder_threads);
 
 	if (g_config.sindex_data_max_memory != ULONG_MAX) {
@@ -1687,11 +2166,14 @@ info_service_config_get(cf_dyn_buf *db)
 	}
 
 	info_append_bool(db, "sindex-gc-enable-histogram", g_config.sindex_gc_enable_histogram); // dynamic only
+	info_append_string(db, "storage-trace-directory", g_config.storage_trace_directory ? g_config.storage_trace_directory : "null");
 	info_append_uint32(db, "ticker-interval", g_config.ticker_interval);
 	info_append_int(db, "transaction-max-ms", (int)(g_config.transaction_max_ns / 1000000));
 	info_append_uint32(db, "transaction-pending-limit", g_config.transaction_pending_limit);
 	info_append_bool(db, "transaction-repeatable-read", g_config.transaction_repeatable_read);
 	info_append_uint32(db, "transaction-retry-ms", g_config.transaction_retry_ms);
+	info_append_bool(db, "transaction-threads-adaptive", g_config.transaction_threads_adaptive);
+	info_append_uint64(db, "udf-runtime-max-memory", g_config.udf_runtime_max_memory);
 	info_append_bool(db, "use-queue-per-device", g_config.use_queue_per_device);
 	info_append_string(db, "work-directory", g_config.work_directory ? g_config.work_directory : "null");
 	info_append_bool(db, "write-duplicate-resolution-disable", g_config.write_duplicate_resolution_disable);
@@ -1705,6 +2187,7 @@ info_service_config_get(cf_dyn_buf *db)
 	info_append_bool(db, "memory-accounting", g_config.memory_accounting);
 #endif
 	info_append_uint32(db, "prole-extra-ttl", g_config.prole_extra_ttl);
+	info_append_uint32(db, "non-master-gc-rps", g_config.non_master_gc_rps);
 	info_append_bool(db, "non-master-sets-delete", g_config.non_master_sets_delete); // dynamic only
 }
 
@@ -1744,6 +2227,15 @@ info_network_config_get(cf_dyn_buf *db)
 	info_append_int(db, "fabric.keepalive-intvl", g_config.fabric_keepalive_intvl);
 	info_append_int(db, "fabric.keepalive-probes", g_config.fabric_keepalive_probes);
 	info_append_int(db, "fabric.latency-max-ms", g_config.fabric_latency_max_ms);
+	info_append_int(db, "fabric.channel-bulk-fds", g_config.fabric_channel_fds[AS_FABRIC_CHANNEL_BULK]);
+	info_append_int(db, "fabric.channel-bulk-send-buf", g_config.fabric_channel_send_buf[AS_FABRIC_CHANNEL_BULK]);
+	info_append_int(db, "fabric.channel-bulk-workers", g_config.fabric_channel_workers[AS_FABRIC_CHANNEL_BULK]);
+	info_append_int(db, "fabric.channel-ctrl-fds", g_config.fabric_channel_fds[AS_FABRIC_CHANNEL_CTRL]);
+	info_append_int(db, "fabric.channel-ctrl-send-buf", g_config.fabric_channel_send_buf[AS_FABRIC_CHANNEL_CTRL]);
+	info_append_int(db, "fabric.channel-ctrl-workers", g_config.fabric_channel_workers[AS_FABRIC_CHANNEL_CTRL]);
+	info_append_int(db, "fabric.channel-rw-fds", g_config.fabric_channel_fds[AS_FABRIC_CHANNEL_RW]);
+	info_append_int(db, "fabric.channel-rw-send-buf", g_config.fabric_channel_send_buf[AS_FABRIC_CHANNEL_RW]);
+	info_append_int(db, "fabric.channel-rw-workers", g_config.fabric_channel_workers[AS_FABRIC_CHANNEL_RW]);
 
 	// Info:
 
@@ -1751,6 +2243,7 @@ info_network_config_get(cf_dyn_buf *db)
 	// because info.port conflicts with XDR config parameter. Ideally XDR should
 	// use xdr.info.port and asd should use info.port.
 	info_append_int(db, "info.port", g_config.info_port);
+	info_append_int(db, "info.metrics-port", g_config.metrics_port);
 }
 
 
@@ -1780,6 +2273,9 @@ info_namespace_config_get(char* context, cf_dyn_buf *db)
 	cf_hist_track_get_settings(ns->udf_hist, db);
 	cf_hist_track_get_settings(ns->write_hist, db);
 
+	info_append_bool(db, "async-replication", ns->async_replication);
+	info_append_uint64(db, "async-replication-max-lag", ns->async_replication_max_lag);
+	info_append_bool(db, "bin-space-slabs", ns->bin_space_slabs);
 	info_append_uint32(db, "cold-start-evict-ttl", ns->cold_start_evict_ttl);
 
 	if (ns->conflict_resolution_policy == AS_NAMESPACE_CONFLICT_RESOLUTION_POLICY_GENERATION) {
@@ -1801,20 +2297,41 @@ info_namespace_config_get(char* context, cf_dyn_buf *db)
 	info_append_bool(db, "enable-benchmarks-udf-sub", ns->udf_sub_benchmarks_enabled);
 	info_append_bool(db, "enable-benchmarks-write", ns->write_benchmarks_enabled);
 	info_append_bool(db, "enable-hist-proxy", ns->proxy_hist_enabled);
+	info_append_bool(db, "enable-hist-stages", ns->stage_hist_enabled);
+	info_append_bool(db, "evict-continuous", ns->evict_continuous);
 	info_append_uint32(db, "evict-hist-buckets", ns->evict_hist_buckets);
 	info_append_uint32(db, "evict-tenths-pct", ns->evict_tenths_pct);
+	info_append_bool(db, "expiration-index", ns->expiration_index);
 	info_append_int(db, "high-water-disk-pct", (int)(ns->hwm_disk * 100));
 	info_append_int(db, "high-water-memory-pct", (int)(ns->hwm_memory * 100));
+	info_append_bool(db, "incremental-histograms", ns->incremental_histograms);
+	info_append_string(db, "index-flash-path",
+			ns->index_flash_path ? ns->index_flash_path : "null");
+	info_append_string(db, "index-numa-policy",
+			ns->index_numa_policy == AS_INDEX_NUMA_POLICY_INTERLEAVE ? "interleave" : "none");
+	info_append_uint64(db, "index-page-size", ns->index_page_size);
 	info_append_bool(db, "ldt-enabled", ns->ldt_enabled);
 	info_append_uint32(db, "ldt-gc-rate", ns->ldt_gc_sleep_us / 1000000);
 	info_append_uint32(db, "ldt-page-size", ns->ldt_page_size);
 	info_append_uint64(db, "max-ttl", ns->max_ttl);
+	info_append_string(db, "memory-snapshot-dir", ns->memory_snapshot_dir ? ns->memory_snapshot_dir : "null");
+	info_append_uint64(db, "memory-snapshot-max-write-rate", ns->memory_snapshot_max_write_rate);
+	info_append_uint32(db, "memory-snapshot-period", ns->memory_snapshot_period);
+	info_append_uint32(db, "memory-snapshot-threads", ns->memory_snapshot_threads);
+	info_append_uint32(db, "migrate-changelog-entries", ns->migrate_changelog_entries);
+	info_append_uint32(db, "migrate-changelog-max-age", ns->migrate_changelog_max_age);
+	info_append_bool(db, "migrate-compression", ns->migrate_compression);
+	info_append_bool(db, "migrate-delta", ns->migrate_delta);
 	info_append_uint32(db, "migrate-order", ns->migrate_order);
 	info_append_uint32(db, "migrate-sleep", ns->migrate_sleep);
+	info_append_uint32(db, "nsup-period", ns->nsup_period);
 	// Note - no obj-size-hist-max, too much to reverse rounding algorithm.
+	info_append_uint32(db, "partition-tree-sprigs", ns->tree_sprigs);
+	info_append_bool(db, "read-coalescing", ns->read_coalescing);
 	info_append_string(db, "read-consistency-level-override", NS_READ_CONSISTENCY_LEVEL_NAME());
 	info_append_bool(db, "single-bin", ns->single_bin);
 	info_append_int(db, "stop-writes-pct", (int)(ns->stop_writes_pct * 100));
+	info_append_uint32(db, "transaction-queues", ns->transaction_queues);
 	info_append_string(db, "write-commit-level-override", NS_WRITE_COMMIT_LEVEL_NAME());
 
 	info_append_string(db, "storage-engine",
@@ -1846,18 +2363,48 @@ info_namespace_config_get(char* context, cf_dyn_buf *db)
 		info_append_uint32(db, "storage-engine.write-block-size", ns->storage_write_block_size);
 		info_append_bool(db, "storage-engine.data-in-memory", ns->storage_data_in_memory);
 		info_append_bool(db, "storage-engine.cold-start-empty", ns->storage_cold_start_empty);
+		info_append_uint32(db, "storage-engine.cold-start-threads", ns->storage_cold_start_threads);
+		info_append_bool(db, "storage-engine.defrag-live-map", ns->storage_defrag_live_map);
 		info_append_uint32(db, "storage-engine.defrag-lwm-pct", ns->storage_defrag_lwm_pct);
 		info_append_uint32(db, "storage-engine.defrag-queue-min", ns->storage_defrag_queue_min);
 		info_append_uint32(db, "storage-engine.defrag-sleep", ns->storage_defrag_sleep);
+		info_append_bool(db, "storage-engine.defrag-adaptive", ns->storage_defrag_adaptive);
 		info_append_int(db, "storage-engine.defrag-startup-minimum", ns->storage_defrag_startup_minimum);
 		info_append_bool(db, "storage-engine.disable-odirect", ns->storage_disable_odirect);
 		info_append_bool(db, "storage-engine.enable-osync", ns->storage_enable_osync);
+		info_append_bool(db, "storage-engine.fast-restart", ns->storage_fast_restart);
 		info_append_uint64(db, "storage-engine.flush-max-ms", ns->storage_flush_max_us / 1000);
 		info_append_uint64(db, "storage-engine.fsync-max-sec", ns->storage_fsync_max_us / 1000000);
+		info_append_uint64(db, "storage-engine.ldt-subrec-cache-size", ns->storage_ldt_subrec_cache_size);
+		info_append_uint32(db, "storage-engine.max-flush-size", ns->storage_max_flush_size);
 		info_append_uint64(db, "storage-engine.max-write-cache", ns->storage_max_write_cache);
 		info_append_uint32(db, "storage-engine.min-avail-pct", ns->storage_min_avail_pct);
 		info_append_uint32(db, "storage-engine.post-write-queue", ns->storage_post_write_queue);
+		info_append_uint64(db, "storage-engine.read-cache-size", ns->storage_read_cache_size);
+		info_append_uint64(db, "storage-engine.shadow-max-write-cache", ns->storage_shadow_max_write_cache);
+		info_append_bool(db, "storage-engine.shadow-stop-writes-on-lag", ns->storage_shadow_stop_writes_on_lag);
+		info_append_uint32(db, "storage-engine.shadow-write-threads", ns->storage_shadow_write_threads);
 		info_append_uint32(db, "storage-engine.write-threads", ns->storage_write_threads);
+
+		if (ns->storage_compression == AS_STORAGE_COMPRESSION_ZLIB) {
+			info_append_string(db, "storage-engine.compression", "zlib");
+		}
+		else if (ns->storage_compression == AS_STORAGE_COMPRESSION_LZ4) {
+			info_append_string(db, "storage-engine.compression", "lz4");
+		}
+		else if (ns->storage_compression == AS_STORAGE_COMPRESSION_ZSTD) {
+			info_append_string(db, "storage-engine.compression", "zstd");
+		}
+		else {
+			info_append_string(db, "storage-engine.compression", "none");
+		}
+
+		info_append_uint32(db, "storage-engine.compression-level", ns->storage_compression_level);
+		info_append_bool(db, "storage-engine.persist-map-indexes", ns->storage_persist_map_indexes);
+		info_append_bool(db, "storage-engine.touch-index-only", ns->storage_touch_index_only);
+		info_append_uint32(db, "storage-engine.ttl-write-streams", ns->storage_ttl_write_streams);
+		info_append_bool(db, "storage-engine.weighted-placement", ns->storage_weighted_placement);
+		info_append_bool(db, "storage-engine.wblock-summaries", ns->storage_wblock_summaries);
 	}
 
 	if (ns->storage_type == AS_STORAGE_ENGINE_KV) {
@@ -1884,6 +2431,7 @@ info_namespace_config_get(char* context, cf_dyn_buf *db)
 	}
 
 	info_append_uint32(db, "sindex.num-partitions", ns->sindex_num_partitions);
+	info_append_string(db, "sindex.snapshot-file", ns->sindex_snapshot_file ? ns->sindex_snapshot_file : "null");
 
 	info_append_bool(db, "geo2dsphere-within.strict", ns->geo2dsphere_within_strict);
 	info_append_uint32(db, "geo2dsphere-within.min-level", (uint32_t)ns->geo2dsphere_within_min_level);
@@ -2043,6 +2591,48 @@ info_command_config_set(char *name, char *params, cf_dyn_buf *db)
 			cf_info(AS_INFO, "Changing value of ticker-interval from %d to %d ", g_config.ticker_interval, val);
 			g_config.ticker_interval = val;
 		}
+		else if (0 == as_info_parameter_get(params, "info-cache-ttl", context, &context_len)) {
+			if (0 != cf_str_atoi(context, &val) || val < 0) {
+				goto Error;
+			}
+			cf_info(AS_INFO, "Changing value of info-cache-ttl from %u to %d ", g_config.info_cache_ttl, val);
+			g_config.info_cache_ttl = (uint32_t)val;
+		}
+		else if (0 == as_info_parameter_get(params, "info-timeout", context, &context_len)) {
+			if (0 != cf_str_atoi(context, &val) || val < 0) {
+				goto Error;
+			}
+			cf_info(AS_INFO, "Changing value of info-timeout from %u to %d ", g_config.info_timeout, val);
+			g_config.info_timeout = (uint32_t)val;
+		}
+		else if (0 == as_info_parameter_get(params, "proto-compression-threshold", context, &context_len)) {
+			if (0 != cf_str_atoi(context, &val) || val < 0) {
+				goto Error;
+			}
+			cf_info(AS_INFO, "Changing value of proto-compression-threshold from %u to %d ", g_config.proto_compression_threshold, val);
+			g_config.proto_compression_threshold = (uint32_t)val;
+		}
+		else if (0 == as_info_parameter_get(params, "slow-txn-threshold", context, &context_len)) {
+			if (0 != cf_str_atoi(context, &val) || val < 0) {
+				goto Error;
+			}
+			cf_info(AS_INFO, "Changing value of slow-txn-threshold from %u to %d ", g_config.slow_txn_threshold, val);
+			g_config.slow_txn_threshold = (uint32_t)val;
+		}
+		else if (0 == as_info_parameter_get(params, "slow-txn-log-rate", context, &context_len)) {
+			if (0 != cf_str_atoi(context, &val) || val < 0) {
+				goto Error;
+			}
+			cf_info(AS_INFO, "Changing value of slow-txn-log-rate from %u to %d ", g_config.slow_txn_log_rate, val);
+			g_config.slow_txn_log_rate = (uint32_t)val;
+		}
+		else if (0 == as_info_parameter_get(params, "hot-key-sample-rate", context, &context_len)) {
+			if (0 != cf_str_atoi(context, &val) || val < 0) {
+				goto Error;
+			}
+			cf_info(AS_INFO, "Changing value of hot-key-sample-rate from %u to %d ", g_config.hot_key_sample_rate, val);
+			g_config.hot_key_sample_rate = (uint32_t)val;
+		}
 		else if (0 == as_info_parameter_get(params, "ldt-benchmarks", context, &context_len)) {
 			if (strncmp(context, "true", 4) == 0 || strncmp(context, "yes", 3) == 0) {
 				clear_ldt_histograms();
@@ -2076,6 +2666,30 @@ info_command_config_set(char *name, char *params, cf_dyn_buf *db)
 			g_config.scan_max_done = val;
 			as_scan_limit_finished_jobs(g_config.scan_max_done);
 		}
+		else if (0 == as_info_parameter_get(params, "scan-max-records-per-sec", context, &context_len)) {
+			uint32_t val_u32;
+			if (0 != cf_str_atoi_u32(context, &val_u32))
+				goto Error;
+			cf_info(AS_INFO, "Changing value of scan-max-records-per-sec from %u to %u ", g_config.scan_max_records_per_sec, val_u32);
+			g_config.scan_max_records_per_sec = val_u32;
+			as_scan_limit_records_per_sec(g_config.scan_max_records_per_sec);
+		}
+		else if (0 == as_info_parameter_get(params, "scan-max-records-per-sec-per-job", context, &context_len)) {
+			uint32_t val_u32;
+			if (0 != cf_str_atoi_u32(context, &val_u32))
+				goto Error;
+			cf_info(AS_INFO, "Changing value of scan-max-records-per-sec-per-job from %u to %u ", g_config.scan_max_records_per_sec_per_job, val_u32);
+			g_config.scan_max_records_per_sec_per_job = val_u32;
+		}
+		else if (0 == as_info_parameter_get(params, "scan-max-threads-per-job", context, &context_len)) {
+			if (0 != cf_str_atoi(context, &val))
+				goto Error;
+			if (val < 0 || val > 32) {
+				goto Error;
+			}
+			cf_info(AS_INFO, "Changing value of scan-max-threads-per-job from %d to %d ", g_config.scan_max_threads_per_job, val);
+			g_config.scan_max_threads_per_job = val;
+		}
 		else if (0 == as_info_parameter_get(params, "scan-max-udf-transactions", context, &context_len)) {
 			if (0 != cf_str_atoi(context, &val))
 				goto Error;
@@ -2092,6 +2706,30 @@ info_command_config_set(char *name, char *params, cf_dyn_buf *db)
 			g_config.scan_threads = val;
 			as_scan_resize_thread_pool(g_config.scan_threads);
 		}
+		else if (0 == as_info_parameter_get(params, "transaction-queues", context, &context_len)) {
+			if (0 != cf_str_atoi(context, &val) || val < 1)
+				goto Error;
+			if (0 != as_tsvc_set_queues((uint32_t)val))
+				goto Error;
+		}
+		else if (0 == as_info_parameter_get(params, "transaction-threads-per-queue", context, &context_len)) {
+			if (0 != cf_str_atoi(context, &val) || val < 1)
+				goto Error;
+			if (0 != as_tsvc_set_threads_per_queue((uint32_t)val))
+				goto Error;
+		}
+		else if (0 == as_info_parameter_get(params, "transaction-threads-adaptive", context, &context_len)) {
+			if (strncmp(context, "true", 4) == 0 || strncmp(context, "yes", 3) == 0) {
+				cf_info(AS_INFO, "Changing value of transaction-threads-adaptive from %s to %s", bool_val[g_config.transaction_threads_adaptive], context);
+				g_config.transaction_threads_adaptive = true;
+			}
+			else if (strncmp(context, "false", 5) == 0 || strncmp(context, "no", 2) == 0) {
+				cf_info(AS_INFO, "Changing value of transaction-threads-adaptive from %s to %s", bool_val[g_config.transaction_threads_adaptive], context);
+				g_config.transaction_threads_adaptive = false;
+			}
+			else
+				goto Error;
+		}
 		else if (0 == as_info_parameter_get(params, "batch-index-threads", context, &context_len)) {
 			if (0 != cf_str_atoi(context, &val))
 				goto Error;
@@ -2158,12 +2796,36 @@ info_command_config_set(char *name, char *params, cf_dyn_buf *db)
 			cf_info(AS_INFO, "Changing value of nsup-period from %d to %d ", g_config.nsup_period, val);
 			g_config.nsup_period = val;
 		}
+		else if (0 == as_info_parameter_get(params, "balance-threads", context, &context_len)) {
+			if (0 != cf_str_atoi(context, &val) || val < 1 || val > MAX_BALANCE_THREADS)
+				goto Error;
+			cf_info(AS_INFO, "Changing value of balance-threads from %u to %d ", g_config.n_balance_threads, val);
+			g_config.n_balance_threads = (uint32_t)val;
+		}
+		else if (0 == as_info_parameter_get(params, "nsup-threads", context, &context_len)) {
+			if (0 != cf_str_atoi(context, &val) || val < 1 || val > MAX_NSUP_THREADS)
+				goto Error;
+			cf_info(AS_INFO, "Changing value of nsup-threads from %u to %d ", g_config.n_nsup_threads, val);
+			g_config.n_nsup_threads = (uint32_t)val;
+		}
 		else if (0 == as_info_parameter_get(params, "paxos-retransmit-period", context, &context_len)) {
 			if (0 != cf_str_atoi(context, &val))
 				goto Error;
 			cf_info(AS_INFO, "Changing value of paxos-retransmit-period from %d to %d ", g_config.paxos_retransmit_period, val);
 			g_config.paxos_retransmit_period = val;
 		}
+		else if (0 == as_info_parameter_get(params, "paxos-compact-sync", context, &context_len)) {
+			if (strncmp(context, "true", 4) == 0 || strncmp(context, "yes", 3) == 0) {
+				cf_info(AS_INFO, "Changing value of paxos-compact-sync from %s to %s", bool_val[g_config.paxos_compact_sync], context);
+				g_config.paxos_compact_sync = true;
+			}
+			else if (strncmp(context, "false", 5) == 0 || strncmp(context, "no", 2) == 0) {
+				cf_info(AS_INFO, "Changing value of paxos-compact-sync from %s to %s", bool_val[g_config.paxos_compact_sync], context);
+				g_config.paxos_compact_sync = false;
+			}
+			else
+				goto Error;
+		}
 		else if (0 == as_info_parameter_get(params, "paxos-max-cluster-size", context, &context_len)) {
 			if (0 != cf_str_atoi(context, &val) || (1 > val) ||
 			    (val > AS_CLUSTER_SZ) ||
@@ -2203,6 +2865,11 @@ info_command_config_set(char *name, char *params, cf_dyn_buf *db)
 			}
 			cf_info(AS_INFO, "Changing value of cluster-id to '%s'", cluster_id);
 		}
+		else if (0 == as_info_parameter_get(params, "migrate-max-bytes-per-sec", context, &context_len)) {
+			uint64_t val = atoll(context);
+			cf_info(AS_INFO, "Changing value of migrate-max-bytes-per-sec from %"PRIu64" to %"PRIu64"", g_config.migrate_max_bytes_per_sec, val);
+			g_config.migrate_max_bytes_per_sec = val;
+		}
 		else if (0 == as_info_parameter_get(params, "migrate-max-num-incoming", context, &context_len)) {
 			if (0 != cf_str_atoi(context, &val) || (0 > val))
 				goto Error;
@@ -2215,6 +2882,17 @@ info_command_config_set(char *name, char *params, cf_dyn_buf *db)
 			cf_info(AS_INFO, "Changing value of migrate-rx-lifetime-ms from %d to %d ", g_config.migrate_rx_lifetime_ms, val);
 			g_config.migrate_rx_lifetime_ms = val;
 		}
+		else if (0 == as_info_parameter_get(params, "migrate-rx-memory-budget", context, &context_len)) {
+			uint64_t val = atoll(context);
+			cf_info(AS_INFO, "Changing value of migrate-rx-memory-budget from %"PRIu64" to %"PRIu64"", g_config.migrate_rx_memory_budget, val);
+			g_config.migrate_rx_memory_budget = val;
+		}
+		else if (0 == as_info_parameter_get(params, "migrate-split-threads", context, &context_len)) {
+			if (0 != cf_str_atoi(context, &val) || (1 > val) || (MAX_MIGRATE_SPLIT_THREADS < val))
+				goto Error;
+			cf_info(AS_INFO, "Changing value of migrate-split-threads from %u to %d ", g_config.migrate_split_threads, val);
+			g_config.migrate_split_threads = (uint32_t)val;
+		}
 		else if (0 == as_info_parameter_get(params, "migrate-threads", context, &context_len)) {
 			if (0 != cf_str_atoi(context, &val) || (0 > val) || (MAX_NUM_MIGRATE_XMIT_THREADS < val))
 				goto Error;
@@ -2245,10 +2923,22 @@ info_command_config_set(char *name, char *params, cf_dyn_buf *db)
 			else
 				goto Error;
 		}
-		else if (0 == as_info_parameter_get(params, "respond-client-on-master-completion", context, &context_len)) {
+		else if (0 == as_info_parameter_get(params, "log-async", context, &context_len)) {
 			if (strncmp(context, "true", 4) == 0 || strncmp(context, "yes", 3) == 0) {
-				cf_info(AS_INFO, "Changing value of respond-client-on-master-completion from %s to %s", bool_val[g_config.respond_client_on_master_completion], context);
-				g_config.respond_client_on_master_completion = true;
+				cf_info(AS_INFO, "Changing value of log-async from %s to %s", bool_val[cf_fault_is_using_async()], context);
+				cf_fault_use_async(true);
+			}
+			else if (strncmp(context, "false", 5) == 0 || strncmp(context, "no", 2) == 0) {
+				cf_info(AS_INFO, "Changing value of log-async from %s to %s", bool_val[cf_fault_is_using_async()], context);
+				cf_fault_use_async(false);
+			}
+			else
+				goto Error;
+		}
+		else if (0 == as_info_parameter_get(params, "respond-client-on-master-completion", context, &context_len)) {
+			if (strncmp(context, "true", 4) == 0 || strncmp(context, "yes", 3) == 0) {
+				cf_info(AS_INFO, "Changing value of respond-client-on-master-completion from %s to %s", bool_val[g_config.respond_client_on_master_completion], context);
+				g_config.respond_client_on_master_completion = true;
 			}
 			else if (strncmp(context, "false", 5) == 0 || strncmp(context, "no", 2) == 0) {
 				cf_info(AS_INFO, "Changing value of respond-client-on-master-completion from %s to %s", bool_val[g_config.respond_client_on_master_completion], context);
@@ -2269,6 +2959,57 @@ info_command_config_set(char *name, char *params, cf_dyn_buf *db)
 			else
 				goto Error;
 		}
+		else if (0 == as_info_parameter_get(params, "admission-control", context, &context_len)) {
+			if (strncmp(context, "true", 4) == 0 || strncmp(context, "yes", 3) == 0) {
+				cf_info(AS_INFO, "Changing value of admission-control from %s to %s", bool_val[g_config.admission_control], context);
+				g_config.admission_control = true;
+			}
+			else if (strncmp(context, "false", 5) == 0 || strncmp(context, "no", 2) == 0) {
+				cf_info(AS_INFO, "Changing value of admission-control from %s to %s", bool_val[g_config.admission_control], context);
+				g_config.admission_control = false;
+			}
+			else
+				goto Error;
+		}
+		else if (0 == as_info_parameter_get(params, "admission-device-latency-ms", context, &context_len)) {
+			if (0 != cf_str_atoi(context, &val) || val < 1 || val > 1000 * 10)
+				goto Error;
+			cf_info(AS_INFO, "Changing value of admission-device-latency-ms from %u to %d ", g_config.admission_device_latency_ms, val);
+			g_config.admission_device_latency_ms = (uint32_t)val;
+		}
+		else if (0 == as_info_parameter_get(params, "admission-queue-wait-ms", context, &context_len)) {
+			if (0 != cf_str_atoi(context, &val) || val < 1 || val > 1000 * 10)
+				goto Error;
+			cf_info(AS_INFO, "Changing value of admission-queue-wait-ms from %u to %d ", g_config.admission_queue_wait_ms, val);
+			g_config.admission_queue_wait_ms = (uint32_t)val;
+		}
+		else if (0 == as_info_parameter_get(params, "alloc-prof-interval", context, &context_len)) {
+			uint32_t val_u32;
+			if (0 != cf_str_atoi_u32(context, &val_u32))
+				goto Error;
+			cf_info(AS_INFO, "Changing value of alloc-prof-interval from %u to %u ", g_config.alloc_prof_interval, val_u32);
+			g_config.alloc_prof_interval = val_u32;
+			cf_alloc_prof_set_interval(val_u32);
+		}
+		else if (0 == as_info_parameter_get(params, "background-max-records-per-sec", context, &context_len)) {
+			uint32_t val_u32;
+			if (0 != cf_str_atoi_u32(context, &val_u32))
+				goto Error;
+			cf_info(AS_INFO, "Changing value of background-max-records-per-sec from %u to %u ", g_config.background_max_records_per_sec, val_u32);
+			g_config.background_max_records_per_sec = val_u32;
+		}
+		else if (0 == as_info_parameter_get(params, "background-udf-inline", context, &context_len)) {
+			if (strncmp(context, "true", 4) == 0 || strncmp(context, "yes", 3) == 0) {
+				cf_info(AS_INFO, "Changing value of background-udf-inline from %s to %s", bool_val[g_config.background_udf_inline], context);
+				g_config.background_udf_inline = true;
+			}
+			else if (strncmp(context, "false", 5) == 0 || strncmp(context, "no", 2) == 0) {
+				cf_info(AS_INFO, "Changing value of background-udf-inline from %s to %s", bool_val[g_config.background_udf_inline], context);
+				g_config.background_udf_inline = false;
+			}
+			else
+				goto Error;
+		}
 		else if (0 == as_info_parameter_get(params, "allow-inline-transactions", context, &context_len)) {
 			if (strncmp(context, "true", 4) == 0 || strncmp(context, "yes", 3) == 0) {
 				cf_info(AS_INFO, "Changing value of allow-inline-transactions from %s to %s", bool_val[g_config.allow_inline_transactions], context);
@@ -2300,6 +3041,13 @@ info_command_config_set(char *name, char *params, cf_dyn_buf *db)
 			cf_info(AS_INFO, "Changing value of prole-extra-ttl from %d to %d ", g_config.prole_extra_ttl, val);
 			g_config.prole_extra_ttl = val;
 		}
+		else if (0 == as_info_parameter_get(params, "non-master-gc-rps", context, &context_len)) {
+			if (0 != cf_str_atoi(context, &val) || val < 0) {
+				goto Error;
+			}
+			cf_info(AS_INFO, "Changing value of non-master-gc-rps from %u to %d ", g_config.non_master_gc_rps, val);
+			g_config.non_master_gc_rps = (uint32_t)val;
+		}
 		else if (0 == as_info_parameter_get(params, "max-msgs-per-type", context, &context_len)) {
 			if ((0 != cf_str_atoi(context, &val)) || (val == 0))
 				goto Error;
@@ -2381,6 +3129,11 @@ info_command_config_set(char *name, char *params, cf_dyn_buf *db)
 			cf_info(AS_INFO, "Changing value of sindex-data-max-memory from %"PRIu64" to %"PRIu64, g_config.sindex_data_max_memory, val);
 			g_config.sindex_data_max_memory = val;
 		}
+		else if (0 == as_info_parameter_get(params, "udf-runtime-max-memory", context, &context_len)) {
+			uint64_t val = atoll(context);
+			cf_info(AS_INFO, "Changing value of udf-runtime-max-memory from %"PRIu64" to %"PRIu64, g_config.udf_runtime_max_memory, val);
+			g_config.udf_runtime_max_memory = val;
+		}
 		else if (0 == as_info_parameter_get(params, "query-threads", context, &context_len)) {
 			uint64_t val = atoll(context);
 			cf_info(AS_INFO, "query-threads = %"PRIu64, val);
@@ -2433,6 +3186,16 @@ info_command_config_set(char *name, char *params, cf_dyn_buf *db)
 			cf_info(AS_INFO, "Changing value of query-sleep from %"PRIu64" uSec to %"PRIu64" uSec ", g_config.query_sleep_us, val);
 			g_config.query_sleep_us = val;
 		}
+		else if (0 == as_info_parameter_get(params, "query-aggr-batch-size", context, &context_len)) {
+			uint64_t val;
+			// Same bounds as config-file parsing.
+			if (0 != cf_str_atoi_u64(context, &val) || val < 1 || val > UINT32_MAX) {
+				cf_warning(AS_INFO, "query-aggr-batch-size must be between 1 and %u", UINT32_MAX);
+				goto Error;
+			}
+			cf_info(AS_INFO, "Changing value of query-aggr-batch-size from %u to %"PRIu64, g_config.query_aggr_bsize, val);
+			g_config.query_aggr_bsize = (uint32_t)val;
+		}
 		else if (0 == as_info_parameter_get(params, "query-batch-size", context, &context_len)) {
 			uint64_t val = atoll(context);
 			cf_info(AS_INFO, "query-batch-size = %"PRIu64, val);
@@ -2498,6 +3261,13 @@ info_command_config_set(char *name, char *params, cf_dyn_buf *db)
 			cf_info(AS_INFO, "Changing value of query-short-q-max-size from %d to %"PRIu64, g_config.query_short_q_max_size, val);
 			g_config.query_short_q_max_size = val;
 		}
+		else if (0 == as_info_parameter_get(params, "query-max-records-per-sec", context, &context_len)) {
+			uint32_t val_u32;
+			if (0 != cf_str_atoi_u32(context, &val_u32))
+				goto Error;
+			cf_info(AS_INFO, "Changing value of query-max-records-per-sec from %u to %u ", g_config.query_max_records_per_sec, val_u32);
+			g_config.query_max_records_per_sec = val_u32;
+		}
 		else if (0 == as_info_parameter_get(params, "query-long-q-max-size", context, &context_len)) {
 			uint64_t val = atoll(context);
 			cf_info(AS_INFO, "query-long-q-max-size = %"PRIu64, val);
@@ -2599,6 +3369,16 @@ info_command_config_set(char *name, char *params, cf_dyn_buf *db)
 				goto Error;
 			as_hb_override_mtu_set(val);
 		}
+		else if (0 == as_info_parameter_get(params, "heartbeat.compact-payloads", context, &context_len)) {
+			if (strncmp(context, "true", 4) == 0 || strncmp(context, "yes", 3) == 0) {
+				as_hb_compact_payloads_set(true);
+			}
+			else if (strncmp(context, "false", 5) == 0 || strncmp(context, "no", 2) == 0) {
+				as_hb_compact_payloads_set(false);
+			}
+			else
+				goto Error;
+		}
 		else if (0 == as_info_parameter_get(params, "heartbeat.protocol", context, &context_len)) {
 			hb_protocol_enum protocol = (!strcmp(context, "v1") ? AS_HB_PROTOCOL_V1 :
 										 (!strcmp(context, "v2") ? AS_HB_PROTOCOL_V2 :
@@ -2669,6 +3449,44 @@ info_command_config_set(char *name, char *params, cf_dyn_buf *db)
 				cf_info(AS_INFO, "Changing value of set-stop-writes-count of ns %s set %s to %lu", ns->name, p_set->name, val);
 				cf_atomic64_set(&p_set->stop_writes_count, val);
 			}
+			else if (0 == as_info_parameter_get(params, "set-memory-quota", context, &context_len) ||
+					0 == as_info_parameter_get(params, "memory-quota", context, &context_len)) {
+				uint64_t val = atoll(context);
+				cf_info(AS_INFO, "Changing value of set-memory-quota of ns %s set %s to %lu", ns->name, p_set->name, val);
+				cf_atomic64_set(&p_set->memory_quota, val);
+			}
+			else if (0 == as_info_parameter_get(params, "set-disk-quota", context, &context_len) ||
+					0 == as_info_parameter_get(params, "disk-quota", context, &context_len)) {
+				uint64_t val = atoll(context);
+				cf_info(AS_INFO, "Changing value of set-disk-quota of ns %s set %s to %lu", ns->name, p_set->name, val);
+				cf_atomic64_set(&p_set->disk_quota, val);
+			}
+			else if (0 == as_info_parameter_get(params, "set-evict-priority", context, &context_len) ||
+					0 == as_info_parameter_get(params, "evict-priority", context, &context_len)) {
+				uint32_t val = (uint32_t)atoll(context);
+				cf_info(AS_INFO, "Changing value of set-evict-priority of ns %s set %s to %u", ns->name, p_set->name, val);
+				cf_atomic32_set(&p_set->evict_priority, val);
+			}
+			else if (0 == as_info_parameter_get(params, "set-enable-latency", context, &context_len) ||
+					0 == as_info_parameter_get(params, "enable-latency", context, &context_len)) {
+				uint16_t set_id = as_namespace_get_set_id(ns, p_set->name);
+
+				if (set_id == INVALID_SET_ID) {
+					goto Error;
+				}
+
+				if ((strncmp(context, "true", 4) == 0) || (strncmp(context, "yes", 3) == 0)) {
+					cf_info(AS_INFO, "Changing value of set-enable-latency of ns %s set %s to %s", ns->name, p_set->name, context);
+					as_namespace_enable_set_latency(ns, set_id, true);
+				}
+				else if ((strncmp(context, "false", 5) == 0) || (strncmp(context, "no", 2) == 0)) {
+					cf_info(AS_INFO, "Changing value of set-enable-latency of ns %s set %s to %s", ns->name, p_set->name, context);
+					as_namespace_enable_set_latency(ns, set_id, false);
+				}
+				else {
+					goto Error;
+				}
+			}
 			else if (0 == as_info_parameter_get(params, "set-delete", context, &context_len) ||
 					0 == as_info_parameter_get(params, "delete", context, &context_len)) {
 				if ((strncmp(context, "true", 4) == 0) || (strncmp(context, "yes", 3) == 0)) {
@@ -2714,6 +3532,19 @@ info_command_config_set(char *name, char *params, cf_dyn_buf *db)
 			cf_info(AS_INFO, "Changing value of evict-tenths-pct memory of ns %s from %d to %d ", ns->name, ns->evict_tenths_pct, atoi(context));
 			ns->evict_tenths_pct = atoi(context);
 		}
+		else if (0 == as_info_parameter_get(params, "evict-continuous", context, &context_len)) {
+			if (strncmp(context, "true", 4) == 0 || strncmp(context, "yes", 3) == 0) {
+				cf_info(AS_INFO, "Changing value of evict-continuous of ns %s from %s to %s", ns->name, bool_val[ns->evict_continuous], context);
+				ns->evict_continuous = true;
+			}
+			else if (strncmp(context, "false", 5) == 0 || strncmp(context, "no", 2) == 0) {
+				cf_info(AS_INFO, "Changing value of evict-continuous of ns %s from %s to %s", ns->name, bool_val[ns->evict_continuous], context);
+				ns->evict_continuous = false;
+			}
+			else {
+				goto Error;
+			}
+		}
 		else if (0 == as_info_parameter_get(params, "evict-hist-buckets", context, &context_len)) {
 			if (0 != cf_str_atoi(context, &val) || val < 100 || val > 10000000) {
 				goto Error;
@@ -2755,6 +3586,61 @@ info_command_config_set(char *name, char *params, cf_dyn_buf *db)
 			cf_info(AS_INFO, "Changing value of max-ttl memory of ns %s from %"PRIu64" to %"PRIu64" ", ns->name, ns->max_ttl, val);
 			ns->max_ttl = val;
 		}
+		else if (0 == as_info_parameter_get(params, "migrate-compression", context, &context_len)) {
+			if (strncmp(context, "true", 4) == 0 || strncmp(context, "yes", 3) == 0) {
+				cf_info(AS_INFO, "Changing value of migrate-compression of ns %s from %s to %s", ns->name, bool_val[ns->migrate_compression], context);
+				ns->migrate_compression = true;
+			}
+			else if (strncmp(context, "false", 5) == 0 || strncmp(context, "no", 2) == 0) {
+				cf_info(AS_INFO, "Changing value of migrate-compression of ns %s from %s to %s", ns->name, bool_val[ns->migrate_compression], context);
+				ns->migrate_compression = false;
+			}
+			else {
+				goto Error;
+			}
+		}
+		else if (0 == as_info_parameter_get(params, "migrate-delta", context, &context_len)) {
+			if (strncmp(context, "true", 4) == 0 || strncmp(context, "yes", 3) == 0) {
+				cf_info(AS_INFO, "Changing value of migrate-delta of ns %s from %s to %s", ns->name, bool_val[ns->migrate_delta], context);
+				ns->migrate_delta = true;
+			}
+			else if (strncmp(context, "false", 5) == 0 || strncmp(context, "no", 2) == 0) {
+				cf_info(AS_INFO, "Changing value of migrate-delta of ns %s from %s to %s", ns->name, bool_val[ns->migrate_delta], context);
+				ns->migrate_delta = false;
+			}
+			else {
+				goto Error;
+			}
+		}
+		else if (0 == as_info_parameter_get(params, "async-replication", context, &context_len)) {
+			if (strncmp(context, "true", 4) == 0 || strncmp(context, "yes", 3) == 0) {
+				cf_info(AS_INFO, "Changing value of async-replication of ns %s from %s to %s", ns->name, bool_val[ns->async_replication], context);
+				ns->async_replication = true;
+			}
+			else if (strncmp(context, "false", 5) == 0 || strncmp(context, "no", 2) == 0) {
+				cf_info(AS_INFO, "Changing value of async-replication of ns %s from %s to %s", ns->name, bool_val[ns->async_replication], context);
+				ns->async_replication = false;
+			}
+			else {
+				goto Error;
+			}
+		}
+		else if (0 == as_info_parameter_get(params, "async-replication-max-lag", context, &context_len)) {
+			uint64_t val;
+
+			if (0 != cf_str_atoi_u64(context, &val) || val < 1024 * 1024) {
+				goto Error;
+			}
+			cf_info(AS_INFO, "Changing value of async-replication-max-lag of ns %s from %"PRIu64" to %"PRIu64"", ns->name, ns->async_replication_max_lag, val);
+			ns->async_replication_max_lag = val;
+		}
+		else if (0 == as_info_parameter_get(params, "migrate-changelog-max-age", context, &context_len)) {
+			if (0 != cf_str_atoi(context, &val) || val < 0) {
+				goto Error;
+			}
+			cf_info(AS_INFO, "Changing value of migrate-changelog-max-age of ns %s from %u to %d", ns->name, ns->migrate_changelog_max_age, val);
+			ns->migrate_changelog_max_age = (uint32_t)val;
+		}
 		else if (0 == as_info_parameter_get(params, "migrate-order", context, &context_len)) {
 			if (0 != cf_str_atoi(context, &val) || val < 1 || val > 10) {
 				goto Error;
@@ -2769,6 +3655,13 @@ info_command_config_set(char *name, char *params, cf_dyn_buf *db)
 			cf_info(AS_INFO, "Changing value of migrate-sleep of ns %s from %u to %d", ns->name, ns->migrate_sleep, val);
 			ns->migrate_sleep = (uint32_t)val;
 		}
+		else if (0 == as_info_parameter_get(params, "nsup-period", context, &context_len)) {
+			if (0 != cf_str_atoi(context, &val) || val < 0) {
+				goto Error;
+			}
+			cf_info(AS_INFO, "Changing value of nsup-period of ns %s from %u to %d", ns->name, ns->nsup_period, val);
+			ns->nsup_period = (uint32_t)val;
+		}
 		else if (0 == as_info_parameter_get(params, "obj-size-hist-max", context, &context_len)) {
 			uint32_t hist_max = (uint32_t)atoi(context);
 			uint32_t round_to = OBJ_SIZE_HIST_NUM_BUCKETS;
@@ -2857,6 +3750,19 @@ info_command_config_set(char *name, char *params, cf_dyn_buf *db)
 			cf_info(AS_INFO, "Changing value of defrag-sleep of ns %s from %u to %d", ns->name, ns->storage_defrag_sleep, val);
 			ns->storage_defrag_sleep = (uint32_t)val;
 		}
+		else if (0 == as_info_parameter_get(params, "defrag-adaptive", context, &context_len)) {
+			if (strncmp(context, "true", 4) == 0 || strncmp(context, "yes", 3) == 0) {
+				cf_info(AS_INFO, "Changing value of defrag-adaptive of ns %s from %s to %s", ns->name, bool_val[ns->storage_defrag_adaptive], context);
+				ns->storage_defrag_adaptive = true;
+			}
+			else if (strncmp(context, "false", 5) == 0 || strncmp(context, "no", 2) == 0) {
+				cf_info(AS_INFO, "Changing value of defrag-adaptive of ns %s from %s to %s", ns->name, bool_val[ns->storage_defrag_adaptive], context);
+				ns->storage_defrag_adaptive = false;
+			}
+			else {
+				goto Error;
+			}
+		}
 		else if (0 == as_info_parameter_get(params, "flush-max-ms", context, &context_len)) {
 			if (0 != cf_str_atoi(context, &val)) {
 				goto Error;
@@ -3070,6 +3976,23 @@ info_command_config_set(char *name, char *params, cf_dyn_buf *db)
 				goto Error;
 			}
 		}
+		else if (0 == as_info_parameter_get(params, "enable-hist-stages", context, &context_len)) {
+			if (strncmp(context, "true", 4) == 0 || strncmp(context, "yes", 3) == 0) {
+				cf_info(AS_INFO, "Changing value of enable-hist-stages of ns %s from %s to %s", ns->name, bool_val[ns->stage_hist_enabled], context);
+				ns->stage_hist_enabled = true;
+			}
+			else if (strncmp(context, "false", 5) == 0 || strncmp(context, "no", 2) == 0) {
+				cf_info(AS_INFO, "Changing value of enable-hist-stages of ns %s from %s to %s", ns->name, bool_val[ns->stage_hist_enabled], context);
+				ns->stage_hist_enabled = false;
+
+				for (int s = 0; s < AS_NUM_STAGES; s++) {
+					cf_hist_track_clear(ns->stage_hists[s]);
+				}
+			}
+			else {
+				goto Error;
+			}
+		}
 		else if (0 == as_info_parameter_get(params, "max-write-cache", context, &context_len)) {
 			if (0 != cf_str_atoi(context, &val)) {
 				goto Error;
@@ -3102,6 +4025,44 @@ info_command_config_set(char *name, char *params, cf_dyn_buf *db)
 			cf_info(AS_INFO, "Changing value of post-write-queue of ns %s from %d to %d ", ns->name, ns->storage_post_write_queue, val);
 			cf_atomic32_set(&ns->storage_post_write_queue, (uint32_t)val);
 		}
+		else if (0 == as_info_parameter_get(params, "shadow-max-write-cache", context, &context_len)) {
+			if (0 != cf_str_atoi(context, &val)) {
+				goto Error;
+			}
+			if (val < (1024 * 1024 * 4)) {
+				cf_warning(AS_INFO, "can't set shadow-max-write-cache less than 4M");
+				goto Error;
+			}
+			cf_info(AS_INFO, "Changing value of shadow-max-write-cache of ns %s from %lu to %d ", ns->name, ns->storage_shadow_max_write_cache, val);
+			ns->storage_shadow_max_write_cache = (uint64_t)val;
+			ns->storage_shadow_max_write_q = (int)(ns->storage_shadow_max_write_cache / ns->storage_write_block_size);
+		}
+		else if (0 == as_info_parameter_get(params, "shadow-stop-writes-on-lag", context, &context_len)) {
+			if (strncmp(context, "true", 4) == 0 || strncmp(context, "yes", 3) == 0) {
+				cf_info(AS_INFO, "Changing value of shadow-stop-writes-on-lag of ns %s from %s to %s", ns->name, bool_val[ns->storage_shadow_stop_writes_on_lag], context);
+				ns->storage_shadow_stop_writes_on_lag = true;
+			}
+			else if (strncmp(context, "false", 5) == 0 || strncmp(context, "no", 2) == 0) {
+				cf_info(AS_INFO, "Changing value of shadow-stop-writes-on-lag of ns %s from %s to %s", ns->name, bool_val[ns->storage_shadow_stop_writes_on_lag], context);
+				ns->storage_shadow_stop_writes_on_lag = false;
+			}
+			else {
+				goto Error;
+			}
+		}
+		else if (0 == as_info_parameter_get(params, "wblock-summaries", context, &context_len)) {
+			if (strncmp(context, "true", 4) == 0 || strncmp(context, "yes", 3) == 0) {
+				cf_info(AS_INFO, "Changing value of wblock-summaries of ns %s from %s to %s", ns->name, bool_val[ns->storage_wblock_summaries], context);
+				ns->storage_wblock_summaries = true;
+			}
+			else if (strncmp(context, "false", 5) == 0 || strncmp(context, "no", 2) == 0) {
+				cf_info(AS_INFO, "Changing value of wblock-summaries of ns %s from %s to %s", ns->name, bool_val[ns->storage_wblock_summaries], context);
+				ns->storage_wblock_summaries = false;
+			}
+			else {
+				goto Error;
+			}
+		}
 		else if (0 == as_info_parameter_get(params, "sindex-data-max-memory", context, &context_len)) {
 			uint64_t val = atoll(context);
 			cf_debug(AS_INFO, "sindex-data-max-memory = %"PRIu64"", val);
@@ -3341,11 +4302,13 @@ info_command_log_set(char *name, char *params, cf_dyn_buf *db)
 
 
 // latency:hist=reads;back=180;duration=60;slice=10;
+// latency-percentiles:hist=reads;back=180;duration=60;
 // throughput:hist=reads;back=180;duration=60;slice=10;
 // hist-track-start:hist=reads;back=43200;slice=30;thresholds=1,4,16,64;
 // hist-track-stop:hist=reads;
 //
 // hist     - optional histogram name - if none, command applies to all cf_hist_track objects
+//			  per-set histograms (see set-enable-latency) are e.g. {test}-set-demo-read
 //
 // for start command:
 // back     - total time span in seconds over which to cache data
@@ -3375,13 +4338,17 @@ info_command_log_set(char *name, char *params, cf_dyn_buf *db)
 // 23:26:24-GMT - timestamp of histogram starting first slice
 // ops/sec,>1ms,>8ms,>64ms - labels for the columns: throughput, and which thresholds
 // 23:26:34,30618.2,0.05,0.00,0.00; - timestamp of histogram ending slice, throughput, latencies
+//
+// latency-percentiles ignores slice - each cached slice is output, with
+// throughput and p50,p90,p99,p99.9,max latencies in ms, e.g.:
+// reads:23:26:24-GMT,ops/sec,p50,p90,p99,p99.9,max(ms);23:26:34,30618.2,0.204,0.412,1.056,3.968,9.317;
 
 int
 info_command_hist_track(char *name, char *params, cf_dyn_buf *db)
 {
 	cf_debug(AS_INFO, "hist track %s command received: params %s", name, params);
 
-	char value_str[50];
+	char value_str[100];
 	int  value_str_len = sizeof(value_str);
 	cf_hist_track* hist_p = NULL;
 
@@ -3420,7 +4387,41 @@ info_command_hist_track(char *name, char *params, cf_dyn_buf *db)
 			else if (0 == strcmp(hist_name, "query")) {
 				hist_p = ns->query_hist;
 			}
-			else {
+			else if (0 == strncmp(hist_name, "stage-", 6)) {
+				for (int s = 0; s < AS_NUM_STAGES; s++) {
+					if (0 == strcmp(hist_name + 6, as_stage_names[s])) {
+						hist_p = ns->stage_hists[s];
+						break;
+					}
+				}
+			}
+			else if (0 == strncmp(hist_name, "set-", 4)) {
+				// Set names may contain '-' - the op follows the last one.
+				char* op_name = strrchr(hist_name + 4, '-');
+				uint16_t set_id = INVALID_SET_ID;
+
+				if (op_name) {
+					*op_name++ = 0;
+					set_id = as_namespace_get_set_id(ns, hist_name + 4);
+				}
+
+				if (set_id != INVALID_SET_ID) {
+					if (0 == strcmp(op_name, "read")) {
+						hist_p = ns->set_read_hists[set_id];
+					}
+					else if (0 == strcmp(op_name, "write")) {
+						hist_p = ns->set_write_hists[set_id];
+					}
+					else if (0 == strcmp(op_name, "udf")) {
+						hist_p = ns->set_udf_hists[set_id];
+					}
+					else if (0 == strcmp(op_name, "query")) {
+						hist_p = ns->set_query_hists[set_id];
+					}
+				}
+			}
+
+			if (! hist_p) {
 				cf_info(AS_INFO, "hist track %s command: unrecognized histogram: %s", name, value_str);
 				cf_dyn_buf_append_string(db, "error-bad-hist-name");
 				return 0;
@@ -3445,6 +4446,19 @@ info_command_hist_track(char *name, char *params, cf_dyn_buf *db)
 				cf_hist_track_stop(ns->write_hist);
 				cf_hist_track_stop(ns->udf_hist);
 				cf_hist_track_stop(ns->query_hist);
+
+				for (int s = 0; s < AS_NUM_STAGES; s++) {
+					cf_hist_track_stop(ns->stage_hists[s]);
+				}
+
+				for (uint32_t set_id = 1; set_id <= AS_SET_MAX_COUNT; set_id++) {
+					if (ns->set_read_hists[set_id]) {
+						cf_hist_track_stop(ns->set_read_hists[set_id]);
+						cf_hist_track_stop(ns->set_write_hists[set_id]);
+						cf_hist_track_stop(ns->set_udf_hists[set_id]);
+						cf_hist_track_stop(ns->set_query_hists[set_id]);
+					}
+				}
 			}
 		}
 
@@ -3514,6 +4528,18 @@ info_command_hist_track(char *name, char *params, cf_dyn_buf *db)
 					cf_dyn_buf_append_string(db, "error-bad-start-params");
 					return 0;
 				}
+
+				for (uint32_t set_id = 1; set_id <= AS_SET_MAX_COUNT; set_id++) {
+					if (ns->set_read_hists[set_id] &&
+							! (cf_hist_track_start(ns->set_read_hists[set_id], back_sec, slice_sec, thresholds) &&
+									cf_hist_track_start(ns->set_write_hists[set_id], back_sec, slice_sec, thresholds) &&
+									cf_hist_track_start(ns->set_udf_hists[set_id], back_sec, slice_sec, thresholds) &&
+									cf_hist_track_start(ns->set_query_hists[set_id], back_sec, slice_sec, thresholds))) {
+
+						cf_dyn_buf_append_string(db, "error-bad-start-params");
+						return 0;
+					}
+				}
 			}
 
 			cf_dyn_buf_append_string(db, "ok");
@@ -3522,42 +4548,317 @@ info_command_hist_track(char *name, char *params, cf_dyn_buf *db)
 		return 0;
 	}
 
-	// From here on it's latency or throughput...
-
-	uint32_t duration_sec = 0;
+	// From here on it's latency or throughput...
+
+	uint32_t duration_sec = 0;
+
+	value_str_len = sizeof(value_str);
+
+	if (0 == as_info_parameter_get(params, "duration", value_str, &value_str_len)) {
+		if (0 == cf_str_atoi(value_str, &i)) {
+			duration_sec = i >= 0 ? (uint32_t)i : (uint32_t)-i;
+		}
+		else {
+			cf_info(AS_INFO, "hist track %s command: duration is not a number, using default", name);
+		}
+	}
+
+	bool throughput_only = 0 == strcmp(name, "throughput");
+	bool percentiles = 0 == strcmp(name, "latency-percentiles");
+
+	cf_debug(AS_INFO, "hist track %s command: back %u, duration %u, slice %u",
+			name, back_sec, duration_sec, slice_sec);
+
+	if (percentiles) {
+		if (hist_p) {
+			cf_hist_track_get_percentiles_info(hist_p, back_sec, duration_sec, db);
+		}
+		else {
+			for (uint32_t i = 0; i < g_config.n_namespaces; i++) {
+				as_namespace* ns = g_config.namespaces[i];
+
+				cf_hist_track_get_percentiles_info(ns->read_hist, back_sec, duration_sec, db);
+				cf_hist_track_get_percentiles_info(ns->write_hist, back_sec, duration_sec, db);
+				cf_hist_track_get_percentiles_info(ns->udf_hist, back_sec, duration_sec, db);
+				cf_hist_track_get_percentiles_info(ns->query_hist, back_sec, duration_sec, db);
+
+				for (uint32_t set_id = 1; set_id <= AS_SET_MAX_COUNT; set_id++) {
+					if (ns->set_latency_enabled[set_id]) {
+						cf_hist_track_get_percentiles_info(ns->set_read_hists[set_id], back_sec, duration_sec, db);
+						cf_hist_track_get_percentiles_info(ns->set_write_hists[set_id], back_sec, duration_sec, db);
+						cf_hist_track_get_percentiles_info(ns->set_udf_hists[set_id], back_sec, duration_sec, db);
+						cf_hist_track_get_percentiles_info(ns->set_query_hists[set_id], back_sec, duration_sec, db);
+					}
+				}
+			}
+		}
+	}
+	else if (hist_p) {
+		cf_hist_track_get_info(hist_p, back_sec, duration_sec, slice_sec, throughput_only, CF_HIST_TRACK_FMT_PACKED, db);
+	}
+	else {
+		for (uint32_t i = 0; i < g_config.n_namespaces; i++) {
+			as_namespace* ns = g_config.namespaces[i];
+
+			cf_hist_track_get_info(ns->read_hist, back_sec, duration_sec, slice_sec, throughput_only, CF_HIST_TRACK_FMT_PACKED, db);
+			cf_hist_track_get_info(ns->write_hist, back_sec, duration_sec, slice_sec, throughput_only, CF_HIST_TRACK_FMT_PACKED, db);
+			cf_hist_track_get_info(ns->udf_hist, back_sec, duration_sec, slice_sec, throughput_only, CF_HIST_TRACK_FMT_PACKED, db);
+			cf_hist_track_get_info(ns->query_hist, back_sec, duration_sec, slice_sec, throughput_only, CF_HIST_TRACK_FMT_PACKED, db);
+
+			for (uint32_t set_id = 1; set_id <= AS_SET_MAX_COUNT; set_id++) {
+				if (ns->set_latency_enabled[set_id]) {
+					cf_hist_track_get_info(ns->set_read_hists[set_id], back_sec, duration_sec, slice_sec, throughput_only, CF_HIST_TRACK_FMT_PACKED, db);
+					cf_hist_track_get_info(ns->set_write_hists[set_id], back_sec, duration_sec, slice_sec, throughput_only, CF_HIST_TRACK_FMT_PACKED, db);
+					cf_hist_track_get_info(ns->set_udf_hists[set_id], back_sec, duration_sec, slice_sec, throughput_only, CF_HIST_TRACK_FMT_PACKED, db);
+					cf_hist_track_get_info(ns->set_query_hists[set_id], back_sec, duration_sec, slice_sec, throughput_only, CF_HIST_TRACK_FMT_PACKED, db);
+				}
+			}
+		}
+	}
+
+	cf_dyn_buf_chomp(db);
+
+	return 0;
+}
+
+//
+// Recent transactions slower than slow-txn-threshold, most recent first.
+//
+// Format:
+//	slow-transactions:[max=<N>]
+//
+// Example output:
+//	time=1476359517812:ns=test:set=demo:digest=...:op=read:result=0:total-us=12840:read-queue-us=11:...;
+//
+int
+info_command_slow_transactions(char *name, char *params, cf_dyn_buf *db)
+{
+	char value_str[32];
+	int value_str_len = sizeof(value_str);
+	uint32_t max = 0;
+
+	if (0 == as_info_parameter_get(params, "max", value_str, &value_str_len) &&
+			0 != cf_str_atoi_u32(value_str, &max)) {
+		cf_dyn_buf_append_string(db, "error-bad-max");
+		return 0;
+	}
+
+	as_slow_txn_get_info(max, db);
+
+	return 0;
+}
+
+//
+// The hottest keys of a namespace, hottest first, from the last complete
+// sampling window (or the current one, if none has completed).
+//
+// Format:
+//	hot-keys:ns=<NAMESPACE>[;max=<N>]
+//
+// Example output:
+//	window-ms=10000:sample-rate=100;digest=...:set=demo:rate=5210;...
+//
+int
+info_command_hot_keys(char *name, char *params, cf_dyn_buf *db)
+{
+	char ns_name[AS_ID_NAMESPACE_SZ];
+	int ns_name_len = sizeof(ns_name);
+	as_namespace *ns = NULL;
+
+	if (0 != as_info_parameter_get(params, "ns", ns_name, &ns_name_len) ||
+			! (ns = as_namespace_get_byname(ns_name))) {
+		cf_dyn_buf_append_string(db, "error-bad-ns");
+		return 0;
+	}
+
+	char value_str[32];
+	int value_str_len = sizeof(value_str);
+	uint32_t max = 0;
+
+	if (0 == as_info_parameter_get(params, "max", value_str, &value_str_len) &&
+			0 != cf_str_atoi_u32(value_str, &max)) {
+		cf_dyn_buf_append_string(db, "error-bad-max");
+		return 0;
+	}
+
+	as_hot_keys_get_info(ns, max, db);
+
+	return 0;
+}
+
+//
+// Node, fabric and namespace counters as fixed-size binary entries, base64
+// encoded. With since=<SEQ> from a previous snapshot's header, only entries
+// that changed are returned - unless that snapshot is no longer held, in which
+// case the header flags it as full. Decode with stats-schema.
+//
+// Format:
+//	stats-binary:[since=<SEQ>]
+//
+int
+info_command_stats_binary(char *name, char *params, cf_dyn_buf *db)
+{
+	char value_str[32];
+	int value_str_len = sizeof(value_str);
+	uint32_t since = 0;
+
+	if (0 == as_info_parameter_get(params, "since", value_str, &value_str_len) &&
+			0 != cf_str_atoi_u32(value_str, &since)) {
+		cf_dyn_buf_append_string(db, "error-bad-since");
+		return 0;
+	}
+
+	as_metrics_get_binary(since, db);
+
+	return 0;
+}
+
+int
+info_get_stats_schema(char *name, cf_dyn_buf *db)
+{
+	as_metrics_get_schema(db);
+
+	return 0;
+}
+
+//
+// Capture a namespace's device I/O - record reads, wblock flushes and defrag
+// reads - to a trace file. No digests or data are recorded. The file is created
+// in storage-trace-directory. Without an action, reports the capture in
+// progress.
+//
+// Format:
+//	storage-trace:[action=start;ns=<NS>;file=<NAME>[;max-ops=<N>]]
+//	storage-trace:action=stop
+//
+int
+info_command_storage_trace(char *name, char *params, cf_dyn_buf *db)
+{
+	char action[16];
+	int action_len = sizeof(action);
+
+	if (0 != as_info_parameter_get(params, "action", action, &action_len)) {
+		as_storage_trace_get_info(db);
+		return 0;
+	}
+
+	const char *err = NULL;
+
+	if (0 == strcmp(action, "start")) {
+		char ns_name[AS_ID_NAMESPACE_SZ];
+		int ns_name_len = sizeof(ns_name);
+		char path[PATH_MAX];
+		int path_len = sizeof(path);
+		char value_str[32];
+		int value_str_len = sizeof(value_str);
+		uint64_t max_ops = 0;
+		as_namespace *ns;
+
+		if (0 != as_info_parameter_get(params, "ns", ns_name, &ns_name_len) ||
+				! (ns = as_namespace_get_byname(ns_name))) {
+			err = "bad-ns";
+		}
+		else if (0 != as_info_parameter_get(params, "file", path, &path_len)) {
+			err = "bad-file";
+		}
+		else if (0 == as_info_parameter_get(params, "max-ops", value_str,
+				&value_str_len) && 0 != cf_str_atoi_u64(value_str, &max_ops)) {
+			err = "bad-max-ops";
+		}
+		else {
+			err = as_storage_trace_start(ns, path, max_ops);
+		}
+	}
+	else if (0 == strcmp(action, "stop")) {
+		err = as_storage_trace_stop();
+	}
+	else {
+		err = "bad-action";
+	}
+
+	if (err) {
+		cf_dyn_buf_append_string(db, "error-");
+		cf_dyn_buf_append_string(db, err);
+	}
+	else {
+		cf_dyn_buf_append_string(db, "ok");
+	}
+
+	return 0;
+}
+
+//
+// Replay a trace from storage-trace against a device no namespace uses,
+// reporting latency percentiles per op type. THE DEVICE IS WRITTEN TO. Engines
+// are ssd (the default), ssd-osync, buffered and pwrite. Paced replays issue
+// ops at their recorded times. Without a trace, reports the last replay.
+//
+// Format:
+//	storage-replay:[trace=<NAME>;device=<PATH>[;engine=<ENGINE>][;threads=<N>][;paced=<BOOL>]]
+//
+// Example output:
+//	status=done:...:elapsed-ms=60013;op=read:count=1982231:p50-us=92:...;op=write:...
+//
+int
+info_command_storage_replay(char *name, char *params, cf_dyn_buf *db)
+{
+	char trace_path[PATH_MAX];
+	int trace_path_len = sizeof(trace_path);
+
+	if (0 != as_info_parameter_get(params, "trace", trace_path,
+			&trace_path_len)) {
+		as_storage_replay_get_info(db);
+		return 0;
+	}
+
+	char device_path[PATH_MAX];
+	int device_path_len = sizeof(device_path);
+	char engine[32];
+	int engine_len = sizeof(engine);
+	char value_str[32];
+	int value_str_len = sizeof(value_str);
+	uint32_t n_threads = 1;
+	bool paced = true;
+	const char *err = NULL;
 
-	value_str_len = sizeof(value_str);
+	if (0 != as_info_parameter_get(params, "device", device_path,
+			&device_path_len)) {
+		err = "bad-device";
+	}
+	else if (0 == as_info_parameter_get(params, "threads", value_str,
+			&value_str_len) && 0 != cf_str_atoi_u32(value_str, &n_threads)) {
+		err = "bad-threads";
+	}
+	else {
+		value_str_len = sizeof(value_str);
 
-	if (0 == as_info_parameter_get(params, "duration", value_str, &value_str_len)) {
-		if (0 == cf_str_atoi(value_str, &i)) {
-			duration_sec = i >= 0 ? (uint32_t)i : (uint32_t)-i;
-		}
-		else {
-			cf_info(AS_INFO, "hist track %s command: duration is not a number, using default", name);
+		if (0 == as_info_parameter_get(params, "paced", value_str,
+				&value_str_len)) {
+			if (0 == strcmp(value_str, "false")) {
+				paced = false;
+			}
+			else if (0 != strcmp(value_str, "true")) {
+				err = "bad-paced";
+			}
 		}
 	}
 
-	bool throughput_only = 0 == strcmp(name, "throughput");
+	if (! err) {
+		bool have_engine = 0 == as_info_parameter_get(params, "engine", engine,
+				&engine_len);
 
-	cf_debug(AS_INFO, "hist track %s command: back %u, duration %u, slice %u",
-			name, back_sec, duration_sec, slice_sec);
+		err = as_storage_replay_start(trace_path, device_path,
+				have_engine ? engine : NULL, n_threads, paced);
+	}
 
-	if (hist_p) {
-		cf_hist_track_get_info(hist_p, back_sec, duration_sec, slice_sec, throughput_only, CF_HIST_TRACK_FMT_PACKED, db);
+	if (err) {
+		cf_dyn_buf_append_string(db, "error-");
+		cf_dyn_buf_append_string(db, err);
 	}
 	else {
-		for (uint32_t i = 0; i < g_config.n_namespaces; i++) {
-			as_namespace* ns = g_config.namespaces[i];
-
-			cf_hist_track_get_info(ns->read_hist, back_sec, duration_sec, slice_sec, throughput_only, CF_HIST_TRACK_FMT_PACKED, db);
-			cf_hist_track_get_info(ns->write_hist, back_sec, duration_sec, slice_sec, throughput_only, CF_HIST_TRACK_FMT_PACKED, db);
-			cf_hist_track_get_info(ns->udf_hist, back_sec, duration_sec, slice_sec, throughput_only, CF_HIST_TRACK_FMT_PACKED, db);
-			cf_hist_track_get_info(ns->query_hist, back_sec, duration_sec, slice_sec, throughput_only, CF_HIST_TRACK_FMT_PACKED, db);
-		}
+		cf_dyn_buf_append_string(db, "ok");
 	}
 
-	cf_dyn_buf_chomp(db);
-
 	return 0;
 }
 
@@ -3632,6 +4933,259 @@ info_static		*static_head = 0;
 info_dynamic	*dynamic_head = 0;
 info_tree		*tree_head = 0;
 info_command	*command_head = 0;
+
+// Heavy names - cacheable ones must be read-only.
+static const struct {
+	const char	*name;
+	bool		cacheable;
+} HEAVY_INFO_NAMES[] = {
+		{ "dump-fabric", false },
+		{ "dump-hb", false },
+		{ "dump-hlc", false },
+		{ "dump-migrates", false },
+		{ "dump-msgs", false },
+		{ "dump-paxos", false },
+		{ "dump-ra", false },
+		{ "dump-rw", false },
+		{ "dump-smd", false },
+		{ "dump-wb", false },
+		{ "dump-wb-summary", false },
+		{ "jem-stats", false },
+		{ "jobs", false },
+		{ "mstats", false },
+		{ "query-list", true },
+		{ "scan-list", true },
+		{ "show-devices", false },
+		{ "sindex-builder-list", true },
+		{ "sindex-histogram", false },
+		{ "sindex-repair", false },
+		{ "sindex-value-histogram", true },
+		{ "storage-replay", false },
+		{ "storage-trace", false }
+};
+
+#define N_HEAVY_INFO_NAMES (sizeof(HEAVY_INFO_NAMES) / sizeof(HEAVY_INFO_NAMES[0]))
+
+// Partition map names - cached until the partition generation changes, so
+// clients polling after a cluster change don't each rebuild the maps.
+static const char *PARTITION_MAP_INFO_NAMES[] = {
+		"replicas-all",
+		"replicas-master",
+		"replicas-prole",
+		"replicas-rack",
+		"replicas-read",
+		"replicas-write"
+};
+
+#define N_PARTITION_MAP_INFO_NAMES (sizeof(PARTITION_MAP_INFO_NAMES) / sizeof(PARTITION_MAP_INFO_NAMES[0]))
+
+static void
+info_exec_stats_add(info_exec_stats *s, uint64_t start_ns)
+{
+	uint64_t us = (cf_getns() - start_ns) / 1000;
+	uint64_t max_us = cf_atomic64_get(s->max_us);
+
+	cf_atomic64_incr(&s->n_calls);
+	cf_atomic64_add(&s->total_us, us);
+
+	while (us > max_us) {
+		uint64_t prev = cf_atomic64_cas(&s->max_us, max_us, us);
+
+		if (prev == max_us) {
+			break;
+		}
+
+		max_us = prev;
+	}
+}
+
+static info_cache *
+info_cache_create()
+{
+	info_cache *c = cf_calloc(1, sizeof(info_cache));
+
+	cf_assert(c, AS_INFO, CF_CRITICAL, "failed info cache calloc");
+	pthread_mutex_init(&c->lock, NULL);
+
+	return c;
+}
+
+// On a hit, appends the cached response. Param is NULL for dynamic names. The
+// generation is the partition generation sampled before the lookup.
+static bool
+info_cache_get(info_cache *c, const char *param, uint32_t generation,
+		cf_dyn_buf *db)
+{
+	if (! c || (! c->by_generation && g_config.info_cache_ttl == 0)) {
+		return false;
+	}
+
+	bool hit = false;
+
+	pthread_mutex_lock(&c->lock);
+
+	bool valid = c->by_generation ?
+			c->generation == generation : cf_getms() < c->expire_ms;
+
+	if (c->rsp && valid &&
+			(! param || (c->param && strcmp(c->param, param) == 0))) {
+		cf_dyn_buf_append_buf(db, c->rsp, c->rsp_sz);
+		hit = true;
+	}
+
+	pthread_mutex_unlock(&c->lock);
+
+	if (hit) {
+		cf_atomic64_incr(&g_stats.info_cache_hits);
+	}
+
+	return hit;
+}
+
+// Caches what was appended to db since offset start. The generation must be
+// the one passed to the missed info_cache_get(), so a response built while the
+// maps changed is not kept past the change.
+static void
+info_cache_put(info_cache *c, const char *param, uint32_t generation,
+		const cf_dyn_buf *db, size_t start)
+{
+	if (! c || (! c->by_generation && g_config.info_cache_ttl == 0)) {
+		return;
+	}
+
+	size_t rsp_sz = db->used_sz - start;
+	uint8_t *rsp = cf_malloc(rsp_sz + 1);
+	char *param_copy = param ? cf_strdup(param) : NULL;
+
+	if (! rsp || (param && ! param_copy)) {
+		if (rsp) cf_free(rsp);
+		if (param_copy) cf_free(param_copy);
+		return;
+	}
+
+	memcpy(rsp, db->buf + start, rsp_sz);
+
+	pthread_mutex_lock(&c->lock);
+
+	if (c->rsp) cf_free(c->rsp);
+	if (c->param) cf_free(c->param);
+
+	c->rsp = rsp;
+	c->rsp_sz = rsp_sz;
+	c->param = param_copy;
+	c->expire_ms = cf_getms() + g_config.info_cache_ttl;
+	c->generation = generation;
+
+	pthread_mutex_unlock(&c->lock);
+}
+
+// Called once all names are registered - the lists don't change after.
+static void
+info_set_partition_map_cached(const char *name)
+{
+	for (info_dynamic *d = dynamic_head; d; d = d->next) {
+		if (strcmp(d->name, name) == 0) {
+			d->cache = info_cache_create();
+			d->cache->by_generation = true;
+		}
+	}
+}
+
+// Called once all names are registered - the lists don't change after.
+static void
+info_set_heavy(const char *name, bool cacheable)
+{
+	for (info_dynamic *d = dynamic_head; d; d = d->next) {
+		if (strcmp(d->name, name) == 0) {
+			d->cls = INFO_CLASS_HEAVY;
+			d->cache = cacheable ? info_cache_create() : NULL;
+		}
+	}
+
+	for (info_tree *t = tree_head; t; t = t->next) {
+		if (strcmp(t->name, name) == 0) {
+			t->cls = INFO_CLASS_HEAVY;
+		}
+	}
+
+	for (info_command *cmd = command_head; cmd; cmd = cmd->next) {
+		if (strcmp(cmd->name, name) == 0) {
+			cmd->cls = INFO_CLASS_HEAVY;
+			cmd->cache = cacheable ? info_cache_create() : NULL;
+		}
+	}
+}
+
+static bool
+info_name_is_heavy(const char *name, size_t len)
+{
+	for (info_dynamic *d = dynamic_head; d; d = d->next) {
+		if (d->cls == INFO_CLASS_HEAVY && strlen(d->name) == len &&
+				memcmp(d->name, name, len) == 0) {
+			return true;
+		}
+	}
+
+	for (info_tree *t = tree_head; t; t = t->next) {
+		if (t->cls == INFO_CLASS_HEAVY && strlen(t->name) == len &&
+				memcmp(t->name, name, len) == 0) {
+			return true;
+		}
+	}
+
+	for (info_command *cmd = command_head; cmd; cmd = cmd->next) {
+		if (cmd->cls == INFO_CLASS_HEAVY && strlen(cmd->name) == len &&
+				memcmp(cmd->name, name, len) == 0) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// A request is heavy if any of its names is - names end at ':' for commands,
+// or at '/' for trees.
+static bool
+info_request_is_heavy(const as_proto *pr)
+{
+	if (! g_info_heavy_work_q) {
+		return false;
+	}
+
+	const char *c = (const char *)pr->data;
+	const char *lim = c + pr->sz;
+
+	while (c < lim) {
+		const char *tok = c;
+
+		while (c < lim && *c != EOL && *c != ':' && *c != TREE_SEP) {
+			c++;
+		}
+
+		if (info_name_is_heavy(tok, (size_t)(c - tok))) {
+			return true;
+		}
+
+		while (c < lim && *c != EOL) {
+			c++;
+		}
+
+		c++;
+	}
+
+	return false;
+}
+
+// A subscription is a request for the subscribe name alone.
+static bool
+info_request_is_subscribe(const as_proto *pr)
+{
+	size_t len = sizeof(AS_PARTITION_STREAM_SUBSCRIBE) - 1;
+
+	return (pr->sz == len || (pr->sz == len + 1 && pr->data[len] == EOL)) &&
+			memcmp(pr->data, AS_PARTITION_STREAM_SUBSCRIBE, len) == 0;
+}
+
 //
 // Pull up all elements in both list into the buffers
 // (efficient enough if you're looking for lots of things)
@@ -3664,10 +5218,14 @@ info_all(const as_file_handle* fd_h, cf_dyn_buf *db)
 	info_dynamic *d = dynamic_head;
 	while (d) {
 		if (d->def == true) {
+			uint64_t start_ns = cf_getns();
+
 			cf_dyn_buf_append_string( db, d->name);
 			cf_dyn_buf_append_char(db, SEP );
 			d->value_fn(d->name, db);
 			cf_dyn_buf_append_char(db, EOL);
+
+			info_exec_stats_add(&d->stats, start_ns);
 		}
 		d = d->next;
 	}
@@ -3724,11 +5282,22 @@ info_some(char *buf, char *buf_lim, const as_file_handle* fd_h, cf_dyn_buf *db)
 				info_dynamic *d = dynamic_head;
 				while (d) {
 					if (strcmp(d->name, name) == 0) {
+						uint64_t start_ns = cf_getns();
+
 						// return exact command string received from client
 						cf_dyn_buf_append_string( db, d->name);
 						cf_dyn_buf_append_char(db, SEP );
-						d->value_fn(d->name, db);
+
+						size_t start = db->used_sz;
+						uint32_t generation = (uint32_t)g_partition_generation;
+
+						if (! info_cache_get(d->cache, NULL, generation, db)) {
+							d->value_fn(d->name, db);
+							info_cache_put(d->cache, NULL, generation, db, start);
+						}
+
 						cf_dyn_buf_append_char(db, EOL);
+						info_exec_stats_add(&d->stats, start_ns);
 						handled = true;
 						break;
 					}
@@ -3748,6 +5317,8 @@ info_some(char *buf, char *buf_lim, const as_file_handle* fd_h, cf_dyn_buf *db)
 					info_tree *t = tree_head;
 					while (t) {
 						if (strcmp(t->name, name) == 0) {
+							uint64_t start_ns = cf_getns();
+
 							// return exact command string received from client
 							cf_dyn_buf_append_string( db, t->name);
 							cf_dyn_buf_append_char( db, TREE_SEP);
@@ -3755,6 +5326,7 @@ info_some(char *buf, char *buf_lim, const as_file_handle* fd_h, cf_dyn_buf *db)
 							cf_dyn_buf_append_char(db, SEP );
 							t->tree_fn(t->name, branch, db);
 							cf_dyn_buf_append_char(db, EOL);
+							info_exec_stats_add(&t->stats, start_ns);
 							handled = true;
 							break;
 						}
@@ -3785,6 +5357,8 @@ info_some(char *buf, char *buf_lim, const as_file_handle* fd_h, cf_dyn_buf *db)
 			info_command *cmd = command_head;
 			while (cmd) {
 				if (strcmp(cmd->name, name) == 0) {
+					uint64_t start_ns = cf_getns();
+
 					// return exact command string received from client
 					cf_dyn_buf_append_string( db, name);
 					cf_dyn_buf_append_char( db, ':');
@@ -3796,13 +5370,20 @@ info_some(char *buf, char *buf_lim, const as_file_handle* fd_h, cf_dyn_buf *db)
 					as_security_log(fd_h, result, cmd->required_perm, name, param);
 
 					if (result == AS_PROTO_RESULT_OK) {
-						cmd->command_fn(cmd->name, param, db);
+						size_t start = db->used_sz;
+						uint32_t generation = (uint32_t)g_partition_generation;
+
+						if (! info_cache_get(cmd->cache, param, generation, db)) {
+							cmd->command_fn(cmd->name, param, db);
+							info_cache_put(cmd->cache, param, generation, db, start);
+						}
 					}
 					else {
 						append_sec_err_str(db, result, cmd->required_perm);
 					}
 
 					cf_dyn_buf_append_char( db, EOL );
+					info_exec_stats_add(&cmd->stats, start_ns);
 					break;
 				}
 				cmd = cmd->next;
@@ -3842,19 +5423,41 @@ as_info_buffer(uint8_t *req_buf, size_t req_buf_len, cf_dyn_buf *rsp)
 //
 
 void *
-thr_info_fn(void *unused)
+thr_info_fn(void *q_arg)
 {
+	cf_queue *q = (cf_queue *)q_arg;
+
 	for ( ; ; ) {
 
 		as_info_transaction it;
 
-		if (0 != cf_queue_pop(g_info_work_q, &it, CF_QUEUE_FOREVER)) {
+		if (0 != cf_queue_pop(q, &it, CF_QUEUE_FOREVER)) {
 			cf_crash(AS_TSVC, "unable to pop from info work queue");
 		}
 
 		as_file_handle *fd_h = it.fd_h;
 		as_proto *pr = it.proto;
 
+		// The client has likely given up - don't spend a thread on it.
+		if (g_config.info_timeout != 0 &&
+				cf_getns() - it.start_time >
+						(uint64_t)g_config.info_timeout * 1000000) {
+			cf_atomic64_incr(&g_stats.info_timeout);
+			as_end_of_transaction_force_close(fd_h);
+			cf_free(pr);
+			continue;
+		}
+
+		// The connection is handed over for partition map pushes.
+		if (info_request_is_subscribe(pr)) {
+			as_partition_stream_subscribe(fd_h);
+			cf_free(pr);
+
+			G_HIST_INSERT_DATA_POINT(info_hist, it.start_time);
+			cf_atomic64_incr(&g_stats.info_complete);
+			continue;
+		}
+
 		// Allocate an output buffer sufficiently large to avoid ever resizing
 		cf_dyn_buf_define_size(db, 128 * 1024);
 		// write space for the header
@@ -3881,6 +5484,9 @@ thr_info_fn(void *unused)
 		// write the data buffer
 		uint8_t	*b = db.buf;
 		uint8_t	*lim = db.buf + db.used_sz;
+
+		as_file_handle_send_lock(fd_h);
+
 		while (b < lim) {
 			int rv = cf_socket_send(fd_h->sock, b, lim - b, MSG_NOSIGNAL);
 			if ((rv < 0) && (errno != EAGAIN) ) {
@@ -3889,6 +5495,7 @@ thr_info_fn(void *unused)
 				} else {
 					cf_info(AS_INFO, "thr_info: can't write all bytes, fd %d error %d", CSFD(fd_h->sock), errno);
 				}
+				as_file_handle_send_unlock(fd_h);
 				as_end_of_transaction_force_close(fd_h);
 				fd_h = NULL;
 				break;
@@ -3904,6 +5511,7 @@ thr_info_fn(void *unused)
 		cf_free(pr);
 
 		if (fd_h) {
+			as_file_handle_send_unlock(fd_h);
 			as_end_of_transaction_ok(fd_h);
 			fd_h = NULL;
 		}
@@ -3927,7 +5535,10 @@ thr_info_fn(void *unused)
 void
 as_info(as_info_transaction *it)
 {
-	if (0 != cf_queue_push(g_info_work_q, it)) {
+	cf_queue *q = info_request_is_heavy(it->proto) ?
+			g_info_heavy_work_q : g_info_work_q;
+
+	if (0 != cf_queue_push(q, it)) {
 		cf_warning(AS_INFO, "failed info queue push");
 
 		// TODO - bother "handling" this?
@@ -3943,6 +5554,13 @@ as_info_queue_get_size()
 	return cf_queue_sz(g_info_work_q);
 }
 
+// Return the number of pending heavy Info requests.
+int
+as_info_heavy_queue_get_size()
+{
+	return g_info_heavy_work_q ? cf_queue_sz(g_info_heavy_work_q) : 0;
+}
+
 // Registers a dynamic name-value calculator.
 // the get_value_fn will be called if a request comes in for this name.
 // only does the registration!
@@ -3966,7 +5584,7 @@ as_info_set_dynamic(char *name, as_info_get_value_fn gv_fn, bool def)
 	}
 
 	if (!e) {
-		e = cf_malloc(sizeof(info_dynamic));
+		e = cf_calloc(1, sizeof(info_dynamic));
 		if (!e) goto Cleanup;
 		e->def = def;
 		e->name = cf_strdup(name);
@@ -4007,7 +5625,7 @@ as_info_set_tree(char *name, as_info_get_tree_fn gv_fn)
 	}
 
 	if (!e) {
-		e = cf_malloc(sizeof(info_tree));
+		e = cf_calloc(1, sizeof(info_tree));
 		if (!e) goto Cleanup;
 		e->name = cf_strdup(name);
 		if (!e->name) {
@@ -4047,7 +5665,7 @@ as_info_set_command(char *name, as_info_command_fn command_fn, as_sec_perm requi
 	}
 
 	if (!e) {
-		e = cf_malloc(sizeof(info_command));
+		e = cf_calloc(1, sizeof(info_command));
 		if (!e) goto Cleanup;
 		e->name = cf_strdup(name);
 		if (!e->name) {
@@ -4818,6 +6436,57 @@ info_get_logs(char *name, cf_dyn_buf *db)
 	return(0);
 }
 
+static void
+append_info_exec_stats(cf_dyn_buf *db, const char *name, info_class cls,
+		const info_exec_stats *s)
+{
+	uint64_t n_calls = cf_atomic64_get(s->n_calls);
+
+	if (n_calls == 0) {
+		return;
+	}
+
+	cf_dyn_buf_append_string(db, name);
+	cf_dyn_buf_append_string(db, cls == INFO_CLASS_HEAVY ? ":class=heavy" : ":class=cheap");
+	cf_dyn_buf_append_string(db, ":calls=");
+	cf_dyn_buf_append_uint64(db, n_calls);
+	cf_dyn_buf_append_string(db, ":avg-us=");
+	cf_dyn_buf_append_uint64(db, cf_atomic64_get(s->total_us) / n_calls);
+	cf_dyn_buf_append_string(db, ":max-us=");
+	cf_dyn_buf_append_uint64(db, cf_atomic64_get(s->max_us));
+	cf_dyn_buf_append_char(db, ';');
+}
+
+// Execution time of each info name that has been called, e.g.:
+//	statistics:class=cheap:calls=1042:avg-us=210:max-us=1893;...
+int
+info_get_command_stats(char *name, cf_dyn_buf *db)
+{
+	size_t start = db->used_sz;
+
+	for (info_dynamic *d = dynamic_head; d; d = d->next) {
+		append_info_exec_stats(db, d->name, d->cls, &d->stats);
+	}
+
+	// Trees share names with dynamics - show them as "name/".
+	for (info_tree *t = tree_head; t; t = t->next) {
+		char tree_name[128];
+
+		snprintf(tree_name, sizeof(tree_name), "%s%c", t->name, TREE_SEP);
+		append_info_exec_stats(db, tree_name, t->cls, &t->stats);
+	}
+
+	for (info_command *cmd = command_head; cmd; cmd = cmd->next) {
+		append_info_exec_stats(db, cmd->name, cmd->cls, &cmd->stats);
+	}
+
+	if (db->used_sz > start) {
+		cf_dyn_buf_chomp(db);
+	}
+
+	return(0);
+}
+
 int
 info_get_objects(char *name, cf_dyn_buf *db)
 {
@@ -4883,14 +6552,21 @@ info_get_namespace_info(as_namespace *ns, cf_dyn_buf *db)
 	info_append_uint64(db, "expired_objects", ns->n_expired_objects);
 	info_append_uint64(db, "evicted_objects", ns->n_evicted_objects);
 	info_append_uint64(db, "set_deleted_objects", ns->n_deleted_set_objects);
+	info_append_uint64(db, "truncated_objects", ns->n_truncated_objects);
+	info_append_uint64(db, "truncate_lut", ns->truncate_lut);
 	info_append_uint64(db, "evict_ttl", ns->evict_ttl);
 	info_append_uint32(db, "nsup_cycle_duration", ns->nsup_cycle_duration);
 	info_append_uint32(db, "nsup_cycle_sleep_pct", ns->nsup_cycle_sleep_pct);
+	info_append_int(db, "non_master_gc_pid", (int)cf_atomic32_get(ns->non_master_gc_pid));
+	info_append_bool(db, "non_master_gc_sets_delete", ns->non_master_gc_sets_delete != 0);
+	info_append_uint64(db, "non_master_gc_expired_objects", ns->n_non_master_gc_expired_objects);
+	info_append_uint64(db, "non_master_gc_deleted_set_objects", ns->n_non_master_gc_deleted_set_objects);
 
 	// Memory usage stats.
 
 	uint64_t data_memory = ns->n_bytes_memory;
-	uint64_t index_memory = as_index_size_get(ns) * (ns->n_objects + ns->n_sub_objects);
+	uint64_t index_used = as_index_size_get(ns) * (ns->n_objects + ns->n_sub_objects);
+	uint64_t index_memory = ns->index_flash_path ? 0 : index_used;
 	uint64_t sindex_memory = ns->sindex_data_memory_used;
 	uint64_t used_memory = data_memory + index_memory + sindex_memory;
 
@@ -4898,6 +6574,10 @@ info_get_namespace_info(as_namespace *ns, cf_dyn_buf *db)
 	info_append_uint64(db, "memory_used_data_bytes", data_memory);
 	info_append_uint64(db, "memory_used_index_bytes", index_memory);
 	info_append_uint64(db, "memory_used_sindex_bytes", sindex_memory);
+	info_append_uint64(db, "index_flash_used_bytes", ns->index_flash_path ? index_used : 0);
+
+	info_append_uint32(db, "index_stages", cf_arenax_stage_count(ns->arena));
+	info_append_uint32(db, "index_huge_page_stages", cf_arenax_huge_stage_count(ns->arena));
 
 	uint64_t free_pct = (ns->memory_size != 0 && (ns->memory_size > used_memory)) ?
 			((ns->memory_size - used_memory) * 100L) / ns->memory_size : 0;
@@ -4928,6 +6608,44 @@ info_get_namespace_info(as_namespace *ns, cf_dyn_buf *db)
 		if (! ns->storage_data_in_memory) {
 			info_append_int(db, "cache_read_pct", (int)(ns->cache_read_pct + 0.5));
 		}
+
+		if (! ns->storage_data_in_memory && ns->storage_read_cache_size != 0) {
+			info_append_uint64(db, "read_cache_hits", cf_shard_counter_get(&ns->n_read_cache_hits));
+			info_append_uint64(db, "read_cache_misses", cf_shard_counter_get(&ns->n_read_cache_misses));
+		}
+
+		if (! ns->storage_data_in_memory && ns->ldt_enabled &&
+				ns->storage_ldt_subrec_cache_size != 0) {
+			info_append_uint64(db, "ldt_subrec_cache_hits", cf_shard_counter_get(&ns->n_ldt_subrec_cache_hits));
+			info_append_uint64(db, "ldt_subrec_cache_misses", cf_shard_counter_get(&ns->n_ldt_subrec_cache_misses));
+		}
+
+		if (ns->storage_shadows[0]) {
+			uint32_t shadow_write_q = 0;
+			uint64_t shadow_lag_ms = 0;
+			uint64_t shadow_dropped_writes = 0;
+
+			as_storage_shadow_stats_ssd(ns, &shadow_write_q, &shadow_lag_ms,
+					&shadow_dropped_writes);
+
+			info_append_uint32(db, "shadow_write_q", shadow_write_q);
+			info_append_uint64(db, "shadow_lag_ms", shadow_lag_ms);
+			info_append_uint64(db, "shadow_dropped_writes", shadow_dropped_writes);
+		}
+
+		if (! ns->storage_data_in_memory) {
+			as_storage_post_write_q_stats_ssd(ns, db);
+		}
+
+		if (ns->storage_compression != AS_STORAGE_COMPRESSION_NONE) {
+			uint64_t orig_bytes = cf_shard_counter_get(&ns->n_compression_orig_bytes);
+			uint64_t comp_bytes = cf_shard_counter_get(&ns->n_compression_bytes);
+
+			info_append_uint64(db, "device_compression_orig_bytes", orig_bytes);
+			info_append_uint64(db, "device_compression_bytes", comp_bytes);
+			info_append_uint64(db, "device_compression_pct",
+					orig_bytes != 0 ? (comp_bytes * 100) / orig_bytes : 100);
+		}
 	}
 
 	// Not bothering with AS_STORAGE_ENGINE_KV.
@@ -4948,38 +6666,79 @@ info_get_namespace_info(as_namespace *ns, cf_dyn_buf *db)
 	info_append_uint64(db, "migrate_rx_partitions_initial", ns->migrate_rx_partitions_initial);
 	info_append_uint64(db, "migrate_rx_partitions_remaining", ns->migrate_rx_partitions_remaining);
 
+	info_append_uint64(db, "migrate_tx_partitions_delta", ns->migrate_tx_partitions_delta);
+	info_append_uint64(db, "migrate_tx_partitions_changelog", ns->migrate_tx_partitions_changelog);
+
 	info_append_uint64(db, "migrate_records_skipped", ns->migrate_records_skipped);
 	info_append_uint64(db, "migrate_records_transmitted", ns->migrate_records_transmitted);
 	info_append_uint64(db, "migrate_record_retransmits", ns->migrate_record_retransmits);
 	info_append_uint64(db, "migrate_record_receives", ns->migrate_record_receives);
+	info_append_uint64(db, "migrate_compression_orig_bytes", ns->migrate_compression_orig_bytes);
+	info_append_uint64(db, "migrate_compression_bytes", ns->migrate_compression_bytes);
+	info_append_uint64(db, "migrate_decompression_errors", ns->migrate_decompression_errors);
+	info_append_uint64(db, "migrate_delta_records_skipped", ns->migrate_delta_records_skipped);
 
 	// From-client transaction stats.
 
 	info_append_uint64(db, "client_tsvc_error", ns->n_client_tsvc_error);
 	info_append_uint64(db, "client_tsvc_timeout", ns->n_client_tsvc_timeout);
+	info_append_uint64(db, "deadline_drops", ns->n_deadline_drops);
+	info_append_uint64(db, "blind_writes", ns->n_blind_writes);
+
+	if (ns->transaction_queues != 0) {
+		info_append_int(db, "tsvc_queue", thr_tsvc_ns_queue_get_size(ns));
+		info_append_uint64(db, "tsvc_queue_waits", ns->n_tsvc_queue_waits);
+		info_append_uint64(db, "tsvc_queue_wait_us", ns->tsvc_queue_wait_us);
+	}
+
+	if (ns->memory_snapshot_dir) {
+		info_append_uint64(db, "memory_snapshot_count", ns->memory_snapshot_count);
+		info_append_uint64(db, "memory_snapshot_last_ms", ns->memory_snapshot_last_ms);
+		info_append_uint64(db, "memory_snapshot_last_records", ns->memory_snapshot_last_records);
+		info_append_uint64(db, "memory_snapshot_last_bytes", ns->memory_snapshot_last_bytes);
+		info_append_uint64(db, "memory_snapshot_loaded_records", ns->memory_snapshot_loaded_records);
+	}
+
+	info_append_uint32(db, "admission_level", ns->admission_level);
+	info_append_uint64(db, "admission_scan_shed", ns->n_admission_scan_shed);
+	info_append_uint64(db, "admission_udf_bg_shed", ns->n_admission_udf_bg_shed);
+	info_append_uint64(db, "admission_migrate_delays", ns->n_admission_migrate_delays);
+	info_append_uint64(db, "admission_write_shed", ns->n_admission_write_shed);
+
+	uint64_t async_repl_lag_bytes;
+	uint64_t async_repl_lag_ms;
+
+	repl_log_get_lag(ns, &async_repl_lag_bytes, &async_repl_lag_ms);
+	info_append_uint64(db, "async_repl_writes", ns->n_async_repl_writes);
+	info_append_uint64(db, "async_repl_rejected", ns->n_async_repl_rejected);
+	info_append_uint64(db, "async_repl_dropped_bytes", ns->n_async_repl_dropped_bytes);
+	info_append_uint64(db, "async_repl_fallbacks", ns->n_async_repl_fallbacks);
+	info_append_uint64(db, "async_repl_lag_bytes", async_repl_lag_bytes);
+	info_append_uint64(db, "async_repl_lag_ms", async_repl_lag_ms);
 
 	info_append_uint64(db, "client_proxy_complete", ns->n_client_proxy_complete);
 	info_append_uint64(db, "client_proxy_error", ns->n_client_proxy_error);
 	info_append_uint64(db, "client_proxy_timeout", ns->n_client_proxy_timeout);
 
-	info_append_uint64(db, "client_read_success", ns->n_client_read_success);
-	info_append_uint64(db, "client_read_error", ns->n_client_read_error);
-	info_append_uint64(db, "client_read_timeout", ns->n_client_read_timeout);
-	info_append_uint64(db, "client_read_not_found", ns->n_client_read_not_found);
+	info_append_uint64(db, "client_read_success", cf_shard_counter_get(&ns->n_client_read_success));
+	info_append_uint64(db, "client_read_error", cf_shard_counter_get(&ns->n_client_read_error));
+	info_append_uint64(db, "client_read_timeout", cf_shard_counter_get(&ns->n_client_read_timeout));
+	info_append_uint64(db, "client_read_not_found", cf_shard_counter_get(&ns->n_client_read_not_found));
+	info_append_uint64(db, "client_read_coalesced", ns->n_client_read_coalesced);
 
-	info_append_uint64(db, "client_write_success", ns->n_client_write_success);
-	info_append_uint64(db, "client_write_error", ns->n_client_write_error);
-	info_append_uint64(db, "client_write_timeout", ns->n_client_write_timeout);
+	info_append_uint64(db, "client_write_success", cf_shard_counter_get(&ns->n_client_write_success));
+	info_append_uint64(db, "client_write_error", cf_shard_counter_get(&ns->n_client_write_error));
+	info_append_uint64(db, "client_write_timeout", cf_shard_counter_get(&ns->n_client_write_timeout));
 
 	// Subset of n_client_write_... above, respectively.
 	info_append_uint64(db, "xdr_write_success", ns->n_xdr_write_success);
 	info_append_uint64(db, "xdr_write_error", ns->n_xdr_write_error);
 	info_append_uint64(db, "xdr_write_timeout", ns->n_xdr_write_timeout);
 
-	info_append_uint64(db, "client_delete_success", ns->n_client_delete_success);
-	info_append_uint64(db, "client_delete_error", ns->n_client_delete_error);
-	info_append_uint64(db, "client_delete_timeout", ns->n_client_delete_timeout);
-	info_append_uint64(db, "client_delete_not_found", ns->n_client_delete_not_found);
+	info_append_uint64(db, "client_delete_success", cf_shard_counter_get(&ns->n_client_delete_success));
+	info_append_uint64(db, "client_delete_error", cf_shard_counter_get(&ns->n_client_delete_error));
+	info_append_uint64(db, "client_delete_timeout", cf_shard_counter_get(&ns->n_client_delete_timeout));
+	info_append_uint64(db, "client_delete_not_found", cf_shard_counter_get(&ns->n_client_delete_not_found));
 
 	info_append_uint64(db, "client_udf_complete", ns->n_client_udf_complete);
 	info_append_uint64(db, "client_udf_error", ns->n_client_udf_error);
@@ -4999,10 +6758,19 @@ info_get_namespace_info(as_namespace *ns, cf_dyn_buf *db)
 	info_append_uint64(db, "batch_sub_proxy_error", ns->n_batch_sub_proxy_error);
 	info_append_uint64(db, "batch_sub_proxy_timeout", ns->n_batch_sub_proxy_timeout);
 
-	info_append_uint64(db, "batch_sub_read_success", ns->n_batch_sub_read_success);
-	info_append_uint64(db, "batch_sub_read_error", ns->n_batch_sub_read_error);
-	info_append_uint64(db, "batch_sub_read_timeout", ns->n_batch_sub_read_timeout);
-	info_append_uint64(db, "batch_sub_read_not_found", ns->n_batch_sub_read_not_found);
+	info_append_uint64(db, "batch_sub_read_success", cf_shard_counter_get(&ns->n_batch_sub_read_success));
+	info_append_uint64(db, "batch_sub_read_error", cf_shard_counter_get(&ns->n_batch_sub_read_error));
+	info_append_uint64(db, "batch_sub_read_timeout", cf_shard_counter_get(&ns->n_batch_sub_read_timeout));
+	info_append_uint64(db, "batch_sub_read_not_found", cf_shard_counter_get(&ns->n_batch_sub_read_not_found));
+
+	info_append_uint64(db, "batch_sub_write_success", ns->n_batch_sub_write_success);
+	info_append_uint64(db, "batch_sub_write_error", ns->n_batch_sub_write_error);
+	info_append_uint64(db, "batch_sub_write_timeout", ns->n_batch_sub_write_timeout);
+
+	info_append_uint64(db, "batch_sub_delete_success", ns->n_batch_sub_delete_success);
+	info_append_uint64(db, "batch_sub_delete_error", ns->n_batch_sub_delete_error);
+	info_append_uint64(db, "batch_sub_delete_timeout", ns->n_batch_sub_delete_timeout);
+	info_append_uint64(db, "batch_sub_delete_not_found", ns->n_batch_sub_delete_not_found);
 
 	// Internal-UDF sub-transaction stats.
 
@@ -5072,6 +6840,7 @@ info_get_namespace_info(as_namespace *ns, cf_dyn_buf *db)
 	// Geospatial query stats:
 	info_append_uint64(db, "geo_region_query_reqs", ns->geo_region_query_count);
 	info_append_uint64(db, "geo_region_query_cells", ns->geo_region_query_cells);
+	info_append_uint64(db, "geo_region_query_cache_hits", ns->geo_region_query_cache_hits);
 	info_append_uint64(db, "geo_region_query_points", ns->geo_region_query_points);
 	info_append_uint64(db, "geo_region_query_falsepos", ns->geo_region_query_falsepos);
 
@@ -5085,6 +6854,7 @@ info_get_namespace_info(as_namespace *ns, cf_dyn_buf *db)
 	// Special non-error counters:
 
 	info_append_uint64(db, "deleted_last_bin", ns->n_deleted_last_bin);
+	info_append_uint64(db, "index_only_touches", ns->n_index_only_touches);
 
 	// LDT stats.
 
@@ -5508,7 +7278,8 @@ as_info_parse_params_to_sindex_imd(char* params, as_sindex_metadata *imd, cf_dyn
 		}
 	}
 
-	// Indexdata = binpath,keytype
+	// Indexdata = binpath,keytype - or for a composite index,
+	// binname,keytype,rangebinname,numeric
 	char indexdata_str[AS_SINDEXDATA_STR_SIZE];
 	int  indexdata_len = sizeof(indexdata_str);
 	if (as_info_parameter_get(params, STR_INDEXDATA, indexdata_str, &indexdata_len)) {
@@ -5519,7 +7290,7 @@ as_info_parse_params_to_sindex_imd(char* params, as_sindex_metadata *imd, cf_dyn
 	}
 	cf_vector *str_v = cf_vector_create(sizeof(void *), 10, VECTOR_FLAG_INITZERO);
 	cf_str_split(",", indexdata_str, str_v);
-	if (2 != (cf_vector_size(str_v))) {
+	if (2 != (cf_vector_size(str_v)) && 4 != (cf_vector_size(str_v))) {
 		cf_warning(AS_INFO, "%s : Failed. Number of bins more than 1 for index %s",
 				cmd, indexname_str);
 		INFO_COMMAND_SINDEX_FAILCODE(AS_PROTO_RESULT_FAIL_PARAMETER,
@@ -5570,6 +7341,43 @@ as_info_parse_params_to_sindex_imd(char* params, as_sindex_metadata *imd, cf_dyn
 		return AS_SINDEX_ERR_PARAM;
 	}
 
+	// Composite index - keyed on the digest of the prefix bin's value and the
+	// range bin's value, so it takes an equality on one and a range on the other.
+	char composite_path_str[AS_SINDEXDATA_STR_SIZE];
+	if (4 == cf_vector_size(str_v)) {
+		char *range_bname = NULL;
+		char *range_type_str = NULL;
+		cf_vector_get(str_v, 2, &range_bname);
+		cf_vector_get(str_v, 3, &range_type_str);
+
+		if (imd->path_length != 0 || imd->itype != AS_SINDEX_ITYPE_DEFAULT ||
+				(ktype != AS_SINDEX_KTYPE_LONG && ktype != AS_SINDEX_KTYPE_DIGEST)) {
+			cf_warning(AS_INFO, "%s : Failed. Composite index %s prefix must be a numeric or "
+					"string bin", cmd, indexname_str);
+			INFO_COMMAND_SINDEX_FAILCODE(AS_PROTO_RESULT_FAIL_PARAMETER,
+					"Composite index prefix must be a numeric or string bin");
+			cf_vector_destroy(str_v);
+			return AS_SINDEX_ERR_PARAM;
+		}
+		if (!range_bname || !range_type_str || !*range_bname ||
+				strlen(range_bname) >= AS_ID_BIN_SZ || !strcmp(range_bname, imd->bname) ||
+				as_sindex_ktype_from_string(range_type_str) != AS_SINDEX_KTYPE_LONG) {
+			cf_warning(AS_INFO, "%s : Failed. Composite index %s range must be another "
+					"numeric bin", cmd, indexname_str);
+			INFO_COMMAND_SINDEX_FAILCODE(AS_PROTO_RESULT_FAIL_PARAMETER,
+					"Composite index range must be another numeric bin");
+			cf_vector_destroy(str_v);
+			return AS_SINDEX_ERR_PARAM;
+		}
+
+		imd->range_bname  = cf_strdup(range_bname);
+		imd->prefix_btype = ktype;
+		imd->btype        = AS_SINDEX_KTYPE_DIGEST;
+
+		snprintf(composite_path_str, sizeof(composite_path_str), "%s,%s", path_str, range_bname);
+		path_str = composite_path_str;
+	}
+
 	cf_vector_destroy(str_v);
 
 	if (is_create) {
@@ -5914,6 +7722,31 @@ END:
 	return(0);
 }
 
+// sindex-value-histogram:ns=test_D;indexname=indname
+int info_command_sindex_value_histogram(char *name, char *params, cf_dyn_buf *db)
+{
+	as_namespace * ns = NULL;
+	char * iname = NULL;
+	if (as_info_parse_ns_iname(params, &ns, &iname, db, "SINDEX VALUE HISTOGRAM")) {
+		return 0;
+	}
+
+	int resp = as_sindex_value_hist_str(ns, iname, db);
+	if (resp) {
+		cf_warning(AS_INFO, "SINDEX VALUE HISTOGRAM : for index %s - ns %s failed with error %d",
+			iname, ns->name, resp);
+		INFO_COMMAND_SINDEX_FAILCODE(
+				as_sindex_err_to_clienterr(resp, __FILE__, __LINE__),
+				as_sindex_err_str(resp));
+	}
+	else {
+		cf_dyn_buf_chomp(db);
+	}
+
+	cf_free(iname);
+	return(0);
+}
+
 int info_command_sindex_list(char *name, char *params, cf_dyn_buf *db) {
 	bool listall = true;
 	char ns_str[128];
@@ -5983,6 +7816,10 @@ as_info_init()
 	// create worker threads
 	g_info_work_q = cf_queue_create(sizeof(as_info_transaction), true);
 
+	if (g_config.n_info_heavy_threads != 0) {
+		g_info_heavy_work_q = cf_queue_create(sizeof(as_info_transaction), true);
+	}
+
 	char vstr[64];
 	sprintf(vstr, "%s build %s", aerospike_build_type, aerospike_build_id);
 
@@ -6005,7 +7842,7 @@ as_info_init()
 	as_info_set("name", istr, false);                    // Alias to 'node'.
 	// Returns list of features supported by this server
 	static char features[1024];
-	strcat(features, "cdt-list;cdt-map;pipelining;geo;float;batch-index;replicas-all;replicas-master;replicas-prole;udf");
+	strcat(features, "cdt-list;cdt-map;pipelining;geo;float;batch-index;replicas-all;replicas-master;replicas-prole;replicas-rack;udf");
 	strcat(features, aerospike_build_features);
 	as_info_set("features", features, true);
 	hb_mode_enum hb_mode;
@@ -6013,15 +7850,16 @@ as_info_init()
 	as_info_set( hb_mode == AS_HB_MODE_MESH ? "mesh" :  "mcast", istr, false);
 
 	// All commands accepted by asinfo/telnet
-	as_info_set("help", "alloc-info;asm;bins;build;build_os;build_time;config-get;config-set;"
-				"df;digests;dump-fabric;dump-hb;dump-migrates;dump-msgs;dump-paxos;dump-rw;"
+	as_info_set("help", "alloc-info;alloc-prof;asm;bins;build;build_os;build_time;config-get;config-set;"
+				"df;digests;dim-compact;dim-slabs;dump-fabric;dump-hb;dump-migrates;dump-msgs;dump-paxos;dump-rw;"
 				"dump-smd;dump-wb;dump-wb-summary;get-config;get-sl;hist-dump;"
 				"hist-track-start;hist-track-stop;jem-stats;jobs;latency;log;log-set;"
 				"log-message;logs;mcast;mem;mesh;mstats;mtrace;name;namespace;namespaces;node;"
+				"partition-compare;partition-digest;"
 				"service;services;services-alumni;services-alumni-reset;set-config;"
 				"set-log;sets;set-sl;show-devices;sindex;sindex-create;sindex-delete;"
-				"sindex-histogram;sindex-repair;"
-				"smd;statistics;status;tip;tip-clear;version;"
+				"sindex-histogram;sindex-repair;sindex-value-histogram;"
+				"smd;statistics;status;storage-replay;storage-trace;tip;tip-clear;version;"
 				"xdr-min-lastshipinfo",
 				false);
 	/*
@@ -6035,14 +7873,17 @@ as_info_init()
 	as_info_set_dynamic("bins", info_get_bins, false);                                // Returns bin usage information and used bin names.
 	as_info_set_dynamic("cluster-generation", info_get_cluster_generation, true);     // Returns cluster generation.
 	as_info_set_dynamic("get-config", info_get_config, false);                        // Returns running config for specified context.
+	as_info_set_dynamic("info-command-stats", info_get_command_stats, false);         // Returns execution time stats of info names.
 	as_info_set_dynamic("logs", info_get_logs, false);                                // Returns a list of log file locations in use by this server.
 	as_info_set_dynamic("namespaces", info_get_namespaces, false);                    // Returns a list of namespace defined on this server.
 	as_info_set_dynamic("objects", info_get_objects, false);                          // Returns the number of objects stored on this server.
 	as_info_set_dynamic("partition-generation", info_get_partition_generation, true); // Returns the current partition generation.
 	as_info_set_dynamic("partition-info", info_get_partition_info, false);            // Returns partition ownership information.
+	as_info_set_dynamic("racks", info_get_racks, false);                              // Returns the rack-id of each node in the cluster.
 	as_info_set_dynamic("replicas-all", info_get_replicas_all, false);                // Base 64 encoded binary representation of partitions this node is replica for.
 	as_info_set_dynamic("replicas-master", info_get_replicas_master, false);          // Base 64 encoded binary representation of partitions this node is master (replica) for.
 	as_info_set_dynamic("replicas-prole", info_get_replicas_prole, false);            // Base 64 encoded binary representation of partitions this node is prole (replica) for.
+	as_info_set_dynamic("replicas-rack", info_get_replicas_rack, false);              // Same as replicas-all, with this node's rack-id.
 	as_info_set_dynamic("replicas-read", info_get_replicas_read, false);              //
 	as_info_set_dynamic("replicas-write", info_get_replicas_write, false);            //
 	as_info_set_dynamic("service", info_get_service, false);                          // IP address and server port for this node, expected to be a single.
@@ -6068,10 +7909,13 @@ as_info_init()
 
 	// Define commands
 	as_info_set_command("alloc-info", info_command_alloc_info, PERM_NONE);                    // Lookup a memory allocation by program location.
+	as_info_set_command("alloc-prof", info_command_alloc_prof, PERM_NONE);                    // Sampled allocation profile by subsystem.
 	as_info_set_command("asm", info_command_asm, PERM_SERVICE_CTRL);                          // Control the operation of the ASMalloc library.
 	as_info_set_command("config-get", info_command_config_get, PERM_NONE);                    // Returns running config for specified context.
 	as_info_set_command("config-set", info_command_config_set, PERM_SET_CONFIG);              // Set a configuration parameter at run time, configuration parameter must be dynamic.
 	as_info_set_command("df", info_command_double_free, PERM_SERVICE_CTRL);                   // Do an intentional double "free()" to test Double "free()" Detection.
+	as_info_set_command("dim-compact", info_command_dim_compact, PERM_SERVICE_CTRL);          // Compact a data-in-memory namespace's heap, or report compaction.
+	as_info_set_command("dim-slabs", info_command_dim_slabs, PERM_SERVICE_CTRL);              // Report bin space slab pools, or compact them.
 	as_info_set_command("dump-fabric", info_command_dump_fabric, PERM_LOGGING_CTRL);          // Print debug information about fabric to the log file.
 	as_info_set_command("dump-hb", info_command_dump_hb, PERM_LOGGING_CTRL);                  // Print debug information about heartbeat state to the log file.
 	as_info_set_command("dump-hlc", info_command_dump_hlc, PERM_LOGGING_CTRL);                // Print debug information about Hybrid Logical Clock to the log file.
@@ -6086,22 +7930,32 @@ as_info_init()
 	as_info_set_command("get-config", info_command_config_get, PERM_NONE);                    // Returns running config for all or a particular context.
 	as_info_set_command("get-sl", info_command_get_sl, PERM_NONE);                            // Get the Paxos succession list.
 	as_info_set_command("hist-dump", info_command_hist_dump, PERM_NONE);                      // Returns a histogram snapshot for a particular histogram.
+	as_info_set_command("hot-keys", info_command_hot_keys, PERM_NONE);                        // Returns a namespace's hottest sampled keys, with rates.
 	as_info_set_command("hist-track-start", info_command_hist_track, PERM_SERVICE_CTRL);      // Start or Restart histogram tracking.
 	as_info_set_command("hist-track-stop", info_command_hist_track, PERM_SERVICE_CTRL);       // Stop histogram tracking.
 	as_info_set_command("jem-stats", info_command_jem_stats, PERM_LOGGING_CTRL);              // Print JEMalloc statistics to the log file.
 	as_info_set_command("latency", info_command_hist_track, PERM_NONE);                       // Returns latency and throughput information.
+	as_info_set_command("latency-percentiles", info_command_hist_track, PERM_NONE);           // Returns latency percentiles and throughput information.
 	as_info_set_command("log-message", info_command_log_message, PERM_NONE);                  // Log a message.
 	as_info_set_command("log-set", info_command_log_set, PERM_LOGGING_CTRL);                  // Set values in the log system.
 	as_info_set_command("mem", info_command_mem, PERM_NONE);                                  // Report on memory usage.
 	as_info_set_command("mstats", info_command_mstats, PERM_LOGGING_CTRL);                    // Dump GLibC-level memory stats.
 	as_info_set_command("mtrace", info_command_mtrace, PERM_SERVICE_CTRL);                    // Control GLibC-level memory tracing.
+	as_info_set_command("partition-compare", info_command_partition_digest, PERM_NONE);       // Compare a partition's hash tree with another node's.
+	as_info_set_command("partition-digest", info_command_partition_digest, PERM_NONE);        // Returns a partition's hash tree, to the given depth.
 	as_info_set_command("set-config", info_command_config_set, PERM_SET_CONFIG);              // Set config values.
 	as_info_set_command("set-log", info_command_log_set, PERM_LOGGING_CTRL);                  // Set values in the log system.
 	as_info_set_command("show-devices", info_command_show_devices, PERM_LOGGING_CTRL);        // Print snapshot of wblocks to the log file.
+	as_info_set_command("slow-transactions", info_command_slow_transactions, PERM_NONE);      // Returns recent slow transactions.
 	as_info_set_command("smd", info_command_smd_cmd, PERM_SERVICE_CTRL);                      // Manipulate the System Metadata.
+	as_info_set_command("stats-binary", info_command_stats_binary, PERM_NONE);                // Returns a base64 binary stats snapshot, or its delta.
+	as_info_set_dynamic("stats-schema", info_get_stats_schema, false);                        // Returns the ids, types and names for stats-binary.
+	as_info_set_command("storage-replay", info_command_storage_replay, PERM_SERVICE_CTRL);    // Replay a device I/O trace against an unused device.
+	as_info_set_command("storage-trace", info_command_storage_trace, PERM_SERVICE_CTRL);      // Capture a namespace's device I/O to a trace file.
 	as_info_set_command("throughput", info_command_hist_track, PERM_NONE);                    // Returns throughput info.
 	as_info_set_command("tip", info_command_tip, PERM_SERVICE_CTRL);                          // Add external IP to mesh-mode heartbeats.
 	as_info_set_command("tip-clear", info_command_tip_clear, PERM_SERVICE_CTRL);              // Clear tip list from mesh-mode heartbeats.
+	as_info_set_command("truncate", info_command_truncate, PERM_SET_CONFIG);                  // Truncate a namespace or set via a last-update-time cutoff.
 	as_info_set_command("xdr-command", as_info_command_xdr, PERM_SERVICE_CTRL);               // Command to XDR module.
 
 	// SINDEX
@@ -6112,6 +7966,7 @@ as_info_init()
 
 	// UDF
 	as_info_set_dynamic("udf-list", udf_cask_info_list, false);
+	as_info_set_dynamic("udf-memory", udf_memtracker_info, false);
 	as_info_set_command("udf-put", udf_cask_info_put, PERM_UDF_MANAGE);
 	as_info_set_command("udf-get", udf_cask_info_get, PERM_NONE);
 	as_info_set_command("udf-remove", udf_cask_info_remove, PERM_UDF_MANAGE);
@@ -6122,6 +7977,7 @@ as_info_init()
 
 	// Undocumented Secondary Index Command
 	as_info_set_command("sindex-histogram", info_command_sindex_histogram, PERM_SERVICE_CTRL);
+	as_info_set_command("sindex-value-histogram", info_command_sindex_value_histogram, PERM_NONE);
 	as_info_set_command("sindex-repair", info_command_sindex_repair, PERM_SERVICE_CTRL);
 
 	as_info_set_dynamic("query-list", as_query_list, false);
@@ -6135,6 +7991,14 @@ as_info_init()
 
 	as_xdr_info_init();
 
+	for (uint32_t i = 0; i < N_HEAVY_INFO_NAMES; i++) {
+		info_set_heavy(HEAVY_INFO_NAMES[i].name, HEAVY_INFO_NAMES[i].cacheable);
+	}
+
+	for (uint32_t i = 0; i < N_PARTITION_MAP_INFO_NAMES; i++) {
+		info_set_partition_map_cached(PARTITION_MAP_INFO_NAMES[i]);
+	}
+
 	// Spin up the Info threads *after* all static and dynamic Info commands have been added
 	// so we can guarantee that the static and dynamic lists will never again be changed.
 	pthread_attr_t thr_attr;
@@ -6143,7 +8007,14 @@ as_info_init()
 
 	for (int i = 0; i < g_config.n_info_threads; i++) {
 		pthread_t tid;
-		if (0 != pthread_create(&tid, &thr_attr, thr_info_fn, (void *) 0 )) {
+		if (0 != pthread_create(&tid, &thr_attr, thr_info_fn, (void *)g_info_work_q)) {
+			cf_crash(AS_INFO, "pthread_create: %s", cf_strerror(errno));
+		}
+	}
+
+	for (int i = 0; i < g_config.n_info_heavy_threads; i++) {
+		pthread_t tid;
+		if (0 != pthread_create(&tid, &thr_attr, thr_info_fn, (void *)g_info_heavy_work_q)) {
 			cf_crash(AS_INFO, "pthread_create: %s", cf_strerror(errno));
 		}
 	}
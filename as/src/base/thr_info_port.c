@@ -210,6 +210,7 @@ thr_info_port_fn(void *arg)
 	info_socket.type = SOCK_STREAM;
 	info_socket.port = g_config.info_port;
 	info_socket.reuse_addr = g_config.socket_reuse_addr ? true : false;
+	info_socket.reuse_port = false;
 	// Listen happens here.
 	if (0 != cf_socket_init_server(&info_socket)) {
 		cf_crash(AS_AS, "couldn't initialize service socket");
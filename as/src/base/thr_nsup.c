@@ -42,28 +42,26 @@
 #include "citrusleaf/cf_digest.h"
 #include "citrusleaf/cf_queue.h"
 
+#include "arenax.h"
 #include "fault.h"
 #include "linear_hist.h"
 #include "vmapx.h"
 
+#include "base/as_stap.h"
 #include "base/cfg.h"
 #include "base/datamodel.h"
+#include "base/expire_index.h"
+#include "base/incr_hist.h"
 #include "base/index.h"
 #include "base/ldt.h"
 #include "base/proto.h"
+#include "base/set_index.h"
 #include "base/thr_sindex.h"
 #include "base/thr_tsvc.h"
 #include "base/transaction.h"
 #include "storage/storage.h"
 
 
-//==========================================================
-// Globals.
-//
-
-pthread_t g_nsup_thread;
-
-
 //==========================================================
 // Eviction during cold-start.
 //
@@ -76,62 +74,123 @@ pthread_t g_nsup_thread;
 #define COLD_START_HIST_MIN_BUCKETS 100000 // histogram memory is transient
 
 
+#define COLD_START_COUNT_BUCKETS 1000000 // 4M of transient memory
+
 //------------------------------------------------
-// Reduce callback prepares for cold-start eviction.
-// - builds cold-start eviction histogram
+// Void-time counts of evictable records, kept as
+// records are added during cold-start, so there's
+// no walk to build the eviction histogram.
 //
-typedef struct cold_start_evict_prep_info_s {
-	as_namespace*		ns;
-	linear_hist*		hist;
-	bool*				sets_not_evicting;
-} cold_start_evict_prep_info;
+typedef struct cold_start_counts_s {
+	uint32_t		start;
+	uint32_t		bucket_width;
+	cf_atomic32		counts[COLD_START_COUNT_BUCKETS];
+} cold_start_counts;
 
-static void
-cold_start_evict_prep_reduce_cb(as_index_ref* r_ref, void* udata)
+static bool
+cold_start_set_evictable(as_namespace* ns, uint16_t set_id)
 {
-	as_index* r = r_ref->r;
-	cold_start_evict_prep_info* p_info = (cold_start_evict_prep_info*)udata;
-	uint32_t set_id = as_index_get_set_id(r);
-	uint32_t void_time = r->void_time;
+	as_set* p_set;
 
-	if (void_time != 0 &&
-			! p_info->sets_not_evicting[set_id]) {
-		linear_hist_insert_data_point(p_info->hist, void_time);
+	if (set_id == INVALID_SET_ID ||
+			cf_vmapx_get_by_index(ns->p_sets_vmap, set_id - 1, (void**)&p_set) != CF_VMAPX_OK) {
+		return true;
 	}
 
-	as_record_done(r_ref, p_info->ns);
+	return ! IS_SET_EVICTION_DISABLED(p_set);
+}
+
+static cf_atomic32*
+cold_start_count(as_namespace* ns, uint32_t void_time, uint16_t set_id)
+{
+	cold_start_counts* csc = ns->cold_start_counts;
+
+	if (! csc || void_time == 0 || ! cold_start_set_evictable(ns, set_id)) {
+		return NULL;
+	}
+
+	uint32_t bucket = void_time > csc->start ?
+			(void_time - csc->start) / csc->bucket_width : 0;
+
+	if (bucket >= COLD_START_COUNT_BUCKETS) {
+		bucket = COLD_START_COUNT_BUCKETS - 1;
+	}
+
+	return &csc->counts[bucket];
 }
 
 //------------------------------------------------
-// Threads prepare for cold-start eviction.
+// Cold-start void-time counts, called by drv_ssd.c.
 //
-typedef struct evict_prep_thread_info_s {
-	as_namespace*		ns;
-	cf_atomic32*		p_pid;
-	linear_hist*		hist;
-	bool*				sets_not_evicting;
-} evict_prep_thread_info;
+void
+as_cold_start_counts_create(as_namespace* ns)
+{
+	cold_start_counts* csc = cf_calloc(1, sizeof(cold_start_counts));
 
-void*
-run_cold_start_evict_prep(void* udata)
+	cf_assert(csc, AS_NSUP, CF_CRITICAL, "calloc failed: %s", cf_strerror(errno));
+
+	csc->start = as_record_void_time_get();
+	csc->bucket_width = (uint32_t)((ns->max_ttl + COLD_START_COUNT_BUCKETS - 1) / COLD_START_COUNT_BUCKETS);
+
+	if (csc->bucket_width == 0) {
+		csc->bucket_width = 1;
+	}
+
+	ns->cold_start_counts = csc;
+}
+
+void
+as_cold_start_counts_destroy(as_namespace* ns)
 {
-	evict_prep_thread_info* p_info = (evict_prep_thread_info*)udata;
-	as_namespace *ns = p_info->ns;
+	cf_free(ns->cold_start_counts);
+	ns->cold_start_counts = NULL;
+}
 
-	cold_start_evict_prep_info cb_info;
+// Call (under the record lock) when a record is counted in.
+void
+as_cold_start_counts_add(as_namespace* ns, uint32_t void_time, uint16_t set_id)
+{
+	cf_atomic32* count = cold_start_count(ns, void_time, set_id);
 
-	cb_info.ns = ns;
-	cb_info.hist = p_info->hist;
-	cb_info.sets_not_evicting = p_info->sets_not_evicting;
+	if (count) {
+		cf_atomic32_incr(count);
+	}
+}
 
-	int pid;
+// Call (under the record lock) when a counted record is replaced or deleted.
+void
+as_cold_start_counts_remove(as_namespace* ns, uint32_t void_time, uint16_t set_id)
+{
+	cf_atomic32* count = cold_start_count(ns, void_time, set_id);
 
-	while ((pid = (int)cf_atomic32_incr(p_info->p_pid)) < AS_PARTITIONS) {
-		// Don't bother with partition reservations - it's startup.
-		as_index_reduce(ns->partitions[pid].vp, cold_start_evict_prep_reduce_cb, &cb_info);
+	if (count) {
+		cf_atomic32_decr(count);
 	}
+}
 
-	return NULL;
+//------------------------------------------------
+// Build the cold-start eviction histogram from the
+// void-time counts. Bucket low edges, as for the
+// threshold, so we never evict beyond it.
+//
+static void
+cold_start_counts_to_hist(as_namespace* ns, linear_hist* hist)
+{
+	cold_start_counts* csc = ns->cold_start_counts;
+
+	for (uint32_t i = 0; i < COLD_START_COUNT_BUCKETS; i++) {
+		int32_t count = (int32_t)cf_atomic32_get(csc->counts[i]);
+
+		if (count > 0) {
+			uint64_t void_time = csc->start + (uint64_t)i * csc->bucket_width;
+
+			if (void_time > UINT32_MAX) {
+				break;
+			}
+
+			linear_hist_insert_data_points(hist, (uint32_t)void_time, (uint32_t)count);
+		}
+	}
 }
 
 //------------------------------------------------
@@ -159,6 +218,7 @@ cold_start_evict_reduce_cb(as_index_ref* r_ref, void* udata)
 	if (void_time != 0) {
 		if (! p_info->sets_not_evicting[set_id] &&
 				void_time < ns->cold_start_threshold_void_time) {
+			as_cold_start_counts_remove(ns, void_time, set_id);
 			as_index_delete(p_partition->vp, &r->key);
 			p_info->num_evicted++;
 		}
@@ -344,40 +404,15 @@ as_cold_start_evict_if_needed(as_namespace* ns)
 		}
 	}
 
-	// Split these tasks across multiple threads.
-	pthread_t evict_threads[NUM_EVICT_THREADS];
-
-	// Reduce all partitions to build the eviction histogram.
-	evict_prep_thread_info prep_thread_infos[NUM_EVICT_THREADS];
-	cf_atomic32 pid = -1;
-
-	for (int n = 0; n < NUM_EVICT_THREADS; n++) {
-		prep_thread_infos[n].ns = ns;
-		prep_thread_infos[n].p_pid = &pid;
-		prep_thread_infos[n].hist = linear_hist_create("thread-hist", now, ttl_range, n_buckets);
-		prep_thread_infos[n].sets_not_evicting = sets_not_evicting;
-
-		if (pthread_create(&evict_threads[n], NULL, run_cold_start_evict_prep, (void*)&prep_thread_infos[n]) != 0) {
-			cf_crash(AS_NSUP, "{%s} failed to create evict-prep thread %d", ns->name, n);
-		}
-	}
-
-	for (int n = 0; n < NUM_EVICT_THREADS; n++) {
-		pthread_join(evict_threads[n], NULL);
-
-		if (n == 0) {
-			continue;
-		}
+	// Void-times were counted as records were added - no walk needed.
+	linear_hist* hist = linear_hist_create("cold-start-hist", now, ttl_range, n_buckets);
 
-		linear_hist_merge(prep_thread_infos[0].hist, prep_thread_infos[n].hist);
-		linear_hist_destroy(prep_thread_infos[n].hist);
-	}
-	// Now we're single-threaded again.
+	cold_start_counts_to_hist(ns, hist);
 
 	// Calculate the eviction threshold.
-	uint32_t n_evictable = set_cold_start_threshold(ns, prep_thread_infos[0].hist);
+	uint32_t n_evictable = set_cold_start_threshold(ns, hist);
 
-	linear_hist_destroy(prep_thread_infos[0].hist);
+	linear_hist_destroy(hist);
 
 	if (n_evictable == 0) {
 		cf_warning(AS_NSUP, "{%s} hwm breached but no records to evict", ns->name);
@@ -387,7 +422,9 @@ as_cold_start_evict_if_needed(as_namespace* ns)
 
 	cf_info(AS_NSUP, "{%s} cold-start found %u records eligible for eviction, evict ttl %u", ns->name, n_evictable, cf_atomic32_get(ns->cold_start_threshold_void_time) - now);
 
-	// Reduce all partitions to evict based on the thresholds.
+	// Reduce all partitions to evict based on the thresholds, split across
+	// multiple threads.
+	pthread_t evict_threads[NUM_EVICT_THREADS];
 	evict_thread_info thread_info;
 
 	thread_info.ns = ns;
@@ -418,169 +455,261 @@ as_cold_start_evict_if_needed(as_namespace* ns)
 //==========================================================
 
 //==========================================================
-// Temporary dangling prole garbage collection.
+// Temporary dangling prole garbage collection, and
+// dangling prole (or other) sets deletion.
+//
+// Non-master partitions are swept a slice at a time from the namespace
+// supervisor's 1-second loop - at most non-master-gc-rps records per second,
+// checkpointed by partition and digest - so cleanup after migrations doesn't
+// come as a burst of deletes.
 //
 
-typedef struct garbage_collect_info_s {
+typedef struct non_master_gc_s {
+	int			pid;				// partition being swept, -1 for none
+	bool		has_keyd;			// keyd is the last digest swept in pid
+	cf_digest	keyd;
+	int			prole_pid;			// last prole partition garbage collected
+	bool		prole_pending;		// nsup cycle asked for a prole partition
+	bool		sets_delete;		// sweeping all partitions, deleting sets
+	bool		sets_deleting[AS_SET_MAX_COUNT + 1];
+	uint32_t	num_deleted;		// so far in pid
+} non_master_gc;
+
+typedef struct non_master_gc_info_s {
 	as_namespace*	ns;
 	as_index_tree*	p_tree;
 	uint32_t		now;
+	bool*			sets_deleting;	// null when garbage collecting proles
+	cf_digest		last_keyd;
 	uint32_t		num_deleted;
-} garbage_collect_info;
+} non_master_gc_info;
 
 static void
-garbage_collect_reduce_cb(as_index_ref* r_ref, void* udata)
+non_master_gc_reduce_cb(as_index_ref* r_ref, void* udata)
 {
-	garbage_collect_info* p_info = (garbage_collect_info*)udata;
-	uint32_t void_time = r_ref->r->void_time;
+	non_master_gc_info* p_info = (non_master_gc_info*)udata;
+	as_index* r = r_ref->r;
 
-	// If we're past void-time plus safety margin, delete the record.
-	if (void_time != 0 && p_info->now > void_time + g_config.prole_extra_ttl) {
-		as_index_delete(p_info->p_tree, &r_ref->r->key);
-		p_info->num_deleted++;
+	p_info->last_keyd = r->key;
+
+	if (p_info->sets_deleting) {
+		if (p_info->sets_deleting[as_index_get_set_id(r)]) {
+			as_index_delete(p_info->p_tree, &r->key);
+			p_info->num_deleted++;
+		}
+	}
+	else {
+		uint32_t void_time = r->void_time;
+
+		// If we're past void-time plus safety margin, delete the record.
+		if (void_time != 0 &&
+				p_info->now > void_time + g_config.prole_extra_ttl) {
+			as_index_delete(p_info->p_tree, &r->key);
+			p_info->num_deleted++;
+		}
 	}
 
 	as_record_done(r_ref, p_info->ns);
 }
 
-static int
-garbage_collect_next_prole_partition(as_namespace* ns, int pid)
+static void
+non_master_gc_init(as_namespace* ns, non_master_gc* gc)
 {
-	as_partition_reservation rsv;
-	AS_PARTITION_RESERVATION_INIT(rsv);
+	memset(gc, 0, sizeof(non_master_gc));
+	gc->pid = -1;
+	gc->prole_pid = -1;
 
-	// Look for the next prole partition past pid, but loop only once over all
-	// partitions.
-	for (int n = 0; n < AS_PARTITIONS; n++) {
-		// Increment pid and wrap if necessary.
-		if (++pid == AS_PARTITIONS) {
-			pid = 0;
-		}
+	cf_atomic32_set(&ns->non_master_gc_pid, (uint32_t)-1);
+}
 
-		// Note - may want a new method to get these under a single partition
-		// lock, but for now just do the two separate reserve calls.
-		if (0 == as_partition_reserve_write(ns, pid, &rsv, 0, 0)) {
-			// This is a master partition - continue.
-			as_partition_release(&rsv);
-			AS_PARTITION_RESERVATION_INIT(rsv);
-		}
-		else if (0 == as_partition_reserve_read(ns, pid, &rsv, 0, 0)) {
-			// This is a prole partition - garbage collect and break.
-			garbage_collect_info cb_info;
+// Called per nsup cycle - one more prole partition to garbage collect, and
+// maybe sets to delete. A new sets deletion restarts the sweep.
+static void
+non_master_gc_request(as_namespace* ns, non_master_gc* gc,
+		const bool* sets_deleting)
+{
+	if (g_config.prole_extra_ttl != 0) {
+		gc->prole_pending = true;
+	}
+
+	if (! sets_deleting) {
+		return;
+	}
+
+	cf_info(AS_NSUP, "namespace %s: deleting non-master records in sets being emptied",
+			ns->name);
 
-			cb_info.ns = ns;
-			cb_info.p_tree = rsv.p->vp;
-			cb_info.now = as_record_void_time_get();
-			cb_info.num_deleted = 0;
+	if (! gc->sets_delete) {
+		memset(gc->sets_deleting, 0, sizeof(gc->sets_deleting));
+	}
+
+	for (uint32_t set_id = 0; set_id <= AS_SET_MAX_COUNT; set_id++) {
+		gc->sets_deleting[set_id] |= sets_deleting[set_id];
+	}
 
-			// Reduce the partition, deleting long-expired records.
-			as_index_reduce(rsv.p->vp, garbage_collect_reduce_cb, &cb_info);
+	// Abandon a partially swept prole partition - it'll come round again.
+	gc->sets_delete = true;
+	gc->pid = 0;
+	gc->has_keyd = false;
+	gc->num_deleted = 0;
 
-			if (cb_info.num_deleted != 0) {
-				cf_info(AS_NSUP, "namespace %s pid %d: %u expired proles",
-						ns->name, pid, cb_info.num_deleted);
+	cf_atomic32_set(&ns->non_master_gc_sets_delete, 1);
+}
+
+// Reserve the next partition to sweep. Returns false if there's nothing to
+// sweep.
+static bool
+non_master_gc_reserve(as_namespace* ns, non_master_gc* gc,
+		as_partition_reservation* rsv)
+{
+	while (true) {
+		AS_PARTITION_RESERVATION_INIT((*rsv));
+
+		if (gc->sets_delete) {
+			if (gc->pid >= AS_PARTITIONS) {
+				gc->sets_delete = false;
+				gc->pid = -1;
+				cf_atomic32_set(&ns->non_master_gc_sets_delete, 0);
+				continue;
 			}
 
-			as_partition_release(&rsv);
+			if (0 == as_partition_reserve_write(ns, gc->pid, rsv, 0, 0)) {
+				// This is a master partition - skip it.
+				as_partition_release(rsv);
+				gc->pid++;
+				gc->has_keyd = false;
+				continue;
+			}
 
-			// Do only one partition per nsup loop.
-			break;
+			if (0 != as_partition_reserve_read(ns, gc->pid, rsv, 0, 0)) {
+				// We don't own this partition - check anyway.
+				AS_PARTITION_RESERVATION_INIT((*rsv));
+				as_partition_reserve_migrate(ns, gc->pid, rsv, 0);
+			}
+
+			return true;
 		}
-	}
 
-	return pid;
-}
+		if (gc->pid == -1) {
+			if (! gc->prole_pending) {
+				return false;
+			}
 
-//
-// END - Temporary dangling prole garbage collection.
-//==========================================================
+			gc->prole_pending = false;
 
-//==========================================================
-// Temporary dangling prole (or other) sets deletion.
-//
+			// Look for the next prole partition past the last, but loop only
+			// once over all partitions.
+			for (int n = 0; n < AS_PARTITIONS; n++) {
+				if (++gc->prole_pid == AS_PARTITIONS) {
+					gc->prole_pid = 0;
+				}
 
-typedef struct non_master_sets_delete_info_s {
-	as_namespace*	ns;
-	bool*			sets_deleting;
-	as_index_tree*	p_tree;
-	uint32_t		num_deleted;
-} non_master_sets_delete_info;
+				if (0 == as_partition_reserve_write(ns, gc->prole_pid, rsv, 0, 0)) {
+					as_partition_release(rsv);
+					AS_PARTITION_RESERVATION_INIT((*rsv));
+				}
+				else if (0 == as_partition_reserve_read(ns, gc->prole_pid, rsv, 0, 0)) {
+					gc->pid = gc->prole_pid;
+					gc->has_keyd = false;
+					gc->num_deleted = 0;
+					return true;
+				}
+			}
 
-static void
-non_master_sets_delete_reduce_cb(as_index_ref* r_ref, void* udata)
-{
-	non_master_sets_delete_info* p_info = (non_master_sets_delete_info*)udata;
-	uint32_t set_id = as_index_get_set_id(r_ref->r);
+			return false;
+		}
 
-	if (p_info->sets_deleting[set_id]) {
-		as_index_delete(p_info->p_tree, &r_ref->r->key);
-		p_info->num_deleted++;
-	}
+		// Resuming a prole partition - give it up if it's no longer a prole.
+		if (0 == as_partition_reserve_write(ns, gc->pid, rsv, 0, 0)) {
+			as_partition_release(rsv);
+			gc->pid = -1;
+			return false;
+		}
 
-	as_record_done(r_ref, p_info->ns);
+		if (0 != as_partition_reserve_read(ns, gc->pid, rsv, 0, 0)) {
+			gc->pid = -1;
+			return false;
+		}
+
+		return true;
+	}
 }
 
+// Called every second - sweep up to non-master-gc-rps records.
 static void
-non_master_sets_delete(as_namespace* ns, bool* sets_deleting)
+non_master_gc_step(as_namespace* ns, non_master_gc* gc)
 {
-	cf_info(AS_NSUP, "namespace %s: deleting non-master records in sets being emptied",
-			ns->name);
-
+	uint32_t budget = g_config.non_master_gc_rps != 0 ?
+			g_config.non_master_gc_rps : UINT32_MAX;
 	as_partition_reservation rsv;
 
-	// Look at all non-master partitions.
-	for (int n = 0; n < AS_PARTITIONS; n++) {
-		AS_PARTITION_RESERVATION_INIT(rsv);
+	while (budget != 0 && non_master_gc_reserve(ns, gc, &rsv)) {
+		cf_atomic32_set(&ns->non_master_gc_pid, (uint32_t)gc->pid);
 
-		if (0 == as_partition_reserve_write(ns, n, &rsv, 0, 0)) {
-			// This is a master partition - continue.
-			as_partition_release(&rsv);
-		}
-		else if (0 == as_partition_reserve_read(ns, n, &rsv, 0, 0)) {
-			// This is a prole partition - check it.
-			non_master_sets_delete_info cb_info;
+		non_master_gc_info cb_info;
 
-			cb_info.ns = ns;
-			cb_info.sets_deleting = sets_deleting;
-			cb_info.p_tree = rsv.p->vp;
-			cb_info.num_deleted = 0;
+		cb_info.ns = ns;
+		cb_info.p_tree = rsv.p->vp;
+		cb_info.now = as_record_void_time_get();
+		cb_info.sets_deleting = gc->sets_delete ? gc->sets_deleting : NULL;
+		cb_info.num_deleted = 0;
 
-			// Reduce the partition, checking and deleting records.
-			as_index_reduce(rsv.p->vp, non_master_sets_delete_reduce_cb, &cb_info);
+		uint32_t n_reduced = as_index_reduce_from(rsv.p->vp,
+				gc->has_keyd ? &gc->keyd : NULL, budget,
+				non_master_gc_reduce_cb, &cb_info);
 
-			if (cb_info.num_deleted != 0) {
-				cf_info(AS_NSUP, "namespace %s pid %d: %u deleted proles",
-						ns->name, n, cb_info.num_deleted);
-			}
+		budget -= n_reduced;
+		gc->num_deleted += cb_info.num_deleted;
 
-			as_partition_release(&rsv);
+		if (n_reduced != 0) {
+			gc->keyd = cb_info.last_keyd;
+			gc->has_keyd = true;
 		}
-		else {
-			// We don't own this partition - check anyway.
-			as_partition_reserve_migrate(ns, n, &rsv, 0);
 
-			non_master_sets_delete_info cb_info;
-
-			cb_info.ns = ns;
-			cb_info.sets_deleting = sets_deleting;
-			cb_info.p_tree = rsv.p->vp;
-			cb_info.num_deleted = 0;
+		if (gc->sets_delete) {
+			cf_atomic64_add(&ns->n_non_master_gc_deleted_set_objects, cb_info.num_deleted);
+		}
+		else {
+			cf_atomic64_add(&ns->n_non_master_gc_expired_objects, cb_info.num_deleted);
+		}
 
-			// Reduce the partition, checking and deleting records.
-			as_index_reduce(rsv.p->vp, non_master_sets_delete_reduce_cb, &cb_info);
+		if (budget == 0) {
+			// Out of budget - resume here next time.
+			as_partition_release(&rsv);
+			break;
+		}
 
-			if (cb_info.num_deleted != 0) {
+		// The partition is done.
+		if (gc->num_deleted != 0) {
+			if (! gc->sets_delete) {
+				cf_info(AS_NSUP, "namespace %s pid %d: %u expired proles",
+						ns->name, gc->pid, gc->num_deleted);
+			}
+			else if (rsv.state == AS_PARTITION_STATE_SYNC) {
+				cf_info(AS_NSUP, "namespace %s pid %d: %u deleted proles",
+						ns->name, gc->pid, gc->num_deleted);
+			}
+			else {
 				cf_info(AS_NSUP, "namespace %s pid %d: %u deleted from dangling partition, state %d, %u records remaining",
-						ns->name, n, cb_info.num_deleted, rsv.state, rsv.p->vp->elements);
+						ns->name, gc->pid, gc->num_deleted, rsv.state, as_index_tree_size(rsv.p->vp));
 			}
-
-			as_partition_release(&rsv);
 		}
+
+		as_partition_release(&rsv);
+
+		gc->pid = gc->sets_delete ? gc->pid + 1 : -1;
+		gc->has_keyd = false;
+		gc->num_deleted = 0;
+	}
+
+	if (gc->pid == -1) {
+		cf_atomic32_set(&ns->non_master_gc_pid, (uint32_t)-1);
 	}
 }
 
 //
-// END - Temporary dangling prole (or other) sets deletion.
+// END - Temporary dangling prole garbage collection, and dangling prole (or
+// other) sets deletion.
 //==========================================================
 
 
@@ -602,6 +731,14 @@ as_nsup_queue_get_size()
 // Wait for delete queue to clear.
 #define DELETE_Q_CLEAR_SLEEP_us		1000 // 1 millisecond
 
+// With expiration-index, a full expire walk rebuilds the index (and histograms)
+// once in this many laps.
+#define EXPIRE_INDEX_FULL_LAPS		16
+
+// With evict-continuous, each step evicts about this much more of the soonest
+// expiring records - one expiration index bucket.
+#define EVICT_CONTINUOUS_STEP_SEC	60
+
 typedef struct record_delete_info_s {
 	as_namespace*	ns;
 	cf_digest		digest;
@@ -621,7 +758,7 @@ run_nsup_delete(void* pv_data)
 			cf_crash(AS_NSUP, "nsup delete queue pop failed");
 		}
 
-		// Generate a delete transaction for this digest, and hand it to tsvc.
+		// Generate a delete transaction for this digest, and process it here.
 
 		size_t sz = sizeof(cl_msg);
 		size_t ns_name_len = strlen(q_item.ns->name);
@@ -673,9 +810,12 @@ run_nsup_delete(void* pv_data)
 		as_transaction_set_msg_field_flag(&tr, AS_MSG_FIELD_TYPE_NAMESPACE);
 		as_transaction_set_msg_field_flag(&tr, AS_MSG_FIELD_TYPE_DIGEST_RIPE);
 
-		thr_tsvc_enqueue(&tr);
+		// Delete under the record lock in this thread - nsup deletes need no
+		// device read, so there's no point in a hop through the tsvc queues.
+		// Replica deletes go out via replica write batches, if configured.
+		process_transaction(&tr);
 
-		// Throttle - don't overwhelm tsvc queue.
+		// Throttle - don't overwhelm the fabric or the proles.
 		if (g_config.nsup_delete_sleep != 0) {
 			usleep(g_config.nsup_delete_sleep);
 		}
@@ -700,17 +840,126 @@ queue_for_delete(as_namespace* ns, cf_digest* p_digest)
 	}
 }
 
+//------------------------------------------------
+// Histograms built while reducing partitions. With
+// multiple nsup threads, each thread builds its own
+// and they're merged into the namespace's.
+//
+typedef struct nsup_hists_s {
+	linear_hist*	obj_size_hist;
+	linear_hist*	evict_hist;
+	linear_hist*	ttl_hist;
+	linear_hist**	set_obj_size_hists;
+	linear_hist**	set_ttl_hists;
+} nsup_hists;
+
+static void
+nsup_hists_init(nsup_hists* hists, as_namespace* ns, bool evict)
+{
+	// With incremental-histograms, the namespace-wide ones aren't walked.
+	hists->obj_size_hist = ns->incremental_histograms ? NULL : ns->obj_size_hist;
+	hists->evict_hist = evict ? ns->evict_hist : NULL;
+	hists->ttl_hist = ns->incremental_histograms ? NULL : ns->ttl_hist;
+	hists->set_obj_size_hists = ns->set_obj_size_hists;
+	hists->set_ttl_hists = ns->set_ttl_hists;
+}
+
+static linear_hist**
+create_similar_set_hists(linear_hist** set_hists)
+{
+	linear_hist** copies = cf_calloc(AS_SET_MAX_COUNT + 1, sizeof(linear_hist*));
+
+	cf_assert(copies, AS_NSUP, CF_CRITICAL, "calloc failed: %s", cf_strerror(errno));
+
+	for (uint32_t set_id = 0; set_id <= AS_SET_MAX_COUNT; set_id++) {
+		if (set_hists[set_id]) {
+			copies[set_id] = linear_hist_create_similar("thread-set-hist", set_hists[set_id]);
+		}
+	}
+
+	return copies;
+}
+
+static void
+merge_set_hists(linear_hist** set_hists, linear_hist** copies)
+{
+	for (uint32_t set_id = 0; set_id <= AS_SET_MAX_COUNT; set_id++) {
+		if (copies[set_id]) {
+			linear_hist_merge(set_hists[set_id], copies[set_id]);
+			linear_hist_destroy(copies[set_id]);
+		}
+	}
+
+	cf_free(copies);
+}
+
+static void
+nsup_hists_create_similar(nsup_hists* copy, const nsup_hists* hists)
+{
+	memset(copy, 0, sizeof(nsup_hists));
+
+	if (hists->obj_size_hist) {
+		copy->obj_size_hist = linear_hist_create_similar("thread-obj-size-hist", hists->obj_size_hist);
+	}
+
+	if (hists->evict_hist) {
+		copy->evict_hist = linear_hist_create_similar("thread-evict-hist", hists->evict_hist);
+	}
+
+	if (hists->ttl_hist) {
+		copy->ttl_hist = linear_hist_create_similar("thread-ttl-hist", hists->ttl_hist);
+	}
+
+	if (hists->set_obj_size_hists) {
+		copy->set_obj_size_hists = create_similar_set_hists(hists->set_obj_size_hists);
+	}
+
+	if (hists->set_ttl_hists) {
+		copy->set_ttl_hists = create_similar_set_hists(hists->set_ttl_hists);
+	}
+}
+
+// Merges copy into hists, and destroys copy.
+static void
+nsup_hists_merge(nsup_hists* hists, nsup_hists* copy)
+{
+	if (copy->obj_size_hist) {
+		linear_hist_merge(hists->obj_size_hist, copy->obj_size_hist);
+		linear_hist_destroy(copy->obj_size_hist);
+	}
+
+	if (copy->evict_hist) {
+		linear_hist_merge(hists->evict_hist, copy->evict_hist);
+		linear_hist_destroy(copy->evict_hist);
+	}
+
+	if (copy->ttl_hist) {
+		linear_hist_merge(hists->ttl_hist, copy->ttl_hist);
+		linear_hist_destroy(copy->ttl_hist);
+	}
+
+	if (copy->set_obj_size_hists) {
+		merge_set_hists(hists->set_obj_size_hists, copy->set_obj_size_hists);
+	}
+
+	if (copy->set_ttl_hists) {
+		merge_set_hists(hists->set_ttl_hists, copy->set_ttl_hists);
+	}
+}
+
 //------------------------------------------------
 // Insert data into object size histograms.
 //
 static void
-add_to_obj_size_histograms(as_namespace* ns, as_index* r)
+add_to_obj_size_histograms(nsup_hists* hists, as_index* r)
 {
 	uint32_t set_id = as_index_get_set_id(r);
-	linear_hist* set_obj_size_hist = ns->set_obj_size_hists[set_id];
+	linear_hist* set_obj_size_hist = hists->set_obj_size_hists[set_id];
 	uint64_t n_rblocks = r->storage_key.ssd.n_rblocks;
 
-	linear_hist_insert_data_point(ns->obj_size_hist, n_rblocks);
+	if (hists->obj_size_hist) {
+		linear_hist_insert_data_point(hists->obj_size_hist, n_rblocks);
+	}
 
 	if (set_obj_size_hist) {
 		linear_hist_insert_data_point(set_obj_size_hist, n_rblocks);
@@ -721,13 +970,15 @@ add_to_obj_size_histograms(as_namespace* ns, as_index* r)
 // Insert data into TTL histograms.
 //
 static void
-add_to_ttl_histograms(as_namespace* ns, as_index* r)
+add_to_ttl_histograms(nsup_hists* hists, as_index* r)
 {
 	uint32_t set_id = as_index_get_set_id(r);
-	linear_hist* set_ttl_hist = ns->set_ttl_hists[set_id];
+	linear_hist* set_ttl_hist = hists->set_ttl_hists[set_id];
 	uint32_t void_time = r->void_time;
 
-	linear_hist_insert_data_point(ns->ttl_hist, void_time);
+	if (hists->ttl_hist) {
+		linear_hist_insert_data_point(hists->ttl_hist, void_time);
+	}
 
 	if (set_ttl_hist) {
 		linear_hist_insert_data_point(set_ttl_hist, void_time);
@@ -735,26 +986,37 @@ add_to_ttl_histograms(as_namespace* ns, as_index* r)
 }
 
 //------------------------------------------------
-// Reduce callback deletes sets.
-// - does set deletion
-// - does expiration
-// - builds object size & TTL histograms
-// - counts 0-void-time records
+// Reduce callback info, shared by all the master
+// partition reduce callbacks below. Each nsup
+// thread has its own copy.
 //
-typedef struct sets_delete_info_s {
+typedef struct nsup_reduce_info_s {
 	as_namespace*	ns;
 	uint32_t		now;
 	bool*			sets_deleting;
+	bool*			sets_not_evicting;
+	uint32_t		evict_void_time;
+	uint32_t*		set_evict_void_times;
+	nsup_hists		hists;
 	uint32_t		num_deleted;
+	uint32_t		num_evicted;
 	uint32_t		num_expired;
 	uint32_t		num_0_void_time;
-} sets_delete_info;
+	bool			rebuild_expire_index;
+} nsup_reduce_info;
 
+//------------------------------------------------
+// Reduce callback deletes sets.
+// - does set deletion
+// - does expiration
+// - builds object size & TTL histograms
+// - counts 0-void-time records
+//
 static void
 sets_delete_reduce_cb(as_index_ref* r_ref, void* udata)
 {
 	as_index* r = r_ref->r;
-	sets_delete_info* p_info = (sets_delete_info*)udata;
+	nsup_reduce_info* p_info = (nsup_reduce_info*)udata;
 	as_namespace* ns = p_info->ns;
 	uint32_t set_id = as_index_get_set_id(r);
 
@@ -774,12 +1036,12 @@ sets_delete_reduce_cb(as_index_ref* r_ref, void* udata)
 			p_info->num_expired++;
 		}
 		else {
-			add_to_obj_size_histograms(ns, r);
-			add_to_ttl_histograms(ns, r);
+			add_to_obj_size_histograms(&p_info->hists, r);
+			add_to_ttl_histograms(&p_info->hists, r);
 		}
 	}
 	else {
-		add_to_obj_size_histograms(ns, r);
+		add_to_obj_size_histograms(&p_info->hists, r);
 		p_info->num_0_void_time++;
 	}
 
@@ -791,29 +1053,23 @@ sets_delete_reduce_cb(as_index_ref* r_ref, void* udata)
 // - builds object size, eviction & TTL histograms
 // - counts 0-void-time records
 //
-typedef struct evict_prep_info_s {
-	as_namespace*	ns;
-	bool*			sets_not_evicting;
-	uint32_t		num_0_void_time;
-} evict_prep_info;
-
 static void
 evict_prep_reduce_cb(as_index_ref* r_ref, void* udata)
 {
 	as_index* r = r_ref->r;
-	evict_prep_info* p_info = (evict_prep_info*)udata;
+	nsup_reduce_info* p_info = (nsup_reduce_info*)udata;
 	as_namespace* ns = p_info->ns;
 	uint32_t set_id = as_index_get_set_id(r);
 	uint32_t void_time = r->void_time;
 
-	add_to_obj_size_histograms(ns, r);
+	add_to_obj_size_histograms(&p_info->hists, r);
 
 	if (void_time != 0) {
 		if (! p_info->sets_not_evicting[set_id]) {
-			linear_hist_insert_data_point(ns->evict_hist, void_time);
+			linear_hist_insert_data_point(p_info->hists.evict_hist, void_time);
 		}
 
-		add_to_ttl_histograms(ns, r);
+		add_to_ttl_histograms(&p_info->hists, r);
 	}
 	else {
 		p_info->num_0_void_time++;
@@ -827,19 +1083,11 @@ evict_prep_reduce_cb(as_index_ref* r_ref, void* udata)
 // - evicts based on general threshold
 // - does expiration on eviction-disabled sets
 //
-typedef struct evict_info_s {
-	as_namespace*	ns;
-	uint32_t		now;
-	bool*			sets_not_evicting;
-	uint32_t		evict_void_time;
-	uint32_t		num_evicted;
-} evict_info;
-
 static void
 evict_reduce_cb(as_index_ref* r_ref, void* udata)
 {
 	as_index* r = r_ref->r;
-	evict_info* p_info = (evict_info*)udata;
+	nsup_reduce_info* p_info = (nsup_reduce_info*)udata;
 	as_namespace* ns = p_info->ns;
 	uint32_t set_id = as_index_get_set_id(r);
 	uint32_t void_time = r->void_time;
@@ -861,23 +1109,38 @@ evict_reduce_cb(as_index_ref* r_ref, void* udata)
 }
 
 //------------------------------------------------
-// Reduce callback expires records.
-// - does expiration
-// - builds object size & TTL histograms
-// - counts 0-void-time records
+// Reduce callback evicts records of sets over quota.
+// - evicts based on per-set thresholds
 //
-typedef struct expire_info_s {
-	as_namespace*	ns;
-	uint32_t		now;
-	uint32_t		num_expired;
-	uint32_t		num_0_void_time;
-} expire_info;
+static void
+quota_evict_reduce_cb(as_index_ref* r_ref, void* udata)
+{
+	as_index* r = r_ref->r;
+	nsup_reduce_info* p_info = (nsup_reduce_info*)udata;
+	as_namespace* ns = p_info->ns;
+	uint32_t void_time = r->void_time;
+
+	if (void_time != 0 &&
+			void_time < p_info->set_evict_void_times[as_index_get_set_id(r)]) {
+		queue_for_delete(ns, &r->key);
+		p_info->num_evicted++;
+	}
 
+	as_record_done(r_ref, ns);
+}
+
+//------------------------------------------------
+// Reduce callback expires records.
+// - does expiration
+// - builds object size & TTL histograms
+// - counts 0-void-time records
+// - rebuilds expiration index, if asked
+//
 static void
 expire_reduce_cb(as_index_ref* r_ref, void* udata)
 {
 	as_index* r = r_ref->r;
-	expire_info* p_info = (expire_info*)udata;
+	nsup_reduce_info* p_info = (nsup_reduce_info*)udata;
 	as_namespace* ns = p_info->ns;
 	uint32_t void_time = r->void_time;
 
@@ -887,35 +1150,230 @@ expire_reduce_cb(as_index_ref* r_ref, void* udata)
 			p_info->num_expired++;
 		}
 		else {
-			add_to_obj_size_histograms(ns, r);
-			add_to_ttl_histograms(ns, r);
+			add_to_obj_size_histograms(&p_info->hists, r);
+			add_to_ttl_histograms(&p_info->hists, r);
+
+			if (p_info->rebuild_expire_index) {
+				as_expire_index_add(ns->partitions[as_partition_getid(r->key)].expire_index,
+						r_ref->r_h, void_time);
+			}
 		}
 	}
 	else {
-		add_to_obj_size_histograms(ns, r);
+		add_to_obj_size_histograms(&p_info->hists, r);
 		p_info->num_0_void_time++;
 	}
 
 	as_record_done(r_ref, ns);
 }
 
+//------------------------------------------------
+// Threads reduce master partitions.
+//
+typedef struct nsup_thread_info_s {
+	nsup_reduce_info	info;
+	as_index_reduce_fn	cb;
+	cf_atomic32*		p_pid;
+	uint32_t			n_waits;
+	const char*			tag;
+} nsup_thread_info;
+
+//------------------------------------------------
+// Reduce callback wrapper rebuilds set index, then
+// does the walk's real work.
+//
+static void
+set_index_rebuild_reduce_cb(as_index_ref* r_ref, void* udata)
+{
+	nsup_thread_info* p_thread_info = (nsup_thread_info*)udata;
+	as_namespace* ns = p_thread_info->info.ns;
+	as_index* r = r_ref->r;
+	uint16_t set_id = as_index_get_set_id(r);
+
+	if (as_set_index_is_indexed(ns, set_id)) {
+		as_set_index_add(ns->partitions[as_partition_getid(r->key)].set_index,
+				set_id, r_ref->r_h);
+	}
+
+	p_thread_info->cb(r_ref, &p_thread_info->info);
+}
+
+static void*
+run_reduce_master_partitions(void* udata)
+{
+	nsup_thread_info* p_thread_info = (nsup_thread_info*)udata;
+	as_namespace* ns = p_thread_info->info.ns;
+	as_partition_reservation rsv;
+	int n;
+
+	while ((n = (int)cf_atomic32_incr(p_thread_info->p_pid)) < AS_PARTITIONS) {
+		if (0 != as_partition_reserve_write(ns, n, &rsv, 0, 0)) {
+			continue;
+		}
+
+		// Clear before reducing - every record is re-added as it's visited.
+		if (p_thread_info->info.rebuild_expire_index) {
+			as_expire_index_clear(rsv.p->expire_index);
+		}
+
+		// Every walk visits every record, so rebuilds the set index if any.
+		if (rsv.p->set_index) {
+			as_set_index_clear(rsv.p->set_index, false);
+			as_index_reduce(rsv.p->vp, set_index_rebuild_reduce_cb, p_thread_info);
+			as_set_index_rebuilt(rsv.p->set_index);
+		}
+		else {
+			as_index_reduce(rsv.p->vp, p_thread_info->cb, &p_thread_info->info);
+		}
+
+		as_partition_release(&rsv);
+
+		while (cf_queue_sz(g_p_nsup_delete_q) > DELETE_Q_SAFETY_THRESHOLD) {
+			usleep(DELETE_Q_SAFETY_SLEEP_us);
+			p_thread_info->n_waits++;
+		}
+
+		cf_debug(AS_NSUP, "{%s} %s done partition index %d, waits %u", ns->name, p_thread_info->tag, n, p_thread_info->n_waits);
+	}
+
+	return NULL;
+}
+
 //------------------------------------------------
 // Reduce all master partitions, using specified
-// functionality. Throttle to make sure deletions
-// generated by reducing each partition don't blow
-// up the delete queue.
+// functionality, split across nsup-threads threads.
+// Throttle to make sure deletions generated by
+// reducing each partition don't blow up the delete
+// queue.
+//
+static void
+reduce_master_partitions(nsup_reduce_info* p_info, as_index_reduce_fn cb, uint32_t* p_n_waits, const char* tag)
+{
+	uint32_t n_threads = g_config.n_nsup_threads;
+	nsup_thread_info thread_infos[n_threads];
+	pthread_t threads[n_threads];
+	cf_atomic32 pid = -1;
+
+	ASD_NSUP_PHASE_START(p_info->ns->id, (char*)tag);
+
+	for (uint32_t t = 0; t < n_threads; t++) {
+		nsup_thread_info* p_thread_info = &thread_infos[t];
+
+		p_thread_info->info = *p_info;
+		p_thread_info->cb = cb;
+		p_thread_info->p_pid = &pid;
+		p_thread_info->n_waits = 0;
+		p_thread_info->tag = tag;
+
+		// This thread takes the first share, using the caller's histograms.
+		if (t == 0) {
+			continue;
+		}
+
+		p_thread_info->info.num_deleted = 0;
+		p_thread_info->info.num_evicted = 0;
+		p_thread_info->info.num_expired = 0;
+		p_thread_info->info.num_0_void_time = 0;
+
+		nsup_hists_create_similar(&p_thread_info->info.hists, &p_info->hists);
+
+		if (pthread_create(&threads[t], NULL, run_reduce_master_partitions, (void*)p_thread_info) != 0) {
+			cf_crash(AS_NSUP, "{%s} failed to create %s thread %u", p_info->ns->name, tag, t);
+		}
+	}
+
+	run_reduce_master_partitions((void*)&thread_infos[0]);
+
+	*p_info = thread_infos[0].info;
+	*p_n_waits += thread_infos[0].n_waits;
+
+	for (uint32_t t = 1; t < n_threads; t++) {
+		nsup_thread_info* p_thread_info = &thread_infos[t];
+
+		pthread_join(threads[t], NULL);
+
+		p_info->num_deleted += p_thread_info->info.num_deleted;
+		p_info->num_evicted += p_thread_info->info.num_evicted;
+		p_info->num_expired += p_thread_info->info.num_expired;
+		p_info->num_0_void_time += p_thread_info->info.num_0_void_time;
+
+		nsup_hists_merge(&p_info->hists, &p_thread_info->info.hists);
+
+		*p_n_waits += p_thread_info->n_waits;
+	}
+
+	ASD_NSUP_PHASE_DONE(p_info->ns->id, (char*)tag);
+}
+
+//------------------------------------------------
+// Delete records listed in expiration index buckets
+// before void-time until, instead of reducing master
+// partitions. Index entries are only hints - each
+// record is looked up (and locked) before deletion.
+// Records due by now are expired, those due later
+// evicted, unless their set is protected from
+// eviction.
 //
 static void
-reduce_master_partitions(as_namespace* ns, as_index_reduce_fn cb, void* udata, uint32_t* p_n_waits, const char* tag)
+delete_by_index(as_namespace* ns, uint32_t now, uint32_t until,
+		const bool* sets_not_evicting, uint32_t* p_n_expired,
+		uint32_t* p_n_evicted, uint32_t* p_n_waits)
 {
 	as_partition_reservation rsv;
 
 	for (int n = 0; n < AS_PARTITIONS; n++) {
+		cf_arenax_handle* handles;
+		uint32_t n_handles;
+
+		// Non-master entries aren't needed - the master deletes those records.
 		if (0 != as_partition_reserve_write(ns, n, &rsv, 0, 0)) {
+			as_expire_index_pop_due(ns->partitions[n].expire_index, ns->arena, until, &handles);
+
+			if (handles) {
+				cf_free(handles);
+			}
+
 			continue;
 		}
 
-		as_index_reduce(rsv.p->vp, cb, udata);
+		n_handles = as_expire_index_pop_due(rsv.p->expire_index, ns->arena, until, &handles);
+
+		for (uint32_t i = 0; i < n_handles; i++) {
+			// The element may since have been freed or reused - any digest
+			// found this way is only a candidate.
+			cf_digest keyd = ((as_index*)cf_arenax_resolve(ns->arena, handles[i]))->key;
+			as_index_ref r_ref;
+
+			r_ref.skip_lock = false;
+
+			if (as_record_get(rsv.tree, &keyd, &r_ref, ns) != 0) {
+				continue;
+			}
+
+			as_index* r = r_ref.r;
+			uint32_t void_time = r->void_time;
+
+			if (void_time != 0 && now > void_time) {
+				queue_for_delete(ns, &r->key);
+				(*p_n_expired)++;
+			}
+			else if (void_time != 0 && until > void_time) {
+				if (sets_not_evicting && ! sets_not_evicting[as_index_get_set_id(r)]) {
+					queue_for_delete(ns, &r->key);
+					(*p_n_evicted)++;
+				}
+				else {
+					// Not ours to evict - keep it listed for expiration.
+					as_expire_index_add(rsv.p->expire_index, handles[i], void_time);
+				}
+			}
+
+			as_record_done(&r_ref, ns);
+		}
+
+		if (handles) {
+			cf_free(handles);
+		}
 
 		as_partition_release(&rsv);
 
@@ -924,8 +1382,155 @@ reduce_master_partitions(as_namespace* ns, as_index_reduce_fn cb, void* udata, u
 			(*p_n_waits)++;
 		}
 
-		cf_debug(AS_NSUP, "{%s} %s done partition index %d, waits %u", ns->name, tag, n, *p_n_waits);
+		cf_debug(AS_NSUP, "{%s} delete-by-index done partition index %d, %u candidates", ns->name, n, n_handles);
+	}
+}
+
+//------------------------------------------------
+// Expire records listed in due expiration index
+// buckets.
+//
+static uint32_t
+expire_by_index(as_namespace* ns, uint32_t now, uint32_t* p_n_waits)
+{
+	uint32_t n_expired = 0;
+	uint32_t n_evicted = 0;
+
+	delete_by_index(ns, now, now, NULL, &n_expired, &n_evicted, p_n_waits);
+
+	return n_expired;
+}
+
+//------------------------------------------------
+// General eviction takes only the lowest
+// evict-priority sets that have records - mark the
+// others not evicting. Records in no set are
+// priority 0. Returns true if any were marked.
+//
+static bool
+mark_sets_by_evict_priority(as_namespace* ns, bool* sets_not_evicting)
+{
+	uint32_t num_sets = cf_vmapx_count(ns->p_sets_vmap);
+	uint32_t priorities[AS_SET_MAX_COUNT + 1];
+	uint64_t n_set_objects = 0;
+	uint32_t min_priority = UINT32_MAX;
+	bool any_priority = false;
+
+	for (uint32_t j = 0; j < num_sets; j++) {
+		uint32_t set_id = j + 1;
+		as_set* p_set;
+
+		if (cf_vmapx_get_by_index(ns->p_sets_vmap, j, (void**)&p_set) != CF_VMAPX_OK) {
+			cf_crash(AS_NSUP, "failed to get set index %u from vmap", j);
+		}
+
+		uint64_t num_elements = cf_atomic64_get(p_set->num_elements);
+
+		priorities[set_id] = cf_atomic32_get(p_set->evict_priority);
+		n_set_objects += num_elements;
+
+		if (priorities[set_id] != 0) {
+			any_priority = true;
+		}
+
+		if (! sets_not_evicting[set_id] && num_elements != 0 &&
+				priorities[set_id] < min_priority) {
+			min_priority = priorities[set_id];
+		}
+	}
+
+	if (! any_priority) {
+		return false;
+	}
+
+	if (ns->n_objects > n_set_objects) {
+		min_priority = 0;
+	}
+
+	bool marked = false;
+
+	if (min_priority != 0) {
+		sets_not_evicting[0] = true;
+		marked = true;
+	}
+
+	for (uint32_t set_id = 1; set_id <= num_sets; set_id++) {
+		if (! sets_not_evicting[set_id] && priorities[set_id] > min_priority) {
+			sets_not_evicting[set_id] = true;
+			marked = true;
+		}
+	}
+
+	return marked;
+}
+
+//------------------------------------------------
+// One evict-continuous step - while the high-water
+// mark is breached, evict the next slice of the
+// soonest expiring records, so eviction is spread
+// out rather than a big swath per nsup cycle.
+// Returns the void-time evicted up to, 0 if none.
+//
+static uint32_t
+evict_continuous_step(as_namespace* ns, uint32_t evict_void_time)
+{
+	bool hwm_breached = false, stop_writes = false;
+
+	as_namespace_eval_write_state(ns, &hwm_breached, &stop_writes);
+
+	if (! hwm_breached) {
+		return 0;
+	}
+
+	// Let the last step's deletes land before judging headroom again.
+	if (cf_queue_sz(g_p_nsup_delete_q) > 0) {
+		return evict_void_time;
+	}
+
+	uint32_t now = as_record_void_time_get();
+	uint32_t until = (evict_void_time > now ? evict_void_time : now) +
+			EVICT_CONTINUOUS_STEP_SEC;
+
+	bool sets_not_evicting[AS_SET_MAX_COUNT + 1];
+
+	memset(sets_not_evicting, 0, sizeof(sets_not_evicting));
+
+	uint32_t num_sets = cf_vmapx_count(ns->p_sets_vmap);
+
+	for (uint32_t j = 0; j < num_sets; j++) {
+		as_set* p_set;
+
+		if (cf_vmapx_get_by_index(ns->p_sets_vmap, j, (void**)&p_set) != CF_VMAPX_OK) {
+			cf_crash(AS_NSUP, "failed to get set index %u from vmap", j);
+		}
+
+		if (IS_SET_EVICTION_DISABLED(p_set)) {
+			sets_not_evicting[j + 1] = true;
+		}
+	}
+
+	mark_sets_by_evict_priority(ns, sets_not_evicting);
+
+	uint32_t n_expired = 0;
+	uint32_t n_evicted = 0;
+	uint32_t n_waits = 0;
+
+	delete_by_index(ns, now, until, sets_not_evicting, &n_expired, &n_evicted,
+			&n_waits);
+
+	if (n_expired != 0) {
+		cf_atomic64_add(&ns->n_expired_objects, n_expired);
 	}
+
+	if (n_evicted != 0) {
+		cf_atomic64_set(&ns->evict_ttl, until - now);
+		cf_atomic64_add(&ns->n_evicted_objects, n_evicted);
+	}
+
+	cf_detail(AS_NSUP, "{%s} evict-continuous to ttl %u: %u expired, %u evicted, %u waits",
+			ns->name, until - now, n_expired, n_evicted, n_waits);
+
+	return until;
 }
 
 //------------------------------------------------
@@ -937,6 +1542,8 @@ sub_reduce_partitions(as_namespace* ns, as_index_reduce_fn cb, void* udata, uint
 {
 	as_partition_reservation rsv;
 
+	ASD_NSUP_PHASE_START(ns->id, (char*)tag);
+
 	for (int n = 0; n < AS_PARTITIONS; n++) {
 		as_partition_reserve_migrate(ns, n, &rsv, 0);
 
@@ -952,6 +1559,8 @@ sub_reduce_partitions(as_namespace* ns, as_index_reduce_fn cb, void* udata, uint
 
 		cf_debug(AS_NSUP, "{%s} %s done partition index %d, waits %u", ns->name, tag, n, *p_n_waits);
 	}
+
+	ASD_NSUP_PHASE_DONE(ns->id, (char*)tag);
 }
 
 //------------------------------------------------
@@ -1057,6 +1666,51 @@ get_threshold(as_namespace* ns, uint32_t* p_evict_void_time)
 	return true;
 }
 
+//------------------------------------------------
+// Get per-set eviction thresholds for sets over
+// memory or disk quota, from their TTL histograms
+// as of the last walk. Returns true if any set has
+// records to evict.
+//
+static bool
+get_set_quota_thresholds(as_namespace* ns, uint32_t* set_evict_void_times)
+{
+	uint32_t num_sets = cf_vmapx_count(ns->p_sets_vmap);
+	bool any = false;
+
+	for (uint32_t j = 0; j < num_sets; j++) {
+		uint32_t set_id = j + 1;
+		as_set* p_set;
+
+		if (cf_vmapx_get_by_index(ns->p_sets_vmap, j, (void**)&p_set) != CF_VMAPX_OK) {
+			cf_crash(AS_NSUP, "failed to get set index %u from vmap", j);
+		}
+
+		if (IS_SET_EVICTION_DISABLED(p_set) || IS_SET_DELETED(p_set) ||
+				! as_set_over_quota(p_set) || ! ns->set_ttl_hists[set_id]) {
+			continue;
+		}
+
+		linear_hist_threshold threshold;
+		uint32_t subtotal = linear_hist_get_threshold_for_fraction(
+				ns->set_ttl_hists[set_id], ns->evict_tenths_pct, &threshold);
+
+		if (subtotal == 0 || threshold.value == 0xFFFFffff) {
+			cf_warning(AS_NSUP, "{%s} set %s over quota but no records eligible for eviction",
+					ns->name, p_set->name);
+			continue;
+		}
+
+		cf_info(AS_NSUP, "{%s} set %s over quota - found %u records eligible for eviction",
+				ns->name, p_set->name, subtotal);
+
+		set_evict_void_times[set_id] = threshold.value;
+		any = true;
+	}
+
+	return any;
+}
+
 //------------------------------------------------
 // Stats per namespace at the end of an nsup lap.
 //
@@ -1134,262 +1788,334 @@ thr_ldt_sup(void *arg)
 }
 
 //------------------------------------------------
-// Namespace supervisor thread "run" function.
+// One expiration, eviction and set deletion cycle of
+// a namespace.
 //
-void *
-thr_nsup(void *arg)
+static void
+nsup_cycle(as_namespace* ns, non_master_gc* gc, uint32_t* p_expire_index_laps)
 {
-	cf_info(AS_NSUP, "namespace supervisor started");
+	uint64_t start_ms = cf_getms();
 
-	// Garbage-collect long-expired proles, one partition per loop.
-	int prole_pids[g_config.n_namespaces];
+	cf_info(AS_NSUP, "{%s} nsup start", ns->name);
 
-	for (int n = 0; n < g_config.n_namespaces; n++) {
-		prole_pids[n] = -1;
-	}
+	linear_hist_clear(ns->obj_size_hist, 0, cf_atomic32_get(ns->obj_size_hist_max));
 
-	uint64_t last_time = cf_get_seconds();
+	// The "now" used for all expiration and eviction.
+	uint32_t now = as_record_void_time_get();
 
-	for ( ; ; ) {
-		// Wake up every 1 second to check the nsup timeout.
-		struct timespec delay = { 1, 0 };
-		nanosleep(&delay, NULL);
+	// Get the histogram range - used by all histograms.
+	uint32_t ttl_range = (uint32_t)get_ttl_range(ns, now);
 
-		uint64_t curr_time = cf_get_seconds();
+	linear_hist_clear(ns->ttl_hist, now, ttl_range);
 
-		if ((curr_time - last_time) < g_config.nsup_period) {
-			continue; // period has not been reached for running eviction check
-		}
+	uint32_t n_expired_records = 0;
+	uint32_t n_0_void_time_records = 0;
+	uint32_t n_deleted_set_records = 0;
+	uint32_t n_set_waits = 0;
 
-		last_time = curr_time;
+	uint32_t num_sets = cf_vmapx_count(ns->p_sets_vmap);
 
-		// Iterate over every namespace.
-		for (int i = 0; i < g_config.n_namespaces; i++) {
-			uint64_t start_ms = cf_getms();
+	bool sets_protected = false;
+	bool do_set_deletion = false;
 
-			as_namespace *ns = g_config.namespaces[i];
+	// Giving these max possible size to spare us checking each record's
+	// set-id during index reduce.
+	bool sets_deleting[AS_SET_MAX_COUNT + 1];
+	bool sets_not_evicting[AS_SET_MAX_COUNT + 1];
 
-			cf_info(AS_NSUP, "{%s} nsup start", ns->name);
+	memset(sets_deleting, 0, sizeof(sets_deleting));
+	memset(sets_not_evicting, 0, sizeof(sets_not_evicting));
 
-			linear_hist_clear(ns->obj_size_hist, 0, cf_atomic32_get(ns->obj_size_hist_max));
+	for (uint32_t j = 0; j < num_sets; j++) {
+		uint32_t set_id = j + 1;
 
-			// The "now" used for all expiration and eviction.
-			uint32_t now = as_record_void_time_get();
+		clear_set_obj_size_hist(ns, set_id);
+		clear_set_ttl_hist(ns, set_id, now, ttl_range);
 
-			// Get the histogram range - used by all histograms.
-			uint32_t ttl_range = (uint32_t)get_ttl_range(ns, now);
+		as_set* p_set;
 
-			linear_hist_clear(ns->ttl_hist, now, ttl_range);
+		if (cf_vmapx_get_by_index(ns->p_sets_vmap, j, (void**)&p_set) != CF_VMAPX_OK) {
+			cf_crash(AS_NSUP, "failed to get set index %u from vmap", j);
+		}
 
-			uint32_t n_expired_records = 0;
-			uint32_t n_0_void_time_records = 0;
-			uint32_t n_deleted_set_records = 0;
-			uint32_t n_set_waits = 0;
+		if (IS_SET_EVICTION_DISABLED(p_set)) {
+			sets_not_evicting[set_id] = true;
+			sets_protected = true;
+		}
 
-			uint32_t num_sets = cf_vmapx_count(ns->p_sets_vmap);
+		if (IS_SET_DELETED(p_set)) {
+			if (cf_atomic64_get(p_set->num_elements) != 0) {
+				sets_deleting[set_id] = true;
+				do_set_deletion = true;
 
-			bool sets_protected = false;
-			bool do_set_deletion = false;
+				cf_info(AS_NSUP, "{%s} deleting set %s", ns->name, p_set->name);
+				continue;
+			}
 
-			// Giving these max possible size to spare us checking each record's
-			// set-id during index reduce.
-			bool sets_deleting[AS_SET_MAX_COUNT + 1];
-			bool sets_not_evicting[AS_SET_MAX_COUNT + 1];
+			// Starts a detached thread which clears all sindex entries
+			// for this set, then switches off the set's 'deleted' flag.
+			as_sindex_initiate_set_delete(ns, p_set);
+		}
+	}
 
-			memset(sets_deleting, 0, sizeof(sets_deleting));
-			memset(sets_not_evicting, 0, sizeof(sets_not_evicting));
+	if (do_set_deletion) {
+		nsup_reduce_info cb_info;
 
-			for (uint32_t j = 0; j < num_sets; j++) {
-				uint32_t set_id = j + 1;
+		memset(&cb_info, 0, sizeof(cb_info));
+		cb_info.ns = ns;
+		cb_info.now = now;
+		cb_info.sets_deleting = sets_deleting;
+		nsup_hists_init(&cb_info.hists, ns, false);
 
-				clear_set_obj_size_hist(ns, set_id);
-				clear_set_ttl_hist(ns, set_id, now, ttl_range);
+		// Reduce master partitions, doing set deletion and general
+		// expiration.
+		reduce_master_partitions(&cb_info, sets_delete_reduce_cb, &n_set_waits, "sets-delete");
 
-				as_set* p_set;
+		n_deleted_set_records = cb_info.num_deleted;
+		n_expired_records = cb_info.num_expired;
+		n_0_void_time_records = cb_info.num_0_void_time;
+	}
 
-				if (cf_vmapx_get_by_index(ns->p_sets_vmap, j, (void**)&p_set) != CF_VMAPX_OK) {
-					cf_crash(AS_NSUP, "failed to get set index %u from vmap", j);
-				}
+	if (mark_sets_by_evict_priority(ns, sets_not_evicting)) {
+		sets_protected = true;
+	}
 
-				if (IS_SET_EVICTION_DISABLED(p_set)) {
-					sets_not_evicting[set_id] = true;
-					sets_protected = true;
-				}
+	uint32_t n_quota_evicted_records = 0;
+	uint32_t set_evict_void_times[AS_SET_MAX_COUNT + 1];
 
-				if (IS_SET_DELETED(p_set)) {
-					if (cf_atomic64_get(p_set->num_elements) != 0) {
-						sets_deleting[set_id] = true;
-						do_set_deletion = true;
+	memset(set_evict_void_times, 0, sizeof(set_evict_void_times));
 
-						cf_info(AS_NSUP, "{%s} deleting set %s", ns->name, p_set->name);
-						continue;
-					}
+	if (get_set_quota_thresholds(ns, set_evict_void_times)) {
+		nsup_reduce_info cb_info;
 
-					// Starts a detached thread which clears all sindex entries
-					// for this set, then switches off the set's 'deleted' flag.
-					as_sindex_initiate_set_delete(ns, p_set);
-				}
-			}
+		memset(&cb_info, 0, sizeof(cb_info));
+		cb_info.ns = ns;
+		cb_info.now = now;
+		cb_info.set_evict_void_times = set_evict_void_times;
 
-			if (do_set_deletion) {
-				sets_delete_info cb_info;
+		// Reduce master partitions, evicting from sets over quota.
+		reduce_master_partitions(&cb_info, quota_evict_reduce_cb, &n_set_waits, "quota-evict");
 
-				memset(&cb_info, 0, sizeof(cb_info));
-				cb_info.ns = ns;
-				cb_info.now = now;
-				cb_info.sets_deleting = sets_deleting;
+		n_quota_evicted_records = cb_info.num_evicted;
+	}
 
-				// Reduce master partitions, doing set deletion and general
-				// expiration.
-				reduce_master_partitions(ns, sets_delete_reduce_cb, &cb_info, &n_set_waits, "sets-delete");
+	// Wait for delete queue to clear, to reduce the chance we'll need
+	// to do general eviction.
 
-				n_deleted_set_records = cb_info.num_deleted;
-				n_expired_records = cb_info.num_expired;
-				n_0_void_time_records = cb_info.num_0_void_time;
-			}
+	uint32_t n_clear_waits = 0;
 
-			// Wait for delete queue to clear, to reduce the chance we'll need
-			// to do general eviction.
+	while (cf_queue_sz(g_p_nsup_delete_q) > 0) {
+		usleep(DELETE_Q_CLEAR_SLEEP_us);
+		n_clear_waits++;
+	}
 
-			uint32_t n_clear_waits = 0;
+	uint32_t n_evicted_records = n_quota_evicted_records;
+	uint32_t evict_ttl = 0;
+	uint32_t n_general_waits = 0;
+	bool hists_built = true;
 
-			while (cf_queue_sz(g_p_nsup_delete_q) > 0) {
-				usleep(DELETE_Q_CLEAR_SLEEP_us);
-				n_clear_waits++;
-			}
+	// Check whether or not we need to do general eviction.
 
-			uint32_t n_evicted_records = 0;
-			uint32_t evict_ttl = 0;
-			uint32_t n_general_waits = 0;
+	bool hwm_breached = false, stop_writes = false;
 
-			// Check whether or not we need to do general eviction.
+	as_namespace_eval_write_state(ns, &hwm_breached, &stop_writes);
 
-			bool hwm_breached = false, stop_writes = false;
+	// Store the state of the threshold breaches.
+	cf_atomic32_set(&ns->stop_writes, stop_writes ? 1 : 0);
+	cf_atomic32_set(&ns->hwm_breached, hwm_breached ? 1 : 0);
 
-			as_namespace_eval_write_state(ns, &hwm_breached, &stop_writes);
+	if (hwm_breached && ! (ns->evict_continuous && ns->expiration_index)) {
+		// Eviction is necessary - unless evict-continuous is doing it.
 
-			// Store the state of the threshold breaches.
-			cf_atomic32_set(&ns->stop_writes, stop_writes ? 1 : 0);
-			cf_atomic32_set(&ns->hwm_breached, hwm_breached ? 1 : 0);
+		linear_hist_clear(ns->obj_size_hist, 0, cf_atomic32_get(ns->obj_size_hist_max));
+		linear_hist_reset(ns->evict_hist, now, ttl_range, ns->evict_hist_buckets);
+		linear_hist_clear(ns->ttl_hist, now, ttl_range);
 
-			if (hwm_breached) {
-				// Eviction is necessary.
+		for (uint32_t j = 0; j < num_sets; j++) {
+			uint32_t set_id = j + 1;
 
-				linear_hist_clear(ns->obj_size_hist, 0, cf_atomic32_get(ns->obj_size_hist_max));
-				linear_hist_reset(ns->evict_hist, now, ttl_range, ns->evict_hist_buckets);
-				linear_hist_clear(ns->ttl_hist, now, ttl_range);
+			linear_hist_clear(ns->set_obj_size_hists[set_id], 0, cf_atomic32_get(ns->obj_size_hist_max));
+			linear_hist_clear(ns->set_ttl_hists[set_id], now, ttl_range);
+		}
 
-				for (uint32_t j = 0; j < num_sets; j++) {
-					uint32_t set_id = j + 1;
+		nsup_reduce_info cb_info1;
 
-					linear_hist_clear(ns->set_obj_size_hists[set_id], 0, cf_atomic32_get(ns->obj_size_hist_max));
-					linear_hist_clear(ns->set_ttl_hists[set_id], now, ttl_range);
-				}
+		memset(&cb_info1, 0, sizeof(cb_info1));
+		cb_info1.ns = ns;
+		cb_info1.sets_not_evicting = sets_not_evicting;
+		nsup_hists_init(&cb_info1.hists, ns, true);
 
-				evict_prep_info cb_info1;
+		// Reduce master partitions, building histograms to calculate
+		// general eviction threshold.
+		reduce_master_partitions(&cb_info1, evict_prep_reduce_cb, &n_general_waits, "evict-prep");
 
-				memset(&cb_info1, 0, sizeof(cb_info1));
-				cb_info1.ns = ns;
-				cb_info1.sets_not_evicting = sets_not_evicting;
+		n_0_void_time_records = cb_info1.num_0_void_time;
 
-				// Reduce master partitions, building histograms to calculate
-				// general eviction threshold.
-				reduce_master_partitions(ns, evict_prep_reduce_cb, &cb_info1, &n_general_waits, "evict-prep");
+		// No histograms are built while evicting.
+		nsup_reduce_info cb_info2;
 
-				n_0_void_time_records = cb_info1.num_0_void_time;
+		memset(&cb_info2, 0, sizeof(cb_info2));
+		cb_info2.ns = ns;
+		cb_info2.now = now;
+		cb_info2.sets_not_evicting = sets_not_evicting;
 
-				evict_info cb_info2;
+		// Determine general eviction threshold.
+		if (get_threshold(ns, &cb_info2.evict_void_time)) {
+			// Save the eviction depth in the device header(s) so it can
+			// be used to speed up cold start, etc.
+			as_storage_save_evict_void_time(ns, cb_info2.evict_void_time);
 
-				memset(&cb_info2, 0, sizeof(cb_info2));
-				cb_info2.ns = ns;
-				cb_info2.now = now;
-				cb_info2.sets_not_evicting = sets_not_evicting;
+			// Reduce master partitions, deleting records up to
+			// threshold. (This automatically deletes expired records.)
+			reduce_master_partitions(&cb_info2, evict_reduce_cb, &n_general_waits, "evict");
 
-				// Determine general eviction threshold.
-				if (get_threshold(ns, &cb_info2.evict_void_time)) {
-					// Save the eviction depth in the device header(s) so it can
-					// be used to speed up cold start, etc.
-					as_storage_save_evict_void_time(ns, cb_info2.evict_void_time);
+			evict_ttl = cb_info2.evict_void_time - now;
+			n_evicted_records += cb_info2.num_evicted;
+		}
+		else if (sets_protected || cb_info2.evict_void_time == now) {
+			// Convert eviction into expiration.
+			cb_info2.evict_void_time = now;
 
-					// Reduce master partitions, deleting records up to
-					// threshold. (This automatically deletes expired records.)
-					reduce_master_partitions(ns, evict_reduce_cb, &cb_info2, &n_general_waits, "evict");
+			// Reduce master partitions, deleting expired records,
+			// including those in eviction-protected sets.
+			reduce_master_partitions(&cb_info2, evict_reduce_cb, &n_general_waits, "expire-protected-sets");
 
-					evict_ttl = cb_info2.evict_void_time - now;
-					n_evicted_records = cb_info2.num_evicted;
-				}
-				else if (sets_protected || cb_info2.evict_void_time == now) {
-					// Convert eviction into expiration.
-					cb_info2.evict_void_time = now;
+			// Count these as expired rather than evicted, since we can.
+			n_expired_records = cb_info2.num_evicted;
+		}
 
-					// Reduce master partitions, deleting expired records,
-					// including those in eviction-protected sets.
-					reduce_master_partitions(ns, evict_reduce_cb, &cb_info2, &n_general_waits, "expire-protected-sets");
+		// For now there's no get_info() call for evict_hist.
+		//linear_hist_save_info(ns->evict_hist);
+	}
+	else if (! do_set_deletion && ns->expiration_index &&
+			*p_expire_index_laps < EXPIRE_INDEX_FULL_LAPS) {
+		// Eviction is not necessary, only expiration - just visit due
+		// expiration index buckets. Histograms keep their last values.
 
-					// Count these as expired rather than evicted, since we can.
-					n_expired_records = cb_info2.num_evicted;
-				}
+		n_expired_records = expire_by_index(ns, now, &n_general_waits);
+		n_0_void_time_records = (uint32_t)ns->non_expirable_objects;
+		hists_built = false;
 
-				// For now there's no get_info() call for evict_hist.
-				//linear_hist_save_info(ns->evict_hist);
-			}
-			else if (! do_set_deletion) {
-				// Eviction is not necessary, only expiration. (But if set
-				// deletion was done, expiration has already been done.)
+		(*p_expire_index_laps)++;
+	}
+	else if (! do_set_deletion) {
+		// Eviction is not necessary, only expiration. (But if set
+		// deletion was done, expiration has already been done.)
 
-				expire_info cb_info;
+		nsup_reduce_info cb_info;
 
-				memset(&cb_info, 0, sizeof(cb_info));
-				cb_info.ns = ns;
-				cb_info.now = now;
+		memset(&cb_info, 0, sizeof(cb_info));
+		cb_info.ns = ns;
+		cb_info.now = now;
+		cb_info.rebuild_expire_index = ns->expiration_index;
+		nsup_hists_init(&cb_info.hists, ns, false);
 
-				// Reduce master partitions, deleting expired records.
-				reduce_master_partitions(ns, expire_reduce_cb, &cb_info, &n_general_waits, "expire");
+		// Reduce master partitions, deleting expired records.
+		reduce_master_partitions(&cb_info, expire_reduce_cb, &n_general_waits, "expire");
 
-				n_expired_records = cb_info.num_expired;
-				n_0_void_time_records = cb_info.num_0_void_time;
-			}
+		*p_expire_index_laps = 0;
+
+		n_expired_records = cb_info.num_expired;
+		n_0_void_time_records = cb_info.num_0_void_time;
+	}
+
+	uint32_t n_master_records = (uint32_t)ns->n_objects;
+
+	// Incremental histograms are current whether or not we walked.
+	if (ns->incremental_histograms) {
+		as_incr_hist_get(ns, now, ttl_range, ns->obj_size_hist, ns->ttl_hist);
 
+		linear_hist_dump(ns->obj_size_hist);
+		linear_hist_save_info(ns->obj_size_hist);
+		linear_hist_dump(ns->ttl_hist);
+		linear_hist_save_info(ns->ttl_hist);
+
+		n_master_records = linear_hist_get_total(ns->ttl_hist) + n_0_void_time_records;
+	}
+
+	if (hists_built) {
+		if (! ns->incremental_histograms) {
 			linear_hist_dump(ns->obj_size_hist);
 			linear_hist_save_info(ns->obj_size_hist);
 			linear_hist_dump(ns->ttl_hist);
 			linear_hist_save_info(ns->ttl_hist);
+		}
 
-			for (uint32_t j = 0; j < num_sets; j++) {
-				uint32_t set_id = j + 1;
+		for (uint32_t j = 0; j < num_sets; j++) {
+			uint32_t set_id = j + 1;
 
-				linear_hist_dump(ns->set_obj_size_hists[set_id]);
-				linear_hist_save_info(ns->set_obj_size_hists[set_id]);
-				linear_hist_dump(ns->set_ttl_hists[set_id]);
-				linear_hist_save_info(ns->set_ttl_hists[set_id]);
-			}
+			linear_hist_dump(ns->set_obj_size_hists[set_id]);
+			linear_hist_save_info(ns->set_obj_size_hists[set_id]);
+			linear_hist_dump(ns->set_ttl_hists[set_id]);
+			linear_hist_save_info(ns->set_ttl_hists[set_id]);
+		}
 
-			update_stats(ns, linear_hist_get_total(ns->ttl_hist) + n_0_void_time_records, n_0_void_time_records,
-					n_expired_records, n_evicted_records, n_deleted_set_records,
-					evict_ttl, n_set_waits, n_clear_waits, n_general_waits,
-					start_ms);
+		n_master_records = linear_hist_get_total(ns->ttl_hist) + n_0_void_time_records;
+	}
 
-			// Delete non-master records from set(s) being deleted.
-			if (do_set_deletion && g_config.non_master_sets_delete) {
-				non_master_sets_delete(ns, sets_deleting);
-			}
+	update_stats(ns, n_master_records, n_0_void_time_records,
+			n_expired_records, n_evicted_records, n_deleted_set_records,
+			evict_ttl, n_set_waits, n_clear_waits, n_general_waits,
+			start_ms);
 
-			// Garbage-collect long-expired proles, one partition per loop.
-			if (g_config.prole_extra_ttl != 0) {
-				prole_pids[i] = garbage_collect_next_prole_partition(ns, prole_pids[i]);
-			}
-		}
+	// Delete non-master records from set(s) being deleted, and garbage-collect
+	// long-expired proles, one partition per loop - throttled, in the
+	// background.
+	non_master_gc_request(ns, gc, do_set_deletion &&
+			g_config.non_master_sets_delete ? sets_deleting : NULL);
+}
+
+//------------------------------------------------
+// Namespace supervisor thread "run" function - one
+// per namespace, so a big namespace's cycle doesn't
+// hold up the others.
+//
+static void *
+run_nsup_namespace(void *udata)
+{
+	as_namespace* ns = (as_namespace*)udata;
+
+	cf_info(AS_NSUP, "{%s} namespace supervisor started", ns->name);
+
+	if (ns->evict_continuous && ! ns->expiration_index) {
+		cf_warning(AS_NSUP, "{%s} evict-continuous needs expiration-index - evicting per nsup cycle", ns->name);
+	}
+
+	// Non-master garbage collection, proceeding a slice per second.
+	non_master_gc gc;
+
+	non_master_gc_init(ns, &gc);
 
-		uint32_t n_clear_waits = 0;
+	// Laps since expiration index was rebuilt - start with a rebuild.
+	uint32_t expire_index_laps = EXPIRE_INDEX_FULL_LAPS;
 
-		while (cf_queue_sz(g_p_nsup_delete_q) > 0) {
-			usleep(DELETE_Q_CLEAR_SLEEP_us);
-			n_clear_waits++;
+	// Void-time evict-continuous has evicted up to, 0 if not evicting.
+	uint32_t evict_void_time = 0;
+
+	uint64_t last_time = cf_get_seconds();
+
+	for ( ; ; ) {
+		// Wake up every 1 second to check the nsup timeout.
+		struct timespec delay = { 1, 0 };
+		nanosleep(&delay, NULL);
+
+		if (ns->evict_continuous && ns->expiration_index) {
+			evict_void_time = evict_continuous_step(ns, evict_void_time);
 		}
 
-		if (n_clear_waits) {
-			cf_info(AS_NSUP, "nsup clear waits: %u", n_clear_waits);
+		non_master_gc_step(ns, &gc);
+
+		uint64_t curr_time = cf_get_seconds();
+		uint32_t period = ns->nsup_period != 0 ?
+				ns->nsup_period : g_config.nsup_period;
+
+		if ((curr_time - last_time) < period) {
+			continue; // period has not been reached for running eviction check
 		}
+
+		last_time = curr_time;
+
+		nsup_cycle(ns, &gc, &expire_index_laps);
 	}
 
 	return NULL;
@@ -1414,9 +2140,23 @@ as_nsup_start()
 		cf_crash(AS_NSUP, "nsup delete thread create failed");
 	}
 
-	// Start namespace supervisor thread to do expiration & eviction.
-	if (0 != pthread_create(&g_nsup_thread, NULL, thr_nsup, NULL)) {
-		cf_crash(AS_NSUP, "nsup thread create failed");
+	as_config_sched_thread(AS_SCHED_POOL_NSUP, g_nsup_delete_thread);
+
+	// Start a namespace supervisor thread per namespace to do expiration &
+	// eviction.
+	for (int i = 0; i < g_config.n_namespaces; i++) {
+		pthread_t thread;
+		pthread_attr_t attrs;
+
+		pthread_attr_init(&attrs);
+		pthread_attr_setdetachstate(&attrs, PTHREAD_CREATE_DETACHED);
+
+		if (0 != pthread_create(&thread, &attrs, run_nsup_namespace, g_config.namespaces[i])) {
+			cf_crash(AS_NSUP, "nsup thread create failed");
+		}
+
+		// Reduce threads inherit the namespace thread's CPUs and policy.
+		as_config_sched_thread(AS_SCHED_POOL_NSUP, thread);
 	}
 
 	// Start LDT supervisor thread to do all sub-record deletions.
@@ -90,6 +90,7 @@
 #include <errno.h>
 #include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <strings.h>
 #include <sys/time.h>
@@ -111,10 +112,14 @@
 #include "ai_btree.h"
 #include "bt.h"
 #include "bt_iterator.h"
+#include "coarse_clock.h"
 
 #include "base/aggr.h"
 #include "base/as_stap.h"
 #include "base/datamodel.h"
+#include "base/job_manager.h"
+#include "base/packet_compression.h"
+#include "base/predexp.h"
 #include "base/proto.h"
 #include "base/secondary_index.h"
 #include "base/stats.h"
@@ -172,6 +177,9 @@ typedef struct as_query_transaction_s {
 	as_sindex_range        * srange;
 	query_type               job_type;  // Job type [LOOKUP/AGG/UDF]
 	cf_vector              * binlist;
+	predexp_eval           * predexp;   // optional filter on results
+	uint32_t                 limit;     // 0 for all, else only top limit keys
+	bool                     limit_desc; // top means highest keys
 	as_file_handle         * fd_h;      // ref counted nonetheless
 	/************************** Run Time Data *********************************/
 	cl_msg                 * msgp;
@@ -213,8 +221,9 @@ typedef struct as_query_transaction_s {
 	cf_atomic32              netio_pop_seq;
 
 	/********************** IO Buf Builder ***********************************/
-	pthread_mutex_t          buf_mutex;
-	cf_buf_builder         * bb_r;
+	pthread_mutex_t          buf_mutex;  // Orders handoffs to netio - results are built per worker
+	cf_buf_builder         * bb_r;       // Only for the fin
+	as_comp_stream         * comp;     // NULL unless client asked for compressed responses
 	/****************** Query State and Result Code **************************/
 	pthread_mutex_t          slock;
 	bool                     do_requeue;
@@ -313,6 +322,9 @@ static cf_atomic32      g_query_threadcnt       = 0;
 cf_atomic32             g_query_short_running   = 0;
 cf_atomic32             g_query_long_running    = 0;
 
+// Paces long running queries - query-max-records-per-sec
+static as_job_pacer     g_query_pacer           = AS_JOB_PACER_INIT;
+
 // I/O & AGGREGATOR
 static pthread_t       g_query_worker_threads[AS_QUERY_MAX_WORKER_THREADS];
 static pthread_attr_t  g_query_worker_th_attr;
@@ -335,6 +347,7 @@ extern cf_vector * as_sindex_binlist_from_msg(as_namespace *ns, as_msg *msgp, in
 // **************************************************************************************************
 
 static void qtr_finish_work(as_query_transaction *qtr, cf_atomic32 *stat, char *fname, int lineno, bool release);
+static void query_stream_keys(void *udata);
 
 // **************************************************************************************************
 
@@ -531,6 +544,16 @@ qwork_poolrequest()
 // **************************************************************************************************
 
 
+// Batch size once a query is long running. Each aggregation batch is one
+// stream UDF application, sending back one partial result - bigger batches
+// mean fewer partials to ship and for the client to reduce.
+static inline uint32_t
+query_long_bsize(as_query_transaction *qtr)
+{
+	return qtr->job_type == QUERY_TYPE_AGGR ?
+			g_config.query_aggr_bsize : g_config.query_bsize;
+}
+
 /*
  * Query State set/get function
  */
@@ -643,7 +666,7 @@ query_check_timeout(as_query_transaction *qtr)
 {
 	if ((qtr)
 		&& (qtr->end_time != 0)
-		&& (cf_getns() > qtr->end_time)) {
+		&& (cf_coarse_getns() > qtr->end_time)) {
 		cf_debug(AS_QUERY, "Query Timed-out %lu %lu", cf_getns(), qtr->end_time);
 		qtr_set_err(qtr, AS_PROTO_RESULT_FAIL_QUERY_TIMEOUT, __FILE__, __LINE__);
 	}
@@ -734,6 +757,17 @@ query_update_stats(as_query_transaction *qtr)
 	qtr->ns->query_hist_active = true;
 	cf_hist_track_insert_data_point(qtr->ns->query_hist, qtr->start_time);
 
+	if (qtr->setname &&
+			cf_atomic32_get(qtr->ns->n_set_latency_enabled) != 0) {
+		uint16_t set_id = as_namespace_get_latency_set_id(qtr->ns,
+				qtr->setname, strlen(qtr->setname));
+
+		if (set_id != INVALID_SET_ID) {
+			cf_hist_track_insert_data_point(qtr->ns->set_query_hists[set_id],
+					qtr->start_time);
+		}
+	}
+
 	SINDEX_HIST_INSERT_DATA_POINT(qtr->si, query_hist, qtr->start_time);
 
 	if (qtr->querying_ai_time_ns) {
@@ -799,8 +833,10 @@ query_teardown(as_query_transaction *qtr)
 	if (qtr->srange)      as_sindex_range_free(&qtr->srange);
 	if (qtr->si)          AS_SINDEX_RELEASE(qtr->si);
 	if (qtr->binlist)     cf_vector_destroy(qtr->binlist);
+	if (qtr->predexp)     predexp_destroy(qtr->predexp);
 	if (qtr->setname)     cf_free(qtr->setname);
 	if (qtr->msgp)        cf_free(qtr->msgp);
+	if (qtr->comp)        as_comp_stream_destroy(qtr->comp);
 	pthread_mutex_destroy(&qtr->slock);
 }
 
@@ -950,9 +986,42 @@ query_netio_wait(as_query_transaction *qtr)
 	return (cf_atomic32_get(qtr->n_io_outstanding) > MAX_OUTSTANDING_IO_REQ) ? AS_QUERY_ERR : AS_QUERY_OK;
 }
 
+// Swaps the io's buffer for its compressed packet. Called with the buffer
+// mutex held, like the seq assignment, so packets are compressed in the order
+// the client gets them. On failure the packet just goes plain.
+static void
+query_netio_compress(as_query_transaction *qtr, as_netio *io)
+{
+	cf_buf_builder *bb_r = io->bb_r;
+
+	as_proto proto;
+	proto.version = PROTO_VERSION;
+	proto.type    = PROTO_TYPE_AS_MSG;
+	proto.sz      = bb_r->used_sz - 8;
+	as_proto_swap(&proto);
+
+	cf_buf_builder *bb_c = cf_buf_builder_create_size(sizeof(cf_buf_builder) +
+			as_comp_stream_bound(qtr->comp, bb_r->used_sz));
+	size_t sz = as_comp_stream_packet(qtr->comp, (uint8_t *)&proto, 8,
+			bb_r->buf + 8, bb_r->used_sz - 8, bb_c->buf);
+
+	if (sz == 0) {
+		cf_buf_builder_free(bb_c);
+		return;
+	}
+
+	bb_c->used_sz  = sz;
+	bb_poolrelease(bb_r);
+	io->bb_r       = bb_c;
+	io->compressed = true;
+}
+
+// Hands a whole result buffer to the network stage, and consumes it. Only the
+// seq assignment and compression are under the buffer mutex - netio itself
+// keeps packets in seq order.
 // Returns AS_NETIO_OK always
 static int
-query_netio(as_query_transaction *qtr)
+query_netio(as_query_transaction *qtr, cf_buf_builder *bb_r)
 {
 #if defined(USE_SYSTEMTAP)
 	uint64_t nodeid = g_config.self_node;
@@ -968,8 +1037,8 @@ query_netio(as_query_transaction *qtr)
 	qtr_reserve(qtr, __FILE__, __LINE__);
 	io.data        = qtr;
 
-	io.bb_r        = qtr->bb_r;
-	qtr->bb_r      = NULL;
+	io.bb_r        = bb_r;
+	io.compressed  = false;
 
 	cf_rc_reserve(qtr->fd_h);
 	io.fd_h        = qtr->fd_h;
@@ -977,17 +1046,60 @@ query_netio(as_query_transaction *qtr)
 	io.offset      = 0;
 
 	cf_atomic32_incr(&qtr->n_io_outstanding);
+
+	pthread_mutex_lock(&qtr->buf_mutex);
+
+	if (as_comp_stream_wants(qtr->comp, io.bb_r->used_sz)) {
+		query_netio_compress(qtr, &io);
+	}
+
 	io.seq         = cf_atomic32_incr(&qtr->netio_push_seq);
+
+	pthread_mutex_unlock(&qtr->buf_mutex);
+
 	io.start_time  = cf_getns();
 
 	int ret        = as_netio_send(&io, NULL, qtr->blocking);
-	qtr->bb_r      = bb_poolrequest();
-   	cf_buf_builder_reserve(&qtr->bb_r, 8, NULL);
 
 	ASD_QUERY_NETIO_FINISHED(nodeid, qtr->trid);
 
 	return ret;
 }
+
+/*
+ * Each worker thread builds results in its own buffer, without a lock, and
+ * hands it to netio whole when full, or at the end of each piece of work.
+ */
+static __thread cf_buf_builder *t_bb_r = NULL;
+
+static cf_buf_builder **
+query_worker_bb()
+{
+	if (!t_bb_r) {
+		if (!(t_bb_r = bb_poolrequest())) {
+			return NULL;
+		}
+		cf_buf_builder_reserve(&t_bb_r, 8, NULL);
+	}
+	return &t_bb_r;
+}
+
+static void
+query_worker_bb_flush(as_query_transaction *qtr)
+{
+	if (!t_bb_r || t_bb_r->used_sz <= 8) {
+		return;
+	}
+
+	if (qtr_failed(qtr) || !qtr->fd_h) {
+		// Nobody to send to - keep the buffer for the next work.
+		t_bb_r->used_sz = 8;
+		return;
+	}
+
+	query_netio(qtr, t_bb_r);
+	t_bb_r = NULL;
+}
 // **************************************************************************************************
 
 
@@ -1144,7 +1256,7 @@ hash_track_qtr(as_query_transaction *qtr)
  *	On success, qtr->n_result_records is incremented by 1.
  *
  * Synchronization -
- * 		Takes a lock over qtr->buf
+ * 		None - fills the worker thread's own buffer
  */
 static int
 query_add_response(void *void_qtr, as_index_ref *r_ref, as_storage_rd *rd)
@@ -1155,27 +1267,26 @@ query_add_response(void *void_qtr, as_index_ref *r_ref, as_storage_rd *rd)
 			qtr->binlist);
 	int ret = 0;
 
-	pthread_mutex_lock(&qtr->buf_mutex);
-	cf_buf_builder *bb_r = qtr->bb_r;
-	if (bb_r == NULL) {
-		// Assert that query is aborted if bb_r is found to be null
-		pthread_mutex_unlock(&qtr->buf_mutex);
+	cf_buf_builder **p_bb_r = query_worker_bb();
+	if (p_bb_r == NULL) {
 		return AS_QUERY_ERR;
 	}
 
-	if (msg_sz > (bb_r->alloc_sz - bb_r->used_sz) && bb_r->used_sz != 0) {
-		query_netio(qtr);
+	if (msg_sz > ((*p_bb_r)->alloc_sz - (*p_bb_r)->used_sz) && (*p_bb_r)->used_sz > 8) {
+		query_worker_bb_flush(qtr);
+		if ((p_bb_r = query_worker_bb()) == NULL) {
+			return AS_QUERY_ERR;
+		}
 	}
 
-	ret = as_msg_make_response_bufbuilder(r, rd, &qtr->bb_r, false,
+	ret = as_msg_make_response_bufbuilder(r, rd, p_bb_r, false,
 			NULL, false, true, true, qtr->binlist);
 	if (ret != 0) {
 		cf_warning(AS_QUERY, "Weird there is space but still the packing failed "
 				"available = %zd msg size = %zu",
-				bb_r->alloc_sz - bb_r->used_sz, msg_sz);
+				(*p_bb_r)->alloc_sz - (*p_bb_r)->used_sz, msg_sz);
 	}
 	cf_atomic64_incr(&qtr->n_result_records);
-	pthread_mutex_unlock(&qtr->buf_mutex);
 	return ret;
 }
 
@@ -1218,9 +1329,9 @@ query_add_fin(as_query_transaction *qtr)
 static int
 query_send_fin(as_query_transaction *qtr) {
 	// Send out the final data back
-	if (qtr->fd_h) {
-		query_add_fin(qtr);
-		query_netio(qtr);
+	if (qtr->fd_h && query_add_fin(qtr) == AS_QUERY_OK) {
+		query_netio(qtr, qtr->bb_r);
+		qtr->bb_r = NULL;
 	}
 	return AS_QUERY_OK;
 }
@@ -1373,6 +1484,30 @@ query_match_listele_foreach(as_val * val, void * udata)
  * possible that it returns digest for which record may have changed. Do the
  * validation before returning the row.
  */
+// The key holds part of the prefix digest, so compare the prefix in full.
+static bool
+query_record_matches_composite(as_query_transaction *qtr, as_storage_rd *rd, as_sindex_key * skey)
+{
+	as_sindex_metadata *imd = qtr->si->imd;
+	as_bin *prefix_bin      = as_bin_get_by_id(rd, imd->binid);
+	as_bin *range_bin       = as_bin_get_by_id(rd, imd->range_binid);
+	cf_digest prefix;
+	cf_digest key;
+
+	if (!prefix_bin || !range_bin ||
+			!as_sindex_composite_key(imd, prefix_bin, range_bin, &prefix, &key)) {
+		cf_debug(AS_QUERY, "query_record_matches: composite bins of index %s not found",
+				imd->iname);
+		return false;
+	}
+
+	int64_t value = as_bin_particle_integer_value(range_bin);
+
+	return memcmp(&prefix, &qtr->srange->prefix.digest, CF_DIGEST_KEY_SZ) == 0 &&
+			memcmp(&key, &skey->key.str_key, CF_DIGEST_KEY_SZ) == 0 &&
+			value >= qtr->srange->start.u.i64 && value <= qtr->srange->end.u.i64;
+}
+
 static bool
 query_record_matches(as_query_transaction *qtr, as_storage_rd *rd, as_sindex_key * skey)
 {
@@ -1380,6 +1515,10 @@ query_record_matches(as_query_transaction *qtr, as_storage_rd *rd, as_sindex_key
 	as_sindex_bin_data *start = &qtr->srange->start;
 	as_sindex_bin_data *end   = &qtr->srange->end;
 
+	if (as_sindex_is_composite(qtr->si->imd)) {
+		return query_record_matches_composite(qtr, rd, skey);
+	}
+
 	//TODO: Make it more general to support sindex over multiple bins	
 	as_bin * b = as_bin_get_by_id(rd, qtr->si->imd->binid);
 
@@ -1581,7 +1720,7 @@ query_io(as_query_transaction *qtr, cf_digest *dig, as_sindex_key * skey)
 	if (rec_rv == 0) {
 		as_index *r = r_ref.r;
 		// check to see this isn't an expired record waiting to die
-		if (as_record_is_expired(r)) {
+		if (as_record_is_doomed(r, ns)) {
 			as_record_done(&r_ref, ns);
 			cf_debug(AS_QUERY,
 					"build_response: record expired. treat as not found");
@@ -1589,6 +1728,13 @@ query_io(as_query_transaction *qtr, cf_digest *dig, as_sindex_key * skey)
 			// that server will never send a error result code to the query client.
 			goto CLEANUP;
 		}
+		predexp_args predargs = { .ns = ns, .md = r, .rd = NULL };
+		// skip the storage read if metadata alone fails the predicate
+		if (qtr->predexp &&
+				predexp_matches_metadata(qtr->predexp, &predargs) == PREDEXP_FALSE) {
+			as_record_done(&r_ref, ns);
+			goto CLEANUP;
+		}
 		// make sure it's brought in from storage if necessary
 		as_storage_rd rd;
 		as_storage_record_open(ns, r, &rd, &r->key);
@@ -1614,6 +1760,13 @@ query_io(as_query_transaction *qtr, cf_digest *dig, as_sindex_key * skey)
 			return AS_QUERY_OK;
 		}
 
+		predargs.rd = &rd;
+		if (qtr->predexp && !predexp_matches_record(qtr->predexp, &predargs)) {
+			as_storage_record_close(r, &rd);
+			as_record_done(&r_ref, ns);
+			goto CLEANUP;
+		}
+
 		int ret = query_add_response(qtr, &r_ref, &rd);
 		if (ret != 0) {
 			as_storage_record_close(r, &rd);
@@ -1661,26 +1814,25 @@ query_add_val_response(void *void_qtr, const as_val *val, bool success)
 
 	int ret = 0;
 
-	pthread_mutex_lock(&qtr->buf_mutex);
-	cf_buf_builder *bb_r = qtr->bb_r;
-	if (bb_r == NULL) {
-		// Assert that query is aborted if bb_r is found to be null
-		pthread_mutex_unlock(&qtr->buf_mutex);
+	cf_buf_builder **p_bb_r = query_worker_bb();
+	if (p_bb_r == NULL) {
 		return AS_QUERY_ERR;
 	}
 
-	if (msg_sz > (bb_r->alloc_sz - bb_r->used_sz) && bb_r->used_sz != 0) {
-		query_netio(qtr);
+	if (msg_sz > ((*p_bb_r)->alloc_sz - (*p_bb_r)->used_sz) && (*p_bb_r)->used_sz > 8) {
+		query_worker_bb_flush(qtr);
+		if ((p_bb_r = query_worker_bb()) == NULL) {
+			return AS_QUERY_ERR;
+		}
 	}
 
-	ret = as_msg_make_val_response_bufbuilder(val, &qtr->bb_r, msg_sz, success);
+	ret = as_msg_make_val_response_bufbuilder(val, p_bb_r, msg_sz, success);
 	if (ret != 0) {
 		cf_warning(AS_QUERY, "Weird there is space but still the packing failed "
 				"available = %zd msg size = %d",
-				bb_r->alloc_sz - bb_r->used_sz, msg_sz);
+				(*p_bb_r)->alloc_sz - (*p_bb_r)->used_sz, msg_sz);
 	}
 	cf_atomic64_incr(&qtr->n_result_records);
-	pthread_mutex_unlock(&qtr->buf_mutex);
 	return ret;
 }
 
@@ -1774,10 +1926,35 @@ agg_record_matches(void *udata, udf_record *urecord, void *key_data)
 	as_query_transaction * qtr = (as_query_transaction*)udata;
 	as_sindex_key *skey        = (void *)key_data;
 	qtr->n_read_success++;
+
+	// Metadata terms first - they need no bins, so a miss costs no bin loads
+	// and never reaches the stream.
+	predexp_retval predexp_result = PREDEXP_TRUE;
+	if (qtr->predexp) {
+		predexp_args predargs = { .ns = qtr->ns, .md = urecord->r_ref->r,
+				.rd = NULL };
+		predexp_result = predexp_matches_metadata(qtr->predexp, &predargs);
+		if (predexp_result == PREDEXP_FALSE) {
+			return false;
+		}
+	}
+
+	// Bins may be deferred - load only those the index check reads.
+	as_sindex_metadata *imd = qtr->si->imd;
+	uint16_t sindex_ids[2] = { (uint16_t)imd->binid, (uint16_t)imd->range_binid };
+	udf_storage_record_load_some_bins(urecord, sindex_ids,
+			as_sindex_is_composite(imd) ? 2 : 1);
+
 	if (query_record_matches(qtr, urecord->rd, skey) == false) {
 		cf_atomic64_incr(&g_stats.query_false_positives); // PUT IT INSIDE PRE_CHECK
 		return false;
 	}
+	if (predexp_result == PREDEXP_UNKNOWN) {
+		udf_storage_record_load_bins(urecord);
+		predexp_args predargs = { .ns = qtr->ns, .md = urecord->r_ref->r,
+				.rd = urecord->rd };
+		return predexp_matches_record(qtr->predexp, &predargs);
+	}
 	return true;
 }
 
@@ -1831,7 +2008,7 @@ query_udf_bg_tr_start(as_query_transaction *qtr, cf_digest *keyd)
 	qtr_reserve(qtr, __FILE__, __LINE__);
 	cf_atomic32_incr(&qtr->n_udf_tr_queued);
 
-	thr_tsvc_enqueue(&tr);
+	thr_tsvc_process_or_enqueue_iudf(&tr);
 
 	return AS_QUERY_OK;
 }
@@ -1991,6 +2168,8 @@ qwork_process(query_work *qworkp)
 			cf_warning(AS_QUERY, "Unsupported query type %d.. Dropping it", qworkp->type);
 			break;
 	}
+	// Before the work is finished, so results go out ahead of the fin.
+	query_worker_bb_flush(qworkp->qtr);
 	return ret;
 }
 
@@ -2039,6 +2218,7 @@ qwork_th(void *q_to_wait_on)
 {
 	unsigned int         thread_id = cf_atomic32_incr(&g_query_worker_threadcnt);
 	cf_detail(AS_QUERY, "Created Query Worker Thread %d", thread_id);
+	as_config_sched_thread(AS_SCHED_POOL_QUERY, pthread_self());
 	query_work   * qworkp     = NULL;
 	int                  ret       = AS_QUERY_OK;
 
@@ -2078,6 +2258,131 @@ qwork_th(void *q_to_wait_on)
  * Query Generator
  */
 // **************************************************************************************************
+/*
+ * Top-N pushdown -
+ * 		The client's QUERY_LIMIT field asks for only the lowest (or highest)
+ * 		limit keys in the range. Each physical tree is walked once in that
+ * 		direction, stopping after limit digests, and the candidates of all the
+ * 		trees are merged here so only the overall top limit are read.
+ *
+ * 		Records are still filtered (predexp, stale entries) after the merge,
+ * 		so a query may return fewer than limit records. For string bins the
+ * 		keys are digests, so which limit records does not follow bin order.
+ */
+typedef struct query_topn_ele_s {
+	as_sindex_key  skey;
+	cf_digest      dig;
+} query_topn_ele;
+
+static int
+query_topn_cmp_int(const void *pa, const void *pb)
+{
+	int64_t a = (int64_t)((const query_topn_ele *)pa)->skey.key.int_key;
+	int64_t b = (int64_t)((const query_topn_ele *)pb)->skey.key.int_key;
+
+	return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+static int
+query_topn_cmp_str(const void *pa, const void *pb)
+{
+	return memcmp(&((const query_topn_ele *)pa)->skey.key.str_key,
+			&((const query_topn_ele *)pb)->skey.key.str_key, CF_DIGEST_KEY_SZ);
+}
+
+static int
+query_topn_append(cf_ll *recl, const query_topn_ele *eles, uint32_t n_eles)
+{
+	for (uint32_t i = 0; i < n_eles; i += AS_INDEX_KEYS_PER_ARR) {
+		as_index_keys_arr *keys_arr = as_index_get_keys_arr();
+		if (!keys_arr) {
+			return -1;
+		}
+
+		as_index_keys_ll_element *node = cf_malloc(sizeof(as_index_keys_ll_element));
+		if (!node) {
+			as_index_keys_release_arr_to_queue(keys_arr);
+			return -1;
+		}
+
+		uint32_t n = n_eles - i < AS_INDEX_KEYS_PER_ARR ?
+				n_eles - i : AS_INDEX_KEYS_PER_ARR;
+
+		for (uint32_t j = 0; j < n; j++) {
+			keys_arr->sindex_keys[j] = eles[i + j].skey;
+			keys_arr->pindex_digs[j] = eles[i + j].dig;
+		}
+		keys_arr->num = n;
+
+		node->keys_arr = keys_arr;
+		cf_ll_append(recl, (cf_ll_element *)node);
+	}
+	return 0;
+}
+
+/*
+ * Function query_select_topn
+ *
+ * Notes -
+ * 		Trims qctx->recl, which holds up to limit candidates per physical
+ * 		tree, to the overall top limit - in order, lowest or highest first.
+ */
+static int
+query_select_topn(as_query_transaction *qtr)
+{
+	as_sindex_qctx *qctx = &qtr->qctx;
+
+	if (qctx->n_bdigs == 0) {
+		return AS_QUERY_OK;
+	}
+
+	query_topn_ele *eles = cf_malloc(sizeof(query_topn_ele) * qctx->n_bdigs);
+	if (!eles) {
+		qtr_set_err(qtr, AS_PROTO_RESULT_FAIL_UNKNOWN, __FILE__, __LINE__);
+		return AS_QUERY_ERR;
+	}
+
+	uint32_t n_eles = 0;
+	for (cf_ll_element *ele = cf_ll_get_head(qctx->recl); ele; ele = ele->next) {
+		as_index_keys_arr *keys_arr = ((as_index_keys_ll_element *)ele)->keys_arr;
+
+		for (uint32_t i = 0; i < keys_arr->num && n_eles < qctx->n_bdigs; i++) {
+			eles[n_eles].skey = keys_arr->sindex_keys[i];
+			eles[n_eles].dig  = keys_arr->pindex_digs[i];
+			n_eles++;
+		}
+	}
+
+	qsort(eles, n_eles, sizeof(query_topn_ele),
+			C_IS_Y(qtr->si->imd->dtype) ? query_topn_cmp_str : query_topn_cmp_int);
+
+	uint32_t n_top = n_eles < qctx->limit ? n_eles : qctx->limit;
+	query_topn_ele *top = eles;
+
+	if (qctx->desc) {
+		// Highest first
+		top = eles + n_eles - n_top;
+		for (uint32_t i = 0; i < n_top / 2; i++) {
+			query_topn_ele t = top[i];
+			top[i] = top[n_top - 1 - i];
+			top[n_top - 1 - i] = t;
+		}
+	}
+
+	cf_ll_reduce(qctx->recl, true /*forward*/, as_index_keys_ll_reduce_fn, NULL);
+
+	int ret = query_topn_append(qctx->recl, top, n_top);
+	cf_free(eles);
+
+	if (ret != 0) {
+		qtr_set_err(qtr, AS_PROTO_RESULT_FAIL_UNKNOWN, __FILE__, __LINE__);
+		return AS_QUERY_ERR;
+	}
+
+	qctx->n_bdigs = n_top;
+	return AS_QUERY_OK;
+}
+
 /*
  * Function query_get_nextbatch
  *
@@ -2127,10 +2432,17 @@ query_get_nextbatch(as_query_transaction *qtr)
 		// Following condition may be true if the
 		// query has moved from short query pool to
 		// long running query pool
-		if (qctx->n_bdigs >= qctx->bsize)
+		if (qctx->n_bdigs >= qctx->bsize && !qctx->limit)
 			return ret;
 	}
 
+	// Top-N - gather at most limit from each tree, all in the same batch
+	if (qctx->limit) {
+		qctx->bsize          = qctx->n_bdigs + qctx->limit;
+		qctx->new_ibtr       = true;
+		qctx->nbtr_done      = false;
+	}
+
 	// Query Aerospike Index
 	int      qret            = as_sindex_query(qtr->si, srange, &qtr->qctx);
 	cf_detail(AS_QUERY, "start %ld end %ld @ %d pimd found %"PRIu64, srange->start.u.i64, srange->end.u.i64, qctx->pimd_idx, qctx->n_bdigs);
@@ -2149,7 +2461,7 @@ query_get_nextbatch(as_query_transaction *qtr)
 			SINDEX_HIST_INSERT_DATA_POINT(qtr->si, query_batch_lookup, time_ns);
 		}
 	}
-	if (qctx->n_bdigs < qctx->bsize) {
+	if (qctx->n_bdigs < qctx->bsize || qctx->limit) {
 		qctx->new_ibtr       = true;
 		qctx->nbtr_done      = false;
 		qctx->pimd_idx++;
@@ -2179,6 +2491,12 @@ query_get_nextbatch(as_query_transaction *qtr)
 		goto batchout;
 	}
 batchout:
+	if (ret == AS_QUERY_DONE && qctx->limit) {
+		ret = query_select_topn(qtr);
+		if (ret == AS_QUERY_OK) {
+			ret = AS_QUERY_DONE;
+		}
+	}
 	return ret;
 }
 
@@ -2219,6 +2537,13 @@ query_run_setup(as_query_transaction *qtr)
 	qtr->qctx.range_index         = 0;
 	qtr->qctx.partitions_pre_reserved = g_config.partitions_pre_reserved;
 	qtr->qctx.bkey                = &qtr->bkey;
+	qtr->qctx.limit               = qtr->limit;
+	qtr->qctx.desc                = qtr->limit_desc;
+	// Lookups can start I/O on digests while the batch is still being found,
+	// unless top-N, which has to have all the candidates to merge first
+	qtr->qctx.stream_fn           = qtr->job_type == QUERY_TYPE_LOOKUP && !qtr->limit ?
+			query_stream_keys : NULL;
+	qtr->qctx.stream_udata        = (void *)qtr;
 	init_ai_obj(qtr->qctx.bkey);
 	bzero(&qtr->qctx.bdig, sizeof(cf_digest));
 	// Populate all the paritions for which this partition is query-able
@@ -2229,8 +2554,16 @@ query_run_setup(as_query_transaction *qtr)
 	cf_buf_builder_reserve(&qtr->bb_r, 8, NULL);
 
 	qtr_set_running(qtr);
-	cf_atomic64_incr(&qtr->ns->query_short_reqs);
-	cf_atomic32_incr(&g_query_short_running);
+
+	if (qtr->short_running) {
+		cf_atomic64_incr(&qtr->ns->query_short_reqs);
+		cf_atomic32_incr(&g_query_short_running);
+	}
+	else {
+		qtr->qctx.bsize = query_long_bsize(qtr);
+		cf_atomic64_incr(&qtr->ns->query_long_reqs);
+		cf_atomic32_incr(&g_query_long_running);
+	}
 
 	// This needs to be distant from the initialization of nodeid to
 	// workaround a lame systemtap/compiler interaction.
@@ -2340,7 +2673,7 @@ query_qtr_check_and_requeue(as_query_transaction *qtr)
 			&& qtr->short_running) {
 		qtr->short_running       = false;
 		// Change batch size to the long running job batch size value
-		qtr->qctx.bsize          = g_config.query_bsize;
+		qtr->qctx.bsize          = query_long_bsize(qtr);
 		cf_atomic32_decr(&g_query_short_running);
 		cf_atomic32_incr(&g_query_long_running);
 		cf_atomic64_incr(&qtr->ns->query_long_reqs);
@@ -2424,6 +2757,54 @@ qtr_process(as_query_transaction *qtr)
 	return AS_QUERY_OK;
 }
 
+/*
+ * Function query_stream_keys
+ *
+ * Notes -
+ * 		Called from the sindex walk, under the sindex lock, each time a keys
+ * 		array in qctx->recl fills. Queues what's been found so far to the I/O
+ * 		workers and leaves an empty list to carry on with. The batch (hence
+ * 		n_bdigs, and the resume point) is unaffected.
+ *
+ * 		Only long running queries stream, and only while the worker queue has
+ * 		room for this query - otherwise the digests stay in recl as before,
+ * 		bounded by the batch size.
+ */
+static void
+query_stream_keys(void *udata)
+{
+	as_query_transaction *qtr = (as_query_transaction *)udata;
+
+	// Work done inline would be done under the sindex lock - don't.
+	if (query_process_inline(qtr)) {
+		return;
+	}
+
+	cf_ll *recl = cf_malloc(sizeof(cf_ll));
+	if (!recl) {
+		return;
+	}
+
+	query_work *qworkp = qwork_poolrequest();
+	if (!qworkp) {
+		cf_free(recl);
+		return;
+	}
+	cf_ll_init(recl, as_index_keys_ll_destroy_fn, false /*no lock*/);
+
+	cf_atomic32_incr(&qtr->n_qwork_active);
+	qtr_reserve(qtr, __FILE__, __LINE__);
+	qworkp->qtr               = qtr;
+	qworkp->type              = QUERY_WORK_TYPE_LOOKUP;
+	qworkp->recl              = qtr->qctx.recl;
+	qworkp->queued_time_ns    = cf_getns();
+	qtr->qctx.recl            = recl;
+
+	if (cf_queue_push(g_query_work_queue, &qworkp)) {
+		cf_crash(AS_QUERY, "Push into Query Work Queue fail ... !!!");
+	}
+}
+
 static int
 query_check_bound(as_query_transaction *qtr)
 {
@@ -2432,6 +2813,29 @@ query_check_bound(as_query_transaction *qtr)
 	}
 	return AS_QUERY_OK;
 }
+
+// Sleeps at most a pacer burst - returns true if the caller should recheck
+// before getting the next batch.
+static bool
+query_pacer_wait()
+{
+	uint64_t due_us = as_job_pacer_due(&g_query_pacer,
+			g_config.query_max_records_per_sec);
+	uint64_t bg_due_us = as_job_pacer_due(&g_background_pacer,
+			g_config.background_max_records_per_sec);
+
+	return as_job_pacer_wait(bg_due_us > due_us ? bg_due_us : due_us);
+}
+
+static void
+query_pacer_charge(uint64_t n_records)
+{
+	as_job_pacer_charge(&g_query_pacer, n_records,
+			g_config.query_max_records_per_sec);
+	as_job_pacer_charge(&g_background_pacer, n_records,
+			g_config.background_max_records_per_sec);
+}
+
 /*
  * Function query_generator
  *
@@ -2492,7 +2896,13 @@ query_generator(as_query_transaction *qtr)
 			continue;
 		}
 
-		// Step 5: Get Next Batch
+		// Step 5: Wait out the records-per-second budgets. Long running
+		//         queries only, short ones are bounded anyway
+		if (!qtr->short_running && query_pacer_wait()) {
+			continue;
+		}
+
+		// Step 6: Get Next Batch
 		loop++;
 		int qret    = query_get_nextbatch(qtr);
 
@@ -2519,7 +2929,11 @@ query_generator(as_query_transaction *qtr)
 			qtr_set_done(qtr, AS_PROTO_RESULT_OK, __FILE__, __LINE__);
 		}
 
-		// Step 6: Prepare Query Request either to process inline or for
+		if (!qtr->short_running) {
+			query_pacer_charge(qtr->qctx.n_bdigs);
+		}
+
+		// Step 7: Prepare Query Request either to process inline or for
 		//         queueing up for offline processing
 		if (qtr_process(qtr)) {
 			qtr_set_err(qtr, AS_PROTO_RESULT_FAIL_QUERY_CBERROR, __FILE__, __LINE__);
@@ -2556,6 +2970,7 @@ query_th(void* q_to_wait_on)
 	cf_queue *           query_queue = (cf_queue*)q_to_wait_on;
 	unsigned int         thread_id    = cf_atomic32_incr(&g_query_threadcnt);
 	cf_detail(AS_QUERY, "Query Thread Created %d", thread_id);
+	as_config_sched_thread(AS_SCHED_POOL_QUERY, pthread_self());
 	as_query_transaction *qtr         = NULL;
 
 	while (1) {
@@ -2658,6 +3073,8 @@ query_setup_fd(as_query_transaction *qtr, as_transaction *tr)
 		case QUERY_TYPE_AGGR:
 			qtr->fd_h                = tr->from.proto_fd_h;
 			qtr->fd_h->fh_info      |= FH_INFO_DONOT_REAP;
+			qtr->comp                = as_comp_stream_create(
+					as_transaction_response_compression(tr));
 			break;
 		case QUERY_TYPE_UDF_BG:
 			qtr->fd_h  = NULL;
@@ -2697,6 +3114,7 @@ query_setup(as_transaction *tr, as_namespace *ns, as_query_transaction **qtrp)
 	cf_vector *binlist      = 0;
 	as_sindex_range *srange = 0;
 	char *setname           = NULL;
+	predexp_eval *predexp   = NULL;
 	as_query_transaction *qtr = NULL;
 
 	bool has_sindex   = as_sindex_ns_has_sindex(ns);
@@ -2752,6 +3170,32 @@ query_setup(as_transaction *tr, as_namespace *ns, as_query_transaction **qtrp)
 		goto Cleanup;
 	}
 
+	// Optional predicate to filter the index results
+	if (as_transaction_has_predexp(tr)) {
+		as_msg_field *pfp = as_msg_field_get(&tr->msgp->msg,
+				AS_MSG_FIELD_TYPE_PREDEXP);
+		if ((predexp = predexp_build(pfp)) == NULL) {
+			cf_warning(AS_QUERY, "Query has malformed predexp field");
+			tr->result_code = AS_PROTO_RESULT_FAIL_PARAMETER;
+			goto Cleanup;
+		}
+	}
+
+	// Optional top-N - limit, and whether from the high end of the range
+	uint32_t limit = 0;
+	bool limit_desc = false;
+	if (as_transaction_has_query_limit(tr)) {
+		as_msg_field *lfp = as_msg_field_get(&tr->msgp->msg,
+				AS_MSG_FIELD_TYPE_QUERY_LIMIT);
+		if (as_msg_field_get_value_sz(lfp) != sizeof(uint32_t) + 1) {
+			cf_warning(AS_QUERY, "Query has malformed limit field");
+			tr->result_code = AS_PROTO_RESULT_FAIL_PARAMETER;
+			goto Cleanup;
+		}
+		limit = cf_swap_from_be32(*(uint32_t *)lfp->data);
+		limit_desc = (lfp->data[sizeof(uint32_t)] & AS_MSG_QUERY_LIMIT_DESC) != 0;
+	}
+
 	if (!has_sindex || !si) {
 		tr->result_code = AS_PROTO_RESULT_FAIL_INDEX_NOTFOUND;
 		goto Cleanup;
@@ -2809,6 +3253,9 @@ query_setup(as_transaction *tr, as_namespace *ns, as_query_transaction **qtrp)
 	qtr->si                  = si;
 	qtr->srange              = srange;
 	qtr->binlist             = binlist;
+	qtr->predexp             = predexp;
+	qtr->limit               = limit;
+	qtr->limit_desc          = limit_desc;
 	qtr->start_time          = start_time;
 	qtr->end_time            = tr->end_time;
 	qtr->msgp                = tr->msgp;
@@ -2819,7 +3266,11 @@ query_setup(as_transaction *tr, as_namespace *ns, as_query_transaction **qtrp)
 	pthread_mutex_init(&qtr->slock, NULL);
 	qtr->state         = AS_QTR_STATE_INIT;
 	qtr->do_requeue    = false;
-	qtr->short_running = true;
+	// Queries expected to find more than the threshold go straight to the
+	// long running pool, rather than holding up short ones until they get
+	// there. Top-N queries only read the top limit.
+	qtr->short_running = (limit != 0 && limit <= g_config.query_threshold) ||
+			as_sindex_estimate_n_objects(si, srange) <= g_config.query_threshold;
 
 	*qtrp = qtr;
 	return rv;
@@ -2830,6 +3281,7 @@ Cleanup:
 	if (si)          AS_SINDEX_RELEASE(si);
 	if (srange)      as_sindex_range_free(&srange);
 	if (binlist)     cf_vector_destroy(binlist);
+	if (predexp)     predexp_destroy(predexp);
 	return rv;
 }
 
@@ -3132,6 +3584,7 @@ as_query_gconfig_default(as_config *c)
 	c->query_priority            = 10;
 	c->query_sleep_us            = 1;
 	c->query_bsize               = QUERY_BATCH_SIZE;
+	c->query_aggr_bsize          = QUERY_AGGR_BATCH_SIZE;
 	c->query_in_transaction_thr  = 0;
 	c->query_req_max_inflight    = AS_QUERY_MAX_QREQ_INFLIGHT;
 	c->query_bufpool_size        = AS_QUERY_MAX_BUFS;
@@ -63,7 +63,7 @@
 #include "base/stats.h"
 
 
-int as_sbld_build(as_sindex* si);
+void as_sbld_build(as_namespace* ns, as_sindex** sis, uint32_t n_sis);
 
 #define RELEASE_ITERATORS(icol) \
 do {                                \
@@ -152,25 +152,65 @@ as_sindex_gc_histogram_dumpall()
 	return;
 }
 
-// Main thread which looks at the request of the populating index
+// Main thread which looks at the request of the populating index. Requests
+// queued together (e.g. several indexes created by one SMD merge) are drained
+// as a batch, and each namespace's share of the batch is populated by a single
+// build job - one pass over the namespace rather than one per index.
 void *
 as_sindex__populate_fn(void *param)
 {
+	as_sindex *batch[AS_SINDEX_MAX];
+	as_sindex *deferred[AS_SINDEX_MAX];
+
 	while(1) {
+		uint32_t n_batch = 0;
+		uint32_t n_deferred = 0;
 		as_sindex *si;
-		cf_queue_pop(g_sindex_populate_q, &si, CF_QUEUE_FOREVER);
-		// TODO should check flag under a lock
-		// conflict with as_sindex_repair
-		if (si->flag & AS_SINDEX_FLAG_POPULATING) {
-			// Earlier job to populate index is still going on, push it back
-			// into the queue to look at it later. this is problem only when
-			// there are multiple populating threads currently there is only 1.
-			cf_queue_push(g_sindex_populate_q, &si);
-		} else {
-			cf_debug(AS_SINDEX, "Populating index %s", si->imd->iname);
-			// should set under a lock
-			si->flag |= AS_SINDEX_FLAG_POPULATING;
-			as_sbld_build(si);
+		int rv = cf_queue_pop(g_sindex_populate_q, &si, CF_QUEUE_FOREVER);
+
+		while (rv == CF_QUEUE_OK) {
+			// TODO should check flag under a lock
+			// conflict with as_sindex_repair
+			if (si->flag & AS_SINDEX_FLAG_POPULATING) {
+				// Earlier job to populate index is still going on, push it
+				// back into the queue to look at it later.
+				deferred[n_deferred++] = si;
+			} else {
+				cf_debug(AS_SINDEX, "Populating index %s", si->imd->iname);
+				// should set under a lock
+				si->flag |= AS_SINDEX_FLAG_POPULATING;
+				batch[n_batch++] = si;
+			}
+
+			if (n_batch == AS_SINDEX_MAX || n_deferred == AS_SINDEX_MAX) {
+				break;
+			}
+
+			rv = cf_queue_pop(g_sindex_populate_q, &si, CF_QUEUE_NOWAIT);
+		}
+
+		// Group the batch by namespace, preserving queue order.
+		while (n_batch != 0) {
+			as_namespace *ns = batch[0]->ns;
+			as_sindex *group[AS_SINDEX_MAX];
+			uint32_t n_group = 0;
+			uint32_t n_rest = 0;
+
+			for (uint32_t i = 0; i < n_batch; i++) {
+				if (batch[i]->ns == ns) {
+					group[n_group++] = batch[i];
+				}
+				else {
+					batch[n_rest++] = batch[i];
+				}
+			}
+
+			as_sbld_build(ns, group, n_group);
+			n_batch = n_rest;
+		}
+
+		for (uint32_t i = 0; i < n_deferred; i++) {
+			cf_queue_push(g_sindex_populate_q, &deferred[i]);
 		}
 	}
 	return NULL;
@@ -192,7 +232,7 @@ as_sindex__destroy_fn(void *param)
 		if (rv) {
 			cf_warning(AS_SINDEX, "Delete from set_binid hash fails with error %d", rv);
 		}
-		SINDEX_WLOCK(&si->imd->slock);
+		SINDEX_IMD_WLOCK(si->imd);
 		ai_btree_destroy(si->imd);
 		// Free entire usage counter for this index after the destroy
 		// code... alc code does not do it.
@@ -216,7 +256,7 @@ as_sindex__destroy_fn(void *param)
 		// remember this is going to release the write lock
 		// of meta-data first. This is the only special case
 		// where both GLOCK and LOCK is called together
-		SINDEX_UNLOCK(&imd->slock);
+		SINDEX_IMD_WUNLOCK(imd);
 		SINDEX_GUNLOCK();
 
 		if (si->new_imd) {
@@ -343,6 +383,11 @@ get_pimd_and_reserve_si(as_namespace *ns, int *si_index, int *p_index, as_sindex
  * Controlling parameters   : Modifiable through clinfo
  * 1. defrag_max_units      - Max units it will defrag in one iteration(i.e before sleeping) default -- 1000 units
  * 2. defrag_period(ms)     - Minimum time delay between two iteration of sindex defrag.     default -- 1    msec
+ * 3. defrag_max_rate       - Max units validated per second, across iterations.           default -- 0 (no limit)
+ *
+ * Each iteration resumes from a cursor (key, offset within the key's digests)
+ * and holds the pimd lock for at most 100 units at a time, so a pass over a
+ * large sindex is spread out rather than done in one sweep.
  *
  * Takes a lock on pimd while defragging
  * TODO : Aerospike Index layer is probably doing a lot of mallocs and copy.
@@ -426,6 +471,13 @@ as_sindex__defrag_fn(void *udata)
 			limit          = (long)si->config.defrag_max_units;
 			defrag_period  = (long)si->config.defrag_period;
 
+			uint32_t max_rate = si->config.defrag_max_rate;
+
+			// An iteration is then at most a second's worth of the rate.
+			if (max_rate != 0 && limit > (long)max_rate) {
+				limit = (long)max_rate;
+			}
+
 			// This can be use to control the defrag thread.
 			// Setting defrag_max_units as 0 can allow a user
 			// to stop defragging of a sindex
@@ -442,20 +494,24 @@ as_sindex__defrag_fn(void *udata)
 			uint64_t pimd_rlock_time_ns = 0;
 			uint64_t processed          = 0;
 			uint64_t found              = 0;
+			uint64_t lock_time_ns       = 0;
+			uint64_t step_start_us      = cf_getus();
 			start_time                  = cf_getms();
 			cf_ll defrag_list;
 			cf_ll_init(&defrag_list, &ll_sindex_gc_destroy_fn, false);
 			int ret = 0;
 			int limit_per_iteration = limit > 100 ? 100 : limit;
 			for (int i = 0; i < limit; i += limit_per_iteration) {
-				SINDEX_RLOCK(&si->imd->slock);
+				SINDEX_IMD_RLOCK(si->imd);
 				pimd = &si->imd->pimd[p_index];
 				SINDEX_RLOCK(&pimd->slock);
+				uint64_t lock_start_ns = cf_getns();
 				SET_TIME_FOR_SINDEX_GC_HIST(pimd_rlock_time_ns);
 				ret  = ai_btree_build_defrag_list(si->imd, pimd, &i_col, &n_offset, limit_per_iteration, &processed, &found, &defrag_list);
 				SINDEX_GC_HIST_INSERT_DATA_POINT(sindex_gc_pimd_rlock_hist, pimd_rlock_time_ns);
+				lock_time_ns += cf_getns() - lock_start_ns;
 				SINDEX_UNLOCK(&pimd->slock);
-				SINDEX_UNLOCK(&si->imd->slock);
+				SINDEX_IMD_RUNLOCK(si->imd);
 				pimd_rlock_time_ns = 0;
 				if (ret != AS_SINDEX_CONTINUE) {
 					break;
@@ -465,6 +521,7 @@ as_sindex__defrag_fn(void *udata)
 			g_stats.sindex_gc_list_creation_time    += (cf_getms() - start_time);
 			g_stats.sindex_gc_objects_validated     += processed;
 			g_stats.sindex_gc_garbage_found         += found;
+			cf_atomic64_add(&si->stats.n_gc_validated, processed);
 			int listsize                             = cf_ll_size(&defrag_list);
 
 			uint64_t deleted = 0;
@@ -475,14 +532,16 @@ as_sindex__defrag_fn(void *udata)
 				uint64_t pimd_wlock_time_ns = 0;
 				bool     more               = true;
 				while (more) {
-					SINDEX_RLOCK(&si->imd->slock);
+					SINDEX_IMD_RLOCK(si->imd);
 					pimd = &si->imd->pimd[p_index];
 					SINDEX_WLOCK(&pimd->slock);
+					uint64_t lock_start_ns = cf_getns();
 					SET_TIME_FOR_SINDEX_GC_HIST(pimd_wlock_time_ns);
 					more = ai_btree_defrag_list(si->imd, pimd, &defrag_list, wl_lim, &deleted);
 					SINDEX_GC_HIST_INSERT_DATA_POINT(sindex_gc_pimd_wlock_hist, pimd_wlock_time_ns);
+					lock_time_ns += cf_getns() - lock_start_ns;
 					SINDEX_UNLOCK(&pimd->slock);
-					SINDEX_UNLOCK(&si->imd->slock);
+					SINDEX_IMD_RUNLOCK(si->imd);
 					pimd_wlock_time_ns = 0;
 				}
 				cf_detail(AS_SINDEX, "Deleted %d units of attempted %ld units from index %s", listsize, limit, si->imd->iname);
@@ -493,11 +552,31 @@ as_sindex__defrag_fn(void *udata)
 			if ((ret == AS_SINDEX_DONE) || (ret == AS_SINDEX_ERR)) {
 				RELEASE_ITERATORS(icol)
 				p_index++;
+
+				if (p_index >= ns->sindex_num_partitions) {
+					cf_atomic64_incr(&si->stats.gc_cycles);
+					cf_atomic32_set(&si->stats.gc_pimd_ix, 0);
+				}
+				else {
+					cf_atomic32_set(&si->stats.gc_pimd_ix, p_index);
+				}
 			}
 			g_stats.sindex_gc_list_deletion_time += (cf_getms() - start_time);
 			g_stats.sindex_gc_garbage_cleaned    += deleted;
+			cf_atomic64_add(&si->stats.gc_lock_time, lock_time_ns / 1000);
 
 			AS_SINDEX_RELEASE(si);
+
+			// Pay for this iteration's units before the next.
+			if (max_rate != 0) {
+				uint64_t due_us     = (processed * 1000000) / max_rate;
+				uint64_t elapsed_us = cf_getus() - step_start_us;
+
+				if (due_us > elapsed_us) {
+					g_stats.sindex_gc_inactivity_dur += (due_us - elapsed_us) / 1000;
+					usleep(due_us - elapsed_us);
+				}
+			}
 		}
 next_ns:
 		sleep(1);
@@ -577,15 +656,18 @@ typedef struct sbld_job_s {
 	// Base object must be first:
 	as_job			_base;
 
-	// Derived class data:
-	as_sindex*		si;
-	uint64_t		si_desync_cnt;
+	// Derived class data - no sindexes means build all of the namespace's:
+	uint32_t		n_sis;
+	as_sindex*		sis[AS_SINDEX_MAX];
+	uint64_t		si_desync_cnts[AS_SINDEX_MAX];
 
 	char*			si_name;
 	cf_atomic64		n_reduced;
 } sbld_job;
 
-sbld_job* sbld_job_create(as_namespace* ns, uint16_t set_id, as_sindex* si);
+sbld_job* sbld_job_create(as_namespace* ns, uint16_t set_id, as_sindex** sis,
+		uint32_t n_sis);
+static void sbld_build_failed(as_sindex** sis, uint32_t n_sis);
 
 // as_job_manager instance for secondary index builder:
 static as_job_manager g_sbld_manager;
@@ -601,50 +683,71 @@ as_sbld_init()
 	// TODO - config for max done?
 	// Initialize with maximum threads since first use is always build-all at
 	// startup. The thread pool will be down-sized right after that.
-	as_job_manager_init(&g_sbld_manager, UINT_MAX, 100, MAX_SINDEX_BUILDER_THREADS);
+	as_job_manager_init(&g_sbld_manager, UINT_MAX, 100, MAX_SINDEX_BUILDER_THREADS,
+			AS_SCHED_POOL_NONE);
 }
 
-int
-as_sbld_build(as_sindex* si)
+// Populates the given sindexes, all in namespace ns, with one build job. The
+// job is scoped to a set only if every sindex is on the same set.
+void
+as_sbld_build(as_namespace* ns, as_sindex** sis, uint32_t n_sis)
 {
-	as_sindex_metadata *imd = si->imd;
-	as_namespace *ns = as_namespace_get_byname(imd->ns_name);
-
 	if (! ns) {
-		cf_warning(AS_SINDEX, "sindex build %s ns %s - unrecognized namespace", imd->iname, imd->ns_name);
-		as_sindex_populate_done(si);
-		AS_SINDEX_RELEASE(si);
-		return -1;
+		cf_warning(AS_SINDEX, "sindex build %s - unrecognized namespace", sis[0]->imd->iname);
+		sbld_build_failed(sis, n_sis);
+		return;
 	}
 
+	as_sindex* build_sis[AS_SINDEX_MAX];
+	uint32_t n_build_sis = 0;
 	uint16_t set_id = INVALID_SET_ID;
+	bool same_set = true;
+
+	for (uint32_t i = 0; i < n_sis; i++) {
+		as_sindex_metadata *imd = sis[i]->imd;
+		uint16_t si_set_id = INVALID_SET_ID;
+
+		if (imd->set && (si_set_id = as_namespace_get_set_id(ns, imd->set)) == INVALID_SET_ID) {
+			cf_info(AS_SINDEX, "sindex build %s ns %s - set %s not found - assuming empty", imd->iname, imd->ns_name, imd->set);
+			sbld_build_failed(&sis[i], 1);
+			continue;
+		}
+
+		if (n_build_sis == 0) {
+			set_id = si_set_id;
+		}
+		else if (si_set_id != set_id) {
+			same_set = false;
+		}
 
-	if (imd->set && (set_id = as_namespace_get_set_id(ns, imd->set)) == INVALID_SET_ID) {
-		cf_info(AS_SINDEX, "sindex build %s ns %s - set %s not found - assuming empty", imd->iname, imd->ns_name, imd->set);
-		as_sindex_populate_done(si);
-		AS_SINDEX_RELEASE(si);
-		return -3;
+		build_sis[n_build_sis++] = sis[i];
 	}
 
-	sbld_job* job = sbld_job_create(ns, set_id, si);
+	if (n_build_sis == 0) {
+		return;
+	}
+
+	sbld_job* job = sbld_job_create(ns, same_set ? set_id : INVALID_SET_ID,
+			build_sis, n_build_sis);
 
 	if (! job) {
-		cf_warning(AS_SINDEX, "sindex build %s ns %s set %s - job alloc failed", imd->iname, imd->ns_name, imd->set);
-		as_sindex_populate_done(si);
-		AS_SINDEX_RELEASE(si);
-		return -2;
+		cf_warning(AS_SINDEX, "sindex build %s ns %s - job alloc failed", build_sis[0]->imd->iname, ns->name);
+		sbld_build_failed(build_sis, n_build_sis);
+		return;
+	}
+
+	if (n_build_sis > 1) {
+		cf_info(AS_SINDEX, "sindex build ns %s - populating %u sindexes in one pass", ns->name, n_build_sis);
 	}
 
 	// Can't fail for this kind of job.
 	as_job_manager_start_job(&g_sbld_manager, (as_job*)job);
-
-	return 0;
 }
 
 int
 as_sbld_build_all(as_namespace* ns)
 {
-	sbld_job* job = sbld_job_create(ns, INVALID_SET_ID, NULL);
+	sbld_job* job = sbld_job_create(ns, INVALID_SET_ID, NULL, 0);
 
 	if (! job) {
 		cf_warning(AS_SINDEX, "sindex build-all ns %s - job alloc failed", ns->name);
@@ -689,15 +792,25 @@ as_sbld_abort(uint64_t trid)
 }
 
 
-//------------------------------------------------
-// sbld_job derived class implementation.
-//
-
-void sbld_job_slice(as_job* _job, as_partition_reservation* rsv);
+void sbld_job_slice(as_job* _job, as_partition_reservation* rsv, cf_digest* lo_keyd, cf_digest* hi_keyd);
 void sbld_job_finish(as_job* _job);
 void sbld_job_destroy(as_job* _job);
 void sbld_job_info(as_job* _job, as_mon_jobstat* stat);
 
+static void
+sbld_build_failed(as_sindex** sis, uint32_t n_sis)
+{
+	for (uint32_t i = 0; i < n_sis; i++) {
+		as_sindex_populate_done(sis[i]);
+		AS_SINDEX_RELEASE(sis[i]);
+	}
+}
+
+
+//------------------------------------------------
+// sbld_job derived class implementation.
+//
+
 const as_job_vtable sbld_job_vtable = {
 		sbld_job_slice,
 		sbld_job_finish,
@@ -712,7 +825,8 @@ void sbld_job_reduce_cb(as_index_ref* r_ref, void* udata);
 //
 
 sbld_job*
-sbld_job_create(as_namespace* ns, uint16_t set_id, as_sindex* si)
+sbld_job_create(as_namespace* ns, uint16_t set_id, as_sindex** sis,
+		uint32_t n_sis)
 {
 	sbld_job* job = cf_malloc(sizeof(sbld_job));
 
@@ -723,9 +837,14 @@ sbld_job_create(as_namespace* ns, uint16_t set_id, as_sindex* si)
 	as_job_init((as_job*)job, &sbld_job_vtable, &g_sbld_manager,
 			RSV_MIGRATE, 0, ns, set_id, AS_JOB_PRIORITY_MEDIUM);
 
-	job->si = si;
-	job->si_desync_cnt = si ? si->desync_cnt : 0;
-	job->si_name = si ? cf_strdup(si->imd->iname) : NULL;
+	job->n_sis = n_sis;
+
+	for (uint32_t i = 0; i < n_sis; i++) {
+		job->sis[i] = sis[i];
+		job->si_desync_cnts[i] = sis[i]->desync_cnt;
+	}
+
+	job->si_name = n_sis != 0 ? cf_strdup(sis[0]->imd->iname) : NULL;
 	job->n_reduced = 0;
 
 	return job;
@@ -736,9 +855,11 @@ sbld_job_create(as_namespace* ns, uint16_t set_id, as_sindex* si)
 //
 
 void
-sbld_job_slice(as_job* _job, as_partition_reservation* rsv)
+sbld_job_slice(as_job* _job, as_partition_reservation* rsv,
+		cf_digest* lo_keyd, cf_digest* hi_keyd)
 {
-	as_index_reduce(rsv->p->vp, sbld_job_reduce_cb, (void*)_job);
+	as_index_reduce_range(rsv->p->vp, lo_keyd, hi_keyd, sbld_job_reduce_cb,
+			(void*)_job);
 }
 
 void
@@ -746,12 +867,16 @@ sbld_job_finish(as_job* _job)
 {
 	sbld_job* job = (sbld_job*)_job;
 
-	as_sindex_ticker_done(_job->ns, job->si, _job->start_ms);
+	as_sindex_ticker_done(_job->ns, job->sis, job->n_sis, _job->start_ms);
+
+	if (job->n_sis != 0) {
+		uint64_t loadtime = cf_getms() - _job->start_ms;
 
-	if (job->si) {
-		as_sindex_populate_done(job->si);
-		job->si->stats.loadtime = cf_getms() - _job->start_ms;
-		AS_SINDEX_RELEASE(job->si);
+		for (uint32_t i = 0; i < job->n_sis; i++) {
+			as_sindex_populate_done(job->sis[i]);
+			job->sis[i]->stats.loadtime = loadtime;
+			AS_SINDEX_RELEASE(job->sis[i]);
+		}
 	}
 	else {
 		as_sindex_boot_populateall_done(_job->ns);
@@ -779,6 +904,10 @@ sbld_job_info(as_job* _job, as_mon_jobstat* stat)
 		char *extra = stat->jdata + strlen(stat->jdata);
 
 		sprintf(extra, ":sindex-name=%s", job->si_name);
+
+		if (job->n_sis > 1) {
+			sprintf(extra + strlen(extra), ":sindex-count=%u", job->n_sis);
+		}
 	}
 	else {
 		strcpy(stat->job_type, "sindex-build-all");
@@ -801,22 +930,36 @@ sbld_job_reduce_cb(as_index_ref* r_ref, void* udata)
 		return;
 	}
 
-	if (job->si) {
-		if (! as_sindex_isactive(job->si) || job->si->desync_cnt > job->si_desync_cnt) {
-			as_record_done(r_ref, ns);
-			as_job_manager_abandon_job(_job->mgr, _job, AS_JOB_FAIL_UNKNOWN);
-			return;
+	// A sindex dropped or desynced mid-build stops being populated - abandon
+	// the job once none are left.
+	bool live[job->n_sis];
+	uint32_t n_live = 0;
+
+	for (uint32_t i = 0; i < job->n_sis; i++) {
+		as_sindex* si = job->sis[i];
+
+		live[i] = as_sindex_isactive(si) &&
+				si->desync_cnt <= job->si_desync_cnts[i];
+
+		if (live[i]) {
+			cf_atomic64_decr(&si->stats.recs_pending);
+			n_live++;
 		}
+	}
 
-		cf_atomic64_decr(&job->si->stats.recs_pending);
+	if (job->n_sis != 0 && n_live == 0) {
+		as_record_done(r_ref, ns);
+		as_job_manager_abandon_job(_job->mgr, _job, AS_JOB_FAIL_UNKNOWN);
+		return;
 	}
 
-	as_sindex_ticker(ns, job->si, cf_atomic64_incr(&job->n_reduced), _job->start_ms);
+	as_sindex_ticker(ns, job->sis, job->n_sis,
+			cf_atomic64_incr(&job->n_reduced), _job->start_ms);
 
 	as_index *r = r_ref->r;
 
 	if ((_job->set_id != INVALID_SET_ID && _job->set_id != as_index_get_set_id(r)) ||
-			as_record_is_expired(r)) {
+			as_record_is_doomed(r, ns)) {
 		as_record_done(r_ref, ns);
 		return;
 	}
@@ -827,8 +970,12 @@ sbld_job_reduce_cb(as_index_ref* r_ref, void* udata)
 	as_bin stack_bins[rd.ns->storage_data_in_memory ? 0 : rd.n_bins];
 	rd.bins = as_bin_get_all(r, &rd, stack_bins);
 
-	if (job->si) {
-		as_sindex_put_rd(job->si, &rd);
+	if (job->n_sis != 0) {
+		for (uint32_t i = 0; i < job->n_sis; i++) {
+			if (live[i]) {
+				as_sindex_put_rd(job->sis[i], &rd);
+			}
+		}
 	}
 	else {
 		as_sindex_putall_rd(ns, &rd);
@@ -34,13 +34,17 @@
 #include "citrusleaf/cf_atomic.h"
 #include "citrusleaf/cf_clock.h"
 #include "citrusleaf/cf_digest.h"
-#include "citrusleaf/cf_queue.h"
 
+#include "coarse_clock.h"
 #include "fault.h"
+#include "ring_queue.h"
 #include "util.h"
 
+#include "base/admission.h"
+#include "base/as_stap.h"
 #include "base/cfg.h"
 #include "base/datamodel.h"
+#include "base/hot_keys.h"
 #include "base/proto.h"
 #include "base/scan.h"
 #include "base/secondary_index.h"
@@ -58,12 +62,118 @@
 #include "transaction/write.h"
 
 
+#define TSVC_QUEUE_CAPACITY	(1024 * 4)
+#define TSVC_MAX_BATCH		16
+#define TSVC_IDLE_WAIT_MS	1000
+
+// Adaptive thread scaling - sample period, and average queue wait above which
+// threads are added to, or below which they're removed from, each queue.
+#define TSVC_ADAPT_PERIOD_US	(1000 * 1000)
+#define TSVC_ADAPT_UP_WAIT_NS	(1000 * 1000)
+#define TSVC_ADAPT_DOWN_WAIT_NS	(100 * 1000)
+
+static cf_atomic32 g_n_queue_threads[MAX_TRANSACTION_QUEUES];
+
+// Enqueuers mid-push to each shared queue - a retired queue's threads don't
+// exit while any are, as these may have picked it before it was retired.
+typedef struct queue_pushers_s {
+	cf_atomic32 n;
+} __attribute__ ((aligned(64))) queue_pushers;
+
+static queue_pushers g_queue_pushers[MAX_TRANSACTION_QUEUES];
+
+// Namespaces' dedicated queues are taken from the top of the queue array, so
+// shared queues below them can still be resized.
+static uint32_t g_dedicated_q_start = MAX_TRANSACTION_QUEUES;
+static as_namespace* g_queue_ns[MAX_TRANSACTION_QUEUES]; // NULL if shared
+static cf_atomic64 g_queue_wait_ns = 0;
+static cf_atomic64 g_queue_waits = 0;
+
+static void* run_adapt_threads(void* arg);
+static void create_queue(uint32_t n_q);
+static bool start_transaction_thread(uint32_t n_q);
+static void start_missing_threads(uint32_t n_q, uint32_t n_threads);
+static void resize_threads_per_queue(uint32_t n_threads);
+static bool claim_thread_exit(uint32_t n_q);
+static void assign_dedicated_queues();
+
+
+static inline bool
+queue_is_retired(uint32_t n_q)
+{
+	return n_q >= (uint32_t)g_config.n_transaction_queues &&
+			n_q < g_dedicated_q_start;
+}
+
+
 static inline bool
 should_security_check_data_op(const as_transaction *tr)
 {
 	return tr->origin == FROM_CLIENT || tr->origin == FROM_BATCH;
 }
 
+// Deadline of a queued transaction - end_time isn't part of the queued head,
+// so this mirrors process_transaction()'s single-record calculation.
+static inline uint64_t
+queued_deadline(const as_transaction *tr)
+{
+	uint32_t ttl = tr->msgp ? tr->msgp->msg.transaction_ttl : 0;
+
+	return tr->start_time + (ttl != 0 ?
+			(uint64_t)ttl * 1000000 : g_config.transaction_max_ns);
+}
+
+// Feed admission control and adaptive thread scaling the time dequeued
+// transactions spent queued - and the namespace, if the queue is its own.
+static void
+note_queue_waits(uint32_t n_q, const as_transaction *batch, uint32_t n_trs)
+{
+	uint64_t now = cf_getns();
+	uint64_t wait_ns = 0;
+	uint32_t n_waits = 0;
+
+	for (uint32_t i = 0; i < n_trs; i++) {
+		const as_transaction *tr = &batch[i];
+
+		if (! as_transaction_is_restart(tr) && tr->start_time != 0 &&
+				tr->start_time < now) {
+			wait_ns += now - tr->start_time;
+			n_waits++;
+		}
+	}
+
+	if (g_config.admission_control) {
+		as_admission_note_queue_wait(wait_ns, n_waits);
+	}
+
+	if (g_config.transaction_threads_adaptive && n_waits != 0) {
+		cf_atomic64_add(&g_queue_wait_ns, (int64_t)wait_ns);
+		cf_atomic64_add(&g_queue_waits, (int64_t)n_waits);
+	}
+
+	as_namespace *ns = g_queue_ns[n_q];
+
+	if (ns && n_waits != 0) {
+		cf_atomic64_add(&ns->tsvc_queue_wait_us, (int64_t)(wait_ns / 1000));
+		cf_atomic64_add(&ns->n_tsvc_queue_waits, (int64_t)n_waits);
+	}
+}
+
+
+// Namespace of a transaction not yet processed - NULL if it has none.
+static as_namespace *
+queued_namespace(const as_transaction *tr)
+{
+	if (tr->msgp->proto.type == PROTO_TYPE_INTERNAL_XDR) {
+		return NULL;
+	}
+
+	as_msg_field *nf = as_msg_field_get(&tr->msgp->msg,
+			AS_MSG_FIELD_TYPE_NAMESPACE);
+
+	return nf ? as_namespace_get_bymsgfield(nf) : NULL;
+}
+
 
 // Handle the transaction, including proxy to another node if necessary.
 void
@@ -207,8 +317,9 @@ process_transaction(as_transaction *tr)
 	}
 
 	// Did the transaction time out while on the queue?
-	if (cf_getns() > tr->end_time) {
+	if (cf_coarse_getns() > tr->end_time) {
 		cf_debug(AS_TSVC, "transaction timed out in queue");
+		cf_atomic64_incr(&ns->n_deadline_drops);
 		as_transaction_error(tr, ns, AS_PROTO_RESULT_FAIL_TIMEOUT);
 		goto Cleanup;
 	}
@@ -292,8 +403,11 @@ process_transaction(as_transaction *tr)
 			goto Cleanup;
 		}
 
-		rv = as_partition_reserve_read(ns, pid, &tr->rsv, &dest,
-				&partition_cluster_key);
+		rv = as_transaction_is_prefer_rack(tr) ?
+				as_partition_reserve_read_prefer_rack(ns, pid, &tr->rsv, &dest,
+						&partition_cluster_key) :
+				as_partition_reserve_read(ns, pid, &tr->rsv, &dest,
+						&partition_cluster_key);
 
 		// TODO - does this reservation promotion really accomplish anything?
 		if (rv == 0 && tr->rsv.n_dupl > 0) {
@@ -319,6 +433,7 @@ process_transaction(as_transaction *tr)
 
 		if (! as_transaction_is_restart(tr)) {
 			tr->benchmark_time = 0;
+			as_hot_keys_sample(ns, tr);
 		}
 
 		transaction_status status;
@@ -397,44 +512,103 @@ Cleanup:
 } // end process_transaction()
 
 
-// Service transactions - arg is the queue we're to service.
+// Service transactions - arg is the index of the queue we're to service.
 void *
 thr_tsvc(void *arg)
 {
-	cf_queue *q = (cf_queue *) arg;
+	uint32_t n_q = (uint32_t)(uintptr_t)arg;
+	cf_ring_queue *q = g_transaction_queues[n_q];
+
+	cf_assert(q, AS_TSVC, CF_CRITICAL, "invalid argument");
 
-	cf_assert(arg, AS_TSVC, CF_CRITICAL, "invalid argument");
+	uint8_t heads[TSVC_MAX_BATCH * AS_TRANSACTION_HEAD_SIZE];
+	as_transaction batch[TSVC_MAX_BATCH];
+	uint64_t deadlines[TSVC_MAX_BATCH];
+	uint32_t order[TSVC_MAX_BATCH];
 
-	// Wait for a transaction to arrive.
+	// Wait for transactions to arrive - but not forever, so idle threads
+	// notice when they're no longer wanted.
 	for ( ; ; ) {
-		as_transaction tr;
-		if (0 != cf_queue_pop(q, &tr, CF_QUEUE_FOREVER)) {
-			cf_crash(AS_TSVC, "unable to pop from transaction queue");
+		// Only batch when this is the queue's sole consumer - otherwise
+		// batching would hold back transactions other threads could be
+		// processing.
+		uint32_t max_batch = g_config.n_transaction_threads_per_queue == 1 ?
+				TSVC_MAX_BATCH : 1;
+		uint32_t n_popped = cf_ring_queue_pop_batch(q, heads, max_batch,
+				TSVC_IDLE_WAIT_MS);
+
+		// A retired queue's threads drain it, then exit once it stays empty.
+		// Enqueuers that picked it before it was retired may still be
+		// pushing - only exit when none are, and nothing more was pushed.
+		// Any later enqueuer sees it's retired and goes elsewhere.
+		if (n_popped == 0 && queue_is_retired(n_q)) {
+			CF_MEMORY_BARRIER();
+
+			if (cf_atomic32_get(g_queue_pushers[n_q].n) == 0 &&
+					cf_ring_queue_sz(q) == 0) {
+				cf_atomic32_decr(&g_n_queue_threads[n_q]);
+				break;
+			}
+
+			continue;
 		}
 
-		if (g_config.svc_benchmarks_enabled &&
-				tr.benchmark_time != 0 && ! as_transaction_is_restart(&tr)) {
-			histogram_insert_data_point(g_stats.svc_queue_hist, tr.benchmark_time);
+		// Order the batch earliest deadline first (insertion sort - it's
+		// small, and usually nearly sorted already).
+		for (uint32_t i = 0; i < n_popped; i++) {
+			memcpy(&batch[i], heads + (i * AS_TRANSACTION_HEAD_SIZE),
+					AS_TRANSACTION_HEAD_SIZE);
+
+			uint64_t deadline = queued_deadline(&batch[i]);
+			uint32_t j = i;
+
+			while (j > 0 && deadlines[order[j - 1]] > deadline) {
+				order[j] = order[j - 1];
+				j--;
+			}
+
+			order[j] = i;
+			deadlines[i] = deadline;
 		}
 
-		process_transaction(&tr);
+		if (n_popped != 0 && (g_config.admission_control ||
+				g_config.transaction_threads_adaptive || g_queue_ns[n_q])) {
+			note_queue_waits(n_q, batch, n_popped);
+		}
+
+		for (uint32_t i = 0; i < n_popped; i++) {
+			as_transaction *tr = &batch[order[i]];
+
+			ASD_TSVC_DEQUEUE((uint64_t)tr->msgp, n_q);
+
+			if (g_config.svc_benchmarks_enabled &&
+					tr->benchmark_time != 0 && ! as_transaction_is_restart(tr)) {
+				histogram_insert_data_point(g_stats.svc_queue_hist, tr->benchmark_time);
+			}
+
+			// Expired transactions are dropped in here.
+			process_transaction(tr);
+		}
+
+		if (! queue_is_retired(n_q) && claim_thread_exit(n_q)) {
+			break;
+		}
 	}
 
 	return NULL;
 } // end thr_tsvc()
 
 
-pthread_t* g_transaction_threads;
 
-static inline pthread_t*
-transaction_thread(int i, int j)
-{
-	return g_transaction_threads + (g_config.n_transaction_threads_per_queue * i) + j;
-}
+static pthread_mutex_t g_resize_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t g_threads_floor; // adaptive scaling never goes below this
 
-cf_queue* g_transaction_queues[MAX_TRANSACTION_QUEUES];
+cf_ring_queue* g_transaction_queues[MAX_TRANSACTION_QUEUES];
 uint32_t g_current_q = 0;
 
+static int enqueue_on(as_transaction *tr, uint32_t n_q);
+static int enqueue_on_shared(as_transaction *tr, uint32_t pick);
+
 void
 as_tsvc_init()
 {
@@ -473,39 +647,141 @@ as_tsvc_init()
 				g_config.n_transaction_queues, g_config.n_transaction_threads_per_queue);
 	}
 
+	assign_dedicated_queues();
+
+	g_threads_floor = (uint32_t)g_config.n_transaction_threads_per_queue;
+
 	// Create the transaction queues.
 	for (int i = 0; i < g_config.n_transaction_queues ; i++) {
-		g_transaction_queues[i] = cf_queue_create(AS_TRANSACTION_HEAD_SIZE, true);
+		create_queue((uint32_t)i);
 	}
 
-	// Allocate the transaction threads that service all the queues.
-	g_transaction_threads = cf_malloc(sizeof(pthread_t) * g_config.n_transaction_queues * g_config.n_transaction_threads_per_queue);
-
-	if (! g_transaction_threads) {
-		cf_crash(AS_TSVC, "tsvc pthread_t array allocation failed");
+	for (uint32_t i = g_dedicated_q_start; i < MAX_TRANSACTION_QUEUES; i++) {
+		create_queue(i);
 	}
 
 	// Start all the transaction threads.
 	for (int i = 0; i < g_config.n_transaction_queues; i++) {
 		for (int j = 0; j < g_config.n_transaction_threads_per_queue; j++) {
-			if (0 != pthread_create(transaction_thread(i, j), NULL, thr_tsvc, (void*)g_transaction_queues[i])) {
+			if (! start_transaction_thread((uint32_t)i)) {
 				cf_crash(AS_TSVC, "tsvc thread %d:%d create failed", i, j);
 			}
 		}
 	}
+
+	for (uint32_t i = g_dedicated_q_start; i < MAX_TRANSACTION_QUEUES; i++) {
+		for (int j = 0; j < g_config.n_transaction_threads_per_queue; j++) {
+			if (! start_transaction_thread(i)) {
+				cf_crash(AS_TSVC, "tsvc thread %u:%d create failed", i, j);
+			}
+		}
+	}
+
+	pthread_t thread;
+	pthread_attr_t attrs;
+
+	pthread_attr_init(&attrs);
+	pthread_attr_setdetachstate(&attrs, PTHREAD_CREATE_DETACHED);
+
+	if (pthread_create(&thread, &attrs, run_adapt_threads, NULL) != 0) {
+		cf_crash(AS_TSVC, "failed to create tsvc adaptive scaling thread");
+	}
 } // end thr_tsvc_init()
 
 
+// Change the number of threads serving each transaction queue.
+int
+as_tsvc_set_threads_per_queue(uint32_t n_threads)
+{
+	if (n_threads < 1 || n_threads > MAX_TRANSACTION_THREADS_PER_QUEUE) {
+		cf_warning(AS_TSVC, "transaction-threads-per-queue %u must be between 1 and %d",
+				n_threads, MAX_TRANSACTION_THREADS_PER_QUEUE);
+		return -1;
+	}
+
+	pthread_mutex_lock(&g_resize_lock);
+
+	cf_info(AS_TSVC, "changing transaction-threads-per-queue from %d to %u",
+			g_config.n_transaction_threads_per_queue, n_threads);
+
+	resize_threads_per_queue(n_threads);
+	g_threads_floor = n_threads;
+
+	pthread_mutex_unlock(&g_resize_lock);
+
+	return 0;
+}
+
+
+// Change the number of shared transaction queues, with their threads.
+int
+as_tsvc_set_queues(uint32_t n_queues)
+{
+	if (g_config.use_queue_per_device || g_config.run_to_completion) {
+		cf_warning(AS_TSVC, "can't change transaction-queues with use-queue-per-device or run-to-completion");
+		return -1;
+	}
+
+	if (n_queues < 1 || n_queues > g_dedicated_q_start) {
+		cf_warning(AS_TSVC, "transaction-queues %u must be between 1 and %u",
+				n_queues, g_dedicated_q_start);
+		return -1;
+	}
+
+	pthread_mutex_lock(&g_resize_lock);
+
+	uint32_t n_orig = (uint32_t)g_config.n_transaction_queues;
+	uint32_t n_threads = (uint32_t)g_config.n_transaction_threads_per_queue;
+
+	cf_info(AS_TSVC, "changing transaction-queues from %u to %u", n_orig,
+			n_queues);
+
+	if (n_queues > n_orig) {
+		// Queues may remain from an earlier shrink, possibly with threads
+		// still draining them - they're reused.
+		for (uint32_t i = n_orig; i < n_queues; i++) {
+			if (! g_transaction_queues[i]) {
+				create_queue(i);
+			}
+
+			start_missing_threads(i, n_threads);
+		}
+
+		// Only now let transactions be distributed to the new queues.
+		g_config.n_transaction_queues = (int)n_queues;
+	}
+	else {
+		// Stop distributing to the retired queues - their threads drain them
+		// and exit once no enqueuer is still pushing to them. The queues
+		// themselves are kept, as enqueuers may still hold them.
+		g_config.n_transaction_queues = (int)n_queues;
+	}
+
+	pthread_mutex_unlock(&g_resize_lock);
+
+	return 0;
+}
+
+
+// Peek into packet and decide if transaction can be executed inline in
+// demarshal thread without blocking on a device.
+bool
+thr_tsvc_can_process_inline(as_transaction *tr)
+{
+	return (g_config.allow_inline_transactions || g_config.run_to_completion) &&
+			g_config.n_namespaces_in_memory != 0 &&
+					(g_config.n_namespaces_not_in_memory == 0 ||
+							as_msg_peek_data_in_memory(&tr->msgp->msg));
+}
+
+
 // Peek into packet and decide if transaction can be executed inline in
 // demarshal thread or if it must be enqueued, and handle appropriately.
 int
 thr_tsvc_process_or_enqueue(as_transaction *tr)
 {
 	// If transaction is for data-in-memory namespace, process in this thread.
-	if (g_config.allow_inline_transactions &&
-			g_config.n_namespaces_in_memory != 0 &&
-					(g_config.n_namespaces_not_in_memory == 0 ||
-							as_msg_peek_data_in_memory(&tr->msgp->msg))) {
+	if (thr_tsvc_can_process_inline(tr)) {
 		process_transaction(tr);
 		return 0;
 	}
@@ -515,6 +791,21 @@ thr_tsvc_process_or_enqueue(as_transaction *tr)
 }
 
 
+// Internal UDF transactions of background scan and query jobs - if configured,
+// process in the job's thread. The jobs' in-flight caps and record rate limits
+// then pace the UDFs directly, without churning the transaction queues.
+int
+thr_tsvc_process_or_enqueue_iudf(as_transaction *tr)
+{
+	if (g_config.background_udf_inline) {
+		process_transaction(tr);
+		return 0;
+	}
+
+	return thr_tsvc_enqueue(tr);
+}
+
+
 // Decide which queue to use, and enqueue transaction.
 int
 thr_tsvc_enqueue(as_transaction *tr)
@@ -556,22 +847,79 @@ thr_tsvc_enqueue(as_transaction *tr)
 		}
 	}
 	else {
-		// In default mode, transaction can go on any queue - distribute evenly.
-		n_q = (g_current_q++) % g_config.n_transaction_queues;
+		as_namespace *ns = g_dedicated_q_start != MAX_TRANSACTION_QUEUES ?
+				queued_namespace(tr) : NULL;
+
+		if (ns && ns->transaction_queues != 0) {
+			// Namespace has its own queues - distribute evenly over those.
+			n_q = ns->tsvc_q_offset +
+					((ns->tsvc_q_next++) % ns->transaction_queues);
+		}
+		else {
+			// In default mode, transaction can go on any queue - distribute
+			// evenly.
+			return enqueue_on_shared(tr, g_current_q++);
+		}
 	}
 
-	cf_queue *q;
+	return enqueue_on(tr, n_q);
+} // end thr_tsvc_enqueue()
+
+
+static int
+enqueue_on(as_transaction *tr, uint32_t n_q)
+{
+	cf_ring_queue *q;
 
 	if ((q = g_transaction_queues[n_q]) == NULL) {
 		cf_crash(AS_TSVC, "transaction queue #%d not initialized!", n_q);
 	}
 
-	if (cf_queue_push(q, tr) != 0) {
-		cf_crash(AS_TSVC, "transaction queue push failed - out of memory?");
-	}
+	ASD_TSVC_ENQUEUE((uint64_t)tr->msgp, n_q);
+
+	cf_ring_queue_push(q, tr);
 
 	return 0;
-} // end thr_tsvc_enqueue()
+}
+
+
+// Enqueue on a shared queue, which as_tsvc_set_queues() may retire at any
+// moment - register as a pusher first, so the queue's threads can't exit
+// until the push is done, then back off if the queue was retired after all.
+static int
+enqueue_on_shared(as_transaction *tr, uint32_t pick)
+{
+	while (true) {
+		uint32_t n_q = pick % (uint32_t)g_config.n_transaction_queues;
+
+		// Atomic increment is a full barrier - the retired check below can't
+		// be reordered before it.
+		cf_atomic32_incr(&g_queue_pushers[n_q].n);
+
+		if (! queue_is_retired(n_q)) {
+			enqueue_on(tr, n_q);
+			cf_atomic32_decr(&g_queue_pushers[n_q].n);
+
+			return 0;
+		}
+
+		cf_atomic32_decr(&g_queue_pushers[n_q].n);
+	}
+}
+
+
+// Enqueue transaction on the queue served by threads sharing this service
+// thread's CPU, unless queue-per-device mode dictates the queue.
+int
+thr_tsvc_enqueue_local(as_transaction *tr, uint32_t thr_id)
+{
+	if (g_config.use_queue_per_device ||
+			g_dedicated_q_start != MAX_TRANSACTION_QUEUES) {
+		return thr_tsvc_enqueue(tr);
+	}
+
+	return enqueue_on_shared(tr, thr_id);
+}
 
 
 // Get one of the most interesting load statistics: the transaction queue depth.
@@ -582,12 +930,210 @@ thr_tsvc_queue_get_size()
 
 	for (int i = 0; i < g_config.n_transaction_queues; i++) {
 		if (g_transaction_queues[i]) {
-			qs += cf_queue_sz(g_transaction_queues[i]);
+			qs += cf_ring_queue_sz(g_transaction_queues[i]);
 		}
 		else {
 			cf_detail(AS_TSVC, "no queue when getting size");
 		}
 	}
 
+	for (uint32_t i = g_dedicated_q_start; i < MAX_TRANSACTION_QUEUES; i++) {
+		qs += cf_ring_queue_sz(g_transaction_queues[i]);
+	}
+
 	return qs;
 } // end thr_tsvc_queue_get_size()
+
+
+// Depth of a namespace's dedicated queues - 0 if it uses the shared ones.
+int
+thr_tsvc_ns_queue_get_size(const as_namespace *ns)
+{
+	int qs = 0;
+
+	for (uint32_t i = 0; i < ns->transaction_queues; i++) {
+		qs += cf_ring_queue_sz(g_transaction_queues[ns->tsvc_q_offset + i]);
+	}
+
+	return qs;
+}
+
+
+//------------------------------------------------
+// Local helpers - resizing transaction threads.
+//
+
+static void*
+run_adapt_threads(void* arg)
+{
+	while (true) {
+		usleep(TSVC_ADAPT_PERIOD_US);
+
+		uint64_t wait_ns = (uint64_t)cf_atomic64_get(g_queue_wait_ns);
+		uint64_t n_waits = (uint64_t)cf_atomic64_get(g_queue_waits);
+
+		cf_atomic64_sub(&g_queue_wait_ns, (int64_t)wait_ns);
+		cf_atomic64_sub(&g_queue_waits, (int64_t)n_waits);
+
+		if (! g_config.transaction_threads_adaptive) {
+			continue;
+		}
+
+		uint64_t avg_wait_ns = n_waits == 0 ? 0 : wait_ns / n_waits;
+
+		pthread_mutex_lock(&g_resize_lock);
+
+		uint32_t n_threads = (uint32_t)g_config.n_transaction_threads_per_queue;
+
+		// One thread per queue at a time, and never below the configured size.
+		if (avg_wait_ns > TSVC_ADAPT_UP_WAIT_NS &&
+				n_threads < MAX_TRANSACTION_THREADS_PER_QUEUE) {
+			cf_info(AS_TSVC, "queue wait %lu us - adding transaction threads, now %u per queue",
+					avg_wait_ns / 1000, n_threads + 1);
+			resize_threads_per_queue(n_threads + 1);
+		}
+		else if (avg_wait_ns < TSVC_ADAPT_DOWN_WAIT_NS &&
+				n_threads > g_threads_floor) {
+			cf_info(AS_TSVC, "queue wait %lu us - removing transaction threads, now %u per queue",
+					avg_wait_ns / 1000, n_threads - 1);
+			resize_threads_per_queue(n_threads - 1);
+		}
+
+		pthread_mutex_unlock(&g_resize_lock);
+	}
+
+	return NULL;
+}
+
+
+static void
+create_queue(uint32_t n_q)
+{
+	g_transaction_queues[n_q] = cf_ring_queue_create(AS_TRANSACTION_HEAD_SIZE,
+			TSVC_QUEUE_CAPACITY);
+
+	if (! g_transaction_queues[n_q]) {
+		cf_crash(AS_TSVC, "failed to create transaction queue %u", n_q);
+	}
+}
+
+
+static bool
+start_transaction_thread(uint32_t n_q)
+{
+	pthread_t thread;
+	pthread_attr_t attrs;
+
+	pthread_attr_init(&attrs);
+	pthread_attr_setdetachstate(&attrs, PTHREAD_CREATE_DETACHED);
+
+	cf_atomic32_incr(&g_n_queue_threads[n_q]);
+
+	if (pthread_create(&thread, &attrs, thr_tsvc, (void*)(uintptr_t)n_q) != 0) {
+		cf_atomic32_decr(&g_n_queue_threads[n_q]);
+		return false;
+	}
+
+	// In run-to-completion mode, queue i is fed by the service thread pinned
+	// to CPU i - keep its transaction threads on that CPU too, unless they're
+	// configured to have CPUs of their own.
+	if (g_config.run_to_completion && n_q < g_dedicated_q_start &&
+			g_config.thread_sched[AS_SCHED_POOL_TRANSACTION].n_cpus == 0) {
+		cf_thread_pin_to_cpu(thread, n_q);
+	}
+
+	as_config_sched_thread(AS_SCHED_POOL_TRANSACTION, thread);
+
+	return true;
+}
+
+
+// Threads beyond n_threads exit by themselves - see claim_thread_exit().
+static void
+start_missing_threads(uint32_t n_q, uint32_t n_threads)
+{
+	int32_t n_running = cf_atomic32_get(g_n_queue_threads[n_q]);
+
+	for (int32_t i = n_running; i < (int32_t)n_threads; i++) {
+		if (! start_transaction_thread(n_q)) {
+			cf_warning(AS_TSVC, "tsvc thread %u:%d create failed", n_q, i);
+		}
+	}
+}
+
+
+// Call under g_resize_lock.
+static void
+resize_threads_per_queue(uint32_t n_threads)
+{
+	g_config.n_transaction_threads_per_queue = (int)n_threads;
+
+	for (int i = 0; i < g_config.n_transaction_queues; i++) {
+		start_missing_threads((uint32_t)i, n_threads);
+	}
+
+	for (uint32_t i = g_dedicated_q_start; i < MAX_TRANSACTION_QUEUES; i++) {
+		start_missing_threads(i, n_threads);
+	}
+}
+
+
+// A thread whose queue has more threads than configured claims one exit.
+static bool
+claim_thread_exit(uint32_t n_q)
+{
+	while (true) {
+		int32_t n_running = cf_atomic32_get(g_n_queue_threads[n_q]);
+
+		if (n_running <= g_config.n_transaction_threads_per_queue) {
+			return false;
+		}
+
+		if (cf_atomic32_cas(&g_n_queue_threads[n_q], n_running,
+				n_running - 1) == n_running) {
+			return true;
+		}
+	}
+}
+
+
+//------------------------------------------------
+// Local helpers - dedicated namespace queues.
+//
+
+static void
+assign_dedicated_queues()
+{
+	for (int i = 0; i < g_config.n_namespaces; i++) {
+		as_namespace *ns = g_config.namespaces[i];
+
+		if (ns->transaction_queues == 0) {
+			continue;
+		}
+
+		if (g_config.use_queue_per_device) {
+			// Queue-per-device already keeps namespaces' queues apart.
+			cf_warning(AS_TSVC, "{%s} transaction-queues ignored with use-queue-per-device",
+					ns->name);
+			ns->transaction_queues = 0;
+			continue;
+		}
+
+		if (ns->transaction_queues > g_dedicated_q_start -
+				(uint32_t)g_config.n_transaction_queues) {
+			cf_crash(AS_TSVC, "{%s} transaction-queues %u - too many queues in total, must be <= %d",
+					ns->name, ns->transaction_queues, MAX_TRANSACTION_QUEUES);
+		}
+
+		g_dedicated_q_start -= ns->transaction_queues;
+		ns->tsvc_q_offset = g_dedicated_q_start;
+
+		for (uint32_t n_q = 0; n_q < ns->transaction_queues; n_q++) {
+			g_queue_ns[g_dedicated_q_start + n_q] = ns;
+		}
+
+		cf_info(AS_TSVC, "{%s} dedicated queues: %u queues with %d threads each",
+				ns->name, ns->transaction_queues,
+				g_config.n_transaction_threads_per_queue);
+	}
+}
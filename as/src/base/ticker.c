@@ -180,7 +180,8 @@ log_ticker_frame()
 		uint64_t n_objects = ns->n_objects;
 		uint64_t n_sub_objects = ns->n_sub_objects;
 
-		size_t index_mem = as_index_size_get(ns) * (n_objects + n_sub_objects);
+		size_t index_mem = ns->index_flash_path ? 0 :
+				as_index_size_get(ns) * (n_objects + n_sub_objects);
 		size_t sindex_mem = ns->sindex_data_memory_used;
 		size_t data_mem = ns->n_bytes_memory;
 		size_t total_mem = index_mem + sindex_mem + data_mem;
@@ -236,7 +237,7 @@ log_line_in_progress()
 			as_nsup_queue_get_size(),
 			rw_request_hash_count(),
 			as_proxy_hash_count(),
-			g_stats.global_record_ref_count
+			cf_shard_counter_get(&g_stats.global_record_ref_count)
 			);
 }
 
@@ -415,11 +416,14 @@ log_line_device_usage(as_namespace* ns)
 				);
 	}
 	else {
-		uint32_t n_reads_from_cache = ns->n_reads_from_cache;
-		uint32_t n_total_reads = ns->n_reads_from_device + n_reads_from_cache;
+		uint64_t cache_total = cf_shard_counter_get(&ns->n_reads_from_cache);
+		uint64_t device_total = cf_shard_counter_get(&ns->n_reads_from_device);
+		uint64_t n_reads_from_cache = cache_total - ns->last_n_reads_from_cache;
+		uint64_t n_total_reads = n_reads_from_cache +
+				device_total - ns->last_n_reads_from_device;
 
-		cf_atomic32_set(&ns->n_reads_from_device, 0);
-		cf_atomic32_set(&ns->n_reads_from_cache, 0);
+		ns->last_n_reads_from_cache = cache_total;
+		ns->last_n_reads_from_device = device_total;
 
 		ns->cache_read_pct =
 				(float)(100 * n_reads_from_cache) /
@@ -431,6 +435,22 @@ log_line_device_usage(as_namespace* ns)
 				available_pct,
 				ns->cache_read_pct
 				);
+
+		if (ns->storage_read_cache_size != 0) {
+			cf_info(AS_INFO, "{%s} read-cache: hits %lu misses %lu",
+					ns->name,
+					cf_shard_counter_get(&ns->n_read_cache_hits),
+					cf_shard_counter_get(&ns->n_read_cache_misses)
+					);
+		}
+
+		if (ns->ldt_enabled && ns->storage_ldt_subrec_cache_size != 0) {
+			cf_info(AS_INFO, "{%s} ldt-subrec-cache: hits %lu misses %lu",
+					ns->name,
+					cf_shard_counter_get(&ns->n_ldt_subrec_cache_hits),
+					cf_shard_counter_get(&ns->n_ldt_subrec_cache_misses)
+					);
+		}
 	}
 }
 
@@ -467,17 +487,17 @@ log_line_client(as_namespace* ns)
 	uint64_t n_proxy_complete = ns->n_client_proxy_complete;
 	uint64_t n_proxy_error = ns->n_client_proxy_error;
 	uint64_t n_proxy_timeout = ns->n_client_proxy_timeout;
-	uint64_t n_read_success = ns->n_client_read_success;
-	uint64_t n_read_error = ns->n_client_read_error;
-	uint64_t n_read_timeout = ns->n_client_read_timeout;
-	uint64_t n_read_not_found = ns->n_client_read_not_found;
-	uint64_t n_write_success = ns->n_client_write_success;
-	uint64_t n_write_error = ns->n_client_write_error;
-	uint64_t n_write_timeout = ns->n_client_write_timeout;
-	uint64_t n_delete_success = ns->n_client_delete_success;
-	uint64_t n_delete_error = ns->n_client_delete_error;
-	uint64_t n_delete_timeout = ns->n_client_delete_timeout;
-	uint64_t n_delete_not_found = ns->n_client_delete_not_found;
+	uint64_t n_read_success = cf_shard_counter_get(&ns->n_client_read_success);
+	uint64_t n_read_error = cf_shard_counter_get(&ns->n_client_read_error);
+	uint64_t n_read_timeout = cf_shard_counter_get(&ns->n_client_read_timeout);
+	uint64_t n_read_not_found = cf_shard_counter_get(&ns->n_client_read_not_found);
+	uint64_t n_write_success = cf_shard_counter_get(&ns->n_client_write_success);
+	uint64_t n_write_error = cf_shard_counter_get(&ns->n_client_write_error);
+	uint64_t n_write_timeout = cf_shard_counter_get(&ns->n_client_write_timeout);
+	uint64_t n_delete_success = cf_shard_counter_get(&ns->n_client_delete_success);
+	uint64_t n_delete_error = cf_shard_counter_get(&ns->n_client_delete_error);
+	uint64_t n_delete_timeout = cf_shard_counter_get(&ns->n_client_delete_timeout);
+	uint64_t n_delete_not_found = cf_shard_counter_get(&ns->n_client_delete_not_found);
 	uint64_t n_udf_complete = ns->n_client_udf_complete;
 	uint64_t n_udf_error = ns->n_client_udf_error;
 	uint64_t n_udf_timeout = ns->n_client_udf_timeout;
@@ -517,22 +537,33 @@ log_line_batch_sub(as_namespace* ns)
 	uint64_t n_proxy_complete = ns->n_batch_sub_proxy_complete;
 	uint64_t n_proxy_error = ns->n_batch_sub_proxy_error;
 	uint64_t n_proxy_timeout = ns->n_batch_sub_proxy_timeout;
-	uint64_t n_read_success = ns->n_batch_sub_read_success;
-	uint64_t n_read_error = ns->n_batch_sub_read_error;
-	uint64_t n_read_timeout = ns->n_batch_sub_read_timeout;
-	uint64_t n_read_not_found = ns->n_batch_sub_read_not_found;
+	uint64_t n_read_success = cf_shard_counter_get(&ns->n_batch_sub_read_success);
+	uint64_t n_read_error = cf_shard_counter_get(&ns->n_batch_sub_read_error);
+	uint64_t n_read_timeout = cf_shard_counter_get(&ns->n_batch_sub_read_timeout);
+	uint64_t n_read_not_found = cf_shard_counter_get(&ns->n_batch_sub_read_not_found);
+	uint64_t n_write_success = ns->n_batch_sub_write_success;
+	uint64_t n_write_error = ns->n_batch_sub_write_error;
+	uint64_t n_write_timeout = ns->n_batch_sub_write_timeout;
+	uint64_t n_delete_success = ns->n_batch_sub_delete_success;
+	uint64_t n_delete_error = ns->n_batch_sub_delete_error;
+	uint64_t n_delete_timeout = ns->n_batch_sub_delete_timeout;
+	uint64_t n_delete_not_found = ns->n_batch_sub_delete_not_found;
 
 	if ((n_tsvc_error | n_tsvc_timeout |
 			n_proxy_complete | n_proxy_error | n_proxy_timeout |
-			n_read_success | n_read_error | n_read_timeout | n_read_not_found) == 0) {
+			n_read_success | n_read_error | n_read_timeout | n_read_not_found |
+			n_write_success | n_write_error | n_write_timeout |
+			n_delete_success | n_delete_error | n_delete_timeout | n_delete_not_found) == 0) {
 		return;
 	}
 
-	cf_info(AS_INFO, "{%s} batch-sub: tsvc (%lu,%lu) proxy (%lu,%lu,%lu) read (%lu,%lu,%lu,%lu)",
+	cf_info(AS_INFO, "{%s} batch-sub: tsvc (%lu,%lu) proxy (%lu,%lu,%lu) read (%lu,%lu,%lu,%lu) write (%lu,%lu,%lu) delete (%lu,%lu,%lu,%lu)",
 			ns->name,
 			n_tsvc_error, n_tsvc_timeout,
 			n_proxy_complete, n_proxy_error, n_proxy_timeout,
-			n_read_success, n_read_error, n_read_timeout, n_read_not_found
+			n_read_success, n_read_error, n_read_timeout, n_read_not_found,
+			n_write_success, n_write_error, n_write_timeout,
+			n_delete_success, n_delete_error, n_delete_timeout, n_delete_not_found
 			);
 }
 
@@ -650,6 +681,12 @@ dump_global_histograms()
 void
 dump_namespace_histograms(as_namespace* ns)
 {
+	if (ns->stage_hist_enabled) {
+		for (int s = 0; s < AS_NUM_STAGES; s++) {
+			cf_hist_track_dump(ns->stage_hists[s]);
+		}
+	}
+
 	if (ns->read_hist_active) {
 		cf_hist_track_dump(ns->read_hist);
 	}
@@ -696,6 +733,17 @@ dump_namespace_histograms(as_namespace* ns)
 		histogram_dump(ns->query_rec_count_hist);
 	}
 
+	if (cf_atomic32_get(ns->n_set_latency_enabled) != 0) {
+		for (uint32_t set_id = 1; set_id <= AS_SET_MAX_COUNT; set_id++) {
+			if (ns->set_latency_enabled[set_id]) {
+				cf_hist_track_dump(ns->set_read_hists[set_id]);
+				cf_hist_track_dump(ns->set_write_hists[set_id]);
+				cf_hist_track_dump(ns->set_udf_hists[set_id]);
+				cf_hist_track_dump(ns->set_query_hists[set_id]);
+			}
+		}
+	}
+
 	if (ns->proxy_hist_enabled) {
 		histogram_dump(ns->proxy_hist);
 	}
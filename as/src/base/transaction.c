@@ -81,6 +81,8 @@ as_transaction_init_body(as_transaction *tr)
 	tr->generation			= 0;
 	tr->void_time			= 0;
 	tr->last_update_time	= 0;
+	tr->stage_time			= 0;
+	memset(tr->stage_us, 0, sizeof(tr->stage_us));
 }
 
 void
@@ -115,6 +117,8 @@ as_transaction_init_from_rw(as_transaction *tr, rw_request *rw)
 	tr->flags = 0;
 	tr->generation = rw->generation;
 	tr->void_time = rw->void_time;
+	tr->stage_time = rw->stage_time;
+	memcpy(tr->stage_us, rw->stage_us, sizeof(tr->stage_us));
 }
 
 void
@@ -189,6 +193,21 @@ as_transaction_set_msg_field_flag(as_transaction *tr, uint8_t type)
 	case AS_MSG_FIELD_TYPE_BATCH_WITH_SET: // shouldn't get here - batch parent handles this
 		tr->msg_fields |= AS_MSG_FIELD_BIT_BATCH_WITH_SET;
 		break;
+	case AS_MSG_FIELD_TYPE_PREDEXP:
+		tr->msg_fields |= AS_MSG_FIELD_BIT_PREDEXP;
+		break;
+	case AS_MSG_FIELD_TYPE_SCAN_CURSOR:
+		tr->msg_fields |= AS_MSG_FIELD_BIT_SCAN_CURSOR;
+		break;
+	case AS_MSG_FIELD_TYPE_RESPONSE_COMPRESSION:
+		tr->msg_fields |= AS_MSG_FIELD_BIT_RESPONSE_COMPRESSION;
+		break;
+	case AS_MSG_FIELD_TYPE_QUERY_LIMIT:
+		tr->msg_fields |= AS_MSG_FIELD_BIT_QUERY_LIMIT;
+		break;
+	case AS_MSG_FIELD_TYPE_MULTIPLEX:
+		tr->msg_fields |= AS_MSG_FIELD_BIT_MULTIPLEX;
+		break;
 	default:
 		return false;
 	}
@@ -331,6 +350,20 @@ as_transaction_init_iudf(as_transaction *tr, as_namespace *ns, cf_digest *keyd)
 	return 0;
 }
 
+// Only called when some set in the namespace has latency histograms enabled.
+uint16_t
+as_transaction_latency_set_id_lookup(const as_transaction *tr)
+{
+	if (! tr->msgp || ! as_transaction_has_set(tr)) {
+		return INVALID_SET_ID;
+	}
+
+	as_msg_field *f = as_msg_field_get(&tr->msgp->msg, AS_MSG_FIELD_TYPE_SET);
+
+	return as_namespace_get_latency_set_id(tr->rsv.ns, (const char *)f->data,
+			as_msg_field_get_value_sz(f));
+}
+
 void
 as_transaction_demarshal_error(as_transaction* tr, uint32_t error_code)
 {
@@ -466,11 +499,17 @@ as_release_file_handle(as_file_handle *proto_fd_h)
 		}
 	}
 
+	if (proto_fd_h->rbuf) {
+		cf_free(proto_fd_h->rbuf);
+		proto_fd_h->rbuf = NULL;
+	}
+
 	if (proto_fd_h->security_filter) {
 		as_security_filter_destroy(proto_fd_h->security_filter);
 		proto_fd_h->security_filter = NULL;
 	}
 
+	pthread_mutex_destroy(&proto_fd_h->send_lock);
 	cf_rc_free(proto_fd_h);
 	cf_atomic64_incr(&g_stats.proto_connections_closed);
 }
@@ -0,0 +1,447 @@
+/*
+ * truncate.c
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/* SYNOPSIS
+ * Truncation of a namespace or set in constant time. A truncate records a
+ * last-update-time cutoff - via SMD, so it's cluster-wide and persisted - and
+ * from then on records last updated before the cutoff are treated as deleted.
+ * A low priority background thread reclaims their index entries and storage.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "base/truncate.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "citrusleaf/cf_atomic.h"
+#include "citrusleaf/cf_clock.h"
+#include "citrusleaf/cf_queue.h"
+
+#include "cf_str.h"
+#include "fault.h"
+#include "vmapx.h"
+
+#include "base/cfg.h"
+#include "base/datamodel.h"
+#include "base/index.h"
+#include "base/rec_props.h"
+#include "base/set_index.h"
+#include "base/system_metadata.h"
+
+
+//==========================================================
+// Constants.
+//
+
+static char TRUNCATE_MODULE[] = "truncate";
+
+#define TRUNCATE_KEY_SZ (AS_ID_NAMESPACE_SZ + 1 + AS_SET_NAME_MAX_SIZE)
+
+// Yield between partitions, so cleanup stays in the background.
+#define TRUNCATE_PARTITION_SLEEP_us 1000
+
+
+//==========================================================
+// Typedefs.
+//
+
+typedef struct truncate_reduce_info_s {
+	as_namespace*	ns;
+	as_index_tree*	tree;
+	uint32_t		n_deleted;
+} truncate_reduce_info;
+
+
+//==========================================================
+// Globals.
+//
+
+static cf_queue* g_truncate_q = NULL;
+static pthread_t g_truncate_thread;
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static int truncate_smd_accept_cb(char* module, as_smd_item_list_t* items, void* udata, uint32_t accept_opt);
+static void truncate_apply(const char* key, const char* value);
+static void* run_truncate(void* udata);
+static void truncate_namespace(as_namespace* ns);
+static uint32_t truncated_indexed_sets(as_namespace* ns, uint16_t* set_ids);
+static bool truncate_reduce_sets(as_partition_reservation* rsv, const uint16_t* set_ids, uint32_t n_set_ids, truncate_reduce_info* p_info);
+static void truncate_reduce_cb(as_index_ref* r_ref, void* udata);
+static inline uint64_t truncate_lut_cutoff(as_namespace* ns, uint16_t set_id);
+
+
+//==========================================================
+// Public API.
+//
+
+// Must happen after namespaces are set up, and before storage is loaded, so
+// truncated records can be skipped at cold start.
+void
+as_truncate_init()
+{
+	if (! (g_truncate_q = cf_queue_create(sizeof(as_namespace*), true))) {
+		cf_crash(AS_TRUNCATE, "truncate queue create failed");
+	}
+
+	if (as_smd_create_module(TRUNCATE_MODULE, 0, 0,
+			truncate_smd_accept_cb, 0, 0, 0) != 0) {
+		cf_crash(AS_TRUNCATE, "failed to create SMD module \"%s\"",
+				TRUNCATE_MODULE);
+	}
+}
+
+void
+as_truncate_start()
+{
+	if (pthread_create(&g_truncate_thread, NULL, run_truncate, NULL) != 0) {
+		cf_crash(AS_TRUNCATE, "truncate thread create failed");
+	}
+}
+
+// If lut_str is null, truncate everything written before now.
+int
+as_truncate_cmd(const char* ns_name, const char* set_name, const char* lut_str)
+{
+	if (! as_namespace_get_byname((char*)ns_name)) {
+		cf_warning(AS_TRUNCATE, "truncate - unknown namespace %s", ns_name);
+		return -1;
+	}
+
+	if (set_name && strlen(set_name) >= AS_SET_NAME_MAX_SIZE) {
+		cf_warning(AS_TRUNCATE, "truncate - set name too long");
+		return -1;
+	}
+
+	uint64_t now = cf_clepoch_milliseconds();
+	uint64_t lut = now;
+
+	if (lut_str) {
+		if (cf_str_atoi_u64((char*)lut_str, &lut) != 0) {
+			cf_warning(AS_TRUNCATE, "truncate - bad lut %s", lut_str);
+			return -1;
+		}
+
+		if (lut > now) {
+			cf_warning(AS_TRUNCATE, "truncate - lut %lu is in the future", lut);
+			return -1;
+		}
+	}
+
+	char smd_key[TRUNCATE_KEY_SZ];
+	char smd_value[32];
+
+	if (set_name) {
+		sprintf(smd_key, "%s|%s", ns_name, set_name);
+	}
+	else {
+		strcpy(smd_key, ns_name);
+	}
+
+	sprintf(smd_value, "%lu", lut);
+
+	cf_info(AS_TRUNCATE, "{%s} truncating %s to lut %lu", ns_name,
+			set_name ? set_name : "all sets", lut);
+
+	return as_smd_set_metadata(TRUNCATE_MODULE, smd_key, smd_value);
+}
+
+bool
+as_truncate_record_is_truncated(as_record* r, as_namespace* ns)
+{
+	if (ns->truncate_lut == 0 && ! ns->any_set_truncated) {
+		return false;
+	}
+
+	return r->last_update_time <
+			truncate_lut_cutoff(ns, as_index_get_set_id(r));
+}
+
+// For records not (yet) in the index - e.g. while loading from storage or
+// receiving migrations.
+bool
+as_truncate_lut_is_truncated(uint64_t rec_lut, as_namespace* ns,
+		const as_rec_props* p_rec_props)
+{
+	uint64_t cutoff = ns->truncate_lut;
+
+	if (ns->any_set_truncated && p_rec_props->size != 0) {
+		const char* set_name;
+		as_set* p_set;
+
+		if (as_rec_props_get_value(p_rec_props, CL_REC_PROPS_FIELD_SET_NAME,
+				NULL, (uint8_t**)&set_name) == 0 &&
+				cf_vmapx_get_by_name(ns->p_sets_vmap, set_name,
+						(void**)&p_set) == CF_VMAPX_OK &&
+				p_set->truncate_lut > cutoff) {
+			cutoff = p_set->truncate_lut;
+		}
+	}
+
+	return rec_lut < cutoff;
+}
+
+
+//==========================================================
+// Local helpers - SMD.
+//
+
+static int
+truncate_smd_accept_cb(char* module, as_smd_item_list_t* items, void* udata,
+		uint32_t accept_opt)
+{
+	for (size_t i = 0; i < items->num_items; i++) {
+		as_smd_item_t* item = items->item[i];
+
+		if (item->action == AS_SMD_ACTION_SET) {
+			truncate_apply(item->key, item->value);
+		}
+		else {
+			// Cutoffs never move back - records already cleaned up are gone.
+			cf_info(AS_TRUNCATE, "ignoring SMD action %d for %s", item->action,
+					item->key);
+		}
+	}
+
+	return 0;
+}
+
+static void
+truncate_apply(const char* key, const char* value)
+{
+	char ns_name[AS_ID_NAMESPACE_SZ];
+	const char* set_name = strchr(key, '|');
+	size_t ns_len = set_name ? (size_t)(set_name - key) : strlen(key);
+
+	if (ns_len == 0 || ns_len >= AS_ID_NAMESPACE_SZ) {
+		cf_warning(AS_TRUNCATE, "bad truncate key %s", key);
+		return;
+	}
+
+	memcpy(ns_name, key, ns_len);
+	ns_name[ns_len] = 0;
+
+	as_namespace* ns = as_namespace_get_byname(ns_name);
+
+	if (! ns) {
+		cf_warning(AS_TRUNCATE, "truncate - unknown namespace %s", ns_name);
+		return;
+	}
+
+	uint64_t lut;
+
+	if (cf_str_atoi_u64((char*)value, &lut) != 0) {
+		cf_warning(AS_TRUNCATE, "{%s} bad truncate lut %s", ns->name, value);
+		return;
+	}
+
+	if (set_name) {
+		set_name++;
+
+		uint16_t set_id = as_namespace_get_create_set_id(ns, set_name);
+		as_set* p_set;
+
+		if (set_id == INVALID_SET_ID || cf_vmapx_get_by_index(ns->p_sets_vmap,
+				set_id - 1, (void**)&p_set) != CF_VMAPX_OK) {
+			cf_warning(AS_TRUNCATE, "{%s} truncate - can't get set %s",
+					ns->name, set_name);
+			return;
+		}
+
+		if (lut <= p_set->truncate_lut) {
+			return;
+		}
+
+		p_set->truncate_lut = lut;
+		ns->any_set_truncated = true;
+
+		cf_info(AS_TRUNCATE, "{%s|%s} got truncate lut %lu", ns->name,
+				set_name, lut);
+	}
+	else {
+		if (lut <= ns->truncate_lut) {
+			return;
+		}
+
+		ns->truncate_lut = lut;
+
+		cf_info(AS_TRUNCATE, "{%s} got truncate lut %lu", ns->name, lut);
+	}
+
+	// Queue the namespace for cleanup, unless it's already queued.
+	if (cf_atomic32_incr(&ns->truncate_pending) == 1) {
+		cf_queue_push(g_truncate_q, &ns);
+	}
+}
+
+
+//==========================================================
+// Local helpers - background cleanup.
+//
+
+static void*
+run_truncate(void* udata)
+{
+	as_namespace* ns;
+
+	while (cf_queue_pop(g_truncate_q, &ns, CF_QUEUE_FOREVER) == CF_QUEUE_OK) {
+		// Cutoffs that arrive from here on will queue the namespace again.
+		cf_atomic32_set(&ns->truncate_pending, 0);
+
+		truncate_namespace(ns);
+	}
+
+	return NULL;
+}
+
+static void
+truncate_namespace(as_namespace* ns)
+{
+	cf_info(AS_TRUNCATE, "{%s} starting truncate cleanup", ns->name);
+
+	uint64_t start_ms = cf_getms();
+	uint64_t n_deleted = 0;
+
+	// If only indexed sets have cutoffs, just visit their records.
+	uint16_t set_ids[AS_SET_MAX_COUNT];
+	uint32_t n_set_ids = truncated_indexed_sets(ns, set_ids);
+
+	// Look at all partitions, whatever their state - all nodes apply the same
+	// cutoffs, so replicas and dangling partitions are cleaned up locally.
+	for (uint32_t pid = 0; pid < AS_PARTITIONS; pid++) {
+		as_partition_reservation rsv;
+
+		AS_PARTITION_RESERVATION_INIT(rsv);
+		as_partition_reserve_migrate(ns, pid, &rsv, NULL);
+
+		truncate_reduce_info cb_info = { ns, rsv.p->vp, 0 };
+
+		// LDT sub-records go with their parents, via LDT garbage collection.
+		if (! truncate_reduce_sets(&rsv, set_ids, n_set_ids, &cb_info)) {
+			as_index_reduce(rsv.p->vp, truncate_reduce_cb, &cb_info);
+		}
+
+		as_partition_release(&rsv);
+
+		n_deleted += cb_info.n_deleted;
+
+		usleep(TRUNCATE_PARTITION_SLEEP_us);
+	}
+
+	cf_atomic64_add(&ns->n_truncated_objects, (int64_t)n_deleted);
+
+	cf_info(AS_TRUNCATE, "{%s} truncate cleanup done - deleted %lu in %lu ms",
+			ns->name, n_deleted, cf_getms() - start_ms);
+}
+
+// Returns 0 unless there's no namespace cutoff, and every set with a cutoff is
+// indexed.
+static uint32_t
+truncated_indexed_sets(as_namespace* ns, uint16_t* set_ids)
+{
+	if (! ns->set_index || ns->truncate_lut != 0) {
+		return 0;
+	}
+
+	uint32_t n_sets = cf_vmapx_count(ns->p_sets_vmap);
+	uint32_t n_set_ids = 0;
+
+	for (uint32_t j = 0; j < n_sets; j++) {
+		as_set* p_set;
+
+		if (cf_vmapx_get_by_index(ns->p_sets_vmap, j, (void**)&p_set) !=
+				CF_VMAPX_OK || p_set->truncate_lut == 0) {
+			continue;
+		}
+
+		uint16_t set_id = (uint16_t)(j + 1);
+
+		if (! as_set_index_is_indexed(ns, set_id)) {
+			return 0;
+		}
+
+		set_ids[n_set_ids++] = set_id;
+	}
+
+	return n_set_ids;
+}
+
+// Returns false if the partition's set index can't be used - the caller should
+// walk the whole tree.
+static bool
+truncate_reduce_sets(as_partition_reservation* rsv, const uint16_t* set_ids,
+		uint32_t n_set_ids, truncate_reduce_info* p_info)
+{
+	if (n_set_ids == 0) {
+		return false;
+	}
+
+	for (uint32_t i = 0; i < n_set_ids; i++) {
+		if (! as_set_index_reduce(p_info->ns, rsv->p, rsv->p->vp, set_ids[i],
+				NULL, NULL, truncate_reduce_cb, p_info)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void
+truncate_reduce_cb(as_index_ref* r_ref, void* udata)
+{
+	truncate_reduce_info* p_info = (truncate_reduce_info*)udata;
+
+	if (as_truncate_record_is_truncated(r_ref->r, p_info->ns)) {
+		as_index_delete(p_info->tree, &r_ref->r->key);
+		p_info->n_deleted++;
+	}
+
+	as_record_done(r_ref, p_info->ns);
+}
+
+static inline uint64_t
+truncate_lut_cutoff(as_namespace* ns, uint16_t set_id)
+{
+	uint64_t cutoff = ns->truncate_lut;
+	as_set* p_set;
+
+	if (ns->any_set_truncated && set_id != INVALID_SET_ID &&
+			cf_vmapx_get_by_index(ns->p_sets_vmap, set_id - 1,
+					(void**)&p_set) == CF_VMAPX_OK &&
+			p_set->truncate_lut > cutoff) {
+		cutoff = p_set->truncate_lut;
+	}
+
+	return cutoff;
+}
@@ -128,6 +128,7 @@ udf_aerospike_delbin(udf_record * urecord, const char * bname)
 	if (has_sindex) {
 		si_arr_index += as_sindex_arr_lookup_by_set_binid_lockfree(rd->ns, set_name, b->id, &si_arr[si_arr_index]);
 		sbins_populated += as_sindex_sbins_from_bin(rd->ns, set_name, b, sbins, AS_SINDEX_OP_DELETE);
+		sbins_populated += as_sindex_sbins_composite_from_bins(rd->ns, set_name, rd->bins, rd->n_bins, b->id, &sbins[sbins_populated], AS_SINDEX_OP_DELETE);
 		SINDEX_GUNLOCK();
 	}
 
@@ -291,6 +292,7 @@ udf_aerospike_setbin(udf_record * urecord, int offset, const char * bname, const
 	if (has_sindex ) {
 		si_arr_index += as_sindex_arr_lookup_by_set_binid_lockfree(rd->ns, set_name, b->id, &si_arr[si_arr_index]);
 		sbins_populated += as_sindex_sbins_from_bin(rd->ns, set_name, b, &sbins[sbins_populated], AS_SINDEX_OP_DELETE);
+		sbins_populated += as_sindex_sbins_composite_from_bins(rd->ns, set_name, rd->bins, rd->n_bins, b->id, &sbins[sbins_populated], AS_SINDEX_OP_DELETE);
 	}
 
 	// we know we are doing an update now, make sure there is particle data,
@@ -340,6 +342,7 @@ udf_aerospike_setbin(udf_record * urecord, int offset, const char * bname, const
 
 		si_arr_index += as_sindex_arr_lookup_by_set_binid_lockfree(rd->ns, set_name, b->id, &si_arr[si_arr_index]);
 		sbins_populated += as_sindex_sbins_from_bin(rd->ns, set_name, b, &sbins[sbins_populated], AS_SINDEX_OP_INSERT);
+		sbins_populated += as_sindex_sbins_composite_from_bins(rd->ns, set_name, rd->bins, rd->n_bins, b->id, &sbins[sbins_populated], AS_SINDEX_OP_INSERT);
 		SINDEX_GUNLOCK();
 		if (sbins_populated > 0) {
 			tr->flags |= AS_TRANSACTION_FLAG_SINDEX_TOUCHED;
@@ -714,6 +717,8 @@ udf_aerospike__execute_updates(udf_record * urecord)
 		return 0;
 	}
 
+	udf_storage_record_load_bins(urecord);
+
 	// fail updates in case update is not allowed. Queries and scans do not
 	// not allow updates. Updates will never be true .. just being paranoid
 	if (!(urecord->flag & UDF_RECORD_FLAG_ALLOW_UPDATES)) {
@@ -828,8 +833,8 @@ udf_aerospike_rec_create(const as_aerospike * as, const as_rec * rec)
 	if (rv == 1) {
 		is_create = true;
 	} else if (rv == 0) {
-		// If it's an expired record, pretend it's a fresh create.
-		if (as_record_is_expired(r_ref->r)) {
+		// If it's an expired or truncated record, pretend it's a fresh create.
+		if (as_record_is_doomed(r_ref->r, tr->rsv.ns)) {
 			as_record_destroy(r_ref->r, tr->rsv.ns);
 			as_record_initialize(r_ref, tr->rsv.ns);
 			cf_atomic_int_incr(&tr->rsv.ns->n_objects);
@@ -47,6 +47,7 @@
 #include "base/cfg.h"
 #include "base/thr_info.h"
 #include "base/system_metadata.h"
+#include "base/udf_result_cache.h"
 #include <sys/stat.h>
 
 char udf_smd_module_name[] = "UDF";
@@ -56,6 +57,7 @@ static int file_read(char *, uint8_t **, size_t *, unsigned char *);
 static int file_write(char *, uint8_t *, size_t, unsigned char *);
 static int file_remove(char *);
 static int file_generation(char *, uint8_t *, size_t, unsigned char *);
+static bool file_matches(char *, const char *, size_t);
 
 static inline int file_resolve(char * filepath, char * filename, char * ext) {
 
@@ -135,6 +137,26 @@ static int file_read(char * filename, uint8_t ** content, size_t * content_len,
 	return 1;
 }
 
+// Whether the stored file has this base 64 encoded content - compared encoded,
+// as file_read() returns it.
+static bool file_matches(char * filename, const char * content64, size_t content64_len) {
+
+	uint8_t *           content             = NULL;
+	size_t              content_len         = 0;
+	unsigned char       content_gen[256]    = {0};
+
+	if ( file_read(filename, &content, &content_len, content_gen) ) {
+		return false;
+	}
+
+	bool matches = content_len == content64_len &&
+			memcmp(content, content64, content_len) == 0;
+
+	cf_free(content);
+
+	return matches;
+}
+
 static int file_write(char * filename, uint8_t * content, size_t content_len, unsigned char * hash) {
 
 	FILE *  file            = NULL;
@@ -579,6 +601,7 @@ int udf_cask_info_clear_cache(char *name, char * params, cf_dyn_buf * out)
 		.type = AS_MODULE_EVENT_CLEAR_CACHE
 	};
 	as_module_update(&mod_lua, &e);
+	udf_result_cache_invalidate();
 
 	mod_lua_unlock(&mod_lua);
 
@@ -643,6 +666,19 @@ udf_cask_smd_accept_fn(char *module, as_smd_item_list_t *items, void *udata, uin
 
 			// base 64 decode it
 			uint32_t encoded_len = strlen(content64_str);
+
+			// SMD re-accepts every item, e.g. on cluster changes - leave
+			// unchanged modules, and their cached Lua states, alone.
+			mod_lua_rdlock(&mod_lua);
+			bool unchanged = file_matches(item->key, content64_str, encoded_len);
+			mod_lua_unlock(&mod_lua);
+
+			if (unchanged) {
+				cf_debug(AS_UDF, "UDF module %s unchanged on accept", item->key);
+				json_decref(item_obj);
+				continue;
+			}
+
 			uint32_t decoded_len = cf_b64_decoded_buf_size(encoded_len) + 1;
 			char *content_str = cf_malloc(decoded_len);
 
@@ -676,6 +712,7 @@ udf_cask_smd_accept_fn(char *module, as_smd_item_list_t *items, void *udata, uin
 				.data.filename  = item->key
 			};
 			as_module_update(&mod_lua, &ame);
+			udf_result_cache_invalidate();
 			mod_lua_unlock(&mod_lua);
 		}
 		else if (item->action == AS_SMD_ACTION_DELETE) {
@@ -690,6 +727,7 @@ udf_cask_smd_accept_fn(char *module, as_smd_item_list_t *items, void *udata, uin
 				.data.filename  = item->key
 			};
 			as_module_update(&mod_lua, &e);
+			udf_result_cache_invalidate();
 
 			mod_lua_unlock(&mod_lua);
 
@@ -22,10 +22,26 @@
 
 
 #include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
 
+#include "citrusleaf/cf_atomic.h"
+
+#include "dynbuf.h"
 #include "fault.h"
 
+#include "base/cfg.h"
 #include "base/udf_memtracker.h"
+#include "transaction/udf.h"
+
+
+#define MAX_UDF_MODULES 256
+
+typedef struct module_mem_s {
+	char		filename[UDF_MAX_STRING_SZ];
+	cf_atomic64	high_water;
+} module_mem;
 
 
 /*****************************************************************************
@@ -34,14 +50,23 @@
 
 static pthread_key_t   modules_tlskey = 0;
 static as_memtracker   g_udf_memtracker;
-static int
+
+// Modules are only ever added, and only under the lock - readers check the
+// count, then the names below it.
+static module_mem      g_module_mem[MAX_UDF_MODULES];
+static cf_atomic32     g_n_module_mem = 0;
+static pthread_mutex_t g_module_mem_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static bool
 udf_memtracker_generic(mem_tracker *mt, const uint32_t num_bytes, memtracker_op op)
 {
+	// Nothing to track - don't fail the caller.
 	if (!mt || !mt->udata || !mt->cb) {
-		return false;
+		return true;
 	}
 
-	mt->cb(mt, num_bytes, op);
+	bool rv = mt->cb(mt, num_bytes, op);
+
 	if (op == MEM_RESERVE) {
 		cf_detail(AS_UDF, "%ld: Memory Tracker %p reserved = %d (bytes)",
 				  pthread_self(), mt, num_bytes);
@@ -52,7 +77,7 @@ udf_memtracker_generic(mem_tracker *mt, const uint32_t num_bytes, memtracker_op
 		cf_detail(AS_UDF, "%ld: Memory Tracker %p reset",
 				  pthread_self(), mt);
 	}
-	return 0;
+	return rv;
 }
 
 void
@@ -103,3 +128,134 @@ udf_memtracker_init()
 	as_memtracker_init(&g_udf_memtracker, NULL, &udf_memtracker_hooks);
 	return &g_udf_memtracker;
 }
+
+static module_mem *
+module_mem_find(const char *filename, uint32_t n)
+{
+	for (uint32_t i = 0; i < n; i++) {
+		if (strcmp(g_module_mem[i].filename, filename) == 0) {
+			return &g_module_mem[i];
+		}
+	}
+
+	return NULL;
+}
+
+static module_mem *
+module_mem_get(const char *filename)
+{
+	module_mem *mm = module_mem_find(filename, cf_atomic32_get(g_n_module_mem));
+
+	if (mm) {
+		return mm;
+	}
+
+	pthread_mutex_lock(&g_module_mem_lock);
+
+	uint32_t n = cf_atomic32_get(g_n_module_mem);
+
+	if (! (mm = module_mem_find(filename, n)) && n < MAX_UDF_MODULES) {
+		mm = &g_module_mem[n];
+		strncpy(mm->filename, filename, sizeof(mm->filename) - 1);
+		cf_atomic64_set(&mm->high_water, 0);
+		cf_atomic32_incr(&g_n_module_mem);
+	}
+
+	pthread_mutex_unlock(&g_module_mem_lock);
+
+	return mm;
+}
+
+static bool
+udf_mem_call_cb(mem_tracker *mt, uint32_t num_bytes, memtracker_op op)
+{
+	udf_mem_call *call = (udf_mem_call *)mt->udata;
+
+	switch (op) {
+	case MEM_RESERVE:
+		if (call->limit != 0 && call->in_use + num_bytes > call->limit) {
+			cf_detail(AS_UDF, "%s: over udf-runtime-max-memory %lu with %lu + %u bytes",
+					call->filename, call->limit, call->in_use, num_bytes);
+			return false;
+		}
+
+		call->in_use += num_bytes;
+
+		if (call->in_use > call->peak) {
+			call->peak = call->in_use;
+		}
+		break;
+	case MEM_RELEASE:
+		call->in_use = num_bytes > call->in_use ? 0 : call->in_use - num_bytes;
+		break;
+	case MEM_RESET:
+		call->in_use = 0;
+		break;
+	}
+
+	return true;
+}
+
+// Returns the as_memtracker to put in the call's as_udf_context.
+as_memtracker *
+udf_mem_call_setup(udf_mem_call *call, const char *filename)
+{
+	call->mt.udata = call;
+	call->mt.cb = udf_mem_call_cb;
+	call->filename = filename;
+	call->in_use = 0;
+	call->peak = 0;
+	call->limit = g_config.udf_runtime_max_memory;
+
+	udf_memtracker_setup(&call->mt);
+
+	return &g_udf_memtracker;
+}
+
+void
+udf_mem_call_done(udf_mem_call *call)
+{
+	udf_memtracker_cleanup();
+
+	if (call->peak == 0) {
+		return;
+	}
+
+	module_mem *mm = module_mem_get(call->filename);
+
+	if (! mm) {
+		return;
+	}
+
+	uint64_t high_water = cf_atomic64_get(mm->high_water);
+
+	while (call->peak > high_water) {
+		uint64_t old = cf_atomic64_cas(&mm->high_water, high_water, call->peak);
+
+		if (old == high_water) {
+			break;
+		}
+
+		high_water = old;
+	}
+}
+
+// Per-module high-water marks, as "filename=bytes;".
+int
+udf_memtracker_info(char *name, cf_dyn_buf *db)
+{
+	uint32_t n = cf_atomic32_get(g_n_module_mem);
+
+	for (uint32_t i = 0; i < n; i++) {
+		cf_dyn_buf_append_string(db, g_module_mem[i].filename);
+		cf_dyn_buf_append_char(db, '=');
+		cf_dyn_buf_append_uint64(db, cf_atomic64_get(g_module_mem[i].high_water));
+		cf_dyn_buf_append_char(db, ';');
+	}
+
+	if (n != 0) {
+		cf_dyn_buf_chomp(db);
+	}
+
+	return 0;
+}
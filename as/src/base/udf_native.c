@@ -0,0 +1,209 @@
+/*
+ * udf_native.c
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/* SYNOPSIS
+ * Loads natively compiled UDF modules and finds their functions by module and
+ * function name. Modules are only loaded at startup, from a local directory -
+ * never through udf-put and SMD, which would let any client with UDF
+ * privileges run arbitrary machine code on every node. The module table is
+ * read-only once loaded, so lookups need no lock.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "base/udf_native.h"
+
+#include <dirent.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "fault.h"
+
+#include "base/cfg.h"
+
+
+//==========================================================
+// Constants.
+//
+
+#define MAX_NATIVE_MODULES 64
+
+
+//==========================================================
+// Globals.
+//
+
+static const udf_native_module* g_native_modules[MAX_NATIVE_MODULES];
+static uint32_t g_n_native_modules = 0;
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static void load_module(const char* path);
+static const udf_native_module* find_module(const char* module);
+static const udf_native_function* find_function(const char* module, const char* function);
+
+
+//==========================================================
+// Public API.
+//
+
+void
+udf_native_init()
+{
+	if (g_config.udf_native_path[0] == '\0') {
+		return;
+	}
+
+	DIR* dir = opendir(g_config.udf_native_path);
+
+	if (! dir) {
+		cf_crash_nostack(AS_UDF, "could not open native udf directory %s: %s",
+				g_config.udf_native_path, cf_strerror(errno));
+	}
+
+	struct dirent* entry;
+
+	while ((entry = readdir(dir)) != NULL) {
+		size_t len = strlen(entry->d_name);
+
+		if (len < 3 || strcmp(entry->d_name + len - 3, ".so") != 0) {
+			continue;
+		}
+
+		char path[1024];
+
+		snprintf(path, sizeof(path), "%s/%s", g_config.udf_native_path,
+				entry->d_name);
+		load_module(path);
+	}
+
+	closedir(dir);
+}
+
+udf_native_record_fn
+udf_native_record_get(const char* module, const char* function)
+{
+	const udf_native_function* fn = find_function(module, function);
+
+	return fn ? fn->record_fn : NULL;
+}
+
+udf_native_stream_fn
+udf_native_stream_get(const char* module, const char* function)
+{
+	const udf_native_function* fn = find_function(module, function);
+
+	return fn ? fn->stream_fn : NULL;
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+static void
+load_module(const char* path)
+{
+	if (g_n_native_modules == MAX_NATIVE_MODULES) {
+		cf_warning(AS_UDF, "too many native udf modules, not loading %s", path);
+		return;
+	}
+
+	void* handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+
+	if (! handle) {
+		cf_warning(AS_UDF, "failed to load native udf module %s: %s", path,
+				dlerror());
+		return;
+	}
+
+	const udf_native_module* mod = (const udf_native_module*)
+			dlsym(handle, UDF_NATIVE_MODULE_SYMBOL);
+
+	if (! mod) {
+		cf_warning(AS_UDF, "native udf module %s has no %s", path,
+				UDF_NATIVE_MODULE_SYMBOL);
+		dlclose(handle);
+		return;
+	}
+
+	if (mod->abi_version != UDF_NATIVE_ABI_VERSION || ! mod->name ||
+			(mod->n_functions != 0 && ! mod->functions)) {
+		cf_warning(AS_UDF, "native udf module %s is invalid or abi version %u not %u",
+				path, mod->abi_version, UDF_NATIVE_ABI_VERSION);
+		dlclose(handle);
+		return;
+	}
+
+	if (find_module(mod->name)) {
+		cf_warning(AS_UDF, "native udf module %s duplicates module '%s'",
+				path, mod->name);
+		dlclose(handle);
+		return;
+	}
+
+	// Never unloaded - functions may be running until shutdown.
+	g_native_modules[g_n_native_modules++] = mod;
+
+	cf_info(AS_UDF, "native udf module '%s' (%s) loaded, %u functions",
+			mod->name, path, mod->n_functions);
+}
+
+static const udf_native_module*
+find_module(const char* module)
+{
+	for (uint32_t i = 0; i < g_n_native_modules; i++) {
+		if (strcmp(g_native_modules[i]->name, module) == 0) {
+			return g_native_modules[i];
+		}
+	}
+
+	return NULL;
+}
+
+static const udf_native_function*
+find_function(const char* module, const char* function)
+{
+	const udf_native_module* mod = find_module(module);
+
+	if (! mod) {
+		return NULL;
+	}
+
+	for (uint32_t i = 0; i < mod->n_functions; i++) {
+		if (strcmp(mod->functions[i].name, function) == 0) {
+			return &mod->functions[i];
+		}
+	}
+
+	return NULL;
+}
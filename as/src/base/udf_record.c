@@ -100,7 +100,20 @@ udf_storage_record_open(udf_record *urecord)
 		rd->n_bins = sizeof(urecord->stack_bins) / sizeof(as_bin);
 	}
 
-	rd->bins = as_bin_get_all(r, rd, urecord->stack_bins);
+	// For data-not-in-memory multibin records, don't load the bins until the
+	// UDF needs all of them - bin reads are served straight from the device
+	// block. LDT records and sub-records are always loaded up front.
+	if ( ! tr->rsv.ns->storage_data_in_memory && ! tr->rsv.ns->single_bin &&
+			! tr->rsv.ns->ldt_enabled &&
+			! (urecord->flag & UDF_RECORD_FLAG_IS_SUBRECORD) ) {
+		rd->bins = urecord->stack_bins;
+		as_bin_set_all_empty(rd);
+		urecord->flag |= UDF_RECORD_FLAG_BINS_DEFERRED;
+	}
+	else {
+		rd->bins = as_bin_get_all(r, rd, urecord->stack_bins);
+	}
+
 	urecord->starting_memory_bytes = as_storage_record_get_n_bytes_memory(rd);
 
 	as_storage_record_get_key(rd);
@@ -118,6 +131,51 @@ udf_storage_record_open(udf_record *urecord)
 	return 0;
 }
 
+/*
+ * Function: Load all bins of a record opened with its bins deferred - before
+ *           anything that looks at or changes the record's bins as a whole.
+ *
+ * Parameters:
+ * 		urec    : UDF record
+ *
+ * Callers:
+ * 		udf_record_bin_names
+ * 		udf_record_numbins
+ * 		udf_aerospike__execute_updates
+ */
+void
+udf_storage_record_load_bins(udf_record *urecord)
+{
+	if (!(urecord->flag & UDF_RECORD_FLAG_BINS_DEFERRED)) {
+		return;
+	}
+
+	as_storage_rd *rd = urecord->rd;
+
+	rd->n_bins = sizeof(urecord->stack_bins) / sizeof(as_bin);
+	rd->bins = as_bin_get_all(urecord->r_ref->r, rd, urecord->stack_bins);
+
+	urecord->flag &= ~UDF_RECORD_FLAG_BINS_DEFERRED;
+}
+
+/*
+ * Function: Load just the given bins of a deferred record, so natively
+ *           checking them doesn't load them all. The record stays
+ *           deferred - UDF bin reads still go straight to the device block.
+ */
+void
+udf_storage_record_load_some_bins(udf_record *urecord, const uint16_t *ids, uint16_t n_ids)
+{
+	if (!(urecord->flag & UDF_RECORD_FLAG_BINS_DEFERRED)) {
+		return;
+	}
+
+	as_storage_rd *rd = urecord->rd;
+
+	rd->n_bins = sizeof(urecord->stack_bins) / sizeof(as_bin);
+	rd->bins = as_bin_get_some(urecord->r_ref->r, rd, urecord->stack_bins, ids, n_ids);
+}
+
 /*
  * Function: Close storage record if it open and also set flags
  *
@@ -175,7 +233,7 @@ udf_storage_record_close(udf_record *urecord)
 			cf_warning(AS_UDF, "Unexpected Internal Error (null r_ref)");
 		}
 
-		urecord->flag &= ~UDF_RECORD_FLAG_STORAGE_OPEN;
+		urecord->flag &= ~(UDF_RECORD_FLAG_STORAGE_OPEN | UDF_RECORD_FLAG_BINS_DEFERRED);
 		cf_detail_digest(AS_UDF, &urecord->tr->keyd, "Storage Close:: Rec(%p) Flag(%x) Digest:",
 				urecord, urecord->flag );
 		return 0;
@@ -227,7 +285,7 @@ udf_record_open(udf_record * urecord)
 	if (!rec_rv) {
 		as_index *r = r_ref->r;
 		// check to see this isn't an expired record waiting to die
-		if (as_record_is_expired(r)) {
+		if (as_record_is_doomed(r, tr->rsv.ns)) {
 			as_record_done(r_ref, tr->rsv.ns);
 			cf_detail(AS_UDF, "udf_record_open: Record has expired cannot read");
 			rec_rv = -2;
@@ -595,6 +653,47 @@ udf_record_bin_ishidden(const udf_record *urecord, const char *name)
 	return as_bin_is_hidden(bb);
 }
 
+/*
+ * Internal Function: Read one bin of a record opened with its bins deferred,
+ *                    straight from the device block, and convert it into
+ *                    as_val - the record's bins stay unloaded.
+ *
+ * Callers:
+ * 		udf_record_storage_get
+ */
+static as_val *
+udf_record_storage_get_deferred(const udf_record *urecord, const char *name)
+{
+	as_storage_rd *rd = urecord->rd;
+	int16_t id = as_bin_get_id(rd->ns, name);
+
+	if (id == -1) {
+		cf_detail(AS_UDF, "udf_record_get: bin not found (%s)", name);
+		return NULL;
+	}
+
+	uint16_t ids[1] = { (uint16_t)id };
+	as_bin bin;
+	as_bin *bins = rd->bins;
+	uint16_t n_bins = rd->n_bins;
+
+	rd->bins = &bin;
+	rd->n_bins = 1;
+	as_bin_set_all_empty(rd);
+
+	int rv = as_storage_particle_read_bins_ssd(rd, ids, 1);
+
+	rd->bins = bins;
+	rd->n_bins = n_bins;
+
+	if (rv != 0 || ! as_bin_inuse(&bin)) {
+		cf_detail(AS_UDF, "udf_record_get: bin not found (%s)", name);
+		return NULL;
+	}
+
+	return as_bin_particle_to_asval(&bin);
+}
+
 /*
  * Internal Function: Read the bin from storage and convert it
  *                    into as_val and return
@@ -627,6 +726,11 @@ udf_record_storage_get(const udf_record *urecord, const char *name)
 		cf_detail(AS_UDF, "Passed Null bin name to storage get");
 		return NULL;
 	}
+
+	if (urecord->flag & UDF_RECORD_FLAG_BINS_DEFERRED) {
+		return udf_record_storage_get_deferred(urecord, name);
+	}
+
 	as_bin * bb = as_bin_get(urecord->rd, name);
 
 	if ( !bb ) {
@@ -1102,6 +1206,8 @@ udf_record_bin_names(const as_rec *rec, as_rec_bin_names_callback callback, void
 	if (urecord && (urecord->flag & UDF_RECORD_FLAG_STORAGE_OPEN)) {
 		uint16_t nbins;
 
+		udf_storage_record_load_bins(urecord);
+
 		if (urecord->rd->ns->single_bin) {
 			nbins = 1;
 			bin_names = alloca(1);
@@ -1147,6 +1253,8 @@ udf_record_numbins(const as_rec * rec)
 			return 1;
 		}
 
+		udf_storage_record_load_bins(urecord);
+
 		uint16_t i;
 		as_storage_rd *rd = urecord->rd;
 		for (i = 0; i < rd->n_bins; i++) {
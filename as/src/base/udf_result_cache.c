@@ -0,0 +1,268 @@
+/*
+ * udf_result_cache.c
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/* SYNOPSIS
+ * A direct-mapped table of read-only record UDF results - a new result
+ * replaces whatever was in its slot. Results are kept msgpack serialized, so
+ * each hit gets its own as_val and nothing is shared between transactions.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "base/udf_result_cache.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "aerospike/as_msgpack.h"
+#include "aerospike/as_serializer.h"
+#include "aerospike/as_val.h"
+#include "citrusleaf/alloc.h"
+#include "citrusleaf/cf_atomic.h"
+#include "citrusleaf/cf_digest.h"
+
+#include "fault.h"
+
+#include "base/cfg.h"
+#include "base/datamodel.h"
+#include "base/proto.h"
+#include "base/stats.h"
+#include "transaction/udf.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+#define MAX_CACHED_RESULT_SZ (16 * 1024)
+
+typedef struct cache_entry_s {
+	pthread_mutex_t	lock;
+	bool			valid;
+	uint32_t		epoch;
+	uint32_t		ns_id;
+	uint16_t		generation;
+	uint64_t		last_update_time;
+	cf_digest		keyd;
+	cf_digest		call_digest; // module, function and arguments
+	uint32_t		value_sz;
+	uint8_t*		value; // msgpack
+} cache_entry;
+
+
+//==========================================================
+// Globals.
+//
+
+static cache_entry* g_cache = NULL;
+static uint32_t g_cache_size = 0;
+
+// Bumped on any UDF module change - entries from earlier epochs are misses.
+static cf_atomic32 g_epoch = 0;
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static cache_entry* entry_lock(const udf_def* def, const cf_digest* keyd, cf_digest* call_digest);
+static bool entry_matches(const cache_entry* e, uint32_t epoch, const as_namespace* ns, const cf_digest* keyd, uint16_t generation, uint64_t last_update_time, const cf_digest* call_digest);
+
+
+//==========================================================
+// Public API.
+//
+
+void
+udf_result_cache_init()
+{
+	if (g_config.n_udf_result_cache_modules == 0 ||
+			g_config.udf_result_cache_size == 0) {
+		return;
+	}
+
+	g_cache_size = g_config.udf_result_cache_size;
+	g_cache = cf_calloc(g_cache_size, sizeof(cache_entry));
+
+	cf_assert(g_cache, AS_UDF, CF_CRITICAL, "failed UDF result cache calloc");
+
+	for (uint32_t i = 0; i < g_cache_size; i++) {
+		pthread_mutex_init(&g_cache[i].lock, NULL);
+	}
+
+	cf_info(AS_UDF, "caching read results of %u module(s) in %u entries",
+			g_config.n_udf_result_cache_modules, g_cache_size);
+}
+
+bool
+udf_result_cache_enabled(const udf_def* def)
+{
+	if (! g_cache) {
+		return false;
+	}
+
+	for (uint32_t i = 0; i < g_config.n_udf_result_cache_modules; i++) {
+		if (strcmp(g_config.udf_result_cache_modules[i], def->filename) == 0) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Returns null on a miss. Generation and last-update-time are the record's,
+// read under the record lock.
+as_val*
+udf_result_cache_get(const udf_def* def, const as_namespace* ns,
+		const cf_digest* keyd, uint16_t generation, uint64_t last_update_time)
+{
+	uint32_t epoch = cf_atomic32_get(g_epoch);
+	cf_digest call_digest;
+	cache_entry* e = entry_lock(def, keyd, &call_digest);
+	as_val* val = NULL;
+
+	if (entry_matches(e, epoch, ns, keyd, generation, last_update_time,
+			&call_digest)) {
+		as_unpacker pk = {
+				.buffer = e->value,
+				.offset = 0,
+				.length = e->value_sz
+		};
+
+		if (as_unpack_val(&pk, &val) != 0) {
+			val = NULL;
+		}
+	}
+
+	pthread_mutex_unlock(&e->lock);
+
+	if (val) {
+		cf_shard_counter_incr(&g_stats.udf_result_cache_hits);
+	}
+	else {
+		cf_shard_counter_incr(&g_stats.udf_result_cache_misses);
+	}
+
+	return val;
+}
+
+// Generation and last-update-time are those of the record the UDF read.
+void
+udf_result_cache_put(const udf_def* def, const as_namespace* ns,
+		const cf_digest* keyd, uint16_t generation, uint64_t last_update_time,
+		const as_val* val)
+{
+	as_serializer s;
+	as_msgpack_init(&s);
+
+	uint32_t value_sz = as_serializer_serialize_getsize(&s, (as_val*)val);
+
+	if (value_sz == 0 || value_sz > MAX_CACHED_RESULT_SZ) {
+		as_serializer_destroy(&s);
+		return;
+	}
+
+	uint8_t* value = cf_malloc(value_sz);
+
+	if (! value) {
+		as_serializer_destroy(&s);
+		return;
+	}
+
+	as_serializer_serialize_presized(&s, val, value);
+	as_serializer_destroy(&s);
+
+	cf_digest call_digest;
+	cache_entry* e = entry_lock(def, keyd, &call_digest);
+
+	if (e->valid) {
+		cf_free(e->value);
+		cf_atomic64_incr(&g_stats.udf_result_cache_evictions);
+	}
+
+	e->valid = true;
+	e->epoch = cf_atomic32_get(g_epoch);
+	e->ns_id = ns->id;
+	e->generation = generation;
+	e->last_update_time = last_update_time;
+	e->keyd = *keyd;
+	e->call_digest = call_digest;
+	e->value_sz = value_sz;
+	e->value = value;
+
+	pthread_mutex_unlock(&e->lock);
+}
+
+// A module was added, changed or removed - leave entries to be overwritten.
+void
+udf_result_cache_invalidate()
+{
+	cf_atomic32_incr(&g_epoch);
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+static cache_entry*
+entry_lock(const udf_def* def, const cf_digest* keyd, cf_digest* call_digest)
+{
+	char name[UDF_MAX_STRING_SZ * 2 + 1];
+	size_t name_len = (size_t)snprintf(name, sizeof(name), "%s:%s",
+			def->filename, def->function);
+
+	if (name_len >= sizeof(name)) {
+		name_len = sizeof(name) - 1;
+	}
+
+	cf_digest_compute2(name, name_len,
+			def->arglist ? def->arglist->data : NULL,
+			def->arglist ? as_msg_field_get_value_sz(def->arglist) : 0,
+			call_digest);
+
+	uint64_t hash = *(uint64_t*)&keyd->digest[0] ^
+			*(uint64_t*)&call_digest->digest[0];
+	cache_entry* e = &g_cache[hash % g_cache_size];
+
+	pthread_mutex_lock(&e->lock);
+
+	return e;
+}
+
+static bool
+entry_matches(const cache_entry* e, uint32_t epoch, const as_namespace* ns,
+		const cf_digest* keyd, uint16_t generation, uint64_t last_update_time,
+		const cf_digest* call_digest)
+{
+	return e->valid && e->epoch == epoch && e->ns_id == ns->id &&
+			e->generation == generation &&
+			e->last_update_time == last_update_time &&
+			cf_digest_compare((cf_digest*)&e->keyd, (cf_digest*)keyd) == 0 &&
+			cf_digest_compare((cf_digest*)&e->call_digest,
+					(cf_digest*)call_digest) == 0;
+}
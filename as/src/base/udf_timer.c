@@ -26,6 +26,7 @@
 
 #include "citrusleaf/cf_clock.h"
 
+#include "coarse_clock.h"
 #include "fault.h"
 
 
@@ -33,43 +34,39 @@
  * STATIC FUNCTIONS
  *****************************************************************************/
 
-static pthread_key_t   timer_tlskey = 0;
-static pthread_once_t  key_once = PTHREAD_ONCE_INIT;
-
-static void
-udf_make_key()
-{
-	pthread_key_create(&timer_tlskey, NULL);
-}
+// The tracker, and its end time - fixed for the life of a UDF call, so read
+// once at setup. Lua hooks check for time out every so many instructions, and
+// then only need a clock read.
+static __thread time_tracker * t_tt = NULL;
+static __thread uint64_t t_end_time = 0;
 
 void
 udf_timer_setup(time_tracker *tt)
 {
-	pthread_once(&key_once, udf_make_key);
-	pthread_setspecific(timer_tlskey, tt);
+	t_tt = tt;
+	t_end_time = tt && tt->end_time ? tt->end_time(tt) : 0;
 	cf_detail(AS_UDF, "tid=%ld tt=%p", pthread_self(), tt);
 }
 
 void
 udf_timer_cleanup()
 {
-	pthread_setspecific(timer_tlskey, NULL);
+	t_tt = NULL;
+	t_end_time = 0;
 	cf_detail(AS_UDF, "tid=%ld", pthread_self());
 }
 
 bool
 udf_timer_timedout(const as_timer * timer)
 {
-	time_tracker *tt = (time_tracker *)pthread_getspecific(timer_tlskey);
-	cf_detail(AS_UDF, "tid=%ld tt=%p", pthread_self(), tt);
-
-	if (!tt || !tt->end_time) {
+	if (t_end_time == 0) {
 		return true;
 	}
-	uint64_t now = cf_getns();
-	bool timedout = (now > tt->end_time(tt));
-	if (timedout) {
-		cf_warning(AS_UDF, "UDF Timed Out [%lu:%lu]", now / 1000000, tt->end_time(tt) / 1000000);
+
+	uint64_t now = cf_coarse_getns();
+
+	if (now > t_end_time) {
+		cf_warning(AS_UDF, "UDF Timed Out [%lu:%lu]", now / 1000000, t_end_time / 1000000);
 		return true;
 	}
 	return false;
@@ -78,13 +75,13 @@ udf_timer_timedout(const as_timer * timer)
 uint64_t
 udf_timer_timeslice(const as_timer * timer)
 {
-	time_tracker *tt = (time_tracker *)pthread_getspecific(timer_tlskey);
-	cf_detail(AS_UDF, "tid=%ld tt=%p", pthread_self(), tt);
+	cf_detail(AS_UDF, "tid=%ld tt=%p", pthread_self(), t_tt);
 
-	if (!tt || !tt->end_time) {
+	if (t_end_time == 0) {
 		return 0;
 	}
-	uint64_t timeslice = (tt->end_time(tt) - cf_getns()) / 1000000;
+	uint64_t now = cf_coarse_getns();
+	uint64_t timeslice = now < t_end_time ? (t_end_time - now) / 1000000 : 0;
 	return (timeslice > 0) ? timeslice : 1;
 }
 
@@ -0,0 +1,782 @@
+/*
+ * xdr_dlog.c
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/* SYNOPSIS
+ * The digest log - a memory-mapped ring file of fixed-size frames, one per
+ * write or delete, for shipping to remote datacenters. Writers reserve a slot
+ * with a compare-and-swap on the reserve cursor, fill the frame in place, and
+ * publish it by storing its slot number last. No lock is taken on the write
+ * path and nothing is synced there - a flusher thread finds how far frames are
+ * contiguously published, msyncs that range every few milliseconds, then
+ * checkpoints the cursors in the header page. Recovery starts from the
+ * checkpoint and scans forward while frames validate, so it reads only what
+ * was written after the last checkpoint.
+ *
+ * The shipper, if a callback is registered, reads flushed frames, drops all
+ * but the latest frame for each digest, groups them by partition, and hands
+ * each group over sorted in storage order.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "base/xdr_dlog.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "citrusleaf/alloc.h"
+#include "citrusleaf/cf_atomic.h"
+#include "citrusleaf/cf_clock.h"
+#include "citrusleaf/cf_digest.h"
+
+#include "dynbuf.h"
+#include "fault.h"
+#include "util.h"
+
+#include "base/cfg.h"
+#include "base/datamodel.h"
+#include "base/index.h"
+#include "storage/storage.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+#define DLOG_MAGIC 0x474F4C4447494458 // "XDIGDLOG"
+#define DLOG_VERSION 1
+
+// Frames start after the header page.
+#define DLOG_HEADER_SIZE 4096
+#define DLOG_MIN_SIZE (1024 * 1024)
+
+#define FLUSH_PERIOD_US (10 * 1000)
+
+#define SHIP_BATCH_SIZE (16 * 1024)
+#define SHIP_IDLE_US (10 * 1000)
+
+COMPILER_ASSERT(sizeof(as_xdr_dlog_entry) == 48);
+
+typedef struct dlog_header_s {
+	uint64_t	magic;
+	uint32_t	version;
+	uint32_t	entry_size;
+	uint64_t	n_slots;
+	uint64_t	write_slot; // frames before this are durable
+	uint64_t	read_slot; // frames before this are shipped
+	uint32_t	unused;
+	uint32_t	crc;
+} dlog_header;
+
+typedef struct dlog_s {
+	int				fd;
+	uint8_t*		base;
+	size_t			size;
+	uint64_t		n_slots;
+	bool			overwrite;
+
+	dlog_header*		header;
+	as_xdr_dlog_entry*	entries;
+
+	// Slots start at 1 so a zeroed frame is never mistaken for a published
+	// one. Each cursor only moves forward.
+	cf_atomic64		reserve_slot;
+	cf_atomic64		flush_slot;
+	cf_atomic64		read_slot;
+
+	pthread_mutex_t	read_lock;
+	uint64_t		last_read_slot; // where the last read started
+
+	as_xdr_dlog_ship_fn	ship_cb;
+	void*				ship_udata;
+
+	cf_atomic64		n_written;
+	cf_atomic64		n_dropped;
+	cf_atomic64		n_overwritten;
+	cf_atomic64		n_flushes;
+	cf_atomic64		n_shipped;
+	cf_atomic64		n_deduped;
+} dlog;
+
+typedef struct ship_item_s {
+	uint64_t			order;
+	as_xdr_dlog_entry	e;
+} ship_item;
+
+
+//==========================================================
+// Globals.
+//
+
+static dlog g_dlog = { .fd = -1 };
+static volatile bool g_dlog_open = false;
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static bool open_log(const char* path, uint64_t size);
+static void recover_log();
+static void* run_flush(void* arg);
+static void flush_range(uint64_t from, uint64_t to);
+static void checkpoint();
+static void* run_ship(void* arg);
+static uint32_t dedup_items(ship_item* items, uint32_t n_items);
+static uint64_t storage_order(as_namespace* ns, as_index_tree* tree, ship_item* item);
+static int item_digest_compare(const void* pa, const void* pb);
+static int item_order_compare(const void* pa, const void* pb);
+
+static inline as_xdr_dlog_entry*
+slot_entry(uint64_t slot)
+{
+	return &g_dlog.entries[slot % g_dlog.n_slots];
+}
+
+static inline uint32_t
+entry_crc(const as_xdr_dlog_entry* e)
+{
+	return (uint32_t)crc32(0, (const uint8_t*)e,
+			offsetof(as_xdr_dlog_entry, crc));
+}
+
+static inline uint32_t
+header_crc(const dlog_header* h)
+{
+	return (uint32_t)crc32(0, (const uint8_t*)h, offsetof(dlog_header, crc));
+}
+
+static inline bool
+entry_is_valid(const as_xdr_dlog_entry* e, uint64_t slot)
+{
+	return e->slot == slot && e->crc == entry_crc(e);
+}
+
+static inline void
+atomic_max(cf_atomic64* p_val, uint64_t val)
+{
+	uint64_t cur = cf_atomic64_get(*p_val);
+
+	while (cur < val) {
+		uint64_t prev = cf_atomic64_cas(p_val, cur, val);
+
+		if (prev == cur) {
+			break;
+		}
+
+		cur = prev;
+	}
+}
+
+
+//==========================================================
+// Public API.
+//
+
+bool
+as_xdr_dlog_init(const char* path, uint64_t size, bool overwrite)
+{
+	if (size < DLOG_MIN_SIZE) {
+		cf_warning(AS_XDR, "digest log size %lu too small, must be >= %d",
+				size, DLOG_MIN_SIZE);
+		return false;
+	}
+
+	g_dlog.overwrite = overwrite;
+	pthread_mutex_init(&g_dlog.read_lock, NULL);
+
+	if (! open_log(path, size)) {
+		return false;
+	}
+
+	recover_log();
+
+	pthread_attr_t attrs;
+	pthread_t thread;
+
+	pthread_attr_init(&attrs);
+	pthread_attr_setdetachstate(&attrs, PTHREAD_CREATE_DETACHED);
+
+	if (pthread_create(&thread, &attrs, run_flush, NULL) != 0) {
+		cf_crash(AS_XDR, "failed to create digest log flush thread");
+	}
+
+	g_dlog_open = true;
+
+	cf_info(AS_XDR, "digest log %s: %lu slots, %lu unshipped", path,
+			g_dlog.n_slots, cf_atomic64_get(g_dlog.reserve_slot) -
+					cf_atomic64_get(g_dlog.read_slot));
+
+	return true;
+}
+
+bool
+as_xdr_dlog_is_open()
+{
+	return g_dlog_open;
+}
+
+void
+as_xdr_dlog_shutdown()
+{
+	if (! g_dlog_open) {
+		return;
+	}
+
+	// Writers may still be running - flush whatever is published so far.
+	uint64_t from = cf_atomic64_get(g_dlog.flush_slot);
+	uint64_t to = from;
+	uint64_t end = cf_atomic64_get(g_dlog.reserve_slot);
+
+	while (to < end && slot_entry(to)->slot == to) {
+		to++;
+	}
+
+	flush_range(from, to);
+	cf_atomic64_set(&g_dlog.flush_slot, to);
+	checkpoint();
+
+	cf_info(AS_XDR, "digest log checkpointed at slot %lu", to);
+}
+
+void
+as_xdr_dlog_write(as_namespace* ns, const cf_digest* keyd,
+		as_generation generation, cf_node master, bool is_delete,
+		uint16_t set_id)
+{
+	uint64_t slot;
+
+	while (true) {
+		slot = cf_atomic64_get(g_dlog.reserve_slot);
+
+		uint64_t read_slot = cf_atomic64_get(g_dlog.read_slot);
+
+		if (slot - read_slot >= g_dlog.n_slots) {
+			// Only overwrite frames that are flushed - the flusher must never
+			// be lapped.
+			if (! g_dlog.overwrite ||
+					slot - cf_atomic64_get(g_dlog.flush_slot) >=
+							g_dlog.n_slots) {
+				cf_atomic64_incr(&g_dlog.n_dropped);
+				return;
+			}
+
+			uint64_t new_read_slot = slot - g_dlog.n_slots + 1;
+
+			if (cf_atomic64_cas(&g_dlog.read_slot, read_slot, new_read_slot) ==
+					read_slot) {
+				cf_atomic64_add(&g_dlog.n_overwritten,
+						new_read_slot - read_slot);
+			}
+		}
+
+		if (cf_atomic64_cas(&g_dlog.reserve_slot, slot, slot + 1) == slot) {
+			break;
+		}
+	}
+
+	as_xdr_dlog_entry* e = slot_entry(slot);
+
+	// Invalidate the frame first, in case a reader is looking at the old one.
+	e->slot = 0;
+	__sync_synchronize();
+
+	e->master = master;
+	e->keyd = *keyd;
+	e->generation = generation;
+	e->set_id = set_id;
+	e->ns_id = (uint8_t)ns->id;
+	e->flags = is_delete ? AS_XDR_DLOG_FLAG_DELETE : 0;
+
+	// The crc covers the slot, so compute it as if the slot were stored.
+	as_xdr_dlog_entry tmp = *e;
+
+	tmp.slot = slot;
+	e->crc = entry_crc(&tmp);
+
+	__sync_synchronize();
+	e->slot = slot;
+
+	cf_atomic64_incr(&g_dlog.n_written);
+}
+
+uint32_t
+as_xdr_dlog_read(as_xdr_dlog_entry* entries, uint32_t max_entries)
+{
+	pthread_mutex_lock(&g_dlog.read_lock);
+
+	uint64_t slot = cf_atomic64_get(g_dlog.read_slot);
+	uint64_t end = cf_atomic64_get(g_dlog.flush_slot);
+	uint32_t n_entries = 0;
+
+	g_dlog.last_read_slot = slot;
+
+	while (slot < end && n_entries < max_entries) {
+		as_xdr_dlog_entry* e = &entries[n_entries];
+
+		*e = *slot_entry(slot);
+		__sync_synchronize();
+
+		// An overwriting writer may have got here first - stop, the next read
+		// starts from wherever the writer pushed the read cursor.
+		if (! entry_is_valid(e, slot) ||
+				cf_atomic64_get(g_dlog.read_slot) > slot) {
+			break;
+		}
+
+		n_entries++;
+		slot++;
+	}
+
+	pthread_mutex_unlock(&g_dlog.read_lock);
+
+	return n_entries;
+}
+
+void
+as_xdr_dlog_ack(uint32_t n_entries)
+{
+	pthread_mutex_lock(&g_dlog.read_lock);
+
+	// An overwriting writer may have pushed the cursor past these already.
+	atomic_max(&g_dlog.read_slot, g_dlog.last_read_slot + n_entries);
+
+	pthread_mutex_unlock(&g_dlog.read_lock);
+}
+
+void
+as_xdr_dlog_register_shipper(as_xdr_dlog_ship_fn cb, void* udata)
+{
+	if (! g_dlog_open) {
+		cf_warning(AS_XDR, "no digest log - can't register shipper");
+		return;
+	}
+
+	if (g_dlog.ship_cb) {
+		cf_crash(AS_XDR, "digest log shipper already registered");
+	}
+
+	g_dlog.ship_cb = cb;
+	g_dlog.ship_udata = udata;
+
+	pthread_attr_t attrs;
+	pthread_t thread;
+
+	pthread_attr_init(&attrs);
+	pthread_attr_setdetachstate(&attrs, PTHREAD_CREATE_DETACHED);
+
+	if (pthread_create(&thread, &attrs, run_ship, NULL) != 0) {
+		cf_crash(AS_XDR, "failed to create digest log ship thread");
+	}
+}
+
+void
+as_xdr_dlog_get_stats(cf_dyn_buf* db)
+{
+	if (! g_dlog_open) {
+		return;
+	}
+
+	uint64_t reserve_slot = cf_atomic64_get(g_dlog.reserve_slot);
+
+	info_append_uint64(db, "xdr_dlog_slots", g_dlog.n_slots);
+	info_append_uint64(db, "xdr_dlog_unflushed",
+			reserve_slot - cf_atomic64_get(g_dlog.flush_slot));
+	info_append_uint64(db, "xdr_dlog_unshipped",
+			reserve_slot - cf_atomic64_get(g_dlog.read_slot));
+	info_append_uint64(db, "xdr_dlog_written", g_dlog.n_written);
+	info_append_uint64(db, "xdr_dlog_dropped", g_dlog.n_dropped);
+	info_append_uint64(db, "xdr_dlog_overwritten", g_dlog.n_overwritten);
+	info_append_uint64(db, "xdr_dlog_flushes", g_dlog.n_flushes);
+	info_append_uint64(db, "xdr_dlog_shipped", g_dlog.n_shipped);
+	info_append_uint64(db, "xdr_dlog_deduped", g_dlog.n_deduped);
+}
+
+
+//==========================================================
+// Local helpers - file & recovery.
+//
+
+static bool
+open_log(const char* path, uint64_t size)
+{
+	int fd = open(path, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+
+	if (fd < 0) {
+		cf_warning(AS_XDR, "failed digest log open %s: %s", path,
+				cf_strerror(errno));
+		return false;
+	}
+
+	if (ftruncate(fd, (off_t)size) != 0) {
+		cf_warning(AS_XDR, "failed digest log truncate %s: %s", path,
+				cf_strerror(errno));
+		close(fd);
+		return false;
+	}
+
+	uint8_t* base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+			0);
+
+	if (base == MAP_FAILED) {
+		cf_warning(AS_XDR, "failed digest log mmap %s: %s", path,
+				cf_strerror(errno));
+		close(fd);
+		return false;
+	}
+
+	g_dlog.fd = fd;
+	g_dlog.base = base;
+	g_dlog.size = size;
+	g_dlog.n_slots = (size - DLOG_HEADER_SIZE) / sizeof(as_xdr_dlog_entry);
+	g_dlog.header = (dlog_header*)base;
+	g_dlog.entries = (as_xdr_dlog_entry*)(base + DLOG_HEADER_SIZE);
+
+	return true;
+}
+
+static void
+recover_log()
+{
+	dlog_header* h = g_dlog.header;
+
+	if (h->magic != DLOG_MAGIC || h->version != DLOG_VERSION ||
+			h->entry_size != sizeof(as_xdr_dlog_entry) ||
+			h->n_slots != g_dlog.n_slots || h->crc != header_crc(h) ||
+			h->write_slot == 0 || h->read_slot > h->write_slot) {
+		// A fresh file is all zeros. Anything else may hold frames that would
+		// validate against new slot numbers, so zero it.
+		if (h->magic != 0) {
+			cf_warning(AS_XDR, "digest log header invalid or size changed - starting empty");
+			memset(g_dlog.entries, 0, g_dlog.n_slots * sizeof(as_xdr_dlog_entry));
+		}
+
+		h->magic = DLOG_MAGIC;
+		h->version = DLOG_VERSION;
+		h->entry_size = sizeof(as_xdr_dlog_entry);
+		h->n_slots = g_dlog.n_slots;
+		h->write_slot = 1;
+		h->read_slot = 1;
+		h->unused = 0;
+		h->crc = header_crc(h);
+
+		msync(g_dlog.base, g_dlog.size, MS_SYNC);
+	}
+
+	// Anything published after the checkpoint may also have made it to disk.
+	uint64_t slot = h->write_slot;
+	uint64_t max_slot = slot + g_dlog.n_slots;
+
+	while (slot < max_slot && entry_is_valid(slot_entry(slot), slot)) {
+		slot++;
+	}
+
+	uint64_t read_slot = h->read_slot;
+
+	if (slot - read_slot > g_dlog.n_slots) {
+		read_slot = slot - g_dlog.n_slots;
+	}
+
+	cf_atomic64_set(&g_dlog.reserve_slot, slot);
+	cf_atomic64_set(&g_dlog.flush_slot, slot);
+	cf_atomic64_set(&g_dlog.read_slot, read_slot);
+
+	if (slot != h->write_slot) {
+		cf_info(AS_XDR, "digest log recovered %lu frames past checkpoint",
+				slot - h->write_slot);
+	}
+
+	checkpoint();
+}
+
+
+//==========================================================
+// Local helpers - flush.
+//
+
+static void*
+run_flush(void* arg)
+{
+	while (true) {
+		usleep(FLUSH_PERIOD_US);
+
+		uint64_t from = cf_atomic64_get(g_dlog.flush_slot);
+		uint64_t end = cf_atomic64_get(g_dlog.reserve_slot);
+		uint64_t to = from;
+
+		// Stop at the first frame still being filled - later frames get
+		// flushed next time round.
+		while (to < end && slot_entry(to)->slot == to) {
+			to++;
+		}
+
+		if (to == from) {
+			continue;
+		}
+
+		flush_range(from, to);
+
+		__sync_synchronize();
+		cf_atomic64_set(&g_dlog.flush_slot, to);
+
+		checkpoint();
+
+		cf_atomic64_incr(&g_dlog.n_flushes);
+	}
+
+	return NULL;
+}
+
+static void
+flush_range(uint64_t from, uint64_t to)
+{
+	if (to == from) {
+		return;
+	}
+
+	uint64_t page_mask = ~((uint64_t)sysconf(_SC_PAGESIZE) - 1);
+	uint64_t from_pos = from % g_dlog.n_slots;
+	uint64_t n = to - from;
+
+	while (n != 0) {
+		uint64_t n_run = g_dlog.n_slots - from_pos;
+
+		if (n_run > n) {
+			n_run = n;
+		}
+
+		uint64_t start = DLOG_HEADER_SIZE +
+				from_pos * sizeof(as_xdr_dlog_entry);
+		uint64_t end = start + n_run * sizeof(as_xdr_dlog_entry);
+		uint64_t page_start = start & page_mask;
+
+		if (msync(g_dlog.base + page_start, end - page_start, MS_SYNC) != 0) {
+			cf_warning(AS_XDR, "failed digest log msync: %s",
+					cf_strerror(errno));
+		}
+
+		n -= n_run;
+		from_pos = 0;
+	}
+}
+
+static void
+checkpoint()
+{
+	dlog_header* h = g_dlog.header;
+
+	h->write_slot = cf_atomic64_get(g_dlog.flush_slot);
+	h->read_slot = cf_atomic64_get(g_dlog.read_slot);
+	h->crc = header_crc(h);
+
+	if (msync(g_dlog.base, DLOG_HEADER_SIZE, MS_SYNC) != 0) {
+		cf_warning(AS_XDR, "failed digest log header msync: %s",
+				cf_strerror(errno));
+	}
+}
+
+
+//==========================================================
+// Local helpers - ship.
+//
+
+static void*
+run_ship(void* arg)
+{
+	as_xdr_dlog_entry* entries =
+			cf_malloc(SHIP_BATCH_SIZE * sizeof(as_xdr_dlog_entry));
+	ship_item* items = cf_malloc(SHIP_BATCH_SIZE * sizeof(ship_item));
+
+	if (! entries || ! items) {
+		cf_crash(AS_XDR, "failed digest log ship buffer alloc");
+	}
+
+	while (true) {
+		uint32_t n_read = as_xdr_dlog_read(entries, SHIP_BATCH_SIZE);
+
+		if (n_read == 0) {
+			usleep(SHIP_IDLE_US);
+			continue;
+		}
+
+		for (uint32_t i = 0; i < n_read; i++) {
+			items[i].e = entries[i];
+		}
+
+		uint32_t n_items = dedup_items(items, n_read);
+
+		cf_atomic64_add(&g_dlog.n_deduped, n_read - n_items);
+
+		uint32_t i = 0;
+
+		// Items are now grouped by namespace and partition.
+		while (i < n_items) {
+			uint8_t ns_id = items[i].e.ns_id;
+			as_partition_id pid = as_partition_getid(items[i].e.keyd);
+			uint32_t j = i + 1;
+
+			while (j < n_items && items[j].e.ns_id == ns_id &&
+					as_partition_getid(items[j].e.keyd) == pid) {
+				j++;
+			}
+
+			if (ns_id == 0 || ns_id > g_config.n_namespaces) {
+				i = j;
+				continue;
+			}
+
+			as_namespace* ns = g_config.namespaces[ns_id - 1];
+			as_partition_reservation rsv;
+
+			as_partition_reserve_migrate(ns, pid, &rsv, NULL);
+
+			for (uint32_t k = i; k < j; k++) {
+				items[k].order = storage_order(ns, rsv.tree, &items[k]);
+			}
+
+			qsort(&items[i], j - i, sizeof(ship_item), item_order_compare);
+
+			for (uint32_t k = i; k < j; k++) {
+				entries[k - i] = items[k].e;
+			}
+
+			g_dlog.ship_cb(ns, &rsv, entries, j - i, g_dlog.ship_udata);
+
+			as_partition_release(&rsv);
+
+			cf_atomic64_add(&g_dlog.n_shipped, j - i);
+
+			i = j;
+		}
+
+		as_xdr_dlog_ack(n_read);
+	}
+
+	return NULL;
+}
+
+// Sorts by namespace, partition and digest, then keeps only the latest item
+// for each digest. Returns the number of items kept.
+static uint32_t
+dedup_items(ship_item* items, uint32_t n_items)
+{
+	qsort(items, n_items, sizeof(ship_item), item_digest_compare);
+
+	uint32_t n_kept = 0;
+
+	for (uint32_t i = 0; i < n_items; i++) {
+		if (n_kept != 0 && items[n_kept - 1].e.ns_id == items[i].e.ns_id &&
+				cf_digest_compare(&items[n_kept - 1].e.keyd,
+						&items[i].e.keyd) == 0) {
+			// Same digest - the later slot sorts later and replaces it.
+			items[n_kept - 1] = items[i];
+			continue;
+		}
+
+		items[n_kept++] = items[i];
+	}
+
+	return n_kept;
+}
+
+static uint64_t
+storage_order(as_namespace* ns, as_index_tree* tree, ship_item* item)
+{
+	// Deletes need no read - ship them last.
+	if ((item->e.flags & AS_XDR_DLOG_FLAG_DELETE) != 0) {
+		return UINT64_MAX;
+	}
+
+	// Data in memory - there's no device order, digest order will do.
+	if (ns->storage_data_in_memory ||
+			ns->storage_type != AS_STORAGE_ENGINE_SSD) {
+		return 0;
+	}
+
+	as_index_ref r_ref;
+
+	r_ref.skip_lock = false;
+
+	if (as_record_get(tree, &item->e.keyd, &r_ref, ns) != 0) {
+		return UINT64_MAX;
+	}
+
+	as_record* r = r_ref.r;
+	uint64_t order = ((uint64_t)r->storage_key.ssd.file_id << 34) |
+			r->storage_key.ssd.rblock_id;
+
+	as_record_done(&r_ref, ns);
+
+	return order;
+}
+
+static int
+item_digest_compare(const void* pa, const void* pb)
+{
+	const as_xdr_dlog_entry* a = &((const ship_item*)pa)->e;
+	const as_xdr_dlog_entry* b = &((const ship_item*)pb)->e;
+
+	if (a->ns_id != b->ns_id) {
+		return a->ns_id < b->ns_id ? -1 : 1;
+	}
+
+	as_partition_id a_pid = as_partition_getid(a->keyd);
+	as_partition_id b_pid = as_partition_getid(b->keyd);
+
+	if (a_pid != b_pid) {
+		return a_pid < b_pid ? -1 : 1;
+	}
+
+	int rv = cf_digest_compare((cf_digest*)&a->keyd, (cf_digest*)&b->keyd);
+
+	if (rv != 0) {
+		return rv;
+	}
+
+	return a->slot < b->slot ? -1 : (a->slot > b->slot ? 1 : 0);
+}
+
+static int
+item_order_compare(const void* pa, const void* pb)
+{
+	const ship_item* a = (const ship_item*)pa;
+	const ship_item* b = (const ship_item*)pb;
+
+	if (a->order != b->order) {
+		return a->order < b->order ? -1 : 1;
+	}
+
+	return cf_digest_compare((cf_digest*)&a->e.keyd, (cf_digest*)&b->e.keyd);
+}
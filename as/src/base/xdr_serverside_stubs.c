@@ -22,11 +22,28 @@
 
 #include "base/xdr_serverside.h"
 
+#include "fault.h"
+
+#include "base/cfg.h"
+#include "base/xdr_dlog.h"
+
 xdr_state g_xdr_state = XDR_DOWN;
 
+// Without the XDR module there's nothing to ship to, but the digest log still
+// runs if configured, so a shipper can be registered against it.
 int as_xdr_init()
 {
-	return -1;
+	if (! g_config.xdr_dlog_enabled || ! g_config.xdr_dlog_path) {
+		return -1;
+	}
+
+	if (! as_xdr_dlog_init(g_config.xdr_dlog_path, g_config.xdr_dlog_size,
+			g_config.xdr_dlog_overwrite)) {
+		cf_crash_nostack(AS_XDR, "failed to open digest log %s",
+				g_config.xdr_dlog_path);
+	}
+
+	return 0;
 }
 
 void xdr_conf_init(const char *config_file)
@@ -39,6 +56,7 @@ void as_xdr_start()
 
 int as_xdr_shutdown()
 {
+	as_xdr_dlog_shutdown();
 	return -1;
 }
 
@@ -72,6 +90,9 @@ void xdr_add_dirty_bin(as_namespace *ns, xdr_dirty_bins *dirty, const char *name
 
 void xdr_write(as_namespace *ns, cf_digest keyd, as_generation generation, cf_node masternode, bool is_delete, uint16_t set_id, xdr_dirty_bins *dirty)
 {
+	if (as_xdr_dlog_is_open()) {
+		as_xdr_dlog_write(ns, &keyd, generation, masternode, is_delete, set_id);
+	}
 }
 
 void as_xdr_handle_txn(as_transaction *txn)
@@ -98,6 +119,7 @@ void xdr_handle_failednodeprocessingdone(cf_node nodeid)
 
 void as_xdr_get_stats(char *name, cf_dyn_buf *db)
 {
+	as_xdr_dlog_get_stats(db);
 }
 
 void as_xdr_get_config(cf_dyn_buf *db)
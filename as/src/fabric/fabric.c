@@ -42,7 +42,6 @@
 #include "citrusleaf/alloc.h"
 #include "citrusleaf/cf_atomic.h"
 #include "citrusleaf/cf_clock.h"
-#include "citrusleaf/cf_ll.h"
 #include "citrusleaf/cf_queue.h"
 #include "citrusleaf/cf_queue_priority.h"
 #include "citrusleaf/cf_shash.h"
@@ -50,6 +49,7 @@
 #include "fault.h"
 #include "msg.h"
 #include "socket.h"
+#include "timer_wheel.h"
 #include "util.h"
 
 #include "base/cfg.h"
@@ -97,13 +97,13 @@ void as_fabric_dump();
 **   ------------------------
 **
 **   When the local node sends a fabric message to a remote node, it will first try to open a new, non-blocking
-**   TCP connection to the remote node using "fabric_connect()".  The number of permissible outbound connections
-**   to a particular remote node is limited to being strictly lower than "FABRIC_MAX_FDS" (currently 8.)  Thus
-**   a maximum of 7 outbound socket connections (each with its own FB [see below]), will generally be created to
-**   each remote node as fabric messages are sent out.  Once the maximum number of outbound sockets is reached,
-**   an already-existing connection will be re-used to send the message.  In addition, there will generally be
-**   7 incoming connections (each with its own FB) from each remote node, for a total of 14 open sockets between
-**   each pair of fabric nodes.
+**   TCP connection to the remote node using "fabric_connect()".  Messages are sent on one of three channels,
+**   by message type - control (paxos, heartbeat, SMD, etc.), replication (reads/writes, proxies, XDR) and
+**   bulk (migration).  Each channel has its own message queue and outbound connections (each with its own
+**   FB [see below]) per remote node, limited by the channel's "fds" configuration (below "FABRIC_MAX_FDS").
+**   Once a channel's maximum number of outbound sockets is reached, an already-existing connection of that
+**   channel will be re-used to send the message.  In addition, there will generally be as many incoming
+**   connections (each with its own FB) from each remote node.
 **
 **   When a node opens a fabric connection to a remote node, the first fabric message sent will be used to
 **   identify the local node by sending its 64-bit node ID (as the value of the "FS_FIELD_NODE" field) to the
@@ -184,6 +184,26 @@ void as_fabric_dump();
 // #define DEBUG 1
 // #define DEBUG_VERBOSE 1
 
+// Unused msgs are cached per thread, per type. Caches exchange MSG_CACHE_XFER
+// msgs at a time with a global per-type depot when they empty or fill up.
+#define MSG_CACHE_SZ		64
+#define MSG_CACHE_XFER		(MSG_CACHE_SZ / 2)
+#define MSG_DEPOT_SZ		1024
+#define MSG_GETS_FLUSH		1024 // publish thread's get count this often
+
+typedef struct msg_cache_s {
+	uint32_t	n_msgs;
+	msg			*msgs[MSG_CACHE_SZ];
+} msg_cache;
+
+typedef struct msg_depot_s {
+	pthread_mutex_t	lock;
+	uint32_t		n_msgs;
+	msg				*msgs[MSG_DEPOT_SZ];
+} msg_depot;
+
+#define MAX_WORKERS (MAX_FABRIC_WORKERS + AS_FABRIC_N_CHANNELS * MAX_FABRIC_CHANNEL_WORKERS)
+
 typedef struct {
 	// Arguably, these first two should be pushed into the msg system
 	const msg_template 	*mt[M_TYPE_MAX];
@@ -193,12 +213,16 @@ typedef struct {
 	as_fabric_msg_fn 	msg_cb[M_TYPE_MAX];
 	void 				*msg_udata[M_TYPE_MAX];
 
-	cf_queue    *msg_pool_queue[M_TYPE_MAX];   // A pool of unused messages, better than calling create
+	msg_depot	msg_depots[M_TYPE_MAX];	// unused msgs shared by per-thread caches
 
+	// General workers come first, then any dedicated to a channel's outbound
+	// connections.
 	int			num_workers;
-	pthread_t	workers_th[MAX_FABRIC_WORKERS];
-	cf_queue	*workers_queue[MAX_FABRIC_WORKERS]; // messages to workers - type worker_queue_element
-	cf_poll		workers_poll[MAX_FABRIC_WORKERS]; // have workers export the epoll fd
+	int			channel_worker_start[AS_FABRIC_N_CHANNELS];
+	int			channel_num_workers[AS_FABRIC_N_CHANNELS]; // 0 - use general workers
+	pthread_t	workers_th[MAX_WORKERS];
+	cf_queue	*workers_queue[MAX_WORKERS]; // messages to workers - type worker_queue_element
+	cf_poll		workers_poll[MAX_WORKERS]; // have workers export the epoll fd
 
 	pthread_t	accept_th;
 
@@ -207,7 +231,7 @@ typedef struct {
 	pthread_t	note_server_th;
 
 	int			note_clients;
-	int			note_fd[MAX_FABRIC_WORKERS];
+	int			note_fd[MAX_WORKERS];
 
 	pthread_t   node_health_th;
 } fabric_args;
@@ -218,6 +242,25 @@ rchash *g_fabric_node_element_hash;
 
 #define FNE_QUEUE_LOW_PRI_SZ_LIMIT	50000
 
+// Which channel each msg type is sent on - replication and proxies must not
+// queue behind migration, nor cluster control behind either.
+static const as_fabric_channel msg_type_channel[M_TYPE_MAX] = {
+		[M_TYPE_MIGRATE] = AS_FABRIC_CHANNEL_BULK,
+		[M_TYPE_PROXY] = AS_FABRIC_CHANNEL_RW,
+		[M_TYPE_RW] = AS_FABRIC_CHANNEL_RW,
+		[M_TYPE_XDR] = AS_FABRIC_CHANNEL_RW
+		// everything else is AS_FABRIC_CHANNEL_CTRL
+};
+
+// Outbound connections and send queue for one traffic class.
+typedef struct {
+	cf_atomic32			outbound_fd_counter;
+
+	pthread_mutex_t		outbound_idle_fb_queue_lock;
+	cf_queue			outbound_idle_fb_queue;
+	cf_queue_priority	*outbound_msg_queue;
+} fne_channel;
+
 // A fabric_node_element is one-per-remote-endpoint
 // it is stored in the fabric_node_element_hash, keyed by the node, so when a message_send
 // is called we can find the queues, and it's linked from the fabric buffer which is
@@ -227,7 +270,6 @@ rchash *g_fabric_node_element_hash;
 typedef struct {
 	cf_node 	node;	// when coming from a fd, we want to know the source node
 
-	cf_atomic32 outbound_fd_counter;
 	shash		*outbound_fb_hash;			// Key: fabric_buffer * ; Value: 0 (Arbitrary & unused.)
 											// Holds references to fb(s) in the hash
 	bool		live;						// set to false on shutdown
@@ -235,12 +277,13 @@ typedef struct {
 	uint64_t	good_write_counter;
 	uint64_t	good_read_counter;
 
-	pthread_mutex_t		outbound_idle_fb_queue_lock;
-	cf_queue			outbound_idle_fb_queue;
-	cf_queue_priority	*outbound_msg_queue;
+	fne_channel	channels[AS_FABRIC_N_CHANNELS];
 } fabric_node_element;
 
 #define FB_BUF_MEM_SZ		(1024 * 1024)
+#define FB_MAX_COALESCE		64 // queued msgs sent in one go after the first
+#define FB_IOV_MIN_SZ		(1024 * 16) // msgs this big are sent with big fields in place
+#define FB_MAX_IOV			16
 
 // When we get notification about a socket, this is the structure
 // that's in the data portion
@@ -254,6 +297,7 @@ typedef struct {
 
 	bool is_outbound;
 	bool failed;                    // This fb has failed and is unusable
+	as_fabric_channel channel;      // outbound only - which queue it sends
 
 	uint8_t		membuf[FB_BUF_MEM_SZ];
 
@@ -262,6 +306,10 @@ typedef struct {
 	size_t		w_buf_sz;
 	size_t		w_buf_written;
 	msg			*w_msg_in_progress;
+	msg			*w_coalesced[FB_MAX_COALESCE]; // sent with w_msg_in_progress
+	uint32_t	w_n_coalesced;
+	struct iovec w_iov[FB_MAX_IOV]; // if w_n_iov isn't 0, w_buf holds the rest
+	uint32_t	w_n_iov;
 	size_t		w_count;
 
 	// This is the read section.
@@ -290,11 +338,23 @@ static void fabric_worker_add(fabric_args *fa, fabric_buffer *fb);
 static void fabric_buffer_set_epoll_state(fabric_buffer *fb);
 static void fabric_heartbeat_event(int nevents, as_hb_event_node *events, void *udata);
 static void fabric_buffer_release(fabric_buffer *fb);
+static size_t fabric_buffer_coalesce(fabric_buffer *fb, size_t used_sz, msg **p_pending);
+static int32_t fabric_buffer_send_iov(fabric_buffer *fb, int32_t flags);
+inline static void msg_cache_note_get();
+static void msg_cache_register();
+static void msg_cache_refill(msg_type type, msg_cache *mc);
+static void msg_cache_spill(msg_type type, msg_cache *mc, uint32_t n);
+static void msg_cache_thread_exit(void *udata);
 
 // Ideally this would not be global, but there is in reality only one fabric,
 // and the alternative would be to pass this value around everywhere.
 static fabric_args *g_fabric_args = 0;
 
+static pthread_key_t g_msg_cache_key;
+static __thread msg_cache t_msg_caches[M_TYPE_MAX];
+static __thread bool t_msg_cache_registered = false;
+static __thread uint64_t t_msg_gets = 0;
+
 // The start message is always sent by the connecting device to specify
 // what the remote endpoint's node ID is. We could pack other info
 // in here as needed too
@@ -330,18 +390,22 @@ fne_create(cf_node node)
 	fne->node = node;
 	fne->live = true;
 
-	if (pthread_mutex_init(&fne->outbound_idle_fb_queue_lock, NULL) != 0) {
-		cf_crash(AS_FABRIC, "failed to init xmit_buffer_queue_lock for fne %p", fne);
-	}
+	for (int i = 0; i < AS_FABRIC_N_CHANNELS; i++) {
+		fne_channel *fc = &fne->channels[i];
 
-	if (! cf_queue_init(&fne->outbound_idle_fb_queue, sizeof(fabric_buffer *), CF_QUEUE_ALLOCSZ, false)) {
-		cf_crash(AS_FABRIC, "failed to create xmit_buffer_queue for fne %p", fne);
-	}
+		if (pthread_mutex_init(&fc->outbound_idle_fb_queue_lock, NULL) != 0) {
+			cf_crash(AS_FABRIC, "failed to init xmit_buffer_queue_lock for fne %p", fne);
+		}
 
-	fne->outbound_msg_queue = cf_queue_priority_create(sizeof(msg *), true);
+		if (! cf_queue_init(&fc->outbound_idle_fb_queue, sizeof(fabric_buffer *), CF_QUEUE_ALLOCSZ, false)) {
+			cf_crash(AS_FABRIC, "failed to create xmit_buffer_queue for fne %p", fne);
+		}
 
-	if (! fne->outbound_msg_queue) {
-		cf_crash(AS_FABRIC, "failed to create xmit_msg_queue for fne %p", fne);
+		fc->outbound_msg_queue = cf_queue_priority_create(sizeof(msg *), true);
+
+		if (! fc->outbound_msg_queue) {
+			cf_crash(AS_FABRIC, "failed to create xmit_msg_queue for fne %p", fne);
+		}
 	}
 
 	if (shash_create(&(fne->outbound_fb_hash), ptr_hash_fn, sizeof(fabric_buffer *), sizeof(uint8_t), 100, SHASH_CR_MT_BIGLOCK) != SHASH_OK) {
@@ -369,29 +433,33 @@ fne_destructor(void *fne_o)
 	fabric_node_element *fne = (fabric_node_element *)fne_o;
 	cf_debug(AS_FABRIC, "destroy FNE: fne %p", fne);
 
-	// xmit_buffer_queue section.
-	if (cf_queue_sz(&fne->outbound_idle_fb_queue) != 0) {
-		cf_crash(AS_FABRIC, "xmit_buffer_queue not empty as expected");
-	}
+	for (int i = 0; i < AS_FABRIC_N_CHANNELS; i++) {
+		fne_channel *fc = &fne->channels[i];
 
-	cf_queue_destroy(&fne->outbound_idle_fb_queue);
-	pthread_mutex_destroy(&fne->outbound_idle_fb_queue_lock);
+		// xmit_buffer_queue section.
+		if (cf_queue_sz(&fc->outbound_idle_fb_queue) != 0) {
+			cf_crash(AS_FABRIC, "xmit_buffer_queue not empty as expected");
+		}
 
-	// xmit_msg_queue section.
-	while (true) {
-		msg *m;
+		cf_queue_destroy(&fc->outbound_idle_fb_queue);
+		pthread_mutex_destroy(&fc->outbound_idle_fb_queue_lock);
 
-		if (cf_queue_priority_pop(fne->outbound_msg_queue, &m, CF_QUEUE_NOWAIT) != CF_QUEUE_OK) {
-			cf_debug(AS_FABRIC, "fne_destructor(%p): xmit msg queue empty", fne);
-			break;
+		// xmit_msg_queue section.
+		while (true) {
+			msg *m;
+
+			if (cf_queue_priority_pop(fc->outbound_msg_queue, &m, CF_QUEUE_NOWAIT) != CF_QUEUE_OK) {
+				cf_debug(AS_FABRIC, "fne_destructor(%p): xmit msg queue empty", fne);
+				break;
+			}
+
+			cf_info(AS_FABRIC, "fabric node endpoint: destroy %"PRIx64" dropping message", fne->node);
+			as_fabric_msg_put(m);
 		}
 
-		cf_info(AS_FABRIC, "fabric node endpoint: destroy %"PRIx64" dropping message", fne->node);
-		as_fabric_msg_put(m);
+		cf_queue_priority_destroy(fc->outbound_msg_queue);
 	}
 
-	cf_queue_priority_destroy(fne->outbound_msg_queue);
-
 	// connected_fb_hash section.
 	if (shash_get_size(fne->outbound_fb_hash) != 0) {
 		cf_crash(AS_FABRIC, "outbound_fb_hash not empty as expected");
@@ -419,10 +487,13 @@ fabric_buffer_create(cf_socket *sock)
 	fb->fne = NULL;
 	fb->is_outbound = false;
 	fb->failed = false;
+	fb->channel = AS_FABRIC_CHANNEL_CTRL;
 
 	fb->w_count = 0;
 	fb->w_buf = NULL;
 	fb->w_msg_in_progress = NULL;
+	fb->w_n_coalesced = 0;
+	fb->w_n_iov = 0;
 
 	fb->r_msg_size = 0;
 	fb->r_type = M_TYPE_FABRIC; // since we don't have an "invalid"
@@ -458,7 +529,7 @@ fabric_buffer_disconnect(fabric_buffer *fb)
 		return;
 	}
 
-	cf_atomic32_decr(&fb->fne->outbound_fd_counter);
+	cf_atomic32_decr(&fb->fne->channels[fb->channel].outbound_fd_counter);
 	cf_debug(AS_FABRIC, "removed fb %p from outbound_fb_hash", fb);
 	cf_rc_release(fb);	// For delete from fne->outbound_fb_hash
 
@@ -478,13 +549,22 @@ fabric_buffer_release(fabric_buffer *fb)
 		if (fb->w_msg_in_progress) {
 			// First message (w_count == 0) is initial M_TYPE_FABRIC message and does not need to be saved.
 			if (fb->fne && fb->w_count > 0) {
-				cf_queue_priority_push(fb->fne->outbound_msg_queue, &fb->w_msg_in_progress, CF_QUEUE_PRIORITY_HIGH);
+				cf_queue_priority_push(fb->fne->channels[fb->channel].outbound_msg_queue, &fb->w_msg_in_progress, CF_QUEUE_PRIORITY_HIGH);
 			}
 			else {
 				as_fabric_msg_put(fb->w_msg_in_progress);
 			}
 		}
 
+		for (uint32_t i = 0; i < fb->w_n_coalesced; i++) {
+			if (fb->fne) {
+				cf_queue_priority_push(fb->fne->channels[fb->channel].outbound_msg_queue, &fb->w_coalesced[i], CF_QUEUE_PRIORITY_HIGH);
+			}
+			else {
+				as_fabric_msg_put(fb->w_coalesced[i]);
+			}
+		}
+
 		if (fb->fne) {
 			fne_release(fb->fne);
 			fb->fne = 0;
@@ -536,7 +616,11 @@ int
 fabric_disconnect(fabric_args *fa, fabric_node_element *fne)
 {
 	int num_fbs = shash_get_size(fne->outbound_fb_hash);
-	int num_fds = cf_atomic32_get(fne->outbound_fd_counter);
+	int num_fds = 0;
+
+	for (int i = 0; i < AS_FABRIC_N_CHANNELS; i++) {
+		num_fds += cf_atomic32_get(fne->channels[i].outbound_fd_counter);
+	}
 
 	if (num_fbs > num_fds) {
 		cf_warning(AS_FABRIC, "number of fabric buffers (%d) > number of open file descriptors (%d) for fne %p", num_fbs, num_fds, fne);
@@ -562,12 +646,15 @@ fabric_buffer_set_keepalive_options(fabric_buffer *fb)
 // connection and adds it to the worker queue only, when the socket becomes
 // writable, messages can start flowing.
 static fabric_buffer *
-fabric_connect(fabric_args *fa, fabric_node_element *fne)
+fabric_connect(fabric_args *fa, fabric_node_element *fne,
+		as_fabric_channel channel)
 {
+	fne_channel *fc = &fne->channels[channel];
+
 	// Don't create too many conns because you'll just get small packets.
-	uint32_t fds = cf_atomic32_incr(&(fne->outbound_fd_counter));
-	if (fds >= FABRIC_MAX_FDS) {
-		cf_atomic32_decr(&fne->outbound_fd_counter);
+	uint32_t fds = cf_atomic32_incr(&(fc->outbound_fd_counter));
+	if (fds > (uint32_t)g_config.fabric_channel_fds[channel]) {
+		cf_atomic32_decr(&fc->outbound_fd_counter);
 		return NULL;
 	}
 
@@ -575,7 +662,7 @@ fabric_connect(fabric_args *fa, fabric_node_element *fne)
 	cf_sock_addr addr;
 	if (as_hb_getaddr(fne->node, &addr.addr) < 0) {
 		cf_debug(AS_FABRIC, "fabric_connect: unknown remote endpoint %"PRIx64, fne->node);
-		cf_atomic32_decr(&fne->outbound_fd_counter);
+		cf_atomic32_decr(&fc->outbound_fd_counter);
 		return NULL;
 	}
 
@@ -587,7 +674,7 @@ fabric_connect(fabric_args *fa, fabric_node_element *fne)
 
 	if (cf_socket_init_client_nb(&addr, &sock) < 0) {
 		cf_debug(AS_FABRIC, "fabric connect could not create connect");
-		cf_atomic32_decr(&fne->outbound_fd_counter);
+		cf_atomic32_decr(&fc->outbound_fd_counter);
 		return NULL;
 	}
 
@@ -598,14 +685,20 @@ fabric_connect(fabric_args *fa, fabric_node_element *fne)
 
 	cf_socket_disable_nagle(fb->sock);
 	fabric_buffer_set_keepalive_options(fb);
+
+	if (g_config.fabric_channel_send_buf[channel] != 0) {
+		cf_socket_set_send_buffer(fb->sock, g_config.fabric_channel_send_buf[channel]);
+	}
+
 	fb->is_outbound = true;
+	fb->channel = channel;
 	fabric_buffer_associate(fb, fne);
 
 	// Grab a start message, send it to the remote endpoint so it knows me.
 	msg *m = as_fabric_msg_get(M_TYPE_FABRIC);
 	if (! m) {
 		fabric_buffer_release(fb);
-		cf_atomic32_decr(&fne->outbound_fd_counter);
+		cf_atomic32_decr(&fc->outbound_fd_counter);
 		return NULL;
 	}
 
@@ -624,14 +717,16 @@ fabric_connect(fabric_args *fa, fabric_node_element *fne)
 	return fb;
 }
 
+// Small queued msgs are appended behind a fresh msg, so they all go in one
+// send - *p_pending is the next queued msg, replaced as msgs are appended.
 static void
-fabric_buffer_send_progress(fabric_buffer *fb, bool is_last)
+fabric_buffer_send_progress(fabric_buffer *fb, msg **p_pending)
 {
 	uint8_t *send_buf;
 	size_t send_sz;
 
 	if (fb->w_buf) {
-		// Partially sent msg.
+		// Partially sent msg(s).
 		send_buf = fb->w_buf + fb->w_buf_written;
 		send_sz = fb->w_buf_sz - fb->w_buf_written;
 	}
@@ -641,21 +736,48 @@ fabric_buffer_send_progress(fabric_buffer *fb, bool is_last)
 
 		send_sz = msg_get_wire_size(m);
 
-		if (send_sz > FB_BUF_MEM_SZ) {
-			send_buf = (uint8_t *)cf_malloc(send_sz);
+		// Send big msgs (e.g. pickled records) without copying big fields.
+		if (send_sz >= FB_IOV_MIN_SZ) {
+			size_t buf_sz = FB_BUF_MEM_SZ;
+
+			fb->w_n_iov = FB_MAX_IOV;
+
+			if (msg_fillbuf_iov(m, fb->membuf, &buf_sz, fb->w_iov,
+					&fb->w_n_iov) != 0) {
+				fb->w_n_iov = 0;
+			}
 		}
-		else {
+
+		if (fb->w_n_iov != 0) {
 			send_buf = fb->membuf;
+			fb->w_buf = send_buf;
+		}
+		else {
+			if (send_sz > FB_BUF_MEM_SZ) {
+				send_buf = (uint8_t *)cf_malloc(send_sz);
+			}
+			else {
+				send_buf = fb->membuf;
+			}
+
+			fb->w_buf = send_buf;
+			msg_fillbuf(m, send_buf, &send_sz);
+
+			if (send_buf == fb->membuf) {
+				send_sz += fabric_buffer_coalesce(fb, send_sz, p_pending);
+			}
 		}
 
-		fb->w_buf = send_buf;
-		msg_fillbuf(m, send_buf, &send_sz);
 		fb->w_buf_sz = send_sz;
 		fb->w_buf_written = 0;
 	}
 
-	int32_t flags = MSG_NOSIGNAL | (is_last ? 0 : MSG_MORE);
-	int32_t w_sz = cf_socket_send(fb->sock, send_buf, send_sz, flags);
+	int32_t flags = MSG_NOSIGNAL | (*p_pending ? MSG_MORE : 0);
+	int32_t w_sz = fb->w_n_iov != 0 ?
+			fabric_buffer_send_iov(fb, flags) :
+			cf_socket_send(fb->sock, send_buf, send_sz, flags);
+
+	cf_atomic64_incr(&g_stats.fabric_sends);
 
 	if (w_sz < 0) {
 		if (errno != EAGAIN && errno != EWOULDBLOCK) {
@@ -675,13 +797,22 @@ fabric_buffer_send_progress(fabric_buffer *fb, bool is_last)
 		as_fabric_msg_put(fb->w_msg_in_progress);
 		fb->w_msg_in_progress = NULL;
 
+		for (uint32_t i = 0; i < fb->w_n_coalesced; i++) {
+			as_fabric_msg_put(fb->w_coalesced[i]);
+		}
+
+		uint32_t n_sent = 1 + fb->w_n_coalesced;
+
+		fb->w_n_coalesced = 0;
+		fb->w_n_iov = 0;
+
 		if (fb->w_buf != fb->membuf) {
 			cf_free(fb->w_buf);
 		}
 
 		fb->w_buf = NULL;
-		fb->w_count++;
-		cf_atomic64_incr(&g_stats.fabric_msgs_sent);
+		fb->w_count += n_sent;
+		cf_atomic64_add(&g_stats.fabric_msgs_sent, n_sent);
 	}
 	else {
 		// Partial send.
@@ -689,6 +820,56 @@ fabric_buffer_send_progress(fabric_buffer *fb, bool is_last)
 	}
 }
 
+// Send what's left of an iov msg - w_buf_written counts bytes over all the
+// iov entries.
+static int32_t
+fabric_buffer_send_iov(fabric_buffer *fb, int32_t flags)
+{
+	struct iovec iov[FB_MAX_IOV];
+	uint32_t n_iov = 0;
+	size_t skip_sz = fb->w_buf_written;
+
+	for (uint32_t i = 0; i < fb->w_n_iov; i++) {
+		if (skip_sz >= fb->w_iov[i].iov_len) {
+			skip_sz -= fb->w_iov[i].iov_len;
+			continue;
+		}
+
+		iov[n_iov].iov_base = (uint8_t *)fb->w_iov[i].iov_base + skip_sz;
+		iov[n_iov].iov_len = fb->w_iov[i].iov_len - skip_sz;
+		n_iov++;
+		skip_sz = 0;
+	}
+
+	return cf_socket_send_iov(fb->sock, iov, n_iov, flags);
+}
+
+// Append queued msgs into membuf after the first msg's used_sz bytes, while
+// they fit. Returns the number of bytes appended.
+static size_t
+fabric_buffer_coalesce(fabric_buffer *fb, size_t used_sz, msg **p_pending)
+{
+	fne_channel *fc = &fb->fne->channels[fb->channel];
+	size_t added_sz = 0;
+
+	while (*p_pending && fb->w_n_coalesced < FB_MAX_COALESCE) {
+		size_t msg_sz = FB_BUF_MEM_SZ - used_sz - added_sz;
+
+		if (msg_fillbuf(*p_pending, fb->membuf + used_sz + added_sz,
+				&msg_sz) != 0) {
+			break; // doesn't fit - it's sent next
+		}
+
+		added_sz += msg_sz;
+		fb->w_coalesced[fb->w_n_coalesced++] = *p_pending;
+		*p_pending = NULL;
+
+		cf_queue_priority_pop(fc->outbound_msg_queue, p_pending, CF_QUEUE_NOWAIT);
+	}
+
+	return added_sz;
+}
+
 static int
 fabric_buffer_process_writable(fabric_buffer *fb)
 {
@@ -700,22 +881,23 @@ fabric_buffer_process_writable(fabric_buffer *fb)
 	//    All messages get sent with MSG_MORE but because buffer full, small
 	//    packets still won't happen.
 	fabric_node_element *fne = fb->fne;
+	fne_channel *fc = &fne->channels[fb->channel];
 
 	// Try first without extra locking.
 	if (! fb->w_msg_in_progress) {
-		cf_queue_priority_pop(fne->outbound_msg_queue, &fb->w_msg_in_progress, CF_QUEUE_NOWAIT);
+		cf_queue_priority_pop(fc->outbound_msg_queue, &fb->w_msg_in_progress, CF_QUEUE_NOWAIT);
 	}
 
 	while (fb->w_msg_in_progress) {
 		msg *pending = NULL;
 
-		cf_queue_priority_pop(fne->outbound_msg_queue, &pending, CF_QUEUE_NOWAIT);
-		fabric_buffer_send_progress(fb, ! pending);
+		cf_queue_priority_pop(fc->outbound_msg_queue, &pending, CF_QUEUE_NOWAIT);
+		fabric_buffer_send_progress(fb, &pending);
 
 		if (fb->w_msg_in_progress) {
 			if (pending) {
 				// w_msg_inprogress not done so put it back.
-				cf_queue_priority_push(fne->outbound_msg_queue, &pending, CF_QUEUE_PRIORITY_HIGH);
+				cf_queue_priority_push(fc->outbound_msg_queue, &pending, CF_QUEUE_PRIORITY_HIGH);
 			}
 
 			return 0;
@@ -729,15 +911,15 @@ fabric_buffer_process_writable(fabric_buffer *fb)
 	}
 	else if (! fb->w_msg_in_progress) {
 		// Try with bigger lock block to sync with as_fabric_send().
-		pthread_mutex_lock(&fne->outbound_idle_fb_queue_lock);
+		pthread_mutex_lock(&fc->outbound_idle_fb_queue_lock);
 
-		if (cf_queue_priority_pop(fne->outbound_msg_queue, &fb->w_msg_in_progress, CF_QUEUE_NOWAIT) == CF_QUEUE_EMPTY) {
+		if (cf_queue_priority_pop(fc->outbound_msg_queue, &fb->w_msg_in_progress, CF_QUEUE_NOWAIT) == CF_QUEUE_EMPTY) {
 			fabric_buffer_set_epoll_state(fb);
 			cf_rc_reserve(fb);
-			cf_queue_push(&fne->outbound_idle_fb_queue, &fb);
+			cf_queue_push(&fc->outbound_idle_fb_queue, &fb);
 		}
 
-		pthread_mutex_unlock(&fne->outbound_idle_fb_queue_lock);
+		pthread_mutex_unlock(&fc->outbound_idle_fb_queue_lock);
 	}
 
 	return 0;
@@ -751,7 +933,7 @@ as_fabric_msg_queue_dump()
 	int total_q_sz = 0;
 	int total_alloced_msgs = 0;
 	for (int i = 0; i < M_TYPE_MAX; i++) {
-		int q_sz = cf_queue_sz(g_fabric_args->msg_pool_queue[i]);
+		int q_sz = (int)g_fabric_args->msg_depots[i].n_msgs;
 		int num_of_type = cf_atomic_int_get(g_num_msgs_by_type[i]);
 		total_alloced_msgs += num_of_type;
 		if (q_sz || num_of_type) {
@@ -766,7 +948,7 @@ as_fabric_msg_queue_dump()
 	cf_info(AS_FABRIC, "Total num. msgs = %d ; Total num. queued = %d ; Delta = %d", num_msgs, total_q_sz, num_msgs - total_q_sz);
 }
 
-// Helper function. Pull a message off the internal queue.
+// Helper function. Get an unused message, from this thread's cache if we can.
 msg *
 as_fabric_msg_get(msg_type type)
 {
@@ -778,15 +960,25 @@ as_fabric_msg_get(msg_type type)
 		return 0;
 	}
 
+	msg_cache_note_get();
+
+	msg_cache *mc = &t_msg_caches[type];
+
+	if (mc->n_msgs == 0) {
+		cf_atomic64_incr(&g_stats.fabric_msg_cache_misses);
+		msg_cache_refill(type, mc);
+	}
+
 	msg *m = 0;
-	cf_queue *q = g_fabric_args->msg_pool_queue[type];
 
-	if (cf_queue_pop(q, &m, CF_QUEUE_NOWAIT) != 0) {
-		msg_create(&m, type, g_fabric_args->mt[type],
-				g_fabric_args->mt_sz[type], g_fabric_args->scratch_sz[type]);
+	if (mc->n_msgs != 0) {
+		m = mc->msgs[--mc->n_msgs];
+		msg_incr_ref(m);
 	}
 	else {
-		msg_incr_ref(m);
+		cf_atomic64_incr(&g_stats.fabric_msg_creates);
+		msg_create(&m, type, g_fabric_args->mt[type],
+				g_fabric_args->mt_sz[type], g_fabric_args->scratch_sz[type]);
 	}
 
 //	cf_debug(AS_FABRIC,"fabric_msg_get: m %p count %d",m,cf_rc_count(m));
@@ -802,12 +994,17 @@ as_fabric_msg_put(msg *m)
 	if (cnt == 0) {
 		msg_reset(m);
 
-		if (cf_queue_sz(g_fabric_args->msg_pool_queue[m->type]) > 128) {
-			msg_put(m);
+		msg_cache *mc = &t_msg_caches[m->type];
+
+		if (! t_msg_cache_registered) {
+			msg_cache_register();
 		}
-		else {
-			cf_queue_push(g_fabric_args->msg_pool_queue[m->type], &m);
+
+		if (mc->n_msgs == MSG_CACHE_SZ) {
+			msg_cache_spill(m->type, mc, MSG_CACHE_XFER);
 		}
+
+		mc->msgs[mc->n_msgs++] = m;
 	}
 	else if (cnt < 0) {
 		msg_dump(m, "extra put");
@@ -815,6 +1012,84 @@ as_fabric_msg_put(msg *m)
 	}
 }
 
+inline static void
+msg_cache_note_get()
+{
+	if (! t_msg_cache_registered) {
+		msg_cache_register();
+	}
+
+	if (++t_msg_gets == MSG_GETS_FLUSH) {
+		cf_atomic64_add(&g_stats.fabric_msg_gets, t_msg_gets);
+		t_msg_gets = 0;
+	}
+}
+
+// So the thread's cached msgs go back to the depots if the thread exits.
+static void
+msg_cache_register()
+{
+	pthread_setspecific(g_msg_cache_key, t_msg_caches);
+	t_msg_cache_registered = true;
+}
+
+static void
+msg_cache_refill(msg_type type, msg_cache *mc)
+{
+	msg_depot *depot = &g_fabric_args->msg_depots[type];
+
+	pthread_mutex_lock(&depot->lock);
+
+	uint32_t n = depot->n_msgs < MSG_CACHE_XFER ? depot->n_msgs : MSG_CACHE_XFER;
+
+	depot->n_msgs -= n;
+	memcpy(mc->msgs, &depot->msgs[depot->n_msgs], n * sizeof(msg *));
+
+	pthread_mutex_unlock(&depot->lock);
+
+	mc->n_msgs = n;
+}
+
+// Move the n least recently cached msgs to the depot, freeing any it can't
+// hold.
+static void
+msg_cache_spill(msg_type type, msg_cache *mc, uint32_t n)
+{
+	msg_depot *depot = &g_fabric_args->msg_depots[type];
+
+	pthread_mutex_lock(&depot->lock);
+
+	uint32_t n_room = MSG_DEPOT_SZ - depot->n_msgs;
+	uint32_t n_kept = n < n_room ? n : n_room;
+
+	memcpy(&depot->msgs[depot->n_msgs], mc->msgs, n_kept * sizeof(msg *));
+	depot->n_msgs += n_kept;
+
+	pthread_mutex_unlock(&depot->lock);
+
+	for (uint32_t i = n_kept; i < n; i++) {
+		msg_put(mc->msgs[i]);
+	}
+
+	mc->n_msgs -= n;
+	memmove(mc->msgs, &mc->msgs[n], mc->n_msgs * sizeof(msg *));
+}
+
+static void
+msg_cache_thread_exit(void *udata)
+{
+	msg_cache *caches = (msg_cache *)udata;
+
+	for (int i = 0; i < M_TYPE_MAX; i++) {
+		if (caches[i].n_msgs != 0) {
+			msg_cache_spill((msg_type)i, &caches[i], caches[i].n_msgs);
+		}
+	}
+
+	cf_atomic64_add(&g_stats.fabric_msg_gets, t_msg_gets);
+	t_msg_gets = 0;
+}
+
 static void
 fabric_buffer_shift(fabric_buffer *fb, uint32_t parsable_size)
 {
@@ -1006,8 +1281,17 @@ fabric_worker_add(fabric_args *fa, fabric_buffer *fb)
 	// Put a message on that worker's queue send a byte to the worker over the notification FD.
 	static int worker_add_index = 0;
 
+	// Outbound connections of a channel with its own workers go to those.
+	int start = 0;
+	int n_workers = g_config.n_fabric_workers;
+
+	if (fb->is_outbound && fa->channel_num_workers[fb->channel] != 0) {
+		start = fa->channel_worker_start[fb->channel];
+		n_workers = fa->channel_num_workers[fb->channel];
+	}
+
 	// Decide which queue to add to -- try round robin for the moment.
-	int worker = worker_add_index++ % fa->num_workers;
+	int worker = start + (int)((uint32_t)worker_add_index++ % n_workers);
 	cf_debug(AS_FABRIC, "worker_fabric_add: adding fd %d to worker id %d notefd %d", CSFD(fb->sock), worker, fa->note_fd[worker]);
 
 	fb->worker_id = worker;
@@ -1032,13 +1316,13 @@ fabric_worker_fn(void *argv)
 	pthread_t self = pthread_self();
 	int worker_id;
 
-	for (worker_id = 0; worker_id < MAX_FABRIC_WORKERS; worker_id++) {
+	for (worker_id = 0; worker_id < MAX_WORKERS; worker_id++) {
 		if (pthread_equal(fa->workers_th[worker_id], self) != 0) {
 			break;
 		}
 	}
 
-	if (worker_id == MAX_FABRIC_WORKERS) {
+	if (worker_id == MAX_WORKERS) {
 		cf_crash(AS_FABRIC, "thread setup failure");
 	}
 
@@ -1176,6 +1460,7 @@ fabric_accept_fn(void *argv)
 	sc.addr = "0.0.0.0";     // inaddr any!
 	sc.port = g_config.fabric_port;
 	sc.reuse_addr = (g_config.socket_reuse_addr) ? true : false;
+	sc.reuse_port = false;
 	sc.type = SOCK_STREAM;
 	if (0 != cf_socket_init_server(&sc)) {
 		cf_crash(AS_FABRIC, "Could not create fabric listener socket - check configuration");
@@ -1318,31 +1603,35 @@ fabric_node_disconnect(cf_node node)
 		cf_warning(AS_FABRIC, "fabric disconnecting FAIL rchash delete: node %"PRIx64, node);
 	}
 
-	while (true) {
-		fabric_buffer *fb;
+	for (int i = 0; i < AS_FABRIC_N_CHANNELS; i++) {
+		fne_channel *fc = &fne->channels[i];
 
-		pthread_mutex_lock(&fne->outbound_idle_fb_queue_lock);
-		int rv = cf_queue_pop(&fne->outbound_idle_fb_queue, &fb, CF_QUEUE_NOWAIT);
-		pthread_mutex_unlock(&fne->outbound_idle_fb_queue_lock);
+		while (true) {
+			fabric_buffer *fb;
 
-		if (rv != CF_QUEUE_OK) {
-			cf_debug(AS_FABRIC, "fabric_node_disconnect(%"PRIx64"): fne: %p : xmit buffer queue empty", node, fne);
-			break;
+			pthread_mutex_lock(&fc->outbound_idle_fb_queue_lock);
+			int rv = cf_queue_pop(&fc->outbound_idle_fb_queue, &fb, CF_QUEUE_NOWAIT);
+			pthread_mutex_unlock(&fc->outbound_idle_fb_queue_lock);
+
+			if (rv != CF_QUEUE_OK) {
+				cf_debug(AS_FABRIC, "fabric_node_disconnect(%"PRIx64"): fne: %p : xmit buffer queue empty", node, fne);
+				break;
+			}
+
+			fabric_buffer_release(fb);
 		}
 
-		fabric_buffer_release(fb);
-	}
+		while (true) {
+			msg *m;
 
-	while (true) {
-		msg *m;
+			if (cf_queue_priority_pop(fc->outbound_msg_queue, &m, CF_QUEUE_NOWAIT) != CF_QUEUE_OK) {
+				cf_debug(AS_FABRIC, "fabric_node_disconnect(%"PRIx64"): fne: %p : xmit msg queue empty", node, fne);
+				break;
+			}
 
-		if (cf_queue_priority_pop(fne->outbound_msg_queue, &m, CF_QUEUE_NOWAIT) != CF_QUEUE_OK) {
-			cf_debug(AS_FABRIC, "fabric_node_disconnect(%"PRIx64"): fne: %p : xmit msg queue empty", node, fne);
-			break;
+			cf_debug(AS_FABRIC, "fabric: dropping message to now-gone (heartbeat fail) node %"PRIx64, node);
+			as_fabric_msg_put(m);
 		}
-
-		cf_debug(AS_FABRIC, "fabric: dropping message to now-gone (heartbeat fail) node %"PRIx64, node);
-		as_fabric_msg_put(m);
 	}
 
 	// Clean up all connected outgoing fabric buffers attached to this FNE.
@@ -1443,6 +1732,12 @@ as_fabric_init()
 
 	fa->num_workers = g_config.n_fabric_workers;
 
+	for (int i = 0; i < AS_FABRIC_N_CHANNELS; i++) {
+		fa->channel_worker_start[i] = fa->num_workers;
+		fa->channel_num_workers[i] = g_config.fabric_channel_workers[i];
+		fa->num_workers += fa->channel_num_workers[i];
+	}
+
 	// Register my little fabric message type, so I can create 'em.
 	as_fabric_register_msg_fn(M_TYPE_FABRIC, fabric_mt, sizeof(fabric_mt),
 			FS_MSG_SCRATCH_SIZE, 0 /* arrival function!*/, 0);
@@ -1451,11 +1746,14 @@ as_fabric_init()
 	rchash_create(&g_fabric_node_element_hash, cf_nodeid_rchash_fn, fne_destructor,
 			sizeof(cf_node), 64, RCHASH_CR_MT_MANYLOCK);
 
-	// Create a global queue for the stashing of wayward messages for reuse.
+	// Create the global depots that rebalance the per-thread msg caches.
 	for (int i = 0; i < M_TYPE_MAX; i++) {
-		fa->msg_pool_queue[i] = cf_queue_create(sizeof(msg *), true);
+		pthread_mutex_init(&fa->msg_depots[i].lock, NULL);
+		fa->msg_depots[i].n_msgs = 0;
 	}
 
+	pthread_key_create(&g_msg_cache_key, msg_cache_thread_exit);
+
 	// Create a thread for monitoring the health of nodes.
 	pthread_create(&(fa->node_health_th), 0, fabric_node_health_fn, 0);
 
@@ -1511,6 +1809,8 @@ as_fabric_start()
 		if (pthread_create(&(fa->workers_th[i]), &thr_attr, fabric_worker_fn, fa) != 0) {
 			cf_crash(AS_FABRIC, "Failed to create fabric_worker_fn() thread %d/%d", i, fa->num_workers);
 		}
+
+		as_config_sched_thread(AS_SCHED_POOL_FABRIC, fa->workers_th[i]);
 	}
 
 	// We want all workers to be available before starting the accept thread.
@@ -1569,12 +1869,14 @@ as_fabric_send(cf_node node, msg *m, int priority)
 		return AS_FABRIC_ERR_NO_NODE;
 	}
 
+	as_fabric_channel channel = msg_type_channel[m->type];
+	fne_channel *fc = &fne->channels[channel];
 	fabric_buffer *fb;
 
 	while (true) {
-		pthread_mutex_lock(&fne->outbound_idle_fb_queue_lock);
-		rv = cf_queue_pop(&fne->outbound_idle_fb_queue, &fb, CF_QUEUE_NOWAIT);
-		pthread_mutex_unlock(&fne->outbound_idle_fb_queue_lock);
+		pthread_mutex_lock(&fc->outbound_idle_fb_queue_lock);
+		rv = cf_queue_pop(&fc->outbound_idle_fb_queue, &fb, CF_QUEUE_NOWAIT);
+		pthread_mutex_unlock(&fc->outbound_idle_fb_queue_lock);
 
 		if (rv != CF_QUEUE_OK) {
 			fb = NULL;
@@ -1591,27 +1893,27 @@ as_fabric_send(cf_node node, msg *m, int priority)
 	}
 
 	if (! fb) {
-		if (priority == AS_FABRIC_PRIORITY_LOW && cf_queue_priority_sz(fne->outbound_msg_queue) > FNE_QUEUE_LOW_PRI_SZ_LIMIT) {
+		if (priority == AS_FABRIC_PRIORITY_LOW && cf_queue_priority_sz(fc->outbound_msg_queue) > FNE_QUEUE_LOW_PRI_SZ_LIMIT) {
 			fne_release(fne);	// rchash_get
 			return AS_FABRIC_ERR_QUEUE_FULL;
 		}
 
-		if ((fb = fabric_connect(g_fabric_args, fne)) != NULL) {
-			cf_queue_priority_push(fne->outbound_msg_queue, &m, priority);
+		if ((fb = fabric_connect(g_fabric_args, fne, channel)) != NULL) {
+			cf_queue_priority_push(fc->outbound_msg_queue, &m, priority);
 			fabric_worker_add(g_fabric_args, fb);
 		}
 		else {
 			// Sync with fabric_buffer_process_writable() to avoid non-empty
 			// xmit_msg_queue with every fb being in xmit_buffer_queue.
-			pthread_mutex_lock(&fne->outbound_idle_fb_queue_lock);
+			pthread_mutex_lock(&fc->outbound_idle_fb_queue_lock);
 
-			cf_queue_pop(&fne->outbound_idle_fb_queue, &fb, CF_QUEUE_NOWAIT);
+			cf_queue_pop(&fc->outbound_idle_fb_queue, &fb, CF_QUEUE_NOWAIT);
 
 			if (! fb) {
-				cf_queue_priority_push(fne->outbound_msg_queue, &m, priority);
+				cf_queue_priority_push(fc->outbound_msg_queue, &m, priority);
 			}
 
-			pthread_mutex_unlock(&fne->outbound_idle_fb_queue_lock);
+			pthread_mutex_unlock(&fc->outbound_idle_fb_queue_lock);
 
 			if (fb) {
 				// Wake up.
@@ -1649,6 +1951,12 @@ fabric_get_node_list_fn(void *key, uint32_t keylen, void *data, void *udata)
 static rchash *g_fabric_transact_xmit_hash = 0;
 static rchash *g_fabric_transact_recv_hash = 0;
 
+// Retransmit and timeout deadlines, keyed by tid. Entries are hints - a
+// transaction that's completed is simply not found in the xmit hash.
+static cf_timer_wheel *g_fabric_transact_wheel = 0;
+
+#define TRANSACT_WHEEL_TICK_MS 10
+
 typedef struct {
 	uint64_t	tid;
 	cf_node 	node;
@@ -1698,12 +2006,6 @@ typedef struct {
 	void *				udata;
 } fabric_transact_xmit;
 
-typedef struct {
-	cf_ll_element ll_e;
-	int op;
-	uint64_t tid;
-} ll_fabric_transact_xmit_element;
-
 typedef struct {
 	cf_node 	node; // where it came from
 	uint64_t	tid;  // inbound tid
@@ -1829,6 +2131,8 @@ as_fabric_transact_start(cf_node dest, msg *m, int timeout_ms, as_fabric_transac
 		return;
 	}
 
+	cf_timer_wheel_add(g_fabric_transact_wheel, &ft->tid, ft->retransmit_ms + 1);
+
 	// Transmit the initial message.
 	msg_incr_ref(m);
 	int rv = as_fabric_send(ft->node, ft->m, AS_FABRIC_PRIORITY_MEDIUM);
@@ -1942,82 +2246,47 @@ as_fabric_transact_register(msg_type type, const msg_template *mt, size_t mt_sz,
 // have completed and need to be signaled
 static pthread_t g_fabric_transact_th;
 
-static int
-fabric_transact_xmit_reduce_fn(void *key, uint32_t keylen, void *o, void *udata)
+// Called outside the wheel lock, and therefore outside any hash lock - fabric
+// short circuits messages to self, so a retransmit may lead straight to a
+// reply, which deletes from the xmit hash in this same thread.
+static void
+fabric_transact_timer_fn(void *key, void *udata)
 {
-	fabric_transact_xmit *ftx = (fabric_transact_xmit *)o;
-	int op = 0;
+	uint64_t tid = *(uint64_t *)key;
+	fabric_transact_xmit *ftx;
 
-	cf_detail(AS_FABRIC, "transact: xmit reduce");
+	// rchash_get increment ref count on transaction ftx.
+	if (rchash_get(g_fabric_transact_xmit_hash, &tid, sizeof(tid), (void **)&ftx) != 0) {
+		// Already completed - stale timer.
+		return;
+	}
 
+	int op = 0;
 	uint64_t now = cf_getms();
 
 	pthread_mutex_lock(&ftx->LOCK);
 
 	if (now > ftx->deadline_ms) {
-		// Expire and remove transactions that are timed out.
 		// Need to call application: we've timed out.
 		op = OP_TRANS_TIMEOUT;
 	}
-	else if (now > ftx->retransmit_ms) {
-		// retransmit, update time counters, etc
-		ftx->retransmit_ms = now + ftx->retransmit_period;
-		ftx->retransmit_period *= 2;
-		op = OP_TRANS_RETRANSMIT;
-	}
-
-	if (op > 0) {
-		// Add the transaction in linked list of transactions to be processed.
-		// Process such transactions outside retransmit hash lock.
-		// Why ?
-		// Fabric short circuit the message to self.
-		// It short circuits it by directly calling receiver function of corresponding module.
-		// Receiver of module construct "reply" and hand over to fabric to deliver.
-		// On receiving "reply", fabric removes original message, for which this is a reply, from retransmit hash
-		//
-		// "fabric_transact_xmit_reduce_fn" function is invoked by reduce_delete.
-		// reduce_delete holds the lock over corrsponding hash (here "retransmit hash").
-		// If the message, sent by this function, is short circuited by fabric,
-		// the same thread will again try to get lock over "retransmit hash".
-		// It is self dead lock.
-		//
-		// To avoid this process it outside retransmit hash lock.
-
-		cf_ll *ll_fabric_transact_xmit  = (cf_ll *)udata;
-
-		// Create new node for list.
-		ll_fabric_transact_xmit_element *ll_ftx_ele = (ll_fabric_transact_xmit_element *)cf_malloc(sizeof(ll_fabric_transact_xmit_element));
-		ll_ftx_ele->tid = ftx->tid;
-		ll_ftx_ele->op = op;
-		// Append into list.
-		cf_ll_append(ll_fabric_transact_xmit, (cf_ll_element *)ll_ftx_ele);
-	}
-	pthread_mutex_unlock(&ftx->LOCK);
-	return 0;
-}
-
-int
-ll_ftx_reduce_fn(cf_ll_element *le, void *udata)
-{
-	ll_fabric_transact_xmit_element *ll_ftx_ele = (ll_fabric_transact_xmit_element *)le;
+	else {
+		if (now > ftx->retransmit_ms) {
+			// retransmit, update time counters, etc
+			ftx->retransmit_ms = now + ftx->retransmit_period;
+			ftx->retransmit_period *= 2;
+			op = OP_TRANS_RETRANSMIT;
+		}
 
-	fabric_transact_xmit *ftx;
-	uint64_t tid;
-	int rv;
+		uint64_t next_ms = ftx->retransmit_ms < ftx->deadline_ms ?
+				ftx->retransmit_ms : ftx->deadline_ms;
 
-	msg *m = 0;
-	cf_node node;
-
-	tid = ll_ftx_ele->tid;
-	// rchash_get increment ref count on transaction ftx.
-	rv = rchash_get(g_fabric_transact_xmit_hash, &tid, sizeof(tid), (void **)&ftx);
-	if (rv != 0) {
-		cf_warning(AS_FABRIC, "No fabric transmit structure in global hash for fabric transaction-id %"PRIu64"", tid);
-		return (CF_LL_REDUCE_DELETE);
+		cf_timer_wheel_add(g_fabric_transact_wheel, &tid, next_ms + 1);
 	}
 
-	if (ll_ftx_ele->op == OP_TRANS_TIMEOUT) {
+	pthread_mutex_unlock(&ftx->LOCK);
 
+	if (op == OP_TRANS_TIMEOUT) {
 		// Call application: we've timed out.
 		if (ftx->cb) {
 			(*ftx->cb) ( 0, ftx->udata, AS_FABRIC_ERR_TIMEOUT);
@@ -2026,59 +2295,37 @@ ll_ftx_reduce_fn(cf_ll_element *le, void *udata)
 		cf_debug(AS_FABRIC, "fabric transact: %"PRIu64" timed out", tid);
 		// rchash_delete removes ftx from hash and decrement ref count on it.
 		rchash_delete(g_fabric_transact_xmit_hash, &tid, sizeof(tid));
-		// It should be final release of transaction ftx.
-		// On final release, it also decrements message ref count, taken by initial fabric_send.
-		fabric_transact_xmit_release(ftx);
-	}
-	else if (ll_ftx_ele->op == OP_TRANS_RETRANSMIT) {
-		//msg_incr_ref(ftx->m);
-		if (ftx->m) {
-			msg_incr_ref(ftx->m);
-			m = ftx->m;
-			node = ftx->node;
-			if (0 != as_fabric_send(node, m, AS_FABRIC_PRIORITY_MEDIUM)) {
-				cf_debug(AS_FABRIC, "fabric: transact: %"PRIu64" retransmit send failed", tid);
-				as_fabric_msg_put(m);
-			}
-			else {
-				cf_debug(AS_FABRIC, "fabric: transact: %"PRIu64" retransmit send success", tid);
-			}
+	}
+	else if (op == OP_TRANS_RETRANSMIT && ftx->m) {
+		msg *m = ftx->m;
+
+		msg_incr_ref(m);
+
+		if (0 != as_fabric_send(ftx->node, m, AS_FABRIC_PRIORITY_MEDIUM)) {
+			cf_debug(AS_FABRIC, "fabric: transact: %"PRIu64" retransmit send failed", tid);
+			as_fabric_msg_put(m);
+		}
+		else {
+			cf_debug(AS_FABRIC, "fabric: transact: %"PRIu64" retransmit send success", tid);
 		}
-		// Decrement ref count, incremented by rchash_get.
-		fabric_transact_xmit_release(ftx);
 	}
-	// Remove it from link list.
-	return CF_LL_REDUCE_DELETE;
-}
 
-// Function to delete node in linked list
-static void
-ll_ftx_destructor_fn(cf_ll_element *e)
-{
-	cf_free(e);
+	// Decrement ref count, incremented by rchash_get. After a timeout, it
+	// should be the final release, which also decrements the message ref count
+	// taken by initial fabric_send.
+	fabric_transact_xmit_release(ftx);
 }
 
 // long running thread for tranaction maintance
 void *
 fabric_transact_fn(void *argv)
 {
-	// Create a list of transactions to be processed in each pass.
-	cf_ll ll_fabric_transact_xmit;
-	// Initialize list to empty list.
-	// This list is processed by single thread. No need of a lock.
-	cf_ll_init(&ll_fabric_transact_xmit, &ll_ftx_destructor_fn, false);
 	while (true) {
-		usleep(10000); // 10 ms for now
-
-		// Visit each entry in g_fabric_transact_xmit_hash and select entries to be retransmitted or timed out.
-		// Add that transaction id (tid) in the link list 'll_fabric_transact_xmit'.
-		rchash_reduce(g_fabric_transact_xmit_hash, fabric_transact_xmit_reduce_fn, (void *)&ll_fabric_transact_xmit);
+		usleep(TRANSACT_WHEEL_TICK_MS * 1000);
 
-		if (cf_ll_size(&ll_fabric_transact_xmit)) {
-			// There are transactions to be processed.
-			// Process each transaction in list.
-			cf_ll_reduce(&ll_fabric_transact_xmit, true /*forward*/, ll_ftx_reduce_fn, NULL);
-		}
+		// Only visits transactions that are due - not the whole xmit hash.
+		cf_timer_wheel_expire(g_fabric_transact_wheel, cf_getms(),
+				fabric_transact_timer_fn, NULL);
 	}
 
 	return 0;
@@ -2094,6 +2341,9 @@ as_fabric_transact_init()
 	rchash_create(&g_fabric_transact_recv_hash, fabric_tranact_recv_hash_fn , fabric_transact_recv_destructor,
 				   sizeof(uint64_t), 64 /* n_buckets */, RCHASH_CR_MT_MANYLOCK);
 
+	g_fabric_transact_wheel = cf_timer_wheel_create(sizeof(uint64_t),
+			TRANSACT_WHEEL_TICK_MS);
+
 	// Create a thread for monitoring transactions.
 	pthread_create(&g_fabric_transact_th, 0, fabric_transact_fn, 0);
 
@@ -2166,8 +2416,12 @@ as_fabric_dump(bool verbose)
 			cf_info(AS_FABRIC, "   %"PRIx64" node not found in hash although reported available", nl.nodes[i]);
 		}
 		else {
-			cf_info(AS_FABRIC, "    %"PRIx64" fds %d live %d goodwrite %"PRIu64" goodread %"PRIu64" q %d", fne->node,
-					fne->outbound_fd_counter, fne->live, fne->good_write_counter, fne->good_read_counter, cf_queue_priority_sz(fne->outbound_msg_queue));
+			fne_channel *fc = fne->channels;
+
+			cf_info(AS_FABRIC, "    %"PRIx64" fds %d/%d/%d live %d goodwrite %"PRIu64" goodread %"PRIu64" q %d/%d/%d", fne->node,
+					fc[AS_FABRIC_CHANNEL_CTRL].outbound_fd_counter, fc[AS_FABRIC_CHANNEL_RW].outbound_fd_counter, fc[AS_FABRIC_CHANNEL_BULK].outbound_fd_counter,
+					fne->live, fne->good_write_counter, fne->good_read_counter,
+					cf_queue_priority_sz(fc[AS_FABRIC_CHANNEL_CTRL].outbound_msg_queue), cf_queue_priority_sz(fc[AS_FABRIC_CHANNEL_RW].outbound_msg_queue), cf_queue_priority_sz(fc[AS_FABRIC_CHANNEL_BULK].outbound_msg_queue));
 			fne_release(fne);
 		}
 	}
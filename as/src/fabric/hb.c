@@ -870,6 +870,12 @@ typedef struct as_hb_s
 	 */
 	pthread_t adjacency_tender_tid;
 
+	/**
+	 * Incremented whenever nodes arrive or depart. Prompts plugins to send
+	 * their lists in full with compact payloads, for new nodes.
+	 */
+	cf_atomic32 adjacency_gen;
+
 } as_hb;
 
 /**
@@ -1079,6 +1085,18 @@ typedef struct as_hb_mesh_tip_clear_udata_s
  */
 #define HB_PLUGIN_DATA_BLOCK_SIZE 8
 
+/**
+ * With compact payloads, the number of pulses a list is sent in full after it
+ * or the adjacency changes, in case some of those pulses are lost.
+ */
+#define HB_PAYLOAD_FULL_REPEAT 3
+
+/**
+ * With compact payloads, the maximum number of pulses between sending a list
+ * in full, in case all pulses after a change are lost.
+ */
+#define HB_PAYLOAD_FULL_INTERVAL 10
+
 /**
  * Global heartbeat instance.
  */
@@ -1155,7 +1173,10 @@ static msg_template g_hb_msg_template[] = {
 	{ AS_HB_MSG_MAX_CLUSTER_SIZE, M_FT_UINT32 },
 	{ AS_HB_MSG_HLC_TIMESTAMP, M_FT_UINT64 },
 	{ AS_HB_MSG_PAXOS_DATA, M_FT_BUF },
-	{ AS_HB_MSG_COMPRESSED_PAYLOAD, M_FT_BUF }
+	{ AS_HB_MSG_COMPRESSED_PAYLOAD, M_FT_BUF },
+	{ AS_HB_MSG_HB_DATA_DIGEST, M_FT_UINT64 },
+	{ AS_HB_MSG_PAXOS_DATA_DIGEST, M_FT_UINT64 },
+	{ AS_HB_MSG_RACK_ID, M_FT_UINT32 }
 };
 
 /**
@@ -1574,6 +1595,8 @@ static void config_hb_fabric_grace_factor_set(int new_factor);
 static uint32_t config_hb_mesh_rw_retry_timeout_get();
 static uint32_t config_override_mtu_get();
 static void config_override_mtu_set(uint32_t mtu);
+static bool config_compact_payloads_get();
+static void config_compact_payloads_set(bool compact_payloads);
 
 static unsigned char config_hb_mcast_ttl_get();
 
@@ -1814,6 +1837,49 @@ as_hb_plugin_register(as_hb_plugin* plugin)
 	hb_plugin_register(plugin);
 }
 
+/**
+ * Digest of a node list, for compact payloads.
+ */
+uint64_t
+as_hb_payload_digest(cf_node* nodes, size_t n_nodes)
+{
+	return cf_hash_fnv(nodes, n_nodes * sizeof(cf_node));
+}
+
+/**
+ * Decide whether a plugin should send its list in full in the outgoing pulse,
+ * or only its digest.
+ */
+bool
+as_hb_payload_send_full(as_hb_payload_state* state, uint64_t digest)
+{
+	if (!config_compact_payloads_get()) {
+		return true;
+	}
+
+	uint32_t adjacency_gen = cf_atomic32_get(g_hb.adjacency_gen);
+
+	if (digest != state->digest || adjacency_gen != state->adjacency_gen) {
+		// Changed, or there are new nodes that may not have the list.
+		state->digest = digest;
+		state->adjacency_gen = adjacency_gen;
+		state->n_full_pending = HB_PAYLOAD_FULL_REPEAT;
+	}
+
+	if (state->n_full_pending != 0 ||
+	    state->n_since_full + 1 >= HB_PAYLOAD_FULL_INTERVAL) {
+		if (state->n_full_pending != 0) {
+			state->n_full_pending--;
+		}
+
+		state->n_since_full = 0;
+		return true;
+	}
+
+	state->n_since_full++;
+	return false;
+}
+
 /**
  * Get the ip address of a node given its node id.
  *
@@ -1906,6 +1972,15 @@ as_hb_override_mtu_set(int mtu)
 	config_override_mtu_set(mtu);
 }
 
+/**
+ * Enable or disable compact adjacency and succession payloads.
+ */
+void
+as_hb_compact_payloads_set(bool compact_payloads)
+{
+	config_compact_payloads_set(compact_payloads);
+}
+
 /**
  * Get the heartbeat pulse transmit interval.
  */
@@ -1986,6 +2061,8 @@ as_hb_info_config_get(cf_dyn_buf* db)
 	info_append_uint32(db, "heartbeat.mesh-rw-retry-timeout",
 			   config_hb_mesh_rw_retry_timeout_get());
 	info_append_int(db, "heartbeat.mtu", MTU());
+	info_append_bool(db, "heartbeat.compact-payloads",
+			 config_compact_payloads_get());
 
 	char protocol_s[AS_HB_PROTOCOL_STR_MAX_LEN()];
 	as_hb_protocol_get_s(config_protocol_get(), protocol_s);
@@ -3378,6 +3455,32 @@ config_override_mtu_set(uint32_t mtu)
 	     multicast_supported_cluster_size_get());
 }
 
+/**
+ * Indicates if compact payloads are enabled.
+ */
+static bool
+config_compact_payloads_get()
+{
+	CONFIG_LOCK();
+	bool compact_payloads = g_config.hb_config.compact_payloads;
+	CONFIG_UNLOCK();
+	return compact_payloads;
+}
+
+/**
+ * Enable or disable compact payloads.
+ */
+static void
+config_compact_payloads_set(bool compact_payloads)
+{
+	CONFIG_LOCK();
+	INFO("Changing value of compact payloads from %s to %s ",
+	     g_config.hb_config.compact_payloads ? "true" : "false",
+	     compact_payloads ? "true" : "false");
+	g_config.hb_config.compact_payloads = compact_payloads;
+	CONFIG_UNLOCK();
+}
+
 /**
  * Get the maximum number of missed heartbeat intervals after which a node is
  * considered expired.
@@ -7473,6 +7576,10 @@ hb_event_queue(as_hb_event_type event_type, cf_node* nodes, int node_count)
 	// Lockless because the queue is thread safe and we do not use
 	// heartbeat
 	// state here.
+	if (node_count != 0) {
+		cf_atomic32_incr(&g_hb.adjacency_gen);
+	}
+
 	for (int i = 0; i < node_count; i++) {
 		as_hb_event_node event;
 		event.evt = event_type;
@@ -7638,9 +7745,20 @@ hb_plugin_set_fn(msg* msg)
 
 		HB_UNLOCK();
 
-		// Populate adjacency list.
-		msg_adjacency_set(msg, adj_list,
-				  adjacency_reduce_udata.adj_count);
+		// Populate adjacency list, or just its digest if unchanged
+		// with compact payloads. Only the transmitter thread sets
+		// pulse messages.
+		static as_hb_payload_state payload_state;
+		uint64_t digest = as_hb_payload_digest(
+		  adj_list, adjacency_reduce_udata.adj_count);
+
+		if (as_hb_payload_send_full(&payload_state, digest)) {
+			msg_adjacency_set(msg, adj_list,
+					  adjacency_reduce_udata.adj_count);
+		} else if (msg_set_uint64(msg, AS_HB_MSG_HB_DATA_DIGEST,
+					  digest) != 0) {
+			CRASH("Error setting adjacency digest on msg.");
+		}
 
 		// Set cluster id
 		char cluster_id[AS_CLUSTER_ID_SZ];
@@ -7660,6 +7778,39 @@ hb_plugin_set_fn(msg* msg)
 	}
 }
 
+/**
+ * Plugin function that detects a pulse message carrying only the digest of the
+ * adjacency list. The previous list is kept, even if the digest does not match
+ * - the next full list will correct it.
+ */
+static bool
+hb_plugin_data_unchanged_fn(msg* msg, cf_node source,
+			    as_hb_plugin_node_data* prev_data)
+{
+	uint64_t digest;
+
+	if (HB_IS_MSG_LEGACY(msg) || msg_is_set(msg, AS_HB_MSG_HB_DATA) ||
+	    msg_get_uint64(msg, AS_HB_MSG_HB_DATA_DIGEST, &digest) != 0) {
+		return false;
+	}
+
+	size_t prev_length = prev_data->data_size > sizeof(size_t)
+			       ? (prev_data->data_size - sizeof(size_t)) /
+				   sizeof(cf_node)
+			       : 0;
+
+	if (as_hb_payload_digest(prev_length == 0
+				   ? NULL
+				   : (cf_node*)(prev_data->data + sizeof(size_t)),
+				 prev_length) != digest) {
+		DETAIL("Adjacency digest mismatch for node %" PRIx64
+		       " - keeping previous list",
+		       source);
+	}
+
+	return true;
+}
+
 /**
  * Plugin function that parses adjacency list out of a heartbeat pulse
  * message.
@@ -7796,6 +7947,18 @@ hb_plugin_msg_parse(msg* msg, as_hb_adjacent_node* adjacent_node,
 			  &adjacent_node->plugin_data
 			     [i][(adjacent_node->plugin_data_cycler + 1) % 2];
 
+			if (g_hb.plugins[i].unchanged_fn &&
+			    (g_hb.plugins[i])
+			      .unchanged_fn(msg, source, prev_data)) {
+				// No new data - swap the previous data into
+				// the current slot instead of parsing. Not a
+				// change.
+				as_hb_plugin_node_data temp = *curr_data;
+				*curr_data = *prev_data;
+				*prev_data = temp;
+				continue;
+			}
+
 			// Ensure there is a preallocated data pointer.
 			if (curr_data->data == NULL) {
 				curr_data->data =
@@ -7863,6 +8026,7 @@ hb_plugin_init()
 	self_plugin.wire_size_per_node = sizeof(cf_node);
 	self_plugin.set_fn = hb_plugin_set_fn;
 	self_plugin.parse_fn = hb_plugin_parse_data_fn;
+	self_plugin.unchanged_fn = hb_plugin_data_unchanged_fn;
 	hb_plugin_register(&self_plugin);
 }
 
@@ -39,6 +39,7 @@
 #include <string.h>
 #include <sys/syscall.h>
 #include <unistd.h>
+#include <zlib.h>
 
 #include "citrusleaf/alloc.h"
 #include "citrusleaf/cf_atomic.h"
@@ -52,12 +53,16 @@
 #include "rchash.h"
 #include "util.h"
 
+#include "base/admission.h"
+#include "base/as_stap.h"
 #include "base/cfg.h"
 #include "base/datamodel.h"
 #include "base/index.h"
 #include "base/ldt.h"
 #include "base/rec_props.h"
+#include "base/truncate.h"
 #include "fabric/fabric.h"
+#include "fabric/partition_changelog.h"
 #include "storage/storage.h"
 
 
@@ -90,7 +95,11 @@ const msg_template migrate_mt[] = {
 		{ MIG_FIELD_PARTITION_SIZE, M_FT_UINT32 },
 		{ MIG_FIELD_META_RECORDS, M_FT_BUF },
 		{ MIG_FIELD_META_SEQUENCE, M_FT_UINT32 },
-		{ MIG_FIELD_META_SEQUENCE_FINAL, M_FT_UINT32 }
+		{ MIG_FIELD_META_SEQUENCE_FINAL, M_FT_UINT32 },
+		{ MIG_FIELD_RECORD_ORIG_SZ, M_FT_UINT32 },
+		{ MIG_FIELD_DELTA_VINFO, M_FT_BUF },
+		{ MIG_FIELD_DELTA_MAX_LUT, M_FT_UINT64 },
+		{ MIG_FIELD_WINDOW, M_FT_UINT32 }
 };
 
 COMPILER_ASSERT(sizeof(migrate_mt) / sizeof(msg_template) == NUM_MIG_FIELDS);
@@ -106,6 +115,27 @@ COMPILER_ASSERT(sizeof(migrate_mt) / sizeof(msg_template) == NUM_MIG_FIELDS);
 #define MIGRATE_RETRANSMIT_STARTDONE_MS (g_config.transaction_retry_ms)
 #define MAX_BYTES_EMIGRATING (16 * 1024 * 1024)
 
+// With migrate-rx-memory-budget configured, each immigration gets an equal
+// share of it as its emigrator's window, within these bounds.
+#define MIN_IMMIGRATION_WINDOW (256 * 1024)
+#define MAX_IMMIGRATION_WINDOW (1024 * 1024 * 1024)
+#define MIG_COMPRESS_MIN_SZ 128 // don't bother compressing tiny pickles
+
+// Delta migration also sends records slightly older than the immigrator's
+// newest, to cover replica writes lost as it left, and clock skew.
+#define MIG_DELTA_LUT_MARGIN_MS (60 * 1000)
+
+// Trees at least this big may be split into digest ranges, each emigrated by
+// its own thread.
+#define MIG_SPLIT_MIN_ELEMENTS (64 * 1024)
+
+// Digest bits 12-23 are the ones just above the partition id. Slices of their
+// value space are contiguous digest ranges within a partition.
+#define MIG_SPLIT_N_VALUES (1 << 12)
+
+// Most send time the byte-rate throttle lets unused bandwidth accumulate.
+#define MIG_THROTTLE_BURST_US (100 * 1000)
+
 typedef struct pickled_record_s {
 	cf_digest     keyd;
 	uint32_t      generation;
@@ -139,6 +169,15 @@ typedef struct emigration_reinsert_ctrl_s {
 	msg *m;
 } emigration_reinsert_ctrl;
 
+typedef struct emigration_slice_s {
+	emigration *emig;
+	as_index_tree *tree;
+	cf_digest *lo_keyd; // null means unbounded
+	cf_digest *hi_keyd; // null means unbounded
+	cf_digest lo;
+	cf_digest hi;
+} emigration_slice;
+
 typedef struct immigration_ldt_version_s {
 	uint64_t        incoming_ldt_version;
 	as_partition_id pid;
@@ -156,6 +195,10 @@ static cf_atomic32 g_emigration_id = 0;
 static cf_atomic32 g_emigration_insert_id = 0;
 static cf_queue *g_emigration_q = NULL;
 static shash *g_immigration_ldt_version_hash;
+static cf_atomic32 g_n_immigrations_receiving = 0;
+
+static pthread_mutex_t g_throttle_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t g_throttle_next_us = 0;
 
 
 //==========================================================
@@ -174,16 +217,22 @@ void emigration_pop(emigration **emigp);
 int emigration_pop_reduce_fn(void *buf, void *udata);
 as_migrate_state emigrate(emigration *emig);
 as_migrate_state emigrate_tree(emigration *emig);
+void emigrate_tree_split(emigration *emig, as_index_tree *tree, uint32_t n_slices);
+void emigrate_changelog(emigration *emig, as_index_tree *tree, cf_digest *keyds, uint32_t n_keyds);
+void *run_emigration_slice(void *arg);
 void *run_emigration_reinserter(void *arg);
 void emigrate_tree_reduce_fn(as_index_ref *r_ref, void *udata);
 bool emigrate_record(emigration *emig, msg *m);
+void emigration_throttle(uint32_t wire_sz);
 int emigration_reinsert_reduce_fn(void *key, void *data, void *udata);
 as_migrate_state emigration_send_start(emigration *emig);
+void emigration_set_delta(emigration *emig, const as_partition_vinfo *immig_vinfo, uint64_t immig_max_lut);
 as_migrate_state emigration_send_done(emigration *emig);
 
 // Immigration.
 void *run_immigration_reaper(void *unused);
 int immigration_reaper_reduce_fn(void *key, uint32_t keylen, void *object, void *udata);
+void immigration_set_window(msg *m);
 
 // Migrate fabric message handling.
 int migrate_receive_msg_cb(cf_node src, msg *m, void *udata);
@@ -193,6 +242,10 @@ void immigration_handle_done_request(cf_node src, msg *m);
 void emigration_handle_insert_ack(cf_node src, msg *m);
 void emigration_handle_ctrl_ack(cf_node src, msg *m, uint32_t op);
 
+// Record compression.
+uint32_t compress_pickled_record(pickled_record *pr);
+uint8_t *decompress_record(const uint8_t *buf, size_t buf_sz, uint32_t orig_sz);
+
 // Info API helpers.
 int emigration_dump_reduce_fn(void *key, uint32_t keylen, void *object, void *udata);
 int immigration_dump_reduce_fn(void *key, uint32_t keylen, void *object, void *udata);
@@ -294,9 +347,12 @@ as_migrate_emigrate(const partition_migrate_record *pmr)
 	emig->tx_flags = pmr->tx_flags;
 	emig->state = EMIG_STATE_ACTIVE;
 	emig->aborted = false;
+	emig->compress = false;
+	emig->delta_lut = 0;
 
 	// Create these later only when we need them - we'll get lots at once.
 	emig->bytes_emigrating = 0;
+	emig->window = MAX_BYTES_EMIGRATING;
 	emig->reinsert_hash = NULL;
 	emig->ctrl_q = NULL;
 	emig->meta_q = NULL;
@@ -498,6 +554,11 @@ immigration_destroy(void *parm)
 	ldtv.incoming_ldt_version = immig->incoming_ldt_version;
 	ldtv.pid = immig->pid;
 
+	// Reaped, or dropped at rebalance, before its DONE arrived.
+	if (immig->receiving && immig->done_recv == 0) {
+		cf_atomic32_decr(&g_n_immigrations_receiving);
+	}
+
 	if (immig->rsv.p) {
 		cf_atomic_int_decr(&immig->rsv.ns->migrate_rx_instance_count);
 
@@ -607,14 +668,14 @@ emigration_pop_reduce_fn(void *buf, void *udata)
 	emigration *emig = *(emigration **)buf;
 
 	if (! emig || // null emig terminates thread
-			emig->rsv.tree->elements == 0 ||
+			as_index_tree_size(emig->rsv.tree) == 0 ||
 			emig->tx_flags == TX_FLAGS_REQUEST ||
 			emig->cluster_key != as_paxos_get_cluster_key()) {
 		return -1; // process immediately
 	}
 
 	uint32_t migrate_order = emig->rsv.ns->migrate_order;
-	uint32_t tree_elements = emig->rsv.tree->elements;
+	uint32_t tree_elements = as_index_tree_size(emig->rsv.tree);
 
 	if (migrate_order < pop_info->best_migrate_order ||
 			(migrate_order == pop_info->best_migrate_order &&
@@ -702,7 +763,25 @@ emigrate_tree(emigration *emig)
 		cf_crash(AS_MIGRATE, "could not start reinserter thread");
 	}
 
-	as_index_reduce(tree, emigrate_tree_reduce_fn, emig);
+	as_partition_changelog *cl = emig->rsv.p->changelog;
+	uint32_t n_slices = g_config.migrate_split_threads;
+	cf_digest *keyds;
+	uint32_t n_keyds;
+
+	if (! is_subrecord && emig->delta_lut != 0 && cl &&
+			as_partition_changelog_get(cl, emig->delta_lut,
+					emig->rsv.ns->migrate_changelog_max_age, &keyds,
+					&n_keyds)) {
+		cf_atomic_int_incr(&emig->rsv.ns->migrate_tx_partitions_changelog);
+		emigrate_changelog(emig, tree, keyds, n_keyds);
+		cf_free(keyds);
+	}
+	else if (n_slices > 1 && as_index_tree_size(tree) >= MIG_SPLIT_MIN_ELEMENTS) {
+		emigrate_tree_split(emig, tree, n_slices);
+	}
+	else {
+		as_index_reduce(tree, emigrate_tree_reduce_fn, emig);
+	}
 
 	// Sets EMIG_STATE_FINISHED only if not already EMIG_STATE_ABORTED.
 	cf_atomic32_setmax(&emig->state, EMIG_STATE_FINISHED);
@@ -714,6 +793,85 @@ emigrate_tree(emigration *emig)
 }
 
 
+// Emigrate a big tree using several threads, each reducing its own range of
+// digests. Records still go to the same immigration - the only shared state is
+// the reinsert hash and byte counts, which are all thread-safe.
+void
+emigrate_tree_split(emigration *emig, as_index_tree *tree, uint32_t n_slices)
+{
+	as_partition_id pid = emig->rsv.pid;
+	emigration_slice slices[n_slices];
+	pthread_t threads[n_slices];
+
+	for (uint32_t i = 0; i < n_slices; i++) {
+		emigration_slice *slice = &slices[i];
+		uint32_t lo_v = (i * MIG_SPLIT_N_VALUES) / n_slices;
+		uint32_t hi_v = ((i + 1) * MIG_SPLIT_N_VALUES) / n_slices;
+
+		slice->emig = emig;
+		slice->tree = tree;
+
+		memset(&slice->lo, 0, sizeof(cf_digest));
+		slice->lo.digest[0] = (uint8_t)(pid & 0xFF);
+		slice->lo.digest[1] = (uint8_t)(((pid >> 8) & 0x0F) | ((lo_v >> 8) << 4));
+		slice->lo.digest[2] = (uint8_t)(lo_v & 0xFF);
+
+		memset(&slice->hi, 0, sizeof(cf_digest));
+		slice->hi.digest[0] = (uint8_t)(pid & 0xFF);
+		slice->hi.digest[1] = (uint8_t)(((pid >> 8) & 0x0F) | ((hi_v >> 8) << 4));
+		slice->hi.digest[2] = (uint8_t)(hi_v & 0xFF);
+
+		slice->lo_keyd = i == 0 ? NULL : &slice->lo;
+		slice->hi_keyd = i == n_slices - 1 ? NULL : &slice->hi;
+	}
+
+	// This thread does the first slice.
+	for (uint32_t i = 1; i < n_slices; i++) {
+		if (pthread_create(&threads[i], NULL, run_emigration_slice,
+				&slices[i]) != 0) {
+			cf_crash(AS_MIGRATE, "could not start emigration slice thread");
+		}
+	}
+
+	run_emigration_slice(&slices[0]);
+
+	for (uint32_t i = 1; i < n_slices; i++) {
+		pthread_join(threads[i], NULL);
+	}
+}
+
+
+// Emigrate only the records the partition's changelog lists as written since
+// the immigrator's delta last-update-time - no tree reduce needed.
+void
+emigrate_changelog(emigration *emig, as_index_tree *tree, cf_digest *keyds,
+		uint32_t n_keyds)
+{
+	for (uint32_t i = 0; i < n_keyds && ! emig->aborted; i++) {
+		as_index_ref r_ref;
+
+		r_ref.skip_lock = false;
+
+		// Records deleted since they were written won't be found.
+		if (as_record_get(tree, &keyds[i], &r_ref, emig->rsv.ns) == 0) {
+			emigrate_tree_reduce_fn(&r_ref, emig);
+		}
+	}
+}
+
+
+void *
+run_emigration_slice(void *arg)
+{
+	emigration_slice *slice = (emigration_slice *)arg;
+
+	as_index_reduce_range(slice->tree, slice->lo_keyd, slice->hi_keyd,
+			emigrate_tree_reduce_fn, slice->emig);
+
+	return NULL;
+}
+
+
 void *
 run_emigration_reinserter(void *arg)
 {
@@ -768,6 +926,12 @@ emigrate_tree_reduce_fn(as_index_ref *r_ref, void *udata)
 		return;
 	}
 
+	if (r_ref->r->last_update_time <= emig->delta_lut) {
+		as_record_done(r_ref, ns);
+		cf_atomic_int_incr(&ns->migrate_delta_records_skipped);
+		return;
+	}
+
 	//--------------------------------------------
 	// Read the record and pickle it.
 	//
@@ -849,9 +1013,26 @@ emigrate_tree_reduce_fn(as_index_ref *r_ref, void *udata)
 				pr.rec_props.size, MSG_SET_HANDOFF_MALLOC);
 	}
 
+	if (emig->compress) {
+		uint32_t orig_sz = compress_pickled_record(&pr);
+
+		if (orig_sz != 0) {
+			msg_set_uint32(m, MIG_FIELD_RECORD_ORIG_SZ, orig_sz);
+			cf_atomic_int_add(&ns->migrate_compression_orig_bytes, orig_sz);
+		}
+		else {
+			cf_atomic_int_add(&ns->migrate_compression_orig_bytes,
+					pr.record_len);
+		}
+
+		cf_atomic_int_add(&ns->migrate_compression_bytes, pr.record_len);
+	}
+
 	msg_set_buf(m, MIG_FIELD_RECORD, pr.record_buf, pr.record_len,
 			MSG_SET_HANDOFF_MALLOC);
 
+	uint32_t wire_sz = msg_get_wire_size(m);
+
 	// This might block if the queues are backed up but a failure is a
 	// hard-fail - can't notify other side.
 	if (! emigrate_record(emig, m)) {
@@ -868,9 +1049,14 @@ emigrate_tree_reduce_fn(as_index_ref *r_ref, void *udata)
 		usleep(ns->migrate_sleep);
 	}
 
+	emigration_throttle(wire_sz);
+
+	as_admission_shed(ns, AS_ADMIT_MIGRATE);
+
 	uint32_t waits = 0;
 
-	while (cf_atomic32_get(emig->bytes_emigrating) > MAX_BYTES_EMIGRATING &&
+	while (cf_atomic32_get(emig->bytes_emigrating) >
+			cf_atomic32_get(emig->window) &&
 			emig->cluster_key == as_paxos_get_cluster_key()) {
 		usleep(1000);
 
@@ -913,6 +1099,38 @@ emigrate_record(emigration *emig, msg *m)
 }
 
 
+// Pace all emigration threads together, so the total rate of records sent
+// stays at or below migrate-max-bytes-per-sec.
+void
+emigration_throttle(uint32_t wire_sz)
+{
+	uint64_t max_bytes_per_sec = g_config.migrate_max_bytes_per_sec;
+
+	if (max_bytes_per_sec == 0) {
+		return;
+	}
+
+	uint64_t now_us = cf_getus();
+
+	pthread_mutex_lock(&g_throttle_lock);
+
+	// Don't let an idle spell bank up more than a short burst.
+	if (g_throttle_next_us + MIG_THROTTLE_BURST_US < now_us) {
+		g_throttle_next_us = now_us - MIG_THROTTLE_BURST_US;
+	}
+
+	g_throttle_next_us += ((uint64_t)wire_sz * 1000000) / max_bytes_per_sec;
+
+	uint64_t send_us = g_throttle_next_us;
+
+	pthread_mutex_unlock(&g_throttle_lock);
+
+	if (send_us > now_us) {
+		usleep((useconds_t)(send_us - now_us));
+	}
+}
+
+
 int
 emigration_reinsert_reduce_fn(void *key, void *data, void *udata)
 {
@@ -947,10 +1165,12 @@ emigration_send_start(emigration *emig)
 		return AS_MIGRATE_STATE_ERROR;
 	}
 
-	uint32_t partition_size = emig->rsv.tree->elements;
+	uint32_t partition_size = as_index_tree_size(emig->rsv.tree);
 
 	msg_set_uint32(m, MIG_FIELD_OP, OPERATION_START);
-	msg_set_uint32(m, MIG_FIELD_FEATURES, MY_MIG_FEATURES);
+	msg_set_uint32(m, MIG_FIELD_FEATURES, MY_MIG_FEATURES |
+			(ns->migrate_compression ? MIG_FEATURE_COMPRESSION : 0) |
+			(ns->migrate_delta && ! ns->ldt_enabled ? MIG_FEATURE_DELTA : 0));
 	msg_set_uint32(m, MIG_FIELD_PARTITION_SIZE, partition_size);
 	msg_set_uint32(m, MIG_FIELD_EMIG_ID, emig->id);
 	msg_set_uint64(m, MIG_FIELD_CLUSTER_KEY, emig->cluster_key);
@@ -1016,6 +1236,30 @@ emigration_send_start(emigration *emig)
 }
 
 
+// Emigrate only records newer than the immigrator's, if its partition is an
+// ancestor of ours - otherwise it may lack older records, so send everything.
+void
+emigration_set_delta(emigration *emig, const as_partition_vinfo *immig_vinfo,
+		uint64_t immig_max_lut)
+{
+	as_partition *p = emig->rsv.p;
+
+	pthread_mutex_lock(&p->lock);
+
+	bool is_ancestor = as_partition_vinfo_is_ancestor(immig_vinfo,
+			&p->version_info);
+
+	pthread_mutex_unlock(&p->lock);
+
+	if (! is_ancestor || immig_max_lut <= MIG_DELTA_LUT_MARGIN_MS) {
+		return;
+	}
+
+	emig->delta_lut = immig_max_lut - MIG_DELTA_LUT_MARGIN_MS;
+	cf_atomic_int_incr(&emig->rsv.ns->migrate_tx_partitions_delta);
+}
+
+
 as_migrate_state
 emigration_send_done(emigration *emig)
 {
@@ -1122,6 +1366,32 @@ immigration_reaper_reduce_fn(void *key, uint32_t keylen, void *object,
 }
 
 
+// Each ack carries the emigrator's current share of the budget, so shares
+// follow immigrations starting and finishing. Without a budget, no window is
+// sent and emigrators keep MAX_BYTES_EMIGRATING.
+void
+immigration_set_window(msg *m)
+{
+	uint64_t budget = g_config.migrate_rx_memory_budget;
+
+	if (budget == 0) {
+		return;
+	}
+
+	int32_t n_receiving = cf_atomic32_get(g_n_immigrations_receiving);
+	uint64_t window = budget / (uint64_t)(n_receiving > 0 ? n_receiving : 1);
+
+	if (window < MIN_IMMIGRATION_WINDOW) {
+		window = MIN_IMMIGRATION_WINDOW;
+	}
+	else if (window > MAX_IMMIGRATION_WINDOW) {
+		window = MAX_IMMIGRATION_WINDOW;
+	}
+
+	msg_set_uint32(m, MIG_FIELD_WINDOW, (uint32_t)window);
+}
+
+
 //==========================================================
 // Local helpers - migrate fabric message handling.
 //
@@ -1251,6 +1521,12 @@ immigration_handle_start_request(cf_node src, msg *m) {
 
 	msg_preserve_fields(m, 1, MIG_FIELD_EMIG_ID);
 
+	// Must get this before the partition may become DESYNC.
+	as_partition_vinfo delta_vinfo;
+	uint64_t delta_max_lut = 0;
+	bool use_delta = (emig_features & MIG_FEATURE_DELTA) != 0 &&
+			as_partition_get_delta_info(ns, pid, &delta_vinfo, &delta_max_lut);
+
 	as_migrate_result rv = as_partition_immigrate_start(ns, pid, cluster_key,
 			start_type, src);
 
@@ -1295,11 +1571,13 @@ immigration_handle_start_request(cf_node src, msg *m) {
 	immig->done_recv = 0;
 	immig->start_recv_ms = 0;
 	immig->done_recv_ms = 0;
+	immig->receiving = false;
 	immig->emig_id = emig_id;
 
 	immig_meta_q_init(&immig->meta_q);
 
-	uint32_t mig_features_in_use = MY_MIG_FEATURES | MIG_FEATURES_SEEN;
+	uint32_t mig_features_in_use = MY_MIG_FEATURES | MIG_FEATURES_SEEN |
+			(emig_features & MIG_FEATURE_COMPRESSION);
 
 	as_partition_reserve_migrate(ns, pid, &immig->rsv, NULL);
 
@@ -1314,6 +1592,9 @@ immigration_handle_start_request(cf_node src, msg *m) {
 			(void *)immig) == RCHASH_OK) {
 		cf_atomic_int_incr(&immig->rsv.ns->migrate_rx_partitions_active);
 
+		cf_atomic32_incr(&g_n_immigrations_receiving);
+		immig->receiving = true;
+
 		immigration_ldt_version ldtv;
 
 		ldtv.incoming_ldt_version = immig->incoming_ldt_version;
@@ -1332,8 +1613,16 @@ immigration_handle_start_request(cf_node src, msg *m) {
 		immigration_release(immig);
 	}
 
+	if (use_delta) {
+		mig_features_in_use |= MIG_FEATURE_DELTA;
+		msg_set_buf(m, MIG_FIELD_DELTA_VINFO, (uint8_t *)&delta_vinfo,
+				sizeof(delta_vinfo), MSG_SET_COPY);
+		msg_set_uint64(m, MIG_FIELD_DELTA_MAX_LUT, delta_max_lut);
+	}
+
 	msg_set_uint32(m, MIG_FIELD_OP, OPERATION_START_ACK_OK);
 	msg_set_uint32(m, MIG_FIELD_FEATURES, mig_features_in_use);
+	immigration_set_window(m);
 
 	if (as_fabric_send(src, m, AS_FABRIC_PRIORITY_MEDIUM) !=
 			AS_FABRIC_SUCCESS) {
@@ -1362,6 +1651,8 @@ immigration_handle_insert_request(cf_node src, msg *m) {
 		return;
 	}
 
+	ASD_MIGRATE_INSERT_START(src, emig_id);
+
 	immigration_hkey hkey;
 
 	hkey.src = src;
@@ -1412,6 +1703,23 @@ immigration_handle_insert_request(cf_node src, msg *m) {
 			return;
 		}
 
+		uint8_t *decomp_buf = NULL;
+		uint32_t orig_sz = 0;
+
+		// Present only if the emigrator compressed the record.
+		if (msg_get_uint32(m, MIG_FIELD_RECORD_ORIG_SZ, &orig_sz) == 0) {
+			if (! (decomp_buf = decompress_record(value, value_sz, orig_sz))) {
+				cf_warning_digest(AS_MIGRATE, keyd, "handle insert: failed record decompression ");
+				cf_atomic_int_incr(&immig->rsv.ns->migrate_decompression_errors);
+				immigration_release(immig);
+				as_fabric_msg_put(m);
+				return;
+			}
+
+			value = decomp_buf;
+			value_sz = orig_sz;
+		}
+
 		as_rec_props rec_props;
 		as_rec_props_clear(&rec_props);
 
@@ -1431,6 +1739,11 @@ immigration_handle_insert_request(cf_node src, msg *m) {
 		if (as_ldt_get_migrate_info(immig, &c, m, keyd)) {
 			immigration_release(immig);
 			as_fabric_msg_put(m);
+
+			if (decomp_buf) {
+				cf_free(decomp_buf);
+			}
+
 			return;
 		}
 
@@ -1438,6 +1751,12 @@ immigration_handle_insert_request(cf_node src, msg *m) {
 		if (*(uint16_t *)c.record_buf == 0) {
 			cf_warning_digest(AS_MIGRATE, keyd, "handle insert: binless pickle, dropping ");
 		}
+		else if (! COMPONENT_IS_LDT_SUB(&c) &&
+				as_truncate_lut_is_truncated(last_update_time, immig->rsv.ns,
+						&rec_props)) {
+			// Truncated on this node too - dropping it is not a failure.
+			cf_detail_digest(AS_MIGRATE, keyd, "handle insert: truncated, dropping ");
+		}
 		else {
 			int winner_idx  = -1;
 			int rv = as_record_flatten(&immig->rsv, keyd, 1, &c, &winner_idx);
@@ -1449,17 +1768,29 @@ immigration_handle_insert_request(cf_node src, msg *m) {
 					cf_warning_digest(AS_MIGRATE, keyd, "handle insert: record flatten failed %d ", rv);
 					immigration_release(immig);
 					as_fabric_msg_put(m);
+
+					if (decomp_buf) {
+						cf_free(decomp_buf);
+					}
+
 					return;
 				}
 			}
 		}
 
+		if (decomp_buf) {
+			cf_free(decomp_buf);
+		}
+
 		immigration_release(immig);
 	}
 
+	ASD_MIGRATE_INSERT_DONE(src, emig_id);
+
 	msg_preserve_fields(m, 2, MIG_FIELD_EMIG_INSERT_ID, MIG_FIELD_EMIG_ID);
 
 	msg_set_uint32(m, MIG_FIELD_OP, OPERATION_INSERT_ACK);
+	immigration_set_window(m);
 
 	if (as_fabric_send(src, m, AS_FABRIC_PRIORITY_MEDIUM) !=
 			AS_FABRIC_SUCCESS) {
@@ -1497,6 +1828,9 @@ immigration_handle_done_request(cf_node src, msg *m) {
 			// Record the time of the first DONE received.
 			immig->done_recv_ms = cf_getms();
 
+			// No more inserts coming - its share goes to the others.
+			cf_atomic32_decr(&g_n_immigrations_receiving);
+
 			as_namespace *ns = immig->rsv.ns;
 
 			if (cf_atomic_int_decr(&ns->migrate_rx_partitions_active) < 0) {
@@ -1557,6 +1891,14 @@ emigration_handle_insert_ack(cf_node src, msg *m)
 		return;
 	}
 
+	uint32_t window;
+
+	// Older immigrators don't send a window - keep the default.
+	if (src == emig->dest &&
+			msg_get_uint32(m, MIG_FIELD_WINDOW, &window) == 0) {
+		cf_atomic32_set(&emig->window, window);
+	}
+
 	emigration_reinsert_ctrl *ri_ctrl = NULL;
 	pthread_mutex_t *vlock;
 
@@ -1600,6 +1942,29 @@ emigration_handle_ctrl_ack(cf_node src, msg *m, uint32_t op)
 
 	msg_get_uint32(m, MIG_FIELD_FEATURES, &immig_features);
 
+	uint32_t window = 0;
+	bool has_window = op == OPERATION_START_ACK_OK &&
+			msg_get_uint32(m, MIG_FIELD_WINDOW, &window) == 0;
+
+	as_partition_vinfo delta_vinfo;
+	uint64_t delta_max_lut = 0;
+	bool has_delta = false;
+
+	if (op == OPERATION_START_ACK_OK &&
+			(immig_features & MIG_FEATURES_SEEN) != 0 &&
+			(immig_features & MIG_FEATURE_DELTA) != 0) {
+		uint8_t *vinfo_buf;
+		size_t vinfo_sz;
+
+		if (msg_get_buf(m, MIG_FIELD_DELTA_VINFO, &vinfo_buf, &vinfo_sz,
+				MSG_GET_DIRECT) == 0 && vinfo_sz == sizeof(delta_vinfo) &&
+				msg_get_uint64(m, MIG_FIELD_DELTA_MAX_LUT,
+						&delta_max_lut) == 0) {
+			memcpy(&delta_vinfo, vinfo_buf, sizeof(delta_vinfo));
+			has_delta = true;
+		}
+	}
+
 	as_fabric_msg_put(m);
 
 	emigration *emig;
@@ -1607,6 +1972,23 @@ emigration_handle_ctrl_ack(cf_node src, msg *m, uint32_t op)
 	if (rchash_get(g_emigration_hash, (void *)&emig_id, sizeof(emig_id),
 			(void **)&emig) == RCHASH_OK) {
 		if (emig->dest == src) {
+			// Older immigrators don't echo the compression feature.
+			if (op == OPERATION_START_ACK_OK &&
+					(immig_features & MIG_FEATURES_SEEN) != 0 &&
+					(immig_features & MIG_FEATURE_COMPRESSION) != 0) {
+				emig->compress = true;
+			}
+
+			if (has_window) {
+				cf_atomic32_set(&emig->window, window);
+			}
+
+			// Only the first ack counts - a retransmitted start finds the
+			// immigrator's partition DESYNC already.
+			if (has_delta && emig->delta_lut == 0) {
+				emigration_set_delta(emig, &delta_vinfo, delta_max_lut);
+			}
+
 			if ((immig_features & MIG_FEATURES_SEEN) == 0 ||
 					(immig_features & MIG_FEATURE_MERGE) == 0) {
 				// TODO - rethink where this should go after further refactor.
@@ -1631,6 +2013,64 @@ emigration_handle_ctrl_ack(cf_node src, msg *m, uint32_t op)
 }
 
 
+//==========================================================
+// Local helpers - record compression.
+//
+
+// Replaces the pickle with a zlib-compressed copy if that's smaller. Returns
+// the uncompressed size, or 0 if the pickle was left as is.
+uint32_t
+compress_pickled_record(pickled_record *pr)
+{
+	if (pr->record_len < MIG_COMPRESS_MIN_SZ) {
+		return 0;
+	}
+
+	uLongf comp_sz = compressBound(pr->record_len);
+	byte *comp_buf = cf_malloc(comp_sz);
+
+	if (! comp_buf) {
+		return 0;
+	}
+
+	if (compress2(comp_buf, &comp_sz, pr->record_buf, pr->record_len,
+			Z_BEST_SPEED) != Z_OK || comp_sz >= pr->record_len) {
+		cf_free(comp_buf);
+		return 0;
+	}
+
+	uint32_t orig_sz = (uint32_t)pr->record_len;
+
+	cf_free(pr->record_buf);
+	pr->record_buf = comp_buf;
+	pr->record_len = comp_sz;
+
+	return orig_sz;
+}
+
+
+// Returns a new allocation holding the uncompressed pickle, or NULL.
+uint8_t *
+decompress_record(const uint8_t *buf, size_t buf_sz, uint32_t orig_sz)
+{
+	uint8_t *decomp_buf = cf_malloc(orig_sz);
+
+	if (! decomp_buf) {
+		return NULL;
+	}
+
+	uLongf decomp_sz = orig_sz;
+
+	if (uncompress(decomp_buf, &decomp_sz, buf, buf_sz) != Z_OK ||
+			decomp_sz != orig_sz) {
+		cf_free(decomp_buf);
+		return NULL;
+	}
+
+	return decomp_buf;
+}
+
+
 //==========================================================
 // Local helpers - info API helpers.
 //
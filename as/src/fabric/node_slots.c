@@ -0,0 +1,193 @@
+/*
+ * node_slots.c
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/* SYNOPSIS
+ * Per-node slot tables, for modules that keep state per destination node -
+ * e.g. batch buffers for proxies and replica writes, and async replication
+ * logs. Lookups don't lock - only adding a node's slot takes the table lock.
+ *
+ * Slots are never freed. Once every slot is in use, a new node takes over the
+ * slot of a node that has left the cluster, if the slot's owner agrees it
+ * holds nothing - so node id churn can't exhaust the table for good.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "fabric/node_slots.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "citrusleaf/cf_atomic.h"
+
+#include "util.h"
+
+#include "fabric/fabric.h"
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static as_node_slot* reclaim_slot(as_node_slots* t, cf_node node);
+
+
+//==========================================================
+// Public API.
+//
+
+// For tables that can't use AS_NODE_SLOTS_INIT.
+void
+as_node_slots_init(as_node_slots* t, void* slots, size_t slot_sz,
+		uint32_t max_slots, as_node_slot_reclaim_fn reclaim_fn)
+{
+	t->slots = (uint8_t*)slots;
+	t->slot_sz = slot_sz;
+	t->max_slots = max_slots;
+	t->n_slots = 0;
+	pthread_mutex_init(&t->lock, NULL);
+	t->reclaim_fn = reclaim_fn;
+}
+
+
+// Returns the node's slot, or NULL if it has none.
+void*
+as_node_slots_find(as_node_slots* t, cf_node node)
+{
+	uint32_t n_slots = as_node_slots_count(t);
+
+	for (uint32_t i = 0; i < n_slots; i++) {
+		as_node_slot* slot = as_node_slots_at(t, i);
+
+		if (slot->node == node) {
+			return slot;
+		}
+	}
+
+	return NULL;
+}
+
+
+// Returns the node's slot, adding it if needed, or NULL if the table is full
+// and no slot can be reclaimed.
+void*
+as_node_slots_get(as_node_slots* t, cf_node node)
+{
+	as_node_slot* slot = as_node_slots_find(t, node);
+
+	if (slot) {
+		return slot;
+	}
+
+	pthread_mutex_lock(&t->lock);
+
+	// Another thread may have added this node's slot meanwhile.
+	if ((slot = as_node_slots_find(t, node)) != NULL) {
+		pthread_mutex_unlock(&t->lock);
+		return slot;
+	}
+
+	if (t->n_slots == t->max_slots) {
+		slot = reclaim_slot(t, node);
+		pthread_mutex_unlock(&t->lock);
+		return slot;
+	}
+
+	slot = as_node_slots_at(t, t->n_slots);
+
+	memset(slot, 0, t->slot_sz);
+	slot->node = node;
+	pthread_mutex_init(&slot->lock, NULL);
+
+	// Publish the slot only once it's initialized.
+	CF_MEMORY_BARRIER_WRITE();
+	cf_atomic32_incr(&t->n_slots);
+
+	pthread_mutex_unlock(&t->lock);
+
+	return slot;
+}
+
+
+// Returns the node's slot locked, adding it first if create is set, or NULL if
+// there's no slot for the node.
+void*
+as_node_slots_lock(as_node_slots* t, cf_node node, bool create)
+{
+	while (true) {
+		as_node_slot* slot = create ?
+				as_node_slots_get(t, node) : as_node_slots_find(t, node);
+
+		if (! slot) {
+			return NULL;
+		}
+
+		pthread_mutex_lock(&slot->lock);
+
+		// The slot may have been reassigned since it was found.
+		if (slot->node == node) {
+			return slot;
+		}
+
+		pthread_mutex_unlock(&slot->lock);
+	}
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+// Call under the table lock.
+static as_node_slot*
+reclaim_slot(as_node_slots* t, cf_node node)
+{
+	if (! t->reclaim_fn) {
+		return NULL;
+	}
+
+	for (uint32_t i = 0; i < t->n_slots; i++) {
+		as_node_slot* slot = as_node_slots_at(t, i);
+		uint64_t lasttime;
+
+		if (as_fabric_get_node_lasttime(slot->node, &lasttime) == 0) {
+			continue; // node still in the cluster
+		}
+
+		pthread_mutex_lock(&slot->lock);
+
+		if (t->reclaim_fn(slot)) {
+			slot->node = node;
+			pthread_mutex_unlock(&slot->lock);
+			return slot;
+		}
+
+		pthread_mutex_unlock(&slot->lock);
+	}
+
+	return NULL;
+}
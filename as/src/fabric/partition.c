@@ -42,10 +42,14 @@
 #include "base/cfg.h"
 #include "base/cluster_config.h"
 #include "base/datamodel.h"
+#include "base/expire_index.h"
+#include "base/incr_hist.h"
 #include "base/index.h"
 #include "base/ldt.h"
+#include "base/set_index.h"
 #include "fabric/fabric.h"
 #include "fabric/migrate.h"
+#include "fabric/partition_changelog.h"
 #include "fabric/paxos.h"
 #include "storage/storage.h"
 #include "transaction/replica_write.h"
@@ -72,6 +76,39 @@ static volatile int g_multi_node = false;
 static volatile int g_balance_init = BALANCE_INIT_UNRESOLVED;
 
 
+// Lock-free reservations. Everything that takes the partition lock makes the
+// state version odd while it holds it - a lock-free reservation fails over to
+// the lock if the version is odd, or changes while the reservation copies the
+// partition's state. Tree references are dropped only once no lock-free
+// reservations are in flight, so none can reserve a tree being destroyed.
+
+static inline void
+partition_lock(as_partition *p)
+{
+	pthread_mutex_lock(&p->lock);
+	cf_atomic32_incr(&p->state_version);
+}
+
+static inline void
+partition_unlock(as_partition *p)
+{
+	cf_atomic32_incr(&p->state_version);
+	pthread_mutex_unlock(&p->lock);
+}
+
+// Call within partition lock, after swapping a tree pointer and before
+// releasing the old tree.
+static inline void
+wait_for_fast_reservations(as_partition *p)
+{
+	__sync_synchronize();
+
+	while (cf_atomic32_get(p->n_fast_reservations) != 0) {
+		__asm__ __volatile__ ("pause" ::: "memory");
+	}
+}
+
+
 // Return number of partitions found in storage.
 int
 as_partition_get_state_from_storage(as_namespace *ns, bool *partition_states)
@@ -152,6 +189,30 @@ is_partition_null(as_partition_vinfo *new_vinfo)
 }
 
 
+// True if vinfo is ancestor, or was derived from it by split-reforms - i.e. a
+// node with version ancestor has all data older than it left with.
+bool
+as_partition_vinfo_is_ancestor(const as_partition_vinfo *ancestor,
+		const as_partition_vinfo *vinfo)
+{
+	if (ancestor->iid == 0 || ancestor->iid != vinfo->iid) {
+		return false;
+	}
+
+	for (int i = 0; i < AS_PARTITION_MAX_VERSION; i++) {
+		if (ancestor->vtp[i] == 0) {
+			return true;
+		}
+
+		if (ancestor->vtp[i] != vinfo->vtp[i]) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
 bool
 increase_partition_version_tree_path(as_partition_vinfo *vinfo, cf_node fsn, cf_node *old_sl, const char* n, size_t pid)
 {
@@ -272,6 +333,9 @@ as_partition_reinit(as_partition *p, as_namespace *ns, int pid)
 
 	p->cluster_key = 0;
 
+	p->max_last_update_time = 0;
+	p->max_last_update_time_valid = true;
+
 	as_index_tree *t = p->vp;
 
 	// First initialization is the only time there's a null tree pointer.
@@ -281,9 +345,9 @@ as_partition_reinit(as_partition *p, as_namespace *ns, int pid)
 					pid);
 		}
 
-		p->vp = as_index_tree_resume(ns->arena,
+		p->vp = as_index_tree_resume(ns->arena, ns->tree_sprigs,
 				(as_index_value_destructor)&as_record_destroy, ns,
-				&ns->tree_roots[pid]);
+				&ns->tree_roots[pid * ns->tree_sprigs]);
 
 		// There's no going back to cold start now - do so the harsh way.
 		if (! p->vp) {
@@ -292,12 +356,13 @@ as_partition_reinit(as_partition *p, as_namespace *ns, int pid)
 		}
 	}
 	else {
-		p->vp = as_index_tree_create(ns->arena,
+		p->vp = as_index_tree_create(ns->arena, ns->tree_sprigs,
 				(as_index_value_destructor)&as_record_destroy, ns,
-				ns->tree_roots ? &ns->tree_roots[pid] : NULL);
+				ns->tree_roots ? &ns->tree_roots[pid * ns->tree_sprigs] : NULL);
 	}
 
 	if (t) {
+		wait_for_fast_reservations(p);
 		as_index_tree_release(t, ns);
 	}
 
@@ -310,9 +375,9 @@ as_partition_reinit(as_partition *p, as_namespace *ns, int pid)
 					ns->name, pid);
 		}
 
-		p->sub_vp = as_index_tree_resume(ns->arena,
+		p->sub_vp = as_index_tree_resume(ns->arena, ns->tree_sprigs,
 				(as_index_value_destructor)&as_record_destroy, ns,
-				&ns->sub_tree_roots[pid]);
+				&ns->sub_tree_roots[pid * ns->tree_sprigs]);
 
 		// There's no going back to cold start now - do so the harsh way.
 		if (! p->sub_vp) {
@@ -321,12 +386,13 @@ as_partition_reinit(as_partition *p, as_namespace *ns, int pid)
 		}
 	}
 	else {
-		p->sub_vp = as_index_tree_create(ns->arena,
+		p->sub_vp = as_index_tree_create(ns->arena, ns->tree_sprigs,
 				(as_index_value_destructor)&as_record_destroy, ns,
-				ns->sub_tree_roots ? &ns->sub_tree_roots[pid] : NULL);
+				ns->sub_tree_roots ? &ns->sub_tree_roots[pid * ns->tree_sprigs] : NULL);
 	}
 
 	if (sub_t) {
+		wait_for_fast_reservations(p);
 		as_index_tree_release(sub_t, ns);
 	}
 }
@@ -343,16 +409,32 @@ set_partition_desync_lockfree(as_partition *p, as_partition_vinfo *vinfo,
 
 	as_index_tree *t = p->vp;
 
-	p->vp = as_index_tree_create(ns->arena,
+	p->vp = as_index_tree_create(ns->arena, ns->tree_sprigs,
 			(as_index_value_destructor)&as_record_destroy, ns,
-			ns->tree_roots ? &ns->tree_roots[pid] : NULL);
+			ns->tree_roots ? &ns->tree_roots[pid * ns->tree_sprigs] : NULL);
+	wait_for_fast_reservations(p);
 	as_index_tree_release(t, ns);
 
+	p->max_last_update_time = 0;
+
+	if (p->expire_index) {
+		as_expire_index_clear(p->expire_index);
+	}
+
+	if (p->set_index) {
+		as_set_index_clear(p->set_index, true);
+	}
+
+	if (p->changelog) {
+		as_partition_changelog_clear(p->changelog);
+	}
+
 	as_index_tree *sub_t = p->sub_vp;
 
-	p->sub_vp = as_index_tree_create(ns->arena,
+	p->sub_vp = as_index_tree_create(ns->arena, ns->tree_sprigs,
 			(as_index_value_destructor)&as_record_destroy, ns,
-			ns->sub_tree_roots ? &ns->sub_tree_roots[pid] : NULL);
+			ns->sub_tree_roots ? &ns->sub_tree_roots[pid * ns->tree_sprigs] : NULL);
+	wait_for_fast_reservations(p);
 	as_index_tree_release(sub_t, ns);
 
 	clear_partition_version_in_storage(ns, pid, flush);
@@ -368,20 +450,34 @@ set_partition_absent_lockfree(as_partition *p, as_partition_vinfo *vinfo, as_nam
 {
 	as_index_tree *t = p->vp;
 
-	p->vp = as_index_tree_create(ns->arena, (as_index_value_destructor)&as_record_destroy, ns, ns->tree_roots ? &ns->tree_roots[pid] : NULL);
+	p->vp = as_index_tree_create(ns->arena, ns->tree_sprigs, (as_index_value_destructor)&as_record_destroy, ns, ns->tree_roots ? &ns->tree_roots[pid * ns->tree_sprigs] : NULL);
 	// A Change:  Set the State BEFORE the tree release, just in case that
 	// is opening too large of a time window.
 	p->state = AS_PARTITION_STATE_ABSENT; // Move the state setting ABOVE the tree release.
 
 	if (t) {
+		wait_for_fast_reservations(p);
 		as_index_tree_release(t, ns);
 	}
 
+	if (p->expire_index) {
+		as_expire_index_clear(p->expire_index);
+	}
+
+	if (p->set_index) {
+		as_set_index_clear(p->set_index, true);
+	}
+
+	if (p->changelog) {
+		as_partition_changelog_clear(p->changelog);
+	}
+
 	as_index_tree *sub_t = p->sub_vp;
 
-	p->sub_vp = as_index_tree_create(ns->arena, (as_index_value_destructor)&as_record_destroy, ns, ns->sub_tree_roots ? &ns->sub_tree_roots[pid] : NULL);
+	p->sub_vp = as_index_tree_create(ns->arena, ns->tree_sprigs, (as_index_value_destructor)&as_record_destroy, ns, ns->sub_tree_roots ? &ns->sub_tree_roots[pid * ns->tree_sprigs] : NULL);
 
 	if (sub_t) {
+		wait_for_fast_reservations(p);
 		as_index_tree_release(sub_t, ns);
 	}
 
@@ -427,6 +523,13 @@ as_partition_init(as_partition *p, as_namespace *ns, int pid)
 
 	p->vp = NULL;
 	p->sub_vp = NULL;
+	p->expire_index = ns->expiration_index ? as_expire_index_create() : NULL;
+	p->set_index = ns->set_index ? as_set_index_create() : NULL;
+	p->incr_hist = ns->incremental_histograms ? as_incr_hist_create(ns) : NULL;
+	p->state_version = 0;
+	p->n_fast_reservations = 0;
+	p->changelog = ns->migrate_changelog_entries != 0 ?
+			as_partition_changelog_create(ns) : NULL;
 	as_partition_reinit(p, ns, pid);
 }
 
@@ -513,9 +616,11 @@ as_partition_health_check(as_namespace *ns, size_t pid, as_partition *p,
 static cf_atomic32 g_partition_check_counter = 0;
 
 
-// Find best node to handle read/write. Called within partition lock.
+// Find best node to handle read/write. Called within partition lock, or
+// lock-free by reservations that validate the partition's state version after.
 static cf_node
-find_sync_copy(as_namespace *ns, size_t pid, as_partition *p, bool is_read)
+find_sync_copy(as_namespace *ns, size_t pid, as_partition *p, bool is_read,
+		bool prefer_rack, bool lockfree)
 {
 	cf_assert(ns, AS_PARTITION, CF_CRITICAL, "invalid namespace");
 	cf_assert((pid < AS_PARTITIONS), AS_PARTITION, CF_CRITICAL,
@@ -528,7 +633,8 @@ find_sync_copy(as_namespace *ns, size_t pid, as_partition *p, bool is_read)
 	int my_index = find_in_replica_list(p, self);
 
 	// Do health check occasionally (expensive to do for every read/write).
-	if ((cf_atomic32_incr(&g_partition_check_counter) & 0x0FFF) == 0) {
+	if (! lockfree &&
+			(cf_atomic32_incr(&g_partition_check_counter) & 0x0FFF) == 0) {
 		as_partition_health_check(ns, pid, p, my_index);
 	}
 
@@ -541,6 +647,8 @@ find_sync_copy(as_namespace *ns, size_t pid, as_partition *p, bool is_read)
 	//		- node is (eventual) master and desync
 	// Return this node if:
 	//		- it's a read, node is replica, and has no origin
+	//		- for prefer-rack reads, the replica must also be sync and not
+	//		  migrating at all, else the read goes to the master
 	// Otherwise, return (eventual) master.
 
 	bool is_sync    = (p->state == AS_PARTITION_STATE_SYNC);
@@ -555,14 +663,16 @@ find_sync_copy(as_namespace *ns, size_t pid, as_partition *p, bool is_read)
 	else if (is_master && is_desync) {
 		n = p->origin;
 	}
-	else if (is_read && is_replica && p->origin == (cf_node)0) {
+	else if (is_read && is_replica && p->origin == (cf_node)0 &&
+			(! prefer_rack || (is_sync && p->pending_migrate_tx == 0 &&
+					p->pending_migrate_rx == 0))) {
 		n = self;
 	}
 	else {
 		n = p->replica[0];
 	}
 
-	if (n == 0 && as_partition_balance_is_init_resolved()) {
+	if (n == 0 && ! lockfree && as_partition_balance_is_init_resolved()) {
 		cf_warning(AS_PARTITION, "{%s:%zu} Returning null node, could not find sync copy of this partition my_index %d, master %"PRIx64" replica %"PRIx64" origin %"PRIx64,
 				ns->name, pid, my_index, p->replica[0], p->replica[1], p->origin);
 	}
@@ -581,11 +691,11 @@ as_partition_proxyee_redirect(as_namespace *ns, as_partition_id pid)
 	as_partition* p = &ns->partitions[pid];
 	cf_node self = g_config.self_node;
 
-	pthread_mutex_lock(&p->lock);
+	partition_lock(p);
 	bool is_master = (0 == find_in_replica_list(p, self));
 	bool is_desync = (p->state == AS_PARTITION_STATE_DESYNC);
 	cf_node eventual = p->origin;
-	pthread_mutex_unlock(&p->lock);
+	partition_unlock(p);
 
 	return is_master && is_desync ? eventual : (cf_node)0;
 }
@@ -610,6 +720,80 @@ as_partition_reservation_copy(as_partition_reservation *dst, as_partition_reserv
 }
 
 
+// Lock-free version of the below - returns false if a state transition is in
+// progress or happened meanwhile, in which case the caller must take the lock.
+static bool
+reserve_read_write_lockfree(as_namespace *ns, as_partition_id pid,
+		as_partition *p, as_partition_reservation *rsv, cf_node *node,
+		bool is_read, bool prefer_rack, uint64_t *cluster_key, int *rv)
+{
+	cf_atomic32_incr(&p->n_fast_reservations); // full barrier
+
+	uint32_t version = cf_atomic32_get(p->state_version);
+
+	if ((version & 1) != 0) {
+		cf_atomic32_decr(&p->n_fast_reservations);
+		return false;
+	}
+
+	uint64_t ck = p->cluster_key;
+	cf_node n = find_sync_copy(ns, pid, p, is_read, prefer_rack, true);
+	as_partition_state state = p->state;
+	bool reserved = false;
+
+	if (n == g_config.self_node && (AS_PARTITION_STATE_SYNC == state
+			|| AS_PARTITION_STATE_ZOMBIE == state)) {
+		rsv->ns = ns;
+		rsv->is_write = is_read ? false : true;
+		rsv->pid = pid;
+		rsv->p = p;
+
+		// No tree can be destroyed while we're counted as in flight.
+		rsv->tree = p->vp;
+		cf_rc_reserve(rsv->tree);
+		rsv->sub_tree = p->sub_vp;
+		cf_rc_reserve(rsv->sub_tree);
+
+		rsv->state = state;
+
+		rsv->n_dupl = p->n_dupl;
+		memcpy(rsv->dupl_nodes, p->dupl_nodes, sizeof(cf_node) * rsv->n_dupl);
+
+		rsv->cluster_key = ck;
+		memcpy(&rsv->vinfo, &p->version_info, sizeof(as_partition_vinfo));
+
+		reserved = true;
+	}
+
+	cf_atomic32_decr(&p->n_fast_reservations); // full barrier
+
+	if (cf_atomic32_get(p->state_version) != version) {
+		if (reserved) {
+			as_index_tree_release(rsv->tree, ns);
+			as_index_tree_release(rsv->sub_tree, ns);
+		}
+
+		return false;
+	}
+
+	if (! reserved && n == g_config.self_node) {
+		memset(rsv, 0, sizeof(*rsv)); // safety - as below
+	}
+
+	if (node) {
+		*node = n;
+	}
+
+	if (cluster_key) {
+		*cluster_key = ck;
+	}
+
+	*rv = reserved ? 0 : -1;
+
+	return true;
+}
+
+
 // Obtain a write reservation on a partition, or get the address of a
 // node who can.
 // On success, the provided as_partition_reservation * is filled in with the appropriate
@@ -620,7 +804,7 @@ as_partition_reservation_copy(as_partition_reservation *dst, as_partition_reserv
 int
 as_partition_reserve_read_write(as_namespace *ns, as_partition_id pid,
 		as_partition_reservation *rsv, cf_node *node,
-		bool is_read, uint64_t *cluster_key)
+		bool is_read, bool prefer_rack, uint64_t *cluster_key)
 {
 	cf_assert(ns, AS_PARTITION, CF_CRITICAL, "invalid namespace");
 	cf_assert(rsv, AS_PARTITION, CF_CRITICAL, "invalid reservation");
@@ -630,10 +814,15 @@ as_partition_reserve_read_write(as_namespace *ns, as_partition_id pid,
 	int rv = -1;
 	as_partition *p = &ns->partitions[pid];
 
-	pthread_mutex_lock(&p->lock);
+	if (reserve_read_write_lockfree(ns, pid, p, rsv, node, is_read, prefer_rack,
+			cluster_key, &rv)) {
+		return rv;
+	}
+
+	partition_lock(p);
 
 	uint64_t ck = p->cluster_key;
-	cf_node n = find_sync_copy(ns, pid, p, is_read);
+	cf_node n = find_sync_copy(ns, pid, p, is_read, prefer_rack, false);
 
 	// If we're aren't writeable, return.
 	if (n != g_config.self_node) {
@@ -671,7 +860,7 @@ as_partition_reserve_read_write(as_namespace *ns, as_partition_id pid,
 	}
 
 finish:
-	pthread_mutex_unlock(&p->lock);
+	partition_unlock(p);
 
 	if (node) {
 		*node = n;
@@ -766,11 +955,11 @@ as_partition_reserve_migrate(as_namespace *ns, as_partition_id pid, as_partition
 
 	as_partition *p = &ns->partitions[pid];
 
-	pthread_mutex_lock(&p->lock);
+	partition_lock(p);
 
 	as_partition_reserve_lockfree(ns, pid, rsv);
 
-	pthread_mutex_unlock(&p->lock);
+	partition_unlock(p);
 
 	if (node) {
 		*node = g_config.self_node;
@@ -818,7 +1007,7 @@ int
 as_partition_reserve_write(as_namespace *ns, as_partition_id pid,
 		as_partition_reservation *rsv, cf_node *node, uint64_t *cluster_key)
 {
-	return as_partition_reserve_read_write(ns, pid, rsv, node, false,
+	return as_partition_reserve_read_write(ns, pid, rsv, node, false, false,
 			cluster_key);
 }
 
@@ -830,7 +1019,19 @@ int
 as_partition_reserve_read(as_namespace *ns, as_partition_id pid,
 		as_partition_reservation *rsv, cf_node *node, uint64_t *cluster_key)
 {
-	return as_partition_reserve_read_write(ns, pid, rsv, node, true,
+	return as_partition_reserve_read_write(ns, pid, rsv, node, true, false,
+			cluster_key);
+}
+
+
+// Reserve a partition for a read the client sent to a replica in its own rack.
+// Same as as_partition_reserve_read(), except that a prole only takes the read
+// if it's sync and not migrating - otherwise the node is the master.
+int
+as_partition_reserve_read_prefer_rack(as_namespace *ns, as_partition_id pid,
+		as_partition_reservation *rsv, cf_node *node, uint64_t *cluster_key)
+{
+	return as_partition_reserve_read_write(ns, pid, rsv, node, true, true,
 			cluster_key);
 }
 
@@ -899,13 +1100,10 @@ as_partition_release(as_partition_reservation *rsv)
 	cf_assert(rsv->p, AS_PARTITION, CF_CRITICAL, "invalid reservation partition");
 	cf_assert(rsv->tree, AS_PARTITION, CF_CRITICAL, "invalid reservation tree");
 
-	pthread_mutex_lock(&rsv->p->lock);
-
+	// Tree references are atomic - no need for the partition lock.
 	as_index_tree_release(rsv->tree, rsv->ns);
 	as_index_tree_release(rsv->sub_tree, rsv->ns);
 
-	pthread_mutex_unlock(&rsv->p->lock);
-
 	// safety
 	rsv->tree = 0;
 	rsv->sub_tree = 0;
@@ -927,11 +1125,11 @@ as_partition_getreplica_read(as_namespace *ns, as_partition_id pid)
 
 	as_partition *p = &ns->partitions[pid];
 
-	pthread_mutex_lock(&p->lock);
+	partition_lock(p);
 
-	cf_node n = find_sync_copy(ns, pid, p, true);
+	cf_node n = find_sync_copy(ns, pid, p, true, false, false);
 
-	pthread_mutex_unlock(&p->lock);
+	partition_unlock(p);
 
 	return n;
 }
@@ -948,10 +1146,10 @@ as_partition_getreplica_prole(as_namespace *ns, as_partition_id pid)
 
 	as_partition *p = &ns->partitions[pid];
 
-	pthread_mutex_lock(&p->lock);
+	partition_lock(p);
 
 	// Check is this is a master node.
-	cf_node n = find_sync_copy(ns, pid, p, false);
+	cf_node n = find_sync_copy(ns, pid, p, false, false, false);
 
 	if (n == g_config.self_node) {
 		// It's a master, return 0.
@@ -959,10 +1157,10 @@ as_partition_getreplica_prole(as_namespace *ns, as_partition_id pid)
 	}
 	else {
 		// Not a master, see if it's a prole.
-		n = find_sync_copy(ns, pid, p, true);
+		n = find_sync_copy(ns, pid, p, true, false, false);
 	}
 
-	pthread_mutex_unlock(&p->lock);
+	partition_unlock(p);
 
 	return n;
 }
@@ -980,7 +1178,7 @@ as_partition_getreplica_readall(as_namespace *ns, as_partition_id pid, cf_node *
 	cf_assert(ns, AS_PARTITION, CF_CRITICAL, "invalid namespace");
 	p = &ns->partitions[pid];
 
-	pthread_mutex_lock(&p->lock);
+	partition_lock(p);
 
 	for (int i = 0; i < g_config.paxos_max_cluster_size; i++) {
 		// Break at the end of the list.
@@ -997,7 +1195,7 @@ as_partition_getreplica_readall(as_namespace *ns, as_partition_id pid, cf_node *
 		nv[c++] = p->replica[i];
 	}
 
-	pthread_mutex_unlock(&p->lock);
+	partition_unlock(p);
 
 	return c;
 }
@@ -1012,11 +1210,11 @@ as_partition_getreplica_write(as_namespace *ns, as_partition_id pid)
 
 	as_partition *p = &ns->partitions[pid];
 
-	pthread_mutex_lock(&p->lock);
+	partition_lock(p);
 
-	cf_node n = find_sync_copy(ns, pid, p, false);
+	cf_node n = find_sync_copy(ns, pid, p, false, false, false);
 
-	pthread_mutex_unlock(&p->lock);
+	partition_unlock(p);
 
 	return n;
 }
@@ -1211,8 +1409,10 @@ as_partition_getreplica_prole_str(cf_dyn_buf *db)
 }
 
 
+// With include_rack, each namespace's entry also carries this node's rack-id:
+// name:rack-id:n_repl,map,map... - clients use it to pick replicas to read.
 void
-as_partition_get_replicas_all_str(cf_dyn_buf *db)
+as_partition_get_replicas_all_str(cf_dyn_buf *db, bool include_rack)
 {
 	size_t db_sz = db->used_sz;
 
@@ -1222,6 +1422,11 @@ as_partition_get_replicas_all_str(cf_dyn_buf *db)
 		cf_dyn_buf_append_string(db, ns->name);
 		cf_dyn_buf_append_char(db, ':');
 
+		if (include_rack) {
+			cf_dyn_buf_append_uint32(db, g_config.rack_id);
+			cf_dyn_buf_append_char(db, ':');
+		}
+
 		int n_repl = (int)ns->replication_factor;
 
 		cf_dyn_buf_append_int(db, n_repl);
@@ -1278,7 +1483,7 @@ as_partition_getinfo_str(cf_dyn_buf *db)
 		for (uint j = 0 ; j < AS_PARTITIONS ; j++) {
 			as_partition *p = &ns->partitions[j];
 
-			pthread_mutex_lock(&p->lock);
+			partition_lock(p);
 
 			char state_c = as_partition_getstate_str(p->state);
 
@@ -1313,9 +1518,9 @@ as_partition_getinfo_str(cf_dyn_buf *db)
 			cf_dyn_buf_append_char(db, ':');
 			cf_dyn_buf_append_uint64_x(db, p->pending_migrate_rx);
 			cf_dyn_buf_append_char(db, ':');
-			cf_dyn_buf_append_uint64(db, (uint64_t) p->vp->elements);
+			cf_dyn_buf_append_uint64(db, (uint64_t) as_index_tree_size(p->vp));
 			cf_dyn_buf_append_char(db, ':');
-			cf_dyn_buf_append_uint64(db, (uint64_t) p->sub_vp->elements);
+			cf_dyn_buf_append_uint64(db, (uint64_t) as_index_tree_size(p->sub_vp));
 			cf_dyn_buf_append_char(db, ':');
 			cf_dyn_buf_append_uint64(db, p->current_outgoing_ldt_version);
 			cf_dyn_buf_append_char(db, ':');
@@ -1326,7 +1531,7 @@ as_partition_getinfo_str(cf_dyn_buf *db)
 			cf_dyn_buf_append_uint64(db, p->version_info.vtp[8]);
 			cf_dyn_buf_append_char(db, ';');
 
-			pthread_mutex_unlock(&p->lock);
+			partition_unlock(p);
 		}
 	}
 
@@ -1382,18 +1587,18 @@ as_partition_get_master_prole_stats(as_namespace* ns,
 	for (int pid = 0; pid < AS_PARTITIONS; pid++) {
 		as_partition *p = &ns->partitions[pid];
 
-		pthread_mutex_lock(&p->lock);
+		partition_lock(p);
 
 		int my_index = find_in_replica_list(p, self); // -1 if node is not found
 		bool am_master = (my_index == 0 && p->state == AS_PARTITION_STATE_SYNC) || p->target != 0;
 
 		if (am_master) {
-			p_stats->n_master_records += p->vp->elements;
-			p_stats->n_master_sub_records += p->sub_vp->elements;
+			p_stats->n_master_records += as_index_tree_size(p->vp);
+			p_stats->n_master_sub_records += as_index_tree_size(p->sub_vp);
 		}
 		else if (my_index > 0 && p->origin == 0) {
-			p_stats->n_prole_records += p->vp->elements;
-			p_stats->n_prole_sub_records += p->sub_vp->elements;
+			p_stats->n_prole_records += as_index_tree_size(p->vp);
+			p_stats->n_prole_sub_records += as_index_tree_size(p->sub_vp);
 		}
 #ifdef PARTITION_INFO_CHECK
 		// else we don't own a copy of this partition...  but maybe we need
@@ -1403,7 +1608,7 @@ as_partition_get_master_prole_stats(as_namespace* ns,
 			int tree_rc = 0;
 
 			if (p->vp) {
-				pcnt = p->vp->elements;
+				pcnt = as_index_tree_size(p->vp);
 				tree_rc = cf_rc_count(p->vp);
 			}
 
@@ -1425,7 +1630,7 @@ as_partition_get_master_prole_stats(as_namespace* ns,
 		}
 #endif
 
-		pthread_mutex_unlock(&p->lock);
+		partition_unlock(p);
 	}
 }
 
@@ -1471,10 +1676,10 @@ as_partition_emigrate_done(as_migrate_state s, as_namespace *ns,
 	bool migration_request = (tx_flags & TX_FLAGS_REQUEST) != 0;
 	as_partition *p = &ns->partitions[pid];
 
-	pthread_mutex_lock(&p->lock);
+	partition_lock(p);
 
 	if (orig_cluster_key != as_paxos_get_cluster_key()) {
-		pthread_mutex_unlock(&p->lock);
+		partition_unlock(p);
 		return;
 	}
 
@@ -1492,7 +1697,7 @@ as_partition_emigrate_done(as_migrate_state s, as_namespace *ns,
 	if (p->pending_migrate_tx == 0) {
 		cf_warning(AS_PARTITION, "{%s:%d} concurrency event - paxos reconfiguration occurred during migrate_tx?",
 				ns->name, pid);
-		pthread_mutex_unlock(&p->lock);
+		partition_unlock(p);
 		return;
 	}
 
@@ -1518,12 +1723,38 @@ as_partition_emigrate_done(as_migrate_state s, as_namespace *ns,
 		cf_atomic32_incr(&g_partition_generation);
 	}
 
-	pthread_mutex_unlock(&p->lock);
+	partition_unlock(p);
 
 	return;
 }
 
 
+// For delta migration - if this partition is complete, gets its version and
+// the maximum last-update-time of its records. Call before immigration starts.
+bool
+as_partition_get_delta_info(as_namespace *ns, as_partition_id pid,
+		as_partition_vinfo *vinfo, uint64_t *max_lut)
+{
+	as_partition *p = &ns->partitions[pid];
+
+	partition_lock(p);
+
+	bool ok = p->state == AS_PARTITION_STATE_SYNC &&
+			p->max_last_update_time_valid &&
+			! is_partition_null(&p->version_info) &&
+			as_index_tree_size(p->vp) != 0;
+
+	if (ok) {
+		*vinfo = p->version_info;
+		*max_lut = (uint64_t)cf_atomic_int_get(p->max_last_update_time);
+	}
+
+	partition_unlock(p);
+
+	return ok;
+}
+
+
 as_migrate_result
 as_partition_immigrate_start(as_namespace *ns, as_partition_id pid,
 		uint64_t orig_cluster_key, uint32_t start_type, cf_node source_node)
@@ -1534,10 +1765,10 @@ as_partition_immigrate_start(as_namespace *ns, as_partition_id pid,
 
 	as_partition *p = &ns->partitions[pid];
 
-	pthread_mutex_lock(&p->lock);
+	partition_lock(p);
 
 	if (orig_cluster_key != as_paxos_get_cluster_key()) {
-		pthread_mutex_unlock(&p->lock);
+		partition_unlock(p);
 		return AS_MIGRATE_AGAIN;
 	}
 
@@ -1545,7 +1776,7 @@ as_partition_immigrate_start(as_namespace *ns, as_partition_id pid,
 
 	if (num_incoming > g_config.migrate_max_num_incoming) {
 		cf_atomic_int_decr(&g_migrate_num_incoming);
-		pthread_mutex_unlock(&p->lock);
+		partition_unlock(p);
 		return AS_MIGRATE_AGAIN;
 	}
 
@@ -1684,12 +1915,24 @@ as_partition_immigrate_start(as_namespace *ns, as_partition_id pid,
 		// Migration has been rejected, incoming migration not expected.
 		cf_atomic_int_decr(&g_migrate_num_incoming);
 	}
+	else {
+		if (p->state == AS_PARTITION_STATE_DESYNC) {
+			// Until the immigration completes, the tree may hold newer records
+			// without older ones.
+			p->max_last_update_time_valid = false;
+		}
+
+		// Immigrated records aren't listed in the changelog.
+		if (p->changelog) {
+			as_partition_changelog_clear(p->changelog);
+		}
+	}
 
 	if (client_replica_maps_update(ns, pid)) {
 		cf_atomic32_incr(&g_partition_generation);
 	}
 
-	pthread_mutex_unlock(&p->lock);
+	partition_unlock(p);
 
 	partition_migrate_record pmr;
 
@@ -1713,15 +1956,15 @@ as_partition_immigrate_done(as_namespace *ns, as_partition_id pid,
 
 	as_partition *p = &ns->partitions[pid];
 
-	pthread_mutex_lock(&p->lock);
+	partition_lock(p);
 
 	if (orig_cluster_key != as_paxos_get_cluster_key()) {
-		pthread_mutex_unlock(&p->lock);
+		partition_unlock(p);
 		return AS_MIGRATE_FAIL;
 	}
 
 	if (p->pending_migrate_rx == 0) {
-		pthread_mutex_unlock(&p->lock);
+		partition_unlock(p);
 		cf_warning(AS_PARTITION, "{%s:%d} immigrate_done concurrency event - paxos reconfiguration occurred during migrate_done?",
 				ns->name, pid);
 		return AS_MIGRATE_FAIL;
@@ -1763,6 +2006,7 @@ as_partition_immigrate_done(as_namespace *ns, as_partition_id pid,
 		p->origin = 0;
 
 		set_partition_sync_lockfree(p, pid, ns, true);
+		p->max_last_update_time_valid = true;
 
 		// If this is not the eventual master, we are done.
 		if (g_config.self_node != p->replica[0]) {
@@ -1884,7 +2128,7 @@ as_partition_immigrate_done(as_namespace *ns, as_partition_id pid,
 		cf_atomic32_incr(&g_partition_generation);
 	}
 
-	pthread_mutex_unlock(&p->lock);
+	partition_unlock(p);
 
 	partition_migrate_record pmr;
 
@@ -2080,6 +2324,680 @@ as_migrate_increment_all_tx_fail() {
 }
 
 
+// The HV rows as hashed and sorted by the last balance - before conversion to
+// nodes and rack-aware adjustment. When the succession list only gains or
+// loses one node, rows are updated from these instead of being rebuilt.
+static uint64_t *g_hv_cache = NULL;
+static cf_node g_hv_cache_succession[AS_CLUSTER_SZ];
+static size_t g_hv_cache_cluster_size = 0;
+
+typedef struct balance_ctx_s {
+	const cf_node *succession;
+	size_t cluster_size;
+	cf_node self;
+	cf_node *hv_ptr;
+	int *hv_slindex_ptr;
+
+	// For updating cached HV rows.
+	bool incremental;
+	int added_index; // -1 if no node was added
+	int remap[AS_CLUSTER_SZ]; // old succession list index to new, -1 if gone
+
+	as_partition_vinfo new_version_for_lost_partitions;
+	uint64_t orig_cluster_key;
+	cf_queue *mq;
+} balance_ctx;
+
+typedef struct balance_worker_s {
+	const balance_ctx *ctx;
+	cf_atomic32 *p_next_pid;
+
+	size_t n_lost;
+	size_t n_unique;
+	size_t n_recreate;
+	size_t n_duplicate;
+	int n_new_versions;
+
+	int ns_pending_migrate_rx[AS_NAMESPACE_SZ];
+	int ns_pending_migrate_tx[AS_NAMESPACE_SZ];
+	int ns_pending_migrate_tx_later[AS_NAMESPACE_SZ];
+} balance_worker;
+
+static void balance_partition(balance_worker *w, int i, int j);
+
+
+// Compute the hash value for a (node, partition) tuple. We separately compute
+// the FNV-1a hash of each fragment of the tuple, then hash them together with a
+// One-at-a-time hash; this method seems to give fairly good distribution. We
+// then stash the node's succession list index in the last few bits.
+static inline uint64_t
+balance_hash(int pid, cf_node node, int index)
+{
+	struct hashbuf {
+		uint64_t n, p;
+	} h;
+
+	h.p = cf_hash_fnv(&pid, sizeof(int));
+	h.n = cf_hash_fnv(&node, sizeof(cf_node));
+
+	return (cf_hash_oneatatime(&h, sizeof(struct hashbuf)) &
+			AS_CLUSTER_SZ_MASKP) + index;
+}
+
+
+// Returns true if cached HV rows can be updated for the new succession list.
+// Surviving nodes must keep their relative order, so that remapping their
+// indices keeps the rows sorted.
+static bool
+balance_hv_cache_remap(balance_ctx *ctx)
+{
+	const cf_node *old_sl = g_hv_cache_succession;
+	const cf_node *new_sl = ctx->succession;
+	size_t old_size = g_hv_cache_cluster_size;
+	size_t new_size = ctx->cluster_size;
+
+	ctx->added_index = -1;
+
+	if (! g_hv_cache) {
+		g_hv_cache = cf_malloc(AS_PARTITIONS * g_config.paxos_max_cluster_size *
+				sizeof(uint64_t));
+
+		if (! g_hv_cache) {
+			cf_crash(AS_PARTITION, "as_partition_balance: couldn't allocate hv cache");
+		}
+
+		return false;
+	}
+
+	if (old_size == 0 || new_size + 1 < old_size || new_size > old_size + 1) {
+		return false;
+	}
+
+	size_t o = 0;
+	size_t n = 0;
+	bool changed = false;
+
+	while (o < old_size || n < new_size) {
+		if (o < old_size && n < new_size && old_sl[o] == new_sl[n]) {
+			ctx->remap[o++] = (int)n++;
+			continue;
+		}
+
+		if (changed || new_size == old_size) {
+			return false;
+		}
+
+		changed = true;
+
+		if (new_size > old_size) {
+			ctx->added_index = (int)n++;
+		}
+		else {
+			ctx->remap[o++] = -1;
+		}
+	}
+
+	return true;
+}
+
+
+static void
+balance_hv_cache_save(const cf_node *succession, size_t cluster_size)
+{
+	memcpy(g_hv_cache_succession, succession, cluster_size * sizeof(cf_node));
+	g_hv_cache_cluster_size = cluster_size;
+}
+
+
+// Build partition i's row of successor nodes - hash, sort, then convert the
+// hash values BACK into node IDs via the succession list index bits, saved in
+// the SL Index array.
+static void
+balance_build_hv_row(const balance_ctx *ctx, int i)
+{
+	const cf_node *succession = ctx->succession;
+	const size_t cluster_size = ctx->cluster_size;
+	cf_node *hv_ptr = ctx->hv_ptr;
+	int *hv_slindex_ptr = ctx->hv_slindex_ptr;
+	uint64_t *row = &g_hv_cache[i * g_config.paxos_max_cluster_size];
+
+	if (ctx->incremental) {
+		uint64_t new_row[cluster_size];
+		bool adding = ctx->added_index >= 0;
+		uint64_t added = adding ?
+				balance_hash(i, succession[ctx->added_index],
+						ctx->added_index) : 0;
+		size_t n = 0;
+
+		// Rows are in descending order - merge in the added node's value.
+		for (size_t k = 0; k < g_hv_cache_cluster_size; k++) {
+			int index = ctx->remap[row[k] & AS_CLUSTER_SZ_MASKN];
+
+			if (index < 0) {
+				continue;
+			}
+
+			uint64_t v = (row[k] & AS_CLUSTER_SZ_MASKP) + index;
+
+			if (adding && added > v) {
+				new_row[n++] = added;
+				adding = false;
+			}
+
+			new_row[n++] = v;
+		}
+
+		if (adding) {
+			new_row[n++] = added;
+		}
+
+		memcpy(row, new_row, n * sizeof(uint64_t));
+	}
+	else {
+		for (int j = 0; j < cluster_size; j++) {
+			row[j] = balance_hash(i, succession[j], j);
+		}
+
+		qsort(row, cluster_size, sizeof(uint64_t), cf_compare_uint64ptr);
+	}
+
+	for (int j = 0; j < cluster_size; j++) {
+		if (0 == row[j]) {
+			break;
+		}
+
+		HV_SLINDEX(i, j) = (int)(row[j] & AS_CLUSTER_SZ_MASKN);
+		HV(i, j) = succession[HV_SLINDEX(i, j)];
+	}
+}
+
+
+// Claim partitions one at a time - build each one's HV row, then balance it in
+// every namespace.
+static void *
+run_balance_worker(void *udata)
+{
+	balance_worker *w = (balance_worker *)udata;
+	int j;
+
+	while ((j = (int)cf_atomic32_incr(w->p_next_pid)) < AS_PARTITIONS) {
+		balance_build_hv_row(w->ctx, j);
+
+		for (int i = 0; i < g_config.n_namespaces; i++) {
+			balance_partition(w, i, j);
+		}
+	}
+
+	return NULL;
+}
+
+
+// Balance one partition of one namespace - partition j's HV row must already be
+// built. Work is disjoint per partition, so workers may run this concurrently.
+static void
+balance_partition(balance_worker *w, int i, int j)
+{
+	const balance_ctx *ctx = w->ctx;
+	as_paxos *paxos = g_paxos;
+	const cf_node *succession = ctx->succession;
+	const size_t cluster_size = ctx->cluster_size;
+	const cf_node self = ctx->self;
+	cf_node *hv_ptr = ctx->hv_ptr;
+	int *hv_slindex_ptr = ctx->hv_slindex_ptr;
+	as_namespace *ns = g_config.namespaces[i];
+	as_partition *p = &ns->partitions[j];
+	partition_migrate_record pmr;
+
+	partition_lock(p);
+
+	uint old_repl_factor = p->p_repl_factor;
+	p->p_repl_factor = ns->replication_factor;
+
+	if (g_config.cluster_mode != CL_MODE_NO_TOPOLOGY &&
+			paxos->cluster_size > 1) {
+		as_partition_adjust_hv_and_slindex(p, hv_ptr, hv_slindex_ptr);
+	}
+
+	memset(p->replica, 0, g_config.paxos_max_cluster_size * sizeof(cf_node));
+	memcpy(p->replica, &hv_ptr[j * g_config.paxos_max_cluster_size], p->p_repl_factor * sizeof(cf_node));
+
+	p->origin = 0;
+	p->target = 0;
+	p->current_outgoing_ldt_version = 0;
+
+	p->pending_migrate_tx = 0;
+	p->pending_migrate_rx = 0;
+	memset(p->replica_tx_onsync, 0, sizeof(p->replica_tx_onsync));
+
+	p->n_dupl = 0;
+	memset(p->dupl_nodes, 0, sizeof(p->dupl_nodes));
+	p->has_master_wait = false;
+	p->has_migrate_tx_later = false;
+	memset(&p->primary_version_info, 0, sizeof(p->primary_version_info));
+
+	// Check if any of the replicas for this partition in the old
+	// succession list are missing from the new succession list.
+	bool create_new_partition_version = false;
+
+	for (int k = 0;  k < old_repl_factor; k++) {
+		bool found = false;
+
+		if (p->old_sl[k] == 0) {
+			continue;
+		}
+
+		for (int l = 0; l < cluster_size; l++) {
+			if (p->old_sl[k] == succession[l]) {
+				found = true;
+				break;
+			}
+		}
+
+		if (! found) {
+			create_new_partition_version = true;
+			break;
+		}
+	}
+
+	// TODO - yes, this happens... try to understand it better.
+	if (p->state == AS_PARTITION_STATE_DESYNC &&
+			! is_partition_null(&p->version_info)) {
+		cf_info(AS_PARTITION, "{%s:%d} partition version is not null, setting state from DESYNC to SYNC",
+				ns->name, j);
+
+		p->state = AS_PARTITION_STATE_SYNC;
+	}
+
+	// Do some integrity checks on partition state.
+	if (is_partition_null(&ns->partitions[j].version_info)) {
+		bool ok = (p->state != AS_PARTITION_STATE_SYNC &&
+				p->state != AS_PARTITION_STATE_ZOMBIE);
+
+		if (! ok) {
+			cf_warning(AS_PARTITION,
+					"{%s:%d} partition version is null but state is SYNC or ZOMBIE or WAIT %d %"PRIx64,
+					ns->name, j, p->state, self);
+		}
+	}
+	else {
+		bool ok = (p->state == AS_PARTITION_STATE_SYNC ||
+				p->state == AS_PARTITION_STATE_ZOMBIE);
+
+		if (! ok) {
+			cf_warning(AS_PARTITION,
+					"{%s:%d} partition version is not null but state is not SYNC/ZOMBIE/WAIT  %d %"PRIx64,
+					ns->name, j, p->state, self);
+		}
+	}
+
+	// Number of unique versions of this partition.
+	size_t n_found = 0;
+
+	// First version in this partition's succession list.
+	as_partition_vinfo f_vinfo;
+	memset(&f_vinfo, 0, sizeof(f_vinfo));
+
+	// Info for duplicate versions.
+	size_t n_dupl = 0;
+	cf_node dupl_nodes[AS_CLUSTER_SZ];
+	as_partition_vinfo dupl_pvinfo[AS_CLUSTER_SZ];
+	memset(dupl_nodes, 0, sizeof(dupl_nodes));
+	memset(dupl_pvinfo, 0, sizeof(dupl_pvinfo));
+
+	for (int k = 0; k < cluster_size; k++) {
+		size_t n_index = HV_SLINDEX(j, k);
+		as_partition_vinfo *vinfo = &paxos->c_partition_vinfo[i][n_index][j];
+
+		if (is_partition_null(vinfo)) {
+			continue;
+		}
+
+		if (n_found == 0) {
+			// First encounter of this partition.
+			n_found++;
+			memcpy(&f_vinfo, vinfo, sizeof(*vinfo));
+			memcpy(&p->primary_version_info, vinfo, sizeof(*vinfo));
+			continue;
+		}
+
+		// Check if this partition version is different than the
+		// ones already encountered.
+		bool found = as_partition_vinfo_same(&f_vinfo, vinfo);
+
+		if (! found) {
+			for (int l = 0; l < n_dupl; l++) {
+				found = as_partition_vinfo_same(&dupl_pvinfo[l], vinfo);
+
+				if (found) {
+					break;
+				}
+			}
+		}
+
+		if (! found) {
+			dupl_nodes[n_dupl] = HV(j, k);
+			memcpy(&dupl_pvinfo[n_dupl], vinfo, sizeof(*vinfo));
+			n_dupl++;
+			n_found++;
+		}
+	}
+
+	int partition_is_lost = 0;
+
+	if (n_found == 0) {
+		partition_is_lost = 1;
+		w->n_lost++;
+	}
+	else if (n_found == 1) {
+		w->n_unique++;
+	}
+	else {
+		w->n_duplicate++;
+	}
+
+	// First create new empty partitions for missing partitions if this
+	// node is a replica. Essentially, all replicas will simultaneously
+	// create new versions of this partition using the version number
+	// derived from the cluster key.
+	if (partition_is_lost) {
+		partition_is_lost = 0;
+		w->n_recreate++;
+
+		int loop_end = cluster_size < p->p_repl_factor ?
+				cluster_size : p->p_repl_factor;
+
+		for (int k = 0; k < loop_end; k++) {
+			int n_index = HV_SLINDEX(j, k);
+			cf_node n_node = HV(j, k);
+
+			if (n_node == self) {
+				// There are no sync copies of this partition available
+				// within the cluster and this node is a replica, so
+				// reinitialize a valid empty partition.
+				as_partition_reinit(p, ns, j);
+				memset(p->replica, 0, g_config.paxos_max_cluster_size * sizeof(cf_node));
+				memcpy(p->replica, &hv_ptr[j * g_config.paxos_max_cluster_size],
+						p->p_repl_factor * sizeof(cf_node));
+				memcpy(&p->primary_version_info,
+						&ctx->new_version_for_lost_partitions,
+						sizeof(p->primary_version_info));
+				set_partition_sync_lockfree(p, j, ns, false);
+			}
+
+			memcpy(&paxos->c_partition_vinfo[i][n_index][j],
+					&ctx->new_version_for_lost_partitions,
+					sizeof(ctx->new_version_for_lost_partitions));
+			paxos->c_partition_size[i][n_index][j] = as_index_tree_size(p->vp);
+			paxos->c_partition_size[i][n_index][j] += as_index_tree_size(p->sub_vp);
+		}
+	}
+
+	// Compute which of the replicas is not sync.
+	bool is_sync[AS_CLUSTER_SZ];
+	int first_sync_node = -1;
+	int my_index_in_hvlist = -1;
+	memset(is_sync, 0, sizeof(is_sync));
+
+	// Note - might need to look beyond replicas to find a sync node.
+	for (int k = 0; k < cluster_size; k++) {
+		int n_index = HV_SLINDEX(j, k);
+
+		is_sync[k] = ! is_partition_null(&paxos->c_partition_vinfo[i][n_index][j]);
+
+		if (is_sync[k] && first_sync_node < 0) {
+			first_sync_node = k;
+
+			as_partition_vinfo old_vinfo, new_vinfo;
+			memcpy(&old_vinfo, &paxos->c_partition_vinfo[i][n_index][j], sizeof(as_partition_vinfo));
+			memcpy(&new_vinfo, &old_vinfo, sizeof(as_partition_vinfo));
+
+			// Increment the version information of the partition
+			// if we have the primary version of this partition.
+			if (create_new_partition_version) {
+				bool version_changed = increase_partition_version_tree_path(
+						&new_vinfo, HV(j, k), p->old_sl, ns->name, j);
+
+				if (version_changed) {
+					w->n_new_versions++;
+					set_new_partition_version(&p->version_info, &old_vinfo, &new_vinfo, ns, j);
+					memcpy(&p->primary_version_info, &new_vinfo, sizeof(p->primary_version_info));
+				}
+			}
+		}
+
+		if (HV(j, k) == self) {
+			my_index_in_hvlist = k;
+		}
+
+		if (succession[n_index] != HV(j, k)) {
+			cf_warning(AS_PARTITION, "{%s:%d} State Error. Node id mismatch hash %"PRIx64" slist %"PRIx64,
+					ns->name, j, HV(j, k), succession[n_index]);
+		}
+	} // end for each node in cluster
+
+	if (my_index_in_hvlist < 0) {
+		cf_crash(AS_PARTITION, "{%s:%d} State Error. Cannot find self in hash value list %"PRIx64,
+				ns->name, j, self);
+		my_index_in_hvlist = 0; // Suppress GCC warning.
+	}
+
+	if (first_sync_node < 0 && partition_is_lost == 0) {
+		cf_warning(AS_PARTITION, "{%s:%d} State Error. Cannot find first sync node for resident partition %"PRIx64,
+				ns->name, j, self);
+	}
+
+	// Create migration requests as needed.
+	switch (partition_is_lost) {
+	case 0:
+
+		// Master
+		//  If not sync switch to desync and wait for migration for
+		//  primary wait for migration from each duplicate partition
+		//  send merged data to all replicas.
+		//  allow reads (read-all)
+		//  allow writes
+		if (my_index_in_hvlist == 0) { // I Master!
+			// Do the following only if the master is not sync.
+			if (! is_sync[0]) {
+				// Master is not sync. Wait for the partition to be
+				// sent from another node this node may or may not be a
+				// replica.
+				p->pending_migrate_rx++;
+				p->origin = HV(j, first_sync_node);
+				set_partition_desync_lockfree(p,
+						&ns->partitions[j].version_info, ns, j,
+						false);
+			}
+			else {
+				p->state = AS_PARTITION_STATE_SYNC;
+			}
+
+			// If there are duplicates, the master will expect
+			// migrations from the first sync node of each
+			// duplicate partition version. This information is
+			// stored in the duplicate data structures of the partition
+			if (n_dupl > 0) {
+				p->n_dupl = n_dupl;
+				memcpy(p->dupl_nodes, dupl_nodes, sizeof(cf_node) * p->n_dupl);
+
+				for (int k = 0; k < p->n_dupl; k++) {
+					p->pending_migrate_rx++;
+				}
+			}
+
+			// If master is sync and there are no duplicate partitions
+			// schedule all the migrates to non-sync replicas right away.
+			if (p->pending_migrate_rx == 0) {
+				int loop_end = cluster_size < p->p_repl_factor ?
+						cluster_size : p->p_repl_factor;
+
+				for (int k = 1; k < loop_end; k++) {
+					if (! is_sync[k]) {
+						// Schedule a migrate of this partition.
+						p->pending_migrate_tx++;
+						partition_migrate_record_fill(&pmr,
+								HV(j, k), ns, j,
+								ctx->orig_cluster_key, TX_FLAGS_NONE);
+						cf_queue_push(ctx->mq, &pmr);
+					}
+				}
+
+				break; // out of switch
+			}
+
+			// Either master is not sync or it is waiting for
+			// duplicate partition versions or both. Schedule
+			// delayed migrates of merged data to replicas. All
+			// replicas will be migrated to in case duplicate
+			// partitions exist. Only non-sync partitions will be
+			// migrated to in case there are no duplicate partitions.
+			int loop_end = cluster_size < p->p_repl_factor ?
+					cluster_size : p->p_repl_factor;
+
+			for (int k = 1; k < loop_end; k++) {
+				// Schedule a delayed migrate of this partition.
+				if (p->n_dupl > 0 || ! is_sync[k]) {
+					p->replica_tx_onsync[k] = true;
+					w->ns_pending_migrate_tx_later[i]++;
+				}
+			}
+
+			break; // out of switch
+		}
+
+		// Non Sync.
+		//     if replica, switch to desync wait for migration from
+		//     master.
+		//     if not replica, move to absent.
+		if (! is_sync[my_index_in_hvlist]) { // Not sync
+			if (my_index_in_hvlist < p->p_repl_factor) {
+				// Wait for the master to send data.
+				p->pending_migrate_rx++;
+				p->origin = HV(j, 0);
+				set_partition_desync_lockfree(p,
+						&ns->partitions[j].version_info, ns, j,
+						false);
+			}
+			else {
+				set_partition_absent_lockfree(p,
+						&ns->partitions[j].version_info, ns, j,
+						false);
+			}
+
+			break; // out of switch
+		}
+
+		// Sync Node - Non-Master:
+		//    if this is the first sync node then send partition
+		//     over to master
+		//        if not a replica, switch to zombie mode an//
+		//         transition to absent later
+		//        if a replica, then wait for migration from master
+		//    if this is not the first sync node
+		//        if a replica, then wait for migration from master
+		//        if not a replica, set to absent
+		//
+		//    If sync or zombie node has primary version,
+		//        allow reads (read-all)
+		//        allow writes
+		//    If sync or zombie node has duplicate version
+		//        allow reads (read-all)
+		//        reject writes
+
+		// If this is the first sync node of the primary
+		// version of this partition, schedule an
+		// immediate migrate to the master node of this partition
+		// If this is the first sync node of a duplicate
+		// version of this partition, schedule an
+		// immediate migrate to the master node of this partition only if the master is sync
+		if (my_index_in_hvlist == first_sync_node ||
+				(cf_contains64(dupl_nodes, n_dupl, self) && is_sync[0])) {
+			// Schedule a migrate of this partition to the master
+			// node. The p->target needs to be set to indicate this
+			// node is migrating data to the master. The last
+			// parameter to the partition_migrate_record_fill()
+			// contains the flush flag that is used to determine
+			// what to do about pending writes once the migration
+			// is over.
+			p->pending_migrate_tx++;
+
+			// The first sync node in the list is going to be the
+			// acting master node. Set the p->target variable and
+			// also initialize the duplicate array. This data will
+			// be used during the time this node performs the
+			// acting role as master.
+			if (my_index_in_hvlist == first_sync_node) {
+				p->target = HV(j, 0);
+
+				if (n_dupl > 0) {
+					p->n_dupl = n_dupl;
+					memcpy(p->dupl_nodes, dupl_nodes, sizeof(cf_node) * p->n_dupl);
+				}
+
+				partition_migrate_record_fill(&pmr, HV(j, 0), ns, j,
+						ctx->orig_cluster_key, TX_FLAGS_ACTING_MASTER);
+			}
+			else {
+				partition_migrate_record_fill(&pmr, HV(j, 0), ns, j,
+						ctx->orig_cluster_key, TX_FLAGS_NONE);
+			}
+
+			cf_queue_push(ctx->mq, &pmr);
+		}
+		// Wait for master to flag that it is sync before
+		// transmitting the partition
+		else if (cf_contains64(dupl_nodes, n_dupl, self) && ! is_sync[0]) {
+			p->has_master_wait = true;
+			p->has_migrate_tx_later = true;
+			w->ns_pending_migrate_tx_later[i]++;
+		}
+
+		// If this is a replica and there are duplicate partitions
+		// then wait for migration from master.
+		if (my_index_in_hvlist < p->p_repl_factor) {
+			if (n_dupl > 0) {
+				p->pending_migrate_rx++;
+				p->origin = HV(j, 0);
+			}
+
+			p->state = AS_PARTITION_STATE_SYNC;
+
+			break; // out of switch
+		}
+
+		// Not a replica. Partition will enter zombie state if it
+		// has pending work. Otherwise, we discard the partition.
+		if (p->pending_migrate_tx || p->has_migrate_tx_later) {
+			p->state = AS_PARTITION_STATE_ZOMBIE;
+		}
+		else  { // throwing away duplicate partition
+			set_partition_absent_lockfree(p,
+					&ns->partitions[j].version_info, ns, j, false);
+		}
+
+		break;
+
+	case 1:
+	default:
+		cf_crash(AS_PARTITION, "{%s:%d} State Error.", ns->name, j);
+		break;
+	}
+
+	// Copy the new succession list over the old succession list.
+	memcpy(p->old_sl, &hv_ptr[j * g_config.paxos_max_cluster_size],
+			sizeof(cf_node) * g_config.paxos_max_cluster_size);
+
+	p->cluster_key = ctx->orig_cluster_key;
+
+	w->ns_pending_migrate_rx[i] += p->pending_migrate_rx;
+	w->ns_pending_migrate_tx[i] += p->pending_migrate_tx;
+
+	client_replica_maps_update(ns, j);
+
+	partition_unlock(p);
+}
+
+
 void
 as_partition_balance()
 {
@@ -2364,51 +3282,6 @@ as_partition_balance()
 	memset(hv_ptr, 0, hv_ptr_sz);
 	memset(hv_slindex_ptr, 0, hv_slindex_ptr_sz);
 
-	// <HV SECTION> <HV_SECTION> <HV SECTION> <HV_SECTION> <HV SECTION>
-	// <HV SECTION> <HV_SECTION> <HV SECTION> <HV_SECTION> <HV SECTION>
-	// Build the array of successor nodes for each partition.
-	for (int i = 0; i < AS_PARTITIONS; i++) {
-		for (int j = 0; j < cluster_size; j++) {
-			struct hashbuf {
-				uint64_t n, p;
-			} h;
-
-			if (0 == succession[j]) {
-				continue;
-			}
-
-			// Compute the hash value for this (node, partition) tuple.
-			// We separately compute the FNV-1a hash of each fragment of
-			// the tuple, then hash them together with a One-at-a-time hash;
-			// this method seems to give fairly good distribution.  We then
-			// stash the node's numerical ID in last few bits.
-			h.p = cf_hash_fnv(&i, sizeof(int));
-			h.n = cf_hash_fnv(&succession[j], sizeof(cf_node));
-			HV(i, j) = cf_hash_oneatatime(&h, sizeof(struct hashbuf));
-			HV(i, j) &= AS_CLUSTER_SZ_MASKP;
-			HV(i, j) += j;
-		} // end for each node in cluster
-
-		// Sort the hashed node values and then convert the hash values BACK
-		// into node IDs (mask everything out except our node index id bits).
-		// Then, Use the ID to get the original node values out of the
-		// succession list, but save the index bits for the SL Index array.
-		qsort(&hv_ptr[i * g_config.paxos_max_cluster_size], cluster_size,
-				sizeof(cf_node), cf_compare_uint64ptr);
-		for (int j = 0; j < cluster_size; j++) {
-			if (0 == HV(i, j)) {
-				break;
-			}
-
-			HV_SLINDEX(i, j) = (int)(HV(i, j) & AS_CLUSTER_SZ_MASKN);
-
-			// Overwrite the above-written hashed value with the correct
-			// succession list value based on the bits of the node entry that
-			// were stashed in the lower byte (and isolated by the mask).
-			HV(i, j) = succession[(int)(HV(i, j) & AS_CLUSTER_SZ_MASKN)];
-		} // end for each node in cluster
-	} // end for each partition
-
 	int n_new_versions = 0;
 
 	// Generate the new partition version based on the cluster key and use this
@@ -2432,468 +3305,81 @@ as_partition_balance()
 	uint64_t orig_cluster_key = as_paxos_get_cluster_key();
 	cf_queue mq;
 
+	// Thread-safe - balance workers push to it concurrently.
 	cf_queue_init(&mq, sizeof(partition_migrate_record),
-			AS_PARTITIONS * g_config.n_namespaces, false);
-
-	for (int i = 0; i < g_config.n_namespaces; i++) {
-		as_namespace *ns = g_config.namespaces[i];
-
-		int ns_pending_migrate_rx = 0;
-		int ns_pending_migrate_tx = 0;
-		int ns_pending_migrate_tx_later = 0;
-
-		for (int j = 0; j < AS_PARTITIONS; j++) {
-			as_partition *p = &ns->partitions[j];
-			partition_migrate_record pmr;
-
-			pthread_mutex_lock(&p->lock);
-
-			uint old_repl_factor = p->p_repl_factor;
-			p->p_repl_factor = ns->replication_factor;
-
-			if (g_config.cluster_mode != CL_MODE_NO_TOPOLOGY &&
-					paxos->cluster_size > 1) {
-				as_partition_adjust_hv_and_slindex(p, hv_ptr, hv_slindex_ptr);
-			}
-
-			memset(p->replica, 0, g_config.paxos_max_cluster_size * sizeof(cf_node));
-			memcpy(p->replica, &hv_ptr[j * g_config.paxos_max_cluster_size], p->p_repl_factor * sizeof(cf_node));
-
-			p->origin = 0;
-			p->target = 0;
-			p->current_outgoing_ldt_version = 0;
-
-			p->pending_migrate_tx = 0;
-			p->pending_migrate_rx = 0;
-			memset(p->replica_tx_onsync, 0, sizeof(p->replica_tx_onsync));
-
-			p->n_dupl = 0;
-			memset(p->dupl_nodes, 0, sizeof(p->dupl_nodes));
-			p->has_master_wait = false;
-			p->has_migrate_tx_later = false;
-			memset(&p->primary_version_info, 0, sizeof(p->primary_version_info));
-
-			// Check if any of the replicas for this partition in the old
-			// succession list are missing from the new succession list.
-			bool create_new_partition_version = false;
-
-			for (int k = 0;  k < old_repl_factor; k++) {
-				bool found = false;
-
-				if (p->old_sl[k] == 0) {
-					continue;
-				}
-
-				for (int l = 0; l < cluster_size; l++) {
-					if (p->old_sl[k] == succession[l]) {
-						found = true;
-						break;
-					}
-				}
-
-				if (! found) {
-					create_new_partition_version = true;
-					break;
-				}
-			}
-
-			// TODO - yes, this happens... try to understand it better.
-			if (p->state == AS_PARTITION_STATE_DESYNC &&
-					! is_partition_null(&p->version_info)) {
-				cf_info(AS_PARTITION, "{%s:%d} partition version is not null, setting state from DESYNC to SYNC",
-						ns->name, j);
-
-				p->state = AS_PARTITION_STATE_SYNC;
-			}
-
-			// Do some integrity checks on partition state.
-			if (is_partition_null(&ns->partitions[j].version_info)) {
-				bool ok = (p->state != AS_PARTITION_STATE_SYNC &&
-						p->state != AS_PARTITION_STATE_ZOMBIE);
-
-				if (! ok) {
-					cf_warning(AS_PARTITION,
-							"{%s:%d} partition version is null but state is SYNC or ZOMBIE or WAIT %d %"PRIx64,
-							ns->name, j, p->state, self);
-				}
-			}
-			else {
-				bool ok = (p->state == AS_PARTITION_STATE_SYNC ||
-						p->state == AS_PARTITION_STATE_ZOMBIE);
-
-				if (! ok) {
-					cf_warning(AS_PARTITION,
-							"{%s:%d} partition version is not null but state is not SYNC/ZOMBIE/WAIT  %d %"PRIx64,
-							ns->name, j, p->state, self);
-				}
-			}
-
-			// Number of unique versions of this partition.
-			size_t n_found = 0;
-
-			// First version in this partition's succession list.
-			as_partition_vinfo f_vinfo;
-			memset(&f_vinfo, 0, sizeof(f_vinfo));
-
-			// Info for duplicate versions.
-			size_t n_dupl = 0;
-			cf_node dupl_nodes[AS_CLUSTER_SZ];
-			as_partition_vinfo dupl_pvinfo[AS_CLUSTER_SZ];
-			memset(dupl_nodes, 0, sizeof(dupl_nodes));
-			memset(dupl_pvinfo, 0, sizeof(dupl_pvinfo));
-
-			for (int k = 0; k < cluster_size; k++) {
-				size_t n_index = HV_SLINDEX(j, k);
-				as_partition_vinfo *vinfo = &paxos->c_partition_vinfo[i][n_index][j];
-
-				if (is_partition_null(vinfo)) {
-					continue;
-				}
+			AS_PARTITIONS * g_config.n_namespaces, true);
 
-				if (n_found == 0) {
-					// First encounter of this partition.
-					n_found++;
-					memcpy(&f_vinfo, vinfo, sizeof(*vinfo));
-					memcpy(&p->primary_version_info, vinfo, sizeof(*vinfo));
-					continue;
-				}
-
-				// Check if this partition version is different than the
-				// ones already encountered.
-				bool found = as_partition_vinfo_same(&f_vinfo, vinfo);
-
-				if (! found) {
-					for (int l = 0; l < n_dupl; l++) {
-						found = as_partition_vinfo_same(&dupl_pvinfo[l], vinfo);
-
-						if (found) {
-							break;
-						}
-					}
-				}
-
-				if (! found) {
-					dupl_nodes[n_dupl] = HV(j, k);
-					memcpy(&dupl_pvinfo[n_dupl], vinfo, sizeof(*vinfo));
-					n_dupl++;
-					n_found++;
-				}
-			}
-
-			int partition_is_lost = 0;
+	balance_ctx ctx;
 
-			if (n_found == 0) {
-				partition_is_lost = 1;
-				n_lost++;
-			}
-			else if (n_found == 1) {
-				n_unique++;
-			}
-			else {
-				n_duplicate++;
-			}
+	ctx.succession = succession;
+	ctx.cluster_size = cluster_size;
+	ctx.self = self;
+	ctx.hv_ptr = hv_ptr;
+	ctx.hv_slindex_ptr = hv_slindex_ptr;
+	ctx.incremental = balance_hv_cache_remap(&ctx);
 
-			// First create new empty partitions for missing partitions if this
-			// node is a replica. Essentially, all replicas will simultaneously
-			// create new versions of this partition using the version number
-			// derived from the cluster key.
-			if (partition_is_lost) {
-				partition_is_lost = 0;
-				n_recreate++;
-
-				int loop_end = cluster_size < p->p_repl_factor ?
-						cluster_size : p->p_repl_factor;
-
-				for (int k = 0; k < loop_end; k++) {
-					int n_index = HV_SLINDEX(j, k);
-					cf_node n_node = HV(j, k);
-
-					if (n_node == self) {
-						// There are no sync copies of this partition available
-						// within the cluster and this node is a replica, so
-						// reinitialize a valid empty partition.
-						as_partition_reinit(p, ns, j);
-						memset(p->replica, 0, g_config.paxos_max_cluster_size * sizeof(cf_node));
-						memcpy(p->replica, &hv_ptr[j * g_config.paxos_max_cluster_size],
-								p->p_repl_factor * sizeof(cf_node));
-						memcpy(&p->primary_version_info,
-								&new_version_for_lost_partitions,
-								sizeof(p->primary_version_info));
-						set_partition_sync_lockfree(p, j, ns, false);
-					}
-
-					memcpy(&paxos->c_partition_vinfo[i][n_index][j],
-							&new_version_for_lost_partitions,
-							sizeof(new_version_for_lost_partitions));
-					paxos->c_partition_size[i][n_index][j] = p->vp->elements;
-					paxos->c_partition_size[i][n_index][j] += p->sub_vp->elements;
-				}
-			}
-
-			// Compute which of the replicas is not sync.
-			bool is_sync[AS_CLUSTER_SZ];
-			int first_sync_node = -1;
-			int my_index_in_hvlist = -1;
-			memset(is_sync, 0, sizeof(is_sync));
-
-			// Note - might need to look beyond replicas to find a sync node.
-			for (int k = 0; k < cluster_size; k++) {
-				int n_index = HV_SLINDEX(j, k);
-
-				is_sync[k] = ! is_partition_null(&paxos->c_partition_vinfo[i][n_index][j]);
-
-				if (is_sync[k] && first_sync_node < 0) {
-					first_sync_node = k;
-
-					as_partition_vinfo old_vinfo, new_vinfo;
-					memcpy(&old_vinfo, &paxos->c_partition_vinfo[i][n_index][j], sizeof(as_partition_vinfo));
-					memcpy(&new_vinfo, &old_vinfo, sizeof(as_partition_vinfo));
-
-					// Increment the version information of the partition
-					// if we have the primary version of this partition.
-					if (create_new_partition_version) {
-						bool version_changed = increase_partition_version_tree_path(
-								&new_vinfo, HV(j, k), p->old_sl, ns->name, j);
-
-						if (version_changed) {
-							n_new_versions++;
-							set_new_partition_version(&p->version_info, &old_vinfo, &new_vinfo, ns, j);
-							memcpy(&p->primary_version_info, &new_vinfo, sizeof(p->primary_version_info));
-						}
-					}
-				}
-
-				if (HV(j, k) == self) {
-					my_index_in_hvlist = k;
-				}
-
-				if (succession[n_index] != HV(j, k)) {
-					cf_warning(AS_PARTITION, "{%s:%d} State Error. Node id mismatch hash %"PRIx64" slist %"PRIx64,
-							ns->name, j, HV(j, k), succession[n_index]);
-				}
-			} // end for each node in cluster
-
-			if (my_index_in_hvlist < 0) {
-				cf_crash(AS_PARTITION, "{%s:%d} State Error. Cannot find self in hash value list %"PRIx64,
-						ns->name, j, self);
-				my_index_in_hvlist = 0; // Suppress GCC warning.
-			}
-
-			if (first_sync_node < 0 && partition_is_lost == 0) {
-				cf_warning(AS_PARTITION, "{%s:%d} State Error. Cannot find first sync node for resident partition %"PRIx64,
-						ns->name, j, self);
-			}
-
-			// Create migration requests as needed.
-			switch (partition_is_lost) {
-			case 0:
-
-				// Master
-				//  If not sync switch to desync and wait for migration for
-				//  primary wait for migration from each duplicate partition
-				//  send merged data to all replicas.
-				//  allow reads (read-all)
-				//  allow writes
-				if (my_index_in_hvlist == 0) { // I Master!
-					// Do the following only if the master is not sync.
-					if (! is_sync[0]) {
-						// Master is not sync. Wait for the partition to be
-						// sent from another node this node may or may not be a
-						// replica.
-						p->pending_migrate_rx++;
-						p->origin = HV(j, first_sync_node);
-						set_partition_desync_lockfree(p,
-								&ns->partitions[j].version_info, ns, j,
-								false);
-					}
-					else {
-						p->state = AS_PARTITION_STATE_SYNC;
-					}
-
-					// If there are duplicates, the master will expect
-					// migrations from the first sync node of each
-					// duplicate partition version. This information is
-					// stored in the duplicate data structures of the partition
-					if (n_dupl > 0) {
-						p->n_dupl = n_dupl;
-						memcpy(p->dupl_nodes, dupl_nodes, sizeof(cf_node) * p->n_dupl);
-
-						for (int k = 0; k < p->n_dupl; k++) {
-							p->pending_migrate_rx++;
-						}
-					}
-
-					// If master is sync and there are no duplicate partitions
-					// schedule all the migrates to non-sync replicas right away.
-					if (p->pending_migrate_rx == 0) {
-						int loop_end = cluster_size < p->p_repl_factor ?
-								cluster_size : p->p_repl_factor;
-
-						for (int k = 1; k < loop_end; k++) {
-							if (! is_sync[k]) {
-								// Schedule a migrate of this partition.
-								p->pending_migrate_tx++;
-								partition_migrate_record_fill(&pmr,
-										HV(j, k), ns, j,
-										orig_cluster_key, TX_FLAGS_NONE);
-								cf_queue_push(&mq, &pmr);
-							}
-						}
-
-						break; // out of switch
-					}
-
-					// Either master is not sync or it is waiting for
-					// duplicate partition versions or both. Schedule
-					// delayed migrates of merged data to replicas. All
-					// replicas will be migrated to in case duplicate
-					// partitions exist. Only non-sync partitions will be
-					// migrated to in case there are no duplicate partitions.
-					int loop_end = cluster_size < p->p_repl_factor ?
-							cluster_size : p->p_repl_factor;
-
-					for (int k = 1; k < loop_end; k++) {
-						// Schedule a delayed migrate of this partition.
-						if (p->n_dupl > 0 || ! is_sync[k]) {
-							p->replica_tx_onsync[k] = true;
-							ns_pending_migrate_tx_later++;
-						}
-					}
-
-					break; // out of switch
-				}
+	if (ctx.incremental) {
+		cf_info(AS_PARTITION, "updating partition succession lists incrementally");
+	}
 
-				// Non Sync.
-				//     if replica, switch to desync wait for migration from
-				//     master.
-				//     if not replica, move to absent.
-				if (! is_sync[my_index_in_hvlist]) { // Not sync
-					if (my_index_in_hvlist < p->p_repl_factor) {
-						// Wait for the master to send data.
-						p->pending_migrate_rx++;
-						p->origin = HV(j, 0);
-						set_partition_desync_lockfree(p,
-								&ns->partitions[j].version_info, ns, j,
-								false);
-					}
-					else {
-						set_partition_absent_lockfree(p,
-								&ns->partitions[j].version_info, ns, j,
-								false);
-					}
+	ctx.new_version_for_lost_partitions = new_version_for_lost_partitions;
+	ctx.orig_cluster_key = orig_cluster_key;
+	ctx.mq = &mq;
 
-					break; // out of switch
-				}
+	uint32_t n_threads = g_config.n_balance_threads;
+	balance_worker workers[n_threads];
+	pthread_t threads[n_threads];
+	cf_atomic32 next_pid = -1;
 
-				// Sync Node - Non-Master:
-				//    if this is the first sync node then send partition
-				//     over to master
-				//        if not a replica, switch to zombie mode an//
-				//         transition to absent later
-				//        if a replica, then wait for migration from master
-				//    if this is not the first sync node
-				//        if a replica, then wait for migration from master
-				//        if not a replica, set to absent
-				//
-				//    If sync or zombie node has primary version,
-				//        allow reads (read-all)
-				//        allow writes
-				//    If sync or zombie node has duplicate version
-				//        allow reads (read-all)
-				//        reject writes
-
-				// If this is the first sync node of the primary
-				// version of this partition, schedule an
-				// immediate migrate to the master node of this partition
-				// If this is the first sync node of a duplicate
-				// version of this partition, schedule an
-				// immediate migrate to the master node of this partition only if the master is sync
-				if (my_index_in_hvlist == first_sync_node ||
-						(cf_contains64(dupl_nodes, n_dupl, self) && is_sync[0])) {
-					// Schedule a migrate of this partition to the master
-					// node. The p->target needs to be set to indicate this
-					// node is migrating data to the master. The last
-					// parameter to the partition_migrate_record_fill()
-					// contains the flush flag that is used to determine
-					// what to do about pending writes once the migration
-					// is over.
-					p->pending_migrate_tx++;
-
-					// The first sync node in the list is going to be the
-					// acting master node. Set the p->target variable and
-					// also initialize the duplicate array. This data will
-					// be used during the time this node performs the
-					// acting role as master.
-					if (my_index_in_hvlist == first_sync_node) {
-						p->target = HV(j, 0);
-
-						if (n_dupl > 0) {
-							p->n_dupl = n_dupl;
-							memcpy(p->dupl_nodes, dupl_nodes, sizeof(cf_node) * p->n_dupl);
-						}
-
-						partition_migrate_record_fill(&pmr, HV(j, 0), ns, j,
-								orig_cluster_key, TX_FLAGS_ACTING_MASTER);
-					}
-					else {
-						partition_migrate_record_fill(&pmr, HV(j, 0), ns, j,
-								orig_cluster_key, TX_FLAGS_NONE);
-					}
+	for (uint32_t t = 0; t < n_threads; t++) {
+		balance_worker *w = &workers[t];
 
-					cf_queue_push(&mq, &pmr);
-				}
-				// Wait for master to flag that it is sync before
-				// transmitting the partition
-				else if (cf_contains64(dupl_nodes, n_dupl, self) && ! is_sync[0]) {
-					p->has_master_wait = true;
-					p->has_migrate_tx_later = true;
-					ns_pending_migrate_tx_later++;
-				}
+		memset(w, 0, sizeof(balance_worker));
+		w->ctx = &ctx;
+		w->p_next_pid = &next_pid;
 
-				// If this is a replica and there are duplicate partitions
-				// then wait for migration from master.
-				if (my_index_in_hvlist < p->p_repl_factor) {
-					if (n_dupl > 0) {
-						p->pending_migrate_rx++;
-						p->origin = HV(j, 0);
-					}
+		// This thread takes the first share.
+		if (t == 0) {
+			continue;
+		}
 
-					p->state = AS_PARTITION_STATE_SYNC;
+		if (pthread_create(&threads[t], NULL, run_balance_worker, w) != 0) {
+			cf_crash(AS_PARTITION, "failed to create balance thread %u", t);
+		}
+	}
 
-					break; // out of switch
-				}
+	run_balance_worker(&workers[0]);
 
-				// Not a replica. Partition will enter zombie state if it
-				// has pending work. Otherwise, we discard the partition.
-				if (p->pending_migrate_tx || p->has_migrate_tx_later) {
-					p->state = AS_PARTITION_STATE_ZOMBIE;
-				}
-				else  { // throwing away duplicate partition
-					set_partition_absent_lockfree(p,
-							&ns->partitions[j].version_info, ns, j, false);
-				}
+	for (uint32_t t = 1; t < n_threads; t++) {
+		pthread_join(threads[t], NULL);
+	}
 
-				break;
+	balance_hv_cache_save(succession, cluster_size);
 
-			case 1:
-			default:
-				cf_crash(AS_PARTITION, "{%s:%d} State Error.", ns->name, j);
-				break;
-			}
+	for (uint32_t t = 0; t < n_threads; t++) {
+		balance_worker *w = &workers[t];
 
-			// Copy the new succession list over the old succession list.
-			memcpy(p->old_sl, &hv_ptr[j * g_config.paxos_max_cluster_size],
-					sizeof(cf_node) * g_config.paxos_max_cluster_size);
+		n_lost += w->n_lost;
+		n_unique += w->n_unique;
+		n_recreate += w->n_recreate;
+		n_duplicate += w->n_duplicate;
+		n_new_versions += w->n_new_versions;
+	}
 
-			p->cluster_key = orig_cluster_key;
+	for (int i = 0; i < g_config.n_namespaces; i++) {
+		as_namespace *ns = g_config.namespaces[i];
 
-			ns_pending_migrate_rx += p->pending_migrate_rx;
-			ns_pending_migrate_tx += p->pending_migrate_tx;
+		int ns_pending_migrate_rx = 0;
+		int ns_pending_migrate_tx = 0;
+		int ns_pending_migrate_tx_later = 0;
 
-			client_replica_maps_update(ns, j);
+		for (uint32_t t = 0; t < n_threads; t++) {
+			balance_worker *w = &workers[t];
 
-			pthread_mutex_unlock(&p->lock);
-		} // end for each partition
+			ns_pending_migrate_rx += w->ns_pending_migrate_rx[i];
+			ns_pending_migrate_tx += w->ns_pending_migrate_tx[i];
+			ns_pending_migrate_tx_later += w->ns_pending_migrate_tx_later[i];
+		}
 
 		int ns_pending_migrate_tx_total = ns_pending_migrate_tx + ns_pending_migrate_tx_later;
 
@@ -2934,7 +3420,7 @@ as_partition_balance()
 
 	partition_migrate_record pmr;
 
-	while (cf_queue_pop(&mq, &pmr, CF_QUEUE_FOREVER) == CF_QUEUE_OK) {
+	while (cf_queue_pop(&mq, &pmr, CF_QUEUE_NOWAIT) == CF_QUEUE_OK) {
 		as_migrate_emigrate(&pmr);
 	}
 
@@ -3019,7 +3505,7 @@ as_partition_balance_init_single_node_cluster()
 
 			if (is_partition_null(&p->version_info)) {
 				// For nsup, which is allowed to operate while we're doing this.
-				pthread_mutex_lock(&p->lock);
+				partition_lock(p);
 
 				p->state = AS_PARTITION_STATE_SYNC;
 				memcpy(p->replica, &g_config.self_node, sizeof(cf_node));
@@ -3033,7 +3519,7 @@ as_partition_balance_init_single_node_cluster()
 
 				n_promoted++;
 
-				pthread_mutex_unlock(&p->lock);
+				partition_unlock(p);
 			}
 		}
 
@@ -0,0 +1,221 @@
+/*
+ * partition_changelog.c
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+
+/* SYNOPSIS
+ * Optional per-partition changelog of recently written digests, so a replica
+ * returning from a brief outage can catch up by migrating only the records it
+ * missed, rather than by reducing the whole partition tree. Each partition has
+ * a fixed-size ring of (digest, last-update-time) entries, appended on every
+ * local (client or replica) write.
+ *
+ * The changelog is complete for writes after its "complete-since" time. That
+ * starts as the time it's created or cleared, and moves forward as the ring
+ * overwrites entries. Immigrations don't add entries - they clear the
+ * changelog instead, as do partition drops. An emigration replays the
+ * changelog only if it's complete back to the immigrator's delta
+ * last-update-time, and that time is within the configured max age.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "fabric/partition_changelog.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "citrusleaf/alloc.h"
+#include "citrusleaf/cf_clock.h"
+#include "citrusleaf/cf_digest.h"
+
+#include "fault.h"
+
+#include "base/datamodel.h"
+#include "base/index.h"
+
+
+//==========================================================
+// Typedefs.
+//
+
+typedef struct cl_entry_s {
+	cf_digest			keyd;
+	uint64_t			last_update_time;
+} __attribute__ ((__packed__)) cl_entry;
+
+struct as_partition_changelog_s {
+	pthread_mutex_t		lock;
+	uint64_t			complete_since;	// every write after this is listed
+	uint32_t			capacity;
+	uint32_t			n_entries;
+	uint32_t			head;			// where the next entry goes
+	cl_entry			entries[];
+};
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static int keyd_compare(const void* a, const void* b);
+
+
+//==========================================================
+// Public API.
+//
+
+as_partition_changelog*
+as_partition_changelog_create(as_namespace* ns)
+{
+	uint32_t capacity = ns->migrate_changelog_entries;
+	as_partition_changelog* cl = cf_malloc(sizeof(as_partition_changelog) +
+			(capacity * sizeof(cl_entry)));
+
+	cf_assert(cl, AS_PARTITION, CF_CRITICAL, "failed changelog malloc");
+
+	pthread_mutex_init(&cl->lock, NULL);
+	cl->complete_since = cf_clepoch_milliseconds();
+	cl->capacity = capacity;
+	cl->n_entries = 0;
+	cl->head = 0;
+
+	return cl;
+}
+
+
+void
+as_partition_changelog_clear(as_partition_changelog* cl)
+{
+	pthread_mutex_lock(&cl->lock);
+
+	cl->complete_since = cf_clepoch_milliseconds();
+	cl->n_entries = 0;
+	cl->head = 0;
+
+	pthread_mutex_unlock(&cl->lock);
+}
+
+
+// Call wherever a client or replica write (not a migration) sets a record's
+// last-update-time.
+void
+as_partition_changelog_record_changed(as_partition* p, as_record* r)
+{
+	as_partition_changelog* cl = p->changelog;
+
+	if (! cl) {
+		return;
+	}
+
+	pthread_mutex_lock(&cl->lock);
+
+	cl_entry* e = &cl->entries[cl->head];
+
+	if (cl->n_entries == cl->capacity) {
+		// Overwriting the oldest entry - writes before it are no longer
+		// guaranteed to be listed.
+		if (e->last_update_time > cl->complete_since) {
+			cl->complete_since = e->last_update_time;
+		}
+	}
+	else {
+		cl->n_entries++;
+	}
+
+	e->keyd = r->key;
+	e->last_update_time = r->last_update_time;
+
+	if (++cl->head == cl->capacity) {
+		cl->head = 0;
+	}
+
+	pthread_mutex_unlock(&cl->lock);
+}
+
+
+bool
+as_partition_changelog_get(as_partition_changelog* cl, uint64_t since_lut,
+		uint32_t max_age_sec, cf_digest** p_keyds, uint32_t* p_n_keyds)
+{
+	uint64_t now = cf_clepoch_milliseconds();
+
+	if (since_lut + ((uint64_t)max_age_sec * 1000) < now) {
+		return false;
+	}
+
+	pthread_mutex_lock(&cl->lock);
+
+	if (cl->complete_since > since_lut) {
+		pthread_mutex_unlock(&cl->lock);
+		return false;
+	}
+
+	cf_digest* keyds = cf_malloc((cl->n_entries + 1) * sizeof(cf_digest));
+
+	cf_assert(keyds, AS_PARTITION, CF_CRITICAL, "failed changelog malloc");
+
+	uint32_t n_keyds = 0;
+	uint32_t tail = (cl->head + cl->capacity - cl->n_entries) % cl->capacity;
+
+	for (uint32_t i = 0; i < cl->n_entries; i++) {
+		const cl_entry* e = &cl->entries[(tail + i) % cl->capacity];
+
+		if (e->last_update_time > since_lut) {
+			keyds[n_keyds++] = e->keyd;
+		}
+	}
+
+	pthread_mutex_unlock(&cl->lock);
+
+	// Hot records are written many times - send each only once.
+	qsort(keyds, n_keyds, sizeof(cf_digest), keyd_compare);
+
+	uint32_t n_unique = 0;
+
+	for (uint32_t i = 0; i < n_keyds; i++) {
+		if (n_unique == 0 ||
+				memcmp(&keyds[i], &keyds[n_unique - 1], sizeof(cf_digest)) != 0) {
+			keyds[n_unique++] = keyds[i];
+		}
+	}
+
+	*p_keyds = keyds;
+	*p_n_keyds = n_unique;
+
+	return true;
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+static int
+keyd_compare(const void* a, const void* b)
+{
+	return memcmp(a, b, sizeof(cf_digest));
+}
@@ -0,0 +1,687 @@
+/*
+ * partition_digest.c
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/* SYNOPSIS
+ * Per-partition hash trees, for checking replicas are consistent without
+ * moving records. A tree is computed on demand by a throttled reduce of the
+ * partition's index - a record's (digest, generation, last-update-time) hash
+ * is summed into a leaf by digest range, so the result doesn't depend on
+ * reduce order. Trees are served locally via info, and to other nodes via a
+ * fabric request handled on a worker thread, so the fabric threads never run
+ * a reduce. Comparing two nodes' trees top-down yields the digest ranges that
+ * differ.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "fabric/partition_digest.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "citrusleaf/cf_atomic.h"
+#include "citrusleaf/cf_clock.h"
+#include "citrusleaf/cf_digest.h"
+#include "citrusleaf/cf_queue.h"
+
+#include "dynbuf.h"
+#include "fault.h"
+#include "msg.h"
+#include "util.h"
+
+#include "base/cfg.h"
+#include "base/datamodel.h"
+#include "base/index.h"
+#include "fabric/fabric.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+typedef enum {
+	// These values go on the wire, so mind backward compatibility if changing.
+	PDIGEST_FIELD_OP,
+	PDIGEST_FIELD_TID,
+	PDIGEST_FIELD_NAMESPACE,
+	PDIGEST_FIELD_PID,
+	PDIGEST_FIELD_RESULT,
+	PDIGEST_FIELD_LEAVES,
+
+	NUM_PDIGEST_FIELDS
+} pdigest_msg_field;
+
+#define PDIGEST_OP_REQUEST 1
+#define PDIGEST_OP_RESPONSE 2
+
+#define PDIGEST_RESULT_OK 0
+#define PDIGEST_RESULT_BAD_NAMESPACE 1
+#define PDIGEST_RESULT_BUSY 2
+
+const msg_template pdigest_mt[] = {
+	{ PDIGEST_FIELD_OP, M_FT_UINT32 },
+	{ PDIGEST_FIELD_TID, M_FT_UINT64 },
+	{ PDIGEST_FIELD_NAMESPACE, M_FT_BUF },
+	{ PDIGEST_FIELD_PID, M_FT_UINT32 },
+	{ PDIGEST_FIELD_RESULT, M_FT_UINT32 },
+	{ PDIGEST_FIELD_LEAVES, M_FT_BUF },
+};
+
+COMPILER_ASSERT(sizeof(pdigest_mt) / sizeof(msg_template) == NUM_PDIGEST_FIELDS);
+
+#define PDIGEST_MSG_SCRATCH_SIZE 64
+
+// Requests queued beyond this are refused rather than left to time out.
+#define MAX_QUEUED_REQUESTS 64
+
+// Covers queueing behind other requests as well as the remote reduce.
+#define COMPARE_TIMEOUT_MS (10 * 1000)
+
+// How many records between rate checks.
+#define THROTTLE_CHECK_RECORDS 64
+
+// How far ahead of the rate a reduce may get before it sleeps.
+#define THROTTLE_SLACK_ms 10
+
+typedef struct pdigest_tree_s {
+	as_partition_digest_node	root;
+	as_partition_digest_node	mids[AS_PARTITION_DIGEST_N_MIDS];
+	as_partition_digest_node	leaves[AS_PARTITION_DIGEST_N_LEAVES];
+} pdigest_tree;
+
+typedef struct pdigest_reduce_s {
+	as_namespace*	ns;
+	pdigest_tree*	tree;
+	uint64_t		start_ms;
+	uint64_t		n_records;
+} pdigest_reduce;
+
+// A remote node's request, waiting for the worker thread.
+typedef struct pdigest_request_s {
+	cf_node			src;
+	uint64_t		tid;
+	as_namespace*	ns;
+	as_partition_id	pid;
+} pdigest_request;
+
+// A local compare waiting for a remote node's leaves - lives on the info
+// thread's stack, linked into g_waiters while it waits.
+typedef struct pdigest_waiter_s {
+	struct pdigest_waiter_s*	next;
+	uint64_t					tid;
+	cf_node						node;
+	bool						done;
+	uint32_t					result;
+	as_partition_digest_node	leaves[AS_PARTITION_DIGEST_N_LEAVES];
+} pdigest_waiter;
+
+
+//==========================================================
+// Forward declarations.
+//
+
+void compute_tree(as_namespace* ns, as_partition_id pid, pdigest_tree* tree);
+void compute_reduce_cb(as_index_ref* r_ref, void* udata);
+void build_parents(pdigest_tree* tree);
+void append_nodes(cf_dyn_buf* db, const as_partition_digest_node* nodes, uint32_t n_nodes);
+void append_divergent_ranges(cf_dyn_buf* db, const pdigest_tree* local, const pdigest_tree* remote);
+
+int pdigest_msg_cb(cf_node src, msg* m, void* udata);
+void handle_request(cf_node src, msg* m);
+void handle_response(msg* m);
+void* run_pdigest_requests(void* arg);
+void send_response(cf_node dst, uint64_t tid, uint32_t result, const pdigest_tree* tree);
+
+static inline uint64_t
+record_hash(const as_record* r)
+{
+	uint64_t h;
+
+	// Digest bytes past the partition id are already uniformly distributed.
+	memcpy(&h, &r->key.digest[12], sizeof(h));
+
+	h ^= ((uint64_t)r->generation << 40) ^ r->last_update_time;
+
+	// 64-bit finalizer (MurmurHash3) - mixes generation and LUT into all bits.
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdUL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53UL;
+	h ^= h >> 33;
+
+	return h;
+}
+
+
+//==========================================================
+// Globals.
+//
+
+// Serializes reduces, so the throttle holds across all requesters.
+static pthread_mutex_t g_compute_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static cf_queue* g_request_q;
+
+static pthread_mutex_t g_waiter_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_waiter_cond = PTHREAD_COND_INITIALIZER;
+static pdigest_waiter* g_waiters = NULL;
+
+static cf_atomic64 g_tid = 0;
+
+
+//==========================================================
+// Public API.
+//
+
+void
+as_partition_digest_init()
+{
+	g_request_q = cf_queue_create(sizeof(pdigest_request), true);
+
+	pthread_t thread;
+	pthread_attr_t attrs;
+
+	pthread_attr_init(&attrs);
+	pthread_attr_setdetachstate(&attrs, PTHREAD_CREATE_DETACHED);
+
+	if (pthread_create(&thread, &attrs, run_pdigest_requests, NULL) != 0) {
+		cf_crash(AS_PARTITION, "failed to create partition digest thread");
+	}
+
+	as_fabric_register_msg_fn(M_TYPE_PARTITION_DIGEST, pdigest_mt,
+			sizeof(pdigest_mt), PDIGEST_MSG_SCRATCH_SIZE, pdigest_msg_cb,
+			NULL);
+}
+
+// Depth 0 gives "records=<n>:hash=<hex>", deeper adds ":nodes=" and a ','
+// separated list of "<n>/<hex>" per node.
+const char*
+as_partition_digest_get_info(as_namespace* ns, as_partition_id pid,
+		uint32_t depth, cf_dyn_buf* db)
+{
+	if (pid >= AS_PARTITIONS) {
+		return "bad-pid";
+	}
+
+	if (depth > 2) {
+		return "bad-depth";
+	}
+
+	pdigest_tree tree;
+
+	compute_tree(ns, pid, &tree);
+
+	cf_dyn_buf_append_string(db, "records=");
+	cf_dyn_buf_append_uint64(db, tree.root.n_records);
+	cf_dyn_buf_append_string(db, ":hash=");
+	cf_dyn_buf_append_uint64_x(db, tree.root.hash);
+
+	if (depth == 1) {
+		append_nodes(db, tree.mids, AS_PARTITION_DIGEST_N_MIDS);
+	}
+	else if (depth == 2) {
+		append_nodes(db, tree.leaves, AS_PARTITION_DIGEST_N_LEAVES);
+	}
+
+	return NULL;
+}
+
+// Gives "match", or "mismatch:leaves=<ranges>" where ranges are ',' separated
+// leaf numbers or "<lo>-<hi>" - leaf n holds the partition's digests whose
+// byte AS_PARTITION_DIGEST_LEAF_BYTE is n.
+const char*
+as_partition_digest_compare(as_namespace* ns, as_partition_id pid,
+		cf_node node, cf_dyn_buf* db)
+{
+	if (pid >= AS_PARTITIONS) {
+		return "bad-pid";
+	}
+
+	if (node == g_config.self_node) {
+		return "bad-node";
+	}
+
+	msg* m = as_fabric_msg_get(M_TYPE_PARTITION_DIGEST);
+
+	if (! m) {
+		return "no-msg";
+	}
+
+	pdigest_waiter waiter = {
+			.tid = cf_atomic64_incr(&g_tid),
+			.node = node
+	};
+
+	msg_set_uint32(m, PDIGEST_FIELD_OP, PDIGEST_OP_REQUEST);
+	msg_set_uint64(m, PDIGEST_FIELD_TID, waiter.tid);
+	msg_set_buf(m, PDIGEST_FIELD_NAMESPACE, (uint8_t*)ns->name,
+			strlen(ns->name), MSG_SET_COPY);
+	msg_set_uint32(m, PDIGEST_FIELD_PID, pid);
+
+	pthread_mutex_lock(&g_waiter_lock);
+	waiter.next = g_waiters;
+	g_waiters = &waiter;
+	pthread_mutex_unlock(&g_waiter_lock);
+
+	if (as_fabric_send(node, m, AS_FABRIC_PRIORITY_MEDIUM) != 0) {
+		as_fabric_msg_put(m);
+
+		pthread_mutex_lock(&g_waiter_lock);
+
+		for (pdigest_waiter** pp = &g_waiters; *pp; pp = &(*pp)->next) {
+			if (*pp == &waiter) {
+				*pp = waiter.next;
+				break;
+			}
+		}
+
+		pthread_mutex_unlock(&g_waiter_lock);
+
+		return "send-failed";
+	}
+
+	// Reduce locally while the remote node does the same.
+	pdigest_tree local;
+
+	compute_tree(ns, pid, &local);
+
+	struct timespec deadline;
+
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += COMPARE_TIMEOUT_MS / 1000;
+
+	pthread_mutex_lock(&g_waiter_lock);
+
+	while (! waiter.done) {
+		if (pthread_cond_timedwait(&g_waiter_cond, &g_waiter_lock,
+				&deadline) == ETIMEDOUT) {
+			break;
+		}
+	}
+
+	// On timeout unlink - the response handler unlinks on completion.
+	if (! waiter.done) {
+		for (pdigest_waiter** pp = &g_waiters; *pp; pp = &(*pp)->next) {
+			if (*pp == &waiter) {
+				*pp = waiter.next;
+				break;
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&g_waiter_lock);
+
+	if (! waiter.done) {
+		return "timeout";
+	}
+
+	if (waiter.result == PDIGEST_RESULT_BAD_NAMESPACE) {
+		return "remote-bad-ns";
+	}
+
+	if (waiter.result == PDIGEST_RESULT_BUSY) {
+		return "remote-busy";
+	}
+
+	pdigest_tree remote;
+
+	memcpy(remote.leaves, waiter.leaves, sizeof(remote.leaves));
+	build_parents(&remote);
+
+	if (local.root.hash == remote.root.hash &&
+			local.root.n_records == remote.root.n_records) {
+		cf_dyn_buf_append_string(db, "match");
+		return NULL;
+	}
+
+	cf_dyn_buf_append_string(db, "mismatch:local-records=");
+	cf_dyn_buf_append_uint64(db, local.root.n_records);
+	cf_dyn_buf_append_string(db, ":remote-records=");
+	cf_dyn_buf_append_uint64(db, remote.root.n_records);
+	cf_dyn_buf_append_string(db, ":leaves=");
+	append_divergent_ranges(db, &local, &remote);
+
+	return NULL;
+}
+
+
+//==========================================================
+// Local helpers - trees.
+//
+
+void
+compute_tree(as_namespace* ns, as_partition_id pid, pdigest_tree* tree)
+{
+	memset(tree, 0, sizeof(pdigest_tree));
+
+	as_partition_reservation rsv;
+
+	// Any state will do - a partition we don't hold gives an empty tree.
+	as_partition_reserve_migrate(ns, pid, &rsv, NULL);
+
+	pthread_mutex_lock(&g_compute_lock);
+
+	pdigest_reduce pr = {
+			.ns = ns,
+			.tree = tree,
+			.start_ms = cf_getms()
+	};
+
+	as_index_reduce(rsv.tree, compute_reduce_cb, &pr);
+
+	pthread_mutex_unlock(&g_compute_lock);
+
+	as_partition_release(&rsv);
+
+	build_parents(tree);
+}
+
+void
+compute_reduce_cb(as_index_ref* r_ref, void* udata)
+{
+	pdigest_reduce* pr = (pdigest_reduce*)udata;
+	as_record* r = r_ref->r;
+	as_partition_digest_node* leaf =
+			&pr->tree->leaves[r->key.digest[AS_PARTITION_DIGEST_LEAF_BYTE]];
+
+	leaf->hash += record_hash(r);
+	leaf->n_records++;
+
+	as_record_done(r_ref, pr->ns);
+
+	// Sleep only once the record lock is released.
+	if (++pr->n_records % THROTTLE_CHECK_RECORDS != 0) {
+		return;
+	}
+
+	uint64_t target_ms = pr->n_records * 1000 /
+			AS_PARTITION_DIGEST_RECORDS_PER_SEC;
+	uint64_t elapsed_ms = cf_getms() - pr->start_ms;
+
+	if (target_ms > elapsed_ms + THROTTLE_SLACK_ms) {
+		usleep((useconds_t)((target_ms - elapsed_ms) * 1000));
+	}
+}
+
+void
+build_parents(pdigest_tree* tree)
+{
+	const uint32_t leaves_per_mid =
+			AS_PARTITION_DIGEST_N_LEAVES / AS_PARTITION_DIGEST_N_MIDS;
+
+	memset(&tree->root, 0, sizeof(tree->root));
+	memset(tree->mids, 0, sizeof(tree->mids));
+
+	for (uint32_t i = 0; i < AS_PARTITION_DIGEST_N_LEAVES; i++) {
+		as_partition_digest_node* mid = &tree->mids[i / leaves_per_mid];
+
+		mid->hash += tree->leaves[i].hash;
+		mid->n_records += tree->leaves[i].n_records;
+	}
+
+	for (uint32_t i = 0; i < AS_PARTITION_DIGEST_N_MIDS; i++) {
+		tree->root.hash += tree->mids[i].hash;
+		tree->root.n_records += tree->mids[i].n_records;
+	}
+}
+
+void
+append_nodes(cf_dyn_buf* db, const as_partition_digest_node* nodes,
+		uint32_t n_nodes)
+{
+	cf_dyn_buf_append_string(db, ":nodes=");
+
+	for (uint32_t i = 0; i < n_nodes; i++) {
+		cf_dyn_buf_append_uint64(db, nodes[i].n_records);
+		cf_dyn_buf_append_char(db, '/');
+		cf_dyn_buf_append_uint64_x(db, nodes[i].hash);
+		cf_dyn_buf_append_char(db, ',');
+	}
+
+	cf_dyn_buf_chomp(db);
+}
+
+static inline bool
+nodes_differ(const as_partition_digest_node* a,
+		const as_partition_digest_node* b)
+{
+	return a->hash != b->hash || a->n_records != b->n_records;
+}
+
+// Descends only into mids that differ, merging adjacent divergent leaves.
+void
+append_divergent_ranges(cf_dyn_buf* db, const pdigest_tree* local,
+		const pdigest_tree* remote)
+{
+	const uint32_t leaves_per_mid =
+			AS_PARTITION_DIGEST_N_LEAVES / AS_PARTITION_DIGEST_N_MIDS;
+	int32_t range_lo = -1;
+	uint32_t range_hi = 0;
+
+	for (uint32_t m = 0; m < AS_PARTITION_DIGEST_N_MIDS; m++) {
+		if (! nodes_differ(&local->mids[m], &remote->mids[m])) {
+			continue;
+		}
+
+		for (uint32_t i = m * leaves_per_mid; i < (m + 1) * leaves_per_mid;
+				i++) {
+			if (! nodes_differ(&local->leaves[i], &remote->leaves[i])) {
+				continue;
+			}
+
+			if (range_lo >= 0 && i == range_hi + 1) {
+				range_hi = i;
+				continue;
+			}
+
+			if (range_lo >= 0) {
+				cf_dyn_buf_append_uint32(db, (uint32_t)range_lo);
+
+				if (range_hi != (uint32_t)range_lo) {
+					cf_dyn_buf_append_char(db, '-');
+					cf_dyn_buf_append_uint32(db, range_hi);
+				}
+
+				cf_dyn_buf_append_char(db, ',');
+			}
+
+			range_lo = (int32_t)i;
+			range_hi = i;
+		}
+	}
+
+	if (range_lo >= 0) {
+		cf_dyn_buf_append_uint32(db, (uint32_t)range_lo);
+
+		if (range_hi != (uint32_t)range_lo) {
+			cf_dyn_buf_append_char(db, '-');
+			cf_dyn_buf_append_uint32(db, range_hi);
+		}
+	}
+}
+
+
+//==========================================================
+// Local helpers - fabric.
+//
+
+int
+pdigest_msg_cb(cf_node src, msg* m, void* udata)
+{
+	uint32_t op;
+
+	if (msg_get_uint32(m, PDIGEST_FIELD_OP, &op) != 0) {
+		cf_warning(AS_PARTITION, "partition digest msg get for op failed");
+		as_fabric_msg_put(m);
+		return 0;
+	}
+
+	switch (op) {
+	case PDIGEST_OP_REQUEST:
+		handle_request(src, m);
+		break;
+	case PDIGEST_OP_RESPONSE:
+		handle_response(m);
+		break;
+	default:
+		cf_warning(AS_PARTITION, "partition digest received unexpected op %u",
+				op);
+		break;
+	}
+
+	as_fabric_msg_put(m);
+
+	return 0;
+}
+
+void
+handle_request(cf_node src, msg* m)
+{
+	pdigest_request req = { .src = src };
+	uint8_t* ns_name;
+	size_t ns_name_len;
+	uint32_t pid;
+
+	if (msg_get_uint64(m, PDIGEST_FIELD_TID, &req.tid) != 0) {
+		cf_warning(AS_PARTITION, "partition digest request has no tid");
+		return;
+	}
+
+	if (msg_get_buf(m, PDIGEST_FIELD_NAMESPACE, &ns_name, &ns_name_len,
+			MSG_GET_DIRECT) != 0 ||
+			! (req.ns = as_namespace_get_bybuf(ns_name, ns_name_len)) ||
+			msg_get_uint32(m, PDIGEST_FIELD_PID, &pid) != 0 ||
+			pid >= AS_PARTITIONS) {
+		send_response(src, req.tid, PDIGEST_RESULT_BAD_NAMESPACE, NULL);
+		return;
+	}
+
+	req.pid = (as_partition_id)pid;
+
+	if (cf_queue_sz(g_request_q) >= MAX_QUEUED_REQUESTS) {
+		send_response(src, req.tid, PDIGEST_RESULT_BUSY, NULL);
+		return;
+	}
+
+	cf_queue_push(g_request_q, &req);
+}
+
+void
+handle_response(msg* m)
+{
+	uint64_t tid;
+	uint32_t result;
+
+	if (msg_get_uint64(m, PDIGEST_FIELD_TID, &tid) != 0 ||
+			msg_get_uint32(m, PDIGEST_FIELD_RESULT, &result) != 0) {
+		cf_warning(AS_PARTITION, "partition digest response missing fields");
+		return;
+	}
+
+	uint8_t* leaves = NULL;
+	size_t leaves_sz = 0;
+
+	if (result == PDIGEST_RESULT_OK &&
+			(msg_get_buf(m, PDIGEST_FIELD_LEAVES, &leaves, &leaves_sz,
+					MSG_GET_DIRECT) != 0 ||
+			leaves_sz != sizeof(((pdigest_waiter*)NULL)->leaves))) {
+		cf_warning(AS_PARTITION, "partition digest response has bad leaves");
+		return;
+	}
+
+	pthread_mutex_lock(&g_waiter_lock);
+
+	for (pdigest_waiter** pp = &g_waiters; *pp; pp = &(*pp)->next) {
+		pdigest_waiter* waiter = *pp;
+
+		if (waiter->tid != tid) {
+			continue;
+		}
+
+		if (leaves) {
+			memcpy(waiter->leaves, leaves, leaves_sz);
+		}
+
+		waiter->result = result;
+		waiter->done = true;
+		*pp = waiter->next;
+
+		pthread_cond_broadcast(&g_waiter_cond);
+		break;
+	}
+
+	// A waiter that timed out is already gone - drop the response.
+	pthread_mutex_unlock(&g_waiter_lock);
+}
+
+void*
+run_pdigest_requests(void* arg)
+{
+	while (true) {
+		pdigest_request req;
+
+		if (cf_queue_pop(g_request_q, &req, CF_QUEUE_FOREVER) !=
+				CF_QUEUE_OK) {
+			continue;
+		}
+
+		pdigest_tree tree;
+
+		compute_tree(req.ns, req.pid, &tree);
+		send_response(req.src, req.tid, PDIGEST_RESULT_OK, &tree);
+	}
+
+	return NULL;
+}
+
+void
+send_response(cf_node dst, uint64_t tid, uint32_t result,
+		const pdigest_tree* tree)
+{
+	msg* m = as_fabric_msg_get(M_TYPE_PARTITION_DIGEST);
+
+	if (! m) {
+		return;
+	}
+
+	msg_set_uint32(m, PDIGEST_FIELD_OP, PDIGEST_OP_RESPONSE);
+	msg_set_uint64(m, PDIGEST_FIELD_TID, tid);
+	msg_set_uint32(m, PDIGEST_FIELD_RESULT, result);
+
+	// Only leaves go on the wire - the requester rebuilds the parents.
+	if (tree) {
+		msg_set_buf(m, PDIGEST_FIELD_LEAVES, (const uint8_t*)tree->leaves,
+				sizeof(tree->leaves), MSG_SET_COPY);
+	}
+
+	if (as_fabric_send(dst, m, AS_FABRIC_PRIORITY_MEDIUM) != 0) {
+		as_fabric_msg_put(m);
+	}
+}
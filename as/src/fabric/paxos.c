@@ -48,6 +48,7 @@
 
 #include "base/cfg.h"
 #include "base/datamodel.h"
+#include "base/index.h"
 #include "base/thr_info.h"
 #include "fabric/fabric.h"
 #include "fabric/hb.h"
@@ -455,6 +456,267 @@ as_paxos_sync_msg_apply(msg *m)
 	return(0);
 }
 
+/*
+ * Compact partition sync tables.
+ *
+ * With paxos-compact-sync, the partition version and size tables for every
+ * (namespace, node) pair travel in one AS_PAXOS_MSG_PARTITION_COMPACT buffer,
+ * in the same order as the PARTITION and PARTITIONSZ array elements they
+ * replace. A table's versions are run-length encoded - a 16-bit run length
+ * followed by the version - since a node's partitions share only a handful of
+ * versions. Sizes (protocol v3 or greater) follow as LEB128 varints. A full
+ * table of 4096 versions and sizes is ~130 KB - typically this is ~10 KB.
+ *
+ * Receivers always accept either encoding, so the option can be switched on
+ * (dynamically) once every node understands the compact field.
+ */
+
+#define COMPACT_VARINT_MAX_SZ 10
+#define COMPACT_TABLE_MAX_SZ (AS_PARTITIONS * (sizeof(uint16_t) + sizeof(as_partition_vinfo) + COMPACT_VARINT_MAX_SZ))
+
+/* compact_table_encode
+ * Encode one table into buf, which must have COMPACT_TABLE_MAX_SZ available;
+ * sizes may be NULL. Returns the number of bytes written. */
+static size_t
+compact_table_encode(uint8_t *buf, const as_partition_vinfo *vi, const uint64_t *sizes)
+{
+	uint8_t *at = buf;
+
+	for (int i = 0; i < AS_PARTITIONS; ) {
+		uint16_t run = 1;
+
+		while (i + run < AS_PARTITIONS &&
+				0 == memcmp(&vi[i], &vi[i + run], sizeof(as_partition_vinfo))) {
+			run++;
+		}
+
+		memcpy(at, &run, sizeof(run));
+		at += sizeof(run);
+		memcpy(at, &vi[i], sizeof(as_partition_vinfo));
+		at += sizeof(as_partition_vinfo);
+
+		i += run;
+	}
+
+	if (sizes) {
+		for (int i = 0; i < AS_PARTITIONS; i++) {
+			uint64_t v = sizes[i];
+
+			while (v >= 0x80) {
+				*at++ = (uint8_t)(v | 0x80);
+				v >>= 7;
+			}
+
+			*at++ = (uint8_t)v;
+		}
+	}
+
+	return (size_t)(at - buf);
+}
+
+/* compact_table_decode
+ * Decode one table; sizes may be NULL. Returns a pointer past the table, or
+ * NULL if the buffer is malformed. */
+static const uint8_t *
+compact_table_decode(const uint8_t *at, const uint8_t *end, as_partition_vinfo *vi, uint64_t *sizes)
+{
+	for (int i = 0; i < AS_PARTITIONS; ) {
+		uint16_t run;
+
+		if ((size_t)(end - at) < sizeof(run) + sizeof(as_partition_vinfo))
+			return(NULL);
+
+		memcpy(&run, at, sizeof(run));
+		at += sizeof(run);
+
+		if (0 == run || i + run > AS_PARTITIONS)
+			return(NULL);
+
+		for (int j = 0; j < run; j++)
+			memcpy(&vi[i + j], at, sizeof(as_partition_vinfo));
+
+		at += sizeof(as_partition_vinfo);
+		i += run;
+	}
+
+	if (sizes) {
+		for (int i = 0; i < AS_PARTITIONS; i++) {
+			uint64_t v = 0;
+			uint32_t shift = 0;
+
+			while (true) {
+				if (at == end || shift > 63)
+					return(NULL);
+
+				uint8_t b = *at++;
+
+				v |= (uint64_t)(b & 0x7F) << shift;
+				shift += 7;
+
+				if (0 == (b & 0x80))
+					break;
+			}
+
+			sizes[i] = v;
+		}
+	}
+
+	return(at);
+}
+
+/* partition_sizes_get
+ * Fill in this node's current record count for each partition of a namespace */
+static void
+partition_sizes_get(int ns_ix, uint64_t *partitionsz)
+{
+	as_namespace *ns = g_config.namespaces[ns_ix];
+
+	for (int j = 0; j < AS_PARTITIONS; j++) {
+		partitionsz[j] = (ns->partitions[j].vp) ? as_index_tree_size(ns->partitions[j].vp) : 0;
+		partitionsz[j] += (ns->partitions[j].sub_vp) ? as_index_tree_size(ns->partitions[j].sub_vp) : 0;
+	}
+}
+
+/* c_partition_vinfo_get
+ * Get the cluster's partition version table for a (namespace, node) pair,
+ * allocating it if necessary */
+static as_partition_vinfo *
+c_partition_vinfo_get(int ns_ix, int node_ix)
+{
+	as_paxos *p = g_paxos;
+	size_t bufsz = sizeof(as_partition_vinfo) * AS_PARTITIONS;
+	as_partition_vinfo *vi = p->c_partition_vinfo[ns_ix][node_ix];
+
+	if (NULL == vi) {
+		vi = cf_rc_alloc(bufsz);
+		cf_assert(vi, AS_PAXOS, CF_CRITICAL, "rc_alloc: %s", cf_strerror(errno));
+		p->c_partition_vinfo[ns_ix][node_ix] = vi;
+	}
+
+	return(vi);
+}
+
+/* as_paxos_partition_sync_request_compact_set
+ * Set this node's partition tables in a partition sync request, compactly */
+static int
+as_paxos_partition_sync_request_compact_set(msg *m)
+{
+	bool with_sizes = AS_PAXOS_PROTOCOL_IS_AT_LEAST_V(3);
+	uint8_t *buf = cf_malloc(g_config.n_namespaces * COMPACT_TABLE_MAX_SZ);
+
+	cf_assert(buf, AS_PAXOS, CF_CRITICAL, "malloc: %s", cf_strerror(errno));
+
+	size_t sz = 0;
+
+	for (int i = 0; i < g_config.n_namespaces; i++) {
+		as_partition_vinfo vi[AS_PARTITIONS];
+		uint64_t partitionsz[AS_PARTITIONS];
+
+		for (int j = 0; j < AS_PARTITIONS; j++)
+			memcpy(&vi[j], &g_config.namespaces[i]->partitions[j].version_info, sizeof(as_partition_vinfo));
+
+		if (with_sizes)
+			partition_sizes_get(i, partitionsz);
+
+		sz += compact_table_encode(buf + sz, vi, with_sizes ? partitionsz : NULL);
+	}
+
+	cf_debug(AS_PAXOS, "compact partition sync request is %zu bytes", sz);
+
+	return(msg_set_buf(m, AS_PAXOS_MSG_PARTITION_COMPACT, buf, sz, MSG_SET_HANDOFF_MALLOC));
+}
+
+/* as_paxos_partition_sync_request_compact_apply
+ * Apply the compact partition tables of a partition sync request */
+static int
+as_paxos_partition_sync_request_compact_apply(const uint8_t *buf, size_t sz, int n_pos)
+{
+	as_paxos *p = g_paxos;
+	bool with_sizes = AS_PAXOS_PROTOCOL_IS_AT_LEAST_V(3);
+	const uint8_t *at = buf;
+	const uint8_t *end = buf + sz;
+
+	for (int i = 0; i < g_config.n_namespaces; i++) {
+		as_partition_vinfo *vi = c_partition_vinfo_get(i, n_pos);
+
+		if (NULL == (at = compact_table_decode(at, end, vi, with_sizes ? p->c_partition_size[i][n_pos] : NULL))) {
+			cf_warning(AS_PAXOS, "unpacking compact partition sync request message failed");
+			return(-1);
+		}
+	}
+
+	if (at != end) {
+		cf_warning(AS_PAXOS, "Different number of namespaces between nodes in same cluster ~~ Please check node configurations");
+		return(-1);
+	}
+
+	return(0);
+}
+
+/* as_paxos_partition_sync_compact_set
+ * Set the whole cluster's partition tables in a partition sync, compactly */
+static int
+as_paxos_partition_sync_compact_set(msg *m, size_t cluster_size)
+{
+	as_paxos *p = g_paxos;
+	bool with_sizes = AS_PAXOS_PROTOCOL_IS_AT_LEAST_V(3);
+	uint8_t *buf = cf_malloc(cluster_size * g_config.n_namespaces * COMPACT_TABLE_MAX_SZ);
+
+	cf_assert(buf, AS_PAXOS, CF_CRITICAL, "malloc: %s", cf_strerror(errno));
+
+	size_t sz = 0;
+
+	for (int i = 0; i < g_config.n_namespaces; i++)
+		for (int j = 0; j < g_config.paxos_max_cluster_size; j++) {
+			if (p->succession[j] == (cf_node)0)
+				continue;
+			as_partition_vinfo *vi = p->c_partition_vinfo[i][j];
+			if (NULL == vi) {
+				cf_warning(AS_PAXOS, "unable to generate partition sync message. no data for [ns=%d][node=%d]", i, j);
+				cf_free(buf);
+				return(-1);
+			}
+			uint64_t *partitionsz = p->c_partition_size[i][j];
+			// populate latest for the self node
+			if (with_sizes && p->succession[j] == g_config.self_node)
+				partition_sizes_get(i, partitionsz);
+			sz += compact_table_encode(buf + sz, vi, with_sizes ? partitionsz : NULL);
+		}
+
+	cf_debug(AS_PAXOS, "compact partition sync is %zu bytes", sz);
+
+	return(msg_set_buf(m, AS_PAXOS_MSG_PARTITION_COMPACT, buf, sz, MSG_SET_HANDOFF_MALLOC));
+}
+
+/* as_paxos_partition_sync_compact_apply
+ * Apply the compact partition tables of a partition sync */
+static int
+as_paxos_partition_sync_compact_apply(const uint8_t *buf, size_t sz)
+{
+	as_paxos *p = g_paxos;
+	bool with_sizes = AS_PAXOS_PROTOCOL_IS_AT_LEAST_V(3);
+	const uint8_t *at = buf;
+	const uint8_t *end = buf + sz;
+
+	for (int i = 0; i < g_config.n_namespaces; i++)
+		for (int j = 0; j < g_config.paxos_max_cluster_size; j++) {
+			if (p->succession[j] == (cf_node)0)
+				continue;
+			as_partition_vinfo *vi = c_partition_vinfo_get(i, j);
+			if (NULL == (at = compact_table_decode(at, end, vi, with_sizes ? p->c_partition_size[i][j] : NULL))) {
+				cf_warning(AS_PAXOS, "unpacking compact partition sync message failed");
+				return(-1);
+			}
+		}
+
+	if (at != end) {
+		cf_warning(AS_PAXOS, "unexpected trailing data in compact partition sync message");
+		return(-1);
+	}
+
+	return(0);
+}
+
 /* as_paxos_partition_sync_request_msg_generate
  * Generate a Paxos partition synchronization request message; returns a pointer to the message,
  * or NULL on error */
@@ -479,6 +741,18 @@ as_paxos_partition_sync_request_msg_generate()
 	if (!AS_PAXOS_PROTOCOL_IS_V(1))
 		e += msg_set_uint32(m, AS_PAXOS_MSG_SUCCESSION_LENGTH, g_config.paxos_max_cluster_size);
 
+	if (g_config.paxos_compact_sync) {
+		e += as_paxos_partition_sync_request_compact_set(m);
+
+		if (0 > e) {
+			cf_warning(AS_PAXOS, "unable to generate sync message");
+			as_fabric_msg_put(m);
+			return(NULL);
+		}
+
+		return(m);
+	}
+
 	/*
 	 * Normally partition locks need to be held for accessing partition vinfo
 	 * In this case, however, migrates are disallowed when we are doing the copy
@@ -524,10 +798,10 @@ as_paxos_partition_sync_request_msg_generate()
 			uint64_t partitionsz[AS_PARTITIONS];
 			for (int j = 0; j < AS_PARTITIONS; j++) {
 				partitionsz[j] = (g_config.namespaces[i]->partitions[j].vp)
-								 ? g_config.namespaces[i]->partitions[j].vp->elements
+								 ? as_index_tree_size(g_config.namespaces[i]->partitions[j].vp)
 								 : 0;
 				partitionsz[j] += (g_config.namespaces[i]->partitions[j].sub_vp)
-								  ? g_config.namespaces[i]->partitions[j].sub_vp->elements
+								  ? as_index_tree_size(g_config.namespaces[i]->partitions[j].sub_vp)
 								  : 0;
 				cf_detail(AS_PAXOS, "Assigning partition size for pid %d, %ld", j, partitionsz[j]);
 			}
@@ -568,6 +842,12 @@ as_paxos_partition_sync_request_msg_apply(msg *m, int n_pos)
 		return -1;
 	}
 
+	uint8_t *compact_buf = NULL;
+	size_t compact_sz = 0;
+
+	if (0 == msg_get_buf(m, AS_PAXOS_MSG_PARTITION_COMPACT, &compact_buf, &compact_sz, MSG_GET_DIRECT) && compact_buf)
+		return(as_paxos_partition_sync_request_compact_apply(compact_buf, compact_sz, n_pos));
+
 	size_t array_size = g_config.n_namespaces;
 
 	int size;
@@ -674,6 +954,22 @@ as_paxos_partition_sync_msg_generate()
 		return(NULL);
 	}
 
+	if (g_config.paxos_compact_sync) {
+		e += as_paxos_partition_sync_compact_set(m, cluster_size);
+
+		if (0 > e) {
+			cf_warning(AS_PAXOS, "unable to generate sync message");
+			as_fabric_msg_put(m);
+			return(NULL);
+		}
+
+		if (cf_context_at_severity(AS_PAXOS, CF_DEBUG)) {
+			dump_partition_state();
+		}
+
+		return(m);
+	}
+
 	size_t array_size = cluster_size * g_config.n_namespaces;
 	cf_debug(AS_PAXOS, "Array Size = %zu", array_size);
 	size_t elem_size = sizeof(as_partition_vinfo) * AS_PARTITIONS;
@@ -726,10 +1022,10 @@ as_paxos_partition_sync_msg_generate()
 				if (p->succession[j] == g_config.self_node) {
 					for (int j = 0; j < AS_PARTITIONS; j++) {
 						partitionsz[j] = (g_config.namespaces[i]->partitions[j].vp)
-										 ? g_config.namespaces[i]->partitions[j].vp->elements
+										 ? as_index_tree_size(g_config.namespaces[i]->partitions[j].vp)
 										 : 0;
 						partitionsz[j] += (g_config.namespaces[i]->partitions[j].sub_vp)
-										  ? g_config.namespaces[i]->partitions[j].sub_vp->elements
+										  ? as_index_tree_size(g_config.namespaces[i]->partitions[j].sub_vp)
 										  : 0;
 						cf_detail(AS_PAXOS, "Assigning partition size for pid %d, %ld", j, partitionsz[j]);
 					}
@@ -814,6 +1110,20 @@ as_paxos_partition_sync_msg_apply(msg *m)
 		return(-1);
 	}
 
+	uint8_t *compact_buf = NULL;
+	size_t compact_sz = 0;
+
+	if (0 == msg_get_buf(m, AS_PAXOS_MSG_PARTITION_COMPACT, &compact_buf, &compact_sz, MSG_GET_DIRECT) && compact_buf) {
+		if (0 != as_paxos_partition_sync_compact_apply(compact_buf, compact_sz))
+			return(-1);
+
+		if (cf_context_at_severity(AS_PAXOS, CF_DEBUG)) {
+			dump_partition_state();
+		}
+
+		return(0);
+	}
+
 	size_t array_size = cluster_size * g_config.n_namespaces;
 
 	int size;
@@ -3385,6 +3695,25 @@ as_paxos_hb_plugin_set_fn(msg* msg)
 		}
 	}
 
+	if (msg->type == M_TYPE_HEARTBEAT) {
+		// With compact payloads, send just a digest of an unchanged
+		// succession list. Only the transmitter thread sets pulse
+		// messages.
+		static as_hb_payload_state payload_state;
+		uint64_t digest =
+		  as_hb_payload_digest(g_paxos->succession, cluster_size);
+
+		if (!as_hb_payload_send_full(&payload_state, digest)) {
+			if (msg_set_uint64(msg, AS_HB_MSG_PAXOS_DATA_DIGEST,
+					   digest) != 0) {
+				cf_crash(AS_PAXOS, "Error setting succession "
+						   "digest on msg.");
+			}
+
+			return;
+		}
+	}
+
 	uint8_t* payload = alloca(
 	  sizeof(uint32_t) // For the paxos version identifier
 	  + (sizeof(cf_node) * cluster_size)); // For the succession list.
@@ -3412,6 +3741,40 @@ as_paxos_hb_plugin_set_fn(msg* msg)
 	as_paxos_hb_msg_succession_set(msg, payload, payload_size);
 }
 
+/**
+ * Plugin function that detects a pulse message carrying only the digest of the
+ * succession list. The previous list is kept, even if the digest does not
+ * match - the next full list will correct it.
+ */
+static bool
+as_paxos_hb_plugin_data_unchanged_fn(msg* msg, cf_node source,
+				     as_hb_plugin_node_data* prev_data)
+{
+	uint64_t digest;
+
+	if (msg->type != M_TYPE_HEARTBEAT ||
+	    msg_is_set(msg, AS_HB_MSG_PAXOS_DATA) ||
+	    msg_get_uint64(msg, AS_HB_MSG_PAXOS_DATA_DIGEST, &digest) != 0) {
+		return false;
+	}
+
+	size_t prev_size = prev_data->data_size > sizeof(size_t)
+			     ? (prev_data->data_size - sizeof(size_t)) /
+				 sizeof(cf_node)
+			     : 0;
+
+	if (as_hb_payload_digest(prev_size == 0
+				   ? NULL
+				   : (cf_node*)(prev_data->data + sizeof(size_t)),
+				 prev_size) != digest) {
+		cf_detail(AS_PAXOS, "succession digest mismatch for node %" PRIx64
+				    " - keeping previous list",
+			  source);
+	}
+
+	return true;
+}
+
 /**
  * Plugin function that parses succession list out of a heartbeat pulse message.
  */
@@ -3531,6 +3894,81 @@ as_paxos_hb_get_principal(cf_node nodeid)
 	return other_succession_list[0];
 }
 
+/**
+ * Set this node's rack-id in an outgoing heartbeat pulse message. Older
+ * heartbeat protocols have no room for it.
+ */
+static void
+as_paxos_hb_rack_plugin_set_fn(msg* msg)
+{
+	if (msg->type != M_TYPE_HEARTBEAT) {
+		return;
+	}
+
+	if (msg_set_uint32(msg, AS_HB_MSG_RACK_ID, g_config.rack_id) != 0) {
+		cf_crash(AS_PAXOS, "Error setting rack-id on msg.");
+	}
+}
+
+/**
+ * Plugin function that parses the rack-id out of a heartbeat pulse message.
+ * Nodes that don't send one are left with no plugin data, i.e. rack-id 0.
+ */
+static void
+as_paxos_hb_rack_plugin_parse_data_fn(msg* msg, cf_node source,
+				      as_hb_plugin_node_data* plugin_data)
+{
+	uint32_t rack_id;
+
+	if (msg->type != M_TYPE_HEARTBEAT ||
+	    msg_get_uint32(msg, AS_HB_MSG_RACK_ID, &rack_id) != 0) {
+		plugin_data->data_size = 0;
+		return;
+	}
+
+	if (plugin_data->data_capacity < sizeof(uint32_t)) {
+		plugin_data->data =
+		  cf_realloc(plugin_data->data, HB_PLUGIN_DATA_BLOCK_SIZE);
+
+		if (plugin_data->data == NULL) {
+			cf_crash(AS_PAXOS,
+				 "Error allocating space for storing rack-id "
+				 "for node %" PRIx64,
+				 source);
+		}
+		plugin_data->data_capacity = HB_PLUGIN_DATA_BLOCK_SIZE;
+	}
+
+	plugin_data->data_size = sizeof(uint32_t);
+	memcpy(plugin_data->data, &rack_id, sizeof(uint32_t));
+}
+
+/**
+ * Get the rack-id of a node from the latest heartbeat pulse.
+ * @return the node's rack-id, or 0 if it's not adjacent or didn't send one.
+ */
+static uint32_t
+as_paxos_hb_get_rack_id(cf_node nodeid)
+{
+	if (nodeid == g_config.self_node) {
+		return g_config.rack_id;
+	}
+
+	void* plugin_data = NULL;
+	uint32_t rack_id = 0;
+
+	if (as_hb_plugin_data_get(nodeid, AS_HB_PLUGIN_RACK, &plugin_data, NULL,
+				  NULL) == sizeof(uint32_t)) {
+		memcpy(&rack_id, plugin_data, sizeof(uint32_t));
+	}
+
+	if (plugin_data) {
+		cf_free(plugin_data);
+	}
+
+	return rack_id;
+}
+
 /* as_paxos_init
  * Initialize the Paxos state structures */
 void
@@ -3570,8 +4008,19 @@ as_paxos_init()
 	paxos_plugin.set_fn = as_paxos_hb_plugin_set_fn;
 	paxos_plugin.parse_fn = as_paxos_hb_plugin_parse_data_fn;
 	paxos_plugin.change_listener = NULL;
+	paxos_plugin.unchanged_fn = as_paxos_hb_plugin_data_unchanged_fn;
 	as_hb_plugin_register(&paxos_plugin);
 
+	/* Register the rack-id plugin for heartbeat subsystem. */
+	as_hb_plugin rack_plugin;
+	memset(&rack_plugin, 0, sizeof(rack_plugin));
+	rack_plugin.id = AS_HB_PLUGIN_RACK;
+	rack_plugin.wire_size_fixed = sizeof(uint32_t);
+	rack_plugin.wire_size_per_node = 0;
+	rack_plugin.set_fn = as_paxos_hb_rack_plugin_set_fn;
+	rack_plugin.parse_fn = as_paxos_hb_rack_plugin_parse_data_fn;
+	as_hb_plugin_register(&rack_plugin);
+
 	/* Register with heartbeat*/
 	as_hb_register_listener(as_paxos_event, NULL);
 
@@ -3658,8 +4107,8 @@ as_paxos_init()
 		/* Initialize the partition sizes array for sending in all Paxos protocol v3 or greater PARTITION_SYNC_REQUEST and PARTITION_SYNC messages. */
 		if (AS_PAXOS_PROTOCOL_IS_AT_LEAST_V(3)) {
 			for (int j = 0; j < AS_PARTITIONS; j++) {
-				p->c_partition_size[i][0][j] = ns->partitions[j].vp ? ns->partitions[j].vp->elements : 0;
-				p->c_partition_size[i][0][j] += ns->partitions[j].sub_vp ? ns->partitions[j].sub_vp->elements : 0;
+				p->c_partition_size[i][0][j] = ns->partitions[j].vp ? as_index_tree_size(ns->partitions[j].vp) : 0;
+				p->c_partition_size[i][0][j] += ns->partitions[j].sub_vp ? as_index_tree_size(ns->partitions[j].sub_vp) : 0;
 			}
 		}
 	}
@@ -3902,3 +4351,30 @@ as_paxos_get_succession_list(cf_dyn_buf *db)
 
 	return 0;
 }
+
+/* as_paxos_get_racks_str
+ * Append the rack-id of each node in the Paxos succession list to the given
+ * "cf_dyn_buf *", as node:rack-id;node:rack-id...
+ */
+void
+as_paxos_get_racks_str(cf_dyn_buf *db)
+{
+	as_paxos *p = g_paxos;
+	size_t db_sz = db->used_sz;
+
+	for (int i = 0; i < g_config.paxos_max_cluster_size; i++) {
+		cf_node node = p->succession[i];
+
+		if ((cf_node) 0 == node)
+			continue;
+
+		cf_dyn_buf_append_uint64_x(db, node);
+		cf_dyn_buf_append_char(db, ':');
+		cf_dyn_buf_append_uint32(db, as_paxos_hb_get_rack_id(node));
+		cf_dyn_buf_append_char(db, ';');
+	}
+
+	if (db_sz != db->used_sz) {
+		cf_dyn_buf_chomp(db);
+	}
+}
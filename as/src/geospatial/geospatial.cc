@@ -22,6 +22,7 @@
 
 #include <errno.h>
 #include <limits.h>
+#include <pthread.h>
 #include <string.h>
 
 #include <stdexcept>
@@ -29,6 +30,8 @@
 #include <s2regioncoverer.h>
 
 extern "C" {
+#include "citrusleaf/cf_digest.h"
+
 #include "fault.h"
 #include "base/datamodel.h"
 } // end extern "C"
@@ -167,6 +170,298 @@ geo_region_cover(as_namespace * ns,
 	}
 }
 
+// Coverings of recently queried regions, direct mapped by digest of the
+// region's GeoJSON and the namespace's coverer settings. Cached coverings have
+// adjacent cell ranges already merged.
+#define COVER_CACHE_SIZE 256
+
+struct CoverCacheEntry
+{
+	pthread_mutex_t	lock;
+	bool			valid;
+	cf_digest		keyd;
+	int				numranges;
+	uint64_t		cellmin[MAX_REGION_CELLS];
+	uint64_t		cellmax[MAX_REGION_CELLS];
+};
+
+static CoverCacheEntry g_cover_cache[COVER_CACHE_SIZE];
+static pthread_once_t g_cover_cache_once = PTHREAD_ONCE_INIT;
+
+static void
+cover_cache_init()
+{
+	for (size_t ii = 0; ii < COVER_CACHE_SIZE; ++ii) {
+		pthread_mutex_init(&g_cover_cache[ii].lock, NULL);
+		g_cover_cache[ii].valid = false;
+	}
+}
+
+// Coverings are sorted by cell id, and leaf cell ids are odd - so a cell
+// whose range starts at the leaf after another's ends is adjacent to it, and
+// one range scan can cover both.
+static int
+merge_cell_ranges(uint64_t * cellminp, uint64_t * cellmaxp, int numcells)
+{
+	int numranges = 0;
+
+	for (int ii = 0; ii < numcells; ++ii) {
+		if (numranges != 0 && cellmaxp[numranges - 1] < UINT64_MAX - 2 &&
+				cellminp[ii] <= cellmaxp[numranges - 1] + 2) {
+			if (cellmaxp[ii] > cellmaxp[numranges - 1]) {
+				cellmaxp[numranges - 1] = cellmaxp[ii];
+			}
+			continue;
+		}
+
+		cellminp[numranges] = cellminp[ii];
+		cellmaxp[numranges] = cellmaxp[ii];
+		++numranges;
+	}
+
+	return numranges;
+}
+
+bool
+geo_region_cover_ranges(as_namespace * ns,
+						const char * buf,
+						size_t bufsz,
+						geo_region_t region,
+						int maxnumranges,
+						uint64_t * cellminp,
+						uint64_t * cellmaxp,
+						int * numrangesp,
+						bool * cachedp)
+{
+	pthread_once(&g_cover_cache_once, cover_cache_init);
+
+	struct {
+		uint32_t min_level;
+		uint32_t max_level;
+		uint32_t max_cells;
+		uint32_t level_mod;
+	} settings = {
+		ns->geo2dsphere_within_min_level,
+		ns->geo2dsphere_within_max_level,
+		ns->geo2dsphere_within_max_cells,
+		ns->geo2dsphere_within_level_mod
+	};
+
+	cf_digest keyd;
+	cf_digest_compute2((void *) buf, bufsz, &settings, sizeof(settings), &keyd);
+
+	CoverCacheEntry * entry =
+			&g_cover_cache[*(uint64_t *) keyd.digest % COVER_CACHE_SIZE];
+
+	*cachedp = false;
+
+	pthread_mutex_lock(&entry->lock);
+
+	if (entry->valid && memcmp(&entry->keyd, &keyd, sizeof(cf_digest)) == 0 &&
+			entry->numranges <= maxnumranges) {
+		memcpy(cellminp, entry->cellmin, entry->numranges * sizeof(uint64_t));
+		memcpy(cellmaxp, entry->cellmax, entry->numranges * sizeof(uint64_t));
+		*numrangesp = entry->numranges;
+		*cachedp = true;
+	}
+
+	pthread_mutex_unlock(&entry->lock);
+
+	if (*cachedp) {
+		return true;
+	}
+
+	uint64_t cellmin[MAX_REGION_CELLS];
+	uint64_t cellmax[MAX_REGION_CELLS];
+	int numcells;
+
+	if (! geo_region_cover(ns, region, MAX_REGION_CELLS, NULL, cellmin,
+			cellmax, &numcells)) {
+		return false;
+	}
+
+	int numranges = merge_cell_ranges(cellmin, cellmax, numcells);
+
+	if (numranges > maxnumranges) {
+		cf_warning(AS_GEO, (char *) "region covered with %d ranges, "
+				   "only %d allowed", numranges, maxnumranges);
+		return false;
+	}
+
+	memcpy(cellminp, cellmin, numranges * sizeof(uint64_t));
+	memcpy(cellmaxp, cellmax, numranges * sizeof(uint64_t));
+	*numrangesp = numranges;
+
+	pthread_mutex_lock(&entry->lock);
+
+	entry->valid = true;
+	entry->keyd = keyd;
+	entry->numranges = numranges;
+	memcpy(entry->cellmin, cellmin, numranges * sizeof(uint64_t));
+	memcpy(entry->cellmax, cellmax, numranges * sizeof(uint64_t));
+
+	pthread_mutex_unlock(&entry->lock);
+
+	return true;
+}
+
+// Geometries of recently matched or indexed GeoJSON values, direct mapped by
+// digest of the GeoJSON. Records' geometries are matched against queries far
+// more often than they change, and parsing dominates the cost of the match.
+// Parsed without namespace context, as for stored particles.
+#define GEOM_CACHE_SIZE 1024
+
+struct GeomCacheEntry
+{
+	pthread_mutex_t	lock;
+	bool			valid;
+	cf_digest		keyd;
+	uint64_t		cellid;
+	S2Region *		regionp;
+	int				numcells;	// < 0 until the region is covered
+	uint64_t		cells[MAX_REGION_CELLS];
+};
+
+static GeomCacheEntry g_geom_cache[GEOM_CACHE_SIZE];
+static pthread_once_t g_geom_cache_once = PTHREAD_ONCE_INIT;
+
+static void
+geom_cache_init()
+{
+	for (size_t ii = 0; ii < GEOM_CACHE_SIZE; ++ii) {
+		pthread_mutex_init(&g_geom_cache[ii].lock, NULL);
+		g_geom_cache[ii].valid = false;
+		g_geom_cache[ii].regionp = NULL;
+	}
+}
+
+// Returns the entry for the GeoJSON locked, parsing it on a miss, or NULL if
+// it doesn't parse to exactly one of a point or a region.
+static GeomCacheEntry *
+geom_cache_get(const char * buf, size_t bufsz)
+{
+	pthread_once(&g_geom_cache_once, geom_cache_init);
+
+	cf_digest keyd;
+	cf_digest_compute((void *) buf, bufsz, &keyd);
+
+	GeomCacheEntry * entry =
+			&g_geom_cache[*(uint64_t *) keyd.digest % GEOM_CACHE_SIZE];
+
+	pthread_mutex_lock(&entry->lock);
+
+	if (entry->valid && memcmp(&entry->keyd, &keyd, sizeof(cf_digest)) == 0) {
+		return entry;
+	}
+
+	uint64_t cellid = 0;
+	geo_region_t region = NULL;
+
+	if (! geo_parse(NULL, buf, bufsz, &cellid, &region)) {
+		pthread_mutex_unlock(&entry->lock);
+		geo_region_destroy(region);
+		return NULL;
+	}
+
+	if ((cellid != 0) == (region != NULL)) {
+		pthread_mutex_unlock(&entry->lock);
+		geo_region_destroy(region);
+		cf_warning(AS_GEO, (char *) "geojson must be one of point or region");
+		return NULL;
+	}
+
+	geo_region_destroy((geo_region_t) entry->regionp);
+
+	entry->valid = true;
+	entry->keyd = keyd;
+	entry->cellid = cellid;
+	entry->regionp = (S2Region *) region;
+	entry->numcells = -1;
+
+	return entry;
+}
+
+bool
+geo_json_point(const char * buf, size_t bufsz, uint64_t * cellidp)
+{
+	GeomCacheEntry * entry = geom_cache_get(buf, bufsz);
+
+	if (! entry) {
+		return false;
+	}
+
+	*cellidp = entry->cellid;
+
+	pthread_mutex_unlock(&entry->lock);
+
+	return true;
+}
+
+bool
+geo_json_region_contains(const char * buf,
+						 size_t bufsz,
+						 uint64_t cellidval,
+						 bool * withinp)
+{
+	GeomCacheEntry * entry = geom_cache_get(buf, bufsz);
+
+	if (! entry) {
+		return false;
+	}
+
+	bool result = entry->regionp != NULL;
+
+	if (result) {
+		*withinp = geo_point_within(cellidval, (geo_region_t) entry->regionp);
+	}
+
+	pthread_mutex_unlock(&entry->lock);
+
+	return result;
+}
+
+bool
+geo_json_region_cover(const char * buf,
+					  size_t bufsz,
+					  int maxnumcells,
+					  uint64_t * cellctrp,
+					  int * numcellsp)
+{
+	GeomCacheEntry * entry = geom_cache_get(buf, bufsz);
+
+	if (! entry) {
+		return false;
+	}
+
+	if (! entry->regionp) {
+		pthread_mutex_unlock(&entry->lock);
+		return false;
+	}
+
+	if (entry->numcells < 0 && ! geo_region_cover(NULL,
+			(geo_region_t) entry->regionp, MAX_REGION_CELLS, entry->cells,
+			NULL, NULL, &entry->numcells)) {
+		entry->numcells = -1;
+		pthread_mutex_unlock(&entry->lock);
+		return false;
+	}
+
+	bool result = entry->numcells <= maxnumcells;
+
+	if (result) {
+		memcpy(cellctrp, entry->cells, entry->numcells * sizeof(uint64_t));
+		*numcellsp = entry->numcells;
+	}
+	else {
+		cf_warning(AS_GEO, (char *) "region covered with %d cells, "
+				   "only %d allowed", entry->numcells, maxnumcells);
+	}
+
+	pthread_mutex_unlock(&entry->lock);
+
+	return result;
+}
+
 bool
 geo_point_centers(as_namespace * ns,
 				  uint64_t cellidval,
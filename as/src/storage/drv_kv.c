@@ -30,6 +30,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <pthread.h>
 #include <stdbool.h>
 #include <stddef.h>
@@ -41,6 +42,8 @@
 #include "citrusleaf/cf_atomic.h"
 #include "citrusleaf/cf_clock.h"
 #include "citrusleaf/cf_queue.h"
+
+#include "base/cfg.h"
 #endif
 
 #include <stdint.h>
@@ -96,6 +99,16 @@
 // Define to use the KV exists API:
 #define USE_KV_EXISTS
 
+// Define to group concurrent puts into batches submitted by a per-device thread:
+#define USE_KV_PUT_PIPELINE
+
+// Define to keep a per-device Bloom filter of stored digests, so misses skip the device:
+#define USE_KV_BLOOM
+
+#if defined(USE_KV_BATCH_PUT) && defined(USE_KV_PUT_PIPELINE)
+#error "USE_KV_BATCH_PUT and USE_KV_PUT_PIPELINE are mutually exclusive"
+#endif
+
 // Define to perform extra read verification checks:
 //#define EXTRA_CHECKS
 
@@ -126,6 +139,20 @@ const uint32_t KV_API_VERSION = 1;
  */
 const uint32_t KV_INITIAL_NUM_IO_VECTORS = 10000;
 
+/*
+ *  Most puts the pipeline thread submits in one batch.
+ */
+#define KV_PIPELINE_MAX_PUTS 256
+
+/*
+ *  Device bytes per Bloom filter bit - about 10 bits per 1K record, 0.1% of
+ *  device size in memory.
+ */
+#define KV_BLOOM_BYTES_PER_BIT 128
+#define KV_BLOOM_MIN_BITS (1UL << 20)
+#define KV_BLOOM_N_PROBES 4
+#define KV_BLOOM_MAGIC 0x4B56424C // "KVBL"
+
 
 /*
  *  Define Types.
@@ -169,6 +196,25 @@ typedef struct drv_kv_s {
 	uint32_t        open_flag;     // "open(2)" flags for this KV device.
 	off_t           file_size;     // Size in bytes of this KV device.
 	char            name[512];     // Name of this KV device.
+#ifdef USE_KV_PUT_PIPELINE
+	bool            pipelined;     // Puts go through the pipeline (batch API ignores put metadata).
+	pthread_mutex_t put_lock;      // Lock for the batch being filled.
+	pthread_cond_t  put_cond;      // Signals new puts to the pipeline thread, and done batches to writers.
+	kv_iovec_t     *put_iovs;      // Batch being filled - points at the writers' own buffers.
+	kv_iovec_t     *submit_iovs;   // Batch being submitted.
+	uint32_t        n_puts;        // Puts in the batch being filled.
+	uint64_t        fill_seq;      // Sequence number of the batch being filled.
+	uint64_t        done_seq;      // Sequence number of the last batch submitted.
+	uint64_t        n_batches;     // Batches submitted.
+	uint64_t        n_batched_puts; // Puts submitted in batches.
+	pthread_t       pipeline_thread;
+#endif
+#ifdef USE_KV_BLOOM
+	uint64_t       *bloom;         // Bloom filter of stored digests.
+	uint64_t        bloom_mask;    // Number of bits minus 1 - a power of 2.
+	bool            bloom_trusted; // Covers every stored digest - false until loaded from a clean shutdown.
+	cf_atomic64     n_bloom_misses; // Lookups the filter answered without device I/O.
+#endif
 #ifdef USE_KV_BATCH_PUT
 	int             blocks_alloc;  // Number of write blocks allocated.
 	int             curr_block;    // Currently active write block index.
@@ -325,6 +371,266 @@ kv_get_file_id(drv_kvs *kvs, cf_digest *keyd)
 	return(keyd->digest[8] % kvs->n_kvs);
 }
 
+#ifdef USE_KV_BLOOM
+/*
+ *  Bloom filter of the digests stored on a KV device.  Digests are already
+ *  uniformly random, so probes are derived straight from them.  Nothing deletes
+ *  from a KV device, so bits are never cleared.  The filter is saved at clean
+ *  shutdown - until one is loaded at startup it can't rule keys out.
+ */
+
+typedef struct kv_bloom_file_header_s {
+	uint32_t        magic;
+	uint32_t        pad;
+	uint64_t        n_bits;
+} kv_bloom_file_header;
+
+static inline void
+kv_bloom_probes(const cf_digest *keyd, uint64_t *h1, uint64_t *h2)
+{
+	memcpy(h1, &keyd->digest[0], sizeof(uint64_t));
+	memcpy(h2, &keyd->digest[CF_DIGEST_KEY_SZ - sizeof(uint64_t)], sizeof(uint64_t));
+	*h2 |= 1; // odd, so probes don't repeat
+}
+
+static void
+kv_bloom_add(drv_kv *kv, const cf_digest *keyd)
+{
+	uint64_t h1, h2;
+
+	kv_bloom_probes(keyd, &h1, &h2);
+
+	for (int i = 0; i < KV_BLOOM_N_PROBES; i++) {
+		uint64_t bit = (h1 + i * h2) & kv->bloom_mask;
+		uint64_t mask = 1UL << (bit & 63);
+		uint64_t *word = &kv->bloom[bit >> 6];
+
+		// Re-writes are common - don't dirty the cache line if already set.
+		if (! (*word & mask)) {
+			__sync_fetch_and_or(word, mask);
+		}
+	}
+}
+
+// Returns true only if the digest is definitely not on the device.
+static bool
+kv_bloom_rules_out(drv_kv *kv, const cf_digest *keyd)
+{
+	if (! kv->bloom_trusted) {
+		return(false);
+	}
+
+	uint64_t h1, h2;
+
+	kv_bloom_probes(keyd, &h1, &h2);
+
+	for (int i = 0; i < KV_BLOOM_N_PROBES; i++) {
+		uint64_t bit = (h1 + i * h2) & kv->bloom_mask;
+
+		if (! (kv->bloom[bit >> 6] & (1UL << (bit & 63)))) {
+			cf_atomic64_incr(&kv->n_bloom_misses);
+			return(true);
+		}
+	}
+
+	return(false);
+}
+
+static void
+kv_bloom_path(as_namespace *ns, int kv_ix, char *path, size_t path_len)
+{
+	snprintf(path, path_len, "%s/%s-kv-%d.bloom", g_config.work_directory,
+			ns->name, kv_ix);
+}
+
+static void
+kv_bloom_init(as_namespace *ns, drv_kv *kv, int kv_ix)
+{
+	uint64_t n_bits = KV_BLOOM_MIN_BITS;
+
+	while (n_bits < (uint64_t)kv->file_size / KV_BLOOM_BYTES_PER_BIT) {
+		n_bits <<= 1;
+	}
+
+	if (!(kv->bloom = cf_calloc(n_bits / 64, sizeof(uint64_t))))
+	  cf_crash(AS_DRV_KV, "failed to cf_calloc() a Bloom filter of %lu bits", n_bits);
+
+	kv->bloom_mask = n_bits - 1;
+	kv->bloom_trusted = false;
+
+	char path[PATH_MAX];
+
+	kv_bloom_path(ns, kv_ix, path, sizeof(path));
+
+	int fd = open(path, O_RDONLY);
+
+	if (-1 == fd) {
+		cf_info(AS_DRV_KV, "KV device: \"%s\" no saved Bloom filter - not used until next clean restart", kv->name);
+		return;
+	}
+
+	kv_bloom_file_header header;
+	size_t bloom_size = n_bits / 8;
+
+	if (read(fd, &header, sizeof(header)) == sizeof(header) &&
+			header.magic == KV_BLOOM_MAGIC && header.n_bits == n_bits &&
+			read(fd, kv->bloom, bloom_size) == (ssize_t)bloom_size) {
+		kv->bloom_trusted = true;
+		cf_info(AS_DRV_KV, "KV device: \"%s\" loaded Bloom filter of %lu bits", kv->name, n_bits);
+	}
+	else {
+		memset(kv->bloom, 0, bloom_size);
+		cf_warning(AS_DRV_KV, "KV device: \"%s\" saved Bloom filter doesn't match - not used until next clean restart", kv->name);
+	}
+
+	close(fd);
+
+	// Writes from now on aren't in the file - only a clean shutdown may save
+	// a filter to trust again.
+	unlink(path);
+}
+
+static void
+kv_bloom_save(as_namespace *ns, drv_kv *kv, int kv_ix)
+{
+	char path[PATH_MAX];
+
+	kv_bloom_path(ns, kv_ix, path, sizeof(path));
+
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+
+	if (-1 == fd) {
+		cf_warning(AS_DRV_KV, "unable to save Bloom filter \"%s\": %s", path, cf_strerror(errno));
+		return;
+	}
+
+	kv_bloom_file_header header = { KV_BLOOM_MAGIC, 0, kv->bloom_mask + 1 };
+	size_t bloom_size = (kv->bloom_mask + 1) / 8;
+
+	if (write(fd, &header, sizeof(header)) != sizeof(header) ||
+			write(fd, kv->bloom, bloom_size) != (ssize_t)bloom_size ||
+			fsync(fd) != 0) {
+		cf_warning(AS_DRV_KV, "unable to save Bloom filter \"%s\": %s", path, cf_strerror(errno));
+		close(fd);
+		unlink(path);
+		return;
+	}
+
+	close(fd);
+}
+#endif
+
+#ifdef USE_KV_PUT_PIPELINE
+/*
+ *  Put pipeline - writers add their puts to the batch being filled and wait,
+ *  while a per-device thread submits each batch in one kv_batch_put().  Puts
+ *  from concurrent writers share device submissions, and a put is still on the
+ *  device when its writer returns.
+ */
+static void *
+run_kv_pipeline(void *udata)
+{
+	drv_kv *kv = (drv_kv *) udata;
+
+	while (true) {
+		pthread_mutex_lock(&kv->put_lock);
+
+		while (0 == kv->n_puts)
+		  pthread_cond_wait(&kv->put_cond, &kv->put_lock);
+
+		// Take the batch - writers start filling the other buffer.
+		kv_iovec_t *iovs = kv->put_iovs;
+		uint32_t n_puts = kv->n_puts;
+		uint64_t seq = kv->fill_seq++;
+
+		kv->put_iovs = kv->submit_iovs;
+		kv->submit_iovs = iovs;
+		kv->n_puts = 0;
+
+		// Wake writers waiting for room.
+		pthread_cond_broadcast(&kv->put_cond);
+		pthread_mutex_unlock(&kv->put_lock);
+
+		int kv_h = kv_h_get(kv);
+		int rv;
+
+		if (0 > (rv = kv_batch_put(kv_h, iovs, n_puts)))
+		  cf_crash(AS_DRV_KV, "kv_batch_put() on device: \"%s\" returned %d with %u iovectors, errno = %d", kv->name, rv, n_puts, errno);
+
+#ifdef USE_KV_H_Q
+		kv_h_put(kv, kv_h);
+#endif
+
+		pthread_mutex_lock(&kv->put_lock);
+
+		kv->done_seq = seq;
+		kv->n_batches++;
+		kv->n_batched_puts += n_puts;
+
+		pthread_cond_broadcast(&kv->put_cond);
+		pthread_mutex_unlock(&kv->put_lock);
+	}
+
+	return(NULL);
+}
+
+// Add a put to the batch being filled, and wait until it's on the device.
+static int
+kv_pipeline_put(drv_kv *kv, kv_key_t *key, uint32_t key_len, void *value, uint32_t value_len)
+{
+	pthread_mutex_lock(&kv->put_lock);
+
+	while (kv->n_puts == KV_PIPELINE_MAX_PUTS)
+	  pthread_cond_wait(&kv->put_cond, &kv->put_lock);
+
+	kv_iovec_t *iov = &kv->put_iovs[kv->n_puts++];
+
+	iov->key = key;
+	iov->key_len = key_len;
+	iov->value = value;
+	iov->value_len = value_len;
+
+	uint64_t seq = kv->fill_seq;
+
+	pthread_cond_broadcast(&kv->put_cond);
+
+	while (kv->done_seq < seq)
+	  pthread_cond_wait(&kv->put_cond, &kv->put_lock);
+
+	pthread_mutex_unlock(&kv->put_lock);
+
+	return((int) value_len);
+}
+
+static void
+kv_pipeline_init(as_namespace *ns, drv_kv *kv)
+{
+	// The batch API ignores put metadata - conditional writes need kv_put().
+	kv->pipelined = ! ns->cond_write;
+
+	if (! kv->pipelined) {
+		cf_info(AS_DRV_KV, "KV device: \"%s\" conditional writes - not pipelining puts", kv->name);
+		return;
+	}
+
+	size_t size = sizeof(kv_iovec_t) * KV_PIPELINE_MAX_PUTS;
+
+	if (!(kv->put_iovs = (kv_iovec_t *) cf_malloc(size)) ||
+			!(kv->submit_iovs = (kv_iovec_t *) cf_malloc(size)))
+	  cf_crash(AS_DRV_KV, "failed to cf_malloc() IO vectors of size %zu", size);
+
+	kv->n_puts = 0;
+	kv->fill_seq = 1;
+	kv->done_seq = 0;
+
+	pthread_mutex_init(&kv->put_lock, NULL);
+	pthread_cond_init(&kv->put_cond, NULL);
+
+	if (0 != pthread_create(&kv->pipeline_thread, NULL, run_kv_pipeline, (void *) kv))
+	  cf_crash(AS_DRV_KV, "unable to create put pipeline thread for KV device: \"%s\"", kv->name);
+}
+#endif
+
 #ifdef USE_KV_BATCH_PUT
 /*
  *  Send a batch of puts to the KV device.
@@ -416,6 +722,10 @@ kv_put_batch(drv_kv *kv, int vsl_fd, kv_key_t *key, uint32_t key_len, void *valu
 
 	return(rv);
 #else
+#ifdef USE_KV_PUT_PIPELINE
+	if (kv->pipelined)
+	  return(kv_pipeline_put(kv, key, key_len, value, value_len));
+#endif
 	// Do a single put ~~ Effectively use a batch of size 1.
 	return(kv_put(vsl_fd, key, key_len, value, value_len, pool_id, expiry, replace, gen_count));
 #endif
@@ -561,6 +871,10 @@ kv_write(as_record *r, as_storage_rd *rd)
 	  cf_warning(AS_DRV_KV, "kv_put_batch() on device: \"%s\" wrote only %d of %d bytes", kv->name, num_written, data_size);
 
 	cf_detail(AS_DRV_KV, "kv_put_batch() on device: \"%s\" wrote %d bytes", kv->name, num_written);
+
+#ifdef USE_KV_BLOOM
+	kv_bloom_add(kv, &rd->keyd);
+#endif
 	
 #ifdef USE_KV_H_Q
 	// Return the KV handle to the queue.
@@ -592,6 +906,13 @@ kv_read(as_storage_rd *rd, uint8_t *read_buf, uint32_t read_size)
 	}
 	drv_kv *kv = rd->u.kv.kv;
 
+#ifdef USE_KV_BLOOM
+	if (kv_bloom_rules_out(kv, &rd->keyd)) {
+		cf_detail(AS_DRV_KV, "kv_read():  Key not in Bloom filter ~~ No problem-o.\n");
+		return((ssize_t) -FIO_ERR_OBJECT_NOT_FOUND);
+	}
+#endif
+
 	// Get the KV handle from the queue.
 	int kv_h = kv_h_get(kv);
 
@@ -792,6 +1113,13 @@ as_storage_namespace_init_kv(as_namespace *ns, cf_queue *complete_q, void *udata
 
 		cf_info(AS_DRV_KV, "Yay!! kv_create() succeeded on KV device: \"%s\" in namespace: \"%s\"! Returned kv_h: %d",
 				kv->name, ns->name, kv_h);
+
+#ifdef USE_KV_BLOOM
+		kv_bloom_init(ns, kv, i);
+#endif
+#ifdef USE_KV_PUT_PIPELINE
+		kv_pipeline_init(ns, kv);
+#endif
 	}
 
 	cf_queue_push(complete_q, &udata);
@@ -811,6 +1139,9 @@ as_storage_namespace_destroy_kv(as_namespace *ns)
 		// First, flush out any pending batch data.
 		// XXX -- Make sure this is multithread safe!!  What thread would call this function anyway??
 		kv_batch_flush(kv);
+#endif
+#ifdef USE_KV_BLOOM
+		cf_free(kv->bloom);
 #endif
 		int fd;
 		do {
@@ -872,6 +1203,11 @@ as_storage_record_exists_kv(as_namespace *ns, cf_digest *keyd)
 	int file_id = kv_get_file_id(kvs, keyd);
 	drv_kv *kv = &kvs->kvs[file_id];
 
+#ifdef USE_KV_BLOOM
+	if (kv_bloom_rules_out(kv, keyd))
+	  return(false);
+#endif
+
 	// Get the KV handle from the queue.
 	int kv_h = kv_h_get(kv);
 
@@ -1059,8 +1395,10 @@ as_storage_record_read_kv(as_storage_rd *rd)
 	cf_detail(AS_DRV_KV, "kv_read() with read_size %d returned %zd", read_size, rv);
 
 	// Just return any error code, such as record not found.
-	if (0 > rv)
-	  return(rv);
+	if (0 > rv) {
+		cf_free(read_buf);
+		return(rv);
+	}
 
 	// two good checks now that we have index records independent of the data records
 	drv_kv_block *block = (drv_kv_block *)read_buf;
@@ -1178,6 +1516,22 @@ as_storage_stats_kv(as_namespace *ns, int *available_pct, uint64_t *used_disk_by
 	return(0);
 }
 
+/*
+ *  Called at clean shutdown, with all record locks held so no puts are in
+ *  flight - pipelined puts are on the device before their writers return.
+ */
+void
+as_storage_shutdown_kv(as_namespace *ns)
+{
+#ifdef USE_KV_BLOOM
+	drv_kvs *kvs = (drv_kvs *) ns->storage_private;
+
+	// Only a filter saved now covers everything on the device.
+	for (int i = 0; i < kvs->n_kvs; i++)
+	  kv_bloom_save(ns, &kvs->kvs[i], i);
+#endif
+}
+
 #else
 
 // Define stubs for building without the KV API.
@@ -1293,4 +1647,10 @@ as_storage_stats_kv(as_namespace *ns, int *available_pct, uint64_t *used_disk_by
 	return 0;
 }
 
+void
+as_storage_shutdown_kv(as_namespace *ns)
+{
+	error_out();
+}
+
 #endif // defined(USE_KV)
@@ -25,12 +25,31 @@
  *
  */
 
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
 
+#include "citrusleaf/alloc.h"
+#include "citrusleaf/cf_atomic.h"
+#include "citrusleaf/cf_clock.h"
+#include "citrusleaf/cf_digest.h"
 #include "citrusleaf/cf_queue.h"
 
+#include "fault.h"
+
 #include "base/datamodel.h"
+#include "base/expire_index.h"
+#include "base/incr_hist.h"
+#include "base/index.h"
+#include "base/rec_props.h"
+#include "base/truncate.h"
 #include "storage/storage.h"
 
 
@@ -46,9 +65,17 @@
  * context rather than a transient main memory context.  (tjl)
  */
 
+static void snapshot_load(as_namespace *ns);
+static void snapshot_start(as_namespace *ns);
+
 int
 as_storage_namespace_init_memory(as_namespace *ns, cf_queue *complete_q, void *udata)
 {
+	if (ns->memory_snapshot_dir) {
+		snapshot_load(ns);
+		snapshot_start(ns);
+	}
+
 	cf_queue_push(complete_q, &udata);
 	return(0);
 }
@@ -77,3 +104,699 @@ as_storage_stats_memory(as_namespace *ns, int *available_pct, uint64_t *used_dis
 	}
 	return(0);
 }
+
+
+
+/* SYNOPSIS
+ * Optional snapshots of a namespace to local files, so a restart can reload
+ * the data instead of waiting for it to be refilled from elsewhere.
+ *
+ * A snapshot is one file per partition, "<dir>/<ns>.<pid>.snap", written to a
+ * temporary file renamed into place once complete. Each file holds a header
+ * with the partition's version, the partition's records - digest, metadata,
+ * rec-props and bins pickled as for migration - and a trailer with the record
+ * count and a crc32 of the records. Partitions that have no version (or no
+ * records) have their file removed.
+ *
+ * Snapshots are taken every memory-snapshot-period seconds, and at shutdown.
+ * Several threads write partitions concurrently. Each record is pickled under
+ * its own record lock, and written after the lock is released, so nothing
+ * waits on the file I/O. Periodic snapshots are paced to
+ * memory-snapshot-max-write-rate - the shutdown snapshot isn't.
+ *
+ * At startup, several threads load the partition files before the namespace
+ * is reported loaded. A file whose header, trailer or crc doesn't check out
+ * is ignored. Expired and truncated records are skipped. The versions of
+ * partitions loaded are reported as this namespace's stored partition
+ * versions, so they rejoin the cluster as a device namespace's would. Note -
+ * like writes in an unflushed device write buffer, writes made after a
+ * partition's last snapshot are lost if the node goes down.
+ */
+
+//==========================================================
+// Constants.
+//
+
+#define SNAPSHOT_MAGIC		0x4D4E5350 // "PSNM"
+#define SNAPSHOT_VERSION	1
+
+#define SNAPSHOT_BUF_SZ		(1024 * 1024)
+
+
+//==========================================================
+// Typedefs.
+//
+
+typedef struct snapshot_header_s {
+	uint32_t			magic;
+	uint32_t			version;
+	char				ns_name[AS_ID_NAMESPACE_SZ];
+	uint32_t			pid;
+	uint32_t			unused;
+	as_partition_vinfo	vinfo;
+} snapshot_header;
+
+typedef struct snapshot_record_s {
+	cf_digest			keyd;
+	uint16_t			generation;
+	uint16_t			unused;
+	uint32_t			void_time;
+	uint64_t			last_update_time;
+	uint32_t			rec_props_sz;
+	uint32_t			bins_sz;
+} __attribute__ ((__packed__)) snapshot_record;
+
+typedef struct snapshot_trailer_s {
+	uint32_t			magic;
+	uint32_t			crc;
+	uint64_t			n_records;
+} snapshot_trailer;
+
+// Hangs from ns->storage_private when snapshots are configured.
+typedef struct drv_memory_s {
+	as_partition_vinfo	vinfo[AS_PARTITIONS]; // loaded at startup
+
+	pthread_mutex_t		lock; // one snapshot at a time
+	volatile bool		shutdown;
+
+	// Per snapshot or load.
+	cf_atomic32			next_pid;
+	bool				paced;
+	uint64_t			start_us;
+	cf_atomic64			n_bytes;
+	cf_atomic64			n_records;
+} drv_memory;
+
+typedef struct snapshot_writer_s {
+	as_namespace		*ns;
+	FILE				*fh;
+	bool				ok;
+	uint32_t			crc;
+	uint64_t			n_records;
+} snapshot_writer;
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static void snapshot_save(as_namespace *ns, bool paced);
+static void *run_snapshot_period(void *udata);
+static void *run_snapshot_save(void *udata);
+static void *run_snapshot_load(void *udata);
+static void run_snapshot_threads(as_namespace *ns, void *(*fn)(void *));
+static void snapshot_path(const as_namespace *ns, uint32_t pid, bool tmp, char *path);
+static bool save_partition(as_namespace *ns, uint32_t pid);
+static void save_reduce_cb(as_index_ref *r_ref, void *udata);
+static bool write_piece(snapshot_writer *w, const void *buf, size_t sz);
+static void pace(as_namespace *ns, uint64_t n_bytes);
+static void load_partition(as_namespace *ns, uint32_t pid);
+static bool load_record(as_namespace *ns, as_partition *p, const snapshot_record *sr, uint8_t *rec_props_data, uint8_t *bins);
+
+
+//==========================================================
+// Public API.
+//
+
+int
+as_storage_info_get_memory(as_namespace *ns, uint idx, uint8_t *buf, size_t *len)
+{
+	drv_memory *drv = (drv_memory *)ns->storage_private;
+
+	if (! drv || idx >= AS_PARTITIONS || *len < sizeof(as_partition_vinfo)) {
+		return -1;
+	}
+
+	memcpy(buf, &drv->vinfo[idx], sizeof(as_partition_vinfo));
+	*len = sizeof(as_partition_vinfo);
+
+	return 0;
+}
+
+void
+as_storage_shutdown_memory(as_namespace *ns)
+{
+	drv_memory *drv = (drv_memory *)ns->storage_private;
+
+	if (! drv) {
+		return;
+	}
+
+	// Also stops the pacing of a periodic snapshot in progress, if any.
+	drv->shutdown = true;
+
+	snapshot_save(ns, false);
+}
+
+
+//==========================================================
+// Local helpers - snapshot scheduling.
+//
+
+static void
+snapshot_load(as_namespace *ns)
+{
+	drv_memory *drv = cf_malloc(sizeof(drv_memory));
+
+	if (! drv) {
+		cf_crash(AS_STORAGE, "{%s} failed memory snapshot alloc", ns->name);
+	}
+
+	memset(drv, 0, sizeof(drv_memory));
+	pthread_mutex_init(&drv->lock, NULL);
+
+	if (access(ns->memory_snapshot_dir, R_OK | W_OK | X_OK) != 0) {
+		cf_crash_nostack(AS_STORAGE, "{%s} can't use memory-snapshot-dir %s: %s",
+				ns->name, ns->memory_snapshot_dir, cf_strerror(errno));
+	}
+
+	ns->storage_private = drv;
+
+	cf_info(AS_STORAGE, "{%s} loading memory snapshot from %s ...", ns->name,
+			ns->memory_snapshot_dir);
+
+	uint64_t start_ms = cf_getms();
+
+	run_snapshot_threads(ns, run_snapshot_load);
+
+	ns->memory_snapshot_loaded_records = cf_atomic64_get(drv->n_records);
+
+	cf_info(AS_STORAGE, "{%s} loaded %lu records from memory snapshot in %lu ms",
+			ns->name, ns->memory_snapshot_loaded_records,
+			cf_getms() - start_ms);
+}
+
+static void
+snapshot_start(as_namespace *ns)
+{
+	if (ns->memory_snapshot_period == 0) {
+		return;
+	}
+
+	pthread_attr_t attrs;
+	pthread_t thread;
+
+	pthread_attr_init(&attrs);
+	pthread_attr_setdetachstate(&attrs, PTHREAD_CREATE_DETACHED);
+
+	if (pthread_create(&thread, &attrs, run_snapshot_period, ns) != 0) {
+		cf_crash(AS_STORAGE, "{%s} failed to create memory snapshot thread",
+				ns->name);
+	}
+
+	pthread_attr_destroy(&attrs);
+}
+
+static void
+snapshot_save(as_namespace *ns, bool paced)
+{
+	drv_memory *drv = (drv_memory *)ns->storage_private;
+
+	pthread_mutex_lock(&drv->lock);
+
+	cf_info(AS_STORAGE, "{%s} saving memory snapshot to %s ...", ns->name,
+			ns->memory_snapshot_dir);
+
+	uint64_t start_ms = cf_getms();
+
+	drv->paced = paced && ns->memory_snapshot_max_write_rate != 0;
+	run_snapshot_threads(ns, run_snapshot_save);
+
+	ns->memory_snapshot_last_ms = cf_getms() - start_ms;
+	ns->memory_snapshot_last_records = cf_atomic64_get(drv->n_records);
+	ns->memory_snapshot_last_bytes = cf_atomic64_get(drv->n_bytes);
+	ns->memory_snapshot_count++;
+
+	cf_info(AS_STORAGE, "{%s} saved %lu records (%lu bytes) to memory snapshot in %lu ms",
+			ns->name, ns->memory_snapshot_last_records,
+			ns->memory_snapshot_last_bytes, ns->memory_snapshot_last_ms);
+
+	pthread_mutex_unlock(&drv->lock);
+}
+
+static void *
+run_snapshot_period(void *udata)
+{
+	as_namespace *ns = (as_namespace *)udata;
+	drv_memory *drv = (drv_memory *)ns->storage_private;
+
+	while (true) {
+		// Sleep a second at a time, so shutdown isn't missed for long.
+		for (uint32_t i = 0; i < ns->memory_snapshot_period; i++) {
+			if (drv->shutdown) {
+				return NULL;
+			}
+
+			sleep(1);
+		}
+
+		if (drv->shutdown) {
+			return NULL;
+		}
+
+		snapshot_save(ns, true);
+	}
+
+	return NULL;
+}
+
+static void *
+run_snapshot_save(void *udata)
+{
+	as_namespace *ns = (as_namespace *)udata;
+	drv_memory *drv = (drv_memory *)ns->storage_private;
+	uint32_t pid;
+
+	while ((pid = cf_atomic32_incr(&drv->next_pid) - 1) < AS_PARTITIONS) {
+		if (! save_partition(ns, pid)) {
+			// Leave the previous file (if any) in place - it's still intact.
+			cf_warning(AS_STORAGE, "{%s} failed memory snapshot of partition %u",
+					ns->name, pid);
+		}
+	}
+
+	return NULL;
+}
+
+static void *
+run_snapshot_load(void *udata)
+{
+	as_namespace *ns = (as_namespace *)udata;
+	drv_memory *drv = (drv_memory *)ns->storage_private;
+	uint32_t pid;
+
+	while ((pid = cf_atomic32_incr(&drv->next_pid) - 1) < AS_PARTITIONS) {
+		load_partition(ns, pid);
+	}
+
+	return NULL;
+}
+
+static void
+run_snapshot_threads(as_namespace *ns, void *(*fn)(void *))
+{
+	drv_memory *drv = (drv_memory *)ns->storage_private;
+
+	cf_atomic32_set(&drv->next_pid, 0);
+	cf_atomic64_set(&drv->n_bytes, 0);
+	cf_atomic64_set(&drv->n_records, 0);
+	drv->start_us = cf_getus();
+
+	uint32_t n_threads = ns->memory_snapshot_threads;
+	pthread_t threads[n_threads];
+
+	for (uint32_t i = 0; i < n_threads; i++) {
+		if (pthread_create(&threads[i], NULL, fn, ns) != 0) {
+			cf_crash(AS_STORAGE, "{%s} failed to create memory snapshot thread",
+					ns->name);
+		}
+	}
+
+	for (uint32_t i = 0; i < n_threads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+}
+
+static void
+snapshot_path(const as_namespace *ns, uint32_t pid, bool tmp, char *path)
+{
+	snprintf(path, PATH_MAX, "%s/%s.%u.snap%s", ns->memory_snapshot_dir,
+			ns->name, pid, tmp ? ".tmp" : "");
+}
+
+
+//==========================================================
+// Local helpers - save.
+//
+
+static bool
+save_partition(as_namespace *ns, uint32_t pid)
+{
+	char path[PATH_MAX];
+
+	snapshot_path(ns, pid, false, path);
+
+	as_partition_reservation rsv;
+
+	as_partition_reserve_migrate(ns, pid, &rsv, NULL);
+
+	// Without a version the records couldn't be trusted on reload anyway.
+	if (is_partition_null(&rsv.vinfo) || as_index_tree_size(rsv.tree) == 0) {
+		as_partition_release(&rsv);
+
+		if (unlink(path) != 0 && errno != ENOENT) {
+			cf_warning(AS_STORAGE, "failed to remove %s: %s", path,
+					cf_strerror(errno));
+		}
+
+		return true;
+	}
+
+	char tmp_path[PATH_MAX];
+
+	snapshot_path(ns, pid, true, tmp_path);
+
+	FILE *fh = fopen(tmp_path, "w");
+
+	if (! fh) {
+		cf_warning(AS_STORAGE, "failed to create %s: %s", tmp_path,
+				cf_strerror(errno));
+		as_partition_release(&rsv);
+		return false;
+	}
+
+	char *vbuf = cf_malloc(SNAPSHOT_BUF_SZ);
+
+	if (vbuf) {
+		setvbuf(fh, vbuf, _IOFBF, SNAPSHOT_BUF_SZ);
+	}
+
+	snapshot_header header;
+
+	memset(&header, 0, sizeof(header));
+	header.magic = SNAPSHOT_MAGIC;
+	header.version = SNAPSHOT_VERSION;
+	strcpy(header.ns_name, ns->name);
+	header.pid = pid;
+	header.vinfo = rsv.vinfo;
+
+	snapshot_writer w = { .ns = ns, .fh = fh, .ok = true, .crc = 0 };
+
+	w.ok = fwrite(&header, sizeof(header), 1, fh) == 1;
+
+	if (w.ok) {
+		as_index_reduce(rsv.tree, save_reduce_cb, &w);
+	}
+
+	as_partition_release(&rsv);
+
+	snapshot_trailer trailer = {
+			.magic = SNAPSHOT_MAGIC,
+			.crc = w.crc,
+			.n_records = w.n_records
+	};
+
+	bool ok = w.ok && fwrite(&trailer, sizeof(trailer), 1, fh) == 1 &&
+			fflush(fh) == 0 && fsync(fileno(fh)) == 0;
+
+	ok = fclose(fh) == 0 && ok;
+
+	if (vbuf) {
+		cf_free(vbuf);
+	}
+
+	if (! ok || rename(tmp_path, path) != 0) {
+		cf_warning(AS_STORAGE, "failed to write %s: %s", path,
+				cf_strerror(errno));
+		unlink(tmp_path);
+		return false;
+	}
+
+	drv_memory *drv = (drv_memory *)ns->storage_private;
+
+	cf_atomic64_add(&drv->n_records, (int64_t)w.n_records);
+
+	return true;
+}
+
+static void
+save_reduce_cb(as_index_ref *r_ref, void *udata)
+{
+	snapshot_writer *w = (snapshot_writer *)udata;
+	as_namespace *ns = w->ns;
+	as_index *r = r_ref->r;
+
+	if (! w->ok || as_record_is_doomed(r, ns)) {
+		as_record_done(r_ref, ns);
+		return;
+	}
+
+	// Copy everything needed while the record is locked ...
+
+	as_storage_rd rd;
+
+	as_storage_record_open(ns, r, &rd, &r->key);
+
+	rd.n_bins = as_bin_get_n_bins(r, &rd);
+	rd.bins = as_bin_get_all(r, &rd, NULL);
+
+	uint8_t *bins;
+	size_t bins_sz;
+
+	if (as_record_pickle(r, &rd, &bins, &bins_sz) != 0) {
+		cf_warning(AS_STORAGE, "failed memory snapshot record pickle");
+		as_storage_record_close(r, &rd);
+		as_record_done(r_ref, ns);
+		w->ok = false;
+		return;
+	}
+
+	snapshot_record sr;
+
+	memset(&sr, 0, sizeof(sr));
+	sr.keyd = r->key;
+	sr.generation = r->generation;
+	sr.void_time = r->void_time;
+	sr.last_update_time = r->last_update_time;
+	sr.bins_sz = (uint32_t)bins_sz;
+
+	as_storage_record_get_key(&rd);
+
+	as_rec_props rec_props;
+
+	as_rec_props_clear(&rec_props);
+	sr.rec_props_sz = as_storage_record_copy_rec_props(&rd, &rec_props);
+
+	as_storage_record_close(r, &rd);
+	as_record_done(r_ref, ns);
+
+	// ... then write it unlocked.
+
+	w->ok = write_piece(w, &sr, sizeof(sr)) &&
+			write_piece(w, rec_props.p_data, sr.rec_props_sz) &&
+			write_piece(w, bins, bins_sz);
+
+	if (rec_props.p_data) {
+		cf_free(rec_props.p_data);
+	}
+
+	cf_free(bins);
+
+	w->n_records++;
+
+	pace(ns, sizeof(sr) + sr.rec_props_sz + bins_sz);
+}
+
+static bool
+write_piece(snapshot_writer *w, const void *buf, size_t sz)
+{
+	if (sz == 0) {
+		return true;
+	}
+
+	w->crc = (uint32_t)crc32(w->crc, (const uint8_t *)buf, (uInt)sz);
+
+	return fwrite(buf, sz, 1, w->fh) == 1;
+}
+
+// Spread a periodic snapshot's writes to keep it under the configured rate.
+static void
+pace(as_namespace *ns, uint64_t n_bytes)
+{
+	drv_memory *drv = (drv_memory *)ns->storage_private;
+	uint64_t total = (uint64_t)cf_atomic64_add(&drv->n_bytes, (int64_t)n_bytes);
+
+	if (! drv->paced || drv->shutdown) {
+		return;
+	}
+
+	uint64_t due_us = drv->start_us +
+			(total * 1000000) / ns->memory_snapshot_max_write_rate;
+	uint64_t now_us = cf_getus();
+
+	if (due_us > now_us) {
+		usleep((useconds_t)(due_us - now_us));
+	}
+}
+
+
+//==========================================================
+// Local helpers - load.
+//
+
+static void
+load_partition(as_namespace *ns, uint32_t pid)
+{
+	char path[PATH_MAX];
+
+	snapshot_path(ns, pid, false, path);
+
+	FILE *fh = fopen(path, "r");
+
+	if (! fh) {
+		if (errno != ENOENT) {
+			cf_warning(AS_STORAGE, "failed to open %s: %s", path,
+					cf_strerror(errno));
+		}
+
+		return;
+	}
+
+	long file_sz = fseek(fh, 0, SEEK_END) == 0 ? ftell(fh) : -1;
+
+	if (file_sz < (long)(sizeof(snapshot_header) + sizeof(snapshot_trailer))) {
+		cf_warning(AS_STORAGE, "ignoring %s - too small", path);
+		fclose(fh);
+		return;
+	}
+
+	uint8_t *buf = cf_malloc((size_t)file_sz);
+
+	if (! buf) {
+		cf_crash(AS_STORAGE, "failed memory snapshot buffer alloc");
+	}
+
+	rewind(fh);
+
+	bool read_ok = fread(buf, (size_t)file_sz, 1, fh) == 1;
+
+	fclose(fh);
+
+	if (! read_ok) {
+		cf_warning(AS_STORAGE, "failed to read %s", path);
+		cf_free(buf);
+		return;
+	}
+
+	snapshot_header *header = (snapshot_header *)buf;
+	snapshot_trailer *trailer =
+			(snapshot_trailer *)(buf + file_sz - sizeof(snapshot_trailer));
+	uint8_t *at = buf + sizeof(snapshot_header);
+	uint8_t *end = (uint8_t *)trailer;
+
+	if (header->magic != SNAPSHOT_MAGIC ||
+			header->version != SNAPSHOT_VERSION ||
+			strncmp(header->ns_name, ns->name, AS_ID_NAMESPACE_SZ) != 0 ||
+			header->pid != pid || trailer->magic != SNAPSHOT_MAGIC ||
+			trailer->crc != (uint32_t)crc32(0, at, (uInt)(end - at))) {
+		cf_warning(AS_STORAGE, "ignoring %s - bad header, trailer or crc", path);
+		cf_free(buf);
+		return;
+	}
+
+	drv_memory *drv = (drv_memory *)ns->storage_private;
+	as_partition *p = &ns->partitions[pid];
+	uint64_t n_records = 0;
+	uint64_t n_loaded = 0;
+
+	while (at < end) {
+		snapshot_record sr;
+
+		if (end - at < (ptrdiff_t)sizeof(sr)) {
+			break;
+		}
+
+		memcpy(&sr, at, sizeof(sr));
+		at += sizeof(sr);
+
+		if ((uint64_t)(end - at) < (uint64_t)sr.rec_props_sz + sr.bins_sz) {
+			break;
+		}
+
+		uint8_t *rec_props_data = at;
+		uint8_t *bins = at + sr.rec_props_sz;
+
+		at = bins + sr.bins_sz;
+		n_records++;
+
+		if (load_record(ns, p, &sr, rec_props_data, bins)) {
+			n_loaded++;
+		}
+	}
+
+	if (at != end || n_records != trailer->n_records) {
+		// The crc matched - a record writer bug, not a torn file.
+		cf_warning(AS_STORAGE, "%s - parsed %lu of %lu records", path,
+				n_records, trailer->n_records);
+	}
+
+	// Even with records skipped, what's loaded is the partition as of this
+	// version.
+	drv->vinfo[pid] = header->vinfo;
+	cf_atomic64_add(&drv->n_records, (int64_t)n_loaded);
+
+	cf_free(buf);
+}
+
+static bool
+load_record(as_namespace *ns, as_partition *p, const snapshot_record *sr,
+		uint8_t *rec_props_data, uint8_t *bins)
+{
+	if (sr->bins_sz == 0 ||
+			(sr->void_time != 0 && sr->void_time < as_record_void_time_get())) {
+		return false;
+	}
+
+	as_rec_props rec_props = { .p_data = rec_props_data, .size = sr->rec_props_sz };
+
+	if (as_truncate_lut_is_truncated(sr->last_update_time, ns, &rec_props)) {
+		return false;
+	}
+
+	cf_digest keyd = sr->keyd;
+	as_index_ref r_ref;
+
+	r_ref.skip_lock = false;
+
+	int rv = as_record_get_create(p->vp, &keyd, &r_ref, ns, false);
+
+	if (rv < 0) {
+		cf_warning_digest(AS_STORAGE, &keyd, "{%s} memory snapshot as_record_get_create() failed ",
+				ns->name);
+		return false;
+	}
+
+	if (rv == 0) {
+		// Already loaded - can't happen unless the partition file is bad.
+		as_record_done(&r_ref, ns);
+		return false;
+	}
+
+	as_index *r = r_ref.r;
+
+	r->generation = sr->generation;
+	r->void_time = sr->void_time;
+	r->last_update_time = sr->last_update_time;
+
+	as_incr_hist_void_time_changed(ns, r, 0);
+	as_expire_index_record_changed(ns, r, 0);
+
+	cf_atomic_int_setmax(&p->max_void_time, r->void_time);
+	cf_atomic_int_setmax(&ns->max_void_time, r->void_time);
+	as_partition_max_lut_update(p, r->last_update_time);
+
+	as_storage_rd rd;
+
+	as_storage_record_create(ns, r, &rd, &keyd);
+
+	// Set-id and stored key.
+	as_record_set_properties(&rd, &rec_props);
+
+	rd.n_bins = as_bin_get_n_bins(r, &rd);
+	rd.bins = as_bin_get_all(r, &rd, NULL);
+
+	if (as_record_unpickle_replace(r, &rd, bins, sr->bins_sz, NULL, false) != 0) {
+		cf_warning_digest(AS_STORAGE, &keyd, "{%s} memory snapshot unpickle failed ",
+				ns->name);
+		as_storage_record_close(r, &rd);
+		as_index_delete(p->vp, &keyd);
+		as_record_done(&r_ref, ns);
+		return false;
+	}
+
+	as_storage_record_adjust_mem_stats(&rd, 0);
+	as_storage_record_close(r, &rd);
+	as_record_done(&r_ref, ns);
+
+	return true;
+}
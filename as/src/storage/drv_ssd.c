@@ -41,12 +41,15 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
 #include <linux/fs.h> // for BLKGETSIZE64
 #include <sys/ioctl.h>
 #include <sys/param.h> // for MAX()
+#include <sys/uio.h>
+#include <zlib.h>
 
 #include "citrusleaf/alloc.h"
 #include "citrusleaf/cf_atomic.h"
@@ -61,12 +64,18 @@
 #include "vmapx.h"
 
 #include "base/datamodel.h"
+#include "base/admission.h"
+#include "base/as_stap.h"
 #include "base/cfg.h"
+#include "base/expire_index.h"
+#include "base/incr_hist.h"
 #include "base/index.h"
 #include "base/ldt.h"
+#include "base/packet_compression.h"
 #include "base/proto.h"
 #include "base/rec_props.h"
 #include "base/secondary_index.h"
+#include "base/truncate.h"
 
 
 //==========================================================
@@ -75,6 +84,10 @@
 
 // Defined in thr_nsup.c, for historical reasons.
 extern bool as_cold_start_evict_if_needed(as_namespace* ns);
+extern void as_cold_start_counts_create(as_namespace* ns);
+extern void as_cold_start_counts_destroy(as_namespace* ns);
+extern void as_cold_start_counts_add(as_namespace* ns, uint32_t void_time, uint16_t set_id);
+extern void as_cold_start_counts_remove(as_namespace* ns, uint32_t void_time, uint16_t set_id);
 
 
 //==========================================================
@@ -82,8 +95,13 @@ extern bool as_cold_start_evict_if_needed(as_namespace* ns);
 //
 
 #define MAX_WRITE_BLOCK_SIZE	(1024 * 1024)
+#define MAX_FLUSH_SIZE			(8 * 1024 * 1024) // coalesced writes of adjacent wblocks
 #define LOAD_BUF_SIZE			MAX_WRITE_BLOCK_SIZE // must be multiple of MAX_WRITE_BLOCK_SIZE
 
+// Cold start's first read of a wblock's summary trailer - enough for a wblock
+// of ~100 small records.
+#define SUMMARY_TAIL_READ_SIZE	(8 * 1024)
+
 // We round usable device/file size down to SSD_DEFAULT_HEADER_LENGTH plus a
 // multiple of LOAD_BUF_SIZE. If we ever change SSD_DEFAULT_HEADER_LENGTH we
 // may break backward compatibility since an old header with different size
@@ -93,12 +111,27 @@ extern bool as_cold_start_evict_if_needed(as_namespace* ns);
 #define SSD_DEFAULT_INFO_NUMBER		(1024 * 4)
 #define SSD_DEFAULT_INFO_LENGTH		(128)
 
-#define SSD_BLOCK_MAGIC		0x037AF200
+#define SSD_BLOCK_MAGIC				0x037AF200
+#define SSD_BLOCK_MAGIC_COMPRESSED	0x037AF201 // bins are zlib-compressed
+#define SSD_BLOCK_MAGIC_LZ4			0x037AF202 // bins are LZ4-compressed
+#define SSD_BLOCK_MAGIC_ZSTD		0x037AF203 // bins are zstd-compressed
 #define LENGTH_BASE			offsetof(struct drv_ssd_block_s, keyd)
 
 #define DEFRAG_STARTUP_RESERVE	4
 #define DEFRAG_RUNTIME_RESERVE	4
 
+// Write queue ring size - deeper queues spill to its locked overflow.
+#define SWB_WRITE_Q_CAPACITY	1024
+
+// Storage-ordered batch reads - merge records at most this far apart, into
+// device reads of at most this size.
+#define BATCH_READ_MAX_GAP		(1024 * 16)
+#define BATCH_READ_MAX_SIZE		(1024 * 256)
+
+// Device sweeps (e.g. for scans) - bytes of one device per slice, a multiple
+// of any write-block-size.
+#define SWEEP_SLICE_SIZE		(1024 * 1024 * 256)
+
 
 //==========================================================
 // Typedefs.
@@ -115,7 +148,7 @@ typedef struct {
 // Per-record metadata on device.
 //
 typedef struct drv_ssd_block_s {
-	cf_signature	sig;			// deprecated
+	cf_signature	sig;			// deprecated - if compressed, uncompressed bins size
 	uint32_t		magic;
 	uint32_t		length;			// total after this field - this struct's pointer + 16
 	cf_digest		keyd;
@@ -128,6 +161,37 @@ typedef struct drv_ssd_block_s {
 } __attribute__ ((__packed__)) drv_ssd_block;
 
 
+//------------------------------------------------
+// Optional wblock summary trailer - per-record
+// metadata packed at the end of a wblock, so cold
+// start can read it instead of the whole wblock.
+// Entries grow down from the footer, which is the
+// wblock's last bytes.
+//
+#define SSD_SUMMARY_MAGIC 0x53554D31 // "SUM1"
+
+typedef struct ssd_summary_entry_s {
+	cf_digest		keyd;
+	as_generation	generation;
+	cf_clock		void_time;
+	uint64_t		last_update_time;
+	uint16_t		rblock_offset;	// record's offset in the wblock, in rblocks
+	uint16_t		n_rblocks;
+	uint16_t		props_size;
+	uint8_t			props[];		// record's rec-props
+} __attribute__ ((__packed__)) ssd_summary_entry;
+
+typedef struct ssd_summary_footer_s {
+	uint32_t	magic;
+	uint32_t	n_entries;
+	uint32_t	size;				// of the entries, which end at the footer
+	uint32_t	crc;				// over the entries and the fields above
+} __attribute__ ((__packed__)) ssd_summary_footer;
+
+#define SUMMARY_ENTRY_SIZE(_props_size) \
+	((uint32_t)sizeof(ssd_summary_entry) + (_props_size))
+
+
 //------------------------------------------------
 // Per-bin metadata on device.
 //
@@ -140,6 +204,16 @@ typedef struct drv_ssd_bin_s {
 } __attribute__ ((__packed__)) drv_ssd_bin;
 
 
+//------------------------------------------------
+// Record to read in a storage-ordered batch read.
+//
+typedef struct ssd_batch_read_ent_s {
+	as_storage_rd	*rd;
+	uint64_t		offset;			// of record on device, in bytes
+	uint64_t		size;			// of record on device, in bytes
+} ssd_batch_read_ent;
+
+
 //==========================================================
 // Miscellaneous utility functions.
 //
@@ -183,6 +257,34 @@ ssd_shadow_fd_get(drv_ssd *ssd)
 }
 
 
+// Does this look like the start of a record?
+static inline bool
+ssd_block_has_magic(const drv_ssd_block *block)
+{
+	return block->magic == SSD_BLOCK_MAGIC ||
+			block->magic == SSD_BLOCK_MAGIC_COMPRESSED ||
+			block->magic == SSD_BLOCK_MAGIC_LZ4 ||
+			block->magic == SSD_BLOCK_MAGIC_ZSTD;
+}
+
+
+// How are this record's bins compressed, if at all?
+static inline compression_type
+ssd_block_compression(const drv_ssd_block *block)
+{
+	switch (block->magic) {
+	case SSD_BLOCK_MAGIC_COMPRESSED:
+		return COMPRESSION_ZLIB;
+	case SSD_BLOCK_MAGIC_LZ4:
+		return COMPRESSION_LZ4;
+	case SSD_BLOCK_MAGIC_ZSTD:
+		return COMPRESSION_ZSTD;
+	default:
+		return COMPRESSION_NONE;
+	}
+}
+
+
 // Save an open file descriptor in the pool
 static inline void
 ssd_fd_put(drv_ssd *ssd, int fd)
@@ -202,7 +304,10 @@ ssd_shadow_fd_put(drv_ssd *ssd, int fd)
 static inline int
 ssd_get_file_id(drv_ssds *ssds, cf_digest *keyd)
 {
-	return keyd->digest[DIGEST_STORAGE_BYTE] % ssds->n_ssds;
+	uint8_t slot = keyd->digest[DIGEST_STORAGE_BYTE];
+
+	return ssds->weighted_placement ?
+			ssds->placement[slot] : slot % ssds->n_ssds;
 }
 
 
@@ -221,6 +326,14 @@ push_wblock_to_free_q(drv_ssd *ssd, uint32_t wblock_id, e_free_to free_to)
 		return;
 	}
 
+	// Bits left by storage that was never freed mustn't outlive the wblock.
+	if (ssd->live_map) {
+		uint64_t rblock_id = BYTES_TO_RBLOCKS(WBLOCK_ID_TO_BYTES(ssd, wblock_id));
+
+		ssd_live_map_clear_range(ssd, rblock_id,
+				rblock_id + BYTES_TO_RBLOCKS(ssd->write_block_size));
+	}
+
 	if (free_to == FREE_TO_HEAD) {
 		cf_queue_push_head(ssd->free_wblock_q, &wblock_id);
 	}
@@ -242,6 +355,16 @@ push_wblock_to_defrag_q(drv_ssd *ssd, uint32_t wblock_id)
 }
 
 
+// Track the latest void-time written to a wblock, so defrag can tell when
+// everything in it has expired.
+static inline void
+wblock_note_void_time(ssd_wblock_state *p_wblock_state, uint32_t void_time)
+{
+	cf_atomic32_setmax(&p_wblock_state->max_void_time,
+			void_time == 0 ? WBLOCK_VOID_TIME_NEVER : (int32_t)void_time);
+}
+
+
 // Available contiguous size.
 static inline uint64_t
 available_size(drv_ssd *ssd)
@@ -255,6 +378,17 @@ available_size(drv_ssd *ssd)
 }
 
 
+// Is free space under twice min-avail-pct? If so, defrag must run flat out
+// and free every wblock it can, to keep clear of stop-writes.
+static inline bool
+defrag_short_of_space(drv_ssd *ssd)
+{
+	uint64_t avail_pct = (available_size(ssd) * 100) / ssd->file_size;
+
+	return avail_pct < (uint64_t)ssd->ns->storage_min_avail_pct * 2;
+}
+
+
 //------------------------------------------------
 // ssd_write_buf "swb" methods.
 //
@@ -291,8 +425,12 @@ static inline void
 swb_reset(ssd_write_buf *swb)
 {
 	swb->skip_post_write_q = false;
+	swb->recently_read = false;
 	swb->wblock_id = STORAGE_INVALID_WBLOCK;
 	swb->pos = 0;
+	swb->end = swb->ssd->write_block_size;
+	swb->summary = false;
+	swb->n_summary_entries = 0;
 }
 
 #define swb_reserve(_swb) cf_atomic32_incr(&(_swb)->rc)
@@ -371,9 +509,13 @@ swb_get(drv_ssd *ssd)
 		swb->rc = 0;
 		swb->n_writers = 0;
 		swb->skip_post_write_q = false;
+		swb->recently_read = false;
 		swb->ssd = ssd;
 		swb->wblock_id = STORAGE_INVALID_WBLOCK;
 		swb->pos = 0;
+		swb->end = ssd->write_block_size;
+		swb->summary = false;
+		swb->n_summary_entries = 0;
 	}
 
 	// Find a device block to write to.
@@ -383,6 +525,13 @@ swb_get(drv_ssd *ssd)
 		return NULL;
 	}
 
+	// Leave room for the summary footer - entries come out of record space as
+	// records are added.
+	if (ssd->ns->storage_wblock_summaries) {
+		swb->summary = true;
+		swb->end = ssd->write_block_size - (uint32_t)sizeof(ssd_summary_footer);
+	}
+
 	ssd_wblock_state* p_wblock_state =
 			&ssd->alloc_table->wblock_state[swb->wblock_id];
 
@@ -405,17 +554,142 @@ swb_get(drv_ssd *ssd)
 
 	swb_reserve(swb);
 	p_wblock_state->swb = swb;
+	cf_atomic32_set(&p_wblock_state->max_void_time, 0);
 
 	pthread_mutex_unlock(&p_wblock_state->LOCK);
 
 	return swb;
 }
 
+// Space a record needs in swb, including its summary entry if swb keeps a
+// summary. A record too big to fit an empty swb along with its entry, or with
+// rec-props too big for an entry, drops the swb's summary - cold start will
+// read that wblock in full.
+static inline uint32_t
+swb_space_needed(ssd_write_buf *swb, uint32_t write_size, uint32_t props_size)
+{
+	if (! swb->summary) {
+		return write_size;
+	}
+
+	if (props_size > UINT16_MAX) {
+		uint32_t footer_offset = swb->ssd->write_block_size -
+				(uint32_t)sizeof(ssd_summary_footer);
+
+		// Don't leave a stale footer from the buffer's last use.
+		memset(&swb->buf[footer_offset], 0, sizeof(ssd_summary_footer));
+		swb->summary = false;
+		return write_size;
+	}
+
+	uint32_t needed = write_size + SUMMARY_ENTRY_SIZE(props_size);
+
+	if (swb->pos == 0 && needed > swb->end) {
+		swb->summary = false;
+		swb->end = swb->ssd->write_block_size;
+		return write_size;
+	}
+
+	return needed;
+}
+
+// Reserve space for a summary entry, below the previous one. Call with the
+// space already checked, under the lock that reserved the record's space.
+static inline ssd_summary_entry *
+swb_reserve_summary_entry(ssd_write_buf *swb, uint32_t props_size)
+{
+	if (! swb->summary) {
+		return NULL;
+	}
+
+	swb->end -= SUMMARY_ENTRY_SIZE(props_size);
+	swb->n_summary_entries++;
+
+	return (ssd_summary_entry*)&swb->buf[swb->end];
+}
+
+static inline void
+swb_fill_summary_entry(ssd_summary_entry *entry, const drv_ssd_block *block,
+		uint32_t swb_pos, uint32_t write_size)
+{
+	entry->keyd = block->keyd;
+	entry->generation = block->generation;
+	entry->void_time = block->void_time;
+	entry->last_update_time = block->last_update_time;
+	entry->rblock_offset = (uint16_t)BYTES_TO_RBLOCKS(swb_pos);
+	entry->n_rblocks = (uint16_t)BYTES_TO_RBLOCKS(write_size);
+	entry->props_size = (uint16_t)block->bins_offset;
+	memcpy(entry->props, block->data, block->bins_offset);
+}
+
+// Write the summary footer - done at every flush, since a partially filled
+// swb may be flushed and then flushed again with more records.
+static void
+swb_seal_summary(ssd_write_buf *swb)
+{
+	if (! swb->summary) {
+		return;
+	}
+
+	uint32_t footer_offset =
+			swb->ssd->write_block_size - (uint32_t)sizeof(ssd_summary_footer);
+	ssd_summary_footer *footer =
+			(ssd_summary_footer*)&swb->buf[footer_offset];
+
+	footer->magic = SSD_SUMMARY_MAGIC;
+	footer->n_entries = swb->n_summary_entries;
+	footer->size = footer_offset - swb->end;
+
+	uLong crc = crc32(0, &swb->buf[swb->end], footer->size);
+
+	footer->crc = (uint32_t)crc32(crc, (const Bytef*)footer,
+			offsetof(ssd_summary_footer, crc));
+}
+
 //
 // END - ssd_write_buf "swb" methods.
 //------------------------------------------------
 
 
+// Get a wblock's valid summary footer from buf, which holds the wblock's tail
+// from tail_offset on - returns NULL if there's none.
+static const ssd_summary_footer *
+ssd_wblock_summary(const drv_ssd *ssd, const uint8_t *buf, uint32_t tail_offset)
+{
+	uint32_t footer_offset =
+			ssd->write_block_size - (uint32_t)sizeof(ssd_summary_footer);
+	const ssd_summary_footer *footer =
+			(const ssd_summary_footer*)&buf[footer_offset - tail_offset];
+
+	if (footer->magic != SSD_SUMMARY_MAGIC ||
+			footer->size > footer_offset - tail_offset ||
+			footer->n_entries > footer->size / sizeof(ssd_summary_entry)) {
+		return NULL;
+	}
+
+	uLong crc = crc32(0, (const Bytef*)footer - footer->size, footer->size);
+
+	if ((uint32_t)crc32(crc, (const Bytef*)footer,
+			offsetof(ssd_summary_footer, crc)) != footer->crc) {
+		return NULL;
+	}
+
+	return footer;
+}
+
+// Where records end in a full wblock buf - any summary trailer follows them.
+static uint32_t
+ssd_wblock_records_end(const drv_ssd *ssd, const uint8_t *buf)
+{
+	const ssd_summary_footer *footer = ssd_wblock_summary(ssd, buf, 0);
+
+	return footer ?
+			ssd->write_block_size - (uint32_t)sizeof(ssd_summary_footer) -
+					footer->size :
+			ssd->write_block_size;
+}
+
+
 // Reduce wblock's used size, if result is 0 put it in the "free" pool, if it's
 // below the defrag threshold put it in the defrag queue.
 void
@@ -443,6 +717,7 @@ ssd_block_free(drv_ssd *ssd, uint64_t rblock_id, uint64_t n_rblocks, char *msg)
 	}
 
 	cf_atomic64_sub(&ssd->inuse_size, size);
+	ssd_live_map_clear(ssd, rblock_id);
 
 	ssd_wblock_state *p_wblock_state = &at->wblock_state[wblock_id];
 
@@ -563,7 +838,8 @@ defrag_move_record(drv_ssd *ssd, drv_ssd_block *block, as_index *r)
 		return;
 	}
 
-	uint32_t write_size = block->length + LENGTH_BASE;
+	// Compressed blocks' lengths are exact, not rounded to rblocks.
+	uint32_t write_size = BYTES_TO_RBLOCK_BYTES(block->length + LENGTH_BASE);
 
 	pthread_mutex_lock(&ssd->defrag_lock);
 
@@ -583,15 +859,16 @@ defrag_move_record(drv_ssd *ssd, drv_ssd_block *block, as_index *r)
 	// Check if there's enough space in defrag buffer - if not, free and zero
 	// any remaining unused space, enqueue it to be flushed to device, and grab
 	// a new buffer.
-	if (write_size > ssd->write_block_size - swb->pos) {
-		if (ssd->write_block_size != swb->pos) {
+	if (swb_space_needed(swb, write_size, block->bins_offset) >
+			swb->end - swb->pos) {
+		if (swb->end != swb->pos) {
 			// Clean the end of the buffer before pushing to write queue.
-			memset(swb->buf + swb->pos, 0, ssd->write_block_size - swb->pos);
+			memset(swb->buf + swb->pos, 0, swb->end - swb->pos);
 		}
 
 		// Enqueue the buffer, to be flushed to device.
 		swb->skip_post_write_q = true;
-		cf_queue_push(ssd->swb_write_q, &swb);
+		cf_ring_queue_push(ssd->swb_write_q, &swb);
 		cf_atomic_int_incr(&ssd->n_defrag_wblock_writes);
 
 		// Get the new buffer.
@@ -603,10 +880,28 @@ defrag_move_record(drv_ssd *ssd, drv_ssd_block *block, as_index *r)
 			pthread_mutex_unlock(&ssd->defrag_lock);
 			return;
 		}
+
+		swb_space_needed(swb, write_size, block->bins_offset);
 	}
 
 	memcpy(swb->buf + swb->pos, (const uint8_t*)block, write_size);
 
+	drv_ssd_block *moved = (drv_ssd_block*)(swb->buf + swb->pos);
+
+	// Index-only touches leave the device copy's metadata behind - catch up.
+	if (ssd->ns->storage_touch_index_only) {
+		moved->generation = r->generation;
+		moved->void_time = r->void_time;
+		moved->last_update_time = r->last_update_time;
+	}
+
+	ssd_summary_entry *entry =
+			swb_reserve_summary_entry(swb, moved->bins_offset);
+
+	if (entry) {
+		swb_fill_summary_entry(entry, moved, swb->pos, write_size);
+	}
+
 	r->storage_key.ssd.file_id = ssd->file_id;
 	r->storage_key.ssd.rblock_id = BYTES_TO_RBLOCKS(WBLOCK_ID_TO_BYTES(ssd, swb->wblock_id) + swb->pos);
 	r->storage_key.ssd.n_rblocks = BYTES_TO_RBLOCKS(write_size);
@@ -615,6 +910,9 @@ defrag_move_record(drv_ssd *ssd, drv_ssd_block *block, as_index *r)
 
 	cf_atomic64_add(&ssd->inuse_size, (int64_t)write_size);
 	cf_atomic32_add(&ssd->alloc_table->wblock_state[swb->wblock_id].inuse_sz, (int32_t)write_size);
+	wblock_note_void_time(&ssd->alloc_table->wblock_state[swb->wblock_id],
+			r->void_time);
+	ssd_live_map_set(ssd, r->storage_key.ssd.rblock_id);
 
 	pthread_mutex_unlock(&ssd->defrag_lock);
 
@@ -622,9 +920,12 @@ defrag_move_record(drv_ssd *ssd, drv_ssd_block *block, as_index *r)
 }
 
 
+// If skip_expired is set, current records that have expired are left in place
+// for expiration to delete - returns -3 and their void-time in *p_void_time.
 int
 ssd_record_defrag(drv_ssd *ssd, drv_ssd_block *block, uint64_t rblock_id,
-		uint32_t n_rblocks, uint64_t filepos)
+		uint32_t n_rblocks, uint64_t filepos, bool skip_expired,
+		uint32_t *p_void_time)
 {
 	as_namespace *ns = ssd->ns;
 	as_partition_reservation rsv;
@@ -648,8 +949,16 @@ ssd_record_defrag(drv_ssd *ssd, drv_ssd_block *block, uint64_t rblock_id,
 		as_index *r = r_ref.r;
 
 		if (r->storage_key.ssd.file_id == ssd->file_id &&
+				r->storage_key.ssd.rblock_id == rblock_id &&
+				skip_expired && r->void_time != 0 &&
+				r->void_time < as_record_void_time_get()) {
+			*p_void_time = r->void_time;
+			rv = -3; // record is current but expired - not worth rewriting
+		}
+		else if (r->storage_key.ssd.file_id == ssd->file_id &&
 				r->storage_key.ssd.rblock_id == rblock_id) {
-			if (r->generation != block->generation) {
+			if (r->generation != block->generation &&
+					! ns->storage_touch_index_only) {
 				cf_warning_digest(AS_DRV_SSD, &r->key, "device %s defrag: rblock_id %lu generation mismatch (%u:%u)%s ",
 						ssd->name, rblock_id, r->generation, block->generation,
 						is_subrec ? " subrec" : "");
@@ -717,6 +1026,30 @@ ssd_is_full(drv_ssd *ssd, uint32_t wblock_id)
 }
 
 
+// Offset within the wblock of the first live record at or after offset, or end
+// if there are none.
+static size_t
+live_map_next(drv_ssd *ssd, uint64_t file_offset, size_t offset, size_t end)
+{
+	uint64_t rblock_id = BYTES_TO_RBLOCKS(file_offset + offset);
+	uint64_t end_rblock_id = BYTES_TO_RBLOCKS(file_offset + end);
+
+	while (rblock_id < end_rblock_id) {
+		uint64_t word = ssd->live_map[rblock_id >> 6] >> (rblock_id & 63);
+
+		if (word != 0) {
+			rblock_id += (uint64_t)__builtin_ctzl(word);
+			break;
+		}
+
+		rblock_id = (rblock_id | 63) + 1;
+	}
+
+	return rblock_id < end_rblock_id ?
+			(size_t)(RBLOCKS_TO_BYTES(rblock_id) - file_offset) : end;
+}
+
+
 int
 ssd_defrag_wblock(drv_ssd *ssd, uint32_t wblock_id, uint8_t *read_buf)
 {
@@ -727,27 +1060,39 @@ ssd_defrag_wblock(drv_ssd *ssd, uint32_t wblock_id, uint8_t *read_buf)
 	int record_count = 0;
 	int num_old_records = 0;
 	int num_deleted_records = 0;
+	int num_expired_records = 0;
+	uint32_t max_expired_void_time = 0;
 
 	ssd_wblock_state* p_wblock_state = &ssd->alloc_table->wblock_state[wblock_id];
 
+	ASD_DEFRAG_WBLOCK_START(ssd->file_id, wblock_id);
+
 	if (cf_atomic32_get(p_wblock_state->inuse_sz) == 0) {
 		goto Finished;
 	}
 
-	int fd = ssd_fd_get(ssd);
-	uint64_t file_offset = WBLOCK_ID_TO_BYTES(ssd, wblock_id);
-
-	uint64_t start_ns = ssd->ns->storage_benchmarks_enabled ? cf_getns() : 0;
+	// Expired records may be left for expiration to delete, unless we're short
+	// of space and need every wblock defrag can free.
+	bool skip_expired = ! defrag_short_of_space(ssd);
+	uint32_t max_void_time = cf_atomic32_get(p_wblock_state->max_void_time);
 
-	if (lseek(fd, (off_t)file_offset, SEEK_SET) != (off_t)file_offset) {
-		cf_warning(AS_DRV_SSD, "%s: seek failed: offset %lu: errno %d (%s)",
-				ssd->name, file_offset, errno, cf_strerror(errno));
-		close(fd);
-		fd = -1;
+	// If everything in the wblock has expired, don't even read it - expiration
+	// will empty and free it. (Index-only touches may extend records without
+	// updating max_void_time, so don't trust it then.)
+	if (skip_expired && ! ssd->ns->storage_touch_index_only &&
+			max_void_time != 0 && max_void_time < as_record_void_time_get()) {
+		cf_atomic64_incr(&ssd->n_defrag_expired_wblocks);
 		goto Finished;
 	}
 
-	ssize_t rlen = read(fd, read_buf, ssd->write_block_size);
+	int fd = ssd_fd_get(ssd);
+	uint64_t file_offset = WBLOCK_ID_TO_BYTES(ssd, wblock_id);
+
+	uint64_t start_ns = ssd->ns->storage_benchmarks_enabled ||
+			g_ssd_trace_enabled ? cf_getns() : 0;
+
+	ssize_t rlen = pread(fd, read_buf, ssd->write_block_size,
+			(off_t)file_offset);
 
 	if (rlen != (ssize_t)ssd->write_block_size) {
 		cf_warning(AS_DRV_SSD, "%s: read failed (%ld): errno %d (%s)",
@@ -758,18 +1103,34 @@ ssd_defrag_wblock(drv_ssd *ssd, uint32_t wblock_id, uint8_t *read_buf)
 	}
 
 	if (start_ns != 0) {
-		histogram_insert_data_point(ssd->hist_large_block_read, start_ns);
+		ssd_trace_note(ssd, SSD_TRACE_DEFRAG_READ, file_offset,
+				ssd->write_block_size, start_ns);
+
+		if (ssd->ns->storage_benchmarks_enabled) {
+			histogram_insert_data_point(ssd->hist_large_block_read, start_ns);
+		}
 	}
 
 	ssd_fd_put(ssd, fd);
 
 	size_t wblock_offset = 0; // current offset within the wblock, in bytes
+	size_t records_end = ssd_wblock_records_end(ssd, read_buf);
 
-	while (wblock_offset < ssd->write_block_size &&
+	// Visit only live records if they're mapped - if none are, the wblock's
+	// inuse_sz isn't accounted for by the map, so scan it all.
+	bool use_map = ssd->live_map &&
+			live_map_next(ssd, file_offset, 0, records_end) < records_end;
+
+	while (wblock_offset < records_end &&
 			cf_atomic32_get(p_wblock_state->inuse_sz) != 0) {
+		if (use_map && (wblock_offset = live_map_next(ssd, file_offset,
+				wblock_offset, records_end)) == records_end) {
+			break;
+		}
+
 		drv_ssd_block *block = (drv_ssd_block*)&read_buf[wblock_offset];
 
-		if (block->magic != SSD_BLOCK_MAGIC) {
+		if (! ssd_block_has_magic(block)) {
 			// First block must have magic.
 			if (wblock_offset == 0) {
 				cf_warning(AS_DRV_SSD, "BLOCK CORRUPTED: device %s has bad data on wblock %d",
@@ -787,17 +1148,18 @@ ssd_defrag_wblock(drv_ssd *ssd, uint32_t wblock_id, uint8_t *read_buf)
 		size_t next_wblock_offset = wblock_offset +
 				BYTES_TO_RBLOCK_BYTES(block->length + LENGTH_BASE);
 
-		if (next_wblock_offset > ssd->write_block_size) {
+		if (next_wblock_offset > records_end) {
 			cf_warning(AS_DRV_SSD, "error: block extends over read size: foff %"PRIu64" boff %"PRIu64" blen %"PRIu64,
 				file_offset, wblock_offset, (uint64_t)block->length);
 			break;
 		}
 
 		// Found a good record, move it if it's current.
+		uint32_t void_time = 0;
 		int rv = ssd_record_defrag(ssd, block,
 				BYTES_TO_RBLOCKS(file_offset + wblock_offset),
 				(uint32_t)BYTES_TO_RBLOCKS(next_wblock_offset - wblock_offset),
-				file_offset + wblock_offset);
+				file_offset + wblock_offset, skip_expired, &void_time);
 
 		if (rv == 0) {
 			record_count++;
@@ -808,10 +1170,26 @@ ssd_defrag_wblock(drv_ssd *ssd, uint32_t wblock_id, uint8_t *read_buf)
 		else if (rv == -2) {
 			num_deleted_records++;
 		}
+		else if (rv == -3) {
+			num_expired_records++;
+
+			if (void_time > max_expired_void_time) {
+				max_expired_void_time = void_time;
+			}
+		}
 
 		wblock_offset = next_wblock_offset;
 	}
 
+	if (num_expired_records != 0) {
+		cf_atomic64_add(&ssd->n_defrag_expired_records, num_expired_records);
+
+		// Only expired records are left - if the wblock comes back to defrag
+		// before they're deleted, it won't need reading.
+		cf_atomic32_set(&p_wblock_state->max_void_time,
+				max_expired_void_time);
+	}
+
 Finished:
 
 	// Note - usually wblock's inuse_sz is 0 here, but may legitimately be non-0
@@ -819,9 +1197,10 @@ Finished:
 	// may have found deleted records in the wblock whose used-size contribution
 	// has not yet been subtracted.
 
-	cf_detail(AS_DRV_SSD, "device %s: wblock-id %u defragged, final in-use-sz %d records (%d:%d:%d)",
+	cf_detail(AS_DRV_SSD, "device %s: wblock-id %u defragged, final in-use-sz %d records (%d:%d:%d:%d)",
 			ssd->name, wblock_id, cf_atomic32_get(p_wblock_state->inuse_sz),
-			record_count, num_old_records, num_deleted_records);
+			record_count, num_old_records, num_deleted_records,
+			num_expired_records);
 
 	// Sanity checks.
 	if (p_wblock_state->swb) {
@@ -845,10 +1224,45 @@ Finished:
 
 	pthread_mutex_unlock(&p_wblock_state->LOCK);
 
+	ASD_DEFRAG_WBLOCK_DONE(ssd->file_id, wblock_id, record_count);
+
 	return record_count;
 }
 
 
+// Scale defrag-sleep by device load - from full speed when free wblocks run
+// short, to 4x defrag-sleep when the write queue is at its limit.
+static uint32_t
+defrag_adaptive_sleep(drv_ssd *ssd)
+{
+	as_namespace *ns = ssd->ns;
+	uint32_t sleep_us = ns->storage_defrag_sleep;
+
+	// Getting close to stop-writes - catch up as fast as possible.
+	if (defrag_short_of_space(ssd)) {
+		return 0;
+	}
+
+	uint32_t write_q_sz = (uint32_t)cf_ring_queue_sz(ssd->swb_write_q);
+
+	// No foreground writes waiting - device has spare capacity.
+	if (write_q_sz == 0) {
+		return sleep_us / 4;
+	}
+
+	uint32_t max_write_q = ns->storage_max_write_q > 0 ?
+			(uint32_t)ns->storage_max_write_q : 1;
+
+	if (write_q_sz >= max_write_q) {
+		return sleep_us * 4;
+	}
+
+	// Back off in proportion to write queue depth.
+	return sleep_us + (uint32_t)(((uint64_t)sleep_us * 3 * write_q_sz) /
+			max_write_q);
+}
+
+
 // Thread "run" function to service a device's defrag queue.
 void*
 run_defrag(void *pv_data)
@@ -889,7 +1303,8 @@ run_defrag(void *pv_data)
 
 		ssd_defrag_wblock(ssd, wblock_id, read_buf);
 
-		uint32_t sleep_us = ssd->ns->storage_defrag_sleep;
+		uint32_t sleep_us = ssd->ns->storage_defrag_adaptive ?
+				defrag_adaptive_sleep(ssd) : ssd->ns->storage_defrag_sleep;
 
 		if (sleep_us != 0) {
 			usleep(sleep_us);
@@ -916,6 +1331,8 @@ ssd_start_defrag_threads(drv_ssds *ssds)
 				(void*)ssd) != 0) {
 			cf_crash(AS_DRV_SSD, "%s defrag thread failed", ssd->name);
 		}
+
+		as_config_sched_thread(AS_SCHED_POOL_DEFRAG, ssd->defrag_thread);
 	}
 }
 
@@ -1103,110 +1520,428 @@ ssd_wblock_init(drv_ssd *ssd)
 		at->wblock_state[i].state = WBLOCK_STATE_NONE;
 		cf_atomic32_set(&at->wblock_state[i].inuse_sz, 0);
 		at->wblock_state[i].swb = 0;
+		cf_atomic32_set(&at->wblock_state[i].max_void_time, 0);
 	}
 
 	ssd->alloc_table = at;
+
+	if (ssd->ns->storage_defrag_live_map) {
+		uint64_t n_words = (BYTES_TO_RBLOCKS(ssd->file_size) + 63) / 64;
+
+		ssd->live_map = cf_malloc(n_words * sizeof(uint64_t));
+
+		if (! ssd->live_map) {
+			cf_crash(AS_DRV_SSD, "%s live-map malloc failed", ssd->name);
+		}
+
+		memset(ssd->live_map, 0, n_words * sizeof(uint64_t));
+
+		cf_info(AS_DRV_SSD, "%s live-map uses %lu bytes", ssd->name,
+				n_words * sizeof(uint64_t));
+	}
+	else {
+		ssd->live_map = NULL;
+	}
 }
 
 
 //==========================================================
-// Storage API implementation: reading records.
+// Record compression.
+//
+// A compressed record keeps its header and record properties as is - only the
+// bins are compressed. Bin offsets stay relative to the uncompressed block, so
+// an expanded block is indistinguishable from one that was never compressed.
 //
 
-inline uint16_t
-as_storage_record_get_n_bins_ssd(as_storage_rd *rd)
+// Per-thread scratch for compressing writes - the flattened record, and its
+// compressed bins. Grown as needed, and kept for the life of the thread.
+static __thread uint8_t *t_flat_buf = NULL;
+static __thread size_t t_flat_buf_size = 0;
+static __thread uint8_t *t_comp_buf = NULL;
+static __thread size_t t_comp_buf_size = 0;
+
+static uint8_t *
+ssd_scratch_buf(uint8_t **p_buf, size_t *p_size, size_t size)
 {
-	return rd->u.ssd.block ? rd->u.ssd.block->n_bins : 0;
+	if (*p_size < size) {
+		// Old contents aren't needed - don't realloc.
+		cf_free(*p_buf);
+		*p_buf = cf_malloc(size);
+		*p_size = *p_buf ? size : 0;
+	}
+
+	return *p_buf;
 }
 
 
-int
-as_storage_record_read_ssd(as_storage_rd *rd)
+static const uint32_t COMPRESSION_BLOCK_MAGIC[] = {
+		[AS_STORAGE_COMPRESSION_NONE] = SSD_BLOCK_MAGIC,
+		[AS_STORAGE_COMPRESSION_ZLIB] = SSD_BLOCK_MAGIC_COMPRESSED,
+		[AS_STORAGE_COMPRESSION_LZ4] = SSD_BLOCK_MAGIC_LZ4,
+		[AS_STORAGE_COMPRESSION_ZSTD] = SSD_BLOCK_MAGIC_ZSTD
+};
+
+
+// Could compressing a record of write_size bytes, with props_size bytes of
+// record properties, save an rblock? Only the bins are compressed, so a record
+// whose bins don't reach past the header's last rblock can't shrink.
+static inline bool
+ssd_compression_may_save(uint32_t write_size, uint32_t props_size)
 {
-	as_record *r = rd->r;
+	return write_size >
+			BYTES_TO_RBLOCK_BYTES(sizeof(drv_ssd_block) + props_size + 1);
+}
 
-	if (STORAGE_RBLOCK_IS_INVALID(r->storage_key.ssd.rblock_id)) {
-		cf_warning_digest(AS_DRV_SSD, &rd->keyd, "{%s} read_ssd: invalid rblock_id ",
-				rd->ns->name);
-		return -1;
+
+// Compress the bins of a flattened block of used_size bytes, into per-thread
+// scratch. On success, returns the compressed bins, and the block's compressed
+// used size via p_comp_size. Returns NULL if compression fails or doesn't save
+// an rblock.
+static const uint8_t *
+ssd_block_compress(as_namespace *ns, const drv_ssd_block *block,
+		uint32_t used_size, uint32_t *p_comp_size)
+{
+	compression_type type = (compression_type)ns->storage_compression;
+	uint32_t head_size = (uint32_t)sizeof(drv_ssd_block) + block->bins_offset;
+	uint32_t bins_size = used_size - head_size;
+	size_t comp_bins_size = as_compress_bound(type, bins_size);
+	uint8_t *comp_bins = ssd_scratch_buf(&t_comp_buf, &t_comp_buf_size,
+			comp_bins_size);
+
+	if (! comp_bins) {
+		return NULL;
 	}
 
-	uint64_t record_offset = RBLOCKS_TO_BYTES(r->storage_key.ssd.rblock_id);
-	uint64_t record_size = RBLOCKS_TO_BYTES(r->storage_key.ssd.n_rblocks);
+	if (as_compress_buf(type, (int)ns->storage_compression_level, bins_size,
+			block->data + block->bins_offset, &comp_bins_size,
+			comp_bins) != 0) {
+		return NULL;
+	}
 
-	uint8_t *read_buf = NULL;
-	drv_ssd_block *block = NULL;
+	uint32_t comp_size = head_size + (uint32_t)comp_bins_size;
 
-	drv_ssd *ssd = rd->u.ssd.ssd;
-	ssd_write_buf *swb = 0;
-	uint32_t wblock = RBLOCK_ID_TO_WBLOCK_ID(ssd, r->storage_key.ssd.rblock_id);
+	if (BYTES_TO_RBLOCK_BYTES(comp_size) >= BYTES_TO_RBLOCK_BYTES(used_size)) {
+		return NULL;
+	}
 
-	swb_check_and_reserve(&ssd->alloc_table->wblock_state[wblock], &swb);
+	*p_comp_size = comp_size;
 
-	if (swb) {
-		// Data is in write buffer, so read it from there.
-		cf_atomic32_incr(&rd->ns->n_reads_from_cache);
+	return comp_bins;
+}
 
-		read_buf = cf_malloc(record_size);
 
-		if (! read_buf) {
-			return -1;
-		}
+// Expand a compressed block into out_block, which must have room for max_size
+// bytes. The expanded block's length covers only its used size.
+static bool
+ssd_block_decompress(const drv_ssd_block *block, drv_ssd_block *out_block,
+		uint64_t max_size)
+{
+	uint64_t size = (uint64_t)block->length + LENGTH_BASE;
+	uint64_t head_size = sizeof(drv_ssd_block) + (uint64_t)block->bins_offset;
+	uint64_t out_size = head_size + block->sig;
 
-		block = (drv_ssd_block*)read_buf;
+	if (head_size > size || out_size > max_size) {
+		cf_warning_digest(AS_DRV_SSD, (cf_digest*)&block->keyd, "decompress: bad sizes - length %u bins-offset %u bins-size %lu ",
+				block->length, block->bins_offset, (uint64_t)block->sig);
+		return false;
+	}
 
-		int swb_offset = record_offset - WBLOCK_ID_TO_BYTES(ssd, wblock);
-		memcpy(read_buf, swb->buf + swb_offset, record_size);
-		swb_release(swb);
+	memcpy(out_block, block, head_size);
+
+	size_t bins_size = block->sig;
+
+	// Note - length is the exact compressed size, except in zlib blocks written
+	// before LZ4 and zstd were added. Those include rblock padding, which zlib
+	// ignores once it reaches the end of the stream.
+	if (as_decompress(ssd_block_compression(block), size - head_size,
+			block->data + block->bins_offset, &bins_size,
+			out_block->data + block->bins_offset) != 0 ||
+			bins_size != block->sig) {
+		cf_warning_digest(AS_DRV_SSD, (cf_digest*)&block->keyd, "decompress: failed ");
+		return false;
 	}
-	else {
-		// Normal case - data is read from device.
-		cf_atomic32_incr(&rd->ns->n_reads_from_device);
 
-		uint64_t record_end_offset = record_offset + record_size;
-		uint64_t read_offset = BYTES_DOWN_TO_IO_MIN(ssd, record_offset);
-		uint64_t read_end_offset = BYTES_UP_TO_IO_MIN(ssd, record_end_offset);
-		size_t read_size = read_end_offset - read_offset;
-		uint64_t record_buf_indent = record_offset - read_offset;
+	out_block->sig = 0;
+	out_block->magic = SSD_BLOCK_MAGIC;
+	out_block->length = (uint32_t)(out_size - LENGTH_BASE);
 
-		read_buf = cf_valloc(read_size);
+	return true;
+}
 
-		if (! read_buf) {
-			return -1;
-		}
 
-		int fd = ssd_fd_get(ssd);
+//==========================================================
+// Storage API implementation: reading records.
+//
+
+inline uint16_t
+as_storage_record_get_n_bins_ssd(as_storage_rd *rd)
+{
+	return rd->u.ssd.block ? rd->u.ssd.block->n_bins : 0;
+}
+
+
+// The cache a record's device copy may be in, if any. LDT sub-records have
+// their own when configured - their digests carry the LDT version, and every
+// key includes the record's location and generation, so a rewritten sub-record
+// never matches a stale entry.
+static inline ssd_read_cache*
+ssd_record_cache(drv_ssds *ssds, as_record *r)
+{
+	if (ssds->ldt_subrec_cache && as_ldt_record_is_sub(r)) {
+		return ssds->ldt_subrec_cache;
+	}
+
+	return ssds->read_cache;
+}
 
-		uint64_t start_ns = rd->ns->storage_benchmarks_enabled ? cf_getns() : 0;
 
-		if (lseek(fd, (off_t)read_offset, SEEK_SET) != (off_t)read_offset) {
-			cf_warning(AS_DRV_SSD, "%s: seek failed: offset %lu: errno %d (%s)",
-					ssd->name, read_offset, errno, cf_strerror(errno));
+// Expand a block that was read (if compressed) and attach it to the rd. Takes
+// ownership of read_buf.
+static int
+ssd_record_read_attach(as_storage_rd *rd, uint8_t *read_buf,
+		drv_ssd_block *block)
+{
+	if (ssd_block_compression(block) != COMPRESSION_NONE) {
+		uint64_t expanded_size = sizeof(drv_ssd_block) +
+				(uint64_t)block->bins_offset + block->sig;
+
+		if (expanded_size > rd->u.ssd.ssd->write_block_size) {
+			cf_warning_digest(AS_DRV_SSD, &rd->keyd, "{%s} read_ssd: bad compressed size %lu ",
+					rd->ns->name, expanded_size);
 			cf_free(read_buf);
-			close(fd);
 			return -1;
 		}
 
-		ssize_t rv = read(fd, read_buf, read_size);
+		uint8_t *expanded_buf = cf_malloc(expanded_size);
 
-		if (rv != (ssize_t)read_size) {
-			cf_warning(AS_DRV_SSD, "%s: read failed (%ld): size %lu: errno %d (%s)",
-					ssd->name, rv, read_size, errno, cf_strerror(errno));
+		if (! expanded_buf) {
 			cf_free(read_buf);
-			close(fd);
 			return -1;
 		}
 
-		if (start_ns != 0) {
-			histogram_insert_data_point(ssd->hist_read, start_ns);
+		if (! ssd_block_decompress(block, (drv_ssd_block*)expanded_buf,
+				expanded_size)) {
+			cf_free(expanded_buf);
+			cf_free(read_buf);
+			return -1;
 		}
 
-		ssd_fd_put(ssd, fd);
-
-		block = (drv_ssd_block*)(read_buf + record_buf_indent);
+		cf_free(read_buf);
+		read_buf = expanded_buf;
+		block = (drv_ssd_block*)expanded_buf;
+	}
 
-		// Sanity checks.
-		if (block->magic != SSD_BLOCK_MAGIC) {
+	rd->u.ssd.block = block;
+	rd->u.ssd.must_free_block = read_buf;
+	rd->have_device_block = true;
+
+	return 0;
+}
+
+
+static int
+ssd_batch_read_ent_compare(const void *pa, const void *pb)
+{
+	const ssd_batch_read_ent *a = (const ssd_batch_read_ent*)pa;
+	const ssd_batch_read_ent *b = (const ssd_batch_read_ent*)pb;
+	int a_file_id = a->rd->u.ssd.ssd->file_id;
+	int b_file_id = b->rd->u.ssd.ssd->file_id;
+
+	if (a_file_id != b_file_id) {
+		return a_file_id < b_file_id ? -1 : 1;
+	}
+
+	return a->offset < b->offset ? -1 : (a->offset > b->offset ? 1 : 0);
+}
+
+
+// Read one merged range of a device, and hand out each record's block.
+static void
+ssd_read_batch_group(drv_ssd *ssd, ssd_batch_read_ent *ents, uint32_t n_ents,
+		uint64_t start, uint64_t end)
+{
+	uint64_t read_offset = BYTES_DOWN_TO_IO_MIN(ssd, start);
+	uint64_t read_end_offset = BYTES_UP_TO_IO_MIN(ssd, end);
+	size_t read_size = read_end_offset - read_offset;
+	uint8_t *read_buf = cf_valloc(read_size);
+
+	if (! read_buf) {
+		return;
+	}
+
+	int fd = ssd_fd_get(ssd);
+	as_namespace *ns = ssd->ns;
+
+	uint64_t start_ns = ns->storage_benchmarks_enabled || g_ssd_trace_enabled ?
+			cf_getns() : 0;
+
+	ASD_STORAGE_READ_START(ssd->file_id, read_offset, read_size);
+
+	ssize_t rv = pread(fd, read_buf, read_size, (off_t)read_offset);
+
+	ASD_STORAGE_READ_DONE(ssd->file_id, read_offset, read_size);
+
+	if (rv != (ssize_t)read_size) {
+		cf_warning(AS_DRV_SSD, "%s: batch read failed (%ld): offset %lu size %lu: errno %d (%s)",
+				ssd->name, rv, read_offset, read_size, errno, cf_strerror(errno));
+		cf_free(read_buf);
+		close(fd);
+		return;
+	}
+
+	if (start_ns != 0) {
+		ssd_trace_note(ssd, SSD_TRACE_READ, read_offset, (uint32_t)read_size,
+				start_ns);
+
+		if (ns->storage_benchmarks_enabled) {
+			histogram_insert_data_point(ssd->hist_read, start_ns);
+		}
+	}
+
+	ssd_fd_put(ssd, fd);
+
+	if (n_ents > 1) {
+		cf_atomic64_add(&ssd->n_batch_read_merged, (int64_t)n_ents - 1);
+	}
+
+	for (uint32_t i = 0; i < n_ents; i++) {
+		as_storage_rd *rd = ents[i].rd;
+		drv_ssd_block *dev_block =
+				(drv_ssd_block*)(read_buf + (ents[i].offset - read_offset));
+
+		// Record may have moved since the caller looked - leave it.
+		if (! ssd_block_has_magic(dev_block) ||
+				cf_digest_compare(&dev_block->keyd, &rd->keyd) != 0) {
+			continue;
+		}
+
+		uint8_t *record_buf = cf_malloc(ents[i].size);
+
+		if (! record_buf) {
+			continue;
+		}
+
+		memcpy(record_buf, dev_block, ents[i].size);
+
+		cf_shard_counter_incr(&ns->n_reads_from_device);
+		cf_atomic64_incr(&ssd->n_cache_read_misses);
+
+		ssd_record_read_attach(rd, record_buf, (drv_ssd_block*)record_buf);
+	}
+
+	cf_free(read_buf);
+}
+
+
+int
+as_storage_record_read_ssd(as_storage_rd *rd)
+{
+	as_record *r = rd->r;
+
+	if (STORAGE_RBLOCK_IS_INVALID(r->storage_key.ssd.rblock_id)) {
+		cf_warning_digest(AS_DRV_SSD, &rd->keyd, "{%s} read_ssd: invalid rblock_id ",
+				rd->ns->name);
+		return -1;
+	}
+
+	uint64_t record_offset = RBLOCKS_TO_BYTES(r->storage_key.ssd.rblock_id);
+	uint64_t record_size = RBLOCKS_TO_BYTES(r->storage_key.ssd.n_rblocks);
+
+	uint8_t *read_buf = NULL;
+	drv_ssd_block *block = NULL;
+
+	drv_ssd *ssd = rd->u.ssd.ssd;
+	ssd_read_cache *cache = ssd_record_cache(
+			(drv_ssds*)rd->ns->storage_private, r);
+	bool is_subrec_cache = cache != NULL &&
+			cache == ((drv_ssds*)rd->ns->storage_private)->ldt_subrec_cache;
+	ssd_write_buf *swb = 0;
+	uint32_t wblock = RBLOCK_ID_TO_WBLOCK_ID(ssd, r->storage_key.ssd.rblock_id);
+
+	swb_check_and_reserve(&ssd->alloc_table->wblock_state[wblock], &swb);
+
+	if (swb) {
+		// Data is in write buffer, so read it from there.
+		cf_shard_counter_incr(&rd->ns->n_reads_from_cache);
+		cf_atomic64_incr(&ssd->n_cache_read_hits);
+
+		// Benign race - only affects post-write queue eviction order.
+		swb->recently_read = true;
+
+		read_buf = cf_malloc(record_size);
+
+		if (! read_buf) {
+			return -1;
+		}
+
+		block = (drv_ssd_block*)read_buf;
+
+		int swb_offset = record_offset - WBLOCK_ID_TO_BYTES(ssd, wblock);
+		memcpy(read_buf, swb->buf + swb_offset, record_size);
+		swb_release(swb);
+	}
+	else if (cache && (read_buf = ssd_read_cache_get(cache, &rd->keyd,
+			(uint16_t)ssd->file_id, r->storage_key.ssd.rblock_id,
+			r->generation, (uint32_t)record_size)) != NULL) {
+		// Data is in read cache - copy was made under the cache lock.
+		cf_shard_counter_incr(is_subrec_cache ?
+				&rd->ns->n_ldt_subrec_cache_hits : &rd->ns->n_read_cache_hits);
+
+		block = (drv_ssd_block*)read_buf;
+	}
+	else {
+		// Normal case - data is read from device.
+		cf_shard_counter_incr(&rd->ns->n_reads_from_device);
+		cf_atomic64_incr(&ssd->n_cache_read_misses);
+
+		uint64_t record_end_offset = record_offset + record_size;
+		uint64_t read_offset = BYTES_DOWN_TO_IO_MIN(ssd, record_offset);
+		uint64_t read_end_offset = BYTES_UP_TO_IO_MIN(ssd, record_end_offset);
+		size_t read_size = read_end_offset - read_offset;
+		uint64_t record_buf_indent = record_offset - read_offset;
+
+		read_buf = cf_valloc(read_size);
+
+		if (! read_buf) {
+			return -1;
+		}
+
+		int fd = ssd_fd_get(ssd);
+
+		uint64_t start_ns = rd->ns->storage_benchmarks_enabled ||
+				g_ssd_trace_enabled ? cf_getns() : 0;
+
+		ASD_STORAGE_READ_START(ssd->file_id, read_offset, read_size);
+
+		// Positioned read - one syscall per device read, and no dependence on
+		// the pooled descriptor's file position.
+		ssize_t rv = pread(fd, read_buf, read_size, (off_t)read_offset);
+
+		ASD_STORAGE_READ_DONE(ssd->file_id, read_offset, read_size);
+
+		if (rv != (ssize_t)read_size) {
+			cf_warning(AS_DRV_SSD, "%s: read failed (%ld): offset %lu size %lu: errno %d (%s)",
+					ssd->name, rv, read_offset, read_size, errno, cf_strerror(errno));
+			cf_free(read_buf);
+			close(fd);
+			return -1;
+		}
+
+		if (start_ns != 0) {
+			ssd_trace_note(ssd, SSD_TRACE_READ, read_offset,
+					(uint32_t)read_size, start_ns);
+
+			if (rd->ns->storage_benchmarks_enabled) {
+				histogram_insert_data_point(ssd->hist_read, start_ns);
+			}
+		}
+
+		ssd_fd_put(ssd, fd);
+
+		block = (drv_ssd_block*)(read_buf + record_buf_indent);
+
+		// Sanity checks.
+		if (! ssd_block_has_magic(block)) {
 			cf_warning(AS_DRV_SSD, "read: bad block magic offset %"PRIu64,
 					read_offset);
 			cf_free(read_buf);
@@ -1218,13 +1953,298 @@ as_storage_record_read_ssd(as_storage_rd *rd)
 			cf_free(read_buf);
 			return -1;
 		}
-	}
 
-	rd->u.ssd.block = block;
-	rd->u.ssd.must_free_block = read_buf;
-	rd->have_device_block = true;
+		if (cache) {
+			cf_shard_counter_incr(is_subrec_cache ?
+					&rd->ns->n_ldt_subrec_cache_misses :
+					&rd->ns->n_read_cache_misses);
+
+			// Cache the block as stored - compressed blocks stay compressed.
+			ssd_read_cache_put(cache, &rd->keyd, (uint16_t)ssd->file_id,
+					r->storage_key.ssd.rblock_id, r->generation,
+					(const uint8_t*)block, (uint32_t)record_size);
+		}
+	}
+
+	return ssd_record_read_attach(rd, read_buf, block);
+}
+
+
+// Storage-ordered read of several records, e.g. for a scan. Records are read
+// sorted by device offset, and records close together on a device are fetched
+// with one read. Any record not read here (e.g. in a write buffer, or failing
+// a sanity check) is left to be read the normal way.
+void
+as_storage_record_read_batch_ssd(as_storage_rd **rds, uint32_t n_rds)
+{
+	ssd_batch_read_ent ents[n_rds];
+	uint32_t n_ents = 0;
+
+	for (uint32_t i = 0; i < n_rds; i++) {
+		as_storage_rd *rd = rds[i];
+		as_record *r = rd->r;
+
+		if (rd->have_device_block || ! rd->record_on_device ||
+				rd->ignore_record_on_device ||
+				STORAGE_RBLOCK_IS_INVALID(r->storage_key.ssd.rblock_id)) {
+			continue;
+		}
+
+		drv_ssd *ssd = rd->u.ssd.ssd;
+		uint32_t wblock = RBLOCK_ID_TO_WBLOCK_ID(ssd,
+				r->storage_key.ssd.rblock_id);
+		ssd_write_buf *swb = 0;
+
+		swb_check_and_reserve(&ssd->alloc_table->wblock_state[wblock], &swb);
+
+		if (swb) {
+			// Resident in a write buffer - leave it for the normal read.
+			swb_release(swb);
+			continue;
+		}
+
+		ents[n_ents].rd = rd;
+		ents[n_ents].offset = RBLOCKS_TO_BYTES(r->storage_key.ssd.rblock_id);
+		ents[n_ents].size = RBLOCKS_TO_BYTES(r->storage_key.ssd.n_rblocks);
+		n_ents++;
+	}
+
+	if (n_ents == 0) {
+		return;
+	}
+
+	qsort(ents, n_ents, sizeof(ssd_batch_read_ent), ssd_batch_read_ent_compare);
+
+	uint32_t i = 0;
+
+	while (i < n_ents) {
+		drv_ssd *ssd = ents[i].rd->u.ssd.ssd;
+		uint64_t start = ents[i].offset;
+		uint64_t end = start + ents[i].size;
+		uint32_t j = i + 1;
+
+		// Merge following records on the same device, if close enough.
+		while (j < n_ents && ents[j].rd->u.ssd.ssd == ssd &&
+				ents[j].offset <= end + BATCH_READ_MAX_GAP &&
+				ents[j].offset + ents[j].size - start <= BATCH_READ_MAX_SIZE) {
+			if (ents[j].offset + ents[j].size > end) {
+				end = ents[j].offset + ents[j].size;
+			}
+
+			j++;
+		}
+
+		ssd_read_batch_group(ssd, &ents[i], j - i, start, end);
+
+		i = j;
+	}
+}
+
+static uint32_t
+ssd_sweep_slices_per_device(drv_ssds *ssds)
+{
+	off_t max_size = 0;
+
+	for (int i = 0; i < ssds->n_ssds; i++) {
+		off_t size = ssds->ssds[i].file_size - ssds->header->header_length;
+
+		if (size > max_size) {
+			max_size = size;
+		}
+	}
+
+	return (uint32_t)((max_size + SWEEP_SLICE_SIZE - 1) / SWEEP_SLICE_SIZE);
+}
+
+
+uint32_t
+as_storage_sweep_n_slices_ssd(as_namespace *ns, uint32_t *p_n_devices)
+{
+	drv_ssds *ssds = (drv_ssds*)ns->storage_private;
+
+	*p_n_devices = (uint32_t)ssds->n_ssds;
+
+	return (uint32_t)ssds->n_ssds * ssd_sweep_slices_per_device(ssds);
+}
+
+
+// Get a wblock's contents - from its write buffer if it has one, otherwise
+// from the device. Returns false if the wblock couldn't be read.
+static bool
+ssd_sweep_read_wblock(drv_ssd *ssd, uint32_t wblock_id, uint8_t *buf)
+{
+	ssd_write_buf *swb = 0;
+
+	swb_check_and_reserve(&ssd->alloc_table->wblock_state[wblock_id], &swb);
+
+	if (swb) {
+		memcpy(buf, swb->buf, ssd->write_block_size);
+		swb_release(swb);
+		return true;
+	}
+
+	uint64_t file_offset = WBLOCK_ID_TO_BYTES(ssd, wblock_id);
+	int fd = ssd_fd_get(ssd);
+
+	uint64_t start_ns = ssd->ns->storage_benchmarks_enabled ||
+			g_ssd_trace_enabled ? cf_getns() : 0;
+
+	ssize_t rlen = pread(fd, buf, ssd->write_block_size, (off_t)file_offset);
+
+	if (rlen != (ssize_t)ssd->write_block_size) {
+		cf_warning(AS_DRV_SSD, "%s: sweep read failed (%ld): offset %lu: errno %d (%s)",
+				ssd->name, rlen, file_offset, errno, cf_strerror(errno));
+		close(fd);
+		return false;
+	}
+
+	if (start_ns != 0) {
+		ssd_trace_note(ssd, SSD_TRACE_READ, file_offset, ssd->write_block_size,
+				start_ns);
+
+		if (ssd->ns->storage_benchmarks_enabled) {
+			histogram_insert_data_point(ssd->hist_large_block_read, start_ns);
+		}
+	}
+
+	ssd_fd_put(ssd, fd);
+
+	return true;
+}
+
+
+// Hand out the live records in a wblock - a record is live if the index still
+// points at this copy. Returns false if the callback stopped the sweep.
+static bool
+ssd_sweep_wblock(drv_ssd *ssd, uint32_t wblock_id, const uint8_t *buf,
+		struct as_index_tree_s **trees, as_storage_sweep_cb cb, void *udata)
+{
+	as_namespace *ns = ssd->ns;
+	uint64_t file_offset = WBLOCK_ID_TO_BYTES(ssd, wblock_id);
+	size_t wblock_offset = 0;
+	size_t records_end = ssd_wblock_records_end(ssd, buf);
+
+	while (wblock_offset < records_end) {
+		const drv_ssd_block *block = (const drv_ssd_block*)&buf[wblock_offset];
+
+		if (! ssd_block_has_magic(block)) {
+			wblock_offset += RBLOCK_SIZE;
+			continue;
+		}
+
+		size_t next_wblock_offset = wblock_offset +
+				BYTES_TO_RBLOCK_BYTES(block->length + LENGTH_BASE);
+
+		if (next_wblock_offset > records_end) {
+			cf_warning(AS_DRV_SSD, "%s: sweep: block extends over wblock %u: boff %lu blen %u",
+					ssd->name, wblock_id, wblock_offset, block->length);
+			break;
+		}
+
+		uint64_t rblock_id = BYTES_TO_RBLOCKS(file_offset + wblock_offset);
+		uint32_t n_rblocks = (uint32_t)
+				BYTES_TO_RBLOCKS(next_wblock_offset - wblock_offset);
+		size_t size = next_wblock_offset - wblock_offset;
+
+		wblock_offset = next_wblock_offset;
+
+		struct as_index_tree_s *tree =
+				trees[as_partition_getid(block->keyd)];
+
+		if (! tree) {
+			continue;
+		}
+
+		as_index_ref r_ref;
+		r_ref.skip_lock = false;
+
+		if (as_record_get(tree, (cf_digest*)&block->keyd, &r_ref, ns) != 0) {
+			continue; // deleted
+		}
+
+		as_index *r = r_ref.r;
+
+		// Skip stale copies - the record has since been rewritten elsewhere.
+		if (r->storage_key.ssd.file_id != ssd->file_id ||
+				r->storage_key.ssd.rblock_id != rblock_id ||
+				r->storage_key.ssd.n_rblocks != n_rblocks ||
+				(r->generation != block->generation &&
+						! ns->storage_touch_index_only)) {
+			as_record_done(&r_ref, ns);
+			continue;
+		}
+
+		as_storage_rd rd;
+
+		as_storage_record_open(ns, r, &rd, &r->key);
+
+		// If the copy fails, the callback's bin reads fall back to the device.
+		uint8_t *record_buf = cf_malloc(size);
+
+		if (record_buf) {
+			memcpy(record_buf, block, size);
+			ssd_record_read_attach(&rd, record_buf, (drv_ssd_block*)record_buf);
+		}
+
+		if (! cb(&r_ref, &rd, udata)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+void
+as_storage_sweep_slice_ssd(as_namespace *ns, uint32_t slice,
+		struct as_index_tree_s **trees, as_storage_sweep_cb cb, void *udata)
+{
+	drv_ssds *ssds = (drv_ssds*)ns->storage_private;
+	drv_ssd *ssd = &ssds->ssds[slice % (uint32_t)ssds->n_ssds];
+	uint64_t range = slice / (uint32_t)ssds->n_ssds;
+
+	uint64_t start_offset = ssds->header->header_length +
+			range * SWEEP_SLICE_SIZE;
+	uint64_t end_offset = start_offset + SWEEP_SLICE_SIZE;
+
+	if (end_offset > (uint64_t)ssd->file_size) {
+		end_offset = (uint64_t)ssd->file_size;
+	}
+
+	uint32_t wblock_id = BYTES_TO_WBLOCK_ID(ssd, start_offset);
+	uint32_t end_wblock_id = BYTES_TO_WBLOCK_ID(ssd, end_offset);
+
+	if (end_wblock_id > ssd->alloc_table->n_wblocks) {
+		end_wblock_id = ssd->alloc_table->n_wblocks;
+	}
+
+	if (wblock_id >= end_wblock_id) {
+		return;
+	}
+
+	uint8_t *buf = cf_valloc(ssd->write_block_size);
+
+	if (! buf) {
+		cf_warning(AS_DRV_SSD, "%s: sweep failed buffer alloc", ssd->name);
+		return;
+	}
+
+	for ( ; wblock_id < end_wblock_id; wblock_id++) {
+		// Free wblocks hold nothing live - a wblock filling now has its swb.
+		if (cf_atomic32_get(ssd->alloc_table->wblock_state[wblock_id].inuse_sz) == 0) {
+			continue;
+		}
+
+		if (! ssd_sweep_read_wblock(ssd, wblock_id, buf)) {
+			continue;
+		}
+
+		if (! ssd_sweep_wblock(ssd, wblock_id, buf, trees, cb, udata)) {
+			break;
+		}
+	}
 
-	return 0;
+	cf_free(buf);
 }
 
 
@@ -1261,6 +2281,58 @@ as_storage_particle_read_all_ssd(as_storage_rd *rd)
 }
 
 
+// Like as_storage_particle_read_all_ssd(), but loads only the bins with the
+// given ids, packed at the start of rd->bins. Matches on the names stored in
+// the block, so other bins cost neither a bin name lookup nor a particle cast.
+int
+as_storage_particle_read_bins_ssd(as_storage_rd *rd, const uint16_t *ids,
+		uint16_t n_ids)
+{
+	// If the record hasn't been read, read it.
+	if (rd->u.ssd.block == 0) {
+		if (0 != as_storage_record_read_ssd(rd)) {
+			cf_info(AS_DRV_SSD, "read_bins: failed as_storage_record_read_ssd()");
+			return -1;
+		}
+	}
+
+	drv_ssd_block *block = rd->u.ssd.block;
+	uint8_t *block_head = (uint8_t*)rd->u.ssd.block;
+
+	const char *names[n_ids];
+
+	for (uint16_t j = 0; j < n_ids; j++) {
+		names[j] = as_bin_get_name_from_id(rd->ns, ids[j]);
+	}
+
+	drv_ssd_bin *ssd_bin = (drv_ssd_bin*)(block->data + block->bins_offset);
+	uint16_t n_found = 0;
+
+	for (uint16_t i = 0; i < block->n_bins && n_found < n_ids; i++) {
+		for (uint16_t j = 0; j < n_ids; j++) {
+			if (strcmp(ssd_bin->name, names[j]) == 0) {
+				as_bin *b = &rd->bins[n_found++];
+
+				b->id = ids[j];
+
+				int rv = as_bin_particle_cast_from_flat(b,
+						block_head + ssd_bin->offset, ssd_bin->len);
+
+				if (0 != rv) {
+					return rv;
+				}
+
+				break;
+			}
+		}
+
+		ssd_bin = (drv_ssd_bin*)(block_head + ssd_bin->next);
+	}
+
+	return 0;
+}
+
+
 bool
 as_storage_record_get_key_ssd(as_storage_rd *rd)
 {
@@ -1291,33 +2363,57 @@ as_storage_record_get_key_ssd(as_storage_rd *rd)
 // Record writing utilities.
 //
 
-void
-ssd_flush_swb(drv_ssd *ssd, ssd_write_buf *swb)
+// Flush swbs for a run of adjacent wblocks in one device write.
+static void
+ssd_flush_swb_run(drv_ssd *ssd, ssd_write_buf **swbs, uint32_t n_swbs)
 {
-	// Wait for all writers to finish.
-	while (cf_atomic32_get(swb->n_writers) != 0) {
-		;
+	struct iovec iov[MAX_SSD_FLUSH_SWBS];
+
+	for (uint32_t i = 0; i < n_swbs; i++) {
+		// Wait for all writers to finish.
+		while (cf_atomic32_get(swbs[i]->n_writers) != 0) {
+			;
+		}
+
+		swb_seal_summary(swbs[i]);
+
+		iov[i].iov_base = swbs[i]->buf;
+		iov[i].iov_len = ssd->write_block_size;
 	}
 
 	int fd = ssd_fd_get(ssd);
-	off_t write_offset = (off_t)WBLOCK_ID_TO_BYTES(ssd, swb->wblock_id);
+	off_t write_offset = (off_t)WBLOCK_ID_TO_BYTES(ssd, swbs[0]->wblock_id);
+	size_t write_size = (size_t)n_swbs * ssd->write_block_size;
 
-	uint64_t start_ns = ssd->ns->storage_benchmarks_enabled ? cf_getns() : 0;
+	uint64_t start_ns = ssd->ns->storage_benchmarks_enabled ||
+			g_config.admission_control || g_ssd_trace_enabled ? cf_getns() : 0;
 
-	if (lseek(fd, write_offset, SEEK_SET) != write_offset) {
-		cf_crash(AS_DRV_SSD, "%s: DEVICE FAILED seek: offset %ld: errno %d (%s)",
-				ssd->name, write_offset, errno, cf_strerror(errno));
+	for (uint32_t i = 0; i < n_swbs; i++) {
+		ASD_STORAGE_FLUSH_START(ssd->file_id, swbs[i]->wblock_id);
 	}
 
-	ssize_t rv_s = write(fd, swb->buf, ssd->write_block_size);
+	ssize_t rv_s = pwritev(fd, iov, (int)n_swbs, write_offset);
 
-	if (rv_s != (ssize_t)ssd->write_block_size) {
-		cf_crash(AS_DRV_SSD, "%s: DEVICE FAILED write: errno %d (%s)",
-				ssd->name, errno, cf_strerror(errno));
+	if (rv_s != (ssize_t)write_size) {
+		cf_crash(AS_DRV_SSD, "%s: DEVICE FAILED write: offset %ld size %lu: errno %d (%s)",
+				ssd->name, write_offset, write_size, errno, cf_strerror(errno));
+	}
+
+	for (uint32_t i = 0; i < n_swbs; i++) {
+		ASD_STORAGE_FLUSH_DONE(ssd->file_id, swbs[i]->wblock_id);
 	}
 
 	if (start_ns != 0) {
-		histogram_insert_data_point(ssd->hist_write, start_ns);
+		ssd_trace_note(ssd, SSD_TRACE_WRITE, (uint64_t)write_offset,
+				write_size, start_ns);
+
+		if (ssd->ns->storage_benchmarks_enabled) {
+			histogram_insert_data_point(ssd->hist_write, start_ns);
+		}
+
+		if (g_config.admission_control) {
+			as_admission_note_device_write(ssd->ns, cf_getns() - start_ns);
+		}
 	}
 
 	ssd_fd_put(ssd, fd);
@@ -1325,23 +2421,61 @@ ssd_flush_swb(drv_ssd *ssd, ssd_write_buf *swb)
 
 
 void
-ssd_shadow_flush_swb(drv_ssd *ssd, ssd_write_buf *swb)
+ssd_flush_swb(drv_ssd *ssd, ssd_write_buf *swb)
 {
-	int fd = ssd_shadow_fd_get(ssd);
-	off_t write_offset = (off_t)WBLOCK_ID_TO_BYTES(ssd, swb->wblock_id);
+	ssd_flush_swb_run(ssd, &swb, 1);
+}
 
-	uint64_t start_ns = ssd->ns->storage_benchmarks_enabled ? cf_getns() : 0;
 
-	if (lseek(fd, write_offset, SEEK_SET) != write_offset) {
-		cf_crash(AS_DRV_SSD, "%s: DEVICE FAILED seek: offset %ld: errno %d (%s)",
-				ssd->shadow_name, write_offset, errno, cf_strerror(errno));
+static int
+swb_wblock_id_compare(const void *pa, const void *pb)
+{
+	const ssd_write_buf *a = *(const ssd_write_buf**)pa;
+	const ssd_write_buf *b = *(const ssd_write_buf**)pb;
+
+	return a->wblock_id < b->wblock_id ? -1 :
+			(a->wblock_id > b->wblock_id ? 1 : 0);
+}
+
+
+// Flush a batch of swbs popped together - swbs for adjacent wblocks are
+// coalesced into one device write. Sorts the batch in place.
+static void
+ssd_flush_swbs(drv_ssd *ssd, ssd_write_buf **swbs, uint32_t n_swbs)
+{
+	if (n_swbs > 1) {
+		qsort(swbs, n_swbs, sizeof(ssd_write_buf*), swb_wblock_id_compare);
 	}
 
-	ssize_t rv_s = write(fd, swb->buf, ssd->write_block_size);
+	uint32_t i = 0;
+
+	while (i < n_swbs) {
+		uint32_t n_run = 1;
+
+		while (i + n_run < n_swbs &&
+				swbs[i + n_run]->wblock_id == swbs[i]->wblock_id + n_run) {
+			n_run++;
+		}
+
+		ssd_flush_swb_run(ssd, &swbs[i], n_run);
+		i += n_run;
+	}
+}
+
+
+void
+ssd_shadow_flush(drv_ssd *ssd, ssd_shadow_write *sw)
+{
+	int fd = ssd_shadow_fd_get(ssd);
+	off_t write_offset = (off_t)WBLOCK_ID_TO_BYTES(ssd, sw->wblock_id);
+
+	uint64_t start_ns = ssd->ns->storage_benchmarks_enabled ? cf_getns() : 0;
+
+	ssize_t rv_s = pwrite(fd, sw->buf, ssd->write_block_size, write_offset);
 
 	if (rv_s != (ssize_t)ssd->write_block_size) {
-		cf_crash(AS_DRV_SSD, "%s: DEVICE FAILED write: errno %d (%s)",
-				ssd->shadow_name, errno, cf_strerror(errno));
+		cf_crash(AS_DRV_SSD, "%s: DEVICE FAILED write: offset %ld: errno %d (%s)",
+				ssd->shadow_name, write_offset, errno, cf_strerror(errno));
 	}
 
 	if (start_ns != 0) {
@@ -1383,7 +2517,11 @@ ssd_post_write(drv_ssd *ssd, ssd_write_buf *swb)
 	}
 
 	if (ssd->post_write_q) {
-		// Release post-write queue swbs if we're over the limit.
+		// Release post-write queue swbs if we're over the limit. Swbs that
+		// were read from while queued get one more trip through the queue -
+		// approximates LRU without reordering the queue on every read.
+		int n_second_chances = cf_queue_sz(ssd->post_write_q);
+
 		while ((uint32_t)cf_queue_sz(ssd->post_write_q) >
 				cf_atomic32_get(ssd->ns->storage_post_write_queue)) {
 			ssd_write_buf* cached_swb;
@@ -1396,6 +2534,12 @@ ssd_post_write(drv_ssd *ssd, ssd_write_buf *swb)
 				break;
 			}
 
+			if (cached_swb->recently_read && n_second_chances-- > 0) {
+				cached_swb->recently_read = false;
+				cf_queue_push(ssd->post_write_q, &cached_swb);
+				continue;
+			}
+
 			swb_dereference_and_release(ssd, cached_swb->wblock_id,
 					cached_swb);
 		}
@@ -1403,6 +2547,119 @@ ssd_post_write(drv_ssd *ssd, ssd_write_buf *swb)
 }
 
 
+static uint8_t *
+ssd_shadow_buf_get(drv_ssd *ssd)
+{
+	uint8_t *buf;
+
+	if (CF_QUEUE_OK != cf_queue_pop(ssd->shadow_buf_free_q, &buf,
+			CF_QUEUE_NOWAIT)) {
+		buf = cf_valloc(ssd->write_block_size);
+
+		if (! buf) {
+			cf_crash(AS_DRV_SSD, "device %s: can't allocate shadow write buffer",
+					ssd->name);
+		}
+	}
+
+	return buf;
+}
+
+
+static void
+ssd_shadow_buf_put(drv_ssd *ssd, uint8_t *buf)
+{
+	// Don't hold on to more buffers than a full shadow queue needs.
+	if (cf_queue_sz(ssd->shadow_buf_free_q) >=
+			ssd->ns->storage_shadow_max_write_q) {
+		cf_free(buf);
+		return;
+	}
+
+	cf_queue_push(ssd->shadow_buf_free_q, &buf);
+}
+
+
+// Queue a copy of a flushed swb for the shadow device, so the swb itself can
+// move on without waiting for the shadow write.
+static void
+ssd_shadow_queue(drv_ssd *ssd, ssd_write_buf *swb)
+{
+	as_namespace *ns = ssd->ns;
+
+	if (! ns->storage_shadow_stop_writes_on_lag &&
+			(int)cf_atomic32_get(ssd->n_shadow_writes_queued) >=
+					ns->storage_shadow_max_write_q) {
+		if (cf_atomic64_incr(&ssd->n_shadow_dropped_writes) == 1) {
+			cf_warning(AS_DRV_SSD, "shadow device %s: can't keep up - dropping shadow writes, shadow is no longer a valid copy",
+					ssd->shadow_name);
+		}
+
+		return;
+	}
+
+	ssd_shadow_write sw = {
+			.buf = ssd_shadow_buf_get(ssd),
+			.wblock_id = swb->wblock_id,
+			.queued_ms = cf_getms()
+	};
+
+	memcpy(sw.buf, swb->buf, ssd->write_block_size);
+
+	cf_atomic32_incr(&ssd->n_shadow_writes_queued);
+
+	// A given wblock always goes to the same shadow worker, so writes to a
+	// reused wblock can't land out of order.
+	cf_queue_push(ssd->shadow_write_q[
+			sw.wblock_id % ns->storage_shadow_write_threads], &sw);
+}
+
+
+// Pass a flushed swb on - copy it for the shadow device, if any, then to the
+// post-write queue.
+static inline void
+ssd_flush_done_one(drv_ssd *ssd, ssd_write_buf *swb)
+{
+	if (ssd->shadow_name) {
+		ssd_shadow_queue(ssd, swb);
+	}
+
+	// Transfer to post-write queue, or release swb, as appropriate.
+	ssd_post_write(ssd, swb);
+}
+
+
+// Complete flushed swbs in the order write workers popped them. Workers don't
+// pop past SSD_FLUSH_WINDOW swbs beyond the oldest incomplete one, so waiting
+// swbs can be slotted by sequence number.
+static void
+ssd_flush_done(drv_ssd *ssd, ssd_write_buf *swb)
+{
+	pthread_mutex_lock(&ssd->flush_done_lock);
+
+	if (swb->flush_seq != ssd->next_flush_done_seq) {
+		ssd->flush_done_pending[swb->flush_seq % SSD_FLUSH_WINDOW] = swb;
+		pthread_mutex_unlock(&ssd->flush_done_lock);
+		return;
+	}
+
+	ssd_flush_done_one(ssd, swb);
+	ssd->next_flush_done_seq++;
+
+	// Complete any swbs that were waiting on this one.
+	ssd_write_buf **p_pending;
+
+	while (*(p_pending = &ssd->flush_done_pending[
+			ssd->next_flush_done_seq % SSD_FLUSH_WINDOW])) {
+		ssd_flush_done_one(ssd, *p_pending);
+		*p_pending = NULL;
+		ssd->next_flush_done_seq++;
+	}
+
+	pthread_mutex_unlock(&ssd->flush_done_lock);
+}
+
+
 // Thread "run" function that flushes write buffers to device.
 void *
 ssd_write_worker(void *arg)
@@ -1410,25 +2667,57 @@ ssd_write_worker(void *arg)
 	drv_ssd *ssd = (drv_ssd*)arg;
 
 	while (ssd->running) {
-		ssd_write_buf *swb;
+		ssd_write_buf *swbs[MAX_SSD_FLUSH_SWBS];
+
+		// Number swbs as they're popped, so that with multiple write workers
+		// flushes may overlap but still complete in order.
+		pthread_mutex_lock(&ssd->flush_lock);
+
+		// Benign race - next_flush_done_seq only grows, so at worst we wait a
+		// little longer than needed.
+		if (ssd->next_flush_seq - ssd->next_flush_done_seq +
+				ssd->max_flush_swbs > SSD_FLUSH_WINDOW) {
+			pthread_mutex_unlock(&ssd->flush_lock);
+			usleep(100);
+			continue;
+		}
+
+		// Take whatever else is queued (up to max-flush-size) so swbs for
+		// adjacent wblocks can go in one device write.
+		uint32_t n_swbs = cf_ring_queue_pop_batch(ssd->swb_write_q, swbs,
+				ssd->max_flush_swbs, 100);
 
-		if (CF_QUEUE_OK != cf_queue_pop(ssd->swb_write_q, &swb, 100)) {
+		if (n_swbs == 0) {
+			pthread_mutex_unlock(&ssd->flush_lock);
 			continue;
 		}
 
-		// Sanity checks (optional).
-		ssd_write_sanity_checks(ssd, swb);
+		for (uint32_t i = 0; i < n_swbs; i++) {
+			swbs[i]->flush_seq = ssd->next_flush_seq++;
+		}
 
-		// Flush to the device.
-		ssd_flush_swb(ssd, swb);
+		pthread_mutex_unlock(&ssd->flush_lock);
 
-		if (ssd->shadow_name) {
-			// Queue for shadow device write.
-			cf_queue_push(ssd->swb_shadow_q, &swb);
+		uint32_t n_in_flight = cf_atomic32_add(&ssd->n_flushes_in_flight,
+				(int32_t)n_swbs);
+
+		// Benign race - high-water mark is only for stats.
+		if (n_in_flight > ssd->max_flushes_in_flight) {
+			ssd->max_flushes_in_flight = n_in_flight;
 		}
-		else {
-			// Transfer to post-write queue, or release swb, as appropriate.
-			ssd_post_write(ssd, swb);
+
+		for (uint32_t i = 0; i < n_swbs; i++) {
+			// Sanity checks (optional).
+			ssd_write_sanity_checks(ssd, swbs[i]);
+		}
+
+		// Flush to the device.
+		ssd_flush_swbs(ssd, swbs, n_swbs);
+
+		cf_atomic32_sub(&ssd->n_flushes_in_flight, (int32_t)n_swbs);
+
+		for (uint32_t i = 0; i < n_swbs; i++) {
+			ssd_flush_done(ssd, swbs[i]);
 		}
 	} // infinite event loop waiting for block to write
 
@@ -1436,27 +2725,39 @@ ssd_write_worker(void *arg)
 }
 
 
-// Thread "run" function that flushes write buffers to shadow device.
+typedef struct ssd_shadow_worker_info_s {
+	drv_ssd		*ssd;
+	cf_queue	*shadow_write_q;
+} ssd_shadow_worker_info;
+
+// Thread "run" function that flushes shadow writes to shadow device.
 void *
 ssd_shadow_worker(void *arg)
 {
-	drv_ssd *ssd = (drv_ssd*)arg;
+	ssd_shadow_worker_info *info = (ssd_shadow_worker_info*)arg;
+	drv_ssd *ssd = info->ssd;
+	cf_queue *shadow_write_q = info->shadow_write_q;
+
+	cf_free(info);
 
 	while (ssd->running) {
-		ssd_write_buf *swb;
+		ssd_shadow_write sw;
 
-		if (CF_QUEUE_OK != cf_queue_pop(ssd->swb_shadow_q, &swb, 100)) {
+		if (CF_QUEUE_OK != cf_queue_pop(shadow_write_q, &sw, 100)) {
 			continue;
 		}
 
-		// Sanity checks (optional).
-		ssd_write_sanity_checks(ssd, swb);
+		// Benign race - lag is only for stats.
+		ssd->shadow_lag_ms = cf_getms() - sw.queued_ms;
 
 		// Flush to the shadow device.
-		ssd_shadow_flush_swb(ssd, swb);
+		ssd_shadow_flush(ssd, &sw);
+
+		ssd_shadow_buf_put(ssd, sw.buf);
 
-		// Transfer to post-write queue, or release swb, as appropriate.
-		ssd_post_write(ssd, swb);
+		if (cf_atomic32_decr(&ssd->n_shadow_writes_queued) == 0) {
+			ssd->shadow_lag_ms = 0;
+		}
 	}
 
 	return NULL;
@@ -1480,11 +2781,25 @@ ssd_start_write_worker_threads(drv_ssds *ssds)
 		for (uint32_t j = 0; j < ssds->ns->storage_write_threads; j++) {
 			pthread_create(&ssd->write_worker_thread[j], 0, ssd_write_worker,
 					(void*)ssd);
+			as_config_sched_thread(AS_SCHED_POOL_WRITE,
+					ssd->write_worker_thread[j]);
 		}
 
-		if (ssd->shadow_name) {
-			pthread_create(&ssd->shadow_worker_thread, 0, ssd_shadow_worker,
-					(void*)ssd);
+		if (! ssd->shadow_name) {
+			continue;
+		}
+
+		for (uint32_t j = 0; j < ssds->ns->storage_shadow_write_threads; j++) {
+			ssd_shadow_worker_info *info =
+					cf_malloc(sizeof(ssd_shadow_worker_info));
+
+			info->ssd = ssd;
+			info->shadow_write_q = ssd->shadow_write_q[j];
+
+			pthread_create(&ssd->shadow_worker_thread[j], 0,
+					ssd_shadow_worker, (void*)info);
+			as_config_sched_thread(AS_SCHED_POOL_WRITE,
+					ssd->shadow_worker_thread[j]);
 		}
 	}
 }
@@ -1505,6 +2820,32 @@ as_storage_record_overhead_size(as_storage_rd *rd)
 }
 
 
+// Ordered maps keep their indexes on device if so configured - otherwise the
+// indexes are stripped, and rebuilt per op after every read.
+static inline uint32_t
+ssd_bin_flat_size(const as_namespace *ns, as_bin *b)
+{
+	if (ns->storage_persist_map_indexes &&
+			as_bin_get_particle_type(b) == AS_PARTICLE_TYPE_MAP) {
+		return as_bin_particle_map_flat_size_with_indexes(b);
+	}
+
+	return as_bin_particle_flat_size(b);
+}
+
+
+static inline uint32_t
+ssd_bin_to_flat(const as_namespace *ns, const as_bin *b, uint8_t *flat)
+{
+	if (ns->storage_persist_map_indexes &&
+			as_bin_get_particle_type(b) == AS_PARTICLE_TYPE_MAP) {
+		return as_bin_particle_map_to_flat_with_indexes(b, flat);
+	}
+
+	return as_bin_particle_to_flat(b, flat);
+}
+
+
 uint32_t
 as_storage_record_size(as_storage_rd *rd)
 {
@@ -1527,20 +2868,113 @@ as_storage_record_size(as_storage_rd *rd)
 
 		// TODO: could factor out sizeof(drv_ssd_bin) and multiply by i, but
 		// for now let's favor the low bin-count case and leave it this way.
-		write_size += sizeof(drv_ssd_bin) + as_bin_particle_flat_size(bin);
+		write_size += sizeof(drv_ssd_bin) + ssd_bin_flat_size(rd->ns, bin);
+	}
+
+	return write_size;
+}
+
+
+static inline uint32_t
+ssd_write_calculate_size(as_record *r, as_storage_rd *rd)
+{
+	// Note - this function is the only place where rounding size (up to a
+	// multiple of RBLOCK_SIZE) is really necessary.
+
+	return BYTES_TO_RBLOCK_BYTES(as_storage_record_size(rd));
+}
+
+
+// Flatten a record into buf - the block header, properties and bins. Returns
+// the number of bytes used, which may be less than the rblock-rounded size.
+static uint32_t
+ssd_flatten_record(as_record *r, as_storage_rd *rd, uint8_t *buf,
+		uint32_t write_size)
+{
+	uint8_t *buf_start = buf;
+
+	drv_ssd_block *block = (drv_ssd_block*)buf;
+
+	buf += sizeof(drv_ssd_block);
+
+	// Properties list goes just before bins.
+	if (rd->rec_props.p_data) {
+		memcpy(buf, rd->rec_props.p_data, rd->rec_props.size);
+		buf += rd->rec_props.size;
+	}
+
+	drv_ssd_bin *ssd_bin = 0;
+	uint32_t write_nbins = 0;
+
+	for (uint16_t i = 0; i < rd->n_bins; i++) {
+		as_bin *bin = &rd->bins[i];
+
+		if (as_bin_inuse(bin)) {
+			ssd_bin = (drv_ssd_bin*)buf;
+			buf += sizeof(drv_ssd_bin);
+
+			ssd_bin->version = 0;
+
+			if (! rd->ns->single_bin) {
+				strcpy(ssd_bin->name, as_bin_get_name_from_id(rd->ns, bin->id));
+			}
+			else {
+				ssd_bin->name[0] = 0;
+			}
+
+			ssd_bin->offset = buf - buf_start;
+
+			uint32_t particle_flat_size = ssd_bin_to_flat(rd->ns, bin, buf);
+
+			buf += particle_flat_size;
+			ssd_bin->len = particle_flat_size;
+			ssd_bin->next = buf - buf_start;
+
+			write_nbins++;
+		}
 	}
 
-	return write_size;
+	block->sig = 0; // deprecated
+	block->length = write_size - LENGTH_BASE;
+	block->magic = SSD_BLOCK_MAGIC;
+	block->keyd = rd->keyd;
+	block->generation = r->generation;
+	block->void_time = r->void_time;
+	block->bins_offset = rd->rec_props.p_data ? rd->rec_props.size : 0;
+	block->n_bins = write_nbins;
+	block->last_update_time = r->last_update_time;
+
+	return (uint32_t)(buf - buf_start);
 }
 
 
+// TTL class boundaries for write streams - with n streams the first n - 1 are
+// used, and records beyond them (or that never expire) go in the last stream.
+static const uint32_t TTL_STREAM_LIMITS[MAX_TTL_WRITE_STREAMS - 1] = {
+		60 * 60,			// 1 hour
+		24 * 60 * 60,		// 1 day
+		7 * 24 * 60 * 60	// 1 week
+};
+
 static inline uint32_t
-ssd_write_calculate_size(as_record *r, as_storage_rd *rd)
+ssd_ttl_write_stream(as_namespace *ns, uint32_t void_time)
 {
-	// Note - this function is the only place where rounding size (up to a
-	// multiple of RBLOCK_SIZE) is really necessary.
+	uint32_t last = ns->storage_ttl_write_streams - 1;
 
-	return BYTES_TO_RBLOCK_BYTES(as_storage_record_size(rd));
+	if (last == 0 || void_time == 0) {
+		return last;
+	}
+
+	uint32_t now = as_record_void_time_get();
+	uint32_t ttl = void_time > now ? void_time - now : 0;
+
+	for (uint32_t i = 0; i < last; i++) {
+		if (ttl < TTL_STREAM_LIMITS[i]) {
+			return i;
+		}
+	}
+
+	return last;
 }
 
 
@@ -1556,14 +2990,58 @@ ssd_write_bins(as_record *r, as_storage_rd *rd)
 		return -AS_PROTO_RESULT_FAIL_RECORD_TOO_BIG;
 	}
 
+	if (0 == rd->bins) {
+		// TODO - just crash?
+		cf_warning(AS_DRV_SSD, "write bins: no bins array");
+		return -AS_PROTO_RESULT_FAIL_UNKNOWN;
+	}
+
+	uint32_t props_size = rd->rec_props.p_data ? rd->rec_props.size : 0;
+
+	// If compressing, flatten and compress before reserving space, since the
+	// compressed size determines how much space to reserve. Records too small
+	// to save an rblock are flattened straight into the swb, as usual.
+	uint8_t *flat_buf = NULL;
+	uint32_t used_size = 0;
+	const uint8_t *comp_bins = NULL;
+	uint32_t comp_size = 0;
+
+	if (rd->ns->storage_compression != AS_STORAGE_COMPRESSION_NONE) {
+		cf_shard_counter_add(&rd->ns->n_compression_orig_bytes, (int64_t)write_size);
+
+		if (ssd_compression_may_save(write_size, props_size)) {
+			flat_buf = ssd_scratch_buf(&t_flat_buf, &t_flat_buf_size,
+					write_size);
+
+			if (! flat_buf) {
+				return -AS_PROTO_RESULT_FAIL_UNKNOWN;
+			}
+
+			used_size = ssd_flatten_record(r, rd, flat_buf, write_size);
+			comp_bins = ssd_block_compress(rd->ns, (drv_ssd_block*)flat_buf,
+					used_size, &comp_size);
+
+			if (comp_bins) {
+				write_size = BYTES_TO_RBLOCK_BYTES(comp_size);
+			}
+		}
+
+		cf_shard_counter_add(&rd->ns->n_compression_bytes, (int64_t)write_size);
+	}
+
+	// Records of similar TTL share wblocks, so wblocks tend to empty all at
+	// once as their records expire.
+	ssd_write_buf **p_current_swb =
+			&ssd->current_swbs[ssd_ttl_write_stream(rd->ns, r->void_time)];
+
 	// Reserve the portion of the current swb where this record will be written.
 	pthread_mutex_lock(&ssd->write_lock);
 
-	ssd_write_buf *swb = ssd->current_swb;
+	ssd_write_buf *swb = *p_current_swb;
 
 	if (! swb) {
 		swb = swb_get(ssd);
-		ssd->current_swb = swb;
+		*p_current_swb = swb;
 
 		if (! swb) {
 			cf_warning(AS_DRV_SSD, "write bins: couldn't get swb");
@@ -1575,25 +3053,27 @@ ssd_write_bins(as_record *r, as_storage_rd *rd)
 	// Check if there's enough space in current buffer - if not, free and zero
 	// any remaining unused space, enqueue it to be flushed to device, and grab
 	// a new buffer.
-	if (write_size > ssd->write_block_size - swb->pos) {
-		if (ssd->write_block_size != swb->pos) {
+	if (swb_space_needed(swb, write_size, props_size) > swb->end - swb->pos) {
+		if (swb->end != swb->pos) {
 			// Clean the end of the buffer before pushing to write queue.
-			memset(&swb->buf[swb->pos], 0, ssd->write_block_size - swb->pos);
+			memset(&swb->buf[swb->pos], 0, swb->end - swb->pos);
 		}
 
 		// Enqueue the buffer, to be flushed to device.
-		cf_queue_push(ssd->swb_write_q, &swb);
+		cf_ring_queue_push(ssd->swb_write_q, &swb);
 		cf_atomic_int_incr(&ssd->n_wblock_writes);
 
 		// Get the new buffer.
 		swb = swb_get(ssd);
-		ssd->current_swb = swb;
+		*p_current_swb = swb;
 
 		if (! swb) {
 			cf_warning(AS_DRV_SSD, "write bins: couldn't get swb");
 			pthread_mutex_unlock(&ssd->write_lock);
 			return -AS_PROTO_RESULT_FAIL_PARTITION_OUT_OF_SPACE;
 		}
+
+		swb_space_needed(swb, write_size, props_size);
 	}
 
 	// There's enough space - save the position where this record will be
@@ -1603,78 +3083,58 @@ ssd_write_bins(as_record *r, as_storage_rd *rd)
 	swb->pos += write_size;
 	cf_atomic32_incr(&swb->n_writers);
 
+	ssd_summary_entry *entry = swb_reserve_summary_entry(swb, props_size);
+
 	pthread_mutex_unlock(&ssd->write_lock);
 	// May now write this record concurrently with others in this swb.
 
-	// Flatten data into the block.
-
 	uint8_t *buf = &swb->buf[swb_pos];
-	uint8_t *buf_start = buf;
 
-	drv_ssd_block *block = (drv_ssd_block*)buf;
+	if (comp_bins) {
+		// Header and properties as flattened, then the compressed bins. The
+		// length is exact - LZ4 and zstd can't read past their data.
+		drv_ssd_block *block = (drv_ssd_block*)buf;
+		uint32_t head_size = (uint32_t)sizeof(drv_ssd_block) + props_size;
 
-	buf += sizeof(drv_ssd_block);
+		memcpy(buf, flat_buf, head_size);
+		memcpy(buf + head_size, comp_bins, comp_size - head_size);
+		memset(buf + comp_size, 0, write_size - comp_size);
 
-	// Properties list goes just before bins.
-	if (rd->rec_props.p_data) {
-		memcpy(buf, rd->rec_props.p_data, rd->rec_props.size);
-		buf += rd->rec_props.size;
+		block->sig = used_size - head_size;
+		block->magic = COMPRESSION_BLOCK_MAGIC[rd->ns->storage_compression];
+		block->length = comp_size - LENGTH_BASE;
 	}
-
-	drv_ssd_bin *ssd_bin = 0;
-	uint32_t write_nbins = 0;
-
-	if (0 == rd->bins) {
-		// TODO - just crash?
-		cf_warning(AS_DRV_SSD, "write bins: no bins array");
-		cf_atomic32_decr(&swb->n_writers);
-		return -AS_PROTO_RESULT_FAIL_UNKNOWN;
+	else if (flat_buf) {
+		// Didn't compress - copy only what was flattened.
+		memcpy(buf, flat_buf, used_size);
+		memset(buf + used_size, 0, write_size - used_size);
+	}
+	else {
+		// Flatten data into the block.
+		ssd_flatten_record(r, rd, buf, write_size);
 	}
 
-	for (uint16_t i = 0; i < rd->n_bins; i++) {
-		as_bin *bin = &rd->bins[i];
-
-		if (as_bin_inuse(bin)) {
-			ssd_bin = (drv_ssd_bin*)buf;
-			buf += sizeof(drv_ssd_bin);
-
-			ssd_bin->version = 0;
-
-			if (! rd->ns->single_bin) {
-				strcpy(ssd_bin->name, as_bin_get_name_from_id(rd->ns, bin->id));
-			}
-			else {
-				ssd_bin->name[0] = 0;
-			}
-
-			ssd_bin->offset = buf - buf_start;
-
-			uint32_t particle_flat_size = as_bin_particle_to_flat(bin, buf);
-
-			buf += particle_flat_size;
-			ssd_bin->len = particle_flat_size;
-			ssd_bin->next = buf - buf_start;
-
-			write_nbins++;
-		}
+	if (entry) {
+		swb_fill_summary_entry(entry, (const drv_ssd_block*)buf, swb_pos,
+				write_size);
 	}
 
-	block->sig = 0; // deprecated
-	block->length = write_size - LENGTH_BASE;
-	block->magic = SSD_BLOCK_MAGIC;
-	block->keyd = rd->keyd;
-	block->generation = r->generation;
-	block->void_time = r->void_time;
-	block->bins_offset = rd->rec_props.p_data ? rd->rec_props.size : 0;
-	block->n_bins = write_nbins;
-	block->last_update_time = r->last_update_time;
+	uint32_t old_n_rblocks = r->storage_key.ssd.n_rblocks;
 
 	r->storage_key.ssd.file_id = ssd->file_id;
 	r->storage_key.ssd.rblock_id = BYTES_TO_RBLOCKS(WBLOCK_ID_TO_BYTES(ssd, swb->wblock_id) + swb_pos);
 	r->storage_key.ssd.n_rblocks = BYTES_TO_RBLOCKS(write_size);
 
+	as_incr_hist_size_changed(rd->ns, r, old_n_rblocks);
+	as_namespace_adjust_set_device(rd->ns, as_index_get_set_id(r),
+			(int64_t)RBLOCKS_TO_BYTES(r->storage_key.ssd.n_rblocks) -
+					(int64_t)RBLOCKS_TO_BYTES(old_n_rblocks));
+
 	cf_atomic64_add(&ssd->inuse_size, (int64_t)write_size);
 	cf_atomic32_add(&ssd->alloc_table->wblock_state[swb->wblock_id].inuse_sz, (int32_t)write_size);
+	wblock_note_void_time(&ssd->alloc_table->wblock_state[swb->wblock_id],
+			r->void_time);
+	ssd_live_map_set(ssd, r->storage_key.ssd.rblock_id);
 
 	// We are finished writing to the buffer.
 	cf_atomic32_decr(&swb->n_writers);
@@ -1917,15 +3377,8 @@ as_storage_analyze_wblock(as_namespace* ns, int device_index,
 	int fd = ssd_fd_get(ssd);
 	uint64_t file_offset = WBLOCK_ID_TO_BYTES(ssd, wblock_id);
 
-	if (lseek(fd, (off_t)file_offset, SEEK_SET) != (off_t)file_offset) {
-		cf_warning(AS_DRV_SSD, "%s: seek failed: offset %lu: errno %d (%s)",
-				ssd->name, file_offset, errno, cf_strerror(errno));
-		cf_free(read_buf);
-		close(fd);
-		return -1;
-	}
-
-	ssize_t rlen = read(fd, read_buf, ssd->write_block_size);
+	ssize_t rlen = pread(fd, read_buf, ssd->write_block_size,
+			(off_t)file_offset);
 
 	if (rlen != (ssize_t)ssd->write_block_size) {
 		cf_warning(AS_DRV_SSD, "%s: read failed (%ld): errno %d (%s)",
@@ -1946,11 +3399,12 @@ as_storage_analyze_wblock(as_namespace* ns, int device_index,
 	uint32_t inuse_sz_start =
 			cf_atomic32_get(ssd->alloc_table->wblock_state[wblock_id].inuse_sz);
 	uint32_t offset = 0;
+	uint32_t records_end = ssd_wblock_records_end(ssd, read_buf);
 
-	while (offset < ssd->write_block_size) {
+	while (offset < records_end) {
 		drv_ssd_block* p_block = (drv_ssd_block*)&read_buf[offset];
 
-		if (p_block->magic != SSD_BLOCK_MAGIC) {
+		if (! ssd_block_has_magic(p_block)) {
 			if (offset == 0) {
 				// First block must have magic.
 				cf_warning(AS_DRV_SSD, "analyze wblock ERROR: 1st block has no magic");
@@ -1968,7 +3422,7 @@ as_storage_analyze_wblock(as_namespace* ns, int device_index,
 		uint32_t next_offset = offset +
 				BYTES_TO_RBLOCK_BYTES(p_block->length + LENGTH_BASE);
 
-		if (next_offset > ssd->write_block_size) {
+		if (next_offset > records_end) {
 			cf_warning(AS_DRV_SSD, "analyze wblock ERROR: record overflows wblock");
 			cf_free(read_buf);
 			return -1;
@@ -2062,18 +3516,37 @@ ssd_log_stats(drv_ssd *ssd, uint64_t *p_prev_n_total_writes,
 	float defrag_write_rate = (float)(n_defrag_writes - *p_prev_n_defrag_writes) /
 			(float)LOG_STATS_INTERVAL_sec;
 
-	cf_info(AS_DRV_SSD, "device %s: used %lu, contig-free %luM (%d wblocks), swb-free %d, w-q %d w-tot %lu (%.1f/s), defrag-q %d defrag-tot %lu (%.1f/s) defrag-w-tot %lu (%.1f/s)",
+	uint32_t max_in_flight = ssd->max_flushes_in_flight;
+
+	ssd->max_flushes_in_flight = cf_atomic32_get(ssd->n_flushes_in_flight);
+
+	cf_info(AS_DRV_SSD, "device %s: used %lu, contig-free %luM (%d wblocks), swb-free %d, w-q %d w-in-flight %u (max %u) w-tot %lu (%.1f/s), defrag-q %d defrag-tot %lu (%.1f/s) defrag-w-tot %lu (%.1f/s) defrag-expired %lu:%lu",
 			ssd->name, ssd->inuse_size,
 			available_size(ssd) >> 20,
 			cf_queue_sz(ssd->free_wblock_q),
 			cf_queue_sz(ssd->swb_free_q),
-			cf_queue_sz(ssd->swb_write_q), n_total_writes, total_write_rate,
+			cf_ring_queue_sz(ssd->swb_write_q),
+			cf_atomic32_get(ssd->n_flushes_in_flight), max_in_flight,
+			n_total_writes, total_write_rate,
 			cf_queue_sz(ssd->defrag_wblock_q), n_defrag_reads, defrag_read_rate,
-			n_defrag_writes, defrag_write_rate);
+			n_defrag_writes, defrag_write_rate,
+			cf_atomic64_get(ssd->n_defrag_expired_wblocks),
+			cf_atomic64_get(ssd->n_defrag_expired_records));
 
 	if (ssd->shadow_name) {
-		cf_info(AS_DRV_SSD, "shadow device %s: w-q %d",
-				ssd->shadow_name, cf_queue_sz(ssd->swb_shadow_q));
+		cf_info(AS_DRV_SSD, "shadow device %s: w-q %d lag-ms %lu dropped %lu",
+				ssd->shadow_name,
+				cf_atomic32_get(ssd->n_shadow_writes_queued),
+				ssd->shadow_lag_ms,
+				cf_atomic64_get(ssd->n_shadow_dropped_writes));
+	}
+
+	if (ssd->post_write_q) {
+		cf_info(AS_DRV_SSD, "device %s: post-write-q %d cache-read hits %lu misses %lu batch-read-merged %lu",
+				ssd->name, cf_queue_sz(ssd->post_write_q),
+				cf_atomic64_get(ssd->n_cache_read_hits),
+				cf_atomic64_get(ssd->n_cache_read_misses),
+				cf_atomic64_get(ssd->n_batch_read_merged));
 	}
 
 	*p_prev_n_total_writes = n_total_writes;
@@ -2103,16 +3576,17 @@ ssd_free_swbs(drv_ssd *ssd)
 }
 
 
+// Note - p_prev_sizes is an array of MAX_TTL_WRITE_STREAMS sizes.
 void
 ssd_flush_current_swb(drv_ssd *ssd, uint64_t *p_prev_n_writes,
-		uint32_t *p_prev_size)
+		uint32_t *p_prev_sizes)
 {
 	uint64_t n_writes = cf_atomic_int_get(ssd->n_wblock_writes);
 
 	// If there's an active write load, we don't need to flush.
 	if (n_writes != *p_prev_n_writes) {
 		*p_prev_n_writes = n_writes;
-		*p_prev_size = 0;
+		memset(p_prev_sizes, 0, sizeof(uint32_t) * MAX_TTL_WRITE_STREAMS);
 		return;
 	}
 
@@ -2126,21 +3600,25 @@ ssd_flush_current_swb(drv_ssd *ssd, uint64_t *p_prev_n_writes,
 		pthread_mutex_unlock(&ssd->write_lock);
 
 		*p_prev_n_writes = n_writes;
-		*p_prev_size = 0;
+		memset(p_prev_sizes, 0, sizeof(uint32_t) * MAX_TTL_WRITE_STREAMS);
 		return;
 	}
 
-	// Flush the current swb if it isn't empty, and has been written to since
+	// Flush each current swb if it isn't empty, and has been written to since
 	// last flushed.
 
-	ssd_write_buf *swb = ssd->current_swb;
+	for (uint32_t i = 0; i < MAX_TTL_WRITE_STREAMS; i++) {
+		ssd_write_buf *swb = ssd->current_swbs[i];
 
-	if (swb && swb->pos != *p_prev_size) {
-		*p_prev_size = swb->pos;
+		if (! swb || swb->pos == p_prev_sizes[i]) {
+			continue;
+		}
+
+		p_prev_sizes[i] = swb->pos;
 
 		// Clean the end of the buffer before flushing.
-		if (ssd->write_block_size != swb->pos) {
-			memset(&swb->buf[swb->pos], 0, ssd->write_block_size - swb->pos);
+		if (swb->end != swb->pos) {
+			memset(&swb->buf[swb->pos], 0, swb->end - swb->pos);
 		}
 
 		// Flush it.
@@ -2187,8 +3665,8 @@ ssd_flush_defrag_swb(drv_ssd *ssd, uint64_t *p_prev_n_writes,
 		*p_prev_size = swb->pos;
 
 		// Clean the end of the buffer before flushing.
-		if (ssd->write_block_size != swb->pos) {
-			memset(&swb->buf[swb->pos], 0, ssd->write_block_size - swb->pos);
+		if (swb->end != swb->pos) {
+			memset(&swb->buf[swb->pos], 0, swb->end - swb->pos);
 		}
 
 		// Flush it.
@@ -2275,7 +3753,7 @@ run_ssd_maintenance(void *udata)
 	uint64_t prev_n_defrag_writes = 0;
 
 	uint64_t prev_n_writes_flush = 0;
-	uint32_t prev_size_flush = 0;
+	uint32_t prev_sizes_flush[MAX_TTL_WRITE_STREAMS] = { 0 };
 	uint64_t prev_n_writes_defrag_flush = 0;
 	uint32_t prev_size_defrag_flush = 0;
 
@@ -2316,7 +3794,7 @@ run_ssd_maintenance(void *udata)
 		uint64_t flush_max_us = ns->storage_flush_max_us;
 
 		if (flush_max_us != 0 && now >= prev_flush + flush_max_us) {
-			ssd_flush_current_swb(ssd, &prev_n_writes_flush, &prev_size_flush);
+			ssd_flush_current_swb(ssd, &prev_n_writes_flush, prev_sizes_flush);
 			prev_flush = now;
 			next = next_time(now, flush_max_us, next);
 		}
@@ -2571,13 +4049,7 @@ void
 as_storage_write_header(drv_ssd *ssd, ssd_device_header *header, size_t size)
 {
 	int fd = ssd_fd_get(ssd);
-
-	if (lseek(fd, 0, SEEK_SET) != 0) {
-		cf_crash(AS_DRV_SSD, "%s: DEVICE FAILED seek: errno %d (%s)",
-				ssd->name, errno, cf_strerror(errno));
-	}
-
-	ssize_t sz = write(fd, (void*)header, size);
+	ssize_t sz = pwrite(fd, (void*)header, size, 0);
 
 	if (sz != (ssize_t)size) {
 		cf_crash(AS_DRV_SSD, "%s: DEVICE FAILED write: errno %d (%s)",
@@ -2591,13 +4063,7 @@ as_storage_write_header(drv_ssd *ssd, ssd_device_header *header, size_t size)
 	}
 
 	fd = ssd_shadow_fd_get(ssd);
-
-	if (lseek(fd, 0, SEEK_SET) != 0) {
-		cf_crash(AS_DRV_SSD, "%s: DEVICE FAILED seek: errno %d (%s)",
-				ssd->shadow_name, errno, cf_strerror(errno));
-	}
-
-	sz = write(fd, (void*)header, size);
+	sz = pwrite(fd, (void*)header, size, 0);
 
 	if (sz != (ssize_t)size) {
 		cf_crash(AS_DRV_SSD, "%s: DEVICE FAILED write: errno %d (%s)",
@@ -2672,9 +4138,11 @@ is_set_evictable(as_namespace* ns, const as_rec_props* p_props)
 // -1 - skipped or deleted this record for a "normal" reason
 // -2 - serious limit encountered, caller won't continue
 // -3 - couldn't parse this record, but caller will continue
+//
+// A block built from a wblock summary entry has rec-props but no bins.
 int
 ssd_record_add(drv_ssds* ssds, drv_ssd* ssd, drv_ssd_block* block,
-		uint64_t rblock_id, uint32_t n_rblocks)
+		uint64_t rblock_id, uint32_t n_rblocks, bool from_summary)
 {
 	as_partition_id pid = as_partition_getid(block->keyd);
 
@@ -2693,7 +4161,7 @@ ssd_record_add(drv_ssds* ssds, drv_ssd* ssd, drv_ssd_block* block,
 	}
 
 	// Sanity-check the record.
-	if (! is_valid_record(block, ns->name)) {
+	if (! from_summary && ! is_valid_record(block, ns->name)) {
 		return -3;
 	}
 
@@ -2754,17 +4222,35 @@ ssd_record_add(drv_ssds* ssds, drv_ssd* ssd, drv_ssd_block* block,
 		// Record already existed. Ignore this one if existing record is newer.
 		if (prefer_existing_record(ssd, wblock_id, block, r)) {
 			as_record_done(&r_ref, ns);
-			ssd->record_add_older_counter++;
+			cf_atomic64_incr(&ssd->record_add_older_counter);
 			return -1;
 		}
 	}
 	// The record we're now reading is the latest version (so far) ...
 
+	// Un-count the version being replaced, before its set-id changes.
+	if (rv == 0) {
+		if (! is_ldt_sub) {
+			as_cold_start_counts_remove(ns, r->void_time,
+					as_index_get_set_id(r));
+		}
+
+		as_namespace_adjust_set_device(ns, as_index_get_set_id(r),
+				-(int64_t)RBLOCKS_TO_BYTES(r->storage_key.ssd.n_rblocks));
+	}
+
+	uint32_t old_void_time = r->void_time;
+
 	// Set/reset the record's void-time, last-update-time, and generation.
 	r->void_time = block->void_time;
 	r->last_update_time = block->last_update_time;
 	r->generation = block->generation;
 
+	// Count now - the record may be deleted before the expiration index hint.
+	if (! is_ldt_sub) {
+		as_incr_hist_void_time_changed(ns, r, old_void_time);
+	}
+
 	// Skip records that have expired. Note - LDT subrecords are expired via
 	// their parent record.
 	if (r->void_time != 0 && ! is_ldt_sub) {
@@ -2786,7 +4272,7 @@ ssd_record_add(drv_ssds* ssds, drv_ssd* ssd, drv_ssd_block* block,
 
 			as_index_delete(p_partition->vp, &block->keyd);
 			as_record_done(&r_ref, ns);
-			ssd->record_add_expired_counter++;
+			cf_atomic64_incr(&ssd->record_add_expired_counter);
 			return -1;
 		}
 
@@ -2795,16 +4281,34 @@ ssd_record_add(drv_ssds* ssds, drv_ssd* ssd, drv_ssd_block* block,
 			cf_detail(AS_DRV_SSD, "record-add truncating void-time %u > max %u",
 					r->void_time, ns->cold_start_max_void_time);
 
+			uint32_t read_void_time = r->void_time;
+
 			r->void_time = ns->cold_start_max_void_time;
-			ssd->record_add_max_ttl_counter++;
+			as_incr_hist_void_time_changed(ns, r, read_void_time);
+			cf_atomic64_incr(&ssd->record_add_max_ttl_counter);
 		}
 	}
 
+	// Skip records that were truncated. (Any older version is also truncated,
+	// so can't be resurrected.) LDT subrecords are truncated via their parent.
+	if (! is_ldt_sub &&
+			as_truncate_lut_is_truncated(r->last_update_time, ns, &props)) {
+		as_index_delete(p_partition->vp, &block->keyd);
+		as_record_done(&r_ref, ns);
+		cf_atomic64_incr(&ssd->record_add_truncated_counter);
+		return -1;
+	}
+
 	// We'll keep the record we're now reading ...
 
+	if (! is_ldt_sub) {
+		as_expire_index_record_changed(ns, r, old_void_time);
+	}
+
 	// Update maximum void-times.
 	cf_atomic_int_setmax(&p_partition->max_void_time, r->void_time);
 	cf_atomic_int_setmax(&ns->max_void_time, r->void_time);
+	as_partition_max_lut_update(p_partition, r->last_update_time);
 
 	if (props.size != 0) {
 		// Do this early since set-id is needed for the secondary index update.
@@ -2814,6 +4318,11 @@ ssd_record_add(drv_ssds* ssds, drv_ssd* ssd, drv_ssd_block* block,
 		as_record_clear_properties(r, ns);
 	}
 
+	// Count the record for cold-start eviction.
+	if (! is_ldt_sub) {
+		as_cold_start_counts_add(ns, r->void_time, as_index_get_set_id(r));
+	}
+
 	cf_detail(AS_RW, "TO INDEX FROM DISK	Digest=%"PRIx64" bits %d",
 			*(uint64_t*)&block->keyd.digest[8],
 			as_ldt_record_get_rectype_bits(r));
@@ -2917,13 +4426,17 @@ ssd_record_add(drv_ssds* ssds, drv_ssd* ssd, drv_ssd_block* block,
 			}
 		}
 
+		if (has_sindex) {
+			sbins_populated += as_sindex_sbins_composite_from_bins(ns, set_name, rd.bins, old_n_bins, -1, &sbins[sbins_populated], AS_SINDEX_OP_DELETE);
+		}
+
 		if (! rd.ns->single_bin) {
 			int32_t delta_bins = (int32_t)block->n_bins - (int32_t)rd.n_bins;
 
 			if (delta_bins) {
 				uint16_t new_size = (uint16_t)block->n_bins;
 				if ((delta_bins < 0) && has_sindex) {
-					sbins_populated += as_sindex_sbins_from_rd(&rd, new_size, old_n_bins, sbins, AS_SINDEX_OP_DELETE);
+					sbins_populated += as_sindex_sbins_from_rd(&rd, new_size, old_n_bins, &sbins[sbins_populated], AS_SINDEX_OP_DELETE);
 				}
 				as_bin_allocate_bin_space(r, &rd, delta_bins);
 			}
@@ -2955,6 +4468,7 @@ ssd_record_add(drv_ssds* ssds, drv_ssd* ssd, drv_ssd_block* block,
 		}
 
 		if (has_sindex) {
+			sbins_populated += as_sindex_sbins_composite_from_bins(ns, set_name, rd.bins, block->n_bins, -1, &sbins[sbins_populated], AS_SINDEX_OP_INSERT);
 			SINDEX_GUNLOCK();
 			if (sbins_populated > 0) {
 				as_sindex_update_by_sbin(ns, as_index_get_set_name(r, ns), sbins, sbins_populated, &rd.keyd);
@@ -2972,24 +4486,35 @@ ssd_record_add(drv_ssds* ssds, drv_ssd* ssd, drv_ssd_block* block,
 		ssd_block_free(&ssds->ssds[r->storage_key.ssd.file_id],
 				r->storage_key.ssd.rblock_id, r->storage_key.ssd.n_rblocks,
 				"record-add");
-		ssd->record_add_replace_counter++;
+		cf_atomic64_incr(&ssd->record_add_replace_counter);
 	}
 	else {
-		ssd->record_add_unique_counter++;
+		cf_atomic64_incr(&ssd->record_add_unique_counter);
 	}
 
 	// Update storage accounting to include this record.
 	// TODO - pass in size instead of n_rblocks.
 	uint32_t size = (uint32_t)RBLOCKS_TO_BYTES(n_rblocks);
 
-	ssd->inuse_size += size;
-	ssd->alloc_table->wblock_state[wblock_id].inuse_sz += size;
+	// Atomic since devices, and ranges within devices, are loaded in
+	// parallel, and a record may replace one being loaded elsewhere.
+	cf_atomic64_add(&ssd->inuse_size, (int64_t)size);
+	cf_atomic32_add(&ssd->alloc_table->wblock_state[wblock_id].inuse_sz,
+			(int32_t)size);
+	wblock_note_void_time(&ssd->alloc_table->wblock_state[wblock_id],
+			r->void_time);
+	ssd_live_map_set(ssd, rblock_id);
+
+	uint32_t old_n_rblocks = r->storage_key.ssd.n_rblocks;
 
 	// Set/reset the record's storage information.
 	r->storage_key.ssd.file_id = ssd->file_id;
 	r->storage_key.ssd.rblock_id = rblock_id;
 	r->storage_key.ssd.n_rblocks = n_rblocks;
 
+	as_incr_hist_size_changed(ns, r, old_n_rblocks);
+	as_namespace_adjust_set_device(ns, as_index_get_set_id(r), (int64_t)size);
+
 	// Make sure subrecord sweep happens.
 	if (is_ldt_parent) {
 		ssd->has_ldt = true;
@@ -3001,47 +4526,282 @@ ssd_record_add(drv_ssds* ssds, drv_ssd* ssd, drv_ssd_block* block,
 }
 
 
-// Sweep through storage devices and rebuild the index.
-//
-// If there are LDT records the sweep is done twice, once for LDT parent records
-// and then again for LDT subrecords.
-int
-ssd_load_device_sweep(drv_ssds *ssds, drv_ssd *ssd)
+// Add the records in a wblock just read into buf to the index. Returns false
+// if the wblock looks unused, or has bad data.
+static bool
+ssd_load_wblock(drv_ssds *ssds, drv_ssd *ssd, uint8_t *buf, off_t file_offset,
+		uint8_t **p_expand_buf)
 {
-	uint8_t *buf = cf_valloc(LOAD_BUF_SIZE);
+	size_t records_end = ssd_wblock_records_end(ssd, buf);
+	size_t block_offset = 0; // current offset within the wblock, in bytes
 
-	bool read_shadow = ssd->shadow_name && ! ssd->sub_sweep;
-	char *read_ssd_name = read_shadow ? ssd->shadow_name : ssd->name;
-	int fd = read_shadow ? ssd_shadow_fd_get(ssd) : ssd_fd_get(ssd);
-	int write_fd = read_shadow ? ssd_fd_get(ssd) : -1;
+	while (block_offset < records_end) {
+		drv_ssd_block *block = (drv_ssd_block*)&buf[block_offset];
 
-	// Seek past the header.
-	off_t file_offset = ssds->header->header_length;
+		// Look for record magic.
+		if (! ssd_block_has_magic(block)) {
+			// No record found here.
+			// (Includes normal case of nothing ever written here).
 
-	if (lseek(fd, file_offset, SEEK_SET) != file_offset) {
-		cf_warning(AS_DRV_SSD, "%s: seek failed: offset %ld: errno %d (%s)",
-				read_ssd_name, file_offset, errno, cf_strerror(errno));
-		close(fd);
-		fd = -1;
-		goto Finished;
+			// We always write some at the start of a wblock.
+			if (block_offset == 0) {
+				return false;
+			}
+
+			// Otherwise check the next rblock, looking for magic.
+			block_offset += RBLOCK_SIZE;
+			continue;
+		}
+
+		// Note - if block->length is sane, we don't need to round up to a
+		// multiple of RBLOCK_SIZE, but let's do it anyway just to be safe.
+		size_t next_block_offset = block_offset +
+				BYTES_TO_RBLOCK_BYTES(block->length + LENGTH_BASE);
+
+		// Sanity-check for wblock overruns.
+		if (next_block_offset > records_end) {
+			cf_warning(AS_DRV_SSD, "error: block extends over wblock: foff %"PRIu64" boff %"PRIu64" blen %"PRIu64,
+				file_offset, block_offset, (uint64_t)block->length);
+			return false;
+		}
+
+		drv_ssd_block *add_block = block;
+
+		// Expand compressed records so they can be checked and loaded like
+		// any other.
+		if (ssd_block_compression(block) != COMPRESSION_NONE) {
+			if (! *p_expand_buf) {
+				*p_expand_buf = cf_malloc(ssd->write_block_size);
+			}
+
+			if (! ssd_block_decompress(block, (drv_ssd_block*)*p_expand_buf,
+					ssd->write_block_size)) {
+				return false;
+			}
+
+			add_block = (drv_ssd_block*)*p_expand_buf;
+		}
+
+		// Found a record - try to add it to the index.
+		int add_rv = ssd_record_add(ssds, ssd, add_block,
+				BYTES_TO_RBLOCKS(file_offset + block_offset),
+				(uint32_t)BYTES_TO_RBLOCKS(next_block_offset - block_offset),
+				false);
+
+		if (add_rv == -2) {
+			cf_crash(AS_DRV_SSD, "hit stop-writes limit before drive scan completed");
+		}
+
+		if (add_rv == -3) {
+			return false;
+		}
+
+		block_offset = next_block_offset;
+	}
+
+	return true;
+}
+
+
+// Add the records listed in a wblock's summary to the index. The summary
+// entries carry everything the index needs when data isn't in memory.
+static void
+ssd_load_wblock_summary(drv_ssds *ssds, drv_ssd *ssd,
+		const ssd_summary_footer *footer, off_t file_offset,
+		drv_ssd_block *block)
+{
+	const uint8_t *p_entry = (const uint8_t*)footer - footer->size;
+	uint32_t wblock_n_rblocks =
+			(uint32_t)BYTES_TO_RBLOCKS(ssd->write_block_size);
+
+	for (uint32_t i = 0; i < footer->n_entries; i++) {
+		const ssd_summary_entry *entry = (const ssd_summary_entry*)p_entry;
+
+		if (p_entry + sizeof(ssd_summary_entry) > (const uint8_t*)footer ||
+				p_entry + SUMMARY_ENTRY_SIZE(entry->props_size) >
+						(const uint8_t*)footer ||
+				entry->n_rblocks == 0 ||
+				(uint32_t)entry->rblock_offset + entry->n_rblocks >
+						wblock_n_rblocks) {
+			cf_warning(AS_DRV_SSD, "{%s} summary: bad entry %u at foff %ld",
+					ssds->ns->name, i, file_offset);
+			return;
+		}
+
+		p_entry += SUMMARY_ENTRY_SIZE(entry->props_size);
+
+		block->sig = 0;
+		block->magic = SSD_BLOCK_MAGIC;
+		block->length = (uint32_t)RBLOCKS_TO_BYTES(entry->n_rblocks) -
+				LENGTH_BASE;
+		block->keyd = entry->keyd;
+		block->generation = entry->generation;
+		block->void_time = entry->void_time;
+		block->bins_offset = entry->props_size;
+		block->n_bins = 0;
+		block->last_update_time = entry->last_update_time;
+		memcpy(block->data, entry->props, entry->props_size);
+
+		int add_rv = ssd_record_add(ssds, ssd, block,
+				BYTES_TO_RBLOCKS(file_offset) + entry->rblock_offset,
+				entry->n_rblocks, true);
+
+		if (add_rv == -2) {
+			cf_crash(AS_DRV_SSD, "hit stop-writes limit before drive scan completed");
+		}
+	}
+}
+
+
+// Rebuild the index for a range of a storage device from wblock summaries -
+// reads only the tail of each wblock, and reads in full any wblock without a
+// valid summary. The range is in whole LOAD_BUF_SIZE blocks.
+static void
+ssd_load_device_summaries_range(drv_ssds *ssds, drv_ssd *ssd,
+		off_t start_offset, off_t end_offset)
+{
+	uint32_t wblock_size = ssd->write_block_size;
+	uint32_t wblocks_per_load_buf = LOAD_BUF_SIZE / wblock_size;
+	uint32_t footer_offset = wblock_size - (uint32_t)sizeof(ssd_summary_footer);
+	uint32_t tail_read_size =
+			(uint32_t)BYTES_UP_TO_IO_MIN(ssd, SUMMARY_TAIL_READ_SIZE);
+
+	if (tail_read_size > wblock_size) {
+		tail_read_size = wblock_size;
+	}
+
+	uint8_t *buf = cf_valloc(wblock_size);
+	drv_ssd_block *add_block =
+			cf_malloc(sizeof(drv_ssd_block) + UINT16_MAX);
+	uint8_t *expand_buf = NULL; // for compressed records, allocated if needed
+
+	int fd = ssd_fd_get(ssd);
+
+	off_t file_offset = start_offset;
+	uint32_t n_wblocks = 0;
+	uint32_t error_count = 0;
+
+	// Loop over all wblocks in range.
+	while (file_offset < end_offset) {
+		uint32_t tail_offset = wblock_size - tail_read_size;
+		ssize_t rlen = pread(fd, buf, tail_read_size, file_offset + tail_offset);
+
+		if (rlen != (ssize_t)tail_read_size) {
+			cf_warning(AS_DRV_SSD, "%s: read failed (%ld): offset %ld: errno %d (%s)",
+					ssd->name, rlen, file_offset + tail_offset, errno,
+					cf_strerror(errno));
+			close(fd);
+			fd = -1;
+			goto Finished;
+		}
+
+		const ssd_summary_footer *footer = (const ssd_summary_footer*)
+				&buf[footer_offset - tail_offset];
+
+		// If the summary is bigger than what we read, read all of it.
+		if (footer->magic == SSD_SUMMARY_MAGIC &&
+				footer->size <= footer_offset &&
+				footer_offset - footer->size < tail_offset) {
+			tail_offset = (uint32_t)BYTES_DOWN_TO_IO_MIN(ssd,
+					footer_offset - footer->size);
+
+			uint32_t read_size = wblock_size - tail_offset;
+
+			rlen = pread(fd, buf, read_size, file_offset + tail_offset);
+
+			if (rlen != (ssize_t)read_size) {
+				cf_warning(AS_DRV_SSD, "%s: read failed (%ld): offset %ld: errno %d (%s)",
+						ssd->name, rlen, file_offset + tail_offset, errno,
+						cf_strerror(errno));
+				close(fd);
+				fd = -1;
+				goto Finished;
+			}
+		}
+
+		footer = ssd_wblock_summary(ssd, buf, tail_offset);
+
+		bool ok = true;
+
+		if (footer) {
+			ssd_load_wblock_summary(ssds, ssd, footer, file_offset, add_block);
+			cf_atomic64_incr(&ssd->n_cold_start_summaries);
+		}
+		else {
+			// No summary, or it failed validation - read the whole wblock.
+			rlen = pread(fd, buf, wblock_size, file_offset);
+
+			if (rlen != (ssize_t)wblock_size) {
+				cf_warning(AS_DRV_SSD, "%s: read failed (%ld): offset %ld: errno %d (%s)",
+						ssd->name, rlen, file_offset, errno,
+						cf_strerror(errno));
+				close(fd);
+				fd = -1;
+				goto Finished;
+			}
+
+			ok = ssd_load_wblock(ssds, ssd, buf, file_offset, &expand_buf);
+		}
+
+		error_count = ok ? 0 : error_count + 1;
+		file_offset += wblock_size;
+
+		if (++n_wblocks % wblocks_per_load_buf == 0) {
+			cf_atomic32_incr(&ssd->cold_start_block_counter);
+		}
+
+		// If we encounter enough 1M of wblocks that have no records, assume
+		// we've read all our data and we're done.
+		if (error_count > 10 * wblocks_per_load_buf) {
+			break;
+		}
+	}
+
+Finished:
+
+	// Account for any part of the range we skipped.
+	if (file_offset < end_offset) {
+		cf_atomic32_add(&ssd->cold_start_block_counter,
+				(int32_t)((end_offset - file_offset) / LOAD_BUF_SIZE));
+	}
+
+	if (fd != -1) {
+		ssd_fd_put(ssd, fd);
+	}
+
+	if (expand_buf) {
+		cf_free(expand_buf);
 	}
 
-	if (read_shadow && lseek(write_fd, file_offset, SEEK_SET) != file_offset) {
-		cf_crash(AS_DRV_SSD, "%s: DEVICE FAILED seek: offset %ld: errno %d (%s)",
-				ssd->name, file_offset, errno, cf_strerror(errno));
-	}
+	cf_free(add_block);
+	cf_free(buf);
+}
+
+
+// Sweep a range of a storage device and rebuild the index. The range is in
+// whole LOAD_BUF_SIZE blocks.
+static void
+ssd_load_device_sweep_range(drv_ssds *ssds, drv_ssd *ssd, off_t start_offset,
+		off_t end_offset)
+{
+	uint8_t *buf = cf_valloc(LOAD_BUF_SIZE);
+	uint8_t *expand_buf = NULL; // for compressed records, allocated if needed
 
-	int error_count = 0;
+	bool read_shadow = ssd->shadow_name && ! ssd->sub_sweep;
+	char *read_ssd_name = read_shadow ? ssd->shadow_name : ssd->name;
+	int fd = read_shadow ? ssd_shadow_fd_get(ssd) : ssd_fd_get(ssd);
+	int write_fd = read_shadow ? ssd_fd_get(ssd) : -1;
 
-	ssd->cold_start_block_counter = file_offset / LOAD_BUF_SIZE;
+	off_t file_offset = start_offset;
+	uint32_t error_count = 0;
 
-	// Loop over all blocks in device.
-	while (true) {
-		ssize_t rlen = read(fd, buf, LOAD_BUF_SIZE);
+	// Loop over all blocks in range.
+	while (file_offset < end_offset) {
+		ssize_t rlen = pread(fd, buf, LOAD_BUF_SIZE, file_offset);
 
 		if (rlen != LOAD_BUF_SIZE) {
-			cf_warning(AS_DRV_SSD, "%s: read failed (%ld): errno %d (%s)",
-					read_ssd_name, rlen, errno, cf_strerror(errno));
+			cf_warning(AS_DRV_SSD, "%s: read failed (%ld): offset %ld: errno %d (%s)",
+					read_ssd_name, rlen, file_offset, errno, cf_strerror(errno));
 			close(fd);
 			fd = -1;
 			goto Finished;
@@ -3049,7 +4809,8 @@ ssd_load_device_sweep(drv_ssds *ssds, drv_ssd *ssd)
 
 		if (read_shadow) {
 			// TODO - ok to always write 1Mb blocks?
-			ssize_t sz = write(write_fd, (void*)buf, LOAD_BUF_SIZE);
+			ssize_t sz = pwrite(write_fd, (void*)buf, LOAD_BUF_SIZE,
+					file_offset);
 
 			if (sz != LOAD_BUF_SIZE) {
 				cf_crash(AS_DRV_SSD, "%s: DEVICE FAILED write: errno %d (%s)",
@@ -3057,77 +4818,37 @@ ssd_load_device_sweep(drv_ssds *ssds, drv_ssd *ssd)
 			}
 		}
 
-		size_t block_offset = 0; // current offset within the 1M block, in bytes
-
-		while (block_offset < LOAD_BUF_SIZE) {
-			drv_ssd_block *block = (drv_ssd_block*)&buf[block_offset];
-
-			// Look for record magic.
-			if (block->magic != SSD_BLOCK_MAGIC) {
-				// No record found here.
-				// (Includes normal case of nothing ever written here).
-
-				block_offset += RBLOCK_SIZE;
-
-				// We always write some at the start of a 1M block.
-				if (block_offset == RBLOCK_SIZE) {
-					error_count++;
-					goto NextBlock;
-				}
-				else {
-					// Otherwise check the next rblock, looking for magic.
-					continue;
-				}
-			}
-
-			// Note - if block->length is sane, we don't need to round up to a
-			// multiple of RBLOCK_SIZE, but let's do it anyway just to be safe.
-			size_t next_block_offset = block_offset +
-					BYTES_TO_RBLOCK_BYTES(block->length + LENGTH_BASE);
-
-			// Sanity-check for 1M block overruns.
-			// TODO - check write_block_size boundaries!
-			if (next_block_offset > LOAD_BUF_SIZE) {
-				cf_warning(AS_DRV_SSD, "error: block extends over read size: foff %"PRIu64" boff %"PRIu64" blen %"PRIu64,
-					file_offset, block_offset, (uint64_t)block->length);
-
-				error_count++;
-				goto NextBlock;
-			}
+		uint32_t n_wblocks = LOAD_BUF_SIZE / ssd->write_block_size;
 
-			// Found a record - try to add it to the index.
-			int add_rv = ssd_record_add(ssds, ssd, block,
-					BYTES_TO_RBLOCKS(file_offset + block_offset),
-					(uint32_t)BYTES_TO_RBLOCKS(next_block_offset - block_offset));
+		for (uint32_t i = 0; i < n_wblocks; i++) {
+			off_t wblock_offset = (off_t)i * ssd->write_block_size;
 
-			if (add_rv == -2) {
-				cf_crash(AS_DRV_SSD, "hit stop-writes limit before drive scan completed");
+			if (ssd_load_wblock(ssds, ssd, buf + wblock_offset,
+					file_offset + wblock_offset, &expand_buf)) {
+				error_count = 0;
 			}
-
-			if (add_rv == -3) {
+			else {
 				error_count++;
-				goto NextBlock;
 			}
-
-			error_count = 0;
-			block_offset = next_block_offset;
 		}
 
-NextBlock:
+		file_offset += LOAD_BUF_SIZE;
+		cf_atomic32_incr(&ssd->cold_start_block_counter);
 
-		// If we encounter enough 1M blocks that have no records, assume we've
-		// read all our data and we're done.
-		if (error_count > 10) {
-			goto Finished;
+		// If we encounter enough 1M of wblocks that have no records, assume
+		// we've read all our data and we're done.
+		if (error_count > 10 * (LOAD_BUF_SIZE / ssd->write_block_size)) {
+			break;
 		}
-
-		file_offset += LOAD_BUF_SIZE;
-		ssd->cold_start_block_counter++;
 	}
 
 Finished:
 
-	ssd->cold_start_block_counter = ssd->file_size / LOAD_BUF_SIZE;
+	// Account for any part of the range we skipped.
+	if (file_offset < end_offset) {
+		cf_atomic32_add(&ssd->cold_start_block_counter,
+				(int32_t)((end_offset - file_offset) / LOAD_BUF_SIZE));
+	}
 
 	if (fd != -1) {
 		read_shadow ? ssd_shadow_fd_put(ssd, fd) : ssd_fd_put(ssd, fd);
@@ -3137,7 +4858,115 @@ Finished:
 		ssd_fd_put(ssd, write_fd);
 	}
 
+	if (expand_buf) {
+		cf_free(expand_buf);
+	}
+
 	cf_free(buf);
+}
+
+
+// Rebuild the index for a range of a storage device. Summaries are enough
+// only if data isn't in memory - and reading the shadow device copies every
+// wblock whole to the primary, so would gain nothing from them.
+static void
+ssd_load_device_range(drv_ssds *ssds, drv_ssd *ssd, off_t start_offset,
+		off_t end_offset)
+{
+	as_namespace *ns = ssds->ns;
+
+	if (ns->storage_wblock_summaries && ! ns->storage_data_in_memory &&
+			! (ssd->shadow_name && ! ssd->sub_sweep)) {
+		ssd_load_device_summaries_range(ssds, ssd, start_offset, end_offset);
+	}
+	else {
+		ssd_load_device_sweep_range(ssds, ssd, start_offset, end_offset);
+	}
+}
+
+
+typedef struct {
+	drv_ssds *ssds;
+	drv_ssd *ssd;
+	off_t start_offset;
+	off_t end_offset;
+} ssd_load_range_data;
+
+// Thread "run" function to sweep one range of a device.
+static void *
+run_load_device_range(void *udata)
+{
+	ssd_load_range_data *lrd = (ssd_load_range_data*)udata;
+
+#ifdef USE_JEM
+	// Allocate long-term storage in this namespace's JEMalloc arena.
+	jem_set_arena(lrd->ssds->ns->jem_arena);
+#endif
+
+	ssd_load_device_range(lrd->ssds, lrd->ssd, lrd->start_offset,
+			lrd->end_offset);
+
+	return NULL;
+}
+
+
+// Sweep through storage devices and rebuild the index.
+//
+// If there are LDT records the sweep is done twice, once for LDT parent records
+// and then again for LDT subrecords.
+//
+// The device may be split into contiguous ranges swept in parallel. Records
+// with the same digest in different ranges are resolved in ssd_record_add()
+// under the record lock, just as for records on different devices.
+int
+ssd_load_device_sweep(drv_ssds *ssds, drv_ssd *ssd)
+{
+	// Skip the header.
+	off_t start_offset = ssds->header->header_length;
+	off_t end_offset = ssd->file_size;
+
+	ssd->cold_start_block_counter = start_offset / LOAD_BUF_SIZE;
+
+	uint32_t n_blocks = (uint32_t)((end_offset - start_offset) / LOAD_BUF_SIZE);
+	uint32_t n_threads = ssds->ns->storage_cold_start_threads;
+
+	if (n_threads > n_blocks) {
+		n_threads = n_blocks;
+	}
+
+	if (n_threads <= 1) {
+		ssd_load_device_range(ssds, ssd, start_offset, end_offset);
+		ssd->cold_start_block_counter = ssd->file_size / LOAD_BUF_SIZE;
+		return 0;
+	}
+
+	pthread_t threads[n_threads];
+	ssd_load_range_data lrds[n_threads];
+	off_t range_offset = start_offset;
+
+	for (uint32_t i = 0; i < n_threads; i++) {
+		// Spread any remainder over the first ranges.
+		uint32_t range_blocks = n_blocks / n_threads +
+				(i < n_blocks % n_threads ? 1 : 0);
+
+		lrds[i].ssds = ssds;
+		lrds[i].ssd = ssd;
+		lrds[i].start_offset = range_offset;
+		lrds[i].end_offset = range_offset + (off_t)range_blocks * LOAD_BUF_SIZE;
+
+		range_offset = lrds[i].end_offset;
+
+		if (pthread_create(&threads[i], NULL, run_load_device_range,
+				&lrds[i]) != 0) {
+			cf_crash(AS_DRV_SSD, "%s: failed to create load thread", ssd->name);
+		}
+	}
+
+	for (uint32_t i = 0; i < n_threads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	ssd->cold_start_block_counter = ssd->file_size / LOAD_BUF_SIZE;
 
 	return 0;
 }
@@ -3193,10 +5022,16 @@ ssd_load_devices_fn(void *udata)
 		ssd_load_device_sweep(ssds, ssd);
 	}
 
-	cf_info(AS_DRV_SSD, "device %s: read complete: UNIQUE %"PRIu64" (REPLACED %"PRIu64") (OLDER %"PRIu64") (EXPIRED %"PRIu64") (MAX-TTL %"PRIu64") records",
+	cf_info(AS_DRV_SSD, "device %s: read complete: UNIQUE %"PRIu64" (REPLACED %"PRIu64") (OLDER %"PRIu64") (EXPIRED %"PRIu64") (MAX-TTL %"PRIu64") (TRUNCATED %"PRIu64") records",
 		ssd->name, ssd->record_add_unique_counter,
 		ssd->record_add_replace_counter, ssd->record_add_older_counter,
-		ssd->record_add_expired_counter, ssd->record_add_max_ttl_counter);
+		ssd->record_add_expired_counter, ssd->record_add_max_ttl_counter,
+		ssd->record_add_truncated_counter);
+
+	if (ssd->n_cold_start_summaries != 0) {
+		cf_info(AS_DRV_SSD, "device %s: loaded %"PRIu64" wblocks from summaries",
+				ssd->name, ssd->n_cold_start_summaries);
+	}
 
 	if (ssd->record_add_sigfail_counter) {
 		cf_warning(AS_DRV_SSD, "device %s: WARNING: %"PRIu64" elements could not be read due to signature failure. Possible hardware errors.",
@@ -3210,6 +5045,7 @@ ssd_load_devices_fn(void *udata)
 		ssd_load_wblock_queues(ssds);
 
 		pthread_mutex_destroy(&ssds->ns->cold_start_evict_lock);
+		as_cold_start_counts_destroy(ssds->ns);
 
 		cf_queue_push(complete_q, &complete_udata);
 		cf_rc_free(complete_rc);
@@ -3268,6 +5104,114 @@ ssd_load_devices_init_header_length(drv_ssds *ssds)
 // Generic startup utilities.
 //
 
+static ssd_placement_header *
+ssd_placement_header_get(ssd_device_header *header)
+{
+	size_t offset = offsetof(ssd_device_header, info_data) +
+			((size_t)header->info_n * header->info_stride);
+
+	if (offset + sizeof(ssd_placement_header) > header->header_length) {
+		return NULL;
+	}
+
+	return (ssd_placement_header*)((uint8_t*)header + offset);
+}
+
+
+// Set up the digest-to-device map. Weights are recorded in the header the
+// first time (or when devices are added), so later restarts place records the
+// same way even if device sizes are reported differently.
+static void
+ssd_init_placement(drv_ssds *ssds)
+{
+	as_namespace *ns = ssds->ns;
+	int n_ssds = ssds->n_ssds;
+	ssd_placement_header *ph = ssd_placement_header_get(ssds->header);
+
+	ssds->weighted_placement = false;
+
+	if (! ph) {
+		if (ns->storage_weighted_placement) {
+			cf_warning(AS_DRV_SSD, "{%s} no header space for placement weights - using equal placement",
+					ns->name);
+		}
+
+		return;
+	}
+
+	if (! ns->storage_weighted_placement || n_ssds == 1) {
+		// Forget any old weights, so they're recomputed if re-enabled.
+		memset(ph, 0, sizeof(ssd_placement_header));
+		return;
+	}
+
+	if (ph->magic != SSD_PLACEMENT_MAGIC ||
+			ph->n_devices != (uint32_t)n_ssds) {
+		memset(ph, 0, sizeof(ssd_placement_header));
+
+		ph->magic = SSD_PLACEMENT_MAGIC;
+		ph->n_devices = (uint32_t)n_ssds;
+
+		for (int i = 0; i < n_ssds; i++) {
+			ph->weights[i] = (uint64_t)ssds->ssds[i].file_size >> 20;
+		}
+
+		cf_info(AS_DRV_SSD, "{%s} recording device placement weights",
+				ns->name);
+	}
+
+	uint64_t total_weight = 0;
+
+	for (int i = 0; i < n_ssds; i++) {
+		total_weight += ph->weights[i];
+	}
+
+	if (total_weight == 0) {
+		cf_warning(AS_DRV_SSD, "{%s} zero placement weights - using equal placement",
+				ns->name);
+		return;
+	}
+
+	// Stripe the slots - each device gets a contiguous range in proportion to
+	// its weight, but at least one slot.
+	uint64_t cum_weight = 0;
+	uint32_t slot = 0;
+
+	for (int i = 0; i < n_ssds; i++) {
+		cum_weight += ph->weights[i];
+
+		uint32_t end = (uint32_t)
+				((cum_weight * N_PLACEMENT_SLOTS) / total_weight);
+
+		if (i == n_ssds - 1) {
+			end = N_PLACEMENT_SLOTS;
+		}
+		else {
+			// Leave at least one slot for each remaining device.
+			uint32_t max_end = N_PLACEMENT_SLOTS - (uint32_t)(n_ssds - 1 - i);
+
+			if (end <= slot) {
+				end = slot + 1;
+			}
+
+			if (end > max_end) {
+				end = max_end;
+			}
+		}
+
+		cf_info(AS_DRV_SSD, "{%s} device %s: placement weight %lu, slots %u of %d",
+				ns->name, ssds->ssds[i].name, ph->weights[i], end - slot,
+				N_PLACEMENT_SLOTS);
+
+		while (slot < end) {
+			ssds->placement[slot++] = (uint8_t)i;
+		}
+	}
+
+	ssds->weighted_placement = true;
+}
+
+
 static int
 first_used_device(ssd_device_header *headers[], int n_ssds)
 {
@@ -3327,7 +5271,9 @@ ssd_load_devices(drv_ssds *ssds, cf_queue *complete_q, void *udata)
 
 		ssds->header->random = random;
 		ssds->header->devices_n = n_ssds;
+		ssd_init_placement(ssds);
 		as_storage_info_flush_ssd(ns);
+		as_namespace_xmem_set_devices(ns, random);
 
 		ssd_load_devices_init_header_length(ssds);
 
@@ -3363,6 +5309,15 @@ ssd_load_devices(drv_ssds *ssds, cf_queue *complete_q, void *udata)
 		}
 	}
 
+	// The resumed index is only good if no one else started on the devices
+	// since it was persisted.
+	if (! ns->cold_start &&
+			! as_namespace_xmem_devices_match(ns, headers[first_used]->random)) {
+		// There's no going back to cold start now - do so the harsh way.
+		cf_crash(AS_DRV_SSD, "ns %s: devices were used since index was persisted - next start will be cold",
+				ns->name);
+	}
+
 	// Drive set OK - fix up header set.
 	ssds->header = headers[first_used];
 	headers[first_used] = 0;
@@ -3376,7 +5331,9 @@ ssd_load_devices(drv_ssds *ssds, cf_queue *complete_q, void *udata)
 
 	ssds->header->random = random;
 	ssds->header->devices_n = n_ssds; // may have added fresh drives
+	ssd_init_placement(ssds);
 	as_storage_info_flush_ssd(ns);
+	as_namespace_xmem_set_devices(ns, random);
 
 	as_partition_get_state_from_storage(ssds->ns, ssds->get_state_from_storage);
 
@@ -3420,6 +5377,8 @@ ssd_load_devices(drv_ssds *ssds, cf_queue *complete_q, void *udata)
 
 	ns->cold_start_max_void_time = now + (uint32_t)ns->max_ttl;
 
+	as_cold_start_counts_create(ns);
+
 	// Fire off threads to load in data - will signal completion when threads
 	// are all done.
 	ssd_load_devices_load(ssds, complete_q, udata);
@@ -3512,6 +5471,30 @@ check_write_block_size(uint32_t write_block_size)
 }
 
 
+static void
+check_max_flush_size(as_namespace *ns)
+{
+	if (ns->storage_max_flush_size == 0) {
+		ns->storage_max_flush_size = ns->storage_write_block_size;
+		return;
+	}
+
+	if (ns->storage_max_flush_size > MAX_FLUSH_SIZE ||
+			ns->storage_max_flush_size / ns->storage_write_block_size >
+					MAX_SSD_FLUSH_SWBS) {
+		cf_crash(AS_DRV_SSD, "{%s} max-flush-size %u exceeds %u or %u write blocks",
+				ns->name, ns->storage_max_flush_size, MAX_FLUSH_SIZE,
+				MAX_SSD_FLUSH_SWBS);
+	}
+
+	if (ns->storage_max_flush_size % ns->storage_write_block_size != 0) {
+		cf_crash(AS_DRV_SSD, "{%s} max-flush-size %u must be a multiple of write-block-size %u",
+				ns->name, ns->storage_max_flush_size,
+				ns->storage_write_block_size);
+	}
+}
+
+
 static off_t
 check_file_size(off_t file_size, const char *tag)
 {
@@ -3838,10 +5821,22 @@ as_storage_namespace_init_ssd(as_namespace *ns, cf_queue *complete_q,
 	ns->storage_defrag_sleep = 0;
 
 	check_write_block_size(ns->storage_write_block_size);
+	check_max_flush_size(ns);
 
 	// The queue limit is more efficient to work with.
 	ns->storage_max_write_q = (int)
 			(ns->storage_max_write_cache / ns->storage_write_block_size);
+	ns->storage_shadow_max_write_q = (int)
+			(ns->storage_shadow_max_write_cache / ns->storage_write_block_size);
+
+	if (ns->storage_shadow_write_threads == 0) {
+		ns->storage_shadow_write_threads = 1;
+	}
+	else if (ns->storage_shadow_write_threads > MAX_SSD_THREADS) {
+		cf_warning(AS_DRV_SSD, "configured number of shadow write threads %u greater than max, using %d instead",
+				ns->storage_shadow_write_threads, MAX_SSD_THREADS);
+		ns->storage_shadow_write_threads = MAX_SSD_THREADS;
+	}
 
 	// Minimize how often we recalculate this.
 	ns->defrag_lwm_size =
@@ -3849,6 +5844,20 @@ as_storage_namespace_init_ssd(as_namespace *ns, cf_queue *complete_q,
 
 	ns->storage_private = (void*)ssds;
 
+	// The read cache only makes sense if records aren't already in memory.
+	if (ns->storage_read_cache_size != 0 && ! ns->storage_data_in_memory &&
+			! (ssds->read_cache =
+					ssd_read_cache_create(ns->storage_read_cache_size))) {
+		cf_crash(AS_DRV_SSD, "ns %s can't create read cache", ns->name);
+	}
+
+	if (ns->storage_ldt_subrec_cache_size != 0 && ns->ldt_enabled &&
+			! ns->storage_data_in_memory &&
+			! (ssds->ldt_subrec_cache =
+					ssd_read_cache_create(ns->storage_ldt_subrec_cache_size))) {
+		cf_crash(AS_DRV_SSD, "ns %s can't create ldt sub-record cache", ns->name);
+	}
+
 	// Finish initializing drv_ssd structures (non-zero-value members).
 	for (int i = 0; i < ssds->n_ssds; i++) {
 		drv_ssd *ssd = &ssds->ssds[i];
@@ -3858,6 +5867,8 @@ as_storage_namespace_init_ssd(as_namespace *ns, cf_queue *complete_q,
 
 		pthread_mutex_init(&ssd->write_lock, 0);
 		pthread_mutex_init(&ssd->defrag_lock, 0);
+		pthread_mutex_init(&ssd->flush_lock, 0);
+		pthread_mutex_init(&ssd->flush_done_lock, 0);
 
 		ssd->running = true;
 
@@ -3877,13 +5888,26 @@ as_storage_namespace_init_ssd(as_namespace *ns, cf_queue *complete_q,
 			cf_crash(AS_DRV_SSD, "can't create shadow fd queue");
 		}
 
-		if (! (ssd->swb_write_q = cf_queue_create(sizeof(void*), true))) {
+		if (! (ssd->swb_write_q = cf_ring_queue_create(sizeof(void*),
+				SWB_WRITE_Q_CAPACITY))) {
 			cf_crash(AS_DRV_SSD, "can't create swb-write queue");
 		}
 
-		if (ssd->shadow_name &&
-				! (ssd->swb_shadow_q = cf_queue_create(sizeof(void*), true))) {
-			cf_crash(AS_DRV_SSD, "can't create swb-shadow queue");
+		ssd->max_flush_swbs =
+				ns->storage_max_flush_size / ns->storage_write_block_size;
+
+		if (ssd->shadow_name) {
+			for (uint32_t j = 0; j < ns->storage_shadow_write_threads; j++) {
+				if (! (ssd->shadow_write_q[j] = cf_queue_create(
+						sizeof(ssd_shadow_write), true))) {
+					cf_crash(AS_DRV_SSD, "can't create shadow-write queue");
+				}
+			}
+
+			if (! (ssd->shadow_buf_free_q = cf_queue_create(sizeof(void*),
+					true))) {
+				cf_crash(AS_DRV_SSD, "can't create shadow-buf-free queue");
+			}
 		}
 
 		if (! (ssd->swb_free_q = cf_queue_create(sizeof(void*), true))) {
@@ -3916,6 +5940,14 @@ as_storage_namespace_init_ssd(as_namespace *ns, cf_queue *complete_q,
 			cf_crash(AS_DRV_SSD, "cannot create histogram %s", histname);
 		}
 
+		snprintf(histname, sizeof(histname), "{%s}-%s-write-q", ns->name, ssd->name);
+
+		if (! (ssd->hist_write_q = histogram_create(histname, HIST_MILLISECONDS))) {
+			cf_crash(AS_DRV_SSD, "cannot create histogram %s", histname);
+		}
+
+		cf_ring_queue_set_hist(ssd->swb_write_q, ssd->hist_write_q);
+
 		if (ssd->shadow_name) {
 			snprintf(histname, sizeof(histname), "{%s}-%s-shadow-write", ns->name, ssd->name);
 
@@ -4010,6 +6042,15 @@ as_storage_record_destroy_ssd(as_namespace *ns, as_record *r)
 		ssd_block_free(ssd, r->storage_key.ssd.rblock_id,
 				r->storage_key.ssd.n_rblocks, "destroy");
 
+		as_namespace_adjust_set_device(ns, as_index_get_set_id(r),
+				-(int64_t)RBLOCKS_TO_BYTES(r->storage_key.ssd.n_rblocks));
+
+		ssd_read_cache *cache = ssd_record_cache(ssds, r);
+
+		if (cache) {
+			ssd_read_cache_remove(cache, &r->key);
+		}
+
 		r->storage_key.ssd.rblock_id = STORAGE_INVALID_RBLOCK;
 		r->storage_key.ssd.n_rblocks = 0;
 	}
@@ -4066,6 +6107,18 @@ as_storage_record_close_ssd(as_record *r, as_storage_rd *rd)
 }
 
 
+uint8_t *
+as_storage_record_detach_block_ssd(as_storage_rd *rd)
+{
+	uint8_t *buf = rd->u.ssd.must_free_block;
+
+	// Leave block set - bins may still be read until the record is closed.
+	rd->u.ssd.must_free_block = NULL;
+
+	return buf;
+}
+
+
 // These are near the top of this file:
 //		as_storage_record_get_n_bins_ssd()
 //		as_storage_record_read_ssd()
@@ -4084,6 +6137,14 @@ int
 as_storage_record_write_ssd(as_record *r, as_storage_rd *rd)
 {
 	// All record writes except defrag come through here!
+	ssd_read_cache *cache = ssd_record_cache(
+			(drv_ssds*)rd->ns->storage_private, r);
+
+	// The new version won't match the cache key anyway - free memory early.
+	if (cache) {
+		ssd_read_cache_remove(cache, &rd->keyd);
+	}
+
 	return as_bin_inuse_has(rd) ? ssd_write(r, rd) : 0;
 }
 
@@ -4152,7 +6213,7 @@ as_storage_overloaded_ssd(as_namespace *ns)
 	// TODO - would be nice to not do this loop every single write transaction!
 	for (int i = 0; i < ssds->n_ssds; i++) {
 		drv_ssd *ssd = &ssds->ssds[i];
-		int qsz = cf_queue_sz(ssd->swb_write_q);
+		int qsz = cf_ring_queue_sz(ssd->swb_write_q);
 
 		if (qsz > max_write_q) {
 			cf_warning(AS_DRV_SSD, "{%s} write fail: queue too deep: q %d, max %d",
@@ -4160,12 +6221,14 @@ as_storage_overloaded_ssd(as_namespace *ns)
 			return true;
 		}
 
-		if (ssd->shadow_name) {
-			qsz = cf_queue_sz(ssd->swb_shadow_q);
+		// Unless configured to drop shadow writes instead, a lagging shadow
+		// stops writes.
+		if (ssd->shadow_name && ns->storage_shadow_stop_writes_on_lag) {
+			qsz = (int)cf_atomic32_get(ssd->n_shadow_writes_queued);
 
-			if (qsz > max_write_q) {
+			if (qsz > ns->storage_shadow_max_write_q) {
 				cf_warning(AS_DRV_SSD, "{%s} write fail: shadow queue too deep: q %d, max %d",
-						ns->name, qsz, max_write_q);
+						ns->name, qsz, ns->storage_shadow_max_write_q);
 				return true;
 			}
 		}
@@ -4175,6 +6238,103 @@ as_storage_overloaded_ssd(as_namespace *ns)
 }
 
 
+uint32_t
+as_storage_write_q_depth_ssd(as_namespace *ns)
+{
+	drv_ssds *ssds = (drv_ssds*)ns->storage_private;
+	uint32_t max_qsz = 0;
+
+	for (int i = 0; i < ssds->n_ssds; i++) {
+		drv_ssd *ssd = &ssds->ssds[i];
+		uint32_t qsz = (uint32_t)cf_ring_queue_sz(ssd->swb_write_q);
+
+		if (qsz > max_qsz) {
+			max_qsz = qsz;
+		}
+
+		// Shadow depth only matters if it can stop writes - report it scaled
+		// to the primary queue's limit.
+		if (ssd->shadow_name && ns->storage_shadow_stop_writes_on_lag &&
+				ns->storage_shadow_max_write_q != 0) {
+			qsz = (uint32_t)(((uint64_t)cf_atomic32_get(
+					ssd->n_shadow_writes_queued) * ns->storage_max_write_q) /
+							ns->storage_shadow_max_write_q);
+
+			if (qsz > max_qsz) {
+				max_qsz = qsz;
+			}
+		}
+	}
+
+	return max_qsz;
+}
+
+
+void
+as_storage_shadow_stats_ssd(as_namespace *ns, uint32_t *write_q,
+		uint64_t *lag_ms, uint64_t *dropped_writes)
+{
+	drv_ssds *ssds = (drv_ssds*)ns->storage_private;
+
+	*write_q = 0;
+	*lag_ms = 0;
+	*dropped_writes = 0;
+
+	for (int i = 0; i < ssds->n_ssds; i++) {
+		drv_ssd *ssd = &ssds->ssds[i];
+
+		if (! ssd->shadow_name) {
+			continue;
+		}
+
+		uint32_t qsz = cf_atomic32_get(ssd->n_shadow_writes_queued);
+
+		if (qsz > *write_q) {
+			*write_q = qsz;
+		}
+
+		if (ssd->shadow_lag_ms > *lag_ms) {
+			*lag_ms = ssd->shadow_lag_ms;
+		}
+
+		*dropped_writes += cf_atomic64_get(ssd->n_shadow_dropped_writes);
+	}
+}
+
+
+// Post-write queue stats - record reads served from swbs (hits) versus from
+// devices (misses), for the namespace and then for each device.
+void
+as_storage_post_write_q_stats_ssd(as_namespace *ns, cf_dyn_buf *db)
+{
+	drv_ssds *ssds = (drv_ssds*)ns->storage_private;
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+
+	for (int i = 0; i < ssds->n_ssds; i++) {
+		hits += cf_atomic64_get(ssds->ssds[i].n_cache_read_hits);
+		misses += cf_atomic64_get(ssds->ssds[i].n_cache_read_misses);
+	}
+
+	info_append_uint64(db, "post_write_q_hits", hits);
+	info_append_uint64(db, "post_write_q_misses", misses);
+
+	for (int i = 0; i < ssds->n_ssds; i++) {
+		drv_ssd *ssd = &ssds->ssds[i];
+		char name[64];
+
+		snprintf(name, sizeof(name), "storage-engine.device[%d].post_write_q", i);
+		info_append_uint32(db, name, (uint32_t)cf_queue_sz(ssd->post_write_q));
+
+		snprintf(name, sizeof(name), "storage-engine.device[%d].post_write_q_hits", i);
+		info_append_uint64(db, name, cf_atomic64_get(ssd->n_cache_read_hits));
+
+		snprintf(name, sizeof(name), "storage-engine.device[%d].post_write_q_misses", i);
+		info_append_uint64(db, name, cf_atomic64_get(ssd->n_cache_read_misses));
+	}
+}
+
+
 bool
 as_storage_has_space_ssd(as_namespace *ns)
 {
@@ -4366,6 +6526,7 @@ as_storage_ticker_stats_ssd(as_namespace *ns)
 		histogram_dump(ssd->hist_read);
 		histogram_dump(ssd->hist_large_block_read);
 		histogram_dump(ssd->hist_write);
+		histogram_dump(ssd->hist_write_q);
 
 		if (ssd->hist_shadow_write) {
 			histogram_dump(ssd->hist_shadow_write);
@@ -4389,6 +6550,7 @@ as_storage_histogram_clear_ssd(as_namespace *ns)
 		histogram_clear(ssd->hist_read);
 		histogram_clear(ssd->hist_large_block_read);
 		histogram_clear(ssd->hist_write);
+		histogram_clear(ssd->hist_write_q);
 
 		if (ssd->hist_shadow_write) {
 			histogram_clear(ssd->hist_shadow_write);
@@ -4417,27 +6579,32 @@ as_storage_shutdown_ssd(as_namespace *ns)
 		pthread_mutex_lock(&ssd->write_lock);
 		pthread_mutex_lock(&ssd->defrag_lock);
 
-		// Flush current swb by pushing it to write-q.
-		if (ssd->current_swb) {
+		// Flush current swbs by pushing them to write-q.
+		for (uint32_t j = 0; j < MAX_TTL_WRITE_STREAMS; j++) {
+			ssd_write_buf *swb = ssd->current_swbs[j];
+
+			if (! swb) {
+				continue;
+			}
+
 			// Clean the end of the buffer before pushing to write-q.
-			if (ssd->write_block_size > ssd->current_swb->pos) {
-				memset(&ssd->current_swb->buf[ssd->current_swb->pos], 0,
-						ssd->write_block_size - ssd->current_swb->pos);
+			if (swb->end > swb->pos) {
+				memset(&swb->buf[swb->pos], 0, swb->end - swb->pos);
 			}
 
-			cf_queue_push(ssd->swb_write_q, &ssd->current_swb);
-			ssd->current_swb = NULL;
+			cf_ring_queue_push(ssd->swb_write_q, &swb);
+			ssd->current_swbs[j] = NULL;
 		}
 
 		// Flush defrag swb by pushing it to write-q.
 		if (ssd->defrag_swb) {
 			// Clean the end of the buffer before pushing to write-q.
-			if (ssd->write_block_size > ssd->defrag_swb->pos) {
+			if (ssd->defrag_swb->end > ssd->defrag_swb->pos) {
 				memset(&ssd->defrag_swb->buf[ssd->defrag_swb->pos], 0,
-						ssd->write_block_size - ssd->defrag_swb->pos);
+						ssd->defrag_swb->end - ssd->defrag_swb->pos);
 			}
 
-			cf_queue_push(ssd->swb_write_q, &ssd->defrag_swb);
+			cf_ring_queue_push(ssd->swb_write_q, &ssd->defrag_swb);
 			ssd->defrag_swb = NULL;
 		}
 	}
@@ -4445,12 +6612,17 @@ as_storage_shutdown_ssd(as_namespace *ns)
 	for (int i = 0; i < ssds->n_ssds; i++) {
 		drv_ssd *ssd = &ssds->ssds[i];
 
-		while (cf_queue_sz(ssd->swb_write_q)) {
+		while (cf_ring_queue_sz(ssd->swb_write_q)) {
+			usleep(1000);
+		}
+
+		// Popped swbs may still be being flushed.
+		while (cf_atomic32_get(ssd->n_flushes_in_flight) != 0) {
 			usleep(1000);
 		}
 
 		if (ssd->shadow_name) {
-			while (cf_queue_sz(ssd->swb_shadow_q)) {
+			while (cf_atomic32_get(ssd->n_shadow_writes_queued) != 0) {
 				usleep(1000);
 			}
 		}
@@ -4467,7 +6639,10 @@ as_storage_shutdown_ssd(as_namespace *ns)
 		}
 
 		if (ssd->shadow_name) {
-			pthread_join(ssd->shadow_worker_thread, &p_void);
+			for (uint32_t j = 0; j < ssds->ns->storage_shadow_write_threads;
+					j++) {
+				pthread_join(ssd->shadow_worker_thread[j], &p_void);
+			}
 		}
 	}
 }
@@ -0,0 +1,312 @@
+/*
+ * drv_ssd_cache.c
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/* SYNOPSIS
+ * Size-bounded memory cache of device blocks, for data-not-in-memory SSD
+ * namespaces. Set-associative - a digest maps to one set of CACHE_N_WAYS
+ * entries, each set with its own lock, and CLOCK eviction within the set.
+ *
+ * Entries are keyed by digest and by the record's storage location and
+ * generation, so a cached block can never be mistaken for a newer version.
+ * Writes and deletes still invalidate promptly, to give the memory back.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "storage/drv_ssd.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "citrusleaf/alloc.h"
+#include "citrusleaf/cf_atomic.h"
+#include "citrusleaf/cf_digest.h"
+
+#include "fault.h"
+
+#include "base/datamodel.h"
+
+
+//==========================================================
+// Constants.
+//
+
+#define CACHE_N_WAYS		8
+#define CACHE_MIN_SETS		(1024 * 4)
+#define CACHE_BYTES_PER_SET	(CACHE_N_WAYS * 1024 * 2) // assume ~2K records
+
+
+//==========================================================
+// Typedefs.
+//
+
+typedef struct cache_entry_s {
+	cf_digest		keyd;
+	uint64_t		rblock_id;
+	uint32_t		generation;
+	uint32_t		size;
+	uint16_t		file_id;
+	bool			referenced;		// CLOCK bit - set on hit
+	uint8_t			*buf;			// null if entry is unused
+} cache_entry;
+
+typedef struct cache_set_s {
+	pthread_mutex_t	lock;
+	uint32_t		hand;			// CLOCK hand
+	cache_entry		entries[CACHE_N_WAYS];
+} cache_set;
+
+struct ssd_read_cache_s {
+	uint64_t		max_size;
+	cf_atomic64		size;			// bytes of blocks currently cached
+	uint32_t		n_sets;			// power of 2
+	cache_set		*sets;
+};
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static inline cache_set* cache_get_set(ssd_read_cache *cache, cf_digest *keyd);
+static inline bool entry_matches(cache_entry *e, cf_digest *keyd, uint16_t file_id, uint64_t rblock_id, uint32_t generation);
+static inline void entry_drop(ssd_read_cache *cache, cache_entry *e);
+
+
+//==========================================================
+// Public API.
+//
+
+ssd_read_cache *
+ssd_read_cache_create(uint64_t max_size)
+{
+	ssd_read_cache *cache = cf_malloc(sizeof(ssd_read_cache));
+
+	if (! cache) {
+		return NULL;
+	}
+
+	uint32_t n_sets = CACHE_MIN_SETS;
+
+	while ((uint64_t)n_sets * CACHE_BYTES_PER_SET < max_size) {
+		n_sets <<= 1;
+	}
+
+	cache->max_size = max_size;
+	cache->size = 0;
+	cache->n_sets = n_sets;
+	cache->sets = cf_malloc(n_sets * sizeof(cache_set));
+
+	if (! cache->sets) {
+		cf_free(cache);
+		return NULL;
+	}
+
+	memset(cache->sets, 0, n_sets * sizeof(cache_set));
+
+	for (uint32_t i = 0; i < n_sets; i++) {
+		pthread_mutex_init(&cache->sets[i].lock, NULL);
+	}
+
+	return cache;
+}
+
+
+// On hit, returns a new allocation holding a copy of the cached block.
+uint8_t *
+ssd_read_cache_get(ssd_read_cache *cache, cf_digest *keyd,
+		uint16_t file_id, uint64_t rblock_id, uint32_t generation,
+		uint32_t size)
+{
+	cache_set *set = cache_get_set(cache, keyd);
+	uint8_t *buf = NULL;
+
+	pthread_mutex_lock(&set->lock);
+
+	for (int i = 0; i < CACHE_N_WAYS; i++) {
+		cache_entry *e = &set->entries[i];
+
+		if (entry_matches(e, keyd, file_id, rblock_id, generation) &&
+				e->size == size) {
+			if ((buf = cf_malloc(size)) != NULL) {
+				memcpy(buf, e->buf, size);
+				e->referenced = true;
+			}
+
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&set->lock);
+
+	return buf;
+}
+
+
+void
+ssd_read_cache_put(ssd_read_cache *cache, cf_digest *keyd,
+		uint16_t file_id, uint64_t rblock_id, uint32_t generation,
+		const uint8_t *block, uint32_t size)
+{
+	// Don't let one record take a big share of the cache.
+	if ((uint64_t)size * CACHE_N_WAYS > cache->max_size) {
+		return;
+	}
+
+	uint8_t *buf = cf_malloc(size);
+
+	if (! buf) {
+		return;
+	}
+
+	memcpy(buf, block, size);
+
+	cache_set *set = cache_get_set(cache, keyd);
+
+	pthread_mutex_lock(&set->lock);
+
+	cache_entry *victim = NULL;
+
+	// Replace any older version of this record, else use a free entry.
+	for (int i = 0; i < CACHE_N_WAYS; i++) {
+		cache_entry *e = &set->entries[i];
+
+		if (e->buf && cf_digest_compare(&e->keyd, keyd) == 0) {
+			entry_drop(cache, e);
+			victim = e;
+			break;
+		}
+
+		if (! e->buf && ! victim) {
+			victim = e;
+		}
+	}
+
+	// Evict - CLOCK within the set, and keep evicting while over the limit.
+	while (! victim || (uint64_t)cf_atomic64_get(cache->size) + size >
+			cache->max_size) {
+		uint32_t n_used = 0;
+
+		for (int i = 0; i < CACHE_N_WAYS; i++) {
+			if (set->entries[i].buf) {
+				n_used++;
+			}
+		}
+
+		if (n_used == 0) {
+			break;
+		}
+
+		cache_entry *e = &set->entries[set->hand];
+
+		set->hand = (set->hand + 1) % CACHE_N_WAYS;
+
+		if (! e->buf) {
+			continue;
+		}
+
+		if (e->referenced) {
+			e->referenced = false;
+			continue;
+		}
+
+		entry_drop(cache, e);
+
+		if (! victim) {
+			victim = e;
+		}
+	}
+
+	if (! victim || (uint64_t)cf_atomic64_get(cache->size) + size >
+			cache->max_size) {
+		// Rest of cache is over the limit - skip this one.
+		pthread_mutex_unlock(&set->lock);
+		cf_free(buf);
+		return;
+	}
+
+	victim->keyd = *keyd;
+	victim->file_id = file_id;
+	victim->rblock_id = rblock_id;
+	victim->generation = generation;
+	victim->size = size;
+	victim->referenced = false;
+	victim->buf = buf;
+
+	cf_atomic64_add(&cache->size, (int64_t)size);
+
+	pthread_mutex_unlock(&set->lock);
+}
+
+
+void
+ssd_read_cache_remove(ssd_read_cache *cache, cf_digest *keyd)
+{
+	cache_set *set = cache_get_set(cache, keyd);
+
+	pthread_mutex_lock(&set->lock);
+
+	for (int i = 0; i < CACHE_N_WAYS; i++) {
+		cache_entry *e = &set->entries[i];
+
+		if (e->buf && cf_digest_compare(&e->keyd, keyd) == 0) {
+			entry_drop(cache, e);
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&set->lock);
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+static inline cache_set*
+cache_get_set(ssd_read_cache *cache, cf_digest *keyd)
+{
+	// The cache spans all the namespace's devices.
+	return &cache->sets[as_digest_spread_hash(keyd) & (cache->n_sets - 1)];
+}
+
+static inline bool
+entry_matches(cache_entry *e, cf_digest *keyd, uint16_t file_id,
+		uint64_t rblock_id, uint32_t generation)
+{
+	return e->buf && e->rblock_id == rblock_id && e->file_id == file_id &&
+			e->generation == generation &&
+			cf_digest_compare(&e->keyd, keyd) == 0;
+}
+
+static inline void
+entry_drop(ssd_read_cache *cache, cache_entry *e)
+{
+	cf_atomic64_sub(&cache->size, (int64_t)e->size);
+	cf_free(e->buf);
+	e->buf = NULL;
+}
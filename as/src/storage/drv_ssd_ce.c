@@ -21,11 +21,171 @@
  */
 
 #include "storage/drv_ssd.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "citrusleaf/cf_atomic.h"
+#include "citrusleaf/cf_digest.h"
+
 #include "fault.h"
 
+#include "base/datamodel.h"
+#include "base/index.h"
+
+
+//==========================================================
+// Typedefs.
+//
+
+typedef struct ssd_resume_info_s {
+	drv_ssds		*ssds;
+	as_index_tree	*tree;
+	as_partition	*p;
+	bool			is_sub;
+	bool			drop_all;	// partition not wanted from storage
+	bool			any_fresh;	// some device was replaced since shutdown
+	uint32_t		n_to_drop;
+} ssd_resume_info;
+
+
+//==========================================================
+// Local helpers.
+//
+
+static inline bool
+resume_must_drop(const ssd_resume_info *ri, as_index *r)
+{
+	if (ri->drop_all || STORAGE_RBLOCK_IS_INVALID(r->storage_key.ssd.rblock_id) ||
+			r->storage_key.ssd.file_id >= (uint64_t)ri->ssds->n_ssds) {
+		return true;
+	}
+
+	return ri->any_fresh &&
+			ri->ssds->ssds[r->storage_key.ssd.file_id].started_fresh;
+}
+
+// Under the tree lock - imitate record-add for a resumed record.
+static void
+resume_record_cb(as_index *r, void *udata)
+{
+	ssd_resume_info *ri = (ssd_resume_info*)udata;
+	as_namespace *ns = ri->ssds->ns;
+
+	// Nothing from the previous run holds a reference any more.
+	cf_atomic32_set(&r->rc, 1);
+
+	if (ri->is_sub) {
+		cf_atomic_int_incr(&ns->n_sub_objects);
+	}
+	else {
+		cf_atomic_int_incr(&ns->n_objects);
+	}
+
+	if (resume_must_drop(ri, r)) {
+		ri->n_to_drop++;
+	}
+
+	// Account for all valid storage, so dropping records balances it.
+	if (STORAGE_RBLOCK_IS_INVALID(r->storage_key.ssd.rblock_id) ||
+			r->storage_key.ssd.file_id >= (uint64_t)ri->ssds->n_ssds) {
+		return;
+	}
+
+	drv_ssd *ssd = &ri->ssds->ssds[r->storage_key.ssd.file_id];
+	uint32_t wblock_id = RBLOCK_ID_TO_WBLOCK_ID(ssd,
+			r->storage_key.ssd.rblock_id);
+	uint32_t size = (uint32_t)RBLOCKS_TO_BYTES(r->storage_key.ssd.n_rblocks);
+
+	cf_atomic64_add(&ssd->inuse_size, (int64_t)size);
+	cf_atomic32_add(&ssd->alloc_table->wblock_state[wblock_id].inuse_sz,
+			(int32_t)size);
+	ssd_live_map_set(ssd, r->storage_key.ssd.rblock_id);
+	cf_atomic64_incr(&ssd->record_add_unique_counter);
+
+	cf_atomic_int_setmax(&ri->p->max_void_time, r->void_time);
+	cf_atomic_int_setmax(&ns->max_void_time, r->void_time);
+	as_partition_max_lut_update(ri->p, r->last_update_time);
+}
+
+// Outside the tree lock - delete records we can't keep.
+static void
+resume_drop_cb(as_index_ref *r_ref, void *udata)
+{
+	ssd_resume_info *ri = (ssd_resume_info*)udata;
+	as_index *r = r_ref->r;
+
+	if (resume_must_drop(ri, r)) {
+		// Storage we couldn't account for mustn't be freed.
+		if (r->storage_key.ssd.file_id >= (uint64_t)ri->ssds->n_ssds) {
+			r->storage_key.ssd.rblock_id = STORAGE_INVALID_RBLOCK;
+			r->storage_key.ssd.n_rblocks = 0;
+		}
+
+		// Destructor does the storage and stats accounting.
+		as_index_delete(ri->tree, &r->key);
+	}
+
+	as_record_done(r_ref, ri->ssds->ns);
+}
+
+static void
+resume_tree(ssd_resume_info *ri, as_index_tree *tree)
+{
+	ri->tree = tree;
+	ri->n_to_drop = 0;
+
+	as_index_reduce_sync(tree, resume_record_cb, ri);
+
+	if (ri->n_to_drop != 0) {
+		as_index_reduce(tree, resume_drop_cb, ri);
+	}
+}
+
+
+//==========================================================
+// Private API - for enterprise separation only.
+//
+
+// Warm restart - the index was resumed from shared memory, so rebuild device
+// usage and namespace stats by reducing it, instead of reading the devices.
 void
 ssd_resume_devices(drv_ssds *ssds)
 {
-	// Should not get here - for enterprise version only.
-	cf_crash(AS_DRV_SSD, "cold start called ssd_resume_devices()");
+	as_namespace *ns = ssds->ns;
+	ssd_resume_info ri = { .ssds = ssds };
+
+	for (int i = 0; i < ssds->n_ssds; i++) {
+		if (ssds->ssds[i].started_fresh) {
+			cf_info(AS_DRV_SSD, "device %s: fresh - dropping its resumed records",
+					ssds->ssds[i].name);
+			ri.any_fresh = true;
+		}
+	}
+
+	cf_info(AS_DRV_SSD, "{%s} reducing resumed index", ns->name);
+
+	for (uint32_t pid = 0; pid < AS_PARTITIONS; pid++) {
+		as_partition *p = &ns->partitions[pid];
+
+		ri.p = p;
+		ri.drop_all = ! ssds->get_state_from_storage[pid];
+
+		ri.is_sub = false;
+		resume_tree(&ri, p->vp);
+
+		ri.is_sub = true;
+		resume_tree(&ri, p->sub_vp);
+	}
+
+	for (int i = 0; i < ssds->n_ssds; i++) {
+		drv_ssd *ssd = &ssds->ssds[i];
+
+		cf_info(AS_DRV_SSD, "device %s: resumed %"PRIu64" records",
+				ssd->name, cf_atomic64_get(ssd->record_add_unique_counter));
+	}
+
+	cf_info(AS_DRV_SSD, "{%s} resumed %"PRIu64" objects, %"PRIu64" sub-objects",
+			ns->name, (uint64_t)ns->n_objects, (uint64_t)ns->n_sub_objects);
 }
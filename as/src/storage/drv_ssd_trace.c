@@ -0,0 +1,961 @@
+/*
+ * drv_ssd_trace.c
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/* SYNOPSIS
+ * Capture and replay of a namespace's device I/O mix.
+ *
+ * Capture records every device record read, wblock flush and defrag wblock
+ * read of one namespace into memory, and writes the trace file on stop. A
+ * trace holds only op type, device index, offset, size, issue time and latency
+ * - no digests, keys or data - so it's safe to take off a production node.
+ *
+ * Replay issues a trace's ops against a device no namespace is using, with
+ * the same I/O calls, alignment and open flags drv_ssd uses - the I/O engine
+ * picks which. It reports replayed latency percentiles per op type, next to
+ * the latencies recorded in the trace. Replay WRITES to the target device.
+ *
+ * Trace files are named, not pathed - they live only in the configured
+ * storage-trace-directory. A replay target is checked against the namespaces'
+ * devices and files by identity, not by name, so aliases, symlinks and
+ * partitions of devices in use are all refused. Block devices are also held
+ * open with O_EXCL for the whole replay, so mounted devices are refused too.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "storage/drv_ssd.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/fs.h> // for BLKGETSIZE64
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h> // for major(), minor()
+
+#include "citrusleaf/alloc.h"
+#include "citrusleaf/cf_atomic.h"
+#include "citrusleaf/cf_clock.h"
+
+#include "dynbuf.h"
+#include "fault.h"
+#include "hdr_hist.h"
+
+#include "base/datamodel.h"
+#include "base/cfg.h"
+#include "storage/storage.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+#define TRACE_MAGIC				"ASSDTRC"
+#define TRACE_VERSION			1
+#define TRACE_DEFAULT_MAX_RECS	(1024 * 1024)
+#define TRACE_MAX_MAX_RECS		(4 * 1024 * 1024)
+
+#define REPLAY_MAX_THREADS		64
+#define REPLAY_HIST_PRECISION	5
+
+typedef struct trace_file_header_s {
+	char		magic[8];
+	uint32_t	version;
+	uint32_t	n_devices;
+	uint32_t	write_block_size;
+	uint32_t	io_min_size;
+	uint64_t	n_recs;
+	uint64_t	n_dropped;
+	uint64_t	duration_ns;
+} trace_file_header;
+
+typedef struct trace_rec_s {
+	uint64_t	time_ns; // since capture start
+	uint64_t	offset;
+	uint32_t	size;
+	uint32_t	latency_us;
+	uint8_t		op; // 0 if never filled in - skipped on replay
+	uint8_t		device_index;
+	uint8_t		unused[6];
+} trace_rec;
+
+typedef struct replay_engine_s {
+	const char*	name;
+	int			open_flags;
+	ssize_t		(*read)(int fd, void* buf, size_t sz, off_t offset);
+	ssize_t		(*write)(int fd, const void* buf, size_t sz, off_t offset);
+} replay_engine;
+
+typedef struct replay_op_result_s {
+	uint64_t				n_ops;
+	hdr_hist_percentiles	replayed;
+	hdr_hist_percentiles	recorded;
+} replay_op_result;
+
+static const char* OP_NAMES[SSD_TRACE_N_OPS] = {
+		[SSD_TRACE_READ] = "read",
+		[SSD_TRACE_WRITE] = "write",
+		[SSD_TRACE_DEFRAG_READ] = "defrag-read"
+};
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static ssize_t engine_pread(int fd, void* buf, size_t sz, off_t offset);
+static ssize_t engine_seek_write(int fd, const void* buf, size_t sz, off_t offset);
+static ssize_t engine_pwrite(int fd, const void* buf, size_t sz, off_t offset);
+
+// The first three reproduce drv_ssd's default, enable-osync and
+// disable-odirect configurations.
+static const replay_engine ENGINES[] = {
+		{ "ssd", O_RDWR | O_DIRECT, engine_pread, engine_seek_write },
+		{ "ssd-osync", O_RDWR | O_DIRECT | O_SYNC, engine_pread, engine_seek_write },
+		{ "buffered", O_RDWR, engine_pread, engine_seek_write },
+		{ "pwrite", O_RDWR | O_DIRECT, engine_pread, engine_pwrite }
+};
+
+#define N_ENGINES (sizeof(ENGINES) / sizeof(replay_engine))
+
+static bool write_trace_file(const char* path, const trace_rec* recs, uint64_t n_recs, uint64_t n_dropped, uint64_t duration_ns, const drv_ssds* ssds);
+static bool trace_file_path(const char* name, char* path);
+static bool device_in_use(const char* path, const struct stat* target);
+static bool same_device(const struct stat* target, const char* path);
+static bool block_sys_path(dev_t rdev, char* sys_path);
+static uint64_t device_size(int fd);
+static void* run_replay(void* udata);
+static void* run_replay_worker(void* udata);
+static void append_percentiles(cf_dyn_buf* db, const char* prefix, const hdr_hist_percentiles* p);
+
+
+//==========================================================
+// Globals.
+//
+
+// Checked inline on the I/O paths - see ssd_trace_note().
+volatile bool g_ssd_trace_enabled = false;
+
+static pthread_mutex_t g_trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static as_namespace* g_trace_ns = NULL;
+static trace_rec* g_trace_recs = NULL;
+static uint64_t g_trace_max_recs = 0;
+static uint64_t g_trace_start_ns = 0;
+static char g_trace_path[PATH_MAX];
+static cf_atomic64 g_trace_n_recs = 0;
+static cf_atomic32 g_trace_n_writers = 0;
+
+static struct {
+	pthread_mutex_t		lock;
+	bool				running;
+	bool				done;
+
+	// Set up at start, read-only while running.
+	char				trace_path[PATH_MAX];
+	char				device_path[PATH_MAX];
+	char				open_path[PATH_MAX]; // device_path resolved when checked
+	int					excl_fd; // holds a block device exclusively, else -1
+	const replay_engine* engine;
+	uint32_t			n_threads;
+	bool				paced;
+	trace_rec*			recs;
+	uint64_t			n_recs;
+	uint32_t			max_size;
+	uint64_t			usable_size;
+	uint64_t			start_ns;
+
+	cf_atomic64			next_rec;
+	cf_atomic64			n_errors;
+	hdr_hist*			replayed[SSD_TRACE_N_OPS];
+	hdr_hist*			recorded[SSD_TRACE_N_OPS];
+
+	// Filled in when done.
+	uint64_t			elapsed_ns;
+	replay_op_result	results[SSD_TRACE_N_OPS];
+} g_replay = { .lock = PTHREAD_MUTEX_INITIALIZER, .excl_fd = -1 };
+
+
+//==========================================================
+// Public API - capture.
+//
+
+// Returns null on success, otherwise the reason for failure. The trace file is
+// created in storage-trace-directory.
+const char*
+as_storage_trace_start(as_namespace* ns, const char* file_name,
+		uint64_t max_recs)
+{
+	if (ns->storage_type != AS_STORAGE_ENGINE_SSD) {
+		return "not-ssd-namespace";
+	}
+
+	if (max_recs == 0) {
+		max_recs = TRACE_DEFAULT_MAX_RECS;
+	}
+	else if (max_recs > TRACE_MAX_MAX_RECS) {
+		max_recs = TRACE_MAX_MAX_RECS;
+	}
+
+	if (! g_config.storage_trace_directory) {
+		return "no-trace-directory";
+	}
+
+	char path[PATH_MAX];
+
+	if (! trace_file_path(file_name, path)) {
+		return "bad-file";
+	}
+
+	pthread_mutex_lock(&g_trace_lock);
+
+	if (g_trace_recs) {
+		pthread_mutex_unlock(&g_trace_lock);
+		return "already-tracing";
+	}
+
+	// Zeroed, so a record a writer didn't finish filling has op 0.
+	g_trace_recs = cf_calloc(max_recs, sizeof(trace_rec));
+
+	if (! g_trace_recs) {
+		pthread_mutex_unlock(&g_trace_lock);
+		return "out-of-memory";
+	}
+
+	strcpy(g_trace_path, path);
+	g_trace_ns = ns;
+	g_trace_max_recs = max_recs;
+	g_trace_start_ns = cf_getns();
+	cf_atomic64_set(&g_trace_n_recs, 0);
+
+	__sync_synchronize();
+	g_ssd_trace_enabled = true;
+
+	pthread_mutex_unlock(&g_trace_lock);
+
+	cf_info(AS_DRV_SSD, "{%s} tracing device I/O, up to %lu ops, to %s",
+			ns->name, max_recs, path);
+
+	return NULL;
+}
+
+// Returns null on success, otherwise the reason for failure.
+const char*
+as_storage_trace_stop()
+{
+	pthread_mutex_lock(&g_trace_lock);
+
+	if (! g_trace_recs) {
+		pthread_mutex_unlock(&g_trace_lock);
+		return "not-tracing";
+	}
+
+	g_ssd_trace_enabled = false;
+	__sync_synchronize();
+
+	// Writers register before checking the flag, so once none are registered
+	// no more records will be filled in.
+	while (cf_atomic32_get(g_trace_n_writers) != 0) {
+		;
+	}
+
+	uint64_t duration_ns = cf_getns() - g_trace_start_ns;
+	uint64_t n_claimed = cf_atomic64_get(g_trace_n_recs);
+	uint64_t n_recs = n_claimed < g_trace_max_recs ?
+			n_claimed : g_trace_max_recs;
+
+	bool ok = write_trace_file(g_trace_path, g_trace_recs, n_recs,
+			n_claimed - n_recs, duration_ns,
+			(const drv_ssds*)g_trace_ns->storage_private);
+
+	if (ok) {
+		cf_info(AS_DRV_SSD, "{%s} wrote %lu traced ops (%lu dropped) to %s",
+				g_trace_ns->name, n_recs, n_claimed - n_recs, g_trace_path);
+	}
+
+	cf_free(g_trace_recs);
+	g_trace_recs = NULL;
+	g_trace_ns = NULL;
+
+	pthread_mutex_unlock(&g_trace_lock);
+
+	return ok ? NULL : "file-write-failed";
+}
+
+void
+as_storage_trace_get_info(cf_dyn_buf* db)
+{
+	pthread_mutex_lock(&g_trace_lock);
+
+	if (! g_trace_recs) {
+		cf_dyn_buf_append_string(db, "status=off");
+		pthread_mutex_unlock(&g_trace_lock);
+		return;
+	}
+
+	uint64_t n_claimed = cf_atomic64_get(g_trace_n_recs);
+	uint64_t n_recs = n_claimed < g_trace_max_recs ?
+			n_claimed : g_trace_max_recs;
+
+	cf_dyn_buf_append_string(db, "status=on:ns=");
+	cf_dyn_buf_append_string(db, g_trace_ns->name);
+	cf_dyn_buf_append_string(db, ":file=");
+	cf_dyn_buf_append_string(db, g_trace_path);
+	cf_dyn_buf_append_string(db, ":ops=");
+	cf_dyn_buf_append_uint64(db, n_recs);
+	cf_dyn_buf_append_string(db, ":dropped=");
+	cf_dyn_buf_append_uint64(db, n_claimed - n_recs);
+	cf_dyn_buf_append_string(db, ":elapsed-ms=");
+	cf_dyn_buf_append_uint64(db, (cf_getns() - g_trace_start_ns) / 1000000);
+
+	pthread_mutex_unlock(&g_trace_lock);
+}
+
+
+//==========================================================
+// Public API - replay.
+//
+
+// Returns null on success, otherwise the reason for failure. The trace file is
+// read from storage-trace-directory.
+const char*
+as_storage_replay_start(const char* trace_name, const char* device_path,
+		const char* engine_name, uint32_t n_threads, bool paced)
+{
+	const replay_engine* engine = &ENGINES[0];
+
+	if (engine_name) {
+		engine = NULL;
+
+		for (uint32_t i = 0; i < N_ENGINES; i++) {
+			if (strcmp(ENGINES[i].name, engine_name) == 0) {
+				engine = &ENGINES[i];
+				break;
+			}
+		}
+
+		if (! engine) {
+			return "unknown-engine";
+		}
+	}
+
+	if (n_threads == 0 || n_threads > REPLAY_MAX_THREADS) {
+		return "bad-threads";
+	}
+
+	if (! g_config.storage_trace_directory) {
+		return "no-trace-directory";
+	}
+
+	char trace_path[PATH_MAX];
+
+	if (! trace_file_path(trace_name, trace_path) ||
+			strlen(device_path) >= PATH_MAX) {
+		return "bad-path";
+	}
+
+	char open_path[PATH_MAX];
+	struct stat target;
+
+	if (! realpath(device_path, open_path) || stat(open_path, &target) != 0 ||
+			! (S_ISBLK(target.st_mode) || S_ISREG(target.st_mode))) {
+		return "cant-open-device";
+	}
+
+	if (device_in_use(open_path, &target)) {
+		return "device-in-use";
+	}
+
+	pthread_mutex_lock(&g_replay.lock);
+
+	if (g_replay.running) {
+		pthread_mutex_unlock(&g_replay.lock);
+		return "already-replaying";
+	}
+
+	int fd = open(trace_path, O_RDONLY | O_NOFOLLOW);
+
+	if (fd == -1) {
+		pthread_mutex_unlock(&g_replay.lock);
+		return "cant-open-trace";
+	}
+
+	trace_file_header header;
+
+	if (read(fd, &header, sizeof(header)) != (ssize_t)sizeof(header) ||
+			memcmp(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0 ||
+			header.version != TRACE_VERSION ||
+			header.n_recs > TRACE_MAX_MAX_RECS) {
+		close(fd);
+		pthread_mutex_unlock(&g_replay.lock);
+		return "bad-trace";
+	}
+
+	size_t recs_sz = header.n_recs * sizeof(trace_rec);
+	trace_rec* recs = cf_malloc(recs_sz == 0 ? 1 : recs_sz);
+
+	if (! recs) {
+		close(fd);
+		pthread_mutex_unlock(&g_replay.lock);
+		return "out-of-memory";
+	}
+
+	if (read(fd, recs, recs_sz) != (ssize_t)recs_sz) {
+		cf_free(recs);
+		close(fd);
+		pthread_mutex_unlock(&g_replay.lock);
+		return "bad-trace";
+	}
+
+	close(fd);
+
+	// Check that the device opens the way the engine needs, and fits the
+	// biggest op with room to spread the rest.
+	uint32_t max_size = header.write_block_size;
+
+	for (uint64_t i = 0; i < header.n_recs; i++) {
+		if (recs[i].size > max_size) {
+			max_size = recs[i].size;
+		}
+	}
+
+	// A block device is held exclusively until the replay is done - fails if
+	// it's mounted, or otherwise held exclusively.
+	bool is_blk = S_ISBLK(target.st_mode);
+
+	fd = open(open_path, engine->open_flags | (is_blk ? O_EXCL : 0));
+
+	if (fd == -1) {
+		cf_free(recs);
+		pthread_mutex_unlock(&g_replay.lock);
+		return errno == EBUSY ? "device-in-use" : "cant-open-device";
+	}
+
+	struct stat opened;
+
+	// Make sure what we opened is what we checked.
+	if (fstat(fd, &opened) != 0 || (is_blk ?
+			! S_ISBLK(opened.st_mode) || opened.st_rdev != target.st_rdev :
+			opened.st_dev != target.st_dev || opened.st_ino != target.st_ino)) {
+		close(fd);
+		cf_free(recs);
+		pthread_mutex_unlock(&g_replay.lock);
+		return "device-changed";
+	}
+
+	uint64_t dev_size = device_size(fd);
+
+	if (max_size == 0 || dev_size < (uint64_t)max_size * 2) {
+		close(fd);
+		cf_free(recs);
+		pthread_mutex_unlock(&g_replay.lock);
+		return "device-too-small";
+	}
+
+	if (! is_blk) {
+		close(fd);
+		fd = -1;
+	}
+
+	for (int op = 1; op < SSD_TRACE_N_OPS; op++) {
+		if (g_replay.replayed[op]) {
+			hdr_hist_destroy(g_replay.replayed[op]);
+			hdr_hist_destroy(g_replay.recorded[op]);
+		}
+
+		g_replay.replayed[op] = hdr_hist_create(REPLAY_HIST_PRECISION);
+		g_replay.recorded[op] = hdr_hist_create(REPLAY_HIST_PRECISION);
+	}
+
+	memset(g_replay.results, 0, sizeof(g_replay.results));
+
+	for (uint64_t i = 0; i < header.n_recs; i++) {
+		uint8_t op = recs[i].op;
+
+		if (op != 0 && op < SSD_TRACE_N_OPS) {
+			hdr_hist_insert_raw(g_replay.recorded[op], recs[i].latency_us);
+			g_replay.results[op].n_ops++;
+		}
+	}
+
+	strcpy(g_replay.trace_path, trace_path);
+	strcpy(g_replay.device_path, device_path);
+	strcpy(g_replay.open_path, open_path);
+	g_replay.excl_fd = fd;
+	g_replay.engine = engine;
+	g_replay.n_threads = n_threads;
+	g_replay.paced = paced;
+	g_replay.recs = recs;
+	g_replay.n_recs = header.n_recs;
+	g_replay.max_size = max_size;
+	g_replay.usable_size = ((dev_size - max_size) / header.write_block_size) *
+			header.write_block_size;
+	g_replay.elapsed_ns = 0;
+	cf_atomic64_set(&g_replay.next_rec, 0);
+	cf_atomic64_set(&g_replay.n_errors, 0);
+
+	pthread_t thread;
+	pthread_attr_t attrs;
+
+	pthread_attr_init(&attrs);
+	pthread_attr_setdetachstate(&attrs, PTHREAD_CREATE_DETACHED);
+
+	if (pthread_create(&thread, &attrs, run_replay, NULL) != 0) {
+		if (fd != -1) {
+			close(fd);
+			g_replay.excl_fd = -1;
+		}
+
+		cf_free(recs);
+		g_replay.recs = NULL;
+		pthread_mutex_unlock(&g_replay.lock);
+		return "cant-create-thread";
+	}
+
+	g_replay.running = true;
+	g_replay.done = false;
+
+	pthread_mutex_unlock(&g_replay.lock);
+
+	cf_info(AS_DRV_SSD, "replaying %lu ops from %s on %s - engine %s, %u threads, %s",
+			header.n_recs, trace_path, device_path, engine->name, n_threads,
+			paced ? "paced" : "unpaced");
+
+	return NULL;
+}
+
+void
+as_storage_replay_get_info(cf_dyn_buf* db)
+{
+	pthread_mutex_lock(&g_replay.lock);
+
+	if (! g_replay.running && ! g_replay.done) {
+		cf_dyn_buf_append_string(db, "status=idle");
+		pthread_mutex_unlock(&g_replay.lock);
+		return;
+	}
+
+	uint64_t n_done = cf_atomic64_get(g_replay.next_rec);
+
+	cf_dyn_buf_append_string(db, g_replay.running ?
+			"status=running" : "status=done");
+	cf_dyn_buf_append_string(db, ":trace=");
+	cf_dyn_buf_append_string(db, g_replay.trace_path);
+	cf_dyn_buf_append_string(db, ":device=");
+	cf_dyn_buf_append_string(db, g_replay.device_path);
+	cf_dyn_buf_append_string(db, ":engine=");
+	cf_dyn_buf_append_string(db, g_replay.engine->name);
+	cf_dyn_buf_append_string(db, ":threads=");
+	cf_dyn_buf_append_uint32(db, g_replay.n_threads);
+	cf_dyn_buf_append_string(db, ":paced=");
+	cf_dyn_buf_append_string(db, g_replay.paced ? "true" : "false");
+	cf_dyn_buf_append_string(db, ":ops=");
+	cf_dyn_buf_append_uint64(db, n_done < g_replay.n_recs ?
+			n_done : g_replay.n_recs);
+	cf_dyn_buf_append_string(db, ":total-ops=");
+	cf_dyn_buf_append_uint64(db, g_replay.n_recs);
+	cf_dyn_buf_append_string(db, ":errors=");
+	cf_dyn_buf_append_uint64(db, cf_atomic64_get(g_replay.n_errors));
+
+	if (g_replay.done) {
+		cf_dyn_buf_append_string(db, ":elapsed-ms=");
+		cf_dyn_buf_append_uint64(db, g_replay.elapsed_ns / 1000000);
+
+		for (int op = 1; op < SSD_TRACE_N_OPS; op++) {
+			const replay_op_result* res = &g_replay.results[op];
+
+			cf_dyn_buf_append_string(db, ";op=");
+			cf_dyn_buf_append_string(db, OP_NAMES[op]);
+			cf_dyn_buf_append_string(db, ":count=");
+			cf_dyn_buf_append_uint64(db, res->n_ops);
+			append_percentiles(db, "", &res->replayed);
+			append_percentiles(db, "recorded-", &res->recorded);
+		}
+	}
+
+	pthread_mutex_unlock(&g_replay.lock);
+}
+
+
+//==========================================================
+// Private API - for drv_ssd.c.
+//
+
+// Called (via ssd_trace_note()) after a device op was issued at start_ns.
+void
+ssd_trace_record(drv_ssd* ssd, uint8_t op, uint64_t offset, uint32_t size,
+		uint64_t start_ns)
+{
+	if (ssd->ns != g_trace_ns || start_ns == 0) {
+		return;
+	}
+
+	cf_atomic32_incr(&g_trace_n_writers);
+
+	if (g_ssd_trace_enabled) {
+		uint64_t ix = (uint64_t)cf_atomic64_incr(&g_trace_n_recs) - 1;
+
+		if (ix < g_trace_max_recs && start_ns >= g_trace_start_ns) {
+			trace_rec* rec = &g_trace_recs[ix];
+
+			rec->time_ns = start_ns - g_trace_start_ns;
+			rec->offset = offset;
+			rec->size = size;
+			rec->latency_us = (uint32_t)((cf_getns() - start_ns) / 1000);
+			rec->device_index = (uint8_t)ssd->file_id;
+			rec->op = op;
+		}
+	}
+
+	cf_atomic32_decr(&g_trace_n_writers);
+}
+
+
+//==========================================================
+// Local helpers - I/O engines.
+//
+
+static ssize_t
+engine_pread(int fd, void* buf, size_t sz, off_t offset)
+{
+	return pread(fd, buf, sz, offset);
+}
+
+// As ssd_flush_swb() does it.
+static ssize_t
+engine_seek_write(int fd, const void* buf, size_t sz, off_t offset)
+{
+	if (lseek(fd, offset, SEEK_SET) != offset) {
+		return -1;
+	}
+
+	return write(fd, buf, sz);
+}
+
+static ssize_t
+engine_pwrite(int fd, const void* buf, size_t sz, off_t offset)
+{
+	return pwrite(fd, buf, sz, offset);
+}
+
+
+//==========================================================
+// Local helpers - capture.
+//
+
+static bool
+write_trace_file(const char* path, const trace_rec* recs, uint64_t n_recs,
+		uint64_t n_dropped, uint64_t duration_ns, const drv_ssds* ssds)
+{
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW,
+			S_IRUSR | S_IWUSR);
+
+	if (fd == -1) {
+		cf_warning(AS_DRV_SSD, "can't open trace file %s: %s", path,
+				cf_strerror(errno));
+		return false;
+	}
+
+	trace_file_header header = {
+			.version = TRACE_VERSION,
+			.n_devices = (uint32_t)ssds->n_ssds,
+			.write_block_size = ssds->ssds[0].write_block_size,
+			.io_min_size = (uint32_t)ssds->ssds[0].io_min_size,
+			.n_recs = n_recs,
+			.n_dropped = n_dropped,
+			.duration_ns = duration_ns
+	};
+
+	memcpy(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+
+	size_t recs_sz = n_recs * sizeof(trace_rec);
+	bool ok = write(fd, &header, sizeof(header)) == (ssize_t)sizeof(header) &&
+			write(fd, recs, recs_sz) == (ssize_t)recs_sz;
+
+	if (! ok) {
+		cf_warning(AS_DRV_SSD, "can't write trace file %s: %s", path,
+				cf_strerror(errno));
+	}
+
+	close(fd);
+
+	return ok;
+}
+
+
+// A trace file name is a single path component - no directories, hidden files
+// or parent references - placed in storage-trace-directory.
+static bool
+trace_file_path(const char* name, char* path)
+{
+	if (name[0] == '\0' || name[0] == '.' || strchr(name, '/')) {
+		return false;
+	}
+
+	int len = snprintf(path, PATH_MAX, "%s/%s",
+			g_config.storage_trace_directory, name);
+
+	return len > 0 && len < PATH_MAX;
+}
+
+
+//==========================================================
+// Local helpers - replay.
+//
+
+static bool
+device_in_use(const char* path, const struct stat* target)
+{
+	for (uint32_t i = 0; i < g_config.n_namespaces; i++) {
+		as_namespace* ns = g_config.namespaces[i];
+
+		for (int d = 0; d < AS_STORAGE_MAX_DEVICES; d++) {
+			if ((ns->storage_devices[d] &&
+					same_device(target, ns->storage_devices[d])) ||
+				(ns->storage_shadows[d] &&
+					same_device(target, ns->storage_shadows[d]))) {
+				return true;
+			}
+		}
+
+		for (int f = 0; f < AS_STORAGE_MAX_FILES; f++) {
+			if (ns->storage_files[f] &&
+					same_device(target, ns->storage_files[f])) {
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+// Same file, same block device, or one block device is a partition of the
+// other. A configured path we can't stat is in use, to be safe.
+static bool
+same_device(const struct stat* target, const char* path)
+{
+	struct stat st;
+
+	if (stat(path, &st) != 0) {
+		return true;
+	}
+
+	if (S_ISREG(target->st_mode) || S_ISREG(st.st_mode)) {
+		return st.st_dev == target->st_dev && st.st_ino == target->st_ino;
+	}
+
+	if (! S_ISBLK(target->st_mode) || ! S_ISBLK(st.st_mode)) {
+		return false;
+	}
+
+	if (st.st_rdev == target->st_rdev) {
+		return true;
+	}
+
+	// A partition's sysfs directory is inside its whole disk's.
+	char a[PATH_MAX];
+	char b[PATH_MAX];
+
+	if (! block_sys_path(target->st_rdev, a) ||
+			! block_sys_path(st.st_rdev, b)) {
+		return true;
+	}
+
+	size_t a_len = strlen(a);
+	size_t b_len = strlen(b);
+
+	return (a_len < b_len && strncmp(a, b, a_len) == 0 && b[a_len] == '/') ||
+			(b_len < a_len && strncmp(a, b, b_len) == 0 && a[b_len] == '/');
+}
+
+static bool
+block_sys_path(dev_t rdev, char* sys_path)
+{
+	char link[64];
+
+	sprintf(link, "/sys/dev/block/%u:%u", major(rdev), minor(rdev));
+
+	return realpath(link, sys_path) != NULL;
+}
+
+static uint64_t
+device_size(int fd)
+{
+	uint64_t size = 0;
+
+	if (ioctl(fd, BLKGETSIZE64, &size) != 0 || size == 0) {
+		off_t end = lseek(fd, 0, SEEK_END);
+
+		size = end < 0 ? 0 : (uint64_t)end;
+	}
+
+	return size;
+}
+
+static void*
+run_replay(void* udata)
+{
+	pthread_t workers[REPLAY_MAX_THREADS];
+	uint32_t n_workers = 0;
+
+	g_replay.start_ns = cf_getns();
+
+	for (uint32_t i = 0; i < g_replay.n_threads; i++) {
+		if (pthread_create(&workers[n_workers], NULL, run_replay_worker,
+				NULL) != 0) {
+			cf_warning(AS_DRV_SSD, "replay started only %u of %u threads",
+					n_workers, g_replay.n_threads);
+			break;
+		}
+
+		n_workers++;
+	}
+
+	for (uint32_t i = 0; i < n_workers; i++) {
+		pthread_join(workers[i], NULL);
+	}
+
+	uint64_t elapsed_ns = cf_getns() - g_replay.start_ns;
+
+	pthread_mutex_lock(&g_replay.lock);
+
+	g_replay.elapsed_ns = elapsed_ns;
+
+	for (int op = 1; op < SSD_TRACE_N_OPS; op++) {
+		hdr_hist_take_percentiles(g_replay.replayed[op],
+				&g_replay.results[op].replayed);
+		hdr_hist_take_percentiles(g_replay.recorded[op],
+				&g_replay.results[op].recorded);
+	}
+
+	cf_free(g_replay.recs);
+	g_replay.recs = NULL;
+
+	if (g_replay.excl_fd != -1) {
+		close(g_replay.excl_fd);
+		g_replay.excl_fd = -1;
+	}
+
+	g_replay.running = false;
+	g_replay.done = true;
+
+	cf_info(AS_DRV_SSD, "replay of %s done in %lu ms, %lu errors",
+			g_replay.trace_path, elapsed_ns / 1000000,
+			cf_atomic64_get(g_replay.n_errors));
+
+	pthread_mutex_unlock(&g_replay.lock);
+
+	return NULL;
+}
+
+static void*
+run_replay_worker(void* udata)
+{
+	const replay_engine* engine = g_replay.engine;
+	// Our exclusive hold doesn't stop our own non-exclusive opens.
+	int fd = open(g_replay.open_path, engine->open_flags);
+
+	if (fd == -1) {
+		cf_warning(AS_DRV_SSD, "replay can't open %s: %s", g_replay.open_path,
+				cf_strerror(errno));
+		return NULL;
+	}
+
+	uint8_t* buf = cf_valloc(g_replay.max_size);
+
+	if (! buf) {
+		close(fd);
+		return NULL;
+	}
+
+	memset(buf, 0, g_replay.max_size);
+
+	while (true) {
+		uint64_t ix = (uint64_t)cf_atomic64_incr(&g_replay.next_rec) - 1;
+
+		if (ix >= g_replay.n_recs) {
+			break;
+		}
+
+		const trace_rec* rec = &g_replay.recs[ix];
+
+		if (rec->op == 0 || rec->op >= SSD_TRACE_N_OPS) {
+			continue;
+		}
+
+		if (g_replay.paced) {
+			uint64_t due_ns = g_replay.start_ns + rec->time_ns;
+			uint64_t now_ns = cf_getns();
+
+			if (due_ns > now_ns) {
+				uint64_t wait_ns = due_ns - now_ns;
+				struct timespec ts = {
+						.tv_sec = (time_t)(wait_ns / 1000000000),
+						.tv_nsec = (long)(wait_ns % 1000000000)
+				};
+
+				nanosleep(&ts, NULL);
+			}
+		}
+
+		// Offsets keep their alignment - usable size is whole wblocks.
+		off_t offset = (off_t)(rec->offset % g_replay.usable_size);
+		uint64_t start_ns = cf_getns();
+		ssize_t rv = rec->op == SSD_TRACE_WRITE ?
+				engine->write(fd, buf, rec->size, offset) :
+				engine->read(fd, buf, rec->size, offset);
+
+		if (rv != (ssize_t)rec->size) {
+			cf_atomic64_incr(&g_replay.n_errors);
+			continue;
+		}
+
+		hdr_hist_insert_data_point(g_replay.replayed[rec->op], start_ns);
+	}
+
+	cf_free(buf);
+	close(fd);
+
+	return NULL;
+}
+
+static void
+append_percentiles(cf_dyn_buf* db, const char* prefix,
+		const hdr_hist_percentiles* p)
+{
+	char str[256];
+
+	snprintf(str, sizeof(str),
+			":%sp50-us=%lu:%sp90-us=%lu:%sp99-us=%lu:%sp99.9-us=%lu:%smax-us=%lu",
+			prefix, p->p50, prefix, p->p90, prefix, p->p99, prefix, p->p999,
+			prefix, p->max);
+	cf_dyn_buf_append_string(db, str);
+}
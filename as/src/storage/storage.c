@@ -31,11 +31,14 @@
 
 #include "storage/storage.h"
 
+#include <pthread.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <string.h>
 
+#include "citrusleaf/alloc.h"
+#include "citrusleaf/cf_clock.h"
 #include "citrusleaf/cf_digest.h"
 #include "citrusleaf/cf_queue.h"
 
@@ -62,40 +65,102 @@
 typedef int (*as_storage_namespace_init_fn)(as_namespace *ns, cf_queue *complete_q, void *udata);
 static const as_storage_namespace_init_fn as_storage_namespace_init_table[AS_STORAGE_ENGINE_TYPES] = {
 	NULL,
-	0, // memory has no init
+	as_storage_namespace_init_memory,
 	as_storage_namespace_init_ssd,
 	as_storage_namespace_init_kv
 };
 
+typedef struct storage_init_job_s {
+	as_namespace *ns;
+	cf_queue *complete_q;
+} storage_init_job;
+
+static cf_queue *g_init_complete_q = NULL;
+static uint32_t g_init_n_pending = 0;
+static uint64_t g_init_start_ms = 0;
+
+// Each namespace's storage init runs on its own thread, so warm restarts (and
+// device scans) of different namespaces proceed concurrently. Loads that take a
+// long time signal completion asynchronously - we only need to kick them off.
+static void *
+run_storage_init(void *udata)
+{
+	storage_init_job *job = (storage_init_job *)udata;
+	as_namespace *ns = job->ns;
+
+	if (0 != as_storage_namespace_init_table[ns->storage_type](ns, job->complete_q, ns)) {
+		cf_crash(AS_STORAGE, "could not initialize storage for namespace %s", ns->name);
+	}
+
+	cf_free(job);
+
+	return NULL;
+}
+
 void
 as_storage_init()
 {
-	cf_queue *complete_q = cf_queue_create(sizeof(void*), true);
+	g_init_complete_q = cf_queue_create(sizeof(as_namespace *), true);
+	g_init_n_pending = g_config.n_namespaces;
+	g_init_start_ms = cf_getms();
+
+	pthread_attr_t attrs;
+
+	pthread_attr_init(&attrs);
+	pthread_attr_setdetachstate(&attrs, PTHREAD_CREATE_DETACHED);
 
 	for (uint32_t i = 0; i < g_config.n_namespaces; i++) {
 		as_namespace *ns = g_config.namespaces[i];
 
 		if (as_storage_namespace_init_table[ns->storage_type]) {
-			if (0 != as_storage_namespace_init_table[ns->storage_type](ns, complete_q, NULL)) {
-				cf_crash(AS_STORAGE, "could not initialize storage for namespace %s", ns->name);
+			storage_init_job *job = cf_malloc(sizeof(storage_init_job));
+
+			if (! job) {
+				cf_crash(AS_STORAGE, "failed storage init job alloc");
+			}
+
+			job->ns = ns;
+			job->complete_q = g_init_complete_q;
+
+			pthread_t thread;
+
+			if (0 != pthread_create(&thread, &attrs, run_storage_init, job)) {
+				cf_crash(AS_STORAGE, "could not create storage init thread for namespace %s",
+						ns->name);
 			}
 		}
 		else {
-			void *_t;
-
-			cf_queue_push(complete_q, &_t);
+			cf_queue_push(g_init_complete_q, &ns);
 		}
 	}
 
-	for (uint32_t i = 0; i < g_config.n_namespaces; i++) {
-		void *_t;
+	pthread_attr_destroy(&attrs);
+}
 
-		while (CF_QUEUE_OK != cf_queue_pop(complete_q, &_t, 2000)) {
-			as_storage_cold_start_ticker_ssd();
+as_namespace *
+as_storage_init_wait_next()
+{
+	if (g_init_n_pending == 0) {
+		if (g_init_complete_q) {
+			cf_queue_destroy(g_init_complete_q);
+			g_init_complete_q = NULL;
 		}
+
+		return NULL;
 	}
 
-	cf_queue_destroy(complete_q);
+	as_namespace *ns;
+
+	while (CF_QUEUE_OK != cf_queue_pop(g_init_complete_q, &ns, 2000)) {
+		as_storage_cold_start_ticker_ssd();
+	}
+
+	g_init_n_pending--;
+
+	cf_info(AS_STORAGE, "{%s} storage loaded in %lu ms", ns->name,
+			cf_getms() - g_init_start_ms);
+
+	return ns;
 }
 
 //--------------------------------------
@@ -232,6 +297,7 @@ as_storage_record_create(as_namespace *ns, as_record *r, as_storage_rd *rd, cf_d
 	rd->keyd = *keyd;
 	rd->bins = 0;
 	rd->n_bins = 0;
+	rd->bin_index = NULL;
 	rd->record_on_device = false;
 	rd->ignore_record_on_device = false;
 	rd->have_device_block = false;
@@ -267,6 +333,7 @@ as_storage_record_open(as_namespace *ns, as_record *r, as_storage_rd *rd, cf_dig
 	rd->keyd = *keyd;
 	rd->bins = 0;
 	rd->n_bins = 0;
+	rd->bin_index = NULL;
 	rd->record_on_device = true;
 	rd->ignore_record_on_device = false;
 	rd->have_device_block = false;
@@ -295,6 +362,8 @@ static const as_storage_record_close_fn as_storage_record_close_table[AS_STORAGE
 int
 as_storage_record_close(as_record *r, as_storage_rd *rd)
 {
+	as_bin_index_detach(rd);
+
 	if (as_storage_record_close_table[rd->storage_type]) {
 		return as_storage_record_close_table[rd->storage_type](r, rd);
 	}
@@ -346,6 +415,70 @@ as_storage_record_read(as_storage_rd *rd)
 	return 0;
 }
 
+//--------------------------------------
+// as_storage_record_read_batch
+//
+
+typedef void (*as_storage_record_read_batch_fn)(as_storage_rd **rds, uint32_t n_rds);
+static const as_storage_record_read_batch_fn as_storage_record_read_batch_table[AS_STORAGE_ENGINE_TYPES] = {
+	NULL,
+	0, // memory has no record read
+	as_storage_record_read_batch_ssd,
+	0 // kv records are read individually
+};
+
+// Optimization only - any record not read here is read the normal way later.
+void
+as_storage_record_read_batch(as_storage_rd **rds, uint32_t n_rds)
+{
+	if (n_rds != 0 && as_storage_record_read_batch_table[rds[0]->storage_type]) {
+		as_storage_record_read_batch_table[rds[0]->storage_type](rds, n_rds);
+	}
+}
+
+//--------------------------------------
+// as_storage_sweep_n_slices
+//
+
+typedef uint32_t (*as_storage_sweep_n_slices_fn)(as_namespace *ns, uint32_t *p_n_devices);
+static const as_storage_sweep_n_slices_fn as_storage_sweep_n_slices_table[AS_STORAGE_ENGINE_TYPES] = {
+	NULL,
+	0, // memory has no devices to sweep
+	as_storage_sweep_n_slices_ssd,
+	0 // kv doesn't sweep
+};
+
+uint32_t
+as_storage_sweep_n_slices(as_namespace *ns, uint32_t *p_n_devices)
+{
+	if (as_storage_sweep_n_slices_table[ns->storage_type]) {
+		return as_storage_sweep_n_slices_table[ns->storage_type](ns, p_n_devices);
+	}
+
+	return 0;
+}
+
+//--------------------------------------
+// as_storage_sweep_slice
+//
+
+typedef void (*as_storage_sweep_slice_fn)(as_namespace *ns, uint32_t slice, struct as_index_tree_s **trees, as_storage_sweep_cb cb, void *udata);
+static const as_storage_sweep_slice_fn as_storage_sweep_slice_table[AS_STORAGE_ENGINE_TYPES] = {
+	NULL,
+	0, // memory has no devices to sweep
+	as_storage_sweep_slice_ssd,
+	0 // kv doesn't sweep
+};
+
+void
+as_storage_sweep_slice(as_namespace *ns, uint32_t slice,
+		struct as_index_tree_s **trees, as_storage_sweep_cb cb, void *udata)
+{
+	if (as_storage_sweep_slice_table[ns->storage_type]) {
+		as_storage_sweep_slice_table[ns->storage_type](ns, slice, trees, cb, udata);
+	}
+}
+
 //--------------------------------------
 // as_storage_particle_read_all
 //
@@ -458,6 +591,28 @@ as_storage_overloaded(as_namespace *ns)
 	return false;
 }
 
+//--------------------------------------
+// as_storage_write_q_depth
+//
+
+typedef uint32_t (*as_storage_write_q_depth_fn)(as_namespace *ns);
+static const as_storage_write_q_depth_fn as_storage_write_q_depth_table[AS_STORAGE_ENGINE_TYPES] = {
+	NULL,
+	0, // memory has no write queue
+	as_storage_write_q_depth_ssd,
+	0  // kv has no write queue
+};
+
+uint32_t
+as_storage_write_q_depth(as_namespace *ns)
+{
+	if (as_storage_write_q_depth_table[ns->storage_type]) {
+		return as_storage_write_q_depth_table[ns->storage_type](ns);
+	}
+
+	return 0;
+}
+
 //--------------------------------------
 // as_storage_has_space
 //
@@ -529,7 +684,7 @@ as_storage_info_set(as_namespace *ns, uint idx, uint8_t *buf, size_t len)
 typedef int (*as_storage_info_get_fn)(as_namespace *ns, uint idx, uint8_t *buf, size_t *len);
 static const as_storage_info_get_fn as_storage_info_get_table[AS_STORAGE_ENGINE_TYPES] = {
 	NULL,
-	0, // memory doesn't support info
+	as_storage_info_get_memory, // only partition versions loaded from snapshot
 	as_storage_info_get_ssd,
 	0  // kv doesn't support info
 };
@@ -739,6 +894,20 @@ as_storage_record_get_key(as_storage_rd *rd)
 	return false;
 }
 
+// Takes ownership of the buffer a data-not-in-memory record was read into, so
+// bins read from it stay valid after the record is closed. Caller must free.
+// Returns NULL if there's no such buffer, or the buffer isn't the record's own.
+uint8_t *
+as_storage_record_detach_block(as_storage_rd *rd)
+{
+	if (rd->storage_type == AS_STORAGE_ENGINE_SSD &&
+			! rd->ns->storage_data_in_memory) {
+		return as_storage_record_detach_block_ssd(rd);
+	}
+
+	return NULL;
+}
+
 size_t
 as_storage_record_rec_props_size(as_storage_rd *rd)
 {
@@ -827,6 +996,16 @@ as_storage_shutdown(void)
 {
 	cf_info(AS_STORAGE, "initiating storage shutdown ...");
 
+	// Snapshot memory namespaces first - snapshots need the record locks.
+
+	for (uint32_t i = 0; i < g_config.n_namespaces; i++) {
+		as_namespace *ns = g_config.namespaces[i];
+
+		if (ns->storage_type == AS_STORAGE_ENGINE_MEMORY) {
+			as_storage_shutdown_memory(ns);
+		}
+	}
+
 	// Pull all record locks - stops everything writing to current swbs such
 	// that each write's record lock scope is either completed or never entered.
 
@@ -845,6 +1024,9 @@ as_storage_shutdown(void)
 			as_storage_shutdown_ssd(ns);
 			as_namespace_xmem_trusted(ns);
 		}
+		else if (ns->storage_type == AS_STORAGE_ENGINE_KV) {
+			as_storage_shutdown_kv(ns);
+		}
 	}
 
   	cf_info(AS_STORAGE, "completed flushing to storage");
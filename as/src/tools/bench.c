@@ -0,0 +1,943 @@
+/*
+ * bench.c
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/* SYNOPSIS
+ * asbench - microbenchmarks of core primitives, built by "make bench" as its
+ * own binary. It links the server's objects (all but the one with asd's
+ * main()), so it measures the same code and allocator that serve traffic,
+ * without a running server.
+ *
+ * Every benchmark works on private structures - its own arena and index tree,
+ * olock, queue, histograms, CDT bins and sindex btrees.
+ *
+ * Keys come from a fixed-seed generator, so runs are reproducible. Runs are
+ * single-threaded, and report one machine-readable line each.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include <getopt.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "citrusleaf/alloc.h"
+#include "citrusleaf/cf_byte_order.h"
+#include "citrusleaf/cf_clock.h"
+#include "citrusleaf/cf_digest.h"
+#include "citrusleaf/cf_queue.h"
+#include "citrusleaf/cf_shash.h"
+
+#include "ai_obj.h"
+#include "ai_types.h"
+#include "arenax.h"
+#include "bt.h"
+#include "cf_str.h"
+#include "dynbuf.h"
+#include "fault.h"
+#include "hdr_hist.h"
+#include "hist.h"
+#include "msg.h"
+#include "ohash.h"
+#include "olock.h"
+
+#include "base/datamodel.h"
+#include "base/index.h"
+#include "base/proto.h"
+#include "base/stats.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+#define BENCH_DEFAULT_OPS	(100 * 1000)
+#define BENCH_MAX_OPS		(1000 * 1000)
+
+#define BENCH_SEED			0x5eed5eed5eed5eedUL
+#define BENCH_TREE_SPRIGS	64
+#define BENCH_ARENA_STAGE	(1024 * 1024) // elements
+#define BENCH_HASH_SLOTS	(32 * 1024) // initial size, as transaction hashes
+#define BENCH_RECORD_LOCKS	(32 * 1024) // as the server's default
+#define BENCH_CDT_ELEMENTS	1000 // per map or list bin
+#define BENCH_CDT_OP_SZ		64
+
+typedef struct bench_ctx_s {
+	uint32_t	n_ops;
+	cf_digest*	keyds;
+	uint64_t	n_result; // keeps work from being optimized away
+} bench_ctx;
+
+typedef void (*bench_fn)(bench_ctx* ctx);
+
+typedef struct bench_def_s {
+	const char*	name;
+	bench_fn	fn;
+} bench_def;
+
+
+//==========================================================
+// Globals.
+//
+
+// Defined in as.c, which isn't linked - it has asd's main().
+pthread_mutex_t g_NONSTOP;
+bool g_startup_complete = false;
+bool g_shutdown_started = false;
+
+// There's no arena or histogram destroy - these last for the run.
+static cf_arenax* g_bench_arena = NULL;
+static histogram* g_bench_hist = NULL;
+static histogram* g_bench_sharded_hist = NULL;
+
+static const msg_template BENCH_MT[] = {
+		{ 0, M_FT_UINT32 },
+		{ 1, M_FT_UINT64 },
+		{ 2, M_FT_BUF },
+		{ 3, M_FT_STR }
+};
+
+static const struct option CMD_OPTS[] = {
+		{ "help", no_argument, 0, 'h' },
+		{ "list", no_argument, 0, 'l' },
+		{ "bench", required_argument, 0, 'b' },
+		{ "ops", required_argument, 0, 'o' },
+		{ 0, 0, 0, 0 }
+};
+
+static const char USAGE[] =
+		"\n"
+		"asbench [--list] [--bench <NAME>] [--ops <N>]\n"
+		"\n"
+		"Runs the named benchmark, or all of them, for N ops (default 100000,\n"
+		"max 1000000). --list prints the benchmark names.\n"
+		;
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static void bench_index_insert(bench_ctx* ctx);
+static void bench_index_get(bench_ctx* ctx);
+static void bench_index_delete(bench_ctx* ctx);
+static void bench_index_reduce(bench_ctx* ctx);
+static void bench_olock(bench_ctx* ctx);
+static void bench_queue(bench_ctx* ctx);
+static void bench_msg(bench_ctx* ctx);
+static void bench_dynbuf(bench_ctx* ctx);
+static void bench_hist(bench_ctx* ctx);
+static void bench_hist_sharded(bench_ctx* ctx);
+static void bench_hdr_hist(bench_ctx* ctx);
+static void bench_shash(bench_ctx* ctx);
+static void bench_ohash(bench_ctx* ctx);
+static void bench_map_put(bench_ctx* ctx);
+static void bench_map_get(bench_ctx* ctx);
+static void bench_list_append(bench_ctx* ctx);
+static void bench_list_get(bench_ctx* ctx);
+static void bench_ai_btree_long(bench_ctx* ctx);
+static void bench_ai_btree_digest(bench_ctx* ctx);
+
+static const bench_def BENCHES[] = {
+		{ "index-insert", bench_index_insert },
+		{ "index-get", bench_index_get },
+		{ "index-delete", bench_index_delete },
+		{ "index-reduce", bench_index_reduce },
+		{ "olock", bench_olock },
+		{ "queue", bench_queue },
+		{ "msg", bench_msg },
+		{ "dynbuf", bench_dynbuf },
+		{ "hist", bench_hist },
+		{ "hist-sharded", bench_hist_sharded },
+		{ "hdr-hist", bench_hdr_hist },
+		{ "shash", bench_shash },
+		{ "ohash", bench_ohash },
+		{ "map-put", bench_map_put },
+		{ "map-get", bench_map_get },
+		{ "list-append", bench_list_append },
+		{ "list-get", bench_list_get },
+		{ "ai-btree-long", bench_ai_btree_long },
+		{ "ai-btree-digest", bench_ai_btree_digest }
+};
+
+#define N_BENCHES (sizeof(BENCHES) / sizeof(bench_def))
+
+static void bench_init();
+static void run_one(const bench_def* def, bench_ctx* ctx);
+static as_index_tree* bench_tree_create();
+static void bench_tree_fill(as_index_tree* tree, bench_ctx* ctx);
+
+static inline uint64_t
+splitmix64(uint64_t* state)
+{
+	uint64_t z = (*state += 0x9e3779b97f4a7c15UL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9UL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebUL;
+
+	return z ^ (z >> 31);
+}
+
+
+//==========================================================
+// Public API.
+//
+
+int
+main(int argc, char** argv)
+{
+	const bench_def* def = NULL;
+	uint32_t n_ops = BENCH_DEFAULT_OPS;
+	int opt;
+	int opt_ix;
+
+	while ((opt = getopt_long(argc, argv, "", CMD_OPTS, &opt_ix)) != -1) {
+		switch (opt) {
+		case 'h':
+			// printf() since we want stdout and don't want cf_fault's prefix.
+			printf("%s\n", USAGE);
+			return 0;
+		case 'l':
+			for (uint32_t i = 0; i < N_BENCHES; i++) {
+				printf("%s\n", BENCHES[i].name);
+			}
+			return 0;
+		case 'b':
+			for (uint32_t i = 0; i < N_BENCHES; i++) {
+				if (strcmp(BENCHES[i].name, optarg) == 0) {
+					def = &BENCHES[i];
+					break;
+				}
+			}
+
+			if (! def) {
+				fprintf(stderr, "asbench: no benchmark %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'o':
+			if (cf_str_atoi_u32(optarg, &n_ops) != 0 || n_ops == 0 ||
+					n_ops > BENCH_MAX_OPS) {
+				fprintf(stderr, "asbench: bad ops %s\n", optarg);
+				return 1;
+			}
+			break;
+		default:
+			// fprintf() since we don't want cf_fault's prefix.
+			fprintf(stderr, "%s\n", USAGE);
+			return 1;
+		}
+	}
+
+	bench_init();
+
+	bench_ctx ctx = { .n_ops = n_ops };
+
+	ctx.keyds = cf_malloc(sizeof(cf_digest) * n_ops);
+	cf_assert(ctx.keyds, CF_MISC, CF_CRITICAL, "failed bench keys malloc");
+
+	uint64_t state = BENCH_SEED;
+
+	for (uint32_t i = 0; i < n_ops; i++) {
+		uint64_t* p = (uint64_t*)&ctx.keyds[i];
+
+		p[0] = splitmix64(&state);
+		p[1] = splitmix64(&state);
+		*(uint32_t*)&p[2] = (uint32_t)splitmix64(&state);
+	}
+
+	if (def) {
+		run_one(def, &ctx);
+	}
+	else {
+		for (uint32_t i = 0; i < N_BENCHES; i++) {
+			run_one(&BENCHES[i], &ctx);
+		}
+	}
+
+	cf_free(ctx.keyds);
+
+	return 0;
+}
+
+
+//==========================================================
+// Local helpers - running and reporting.
+//
+
+// What asd's startup sets up that the benchmarked code relies on.
+static void
+bench_init()
+{
+	cf_rc_init(NULL);
+	cf_fault_init();
+	as_stats_init();
+
+	// Index reduce takes record locks.
+	if (! (g_record_locks = olock_create(BENCH_RECORD_LOCKS, false))) {
+		cf_crash(CF_MISC, "failed bench record locks create");
+	}
+
+	g_bench_arena = cf_malloc(cf_arenax_sizeof());
+	cf_assert(g_bench_arena, CF_MISC, CF_CRITICAL, "failed bench arena malloc");
+
+	// Key base 0 - stages are heap memory, not shared memory.
+	cf_arenax_err err = cf_arenax_create(g_bench_arena, 0,
+			(uint32_t)sizeof(as_index), BENCH_ARENA_STAGE, 0,
+			CF_ARENAX_BIGLOCK);
+
+	if (err != CF_ARENAX_OK) {
+		cf_crash(CF_MISC, "can't create bench arena: %s",
+				cf_arenax_errstr(err));
+	}
+
+	g_bench_hist = histogram_create("bench", HIST_RAW);
+	g_bench_sharded_hist = histogram_create("bench-sharded", HIST_RAW);
+
+	if (! histogram_add_shards(g_bench_sharded_hist)) {
+		cf_crash(CF_MISC, "can't shard bench histogram");
+	}
+}
+
+// name=<bench>:ops=<N>:ns=<total>:ns-per-op=<avg>
+static void
+run_one(const bench_def* def, bench_ctx* ctx)
+{
+	ctx->n_result = 0;
+
+	uint64_t start_ns = cf_getns();
+
+	def->fn(ctx);
+
+	uint64_t total_ns = cf_getns() - start_ns;
+
+	printf("name=%s:ops=%u:ns=%lu:ns-per-op=%.2f\n", def->name, ctx->n_ops,
+			total_ns, (double)total_ns / (double)ctx->n_ops);
+
+	cf_detail(CF_MISC, "bench %s result %lu", def->name, ctx->n_result);
+}
+
+
+//==========================================================
+// Local helpers - index.
+//
+// Each run builds its own tree. Times include the fill, so subtract the
+// index-insert time to isolate a lookup, delete or reduce.
+//
+
+static as_index_tree*
+bench_tree_create()
+{
+	as_index_tree* tree = as_index_tree_create(g_bench_arena,
+			BENCH_TREE_SPRIGS, NULL, NULL, NULL);
+
+	cf_assert(tree, CF_MISC, CF_CRITICAL, "failed bench tree create");
+
+	return tree;
+}
+
+static void
+bench_tree_insert(as_index_tree* tree, cf_digest* keyd)
+{
+	as_index_ref r_ref;
+
+	r_ref.skip_lock = true; // don't touch the record locks live traffic uses
+
+	int rv = as_index_get_insert_vlock(tree, keyd, &r_ref);
+
+	if (rv < 0) {
+		cf_crash(CF_MISC, "bench index insert failed");
+	}
+
+	if (rv == 1) {
+		r_ref.r->generation = 1; // now a valid record
+	}
+
+	as_index_release(r_ref.r);
+	cf_shard_counter_decr(&g_stats.global_record_ref_count);
+}
+
+static void
+bench_tree_fill(as_index_tree* tree, bench_ctx* ctx)
+{
+	for (uint32_t i = 0; i < ctx->n_ops; i++) {
+		bench_tree_insert(tree, &ctx->keyds[i]);
+	}
+}
+
+static void
+bench_index_insert(bench_ctx* ctx)
+{
+	as_index_tree* tree = bench_tree_create();
+
+	bench_tree_fill(tree, ctx);
+
+	ctx->n_result = as_index_tree_size(tree);
+	as_index_tree_release(tree, NULL);
+}
+
+static void
+bench_index_get(bench_ctx* ctx)
+{
+	as_index_tree* tree = bench_tree_create();
+
+	bench_tree_fill(tree, ctx);
+
+	uint64_t start_ns = cf_getns();
+
+	for (uint32_t i = 0; i < ctx->n_ops; i++) {
+		as_index_ref r_ref;
+
+		r_ref.skip_lock = true;
+
+		if (as_index_get_vlock(tree, &ctx->keyds[i], &r_ref) == 0) {
+			ctx->n_result += r_ref.r->generation;
+			as_index_release(r_ref.r);
+			cf_shard_counter_decr(&g_stats.global_record_ref_count);
+		}
+	}
+
+	cf_detail(CF_MISC, "bench index-get lookups %lu ns", cf_getns() - start_ns);
+
+	as_index_tree_release(tree, NULL);
+}
+
+static void
+bench_index_delete(bench_ctx* ctx)
+{
+	as_index_tree* tree = bench_tree_create();
+
+	bench_tree_fill(tree, ctx);
+
+	for (uint32_t i = 0; i < ctx->n_ops; i++) {
+		ctx->n_result += as_index_delete(tree, &ctx->keyds[i]) == 0 ? 1 : 0;
+	}
+
+	as_index_tree_release(tree, NULL);
+}
+
+static void
+bench_reduce_cb(as_index_ref* r_ref, void* udata)
+{
+	bench_ctx* ctx = (bench_ctx*)udata;
+
+	ctx->n_result += r_ref->r->generation;
+
+	pthread_mutex_unlock(r_ref->olock);
+	as_index_release(r_ref->r);
+	cf_shard_counter_decr(&g_stats.global_record_ref_count);
+}
+
+static void
+bench_index_reduce(bench_ctx* ctx)
+{
+	as_index_tree* tree = bench_tree_create();
+
+	bench_tree_fill(tree, ctx);
+	as_index_reduce(tree, bench_reduce_cb, ctx);
+	as_index_tree_release(tree, NULL);
+}
+
+
+//==========================================================
+// Local helpers - other primitives.
+//
+
+static void
+bench_olock(bench_ctx* ctx)
+{
+	olock* ol = olock_create(16 * 1024, true);
+
+	cf_assert(ol, CF_MISC, CF_CRITICAL, "failed bench olock create");
+
+	for (uint32_t i = 0; i < ctx->n_ops; i++) {
+		olock_lock(ol, &ctx->keyds[i]);
+		olock_unlock(ol, &ctx->keyds[i]);
+	}
+
+	olock_destroy(ol);
+}
+
+// One op is a push and a pop.
+static void
+bench_queue(bench_ctx* ctx)
+{
+	cf_queue* q = cf_queue_create(sizeof(uint64_t), true);
+
+	cf_assert(q, CF_MISC, CF_CRITICAL, "failed bench queue create");
+
+	for (uint32_t i = 0; i < ctx->n_ops; i++) {
+		uint64_t v = i;
+
+		cf_queue_push(q, &v);
+	}
+
+	for (uint32_t i = 0; i < ctx->n_ops; i++) {
+		uint64_t v;
+
+		if (cf_queue_pop(q, &v, CF_QUEUE_NOWAIT) == CF_QUEUE_OK) {
+			ctx->n_result += v;
+		}
+	}
+
+	cf_queue_destroy(q);
+}
+
+// One op is a fillbuf and a parse.
+static void
+bench_msg(bench_ctx* ctx)
+{
+	msg* m_out;
+	msg* m_in;
+
+	if (msg_create(&m_out, M_TYPE_UNUSED_6, BENCH_MT, sizeof(BENCH_MT), 0)
+			!= 0 || msg_create(&m_in, M_TYPE_UNUSED_6, BENCH_MT,
+					sizeof(BENCH_MT), 0) != 0) {
+		cf_crash(CF_MISC, "failed bench msg create");
+	}
+
+	uint8_t buf[1024];
+
+	for (uint32_t i = 0; i < ctx->n_ops; i++) {
+		msg_set_uint32(m_out, 0, i);
+		msg_set_uint64(m_out, 1, (uint64_t)i << 32);
+		msg_set_buf(m_out, 2, (const uint8_t*)&ctx->keyds[i],
+				sizeof(cf_digest), MSG_SET_COPY);
+		msg_set_str(m_out, 3, "benchmark", MSG_SET_COPY);
+
+		size_t buf_sz = sizeof(buf);
+
+		if (msg_fillbuf(m_out, buf, &buf_sz) != 0 ||
+				msg_parse(m_in, buf, buf_sz) != 0) {
+			cf_crash(CF_MISC, "bench msg fillbuf/parse failed");
+		}
+
+		uint32_t v;
+
+		msg_get_uint32(m_in, 0, &v);
+		ctx->n_result += v;
+		msg_reset(m_in);
+	}
+
+	msg_put(m_out);
+	msg_put(m_in);
+}
+
+// One op is appending a string and a number.
+static void
+bench_dynbuf(bench_ctx* ctx)
+{
+	cf_dyn_buf_define_size(db, 4 * 1024);
+
+	for (uint32_t i = 0; i < ctx->n_ops; i++) {
+		cf_dyn_buf_append_string(&db, "objects=");
+		cf_dyn_buf_append_uint64(&db, i);
+
+		// Keep it bounded, as info responses are.
+		if (db.used_sz > 64 * 1024) {
+			ctx->n_result += db.used_sz;
+			db.used_sz = 0;
+		}
+	}
+
+	cf_dyn_buf_free(&db);
+}
+
+static void
+bench_hist(bench_ctx* ctx)
+{
+	for (uint32_t i = 0; i < ctx->n_ops; i++) {
+		histogram_insert_raw(g_bench_hist, ((uint64_t*)&ctx->keyds[i])[0] >> 44);
+	}
+}
+
+static void
+bench_hist_sharded(bench_ctx* ctx)
+{
+	for (uint32_t i = 0; i < ctx->n_ops; i++) {
+		histogram_insert_raw(g_bench_sharded_hist,
+				((uint64_t*)&ctx->keyds[i])[0] >> 44);
+	}
+}
+
+static void
+bench_hdr_hist(bench_ctx* ctx)
+{
+	hdr_hist* h = hdr_hist_create(7);
+
+	cf_assert(h, CF_MISC, CF_CRITICAL, "failed bench hdr hist create");
+
+	for (uint32_t i = 0; i < ctx->n_ops; i++) {
+		hdr_hist_insert_raw(h, ((uint64_t*)&ctx->keyds[i])[0] >> 44);
+	}
+
+	hdr_hist_destroy(h);
+}
+
+
+//==========================================================
+// Local helpers - hashes.
+//
+// One op is a put, a get and a delete of a digest key with a pointer value,
+// as in the rw_request hash.
+//
+
+static uint32_t
+bench_shash_fn(void* key)
+{
+	return *(uint32_t*)key;
+}
+
+static uint32_t
+bench_ohash_fn(const void* key)
+{
+	return *(const uint32_t*)key;
+}
+
+static void
+bench_shash(bench_ctx* ctx)
+{
+	shash* h;
+
+	if (shash_create(&h, bench_shash_fn, sizeof(cf_digest), sizeof(void*),
+			BENCH_HASH_SLOTS, SHASH_CR_MT_MANYLOCK) != SHASH_OK) {
+		cf_crash(CF_MISC, "failed bench shash create");
+	}
+
+	for (uint32_t i = 0; i < ctx->n_ops; i++) {
+		void* v = &ctx->keyds[i];
+
+		shash_put(h, &ctx->keyds[i], &v);
+	}
+
+	for (uint32_t i = 0; i < ctx->n_ops; i++) {
+		void* v;
+
+		if (shash_get(h, &ctx->keyds[i], &v) == SHASH_OK) {
+			ctx->n_result += v == &ctx->keyds[i] ? 1 : 0;
+		}
+	}
+
+	for (uint32_t i = 0; i < ctx->n_ops; i++) {
+		shash_delete(h, &ctx->keyds[i]);
+	}
+
+	shash_destroy(h);
+}
+
+static void
+bench_ohash(bench_ctx* ctx)
+{
+	cf_ohash* h = cf_ohash_create(bench_ohash_fn, sizeof(cf_digest),
+			sizeof(void*), BENCH_HASH_SLOTS, 64);
+
+	cf_assert(h, CF_MISC, CF_CRITICAL, "failed bench ohash create");
+
+	for (uint32_t i = 0; i < ctx->n_ops; i++) {
+		void* v = &ctx->keyds[i];
+
+		cf_ohash_put(h, &ctx->keyds[i], &v);
+	}
+
+	for (uint32_t i = 0; i < ctx->n_ops; i++) {
+		void* v;
+
+		if (cf_ohash_get(h, &ctx->keyds[i], &v) == CF_OHASH_OK) {
+			ctx->n_result += v == &ctx->keyds[i] ? 1 : 0;
+		}
+	}
+
+	for (uint32_t i = 0; i < ctx->n_ops; i++) {
+		cf_ohash_delete(h, &ctx->keyds[i]);
+	}
+
+	cf_ohash_destroy(h);
+}
+
+
+//==========================================================
+// Local helpers - packed map and list.
+//
+// Ops go through the same entry points client CDT ops use, on a private bin
+// of up to BENCH_CDT_ELEMENTS elements. Lookups include the fill.
+//
+
+static uint8_t*
+bench_pack_uint64(uint8_t* p, uint64_t v)
+{
+	*p++ = 0xcf;
+	v = cf_swap_to_be64(v);
+	memcpy(p, &v, sizeof(v));
+	return p + sizeof(v);
+}
+
+// Lays out an op as demarshal leaves it - host-order size, no bin name - with
+// CDT op type then msgpack args.
+static as_msg_op*
+bench_cdt_op(uint8_t* buf, uint16_t cdt_op, const uint8_t* args,
+		uint32_t args_sz)
+{
+	as_msg_op* op = (as_msg_op*)buf;
+
+	op->op_sz = 4 + (uint32_t)sizeof(uint16_t) + args_sz;
+	op->op = AS_MSG_OP_CDT_MODIFY;
+	op->particle_type = AS_PARTICLE_TYPE_BLOB;
+	op->version = 0;
+	op->name_sz = 0;
+
+	uint16_t type_be = cf_swap_to_be16(cdt_op);
+	uint8_t* p = as_msg_op_get_value_p(op);
+
+	memcpy(p, &type_be, sizeof(type_be));
+	memcpy(p + sizeof(type_be), args, args_sz);
+
+	return op;
+}
+
+static void
+bench_bin_init(as_bin* b)
+{
+	memset(b, 0, sizeof(as_bin));
+	as_bin_set_empty(b);
+}
+
+static void
+bench_cdt_modify(as_bin* b, as_msg_op* op)
+{
+	as_bin result;
+
+	bench_bin_init(&result);
+
+	if (as_bin_cdt_alloc_modify_from_client(b, op, &result) != 0) {
+		cf_crash(CF_MISC, "bench cdt modify failed");
+	}
+
+	as_bin_particle_destroy(&result, true);
+}
+
+static void
+bench_cdt_read(bench_ctx* ctx, as_bin* b, as_msg_op* op)
+{
+	as_bin result;
+
+	bench_bin_init(&result);
+
+	if (as_bin_cdt_read_from_client(b, op, &result) != 0) {
+		cf_crash(CF_MISC, "bench cdt read failed");
+	}
+
+	ctx->n_result += as_bin_inuse(&result) ? 1 : 0;
+	as_bin_particle_destroy(&result, true);
+}
+
+static void
+bench_map_put_key(as_bin* b, uint64_t key, uint64_t value)
+{
+	uint8_t args[1 + 9 + 9];
+	uint8_t* p = args;
+	uint8_t buf[BENCH_CDT_OP_SZ];
+
+	*p++ = 0x92; // [key, value]
+	p = bench_pack_uint64(p, key);
+	p = bench_pack_uint64(p, value);
+
+	bench_cdt_modify(b, bench_cdt_op(buf, AS_CDT_OP_MAP_PUT, args,
+			(uint32_t)(p - args)));
+}
+
+static void
+bench_list_append_value(as_bin* b, uint64_t value)
+{
+	uint8_t args[1 + 9];
+	uint8_t* p = args;
+	uint8_t buf[BENCH_CDT_OP_SZ];
+
+	*p++ = 0x91; // [value]
+	p = bench_pack_uint64(p, value);
+
+	bench_cdt_modify(b, bench_cdt_op(buf, AS_CDT_OP_LIST_APPEND, args,
+			(uint32_t)(p - args)));
+}
+
+// One op is a put of one of BENCH_CDT_ELEMENTS keys - new until the map is
+// full, then an overwrite.
+static void
+bench_map_put(bench_ctx* ctx)
+{
+	as_bin b;
+
+	bench_bin_init(&b);
+
+	for (uint32_t i = 0; i < ctx->n_ops; i++) {
+		bench_map_put_key(&b, ((uint64_t*)&ctx->keyds[i])[0] %
+				BENCH_CDT_ELEMENTS, i);
+	}
+
+	as_bin_particle_destroy(&b, true);
+}
+
+static void
+bench_map_get(bench_ctx* ctx)
+{
+	as_bin b;
+
+	bench_bin_init(&b);
+
+	for (uint32_t i = 0; i < BENCH_CDT_ELEMENTS; i++) {
+		bench_map_put_key(&b, i, i);
+	}
+
+	uint8_t args[1 + 1 + 9];
+	uint8_t buf[BENCH_CDT_OP_SZ];
+
+	for (uint32_t i = 0; i < ctx->n_ops; i++) {
+		uint8_t* p = args;
+
+		*p++ = 0x92; // [result type, key]
+		*p++ = RESULT_TYPE_VALUE;
+		p = bench_pack_uint64(p, ((uint64_t*)&ctx->keyds[i])[0] %
+				BENCH_CDT_ELEMENTS);
+
+		bench_cdt_read(ctx, &b, bench_cdt_op(buf, AS_CDT_OP_MAP_GET_BY_KEY,
+				args, (uint32_t)(p - args)));
+	}
+
+	as_bin_particle_destroy(&b, true);
+}
+
+// Starts a new list every BENCH_CDT_ELEMENTS appends.
+static void
+bench_list_append(bench_ctx* ctx)
+{
+	as_bin b;
+
+	bench_bin_init(&b);
+
+	for (uint32_t i = 0; i < ctx->n_ops; i++) {
+		if (i % BENCH_CDT_ELEMENTS == 0) {
+			as_bin_particle_destroy(&b, true);
+			bench_bin_init(&b);
+		}
+
+		bench_list_append_value(&b, ((uint64_t*)&ctx->keyds[i])[0]);
+	}
+
+	as_bin_particle_destroy(&b, true);
+}
+
+static void
+bench_list_get(bench_ctx* ctx)
+{
+	as_bin b;
+
+	bench_bin_init(&b);
+
+	for (uint32_t i = 0; i < BENCH_CDT_ELEMENTS; i++) {
+		bench_list_append_value(&b, i);
+	}
+
+	uint8_t args[1 + 9];
+	uint8_t buf[BENCH_CDT_OP_SZ];
+
+	for (uint32_t i = 0; i < ctx->n_ops; i++) {
+		uint8_t* p = args;
+
+		*p++ = 0x91; // [index]
+		p = bench_pack_uint64(p, ((uint64_t*)&ctx->keyds[i])[0] %
+				BENCH_CDT_ELEMENTS);
+
+		bench_cdt_read(ctx, &b, bench_cdt_op(buf, AS_CDT_OP_LIST_GET, args,
+				(uint32_t)(p - args)));
+	}
+
+	as_bin_particle_destroy(&b, true);
+}
+
+
+//==========================================================
+// Local helpers - sindex btrees.
+//
+// The two btree shapes a secondary index is built from - integer bin values
+// to digest trees, and the digest trees themselves. One op is an add, a find
+// and a delete, so the trees are empty when destroyed.
+//
+
+static void
+bench_ai_btree_long(bench_ctx* ctx)
+{
+	// Any imatch - it's only used by trees of type BT_SIMP_UNIQ.
+	bt* ibtr = createIndexBT(COL_TYPE_LONG, 0);
+
+	cf_assert(ibtr, CF_MISC, CF_CRITICAL, "failed bench ai btree create");
+
+	ai_obj key;
+
+	// The values stand in for digest trees - never dereferenced.
+	for (uint32_t i = 0; i < ctx->n_ops; i++) {
+		init_ai_objLong(&key, ((uint64_t*)&ctx->keyds[i])[0] >> 1);
+		btIndAdd(ibtr, &key, (bt*)&ctx->keyds[i]);
+	}
+
+	for (uint32_t i = 0; i < ctx->n_ops; i++) {
+		init_ai_objLong(&key, ((uint64_t*)&ctx->keyds[i])[0] >> 1);
+		ctx->n_result += btIndFind(ibtr, &key) ? 1 : 0;
+	}
+
+	for (uint32_t i = 0; i < ctx->n_ops; i++) {
+		init_ai_objLong(&key, ((uint64_t*)&ctx->keyds[i])[0] >> 1);
+		btIndDelete(ibtr, &key);
+	}
+
+	bt_destroy(ibtr);
+}
+
+static void
+bench_ai_btree_digest(bench_ctx* ctx)
+{
+	bt* nbtr = createIndexNode(COL_TYPE_U160, COL_TYPE_NONE);
+
+	cf_assert(nbtr, CF_MISC, CF_CRITICAL, "failed bench ai btree create");
+
+	ai_obj apk;
+
+	for (uint32_t i = 0; i < ctx->n_ops; i++) {
+		init_ai_objU160(&apk, *(uint160*)&ctx->keyds[i]);
+		btIndNodeAdd(nbtr, &apk);
+	}
+
+	for (uint32_t i = 0; i < ctx->n_ops; i++) {
+		init_ai_objU160(&apk, *(uint160*)&ctx->keyds[i]);
+		ctx->n_result += btIndNodeExist(nbtr, &apk) ? 1 : 0;
+	}
+
+	for (uint32_t i = 0; i < ctx->n_ops; i++) {
+		init_ai_objU160(&apk, *(uint160*)&ctx->keyds[i]);
+		btIndNodeDelete(nbtr, &apk, NULL);
+	}
+
+	bt_destroy(nbtr);
+}
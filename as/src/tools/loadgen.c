@@ -0,0 +1,956 @@
+/*
+ * loadgen.c
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/* SYNOPSIS
+ * asloadgen - load generator speaking the client wire protocol, built by
+ * "make loadgen" as its own binary. Nothing here is linked into asd.
+ *
+ * Each connection runs one request at a time - reads, writes, deletes,
+ * increments, map puts and batch reads in a weighted mix over a fixed key
+ * range - over TCP to any node. Requests are laid out with the server's own
+ * proto.h definitions.
+ *
+ * Keys are integers hashed the way clients hash them, so the records written
+ * are the ones a client would write for the same set and keys. The report
+ * gives throughput, errors and latency percentiles per op type.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "citrusleaf/alloc.h"
+#include "citrusleaf/cf_atomic.h"
+#include "citrusleaf/cf_byte_order.h"
+#include "citrusleaf/cf_clock.h"
+#include "citrusleaf/cf_digest.h"
+
+#include "cf_str.h"
+#include "fault.h"
+#include "hdr_hist.h"
+#include "socket.h"
+
+#include "base/datamodel.h"
+#include "base/proto.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+typedef enum {
+	LG_READ,
+	LG_WRITE,
+	LG_DELETE,
+	LG_INCR,
+	LG_MAP_PUT,
+	LG_BATCH,
+
+	LG_N_OPS
+} lg_op;
+
+#define LG_MAX_CONNECTIONS		256
+#define LG_MAX_BATCH_SIZE		5000
+#define LG_MAX_BIN_SIZE			(128 * 1024)
+
+#define LG_HIST_PRECISION		5
+#define LG_CONNECT_TIMEOUT_MS	1000
+#define LG_RECV_TIMEOUT_SEC		10
+#define LG_MAX_RESPONSE_SZ		(128 * 1024 * 1024)
+#define LG_MAP_KEYS				16 // map keys used per record - fixints
+
+#define LG_INT_BIN				"lg-int"
+#define LG_BLOB_BIN				"lg-blob"
+#define LG_MAP_BIN				"lg-map"
+
+typedef struct lg_cfg_s {
+	char		ns_name[AS_ID_NAMESPACE_SZ];
+	char		set_name[AS_SET_NAME_MAX_SIZE];
+	char		host[64];
+	uint16_t	port;
+
+	uint32_t	n_connections;
+	uint32_t	duration_sec;
+	uint64_t	n_keys;
+	uint32_t	batch_size;
+	uint32_t	bin_size;
+	uint32_t	mix[LG_N_OPS]; // weights, in percent
+} lg_cfg;
+
+typedef struct lg_worker_s {
+	uint32_t	id;
+	uint64_t	rand_state;
+	cf_socket*	sock;
+	uint8_t*	req;
+	size_t		req_capacity;
+	uint8_t*	resp;
+	size_t		resp_capacity;
+	uint8_t*	blob;
+} lg_worker;
+
+static const char* OP_NAMES[LG_N_OPS] = {
+		[LG_READ] = "read",
+		[LG_WRITE] = "write",
+		[LG_DELETE] = "delete",
+		[LG_INCR] = "incr",
+		[LG_MAP_PUT] = "map-put",
+		[LG_BATCH] = "batch"
+};
+
+static const struct option CMD_OPTS[] = {
+		{ "help", no_argument, 0, 'h' },
+		{ "host", required_argument, 0, 'H' },
+		{ "port", required_argument, 0, 'p' },
+		{ "namespace", required_argument, 0, 'n' },
+		{ "set", required_argument, 0, 's' },
+		{ "connections", required_argument, 0, 'c' },
+		{ "duration", required_argument, 0, 'd' },
+		{ "keys", required_argument, 0, 'k' },
+		{ "mix", required_argument, 0, 'm' },
+		{ "batch-size", required_argument, 0, 'b' },
+		{ "bin-size", required_argument, 0, 'z' },
+		{ 0, 0, 0, 0 }
+};
+
+static const char USAGE[] =
+		"\n"
+		"asloadgen --namespace <NS> [--host <HOST>] [--port <PORT>] [--set <SET>]\n"
+		"          [--connections <N>] [--duration <SEC>] [--keys <N>]\n"
+		"          [--mix <OP>:<WEIGHT>,...] [--batch-size <N>] [--bin-size <BYTES>]\n"
+		"\n"
+		"Ops are read, write, delete, incr, map-put and batch - the default mix is\n"
+		"read:80,write:20. Runs until the duration is up, or until interrupted.\n"
+		;
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static const char* parse_mix(const char* str, uint32_t mix[]);
+static const char* check_cfg(const lg_cfg* cfg);
+static void handle_stop(int sig_num);
+static void* run_worker(void* udata);
+static bool conn_open(lg_worker* w);
+static void conn_close(lg_worker* w);
+static bool send_all(cf_socket* sock, const uint8_t* buf, size_t sz);
+static bool recv_all(cf_socket* sock, void* buf, size_t sz);
+static bool recv_response(lg_worker* w, lg_op op, uint8_t* result_code);
+static size_t build_request(lg_worker* w, lg_op op);
+static lg_op pick_op(lg_worker* w);
+static uint64_t lg_rand(lg_worker* w);
+static void print_report(uint64_t elapsed_ns);
+
+
+//==========================================================
+// Globals.
+//
+
+static struct {
+	// Set up before the workers start, read-only while running.
+	lg_cfg				cfg;
+	uint32_t			mix_total;
+	uint64_t			deadline_ns;
+
+	volatile sig_atomic_t	stop;
+
+	cf_atomic64			n_ops[LG_N_OPS];
+	cf_atomic64			n_not_found[LG_N_OPS];
+	cf_atomic64			n_errors[LG_N_OPS];
+	cf_atomic64			n_conn_errors;
+	hdr_hist*			hists[LG_N_OPS];
+} g_lg;
+
+
+//==========================================================
+// Public API.
+//
+
+int
+main(int argc, char** argv)
+{
+	lg_cfg* cfg = &g_lg.cfg;
+
+	*cfg = (lg_cfg){
+			.host = "127.0.0.1",
+			.port = 3000,
+			.n_connections = 16,
+			.duration_sec = 60,
+			.n_keys = 100000,
+			.batch_size = 100,
+			.bin_size = 100,
+			.mix = { [LG_READ] = 80, [LG_WRITE] = 20 }
+	};
+
+	int opt;
+	int opt_ix;
+	uint32_t value;
+	const char* err = NULL;
+
+	while (! err &&
+			(opt = getopt_long(argc, argv, "", CMD_OPTS, &opt_ix)) != -1) {
+		switch (opt) {
+		case 'h':
+			// printf() since we want stdout and don't want cf_fault's prefix.
+			printf("%s\n", USAGE);
+			return 0;
+		case 'H':
+			if (strlen(optarg) >= sizeof(cfg->host)) {
+				err = "bad host";
+			}
+			else {
+				strcpy(cfg->host, optarg);
+			}
+			break;
+		case 'p':
+			if (cf_str_atoi_u32(optarg, &value) != 0 || value == 0 ||
+					value > 0xFFFF) {
+				err = "bad port";
+			}
+			else {
+				cfg->port = (uint16_t)value;
+			}
+			break;
+		case 'n':
+			if (strlen(optarg) >= sizeof(cfg->ns_name)) {
+				err = "bad namespace";
+			}
+			else {
+				strcpy(cfg->ns_name, optarg);
+			}
+			break;
+		case 's':
+			if (optarg[0] == '\0' || strlen(optarg) >= sizeof(cfg->set_name)) {
+				err = "bad set";
+			}
+			else {
+				strcpy(cfg->set_name, optarg);
+			}
+			break;
+		case 'c':
+			if (cf_str_atoi_u32(optarg, &cfg->n_connections) != 0) {
+				err = "bad connections";
+			}
+			break;
+		case 'd':
+			if (cf_str_atoi_u32(optarg, &cfg->duration_sec) != 0) {
+				err = "bad duration";
+			}
+			break;
+		case 'k':
+			if (cf_str_atoi_u64(optarg, &cfg->n_keys) != 0) {
+				err = "bad keys";
+			}
+			break;
+		case 'm':
+			err = parse_mix(optarg, cfg->mix);
+			break;
+		case 'b':
+			if (cf_str_atoi_u32(optarg, &cfg->batch_size) != 0) {
+				err = "bad batch size";
+			}
+			break;
+		case 'z':
+			if (cf_str_atoi_u32(optarg, &cfg->bin_size) != 0) {
+				err = "bad bin size";
+			}
+			break;
+		default:
+			// fprintf() since we don't want cf_fault's prefix.
+			fprintf(stderr, "%s\n", USAGE);
+			return 1;
+		}
+	}
+
+	if (! err) {
+		err = check_cfg(cfg);
+	}
+
+	if (err) {
+		fprintf(stderr, "asloadgen: %s\n%s\n", err, USAGE);
+		return 1;
+	}
+
+	for (int op = 0; op < LG_N_OPS; op++) {
+		g_lg.mix_total += cfg->mix[op];
+		g_lg.hists[op] = hdr_hist_create(LG_HIST_PRECISION);
+	}
+
+	// A lost connection shows up as a failed send, not a signal.
+	signal(SIGPIPE, SIG_IGN);
+	signal(SIGINT, handle_stop);
+	signal(SIGTERM, handle_stop);
+
+	uint64_t start_ns = cf_getns();
+
+	g_lg.deadline_ns = start_ns + (uint64_t)cfg->duration_sec * 1000000000;
+
+	pthread_t threads[LG_MAX_CONNECTIONS];
+	lg_worker* workers = cf_malloc(sizeof(lg_worker) * cfg->n_connections);
+	uint32_t n_workers = 0;
+
+	if (! workers) {
+		fprintf(stderr, "asloadgen: out of memory\n");
+		return 1;
+	}
+
+	memset(workers, 0, sizeof(lg_worker) * cfg->n_connections);
+
+	for (uint32_t i = 0; i < cfg->n_connections; i++) {
+		workers[i].id = i;
+
+		if (pthread_create(&threads[n_workers], NULL, run_worker,
+				&workers[i]) != 0) {
+			fprintf(stderr, "asloadgen: started only %u of %u connections\n",
+					n_workers, cfg->n_connections);
+			break;
+		}
+
+		n_workers++;
+	}
+
+	for (uint32_t i = 0; i < n_workers; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	cf_free(workers);
+
+	print_report(cf_getns() - start_ns);
+
+	return 0;
+}
+
+
+//==========================================================
+// Local helpers - options.
+//
+
+// Parses a mix like "read:80,write:20" - ops not named get weight 0. Returns
+// null on success, otherwise the reason for failure.
+static const char*
+parse_mix(const char* str, uint32_t mix[])
+{
+	char buf[256];
+
+	if (strlen(str) >= sizeof(buf)) {
+		return "bad mix";
+	}
+
+	strcpy(buf, str);
+	memset(mix, 0, sizeof(uint32_t) * LG_N_OPS);
+
+	char* save = NULL;
+
+	for (char* tok = strtok_r(buf, ",", &save); tok;
+			tok = strtok_r(NULL, ",", &save)) {
+		char* colon = strchr(tok, ':');
+
+		if (! colon) {
+			return "bad mix";
+		}
+
+		*colon = '\0';
+
+		int op;
+
+		for (op = 0; op < LG_N_OPS; op++) {
+			if (strcmp(tok, OP_NAMES[op]) == 0) {
+				break;
+			}
+		}
+
+		if (op == LG_N_OPS) {
+			return "unknown op in mix";
+		}
+
+		if (cf_str_atoi_u32(colon + 1, &mix[op]) != 0 || mix[op] > 100) {
+			return "bad mix";
+		}
+	}
+
+	return NULL;
+}
+
+// Returns null if the config is usable, otherwise the reason it isn't.
+static const char*
+check_cfg(const lg_cfg* cfg)
+{
+	uint32_t mix_total = 0;
+
+	for (int op = 0; op < LG_N_OPS; op++) {
+		mix_total += cfg->mix[op];
+	}
+
+	if (mix_total == 0) {
+		return "bad mix";
+	}
+
+	if (cfg->ns_name[0] == '\0') {
+		return "no namespace";
+	}
+
+	if (cfg->host[0] == '\0') {
+		return "bad host";
+	}
+
+	if (cfg->n_connections == 0 || cfg->n_connections > LG_MAX_CONNECTIONS) {
+		return "bad connections";
+	}
+
+	if (cfg->n_keys == 0) {
+		return "bad keys";
+	}
+
+	if (cfg->batch_size == 0 || cfg->batch_size > LG_MAX_BATCH_SIZE) {
+		return "bad batch size";
+	}
+
+	if (cfg->bin_size > LG_MAX_BIN_SIZE) {
+		return "bad bin size";
+	}
+
+	if (cfg->duration_sec == 0) {
+		return "bad duration";
+	}
+
+	return NULL;
+}
+
+static void
+handle_stop(int sig_num)
+{
+	g_lg.stop = 1;
+}
+
+
+//==========================================================
+// Local helpers - threads.
+//
+
+static void*
+run_worker(void* udata)
+{
+	lg_worker* w = (lg_worker*)udata;
+	const lg_cfg* cfg = &g_lg.cfg;
+
+	w->rand_state = ((uint64_t)w->id + 1) * 0x9e3779b97f4a7c15UL;
+
+	// Room for the biggest request - a full batch, or a write with its blob.
+	w->req_capacity = 1024 + cfg->bin_size +
+			(size_t)cfg->batch_size * (4 + CF_DIGEST_KEY_SZ + 1 + 5 + 5 +
+					AS_ID_NAMESPACE_SZ);
+	w->req = cf_malloc(w->req_capacity);
+	w->resp_capacity = 64 * 1024;
+	w->resp = cf_malloc(w->resp_capacity);
+	w->blob = cf_malloc(cfg->bin_size == 0 ? 1 : cfg->bin_size);
+
+	if (! w->req || ! w->resp || ! w->blob) {
+		cf_warning(CF_MISC, "loadgen connection %u out of memory", w->id);
+		goto Cleanup;
+	}
+
+	for (uint32_t i = 0; i < cfg->bin_size; i++) {
+		w->blob[i] = (uint8_t)lg_rand(w);
+	}
+
+	while (! g_lg.stop && cf_getns() < g_lg.deadline_ns) {
+		if (! w->sock && ! conn_open(w)) {
+			cf_atomic64_incr(&g_lg.n_conn_errors);
+
+			struct timespec ts = { .tv_sec = 0, .tv_nsec = 100 * 1000 * 1000 };
+
+			nanosleep(&ts, NULL);
+			continue;
+		}
+
+		lg_op op = pick_op(w);
+		size_t sz = build_request(w, op);
+		uint64_t start_ns = cf_getns();
+		uint8_t result_code;
+
+		if (! send_all(w->sock, w->req, sz) ||
+				! recv_response(w, op, &result_code)) {
+			conn_close(w);
+			cf_atomic64_incr(&g_lg.n_conn_errors);
+			continue;
+		}
+
+		hdr_hist_insert_data_point(g_lg.hists[op], start_ns);
+		cf_atomic64_incr(&g_lg.n_ops[op]);
+
+		if (result_code == AS_PROTO_RESULT_FAIL_NOTFOUND) {
+			cf_atomic64_incr(&g_lg.n_not_found[op]);
+		}
+		else if (result_code != AS_PROTO_RESULT_OK) {
+			cf_atomic64_incr(&g_lg.n_errors[op]);
+		}
+	}
+
+	conn_close(w);
+
+Cleanup:
+	if (w->req) {
+		cf_free(w->req);
+	}
+
+	if (w->resp) {
+		cf_free(w->resp);
+	}
+
+	if (w->blob) {
+		cf_free(w->blob);
+	}
+
+	return NULL;
+}
+
+
+//==========================================================
+// Local helpers - connections.
+//
+
+static bool
+conn_open(lg_worker* w)
+{
+	cf_socket_cfg sock_cfg = {
+			.addr = g_lg.cfg.host,
+			.port = g_lg.cfg.port,
+			.type = SOCK_STREAM
+	};
+
+	if (cf_socket_init_client(&sock_cfg, LG_CONNECT_TIMEOUT_MS) != 0) {
+		return false;
+	}
+
+	// Don't hang forever on a lost reply.
+	struct timeval tv = { .tv_sec = LG_RECV_TIMEOUT_SEC, .tv_usec = 0 };
+
+	setsockopt(sock_cfg.sock->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	w->sock = sock_cfg.sock;
+
+	return true;
+}
+
+static void
+conn_close(lg_worker* w)
+{
+	if (w->sock) {
+		cf_socket_close(w->sock);
+		w->sock = NULL;
+	}
+}
+
+static bool
+send_all(cf_socket* sock, const uint8_t* buf, size_t sz)
+{
+	size_t off = 0;
+
+	while (off < sz) {
+		int32_t rv = cf_socket_send(sock, (void*)(buf + off), sz - off, 0);
+
+		if (rv <= 0) {
+			return false;
+		}
+
+		off += (size_t)rv;
+	}
+
+	return true;
+}
+
+static bool
+recv_all(cf_socket* sock, void* buf, size_t sz)
+{
+	uint8_t* p = (uint8_t*)buf;
+	size_t off = 0;
+
+	while (off < sz) {
+		int32_t rv = cf_socket_recv(sock, p + off, sz - off, 0);
+
+		if (rv <= 0) {
+			return false;
+		}
+
+		off += (size_t)rv;
+	}
+
+	return true;
+}
+
+// Reads one reply - for batches, messages up to the one flagged last.
+static bool
+recv_response(lg_worker* w, lg_op op, uint8_t* result_code)
+{
+	while (true) {
+		uint64_t proto_be;
+
+		if (! recv_all(w->sock, &proto_be, sizeof(proto_be))) {
+			return false;
+		}
+
+		uint64_t proto = cf_swap_from_be64(proto_be);
+		uint64_t sz = proto & 0xFFFFffffFFFF;
+
+		if ((proto >> 56) != PROTO_VERSION || sz < sizeof(as_msg) ||
+				sz > LG_MAX_RESPONSE_SZ) {
+			return false;
+		}
+
+		if (sz > w->resp_capacity) {
+			uint8_t* resp = cf_realloc(w->resp, sz);
+
+			if (! resp) {
+				return false;
+			}
+
+			w->resp = resp;
+			w->resp_capacity = sz;
+		}
+
+		if (! recv_all(w->sock, w->resp, sz)) {
+			return false;
+		}
+
+		if (op != LG_BATCH) {
+			*result_code = ((as_msg*)w->resp)->result_code;
+			return true;
+		}
+
+		// Walk the messages - fields and ops are size-prefixed.
+		uint64_t off = 0;
+
+		while (off + sizeof(as_msg) <= sz) {
+			as_msg* m = (as_msg*)(w->resp + off);
+			uint32_t n_fields = cf_swap_from_be16(m->n_fields);
+			uint32_t n_ops = cf_swap_from_be16(m->n_ops);
+
+			if (m->info3 & AS_MSG_INFO3_LAST) {
+				*result_code = m->result_code;
+				return true;
+			}
+
+			off += sizeof(as_msg);
+
+			for (uint32_t i = 0; i < n_fields + n_ops; i++) {
+				uint32_t item_sz_be;
+
+				if (off + sizeof(item_sz_be) > sz) {
+					return false;
+				}
+
+				memcpy(&item_sz_be, w->resp + off, sizeof(item_sz_be));
+				off += sizeof(item_sz_be) + cf_swap_from_be32(item_sz_be);
+			}
+		}
+	}
+}
+
+
+//==========================================================
+// Local helpers - requests.
+//
+
+static inline uint8_t*
+put_be16(uint8_t* p, uint16_t v)
+{
+	v = cf_swap_to_be16(v);
+	memcpy(p, &v, sizeof(v));
+	return p + sizeof(v);
+}
+
+static inline uint8_t*
+put_be32(uint8_t* p, uint32_t v)
+{
+	v = cf_swap_to_be32(v);
+	memcpy(p, &v, sizeof(v));
+	return p + sizeof(v);
+}
+
+static inline uint8_t*
+put_be64(uint8_t* p, uint64_t v)
+{
+	v = cf_swap_to_be64(v);
+	memcpy(p, &v, sizeof(v));
+	return p + sizeof(v);
+}
+
+static uint8_t*
+put_msg_header(uint8_t* p, uint8_t info1, uint8_t info2, uint8_t info3,
+		uint16_t n_fields, uint16_t n_ops)
+{
+	*p++ = (uint8_t)sizeof(as_msg);
+	*p++ = info1;
+	*p++ = info2;
+	*p++ = info3;
+	*p++ = 0; // unused
+	*p++ = 0; // result code
+	p = put_be32(p, 0); // generation
+	p = put_be32(p, 0); // record ttl - namespace default
+	p = put_be32(p, 0); // transaction ttl - server default
+	p = put_be16(p, n_fields);
+	return put_be16(p, n_ops);
+}
+
+static uint8_t*
+put_field(uint8_t* p, uint8_t type, const void* data, uint32_t sz)
+{
+	p = put_be32(p, sz + 1);
+	*p++ = type;
+	memcpy(p, data, sz);
+	return p + sz;
+}
+
+static uint8_t*
+put_op(uint8_t* p, uint8_t op, uint8_t particle_type, const char* name,
+		const void* value, uint32_t value_sz)
+{
+	uint8_t name_sz = (uint8_t)strlen(name);
+
+	p = put_be32(p, 4 + name_sz + value_sz);
+	*p++ = op;
+	*p++ = particle_type;
+	*p++ = 0; // version
+	*p++ = name_sz;
+	memcpy(p, name, name_sz);
+	p += name_sz;
+	memcpy(p, value, value_sz);
+	return p + value_sz;
+}
+
+// Hash an integer key the way clients do - set name, then particle type and
+// big-endian value.
+static void
+key_digest(uint64_t key, cf_digest* keyd)
+{
+	const lg_cfg* cfg = &g_lg.cfg;
+	uint8_t key_buf[1 + sizeof(uint64_t)];
+
+	key_buf[0] = AS_PARTICLE_TYPE_INTEGER;
+	put_be64(key_buf + 1, key);
+
+	cf_digest_compute2((void*)cfg->set_name, strlen(cfg->set_name), key_buf,
+			sizeof(key_buf), keyd);
+}
+
+// Writes a wire-format request into the worker's buffer. Returns its size.
+static size_t
+build_request(lg_worker* w, lg_op op)
+{
+	const lg_cfg* cfg = &g_lg.cfg;
+	uint32_t ns_len = (uint32_t)strlen(cfg->ns_name);
+	uint32_t set_len = (uint32_t)strlen(cfg->set_name);
+	uint8_t* p = w->req + sizeof(as_proto);
+	cf_digest keyd;
+
+	if (op == LG_BATCH) {
+		uint32_t n_keys = cfg->batch_size;
+
+		p = put_msg_header(p, AS_MSG_INFO1_READ | AS_MSG_INFO1_BATCH, 0, 0, 1,
+				0);
+
+		uint8_t* field = p;
+
+		p += sizeof(uint32_t); // field size, filled in below
+		*p++ = AS_MSG_FIELD_TYPE_BATCH;
+		p = put_be32(p, n_keys);
+		*p++ = 1; // allow inline
+
+		for (uint32_t i = 0; i < n_keys; i++) {
+			key_digest(lg_rand(w) % cfg->n_keys, &keyd);
+
+			p = put_be32(p, i);
+			memcpy(p, &keyd, CF_DIGEST_KEY_SZ);
+			p += CF_DIGEST_KEY_SZ;
+
+			// Every row after the first repeats its namespace and flags.
+			if (i != 0) {
+				*p++ = 1;
+				continue;
+			}
+
+			*p++ = 0;
+			*p++ = AS_MSG_INFO1_READ | AS_MSG_INFO1_GET_ALL;
+			p = put_be16(p, 1);
+			p = put_be16(p, 0);
+			p = put_field(p, AS_MSG_FIELD_TYPE_NAMESPACE, cfg->ns_name, ns_len);
+		}
+
+		put_be32(field, (uint32_t)(p - field - sizeof(uint32_t)));
+	}
+	else {
+		uint8_t info1 = 0;
+		uint8_t info2 = 0;
+		uint16_t n_ops = 0;
+
+		switch (op) {
+		case LG_READ:
+			info1 = AS_MSG_INFO1_READ | AS_MSG_INFO1_GET_ALL;
+			break;
+		case LG_WRITE:
+			info2 = AS_MSG_INFO2_WRITE;
+			n_ops = cfg->bin_size == 0 ? 1 : 2;
+			break;
+		case LG_DELETE:
+			info2 = AS_MSG_INFO2_WRITE | AS_MSG_INFO2_DELETE;
+			break;
+		default: // incr and map put
+			info2 = AS_MSG_INFO2_WRITE;
+			n_ops = 1;
+			break;
+		}
+
+		p = put_msg_header(p, info1, info2, 0, set_len == 0 ? 2 : 3, n_ops);
+		p = put_field(p, AS_MSG_FIELD_TYPE_NAMESPACE, cfg->ns_name, ns_len);
+
+		if (set_len != 0) {
+			p = put_field(p, AS_MSG_FIELD_TYPE_SET, cfg->set_name, set_len);
+		}
+
+		key_digest(lg_rand(w) % cfg->n_keys, &keyd);
+		p = put_field(p, AS_MSG_FIELD_TYPE_DIGEST_RIPE, &keyd,
+				CF_DIGEST_KEY_SZ);
+
+		uint8_t value[32];
+
+		switch (op) {
+		case LG_WRITE:
+			put_be64(value, lg_rand(w));
+			p = put_op(p, AS_MSG_OP_WRITE, AS_PARTICLE_TYPE_INTEGER, LG_INT_BIN,
+					value, sizeof(uint64_t));
+
+			if (cfg->bin_size != 0) {
+				p = put_op(p, AS_MSG_OP_WRITE, AS_PARTICLE_TYPE_BLOB,
+						LG_BLOB_BIN, w->blob, cfg->bin_size);
+			}
+			break;
+		case LG_INCR:
+			put_be64(value, 1);
+			p = put_op(p, AS_MSG_OP_INCR, AS_PARTICLE_TYPE_INTEGER, LG_INT_BIN,
+					value, sizeof(uint64_t));
+			break;
+		case LG_MAP_PUT: {
+			// CDT op type, then msgpack args [key, value] - fixint key and
+			// uint64 value.
+			uint8_t* v = put_be16(value, AS_CDT_OP_MAP_PUT);
+
+			*v++ = 0x92;
+			*v++ = (uint8_t)(lg_rand(w) % LG_MAP_KEYS);
+			*v++ = 0xcf;
+			v = put_be64(v, lg_rand(w));
+
+			p = put_op(p, AS_MSG_OP_CDT_MODIFY, AS_PARTICLE_TYPE_BLOB,
+					LG_MAP_BIN, value, (uint32_t)(v - value));
+			break;
+		}
+		default:
+			break;
+		}
+	}
+
+	size_t sz = (size_t)(p - w->req);
+
+	put_be64(w->req, ((uint64_t)PROTO_VERSION << 56) |
+			((uint64_t)PROTO_TYPE_AS_MSG << 48) | (sz - sizeof(as_proto)));
+
+	return sz;
+}
+
+static lg_op
+pick_op(lg_worker* w)
+{
+	uint32_t r = (uint32_t)(lg_rand(w) % g_lg.mix_total);
+
+	for (int op = 0; op < LG_N_OPS; op++) {
+		if (r < g_lg.cfg.mix[op]) {
+			return (lg_op)op;
+		}
+
+		r -= g_lg.cfg.mix[op];
+	}
+
+	return LG_READ; // can't get here
+}
+
+// splitmix64 - per worker, seeded by connection, so runs are reproducible.
+static uint64_t
+lg_rand(lg_worker* w)
+{
+	uint64_t z = (w->rand_state += 0x9e3779b97f4a7c15UL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9UL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebUL;
+
+	return z ^ (z >> 31);
+}
+
+
+//==========================================================
+// Local helpers - reporting.
+//
+
+static void
+print_report(uint64_t elapsed_ns)
+{
+	const lg_cfg* cfg = &g_lg.cfg;
+	uint64_t elapsed_ms = elapsed_ns / 1000000;
+
+	printf("host %s:%u ns %s set %s - %u connections, %lu keys, %lu ms, %lu connection errors\n",
+			cfg->host, cfg->port, cfg->ns_name, cfg->set_name,
+			cfg->n_connections, cfg->n_keys, elapsed_ms,
+			cf_atomic64_get(g_lg.n_conn_errors));
+
+	printf("%-8s %10s %8s %10s %8s %8s %8s %8s %8s %8s\n", "op", "count",
+			"tps", "not-found", "errors", "p50-us", "p90-us", "p99-us",
+			"p99.9-us", "max-us");
+
+	for (int op = 0; op < LG_N_OPS; op++) {
+		if (cfg->mix[op] == 0) {
+			continue;
+		}
+
+		uint64_t n_ops = cf_atomic64_get(g_lg.n_ops[op]);
+		hdr_hist_percentiles p;
+
+		hdr_hist_take_percentiles(g_lg.hists[op], &p);
+
+		printf("%-8s %10lu %8lu %10lu %8lu %8lu %8lu %8lu %8lu %8lu\n",
+				OP_NAMES[op], n_ops,
+				elapsed_ms == 0 ? 0 : n_ops * 1000 / elapsed_ms,
+				cf_atomic64_get(g_lg.n_not_found[op]),
+				cf_atomic64_get(g_lg.n_errors[op]),
+				p.p50, p.p90, p.p99, p.p999, p.max);
+	}
+}
@@ -38,17 +38,21 @@
 #include "dynbuf.h"
 #include "fault.h"
 
+#include "base/batch.h"
 #include "base/cfg.h"
 #include "base/datamodel.h"
 #include "base/index.h"
 #include "base/proto.h"
 #include "base/secondary_index.h"
+#include "base/slow_txn.h"
 #include "base/transaction.h"
 #include "base/transaction_policy.h"
 #include "base/xdr_serverside.h"
 #include "storage/storage.h"
 #include "transaction/duplicate_resolve.h"
 #include "transaction/proxy.h"
+#include "transaction/read_coalesce.h"
+#include "transaction/repl_log.h"
 #include "transaction/replica_write.h"
 #include "transaction/rw_request.h"
 #include "transaction/rw_request_hash.h"
@@ -75,16 +79,35 @@ client_delete_update_stats(as_namespace* ns, uint8_t result_code)
 {
 	switch (result_code) {
 	case AS_PROTO_RESULT_OK:
-		cf_atomic64_incr(&ns->n_client_delete_success);
+		cf_shard_counter_incr(&ns->n_client_delete_success);
 		break;
 	case AS_PROTO_RESULT_FAIL_TIMEOUT:
-		cf_atomic64_incr(&ns->n_client_delete_timeout);
+		cf_shard_counter_incr(&ns->n_client_delete_timeout);
 		break;
 	default:
-		cf_atomic64_incr(&ns->n_client_delete_error);
+		cf_shard_counter_incr(&ns->n_client_delete_error);
 		break;
 	case AS_PROTO_RESULT_FAIL_NOTFOUND:
-		cf_atomic64_incr(&ns->n_client_delete_not_found);
+		cf_shard_counter_incr(&ns->n_client_delete_not_found);
+		break;
+	}
+}
+
+static inline void
+batch_sub_delete_update_stats(as_namespace* ns, uint8_t result_code)
+{
+	switch (result_code) {
+	case AS_PROTO_RESULT_OK:
+		cf_atomic64_incr(&ns->n_batch_sub_delete_success);
+		break;
+	case AS_PROTO_RESULT_FAIL_TIMEOUT:
+		cf_atomic64_incr(&ns->n_batch_sub_delete_timeout);
+		break;
+	default:
+		cf_atomic64_incr(&ns->n_batch_sub_delete_error);
+		break;
+	case AS_PROTO_RESULT_FAIL_NOTFOUND:
+		cf_atomic64_incr(&ns->n_batch_sub_delete_not_found);
 		break;
 	}
 }
@@ -104,6 +127,13 @@ as_delete_start(as_transaction* tr)
 		return TRANS_DONE_ERROR;
 	}
 
+	// Push back if async replication has fallen too far behind.
+	if (repl_log_is_full(tr)) {
+		tr->result_code = AS_PROTO_RESULT_FAIL_REPL_LAG;
+		send_delete_response(tr);
+		return TRANS_DONE_ERROR;
+	}
+
 	// Create rw_request and add to hash.
 	rw_request_hkey hkey = { tr->rsv.ns->id, tr->keyd };
 	rw_request* rw = rw_request_create(&tr->keyd);
@@ -162,6 +192,14 @@ as_delete_start(as_transaction* tr)
 		return TRANS_DONE_SUCCESS;
 	}
 
+	// With async replication, transaction is finished once replica writes are
+	// logged.
+	if (repl_log_write(rw, tr)) {
+		rw_request_hash_delete(&hkey, rw);
+		send_delete_response(tr);
+		return TRANS_DONE_SUCCESS;
+	}
+
 	if (! start_delete_repl_write(rw, tr)) {
 		rw_request_hash_delete(&hkey, rw);
 		tr->result_code = AS_PROTO_RESULT_FAIL_UNKNOWN;
@@ -251,6 +289,11 @@ delete_dup_res_cb(rw_request* rw)
 		return true;
 	}
 
+	if (repl_log_write(rw, &tr)) {
+		send_delete_response(&tr);
+		return true;
+	}
+
 	if (! delete_repl_write_after_dup_res(rw, &tr)) {
 		tr.result_code = AS_PROTO_RESULT_FAIL_UNKNOWN;
 		send_delete_response(&tr);
@@ -318,6 +361,7 @@ send_delete_response(as_transaction* tr)
 		as_msg_send_reply(tr->from.proto_fd_h, tr->result_code, tr->generation,
 				tr->void_time, NULL, NULL, 0, NULL, as_transaction_trid(tr),
 				NULL);
+		as_slow_txn_check(tr);
 		client_delete_update_stats(tr->rsv.ns, tr->result_code);
 		break;
 	case FROM_PROXY:
@@ -325,11 +369,15 @@ send_delete_response(as_transaction* tr)
 				tr->result_code, tr->generation, tr->void_time, NULL, NULL, 0,
 				NULL, as_transaction_trid(tr), NULL);
 		break;
+	case FROM_BATCH:
+		as_batch_add_result(tr, NULL, tr->generation, tr->void_time, 0, NULL,
+				NULL);
+		batch_sub_delete_update_stats(tr->rsv.ns, tr->result_code);
+		break;
 	case FROM_NSUP:
 		break;
-	case FROM_BATCH:
 	case FROM_IUDF:
-		// Should be impossible for batch reads and internal UDFs to get here.
+		// Should be impossible for internal UDFs to get here.
 	default:
 		cf_crash(AS_RW, "unexpected transaction origin %u", tr->origin);
 		break;
@@ -353,11 +401,15 @@ delete_timeout_cb(rw_request* rw)
 		break;
 	case FROM_PROXY:
 		break;
+	case FROM_BATCH:
+		as_batch_add_error(rw->from.batch_shared, rw->from_data.batch_index,
+				AS_PROTO_RESULT_FAIL_TIMEOUT);
+		batch_sub_delete_update_stats(rw->rsv.ns, AS_PROTO_RESULT_FAIL_TIMEOUT);
+		break;
 	case FROM_NSUP:
 		break;
-	case FROM_BATCH:
 	case FROM_IUDF:
-		// Should be impossible for batch reads and internal UDFs to get here.
+		// Should be impossible for internal UDFs to get here.
 	default:
 		cf_crash(AS_RW, "unexpected transaction origin %u", rw->origin);
 		break;
@@ -433,6 +485,7 @@ delete_master(as_transaction* tr)
 	tr->void_time = r->void_time;
 	tr->last_update_time = r->last_update_time;
 
+	as_read_coalesce_record_changed(ns, &tr->keyd);
 	as_index_delete(tree, &tr->keyd);
 	as_record_done(&r_ref, ns);
 
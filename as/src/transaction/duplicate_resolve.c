@@ -48,6 +48,7 @@
 #include "storage/storage.h"
 #include "transaction/rw_request.h"
 #include "transaction/rw_request_hash.h"
+#include "transaction/rw_utils.h"
 
 
 //==========================================================
@@ -57,6 +58,9 @@
 void done_handle_request(as_partition_reservation* rsv, as_index_ref* r_ref);
 void send_dup_res_ack(cf_node node, msg* m, uint32_t result);
 void send_ack_for_bad_request(cf_node node, msg* m);
+bool fetch_winner_record(rw_request* rw);
+msg* make_record_request(rw_request* rw);
+bool is_meta_only_ack(const msg* m);
 bool apply_winner(rw_request* rw);
 void get_ldt_info(const msg* m, as_record_merge_component* c);
 
@@ -99,6 +103,14 @@ dup_res_make_message(rw_request* rw, as_transaction* tr, bool send_metadata)
 		}
 	}
 
+	// With more than one duplicate, first ask only for metadata, and then only
+	// the winner for its record. (A lone duplicate already sends its record
+	// only if it beats our metadata.)
+	if (tr->rsv.n_dupl > 1 && ! ns->ldt_enabled) {
+		msg_set_uint32(m, RW_FIELD_INFO, RW_INFO_DUP_META_ONLY);
+		rw->dup_meta_only = true;
+	}
+
 	return true;
 }
 
@@ -120,6 +132,8 @@ dup_res_setup_rw(rw_request* rw, as_transaction* tr, dup_res_done_cb dup_res_cb,
 
 	rw->start_time = tr->start_time;
 	rw->benchmark_time = tr->benchmark_time;
+	rw->stage_time = tr->stage_time;
+	memcpy(rw->stage_us, tr->stage_us, sizeof(rw->stage_us));
 
 	as_partition_reservation_copy(&rw->rsv, &tr->rsv);
 	// Hereafter, rw must release the reservation - happens in destructor.
@@ -142,6 +156,8 @@ dup_res_setup_rw(rw_request* rw, as_transaction* tr, dup_res_done_cb dup_res_cb,
 		rw->dup_result_code[i] = 0;
 	}
 
+	rw_request_hash_schedule(rw);
+
 	// Allow retransmit thread to destroy rw as soon as we unlock.
 	rw->is_set_up = true;
 }
@@ -186,6 +202,12 @@ dup_res_handle_request(cf_node node, msg* m)
 		return;
 	}
 
+	uint32_t info = 0;
+
+	msg_get_uint32(m, RW_FIELD_INFO, &info);
+
+	bool meta_only = (info & RW_INFO_DUP_META_ONLY) != 0 && ! ns->ldt_enabled;
+
 	uint32_t generation = 0;
 	uint32_t void_time = 0;
 	bool local_conflict_check =
@@ -242,6 +264,10 @@ dup_res_handle_request(cf_node node, msg* m)
 		msg_set_uint32(m, RW_FIELD_INFO,
 				RW_INFO_LDT_PARENTREC | RW_INFO_LDT_DUMMY);
 	}
+	else if (meta_only) {
+		// First phase - requester will ask again if our record wins.
+		msg_set_uint32(m, RW_FIELD_INFO, RW_INFO_DUP_META_ONLY);
+	}
 	else {
 		as_storage_rd rd;
 
@@ -400,6 +426,14 @@ dup_res_handle_ack(cf_node node, msg* m)
 			return;
 		}
 
+		if (! rw->dup_meta_only && is_meta_only_ack(m)) {
+			// First phase ack (retransmitted) while fetching winner's record.
+			pthread_mutex_unlock(&rw->lock);
+			rw_request_release(rw);
+			as_fabric_msg_put(m);
+			return;
+		}
+
 		rw->dest_complete[i] = true;
 		rw->dup_result_code[i] = result_code;
 		rw->dup_msg[i] = m;
@@ -427,6 +461,13 @@ dup_res_handle_ack(cf_node node, msg* m)
 		}
 	}
 
+	if (rw->dup_meta_only && fetch_winner_record(rw)) {
+		// Second phase started - wait for the winner's record.
+		pthread_mutex_unlock(&rw->lock);
+		rw_request_release(rw);
+		return;
+	}
+
 	bool is_ldt_ship_op = apply_winner(rw);
 	// Note - apply_winner() puts all rw->dup_msg[]s including m, so don't call
 	// as_fabric_msg_put(m) afterwards.
@@ -505,6 +546,142 @@ send_ack_for_bad_request(cf_node node, msg* m)
 }
 
 
+// Ends the metadata-only phase. If the best duplicate sent only metadata, puts
+// all first phase acks and asks that node alone for its record. Returns false
+// if there's nothing to fetch, so the acks at hand are applied as usual.
+bool
+fetch_winner_record(rw_request* rw)
+{
+	rw->dup_meta_only = false;
+
+	conflict_resolution_pol policy = rw->rsv.ns->conflict_resolution_policy;
+	int winner_i = -1;
+	uint32_t winner_generation = 0;
+	uint32_t winner_void_time = 0;
+	uint64_t winner_last_update_time = 0;
+
+	for (int i = 0; i < rw->n_dest_nodes; i++) {
+		msg* m = rw->dup_msg[i];
+
+		if (! m) {
+			continue;
+		}
+
+		uint32_t result_code;
+		uint32_t generation;
+		uint32_t void_time;
+		uint64_t last_update_time = 0;
+
+		msg_get_uint32(m, RW_FIELD_RESULT, &result_code);
+
+		if (result_code != AS_PROTO_RESULT_OK ||
+				msg_get_uint32(m, RW_FIELD_GENERATION, &generation) != 0 ||
+				msg_get_uint32(m, RW_FIELD_VOID_TIME, &void_time) != 0) {
+			continue;
+		}
+
+		msg_get_uint64(m, RW_FIELD_LAST_UPDATE_TIME, &last_update_time);
+
+		if (winner_i == -1 || 0 < as_record_resolve_conflict(policy,
+				winner_generation, winner_last_update_time, winner_void_time,
+				generation, last_update_time, void_time)) {
+			winner_i = i;
+			winner_generation = generation;
+			winner_void_time = void_time;
+			winner_last_update_time = last_update_time;
+		}
+	}
+
+	// Nothing beat our copy, or the winner (an older node) sent its record.
+	if (winner_i == -1 || ! is_meta_only_ack(rw->dup_msg[winner_i])) {
+		return false;
+	}
+
+	msg* m = make_record_request(rw);
+
+	if (! m) {
+		cf_warning_digest(AS_RW, &rw->keyd, "dup-res: can't fetch winner ");
+		return false;
+	}
+
+	cf_node winner = rw->dest_nodes[winner_i];
+
+	for (int i = 0; i < rw->n_dest_nodes; i++) {
+		if (rw->dup_msg[i]) {
+			as_fabric_msg_put(rw->dup_msg[i]);
+			rw->dup_msg[i] = NULL;
+		}
+	}
+
+	as_fabric_msg_put(rw->dest_msg);
+	rw->dest_msg = m;
+
+	rw->n_dest_nodes = 1;
+	rw->dest_nodes[0] = winner;
+	rw->dest_complete[0] = false;
+	rw->dup_result_code[0] = 0;
+
+	rw->xmit_ms = cf_getms() + rw->retry_interval_ms;
+
+	send_rw_messages(rw);
+
+	// If the winner just left, go on with our copy.
+	return ! rw->dest_complete[0];
+}
+
+
+// Second phase request - same as the first, but for the record. Our metadata
+// goes too, so the winner still sends nothing if its record has since lost.
+msg*
+make_record_request(rw_request* rw)
+{
+	msg* m = as_fabric_msg_get(M_TYPE_RW);
+
+	if (! m) {
+		return NULL;
+	}
+
+	as_namespace* ns = rw->rsv.ns;
+	msg* first = rw->dest_msg;
+
+	msg_set_uint32(m, RW_FIELD_OP, RW_OP_DUP);
+	msg_set_buf(m, RW_FIELD_NAMESPACE, (uint8_t*)ns->name, strlen(ns->name),
+			MSG_SET_COPY);
+	msg_set_uint32(m, RW_FIELD_NS_ID, ns->id);
+	msg_set_buf(m, RW_FIELD_DIGEST, (void*)&rw->keyd, sizeof(cf_digest),
+			MSG_SET_COPY);
+	msg_set_uint64(m, RW_FIELD_CLUSTER_KEY, rw->rsv.cluster_key);
+	msg_set_uint32(m, RW_FIELD_TID, rw->tid);
+
+	uint32_t generation;
+	uint32_t void_time;
+	uint64_t last_update_time;
+
+	if (msg_get_uint32(first, RW_FIELD_GENERATION, &generation) == 0 &&
+			msg_get_uint32(first, RW_FIELD_VOID_TIME, &void_time) == 0) {
+		msg_set_uint32(m, RW_FIELD_GENERATION, generation);
+		msg_set_uint32(m, RW_FIELD_VOID_TIME, void_time);
+
+		if (msg_get_uint64(first, RW_FIELD_LAST_UPDATE_TIME,
+				&last_update_time) == 0) {
+			msg_set_uint64(m, RW_FIELD_LAST_UPDATE_TIME, last_update_time);
+		}
+	}
+
+	return m;
+}
+
+
+bool
+is_meta_only_ack(const msg* m)
+{
+	uint32_t info;
+
+	return msg_get_uint32(m, RW_FIELD_INFO, &info) == 0 &&
+			(info & RW_INFO_DUP_META_ONLY) != 0;
+}
+
+
 bool
 apply_winner(rw_request* rw)
 {
@@ -553,6 +730,11 @@ apply_winner(rw_request* rw)
 			}
 		}
 
+		if (is_meta_only_ack(m)) {
+			// Lost to a duplicate that sent its record.
+			continue;
+		}
+
 		if (msg_get_buf(m, RW_FIELD_RECORD, &dups[n].record_buf,
 				&dups[n].record_buf_sz, MSG_GET_DIRECT) != 0) {
 			cf_warning_digest(AS_RW, &rw->keyd, "dup-res ack: no record ");
@@ -37,11 +37,11 @@
 #include "citrusleaf/cf_atomic.h"
 #include "citrusleaf/cf_clock.h"
 #include "citrusleaf/cf_digest.h"
-#include "citrusleaf/cf_shash.h"
 
 #include "dynbuf.h"
 #include "fault.h"
 #include "msg.h"
+#include "ohash.h"
 #include "socket.h"
 #include "util.h"
 
@@ -52,6 +52,7 @@
 #include "base/transaction.h"
 #include "base/stats.h"
 #include "fabric/fabric.h"
+#include "fabric/node_slots.h"
 #include "fabric/paxos.h"
 #include "transaction/rw_request.h"
 #include "transaction/rw_request_hash.h"
@@ -73,6 +74,7 @@ typedef enum {
 	PROXY_FIELD_CLUSTER_KEY,
 	PROXY_FIELD_TIMEOUT_MS, // deprecated
 	PROXY_FIELD_INFO,
+	PROXY_FIELD_BATCH, // flattened proxy msgs
 
 	NUM_PROXY_FIELDS
 } proxy_msg_field;
@@ -80,6 +82,7 @@ typedef enum {
 #define PROXY_OP_REQUEST 1
 #define PROXY_OP_RESPONSE 2
 #define PROXY_OP_RETURN_TO_SENDER 3
+#define PROXY_OP_BATCH 4
 
 // LDT-related.
 #define PROXY_INFO_SHIPPED_OP 0x0001
@@ -93,12 +96,24 @@ const msg_template proxy_mt[] = {
 	{ PROXY_FIELD_CLUSTER_KEY, M_FT_UINT64 },
 	{ PROXY_FIELD_TIMEOUT_MS, M_FT_UINT32 },
 	{ PROXY_FIELD_INFO, M_FT_UINT32 },
+	{ PROXY_FIELD_BATCH, M_FT_BUF },
 };
 
 COMPILER_ASSERT(sizeof(proxy_mt) / sizeof(msg_template) == NUM_PROXY_FIELDS);
 
 #define PROXY_MSG_SCRATCH_SIZE 128
 
+#define PROXY_BATCH_MAX_NODES AS_CLUSTER_SZ
+#define PROXY_BATCH_FLUSH_SZ (1024 * 64)
+
+// Proxy msgs to a node waiting to go as one PROXY_OP_BATCH msg.
+typedef struct proxy_batch_slot_s {
+	as_node_slot	base;
+	uint8_t*		buf;
+	size_t			used_sz;
+	size_t			alloc_sz;
+} proxy_batch_slot;
+
 typedef struct proxy_request_s {
 	uint32_t		msg_fields;
 
@@ -140,16 +155,24 @@ typedef struct proxy_request_s {
 //
 
 void* run_proxy_retransmit(void* arg);
-int proxy_retransmit_reduce_fn(void* key, void* data, void* udata);
+int proxy_retransmit_reduce_fn(const void* key, void* data, void* udata);
 int proxy_retransmit_send(proxy_request* pr);
 
 void on_proxy_paxos_change(as_paxos_generation gen, as_paxos_change* change,
 		cf_node succession[], void* udata);
-int proxy_paxos_change_reduce_fn(void* key, void* data, void* udata);
-int proxy_paxos_change_delete_reduce_fn(void* key, void* data, void* udata);
+int proxy_paxos_change_reduce_fn(const void* key, void* data, void* udata);
+int proxy_paxos_change_delete_reduce_fn(const void* key, void* data,
+		void* udata);
 
 int proxy_msg_cb(cf_node src, msg* m, void* udata);
 
+void proxy_send(cf_node dst, msg* m);
+bool proxy_batch_add(cf_node dst, const msg* m);
+bool proxy_batch_slot_reclaim(void* pv_slot);
+void* run_proxy_batch_flush(void* arg);
+void proxy_batch_send(cf_node node, uint8_t* buf, size_t sz);
+void proxy_handle_batch(cf_node src, msg* m);
+
 void proxyer_handle_response(msg* m, uint32_t tid);
 int proxyer_handle_client_response(msg* m, proxy_request* pr);
 int proxyer_handle_batch_response(msg* m, proxy_request* pr);
@@ -159,12 +182,13 @@ void proxyee_handle_request(cf_node src, msg* m, uint32_t tid);
 
 void shipop_response_handler(msg* m, proxy_request* pr);
 void shipop_handle_client_response(msg* m, rw_request* rw);
+void shipop_handle_batch_response(msg* m, rw_request* rw);
 void shipop_timeout_handler(proxy_request* pr);
 
 static inline uint32_t
-proxy_hash_fn(void* value)
+proxy_hash_fn(const void* key)
 {
-	return *(uint32_t*)value;
+	return *(const uint32_t*)key;
 }
 
 static inline void
@@ -210,9 +234,14 @@ batch_sub_proxy_update_stats(as_namespace* ns, uint8_t result_code)
 // Globals.
 //
 
-static shash* g_proxy_hash = NULL;
+static cf_ohash* g_proxy_hash = NULL;
 static cf_atomic32 g_proxy_tid = 0;
 
+static proxy_batch_slot g_proxy_batch_slot_array[PROXY_BATCH_MAX_NODES];
+static as_node_slots g_proxy_batch_slots = AS_NODE_SLOTS_INIT(
+		g_proxy_batch_slot_array, PROXY_BATCH_MAX_NODES,
+		proxy_batch_slot_reclaim);
+
 
 //==========================================================
 // Public API.
@@ -221,8 +250,11 @@ static cf_atomic32 g_proxy_tid = 0;
 void
 as_proxy_init()
 {
-	shash_create(&g_proxy_hash, proxy_hash_fn, sizeof(uint32_t),
-			sizeof(proxy_request), 4 * 1024, SHASH_CR_MT_MANYLOCK);
+	g_proxy_hash = cf_ohash_create(proxy_hash_fn, sizeof(uint32_t),
+			sizeof(proxy_request), 4 * 1024, 64);
+
+	cf_assert(g_proxy_hash, AS_PROXY, CF_CRITICAL,
+			"failed to create proxy hash");
 
 	pthread_t thread;
 	pthread_attr_t attrs;
@@ -234,6 +266,11 @@ as_proxy_init()
 		cf_crash(AS_RW, "failed to create proxy retransmit thread");
 	}
 
+	if (g_config.proxy_batch_us != 0 &&
+			pthread_create(&thread, &attrs, run_proxy_batch_flush, NULL) != 0) {
+		cf_crash(AS_RW, "failed to create proxy batch thread");
+	}
+
 	as_paxos_register_change_callback(on_proxy_paxos_change, NULL);
 
 	as_fabric_register_msg_fn(M_TYPE_PROXY, proxy_mt, sizeof(proxy_mt),
@@ -244,7 +281,7 @@ as_proxy_init()
 uint32_t
 as_proxy_hash_count()
 {
-	return shash_get_size(g_proxy_hash);
+	return cf_ohash_get_size(g_proxy_hash);
 }
 
 
@@ -301,8 +338,8 @@ as_proxy_divert(cf_node dst, as_transaction* tr, as_namespace* ns,
 
 	pr.rw = NULL;
 
-	if (shash_put(g_proxy_hash, &tid, &pr) != SHASH_OK) {
-		cf_warning(AS_PROXY, "failed shash put");
+	if (cf_ohash_put(g_proxy_hash, &tid, &pr) != CF_OHASH_OK) {
+		cf_warning(AS_PROXY, "failed proxy hash put");
 		as_fabric_msg_put(m);
 		return false;
 	}
@@ -310,14 +347,11 @@ as_proxy_divert(cf_node dst, as_transaction* tr, as_namespace* ns,
 	tr->msgp = NULL; // pattern, not needed
 	tr->from.any = NULL; // pattern, not needed
 
-	// Send fabric message to remote node.
+	// Send fabric message to remote node - the hash keeps its reference for
+	// retransmits.
 
 	msg_incr_ref(m);
-
-	if (as_fabric_send(dst, m, AS_FABRIC_PRIORITY_MEDIUM) !=
-			AS_FABRIC_SUCCESS) {
-		as_fabric_msg_put(m);
-	}
+	proxy_send(dst, m);
 
 	return true;
 }
@@ -341,10 +375,7 @@ as_proxy_return_to_sender(const as_transaction* tr, as_namespace* ns)
 	msg_set_uint64(m, PROXY_FIELD_REDIRECT,
 			redirect_node == (cf_node)0 ? tr->from.proxy_node : redirect_node);
 
-	if (as_fabric_send(tr->from.proxy_node, m, AS_FABRIC_PRIORITY_MEDIUM) !=
-			AS_FABRIC_SUCCESS) {
-		as_fabric_msg_put(m);
-	}
+	proxy_send(tr->from.proxy_node, m);
 }
 
 
@@ -371,10 +402,7 @@ as_proxy_send_response(cf_node dst, uint32_t proxy_tid, uint32_t result_code,
 	msg_set_buf(m, PROXY_FIELD_AS_PROTO, (uint8_t*)msgp, msg_sz,
 			MSG_SET_HANDOFF_MALLOC);
 
-	if (as_fabric_send(dst, m, AS_FABRIC_PRIORITY_MEDIUM) !=
-			AS_FABRIC_SUCCESS) {
-		as_fabric_msg_put(m);
-	}
+	proxy_send(dst, m);
 }
 
 
@@ -403,10 +431,7 @@ as_proxy_send_ops_response(cf_node dst, uint32_t proxy_tid, cf_dyn_buf* db)
 		db->buf = NULL; // the fabric owns the buffer now
 	}
 
-	if (as_fabric_send(dst, m, AS_FABRIC_PRIORITY_MEDIUM) !=
-			AS_FABRIC_SUCCESS) {
-		as_fabric_msg_put(m);
-	}
+	proxy_send(dst, m);
 }
 
 
@@ -462,7 +487,7 @@ as_proxy_shipop(cf_node dst, rw_request* rw)
 	cf_rc_reserve(rw);
 	pr.rw = rw;
 
-	if (shash_put(g_proxy_hash, &tid, &pr) != SHASH_OK) {
+	if (cf_ohash_put(g_proxy_hash, &tid, &pr) != CF_OHASH_OK) {
 		as_fabric_msg_put(m);
 		return;
 	}
@@ -487,7 +512,7 @@ proxyer_handle_response(msg* m, uint32_t tid)
 {
 	proxy_request pr;
 
-	if (shash_get_and_delete(g_proxy_hash, &tid, &pr) != SHASH_OK) {
+	if (cf_ohash_get_and_delete(g_proxy_hash, &tid, &pr) != CF_OHASH_OK) {
 		// Some other response (or timeout) has already finished this pr.
 		return;
 	}
@@ -548,6 +573,8 @@ proxyer_handle_client_response(msg* m, proxy_request* pr)
 	as_file_handle* fd_h = pr->from.proto_fd_h;
 	size_t pos = 0;
 
+	as_file_handle_send_lock(fd_h);
+
 	while (pos < proto_sz) {
 		int rv = cf_socket_send(fd_h->sock, proto + pos, proto_sz - pos,
 				MSG_NOSIGNAL);
@@ -558,6 +585,7 @@ proxyer_handle_client_response(msg* m, proxy_request* pr)
 		else if (rv < 0) {
 			if (errno != EWOULDBLOCK) {
 				// Common when a client aborts.
+				as_file_handle_send_unlock(fd_h);
 				as_end_of_transaction_force_close(fd_h);
 				return AS_PROTO_RESULT_FAIL_UNKNOWN;
 			}
@@ -567,11 +595,13 @@ proxyer_handle_client_response(msg* m, proxy_request* pr)
 		else {
 			cf_warning(AS_PROTO, "send returned 0: fd %d sz %zu pos %zu ",
 					CSFD(fd_h->sock), proto_sz, pos);
+			as_file_handle_send_unlock(fd_h);
 			as_end_of_transaction_force_close(fd_h);
 			return AS_PROTO_RESULT_FAIL_UNKNOWN;
 		}
 	}
 
+	as_file_handle_send_unlock(fd_h);
 	as_end_of_transaction_ok(fd_h);
 
 	return AS_PROTO_RESULT_OK;
@@ -611,7 +641,8 @@ proxyer_handle_return_to_sender(msg* m, uint32_t tid)
 	proxy_request* pr;
 	pthread_mutex_t* lock;
 
-	if (shash_get_vlock(g_proxy_hash, &tid, (void**)&pr, &lock) != SHASH_OK) {
+	if (cf_ohash_get_vlock(g_proxy_hash, &tid, (void**)&pr, &lock) !=
+			CF_OHASH_OK) {
 		// Some other response (or timeout) has already finished this pr.
 		return;
 	}
@@ -672,7 +703,7 @@ proxyer_handle_return_to_sender(msg* m, uint32_t tid)
 
 	as_fabric_msg_put(pr->fab_msg);
 
-	shash_delete_lockfree(g_proxy_hash, &tid);
+	cf_ohash_delete_lockfree(g_proxy_hash, &tid);
 	pthread_mutex_unlock(lock);
 }
 
@@ -771,7 +802,7 @@ run_proxy_retransmit(void* arg)
 		now.now_ns = cf_getns();
 		now.now_ms = now.now_ns / 1000000;
 
-		shash_reduce_delete(g_proxy_hash, proxy_retransmit_reduce_fn, &now);
+		cf_ohash_reduce(g_proxy_hash, proxy_retransmit_reduce_fn, &now);
 	}
 
 	return NULL;
@@ -779,7 +810,7 @@ run_proxy_retransmit(void* arg)
 
 
 int
-proxy_retransmit_reduce_fn(void* key, void* data, void* udata)
+proxy_retransmit_reduce_fn(const void* key, void* data, void* udata)
 {
 	proxy_request* pr = data;
 	now_times* now = (now_times*)udata;
@@ -790,7 +821,7 @@ proxy_retransmit_reduce_fn(void* key, void* data, void* udata)
 		if (pr->rw) {
 			shipop_timeout_handler(pr);
 			as_fabric_msg_put(pr->fab_msg);
-			return SHASH_REDUCE_DELETE;
+			return CF_OHASH_REDUCE_DELETE;
 		}
 
 		cf_assert(pr->from.any, AS_PROXY, CF_CRITICAL,
@@ -819,7 +850,7 @@ proxy_retransmit_reduce_fn(void* key, void* data, void* udata)
 		pr->from.any = NULL; // pattern, not needed
 		as_fabric_msg_put(pr->fab_msg);
 
-		return SHASH_REDUCE_DELETE;
+		return CF_OHASH_REDUCE_DELETE;
 	}
 
 	// Handle retransmits. (Ship-ops are exempt.)
@@ -832,7 +863,7 @@ proxy_retransmit_reduce_fn(void* key, void* data, void* udata)
 		return proxy_retransmit_send(pr);
 	}
 
-	return SHASH_OK;
+	return CF_OHASH_OK;
 }
 
 
@@ -848,7 +879,7 @@ proxy_retransmit_send(proxy_request* pr)
 				AS_FABRIC_PRIORITY_MEDIUM);
 
 		if (rv == AS_FABRIC_SUCCESS) {
-			return SHASH_OK;
+			return CF_OHASH_OK;
 		}
 
 		as_fabric_msg_put(pr->fab_msg);
@@ -856,7 +887,7 @@ proxy_retransmit_send(proxy_request* pr)
 		if (rv != AS_FABRIC_ERR_NO_NODE) {
 			// Should never get here - 'queue full' error is impossible for
 			// medium priority...
-			return SHASH_ERR;
+			return CF_OHASH_ERR;
 		}
 
 		// The node I'm proxying to is no longer up. Find another node. (Easier
@@ -894,12 +925,12 @@ proxy_retransmit_send(proxy_request* pr)
 
 			as_fabric_msg_put(pr->fab_msg);
 
-			return SHASH_REDUCE_DELETE;
+			return CF_OHASH_REDUCE_DELETE;
 		}
 
 		// Original destination - just wait for the next retransmit.
 		if (new_dst == pr->dest) {
-			return SHASH_OK;
+			return CF_OHASH_OK;
 		}
 
 		// Different destination - retry immediately. This is the reason for the
@@ -908,7 +939,7 @@ proxy_retransmit_send(proxy_request* pr)
 	}
 
 	// For now, it's impossible to get here.
-	return SHASH_ERR;
+	return CF_OHASH_ERR;
 }
 
 
@@ -932,12 +963,12 @@ on_proxy_paxos_change(as_paxos_generation gen, as_paxos_change* change,
 
 	// Iterate through the hash table and find nodes that are not in the
 	// succession list. Remove these entries from the hash table.
-	shash_reduce(g_proxy_hash, proxy_paxos_change_reduce_fn, (void*)&del);
+	cf_ohash_reduce(g_proxy_hash, proxy_paxos_change_reduce_fn, (void*)&del);
 
 	// If there are nodes to be deleted, execute the deletion algorithm.
 	for (int i = 0; i < g_config.paxos_max_cluster_size; i++) {
 		if (del.deletions[i] != (cf_node)0) {
-			shash_reduce(g_proxy_hash, proxy_paxos_change_delete_reduce_fn,
+			cf_ohash_reduce(g_proxy_hash, proxy_paxos_change_delete_reduce_fn,
 					(void*)&del.deletions[i]);
 		}
 	}
@@ -945,7 +976,7 @@ on_proxy_paxos_change(as_paxos_generation gen, as_paxos_change* change,
 
 
 int
-proxy_paxos_change_reduce_fn(void* key, void* data, void* udata)
+proxy_paxos_change_reduce_fn(const void* key, void* data, void* udata)
 {
 	proxy_request* pr = (proxy_request*)data;
 	rw_paxos_change_struct* del = (rw_paxos_change_struct*)udata;
@@ -976,7 +1007,7 @@ proxy_paxos_change_reduce_fn(void* key, void* data, void* udata)
 
 
 int
-proxy_paxos_change_delete_reduce_fn(void* key, void* data, void* udata)
+proxy_paxos_change_delete_reduce_fn(const void* key, void* data, void* udata)
 {
 	proxy_request* pr = (proxy_request*)data;
 	cf_node* node = (cf_node*)udata;
@@ -1004,6 +1035,12 @@ proxy_msg_cb(cf_node src, msg* m, void* udata)
 		return 0;
 	}
 
+	if (op == PROXY_OP_BATCH) {
+		proxy_handle_batch(src, m);
+		as_fabric_msg_put(m);
+		return 0;
+	}
+
 	uint32_t tid;
 
 	if (msg_get_uint32(m, PROXY_FIELD_TID, &tid) != 0) {
@@ -1032,6 +1069,209 @@ proxy_msg_cb(cf_node src, msg* m, void* udata)
 }
 
 
+//==========================================================
+// Local helpers - batching.
+//
+
+// Consumes the caller's reference to m.
+void
+proxy_send(cf_node dst, msg* m)
+{
+	if (g_config.proxy_batch_us != 0 && proxy_batch_add(dst, m)) {
+		as_fabric_msg_put(m);
+		return;
+	}
+
+	if (as_fabric_send(dst, m, AS_FABRIC_PRIORITY_MEDIUM) !=
+			AS_FABRIC_SUCCESS) {
+		as_fabric_msg_put(m);
+	}
+}
+
+
+// Returns false if the caller must send m directly.
+bool
+proxy_batch_add(cf_node dst, const msg* m)
+{
+	uint64_t lasttime;
+
+	// Batched sends are asynchronous - let a direct send fail now if the node
+	// is gone.
+	if (as_fabric_get_node_lasttime(dst, &lasttime) != 0) {
+		return false;
+	}
+
+	proxy_batch_slot* slot = as_node_slots_lock(&g_proxy_batch_slots, dst,
+			true);
+
+	if (! slot) {
+		return false;
+	}
+
+	size_t sz = msg_get_wire_size(m);
+
+	if (slot->used_sz + sz > slot->alloc_sz) {
+		size_t alloc_sz = slot->used_sz + sz > PROXY_BATCH_FLUSH_SZ ?
+				slot->used_sz + sz : PROXY_BATCH_FLUSH_SZ;
+		uint8_t* buf = cf_realloc(slot->buf, alloc_sz);
+
+		if (! buf) {
+			pthread_mutex_unlock(&slot->base.lock);
+			return false;
+		}
+
+		slot->buf = buf;
+		slot->alloc_sz = alloc_sz;
+	}
+
+	msg_fillbuf(m, slot->buf + slot->used_sz, &sz);
+	slot->used_sz += sz;
+
+	uint8_t* full_buf = NULL;
+	size_t full_sz = 0;
+
+	if (slot->used_sz >= PROXY_BATCH_FLUSH_SZ) {
+		full_buf = slot->buf;
+		full_sz = slot->used_sz;
+
+		slot->buf = NULL;
+		slot->used_sz = 0;
+		slot->alloc_sz = 0;
+	}
+
+	pthread_mutex_unlock(&slot->base.lock);
+
+	if (full_buf) {
+		proxy_batch_send(dst, full_buf, full_sz);
+	}
+
+	return true;
+}
+
+
+void*
+run_proxy_batch_flush(void* arg)
+{
+	while (true) {
+		usleep(g_config.proxy_batch_us);
+
+		uint32_t n_slots = as_node_slots_count(&g_proxy_batch_slots);
+
+		for (uint32_t i = 0; i < n_slots; i++) {
+			proxy_batch_slot* slot =
+					as_node_slots_at(&g_proxy_batch_slots, i);
+
+			pthread_mutex_lock(&slot->base.lock);
+
+			cf_node node = slot->base.node;
+			uint8_t* buf = slot->buf;
+			size_t sz = slot->used_sz;
+
+			if (sz != 0) {
+				slot->buf = NULL;
+				slot->used_sz = 0;
+				slot->alloc_sz = 0;
+			}
+
+			pthread_mutex_unlock(&slot->base.lock);
+
+			if (sz != 0) {
+				proxy_batch_send(node, buf, sz);
+			}
+		}
+	}
+
+	return NULL;
+}
+
+
+// Call under the slot lock. A departed node's last batch is still sent (and
+// fails) on the next flush - until then the slot isn't empty.
+bool
+proxy_batch_slot_reclaim(void* pv_slot)
+{
+	proxy_batch_slot* slot = (proxy_batch_slot*)pv_slot;
+
+	if (slot->used_sz != 0) {
+		return false;
+	}
+
+	if (slot->buf) {
+		cf_free(slot->buf);
+		slot->buf = NULL;
+	}
+
+	slot->alloc_sz = 0;
+
+	return true;
+}
+
+
+void
+proxy_batch_send(cf_node node, uint8_t* buf, size_t sz)
+{
+	msg* m = as_fabric_msg_get(M_TYPE_PROXY);
+
+	if (! m) {
+		// Lost like a dropped msg - requests retransmit, responses time out.
+		cf_free(buf);
+		return;
+	}
+
+	msg_set_uint32(m, PROXY_FIELD_OP, PROXY_OP_BATCH);
+	msg_set_buf(m, PROXY_FIELD_BATCH, buf, sz, MSG_SET_HANDOFF_MALLOC);
+
+	if (as_fabric_send(node, m, AS_FABRIC_PRIORITY_MEDIUM) !=
+			AS_FABRIC_SUCCESS) {
+		as_fabric_msg_put(m);
+	}
+}
+
+
+// Handle each embedded msg exactly as if it had arrived on its own.
+void
+proxy_handle_batch(cf_node src, msg* m)
+{
+	uint8_t* buf;
+	size_t sz;
+
+	if (msg_get_buf(m, PROXY_FIELD_BATCH, &buf, &sz, MSG_GET_DIRECT) != 0) {
+		cf_warning(AS_PROXY, "proxy batch: no batch");
+		return;
+	}
+
+	const uint8_t* end = buf + sz;
+
+	while (buf < end) {
+		uint32_t op_sz;
+		msg_type type;
+
+		if (msg_get_initial(&op_sz, &type, buf, (uint32_t)(end - buf)) != 0 ||
+				op_sz > (uint32_t)(end - buf) || type != M_TYPE_PROXY) {
+			cf_warning(AS_PROXY, "proxy batch: bad embedded msg");
+			break;
+		}
+
+		msg* op_msg = as_fabric_msg_get(M_TYPE_PROXY);
+
+		if (! op_msg) {
+			break;
+		}
+
+		if (msg_parse(op_msg, buf, op_sz) != 0) {
+			cf_warning(AS_PROXY, "proxy batch: bad embedded msg");
+			as_fabric_msg_put(op_msg);
+			break;
+		}
+
+		// Puts op_msg.
+		proxy_msg_cb(src, op_msg, NULL);
+
+		buf += op_sz;
+	}
+}
+
+
 //==========================================================
 // Local helpers - LDT-related.
 //
@@ -1070,12 +1310,14 @@ shipop_response_handler(msg* m, proxy_request* pr)
 			as_fabric_msg_put(pr->fab_msg);
 		}
 		break;
+	case FROM_BATCH:
+		shipop_handle_batch_response(m, rw);
+		break;
 	case FROM_IUDF:
 		rw->from.iudf_orig->cb(rw->from.iudf_orig->udata, 0);
 		break;
-	case FROM_BATCH:
 	case FROM_NSUP:
-		// Should be impossible for batch reads and nsup deletes to get here.
+		// Should be impossible for nsup deletes to get here.
 	default:
 		cf_crash(AS_PROXY, "unexpected transaction origin %u", rw->origin);
 		break;
@@ -1111,6 +1353,8 @@ shipop_handle_client_response(msg* m, rw_request* rw)
 	as_file_handle* fd_h = rw->from.proto_fd_h;
 	size_t pos = 0;
 
+	as_file_handle_send_lock(fd_h);
+
 	while (pos < proto_sz) {
 		int rv = cf_socket_send(fd_h->sock, proto + pos, proto_sz - pos,
 				MSG_NOSIGNAL);
@@ -1121,6 +1365,7 @@ shipop_handle_client_response(msg* m, rw_request* rw)
 		else if (rv < 0) {
 			if (errno != EWOULDBLOCK) {
 				// Common when a client aborts.
+				as_file_handle_send_unlock(fd_h);
 				as_end_of_transaction_force_close(fd_h);
 				return;
 			}
@@ -1130,15 +1375,36 @@ shipop_handle_client_response(msg* m, rw_request* rw)
 		else {
 			cf_warning(AS_PROTO, "send returned 0: fd %d sz %zu pos %zu ",
 					CSFD(fd_h->sock), proto_sz, pos);
+			as_file_handle_send_unlock(fd_h);
 			as_end_of_transaction_force_close(fd_h);
 			return;
 		}
 	}
 
+	as_file_handle_send_unlock(fd_h);
 	as_end_of_transaction_ok(fd_h);
 }
 
 
+void
+shipop_handle_batch_response(msg* m, rw_request* rw)
+{
+	cl_msg* msgp;
+	size_t msgp_sz;
+
+	if (msg_get_buf(m, PROXY_FIELD_AS_PROTO, (uint8_t**)&msgp, &msgp_sz,
+			MSG_GET_DIRECT) != 0) {
+		cf_warning(AS_PROXY, "msg get for proto failed");
+		as_batch_add_error(rw->from.batch_shared, rw->from_data.batch_index,
+				AS_PROTO_RESULT_FAIL_UNKNOWN);
+		return;
+	}
+
+	as_batch_add_proxy_result(rw->from.batch_shared, rw->from_data.batch_index,
+			&rw->keyd, msgp, msgp_sz);
+}
+
+
 void
 shipop_timeout_handler(proxy_request* pr)
 {
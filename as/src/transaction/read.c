@@ -30,6 +30,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <sys/uio.h>
 
 #include "citrusleaf/alloc.h"
 #include "citrusleaf/cf_atomic.h"
@@ -43,11 +44,13 @@
 #include "base/datamodel.h"
 #include "base/index.h"
 #include "base/proto.h"
+#include "base/slow_txn.h"
 #include "base/transaction.h"
 #include "base/transaction_policy.h"
 #include "storage/storage.h"
 #include "transaction/duplicate_resolve.h"
 #include "transaction/proxy.h"
+#include "transaction/read_coalesce.h"
 #include "transaction/rw_request.h"
 #include "transaction/rw_request_hash.h"
 #include "transaction/rw_utils.h"
@@ -63,27 +66,34 @@ bool read_dup_res_cb(rw_request* rw);
 void send_read_response(as_transaction* tr, as_msg_op** ops,
 		as_bin** response_bins, uint16_t n_bins, const char* set_name,
 		cf_dyn_buf* db);
+void send_read_response_iov(as_transaction* tr, struct iovec* iov,
+		uint32_t n_iov);
+void send_read_response_waiters(as_transaction* tr, as_read_waiter* waiters,
+		uint32_t n_waiters, cf_dyn_buf* db, const struct iovec* iov,
+		uint32_t n_iov);
 void read_timeout_cb(rw_request* rw);
 
 transaction_status read_local(as_transaction* tr, bool stop_if_not_found);
 void read_local_done(as_transaction* tr, as_index_ref* r_ref, as_storage_rd* rd,
 		int result_code);
+bool read_local_bin_ids(as_namespace* ns, as_msg* m, uint16_t* ids,
+		uint16_t* p_n_ids);
 
 static inline void
 client_read_update_stats(as_namespace* ns, uint8_t result_code)
 {
 	switch (result_code) {
 	case AS_PROTO_RESULT_OK:
-		cf_atomic64_incr(&ns->n_client_read_success);
+		cf_shard_counter_incr(&ns->n_client_read_success);
 		break;
 	case AS_PROTO_RESULT_FAIL_TIMEOUT:
-		cf_atomic64_incr(&ns->n_client_read_timeout);
+		cf_shard_counter_incr(&ns->n_client_read_timeout);
 		break;
 	default:
-		cf_atomic64_incr(&ns->n_client_read_error);
+		cf_shard_counter_incr(&ns->n_client_read_error);
 		break;
 	case AS_PROTO_RESULT_FAIL_NOTFOUND:
-		cf_atomic64_incr(&ns->n_client_read_not_found);
+		cf_shard_counter_incr(&ns->n_client_read_not_found);
 		break;
 	}
 }
@@ -93,16 +103,16 @@ batch_sub_read_update_stats(as_namespace* ns, uint8_t result_code)
 {
 	switch (result_code) {
 	case AS_PROTO_RESULT_OK:
-		cf_atomic64_incr(&ns->n_batch_sub_read_success);
+		cf_shard_counter_incr(&ns->n_batch_sub_read_success);
 		break;
 	case AS_PROTO_RESULT_FAIL_TIMEOUT:
-		cf_atomic64_incr(&ns->n_batch_sub_read_timeout);
+		cf_shard_counter_incr(&ns->n_batch_sub_read_timeout);
 		break;
 	default:
-		cf_atomic64_incr(&ns->n_batch_sub_read_error);
+		cf_shard_counter_incr(&ns->n_batch_sub_read_error);
 		break;
 	case AS_PROTO_RESULT_FAIL_NOTFOUND:
-		cf_atomic64_incr(&ns->n_batch_sub_read_not_found);
+		cf_shard_counter_incr(&ns->n_batch_sub_read_not_found);
 		break;
 	}
 }
@@ -117,8 +127,16 @@ as_read_start(as_transaction* tr)
 {
 	BENCHMARK_START(tr, read, FROM_CLIENT);
 	BENCHMARK_START(tr, batch_sub, FROM_BATCH);
+	STAGE_START(tr, AS_STAGE_READ_QUEUE);
 
 	if (tr->rsv.n_dupl == 0) {
+		// Hot key - if an identical read is in flight, its response is ours.
+		if (as_read_coalesce_join(tr)) {
+			// Leader now owns our fd_h - just release reservation & free msgp.
+			tr->from.proto_fd_h = NULL;
+			return TRANS_DONE_SUCCESS;
+		}
+
 		// No duplicates to resolve. Try to read local copy - response sent to
 		// origin no matter what.
 		return read_local(tr, false);
@@ -197,6 +215,7 @@ read_dup_res_cb(rw_request* rw)
 {
 	BENCHMARK_NEXT_DATA_POINT(rw, read, dup_res);
 	BENCHMARK_NEXT_DATA_POINT(rw, batch_sub, dup_res);
+	STAGE_NEXT_DATA_POINT(rw, AS_STAGE_READ_DUP_RES);
 
 	as_transaction tr;
 	as_transaction_init_from_rw(&tr, rw);
@@ -226,6 +245,10 @@ send_read_response(as_transaction* tr, as_msg_op** ops, as_bin** response_bins,
 	// Note - if tr was setup from rw, rw->from.any has been set null and
 	// informs timeout it lost the race.
 
+	// If we're a coalescing leader, no more reads can attach after this.
+	as_read_waiter* waiters;
+	uint32_t n_waiters = as_read_coalesce_detach(tr, &waiters);
+
 	switch (tr->origin) {
 	case FROM_CLIENT:
 		BENCHMARK_NEXT_DATA_POINT(tr, read, local);
@@ -238,7 +261,9 @@ send_read_response(as_transaction* tr, as_msg_op** ops, as_bin** response_bins,
 					tr->rsv.ns, as_transaction_trid(tr), set_name);
 		}
 		BENCHMARK_NEXT_DATA_POINT(tr, read, response);
+		STAGE_NEXT_DATA_POINT(tr, AS_STAGE_READ_RESPONSE);
 		HIST_TRACK_ACTIVATE_INSERT_DATA_POINT(tr, read_hist);
+		as_slow_txn_check(tr);
 		client_read_update_stats(tr->rsv.ns, tr->result_code);
 		break;
 	case FROM_PROXY:
@@ -268,10 +293,96 @@ send_read_response(as_transaction* tr, as_msg_op** ops, as_bin** response_bins,
 		break;
 	}
 
+	if (n_waiters != 0) {
+		send_read_response_waiters(tr, waiters, n_waiters, db, NULL, 0);
+	}
+
+	tr->from.any = NULL; // pattern, not needed
+}
+
+
+// Only client reads use iovec responses.
+void
+send_read_response_iov(as_transaction* tr, struct iovec* iov, uint32_t n_iov)
+{
+	// Paranoia - shouldn't get here on losing race with timeout.
+	if (! tr->from.any) {
+		cf_warning(AS_RW, "transaction origin %u has null 'from'", tr->origin);
+		return;
+	}
+
+	as_read_waiter* waiters;
+	uint32_t n_waiters = as_read_coalesce_detach(tr, &waiters);
+
+	// Sending advances iov - keep the original for any waiters.
+	struct iovec waiter_iov[n_waiters == 0 ? 0 : n_iov];
+
+	if (n_waiters != 0) {
+		for (uint32_t i = 0; i < n_iov; i++) {
+			waiter_iov[i] = iov[i];
+		}
+	}
+
+	BENCHMARK_NEXT_DATA_POINT(tr, read, local);
+	as_msg_send_iov_reply(tr->from.proto_fd_h, iov, n_iov);
+	BENCHMARK_NEXT_DATA_POINT(tr, read, response);
+	STAGE_NEXT_DATA_POINT(tr, AS_STAGE_READ_RESPONSE);
+	HIST_TRACK_ACTIVATE_INSERT_DATA_POINT(tr, read_hist);
+	as_slow_txn_check(tr);
+	client_read_update_stats(tr->rsv.ns, tr->result_code);
+
+	if (n_waiters != 0) {
+		send_read_response_waiters(tr, waiters, n_waiters, NULL, waiter_iov,
+				n_iov);
+	}
+
 	tr->from.any = NULL; // pattern, not needed
 }
 
 
+// Send a coalescing leader's response to the client reads attached to it.
+void
+send_read_response_waiters(as_transaction* tr, as_read_waiter* waiters,
+		uint32_t n_waiters, cf_dyn_buf* db, const struct iovec* iov,
+		uint32_t n_iov)
+{
+	as_namespace* ns = tr->rsv.ns;
+	uint16_t latency_set_id = as_transaction_latency_set_id(tr);
+
+	for (uint32_t i = 0; i < n_waiters; i++) {
+		as_file_handle* fd_h = waiters[i].fd_h;
+
+		if (n_iov != 0) {
+			struct iovec w_iov[n_iov];
+
+			for (uint32_t j = 0; j < n_iov; j++) {
+				w_iov[j] = iov[j];
+			}
+
+			as_msg_send_iov_reply(fd_h, w_iov, n_iov);
+		}
+		else if (db && db->used_sz != 0) {
+			as_msg_send_ops_reply(fd_h, db);
+		}
+		else {
+			as_msg_send_reply(fd_h, tr->result_code, tr->generation,
+					tr->void_time, NULL, NULL, 0, ns, 0, NULL);
+		}
+
+		ns->read_hist_active = true;
+		cf_hist_track_insert_data_point(ns->read_hist, waiters[i].start_time);
+
+		if (latency_set_id != INVALID_SET_ID) {
+			cf_hist_track_insert_data_point(ns->set_read_hists[latency_set_id],
+					waiters[i].start_time);
+		}
+		client_read_update_stats(ns, tr->result_code);
+	}
+
+	cf_free(waiters);
+}
+
+
 void
 read_timeout_cb(rw_request* rw)
 {
@@ -328,13 +439,22 @@ read_local(as_transaction* tr, bool stop_if_not_found)
 		return TRANS_DONE_ERROR;
 	}
 
+	STAGE_NEXT_DATA_POINT(tr, AS_STAGE_READ_LOCK);
+
 	as_record* r = r_ref.r;
 	as_storage_rd rd;
 
 	as_storage_record_open(ns, r, &rd, &tr->keyd);
 
+	// Don't spend a device read on a transaction that's already timed out.
+	if (! ns->storage_data_in_memory && as_transaction_is_past_deadline(tr)) {
+		cf_atomic64_incr(&ns->n_deadline_drops);
+		read_local_done(tr, &r_ref, &rd, AS_PROTO_RESULT_FAIL_TIMEOUT);
+		return TRANS_DONE_ERROR;
+	}
+
 	// Check if it's an expired record.
-	if (as_record_is_expired(r)) {
+	if (as_record_is_doomed(r, ns)) {
 		read_local_done(tr, &r_ref, &rd, AS_PROTO_RESULT_FAIL_NOTFOUND);
 		return TRANS_DONE_ERROR;
 	}
@@ -360,9 +480,22 @@ read_local(as_transaction* tr, bool stop_if_not_found)
 
 	as_bin stack_bins[ns->storage_data_in_memory ? 0 : rd.n_bins];
 
-	rd.bins = as_bin_get_all(r, &rd, stack_bins);
+	// For data-not-in-memory, load only the bins the ops ask for, if possible.
+	uint16_t read_ids[m->n_ops + 1];
+	uint16_t n_read_ids = 0;
+	bool projected = read_local_bin_ids(ns, m, read_ids, &n_read_ids);
 
-	if (! as_bin_inuse_has(&rd)) {
+	if (projected) {
+		rd.bins = as_bin_get_some(r, &rd, stack_bins, read_ids, n_read_ids);
+	}
+	else {
+		rd.bins = as_bin_get_all(r, &rd, stack_bins);
+	}
+
+	STAGE_NEXT_DATA_POINT(tr, AS_STAGE_READ_STORAGE);
+
+	// Note - with projection, requested bins may legitimately all be absent.
+	if (projected ? rd.n_bins == 0 : ! as_bin_inuse_has(&rd)) {
 		cf_warning_digest(AS_RW, &tr->keyd, "{%s} read_local: found record with no bins ", ns->name);
 		read_local_done(tr, &r_ref, &rd, AS_PROTO_RESULT_FAIL_NOTFOUND);
 		return TRANS_DONE_ERROR;
@@ -394,6 +527,11 @@ read_local(as_transaction* tr, bool stop_if_not_found)
 		bool respond_all_ops = (m->info2 & AS_MSG_INFO2_RESPOND_ALL_OPS) != 0;
 		int result;
 
+		// Many ops on a wide record - index the bins. Closing rd detaches.
+		if (m->n_ops > 1) {
+			as_bin_index_attach(&rd);
+		}
+
 		as_msg_op* op = 0;
 		int n = 0;
 
@@ -406,14 +544,23 @@ read_local(as_transaction* tr, bool stop_if_not_found)
 					response_bins[n_bins++] = b;
 				}
 			}
-			else if (op->op == AS_MSG_OP_CDT_READ) {
+			else if (op->op == AS_MSG_OP_CDT_READ ||
+					op->op == AS_MSG_OP_BLOB_READ) {
 				as_bin* b = as_bin_get_from_buf(&rd, op->name, op->name_sz);
 
 				if (b) {
 					as_bin* rb = &result_bins[n_result_bins];
 					as_bin_set_empty(rb);
 
-					if ((result = as_bin_cdt_read_from_client(b, op, rb)) < 0) {
+					if (op->op == AS_MSG_OP_BLOB_READ) {
+						if ((result = as_bin_blob_read_from_client(b, op, rb)) < 0) {
+							cf_warning_digest(AS_RW, &tr->keyd, "{%s} read_local: failed as_bin_blob_read_from_client() ", ns->name);
+							destroy_stack_bins(result_bins, n_result_bins);
+							read_local_done(tr, &r_ref, &rd, -result);
+							return TRANS_DONE_ERROR;
+						}
+					}
+					else if ((result = as_bin_cdt_read_from_client(b, op, rb)) < 0) {
 						cf_warning_digest(AS_RW, &tr->keyd, "{%s} read_local: failed as_bin_cdt_read_from_client() ", ns->name);
 						destroy_stack_bins(result_bins, n_result_bins);
 						read_local_done(tr, &r_ref, &rd, -result);
@@ -449,22 +596,49 @@ read_local(as_transaction* tr, bool stop_if_not_found)
 
 	cf_dyn_buf_define_size(db, 16 * 1024);
 
+	struct iovec iov[AS_MSG_RESPONSE_MAX_IOV];
+	uint32_t n_iov = 0;
+	uint8_t* held_block = NULL;
+
 	if (tr->origin != FROM_BATCH) {
 		db.used_sz = db.alloc_sz;
-		db.buf = (uint8_t*)as_msg_make_response_msg(tr->result_code,
-				r->generation, r->void_time, p_ops, response_bins, n_bins, ns,
-				(cl_msg*)dyn_bufdb, &db.used_sz, as_transaction_trid(tr),
-				set_name);
+
+		// Client reads of data-not-in-memory records keep the device read
+		// buffer past the record close, and send big values from it in place.
+		// (CDT read results are freed below, so don't reference those.)
+		if (tr->origin == FROM_CLIENT && n_result_bins == 0 &&
+				(held_block = as_storage_record_detach_block(&rd)) != NULL) {
+			db.buf = (uint8_t*)as_msg_make_response_iov(tr->result_code,
+					r->generation, r->void_time, p_ops, response_bins, n_bins,
+					ns, (cl_msg*)dyn_bufdb, &db.used_sz,
+					as_transaction_trid(tr), set_name, iov, &n_iov);
+		}
+		else {
+			db.buf = (uint8_t*)as_msg_make_response_msg(tr->result_code,
+					r->generation, r->void_time, p_ops, response_bins, n_bins,
+					ns, (cl_msg*)dyn_bufdb, &db.used_sz,
+					as_transaction_trid(tr), set_name);
+		}
 
 		if (! db.buf)	{
 			cf_warning_digest(AS_RW, &tr->keyd, "{%s} read_local: failed make response msg ", ns->name);
 			destroy_stack_bins(result_bins, n_result_bins);
 			read_local_done(tr, &r_ref, &rd, AS_PROTO_RESULT_FAIL_UNKNOWN);
+
+			if (held_block) {
+				cf_free(held_block);
+			}
+
 			return TRANS_DONE_ERROR;
 		}
 
 		db.is_stack = db.buf == dyn_bufdb;
-		// Note - not bothering to correct alloc_sz if buf was allocated.
+
+		// An allocated buf goes back to the pool, so mustn't overstate it.
+		if (! db.is_stack) {
+			db.alloc_sz = db.used_sz;
+			db.is_pooled = true;
+		}
 	}
 	else {
 		tr->generation = r->generation;
@@ -478,10 +652,20 @@ read_local(as_transaction* tr, bool stop_if_not_found)
 
 	destroy_stack_bins(result_bins, n_result_bins);
 	as_storage_record_close(r, &rd);
+
+	// No more reads may join once the record can change.
+	as_read_coalesce_close(tr);
 	as_record_done(&r_ref, ns);
 
 	// Now that we're not under the record lock, send the message we just built.
-	if (db.used_sz != 0) {
+	if (held_block) {
+		send_read_response_iov(tr, iov, n_iov);
+
+		cf_dyn_buf_free(&db);
+		cf_free(held_block);
+		tr->from.proto_fd_h = NULL;
+	}
+	else if (db.used_sz != 0) {
 		send_read_response(tr, NULL, NULL, 0, NULL, &db);
 
 		cf_dyn_buf_free(&db);
@@ -492,10 +676,62 @@ read_local(as_transaction* tr, bool stop_if_not_found)
 }
 
 
+// For data-not-in-memory reads of specific bins, collect the (unique) ids of
+// the bins to load from device. Returns false if all bins must be loaded.
+bool
+read_local_bin_ids(as_namespace* ns, as_msg* m, uint16_t* ids,
+		uint16_t* p_n_ids)
+{
+	if (ns->storage_type != AS_STORAGE_ENGINE_SSD ||
+			ns->storage_data_in_memory || ns->single_bin ||
+			(m->info1 & AS_MSG_INFO1_GET_ALL) != 0 || m->n_ops == 0) {
+		return false;
+	}
+
+	uint16_t n_ids = 0;
+	as_msg_op* op = 0;
+	int n = 0;
+
+	while ((op = as_msg_op_iterate(m, op, &n)) != NULL) {
+		if (op->op != AS_MSG_OP_READ && op->op != AS_MSG_OP_CDT_READ &&
+				op->op != AS_MSG_OP_BLOB_READ) {
+			// Let read_local() reject the op.
+			return false;
+		}
+
+		uint32_t id;
+
+		// A bin name never used in this namespace can't be in the record.
+		if (! as_bin_get_id_w_len(ns, op->name, op->name_sz, &id)) {
+			continue;
+		}
+
+		uint16_t i;
+
+		for (i = 0; i < n_ids; i++) {
+			if (ids[i] == (uint16_t)id) {
+				break;
+			}
+		}
+
+		if (i == n_ids) {
+			ids[n_ids++] = (uint16_t)id;
+		}
+	}
+
+	*p_n_ids = n_ids;
+
+	return true;
+}
+
+
 void
 read_local_done(as_transaction* tr, as_index_ref* r_ref, as_storage_rd* rd,
 		int result_code)
 {
+	// No more reads may join once the record can change.
+	as_read_coalesce_close(tr);
+
 	if (r_ref) {
 		if (rd) {
 			as_storage_record_close(r_ref->r, rd);
@@ -0,0 +1,369 @@
+/*
+ * read_coalesce.c
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/* SYNOPSIS
+ * Read coalescing for hot keys. The first eligible client read of a digest
+ * becomes the leader and does the index lookup and device read as usual.
+ * While it's in flight, later reads with an identical request attach to it as
+ * waiters, and the leader sends each of them its own response.
+ *
+ * Coalesced reads are concurrent with the leader, so the shared response is
+ * as valid for them as for the leader. Requests must match byte for byte past
+ * the as_msg header, so that the response is identical - reads with a trid or
+ * from XDR aren't coalesced, since their responses are request specific.
+ *
+ * Reads only join a leader that saw the same generation. An entry is closed -
+ * no more reads may join it - by its leader before it releases the record
+ * lock, and by any write or delete of the record before that is acked. So a
+ * read that starts after a write is acked never gets the old value.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "transaction/read_coalesce.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "citrusleaf/alloc.h"
+#include "citrusleaf/cf_atomic.h"
+#include "citrusleaf/cf_digest.h"
+
+#include "fault.h"
+#include "util.h"
+
+#include "base/cfg.h"
+#include "base/datamodel.h"
+#include "base/index.h"
+#include "base/proto.h"
+#include "base/transaction.h"
+
+
+//==========================================================
+// Constants.
+//
+
+#define RC_N_STRIPES		256
+#define RC_MIN_CAPACITY		8
+
+
+//==========================================================
+// Typedefs.
+//
+
+typedef struct rc_entry_s {
+	struct rc_entry_s*	next;
+	as_transaction*		leader;
+	as_namespace_id		ns_id;
+	bool				closed;
+	as_generation		generation; // 0 - record not found
+	cf_digest			keyd;
+	as_read_waiter*		waiters;
+	uint32_t			n_waiters;
+	uint32_t			capacity;
+} rc_entry;
+
+typedef struct rc_stripe_s {
+	pthread_mutex_t		lock;
+	rc_entry*			entries;
+} rc_stripe;
+
+
+//==========================================================
+// Globals.
+//
+
+static rc_stripe g_rc_stripes[RC_N_STRIPES];
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static bool is_eligible(as_transaction* tr);
+static as_generation peek_generation(as_transaction* tr);
+static bool requests_match(const as_transaction* tr0, const as_transaction* tr);
+static bool entry_add_waiter(rc_entry* e, as_transaction* tr);
+
+static inline rc_stripe*
+get_stripe(const cf_digest* keyd)
+{
+	return &g_rc_stripes[as_digest_spread_hash(keyd) % RC_N_STRIPES];
+}
+
+
+//==========================================================
+// Public API.
+//
+
+void
+as_read_coalesce_init()
+{
+	for (uint32_t i = 0; i < RC_N_STRIPES; i++) {
+		pthread_mutex_init(&g_rc_stripes[i].lock, NULL);
+		g_rc_stripes[i].entries = NULL;
+	}
+}
+
+
+// Returns true if the transaction was attached as a waiter - the caller must
+// then not respond, but is finished with the reservation and msgp. Otherwise
+// the caller reads as usual, and may have become a leader.
+bool
+as_read_coalesce_join(as_transaction* tr)
+{
+	if (! is_eligible(tr)) {
+		return false;
+	}
+
+	as_namespace* ns = tr->rsv.ns;
+	as_generation generation = peek_generation(tr);
+	rc_stripe* stripe = get_stripe(&tr->keyd);
+	rc_entry* e;
+
+	pthread_mutex_lock(&stripe->lock);
+
+	for (e = stripe->entries; e; e = e->next) {
+		if (! e->closed && e->ns_id == ns->id &&
+				e->generation == generation &&
+				cf_digest_compare(&e->keyd, &tr->keyd) == 0) {
+			break;
+		}
+	}
+
+	if (e) {
+		// Leader's msgp is valid while its entry is in the stripe.
+		bool attached = requests_match(e->leader, tr) &&
+				entry_add_waiter(e, tr);
+
+		pthread_mutex_unlock(&stripe->lock);
+
+		if (attached) {
+			cf_atomic64_incr(&ns->n_client_read_coalesced);
+		}
+
+		// If not attached, read independently - don't displace the leader.
+		return attached;
+	}
+
+	if (! (e = cf_malloc(sizeof(rc_entry)))) {
+		pthread_mutex_unlock(&stripe->lock);
+		return false;
+	}
+
+	e->leader = tr;
+	e->ns_id = ns->id;
+	e->closed = false;
+	e->generation = generation;
+	e->keyd = tr->keyd;
+	e->waiters = NULL;
+	e->n_waiters = 0;
+	e->capacity = 0;
+
+	e->next = stripe->entries;
+	stripe->entries = e;
+
+	pthread_mutex_unlock(&stripe->lock);
+
+	tr->flags |= AS_TRANSACTION_FLAG_COALESCE_LEADER;
+
+	return false;
+}
+
+
+// Leader calls this before it releases the record lock - no more reads can
+// attach after this.
+void
+as_read_coalesce_close(as_transaction* tr)
+{
+	if ((tr->flags & AS_TRANSACTION_FLAG_COALESCE_LEADER) == 0) {
+		return;
+	}
+
+	rc_stripe* stripe = get_stripe(&tr->keyd);
+
+	pthread_mutex_lock(&stripe->lock);
+
+	for (rc_entry* e = stripe->entries; e; e = e->next) {
+		if (e->leader == tr) {
+			e->closed = true;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&stripe->lock);
+}
+
+
+// Leader calls this (once) before responding. Returns the number of waiters,
+// in an allocation the caller must free - no more can attach after this.
+uint32_t
+as_read_coalesce_detach(as_transaction* tr, as_read_waiter** p_waiters)
+{
+	*p_waiters = NULL;
+
+	if ((tr->flags & AS_TRANSACTION_FLAG_COALESCE_LEADER) == 0) {
+		return 0;
+	}
+
+	tr->flags &= ~AS_TRANSACTION_FLAG_COALESCE_LEADER;
+
+	rc_stripe* stripe = get_stripe(&tr->keyd);
+	rc_entry** p_e;
+	rc_entry* e = NULL;
+
+	pthread_mutex_lock(&stripe->lock);
+
+	for (p_e = &stripe->entries; *p_e; p_e = &(*p_e)->next) {
+		if ((*p_e)->leader == tr) {
+			e = *p_e;
+			*p_e = e->next;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&stripe->lock);
+
+	if (! e) {
+		cf_warning_digest(AS_RW, &tr->keyd, "read coalesce leader not found ");
+		return 0;
+	}
+
+	uint32_t n_waiters = e->n_waiters;
+
+	*p_waiters = e->waiters;
+	cf_free(e);
+
+	return n_waiters;
+}
+
+
+// A write or delete of the record - reads that start from now on mustn't join
+// reads already in flight.
+void
+as_read_coalesce_close_digest(as_namespace* ns, cf_digest* keyd)
+{
+	rc_stripe* stripe = get_stripe(keyd);
+
+	pthread_mutex_lock(&stripe->lock);
+
+	for (rc_entry* e = stripe->entries; e; e = e->next) {
+		if (e->ns_id == ns->id && cf_digest_compare(&e->keyd, keyd) == 0) {
+			e->closed = true;
+		}
+	}
+
+	pthread_mutex_unlock(&stripe->lock);
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+static bool
+is_eligible(as_transaction* tr)
+{
+	as_namespace* ns = tr->rsv.ns;
+
+	return tr->origin == FROM_CLIENT && ns->read_coalescing &&
+			! ns->storage_data_in_memory && as_transaction_trid(tr) == 0 &&
+			! as_msg_is_xdr(&tr->msgp->msg);
+}
+
+
+// The record's generation without taking its lock - only the match key, the
+// leader reads the record under the lock as usual.
+static as_generation
+peek_generation(as_transaction* tr)
+{
+	as_index_ref r_ref;
+	r_ref.skip_lock = true;
+
+	if (as_record_get(tr->rsv.tree, &tr->keyd, &r_ref, tr->rsv.ns) != 0) {
+		return 0;
+	}
+
+	as_generation generation = r_ref.r->generation;
+
+	as_record_done(&r_ref, tr->rsv.ns);
+
+	return generation;
+}
+
+
+static bool
+requests_match(const as_transaction* tr0, const as_transaction* tr)
+{
+	const cl_msg* msgp0 = tr0->msgp;
+	const cl_msg* msgp = tr->msgp;
+
+	if (msgp0->proto.sz != msgp->proto.sz ||
+			msgp0->msg.info1 != msgp->msg.info1 ||
+			msgp0->msg.info2 != msgp->msg.info2 ||
+			msgp0->msg.info3 != msgp->msg.info3 ||
+			msgp0->msg.n_fields != msgp->msg.n_fields ||
+			msgp0->msg.n_ops != msgp->msg.n_ops) {
+		return false;
+	}
+
+	// Fields then ops - namespace, set, key, bin names, etc.
+	return memcmp(msgp0->msg.data, msgp->msg.data,
+			msgp->proto.sz - sizeof(as_msg)) == 0;
+}
+
+
+static bool
+entry_add_waiter(rc_entry* e, as_transaction* tr)
+{
+	// Past the hot key pending limit, make the transaction read for itself.
+	if (g_config.transaction_pending_limit != 0 &&
+			e->n_waiters >= g_config.transaction_pending_limit) {
+		return false;
+	}
+
+	if (e->n_waiters == e->capacity) {
+		uint32_t capacity = e->capacity == 0 ?
+				RC_MIN_CAPACITY : e->capacity * 2;
+		as_read_waiter* resized = cf_realloc(e->waiters,
+				capacity * sizeof(as_read_waiter));
+
+		if (! resized) {
+			return false;
+		}
+
+		e->waiters = resized;
+		e->capacity = capacity;
+	}
+
+	as_read_waiter* w = &e->waiters[e->n_waiters++];
+
+	w->fd_h = tr->from.proto_fd_h;
+	w->start_time = tr->start_time;
+
+	return true;
+}
@@ -0,0 +1,470 @@
+/*
+ * repl_log.c
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/* SYNOPSIS
+ * Asynchronous replication. For a namespace with async-replication set, the
+ * master doesn't keep an rw_request until the replicas ack - a write's replica
+ * write message is flattened onto a log per namespace and destination node,
+ * and the transaction is finished. The log is a list of batches, streamed to
+ * the destination one RW_OP_WRITE_ASYNC_BATCH at a time - the next batch goes
+ * when the prole acks the current one, so batches grow with load and arrive in
+ * order. An unacked batch is retransmitted as is - the prole applying it again
+ * is harmless, since nothing newer was sent meanwhile.
+ *
+ * When a destination's unacked bytes reach async-replication-max-lag, new
+ * writes to the partitions it replicates are refused until it catches up. A
+ * destination that leaves the cluster has its log dropped - migration brings
+ * its replicas up to date if it returns.
+ *
+ * A write that can't be logged for every destination - no slot, or no memory
+ * for a batch - falls back to synchronous replication. Destinations it was
+ * already logged for may apply it twice, which is harmless, as for a
+ * retransmit.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "transaction/repl_log.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "citrusleaf/alloc.h"
+#include "citrusleaf/cf_atomic.h"
+#include "citrusleaf/cf_clock.h"
+
+#include "fault.h"
+#include "msg.h"
+#include "util.h"
+
+#include "base/cfg.h"
+#include "base/datamodel.h"
+#include "base/transaction.h"
+#include "fabric/fabric.h"
+#include "fabric/hb.h"
+#include "fabric/node_slots.h"
+#include "transaction/replica_write.h"
+#include "transaction/rw_request.h"
+#include "transaction/rw_request_hash.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+#define RL_MAX_NODES		AS_CLUSTER_SZ
+#define RL_BATCH_SZ			(1024 * 256)
+#define RL_STREAM_PERIOD_us	1000
+#define RL_RETRANSMIT_MS	200
+
+typedef struct rl_batch_s {
+	struct rl_batch_s*	next;
+	uint64_t			oldest_ms; // when its first write was logged
+	size_t				sz;
+	size_t				alloc_sz;
+	uint8_t				buf[];
+} rl_batch;
+
+typedef struct rl_slot_s {
+	as_node_slot	base;
+
+	// Oldest batch first - the head may be in flight, the tail is appended to.
+	rl_batch*		head;
+	rl_batch*		tail;
+	bool			head_in_flight;
+	uint32_t		head_seq;
+	uint64_t		head_sent_ms;
+	uint32_t		next_seq;
+
+	uint64_t		lag_bytes; // written under lock, read without
+} rl_slot;
+
+typedef struct rl_ns_slots_s {
+	rl_slot			slots[RL_MAX_NODES];
+	as_node_slots	table;
+} rl_ns_slots;
+
+
+//==========================================================
+// Globals.
+//
+
+static rl_ns_slots g_rl[AS_NAMESPACE_SZ];
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static inline as_node_slots* ns_slots(const as_namespace* ns);
+static bool slot_reclaim(void* pv_slot);
+static bool append(as_namespace* ns, rl_slot* slot, const msg* m, size_t sz, uint64_t now);
+static void* run_stream(void* arg);
+static void send_head(const as_namespace* ns, rl_slot* slot, uint64_t now);
+static void drop_all(as_namespace* ns, rl_slot* slot);
+
+
+//==========================================================
+// Public API.
+//
+
+void
+repl_log_init()
+{
+	pthread_t thread;
+	pthread_attr_t attrs;
+
+	for (uint32_t i = 0; i < AS_NAMESPACE_SZ; i++) {
+		as_node_slots_init(&g_rl[i].table, g_rl[i].slots, sizeof(rl_slot),
+				RL_MAX_NODES, slot_reclaim);
+	}
+
+	pthread_attr_init(&attrs);
+	pthread_attr_setdetachstate(&attrs, PTHREAD_CREATE_DETACHED);
+
+	// Always started - async-replication is dynamic.
+	if (pthread_create(&thread, &attrs, run_stream, NULL) != 0) {
+		cf_crash(AS_RW, "failed to create async replication thread");
+	}
+}
+
+
+bool
+repl_log_is_full(as_transaction* tr)
+{
+	as_namespace* ns = tr->rsv.ns;
+
+	if (! ns->async_replication || tr->origin == FROM_NSUP) {
+		return false;
+	}
+
+	cf_node nodes[AS_CLUSTER_SZ];
+	int n_nodes = as_partition_getreplica_readall(ns, tr->rsv.pid, nodes);
+
+	for (int i = 0; i < n_nodes; i++) {
+		rl_slot* slot = as_node_slots_find(ns_slots(ns), nodes[i]);
+
+		if (slot && slot->lag_bytes >= ns->async_replication_max_lag) {
+			cf_atomic64_incr(&ns->n_async_repl_rejected);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+bool
+repl_log_write(rw_request* rw, as_transaction* tr)
+{
+	as_namespace* ns = tr->rsv.ns;
+
+	// LDT multi-ops need their acks - keep them synchronous.
+	if (! ns->async_replication || ns->ldt_enabled || rw->is_multiop) {
+		return false;
+	}
+
+	if (! repl_write_make_message(rw, tr)) {
+		return false;
+	}
+
+	size_t sz = msg_get_wire_size(rw->dest_msg);
+	uint64_t now = cf_getms();
+
+	for (int i = 0; i < rw->n_dest_nodes; i++) {
+		rl_slot* slot = as_node_slots_lock(ns_slots(ns), rw->dest_nodes[i],
+				true);
+
+		if (! slot) {
+			cf_detail(AS_RW, "{%s} async replication: no slot for node %lx",
+					ns->name, rw->dest_nodes[i]);
+			cf_atomic64_incr(&ns->n_async_repl_fallbacks);
+			return false;
+		}
+
+		bool ok = append(ns, slot, rw->dest_msg, sz, now);
+
+		pthread_mutex_unlock(&slot->base.lock);
+
+		if (! ok) {
+			cf_atomic64_incr(&ns->n_async_repl_fallbacks);
+			return false;
+		}
+	}
+
+	cf_atomic64_incr(&ns->n_async_repl_writes);
+
+	return true;
+}
+
+
+void
+repl_log_handle_ack(cf_node node, msg* m)
+{
+	uint32_t ns_id;
+	uint32_t seq;
+
+	if (msg_get_uint32(m, RW_FIELD_NS_ID, &ns_id) != 0 ||
+			msg_get_uint32(m, RW_FIELD_TID, &seq) != 0) {
+		cf_warning(AS_RW, "async replication ack: missing fields");
+		as_fabric_msg_put(m);
+		return;
+	}
+
+	as_fabric_msg_put(m);
+
+	as_namespace* ns = as_namespace_get_byid(ns_id);
+	rl_slot* slot = ns ? as_node_slots_lock(ns_slots(ns), node, false) : NULL;
+
+	if (! slot) {
+		return;
+	}
+
+	// A stale ack, e.g. for a retransmitted batch, is ignored.
+	if (slot->head_in_flight && slot->head_seq == seq) {
+		rl_batch* acked = slot->head;
+
+		slot->head = acked->next;
+
+		if (! slot->head) {
+			slot->tail = NULL;
+		}
+
+		slot->head_in_flight = false;
+		slot->lag_bytes -= acked->sz;
+		cf_free(acked);
+
+		// Don't wait for the stream thread - this is what batches under load.
+		if (slot->head) {
+			send_head(ns, slot, cf_getms());
+		}
+	}
+
+	pthread_mutex_unlock(&slot->base.lock);
+}
+
+
+void
+repl_log_get_lag(const as_namespace* ns, uint64_t* p_lag_bytes,
+		uint64_t* p_lag_ms)
+{
+	as_node_slots* table = ns_slots(ns);
+	uint32_t n_slots = as_node_slots_count(table);
+	uint64_t now = cf_getms();
+	uint64_t lag_bytes = 0;
+	uint64_t lag_ms = 0;
+
+	for (uint32_t i = 0; i < n_slots; i++) {
+		rl_slot* slot = as_node_slots_at(table, i);
+
+		pthread_mutex_lock(&slot->base.lock);
+
+		lag_bytes += slot->lag_bytes;
+
+		if (slot->head && now > slot->head->oldest_ms &&
+				now - slot->head->oldest_ms > lag_ms) {
+			lag_ms = now - slot->head->oldest_ms;
+		}
+
+		pthread_mutex_unlock(&slot->base.lock);
+	}
+
+	*p_lag_bytes = lag_bytes;
+	*p_lag_ms = lag_ms;
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+static inline as_node_slots*
+ns_slots(const as_namespace* ns)
+{
+	return &g_rl[ns->id - 1].table;
+}
+
+
+// Call under the slot lock. A departed node's log is dropped by the stream
+// thread - until then the slot isn't empty.
+static bool
+slot_reclaim(void* pv_slot)
+{
+	rl_slot* slot = (rl_slot*)pv_slot;
+
+	if (slot->head) {
+		return false;
+	}
+
+	slot->head_in_flight = false;
+	slot->head_seq = 0;
+	slot->head_sent_ms = 0;
+	slot->next_seq = 0;
+	slot->lag_bytes = 0;
+
+	return true;
+}
+
+
+// Call under the slot lock. Returns false if the write couldn't be logged.
+static bool
+append(as_namespace* ns, rl_slot* slot, const msg* m, size_t sz, uint64_t now)
+{
+	rl_batch* batch = slot->tail;
+
+	// An in-flight batch must go out again exactly as it was.
+	if (! batch || batch->sz + sz > batch->alloc_sz ||
+			(batch == slot->head && slot->head_in_flight)) {
+		size_t alloc_sz = sz > RL_BATCH_SZ ? sz : RL_BATCH_SZ;
+
+		if (! (batch = cf_malloc(sizeof(rl_batch) + alloc_sz))) {
+			cf_warning(AS_RW, "{%s} async replication: can't allocate batch",
+					ns->name);
+			return false;
+		}
+
+		batch->next = NULL;
+		batch->oldest_ms = now;
+		batch->sz = 0;
+		batch->alloc_sz = alloc_sz;
+
+		if (slot->tail) {
+			slot->tail->next = batch;
+		}
+		else {
+			slot->head = batch;
+		}
+
+		slot->tail = batch;
+	}
+
+	msg_fillbuf(m, batch->buf + batch->sz, &sz);
+	batch->sz += sz;
+	slot->lag_bytes += sz;
+
+	return true;
+}
+
+
+static void*
+run_stream(void* arg)
+{
+	while (true) {
+		usleep(RL_STREAM_PERIOD_us);
+
+		uint64_t now = cf_getms();
+
+		for (uint32_t ns_ix = 0; ns_ix < g_config.n_namespaces; ns_ix++) {
+			as_namespace* ns = g_config.namespaces[ns_ix];
+			as_node_slots* table = ns_slots(ns);
+			uint32_t n_slots = as_node_slots_count(table);
+
+			for (uint32_t i = 0; i < n_slots; i++) {
+				rl_slot* slot = as_node_slots_at(table, i);
+				cf_node node = slot->base.node;
+				uint64_t lasttime;
+				bool node_gone = as_fabric_get_node_lasttime(node,
+						&lasttime) != 0;
+
+				pthread_mutex_lock(&slot->base.lock);
+
+				// If the slot was reassigned meanwhile, catch it next time.
+				if (slot->base.node != node) {
+					pthread_mutex_unlock(&slot->base.lock);
+					continue;
+				}
+
+				if (node_gone) {
+					drop_all(ns, slot);
+				}
+				else if (slot->head && (! slot->head_in_flight ||
+						now - slot->head_sent_ms >= RL_RETRANSMIT_MS)) {
+					send_head(ns, slot, now);
+				}
+
+				pthread_mutex_unlock(&slot->base.lock);
+			}
+		}
+	}
+
+	return NULL;
+}
+
+
+// Call under the slot lock.
+static void
+send_head(const as_namespace* ns, rl_slot* slot, uint64_t now)
+{
+	rl_batch* batch = slot->head;
+
+	if (! slot->head_in_flight) {
+		slot->head_in_flight = true;
+		slot->head_seq = slot->next_seq++;
+	}
+
+	slot->head_sent_ms = now;
+
+	msg* m = as_fabric_msg_get(M_TYPE_RW);
+
+	if (! m) {
+		// Will be retransmitted.
+		return;
+	}
+
+	msg_set_uint32(m, RW_FIELD_OP, RW_OP_WRITE_ASYNC_BATCH);
+	msg_set_uint32(m, RW_FIELD_NS_ID, ns->id);
+	msg_set_uint32(m, RW_FIELD_TID, slot->head_seq);
+	msg_set_buf(m, RW_FIELD_BATCH, batch->buf, batch->sz, MSG_SET_COPY);
+
+	if (as_fabric_send(slot->base.node, m, AS_FABRIC_PRIORITY_MEDIUM) !=
+			AS_FABRIC_SUCCESS) {
+		as_fabric_msg_put(m);
+	}
+}
+
+
+// Call under the slot lock.
+static void
+drop_all(as_namespace* ns, rl_slot* slot)
+{
+	if (! slot->head) {
+		return;
+	}
+
+	cf_atomic64_add(&ns->n_async_repl_dropped_bytes, slot->lag_bytes);
+
+	while (slot->head) {
+		rl_batch* batch = slot->head;
+
+		slot->head = batch->next;
+		cf_free(batch);
+	}
+
+	slot->tail = NULL;
+	slot->head_in_flight = false;
+	slot->lag_bytes = 0;
+}
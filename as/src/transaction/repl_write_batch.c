@@ -0,0 +1,269 @@
+/*
+ * repl_write_batch.c
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/* SYNOPSIS
+ * Group commit for replica writes. If replica-write-batch-us is configured,
+ * replica write messages to a node are flattened into that node's batch
+ * buffer instead of being sent one by one. A batch is sent as a single
+ * RW_OP_WRITE_BATCH fabric message when it reaches a size limit, or when the
+ * flush thread next runs. The prole applies the embedded writes in order and
+ * answers with a single RW_OP_WRITE_BATCH_ACK holding the individual acks.
+ *
+ * Embedded messages are ordinary RW_OP_WRITE messages, so the prole and ack
+ * handling are unchanged per write. A lost batch is covered, as for a lost
+ * single message, by the rw_request retransmit.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "transaction/repl_write_batch.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "citrusleaf/alloc.h"
+#include "citrusleaf/cf_atomic.h"
+
+#include "fault.h"
+#include "msg.h"
+#include "util.h"
+
+#include "base/cfg.h"
+#include "fabric/fabric.h"
+#include "fabric/hb.h"
+#include "fabric/node_slots.h"
+#include "transaction/rw_request_hash.h"
+
+
+//==========================================================
+// Constants.
+//
+
+#define RB_MAX_NODES		AS_CLUSTER_SZ
+#define RB_FLUSH_SZ			(1024 * 64)
+
+
+//==========================================================
+// Typedefs.
+//
+
+typedef struct rb_slot_s {
+	as_node_slot	base;
+	uint8_t*		buf;
+	size_t			used_sz;
+	size_t			alloc_sz;
+} rb_slot;
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static void* run_flush(void* arg);
+static void slot_take(rb_slot* slot, uint8_t** p_buf, size_t* p_sz);
+static bool slot_reclaim(void* pv_slot);
+static void send_batch(cf_node node, uint8_t* buf, size_t sz);
+
+
+//==========================================================
+// Globals.
+//
+
+static rb_slot g_rb_slot_array[RB_MAX_NODES];
+static as_node_slots g_rb_slots = AS_NODE_SLOTS_INIT(g_rb_slot_array,
+		RB_MAX_NODES, slot_reclaim);
+
+
+//==========================================================
+// Public API.
+//
+
+void
+repl_write_batch_init()
+{
+	if (g_config.replica_write_batch_us == 0) {
+		return;
+	}
+
+	pthread_t thread;
+	pthread_attr_t attrs;
+
+	pthread_attr_init(&attrs);
+	pthread_attr_setdetachstate(&attrs, PTHREAD_CREATE_DETACHED);
+
+	if (pthread_create(&thread, &attrs, run_flush, NULL) != 0) {
+		cf_crash(AS_RW, "failed to create replica write batch thread");
+	}
+}
+
+
+// Call under the rw_request lock. Returns AS_FABRIC_SUCCESS if the message is
+// batched, AS_FABRIC_ERR_NO_NODE if the node is gone, or another error if the
+// caller must send the message directly.
+int
+repl_write_batch_add(cf_node node, const msg* m)
+{
+	uint64_t lasttime;
+
+	// Batched sends are asynchronous - find out now if the node is gone.
+	if (as_fabric_get_node_lasttime(node, &lasttime) != 0) {
+		return AS_FABRIC_ERR_NO_NODE;
+	}
+
+	rb_slot* slot = as_node_slots_lock(&g_rb_slots, node, true);
+
+	if (! slot) {
+		return AS_FABRIC_ERR_QUEUE_FULL;
+	}
+
+	size_t sz = msg_get_wire_size(m);
+
+	if (slot->used_sz + sz > slot->alloc_sz) {
+		size_t alloc_sz = slot->used_sz + sz > RB_FLUSH_SZ ?
+				slot->used_sz + sz : RB_FLUSH_SZ;
+		uint8_t* buf = cf_realloc(slot->buf, alloc_sz);
+
+		if (! buf) {
+			pthread_mutex_unlock(&slot->base.lock);
+			return AS_FABRIC_ERR_UNKNOWN;
+		}
+
+		slot->buf = buf;
+		slot->alloc_sz = alloc_sz;
+	}
+
+	msg_fillbuf(m, slot->buf + slot->used_sz, &sz);
+	slot->used_sz += sz;
+
+	uint8_t* full_buf = NULL;
+	size_t full_sz = 0;
+
+	if (slot->used_sz >= RB_FLUSH_SZ) {
+		slot_take(slot, &full_buf, &full_sz);
+	}
+
+	pthread_mutex_unlock(&slot->base.lock);
+
+	if (full_buf) {
+		send_batch(node, full_buf, full_sz);
+	}
+
+	return AS_FABRIC_SUCCESS;
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+static void*
+run_flush(void* arg)
+{
+	while (true) {
+		usleep(g_config.replica_write_batch_us);
+
+		uint32_t n_slots = as_node_slots_count(&g_rb_slots);
+
+		for (uint32_t i = 0; i < n_slots; i++) {
+			rb_slot* slot = as_node_slots_at(&g_rb_slots, i);
+			uint8_t* buf = NULL;
+			size_t sz = 0;
+
+			pthread_mutex_lock(&slot->base.lock);
+
+			cf_node node = slot->base.node;
+
+			slot_take(slot, &buf, &sz);
+			pthread_mutex_unlock(&slot->base.lock);
+
+			if (buf) {
+				send_batch(node, buf, sz);
+			}
+		}
+	}
+
+	return NULL;
+}
+
+
+static void
+slot_take(rb_slot* slot, uint8_t** p_buf, size_t* p_sz)
+{
+	if (slot->used_sz == 0) {
+		return;
+	}
+
+	*p_buf = slot->buf;
+	*p_sz = slot->used_sz;
+
+	slot->buf = NULL;
+	slot->used_sz = 0;
+	slot->alloc_sz = 0;
+}
+
+
+// Call under the slot lock. A departed node's last batch is still sent (and
+// fails) on the next flush - until then the slot isn't empty.
+static bool
+slot_reclaim(void* pv_slot)
+{
+	rb_slot* slot = (rb_slot*)pv_slot;
+
+	if (slot->used_sz != 0) {
+		return false;
+	}
+
+	if (slot->buf) {
+		cf_free(slot->buf);
+		slot->buf = NULL;
+	}
+
+	slot->alloc_sz = 0;
+
+	return true;
+}
+
+
+static void
+send_batch(cf_node node, uint8_t* buf, size_t sz)
+{
+	msg* m = as_fabric_msg_get(M_TYPE_RW);
+
+	if (! m) {
+		// Retransmits will re-batch these writes.
+		cf_free(buf);
+		return;
+	}
+
+	msg_set_uint32(m, RW_FIELD_OP, RW_OP_WRITE_BATCH);
+	msg_set_buf(m, RW_FIELD_BATCH, buf, sz, MSG_SET_HANDOFF_MALLOC);
+
+	if (as_fabric_send(node, m, AS_FABRIC_PRIORITY_MEDIUM) !=
+			AS_FABRIC_SUCCESS) {
+		as_fabric_msg_put(m);
+	}
+}
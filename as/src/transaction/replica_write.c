@@ -35,12 +35,16 @@
 #include "citrusleaf/cf_clock.h"
 #include "citrusleaf/cf_digest.h"
 
+#include "dynbuf.h"
 #include "fault.h"
 #include "msg.h"
 #include "util.h"
 
+#include "base/as_stap.h"
 #include "base/cfg.h"
 #include "base/datamodel.h"
+#include "base/expire_index.h"
+#include "base/incr_hist.h"
 #include "base/index.h"
 #include "base/ldt.h"
 #include "base/proto.h"
@@ -48,6 +52,8 @@
 #include "base/transaction.h"
 #include "fabric/fabric.h"
 #include "fabric/migrate.h" // for LDTs
+#include "fabric/partition_changelog.h"
+#include "transaction/read_coalesce.h"
 #include "transaction/rw_request.h"
 #include "transaction/rw_request_hash.h"
 #include "transaction/rw_utils.h"
@@ -72,6 +78,8 @@ typedef struct ldt_prole_info_s {
 
 uint32_t pack_info_bits(as_transaction* tr, bool has_udf);
 uint32_t pack_ldt_info_bits(as_transaction* tr, bool is_parent, bool is_sub);
+uint32_t apply_repl_write(cf_node node, msg* m);
+void set_repl_write_ack(msg* m, uint32_t result);
 void send_repl_write_ack(cf_node node, msg* m, uint32_t result);
 void send_multiop_ack(cf_node node, msg* m, uint32_t result);
 bool handle_multiop_subop(cf_node node, msg* m, as_partition_reservation* rsv,
@@ -91,6 +99,9 @@ int write_replica(as_partition_reservation* rsv, cf_digest* keyd,
 		const as_rec_props* p_rec_props, as_generation generation,
 		uint32_t void_time, uint64_t last_update_time, cf_node master,
 		uint32_t info, ldt_prole_info* linfo);
+bool touch_replica_index_only(as_partition_reservation* rsv, as_record* r,
+		as_generation generation, uint32_t void_time,
+		uint64_t last_update_time);
 
 
 //==========================================================
@@ -202,6 +213,8 @@ repl_write_setup_rw(rw_request* rw, as_transaction* tr,
 
 	rw->start_time = tr->start_time;
 	rw->benchmark_time = tr->benchmark_time;
+	rw->stage_time = tr->stage_time;
+	memcpy(rw->stage_us, tr->stage_us, sizeof(rw->stage_us));
 
 	as_partition_reservation_copy(&rw->rsv, &tr->rsv);
 	// Hereafter, rw_request must release reservation - happens in destructor.
@@ -220,6 +233,8 @@ repl_write_setup_rw(rw_request* rw, as_transaction* tr,
 		rw->dest_complete[i] = false;
 	}
 
+	rw_request_hash_schedule(rw);
+
 	// Allow retransmit thread to destroy rw_request as soon as we unlock.
 	rw->is_set_up = true;
 }
@@ -235,6 +250,8 @@ repl_write_reset_rw(rw_request* rw, as_transaction* tr, repl_write_done_cb cb)
 	// Needed for response to origin.
 	rw->generation = tr->generation;
 	rw->void_time = tr->void_time;
+	rw->stage_time = tr->stage_time;
+	memcpy(rw->stage_us, tr->stage_us, sizeof(rw->stage_us));
 
 	rw->repl_write_cb = cb;
 
@@ -251,126 +268,7 @@ repl_write_reset_rw(rw_request* rw, as_transaction* tr, repl_write_done_cb cb)
 void
 repl_write_handle_op(cf_node node, msg* m)
 {
-	uint8_t* ns_name;
-	size_t ns_name_len;
-
-	if (msg_get_buf(m, RW_FIELD_NAMESPACE, &ns_name, &ns_name_len,
-			MSG_GET_DIRECT) != 0) {
-		cf_warning(AS_RW, "repl_write_handle_op: no namespace");
-		send_repl_write_ack(node, m, AS_PROTO_RESULT_FAIL_UNKNOWN);
-		return;
-	}
-
-	as_namespace* ns = as_namespace_get_bybuf(ns_name, ns_name_len);
-
-	if (! ns) {
-		cf_warning(AS_RW, "repl_write_handle_op: invalid namespace");
-		send_repl_write_ack(node, m, AS_PROTO_RESULT_FAIL_UNKNOWN);
-		return;
-	}
-
-	cf_digest* keyd;
-	size_t sz;
-
-	if (msg_get_buf(m, RW_FIELD_DIGEST, (uint8_t**)&keyd, &sz,
-			MSG_GET_DIRECT) != 0) {
-		cf_warning(AS_RW, "repl_write_handle_op: no digest");
-		send_repl_write_ack(node, m, AS_PROTO_RESULT_FAIL_UNKNOWN);
-		return;
-	}
-
-	as_partition_reservation rsv;
-
-	as_partition_reserve_migrate(ns, as_partition_getid(*keyd), &rsv, NULL);
-
-	if (rsv.state == AS_PARTITION_STATE_ABSENT) {
-		as_partition_release(&rsv);
-		send_repl_write_ack(node, m, AS_PROTO_RESULT_FAIL_CLUSTER_KEY_MISMATCH);
-		return;
-	}
-
-	uint32_t info = 0;
-
-	msg_get_uint32(m, RW_FIELD_INFO, &info);
-
-	ldt_prole_info linfo;
-
-	if ((info & RW_INFO_LDT) != 0 && ! ldt_get_info(&linfo, m, &rsv)) {
-		cf_warning(AS_RW, "repl_write_handle_op: bad ldt info");
-		as_partition_release(&rsv);
-		send_repl_write_ack(node, m, AS_PROTO_RESULT_FAIL_UNKNOWN);
-		return;
-	}
-
-	cl_msg* msgp;
-	size_t msgp_sz;
-
-	uint8_t* pickled_buf;
-	size_t pickled_sz;
-
-	uint32_t result;
-
-	if (msg_get_buf(m, RW_FIELD_AS_MSG, (uint8_t**)&msgp, &msgp_sz,
-			MSG_GET_DIRECT) == 0) {
-		// <><><><><><>  Delete Operation  <><><><><><>
-
-		// TODO - does this really need to be here? Just to fill linfo?
-		if (! ldt_get_prole_version(&rsv, keyd, &linfo, info, NULL, false)) {
-			as_partition_release(&rsv);
-			send_repl_write_ack(node, m, AS_PROTO_RESULT_OK); // ???
-			return;
-		}
-
-		result = delete_replica(&rsv, keyd,
-				(info & (RW_INFO_LDT_SUBREC | RW_INFO_LDT_ESR)) != 0,
-				(info & RW_INFO_NSUP_DELETE) != 0,
-				as_msg_is_xdr(&msgp->msg),
-				node);
-	}
-	else if (msg_get_buf(m, RW_FIELD_RECORD, (uint8_t**)&pickled_buf,
-			&pickled_sz, MSG_GET_DIRECT) == 0) {
-		// <><><><><><>  Write Pickle  <><><><><><>
-
-		as_generation generation;
-
-		if (msg_get_uint32(m, RW_FIELD_GENERATION, &generation) != 0) {
-			cf_warning(AS_RW, "repl_write_handle_op: no generation");
-			as_partition_release(&rsv);
-			send_repl_write_ack(node, m, AS_PROTO_RESULT_FAIL_UNKNOWN);
-			return;
-		}
-
-		uint32_t void_time;
-
-		if (msg_get_uint32(m, RW_FIELD_VOID_TIME, &void_time) != 0) {
-			cf_warning(AS_RW, "repl_write_handle_op: no void-time");
-			as_partition_release(&rsv);
-			send_repl_write_ack(node, m, AS_PROTO_RESULT_FAIL_UNKNOWN);
-			return;
-		}
-
-		uint64_t last_update_time = 0;
-
-		// Optional - older versions won't send it.
-		msg_get_uint64(m, RW_FIELD_LAST_UPDATE_TIME, &last_update_time);
-
-		as_rec_props rec_props;
-		size_t rec_props_size = 0;
-
-		msg_get_buf(m, RW_FIELD_REC_PROPS, &rec_props.p_data, &rec_props_size,
-				MSG_GET_DIRECT);
-		rec_props.size = (uint32_t)rec_props_size;
-
-		result = write_replica(&rsv, keyd, pickled_buf, pickled_sz, &rec_props,
-				generation, void_time, last_update_time, node, info, &linfo);
-	}
-	else {
-		cf_warning(AS_RW, "repl_write_handle_op: no msg or pickle");
-		result = AS_PROTO_RESULT_FAIL_UNKNOWN;
-	}
-
-	as_partition_release(&rsv);
-	send_repl_write_ack(node, m, result);
+	send_repl_write_ack(node, m, apply_repl_write(node, m));
 }
 
 
@@ -413,6 +311,8 @@ repl_write_handle_ack(cf_node node, msg* m)
 		return;
 	}
 
+	ASD_REPL_WRITE_ACK(tid, node, result_code);
+
 	rw_request_hkey hkey = { ns_id, *keyd };
 	rw_request* rw = rw_request_hash_get(&hkey);
 
@@ -491,6 +391,195 @@ repl_write_handle_ack(cf_node node, msg* m)
 }
 
 
+// Apply each write in a batch, and answer with one message holding the acks.
+void
+repl_write_handle_batch(cf_node node, msg* m)
+{
+	uint8_t* buf;
+	size_t sz;
+
+	if (msg_get_buf(m, RW_FIELD_BATCH, &buf, &sz, MSG_GET_DIRECT) != 0) {
+		cf_warning(AS_RW, "repl-write batch: no batch");
+		as_fabric_msg_put(m);
+		return;
+	}
+
+	msg* op_msg = as_fabric_msg_get(M_TYPE_RW);
+
+	if (! op_msg) {
+		// Master will retransmit.
+		as_fabric_msg_put(m);
+		return;
+	}
+
+	cf_dyn_buf_define_size(db, 16 * 1024);
+
+	const uint8_t* end = buf + sz;
+
+	while (buf < end) {
+		uint32_t op_sz;
+		msg_type type;
+
+		if (msg_get_initial(&op_sz, &type, buf, (uint32_t)(end - buf)) != 0 ||
+				op_sz > (uint32_t)(end - buf) ||
+				msg_parse(op_msg, buf, op_sz) != 0) {
+			cf_warning(AS_RW, "repl-write batch: bad embedded msg");
+			break;
+		}
+
+		set_repl_write_ack(op_msg, apply_repl_write(node, op_msg));
+
+		size_t ack_sz = msg_get_wire_size(op_msg);
+		uint8_t* ack_buf;
+
+		if (cf_dyn_buf_reserve(&db, ack_sz, &ack_buf) != 0) {
+			// Master will retransmit the writes we can't ack.
+			break;
+		}
+
+		msg_fillbuf(op_msg, ack_buf, &ack_sz);
+		msg_reset(op_msg);
+
+		buf += op_sz;
+	}
+
+	as_fabric_msg_put(op_msg);
+	as_fabric_msg_put(m);
+
+	if (db.used_sz == 0) {
+		cf_dyn_buf_free(&db);
+		return;
+	}
+
+	msg* ack = as_fabric_msg_get(M_TYPE_RW);
+
+	if (ack) {
+		msg_set_uint32(ack, RW_FIELD_OP, RW_OP_WRITE_BATCH_ACK);
+		msg_set_buf(ack, RW_FIELD_BATCH, db.buf, db.used_sz, MSG_SET_COPY);
+
+		if (as_fabric_send(node, ack, AS_FABRIC_PRIORITY_MEDIUM) !=
+				AS_FABRIC_SUCCESS) {
+			as_fabric_msg_put(ack);
+		}
+	}
+
+	cf_dyn_buf_free(&db);
+}
+
+
+void
+repl_write_handle_batch_ack(cf_node node, msg* m)
+{
+	uint8_t* buf;
+	size_t sz;
+
+	if (msg_get_buf(m, RW_FIELD_BATCH, &buf, &sz, MSG_GET_DIRECT) != 0) {
+		cf_warning(AS_RW, "repl-write batch ack: no batch");
+		as_fabric_msg_put(m);
+		return;
+	}
+
+	const uint8_t* end = buf + sz;
+
+	while (buf < end) {
+		uint32_t ack_sz;
+		msg_type type;
+
+		if (msg_get_initial(&ack_sz, &type, buf, (uint32_t)(end - buf)) != 0 ||
+				ack_sz > (uint32_t)(end - buf)) {
+			cf_warning(AS_RW, "repl-write batch ack: bad embedded msg");
+			break;
+		}
+
+		msg* ack = as_fabric_msg_get(M_TYPE_RW);
+
+		if (! ack) {
+			break;
+		}
+
+		if (msg_parse(ack, buf, ack_sz) != 0) {
+			cf_warning(AS_RW, "repl-write batch ack: bad embedded msg");
+			as_fabric_msg_put(ack);
+			break;
+		}
+
+		// Handles the ack exactly as if it had arrived on its own, and puts it.
+		repl_write_handle_ack(node, ack);
+
+		buf += ack_sz;
+	}
+
+	as_fabric_msg_put(m);
+}
+
+
+// Apply an async replication batch in order. There are no per-write acks - one
+// ack with the batch's sequence number lets master send the next batch.
+void
+repl_write_handle_async_batch(cf_node node, msg* m)
+{
+	uint32_t ns_id;
+	uint32_t seq;
+	uint8_t* buf;
+	size_t sz;
+
+	if (msg_get_uint32(m, RW_FIELD_NS_ID, &ns_id) != 0 ||
+			msg_get_uint32(m, RW_FIELD_TID, &seq) != 0 ||
+			msg_get_buf(m, RW_FIELD_BATCH, &buf, &sz, MSG_GET_DIRECT) != 0) {
+		cf_warning(AS_RW, "repl-write async batch: missing fields");
+		as_fabric_msg_put(m);
+		return;
+	}
+
+	msg* op_msg = as_fabric_msg_get(M_TYPE_RW);
+
+	if (! op_msg) {
+		// Master will retransmit.
+		as_fabric_msg_put(m);
+		return;
+	}
+
+	const uint8_t* end = buf + sz;
+
+	while (buf < end) {
+		uint32_t op_sz;
+		msg_type type;
+
+		if (msg_get_initial(&op_sz, &type, buf, (uint32_t)(end - buf)) != 0 ||
+				op_sz > (uint32_t)(end - buf) ||
+				msg_parse(op_msg, buf, op_sz) != 0) {
+			cf_warning(AS_RW, "repl-write async batch: bad embedded msg");
+			break;
+		}
+
+		// A failed write is not retried - migration reconciles the replica.
+		apply_repl_write(node, op_msg);
+		msg_reset(op_msg);
+
+		buf += op_sz;
+	}
+
+	as_fabric_msg_put(op_msg);
+	as_fabric_msg_put(m);
+
+	msg* ack = as_fabric_msg_get(M_TYPE_RW);
+
+	if (! ack) {
+		// Master will retransmit, and we'll apply the batch again.
+		return;
+	}
+
+	msg_set_uint32(ack, RW_FIELD_OP, RW_OP_WRITE_ASYNC_BATCH_ACK);
+	msg_set_uint32(ack, RW_FIELD_NS_ID, ns_id);
+	msg_set_uint32(ack, RW_FIELD_TID, seq);
+
+	if (as_fabric_send(node, ack, AS_FABRIC_PRIORITY_MEDIUM) !=
+			AS_FABRIC_SUCCESS) {
+		as_fabric_msg_put(ack);
+	}
+}
+
+
 // For LDTs only:
 void
 repl_write_ldt_make_message(msg* m, as_transaction* tr, uint8_t** p_pickled_buf,
@@ -678,6 +767,125 @@ repl_write_handle_multiop_ack(cf_node node, msg* m)
 // Local helpers - messages.
 //
 
+uint32_t
+apply_repl_write(cf_node node, msg* m)
+{
+	uint8_t* ns_name;
+	size_t ns_name_len;
+
+	if (msg_get_buf(m, RW_FIELD_NAMESPACE, &ns_name, &ns_name_len,
+			MSG_GET_DIRECT) != 0) {
+		cf_warning(AS_RW, "apply_repl_write: no namespace");
+		return AS_PROTO_RESULT_FAIL_UNKNOWN;
+	}
+
+	as_namespace* ns = as_namespace_get_bybuf(ns_name, ns_name_len);
+
+	if (! ns) {
+		cf_warning(AS_RW, "apply_repl_write: invalid namespace");
+		return AS_PROTO_RESULT_FAIL_UNKNOWN;
+	}
+
+	cf_digest* keyd;
+	size_t sz;
+
+	if (msg_get_buf(m, RW_FIELD_DIGEST, (uint8_t**)&keyd, &sz,
+			MSG_GET_DIRECT) != 0) {
+		cf_warning(AS_RW, "apply_repl_write: no digest");
+		return AS_PROTO_RESULT_FAIL_UNKNOWN;
+	}
+
+	as_partition_reservation rsv;
+
+	as_partition_reserve_migrate(ns, as_partition_getid(*keyd), &rsv, NULL);
+
+	if (rsv.state == AS_PARTITION_STATE_ABSENT) {
+		as_partition_release(&rsv);
+		return AS_PROTO_RESULT_FAIL_CLUSTER_KEY_MISMATCH;
+	}
+
+	uint32_t info = 0;
+
+	msg_get_uint32(m, RW_FIELD_INFO, &info);
+
+	ldt_prole_info linfo;
+
+	if ((info & RW_INFO_LDT) != 0 && ! ldt_get_info(&linfo, m, &rsv)) {
+		cf_warning(AS_RW, "apply_repl_write: bad ldt info");
+		as_partition_release(&rsv);
+		return AS_PROTO_RESULT_FAIL_UNKNOWN;
+	}
+
+	cl_msg* msgp;
+	size_t msgp_sz;
+
+	uint8_t* pickled_buf;
+	size_t pickled_sz;
+
+	uint32_t result;
+
+	if (msg_get_buf(m, RW_FIELD_AS_MSG, (uint8_t**)&msgp, &msgp_sz,
+			MSG_GET_DIRECT) == 0) {
+		// <><><><><><>  Delete Operation  <><><><><><>
+
+		// TODO - does this really need to be here? Just to fill linfo?
+		if (! ldt_get_prole_version(&rsv, keyd, &linfo, info, NULL, false)) {
+			as_partition_release(&rsv);
+			return AS_PROTO_RESULT_OK; // ???
+		}
+
+		result = delete_replica(&rsv, keyd,
+				(info & (RW_INFO_LDT_SUBREC | RW_INFO_LDT_ESR)) != 0,
+				(info & RW_INFO_NSUP_DELETE) != 0,
+				as_msg_is_xdr(&msgp->msg),
+				node);
+	}
+	else if (msg_get_buf(m, RW_FIELD_RECORD, (uint8_t**)&pickled_buf,
+			&pickled_sz, MSG_GET_DIRECT) == 0) {
+		// <><><><><><>  Write Pickle  <><><><><><>
+
+		as_generation generation;
+
+		if (msg_get_uint32(m, RW_FIELD_GENERATION, &generation) != 0) {
+			cf_warning(AS_RW, "apply_repl_write: no generation");
+			as_partition_release(&rsv);
+			return AS_PROTO_RESULT_FAIL_UNKNOWN;
+		}
+
+		uint32_t void_time;
+
+		if (msg_get_uint32(m, RW_FIELD_VOID_TIME, &void_time) != 0) {
+			cf_warning(AS_RW, "apply_repl_write: no void-time");
+			as_partition_release(&rsv);
+			return AS_PROTO_RESULT_FAIL_UNKNOWN;
+		}
+
+		uint64_t last_update_time = 0;
+
+		// Optional - older versions won't send it.
+		msg_get_uint64(m, RW_FIELD_LAST_UPDATE_TIME, &last_update_time);
+
+		as_rec_props rec_props;
+		size_t rec_props_size = 0;
+
+		msg_get_buf(m, RW_FIELD_REC_PROPS, &rec_props.p_data, &rec_props_size,
+				MSG_GET_DIRECT);
+		rec_props.size = (uint32_t)rec_props_size;
+
+		result = write_replica(&rsv, keyd, pickled_buf, pickled_sz, &rec_props,
+				generation, void_time, last_update_time, node, info, &linfo);
+	}
+	else {
+		cf_warning(AS_RW, "apply_repl_write: no msg or pickle");
+		result = AS_PROTO_RESULT_FAIL_UNKNOWN;
+	}
+
+	as_partition_release(&rsv);
+
+	return result;
+}
+
+
 uint32_t
 pack_info_bits(as_transaction* tr, bool has_udf)
 {
@@ -699,6 +907,10 @@ pack_info_bits(as_transaction* tr, bool has_udf)
 		info |= RW_INFO_UDF_WRITE;
 	}
 
+	if ((tr->flags & AS_TRANSACTION_FLAG_INDEX_ONLY) != 0) {
+		info |= RW_INFO_INDEX_ONLY;
+	}
+
 	return info;
 }
 
@@ -728,12 +940,19 @@ pack_ldt_info_bits(as_transaction* tr, bool is_parent, bool is_sub)
 
 
 void
-send_repl_write_ack(cf_node node, msg* m, uint32_t result)
+set_repl_write_ack(msg* m, uint32_t result)
 {
 	msg_preserve_fields(m, 3, RW_FIELD_NS_ID, RW_FIELD_DIGEST, RW_FIELD_TID);
 
 	msg_set_uint32(m, RW_FIELD_OP, RW_OP_WRITE_ACK);
 	msg_set_uint32(m, RW_FIELD_RESULT, result);
+}
+
+
+void
+send_repl_write_ack(cf_node node, msg* m, uint32_t result)
+{
+	set_repl_write_ack(m, result);
 
 	if (as_fabric_send(node, m, AS_FABRIC_PRIORITY_MEDIUM) !=
 			AS_FABRIC_SUCCESS) {
@@ -957,6 +1176,7 @@ delete_replica(as_partition_reservation* rsv, cf_digest* keyd, bool is_subrec,
 	uint16_t set_id = as_index_get_set_id(r);
 	uint16_t generation = r->generation;
 
+	as_read_coalesce_record_changed(ns, keyd);
 	as_index_delete(tree, keyd);
 	as_record_done(&r_ref, ns);
 
@@ -1011,6 +1231,25 @@ write_replica(as_partition_reservation* rsv, cf_digest* keyd,
 	}
 
 	as_record* r = r_ref.r;
+
+	// Master only touched - if we have the version it touched, so do we.
+	if (rv == 0 && (info & RW_INFO_INDEX_ONLY) != 0 && ! is_subrec &&
+			! is_ldt_parent &&
+			touch_replica_index_only(rsv, r, generation, void_time,
+					last_update_time)) {
+		uint16_t set_id = as_index_get_set_id(r);
+
+		as_read_coalesce_record_changed(ns, keyd);
+		as_record_done(&r_ref, ns);
+
+		if ((info & RW_INFO_XDR) == 0 ||
+				is_xdr_forwarding_enabled() || ns->ns_forward_xdr_writes) {
+			xdr_write(ns, *keyd, generation, master, false, set_id, NULL);
+		}
+
+		return AS_PROTO_RESULT_OK;
+	}
+
 	as_storage_rd rd;
 	bool is_create = false;
 
@@ -1076,9 +1315,19 @@ write_replica(as_partition_reservation* rsv, cf_digest* keyd,
 		return AS_PROTO_RESULT_FAIL_UNKNOWN; // TODO - better granularity?
 	}
 
+	uint32_t old_void_time = r->void_time;
+
 	r->generation = generation;
 	r->void_time = void_time;
 	r->last_update_time = last_update_time;
+	as_partition_max_lut_update(rsv->p, last_update_time);
+	as_partition_changelog_record_changed(rsv->p, r);
+	as_read_coalesce_record_changed(ns, keyd);
+
+	if (! is_subrec) {
+		as_expire_index_record_changed(ns, r, old_void_time);
+		as_incr_hist_void_time_changed(ns, r, old_void_time);
+	}
 
 	as_storage_record_adjust_mem_stats(&rd, memory_bytes);
 
@@ -1137,3 +1386,44 @@ write_replica(as_partition_reservation* rsv, cf_digest* keyd,
 
 	return AS_PROTO_RESULT_OK;
 }
+
+
+// Apply a master's index-only touch to the record's metadata, if the record
+// is the version the master touched. Otherwise the caller writes the pickle.
+bool
+touch_replica_index_only(as_partition_reservation* rsv, as_record* r,
+		as_generation generation, uint32_t void_time,
+		uint64_t last_update_time)
+{
+	as_namespace* ns = rsv->ns;
+
+	if (! ns->storage_touch_index_only || ns->storage_data_in_memory ||
+			ns->storage_type != AS_STORAGE_ENGINE_SSD) {
+		return false;
+	}
+
+	uint16_t next_generation = (uint16_t)(r->generation + 1);
+
+	if (next_generation == 0) {
+		next_generation = 1;
+	}
+
+	if (generation != next_generation) {
+		return false;
+	}
+
+	uint32_t old_void_time = r->void_time;
+
+	r->generation = generation;
+	r->void_time = void_time;
+	r->last_update_time = last_update_time;
+	as_partition_max_lut_update(rsv->p, last_update_time);
+	as_partition_changelog_record_changed(rsv->p, r);
+
+	as_expire_index_record_changed(ns, r, old_void_time);
+	as_incr_hist_void_time_changed(ns, r, old_void_time);
+
+	cf_atomic64_incr(&ns->n_index_only_touches);
+
+	return true;
+}
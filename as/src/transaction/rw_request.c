@@ -29,6 +29,7 @@
 #include <pthread.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 
 #include "citrusleaf/alloc.h"
@@ -45,12 +46,38 @@
 #include "fabric/fabric.h"
 
 
+//==========================================================
+// Typedefs & constants.
+//
+
+// Destroyed rw_requests are kept per thread for reuse. Threads that release
+// more than they create (e.g. fabric threads) free the excess.
+#define FREELIST_MAX 64
+
+typedef struct rw_freelist_s {
+	rw_request*	head;
+	uint32_t	n_rws;
+} rw_freelist;
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static rw_freelist* get_freelist();
+
+
 //==========================================================
 // Globals.
 //
 
 static cf_atomic32 g_rw_tid = 0;
 
+static __thread rw_freelist* t_freelist = NULL;
+
+static pthread_key_t g_freelist_key;
+static pthread_once_t g_freelist_once = PTHREAD_ONCE_INIT;
+
 
 //==========================================================
 // Public API.
@@ -59,8 +86,21 @@ static cf_atomic32 g_rw_tid = 0;
 rw_request*
 rw_request_create(cf_digest* keyd)
 {
-	rw_request* rw = cf_rc_alloc(sizeof(rw_request));
-	cf_assert(rw, AS_RW, CF_CRITICAL, "alloc rw_request");
+	rw_freelist* fl = get_freelist();
+	rw_request* rw;
+
+	if (fl && fl->head) {
+		rw = fl->head;
+		fl->head = rw->free_next;
+		fl->n_rws--;
+
+		// Ref-count was left at 0 by the last release.
+		cf_rc_reserve(rw);
+	}
+	else {
+		rw = cf_rc_alloc(sizeof(rw_request));
+		cf_assert(rw, AS_RW, CF_CRITICAL, "alloc rw_request");
+	}
 
 	// as_transaction look-alike:
 	rw->msgp				= NULL;
@@ -72,6 +112,8 @@ rw_request_create(cf_digest* keyd)
 	rw->keyd				= *keyd;
 	rw->start_time			= 0;
 	rw->benchmark_time		= 0;
+	rw->stage_time			= 0;
+	memset(rw->stage_us, 0, sizeof(rw->stage_us));
 
 	AS_PARTITION_RESERVATION_INIT(rw->rsv);
 
@@ -95,11 +137,13 @@ rw_request_create(cf_digest* keyd)
 
 	rw->response_db.buf = NULL;
 	rw->response_db.is_stack = false;
+	rw->response_db.is_pooled = false;
 	rw->response_db.alloc_sz = 0;
 	rw->response_db.used_sz = 0;
 
 	rw->tid = cf_atomic32_incr(&g_rw_tid);
 	rw->dup_res_complete = false;
+	rw->dup_meta_only = false;
 	rw->dup_res_cb = NULL;
 	rw->repl_write_cb = NULL;
 	rw->timeout_cb = NULL;
@@ -107,9 +151,12 @@ rw_request_create(cf_digest* keyd)
 	rw->dest_msg = NULL;
 	rw->xmit_ms = 0;
 	rw->retry_interval_ms = 0;
+	rw->timer_ms = 0;
 
 	rw->n_dest_nodes = 0;
 
+	rw->free_next = NULL;
+
 	return rw;
 }
 
@@ -166,3 +213,72 @@ rw_request_destroy(rw_request* rw)
 		e = next;
 	}
 }
+
+
+// Call after rw_request_destroy(), when the ref-count reaches 0.
+void
+rw_request_free(rw_request* rw)
+{
+	rw_freelist* fl = get_freelist();
+
+	if (! fl || fl->n_rws >= FREELIST_MAX) {
+		cf_rc_free(rw);
+		return;
+	}
+
+	rw->free_next = fl->head;
+	fl->head = rw;
+	fl->n_rws++;
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+static void
+freelist_destroy(void* udata)
+{
+	rw_freelist* fl = (rw_freelist*)udata;
+	rw_request* rw = fl->head;
+
+	while (rw) {
+		rw_request* next = rw->free_next;
+
+		cf_rc_free(rw);
+		rw = next;
+	}
+
+	cf_free(fl);
+}
+
+
+static void
+freelist_key_create()
+{
+	pthread_key_create(&g_freelist_key, freelist_destroy);
+}
+
+
+static rw_freelist*
+get_freelist()
+{
+	if (! t_freelist) {
+		pthread_once(&g_freelist_once, freelist_key_create);
+
+		rw_freelist* fl = cf_malloc(sizeof(rw_freelist));
+
+		if (! fl) {
+			return NULL;
+		}
+
+		fl->head = NULL;
+		fl->n_rws = 0;
+
+		// Emptied at thread exit.
+		pthread_setspecific(g_freelist_key, fl);
+		t_freelist = fl;
+	}
+
+	return t_freelist;
+}
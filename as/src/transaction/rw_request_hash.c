@@ -39,7 +39,8 @@
 
 #include "fault.h"
 #include "msg.h"
-#include "rchash.h"
+#include "ohash.h"
+#include "timer_wheel.h"
 #include "util.h"
 
 #include "base/cfg.h"
@@ -52,6 +53,8 @@
 #include "fabric/paxos.h"
 #include "transaction/duplicate_resolve.h"
 #include "transaction/replica_write.h"
+#include "transaction/repl_log.h"
+#include "transaction/repl_write_batch.h"
 #include "transaction/rw_request.h"
 #include "transaction/rw_utils.h"
 
@@ -77,29 +80,54 @@ const msg_template rw_mt[] = {
 		{ RW_FIELD_REC_PROPS, M_FT_BUF },
 		{ RW_FIELD_MULTIOP, M_FT_BUF },
 		{ RW_FIELD_LDT_VERSION, M_FT_UINT64 },
-		{ RW_FIELD_LAST_UPDATE_TIME, M_FT_UINT64 }
+		{ RW_FIELD_LAST_UPDATE_TIME, M_FT_UINT64 },
+		{ RW_FIELD_BATCH, M_FT_BUF }
 };
 
 COMPILER_ASSERT(sizeof(rw_mt) / sizeof(msg_template) == NUM_RW_FIELDS);
 
 #define RW_MSG_SCRATCH_SIZE 280 // 128 + 152 for prole deletes
 
+#define RETRANSMIT_TICK_MS 10
+
+// Sharded by partition, each shard with its own hash (and locks) and its own
+// retransmit wheel. Must divide AS_PARTITIONS.
+#define N_SHARDS 16
+#define SHARD_N_SLOTS (32 * 1024 / N_SHARDS)
+#define SHARD_N_STRIPES 8
+
+// Hashes hold a reference to each rw_request - values are the pointers.
+typedef struct rw_hash_shard_s {
+	cf_ohash*		hash;
+	cf_timer_wheel*	retransmit_wheel;
+} __attribute__ ((aligned(64))) rw_hash_shard;
+
+COMPILER_ASSERT(AS_PARTITIONS % N_SHARDS == 0);
+
+// Retransmit wheel entry - the rw_request pointer and deadline identify which
+// timer is current, since superseded timers can't be removed from the wheel.
+typedef struct retransmit_timer_s {
+	rw_request_hkey	hkey;
+	rw_request*		rw;
+	uint64_t		deadline_ms;
+} retransmit_timer;
+
 
 //==========================================================
 // Forward Declarations.
 //
 
-uint32_t rw_request_hash_fn(void* value, uint32_t value_len);
+static inline rw_hash_shard* get_shard(const rw_request_hkey* hkey);
+uint32_t rw_request_hash_fn(const void* key);
 transaction_status handle_hot_key(rw_request* rw0, as_transaction* tr);
 
 void* run_retransmit(void* arg);
-int retransmit_reduce_fn(void* key, uint32_t keylen, void* data, void* udata);
+void retransmit_timer_fn(void* key, void* udata);
 
 void on_paxos_change(as_paxos_generation gen, as_paxos_change* change,
 		cf_node succession[], void* udata);
-int paxos_change_reduce_fn(void* key, uint32_t keylen, void* data, void* udata);
-int paxos_change_delete_reduce_fn(void* key, uint32_t keylen, void* data,
-		void* udata);
+int paxos_change_reduce_fn(const void* key, void* data, void* udata);
+int paxos_change_delete_reduce_fn(const void* key, void* data, void* udata);
 
 int rw_msg_cb(cf_node id, msg* m, void* udata);
 
@@ -108,7 +136,7 @@ int rw_msg_cb(cf_node id, msg* m, void* udata);
 // Globals.
 //
 
-static rchash* g_rw_request_hash = NULL;
+static rw_hash_shard g_shards[N_SHARDS];
 
 
 //==========================================================
@@ -118,8 +146,22 @@ static rchash* g_rw_request_hash = NULL;
 void
 as_rw_init()
 {
-	rchash_create(&g_rw_request_hash, rw_request_hash_fn, rw_request_hdestroy,
-			sizeof(rw_request_hkey), 32 * 1024, RCHASH_CR_MT_MANYLOCK);
+	for (uint32_t i = 0; i < N_SHARDS; i++) {
+		rw_hash_shard* shard = &g_shards[i];
+
+		shard->hash = cf_ohash_create(rw_request_hash_fn,
+				sizeof(rw_request_hkey), sizeof(rw_request*), SHARD_N_SLOTS,
+				SHARD_N_STRIPES);
+
+		cf_assert(shard->hash, AS_RW, CF_CRITICAL,
+				"failed to create rw_request hash");
+
+		shard->retransmit_wheel = cf_timer_wheel_create(
+				sizeof(retransmit_timer), RETRANSMIT_TICK_MS);
+
+		cf_assert(shard->retransmit_wheel, AS_RW, CF_CRITICAL,
+				"failed to create retransmit wheel");
+	}
 
 	pthread_t thread;
 	pthread_attr_t attrs;
@@ -135,13 +177,22 @@ as_rw_init()
 
 	as_fabric_register_msg_fn(M_TYPE_RW, rw_mt, sizeof(rw_mt),
 			RW_MSG_SCRATCH_SIZE, rw_msg_cb, NULL);
+
+	repl_write_batch_init();
+	repl_log_init();
 }
 
 
 uint32_t
 rw_request_hash_count()
 {
-	return rchash_get_size(g_rw_request_hash);
+	uint32_t count = 0;
+
+	for (uint32_t i = 0; i < N_SHARDS; i++) {
+		count += cf_ohash_get_size(g_shards[i].hash);
+	}
+
+	return count;
 }
 
 
@@ -149,27 +200,25 @@ transaction_status
 rw_request_hash_insert(rw_request_hkey* hkey, rw_request* rw,
 		as_transaction* tr)
 {
+	cf_ohash* hash = get_shard(hkey)->hash;
 	int insert_rv;
 
-	while ((insert_rv = rchash_put_unique(g_rw_request_hash, hkey,
-			sizeof(*hkey), rw)) != RCHASH_OK) {
+	while ((insert_rv = cf_ohash_put_unique(hash, hkey, &rw)) !=
+			CF_OHASH_OK) {
 
-		if (insert_rv != RCHASH_ERR_FOUND) {
+		if (insert_rv != CF_OHASH_ERR_FOUND) {
 			tr->result_code = AS_PROTO_RESULT_FAIL_UNKNOWN; // malloc failure
 			return TRANS_DONE_ERROR;
 		}
 		// else - rw_request with this digest already in hash - get it.
 
-		rw_request* rw0;
-		int get_rv = rchash_get(g_rw_request_hash, hkey, sizeof(*hkey),
-				(void**)&rw0);
+		rw_request* rw0 = rw_request_hash_get(hkey);
 
-		if (get_rv == RCHASH_ERR_NOTFOUND) {
+		if (! rw0) {
 			// Try insertion again immediately.
 			continue;
 		}
 		// else - got it - handle "hot key" scenario.
-		cf_assert(get_rv == RCHASH_OK, AS_RW, CF_CRITICAL, "rchash_get error");
 
 		pthread_mutex_lock(&rw0->lock);
 
@@ -185,24 +234,73 @@ rw_request_hash_insert(rw_request_hkey* hkey, rw_request* rw,
 }
 
 
+// Deletes only if rw is still the one in the hash, and drops the hash's
+// reference.
 void
 rw_request_hash_delete(rw_request_hkey* hkey, rw_request* rw)
 {
-	rchash_delete_object(g_rw_request_hash, hkey, sizeof(*hkey), rw);
+	cf_ohash* hash = get_shard(hkey)->hash;
+	rw_request** p_rw;
+	pthread_mutex_t* lock;
+
+	if (cf_ohash_get_vlock(hash, hkey, (void**)&p_rw, &lock) != CF_OHASH_OK) {
+		return;
+	}
+
+	bool match = *p_rw == rw;
+
+	if (match) {
+		cf_ohash_delete_lockfree(hash, hkey);
+	}
+
+	pthread_mutex_unlock(lock);
+
+	if (match) {
+		rw_request_release(rw);
+	}
 }
 
 
 rw_request*
 rw_request_hash_get(rw_request_hkey* hkey)
 {
-	rw_request* rw = NULL;
+	rw_request** p_rw;
+	pthread_mutex_t* lock;
 
-	rchash_get(g_rw_request_hash, hkey, sizeof(*hkey), (void**)&rw);
+	if (cf_ohash_get_vlock(get_shard(hkey)->hash, hkey, (void**)&p_rw,
+			&lock) != CF_OHASH_OK) {
+		return NULL;
+	}
+
+	rw_request* rw = *p_rw;
+
+	cf_rc_reserve(rw);
+	pthread_mutex_unlock(lock);
 
 	return rw;
 }
 
 
+// Call under the rw_request lock, whenever xmit_ms may have moved earlier.
+// Only the most recently scheduled timer is acted on.
+void
+rw_request_hash_schedule(rw_request* rw)
+{
+	uint64_t end_ms = rw->end_time / 1000000;
+	retransmit_timer timer;
+
+	timer.hkey.ns_id = rw->rsv.ns->id;
+	timer.hkey.keyd = rw->keyd;
+	timer.rw = rw;
+	timer.deadline_ms = (rw->xmit_ms < end_ms ? rw->xmit_ms : end_ms) + 1;
+
+	rw->timer_ms = timer.deadline_ms;
+
+	cf_timer_wheel_add(get_shard(&timer.hkey)->retransmit_wheel, &timer,
+			timer.deadline_ms);
+}
+
+
 // For debugging only.
 void
 rw_request_hash_dump()
@@ -216,10 +314,17 @@ rw_request_hash_dump()
 // Local helpers - hash insertion.
 //
 
+static inline rw_hash_shard*
+get_shard(const rw_request_hkey* hkey)
+{
+	return &g_shards[as_partition_getid(hkey->keyd) % N_SHARDS];
+}
+
+
 uint32_t
-rw_request_hash_fn(void* value, uint32_t value_len)
+rw_request_hash_fn(const void* key)
 {
-	rw_request_hkey* hkey = (rw_request_hkey*)value;
+	const rw_request_hkey* hkey = (const rw_request_hkey*)key;
 
 	// TODO - surely this can be simpler, use 4 bytes???
 	return	(hkey->keyd.digest[DIGEST_SCRAMBLE_BYTE1] << 16) |
@@ -275,52 +380,71 @@ void*
 run_retransmit(void* arg)
 {
 	while (true) {
-		usleep(130 * 1000);
-
-		now_times now;
+		usleep(RETRANSMIT_TICK_MS * 1000);
 
-		now.now_ns = cf_getns();
-		now.now_ms = now.now_ns / 1000000;
+		uint64_t now_ms = cf_getms();
 
-		rchash_reduce(g_rw_request_hash, retransmit_reduce_fn, &now);
+		// Only visits rw_requests that are due - not the whole hash.
+		for (uint32_t i = 0; i < N_SHARDS; i++) {
+			cf_timer_wheel_expire(g_shards[i].retransmit_wheel, now_ms,
+					retransmit_timer_fn, NULL);
+		}
 	}
 
 	return NULL;
 }
 
 
-int
-retransmit_reduce_fn(void* key, uint32_t keylen, void* data, void* udata)
+void
+retransmit_timer_fn(void* key, void* udata)
 {
-	rw_request* rw = data;
-	now_times* now = (now_times*)udata;
+	retransmit_timer* timer = (retransmit_timer*)key;
+	rw_request* rw = rw_request_hash_get(&timer->hkey);
 
-	if (! rw->is_set_up) {
-		return 0;
+	if (! rw) {
+		return;
 	}
 
-	if (now->now_ns > rw->end_time) {
-		pthread_mutex_lock(&rw->lock);
+	// Could be a different rw_request for the same digest - the pointer can
+	// only match if ours is still in the hash, since we now hold a reference.
+	if (rw != timer->rw) {
+		rw_request_release(rw);
+		return;
+	}
 
+	pthread_mutex_lock(&rw->lock);
+
+	// Superseded by a later schedule.
+	if (rw->timer_ms != timer->deadline_ms) {
+		pthread_mutex_unlock(&rw->lock);
+		rw_request_release(rw);
+		return;
+	}
+
+	uint64_t now_ns = cf_getns();
+	uint64_t now_ms = now_ns / 1000000;
+
+	if (now_ns > rw->end_time) {
 		rw->timeout_cb(rw);
 
 		pthread_mutex_unlock(&rw->lock);
 
-		return RCHASH_REDUCE_DELETE;
+		rw_request_hash_delete(&timer->hkey, rw);
+		rw_request_release(rw);
+		return;
 	}
 
-	if (rw->xmit_ms < now->now_ms) {
-		pthread_mutex_lock(&rw->lock);
-
-		rw->xmit_ms = now->now_ms + rw->retry_interval_ms;
+	if (rw->xmit_ms < now_ms) {
+		rw->xmit_ms = now_ms + rw->retry_interval_ms;
 		rw->retry_interval_ms *= 2;
 
 		send_rw_messages(rw);
-
-		pthread_mutex_unlock(&rw->lock);
 	}
 
-	return 0;
+	rw_request_hash_schedule(rw);
+
+	pthread_mutex_unlock(&rw->lock);
+	rw_request_release(rw);
 }
 
 
@@ -349,12 +473,18 @@ on_paxos_change(as_paxos_generation gen, as_paxos_change* change,
 
 	// Iterate through the hash table and find nodes that are not in the
 	// succession list. Remove these entries from the hash table.
-	rchash_reduce(g_rw_request_hash, paxos_change_reduce_fn, (void*)&del);
+	for (uint32_t s = 0; s < N_SHARDS; s++) {
+		cf_ohash_reduce(g_shards[s].hash, paxos_change_reduce_fn, (void*)&del);
+	}
 
 	// If there are nodes to be deleted, execute the deletion algorithm.
 	for (int i = 0; i < g_config.paxos_max_cluster_size; i++) {
-		if (del.deletions[i] != (cf_node)0) {
-			rchash_reduce(g_rw_request_hash, paxos_change_delete_reduce_fn,
+		if (del.deletions[i] == (cf_node)0) {
+			continue;
+		}
+
+		for (uint32_t s = 0; s < N_SHARDS; s++) {
+			cf_ohash_reduce(g_shards[s].hash, paxos_change_delete_reduce_fn,
 					(void*)&del.deletions[i]);
 		}
 	}
@@ -362,9 +492,9 @@ on_paxos_change(as_paxos_generation gen, as_paxos_change* change,
 
 
 int
-paxos_change_reduce_fn(void* key, uint32_t keylen, void* data, void* udata)
+paxos_change_reduce_fn(const void* key, void* data, void* udata)
 {
-	rw_request* rw = (rw_request*)data;
+	rw_request* rw = *(rw_request**)data;
 	rw_paxos_change_struct* del = (rw_paxos_change_struct*)udata;
 	bool node_in_slist = false;
 
@@ -400,18 +530,28 @@ paxos_change_reduce_fn(void* key, uint32_t keylen, void* data, void* udata)
 
 
 int
-paxos_change_delete_reduce_fn(void* key, uint32_t keylen, void* data,
-		void* udata)
+paxos_change_delete_reduce_fn(const void* key, void* data, void* udata)
 {
-	rw_request* rw = (rw_request*)data;
+	rw_request* rw = *(rw_request**)data;
 	cf_node* node = (cf_node*)udata;
 
+	pthread_mutex_lock(&rw->lock);
+
+	if (! rw->is_set_up) {
+		pthread_mutex_unlock(&rw->lock);
+		return 0;
+	}
+
 	for (int i = 0; i < rw->n_dest_nodes; i++) {
 		if (! rw->dest_complete[i] && rw->dest_nodes[i] == *node) {
 			rw->xmit_ms = 0;
+			rw_request_hash_schedule(rw);
+			break;
 		}
 	}
 
+	pthread_mutex_unlock(&rw->lock);
+
 	return 0;
 }
 
@@ -451,6 +591,18 @@ rw_msg_cb(cf_node id, msg* m, void* udata)
 	case RW_OP_WRITE_ACK:
 		repl_write_handle_ack(id, m);
 		break;
+	case RW_OP_WRITE_BATCH:
+		repl_write_handle_batch(id, m);
+		break;
+	case RW_OP_WRITE_BATCH_ACK:
+		repl_write_handle_batch_ack(id, m);
+		break;
+	case RW_OP_WRITE_ASYNC_BATCH:
+		repl_write_handle_async_batch(id, m);
+		break;
+	case RW_OP_WRITE_ASYNC_BATCH_ACK:
+		repl_log_handle_ack(id, m);
+		break;
 
 	//--------------------------------------------
 	// LDT-related:
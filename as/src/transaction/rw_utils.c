@@ -37,15 +37,22 @@
 #include "fault.h"
 #include "msg.h"
 
-#include "base/cfg.h" // xdr_allows_write
+#include "base/as_stap.h"
+#include "base/cfg.h"
 #include "base/datamodel.h"
+#include "base/expire_index.h"
+#include "base/incr_hist.h"
 #include "base/ldt.h"
 #include "base/proto.h" // xdr_allows_write
 #include "base/secondary_index.h"
+#include "base/set_index.h"
 #include "base/transaction.h"
 #include "fabric/fabric.h"
+#include "fabric/partition_changelog.h"
 #include "storage/storage.h"
+#include "transaction/repl_write_batch.h"
 #include "transaction/rw_request.h"
+#include "transaction/rw_request_hash.h"
 
 
 //==========================================================
@@ -76,11 +83,35 @@ xdr_allows_write(as_transaction* tr)
 void
 send_rw_messages(rw_request* rw)
 {
+	uint32_t op = 0;
+
+	msg_get_uint32(rw->dest_msg, RW_FIELD_OP, &op);
+
+	bool batch = g_config.replica_write_batch_us != 0 && op == RW_OP_WRITE;
+
 	for (int i = 0; i < rw->n_dest_nodes; i++) {
 		if (rw->dest_complete[i]) {
 			continue;
 		}
 
+		ASD_RW_SEND(rw->tid, rw->dest_nodes[i], op);
+
+		if (batch) {
+			int rv = repl_write_batch_add(rw->dest_nodes[i], rw->dest_msg);
+
+			if (rv == AS_FABRIC_SUCCESS) {
+				continue;
+			}
+
+			if (rv == AS_FABRIC_ERR_NO_NODE) {
+				// Mark as complete although we won't have a response msg.
+				rw->dest_complete[i] = true;
+				rw->dup_result_code[i] = AS_PROTO_RESULT_FAIL_UNKNOWN;
+				continue;
+			}
+			// else - couldn't batch, send directly.
+		}
+
 		msg_incr_ref(rw->dest_msg);
 
 		int rv = as_fabric_send(rw->dest_nodes[i], rw->dest_msg,
@@ -113,7 +144,14 @@ set_set_from_msg(as_record* r, as_namespace* ns, as_msg* m)
 	}
 
 	// Given the name, find/assign the set-ID and write it in the as_index.
-	return as_index_set_set_w_len(r, ns, (const char*)f->data, name_len, true);
+	int rv = as_index_set_set_w_len(r, ns, (const char*)f->data, name_len,
+			true);
+
+	if (rv == 0) {
+		as_set_index_record_set(ns, r);
+	}
+
+	return rv;
 }
 
 
@@ -156,6 +194,21 @@ get_msg_key(as_transaction* tr, as_storage_rd* rd)
 }
 
 
+// Checks the client-sent key against the digest instead of against a stored
+// key, so a caller can trust the sent key without reading the record.
+bool
+msg_key_matches_digest(as_transaction* tr, const char* set_name)
+{
+	as_msg_field* f = as_msg_field_get(&tr->msgp->msg, AS_MSG_FIELD_TYPE_KEY);
+	cf_digest keyd;
+
+	cf_digest_compute2((void*)set_name, set_name ? strlen(set_name) : 0,
+			f->data, as_msg_field_get_value_sz(f), &keyd);
+
+	return cf_digest_compare(&keyd, &tr->keyd) == 0;
+}
+
+
 void
 update_metadata_in_index(as_transaction* tr, bool increment_generation,
 		as_record* r)
@@ -165,6 +218,7 @@ update_metadata_in_index(as_transaction* tr, bool increment_generation,
 	as_namespace* ns = tr->rsv.ns;
 
 	uint64_t now = cf_clepoch_milliseconds();
+	uint32_t old_void_time = r->void_time;
 
 	if (m->record_ttl == 0xFFFFffff) {
 		// TTL = -1 - set record to "never expire".
@@ -188,11 +242,17 @@ update_metadata_in_index(as_transaction* tr, bool increment_generation,
 		r->void_time = 0;
 	}
 
+	as_expire_index_record_changed(ns, r, old_void_time);
+	as_incr_hist_void_time_changed(ns, r, old_void_time);
+
 	// Note - last-update-time is not allowed to go backwards!
 	if (r->last_update_time < now) {
 		r->last_update_time = now;
 	}
 
+	as_partition_max_lut_update(tr->rsv.p, r->last_update_time);
+	as_partition_changelog_record_changed(tr->rsv.p, r);
+
 	if (increment_generation) {
 		r->generation++;
 
@@ -268,6 +328,10 @@ delete_adjust_sindex(as_storage_rd* rd)
 				&sbins[sbins_populated], AS_SINDEX_OP_DELETE);
 	}
 
+	sbins_populated += as_sindex_sbins_composite_from_bins(ns, set_name,
+			rd->bins, rd->n_bins, -1, &sbins[sbins_populated],
+			AS_SINDEX_OP_DELETE);
+
 	SINDEX_GUNLOCK();
 
 	if (sbins_populated) {
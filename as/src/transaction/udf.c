@@ -54,15 +54,21 @@
 #include "base/ldt_aerospike.h"
 #include "base/proto.h"
 #include "base/secondary_index.h"
+#include "base/slow_txn.h"
 #include "base/transaction.h"
 #include "base/transaction_policy.h"
 #include "base/udf_aerospike.h"
 #include "base/udf_arglist.h"
 #include "base/udf_cask.h"
+#include "base/udf_memtracker.h"
+#include "base/udf_native.h"
 #include "base/udf_record.h"
+#include "base/udf_result_cache.h"
 #include "base/udf_timer.h"
 #include "transaction/duplicate_resolve.h"
 #include "transaction/proxy.h"
+#include "transaction/read_coalesce.h"
+#include "transaction/repl_log.h"
 #include "transaction/replica_write.h"
 #include "transaction/rw_request.h"
 #include "transaction/rw_request_hash.h"
@@ -206,6 +212,9 @@ as_udf_init()
 	as_module_configure(&mod_lua, &g_config.mod_lua);
 	as_log_set_callback(log_callback);
 	udf_cask_init();
+	udf_native_init();
+	udf_memtracker_init();
+	udf_result_cache_init();
 	as_aerospike_init(&g_as_aerospike, NULL, &udf_aerospike_hooks);
 	ldt_init();
 }
@@ -269,6 +278,13 @@ as_udf_start(as_transaction* tr)
 		return TRANS_DONE_ERROR;
 	}
 
+	// Push back if async replication has fallen too far behind.
+	if (repl_log_is_full(tr)) {
+		tr->result_code = AS_PROTO_RESULT_FAIL_REPL_LAG;
+		send_udf_response(tr, NULL);
+		return TRANS_DONE_ERROR;
+	}
+
 	// Create rw_request and add to hash.
 	rw_request_hkey hkey = { tr->rsv.ns->id, tr->keyd };
 	rw_request* rw = rw_request_create(&tr->keyd);
@@ -330,6 +346,14 @@ as_udf_start(as_transaction* tr)
 		return TRANS_DONE_SUCCESS;
 	}
 
+	// With async replication, transaction is finished once replica writes are
+	// logged.
+	if (repl_log_write(rw, tr)) {
+		send_udf_response(tr, &rw->response_db);
+		rw_request_hash_delete(&hkey, rw);
+		return TRANS_DONE_SUCCESS;
+	}
+
 	if (! start_udf_repl_write(rw, tr)) {
 		rw_request_hash_delete(&hkey, rw);
 		tr->result_code = AS_PROTO_RESULT_FAIL_UNKNOWN;
@@ -452,6 +476,11 @@ udf_dup_res_cb(rw_request* rw)
 		return true;
 	}
 
+	if (repl_log_write(rw, &tr)) {
+		send_udf_response(&tr, &rw->response_db);
+		return true;
+	}
+
 	if (! udf_repl_write_after_dup_res(rw, &tr)) {
 		tr.result_code = AS_PROTO_RESULT_FAIL_UNKNOWN;
 		send_udf_response(&tr, NULL);
@@ -529,6 +558,7 @@ send_udf_response(as_transaction* tr, cf_dyn_buf* db)
 		}
 		BENCHMARK_NEXT_DATA_POINT(tr, udf, response);
 		HIST_TRACK_ACTIVATE_INSERT_DATA_POINT(tr, udf_hist);
+		as_slow_txn_check(tr);
 		client_udf_update_stats(tr->rsv.ns, tr->result_code);
 		break;
 	case FROM_PROXY:
@@ -678,7 +708,7 @@ udf_master_apply(udf_call* call, rw_request* rw)
 
 	int get_rv = as_record_get(tr->rsv.tree, &tr->keyd, &r_ref, ns);
 
-	if (get_rv == 0 && as_record_is_expired(r_ref.r)) {
+	if (get_rv == 0 && as_record_is_doomed(r_ref.r, ns)) {
 		// If record is expired, pretend it was not found.
 		as_record_done(&r_ref, ns);
 		get_rv = -1;
@@ -747,6 +777,32 @@ udf_master_apply(udf_call* call, rw_request* rw)
 				UDF_RECORD_FLAG_PREEXISTS);
 	}
 
+	// Serve results of deterministic read functions from the cache, if the
+	// record hasn't changed since.
+
+	bool cacheable = get_rv == 0 && tr->origin != FROM_IUDF &&
+			(urecord.flag & UDF_RECORD_FLAG_METADATA_UPDATED) == 0 &&
+			udf_result_cache_enabled(call->def);
+	uint16_t generation = 0;
+	uint64_t last_update_time = 0;
+
+	if (cacheable) {
+		generation = r_ref.r->generation;
+		last_update_time = r_ref.r->last_update_time;
+
+		as_val* cached = udf_result_cache_get(call->def, ns, &tr->keyd,
+				generation, last_update_time);
+
+		if (cached) {
+			udf_record_close(&urecord);
+			process_success(call, cached, &rw->response_db);
+			as_val_destroy(cached);
+			update_lua_complete_stats(tr->origin, ns, UDF_OPTYPE_READ, 0, true);
+			ldt_record_destroy(&lrecord);
+			return UDF_OPTYPE_READ;
+		}
+	}
+
 	// Run UDF.
 
 	// This as_rec needs to be in the heap - once passed into the lua scope it
@@ -777,6 +833,11 @@ udf_master_apply(udf_call* call, rw_request* rw)
 		if (! result.is_success) {
 			ldt_update_err_stats(ns, result.value);
 		}
+		else if (cacheable && optype == UDF_OPTYPE_READ &&
+				(lrecord.udf_context & UDF_CONTEXT_LDT) == 0) {
+			udf_result_cache_put(call->def, ns, &tr->keyd, generation,
+					last_update_time, result.value);
+		}
 
 		process_result(&result, call, &rw->response_db);
 	}
@@ -822,16 +883,23 @@ udf_apply_record(udf_call* call, as_rec* rec, as_result* result)
 	as_timer timer;
 	as_timer_init(&timer, &udf_timer_tracker, &udf_timer_hooks);
 
+	udf_mem_call mem_call;
+
 	as_udf_context ctx = {
 		.as			= &g_ldt_aerospike,
 		.timer		= &timer,
-		.memtracker	= NULL
+		.memtracker	= udf_mem_call_setup(&mem_call, call->def->filename)
 	};
 
 	uint64_t start_time = g_config.ldt_benchmarks ? cf_getns() : 0;
 
-	int apply_rv = as_module_apply_record(&mod_lua, &ctx, call->def->filename,
-			call->def->function, rec, &arglist, result);
+	udf_native_record_fn native_fn = udf_native_record_get(
+			call->def->filename, call->def->function);
+
+	int apply_rv = native_fn ?
+			native_fn(&ctx, rec, &arglist, result) :
+			as_module_apply_record(&mod_lua, &ctx, call->def->filename,
+					call->def->function, rec, &arglist, result);
 
 	if (start_time != 0) {
 		ldt_record* lrecord = (ldt_record*)as_rec_source(rec);
@@ -841,6 +909,7 @@ udf_apply_record(udf_call* call, as_rec* rec, as_result* result)
 		}
 	}
 
+	udf_mem_call_done(&mem_call);
 	udf_timer_cleanup();
 	as_list_destroy(&arglist);
 
@@ -1011,6 +1080,7 @@ udf_post_processing(udf_record* urecord, udf_optype* urecord_op,
 
 	if (UDF_OP_IS_DELETE(*urecord_op) || UDF_OP_IS_WRITE(*urecord_op)) {
 		udf_xdr_ship_op = true;
+		as_read_coalesce_record_changed(tr->rsv.ns, &urecord->keyd);
 	}
 
 	if (udf_zero_bins_left(urecord)) {
@@ -1037,7 +1107,7 @@ udf_post_processing(udf_record* urecord, udf_optype* urecord_op,
 		if (! as_index_is_flag_set(r_ref->r, AS_INDEX_FLAG_KEY_STORED) &&
 				rd->key) {
 			if (rd->ns->storage_data_in_memory) {
-				as_record_allocate_key(r_ref->r, rd->key, rd->key_size);
+				as_record_allocate_key(r_ref->r, rd->ns, rd->key, rd->key_size);
 			}
 
 			as_index_set_flags(r_ref->r, AS_INDEX_FLAG_KEY_STORED);
@@ -1046,7 +1116,7 @@ udf_post_processing(udf_record* urecord, udf_optype* urecord_op,
 		else if (as_index_is_flag_set(r_ref->r, AS_INDEX_FLAG_KEY_STORED) &&
 				! rd->key) {
 			if (rd->ns->storage_data_in_memory) {
-				as_record_remove_key(r_ref->r);
+				as_record_remove_key(r_ref->r, rd->ns);
 			}
 
 			as_index_clear_flags(r_ref->r, AS_INDEX_FLAG_KEY_STORED);
@@ -1316,6 +1386,7 @@ process_udf_failure(udf_call* call, const as_string* s, cf_dyn_buf* db)
 
 	db->buf = msgp;
 	db->is_stack = false;
+	db->is_pooled = true; // alloc_sz may understate the buffer - ok
 	db->alloc_sz = msg_sz;
 	db->used_sz = msg_sz;
 }
@@ -1377,6 +1448,7 @@ process_response(udf_call* call, const char* bin_name, const as_val* val,
 
 	db->buf = msgp;
 	db->is_stack = false;
+	db->is_pooled = true; // alloc_sz may understate the buffer - ok
 	db->alloc_sz = msg_sz;
 	db->used_sz = msg_sz;
 
@@ -39,18 +39,25 @@
 #include "fault.h"
 #include "jem.h"
 
+#include "base/admission.h"
+#include "base/batch.h"
 #include "base/cfg.h"
 #include "base/datamodel.h"
+#include "base/dim_slab.h"
+#include "base/incr_hist.h"
 #include "base/index.h"
 #include "base/ldt.h"
 #include "base/proto.h"
 #include "base/secondary_index.h"
+#include "base/slow_txn.h"
 #include "base/transaction.h"
 #include "base/transaction_policy.h"
 #include "base/xdr_serverside.h"
 #include "storage/storage.h"
 #include "transaction/duplicate_resolve.h"
 #include "transaction/proxy.h"
+#include "transaction/read_coalesce.h"
+#include "transaction/repl_log.h"
 #include "transaction/replica_write.h"
 #include "transaction/rw_request.h"
 #include "transaction/rw_request_hash.h"
@@ -62,6 +69,7 @@
 //
 
 #define STACK_PARTICLES_SIZE (1024 * 1024)
+#define CDT_RUN_PARTICLES_SIZE (64 * 1024)
 
 typedef struct index_metadata_s {
 	uint32_t void_time;
@@ -92,7 +100,8 @@ int write_master_policies(as_transaction* tr, bool* p_must_not_create,
 		bool* p_record_level_replace, bool* p_must_fetch_data,
 		bool* p_increment_generation);
 bool check_msg_set_name(as_transaction* tr, const char* set_name);
-int write_master_handle_msg_key(as_transaction* tr, as_storage_rd* rd);
+int write_master_handle_msg_key(as_transaction* tr, as_storage_rd* rd,
+		const char* set_name, bool blind_write);
 
 int write_master_dim_single_bin(as_transaction* tr, as_storage_rd* rd,
 		bool record_created, bool increment_generation, rw_request* rw,
@@ -105,9 +114,10 @@ int write_master_ssd_single_bin(as_transaction* tr, as_storage_rd* rd,
 		bool* is_delete, xdr_dirty_bins* dirty_bins);
 int write_master_ssd(as_transaction* tr, const char* set_name,
 		as_storage_rd* rd, bool must_fetch_data, bool record_level_replace,
-		bool increment_generation, rw_request* rw, bool* is_delete,
-		xdr_dirty_bins* dirty_bins);
+		bool has_sindex, bool increment_generation, rw_request* rw,
+		bool* is_delete, xdr_dirty_bins* dirty_bins);
 
+bool write_master_is_index_only_touch(as_transaction* tr, as_storage_rd* rd);
 void write_master_update_index_metadata(as_transaction* tr,
 		bool increment_generation, index_metadata* old, as_record* r);
 int write_master_bin_ops(as_transaction* tr, as_storage_rd* rd,
@@ -118,12 +128,20 @@ int write_master_bin_ops_loop(as_transaction* tr, as_storage_rd* rd,
 		as_bin* result_bins, uint32_t* p_n_result_bins,
 		cf_ll_buf* particles_llb, as_bin* cleanup_bins,
 		uint32_t* p_n_cleanup_bins, xdr_dirty_bins* dirty_bins);
+int write_master_cdt_modify_run(as_transaction* tr, as_bin* b,
+		as_msg_op** p_op, int* p_i, as_msg_op** ops, as_bin* response_bins,
+		uint32_t* p_n_response_bins, as_bin* result_bins,
+		uint32_t* p_n_result_bins, as_bin* cleanup_bins,
+		uint32_t* p_n_cleanup_bins);
+int write_master_particle_to_heap(as_bin* b);
 int write_master_bin_check(as_transaction* tr, as_bin* bin);
+int write_master_compare(as_transaction* tr, as_storage_rd* rd,
+		as_msg_op* op);
 bool write_master_sindex_update(as_namespace* ns, const char* set_name,
 		cf_digest* keyd, as_bin* old_bins, uint32_t n_old_bins,
 		as_bin* new_bins, uint32_t n_new_bins);
 
-void write_master_index_metadata_unwind(index_metadata* old, as_record* r);
+void write_master_index_metadata_unwind(index_metadata* old, as_record* r, as_namespace* ns);
 void write_master_dim_single_bin_unwind(as_bin* old_bin, as_bin* new_bin,
 		as_bin* cleanup_bins, uint32_t n_cleanup_bins);
 void write_master_dim_unwind(as_bin* old_bins, uint32_t n_old_bins,
@@ -135,19 +153,19 @@ client_write_update_stats(as_namespace* ns, uint8_t result_code, bool is_xdr_op)
 {
 	switch (result_code) {
 	case AS_PROTO_RESULT_OK:
-		cf_atomic64_incr(&ns->n_client_write_success);
+		cf_shard_counter_incr(&ns->n_client_write_success);
 		if (is_xdr_op) {
 			cf_atomic64_incr(&ns->n_xdr_write_success);
 		}
 		break;
 	case AS_PROTO_RESULT_FAIL_TIMEOUT:
-		cf_atomic64_incr(&ns->n_client_write_timeout);
+		cf_shard_counter_incr(&ns->n_client_write_timeout);
 		if (is_xdr_op) {
 			cf_atomic64_incr(&ns->n_xdr_write_timeout);
 		}
 		break;
 	default:
-		cf_atomic64_incr(&ns->n_client_write_error);
+		cf_shard_counter_incr(&ns->n_client_write_error);
 		if (is_xdr_op) {
 			cf_atomic64_incr(&ns->n_xdr_write_error);
 		}
@@ -155,6 +173,22 @@ client_write_update_stats(as_namespace* ns, uint8_t result_code, bool is_xdr_op)
 	}
 }
 
+static inline void
+batch_sub_write_update_stats(as_namespace* ns, uint8_t result_code)
+{
+	switch (result_code) {
+	case AS_PROTO_RESULT_OK:
+		cf_atomic64_incr(&ns->n_batch_sub_write_success);
+		break;
+	case AS_PROTO_RESULT_FAIL_TIMEOUT:
+		cf_atomic64_incr(&ns->n_batch_sub_write_timeout);
+		break;
+	default:
+		cf_atomic64_incr(&ns->n_batch_sub_write_error);
+		break;
+	}
+}
+
 static inline void
 append_bin_to_destroy(as_bin* b, as_bin* bins, uint32_t* p_n_bins)
 {
@@ -163,6 +197,24 @@ append_bin_to_destroy(as_bin* b, as_bin* bins, uint32_t* p_n_bins)
 	}
 }
 
+// Returns the next op if it's a CDT modify of the same bin as op, else NULL.
+static inline as_msg_op*
+next_cdt_modify_on_bin(const as_msg* m, as_msg_op* op, int i)
+{
+	if (i + 1 >= (int)m->n_ops) {
+		return NULL;
+	}
+
+	as_msg_op* next = as_msg_op_get_next(op);
+
+	if (next->op != AS_MSG_OP_CDT_MODIFY || next->name_sz != op->name_sz ||
+			memcmp(next->name, op->name, op->name_sz) != 0) {
+		return NULL;
+	}
+
+	return next;
+}
+
 
 //==========================================================
 // Public API.
@@ -172,6 +224,7 @@ transaction_status
 as_write_start(as_transaction* tr)
 {
 	BENCHMARK_START(tr, write, FROM_CLIENT);
+	STAGE_START(tr, AS_STAGE_WRITE_QUEUE);
 
 	// Apply XDR filter.
 	if (! xdr_allows_write(tr)) {
@@ -187,6 +240,20 @@ as_write_start(as_transaction* tr)
 		return TRANS_DONE_ERROR;
 	}
 
+	// Shed writes if admission control says we're badly overloaded.
+	if (as_admission_shed(tr->rsv.ns, AS_ADMIT_WRITE)) {
+		tr->result_code = AS_PROTO_RESULT_FAIL_WRITE_SHED;
+		send_write_response(tr, NULL);
+		return TRANS_DONE_ERROR;
+	}
+
+	// Push back if async replication has fallen too far behind.
+	if (repl_log_is_full(tr)) {
+		tr->result_code = AS_PROTO_RESULT_FAIL_REPL_LAG;
+		send_write_response(tr, NULL);
+		return TRANS_DONE_ERROR;
+	}
+
 	// Create rw_request and add to hash.
 	rw_request_hkey hkey = { tr->rsv.ns->id, tr->keyd };
 	rw_request* rw = rw_request_create(&tr->keyd);
@@ -227,6 +294,7 @@ as_write_start(as_transaction* tr)
 	status = write_master(rw, tr);
 
 	BENCHMARK_NEXT_DATA_POINT(tr, write, master);
+	STAGE_NEXT_DATA_POINT(tr, AS_STAGE_WRITE_MASTER);
 
 	// If error, transaction is finished.
 	if (status != TRANS_IN_PROGRESS) {
@@ -247,6 +315,14 @@ as_write_start(as_transaction* tr)
 		return TRANS_DONE_SUCCESS;
 	}
 
+	// With async replication, transaction is finished once replica writes are
+	// logged.
+	if (repl_log_write(rw, tr)) {
+		send_write_response(tr, &rw->response_db);
+		rw_request_hash_delete(&hkey, rw);
+		return TRANS_DONE_SUCCESS;
+	}
+
 	if (! start_write_repl_write(rw, tr)) {
 		rw_request_hash_delete(&hkey, rw);
 		tr->result_code = AS_PROTO_RESULT_FAIL_UNKNOWN;
@@ -317,6 +393,7 @@ bool
 write_dup_res_cb(rw_request* rw)
 {
 	BENCHMARK_NEXT_DATA_POINT(rw, write, dup_res);
+	STAGE_NEXT_DATA_POINT(rw, AS_STAGE_WRITE_DUP_RES);
 
 	as_transaction tr;
 	as_transaction_init_from_rw(&tr, rw);
@@ -324,6 +401,7 @@ write_dup_res_cb(rw_request* rw)
 	transaction_status status = write_master(rw, &tr);
 
 	BENCHMARK_NEXT_DATA_POINT((&tr), write, master);
+	STAGE_NEXT_DATA_POINT((&tr), AS_STAGE_WRITE_MASTER);
 
 	if (status == TRANS_DONE_ERROR) {
 		send_write_response(&tr, NULL);
@@ -340,6 +418,11 @@ write_dup_res_cb(rw_request* rw)
 		return true;
 	}
 
+	if (repl_log_write(rw, &tr)) {
+		send_write_response(&tr, &rw->response_db);
+		return true;
+	}
+
 	if (! write_repl_write_after_dup_res(rw, &tr)) {
 		tr.result_code = AS_PROTO_RESULT_FAIL_UNKNOWN;
 		send_write_response(&tr, NULL);
@@ -378,6 +461,7 @@ void
 write_repl_write_cb(rw_request* rw)
 {
 	BENCHMARK_NEXT_DATA_POINT(rw, write, repl_write);
+	STAGE_NEXT_DATA_POINT(rw, AS_STAGE_WRITE_REPL_WRITE);
 
 	as_transaction tr;
 	as_transaction_init_from_rw(&tr, rw);
@@ -415,7 +499,9 @@ send_write_response(as_transaction* tr, cf_dyn_buf* db)
 					as_transaction_trid(tr), NULL);
 		}
 		BENCHMARK_NEXT_DATA_POINT(tr, write, response);
+		STAGE_NEXT_DATA_POINT(tr, AS_STAGE_WRITE_RESPONSE);
 		HIST_TRACK_ACTIVATE_INSERT_DATA_POINT(tr, write_hist);
+		as_slow_txn_check(tr);
 		client_write_update_stats(tr->rsv.ns, tr->result_code,
 				as_transaction_is_xdr(tr));
 		break;
@@ -431,10 +517,21 @@ send_write_response(as_transaction* tr, cf_dyn_buf* db)
 		}
 		break;
 	case FROM_BATCH:
+		if (db && db->used_sz != 0) {
+			// Same form as a proxied response - ready-made message.
+			as_batch_add_proxy_result(tr->from.batch_shared,
+					tr->from_data.batch_index, &tr->keyd, (cl_msg*)db->buf,
+					db->used_sz);
+		}
+		else {
+			as_batch_add_result(tr, NULL, tr->generation, tr->void_time, 0,
+					NULL, NULL);
+		}
+		batch_sub_write_update_stats(tr->rsv.ns, tr->result_code);
+		break;
 	case FROM_IUDF:
 	case FROM_NSUP:
-		// Should be impossible for batch reads, internal UDFs, and nsup deletes
-		// to get here.
+		// Should be impossible for internal UDFs and nsup deletes to get here.
 	default:
 		cf_crash(AS_RW, "unexpected transaction origin %u", tr->origin);
 		break;
@@ -461,10 +558,14 @@ write_timeout_cb(rw_request* rw)
 	case FROM_PROXY:
 		break;
 	case FROM_BATCH:
+		as_batch_add_error(rw->from.batch_shared, rw->from_data.batch_index,
+				AS_PROTO_RESULT_FAIL_TIMEOUT);
+		// Timeouts aren't included in histograms.
+		batch_sub_write_update_stats(rw->rsv.ns, AS_PROTO_RESULT_FAIL_TIMEOUT);
+		break;
 	case FROM_IUDF:
 	case FROM_NSUP:
-		// Should be impossible for batch reads, internal UDFs, and nsup deletes
-		// to get here.
+		// Should be impossible for internal UDFs and nsup deletes to get here.
 	default:
 		cf_crash(AS_RW, "unexpected transaction origin %u", rw->origin);
 		break;
@@ -508,6 +609,15 @@ write_master(rw_request* rw, as_transaction* tr)
 		return TRANS_DONE_ERROR;
 	}
 
+	// Don't spend device reads and writes on a transaction that's already
+	// timed out - nothing has been changed yet.
+	if (! tr->rsv.ns->storage_data_in_memory &&
+			as_transaction_is_past_deadline(tr)) {
+		cf_atomic64_incr(&tr->rsv.ns->n_deadline_drops);
+		write_master_failed(tr, 0, false, 0, 0, AS_PROTO_RESULT_FAIL_TIMEOUT);
+		return TRANS_DONE_ERROR;
+	}
+
 	//------------------------------------------------------
 	// Find or create the as_index and get a reference -
 	// this locks the record. Perform all checks that don't
@@ -533,7 +643,7 @@ write_master(rw_request* rw, as_transaction* tr)
 
 		r = r_ref.r;
 
-		if (as_record_is_expired(r)) {
+		if (as_record_is_doomed(r, ns)) {
 			write_master_failed(tr, &r_ref, record_created, tree, 0, AS_PROTO_RESULT_FAIL_NOTFOUND);
 			return TRANS_DONE_ERROR;
 		}
@@ -550,8 +660,8 @@ write_master(rw_request* rw, as_transaction* tr)
 		r = r_ref.r;
 		record_created = rv == 1;
 
-		// If it's an expired record, pretend it's a fresh create.
-		if (! record_created && as_record_is_expired(r)) {
+		// If it's an expired or truncated record, pretend it's a fresh create.
+		if (! record_created && as_record_is_doomed(r, ns)) {
 			as_record_destroy(r, ns);
 			as_record_initialize(&r_ref, ns);
 			cf_atomic_int_incr(&ns->n_objects);
@@ -559,6 +669,8 @@ write_master(rw_request* rw, as_transaction* tr)
 		}
 	}
 
+	STAGE_NEXT_DATA_POINT(tr, AS_STAGE_WRITE_LOCK);
+
 	// Enforce record-level create-only existence policy.
 	if ((m->info2 & AS_MSG_INFO2_CREATE_ONLY) && ! record_created) {
 		write_master_failed(tr, &r_ref, record_created, tree, 0, AS_PROTO_RESULT_FAIL_RECORD_EXISTS);
@@ -614,8 +726,19 @@ write_master(rw_request* rw, as_transaction* tr)
 		as_storage_record_open(ns, r, &rd, &tr->keyd);
 	}
 
+	// Sindexes on other sets don't need this record's old bins.
+	bool has_sindex = ! ns->storage_data_in_memory && ! ns->single_bin &&
+			as_sindex_set_has_sindex(ns, set_name);
+
+	// A blind write replaces an existing record on the device without ever
+	// reading it - the old block is just freed when the new one is written.
+	bool blind_write = ! ns->storage_data_in_memory && ! record_created &&
+			! must_fetch_data &&
+			(ns->single_bin || (record_level_replace && ! has_sindex));
+
 	// Deal with key storage as needed.
-	if (0 != (result = write_master_handle_msg_key(tr, &rd))) {
+	if (0 != (result = write_master_handle_msg_key(tr, &rd, set_name,
+			blind_write))) {
 		write_master_failed(tr, &r_ref, record_created, tree, &rd, result);
 		return TRANS_DONE_ERROR;
 	}
@@ -666,8 +789,8 @@ write_master(rw_request* rw, as_transaction* tr)
 		}
 		else {
 			result = write_master_ssd(tr, set_name, &rd,
-					must_fetch_data, record_level_replace, increment_generation,
-					rw, &is_delete, &dirty_bins);
+					must_fetch_data, record_level_replace, has_sindex,
+					increment_generation, rw, &is_delete, &dirty_bins);
 		}
 	}
 
@@ -680,6 +803,11 @@ write_master(rw_request* rw, as_transaction* tr)
 		return TRANS_DONE_ERROR;
 	}
 
+	// Count blind writes only once the new record is on the device.
+	if (blind_write && (tr->flags & AS_TRANSACTION_FLAG_INDEX_ONLY) == 0) {
+		cf_atomic64_incr(&ns->n_blind_writes);
+	}
+
 	//------------------------------------------------------
 	// Done - complete function's output, release the record
 	// lock, and do XDR write if appropriate.
@@ -692,6 +820,9 @@ write_master(rw_request* rw, as_transaction* tr)
 	// Get set-id before releasing.
 	uint16_t set_id = as_index_get_set_id(r_ref.r);
 
+	// Reads from now on mustn't share an in-flight read of the old record.
+	as_read_coalesce_record_changed(ns, &tr->keyd);
+
 	// If we ended up with no bins, delete the record.
 	if (is_delete) {
 		as_index_delete(tree, &tr->keyd);
@@ -883,6 +1014,19 @@ write_master_policies(as_transaction* tr, bool* p_must_not_create,
 
 			must_fetch_data = true;
 		}
+		else if (op->op == AS_MSG_OP_COMPARE) {
+			if (record_level_replace) {
+				cf_warning_digest(AS_RW, &tr->keyd, "{%s} write_master: compare op can't have record-level replace flag ", ns->name);
+				return AS_PROTO_RESULT_FAIL_PARAMETER;
+			}
+
+			if (op->version > AS_MSG_COMPARE_GE) {
+				cf_warning_digest(AS_RW, &tr->keyd, "{%s} write_master: unknown comparison %u ", ns->name, op->version);
+				return AS_PROTO_RESULT_FAIL_PARAMETER;
+			}
+
+			must_fetch_data = true;
+		}
 		else if (op_is_read_all(op, m)) {
 			if (respond_all_ops) {
 				cf_warning_digest(AS_RW, &tr->keyd, "{%s} write_master: read-all op can't have respond-all-ops flag ", ns->name);
@@ -910,7 +1054,8 @@ write_master_policies(as_transaction* tr, bool* p_must_not_create,
 			generates_response_bin = true; // CDT modify may generate a response bin
 			must_fetch_data = true;
 		}
-		else if (op->op == AS_MSG_OP_CDT_READ) {
+		else if (op->op == AS_MSG_OP_CDT_READ ||
+				op->op == AS_MSG_OP_BLOB_READ) {
 			generates_response_bin = true;
 			must_fetch_data = true;
 		}
@@ -970,7 +1115,8 @@ check_msg_set_name(as_transaction* tr, const char* set_name)
 
 
 int
-write_master_handle_msg_key(as_transaction* tr, as_storage_rd* rd)
+write_master_handle_msg_key(as_transaction* tr, as_storage_rd* rd,
+		const char* set_name, bool blind_write)
 {
 	// Shortcut pointers.
 	as_msg* m = &tr->msgp->msg;
@@ -979,11 +1125,18 @@ write_master_handle_msg_key(as_transaction* tr, as_storage_rd* rd)
 	if (as_index_is_flag_set(rd->r, AS_INDEX_FLAG_KEY_STORED)) {
 		// Key stored for this record - be sure it gets rewritten.
 
+		// For a blind write, use the client-sent key if it hashes to the
+		// digest - the stored key could only differ by a digest collision.
+		if (blind_write && as_transaction_has_key(tr) &&
+				msg_key_matches_digest(tr, set_name)) {
+			get_msg_key(tr, rd);
+			return 0;
+		}
+
 		// This will force a device read for non-data-in-memory, even if
 		// must_fetch_data is false! Since there's no advantage to using the
 		// loaded block after this if must_fetch_data is false, leave the
 		// subsequent code as-is.
-		// TODO - use client-sent key instead of device-stored key if available?
 		if (! as_storage_record_get_key(rd)) {
 			cf_warning_digest(AS_RW, &tr->keyd, "{%s} write_master: can't get stored key ", ns->name);
 			return AS_PROTO_RESULT_FAIL_UNKNOWN;
@@ -1036,7 +1189,7 @@ write_master_dim_single_bin(as_transaction* tr, as_storage_rd* rd,
 	// For data-in-memory:
 	// - if just created record - sets rd->bins to empty bin embedded in index
 	// - otherwise - sets rd->bins to existing embedded bin
-	as_storage_rd_load_bins(rd, NULL);
+	as_storage_rd_load_bins_dim(rd, true);
 
 	// For memory accounting, note current usage.
 	uint64_t memory_bytes = 0;
@@ -1080,7 +1233,7 @@ write_master_dim_single_bin(as_transaction* tr, as_storage_rd* rd,
 			&n_cleanup_bins, &rw->response_db, dirty_bins);
 
 	if (result != 0) {
-		write_master_index_metadata_unwind(&old_metadata, r);
+		write_master_index_metadata_unwind(&old_metadata, r, ns);
 		write_master_dim_single_bin_unwind(&old_bin, rd->bins, cleanup_bins, n_cleanup_bins);
 		return result;
 	}
@@ -1091,7 +1244,7 @@ write_master_dim_single_bin(as_transaction* tr, as_storage_rd* rd,
 
 	// Pickle before writing - can't fail after.
 	if (! pickle_all(rd, rw)) {
-		write_master_index_metadata_unwind(&old_metadata, r);
+		write_master_index_metadata_unwind(&old_metadata, r, ns);
 		write_master_dim_single_bin_unwind(&old_bin, rd->bins, cleanup_bins, n_cleanup_bins);
 		return AS_PROTO_RESULT_FAIL_UNKNOWN;
 	}
@@ -1102,7 +1255,7 @@ write_master_dim_single_bin(as_transaction* tr, as_storage_rd* rd,
 
 	if ((result = as_storage_record_write(r, rd)) < 0) {
 		cf_warning_digest(AS_RW, &tr->keyd, "{%s} write_master: failed as_storage_record_write() ", ns->name);
-		write_master_index_metadata_unwind(&old_metadata, r);
+		write_master_index_metadata_unwind(&old_metadata, r, ns);
 		write_master_dim_single_bin_unwind(&old_bin, rd->bins, cleanup_bins, n_cleanup_bins);
 		return -result;
 	}
@@ -1131,13 +1284,13 @@ write_master_dim(as_transaction* tr, const char* set_name, as_storage_rd* rd,
 	as_record* r = rd->r;
 
 	// For data-in-memory - number of bins in existing record.
-	rd->n_bins = as_bin_get_n_bins(r, rd);
+	rd->n_bins = as_bin_get_n_bins_dim(r);
 
 	// Set rd->bins!
 	// For data-in-memory:
 	// - if just created record - sets rd->bins to NULL
 	// - otherwise - sets rd->bins to existing (already populated) bins array
-	as_storage_rd_load_bins(rd, NULL);
+	as_storage_rd_load_bins_dim(rd, false);
 
 	// For memory accounting, note current usage.
 	uint64_t memory_bytes = as_storage_record_get_n_bytes_memory(rd);
@@ -1197,7 +1350,7 @@ write_master_dim(as_transaction* tr, const char* set_name, as_storage_rd* rd,
 			&n_cleanup_bins, &rw->response_db, dirty_bins);
 
 	if (result != 0) {
-		write_master_index_metadata_unwind(&old_metadata, r);
+		write_master_index_metadata_unwind(&old_metadata, r, ns);
 		write_master_dim_unwind(old_bins, n_old_bins, new_bins, n_new_bins, cleanup_bins, n_cleanup_bins);
 		return result;
 	}
@@ -1211,20 +1364,32 @@ write_master_dim(as_transaction* tr, const char* set_name, as_storage_rd* rd,
 	n_new_bins = (uint32_t)rd->n_bins;
 	new_bins_size = n_new_bins * sizeof(as_bin);
 
-	as_bin_space* new_bin_space = (as_bin_space*)
-			cf_malloc(sizeof(as_bin_space) + new_bins_size);
+	as_bin_space* old_bin_space = as_index_get_bin_space(r);
+
+	// If the number of bins is unchanged - e.g. increments of existing bins -
+	// the existing bin space can take the new bins, no need to reallocate.
+	// (Only the allocation is saved - such writes still bump the generation,
+	// write to storage and replicate like any other.)
+	bool reuse_bin_space = old_bin_space &&
+			old_bin_space->n_bins == (uint16_t)n_new_bins;
+
+	as_bin_space* new_bin_space = reuse_bin_space ? old_bin_space :
+			as_dim_slab_alloc_bin_space(ns, (uint16_t)n_new_bins);
 
 	if (! new_bin_space) {
 		cf_warning(AS_RW, "write_master: failed alloc new as_bin_space");
-		write_master_index_metadata_unwind(&old_metadata, r);
+		write_master_index_metadata_unwind(&old_metadata, r, ns);
 		write_master_dim_unwind(old_bins, n_old_bins, new_bins, n_new_bins, cleanup_bins, n_cleanup_bins);
 		return AS_PROTO_RESULT_FAIL_UNKNOWN;
 	}
 
 	// Pickle before writing - can't fail after.
 	if (! pickle_all(rd, rw)) {
-		cf_free(new_bin_space);
-		write_master_index_metadata_unwind(&old_metadata, r);
+		if (! reuse_bin_space) {
+			as_dim_slab_free_bin_space(ns, new_bin_space, (uint16_t)n_new_bins);
+		}
+
+		write_master_index_metadata_unwind(&old_metadata, r, ns);
 		write_master_dim_unwind(old_bins, n_old_bins, new_bins, n_new_bins, cleanup_bins, n_cleanup_bins);
 		return AS_PROTO_RESULT_FAIL_UNKNOWN;
 	}
@@ -1235,8 +1400,11 @@ write_master_dim(as_transaction* tr, const char* set_name, as_storage_rd* rd,
 
 	if ((result = as_storage_record_write(r, rd)) < 0) {
 		cf_warning_digest(AS_RW, &tr->keyd, "{%s} write_master: failed as_storage_record_write() ", ns->name);
-		cf_free(new_bin_space);
-		write_master_index_metadata_unwind(&old_metadata, r);
+		if (! reuse_bin_space) {
+			as_dim_slab_free_bin_space(ns, new_bin_space, (uint16_t)n_new_bins);
+		}
+
+		write_master_index_metadata_unwind(&old_metadata, r, ns);
 		write_master_dim_unwind(old_bins, n_old_bins, new_bins, n_new_bins, cleanup_bins, n_cleanup_bins);
 		return -result;
 	}
@@ -1270,18 +1438,18 @@ write_master_dim(as_transaction* tr, const char* set_name, as_storage_rd* rd,
 	memcpy((void*)new_bin_space->bins, new_bins, new_bins_size);
 
 	// Swizzle the index element's as_bin_space pointer.
-	as_bin_space* old_bin_space = as_index_get_bin_space(r);
+	if (! reuse_bin_space) {
+		if (old_bin_space) {
+			as_dim_slab_free_bin_space(ns, old_bin_space, old_bin_space->n_bins);
+		}
 
-	if (old_bin_space) {
-		cf_free(old_bin_space);
+		as_index_set_bin_space(r, new_bin_space);
 	}
 
-	as_index_set_bin_space(r, new_bin_space);
-
 	// Accommodate a new stored key - wasn't needed for pickling and writing.
 	if (! as_index_is_flag_set(r, AS_INDEX_FLAG_KEY_STORED) && rd->key) {
 		// TODO - should we check allocation failure?
-		as_record_allocate_key(r, rd->key, rd->key_size);
+		as_record_allocate_key(r, ns, rd->key, rd->key_size);
 		as_index_set_flags(r, AS_INDEX_FLAG_KEY_STORED);
 	}
 
@@ -1313,7 +1481,7 @@ write_master_ssd_single_bin(as_transaction* tr, as_storage_rd* rd,
 	// - otherwise - sets rd->bins to stack_bin, reads existing record off
 	//		device and populates bin (including particle pointer into block
 	//		buffer)
-	int result = as_storage_rd_load_bins(rd, &stack_bin);
+	int result = as_storage_rd_load_bins_ssd(rd, &stack_bin);
 
 	if (result < 0) {
 		cf_warning_digest(AS_RW, &tr->keyd, "{%s} write_master: failed as_storage_rd_load_bins()", ns->name);
@@ -1339,7 +1507,7 @@ write_master_ssd_single_bin(as_transaction* tr, as_storage_rd* rd,
 	if ((result = write_master_bin_ops(tr, rd, &particles_llb, NULL, NULL,
 			&rw->response_db, dirty_bins)) != 0) {
 		cf_ll_buf_free(&particles_llb);
-		write_master_index_metadata_unwind(&old_metadata, r);
+		write_master_index_metadata_unwind(&old_metadata, r, ns);
 		return result;
 	}
 
@@ -1350,7 +1518,7 @@ write_master_ssd_single_bin(as_transaction* tr, as_storage_rd* rd,
 	// Pickle before writing - bins may disappear on as_storage_record_close().
 	if (! pickle_all(rd, rw)) {
 		cf_ll_buf_free(&particles_llb);
-		write_master_index_metadata_unwind(&old_metadata, r);
+		write_master_index_metadata_unwind(&old_metadata, r, ns);
 		return AS_PROTO_RESULT_FAIL_UNKNOWN;
 	}
 
@@ -1358,10 +1526,15 @@ write_master_ssd_single_bin(as_transaction* tr, as_storage_rd* rd,
 	// Write the record to storage.
 	//
 
-	if ((result = as_storage_record_write(r, rd)) < 0) {
+	if (write_master_is_index_only_touch(tr, rd)) {
+		// Bins are unchanged - defrag will bring the device copy up to date.
+		tr->flags |= AS_TRANSACTION_FLAG_INDEX_ONLY;
+		cf_atomic64_incr(&ns->n_index_only_touches);
+	}
+	else if ((result = as_storage_record_write(r, rd)) < 0) {
 		cf_warning_digest(AS_RW, &tr->keyd, "{%s} write_master: failed as_storage_record_write() ", ns->name);
 		cf_ll_buf_free(&particles_llb);
-		write_master_index_metadata_unwind(&old_metadata, r);
+		write_master_index_metadata_unwind(&old_metadata, r, ns);
 		return -result;
 	}
 
@@ -1383,7 +1556,7 @@ write_master_ssd_single_bin(as_transaction* tr, as_storage_rd* rd,
 
 int
 write_master_ssd(as_transaction* tr, const char* set_name, as_storage_rd* rd,
-		bool must_fetch_data, bool record_level_replace,
+		bool must_fetch_data, bool record_level_replace, bool has_sindex,
 		bool increment_generation, rw_request* rw, bool* is_delete,
 		xdr_dirty_bins* dirty_bins)
 {
@@ -1391,7 +1564,6 @@ write_master_ssd(as_transaction* tr, const char* set_name, as_storage_rd* rd,
 	as_msg* m = &tr->msgp->msg;
 	as_namespace* ns = tr->rsv.ns;
 	as_record* r = rd->r;
-	bool has_sindex = as_sindex_ns_has_sindex(ns);
 
 	// If it's not touch or modify, determine if we must read existing record.
 	if (! must_fetch_data) {
@@ -1403,7 +1575,7 @@ write_master_ssd(as_transaction* tr, const char* set_name, as_storage_rd* rd,
 	// For non-data-in-memory:
 	// - if just created record, or must_fetch_data is false - 0
 	// - otherwise - number of bins in existing record
-	rd->n_bins = as_bin_get_n_bins(r, rd);
+	rd->n_bins = as_bin_get_n_bins_ssd(rd);
 
 	uint32_t n_old_bins = (uint32_t)rd->n_bins;
 	uint32_t n_new_bins = n_old_bins + m->n_ops; // can't be more than this
@@ -1421,7 +1593,7 @@ write_master_ssd(as_transaction* tr, const char* set_name, as_storage_rd* rd,
 	//		empty new_bins
 	// - otherwise - sets rd->bins to new_bins, reads existing record off device
 	//		and populates bins (including particle pointers into block buffer)
-	int result = as_storage_rd_load_bins(rd, new_bins);
+	int result = as_storage_rd_load_bins_ssd(rd, new_bins);
 
 	if (result < 0) {
 		cf_warning_digest(AS_RW, &tr->keyd, "{%s} write_master: failed as_storage_rd_load_bins()", ns->name);
@@ -1461,7 +1633,7 @@ write_master_ssd(as_transaction* tr, const char* set_name, as_storage_rd* rd,
 	if ((result = write_master_bin_ops(tr, rd, &particles_llb, NULL, NULL,
 			&rw->response_db, dirty_bins)) != 0) {
 		cf_ll_buf_free(&particles_llb);
-		write_master_index_metadata_unwind(&old_metadata, r);
+		write_master_index_metadata_unwind(&old_metadata, r, ns);
 		return result;
 	}
 
@@ -1476,7 +1648,7 @@ write_master_ssd(as_transaction* tr, const char* set_name, as_storage_rd* rd,
 	// Pickle before writing - bins may disappear on as_storage_record_close().
 	if (! pickle_all(rd, rw)) {
 		cf_ll_buf_free(&particles_llb);
-		write_master_index_metadata_unwind(&old_metadata, r);
+		write_master_index_metadata_unwind(&old_metadata, r, ns);
 		return AS_PROTO_RESULT_FAIL_UNKNOWN;
 	}
 
@@ -1484,10 +1656,15 @@ write_master_ssd(as_transaction* tr, const char* set_name, as_storage_rd* rd,
 	// Write the record to storage.
 	//
 
-	if ((result = as_storage_record_write(r, rd)) < 0) {
+	if (write_master_is_index_only_touch(tr, rd)) {
+		// Bins are unchanged - defrag will bring the device copy up to date.
+		tr->flags |= AS_TRANSACTION_FLAG_INDEX_ONLY;
+		cf_atomic64_incr(&ns->n_index_only_touches);
+	}
+	else if ((result = as_storage_record_write(r, rd)) < 0) {
 		cf_warning_digest(AS_RW, &tr->keyd, "{%s} write_master: failed as_storage_record_write() ", ns->name);
 		cf_ll_buf_free(&particles_llb);
-		write_master_index_metadata_unwind(&old_metadata, r);
+		write_master_index_metadata_unwind(&old_metadata, r, ns);
 		return -result;
 	}
 
@@ -1517,6 +1694,39 @@ write_master_ssd(as_transaction* tr, const char* set_name, as_storage_rd* rd,
 }
 
 
+// A touch of an existing record that changes nothing on the device but
+// metadata needn't rewrite it, if so configured.
+bool
+write_master_is_index_only_touch(as_transaction* tr, as_storage_rd* rd)
+{
+	as_namespace* ns = tr->rsv.ns;
+	as_record* r = rd->r;
+
+	if (! ns->storage_touch_index_only || ns->storage_data_in_memory ||
+			ns->storage_type != AS_STORAGE_ENGINE_SSD) {
+		return false;
+	}
+
+	// A new stored key, or an LDT parent's version, must go to the device.
+	if ((rd->key && ! as_index_is_flag_set(r, AS_INDEX_FLAG_KEY_STORED)) ||
+			(ns->ldt_enabled && as_ldt_record_is_parent(r))) {
+		return false;
+	}
+
+	as_msg* m = &tr->msgp->msg;
+	as_msg_op* op = NULL;
+	int i = 0;
+
+	while ((op = as_msg_op_iterate(m, op, &i)) != NULL) {
+		if (op->op != AS_MSG_OP_TOUCH) {
+			return false;
+		}
+	}
+
+	return m->n_ops != 0;
+}
+
+
 //==========================================================
 // write_master() - apply record updates.
 //
@@ -1551,10 +1761,17 @@ write_master_bin_ops(as_transaction* tr, as_storage_rd* rd,
 	uint32_t n_response_bins = 0;
 	uint32_t n_result_bins = 0;
 
+	// Many ops on a wide record - index the bins for the ops' lookups.
+	if (m->n_ops > 1) {
+		as_bin_index_attach(rd);
+	}
+
 	int result = write_master_bin_ops_loop(tr, rd, ops, response_bins,
 			&n_response_bins, result_bins, &n_result_bins, particles_llb,
 			cleanup_bins, p_n_cleanup_bins, dirty_bins);
 
+	as_bin_index_detach(rd);
+
 	if (result != 0) {
 		destroy_stack_bins(result_bins, n_result_bins);
 		return result;
@@ -1590,6 +1807,7 @@ write_master_bin_ops(as_transaction* tr, as_storage_rd* rd,
 	// Stash the message, to be sent later.
 	db->buf = msgp;
 	db->is_stack = false;
+	db->is_pooled = true; // alloc_sz may understate the buffer - ok
 	db->alloc_sz = msg_sz;
 	db->used_sz = msg_sz;
 
@@ -1701,6 +1919,14 @@ write_master_bin_ops_loop(as_transaction* tr, as_storage_rd* rd,
 				as_bin_set_empty(&response_bins[(*p_n_response_bins)++]);
 			}
 		}
+		// Check a condition, under the record lock. Any earlier ops are undone
+		// with the rest if it fails, so e.g. compare then write is a
+		// compare-and-set, and increment then compare is a bounded increment.
+		else if (op->op == AS_MSG_OP_COMPARE) {
+			if ((result = write_master_compare(tr, rd, op)) != 0) {
+				return result;
+			}
+		}
 		else if (op_is_read_all(op, m)) {
 			for (uint16_t i = 0; i < rd->n_bins; i++) {
 				as_bin* b = &rd->bins[i];
@@ -1736,34 +1962,46 @@ write_master_bin_ops_loop(as_transaction* tr, as_storage_rd* rd,
 				return result;
 			}
 
-			as_bin result_bin;
-			as_bin_set_empty(&result_bin);
+			// Consecutive modifies of a data-in-memory bin are applied as a run,
+			// sparing the allocation of each intermediate particle. This
+			// consumes the run's ops - op is left at the last.
+			if (ns->storage_data_in_memory && next_cdt_modify_on_bin(m, op, i)) {
+				if ((result = write_master_cdt_modify_run(tr, b, &op, &i, ops,
+						response_bins, p_n_response_bins, result_bins,
+						p_n_result_bins, cleanup_bins, p_n_cleanup_bins)) != 0) {
+					return result;
+				}
+			}
+			else {
+				as_bin result_bin;
+				as_bin_set_empty(&result_bin);
 
-			if (ns->storage_data_in_memory) {
-				as_bin cleanup_bin = *b;
+				if (ns->storage_data_in_memory) {
+					as_bin cleanup_bin = *b;
 
-				if ((result = as_bin_cdt_alloc_modify_from_client(b, op, &result_bin)) < 0) {
-					cf_warning_digest(AS_RW, &tr->keyd, "{%s} write_master: failed as_bin_cdt_alloc_modify_from_client() ", ns->name);
-					return -result;
-				}
+					if ((result = as_bin_cdt_alloc_modify_from_client(b, op, &result_bin)) < 0) {
+						cf_warning_digest(AS_RW, &tr->keyd, "{%s} write_master: failed as_bin_cdt_alloc_modify_from_client() ", ns->name);
+						return -result;
+					}
 
-				// Account for noop CDT operations. Modifying non-mutable
-				// particle contents in-place is still disallowed.
-				if (cleanup_bin.particle != b->particle) {
-					append_bin_to_destroy(&cleanup_bin, cleanup_bins, p_n_cleanup_bins);
+					// Account for noop CDT operations. Modifying non-mutable
+					// particle contents in-place is still disallowed.
+					if (cleanup_bin.particle != b->particle) {
+						append_bin_to_destroy(&cleanup_bin, cleanup_bins, p_n_cleanup_bins);
+					}
 				}
-			}
-			else {
-				if ((result = as_bin_cdt_stack_modify_from_client(b, particles_llb, op, &result_bin)) < 0) {
-					cf_warning_digest(AS_RW, &tr->keyd, "{%s} write_master: failed as_bin_cdt_alloc_modify_from_client() ", ns->name);
-					return -result;
+				else {
+					if ((result = as_bin_cdt_stack_modify_from_client(b, particles_llb, op, &result_bin)) < 0) {
+						cf_warning_digest(AS_RW, &tr->keyd, "{%s} write_master: failed as_bin_cdt_alloc_modify_from_client() ", ns->name);
+						return -result;
+					}
 				}
-			}
 
-			if (respond_all_ops || as_bin_inuse(&result_bin)) {
-				ops[*p_n_response_bins] = op;
-				response_bins[(*p_n_response_bins)++] = result_bin;
-				append_bin_to_destroy(&result_bin, result_bins, p_n_result_bins);
+				if (respond_all_ops || as_bin_inuse(&result_bin)) {
+					ops[*p_n_response_bins] = op;
+					response_bins[(*p_n_response_bins)++] = result_bin;
+					append_bin_to_destroy(&result_bin, result_bins, p_n_result_bins);
+				}
 			}
 
 			if (! as_bin_inuse(b)) {
@@ -1800,6 +2038,32 @@ write_master_bin_ops_loop(as_transaction* tr, as_storage_rd* rd,
 				as_bin_set_empty(&response_bins[(*p_n_response_bins)++]);
 			}
 		}
+		// Reads the bin as left by earlier ops - e.g. after a byte range write.
+		else if (op->op == AS_MSG_OP_BLOB_READ) {
+			as_bin* b = as_bin_get_from_buf(rd, op->name, op->name_sz);
+
+			if ((result = write_master_bin_check(tr, b)) != 0) {
+				return result;
+			}
+
+			if (b) {
+				as_bin result_bin;
+				as_bin_set_empty(&result_bin);
+
+				if ((result = as_bin_blob_read_from_client(b, op, &result_bin)) < 0) {
+					cf_warning_digest(AS_RW, &tr->keyd, "{%s} write_master: failed as_bin_blob_read_from_client() ", ns->name);
+					return -result;
+				}
+
+				ops[*p_n_response_bins] = op;
+				response_bins[(*p_n_response_bins)++] = result_bin;
+				append_bin_to_destroy(&result_bin, result_bins, p_n_result_bins);
+			}
+			else if (respond_all_ops) {
+				ops[*p_n_response_bins] = op;
+				as_bin_set_empty(&response_bins[(*p_n_response_bins)++]);
+			}
+		}
 		else {
 			cf_warning_digest(AS_RW, &tr->keyd, "{%s} write_master: unknown bin op %u ", ns->name, op->op);
 			return AS_PROTO_RESULT_FAIL_PARAMETER;
@@ -1810,6 +2074,113 @@ write_master_bin_ops_loop(as_transaction* tr, as_storage_rd* rd,
 }
 
 
+int
+write_master_cdt_modify_run(as_transaction* tr, as_bin* b, as_msg_op** p_op,
+		int* p_i, as_msg_op** ops, as_bin* response_bins,
+		uint32_t* p_n_response_bins, as_bin* result_bins,
+		uint32_t* p_n_result_bins, as_bin* cleanup_bins,
+		uint32_t* p_n_cleanup_bins)
+{
+	as_msg* m = &tr->msgp->msg;
+	as_namespace* ns = tr->rsv.ns;
+	bool respond_all_ops = (m->info2 & AS_MSG_INFO2_RESPOND_ALL_OPS) != 0;
+
+	// All but the last op build their particles here - the last op allocates
+	// as usual, so only the particle from before the run needs destroying.
+	cf_ll_buf_inita(run_llb, CDT_RUN_PARTICLES_SIZE);
+
+	as_bin cleanup_bin = *b;
+	as_particle* p_transient = NULL;
+	as_msg_op* op = *p_op;
+	int result;
+
+	while (true) {
+		as_msg_op* next = next_cdt_modify_on_bin(m, op, *p_i);
+		as_particle* p_before = b->particle;
+
+		as_bin result_bin;
+		as_bin_set_empty(&result_bin);
+
+		if (next) {
+			result = as_bin_cdt_stack_modify_from_client(b, &run_llb, op, &result_bin);
+		}
+		else {
+			result = as_bin_cdt_alloc_modify_from_client(b, op, &result_bin);
+		}
+
+		if (result < 0) {
+			cf_warning_digest(AS_RW, &tr->keyd, "{%s} write_master: failed CDT modify in run ", ns->name);
+			*b = cleanup_bin;
+			cf_ll_buf_free(&run_llb);
+			return -result;
+		}
+
+		if (next && b->particle != p_before) {
+			p_transient = b->particle;
+		}
+
+		if (respond_all_ops || as_bin_inuse(&result_bin)) {
+			ops[*p_n_response_bins] = op;
+			response_bins[(*p_n_response_bins)++] = result_bin;
+			append_bin_to_destroy(&result_bin, result_bins, p_n_result_bins);
+		}
+
+		// A bin emptied mid-run ends the run - the caller removes the bin.
+		if (! next || ! as_bin_inuse(b)) {
+			break;
+		}
+
+		op = next;
+		(*p_i)++;
+	}
+
+	*p_op = op;
+
+	// A noop last op leaves a transient particle in the bin.
+	if (as_bin_inuse(b) && p_transient && b->particle == p_transient &&
+			(result = write_master_particle_to_heap(b)) != 0) {
+		cf_warning_digest(AS_RW, &tr->keyd, "{%s} write_master: failed copying CDT run particle ", ns->name);
+		*b = cleanup_bin;
+		cf_ll_buf_free(&run_llb);
+		return result;
+	}
+
+	cf_ll_buf_free(&run_llb);
+
+	if (cleanup_bin.particle != b->particle) {
+		append_bin_to_destroy(&cleanup_bin, cleanup_bins, p_n_cleanup_bins);
+	}
+
+	return 0;
+}
+
+
+// Re-allocate a bin's particle via its pickled form - works for any particle
+// layout, including ones with internal pointers.
+int
+write_master_particle_to_heap(as_bin* b)
+{
+	uint32_t pickled_sz = as_bin_particle_pickled_size(b);
+	uint8_t* pickled = cf_malloc(pickled_sz);
+
+	if (! pickled) {
+		return AS_PROTO_RESULT_FAIL_UNKNOWN;
+	}
+
+	as_bin_particle_to_pickled(b, pickled);
+
+	// The transient particle isn't ours to destroy.
+	as_bin_set_empty(b);
+
+	uint8_t* p_pickled = pickled;
+	int result = as_bin_particle_replace_from_pickled(b, &p_pickled);
+
+	cf_free(pickled);
+
+	return result == 0 ? 0 : AS_PROTO_RESULT_FAIL_UNKNOWN;
+}
+
+
 // For now, used only for read ops.
 int
 write_master_bin_check(as_transaction* tr, as_bin* bin)
@@ -1824,6 +2195,73 @@ write_master_bin_check(as_transaction* tr, as_bin* bin)
 }
 
 
+int
+write_master_compare(as_transaction* tr, as_storage_rd* rd,
+		as_msg_op* op)
+{
+	as_bin* b = as_bin_get_from_buf(rd, op->name, op->name_sz);
+	int result;
+
+	if ((result = write_master_bin_check(tr, b)) != 0) {
+		return result;
+	}
+
+	bool is_eq;
+
+	if (op->particle_type == AS_PARTICLE_TYPE_NULL || ! b) {
+		is_eq = op->particle_type == AS_PARTICLE_TYPE_NULL && ! b;
+
+		if (op->version != AS_MSG_COMPARE_EQ &&
+				op->version != AS_MSG_COMPARE_NE) {
+			// Ordered comparisons with no value are never true.
+			return AS_PROTO_RESULT_FAIL_COMPARE;
+		}
+	}
+	else if (op->version == AS_MSG_COMPARE_EQ ||
+			op->version == AS_MSG_COMPARE_NE) {
+		if ((result = as_bin_particle_compare_from_client(b, op)) < 0) {
+			return -result;
+		}
+
+		is_eq = result == 0;
+	}
+	else {
+		if (as_bin_get_particle_type(b) != AS_PARTICLE_TYPE_INTEGER ||
+				op->particle_type != AS_PARTICLE_TYPE_INTEGER ||
+				as_msg_op_get_value_sz(op) != sizeof(uint64_t)) {
+			cf_warning_digest(AS_RW, &tr->keyd, "{%s} write_master: ordered compare needs integers ", tr->rsv.ns->name);
+			return AS_PROTO_RESULT_FAIL_INCOMPATIBLE_TYPE;
+		}
+
+		int64_t bin_value = as_bin_particle_integer_value(b);
+		int64_t op_value = (int64_t)cf_swap_from_be64(
+				*(uint64_t*)as_msg_op_get_value_p(op));
+		bool is_true;
+
+		switch (op->version) {
+		case AS_MSG_COMPARE_LT:
+			is_true = bin_value < op_value;
+			break;
+		case AS_MSG_COMPARE_LE:
+			is_true = bin_value <= op_value;
+			break;
+		case AS_MSG_COMPARE_GT:
+			is_true = bin_value > op_value;
+			break;
+		default: // AS_MSG_COMPARE_GE
+			is_true = bin_value >= op_value;
+			break;
+		}
+
+		return is_true ? 0 : AS_PROTO_RESULT_FAIL_COMPARE;
+	}
+
+	bool is_true = op->version == AS_MSG_COMPARE_EQ ? is_eq : ! is_eq;
+
+	return is_true ? 0 : AS_PROTO_RESULT_FAIL_COMPARE;
+}
+
+
 bool
 write_master_sindex_update(as_namespace* ns, const char* set_name,
 		cf_digest* keyd, as_bin* old_bins, uint32_t n_old_bins,
@@ -1914,6 +2352,15 @@ write_master_sindex_update(as_namespace* ns, const char* set_name,
 				&new_bins[i_new], &sbins[sbins_populated], AS_SINDEX_OP_INSERT);
 	}
 
+	// Composite sindexes - unchanged keys cancel out when applied.
+
+	sbins_populated += as_sindex_sbins_composite_from_bins(ns, set_name,
+			old_bins, (uint16_t)n_old_bins, -1, &sbins[sbins_populated],
+			AS_SINDEX_OP_DELETE);
+	sbins_populated += as_sindex_sbins_composite_from_bins(ns, set_name,
+			new_bins, (uint16_t)n_new_bins, -1, &sbins[sbins_populated],
+			AS_SINDEX_OP_INSERT);
+
 	SINDEX_GUNLOCK();
 
 	if (sbins_populated != 0) {
@@ -1932,11 +2379,16 @@ write_master_sindex_update(as_namespace* ns, const char* set_name,
 //
 
 void
-write_master_index_metadata_unwind(index_metadata* old, as_record* r)
+write_master_index_metadata_unwind(index_metadata* old, as_record* r,
+		as_namespace* ns)
 {
+	uint32_t new_void_time = r->void_time;
+
 	r->void_time = old->void_time;
 	r->last_update_time = old->last_update_time;
 	r->generation = old->generation;
+
+	as_incr_hist_void_time_changed(ns, r, new_void_time);
 }
 
 
@@ -0,0 +1,79 @@
+/*
+ * alloc_prof.h
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/*
+ * Sampled allocation profiling, cheap enough to leave on. Each thread counts
+ * bytes allocated, and every interval bytes or so the allocation that crosses
+ * the line is sampled - tagged by the source file that allocated it, and
+ * remembered until freed. A sample stands for all the bytes since the last
+ * one, so allocated bytes per tag are exact in total, and live bytes per tag
+ * are an estimate that gets better as the interval shrinks.
+ *
+ * The tags, and which files map to which, are the caller's.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "citrusleaf/cf_atomic.h"
+
+#include "dynbuf.h"
+
+
+#define CF_ALLOC_PROF_MAX_TAGS 16
+#define CF_ALLOC_PROF_DEFAULT_INTERVAL (512 * 1024) // bytes between samples
+
+// Returns the tag index for an allocating source file - out-of-range indexes
+// count under the last tag.
+typedef uint32_t (*cf_alloc_prof_tag_fn)(const char *file);
+
+void cf_alloc_prof_init(const char *const *tag_names, uint32_t n_tags, cf_alloc_prof_tag_fn tag_fn);
+void cf_alloc_prof_set_interval(uint64_t interval);
+void cf_alloc_prof_get_info(cf_dyn_buf *db);
+
+// Used by the inlines below.
+extern __thread int64_t g_alloc_prof_countdown;
+extern cf_atomic32 g_alloc_prof_n_live;
+
+void cf_alloc_prof_sample(void *p, size_t sz, const char *file);
+void cf_alloc_prof_untrack(void *p);
+
+// Call for every allocation - only one in interval bytes takes the slow path.
+static inline void
+cf_alloc_prof_alloc(void *p, size_t sz, const char *file)
+{
+	if ((g_alloc_prof_countdown -= (int64_t)sz) <= 0 && p) {
+		cf_alloc_prof_sample(p, sz, file);
+	}
+}
+
+// Call for every free - only looks up the pointer while samples are live.
+static inline void
+cf_alloc_prof_free(void *p)
+{
+	if (p && cf_atomic32_get(g_alloc_prof_n_live) != 0) {
+		cf_alloc_prof_untrack(p);
+	}
+}
@@ -41,8 +41,11 @@
 // Typedefs & Constants
 //
 
-#define CF_ARENAX_BIGLOCK	(1 << 0)
-#define CF_ARENAX_CALLOC	(1 << 1)
+#define CF_ARENAX_BIGLOCK		(1 << 0)
+#define CF_ARENAX_CALLOC		(1 << 1)
+#define CF_ARENAX_HUGE_2M		(1 << 2) // back stages with 2M huge pages
+#define CF_ARENAX_HUGE_1G		(1 << 3) // back stages with 1G huge pages
+#define CF_ARENAX_INTERLEAVE	(1 << 4) // interleave stages across NUMA nodes
 
 // Stage is indexed by 8 bits.
 #define CF_ARENAX_MAX_STAGES (1 << 8) // 256
@@ -70,6 +73,7 @@ typedef enum {
 typedef struct cf_arenax_s {
 	// Configuration (passed in constructors)
 	key_t				key_base;
+	const char*			flash_path; // stage files are this plus stage id
 	uint32_t			element_size;
 	uint32_t			stage_capacity;
 	uint32_t			max_stages;
@@ -90,6 +94,7 @@ typedef struct cf_arenax_s {
 
 	// Current Stages
 	uint32_t			stage_count;
+	uint32_t			huge_stage_count; // stages that got huge pages
 	uint8_t*			stages[CF_ARENAX_MAX_STAGES];
 } cf_arenax;
 
@@ -127,6 +132,12 @@ cf_arenax_err cf_arenax_create(cf_arenax* _this, key_t key_base,
 		uint32_t element_size, uint32_t stage_capacity, uint32_t max_stages,
 		uint32_t flags);
 
+// Stages are files on flash, mapped in - only hot pages need be in memory.
+// The path must outlive the arena.
+cf_arenax_err cf_arenax_create_flash(cf_arenax* _this, const char* flash_path,
+		uint32_t element_size, uint32_t stage_capacity, uint32_t max_stages,
+		uint32_t flags);
+
 //------------------------------------------------
 // Allocate/Free an Element
 //
@@ -138,9 +149,22 @@ void cf_arenax_free(cf_arenax* _this, cf_arenax_handle h);
 //
 void* cf_arenax_resolve(cf_arenax* _this, cf_arenax_handle h);
 
+//------------------------------------------------
+// Convert Pointer to Handle
+//
+cf_arenax_handle cf_arenax_get_handle(cf_arenax* _this, const void* p);
+
+//------------------------------------------------
+// Stage Statistics
+//
+uint32_t cf_arenax_stage_count(cf_arenax* _this);
+uint32_t cf_arenax_huge_stage_count(cf_arenax* _this);
+
 
 //==========================================================
 // Private API - for enterprise separation only
 //
 
 cf_arenax_err cf_arenax_add_stage(cf_arenax* _this);
+cf_arenax_err cf_arenax_resume(cf_arenax* _this);
+void cf_arenax_destroy_stages(key_t key_base, uint32_t max_stages);
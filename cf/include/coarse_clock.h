@@ -0,0 +1,58 @@
+/*
+ * coarse_clock.h
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/*
+ * Coarse clock - same base as cf_getns() and cf_getms(), but read from a value
+ * a ticker thread refreshes every CF_COARSE_CLOCK_TICK_US, so a read is a load
+ * rather than a clock call. It lags by up to a tick (more if the ticker isn't
+ * scheduled), so is for timeout checks and the like - latencies and anything
+ * stored should still use the precise clock.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "citrusleaf/cf_atomic.h"
+#include "citrusleaf/cf_clock.h"
+
+
+#define CF_COARSE_CLOCK_TICK_US 1000
+
+extern cf_atomic64 g_coarse_clock_ns;
+
+void cf_coarse_clock_start();
+
+// Until the ticker has started, falls back to the precise clock.
+static inline uint64_t
+cf_coarse_getns()
+{
+	uint64_t now_ns = cf_atomic64_get(g_coarse_clock_ns);
+
+	return now_ns != 0 ? now_ns : cf_getns();
+}
+
+static inline uint64_t
+cf_coarse_getms()
+{
+	return cf_coarse_getns() / 1000000;
+}
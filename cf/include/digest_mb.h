@@ -0,0 +1,44 @@
+/*
+ * digest_mb.h
+ *
+ * Copyright (C) 2017 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/*
+ * Multi-buffer RIPEMD-160 - computes several digests at once, one message per
+ * SIMD lane. Results are identical to cf_digest_compute() on each message.
+ * Worth using only where a number of digests are wanted together - messages
+ * in a group are hashed in lockstep, so a group costs as much as its longest
+ * message.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "citrusleaf/cf_digest.h"
+
+
+// Already-grouped callers may find these useful for sizing.
+#define CF_DIGEST_MB_LANES_SSE 4
+#define CF_DIGEST_MB_LANES_AVX2 8
+
+void cf_digest_compute_mb(const void * const *bufs, const size_t *lens,
+		uint32_t n, cf_digest *digests);
@@ -38,10 +38,16 @@ typedef struct cf_dyn_buf_s {
 	bool		is_stack;
 	size_t		alloc_sz;
 	size_t		used_sz;
+	bool		is_pooled; // heap buf goes back to the thread's pool - alloc_sz must not overstate it
 } cf_dyn_buf;
 
-#define cf_dyn_buf_define(__x)  uint8_t dyn_buf##__x[1024]; cf_dyn_buf __x = { dyn_buf##__x, true, 1024, 0 }
-#define cf_dyn_buf_define_size(__x, __sz)  uint8_t dyn_buf##__x[__sz]; cf_dyn_buf __x = { dyn_buf##__x, true, __sz, 0 }
+#define cf_dyn_buf_define(__x)  uint8_t dyn_buf##__x[1024]; cf_dyn_buf __x = { dyn_buf##__x, true, 1024, 0, false }
+#define cf_dyn_buf_define_size(__x, __sz)  uint8_t dyn_buf##__x[__sz]; cf_dyn_buf __x = { dyn_buf##__x, true, __sz, 0, false }
+
+// Heap buffers that are reused across responses, per thread. Buffers are
+// plain cf_malloc() memory, so may also be handed off and cf_free()'d.
+extern void *cf_dyn_buf_pool_get(size_t sz, size_t *p_alloc_sz);
+extern void cf_dyn_buf_pool_put(void *buf, size_t alloc_sz);
 
 extern int cf_dyn_buf_init_heap(cf_dyn_buf *db, size_t sz);
 extern int cf_dyn_buf_reserve(cf_dyn_buf *db, size_t sz, uint8_t **from);
@@ -106,6 +106,7 @@ typedef enum {
 	AS_SINDEX,
 	AS_SMD,
 	AS_STORAGE,
+	AS_TRUNCATE,
 	AS_TSVC,
 	AS_UDF,
 	AS_XDR,
@@ -141,6 +142,15 @@ typedef struct cf_fault_sink {
 
 #define CF_FAULT_SINKS_MAX 8
 
+/* cf_fault_async_stats
+ * Counters for asynchronous logging */
+typedef struct cf_fault_async_stats {
+	uint64_t queued;
+	uint64_t dropped;		// ring was full
+	uint64_t rate_limited;
+	uint64_t suppressed;	// collapsed into "repeated" lines
+} cf_fault_async_stats;
+
 /**
  * When we want to dump out some binary data (like a digest, a bit string
  * or a buffer), we want to be able to specify how we'll display the data.
@@ -181,6 +191,11 @@ extern void cf_fault_sink_logroll(void);
 extern void cf_fault_use_local_time(bool val);
 extern bool cf_fault_is_using_local_time();
 
+extern void cf_fault_use_async(bool val);
+extern bool cf_fault_is_using_async();
+extern void cf_fault_start_async();
+extern void cf_fault_get_async_stats(cf_fault_async_stats *stats);
+
 extern cf_fault_severity cf_fault_filter[];
 
 // Define the mechanism that we'll use to write into the Server Log.
@@ -0,0 +1,60 @@
+/*
+ * hdr_hist.h
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+
+/*
+ * Latency histogram with log-linear buckets - each power of two of
+ * microseconds is split into 2^(precision - 1) equal buckets, so reported
+ * values are within 2^(1 - precision) of the true ones, whatever the scale.
+ * Unlike the power-of-two histograms, it answers percentile queries.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+
+#define HDR_HIST_MIN_PRECISION 1
+#define HDR_HIST_MAX_PRECISION 10
+
+// Percentiles in microseconds, of the data points in some interval.
+typedef struct hdr_hist_percentiles_s {
+	uint64_t total;
+	uint64_t p50;
+	uint64_t p90;
+	uint64_t p99;
+	uint64_t p999;
+	uint64_t max;
+} hdr_hist_percentiles;
+
+typedef struct hdr_hist_s hdr_hist;
+
+hdr_hist *hdr_hist_create(uint32_t precision);
+void hdr_hist_destroy(hdr_hist *h);
+
+// These are thread-safe.
+uint64_t hdr_hist_insert_data_point(hdr_hist *h, uint64_t start_ns);
+void hdr_hist_insert_raw(hdr_hist *h, uint64_t usec);
+void hdr_hist_clear(hdr_hist *h);
+
+// Empties the histogram, getting percentiles of what it held.
+void hdr_hist_take_percentiles(hdr_hist *h, hdr_hist_percentiles *p);
@@ -27,6 +27,7 @@
 #include <stdint.h>
 #include "citrusleaf/cf_atomic.h"
 #include "dynbuf.h"
+#include "shard_counter.h"
 
 
 //==========================================================
@@ -48,6 +49,19 @@ typedef enum {
 #define HIST_TAG_MICROSECONDS	"usec"
 #define HIST_TAG_RAW			"count"
 
+// Optional per-thread buckets, for histograms on transaction paths. A thread
+// with its own shard counter slot owns the matching shard and increments it
+// without atomics - threads sharing slots use the base counts. Reads merge
+// the shards. Shards are never zeroed - clearing snapshots their totals.
+typedef struct histogram_shard_s {
+	uint64_t counts[N_BUCKETS];
+} __attribute__ ((aligned(SHARD_COUNTER_LINE_SZ))) histogram_shard;
+
+typedef struct histogram_shards_s {
+	uint64_t cleared[N_BUCKETS];
+	histogram_shard shards[SHARD_COUNTER_SLOTS];
+} histogram_shards;
+
 // DO NOT access this member data directly - use the API!
 // (Except for cf_hist_track, for which histogram is a base class.)
 typedef struct histogram_s {
@@ -55,10 +69,13 @@ typedef struct histogram_s {
 	const char* scale_tag;
 	uint32_t time_div;
 	cf_atomic64 counts[N_BUCKETS];
+	histogram_shards* shards; // NULL if not sharded
 } histogram;
 
 extern histogram *histogram_create(const char *name, histogram_scale scale);
+extern bool histogram_add_shards(histogram *h);
 extern void histogram_clear(histogram *h);
+extern void histogram_get_counts(histogram *h, uint64_t counts[]);
 extern void histogram_dump(histogram *h );
 
 extern uint64_t histogram_insert_data_point(histogram *h, uint64_t start_ns);
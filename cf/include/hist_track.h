@@ -54,6 +54,7 @@ typedef enum {
 //
 cf_hist_track* cf_hist_track_create(const char* name, histogram_scale scale);
 void cf_hist_track_destroy(cf_hist_track* _this);
+void cf_hist_track_enable_percentiles(cf_hist_track* _this, uint32_t precision);
 
 //------------------------------------------------
 // Start/Stop Caching Data
@@ -79,6 +80,8 @@ void cf_hist_track_insert_raw(cf_hist_track* _this, uint64_t value);
 void cf_hist_track_get_info(cf_hist_track* _this, uint32_t back_sec,
 		uint32_t duration_sec, uint32_t slice_sec, bool throughput_only,
 		cf_hist_track_info_format info_fmt, cf_dyn_buf* db_p);
+void cf_hist_track_get_percentiles_info(cf_hist_track* _this,
+		uint32_t back_sec, uint32_t duration_sec, cf_dyn_buf* db_p);
 
 //------------------------------------------------
 // Get Current Settings
@@ -79,6 +79,29 @@ int jem_enable_tcache(bool enabled);
  */
 void *jem_allocate_in_arena(int arena, size_t size, bool use_allocm);
 
+/*
+ *  Memory usage of one JEMalloc arena, in bytes, as "malloc_stats_print()"
+ *  reports it.  Fragmentation is the part of active that isn't allocated.
+ */
+typedef struct jem_arena_stats_s {
+	size_t allocated;   // small + large allocations (huge ones aren't per-arena)
+	size_t active;      // pages backing runs in use
+	size_t dirty;       // unused pages not yet purged
+	size_t mapped;
+} jem_arena_stats;
+
+/*
+ *  Get the current memory usage of the given JEMalloc arena.
+ *  Returns 0 if successful, -1 otherwise.
+ */
+int jem_get_arena_stats(int arena, jem_arena_stats *stats);
+
+/*
+ *  Return the given JEMalloc arena's dirty pages to the OS.
+ *  Returns 0 if successful, -1 otherwise.
+ */
+int jem_purge_arena(int arena);
+
 /*
  *  Log information about the state of JEMalloc.
  *
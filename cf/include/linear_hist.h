@@ -41,6 +41,7 @@ typedef struct linear_hist_threshold_s {
 //
 
 linear_hist *linear_hist_create(const char *name, uint32_t start, uint32_t max_offset, uint32_t num_buckets);
+linear_hist *linear_hist_create_similar(const char *name, const linear_hist *h);
 void linear_hist_destroy(linear_hist *h);
 void linear_hist_reset(linear_hist *h, uint32_t start, uint32_t max_offset, uint32_t num_buckets);
 void linear_hist_clear(linear_hist *h, uint32_t start, uint32_t max_offset);
@@ -48,6 +49,7 @@ void linear_hist_clear(linear_hist *h, uint32_t start, uint32_t max_offset);
 uint32_t linear_hist_get_total(linear_hist *h);
 void linear_hist_merge(linear_hist *h1, linear_hist *h2);
 void linear_hist_insert_data_point(linear_hist *h, uint32_t point);
+void linear_hist_insert_data_points(linear_hist *h, uint32_t point, uint32_t count);
 uint32_t linear_hist_get_threshold_for_fraction(linear_hist *h, uint32_t tenths_pct, linear_hist_threshold *p_threshold);
 uint32_t linear_hist_get_threshold_for_subtotal(linear_hist *h, uint32_t subtotal, linear_hist_threshold *p_threshold);
 
@@ -26,6 +26,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <sys/uio.h>
 #include <citrusleaf/cf_atomic.h>
 #include <citrusleaf/cf_types.h>
 #include "dynbuf.h"
@@ -59,7 +60,7 @@ typedef enum msg_type_t {
 	M_TYPE_UNUSED_6 = 6,
 	M_TYPE_RW = 7,
 	M_TYPE_INFO = 8,
-	M_TYPE_UNUSED_9 = 9,
+	M_TYPE_PARTITION_DIGEST = 9,
 	M_TYPE_UNUSED_10 = 10,
 	M_TYPE_XDR = 11,
 	M_TYPE_UNUSED_12 = 12,
@@ -132,6 +133,10 @@ typedef enum {
 	MSG_GET_COPY_MALLOC
 } msg_get_type;
 
+// Buffer fields at least this big are referenced, not copied, by
+// msg_fillbuf_iov().
+#define MSG_IOV_MIN_REF_SZ (1024 * 4)
+
 typedef enum {
 	MSG_SET_HANDOFF_MALLOC,
 	MSG_SET_COPY
@@ -182,6 +187,7 @@ uint32_t msg_get_wire_size(const msg *m);
 int msg_get_template_fixed_sz(const msg_template* mt, const size_t mt_len);
 
 int msg_fillbuf(const msg *m, uint8_t *buf, size_t *buflen);
+int msg_fillbuf_iov(const msg *m, uint8_t *buf, size_t *buflen, struct iovec *iov, uint32_t *n_iov);
 
 //------------------------------------------------
 // Parse flattened data into messages.
@@ -0,0 +1,73 @@
+/*
+ * ohash.h
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/*
+ * Open-addressing hash table of fixed-size keys and values, stored inline.
+ * The table is split into lock stripes, each an independent linear-probing
+ * table that grows by itself under its own lock - inserting allocates nothing
+ * except when a stripe doubles.
+ *
+ * Calls are the shash ones, so hot users can switch over directly. Values are
+ * copied - tables of ref-counted objects store pointers, and reserve them under
+ * the stripe lock via cf_ohash_get_vlock().
+ */
+
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+
+
+#define CF_OHASH_OK				0
+#define CF_OHASH_ERR			-1
+#define CF_OHASH_ERR_FOUND		-4
+#define CF_OHASH_ERR_NOTFOUND	-3
+
+// Reduce callbacks return CF_OHASH_OK to go on, CF_OHASH_REDUCE_DELETE to
+// delete the element and go on, or anything else to stop.
+#define CF_OHASH_REDUCE_DELETE	1
+
+typedef struct cf_ohash_s cf_ohash;
+
+typedef uint32_t (*cf_ohash_hash_fn)(const void *key);
+typedef int (*cf_ohash_reduce_fn)(const void *key, void *value, void *udata);
+
+// Stripes and slots per stripe are rounded up to powers of 2.
+cf_ohash *cf_ohash_create(cf_ohash_hash_fn h_fn, uint32_t key_size, uint32_t value_size, uint32_t n_slots, uint32_t n_stripes);
+void cf_ohash_destroy(cf_ohash *h);
+
+uint32_t cf_ohash_get_size(cf_ohash *h);
+
+int cf_ohash_put(cf_ohash *h, const void *key, const void *value);
+int cf_ohash_put_unique(cf_ohash *h, const void *key, const void *value);
+int cf_ohash_get(cf_ohash *h, const void *key, void *value);
+
+// On success the stripe is left locked - *p_value is valid until unlocked, and
+// the element may be deleted meanwhile with cf_ohash_delete_lockfree().
+int cf_ohash_get_vlock(cf_ohash *h, const void *key, void **p_value, pthread_mutex_t **p_lock);
+
+int cf_ohash_delete(cf_ohash *h, const void *key);
+int cf_ohash_delete_lockfree(cf_ohash *h, const void *key);
+int cf_ohash_get_and_delete(cf_ohash *h, const void *key, void *value);
+
+// Callbacks run under each stripe's lock in turn.
+int cf_ohash_reduce(cf_ohash *h, cf_ohash_reduce_fn reduce_fn, void *udata);
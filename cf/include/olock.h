@@ -32,16 +32,20 @@
 #include <citrusleaf/cf_digest.h>
 
 
+#define OLOCK_MAX_LOCKS (64 * 1024) // hash uses 16 digest bits
+
 typedef struct olock_s {
 	uint32_t n_locks;
 	uint32_t mask;
+	uint64_t *contended; // per lock, count of acquisitions that had to wait
 	pthread_mutex_t locks[];
 } olock;
 
 void olock_lock(olock *ol, cf_digest *d);
 void olock_vlock(olock *ol, cf_digest *d, pthread_mutex_t **vlock);
 void olock_unlock(olock *ol, cf_digest *d);
-olock *olock_create(uint32_t n_locks, bool mutex);
+olock *olock_create(uint32_t n_locks, bool adaptive);
 void olock_destroy(olock *o);
+uint64_t olock_contended(olock *ol, uint64_t *p_max, uint32_t *p_n_hot);
 
 extern olock *g_record_locks;
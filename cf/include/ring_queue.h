@@ -0,0 +1,54 @@
+/*
+ * ring_queue.h
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/*
+ * Multi-producer multi-consumer queue - a bounded lock-free ring of fixed-size
+ * elements, which spills to a locked overflow queue rather than ever failing a
+ * push. Consumers spin briefly (adaptively) before sleeping on a condvar.
+ *
+ * Elements stay FIFO through an overflow - while the overflow holds anything,
+ * pushes go there too, and it drains before the ring is used again.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "hist.h"
+
+
+#define CF_RING_QUEUE_OK		0
+#define CF_RING_QUEUE_EMPTY		-2
+
+#define CF_RING_QUEUE_FOREVER	-1
+#define CF_RING_QUEUE_NOWAIT	0
+
+typedef struct cf_ring_queue_s cf_ring_queue;
+
+cf_ring_queue *cf_ring_queue_create(uint32_t element_sz, uint32_t capacity);
+void cf_ring_queue_destroy(cf_ring_queue *q);
+void cf_ring_queue_set_hist(cf_ring_queue *q, histogram *wait_hist);
+
+void cf_ring_queue_push(cf_ring_queue *q, const void *element);
+int cf_ring_queue_pop(cf_ring_queue *q, void *element, int ms_wait);
+uint32_t cf_ring_queue_pop_batch(cf_ring_queue *q, void *elements, uint32_t max_elements, int ms_wait);
+int cf_ring_queue_sz(cf_ring_queue *q);
@@ -0,0 +1,95 @@
+/*
+ * shard_counter.h
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/*
+ * A statistic counter for hot paths, split into cache-line slots so threads
+ * incrementing it don't contend for one line. Each thread is given a slot the
+ * first time it counts - threads share slots only beyond SHARD_COUNTER_SLOTS
+ * threads. Reads sum the slots, so are for the ticker and info, not for
+ * anything that needs an exact moment's value.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+
+#define SHARD_COUNTER_SLOTS 32 // power of 2
+#define SHARD_COUNTER_LINE_SZ 64
+
+// Aligned, so a slot never straddles two lines - containers must be allocated
+// aligned (e.g. cf_valloc()) for it to hold.
+typedef struct cf_shard_counter_slot_s {
+	uint64_t	value;
+	uint8_t		pad[SHARD_COUNTER_LINE_SZ - sizeof(uint64_t)];
+} __attribute__ ((aligned(SHARD_COUNTER_LINE_SZ))) cf_shard_counter_slot;
+
+typedef struct cf_shard_counter_s {
+	cf_shard_counter_slot slots[SHARD_COUNTER_SLOTS];
+} cf_shard_counter;
+
+extern __thread uint32_t g_shard_counter_slot; // 0 means not yet assigned
+
+uint32_t cf_shard_counter_assign_slot();
+
+static inline uint64_t*
+cf_shard_counter_slot_value(cf_shard_counter *c)
+{
+	uint32_t slot = g_shard_counter_slot;
+
+	if (slot == 0) {
+		slot = cf_shard_counter_assign_slot();
+	}
+
+	return &c->slots[slot & (SHARD_COUNTER_SLOTS - 1)].value;
+}
+
+static inline void
+cf_shard_counter_add(cf_shard_counter *c, int64_t delta)
+{
+	// Still atomic - slots are shared beyond SHARD_COUNTER_SLOTS threads.
+	__sync_fetch_and_add(cf_shard_counter_slot_value(c), (uint64_t)delta);
+}
+
+static inline void
+cf_shard_counter_incr(cf_shard_counter *c)
+{
+	cf_shard_counter_add(c, 1);
+}
+
+static inline void
+cf_shard_counter_decr(cf_shard_counter *c)
+{
+	cf_shard_counter_add(c, -1);
+}
+
+static inline uint64_t
+cf_shard_counter_get(const cf_shard_counter *c)
+{
+	uint64_t sum = 0;
+
+	for (uint32_t i = 0; i < SHARD_COUNTER_SLOTS; i++) {
+		sum += *(volatile const uint64_t*)&c->slots[i].value;
+	}
+
+	return sum;
+}
@@ -30,6 +30,7 @@
 #include <netinet/in.h>
 #include <sys/epoll.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 
 #include "msg.h"
 #include "util.h"
@@ -62,6 +63,7 @@ typedef struct {
 	const char *addr;
 	cf_ip_port port;
 	bool reuse_addr;
+	bool reuse_port; // lets several sockets - e.g. one per thread - share a port
 	int32_t type;
 	cf_socket *sock;
 } cf_socket_cfg;
@@ -183,6 +185,7 @@ CF_MUST_CHECK int32_t cf_socket_recv_from(cf_socket *sock, void *buff, size_t si
 CF_MUST_CHECK int32_t cf_socket_recv(cf_socket *sock, void *buff, size_t size, int32_t flags);
 CF_MUST_CHECK int32_t cf_socket_send_to(cf_socket *sock, void *buff, size_t size, int32_t flags, cf_sock_addr *addr);
 CF_MUST_CHECK int32_t cf_socket_send(cf_socket *sock, void *buff, size_t size, int32_t flags);
+CF_MUST_CHECK int32_t cf_socket_send_iov(cf_socket *sock, struct iovec *iov, uint32_t n_iov, int32_t flags);
 
 void cf_socket_write_shutdown(cf_socket *sock);
 void cf_socket_shutdown(cf_socket *sock);
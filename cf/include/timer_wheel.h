@@ -0,0 +1,46 @@
+/*
+ * timer_wheel.h
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/*
+ * Hierarchical timer wheel of fixed-size keys with millisecond deadlines.
+ * Adding is O(1), and expiring costs O(expired) plus amortized cascading - no
+ * scan of everything outstanding.
+ *
+ * Timers can't be cancelled - owners should treat an expired key as a hint,
+ * look up whatever it refers to, and ignore it if it's gone or changed.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+
+typedef struct cf_timer_wheel_s cf_timer_wheel;
+
+// Called outside the wheel lock - may add timers.
+typedef void (*cf_timer_wheel_fn)(void *key, void *udata);
+
+cf_timer_wheel *cf_timer_wheel_create(uint32_t key_sz, uint32_t tick_ms);
+void cf_timer_wheel_destroy(cf_timer_wheel *tw);
+
+void cf_timer_wheel_add(cf_timer_wheel *tw, const void *key, uint64_t deadline_ms);
+uint32_t cf_timer_wheel_expire(cf_timer_wheel *tw, uint64_t now_ms, cf_timer_wheel_fn cb, void *udata);
@@ -181,3 +181,7 @@ extern void cf_process_daemonize(int *fd_ignore_list, int list_size);
 
 /* daemon.c */
 extern void cf_process_privsep(uid_t uid, gid_t gid);
+extern uint32_t cf_process_n_cpus();
+extern void cf_thread_pin_to_cpu(pthread_t thread, uint32_t cpu);
+extern void cf_thread_restrict_to_cpus(pthread_t thread, const uint16_t *cpus, uint32_t n_cpus);
+extern void cf_thread_set_sched_policy(pthread_t thread, int policy, int priority);
@@ -66,6 +66,7 @@ typedef enum {
 size_t cf_vmapx_sizeof(uint32_t value_size, uint32_t max_count);
 
 cf_vmapx_err cf_vmapx_create(cf_vmapx* _this, uint32_t value_size, uint32_t max_count, uint32_t hash_size, uint32_t max_name_size);
+cf_vmapx_err cf_vmapx_resume(cf_vmapx* _this, uint32_t value_size, uint32_t max_count, uint32_t hash_size, uint32_t max_name_size);
 void cf_vmapx_release(cf_vmapx* _this);
 
 uint32_t cf_vmapx_count(const cf_vmapx* _this);
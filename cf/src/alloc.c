@@ -42,6 +42,7 @@
 #include <citrusleaf/cf_shash.h>
 #include <citrusleaf/cf_types.h> // for byte
 
+#include "alloc_prof.h"
 #include "fault.h"
 
 
@@ -1465,6 +1466,8 @@ cf_malloc_at(size_t sz, char *file, int line)
 {
 	void *p = malloc(sz);
 
+	cf_alloc_prof_alloc(p, sz, file);
+
 	if (!g_memory_accounting_enabled) {
 		return(p);
 	}
@@ -1499,6 +1502,8 @@ cf_malloc_at(size_t sz, char *file, int line)
 void
 cf_free_at(void *p, char *file, int line)
 {
+	cf_alloc_prof_free(p);
+
 	if (!g_memory_accounting_enabled) {
 		free(p);
 		return;
@@ -1538,6 +1543,8 @@ cf_calloc_at(size_t nmemb, size_t sz, char *file, int line)
 {
 	void *p = calloc(nmemb, sz);
 
+	cf_alloc_prof_alloc(p, nmemb * sz, file);
+
 	if (!g_memory_accounting_enabled) {
 		return(p);
 	}
@@ -1564,8 +1571,13 @@ cf_calloc_at(size_t nmemb, size_t sz, char *file, int line)
 void *
 cf_realloc_at(void *ptr, size_t sz, char *file, int line)
 {
+	// Untrack first - once realloc() returns, the old address may be reused.
+	cf_alloc_prof_free(ptr);
+
 	void *p = realloc(ptr, sz);
 
+	cf_alloc_prof_alloc(p, sz, file);
+
 	if (!g_memory_accounting_enabled) {
 		return(p);
 	}
@@ -1658,6 +1670,8 @@ cf_strdup_at(const char *s, char *file, int line)
 //	void *p = strdup(s);
 #endif
 
+	cf_alloc_prof_alloc(p, p ? strlen(s) + 1 : 0, file);
+
 	if (!g_memory_accounting_enabled) {
 		return(p);
 	}
@@ -1697,6 +1711,8 @@ cf_strndup_at(const char *s, size_t n, char *file, int line)
 //	void *p = strndup(s, n);
 #endif
 
+	cf_alloc_prof_alloc(p, p ? strlen((char *)p) + 1 : 0, file);
+
 	if (!g_memory_accounting_enabled) {
 		return(p);
 	}
@@ -1730,6 +1746,7 @@ cf_valloc_at(size_t sz, char *file, int line)
 
 	if (!g_memory_accounting_enabled) {
 		if (0 == posix_memalign(&p, VALLOC_SZ, sz)) {
+			cf_alloc_prof_alloc(p, sz, file);
 			return(p);
 		} else {
 			return(0);
@@ -1740,6 +1757,8 @@ cf_valloc_at(size_t sz, char *file, int line)
 	cf_atomic64_incr(&mem_count_vallocs);
 
 	if (0 == posix_memalign(&p, VALLOC_SZ, sz)) {
+		cf_alloc_prof_alloc(p, sz, file);
+
 		if (SHASH_OK == shash_put_unique(mem_count_shash, &p, &sz)) {
 			update_alloc_at_location(p, sz, CF_ALLOC_TYPE_VALLOC, file, line);
 		} else {
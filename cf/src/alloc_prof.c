@@ -0,0 +1,254 @@
+/*
+ * alloc_prof.c
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+#include "alloc_prof.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "citrusleaf/cf_atomic.h"
+#include "citrusleaf/cf_clock.h"
+
+#include "dynbuf.h"
+
+
+// Everything here is static - the profiler runs inside the allocator, so it
+// must never allocate.
+
+#define N_SLOTS (64 * 1024) // power of 2
+#define PROBE_WINDOW 8
+#define OFF_RECHECK_BYTES (1024 * 1024) // how often threads look while off
+#define MIN_RATE_WINDOW_MS 1000
+
+typedef struct prof_slot_s {
+	cf_atomic64	p;			// sampled pointer, 0 if free
+	uint32_t	tag;
+	uint64_t	weight;		// bytes this sample stands for
+} prof_slot;
+
+typedef struct prof_tag_stats_s {
+	cf_atomic64	alloc_bytes;
+	cf_atomic64	allocs;		// estimated - a sample stands for weight / size allocations
+	cf_atomic64	live_bytes;	// estimated
+} prof_tag_stats;
+
+__thread int64_t g_alloc_prof_countdown = 0;
+cf_atomic32 g_alloc_prof_n_live = 0;
+
+static __thread int64_t t_countdown_start = 0;
+static __thread uint64_t t_rand = 0;
+
+static const char *const *g_tag_names = NULL;
+static uint32_t g_n_tags = 0;
+static cf_alloc_prof_tag_fn g_tag_fn = NULL;
+static volatile uint64_t g_interval = CF_ALLOC_PROF_DEFAULT_INTERVAL; // 0 is off
+
+static prof_slot g_slots[N_SLOTS];
+static prof_tag_stats g_stats[CF_ALLOC_PROF_MAX_TAGS];
+static cf_atomic64 g_n_dropped = 0;
+
+// Rates are over the time since the last report at least a window ago.
+static pthread_mutex_t g_report_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t g_report_ms = 0;
+static uint64_t g_last_alloc_bytes[CF_ALLOC_PROF_MAX_TAGS];
+static uint64_t g_last_allocs[CF_ALLOC_PROF_MAX_TAGS];
+static uint64_t g_alloc_bytes_rate[CF_ALLOC_PROF_MAX_TAGS];
+static uint64_t g_allocs_rate[CF_ALLOC_PROF_MAX_TAGS];
+
+
+static inline uint32_t
+slot_index(void *p)
+{
+	return (uint32_t)((((uint64_t)p >> 4) * 0x9e3779b97f4a7c15UL) >> 48) &
+			(N_SLOTS - 1);
+}
+
+// Jitter the interval so periodic allocation patterns don't alias with it.
+static void
+reset_countdown(uint64_t interval)
+{
+	int64_t start = OFF_RECHECK_BYTES;
+
+	if (interval != 0) {
+		if (t_rand == 0) {
+			t_rand = (uint64_t)&t_rand | 1;
+		}
+
+		t_rand ^= t_rand << 13;
+		t_rand ^= t_rand >> 7;
+		t_rand ^= t_rand << 17;
+
+		start = (int64_t)(interval / 2 + t_rand % interval);
+	}
+
+	g_alloc_prof_countdown = start;
+	t_countdown_start = start;
+}
+
+void
+cf_alloc_prof_init(const char *const *tag_names, uint32_t n_tags,
+		cf_alloc_prof_tag_fn tag_fn)
+{
+	g_tag_names = tag_names;
+	g_n_tags = n_tags > CF_ALLOC_PROF_MAX_TAGS ? CF_ALLOC_PROF_MAX_TAGS : n_tags;
+	g_report_ms = cf_getms();
+
+	__sync_synchronize();
+
+	g_tag_fn = tag_fn;
+}
+
+void
+cf_alloc_prof_set_interval(uint64_t interval)
+{
+	// Threads pick it up at their next sample.
+	g_interval = interval;
+}
+
+void
+cf_alloc_prof_sample(void *p, size_t sz, const char *file)
+{
+	// Every byte since the last sample, this allocation's included.
+	int64_t weight = t_countdown_start - g_alloc_prof_countdown;
+	uint64_t interval = g_interval;
+
+	reset_countdown(interval);
+
+	if (interval == 0 || ! g_tag_fn || weight <= 0) {
+		return;
+	}
+
+	uint32_t tag = g_tag_fn(file);
+
+	if (tag >= g_n_tags) {
+		tag = g_n_tags - 1;
+	}
+
+	prof_tag_stats *ts = &g_stats[tag];
+
+	cf_atomic64_add(&ts->alloc_bytes, weight);
+	cf_atomic64_add(&ts->allocs, sz == 0 || (uint64_t)weight < sz ?
+			1 : (uint64_t)weight / sz);
+
+	uint32_t base = slot_index(p);
+
+	for (uint32_t i = 0; i < PROBE_WINDOW; i++) {
+		prof_slot *slot = &g_slots[(base + i) & (N_SLOTS - 1)];
+
+		// The pointer isn't handed out yet, so nothing can untrack it before
+		// the tag and weight are set.
+		if (cf_atomic64_get(slot->p) == 0 &&
+				cf_atomic64_cas(&slot->p, 0, (uint64_t)p) == 0) {
+			slot->tag = tag;
+			slot->weight = (uint64_t)weight;
+			cf_atomic64_add(&ts->live_bytes, weight);
+			cf_atomic32_incr(&g_alloc_prof_n_live);
+			return;
+		}
+	}
+
+	cf_atomic64_incr(&g_n_dropped);
+}
+
+void
+cf_alloc_prof_untrack(void *p)
+{
+	uint32_t base = slot_index(p);
+
+	// Scan the whole window - freed slots aren't tombstoned.
+	for (uint32_t i = 0; i < PROBE_WINDOW; i++) {
+		prof_slot *slot = &g_slots[(base + i) & (N_SLOTS - 1)];
+
+		if (cf_atomic64_get(slot->p) != (int64_t)(uint64_t)p) {
+			continue;
+		}
+
+		uint32_t tag = slot->tag;
+		uint64_t weight = slot->weight;
+
+		if (cf_atomic64_cas(&slot->p, (uint64_t)p, 0) == (int64_t)(uint64_t)p) {
+			cf_atomic64_sub(&g_stats[tag].live_bytes, weight);
+			cf_atomic32_decr(&g_alloc_prof_n_live);
+		}
+
+		return;
+	}
+}
+
+void
+cf_alloc_prof_get_info(cf_dyn_buf *db)
+{
+	cf_dyn_buf_append_string(db, "interval=");
+	cf_dyn_buf_append_uint64(db, g_interval);
+	cf_dyn_buf_append_string(db, ":live-samples=");
+	cf_dyn_buf_append_uint32(db, cf_atomic32_get(g_alloc_prof_n_live));
+	cf_dyn_buf_append_string(db, ":dropped-samples=");
+	cf_dyn_buf_append_uint64(db, cf_atomic64_get(g_n_dropped));
+
+	if (! g_tag_fn) {
+		return;
+	}
+
+	pthread_mutex_lock(&g_report_lock);
+
+	uint64_t now_ms = cf_getms();
+	uint64_t elapsed_ms = now_ms - g_report_ms;
+	bool new_window = elapsed_ms >= MIN_RATE_WINDOW_MS;
+
+	for (uint32_t tag = 0; tag < g_n_tags; tag++) {
+		prof_tag_stats *ts = &g_stats[tag];
+		uint64_t alloc_bytes = cf_atomic64_get(ts->alloc_bytes);
+		uint64_t allocs = cf_atomic64_get(ts->allocs);
+
+		if (new_window) {
+			g_alloc_bytes_rate[tag] =
+					(alloc_bytes - g_last_alloc_bytes[tag]) * 1000 / elapsed_ms;
+			g_allocs_rate[tag] =
+					(allocs - g_last_allocs[tag]) * 1000 / elapsed_ms;
+			g_last_alloc_bytes[tag] = alloc_bytes;
+			g_last_allocs[tag] = allocs;
+		}
+
+		int64_t live_bytes = cf_atomic64_get(ts->live_bytes);
+
+		cf_dyn_buf_append_string(db, ";tag=");
+		cf_dyn_buf_append_string(db, g_tag_names[tag]);
+		cf_dyn_buf_append_string(db, ":live-bytes=");
+		cf_dyn_buf_append_uint64(db, live_bytes < 0 ? 0 : (uint64_t)live_bytes);
+		cf_dyn_buf_append_string(db, ":alloc-bytes=");
+		cf_dyn_buf_append_uint64(db, alloc_bytes);
+		cf_dyn_buf_append_string(db, ":allocs=");
+		cf_dyn_buf_append_uint64(db, allocs);
+		cf_dyn_buf_append_string(db, ":alloc-bytes-per-sec=");
+		cf_dyn_buf_append_uint64(db, g_alloc_bytes_rate[tag]);
+		cf_dyn_buf_append_string(db, ":allocs-per-sec=");
+		cf_dyn_buf_append_uint64(db, g_allocs_rate[tag]);
+	}
+
+	if (new_window) {
+		g_report_ms = now_ms;
+	}
+
+	pthread_mutex_unlock(&g_report_lock);
+}
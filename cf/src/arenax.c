@@ -88,13 +88,13 @@ cf_arenax_errstr(cf_arenax_err err)
 }
 
 //------------------------------------------------
-// Create a cf_arenax object in persistent memory.
-// Also create and attach the first arena stage in
-// persistent memory.
+// Set up a cf_arenax object, and create and attach
+// its first stage.
 //
-cf_arenax_err
-cf_arenax_create(cf_arenax* this, key_t key_base, uint32_t element_size,
-		uint32_t stage_capacity, uint32_t max_stages, uint32_t flags)
+static cf_arenax_err
+arenax_create(cf_arenax* this, key_t key_base, const char* flash_path,
+		uint32_t element_size, uint32_t stage_capacity, uint32_t max_stages,
+		uint32_t flags)
 {
 	if (stage_capacity == 0) {
 		stage_capacity = MAX_STAGE_CAPACITY;
@@ -112,6 +112,11 @@ cf_arenax_create(cf_arenax* this, key_t key_base, uint32_t element_size,
 		return CF_ARENAX_ERR_BAD_PARAM;
 	}
 
+	if ((flags & CF_ARENAX_HUGE_2M) && (flags & CF_ARENAX_HUGE_1G)) {
+		cf_warning(CF_ARENAX, "can't use both 2M and 1G huge pages");
+		return CF_ARENAX_ERR_BAD_PARAM;
+	}
+
 	uint64_t stage_size = (uint64_t)stage_capacity * (uint64_t)element_size;
 
 	if (stage_size > MAX_STAGE_SIZE) {
@@ -120,6 +125,7 @@ cf_arenax_create(cf_arenax* this, key_t key_base, uint32_t element_size,
 	}
 
 	this->key_base = key_base;
+	this->flash_path = flash_path;
 	this->element_size = element_size;
 	this->stage_capacity = stage_capacity;
 	this->max_stages = max_stages;
@@ -139,6 +145,7 @@ cf_arenax_create(cf_arenax* this, key_t key_base, uint32_t element_size,
 	}
 
 	this->stage_count = 0;
+	this->huge_stage_count = 0;
 	memset(this->stages, 0, sizeof(this->stages));
 
 	// Add first stage.
@@ -152,6 +159,37 @@ cf_arenax_create(cf_arenax* this, key_t key_base, uint32_t element_size,
 	return result;
 }
 
+//------------------------------------------------
+// Create a cf_arenax object in persistent memory.
+// Also create and attach the first arena stage in
+// persistent memory.
+//
+cf_arenax_err
+cf_arenax_create(cf_arenax* this, key_t key_base, uint32_t element_size,
+		uint32_t stage_capacity, uint32_t max_stages, uint32_t flags)
+{
+	return arenax_create(this, key_base, NULL, element_size, stage_capacity,
+			max_stages, flags);
+}
+
+//------------------------------------------------
+// Create a cf_arenax object whose stages are files
+// on flash, mapped into memory.
+//
+cf_arenax_err
+cf_arenax_create_flash(cf_arenax* this, const char* flash_path,
+		uint32_t element_size, uint32_t stage_capacity, uint32_t max_stages,
+		uint32_t flags)
+{
+	if (! flash_path || (flags & (CF_ARENAX_HUGE_2M | CF_ARENAX_HUGE_1G))) {
+		cf_warning(CF_ARENAX, "flash arena needs a path, and can't use huge pages");
+		return CF_ARENAX_ERR_BAD_PARAM;
+	}
+
+	return arenax_create(this, 0, flash_path, element_size, stage_capacity,
+			max_stages, flags);
+}
+
 //------------------------------------------------
 // Allocate an element within the arena.
 //
@@ -237,3 +275,47 @@ cf_arenax_resolve(cf_arenax* this, cf_arenax_handle h)
 	return this->stages[((arenax_handle*)&h)->stage_id] +
 			(((arenax_handle*)&h)->element_id * this->element_size);
 }
+
+//------------------------------------------------
+// Convert memory address to cf_arenax_handle - the
+// reverse of cf_arenax_resolve(). Returns the null
+// handle if the address isn't in any stage.
+//
+cf_arenax_handle
+cf_arenax_get_handle(cf_arenax* this, const void* p)
+{
+	const uint8_t* p_element = (const uint8_t*)p;
+	uint32_t stage_count = this->stage_count;
+
+	for (uint32_t i = 0; i < stage_count; i++) {
+		const uint8_t* stage = this->stages[i];
+
+		if (p_element >= stage && p_element < stage + this->stage_size) {
+			cf_arenax_handle h = 0;
+
+			((arenax_handle*)&h)->stage_id = i;
+			((arenax_handle*)&h)->element_id =
+					(uint32_t)((p_element - stage) / this->element_size);
+
+			return h;
+		}
+	}
+
+	return 0;
+}
+
+//------------------------------------------------
+// Get number of stages, and how many of them are
+// backed by huge pages.
+//
+uint32_t
+cf_arenax_stage_count(cf_arenax* this)
+{
+	return this->stage_count;
+}
+
+uint32_t
+cf_arenax_huge_stage_count(cf_arenax* this)
+{
+	return this->huge_stage_count;
+}
@@ -22,11 +22,252 @@
 
 #include "arenax.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/mempolicy.h>
+#include <sys/ipc.h>
+#include <sys/mman.h>
+#include <sys/shm.h>
+#include <sys/syscall.h>
 #include "citrusleaf/alloc.h"
 #include "fault.h"
 
 
+// Huge page size encoding - may be missing from older headers.
+#ifndef SHM_HUGE_SHIFT
+#define SHM_HUGE_SHIFT 26
+#endif
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+#define HUGE_2M_SHIFT 21
+#define HUGE_1G_SHIFT 30
+
+// Enough for 1024 NUMA nodes.
+#define MAX_NUMA_NODES 1024
+
+
+//------------------------------------------------
+// Huge page size shift configured for stages, or
+// 0 for normal pages.
+//
+static int
+arenax_huge_shift(cf_arenax* this)
+{
+	if (this->flags & CF_ARENAX_HUGE_1G) {
+		return HUGE_1G_SHIFT;
+	}
+
+	if (this->flags & CF_ARENAX_HUGE_2M) {
+		return HUGE_2M_SHIFT;
+	}
+
+	return 0;
+}
+
+//------------------------------------------------
+// Stage size rounded up to a whole number of huge
+// pages.
+//
+static size_t
+arenax_huge_stage_size(cf_arenax* this, int huge_shift)
+{
+	size_t page_size = (size_t)1 << huge_shift;
+
+	return (this->stage_size + page_size - 1) & ~(page_size - 1);
+}
+
+//------------------------------------------------
+// Spread a new (untouched) stage's pages across
+// all the NUMA nodes we're allowed to use.
+//
+static void
+arenax_interleave(uint8_t* p_stage, size_t size)
+{
+	unsigned long nodemask[MAX_NUMA_NODES / (8 * sizeof(unsigned long))];
+
+	memset(nodemask, 0, sizeof(nodemask));
+
+	if (syscall(SYS_get_mempolicy, NULL, nodemask, MAX_NUMA_NODES, NULL,
+			MPOL_F_MEMS_ALLOWED) != 0 ||
+		syscall(SYS_mbind, p_stage, size, MPOL_INTERLEAVE, nodemask,
+			MAX_NUMA_NODES, 0) != 0) {
+		cf_warning(CF_ARENAX, "could not interleave arena stage: errno %d (%s)",
+				errno, cf_strerror(errno));
+	}
+}
+
+//------------------------------------------------
+// Get a shared memory segment, removing an old
+// segment left with the same key if creating.
+//
+static int
+arenax_shmget(key_t key, size_t size, int flags)
+{
+	int shmid = shmget(key, size, flags);
+
+	if (shmid < 0 && (flags & IPC_CREAT) && errno == EEXIST) {
+		int old_shmid = shmget(key, 0, 0666);
+
+		if (old_shmid >= 0) {
+			shmctl(old_shmid, IPC_RMID, NULL);
+		}
+
+		shmid = shmget(key, size, flags);
+	}
+
+	return shmid;
+}
+
+
+//------------------------------------------------
+// Get (optionally create) and attach a shared
+// memory stage. If creating, an old segment left
+// with the same key is removed first, and huge
+// pages are used if configured and available.
+//
+static uint8_t*
+arenax_shm_stage(cf_arenax* this, uint32_t stage_id, bool create,
+		bool* p_huge)
+{
+	key_t key = this->key_base + 1 + (key_t)stage_id;
+	int huge_shift = create ? arenax_huge_shift(this) : 0;
+	int shmid = -1;
+
+	if (huge_shift != 0) {
+		shmid = arenax_shmget(key, arenax_huge_stage_size(this, huge_shift),
+				IPC_CREAT | IPC_EXCL | 0666 | SHM_HUGETLB |
+				(huge_shift << SHM_HUGE_SHIFT));
+
+		if (shmid < 0) {
+			cf_warning(CF_ARENAX, "could not get huge pages for shm key 0x%x stage %u - using normal pages: errno %d (%s)",
+					key, stage_id, errno, cf_strerror(errno));
+		}
+		else {
+			*p_huge = true;
+		}
+	}
+
+	if (shmid < 0) {
+		shmid = arenax_shmget(key, this->stage_size,
+				create ? IPC_CREAT | IPC_EXCL | 0666 : 0666);
+	}
+
+	if (shmid < 0) {
+		cf_warning(CF_ARENAX, "could not get shm key 0x%x stage %u: errno %d (%s)",
+				key, stage_id, errno, cf_strerror(errno));
+		return NULL;
+	}
+
+	uint8_t* p_stage = (uint8_t*)shmat(shmid, NULL, 0);
+
+	if (p_stage == (uint8_t*)-1) {
+		cf_warning(CF_ARENAX, "could not attach shm key 0x%x stage %u: errno %d (%s)",
+				key, stage_id, errno, cf_strerror(errno));
+		return NULL;
+	}
+
+	return p_stage;
+}
+
+//------------------------------------------------
+// Allocate a private (non-persistent) stage. Only
+// uses mmap() when pages need special handling -
+// mbind() needs a page-aligned address.
+//
+static uint8_t*
+arenax_mmap_stage(cf_arenax* this, bool* p_huge)
+{
+	int huge_shift = arenax_huge_shift(this);
+
+	if (huge_shift != 0) {
+		void* p = mmap(NULL, arenax_huge_stage_size(this, huge_shift),
+				PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB |
+				(huge_shift << MAP_HUGE_SHIFT), -1, 0);
+
+		if (p != MAP_FAILED) {
+			*p_huge = true;
+			return (uint8_t*)p;
+		}
+
+		cf_warning(CF_ARENAX, "could not get huge pages for stage %u - using normal pages: errno %d (%s)",
+				this->stage_count, errno, cf_strerror(errno));
+	}
+
+	if (this->flags & CF_ARENAX_INTERLEAVE) {
+		void* p = mmap(NULL, this->stage_size, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+		return p == MAP_FAILED ? NULL : (uint8_t*)p;
+	}
+
+	return (uint8_t*)cf_malloc(this->stage_size);
+}
+
+//------------------------------------------------
+// Allocate a stage in a file on flash, mapped in
+// shared so the kernel pages it in and out - only
+// hot index pages stay in memory. The file is
+// unlinked once mapped, so it goes away with the
+// process.
+//
+static uint8_t*
+arenax_flash_stage(cf_arenax* this)
+{
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%s-%03u", this->flash_path,
+			this->stage_count);
+
+	int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+
+	if (fd < 0) {
+		cf_warning(CF_ARENAX, "could not open arena stage file %s: errno %d (%s)",
+				path, errno, cf_strerror(errno));
+		return NULL;
+	}
+
+	// Reserve the space now - running out while paging out would be fatal.
+	int rv = posix_fallocate(fd, 0, (off_t)this->stage_size);
+
+	if (rv != 0) {
+		cf_warning(CF_ARENAX, "could not allocate arena stage file %s: errno %d (%s)",
+				path, rv, cf_strerror(rv));
+		close(fd);
+		unlink(path);
+		return NULL;
+	}
+
+	void* p = mmap(NULL, this->stage_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			fd, 0);
+
+	close(fd);
+	unlink(path);
+
+	if (p == MAP_FAILED) {
+		cf_warning(CF_ARENAX, "could not map arena stage file %s: errno %d (%s)",
+				path, errno, cf_strerror(errno));
+		return NULL;
+	}
+
+	// Tree walks touch elements all over a stage - readahead would only push
+	// hot pages out of the page cache.
+	if (madvise(p, this->stage_size, MADV_RANDOM) != 0) {
+		cf_warning(CF_ARENAX, "could not advise arena stage file %s: errno %d (%s)",
+				path, errno, cf_strerror(errno));
+	}
+
+	return (uint8_t*)p;
+}
+
 //------------------------------------------------
 // Create and attach a persistent memory block,
 // and store its pointer in the stages array.
@@ -40,7 +281,19 @@ cf_arenax_add_stage(cf_arenax* this)
 		return CF_ARENAX_ERR_STAGE_CREATE;
 	}
 
-	uint8_t* p_stage = (uint8_t*)cf_malloc(this->stage_size);
+	bool huge = false;
+	uint8_t* p_stage;
+
+	if (this->flash_path) {
+		p_stage = arenax_flash_stage(this);
+	}
+	// A key base means stages live in shared memory, to survive restarts.
+	else if (this->key_base != 0) {
+		p_stage = arenax_shm_stage(this, this->stage_count, true, &huge);
+	}
+	else {
+		p_stage = arenax_mmap_stage(this, &huge);
+	}
 
 	if (! p_stage) {
 		cf_warning(CF_ARENAX, "could not allocate %lu-byte arena stage %u",
@@ -48,7 +301,66 @@ cf_arenax_add_stage(cf_arenax* this)
 		return CF_ARENAX_ERR_STAGE_CREATE;
 	}
 
+	// Flash stages live in the page cache - no memory policy to set.
+	if ((this->flags & CF_ARENAX_INTERLEAVE) && ! this->flash_path) {
+		arenax_interleave(p_stage, this->stage_size);
+	}
+
+	if (huge) {
+		this->huge_stage_count++;
+	}
+
 	this->stages[this->stage_count++] = p_stage;
 
 	return CF_ARENAX_OK;
 }
+
+//------------------------------------------------
+// Re-attach the shared memory stages of a
+// cf_arenax object persisted by a previous run.
+//
+cf_arenax_err
+cf_arenax_resume(cf_arenax* this)
+{
+	if (this->key_base == 0 || this->stage_count > this->max_stages) {
+		return CF_ARENAX_ERR_BAD_PARAM;
+	}
+
+	for (uint32_t i = 0; i < this->stage_count; i++) {
+		bool huge = false;
+
+		if (! (this->stages[i] = arenax_shm_stage(this, i, false, &huge))) {
+			for (uint32_t j = 0; j < i; j++) {
+				shmdt(this->stages[j]);
+			}
+
+			return CF_ARENAX_ERR_STAGE_ATTACH;
+		}
+	}
+
+	// Lock state from the previous run is meaningless.
+	if ((this->flags & CF_ARENAX_BIGLOCK) &&
+			pthread_mutex_init(&this->lock, 0) != 0) {
+		return CF_ARENAX_ERR_UNKNOWN;
+	}
+
+	return CF_ARENAX_OK;
+}
+
+//------------------------------------------------
+// Remove all shared memory stages for a key base,
+// e.g. leftovers of a run that can't be resumed.
+//
+void
+cf_arenax_destroy_stages(key_t key_base, uint32_t max_stages)
+{
+	for (uint32_t i = 0; i < max_stages; i++) {
+		int shmid = shmget(key_base + 1 + (key_t)i, 0, 0666);
+
+		if (shmid < 0) {
+			break; // stages are created in order
+		}
+
+		shmctl(shmid, IPC_RMID, NULL);
+	}
+}
@@ -0,0 +1,88 @@
+/*
+ * coarse_clock.c
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "coarse_clock.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "citrusleaf/cf_atomic.h"
+#include "citrusleaf/cf_clock.h"
+
+#include "fault.h"
+
+
+//==========================================================
+// Globals.
+//
+
+cf_atomic64 g_coarse_clock_ns = 0;
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static void *run_coarse_clock(void *udata);
+
+
+//==========================================================
+// Public API.
+//
+
+void
+cf_coarse_clock_start()
+{
+	cf_atomic64_set(&g_coarse_clock_ns, cf_getns());
+
+	pthread_t thread;
+	pthread_attr_t attrs;
+
+	pthread_attr_init(&attrs);
+	pthread_attr_setdetachstate(&attrs, PTHREAD_CREATE_DETACHED);
+
+	if (pthread_create(&thread, &attrs, run_coarse_clock, NULL) != 0) {
+		cf_crash(CF_MISC, "failed to create coarse clock thread");
+	}
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+static void *
+run_coarse_clock(void *udata)
+{
+	while (true) {
+		usleep(CF_COARSE_CLOCK_TICK_US);
+		cf_atomic64_set(&g_coarse_clock_ns, cf_getns());
+	}
+
+	return NULL;
+}
@@ -29,6 +29,9 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <grp.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -116,3 +119,67 @@ cf_process_daemonize(int *fd_ignore_list, int list_size)
 		}
 	}
 }
+
+
+// Number of CPUs currently online.
+uint32_t
+cf_process_n_cpus()
+{
+	long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return n_cpus > 0 ? (uint32_t)n_cpus : 1;
+}
+
+
+// Restrict a thread to one CPU. Failure isn't fatal - the thread just keeps
+// running wherever the scheduler puts it.
+void
+cf_thread_pin_to_cpu(pthread_t thread, uint32_t cpu)
+{
+	cpu_set_t cpus;
+
+	CPU_ZERO(&cpus);
+	CPU_SET(cpu % cf_process_n_cpus(), &cpus);
+
+	int rv = pthread_setaffinity_np(thread, sizeof(cpus), &cpus);
+
+	if (rv != 0) {
+		cf_warning(CF_MISC, "couldn't pin thread to cpu %u: %s", cpu, cf_strerror(rv));
+	}
+}
+
+
+// Restrict a thread to a set of CPUs - the scheduler still moves it among
+// them. Failure isn't fatal, as above.
+void
+cf_thread_restrict_to_cpus(pthread_t thread, const uint16_t *cpus, uint32_t n_cpus)
+{
+	cpu_set_t cpu_set;
+
+	CPU_ZERO(&cpu_set);
+
+	for (uint32_t i = 0; i < n_cpus; i++) {
+		CPU_SET(cpus[i], &cpu_set);
+	}
+
+	int rv = pthread_setaffinity_np(thread, sizeof(cpu_set), &cpu_set);
+
+	if (rv != 0) {
+		cf_warning(CF_MISC, "couldn't restrict thread to %u cpus: %s", n_cpus, cf_strerror(rv));
+	}
+}
+
+
+// Typically fails without CAP_SYS_NICE for the real-time policies - the
+// thread then keeps SCHED_OTHER.
+void
+cf_thread_set_sched_policy(pthread_t thread, int policy, int priority)
+{
+	struct sched_param param = { .sched_priority = priority };
+
+	int rv = pthread_setschedparam(thread, policy, &param);
+
+	if (rv != 0) {
+		cf_warning(CF_MISC, "couldn't set thread scheduling policy %d priority %d: %s", policy, priority, cf_strerror(rv));
+	}
+}
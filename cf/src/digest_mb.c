@@ -0,0 +1,300 @@
+/*
+ * digest_mb.c
+ *
+ * Copyright (C) 2017 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+#include "digest_mb.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "citrusleaf/cf_digest.h"
+
+
+/*
+ * The lane arithmetic uses GCC vector extensions, so the same code builds as
+ * SSE2 for 4 lanes, AVX2 for 8 lanes (in a function targeted at AVX2, chosen
+ * at run time), and as plain scalar code on other architectures.
+ */
+
+typedef uint32_t v4u32 __attribute__ ((vector_size (16)));
+#if defined(__x86_64__)
+typedef uint32_t v8u32 __attribute__ ((vector_size (32)));
+#endif
+
+#define BLOCK_SZ 64
+
+// Per-step message word order, left and right lines.
+static const uint8_t RL[80] = {
+		0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+		7, 4, 13, 1, 10, 6, 15, 3, 12, 0, 9, 5, 2, 14, 11, 8,
+		3, 10, 14, 4, 9, 15, 8, 1, 2, 7, 0, 6, 13, 11, 5, 12,
+		1, 9, 11, 10, 0, 8, 12, 4, 13, 3, 7, 15, 14, 5, 6, 2,
+		4, 0, 5, 9, 7, 12, 2, 10, 14, 1, 3, 8, 11, 6, 15, 13
+};
+
+static const uint8_t RR[80] = {
+		5, 14, 7, 0, 9, 2, 11, 4, 13, 6, 15, 8, 1, 10, 3, 12,
+		6, 11, 3, 7, 0, 13, 5, 10, 14, 15, 8, 12, 4, 9, 1, 2,
+		15, 5, 1, 3, 7, 14, 6, 9, 11, 8, 12, 2, 10, 0, 4, 13,
+		8, 6, 4, 1, 3, 11, 15, 0, 5, 12, 2, 13, 9, 7, 10, 14,
+		12, 15, 10, 4, 1, 5, 8, 7, 6, 2, 13, 14, 0, 3, 9, 11
+};
+
+// Per-step rotate amounts, left and right lines.
+static const uint8_t SL[80] = {
+		11, 14, 15, 12, 5, 8, 7, 9, 11, 13, 14, 15, 6, 7, 9, 8,
+		7, 6, 8, 13, 11, 9, 7, 15, 7, 12, 15, 9, 11, 7, 13, 12,
+		11, 13, 6, 7, 14, 9, 13, 15, 14, 8, 13, 6, 5, 12, 7, 5,
+		11, 12, 14, 15, 14, 15, 9, 8, 9, 14, 5, 6, 8, 6, 5, 12,
+		9, 15, 5, 11, 6, 8, 13, 12, 5, 12, 13, 14, 11, 8, 5, 6
+};
+
+static const uint8_t SR[80] = {
+		8, 9, 9, 11, 13, 15, 15, 5, 7, 7, 8, 11, 14, 14, 12, 6,
+		9, 13, 15, 7, 12, 8, 9, 11, 7, 7, 12, 7, 6, 15, 13, 11,
+		9, 7, 15, 11, 8, 6, 6, 14, 12, 13, 5, 14, 13, 13, 7, 5,
+		15, 5, 8, 11, 14, 14, 6, 14, 6, 9, 12, 9, 12, 5, 15, 8,
+		8, 5, 12, 9, 12, 5, 14, 6, 8, 13, 6, 5, 15, 13, 11, 11
+};
+
+static const uint32_t KL[5] = {
+		0x00000000, 0x5A827999, 0x6ED9EBA1, 0x8F1BBCDC, 0xA953FD4E
+};
+
+static const uint32_t KR[5] = {
+		0x50A28BE6, 0x5C4DD124, 0x6D703EF3, 0x7A6D76E9, 0x00000000
+};
+
+static const uint32_t H_INIT[5] = {
+		0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0
+};
+
+// Boolean functions - round r of the left line uses F(r), the right line uses
+// F(4 - r). Any vector type works.
+#define F_0(x, y, z) ((x) ^ (y) ^ (z))
+#define F_1(x, y, z) (((x) & (y)) | (~(x) & (z)))
+#define F_2(x, y, z) (((x) | ~(y)) ^ (z))
+#define F_3(x, y, z) (((x) & (z)) | ((y) & ~(z)))
+#define F_4(x, y, z) ((x) ^ ((y) | ~(z)))
+
+#define ROL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+#define F_ROUND(round, x, y, z) \
+		((round) == 0 ? F_0(x, y, z) : \
+		 (round) == 1 ? F_1(x, y, z) : \
+		 (round) == 2 ? F_2(x, y, z) : \
+		 (round) == 3 ? F_3(x, y, z) : F_4(x, y, z))
+
+// Compress one block per lane into h, for lanes whose mask is all ones.
+#define DEFINE_COMPRESS(_name, _vt, _attr) \
+static _attr void \
+_name(_vt *h, const _vt *x, _vt mask) \
+{ \
+	_vt al = h[0], bl = h[1], cl = h[2], dl = h[3], el = h[4]; \
+	_vt ar = h[0], br = h[1], cr = h[2], dr = h[3], er = h[4]; \
+	\
+	for (int j = 0; j < 80; j++) { \
+		int round = j >> 4; \
+		_vt t; \
+		\
+		t = al + F_ROUND(round, bl, cl, dl) + x[RL[j]] + KL[round]; \
+		t = ROL(t, SL[j]) + el; \
+		al = el; el = dl; dl = ROL(cl, 10); cl = bl; bl = t; \
+		\
+		t = ar + F_ROUND(4 - round, br, cr, dr) + x[RR[j]] + KR[round]; \
+		t = ROL(t, SR[j]) + er; \
+		ar = er; er = dr; dr = ROL(cr, 10); cr = br; br = t; \
+	} \
+	\
+	_vt t = h[1] + cl + dr; \
+	_vt n[5]; \
+	\
+	n[1] = h[2] + dl + er; \
+	n[2] = h[3] + el + ar; \
+	n[3] = h[4] + al + br; \
+	n[4] = h[0] + bl + cr; \
+	n[0] = t; \
+	\
+	for (int i = 0; i < 5; i++) { \
+		h[i] = (n[i] & mask) | (h[i] & ~mask); \
+	} \
+}
+
+// Blocks needed for a message - data, the 0x80 byte and the 8 byte length.
+static inline uint64_t
+n_blocks(size_t len)
+{
+	return (len + 1 + 8 + BLOCK_SZ - 1) / BLOCK_SZ;
+}
+
+// Fill a lane's copy of block b of its padded message.
+static void
+load_block(const uint8_t *buf, size_t len, uint64_t b, uint8_t *block)
+{
+	uint64_t start = b * BLOCK_SZ;
+	size_t n_data = 0;
+
+	if (start < len) {
+		n_data = len - start < BLOCK_SZ ? len - start : BLOCK_SZ;
+		memcpy(block, buf + start, n_data);
+	}
+
+	memset(block + n_data, 0, BLOCK_SZ - n_data);
+
+	// The 0x80 byte goes just past the data, if that's in this block.
+	if (start + n_data == len && n_data < BLOCK_SZ) {
+		block[n_data] = 0x80;
+	}
+
+	if (b == n_blocks(len) - 1) {
+		uint64_t n_bits = (uint64_t)len << 3;
+
+		for (int i = 0; i < 8; i++) {
+			block[BLOCK_SZ - 8 + i] = (uint8_t)(n_bits >> (8 * i));
+		}
+	}
+}
+
+static inline uint32_t
+le32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+			((uint32_t)p[3] << 24);
+}
+
+static inline void
+put_le32(uint8_t *p, uint32_t v)
+{
+	p[0] = (uint8_t)v;
+	p[1] = (uint8_t)(v >> 8);
+	p[2] = (uint8_t)(v >> 16);
+	p[3] = (uint8_t)(v >> 24);
+}
+
+// Hash one group of up to _lanes messages - unused lanes hash nothing.
+#define DEFINE_GROUP(_name, _compress, _vt, _lanes, _attr) \
+static _attr void \
+_name(const void * const *bufs, const size_t *lens, uint32_t n, \
+		cf_digest *digests) \
+{ \
+	_vt h[5]; \
+	uint64_t lane_blocks[_lanes]; \
+	uint64_t max_blocks = 0; \
+	\
+	for (int i = 0; i < 5; i++) { \
+		for (int l = 0; l < _lanes; l++) { \
+			h[i][l] = H_INIT[i]; \
+		} \
+	} \
+	\
+	for (uint32_t l = 0; l < _lanes; l++) { \
+		lane_blocks[l] = l < n ? n_blocks(lens[l]) : 0; \
+		\
+		if (lane_blocks[l] > max_blocks) { \
+			max_blocks = lane_blocks[l]; \
+		} \
+	} \
+	\
+	uint8_t block[BLOCK_SZ]; \
+	\
+	for (uint64_t b = 0; b < max_blocks; b++) { \
+		_vt x[16]; \
+		_vt mask; \
+		\
+		for (uint32_t l = 0; l < _lanes; l++) { \
+			if (b < lane_blocks[l]) { \
+				load_block((const uint8_t*)bufs[l], lens[l], b, block); \
+				mask[l] = 0xFFFFffff; \
+			} \
+			else { \
+				memset(block, 0, BLOCK_SZ); \
+				mask[l] = 0; \
+			} \
+			\
+			for (int i = 0; i < 16; i++) { \
+				x[i][l] = le32(block + i * 4); \
+			} \
+		} \
+		\
+		_compress(h, x, mask); \
+	} \
+	\
+	for (uint32_t l = 0; l < n; l++) { \
+		for (int i = 0; i < 5; i++) { \
+			put_le32(digests[l].digest + i * 4, h[i][l]); \
+		} \
+	} \
+}
+
+DEFINE_COMPRESS(compress_4, v4u32, )
+DEFINE_GROUP(group_4, compress_4, v4u32, CF_DIGEST_MB_LANES_SSE, )
+
+#if defined(__x86_64__)
+DEFINE_COMPRESS(compress_8, v8u32, __attribute__ ((target ("avx2"))))
+DEFINE_GROUP(group_8, compress_8, v8u32, CF_DIGEST_MB_LANES_AVX2,
+		__attribute__ ((target ("avx2"))))
+
+static bool
+have_avx2()
+{
+	static int8_t known = -1;
+
+	if (known < 0) {
+		__builtin_cpu_init();
+		known = __builtin_cpu_supports("avx2") ? 1 : 0;
+	}
+
+	return known == 1;
+}
+#endif
+
+
+/* cf_digest_compute_mb
+ * Digest n messages - digests[i] is the RIPEMD-160 of bufs[i], lens[i]. */
+void
+cf_digest_compute_mb(const void * const *bufs, const size_t *lens, uint32_t n,
+		cf_digest *digests)
+{
+	uint32_t i = 0;
+
+#if defined(__x86_64__)
+	if (n - i >= CF_DIGEST_MB_LANES_AVX2 && have_avx2()) {
+		for ( ; n - i >= CF_DIGEST_MB_LANES_AVX2; i += CF_DIGEST_MB_LANES_AVX2) {
+			group_8(bufs + i, lens + i, CF_DIGEST_MB_LANES_AVX2, digests + i);
+		}
+	}
+#endif
+
+	// A part-filled group still beats hashing two or more one at a time.
+	while (n - i >= 2) {
+		uint32_t n_group = n - i < CF_DIGEST_MB_LANES_SSE ?
+				n - i : CF_DIGEST_MB_LANES_SSE;
+
+		group_4(bufs + i, lens + i, n_group, digests + i);
+		i += n_group;
+	}
+
+	if (i < n) {
+		cf_digest_compute((void*)bufs[i], lens[i], &digests[i]);
+	}
+}
@@ -22,6 +22,7 @@
 
 #include "dynbuf.h"
 
+#include <pthread.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -36,6 +37,174 @@
 
 #define MAX_BACKOFF (1024 * 256)
 
+// Each thread keeps a few heap buffers for its next responses. Bigger ones go
+// back to the heap, so an occasional huge response isn't held.
+#define POOL_N_BUFS 8
+#define POOL_MIN_BUF_SZ 1024
+#define POOL_MAX_BUF_SZ (128 * 1024)
+
+// The size estimate moves 1/8 of the way to each response's size.
+#define SIZE_EST_SHIFT 3
+
+typedef struct buf_pool_s {
+	uint32_t	n_bufs;
+	size_t		size_est;
+	void		*bufs[POOL_N_BUFS];
+	size_t		sizes[POOL_N_BUFS];
+} buf_pool;
+
+static __thread buf_pool *t_pool = NULL;
+
+static pthread_key_t g_pool_key;
+static pthread_once_t g_pool_once = PTHREAD_ONCE_INIT;
+
+static void
+pool_destroy(void *udata)
+{
+	buf_pool *pool = (buf_pool *)udata;
+
+	for (uint32_t i = 0; i < pool->n_bufs; i++) {
+		cf_free(pool->bufs[i]);
+	}
+
+	cf_free(pool);
+}
+
+static void
+pool_key_create()
+{
+	pthread_key_create(&g_pool_key, pool_destroy);
+}
+
+static buf_pool *
+get_pool()
+{
+	if (! t_pool) {
+		pthread_once(&g_pool_once, pool_key_create);
+
+		buf_pool *pool = cf_malloc(sizeof(buf_pool));
+
+		if (! pool) {
+			return NULL;
+		}
+
+		memset(pool, 0, sizeof(buf_pool));
+
+		// Freed at thread exit.
+		pthread_setspecific(g_pool_key, pool);
+		t_pool = pool;
+	}
+
+	return t_pool;
+}
+
+static void
+pool_note_size(size_t used_sz)
+{
+	buf_pool *pool = get_pool();
+
+	if (! pool) {
+		return;
+	}
+
+	int64_t diff = (int64_t)used_sz - (int64_t)pool->size_est;
+
+	pool->size_est = (size_t)((int64_t)pool->size_est +
+			(diff >> SIZE_EST_SHIFT));
+}
+
+// Returns a buffer of at least sz - alloc_sz bytes - reused if possible,
+// otherwise sized for the recent responses of this thread.
+void *
+cf_dyn_buf_pool_get(size_t sz, size_t *p_alloc_sz)
+{
+	buf_pool *pool = get_pool();
+
+	if (pool) {
+		int best = -1;
+
+		// Smallest that fits, so big buffers stay for big responses.
+		for (uint32_t i = 0; i < pool->n_bufs; i++) {
+			if (pool->sizes[i] >= sz &&
+					(best < 0 || pool->sizes[i] < pool->sizes[best])) {
+				best = (int)i;
+			}
+		}
+
+		if (best >= 0) {
+			void *buf = pool->bufs[best];
+
+			*p_alloc_sz = pool->sizes[best];
+
+			pool->n_bufs--;
+			pool->bufs[best] = pool->bufs[pool->n_bufs];
+			pool->sizes[best] = pool->sizes[pool->n_bufs];
+
+			return buf;
+		}
+	}
+
+	size_t alloc_sz = sz;
+
+	if (pool && sz <= POOL_MAX_BUF_SZ) {
+		size_t est = pool->size_est > POOL_MAX_BUF_SZ ?
+				POOL_MAX_BUF_SZ : pool->size_est;
+
+		if (alloc_sz < est) {
+			alloc_sz = est;
+		}
+
+		if (alloc_sz < POOL_MIN_BUF_SZ) {
+			alloc_sz = POOL_MIN_BUF_SZ;
+		}
+	}
+
+	void *buf = cf_malloc(alloc_sz);
+
+	if (buf) {
+		*p_alloc_sz = alloc_sz;
+	}
+
+	return buf;
+}
+
+void
+cf_dyn_buf_pool_put(void *buf, size_t alloc_sz)
+{
+	buf_pool *pool = alloc_sz >= POOL_MIN_BUF_SZ &&
+			alloc_sz <= POOL_MAX_BUF_SZ ? get_pool() : NULL;
+
+	if (! pool) {
+		cf_free(buf);
+		return;
+	}
+
+	if (pool->n_bufs < POOL_N_BUFS) {
+		pool->bufs[pool->n_bufs] = buf;
+		pool->sizes[pool->n_bufs] = alloc_sz;
+		pool->n_bufs++;
+		return;
+	}
+
+	// Full - keep the bigger one of this and the smallest pooled.
+	uint32_t smallest = 0;
+
+	for (uint32_t i = 1; i < POOL_N_BUFS; i++) {
+		if (pool->sizes[i] < pool->sizes[smallest]) {
+			smallest = i;
+		}
+	}
+
+	if (pool->sizes[smallest] < alloc_sz) {
+		cf_free(pool->bufs[smallest]);
+		pool->bufs[smallest] = buf;
+		pool->sizes[smallest] = alloc_sz;
+	}
+	else {
+		cf_free(buf);
+	}
+}
+
 size_t
 cf_dyn_buf_get_newsize(int alloc, int used, int requested)
 {
@@ -65,10 +234,11 @@ cf_dyn_buf_reserve_internal(cf_dyn_buf *db, size_t sz)
 	if (new_sz > db->alloc_sz) {
 		uint8_t	*_t;
 		if (db->is_stack) {
-			_t = cf_malloc(new_sz);
+			_t = cf_dyn_buf_pool_get(new_sz, &new_sz);
 			if (!_t)	return(-1);
 			memcpy(_t, db->buf, db->used_sz);
 			db->is_stack = false;
+			db->is_pooled = true;
 			db->buf = _t;
 		}
 		else {
@@ -90,12 +260,12 @@ cf_dyn_buf_reserve_internal(cf_dyn_buf *db, size_t sz)
 int
 cf_dyn_buf_init_heap(cf_dyn_buf *db, size_t sz)
 {
-	db->buf = cf_malloc(sz);
+	db->buf = cf_dyn_buf_pool_get(sz, &db->alloc_sz);
 	if (! db->buf) {
 		return -1;
 	}
 	db->is_stack = false;
-	db->alloc_sz = sz;
+	db->is_pooled = true;
 	db->used_sz = 0;
 	return 0;
 }
@@ -195,7 +365,16 @@ cf_dyn_buf_strdup(cf_dyn_buf *db)
 void
 cf_dyn_buf_free(cf_dyn_buf *db)
 {
-	if (! db->is_stack && db->buf) {
+	if (db->is_stack || ! db->buf) {
+		return;
+	}
+
+	pool_note_size(db->used_sz);
+
+	if (db->is_pooled) {
+		cf_dyn_buf_pool_put(db->buf, db->alloc_sz);
+	}
+	else {
 		cf_free(db->buf);
 	}
 }
@@ -479,13 +658,25 @@ cf_buf_builder_reset(cf_buf_builder *bb)
 // TODO - We've only implemented a few cf_ll_buf methods for now. We'll add more
 // functionality if and when it's needed.
 
+// A cf_ll_buf lives for one transaction, so its heap stages would otherwise be
+// allocated and freed every time one overflows its stack stage. Each thread
+// instead keeps a freed stage, up to this size, for its next cf_ll_buf.
+#define LLB_SPARE_STAGE_MAX_SZ (4 * 1024 * 1024)
+
+static __thread cf_ll_buf_stage *t_spare_stage = NULL;
+
 int
 cf_ll_buf_grow(cf_ll_buf *llb, size_t sz)
 {
 	size_t buf_sz = sz > llb->head->buf_sz ? sz : llb->head->buf_sz;
-	cf_ll_buf_stage *new_tail = cf_malloc(sizeof(cf_ll_buf_stage) + buf_sz);
+	cf_ll_buf_stage *new_tail;
 
-	if (! new_tail) {
+	if (t_spare_stage && t_spare_stage->buf_sz >= buf_sz) {
+		new_tail = t_spare_stage;
+		t_spare_stage = NULL;
+		buf_sz = new_tail->buf_sz;
+	}
+	else if (! (new_tail = cf_malloc(sizeof(cf_ll_buf_stage) + buf_sz))) {
 		return -1;
 	}
 
@@ -529,6 +720,18 @@ cf_ll_buf_free(cf_ll_buf *llb)
 		cf_ll_buf_stage *temp = cur;
 
 		cur = cur->next;
+
+		// Keep the largest stage that's not too large as the spare.
+		if (temp->buf_sz <= LLB_SPARE_STAGE_MAX_SZ &&
+				(! t_spare_stage || temp->buf_sz > t_spare_stage->buf_sz)) {
+			if (t_spare_stage) {
+				cf_free(t_spare_stage);
+			}
+
+			t_spare_stage = temp;
+			continue;
+		}
+
 		cf_free(temp);
 	}
 }
@@ -24,6 +24,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdarg.h>
 #include <stdbool.h>
@@ -37,6 +38,7 @@
 
 #include <aerospike/as_log.h>
 #include <citrusleaf/alloc.h>
+#include <citrusleaf/cf_atomic.h>
 #include <citrusleaf/cf_b64.h>
 
 
@@ -98,6 +100,7 @@ char *cf_fault_context_strings[] = {
 		"sindex",
 		"smd",
 		"storage",
+		"truncate",
 		"tsvc",
 		"udf",
 		"xdr"
@@ -414,6 +417,375 @@ cf_fault_is_using_local_time()
 	return g_use_local_time;
 }
 
+
+/*
+ * Asynchronous logging.
+ *
+ * When enabled, each thread formats its messages into its own single-producer
+ * ring, and a dedicated logger thread drains all rings and does the write()s.
+ * A thread that logs too fast, or whose ring is full, drops messages rather
+ * than block - drops are counted and reported by the logger. The logger also
+ * collapses consecutive identical messages from a thread into a single
+ * "repeated" line. Critical messages are always written synchronously, after
+ * the thread's ring has drained, so they stay in order and reach the sinks
+ * before we abort.
+ */
+
+#define ASYNC_SLOT_SZ 1024
+#define ASYNC_RING_SLOTS 64 // must be power of 2
+#define ASYNC_MAX_RINGS 2048
+#define ASYNC_MAX_PER_SEC 2000 // per thread
+#define ASYNC_IDLE_SLEEP_US (5 * 1000)
+#define ASYNC_CRITICAL_DRAIN_WAIT_US (1000 * 1000)
+
+typedef struct async_slot_s {
+	cf_fault_context context;
+	cf_fault_severity severity;
+	uint32_t len;
+	uint32_t body_off; // past the timestamp - used to detect duplicates
+	char buf[ASYNC_SLOT_SZ];
+} async_slot;
+
+typedef struct async_ring_s {
+	// Producer-only.
+	volatile uint32_t head;
+	time_t rate_sec;
+	uint32_t rate_count;
+
+	// Logger-only.
+	volatile uint32_t tail;
+	volatile bool orphaned;
+	uint32_t n_repeats;
+	time_t last_time;
+	async_slot last;
+
+	async_slot slots[ASYNC_RING_SLOTS];
+} async_ring;
+
+static bool g_use_async = false;
+static bool g_async_started = false;
+
+static async_ring* volatile g_async_rings[ASYNC_MAX_RINGS];
+static pthread_key_t g_async_ring_key;
+static __thread async_ring* t_async_ring = NULL;
+
+static cf_atomic64 g_async_queued = 0;
+static cf_atomic64 g_async_dropped = 0;
+static cf_atomic64 g_async_rate_limited = 0;
+static cf_atomic64 g_async_suppressed = 0;
+
+static void
+fault_write_sinks(const cf_fault_context context, const cf_fault_severity severity, const char *buf, size_t len)
+{
+	for (int i = 0; i < cf_fault_sinks_inuse; i++) {
+		if ((severity <= cf_fault_sinks[i].limit[context]) || (CF_CRITICAL == severity)) {
+			if (0 >= write(cf_fault_sinks[i].fd, buf, len)) {
+				// this is OK for a bit in case of a HUP. It's even better to queue the buffers and apply them
+				// after the hup. TODO.
+				fprintf(stderr, "internal failure in fault message write: %s\n", cf_strerror(errno));
+			}
+		}
+	}
+}
+
+
+
+void
+cf_fault_use_async(bool val)
+{
+	g_use_async = val;
+}
+
+bool
+cf_fault_is_using_async()
+{
+	return g_use_async;
+}
+
+void
+cf_fault_get_async_stats(cf_fault_async_stats *stats)
+{
+	stats->queued = cf_atomic64_get(g_async_queued);
+	stats->dropped = cf_atomic64_get(g_async_dropped);
+	stats->rate_limited = cf_atomic64_get(g_async_rate_limited);
+	stats->suppressed = cf_atomic64_get(g_async_suppressed);
+}
+
+static inline bool
+async_is_active()
+{
+	return g_use_async && g_async_started && cf_fault_sinks_inuse != 0;
+}
+
+static void
+async_ring_orphan(void *udata)
+{
+	// Thread is exiting - the logger frees the ring once it's drained.
+	((async_ring *)udata)->orphaned = true;
+}
+
+static async_ring *
+async_ring_get()
+{
+	if (t_async_ring) {
+		return t_async_ring;
+	}
+
+	async_ring *ring = cf_malloc(sizeof(async_ring));
+
+	if (! ring) {
+		return NULL;
+	}
+
+	memset(ring, 0, sizeof(async_ring));
+
+	for (int i = 0; i < ASYNC_MAX_RINGS; i++) {
+		if (__sync_bool_compare_and_swap(&g_async_rings[i], NULL, ring)) {
+			pthread_setspecific(g_async_ring_key, ring);
+			t_async_ring = ring;
+			return ring;
+		}
+	}
+
+	// Too many logging threads - this one will log synchronously.
+	cf_free(ring);
+	return NULL;
+}
+
+// Returns false if the caller should write the message synchronously.
+static bool
+async_enqueue(const cf_fault_context context, const cf_fault_severity severity,
+		time_t now, const char *buf, size_t len, size_t body_off)
+{
+	if (len >= ASYNC_SLOT_SZ) {
+		return false;
+	}
+
+	async_ring *ring = async_ring_get();
+
+	if (! ring) {
+		return false;
+	}
+
+	if (ring->rate_sec != now) {
+		ring->rate_sec = now;
+		ring->rate_count = 0;
+	}
+
+	if (ring->rate_count++ >= ASYNC_MAX_PER_SEC) {
+		cf_atomic64_incr(&g_async_rate_limited);
+		return true;
+	}
+
+	uint32_t head = ring->head;
+
+	if (head - ring->tail == ASYNC_RING_SLOTS) {
+		cf_atomic64_incr(&g_async_dropped);
+		return true;
+	}
+
+	async_slot *slot = &ring->slots[head & (ASYNC_RING_SLOTS - 1)];
+
+	slot->context = context;
+	slot->severity = severity;
+	slot->len = (uint32_t)len;
+	slot->body_off = (uint32_t)body_off;
+	memcpy(slot->buf, buf, len);
+
+	// Slot must be complete before the logger can see it.
+	__sync_synchronize();
+
+	ring->head = head + 1;
+	cf_atomic64_incr(&g_async_queued);
+
+	return true;
+}
+
+// Before a critical message is written synchronously, give the logger a
+// chance to write this thread's earlier messages.
+static void
+async_drain_own_ring()
+{
+	async_ring *ring = t_async_ring;
+
+	if (! ring || ! g_async_started) {
+		return;
+	}
+
+	for (uint32_t waited = 0; ring->tail != ring->head &&
+			waited < ASYNC_CRITICAL_DRAIN_WAIT_US; waited += 1000) {
+		usleep(1000);
+	}
+}
+
+static void
+async_flush_repeats(async_ring *ring)
+{
+	if (ring->n_repeats == 0) {
+		return;
+	}
+
+	char mbuf[ASYNC_SLOT_SZ];
+	struct tm nowtm;
+	size_t limit = sizeof(mbuf);
+	size_t pos;
+
+	if (g_use_local_time) {
+		localtime_r(&ring->last_time, &nowtm);
+		pos = strftime(mbuf, limit, "%b %d %Y %T GMT%z: ", &nowtm);
+	}
+	else {
+		gmtime_r(&ring->last_time, &nowtm);
+		pos = strftime(mbuf, limit, "%b %d %Y %T %Z: ", &nowtm);
+	}
+
+	pos += snprintf(mbuf + pos, limit - pos, "%s (%s): (fault.c) previous message repeated %u times\n",
+			cf_fault_severity_strings[ring->last.severity],
+			cf_fault_context_strings[ring->last.context], ring->n_repeats);
+
+	if (pos >= limit) {
+		pos = limit - 1;
+	}
+
+	fault_write_sinks(ring->last.context, ring->last.severity, mbuf, pos);
+	ring->n_repeats = 0;
+}
+
+static inline bool
+async_is_repeat(const async_ring *ring, const async_slot *slot)
+{
+	const async_slot *last = &ring->last;
+
+	return last->len != 0 && slot->context == last->context &&
+			slot->severity == last->severity &&
+			slot->len - slot->body_off == last->len - last->body_off &&
+			memcmp(slot->buf + slot->body_off, last->buf + last->body_off,
+					slot->len - slot->body_off) == 0;
+}
+
+// Returns true if anything was written.
+static bool
+async_ring_drain(async_ring *ring, time_t now)
+{
+	uint32_t tail = ring->tail;
+	uint32_t head = ring->head;
+
+	if (tail == head) {
+		// Don't hold a pending repeat count forever.
+		if (ring->n_repeats != 0 && now != ring->last_time) {
+			async_flush_repeats(ring);
+		}
+
+		return false;
+	}
+
+	// Read slots only after seeing head.
+	__sync_synchronize();
+
+	while (tail != head) {
+		async_slot *slot = &ring->slots[tail & (ASYNC_RING_SLOTS - 1)];
+
+		if (async_is_repeat(ring, slot)) {
+			ring->n_repeats++;
+			ring->last_time = now;
+			cf_atomic64_incr(&g_async_suppressed);
+		}
+		else {
+			async_flush_repeats(ring);
+			fault_write_sinks(slot->context, slot->severity, slot->buf, slot->len);
+			memcpy(&ring->last, slot, offsetof(async_slot, buf) + slot->len);
+			ring->last_time = now;
+		}
+
+		tail++;
+	}
+
+	// Done with slots before the producer can reuse them.
+	__sync_synchronize();
+
+	ring->tail = tail;
+
+	return true;
+}
+
+static void *
+run_async_logger(void *udata)
+{
+	uint64_t last_dropped = 0;
+	uint64_t last_rate_limited = 0;
+	time_t last_report = time(NULL);
+
+	while (true) {
+		time_t now = time(NULL);
+		bool did_work = false;
+
+		for (int i = 0; i < ASYNC_MAX_RINGS; i++) {
+			async_ring *ring = g_async_rings[i];
+
+			if (! ring) {
+				continue;
+			}
+
+			// Check before draining, so nothing pushed earlier is missed.
+			bool orphaned = ring->orphaned;
+
+			if (async_ring_drain(ring, now)) {
+				did_work = true;
+			}
+
+			if (orphaned && ring->tail == ring->head) {
+				async_flush_repeats(ring);
+				g_async_rings[i] = NULL;
+				cf_free(ring);
+			}
+		}
+
+		if (now != last_report) {
+			uint64_t dropped = cf_atomic64_get(g_async_dropped);
+			uint64_t rate_limited = cf_atomic64_get(g_async_rate_limited);
+
+			if (dropped != last_dropped || rate_limited != last_rate_limited) {
+				cf_warning(CF_MISC, "async logging discarded messages: %lu ring-full %lu rate-limited",
+						dropped - last_dropped, rate_limited - last_rate_limited);
+
+				last_dropped = dropped;
+				last_rate_limited = rate_limited;
+			}
+
+			last_report = now;
+		}
+
+		if (! did_work) {
+			usleep(ASYNC_IDLE_SLEEP_US);
+		}
+	}
+
+	return NULL;
+}
+
+/* cf_fault_start_async
+ * Start the logger thread - must be called after daemonizing. Messages are
+ * only queued while async logging is configured on. */
+void
+cf_fault_start_async()
+{
+	if (0 != pthread_key_create(&g_async_ring_key, async_ring_orphan)) {
+		cf_crash(CF_MISC, "failed to create async logging thread key");
+	}
+
+	pthread_attr_t attrs;
+	pthread_t thread;
+
+	pthread_attr_init(&attrs);
+	pthread_attr_setdetachstate(&attrs, PTHREAD_CREATE_DETACHED);
+
+	if (0 != pthread_create(&thread, &attrs, run_async_logger, NULL)) {
+		cf_crash(CF_MISC, "failed to create async logging thread");
+	}
+
+	g_async_started = true;
+}
+
 /* cf_fault_event
  * Respond to a fault */
 void
@@ -442,6 +814,9 @@ cf_fault_event(const cf_fault_context context, const cf_fault_severity severity,
 		pos = strftime(mbuf, limit, "%b %d %Y %T %Z: ", &nowtm);
 	}
 
+	// Duplicate detection for async logging ignores the timestamp.
+	size_t body_off = pos;
+
 	/* Set the context/scope/severity tag */
 	pos += snprintf(mbuf + pos, limit - pos, "%s (%s): ", cf_fault_severity_strings[severity], cf_fault_context_strings[context]);
 
@@ -479,16 +854,13 @@ cf_fault_event(const cf_fault_context context, const cf_fault_severity severity,
 		/* If no fault sinks are defined, use stderr for important messages */
 		if (severity <= NO_SINKS_LIMIT)
 			fprintf(stderr, "%s", mbuf);
-	} else {
-		for (int i = 0; i < cf_fault_sinks_inuse; i++) {
-			if ((severity <= cf_fault_sinks[i].limit[context]) || (CF_CRITICAL == severity)) {
-				if (0 >= write(cf_fault_sinks[i].fd, mbuf, pos)) {
-					// this is OK for a bit in case of a HUP. It's even better to queue the buffers and apply them
-					// after the hup. TODO.
-					fprintf(stderr, "internal failure in fault message write: %s\n", cf_strerror(errno));
-				}
-			}
+	} else if (CF_CRITICAL == severity || ! async_is_active() ||
+			! async_enqueue(context, severity, now, mbuf, pos, body_off)) {
+		if (CF_CRITICAL == severity) {
+			async_drain_own_ring();
 		}
+
+		fault_write_sinks(context, severity, mbuf, pos);
 	}
 
 	/* Critical errors */
@@ -711,6 +1083,9 @@ cf_fault_event2(const cf_fault_context context,
 		pos = strftime(mbuf, limit, "%b %d %Y %T %Z: ", &nowtm);
 	}
 
+	// Duplicate detection for async logging ignores the timestamp.
+	size_t body_off = pos;
+
 	// If we're given a valid MEMORY POINTER for a binary value, then
 	// compute the string that corresponds to the bytes.
 	if (mem_ptr) {
@@ -802,16 +1177,13 @@ cf_fault_event2(const cf_fault_context context,
 		/* If no fault sinks are defined, use stderr for critical messages */
 		if (CF_CRITICAL == severity)
 			fprintf(stderr, "%s", mbuf);
-	} else {
-		for (int i = 0; i < cf_fault_sinks_inuse; i++) {
-			if ((severity <= cf_fault_sinks[i].limit[context]) || (CF_CRITICAL == severity)) {
-				if (0 >= write(cf_fault_sinks[i].fd, mbuf, pos)) {
-					// this is OK for a bit in case of a HUP. It's even better to queue the buffers and apply them
-					// after the hup. TODO.
-					fprintf(stderr, "internal failure in fault message write: %s\n", cf_strerror(errno));
-				}
-			}
+	} else if (CF_CRITICAL == severity || ! async_is_active() ||
+			! async_enqueue(context, severity, now, mbuf, pos, body_off)) {
+		if (CF_CRITICAL == severity) {
+			async_drain_own_ring();
 		}
+
+		fault_write_sinks(context, severity, mbuf, pos);
 	}
 
 	/* Critical errors */
@@ -850,6 +1222,9 @@ cf_fault_event_nostack(const cf_fault_context context,
 		pos = strftime(mbuf, limit, "%b %d %Y %T %Z: ", &nowtm);
 	}
 
+	// Duplicate detection for async logging ignores the timestamp.
+	size_t body_off = pos;
+
 	/* Set the context/scope/severity tag */
 	pos += snprintf(mbuf + pos, limit - pos, "%s (%s): ", cf_fault_severity_strings[severity], cf_fault_context_strings[context]);
 
@@ -886,16 +1261,13 @@ cf_fault_event_nostack(const cf_fault_context context,
 		/* If no fault sinks are defined, use stderr for important messages */
 		if (severity <= NO_SINKS_LIMIT)
 			fprintf(stderr, "%s", mbuf);
-	} else {
-		for (int i = 0; i < cf_fault_sinks_inuse; i++) {
-			if ((severity <= cf_fault_sinks[i].limit[context]) || (CF_CRITICAL == severity)) {
-				if (0 >= write(cf_fault_sinks[i].fd, mbuf, pos)) {
-					// this is OK for a bit in case of a HUP. It's even better to queue the buffers and apply them
-					// after the hup. TODO.
-					fprintf(stderr, "internal failure in fault message write: %s\n", cf_strerror(errno));
-				}
-			}
+	} else if (CF_CRITICAL == severity || ! async_is_active() ||
+			! async_enqueue(context, severity, now, mbuf, pos, body_off)) {
+		if (CF_CRITICAL == severity) {
+			async_drain_own_ring();
 		}
+
+		fault_write_sinks(context, severity, mbuf, pos);
 	}
 
 	/* Critical errors */
@@ -0,0 +1,247 @@
+/*
+ * hdr_hist.c
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+
+//==========================================================
+// Includes.
+//
+
+#include "hdr_hist.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "citrusleaf/alloc.h"
+#include "citrusleaf/cf_atomic.h"
+#include "citrusleaf/cf_clock.h"
+
+#include "fault.h"
+
+
+//==========================================================
+// Private class data.
+//
+
+// Values are clamped below 2^40 microseconds - about 12 days.
+#define HDR_HIST_MAX_BITS 40
+
+struct hdr_hist_s {
+	uint32_t precision;
+	uint32_t num_buckets;
+	cf_atomic64 max;
+	cf_atomic64 counts[];
+};
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static uint32_t bucket_of(const hdr_hist *h, uint64_t usec);
+static uint64_t bucket_max(const hdr_hist *h, uint32_t b);
+
+
+//==========================================================
+// Public API.
+//
+
+//------------------------------------------------
+// Create a log-linear histogram.
+//
+hdr_hist*
+hdr_hist_create(uint32_t precision)
+{
+	if (precision < HDR_HIST_MIN_PRECISION ||
+			precision > HDR_HIST_MAX_PRECISION) {
+		cf_crash(AS_INFO, "hdr_hist_create - bad precision %u", precision);
+	}
+
+	uint32_t n_subs = 1 << precision;
+	uint32_t num_buckets = n_subs +
+			(HDR_HIST_MAX_BITS - precision) * (n_subs / 2);
+
+	hdr_hist *h = cf_calloc(1, sizeof(hdr_hist) +
+			num_buckets * sizeof(cf_atomic64));
+
+	if (! h) {
+		cf_crash(AS_INFO, "hdr_hist_create - alloc failed");
+	}
+
+	h->precision = precision;
+	h->num_buckets = num_buckets;
+
+	return h;
+}
+
+//------------------------------------------------
+// Destroy a log-linear histogram.
+//
+void
+hdr_hist_destroy(hdr_hist *h)
+{
+	cf_free(h);
+}
+
+//------------------------------------------------
+// Insert a time interval data point - time elapsed
+// since start_ns, in microseconds. Assumes start_ns
+// was obtained via cf_getns().
+//
+uint64_t
+hdr_hist_insert_data_point(hdr_hist *h, uint64_t start_ns)
+{
+	uint64_t end_ns = cf_getns();
+
+	// The clock going backwards counts as 0.
+	hdr_hist_insert_raw(h, end_ns > start_ns ? (end_ns - start_ns) / 1000 : 0);
+
+	return end_ns;
+}
+
+//------------------------------------------------
+// Insert a data point in microseconds.
+//
+void
+hdr_hist_insert_raw(hdr_hist *h, uint64_t usec)
+{
+	cf_atomic64_incr(&h->counts[bucket_of(h, usec)]);
+
+	uint64_t max = cf_atomic64_get(h->max);
+
+	while (usec > max) {
+		if (cf_atomic64_cas(&h->max, max, usec) == max) {
+			break;
+		}
+
+		max = cf_atomic64_get(h->max);
+	}
+}
+
+//------------------------------------------------
+// Clear a log-linear histogram.
+//
+void
+hdr_hist_clear(hdr_hist *h)
+{
+	for (uint32_t b = 0; b < h->num_buckets; b++) {
+		cf_atomic64_set(&h->counts[b], 0);
+	}
+
+	cf_atomic64_set(&h->max, 0);
+}
+
+//------------------------------------------------
+// Empty a log-linear histogram and get percentiles
+// of what it held. Buckets are swapped out one by
+// one, so concurrent data points are never lost -
+// they're counted now or next time. A percentile
+// is its bucket's highest value, capped by max.
+//
+void
+hdr_hist_take_percentiles(hdr_hist *h, hdr_hist_percentiles *p)
+{
+	uint64_t max = __sync_fetch_and_and(&h->max, 0);
+
+	static const uint64_t tenths_pcts[] = { 500, 900, 990, 999 };
+	uint64_t *pcts[] = { &p->p50, &p->p90, &p->p99, &p->p999 };
+	uint32_t num_pcts = sizeof(tenths_pcts) / sizeof(tenths_pcts[0]);
+
+	uint64_t *counts = cf_malloc(h->num_buckets * sizeof(uint64_t));
+
+	if (! counts) {
+		cf_crash(AS_INFO, "hdr_hist_take_percentiles - alloc failed");
+	}
+
+	uint64_t total = 0;
+
+	for (uint32_t b = 0; b < h->num_buckets; b++) {
+		counts[b] = __sync_fetch_and_and(&h->counts[b], 0);
+		total += counts[b];
+	}
+
+	memset(p, 0, sizeof(hdr_hist_percentiles));
+	p->total = total;
+	p->max = max;
+
+	uint64_t subtotal = 0;
+	uint32_t i = 0;
+
+	for (uint32_t b = 0; b < h->num_buckets && i < num_pcts; b++) {
+		subtotal += counts[b];
+
+		// Rank of the data point at each percentile, rounding up.
+		while (i < num_pcts &&
+				subtotal * 1000 >= total * tenths_pcts[i]) {
+			uint64_t value = bucket_max(h, b);
+
+			*pcts[i++] = value < max ? value : max;
+		}
+	}
+
+	cf_free(counts);
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+// Values with no more significant bits than precision are exact, then each
+// power of two is split into 2^(precision - 1) buckets.
+static uint32_t
+bucket_of(const hdr_hist *h, uint64_t usec)
+{
+	uint64_t limit = (1UL << HDR_HIST_MAX_BITS) - 1;
+
+	if (usec > limit) {
+		usec = limit;
+	}
+
+	uint32_t n_subs = 1 << h->precision;
+
+	if (usec < n_subs) {
+		return (uint32_t)usec;
+	}
+
+	uint32_t n_bits = 64 - __builtin_clzll(usec);
+	uint32_t shift = n_bits - h->precision;
+	uint32_t top = (uint32_t)(usec >> shift); // n_subs / 2 ... n_subs - 1
+
+	return n_subs + (shift - 1) * (n_subs / 2) + top - n_subs / 2;
+}
+
+// Highest value counted in a bucket.
+static uint64_t
+bucket_max(const hdr_hist *h, uint32_t b)
+{
+	uint32_t n_subs = 1 << h->precision;
+
+	if (b < n_subs) {
+		return b;
+	}
+
+	uint32_t k = b - n_subs;
+	uint32_t shift = k / (n_subs / 2) + 1;
+	uint64_t top = n_subs / 2 + k % (n_subs / 2);
+
+	return ((top + 1) << shift) - 1;
+}
@@ -34,6 +34,7 @@
 
 #include "dynbuf.h"
 #include "fault.h"
+#include "shard_counter.h"
 
 
 //==========================================================
@@ -42,7 +43,8 @@
 
 //------------------------------------------------
 // Create a histogram. There's no destroy(), but
-// you can just cf_free() the histogram.
+// you can just cf_free() the histogram - if it
+// has shards, cf_free() them first.
 //
 histogram*
 histogram_create(const char *name, histogram_scale scale)
@@ -63,6 +65,7 @@ histogram_create(const char *name, histogram_scale scale)
 
 	strcpy(h->name, name);
 	memset((void *)&h->counts, 0, sizeof(h->counts));
+	h->shards = NULL;
 
 	switch (scale) {
 	case HIST_MILLISECONDS:
@@ -84,15 +87,113 @@ histogram_create(const char *name, histogram_scale scale)
 	return h;
 }
 
+//------------------------------------------------
+// Give a histogram per-thread shards. Call before
+// any data points are inserted.
+//
+bool
+histogram_add_shards(histogram *h)
+{
+	histogram_shards *shards = cf_valloc(sizeof(histogram_shards));
+
+	if (! shards) {
+		return false;
+	}
+
+	memset((void *)shards, 0, sizeof(histogram_shards));
+	h->shards = shards;
+
+	return true;
+}
+
 //------------------------------------------------
 // Clear a histogram.
 //
+// Shards are only written by their owners, so
+// can't be zeroed here - instead remember their
+// totals, to subtract from later reads.
+//
 void
 histogram_clear(histogram *h)
 {
 	for (int i = 0; i < N_BUCKETS; i++) {
 		cf_atomic64_set(&h->counts[i], 0);
 	}
+
+	histogram_shards *shards = h->shards;
+
+	if (! shards) {
+		return;
+	}
+
+	for (int i = 0; i < N_BUCKETS; i++) {
+		uint64_t sum = 0;
+
+		for (int s = 0; s < SHARD_COUNTER_SLOTS; s++) {
+			sum += *(volatile uint64_t *)&shards->shards[s].counts[i];
+		}
+
+		*(volatile uint64_t *)&shards->cleared[i] = sum;
+	}
+}
+
+//------------------------------------------------
+// Get a histogram's bucket counts, merging shards.
+// Counts must have N_BUCKETS elements.
+//
+void
+histogram_get_counts(histogram *h, uint64_t counts[])
+{
+	for (int i = 0; i < N_BUCKETS; i++) {
+		counts[i] = cf_atomic64_get(h->counts[i]);
+	}
+
+	histogram_shards *shards = h->shards;
+
+	if (! shards) {
+		return;
+	}
+
+	for (int i = 0; i < N_BUCKETS; i++) {
+		uint64_t sum = 0;
+
+		for (int s = 0; s < SHARD_COUNTER_SLOTS; s++) {
+			sum += *(volatile uint64_t *)&shards->shards[s].counts[i];
+		}
+
+		uint64_t cleared = *(volatile uint64_t *)&shards->cleared[i];
+
+		// Data points may beat the snapshot in a race with clear.
+		if (sum > cleared) {
+			counts[i] += sum - cleared;
+		}
+	}
+}
+
+//------------------------------------------------
+// Count a data point in a bucket - in the calling
+// thread's own shard, if it has one.
+//
+static inline void
+count_data_point(histogram *h, int bucket)
+{
+	if (h->shards) {
+		uint32_t slot = g_shard_counter_slot;
+
+		if (slot == 0) {
+			slot = cf_shard_counter_assign_slot();
+		}
+
+		// Slots below SHARD_COUNTER_SLOTS are never handed out twice.
+		if (slot < SHARD_COUNTER_SLOTS) {
+			uint64_t *count = &h->shards->shards[slot].counts[bucket];
+
+			*(volatile uint64_t *)count = *count + 1;
+			return;
+		}
+	}
+
+	cf_atomic64_incr(&h->counts[bucket]);
 }
 
 //------------------------------------------------
@@ -108,9 +209,7 @@ histogram_dump(histogram *h)
 	int b;
 	uint64_t counts[N_BUCKETS];
 
-	for (b = 0; b < N_BUCKETS; b++) {
-		counts[b] = cf_atomic64_get(h->counts[b]);
-	}
+	histogram_get_counts(h, counts);
 
 	int i = N_BUCKETS;
 	int j = 0;
@@ -278,7 +377,7 @@ histogram_insert_data_point(histogram *h, uint64_t start_ns)
 		}
 	}
 
-	cf_atomic64_incr(&h->counts[bucket]);
+	count_data_point(h, bucket);
 
 	return end_ns;
 }
@@ -299,7 +398,7 @@ histogram_insert_data_point(histogram *h, uint64_t start_ns)
 void
 histogram_insert_raw(histogram *h, uint64_t value)
 {
-	cf_atomic64_incr(&h->counts[msb(value)]);
+	count_data_point(h, msb(value));
 }
 
 
@@ -43,6 +43,7 @@
 #include <citrusleaf/alloc.h>
 
 #include "dynbuf.h"
+#include "hdr_hist.h"
 #include "hist.h"
 
 
@@ -84,6 +85,7 @@ const uint32_t default_buckets[DEFAULT_NUM_COLS] = { 0, 3, 6 };
 typedef struct row_s {
 	uint32_t		timestamp;
 	uint64_t		total;
+	hdr_hist_percentiles pcts; // of the slice ending here, if hdr is set
 	uint64_t		overs[];
 } row;
 
@@ -101,6 +103,9 @@ struct cf_hist_track_s {
 	uint32_t		slice_sec;
 	uint32_t		buckets[MAX_NUM_COLS];
 	uint32_t		num_cols;
+
+	// Optional log-linear histogram, for percentiles
+	hdr_hist*		hdr;
 };
 
 //------------------------------------------------
@@ -115,6 +120,10 @@ static void output_header(cf_hist_track* this, uint32_t start_ts,
 static void output_slice(cf_hist_track* this, row* prev_row_p, row* row_p,
 		uint32_t diff_sec, uint32_t num_cols,
 		cf_hist_track_info_format info_fmt, cf_dyn_buf* db_p);
+static void output_percentiles_header(cf_hist_track* this, uint32_t start_ts,
+		cf_dyn_buf* db_p);
+static void output_percentiles_slice(row* prev_row_p, row* row_p,
+		cf_dyn_buf* db_p);
 static int threshold_to_bucket(int threshold);
 static int thresholds_to_buckets(const char* thresholds, uint32_t buckets[]);
 
@@ -151,6 +160,7 @@ cf_hist_track_create(const char* name, histogram_scale scale)
 	// Base histogram setup, same as in histogram_create():
 	strcpy(this->hist.name, name);
 	memset((void*)this->hist.counts, 0, sizeof(this->hist.counts));
+	this->hist.shards = NULL;
 
 	switch (scale) {
 	case HIST_MILLISECONDS:
@@ -171,6 +181,7 @@ cf_hist_track_create(const char* name, histogram_scale scale)
 
 	// Start with tracking off.
 	this->rows = NULL;
+	this->hdr = NULL;
 
 	return this;
 }
@@ -183,9 +194,29 @@ cf_hist_track_destroy(cf_hist_track* this)
 {
 	cf_hist_track_stop(this);
 	pthread_mutex_destroy(&this->rows_lock);
+
+	if (this->hist.shards) {
+		cf_free(this->hist.shards);
+	}
+
+	if (this->hdr) {
+		hdr_hist_destroy(this->hdr);
+	}
+
 	cf_free(this);
 }
 
+//------------------------------------------------
+// Also record time data points in a log-linear
+// histogram, so saved rows have percentiles. Call
+// before any data points are inserted.
+//
+void
+cf_hist_track_enable_percentiles(cf_hist_track* this, uint32_t precision)
+{
+	this->hdr = hdr_hist_create(precision);
+}
+
 //------------------------------------------------
 // Start tracking. May call this again without
 // first calling cf_hist_track_disable() to use
@@ -297,6 +328,11 @@ cf_hist_track_dump(cf_hist_track* this)
 	pthread_mutex_lock(&this->rows_lock);
 
 	if (! this->rows) {
+		// Don't let a later first row cover everything since now.
+		if (this->hdr) {
+			hdr_hist_clear(this->hdr);
+		}
+
 		pthread_mutex_unlock(&this->rows_lock);
 		return;
 	}
@@ -317,8 +353,9 @@ cf_hist_track_dump(cf_hist_track* this)
 	uint64_t counts[N_BUCKETS];
 	uint64_t total_count = 0;
 
+	histogram_get_counts((histogram*)this, counts);
+
 	for (int j = 0; j < N_BUCKETS; j++) {
-		counts[j] = cf_atomic64_get(this->hist.counts[j]);
 		total_count += counts[j];
 	}
 
@@ -336,6 +373,13 @@ cf_hist_track_dump(cf_hist_track* this)
 	row_p->total = total_count;
 	row_p->timestamp = now_ts;
 
+	if (this->hdr) {
+		hdr_hist_take_percentiles(this->hdr, &row_p->pcts);
+	}
+	else {
+		memset(&row_p->pcts, 0, sizeof(row_p->pcts));
+	}
+
 	// Increment the current and oldest row indexes.
 	this->write_row_n++;
 
@@ -352,7 +396,14 @@ cf_hist_track_dump(cf_hist_track* this)
 uint64_t
 cf_hist_track_insert_data_point(cf_hist_track* this, uint64_t start_ns)
 {
-	return histogram_insert_data_point((histogram*)this, start_ns);
+	uint64_t end_ns = histogram_insert_data_point((histogram*)this, start_ns);
+
+	if (this->hdr) {
+		hdr_hist_insert_raw(this->hdr,
+				end_ns > start_ns ? (end_ns - start_ns) / 1000 : 0);
+	}
+
+	return end_ns;
 }
 
 //------------------------------------------------
@@ -436,6 +487,57 @@ cf_hist_track_get_info(cf_hist_track* this, uint32_t back_sec,
 	pthread_mutex_unlock(&this->rows_lock);
 }
 
+//------------------------------------------------
+// Get time-sliced percentiles from cache. Each
+// saved row is a slice - percentiles of adjacent
+// rows can't be merged.
+//
+void
+cf_hist_track_get_percentiles_info(cf_hist_track* this, uint32_t back_sec,
+		uint32_t duration_sec, cf_dyn_buf* db_p)
+{
+	pthread_mutex_lock(&this->rows_lock);
+
+	if (! this->hdr) {
+		cf_dyn_buf_append_string(db_p, "error-no-percentiles;");
+		pthread_mutex_unlock(&this->rows_lock);
+		return;
+	}
+
+	if (! this->rows) {
+		cf_dyn_buf_append_string(db_p, "error-not-tracking;");
+		pthread_mutex_unlock(&this->rows_lock);
+		return;
+	}
+
+	uint32_t start_row_n = get_start_row_n(this, back_sec);
+
+	if (start_row_n == -1) {
+		cf_dyn_buf_append_string(db_p, "error-no-data-yet-or-back-too-small;");
+		pthread_mutex_unlock(&this->rows_lock);
+		return;
+	}
+
+	row* prev_row_p = get_row(this, start_row_n);
+	uint32_t start_ts = prev_row_p->timestamp;
+
+	output_percentiles_header(this, start_ts, db_p);
+
+	for (uint32_t row_n = start_row_n + 1; row_n < this->write_row_n; row_n++) {
+		row* row_p = get_row(this, row_n);
+
+		output_percentiles_slice(prev_row_p, row_p, db_p);
+
+		if (duration_sec != 0 && row_p->timestamp - start_ts > duration_sec) {
+			break;
+		}
+
+		prev_row_p = row_p;
+	}
+
+	pthread_mutex_unlock(&this->rows_lock);
+}
+
 //------------------------------------------------
 // Get current settings which were passed into
 // cf_hist_track_start(), in format suitable for
@@ -680,6 +782,56 @@ output_slice(cf_hist_track* this, row* prev_row_p, row* row_p,
 	cf_dyn_buf_append_string(db_p, output);
 }
 
+//------------------------------------------------
+// Make percentiles info "header" and append it to
+// db_p.
+//
+static void
+output_percentiles_header(cf_hist_track* this, uint32_t start_ts,
+		cf_dyn_buf* db_p)
+{
+	cf_dyn_buf_append_string(db_p, ((histogram*)this)->name);
+
+	char output[MAX_FORMATTED_ROW_SIZE];
+	time_t start_ts_time_t = (time_t)start_ts;
+	struct tm start_tm;
+
+	gmtime_r(&start_ts_time_t, &start_tm);
+	strftime(output, MAX_FORMATTED_ROW_SIZE - 2,
+			":%T-GMT,ops/sec,p50,p90,p99,p99.9,max(ms);", &start_tm);
+
+	cf_dyn_buf_append_string(db_p, output);
+}
+
+//------------------------------------------------
+// Make percentiles info for slice ending at row_p
+// and append to db_p.
+//
+static void
+output_percentiles_slice(row* prev_row_p, row* row_p, cf_dyn_buf* db_p)
+{
+	char output[MAX_FORMATTED_ROW_SIZE];
+	char* write_p = output;
+	char* end_p = output + MAX_FORMATTED_ROW_SIZE - 2;
+	time_t row_ts_time_t = (time_t)row_p->timestamp;
+	struct tm row_tm;
+
+	gmtime_r(&row_ts_time_t, &row_tm);
+	write_p += strftime(output, MAX_FORMATTED_ROW_SIZE - 2, "%T", &row_tm);
+
+	uint32_t diff_sec = row_p->timestamp - prev_row_p->timestamp;
+	const hdr_hist_percentiles* p = &row_p->pcts;
+
+	write_p += snprintf(write_p, end_p - write_p,
+			",%.1f,%.3f,%.3f,%.3f,%.3f,%.3f;",
+			diff_sec != 0 ? (double)p->total / diff_sec : 0,
+			(double)p->p50 / 1000, (double)p->p90 / 1000,
+			(double)p->p99 / 1000, (double)p->p999 / 1000,
+			(double)p->max / 1000);
+
+	cf_dyn_buf_append_string(db_p, output);
+}
+
 //------------------------------------------------
 // Convert threshold milliseconds to bucket index.
 //
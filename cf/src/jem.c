@@ -29,6 +29,8 @@
 #include <errno.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <jemalloc/jemalloc.h>
@@ -253,6 +255,84 @@ void *jem_allocate_in_arena(int arena, size_t size, bool use_allocm)
 	return ptr;
 }
 
+/*
+ *  Read one "size_t" JEMalloc statistic for an arena, by name suffix.
+ *  Returns 0 if successful, -1 otherwise.
+ */
+static int jem_get_arena_stat(int arena, const char *suffix, size_t *value)
+{
+	char name[64];
+	size_t len = sizeof(size_t);
+
+	snprintf(name, sizeof(name), "stats.arenas.%d.%s", arena, suffix);
+
+	if (mallctl(name, value, &len, NULL, 0)) {
+		cf_warning(CF_JEM, "Failed to get JEMalloc statistic \"%s\" (errno %d)!", name, errno);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ *  Get the current memory usage of the given JEMalloc arena.
+ *  Returns 0 if successful, -1 otherwise.
+ */
+int jem_get_arena_stats(int arena, jem_arena_stats *stats)
+{
+	if (!jem_enabled || (arena < 0)) {
+		return -1;
+	}
+
+	// Statistics are a snapshot as of the last epoch - refresh them.
+	uint64_t epoch = 1;
+	size_t page = 0;
+	size_t len = sizeof(page);
+	size_t pactive = 0, pdirty = 0, small = 0, large = 0;
+
+	if (mallctl("epoch", NULL, NULL, &epoch, sizeof(epoch)) ||
+			mallctl("arenas.page", &page, &len, NULL, 0)) {
+		cf_warning(CF_JEM, "Failed to refresh JEMalloc statistics (errno %d)!", errno);
+		return -1;
+	}
+
+	if (jem_get_arena_stat(arena, "pactive", &pactive) ||
+			jem_get_arena_stat(arena, "pdirty", &pdirty) ||
+			jem_get_arena_stat(arena, "mapped", &stats->mapped) ||
+			jem_get_arena_stat(arena, "small.allocated", &small) ||
+			jem_get_arena_stat(arena, "large.allocated", &large)) {
+		return -1;
+	}
+
+	stats->allocated = small + large;
+	stats->active = pactive * page;
+	stats->dirty = pdirty * page;
+
+	return 0;
+}
+
+/*
+ *  Return the given JEMalloc arena's dirty pages to the OS.
+ *  Returns 0 if successful, -1 otherwise.
+ */
+int jem_purge_arena(int arena)
+{
+	if (!jem_enabled || (arena < 0)) {
+		return -1;
+	}
+
+	char name[32];
+
+	snprintf(name, sizeof(name), "arena.%d.purge", arena);
+
+	if (mallctl(name, NULL, NULL, NULL, 0)) {
+		cf_warning(CF_JEM, "Failed to purge JEMalloc arena #%d (errno %d)!", arena, errno);
+		return -1;
+	}
+
+	return 0;
+}
+
 /*
  *  Log information about the state of JEMalloc.
  *
@@ -109,6 +109,21 @@ linear_hist_create(const char *name, uint32_t start, uint32_t max_offset,
 	return h;
 }
 
+//------------------------------------------------
+// Create an empty linear histogram with the same
+// range and buckets as h, so it can be merged into
+// h.
+//
+linear_hist*
+linear_hist_create_similar(const char *name, const linear_hist *h)
+{
+	linear_hist *h_new = linear_hist_create(name, h->start, 0, h->num_buckets);
+
+	h_new->bucket_width = h->bucket_width;
+
+	return h_new;
+}
+
 //------------------------------------------------
 // Destroy a linear histogram.
 //
@@ -116,6 +131,7 @@ void
 linear_hist_destroy(linear_hist *h)
 {
 	pthread_mutex_destroy(&h->info_lock);
+	cf_free(h->counts);
 	cf_free(h);
 }
 
@@ -198,6 +214,15 @@ linear_hist_merge(linear_hist *h1, linear_hist *h2)
 //
 void
 linear_hist_insert_data_point(linear_hist *h, uint32_t point)
+{
+	linear_hist_insert_data_points(h, point, 1);
+}
+
+//------------------------------------------------
+// Insert a number of identical data points.
+//
+void
+linear_hist_insert_data_points(linear_hist *h, uint32_t point, uint32_t count)
 {
 	int32_t offset = (int32_t)(point - h->start);
 	int32_t bucket = 0;
@@ -210,7 +235,7 @@ linear_hist_insert_data_point(linear_hist *h, uint32_t point)
 		}
 	}
 
-	h->counts[bucket]++;
+	h->counts[bucket] += count;
 }
 
 //------------------------------------------------
@@ -32,6 +32,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/uio.h>
 
 #include "citrusleaf/cf_atomic.h"
 #include "citrusleaf/cf_types.h"
@@ -274,6 +275,89 @@ msg_fillbuf(const msg *m, uint8_t *buf, size_t *buflen)
 }
 
 
+// Like msg_fillbuf(), but big buffer fields aren't copied - iov entries refer
+// to them in place, between entries for the rest of the msg, which is written
+// to buf. On input *buflen and *n_iov are capacities, on output what's used.
+// The msg must not be changed or freed until the iov has been sent.
+int
+msg_fillbuf_iov(const msg *m, uint8_t *buf, size_t *buflen, struct iovec *iov,
+		uint32_t *n_iov)
+{
+	uint32_t sz = msg_get_wire_size(m);
+	uint32_t max_iov = *n_iov;
+	uint32_t iov_i = 0;
+	size_t ref_sz = 0;
+
+	if (max_iov == 0) {
+		return -2;
+	}
+
+	uint8_t *at = buf;
+	uint8_t *seg_start = buf;
+
+	*(uint32_t *)at = cf_swap_to_be32(sz - 6);
+	at += 4;
+
+	*(uint16_t *)at = cf_swap_to_be16(m->type);
+	at += 2;
+
+	for (uint32_t i = 0; i < m->n_fields; i++) {
+		const msg_field *mf = &m->f[i];
+
+		if (! (mf->is_valid && mf->is_set)) {
+			continue;
+		}
+
+		// Parsed msgs may point into a fabric buffer that won't stay put.
+		bool by_ref = mf->type == M_FT_BUF && ! m->just_parsed &&
+				mf->field_len >= MSG_IOV_MIN_REF_SZ && iov_i + 2 < max_iov;
+		size_t need_sz = by_ref ? 7 : msg_get_wire_field_size(mf->type,
+				mf->field_len);
+
+		// Leave room for the rest of the msg - refs are only an optimization.
+		if ((size_t)(at - buf) + need_sz > *buflen) {
+			return -2;
+		}
+
+		if (! by_ref) {
+			at += msg_stamp_field(at, mf);
+			continue;
+		}
+
+		at[0] = (mf->id >> 8) & 0xff;
+		at[1] = mf->id & 0xff;
+		at[2] = (uint8_t)mf->type;
+		*(uint32_t *)(at + 3) = cf_swap_to_be32(mf->field_len);
+		at += 7;
+
+		iov[iov_i].iov_base = seg_start;
+		iov[iov_i].iov_len = (size_t)(at - seg_start);
+		iov_i++;
+
+		iov[iov_i].iov_base = mf->u.buf;
+		iov[iov_i].iov_len = mf->field_len;
+		iov_i++;
+
+		ref_sz += mf->field_len;
+		seg_start = at;
+	}
+
+	if (at != seg_start) {
+		iov[iov_i].iov_base = seg_start;
+		iov[iov_i].iov_len = (size_t)(at - seg_start);
+		iov_i++;
+	}
+
+	cf_assert((size_t)(at - buf) + ref_sz == sz, CF_MSG, CF_CRITICAL,
+			"msg iov size mismatch");
+
+	*buflen = (size_t)(at - buf);
+	*n_iov = iov_i;
+
+	return 0;
+}
+
+
 //==========================================================
 // Public API - parse flattened data into messages.
 //
@@ -0,0 +1,520 @@
+/*
+ * ohash.c
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/* SYNOPSIS
+ * Each slot holds the element's full hash, an in-use flag, the key and the
+ * value, so probing compares hashes without touching keys, and growing never
+ * re-hashes. The top bits of the (mixed) hash pick the stripe, the low bits
+ * the home slot. Stripes double past 3/4 full.
+ *
+ * Deletes shift later elements of the probe cluster back, rather than leaving
+ * tombstones, so lookups never degrade with churn. Reduces start each stripe
+ * just past an empty slot, so elements shifted back by a delete along the way
+ * are still visited exactly once.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "ohash.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "citrusleaf/alloc.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+#define MIN_STRIPE_SLOTS 8
+
+typedef struct slot_s {
+	uint32_t	hash;
+	uint32_t	in_use;
+	uint8_t		data[]; // key, then value at value_offset
+} slot;
+
+typedef struct stripe_s {
+	pthread_mutex_t	lock;
+	uint32_t		n_slots; // power of 2
+	uint32_t		n_elements;
+	uint8_t			*slots;
+} __attribute__ ((aligned(64))) stripe;
+
+struct cf_ohash_s {
+	cf_ohash_hash_fn	h_fn;
+	uint32_t			key_size;
+	uint32_t			value_size;
+	uint32_t			value_offset;
+	uint32_t			slot_size;
+	uint32_t			n_stripes; // power of 2
+	uint32_t			stripe_shift;
+	stripe				*stripes;
+};
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static int find(const cf_ohash *h, const stripe *st, uint32_t hash, const void *key);
+static int insert(cf_ohash *h, stripe *st, uint32_t hash, const void *key, const void *value);
+static bool grow(cf_ohash *h, stripe *st);
+static void delete_at(cf_ohash *h, stripe *st, uint32_t i);
+
+static inline uint32_t
+round_up_pow2(uint32_t n)
+{
+	uint32_t p = 1;
+
+	while (p < n) {
+		p <<= 1;
+	}
+
+	return p;
+}
+
+static inline uint32_t
+round_up_8(uint32_t n)
+{
+	return (n + 7) & ~7U;
+}
+
+// The murmur3 finalizer - callers' hashes may have few or clustered bits.
+static inline uint32_t
+mix(uint32_t hash)
+{
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6b;
+	hash ^= hash >> 13;
+	hash *= 0xc2b2ae35;
+	hash ^= hash >> 16;
+
+	return hash;
+}
+
+static inline slot *
+slot_at(const cf_ohash *h, const stripe *st, uint32_t i)
+{
+	return (slot *)(st->slots + ((size_t)i * h->slot_size));
+}
+
+static inline stripe *
+stripe_of(const cf_ohash *h, uint32_t hash)
+{
+	return &h->stripes[h->n_stripes == 1 ? 0 : hash >> h->stripe_shift];
+}
+
+
+//==========================================================
+// Public API.
+//
+
+cf_ohash *
+cf_ohash_create(cf_ohash_hash_fn h_fn, uint32_t key_size, uint32_t value_size,
+		uint32_t n_slots, uint32_t n_stripes)
+{
+	cf_ohash *h = cf_malloc(sizeof(cf_ohash));
+
+	if (! h) {
+		return NULL;
+	}
+
+	n_stripes = round_up_pow2(n_stripes == 0 ? 1 : n_stripes);
+
+	uint32_t stripe_slots = round_up_pow2(n_slots / n_stripes);
+
+	if (stripe_slots < MIN_STRIPE_SLOTS) {
+		stripe_slots = MIN_STRIPE_SLOTS;
+	}
+
+	h->h_fn = h_fn;
+	h->key_size = key_size;
+	h->value_size = value_size;
+	h->value_offset = round_up_8(key_size);
+	h->slot_size = (uint32_t)sizeof(slot) + h->value_offset +
+			round_up_8(value_size);
+	h->n_stripes = n_stripes;
+	h->stripe_shift = 32 - (uint32_t)__builtin_ctz(n_stripes);
+
+	// Page-aligned, so stripes really are a cache line apart.
+	h->stripes = cf_valloc(sizeof(stripe) * n_stripes);
+
+	if (! h->stripes) {
+		cf_free(h);
+		return NULL;
+	}
+
+	for (uint32_t i = 0; i < n_stripes; i++) {
+		stripe *st = &h->stripes[i];
+		size_t sz = (size_t)stripe_slots * h->slot_size;
+
+		pthread_mutex_init(&st->lock, NULL);
+		st->n_slots = stripe_slots;
+		st->n_elements = 0;
+		st->slots = cf_malloc(sz);
+
+		if (! st->slots) {
+			h->n_stripes = i;
+			cf_ohash_destroy(h);
+			return NULL;
+		}
+
+		memset(st->slots, 0, sz);
+	}
+
+	return h;
+}
+
+void
+cf_ohash_destroy(cf_ohash *h)
+{
+	for (uint32_t i = 0; i < h->n_stripes; i++) {
+		pthread_mutex_destroy(&h->stripes[i].lock);
+		cf_free(h->stripes[i].slots);
+	}
+
+	cf_free(h->stripes);
+	cf_free(h);
+}
+
+// Not a snapshot - stripes are read without their locks.
+uint32_t
+cf_ohash_get_size(cf_ohash *h)
+{
+	uint32_t size = 0;
+
+	for (uint32_t i = 0; i < h->n_stripes; i++) {
+		size += *(volatile uint32_t *)&h->stripes[i].n_elements;
+	}
+
+	return size;
+}
+
+int
+cf_ohash_put(cf_ohash *h, const void *key, const void *value)
+{
+	uint32_t hash = mix(h->h_fn(key));
+	stripe *st = stripe_of(h, hash);
+
+	pthread_mutex_lock(&st->lock);
+
+	int i = find(h, st, hash, key);
+	int rv = CF_OHASH_OK;
+
+	if (i >= 0) {
+		memcpy(slot_at(h, st, (uint32_t)i)->data + h->value_offset, value,
+				h->value_size);
+	}
+	else {
+		rv = insert(h, st, hash, key, value);
+	}
+
+	pthread_mutex_unlock(&st->lock);
+
+	return rv;
+}
+
+int
+cf_ohash_put_unique(cf_ohash *h, const void *key, const void *value)
+{
+	uint32_t hash = mix(h->h_fn(key));
+	stripe *st = stripe_of(h, hash);
+
+	pthread_mutex_lock(&st->lock);
+
+	int rv = find(h, st, hash, key) >= 0 ?
+			CF_OHASH_ERR_FOUND : insert(h, st, hash, key, value);
+
+	pthread_mutex_unlock(&st->lock);
+
+	return rv;
+}
+
+int
+cf_ohash_get(cf_ohash *h, const void *key, void *value)
+{
+	uint32_t hash = mix(h->h_fn(key));
+	stripe *st = stripe_of(h, hash);
+
+	pthread_mutex_lock(&st->lock);
+
+	int i = find(h, st, hash, key);
+
+	if (i >= 0 && value) {
+		memcpy(value, slot_at(h, st, (uint32_t)i)->data + h->value_offset,
+				h->value_size);
+	}
+
+	pthread_mutex_unlock(&st->lock);
+
+	return i >= 0 ? CF_OHASH_OK : CF_OHASH_ERR_NOTFOUND;
+}
+
+int
+cf_ohash_get_vlock(cf_ohash *h, const void *key, void **p_value,
+		pthread_mutex_t **p_lock)
+{
+	uint32_t hash = mix(h->h_fn(key));
+	stripe *st = stripe_of(h, hash);
+
+	pthread_mutex_lock(&st->lock);
+
+	int i = find(h, st, hash, key);
+
+	if (i < 0) {
+		pthread_mutex_unlock(&st->lock);
+		return CF_OHASH_ERR_NOTFOUND;
+	}
+
+	*p_value = slot_at(h, st, (uint32_t)i)->data + h->value_offset;
+	*p_lock = &st->lock;
+
+	return CF_OHASH_OK;
+}
+
+int
+cf_ohash_delete(cf_ohash *h, const void *key)
+{
+	return cf_ohash_get_and_delete(h, key, NULL);
+}
+
+int
+cf_ohash_delete_lockfree(cf_ohash *h, const void *key)
+{
+	uint32_t hash = mix(h->h_fn(key));
+	stripe *st = stripe_of(h, hash);
+	int i = find(h, st, hash, key);
+
+	if (i < 0) {
+		return CF_OHASH_ERR_NOTFOUND;
+	}
+
+	delete_at(h, st, (uint32_t)i);
+
+	return CF_OHASH_OK;
+}
+
+int
+cf_ohash_get_and_delete(cf_ohash *h, const void *key, void *value)
+{
+	uint32_t hash = mix(h->h_fn(key));
+	stripe *st = stripe_of(h, hash);
+
+	pthread_mutex_lock(&st->lock);
+
+	int i = find(h, st, hash, key);
+
+	if (i >= 0) {
+		if (value) {
+			memcpy(value, slot_at(h, st, (uint32_t)i)->data + h->value_offset,
+					h->value_size);
+		}
+
+		delete_at(h, st, (uint32_t)i);
+	}
+
+	pthread_mutex_unlock(&st->lock);
+
+	return i >= 0 ? CF_OHASH_OK : CF_OHASH_ERR_NOTFOUND;
+}
+
+int
+cf_ohash_reduce(cf_ohash *h, cf_ohash_reduce_fn reduce_fn, void *udata)
+{
+	for (uint32_t s = 0; s < h->n_stripes; s++) {
+		stripe *st = &h->stripes[s];
+
+		pthread_mutex_lock(&st->lock);
+
+		uint32_t mask = st->n_slots - 1;
+		uint32_t start = 0;
+
+		// There's always an empty slot - stripes are at most 3/4 full.
+		while (slot_at(h, st, start)->in_use) {
+			start++;
+		}
+
+		uint32_t i = (start + 1) & mask;
+		uint32_t n_left = st->n_slots;
+
+		while (n_left != 0) {
+			slot *sl = slot_at(h, st, i);
+
+			if (sl->in_use) {
+				int rv = reduce_fn(sl->data, sl->data + h->value_offset,
+						udata);
+
+				if (rv == CF_OHASH_REDUCE_DELETE) {
+					// Look at slot i again - a later element may now be here.
+					delete_at(h, st, i);
+					continue;
+				}
+
+				if (rv != CF_OHASH_OK) {
+					pthread_mutex_unlock(&st->lock);
+					return rv;
+				}
+			}
+
+			i = (i + 1) & mask;
+			n_left--;
+		}
+
+		pthread_mutex_unlock(&st->lock);
+	}
+
+	return CF_OHASH_OK;
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+static int
+find(const cf_ohash *h, const stripe *st, uint32_t hash, const void *key)
+{
+	uint32_t mask = st->n_slots - 1;
+	uint32_t i = hash & mask;
+
+	while (true) {
+		const slot *sl = slot_at(h, st, i);
+
+		if (! sl->in_use) {
+			return -1;
+		}
+
+		if (sl->hash == hash && memcmp(sl->data, key, h->key_size) == 0) {
+			return (int)i;
+		}
+
+		i = (i + 1) & mask;
+	}
+}
+
+static int
+insert(cf_ohash *h, stripe *st, uint32_t hash, const void *key,
+		const void *value)
+{
+	if ((st->n_elements + 1) * 4 > st->n_slots * 3 && ! grow(h, st)) {
+		return CF_OHASH_ERR;
+	}
+
+	uint32_t mask = st->n_slots - 1;
+	uint32_t i = hash & mask;
+	slot *sl;
+
+	while ((sl = slot_at(h, st, i))->in_use) {
+		i = (i + 1) & mask;
+	}
+
+	sl->hash = hash;
+	sl->in_use = 1;
+	memcpy(sl->data, key, h->key_size);
+	memcpy(sl->data + h->value_offset, value, h->value_size);
+
+	st->n_elements++;
+
+	return CF_OHASH_OK;
+}
+
+static bool
+grow(cf_ohash *h, stripe *st)
+{
+	uint32_t n_slots = st->n_slots * 2;
+	size_t sz = (size_t)n_slots * h->slot_size;
+	uint8_t *slots = cf_malloc(sz);
+
+	if (! slots) {
+		return false;
+	}
+
+	memset(slots, 0, sz);
+
+	stripe old = *st;
+
+	st->n_slots = n_slots;
+	st->slots = slots;
+
+	uint32_t mask = n_slots - 1;
+
+	for (uint32_t i = 0; i < old.n_slots; i++) {
+		slot *from = slot_at(h, &old, i);
+
+		if (! from->in_use) {
+			continue;
+		}
+
+		uint32_t j = from->hash & mask;
+
+		while (slot_at(h, st, j)->in_use) {
+			j = (j + 1) & mask;
+		}
+
+		memcpy(slot_at(h, st, j), from, h->slot_size);
+	}
+
+	cf_free(old.slots);
+
+	return true;
+}
+
+// Backward-shift delete - pull later elements of the cluster into the hole if
+// that doesn't put them before their home slot.
+static void
+delete_at(cf_ohash *h, stripe *st, uint32_t i)
+{
+	uint32_t mask = st->n_slots - 1;
+	uint32_t j = i;
+
+	while (true) {
+		j = (j + 1) & mask;
+
+		slot *sl = slot_at(h, st, j);
+
+		if (! sl->in_use) {
+			break;
+		}
+
+		uint32_t home = sl->hash & mask;
+
+		// Can move unless home is cyclically in (i, j].
+		bool stays = i <= j ?
+				home > i && home <= j :
+				home > i || home <= j;
+
+		if (! stays) {
+			memcpy(slot_at(h, st, i), sl, h->slot_size);
+			i = j;
+		}
+	}
+
+	slot_at(h, st, i)->in_use = 0;
+	st->n_elements--;
+}
@@ -51,12 +51,26 @@ olock *g_record_locks;
 
 #define OLOCK_HASH(__ol, __d) ( ( (__d->digest[2] << 8) | (__d->digest[3]) ) & __ol->mask )
 
+// Uncontended path costs the same as a plain lock - only when the trylock
+// fails do we count (atomically, since we don't hold the lock) and block.
+static inline int
+olock_acquire(olock *ol, uint32_t n)
+{
+	if (pthread_mutex_trylock(&ol->locks[n]) == 0) {
+		return 0;
+	}
+
+	__sync_fetch_and_add(&ol->contended[n], 1);
+
+	return pthread_mutex_lock(&ol->locks[n]);
+}
+
 void
 olock_lock(olock *ol, cf_digest *d)
 {
 	uint32_t n = OLOCK_HASH(ol, d);
 
-	pthread_mutex_lock(&ol->locks[n]);
+	olock_acquire(ol, n);
 }
 
 void
@@ -66,7 +80,7 @@ olock_vlock(olock *ol, cf_digest *d, pthread_mutex_t **vlock)
 
 	*vlock = &ol->locks[n];
 
-	if (0 != pthread_mutex_lock(*vlock)) {
+	if (0 != olock_acquire(ol, n)) {
 		fprintf(stderr, "olock vlock failed\n");
 	}
 }
@@ -81,34 +95,48 @@ olock_unlock(olock *ol, cf_digest *d)
 	}
 }
 
+// If adaptive, locks spin briefly before parking the thread - good when
+// critical sections are short and contention is occasional.
 olock *
-olock_create(uint32_t n_locks, bool mutex)
+olock_create(uint32_t n_locks, bool adaptive)
 {
+	uint32_t mask = n_locks - 1;
+
+	if (n_locks == 0 || n_locks > OLOCK_MAX_LOCKS || (mask & n_locks) != 0) {
+		fprintf(stderr, "olock: number of locks %u must be a power of 2 no more than %u\n", n_locks, OLOCK_MAX_LOCKS);
+		return 0;
+	}
+
 	olock *ol = cf_malloc(sizeof(olock) + (sizeof(pthread_mutex_t) * n_locks));
 
 	if (! ol) {
 		return 0;
 	}
 
-	uint32_t mask = n_locks - 1;
+	ol->contended = cf_calloc(n_locks, sizeof(uint64_t));
 
-	if ((mask & n_locks) != 0) {
-		fprintf(stderr, "olock: make sure your number of locks is a power of 2, n_locks aint\n");
+	if (! ol->contended) {
+		cf_free(ol);
 		return 0;
 	}
 
 	ol->n_locks = n_locks;
 	ol->mask = mask;
 
+	pthread_mutexattr_t attr;
+
+	pthread_mutexattr_init(&attr);
+
+	if (adaptive) {
+		pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ADAPTIVE_NP);
+	}
+
 	for (int i = 0; i < n_locks; i++) {
-		if (mutex) {
-			pthread_mutex_init(&ol->locks[i], 0);
-		}
-		else {
-			fprintf(stderr, "olock: todo add reader writer locks\n");
-		}
+		pthread_mutex_init(&ol->locks[i], &attr);
 	}
 
+	pthread_mutexattr_destroy(&attr);
+
 	return ol;
 }
 
@@ -119,5 +147,45 @@ olock_destroy(olock *ol)
 		pthread_mutex_destroy(&ol->locks[i]);
 	}
 
+	cf_free(ol->contended);
 	cf_free(ol);
 }
+
+// Returns total contended acquisitions. Optionally returns the worst lock's
+// count, and how many locks saw more than 4x their fair share - stripes that
+// are likely shared by hot keys.
+uint64_t
+olock_contended(olock *ol, uint64_t *p_max, uint32_t *p_n_hot)
+{
+	uint64_t total = 0;
+	uint64_t max = 0;
+
+	for (uint32_t i = 0; i < ol->n_locks; i++) {
+		uint64_t n = ol->contended[i];
+
+		total += n;
+
+		if (n > max) {
+			max = n;
+		}
+	}
+
+	if (p_max) {
+		*p_max = max;
+	}
+
+	if (p_n_hot) {
+		uint64_t hot = (total * 4) / ol->n_locks;
+		uint32_t n_hot = 0;
+
+		for (uint32_t i = 0; i < ol->n_locks; i++) {
+			if (ol->contended[i] > hot && ol->contended[i] != 0) {
+				n_hot++;
+			}
+		}
+
+		*p_n_hot = n_hot;
+	}
+
+	return total;
+}
@@ -0,0 +1,467 @@
+/*
+ * ring_queue.c
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/* SYNOPSIS
+ * Bounded MPMC ring - each cell carries a sequence number which tells
+ * producers and consumers whether the cell is theirs for the position they
+ * claimed, so positions are claimed by CAS and no lock is ever taken while
+ * the ring has room and elements.
+ *
+ * A full ring spills to a locked cf_queue, so pushes never fail or block -
+ * important since consumers of some queues (e.g. transaction queues) also
+ * push to them. While anything is in the overflow, pushes keep going there,
+ * so ring elements are always older than overflow elements - the ring drains
+ * first, then the overflow in order, and only then does the ring take pushes
+ * again. Consumers with nothing to pop spin for a while, then sleep.
+ * Producers only take the sleep lock when someone is actually sleeping.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "ring_queue.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "citrusleaf/alloc.h"
+#include "citrusleaf/cf_atomic.h"
+#include "citrusleaf/cf_clock.h"
+#include "citrusleaf/cf_queue.h"
+
+#include "fault.h"
+#include "hist.h"
+
+
+//==========================================================
+// Constants.
+//
+
+#define MIN_CAPACITY	16
+#define MIN_SPIN		64
+#define MAX_SPIN		(1024 * 16)
+
+
+//==========================================================
+// Typedefs.
+//
+
+typedef struct ring_cell_s {
+	cf_atomic64		seq;
+	uint64_t		enq_ns;		// only set if the queue has a histogram
+	uint8_t			data[];
+} ring_cell;
+
+struct cf_ring_queue_s {
+	// Read-mostly.
+	uint8_t			*cells;
+	uint32_t		element_sz;
+	uint32_t		cell_sz;
+	uint64_t		mask;
+	histogram		*wait_hist;
+
+	cf_queue		*overflow;	// elements are enq_ns + data
+	cf_atomic32		n_overflow;
+
+	pthread_mutex_t	sleep_lock;
+	pthread_cond_t	sleep_cond;
+	cf_atomic32		n_sleepers;
+	uint32_t		spin_limit;	// adaptive, racy updates are harmless
+
+	// Separate cache lines for the two hot positions.
+	cf_atomic64		enqueue_pos __attribute__ ((aligned(64)));
+	cf_atomic64		dequeue_pos __attribute__ ((aligned(64)));
+};
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static void push_overflow(cf_ring_queue *q, const void *element, uint64_t enq_ns);
+static bool pop_one(cf_ring_queue *q, void *element);
+static bool pop_ring(cf_ring_queue *q, void *element);
+static bool pop_overflow(cf_ring_queue *q, void *element);
+static bool spin_pop(cf_ring_queue *q, void *element);
+static bool sleep_pop(cf_ring_queue *q, void *element, int ms_wait);
+
+static inline ring_cell*
+get_cell(cf_ring_queue *q, uint64_t pos)
+{
+	return (ring_cell*)(q->cells + (pos & q->mask) * q->cell_sz);
+}
+
+static inline void
+cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__asm__ __volatile__ ("pause" ::: "memory");
+#else
+	cf_compiler_barrier();
+#endif
+}
+
+
+//==========================================================
+// Public API.
+//
+
+// Capacity is rounded up to a power of 2.
+cf_ring_queue *
+cf_ring_queue_create(uint32_t element_sz, uint32_t capacity)
+{
+	cf_ring_queue *q = cf_malloc(sizeof(cf_ring_queue));
+
+	if (! q) {
+		return NULL;
+	}
+
+	memset(q, 0, sizeof(cf_ring_queue));
+
+	uint32_t n_cells = MIN_CAPACITY;
+
+	while (n_cells < capacity) {
+		n_cells <<= 1;
+	}
+
+	q->element_sz = element_sz;
+	q->cell_sz = (sizeof(ring_cell) + element_sz + 7) & ~7;
+	q->mask = n_cells - 1;
+	q->cells = cf_malloc((size_t)n_cells * q->cell_sz);
+
+	if (! q->cells) {
+		cf_free(q);
+		return NULL;
+	}
+
+	q->overflow = cf_queue_create(sizeof(uint64_t) + element_sz, true);
+
+	if (! q->overflow) {
+		cf_free(q->cells);
+		cf_free(q);
+		return NULL;
+	}
+
+	for (uint64_t i = 0; i < n_cells; i++) {
+		get_cell(q, i)->seq = i;
+	}
+
+	pthread_mutex_init(&q->sleep_lock, NULL);
+	pthread_cond_init(&q->sleep_cond, NULL);
+	q->spin_limit = MIN_SPIN;
+
+	return q;
+}
+
+
+void
+cf_ring_queue_destroy(cf_ring_queue *q)
+{
+	cf_queue_destroy(q->overflow);
+	pthread_cond_destroy(&q->sleep_cond);
+	pthread_mutex_destroy(&q->sleep_lock);
+	cf_free(q->cells);
+	cf_free(q);
+}
+
+
+// Set before use - records time spent queued by each popped element.
+void
+cf_ring_queue_set_hist(cf_ring_queue *q, histogram *wait_hist)
+{
+	q->wait_hist = wait_hist;
+}
+
+
+void
+cf_ring_queue_push(cf_ring_queue *q, const void *element)
+{
+	uint64_t enq_ns = q->wait_hist ? cf_getns() : 0;
+	uint64_t pos = cf_atomic64_get(q->enqueue_pos);
+	ring_cell *cell;
+
+	// Don't overtake elements already spilled - keeps the queue FIFO.
+	if (cf_atomic32_get(q->n_overflow) != 0) {
+		push_overflow(q, element, enq_ns);
+		goto Signal;
+	}
+
+	while (true) {
+		cell = get_cell(q, pos);
+
+		int64_t diff = (int64_t)cf_atomic64_get(cell->seq) - (int64_t)pos;
+
+		if (diff == 0) {
+			if (cf_atomic64_cas(&q->enqueue_pos, pos, pos + 1) == pos) {
+				break;
+			}
+
+			pos = cf_atomic64_get(q->enqueue_pos);
+		}
+		else if (diff < 0) {
+			// Ring is full - spill.
+			push_overflow(q, element, enq_ns);
+			cell = NULL;
+			break;
+		}
+		else {
+			pos = cf_atomic64_get(q->enqueue_pos);
+		}
+	}
+
+	if (cell) {
+		cell->enq_ns = enq_ns;
+		memcpy(cell->data, element, q->element_sz);
+		CF_MEMORY_BARRIER_WRITE();
+		cf_atomic64_set(&cell->seq, pos + 1);
+	}
+
+Signal:
+	// Pairs with the sleeper's increment-then-recheck.
+	CF_MEMORY_BARRIER();
+
+	if (cf_atomic32_get(q->n_sleepers) != 0) {
+		pthread_mutex_lock(&q->sleep_lock);
+		pthread_cond_signal(&q->sleep_cond);
+		pthread_mutex_unlock(&q->sleep_lock);
+	}
+}
+
+
+// Returns CF_RING_QUEUE_OK or CF_RING_QUEUE_EMPTY (on timeout). Pass
+// CF_RING_QUEUE_FOREVER, CF_RING_QUEUE_NOWAIT, or milliseconds.
+int
+cf_ring_queue_pop(cf_ring_queue *q, void *element, int ms_wait)
+{
+	if (pop_one(q, element)) {
+		return CF_RING_QUEUE_OK;
+	}
+
+	if (ms_wait == CF_RING_QUEUE_NOWAIT) {
+		return CF_RING_QUEUE_EMPTY;
+	}
+
+	if (spin_pop(q, element) || sleep_pop(q, element, ms_wait)) {
+		return CF_RING_QUEUE_OK;
+	}
+
+	return CF_RING_QUEUE_EMPTY;
+}
+
+
+// Waits (as for cf_ring_queue_pop()) for the first element only, then takes
+// whatever else is immediately available. Returns the number of elements.
+uint32_t
+cf_ring_queue_pop_batch(cf_ring_queue *q, void *elements, uint32_t max_elements,
+		int ms_wait)
+{
+	if (max_elements == 0 ||
+			cf_ring_queue_pop(q, elements, ms_wait) != CF_RING_QUEUE_OK) {
+		return 0;
+	}
+
+	uint8_t *at = (uint8_t*)elements + q->element_sz;
+	uint32_t n = 1;
+
+	while (n < max_elements && pop_one(q, at)) {
+		at += q->element_sz;
+		n++;
+	}
+
+	return n;
+}
+
+
+// Approximate if there are concurrent pushes and pops.
+int
+cf_ring_queue_sz(cf_ring_queue *q)
+{
+	uint64_t dequeue_pos = cf_atomic64_get(q->dequeue_pos);
+	uint64_t enqueue_pos = cf_atomic64_get(q->enqueue_pos);
+	int sz = enqueue_pos > dequeue_pos ? (int)(enqueue_pos - dequeue_pos) : 0;
+
+	return sz + (int)cf_atomic32_get(q->n_overflow);
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+static void
+push_overflow(cf_ring_queue *q, const void *element, uint64_t enq_ns)
+{
+	uint8_t buf[sizeof(uint64_t) + q->element_sz];
+
+	*(uint64_t*)buf = enq_ns;
+	memcpy(buf + sizeof(uint64_t), element, q->element_sz);
+
+	cf_atomic32_incr(&q->n_overflow);
+	cf_queue_push(q->overflow, buf);
+}
+
+
+static bool
+pop_one(cf_ring_queue *q, void *element)
+{
+	// Ring first - its elements are all older than any in the overflow.
+	return pop_ring(q, element) ||
+			(cf_atomic32_get(q->n_overflow) != 0 && pop_overflow(q, element));
+}
+
+
+static bool
+pop_ring(cf_ring_queue *q, void *element)
+{
+	uint64_t pos = cf_atomic64_get(q->dequeue_pos);
+	ring_cell *cell;
+
+	while (true) {
+		cell = get_cell(q, pos);
+
+		int64_t diff = (int64_t)cf_atomic64_get(cell->seq) - (int64_t)(pos + 1);
+
+		if (diff == 0) {
+			if (cf_atomic64_cas(&q->dequeue_pos, pos, pos + 1) == pos) {
+				break;
+			}
+
+			pos = cf_atomic64_get(q->dequeue_pos);
+		}
+		else if (diff < 0) {
+			return false; // empty
+		}
+		else {
+			pos = cf_atomic64_get(q->dequeue_pos);
+		}
+	}
+
+	CF_MEMORY_BARRIER_READ();
+
+	uint64_t enq_ns = cell->enq_ns;
+
+	memcpy(element, cell->data, q->element_sz);
+
+	// Don't let the producer of the next lap overwrite before we've copied.
+	CF_MEMORY_BARRIER();
+	cf_atomic64_set(&cell->seq, pos + q->mask + 1);
+
+	if (q->wait_hist && enq_ns != 0) {
+		histogram_insert_data_point(q->wait_hist, enq_ns);
+	}
+
+	return true;
+}
+
+
+static bool
+pop_overflow(cf_ring_queue *q, void *element)
+{
+	uint8_t buf[sizeof(uint64_t) + q->element_sz];
+
+	if (cf_queue_pop(q->overflow, buf, CF_QUEUE_NOWAIT) != CF_QUEUE_OK) {
+		return false;
+	}
+
+	cf_atomic32_decr(&q->n_overflow);
+	memcpy(element, buf + sizeof(uint64_t), q->element_sz);
+
+	uint64_t enq_ns = *(uint64_t*)buf;
+
+	if (q->wait_hist && enq_ns != 0) {
+		histogram_insert_data_point(q->wait_hist, enq_ns);
+	}
+
+	return true;
+}
+
+
+// Spin while elements are arriving quickly enough to pay for it - the limit
+// grows when spinning finds something, and shrinks when it doesn't.
+static bool
+spin_pop(cf_ring_queue *q, void *element)
+{
+	uint32_t spin_limit = q->spin_limit;
+
+	for (uint32_t i = 0; i < spin_limit; i++) {
+		cpu_relax();
+
+		if (pop_one(q, element)) {
+			if (spin_limit < MAX_SPIN) {
+				q->spin_limit = spin_limit * 2;
+			}
+
+			return true;
+		}
+	}
+
+	if (spin_limit > MIN_SPIN) {
+		q->spin_limit = spin_limit / 2;
+	}
+
+	return false;
+}
+
+
+static bool
+sleep_pop(cf_ring_queue *q, void *element, int ms_wait)
+{
+	struct timespec deadline;
+
+	if (ms_wait > 0) {
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += ms_wait / 1000;
+		deadline.tv_nsec += (ms_wait % 1000) * 1000000;
+
+		if (deadline.tv_nsec >= 1000000000) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+	}
+
+	bool popped = false;
+
+	pthread_mutex_lock(&q->sleep_lock);
+	cf_atomic32_incr(&q->n_sleepers);
+
+	while (! (popped = pop_one(q, element))) {
+		if (ms_wait < 0) {
+			pthread_cond_wait(&q->sleep_cond, &q->sleep_lock);
+		}
+		else if (pthread_cond_timedwait(&q->sleep_cond, &q->sleep_lock,
+				&deadline) == ETIMEDOUT) {
+			popped = pop_one(q, element);
+			break;
+		}
+	}
+
+	cf_atomic32_decr(&q->n_sleepers);
+	pthread_mutex_unlock(&q->sleep_lock);
+
+	return popped;
+}
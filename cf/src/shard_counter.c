@@ -0,0 +1,47 @@
+/*
+ * shard_counter.c
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+#include "shard_counter.h"
+
+#include <stdint.h>
+
+#include "citrusleaf/cf_atomic.h"
+
+
+__thread uint32_t g_shard_counter_slot = 0;
+
+static cf_atomic32 g_n_slots_assigned = 0;
+
+// Hand out slots round-robin, skipping 0 so it can mean "not assigned".
+uint32_t
+cf_shard_counter_assign_slot()
+{
+	uint32_t slot;
+
+	do {
+		slot = cf_atomic32_incr(&g_n_slots_assigned);
+	} while (slot == 0);
+
+	g_shard_counter_slot = slot;
+
+	return slot;
+}
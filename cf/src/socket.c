@@ -46,6 +46,7 @@
 #include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 #include "fault.h"
 
@@ -473,6 +474,11 @@ cf_socket_init_server(cf_socket_cfg *conf)
 		safe_setsockopt(sock->fd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
 	}
 
+	if (conf->reuse_port) {
+		static const int32_t flag = 1;
+		safe_setsockopt(sock->fd, SOL_SOCKET, SO_REUSEPORT, &flag, sizeof(flag));
+	}
+
 	while (bind(sock->fd, (struct sockaddr *)&sas,
 			cf_socket_addr_len((struct sockaddr *)&sas)) < 0) {
 		if (errno != EADDRINUSE) {
@@ -783,6 +789,24 @@ cf_socket_send(cf_socket *sock, void *buff, size_t size, int32_t flags)
 	return cf_socket_send_to(sock, buff, size, flags, NULL);
 }
 
+int32_t
+cf_socket_send_iov(cf_socket *sock, struct iovec *iov, uint32_t n_iov, int32_t flags)
+{
+	struct msghdr msg = {
+		.msg_iov = iov,
+		.msg_iovlen = n_iov
+	};
+
+	int32_t res = sendmsg(sock->fd, &msg, flags | MSG_NOSIGNAL);
+
+	if (res < 0) {
+		cf_debug(CF_SOCKET, "Error while sending on FD %d: %d (%s)",
+				sock->fd, errno, cf_strerror(errno));
+	}
+
+	return res;
+}
+
 int32_t
 cf_socket_recv_from(cf_socket *sock, void *buff, size_t size, int32_t flags, cf_sock_addr *addr)
 {
@@ -0,0 +1,316 @@
+/*
+ * timer_wheel.c
+ *
+ * Copyright (C) 2016 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+/* SYNOPSIS
+ * Four-level wheel, in the style of the classic kernel timer wheel. Level 0
+ * has a slot per tick for the next TW_L0_SLOTS ticks, and each level above
+ * has TW_LN_SLOTS slots, each spanning a whole turn of the level below. As
+ * level 0 completes a turn, the next slot of level 1 is cascaded - its timers
+ * re-added, now landing lower - and so on up.
+ *
+ * Slots are arrays of entries - the expiry tick followed by the key. Deadlines
+ * beyond the wheel's range are clamped, so such timers expire early.
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "timer_wheel.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "citrusleaf/alloc.h"
+#include "citrusleaf/cf_clock.h"
+
+#include "fault.h"
+
+
+//==========================================================
+// Constants.
+//
+
+#define TW_L0_BITS		8
+#define TW_L0_SLOTS		(1 << TW_L0_BITS)
+#define TW_L0_MASK		(TW_L0_SLOTS - 1)
+
+#define TW_LN_BITS		6
+#define TW_LN_SLOTS		(1 << TW_LN_BITS)
+#define TW_LN_MASK		(TW_LN_SLOTS - 1)
+
+#define TW_N_UPPER		3
+#define TW_MAX_DELTA	(1UL << (TW_L0_BITS + (TW_N_UPPER * TW_LN_BITS)))
+
+#define TW_MIN_CAPACITY	8
+
+
+//==========================================================
+// Typedefs.
+//
+
+typedef struct tw_slot_s {
+	uint8_t		*entries;
+	uint32_t	n_entries;
+	uint32_t	capacity;
+} tw_slot;
+
+struct cf_timer_wheel_s {
+	pthread_mutex_t	lock;
+	uint32_t		key_sz;
+	uint32_t		entry_sz;	// expiry tick + key
+	uint32_t		tick_ms;
+	uint64_t		cur_tick;	// next tick to expire
+	tw_slot			l0[TW_L0_SLOTS];
+	tw_slot			ln[TW_N_UPPER][TW_LN_SLOTS];
+};
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static void add_lockfree(cf_timer_wheel *tw, uint64_t tick, const void *key);
+static void cascade(cf_timer_wheel *tw, tw_slot *slot);
+static uint8_t *slot_append(cf_timer_wheel *tw, tw_slot *slot, uint32_t n_entries);
+static void slot_free(tw_slot *slot);
+
+static inline uint64_t
+entry_tick(const uint8_t *entry)
+{
+	return *(const uint64_t*)entry;
+}
+
+
+//==========================================================
+// Public API.
+//
+
+cf_timer_wheel *
+cf_timer_wheel_create(uint32_t key_sz, uint32_t tick_ms)
+{
+	cf_timer_wheel *tw = cf_malloc(sizeof(cf_timer_wheel));
+
+	if (! tw) {
+		return NULL;
+	}
+
+	memset(tw, 0, sizeof(cf_timer_wheel));
+	pthread_mutex_init(&tw->lock, NULL);
+
+	tw->key_sz = key_sz;
+	tw->entry_sz = (uint32_t)sizeof(uint64_t) + key_sz;
+	tw->tick_ms = tick_ms;
+	tw->cur_tick = cf_getms() / tick_ms;
+
+	return tw;
+}
+
+
+void
+cf_timer_wheel_destroy(cf_timer_wheel *tw)
+{
+	for (uint32_t i = 0; i < TW_L0_SLOTS; i++) {
+		slot_free(&tw->l0[i]);
+	}
+
+	for (uint32_t l = 0; l < TW_N_UPPER; l++) {
+		for (uint32_t i = 0; i < TW_LN_SLOTS; i++) {
+			slot_free(&tw->ln[l][i]);
+		}
+	}
+
+	pthread_mutex_destroy(&tw->lock);
+	cf_free(tw);
+}
+
+
+// The timer expires at the first cf_timer_wheel_expire() call whose now_ms is
+// at or after deadline_ms, to within a tick.
+void
+cf_timer_wheel_add(cf_timer_wheel *tw, const void *key, uint64_t deadline_ms)
+{
+	// Round up, so a timer never expires before its deadline.
+	uint64_t tick = (deadline_ms + tw->tick_ms - 1) / tw->tick_ms;
+
+	pthread_mutex_lock(&tw->lock);
+	add_lockfree(tw, tick, key);
+	pthread_mutex_unlock(&tw->lock);
+}
+
+
+// Expire all timers due by now_ms, making callbacks outside the lock. Returns
+// the number expired. Only one thread should expire a given wheel.
+uint32_t
+cf_timer_wheel_expire(cf_timer_wheel *tw, uint64_t now_ms,
+		cf_timer_wheel_fn cb, void *udata)
+{
+	uint64_t now_tick = now_ms / tw->tick_ms;
+	tw_slot due = { NULL, 0, 0 };
+
+	pthread_mutex_lock(&tw->lock);
+
+	while (tw->cur_tick <= now_tick) {
+		uint32_t index = (uint32_t)(tw->cur_tick & TW_L0_MASK);
+
+		// Level 0 is starting a turn - cascade upper levels as they turn too.
+		if (index == 0) {
+			for (uint32_t l = 0; l < TW_N_UPPER; l++) {
+				uint32_t l_index = (uint32_t)((tw->cur_tick >>
+						(TW_L0_BITS + (l * TW_LN_BITS))) & TW_LN_MASK);
+
+				cascade(tw, &tw->ln[l][l_index]);
+
+				if (l_index != 0) {
+					break;
+				}
+			}
+		}
+
+		tw_slot *slot = &tw->l0[index];
+
+		if (! due.entries) {
+			due = *slot;
+			memset(slot, 0, sizeof(tw_slot));
+		}
+		else if (slot->n_entries != 0) {
+			memcpy(slot_append(tw, &due, slot->n_entries), slot->entries,
+					slot->n_entries * tw->entry_sz);
+			slot_free(slot);
+		}
+
+		tw->cur_tick++;
+	}
+
+	pthread_mutex_unlock(&tw->lock);
+
+	uint32_t n_expired = due.n_entries;
+
+	for (uint32_t i = 0; i < n_expired; i++) {
+		cb(due.entries + (i * tw->entry_sz) + sizeof(uint64_t), udata);
+	}
+
+	slot_free(&due);
+
+	return n_expired;
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+static void
+add_lockfree(cf_timer_wheel *tw, uint64_t tick, const void *key)
+{
+	// Already due - will expire next time.
+	if (tick < tw->cur_tick) {
+		tick = tw->cur_tick;
+	}
+
+	uint64_t delta = tick - tw->cur_tick;
+	tw_slot *slot = NULL;
+
+	if (delta >= TW_MAX_DELTA) {
+		delta = TW_MAX_DELTA - 1;
+		tick = tw->cur_tick + delta;
+	}
+
+	if (delta < TW_L0_SLOTS) {
+		slot = &tw->l0[tick & TW_L0_MASK];
+	}
+	else {
+		for (uint32_t l = 0; l < TW_N_UPPER; l++) {
+			uint32_t shift = TW_L0_BITS + (l * TW_LN_BITS);
+
+			if (delta < (1UL << (shift + TW_LN_BITS))) {
+				slot = &tw->ln[l][(tick >> shift) & TW_LN_MASK];
+				break;
+			}
+		}
+	}
+
+	uint8_t *entry = slot_append(tw, slot, 1);
+
+	*(uint64_t*)entry = tick;
+	memcpy(entry + sizeof(uint64_t), key, tw->key_sz);
+}
+
+
+static void
+cascade(cf_timer_wheel *tw, tw_slot *slot)
+{
+	tw_slot cascading = *slot;
+
+	memset(slot, 0, sizeof(tw_slot));
+
+	for (uint32_t i = 0; i < cascading.n_entries; i++) {
+		const uint8_t *entry = cascading.entries + (i * tw->entry_sz);
+
+		add_lockfree(tw, entry_tick(entry), entry + sizeof(uint64_t));
+	}
+
+	slot_free(&cascading);
+}
+
+
+// Returns where to copy the appended entries.
+static uint8_t *
+slot_append(cf_timer_wheel *tw, tw_slot *slot, uint32_t n_entries)
+{
+	uint32_t n_needed = slot->n_entries + n_entries;
+
+	if (n_needed > slot->capacity) {
+		uint32_t capacity = slot->capacity == 0 ?
+				TW_MIN_CAPACITY : slot->capacity;
+
+		while (capacity < n_needed) {
+			capacity *= 2;
+		}
+
+		uint8_t *resized = cf_realloc(slot->entries, capacity * tw->entry_sz);
+
+		cf_assert(resized, CF_MISC, CF_CRITICAL, "failed timer wheel realloc");
+
+		slot->entries = resized;
+		slot->capacity = capacity;
+	}
+
+	uint8_t *entry = slot->entries + (slot->n_entries * tw->entry_sz);
+
+	slot->n_entries = n_needed;
+
+	return entry;
+}
+
+
+static void
+slot_free(tw_slot *slot)
+{
+	if (slot->entries) {
+		cf_free(slot->entries);
+	}
+
+	memset(slot, 0, sizeof(tw_slot));
+}
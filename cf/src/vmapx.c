@@ -34,6 +34,7 @@
 #include <string.h>
 
 #include "citrusleaf/alloc.h"
+#include "citrusleaf/cf_atomic.h"
 
 #include "util.h"
 
@@ -87,6 +88,40 @@ cf_vmapx_create(cf_vmapx* this, uint32_t value_size, uint32_t max_count,
 	return CF_VMAPX_OK;
 }
 
+//------------------------------------------------
+// Resume a cf_vmapx object persisted by a previous
+// run - rebuild the (process memory) hash.
+//
+cf_vmapx_err
+cf_vmapx_resume(cf_vmapx* this, uint32_t value_size, uint32_t max_count,
+		uint32_t hash_size, uint32_t max_name_size)
+{
+	if (this->value_size != value_size || this->max_count != max_count ||
+			this->key_size != max_name_size || this->count > max_count ||
+			hash_size == 0) {
+		return CF_VMAPX_ERR_BAD_PARAM;
+	}
+
+	if (! (this->p_hash = vhash_create(max_name_size, hash_size))) {
+		return CF_VMAPX_ERR_UNKNOWN;
+	}
+
+	for (uint32_t i = 0; i < this->count; i++) {
+		const char* name = (const char*)cf_vmapx_value_ptr(this, i);
+		size_t name_len = strnlen(name, max_name_size);
+
+		if (name_len == max_name_size ||
+				! vhash_put(this->p_hash, name, name_len, i)) {
+			vhash_destroy(this->p_hash);
+			return CF_VMAPX_ERR_UNKNOWN;
+		}
+	}
+
+	pthread_mutex_init(&this->write_lock, 0);
+
+	return CF_VMAPX_OK;
+}
+
 //------------------------------------------------
 // Free internal resources of a cf_vmapx object.
 // Don't call after failed cf_vmapx_create() or
@@ -112,7 +147,12 @@ cf_vmapx_release(cf_vmapx* this)
 uint32_t
 cf_vmapx_count(const cf_vmapx* this)
 {
-	return this->count;
+	uint32_t count = this->count;
+
+	// Pairs with the write barrier before the count is published.
+	CF_MEMORY_BARRIER_READ();
+
+	return count;
 }
 
 //------------------------------------------------
@@ -121,7 +161,7 @@ cf_vmapx_count(const cf_vmapx* this)
 cf_vmapx_err
 cf_vmapx_get_by_index(const cf_vmapx* this, uint32_t index, void** pp_value)
 {
-	if (index >= this->count) {
+	if (index >= cf_vmapx_count(this)) {
 		return CF_VMAPX_ERR_BAD_PARAM;
 	}
 
@@ -237,9 +277,11 @@ cf_vmapx_put_unique_w_len(cf_vmapx* this, const void* p_value, size_t name_len,
 	// In case it wasn't already, null-terminate name within stored value.
 	value_ptr[name_len] = 0;
 
-	// Increment count here so indexes returned by other public API calls (just
-	// after adding to hash below) are guaranteed to be valid.
-	this->count++;
+	// Publish the value before the count - readers take no lock. Increment
+	// count here so indexes returned by other public API calls (just after
+	// adding to hash below) are guaranteed to be valid.
+	CF_MEMORY_BARRIER_WRITE();
+	this->count = count + 1;
 
 	// Add to hash.
 	if (! vhash_put(this->p_hash, value_ptr, name_len, count)) {
@@ -282,13 +324,18 @@ cf_vmapx_value_ptr(const cf_vmapx* this, uint32_t index)
 // - It's thread safe yet lockless. (Relies on cf_vmapx's write_lock.)
 // - Element keys are null-terminated strings.
 // - Element values are uint32_t's.
+//
+// Rows are append-only. A put fills in the element, links it at the row's
+// tail, then publishes it with a release store of the row count. A get loads
+// the row count first, and visits only that many elements - all of which were
+// complete before the count it saw.
 
 struct vhash_s {
 	uint32_t key_size;
 	uint32_t ele_size;
 	uint32_t n_rows;
 	uint8_t* table;
-	uint32_t row_counts[];
+	volatile uint32_t row_counts[];
 };
 
 typedef struct vhash_ele_s {
@@ -369,34 +416,39 @@ vhash_put(vhash* h, const char* zkey, size_t key_len, uint32_t value)
 
 	vhash_ele* e = (vhash_ele*)(h->table + (h->ele_size * row_i));
 
-	if (h->row_counts[row_i] == 0) {
+	uint32_t row_count = h->row_counts[row_i];
+
+	if (row_count == 0) {
 		strcpy(VHASH_ELE_KEY_PTR(e), zkey);
 		*VHASH_ELE_VALUE_PTR(h, e) = value;
-		h->row_counts[row_i]++;
+
+		CF_MEMORY_BARRIER_WRITE();
+		h->row_counts[row_i] = 1;
 
 		return true;
 	}
 
-	vhash_ele* e_head = e;
-
 	// This function is always called under write lock, after get, so we'll
-	// never encounter the key - don't bother checking it.
-	while (e) {
+	// never encounter the key - don't bother checking it. Find the tail -
+	// inserting anywhere else would shift elements out of a concurrent get's
+	// view.
+	while (e->next) {
 		e = e->next;
 	}
 
-	e = (vhash_ele*)cf_malloc(h->ele_size);
+	vhash_ele* e_new = (vhash_ele*)cf_malloc(h->ele_size);
 
-	if (! e) {
+	if (! e_new) {
 		return false;
 	}
 
-	e->next = e_head->next;
-	e_head->next = e;
+	e_new->next = NULL;
+	strcpy(VHASH_ELE_KEY_PTR(e_new), zkey);
+	*VHASH_ELE_VALUE_PTR(h, e_new) = value;
 
-	strcpy(VHASH_ELE_KEY_PTR(e), zkey);
-	*VHASH_ELE_VALUE_PTR(h, e) = value;
-	h->row_counts[row_i]++;
+	CF_MEMORY_BARRIER_WRITE();
+	e->next = e_new;
+	h->row_counts[row_i] = row_count + 1;
 
 	return true;
 }
@@ -416,6 +468,9 @@ vhash_get(const vhash* h, const char* key, size_t key_len, uint32_t* p_value)
 		return false;
 	}
 
+	// Pairs with the write barrier before the row count is published.
+	CF_MEMORY_BARRIER_READ();
+
 	vhash_ele* e = (vhash_ele*)(h->table + (h->ele_size * row_i));
 
 	// Use row count instead of following pointers to the end, for thread